@@ -0,0 +1,637 @@
+/*-------------------------------------------------------------------------
+ *
+ * binary_copy.c
+ *    Routines for passing the rows of COPY ... FROM with binary input
+ *    through to the shards of hash and reference tables.
+ *
+ * A regular COPY parses every column of every row into a datum, only to
+ * serialise the same values again in the COPY format that is sent to the
+ * shards. When the input is already in the binary format and the shards are
+ * sent binary COPY data with the same column types, the input rows are
+ * byte-for-byte the rows that the shards receive. When
+ * citus.enable_binary_copy_passthrough is enabled, such a COPY only splits
+ * the input into rows using the field lengths, decodes the distribution
+ * column to find the shard, and forwards the original bytes of the row.
+ *
+ * The values of the other columns are only checked by the receive functions
+ * on the workers when the shards are written.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include "commands/copy.h"
+#include "commands/defrem.h"
+#include "distributed/commands/binary_copy.h"
+#include "distributed/commands/multi_copy.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/pg_dist_partition.h"
+#include "distributed/transmit.h"
+#include "executor/executor.h"
+#include "libpq/libpq.h"
+#include "mb/pg_wchar.h"
+#include "port/pg_bswap.h"
+#include "storage/fd.h"
+#include "tcop/tcopprot.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+
+
+/* size of the blocks in which the input is read from a file or program */
+#define BINARY_COPY_READ_SIZE (64 * 1024)
+
+/* offset of the unread input after which the read part is discarded */
+#define BINARY_COPY_COMPACT_OFFSET (64 * 1024)
+
+/* length of the signature at the start of binary COPY data */
+#define BINARY_COPY_SIGNATURE_LENGTH 11
+
+/* flag in the header of binary COPY data that marks rows with OIDs */
+#define BINARY_COPY_OIDS_FLAG (1 << 16)
+
+
+/*
+ * BinaryCopyReader reads the binary input of a COPY into a buffer from which
+ * complete rows are taken.
+ */
+typedef struct BinaryCopyReader
+{
+	/* source of the input; copyFile is NULL when reading from the frontend */
+	FILE *copyFile;
+	bool isProgram;
+	char *fileName;
+	StringInfo copyData;
+	bool frontendCopyDone;
+
+	/* input that has been read, the cursor points at the next row */
+	StringInfo inputData;
+
+	/* number of rows read so far, for errors */
+	uint64 rowNumber;
+	char *relationName;
+} BinaryCopyReader;
+
+
+/* config variable managed via guc.c */
+bool EnableBinaryCopyPassthrough = false;
+
+static const char BinaryCopySignature[BINARY_COPY_SIGNATURE_LENGTH] =
+	"PGCOPY\n\377\r\n\0";
+
+
+/* local function forward declarations */
+static bool IsBinaryCopy(CopyStmt *copyStatement);
+static int CopyFieldCount(TupleDesc tupleDescriptor);
+static int PartitionFieldIndex(TupleDesc tupleDescriptor, int partitionColumnIndex);
+static BinaryCopyReader * BeginBinaryCopyRead(CopyStmt *copyStatement,
+											  int fieldCount);
+static void EndBinaryCopyRead(BinaryCopyReader *reader);
+static bool EnsureBinaryInput(BinaryCopyReader *reader, int byteCount);
+static bool ReadBinaryInputBlock(BinaryCopyReader *reader);
+static void ReadBinaryCopyHeader(BinaryCopyReader *reader);
+static int16 PeekInputInt16(BinaryCopyReader *reader, int offset);
+static int32 PeekInputInt32(BinaryCopyReader *reader, int offset);
+static void BinaryCopyErrorCallback(void *arg);
+
+
+/*
+ * CanPassThroughBinaryCopy returns whether the binary input rows of the given
+ * COPY ... FROM can be sent to the shards as they are. This requires the rows
+ * to contain all columns of the table in order, and the receiver to send
+ * binary COPY data in the encoding in which the client sends text values.
+ */
+bool
+CanPassThroughBinaryCopy(CopyStmt *copyStatement, CitusCopyDestReceiver *copyDest)
+{
+	char partitionMethod = copyDest->tableMetadata->partitionMethod;
+
+	if (!EnableBinaryCopyPassthrough || !IsBinaryCopy(copyStatement))
+	{
+		return false;
+	}
+
+	if (partitionMethod != DISTRIBUTE_BY_HASH && partitionMethod != DISTRIBUTE_BY_NONE)
+	{
+		return false;
+	}
+
+	/* the rows are routed to the shards in the format they arrive in */
+	if (copyStatement->attlist != NIL || !copyDest->copyOutState->binary)
+	{
+		return false;
+	}
+
+	/* connections to the workers use the database encoding */
+	if (pg_get_client_encoding() != GetDatabaseEncoding())
+	{
+		return false;
+	}
+
+	/* only the frontend/backend protocol 3 copy sub-protocol is supported */
+	if (copyStatement->filename == NULL &&
+		(whereToSendOutput != DestRemote ||
+		 PG_PROTOCOL_MAJOR(FrontendProtocol) < 3))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * IsBinaryCopy returns whether the given COPY uses the binary format.
+ */
+static bool
+IsBinaryCopy(CopyStmt *copyStatement)
+{
+	ListCell *optionCell = NULL;
+	bool binaryFormat = false;
+
+	foreach(optionCell, copyStatement->options)
+	{
+		DefElem *option = (DefElem *) lfirst(optionCell);
+
+		if (strcmp(option->defname, "format") == 0)
+		{
+			binaryFormat = (strcmp(defGetString(option), "binary") == 0);
+		}
+	}
+
+	return binaryFormat;
+}
+
+
+/*
+ * PassThroughBinaryCopy reads the binary input of the given COPY statement and
+ * sends every row as it is to the shard it belongs to, through the given
+ * receiver which should already be started. The function returns the number
+ * of rows that were copied.
+ */
+uint64
+PassThroughBinaryCopy(CopyStmt *copyStatement, CitusCopyDestReceiver *copyDest)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(copyDest->distributedRelation);
+	int partitionColumnIndex = copyDest->partitionColumnIndex;
+	EState *executorState = copyDest->executorState;
+	MemoryContext executorTupleContext = GetPerTupleMemoryContext(executorState);
+	int partitionFieldIndex = -1;
+	FmgrInfo *receiveFunction = palloc0(sizeof(FmgrInfo));
+	Oid typeIoParam = InvalidOid;
+	int32 typeModifier = -1;
+	ErrorContextCallback errorCallback;
+
+	/* raise errors in the options before starting to read input */
+	ProcessCopyOptions(NULL, NULL, true, copyStatement->options);
+
+	Datum *columnValues = palloc0(tupleDescriptor->natts * sizeof(Datum));
+	bool *columnNulls = palloc0(tupleDescriptor->natts * sizeof(bool));
+	StringInfo partitionValueData = makeStringInfo();
+
+	if (partitionColumnIndex != INVALID_PARTITION_COLUMN_INDEX)
+	{
+		Form_pg_attribute partitionColumn = TupleDescAttr(tupleDescriptor,
+														  partitionColumnIndex);
+		Oid receiveFunctionId = InvalidOid;
+
+		getTypeBinaryInputInfo(partitionColumn->atttypid, &receiveFunctionId,
+							   &typeIoParam);
+		fmgr_info(receiveFunctionId, receiveFunction);
+		typeModifier = partitionColumn->atttypmod;
+
+		partitionFieldIndex = PartitionFieldIndex(tupleDescriptor, partitionColumnIndex);
+	}
+
+	int fieldCount = CopyFieldCount(tupleDescriptor);
+	BinaryCopyReader *reader = BeginBinaryCopyRead(copyStatement, fieldCount);
+	reader->relationName = RelationGetRelationName(copyDest->distributedRelation);
+
+	/* set up callback to identify error row number */
+	errorCallback.callback = BinaryCopyErrorCallback;
+	errorCallback.arg = (void *) reader;
+	errorCallback.previous = error_context_stack;
+	error_context_stack = &errorCallback;
+
+	ReadBinaryCopyHeader(reader);
+
+	while (true)
+	{
+		StringInfo inputData = reader->inputData;
+		bool partitionFieldFound = false;
+		int rowLength = 0;
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (!EnsureBinaryInput(reader, sizeof(int16)))
+		{
+			/* like COPY, accept input that ends without a trailer */
+			break;
+		}
+
+		int16 rowFieldCount = PeekInputInt16(reader, 0);
+		if (rowFieldCount == -1)
+		{
+			break;
+		}
+
+		reader->rowNumber++;
+
+		if (rowFieldCount != fieldCount)
+		{
+			ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+							errmsg("row field count is %d, expected %d",
+								   (int) rowFieldCount, fieldCount)));
+		}
+
+		rowLength = sizeof(int16);
+
+		for (int fieldIndex = 0; fieldIndex < fieldCount; fieldIndex++)
+		{
+			if (!EnsureBinaryInput(reader, rowLength + sizeof(int32)))
+			{
+				ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+								errmsg("unexpected EOF in COPY data")));
+			}
+
+			int32 fieldLength = PeekInputInt32(reader, rowLength);
+			rowLength += sizeof(int32);
+
+			if (fieldLength == -1)
+			{
+				if (fieldIndex == partitionFieldIndex)
+				{
+					columnNulls[partitionColumnIndex] = true;
+				}
+
+				continue;
+			}
+
+			if (fieldLength < 0)
+			{
+				ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+								errmsg("invalid field size")));
+			}
+
+			if (!EnsureBinaryInput(reader, rowLength + fieldLength))
+			{
+				ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+								errmsg("unexpected EOF in COPY data")));
+			}
+
+			if (fieldIndex == partitionFieldIndex)
+			{
+				resetStringInfo(partitionValueData);
+				appendBinaryStringInfo(partitionValueData,
+									   inputData->data + inputData->cursor + rowLength,
+									   fieldLength);
+				partitionFieldFound = true;
+			}
+
+			rowLength += fieldLength;
+		}
+
+		MemoryContext oldContext = MemoryContextSwitchTo(executorTupleContext);
+
+		if (partitionFieldFound)
+		{
+			columnValues[partitionColumnIndex] =
+				ReceiveFunctionCall(receiveFunction, partitionValueData, typeIoParam,
+									typeModifier);
+			columnNulls[partitionColumnIndex] = false;
+		}
+
+		int shardIndex = ShardIndexForTuple(copyDest, columnValues, columnNulls);
+
+		MemoryContextSwitchTo(oldContext);
+
+		CitusSendCopyRowToShardIndex(copyDest, shardIndex,
+									 inputData->data + inputData->cursor, rowLength);
+		inputData->cursor += rowLength;
+
+		ResetPerTupleExprContext(executorState);
+	}
+
+	/* discard the remaining input, like COPY does after the trailer */
+	while (reader->copyFile == NULL && !reader->frontendCopyDone)
+	{
+		resetStringInfo(reader->copyData);
+		reader->frontendCopyDone = ReceiveCopyData(reader->copyData);
+	}
+
+	/* all rows have been copied, stop showing row number in errors */
+	error_context_stack = errorCallback.previous;
+
+	EndBinaryCopyRead(reader);
+
+	return reader->rowNumber;
+}
+
+
+/*
+ * CopyFieldCount returns the number of fields in the binary COPY rows of a
+ * table with the given tuple descriptor. Dropped and generated columns do not
+ * have a field.
+ */
+static int
+CopyFieldCount(TupleDesc tupleDescriptor)
+{
+	return list_length(CopyColumnNameList(tupleDescriptor));
+}
+
+
+/*
+ * PartitionFieldIndex returns the index of the field of the partition column
+ * in the binary COPY rows of a table with the given tuple descriptor.
+ */
+static int
+PartitionFieldIndex(TupleDesc tupleDescriptor, int partitionColumnIndex)
+{
+	int fieldIndex = 0;
+
+	for (int columnIndex = 0; columnIndex < partitionColumnIndex; columnIndex++)
+	{
+		Form_pg_attribute column = TupleDescAttr(tupleDescriptor, columnIndex);
+
+		if (column->attisdropped
+#if PG_VERSION_NUM >= 120000
+			|| column->attgenerated == ATTRIBUTE_GENERATED_STORED
+#endif
+			)
+		{
+			continue;
+		}
+
+		fieldIndex++;
+	}
+
+	return fieldIndex;
+}
+
+
+/*
+ * BeginBinaryCopyRead opens the data source of the given COPY statement, or
+ * starts receiving the input from the frontend.
+ */
+static BinaryCopyReader *
+BeginBinaryCopyRead(CopyStmt *copyStatement, int fieldCount)
+{
+	BinaryCopyReader *reader = palloc0(sizeof(BinaryCopyReader));
+
+	reader->inputData = makeStringInfo();
+	reader->copyData = makeStringInfo();
+	reader->fileName = copyStatement->filename;
+	reader->isProgram = copyStatement->is_program;
+
+	if (copyStatement->filename == NULL)
+	{
+		SendCopyInStart(true, fieldCount);
+	}
+	else if (copyStatement->is_program)
+	{
+		reader->copyFile = OpenPipeStream(copyStatement->filename, PG_BINARY_R);
+		if (reader->copyFile == NULL)
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not execute command \"%s\": %m",
+								   copyStatement->filename)));
+		}
+	}
+	else
+	{
+		reader->copyFile = AllocateFile(copyStatement->filename, PG_BINARY_R);
+		if (reader->copyFile == NULL)
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not open file \"%s\" for reading: %m",
+								   copyStatement->filename)));
+		}
+	}
+
+	return reader;
+}
+
+
+/*
+ * EndBinaryCopyRead closes the data source of the COPY.
+ */
+static void
+EndBinaryCopyRead(BinaryCopyReader *reader)
+{
+	if (reader->copyFile == NULL)
+	{
+		return;
+	}
+
+	if (reader->isProgram)
+	{
+		int closeResult = ClosePipeStream(reader->copyFile);
+		if (closeResult == -1)
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not close pipe to external command: %m")));
+		}
+		else if (closeResult != 0)
+		{
+			ereport(ERROR, (errcode(ERRCODE_EXTERNAL_ROUTINE_EXCEPTION),
+							errmsg("program \"%s\" failed", reader->fileName),
+							errdetail_internal("%s", wait_result_to_str(closeResult))));
+		}
+	}
+	else if (FreeFile(reader->copyFile) != 0)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not close file \"%s\": %m", reader->fileName)));
+	}
+
+	reader->copyFile = NULL;
+}
+
+
+/*
+ * EnsureBinaryInput reads input until at least the given number of bytes
+ * follow the cursor, and returns false if the input ends before that. Offsets
+ * relative to the cursor remain valid, but pointers into the input do not.
+ */
+static bool
+EnsureBinaryInput(BinaryCopyReader *reader, int byteCount)
+{
+	StringInfo inputData = reader->inputData;
+
+	while (inputData->len - inputData->cursor < byteCount)
+	{
+		/* discard the rows that were already sent before reading more */
+		if (inputData->cursor >= BINARY_COPY_COMPACT_OFFSET)
+		{
+			int remainingLength = inputData->len - inputData->cursor;
+
+			memmove(inputData->data, inputData->data + inputData->cursor,
+					remainingLength);
+			inputData->len = remainingLength;
+			inputData->data[inputData->len] = '\0';
+			inputData->cursor = 0;
+		}
+
+		if (!ReadBinaryInputBlock(reader))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * ReadBinaryInputBlock appends the next block of input to the input buffer,
+ * and returns false if the input ended.
+ */
+static bool
+ReadBinaryInputBlock(BinaryCopyReader *reader)
+{
+	StringInfo inputData = reader->inputData;
+
+	if (reader->copyFile != NULL)
+	{
+		enlargeStringInfo(inputData, BINARY_COPY_READ_SIZE);
+
+		size_t bytesRead = fread(inputData->data + inputData->len, 1,
+								 BINARY_COPY_READ_SIZE, reader->copyFile);
+		if (ferror(reader->copyFile))
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not read from COPY file: %m")));
+		}
+
+		inputData->len += bytesRead;
+		inputData->data[inputData->len] = '\0';
+
+		return bytesRead > 0;
+	}
+
+	while (!reader->frontendCopyDone)
+	{
+		StringInfo copyData = reader->copyData;
+
+		resetStringInfo(copyData);
+		reader->frontendCopyDone = ReceiveCopyData(copyData);
+
+		if (copyData->len > 0)
+		{
+			appendBinaryStringInfo(inputData, copyData->data, copyData->len);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * ReadBinaryCopyHeader checks the header of the binary COPY input and moves
+ * the cursor past it, such that it points at the first row.
+ */
+static void
+ReadBinaryCopyHeader(BinaryCopyReader *reader)
+{
+	StringInfo inputData = reader->inputData;
+	int headerLength = BINARY_COPY_SIGNATURE_LENGTH;
+
+	if (!EnsureBinaryInput(reader, headerLength) ||
+		memcmp(inputData->data + inputData->cursor, BinaryCopySignature,
+			   BINARY_COPY_SIGNATURE_LENGTH) != 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("COPY file signature not recognized")));
+	}
+
+	if (!EnsureBinaryInput(reader, headerLength + sizeof(int32)))
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("invalid COPY file header (missing flags)")));
+	}
+
+	int32 flags = PeekInputInt32(reader, headerLength);
+	headerLength += sizeof(int32);
+
+	if ((flags & BINARY_COPY_OIDS_FLAG) != 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("invalid COPY file header (WITH OIDS)")));
+	}
+
+	flags &= ~BINARY_COPY_OIDS_FLAG;
+	if ((flags >> 16) != 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("unrecognized critical flags in COPY file header")));
+	}
+
+	if (!EnsureBinaryInput(reader, headerLength + sizeof(int32)))
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("invalid COPY file header (missing length)")));
+	}
+
+	int32 extensionLength = PeekInputInt32(reader, headerLength);
+	headerLength += sizeof(int32);
+
+	if (extensionLength < 0 ||
+		!EnsureBinaryInput(reader, headerLength + extensionLength))
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("invalid COPY file header (wrong length)")));
+	}
+
+	inputData->cursor += headerLength + extensionLength;
+}
+
+
+/*
+ * PeekInputInt16 returns the network byte order int16 at the given offset
+ * from the cursor, which the caller should have made sure was read.
+ */
+static int16
+PeekInputInt16(BinaryCopyReader *reader, int offset)
+{
+	StringInfo inputData = reader->inputData;
+	uint16 value = 0;
+
+	memcpy(&value, inputData->data + inputData->cursor + offset, sizeof(value));
+
+	return (int16) pg_ntoh16(value);
+}
+
+
+/*
+ * PeekInputInt32 returns the network byte order int32 at the given offset
+ * from the cursor, which the caller should have made sure was read.
+ */
+static int32
+PeekInputInt32(BinaryCopyReader *reader, int offset)
+{
+	StringInfo inputData = reader->inputData;
+	uint32 value = 0;
+
+	memcpy(&value, inputData->data + inputData->cursor + offset, sizeof(value));
+
+	return (int32) pg_ntoh32(value);
+}
+
+
+/*
+ * BinaryCopyErrorCallback adds the row that was being read to errors that
+ * are raised while passing the input through.
+ */
+static void
+BinaryCopyErrorCallback(void *arg)
+{
+	BinaryCopyReader *reader = (BinaryCopyReader *) arg;
+
+	errcontext("COPY %s, line " UINT64_FORMAT, reader->relationName,
+			   reader->rowNumber);
+}
@@ -17,6 +17,9 @@
 #include "access/htup.h"
 #include "access/htup_details.h"
 #include "access/nbtree.h"
+#if PG_VERSION_NUM >= 120000
+#include "access/tableam.h"
+#endif
 #include "access/xact.h"
 #include "catalog/dependency.h"
 #include "catalog/index.h"
@@ -33,6 +36,8 @@
 #include "commands/extension.h"
 #include "commands/trigger.h"
 #include "distributed/commands/multi_copy.h"
+#include "distributed/commands/parallel_copy.h"
+#include "distributed/commands/utility_hook.h"
 #include "distributed/citus_ruleutils.h"
 #include "distributed/colocation_utils.h"
 #include "distributed/commands.h"
@@ -99,17 +104,20 @@ static void EnsureLocalTableEmptyIfNecessary(Oid relationId, char distributionMe
 											 bool viaDepracatedAPI);
 static bool LocalTableEmpty(Oid tableId);
 static void CopyLocalDataIntoShards(Oid relationId);
+static uint64 ScanLocalDataIntoShards(Relation distributedRelation,
+									  DestReceiver *copyDest, EState *estate);
 static List * TupleDescColumnNameList(TupleDesc tupleDescriptor);
 static bool RelationUsesIdentityColumns(TupleDesc relationDesc);
 static bool DistributionColumnUsesGeneratedStoredColumn(TupleDesc relationDesc,
 														Var *distributionColumn);
-static bool RelationUsesHeapAccessMethodOrNone(Relation relation);
+static bool RelationUsesSupportedAccessMethod(Relation relation);
 static bool CanUseExclusiveConnections(Oid relationId, bool localTableEmpty);
 
 /* exports for SQL callable functions */
 PG_FUNCTION_INFO_V1(master_create_distributed_table);
 PG_FUNCTION_INFO_V1(create_distributed_table);
 PG_FUNCTION_INFO_V1(create_reference_table);
+PG_FUNCTION_INFO_V1(create_distributed_partitions);
 
 
 /*
@@ -311,6 +319,90 @@ create_reference_table(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * create_distributed_partitions creates partitions with the given names and
+ * bounds of a distributed partitioned table. Creating a partition of a
+ * distributed table distributes it right away, which takes a round trip to
+ * each node per partition. Here, the shards of all partitions are instead
+ * created together, such that each node creates and attaches many shards
+ * per round trip over parallel connections. The partitions are created in
+ * the schema of the partitioned table.
+ */
+Datum
+create_distributed_partitions(PG_FUNCTION_ARGS)
+{
+	Oid parentRelationId = PG_GETARG_OID(0);
+	ArrayType *partitionNameArray = PG_GETARG_ARRAYTYPE_P(1);
+	ArrayType *partitionBoundArray = PG_GETARG_ARRAYTYPE_P(2);
+
+	CheckCitusVersion(ERROR);
+	EnsureCoordinator();
+	EnsureTableOwner(parentRelationId);
+
+	int32 partitionCount = ArrayObjectCount(partitionNameArray);
+	if (ArrayObjectCount(partitionBoundArray) != partitionCount)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("the number of partition names and partition bounds "
+							   "must be equal")));
+	}
+
+	/* creating a partition takes the same lock on the partitioned table */
+	Relation parentRelation = relation_open(parentRelationId, AccessExclusiveLock);
+
+	if (!IsDistributedTable(parentRelationId) || !PartitionedTable(parentRelationId))
+	{
+		char *relationName = get_rel_name(parentRelationId);
+
+		ereport(ERROR, (errcode(ERRCODE_WRONG_OBJECT_TYPE),
+						errmsg("\"%s\" is not a distributed partitioned table",
+							   relationName)));
+	}
+
+	char *schemaName = get_namespace_name(get_rel_namespace(parentRelationId));
+	char *qualifiedParentName = generate_qualified_relation_name(parentRelationId);
+	Datum *partitionNameDatumArray = DeconstructArrayObject(partitionNameArray);
+	Datum *partitionBoundDatumArray = DeconstructArrayObject(partitionBoundArray);
+
+	BeginBatchedShardCreation();
+
+	PG_TRY();
+	{
+		for (int partitionIndex = 0; partitionIndex < partitionCount; partitionIndex++)
+		{
+			char *partitionName =
+				TextDatumGetCString(partitionNameDatumArray[partitionIndex]);
+			char *partitionBound =
+				TextDatumGetCString(partitionBoundDatumArray[partitionIndex]);
+			StringInfo createCommand = makeStringInfo();
+
+			appendStringInfo(createCommand, "CREATE TABLE %s PARTITION OF %s "
+											"FOR VALUES %s",
+							 quote_qualified_identifier(schemaName, partitionName),
+							 qualifiedParentName, partitionBound);
+
+			/* distributes the partition, but defers the creation of its shards */
+			Node *createStatement = ParseTreeNode(createCommand->data);
+			CitusProcessUtility(createStatement, createCommand->data,
+								PROCESS_UTILITY_TOPLEVEL, NULL, None_Receiver, NULL);
+			CommandCounterIncrement();
+		}
+
+		FinishBatchedShardCreation();
+	}
+	PG_CATCH();
+	{
+		AbortBatchedShardCreation();
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	relation_close(parentRelation, NoLock);
+
+	PG_RETURN_VOID();
+}
+
+
 /*
  * CreateDistributedTable creates distributed table in the given configuration.
  * This functions contains all necessary logic to create distributed tables. It
@@ -633,10 +725,13 @@ EnsureRelationCanBeDistributed(Oid relationId, Var *distributionColumn,
 	TupleDesc relationDesc = RelationGetDescr(relation);
 	char *relationName = RelationGetRelationName(relation);
 
-	if (!RelationUsesHeapAccessMethodOrNone(relation))
+	if (!RelationUsesSupportedAccessMethod(relation))
 	{
-		ereport(ERROR, (errmsg(
-							"cannot distribute relations using non-heap access methods")));
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot distribute relation: %s", relationName),
+						errdetail("Distributed relations must use the heap access "
+								  "method or an access method that is created by an "
+								  "extension.")));
 	}
 
 #if PG_VERSION_NUM < 120000
@@ -1169,7 +1264,9 @@ RegularTable(Oid relationId)
  * DestReceiver, but we are in a tricky spot here since Citus is already
  * intercepting queries on this table in the planner and executor hooks and we
  * want to read from the local table. To keep it simple, we perform a heap scan
- * directly on the table.
+ * directly on the table. When citus.max_parallel_copy_workers is set, parallel
+ * workers scan the table and serialise its rows, which are sent to the shards
+ * over the connections of this backend.
  *
  * Any writes on the table that are started during this operation will be handled
  * as distributed queries once the current transaction commits. SELECTs will
@@ -1191,13 +1288,6 @@ CopyLocalDataIntoShards(Oid distributedRelationId)
 	bool stopOnFailure = true;
 
 	EState *estate = NULL;
-#if PG_VERSION_NUM >= 120000
-	TableScanDesc scan = NULL;
-#else
-	HeapScanDesc scan = NULL;
-#endif
-	HeapTuple tuple = NULL;
-	MemoryContext oldContext = NULL;
 	uint64 rowsCopied = 0;
 
 	/* take an ExclusiveLock to block all operations except SELECT */
@@ -1227,8 +1317,6 @@ CopyLocalDataIntoShards(Oid distributedRelationId)
 
 	/* get the table columns */
 	tupleDescriptor = RelationGetDescr(distributedRelation);
-	TupleTableSlot *slot = MakeSingleTupleTableSlotCompat(tupleDescriptor,
-														  &TTSOpsHeapTuple);
 	columnNameList = TupleDescColumnNameList(tupleDescriptor);
 
 	/* determine the partition column in the tuple descriptor */
@@ -1240,19 +1328,79 @@ CopyLocalDataIntoShards(Oid distributedRelationId)
 
 	/* initialise per-tuple memory context */
 	estate = CreateExecutorState();
-	ExprContext *econtext = GetPerTupleExprContext(estate);
-	econtext->ecxt_scantuple = slot;
 
-	copyDest =
-		(DestReceiver *) CreateCitusCopyDestReceiver(distributedRelationId,
-													 columnNameList,
-													 partitionColumnIndex,
-													 estate, stopOnFailure,
-													 NULL);
+	CitusCopyDestReceiver *citusCopyDest =
+		CreateCitusCopyDestReceiver(distributedRelationId, columnNameList,
+									partitionColumnIndex, estate, stopOnFailure,
+									NULL);
+
+	/* the copy of the local data is the part of the operation that takes time */
+	citusCopyDest->progressOperation = CITUS_OPERATION_CREATE_DISTRIBUTED_TABLE;
+	copyDest = (DestReceiver *) citusCopyDest;
 
 	/* initialise state for writing to shards, we'll open connections on demand */
 	copyDest->rStartup(copyDest, 0, tupleDescriptor);
 
+	if (ParallelCopyLocalDataToShards(distributedRelation, citusCopyDest,
+									  &rowsCopied))
+	{
+		if (rowsCopied > 0)
+		{
+			ereport(NOTICE, (errmsg("Copying data from local table...")));
+		}
+	}
+	else
+	{
+		rowsCopied = ScanLocalDataIntoShards(distributedRelation, copyDest, estate);
+	}
+
+	if (rowsCopied % 1000000 != 0)
+	{
+		ereport(DEBUG1, (errmsg("Copied " UINT64_FORMAT " rows", rowsCopied)));
+	}
+
+	/* finish writing into the shards */
+	copyDest->rShutdown(copyDest);
+	copyDest->rDestroy(copyDest);
+
+	/* free memory and close the relation */
+	FreeExecutorState(estate);
+	heap_close(distributedRelation, NoLock);
+
+	PopActiveSnapshot();
+}
+
+
+/*
+ * ScanLocalDataIntoShards scans the local table with the active snapshot and
+ * passes every row to the given destination receiver. The function returns the
+ * number of rows that were copied.
+ */
+static uint64
+ScanLocalDataIntoShards(Relation distributedRelation, DestReceiver *copyDest,
+						EState *estate)
+{
+#if PG_VERSION_NUM >= 120000
+	TableScanDesc scan = NULL;
+#else
+	HeapScanDesc scan = NULL;
+	HeapTuple tuple = NULL;
+#endif
+	uint64 rowsCopied = 0;
+
+#if PG_VERSION_NUM >= 120000
+
+	/* tables may use other access methods than heap, such as columnar ones */
+	TupleTableSlot *slot = table_slot_create(distributedRelation, NULL);
+#else
+	TupleTableSlot *slot =
+		MakeSingleTupleTableSlotCompat(RelationGetDescr(distributedRelation),
+									   &TTSOpsHeapTuple);
+#endif
+
+	ExprContext *econtext = GetPerTupleExprContext(estate);
+	econtext->ecxt_scantuple = slot;
+
 	/* begin reading from local table */
 #if PG_VERSION_NUM >= 120000
 	scan = table_beginscan(distributedRelation, GetActiveSnapshot(), 0, NULL);
@@ -1260,17 +1408,20 @@ CopyLocalDataIntoShards(Oid distributedRelationId)
 	scan = heap_beginscan(distributedRelation, GetActiveSnapshot(), 0, NULL);
 #endif
 
-	oldContext = MemoryContextSwitchTo(GetPerTupleMemoryContext(estate));
+	MemoryContext oldContext = MemoryContextSwitchTo(GetPerTupleMemoryContext(estate));
 
+#if PG_VERSION_NUM >= 120000
+	while (table_scan_getnextslot(scan, ForwardScanDirection, slot))
+	{
+		/* send the tuple to a shard */
+		copyDest->receiveSlot(slot, copyDest);
+#else
 	while ((tuple = heap_getnext(scan, ForwardScanDirection)) != NULL)
 	{
 		/* materialize tuple and send it to a shard */
-#if PG_VERSION_NUM >= 120000
-		ExecStoreHeapTuple(tuple, slot, false);
-#else
 		ExecStoreTuple(tuple, slot, InvalidBuffer, false);
-#endif
 		copyDest->receiveSlot(slot, copyDest);
+#endif
 
 		/* clear tuple memory */
 		ResetPerTupleExprContext(estate);
@@ -1291,11 +1442,6 @@ CopyLocalDataIntoShards(Oid distributedRelationId)
 		}
 	}
 
-	if (rowsCopied % 1000000 != 0)
-	{
-		ereport(DEBUG1, (errmsg("Copied " UINT64_FORMAT " rows", rowsCopied)));
-	}
-
 	MemoryContextSwitchTo(oldContext);
 
 	/* finish reading from the local table */
@@ -1305,16 +1451,9 @@ CopyLocalDataIntoShards(Oid distributedRelationId)
 	heap_endscan(scan);
 #endif
 
-	/* finish writing into the shards */
-	copyDest->rShutdown(copyDest);
-	copyDest->rDestroy(copyDest);
-
-	/* free memory and close the relation */
 	ExecDropSingleTupleTableSlot(slot);
-	FreeExecutorState(estate);
-	heap_close(distributedRelation, NoLock);
 
-	PopActiveSnapshot();
+	return rowsCopied;
 }
 
 
@@ -1392,15 +1531,23 @@ DistributionColumnUsesGeneratedStoredColumn(TupleDesc relationDesc,
 
 
 /*
- * Returns whether given relation uses default access method
+ * RelationUsesSupportedAccessMethod returns whether the given relation uses the
+ * default access method, or an access method that is created by an extension,
+ * such as a columnar storage extension. Creating the table on the workers also
+ * creates the extension there, so the shards can use the same access method.
  */
 static bool
-RelationUsesHeapAccessMethodOrNone(Relation relation)
+RelationUsesSupportedAccessMethod(Relation relation)
 {
 #if PG_VERSION_NUM >= 120000
+	if (relation->rd_rel->relkind != RELKIND_RELATION ||
+		relation->rd_amhandler == HEAP_TABLE_AM_HANDLER_OID)
+	{
+		return true;
+	}
 
-	return relation->rd_rel->relkind != RELKIND_RELATION ||
-		   relation->rd_amhandler == HEAP_TABLE_AM_HANDLER_OID;
+	return OidIsValid(getExtensionOfObject(AccessMethodRelationId,
+										   relation->rd_rel->relam));
 #else
 	return true;
 #endif
@@ -14,6 +14,7 @@
 #include "distributed/commands/utility_hook.h"
 #include "distributed/master_metadata_utility.h"
 #include "distributed/master_protocol.h"
+#include "distributed/metadata/shard_column_stats.h"
 #include "distributed/metadata_sync.h"
 #include "distributed/worker_transaction.h"
 #include "utils/builtins.h"
@@ -81,6 +82,7 @@ master_remove_partition_metadata(PG_FUNCTION_ARGS)
 
 	CheckTableSchemaNameForDrop(relationId, &schemaName, &tableName);
 
+	DeleteShardColumnStatistics(relationId);
 	DeletePartitionRow(relationId);
 
 	PG_RETURN_VOID();
@@ -23,11 +23,16 @@
 #include "distributed/citus_ruleutils.h"
 #include "distributed/commands.h"
 #include "distributed/commands/utility_hook.h"
+#include "distributed/connection_management.h"
 #include "distributed/distributed_planner.h"
+#include "distributed/listutils.h"
 #include "distributed/master_protocol.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_physical_planner.h"
+#include "distributed/multi_progress.h"
+#include "distributed/remote_commands.h"
 #include "distributed/resource_lock.h"
+#include "distributed/tuplestore.h"
 #include "distributed/version_compat.h"
 #include "lib/stringinfo.h"
 #include "miscadmin.h"
@@ -38,8 +43,40 @@
 #include "utils/lsyscache.h"
 #include "utils/syscache.h"
 
+/* number of columns returned by get_index_build_progress */
+#define INDEX_BUILD_PROGRESS_FIELDS 6
+
+/* number of times a failed shard index build is retried */
+#define SHARD_INDEX_BUILD_RETRY_COUNT 1
+
+
+/* ShardIndexBuild is the build of the index on a single shard placement */
+typedef struct ShardIndexBuild
+{
+	ShardPlacement *placement;
+	const char *buildCommand;
+	char *cleanupCommand;
+	int attemptCount;
+	MultiConnection *connection;    /* connection of the ongoing build, if any */
+	ShardOperationProgress *progress; /* step in the progress monitor, if any */
+} ShardIndexBuild;
+
+
+/* config variable managed via guc.c */
+bool EnableConcurrentIndexBuildRetries = false;
+
+
 /* Local functions forward declarations for helper functions */
 static List * CreateIndexTaskList(Oid relationId, IndexStmt *indexStmt);
+static List * ShardIndexBuildList(DDLJob *ddlJob);
+static int ShardIndexBuildCountOnNode(List *shardIndexBuildList,
+									  ShardPlacement *placement);
+static MultiConnection * ShardIndexBuildConnection(List **idleConnectionList,
+												   ShardPlacement *placement);
+static bool FinishShardIndexBuild(ShardIndexBuild *shardIndexBuild);
+static void CleanupShardIndexBuild(ShardIndexBuild *shardIndexBuild);
+static void SetShardIndexBuildProgress(ShardIndexBuild *shardIndexBuild,
+									   ShardOperationStatus status);
 static List * CreateReindexTaskList(Oid relationId, ReindexStmt *reindexStmt);
 static void RangeVarCallbackForDropIndex(const RangeVar *rel, Oid relOid, Oid oldRelOid,
 										 void *arg);
@@ -75,6 +112,10 @@ struct ReindexIndexCallbackState
 };
 
 
+/* exports for SQL callable functions */
+PG_FUNCTION_INFO_V1(get_index_build_progress);
+
+
 /*
  * IsIndexRenameStmt returns whether the passed-in RenameStmt is the following
  * form:
@@ -177,6 +218,11 @@ PlanIndexStmt(IndexStmt *createIndexStatement, const char *createIndexCommand)
 				ddlJob->commandString = createIndexCommand;
 				ddlJob->taskList = CreateIndexTaskList(relationId, createIndexStatement);
 
+				if (createIndexStatement->concurrent)
+				{
+					ddlJob->concurrentIndexName = indexName;
+				}
+
 				ddlJobs = list_make1(ddlJob);
 			}
 		}
@@ -536,6 +582,368 @@ CreateIndexTaskList(Oid relationId, IndexStmt *indexStmt)
 }
 
 
+/*
+ * ExecuteConcurrentIndexBuild builds the shard indexes of a CREATE INDEX
+ * CONCURRENTLY command, using up to the DDL executor pool size of connections
+ * per node. Unlike the regular DDL execution, a failed shard build does not
+ * abort the builds on the other shards. Instead, the invalid index that the
+ * failed build left behind is dropped and the build is retried, and only the
+ * shards that keep failing are reported at the end. The state of each build
+ * is published via get_index_build_progress().
+ *
+ * The builds run outside of transaction blocks on the workers, where CREATE
+ * INDEX CONCURRENTLY does not block writes to the shards, and the distributed
+ * table itself is only locked in ShareUpdateExclusiveLock mode.
+ */
+void
+ExecuteConcurrentIndexBuild(DDLJob *ddlJob)
+{
+	List *pendingBuildList = ShardIndexBuildList(ddlJob);
+	List *failedBuildList = NIL;
+	List *idleConnectionList = NIL;
+	int targetPoolSize = DDLTargetPoolSize();
+	ShardIndexBuild *shardIndexBuild = NULL;
+	ShardOperationProgress *progressArray = NULL;
+	int progressIndex = 0;
+
+	if (pendingBuildList == NIL)
+	{
+		return;
+	}
+
+	ProgressMonitorData *monitor =
+		CreateShardOperationProgressMonitor(CITUS_OPERATION_CREATE_INDEX,
+											ddlJob->targetRelationId,
+											list_length(pendingBuildList));
+	if (monitor != NULL)
+	{
+		progressArray = (ShardOperationProgress *) monitor->steps;
+	}
+
+	foreach_ptr(shardIndexBuild, pendingBuildList)
+	{
+		if (progressArray != NULL)
+		{
+			ShardOperationProgress *step = &progressArray[progressIndex++];
+
+			step->shardId = shardIndexBuild->placement->shardId;
+			strlcpy(step->nodeName, shardIndexBuild->placement->nodeName,
+					WORKER_LENGTH);
+			step->nodePort = shardIndexBuild->placement->nodePort;
+
+			shardIndexBuild->progress = step;
+		}
+	}
+
+	while (pendingBuildList != NIL)
+	{
+		List *runningBuildList = NIL;
+		List *deferredBuildList = NIL;
+
+		/* start as many builds as the pool size of each node allows */
+		foreach_ptr(shardIndexBuild, pendingBuildList)
+		{
+			ShardPlacement *placement = shardIndexBuild->placement;
+
+			if (ShardIndexBuildCountOnNode(runningBuildList, placement) >=
+				targetPoolSize)
+			{
+				deferredBuildList = lappend(deferredBuildList, shardIndexBuild);
+				continue;
+			}
+
+			shardIndexBuild->connection =
+				ShardIndexBuildConnection(&idleConnectionList, placement);
+			shardIndexBuild->attemptCount++;
+
+			SetShardIndexBuildProgress(shardIndexBuild, SHARD_OPERATION_RUNNING);
+
+			if (SendRemoteCommand(shardIndexBuild->connection,
+								  shardIndexBuild->buildCommand) == 0)
+			{
+				ReportConnectionError(shardIndexBuild->connection, WARNING);
+			}
+
+			runningBuildList = lappend(runningBuildList, shardIndexBuild);
+		}
+
+		/* wait for the builds, and retry or give up on the failed ones */
+		foreach_ptr(shardIndexBuild, runningBuildList)
+		{
+			MultiConnection *connection = shardIndexBuild->connection;
+
+			if (FinishShardIndexBuild(shardIndexBuild))
+			{
+				SetShardIndexBuildProgress(shardIndexBuild, SHARD_OPERATION_DONE);
+			}
+			else
+			{
+				CleanupShardIndexBuild(shardIndexBuild);
+
+				if (shardIndexBuild->attemptCount <= SHARD_INDEX_BUILD_RETRY_COUNT)
+				{
+					SetShardIndexBuildProgress(shardIndexBuild,
+											   SHARD_OPERATION_WAITING);
+					deferredBuildList = lappend(deferredBuildList, shardIndexBuild);
+				}
+				else
+				{
+					SetShardIndexBuildProgress(shardIndexBuild,
+											   SHARD_OPERATION_FAILED);
+					failedBuildList = lappend(failedBuildList, shardIndexBuild);
+				}
+			}
+
+			if (PQstatus(connection->pgConn) == CONNECTION_OK)
+			{
+				idleConnectionList = lappend(idleConnectionList, connection);
+			}
+			else
+			{
+				CloseConnection(connection);
+			}
+
+			shardIndexBuild->connection = NULL;
+		}
+
+		pendingBuildList = deferredBuildList;
+	}
+
+	MultiConnection *connection = NULL;
+	foreach_ptr(connection, idleConnectionList)
+	{
+		CloseConnection(connection);
+	}
+
+	if (monitor != NULL)
+	{
+		FinalizeCurrentProgressMonitor();
+	}
+
+	if (failedBuildList != NIL)
+	{
+		ShardIndexBuild *failedBuild = (ShardIndexBuild *) linitial(failedBuildList);
+		ShardPlacement *failedPlacement = failedBuild->placement;
+
+		ereport(ERROR, (errmsg("could not build the index on %d shard placements",
+							   list_length(failedBuildList)),
+						errdetail("Building the index on shard " UINT64_FORMAT
+								  " on %s:%d failed %d times.",
+								  failedPlacement->shardId, failedPlacement->nodeName,
+								  failedPlacement->nodePort,
+								  failedBuild->attemptCount)));
+	}
+}
+
+
+/*
+ * ShardIndexBuildList returns a ShardIndexBuild for each placement of each
+ * task of the given CREATE INDEX CONCURRENTLY job.
+ */
+static List *
+ShardIndexBuildList(DDLJob *ddlJob)
+{
+	List *shardIndexBuildList = NIL;
+	Oid schemaId = get_rel_namespace(ddlJob->targetRelationId);
+	char *schemaName = get_namespace_name(schemaId);
+	Task *task = NULL;
+
+	foreach_ptr(task, ddlJob->taskList)
+	{
+		char *shardIndexName = pstrdup(ddlJob->concurrentIndexName);
+		StringInfo cleanupCommand = makeStringInfo();
+		ShardPlacement *placement = NULL;
+
+		AppendShardIdToName(&shardIndexName, task->anchorShardId);
+		appendStringInfo(cleanupCommand, "DROP INDEX CONCURRENTLY IF EXISTS %s",
+						 quote_qualified_identifier(schemaName, shardIndexName));
+
+		foreach_ptr(placement, task->taskPlacementList)
+		{
+			ShardIndexBuild *shardIndexBuild = palloc0(sizeof(ShardIndexBuild));
+			shardIndexBuild->placement = placement;
+			shardIndexBuild->buildCommand = task->queryString;
+			shardIndexBuild->cleanupCommand = cleanupCommand->data;
+
+			shardIndexBuildList = lappend(shardIndexBuildList, shardIndexBuild);
+		}
+	}
+
+	return shardIndexBuildList;
+}
+
+
+/*
+ * ShardIndexBuildCountOnNode returns the number of builds in the given list
+ * that run on the node of the given placement.
+ */
+static int
+ShardIndexBuildCountOnNode(List *shardIndexBuildList, ShardPlacement *placement)
+{
+	int buildCount = 0;
+	ShardIndexBuild *shardIndexBuild = NULL;
+
+	foreach_ptr(shardIndexBuild, shardIndexBuildList)
+	{
+		if (shardIndexBuild->placement->nodeId == placement->nodeId)
+		{
+			buildCount++;
+		}
+	}
+
+	return buildCount;
+}
+
+
+/*
+ * ShardIndexBuildConnection returns an idle connection to the node of the
+ * given placement, removing it from the idle connection list, or opens a new
+ * connection if there is none. The builds use dedicated connections because
+ * CREATE INDEX CONCURRENTLY cannot run in the transaction blocks that the
+ * connections of the distributed transaction might be in.
+ */
+static MultiConnection *
+ShardIndexBuildConnection(List **idleConnectionList, ShardPlacement *placement)
+{
+	MultiConnection *connection = NULL;
+
+	foreach_ptr(connection, *idleConnectionList)
+	{
+		if (strncmp(connection->hostname, placement->nodeName, MAX_NODE_LENGTH) == 0 &&
+			connection->port == placement->nodePort)
+		{
+			*idleConnectionList = list_delete_ptr(*idleConnectionList, connection);
+			return connection;
+		}
+	}
+
+	return GetNodeConnection(FORCE_NEW_CONNECTION, placement->nodeName,
+							 placement->nodePort);
+}
+
+
+/*
+ * FinishShardIndexBuild waits for the given build to finish and returns whether
+ * it succeeded. Failures are reported as warnings.
+ */
+static bool
+FinishShardIndexBuild(ShardIndexBuild *shardIndexBuild)
+{
+	MultiConnection *connection = shardIndexBuild->connection;
+	bool raiseInterrupts = true;
+
+	if (PQstatus(connection->pgConn) != CONNECTION_OK)
+	{
+		return false;
+	}
+
+	PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+	bool buildSucceeded = IsResponseOK(result);
+	if (!buildSucceeded)
+	{
+		ReportResultError(connection, result, WARNING);
+	}
+
+	PQclear(result);
+	ForgetResults(connection);
+
+	return buildSucceeded;
+}
+
+
+/*
+ * CleanupShardIndexBuild drops the invalid index that a failed build might
+ * have left behind on the placement, such that it can be built again.
+ */
+static void
+CleanupShardIndexBuild(ShardIndexBuild *shardIndexBuild)
+{
+	ShardPlacement *placement = shardIndexBuild->placement;
+	MultiConnection *connection = shardIndexBuild->connection;
+
+	if (PQstatus(connection->pgConn) != CONNECTION_OK)
+	{
+		connection = GetNodeConnection(FORCE_NEW_CONNECTION, placement->nodeName,
+									   placement->nodePort);
+		ExecuteOptionalRemoteCommand(connection, shardIndexBuild->cleanupCommand,
+									 NULL);
+		CloseConnection(connection);
+		return;
+	}
+
+	ExecuteOptionalRemoteCommand(connection, shardIndexBuild->cleanupCommand, NULL);
+}
+
+
+/*
+ * SetShardIndexBuildProgress updates the state of the given build in the
+ * progress monitor, if there is one.
+ */
+static void
+SetShardIndexBuildProgress(ShardIndexBuild *shardIndexBuild, ShardOperationStatus status)
+{
+	if (shardIndexBuild->progress != NULL)
+	{
+		shardIndexBuild->progress->status = status;
+	}
+}
+
+
+/*
+ * get_index_build_progress returns the shard index builds of the ongoing
+ * CREATE INDEX CONCURRENTLY commands, along with whether they are waiting (0),
+ * being built (1), built (2) or failed (3).
+ */
+Datum
+get_index_build_progress(PG_FUNCTION_ARGS)
+{
+	List *attachedDSMSegmentList = NIL;
+	ProgressMonitorData *monitor = NULL;
+	TupleDesc tupleDescriptor = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	List *monitorList = ProgressMonitorList(SHARD_OPERATION_PROGRESS_MAGIC_NUMBER,
+											&attachedDSMSegmentList);
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	foreach_ptr(monitor, monitorList)
+	{
+		ShardOperationProgress *progressArray = monitor->steps;
+
+		for (int stepIndex = 0; stepIndex < monitor->stepCount; stepIndex++)
+		{
+			ShardOperationProgress *step = &progressArray[stepIndex];
+			Datum values[INDEX_BUILD_PROGRESS_FIELDS];
+			bool isNulls[INDEX_BUILD_PROGRESS_FIELDS];
+
+			if (step->operationType != CITUS_OPERATION_CREATE_INDEX)
+			{
+				continue;
+			}
+
+			memset(values, 0, sizeof(values));
+			memset(isNulls, false, sizeof(isNulls));
+
+			values[0] = Int32GetDatum(monitor->processId);
+			values[1] = ObjectIdGetDatum(step->relationId);
+			values[2] = Int64GetDatum(step->shardId);
+			values[3] = CStringGetTextDatum(step->nodeName);
+			values[4] = Int32GetDatum(step->nodePort);
+			values[5] = Int64GetDatum(step->status);
+
+			tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+		}
+	}
+
+	tuplestore_donestoring(tupleStore);
+
+	DetachFromDSMSegments(attachedDSMSegmentList);
+
+	return (Datum) 0;
+}
+
+
 /*
  * CreateReindexTaskList builds a list of tasks to execute a REINDEX command
  * against a specified distributed table.
@@ -68,9 +68,13 @@
 #include "catalog/pg_type.h"
 #include "commands/copy.h"
 #include "commands/defrem.h"
+#include "distributed/commands/binary_copy.h"
 #include "distributed/commands/multi_copy.h"
+#include "distributed/commands/parallel_copy.h"
+#include "distributed/commands/parallel_copy_to.h"
 #include "distributed/commands/utility_hook.h"
 #include "distributed/intermediate_results.h"
+#include "distributed/listutils.h"
 #include "distributed/local_executor.h"
 #include "distributed/log_utils.h"
 #include "distributed/master_protocol.h"
@@ -79,24 +83,32 @@
 #include "distributed/multi_physical_planner.h"
 #include "distributed/multi_router_planner.h"
 #include "distributed/multi_executor.h"
+#include "distributed/multi_progress.h"
 #include "distributed/placement_connection.h"
 #include "distributed/relation_access_tracking.h"
 #include "distributed/remote_commands.h"
 #include "distributed/remote_transaction.h"
 #include "distributed/resource_lock.h"
 #include "distributed/shard_pruning.h"
+#include "distributed/shardinterval_utils.h"
+#include "distributed/transmit.h"
 #include "distributed/version_compat.h"
 #include "distributed/worker_protocol.h"
 #include "executor/executor.h"
 #include "foreign/foreign.h"
 #include "libpq/pqformat.h"
+#include "mb/pg_wchar.h"
 #include "nodes/makefuncs.h"
+#include "storage/lmgr.h"
 #include "tsearch/ts_locale.h"
 #include "utils/builtins.h"
+#include "utils/date.h"
+#include "utils/fmgroids.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
 #include "utils/syscache.h"
 #include "utils/memutils.h"
+#include "utils/timestamp.h"
 
 
 /* constant used in binary protocol */
@@ -105,6 +117,14 @@ static const char BinarySignature[11] = "PGCOPY\n\377\r\n\0";
 /* use a global connection to the master node in order to skip passing it around */
 static MultiConnection *masterConnection = NULL;
 
+/* config variables managed via guc.c */
+int TimeRangeShardInterval = 0;
+int MaxCopyConnectionsPerNode = 0;
+bool EnableLocalCopy = false;
+
+/* buffer that the data source callback of a local COPY reads from */
+static StringInfo LocalCopyBuffer = NULL;
+
 /*
  * Data size threshold to switch over the active placement for a connection.
  * If this is too low, overhead of starting COPY commands will hurt the
@@ -114,6 +134,23 @@ static MultiConnection *masterConnection = NULL;
  */
 #define COPY_SWITCH_OVER_THRESHOLD (4 * 1024 * 1024)
 
+/*
+ * Rows are serialised into per-shard buffers, and a shard's buffer is sent to
+ * its placements once it grows beyond COPY_SHARD_BATCH_SIZE. This way the
+ * shard state lookup and the copy data message are paid once per batch of rows
+ * instead of once per row. To bound memory use when rows are spread over many
+ * shards, all buffers are sent once their total size grows beyond
+ * COPY_BUFFERED_DATA_LIMIT.
+ */
+#define COPY_SHARD_BATCH_SIZE (64 * 1024)
+#define COPY_BUFFERED_DATA_LIMIT (16 * 1024 * 1024)
+
+/*
+ * Rows for a placement on the local node are copied into the shard without a
+ * connection, once LOCAL_COPY_FLUSH_THRESHOLD bytes are buffered for the shard.
+ */
+#define LOCAL_COPY_FLUSH_THRESHOLD (512 * 1024)
+
 typedef struct CopyShardState CopyShardState;
 typedef struct CopyPlacementState CopyPlacementState;
 
@@ -133,7 +170,9 @@ typedef struct CopyPlacementState CopyPlacementState;
  *
  * If no previous command in the current transaction has used adaptive_executor.c,
  * then CopyGetPlacementConnection() returns one connection per placement and no
- * buffering happens and we put the copy data directly on connection.
+ * buffering happens and we put the copy data directly on connection. The same
+ * buffering lets COPY multiplex many placements over a bounded number of
+ * connections per node when citus.max_copy_connections_per_node is set.
  */
 typedef struct CopyConnectionState
 {
@@ -154,6 +193,9 @@ typedef struct CopyConnectionState
 	 * In this case, old activePlacementState isn't NULL, is added to this list.
 	 */
 	dlist_head bufferedPlacementList;
+
+	/* number of placements that are assigned to the connection */
+	int placementCount;
 } CopyConnectionState;
 
 
@@ -181,8 +223,14 @@ struct CopyShardState
 	/* Used as hash key. */
 	uint64 shardId;
 
-	/* List of CopyPlacementStates for all active placements of the shard. */
+	/* List of CopyPlacementStates for all active remote placements of the shard. */
 	List *placementStateList;
+
+	/* whether rows are also copied locally into a placement on this node */
+	bool hasLocalPlacement;
+
+	/* rows buffered for the local placement */
+	StringInfo localCopyBuffer;
 };
 
 /* ShardConnections represents a set of connections for each placement of a shard */
@@ -198,6 +246,8 @@ typedef struct ShardConnections
 /* Local functions forward declarations */
 static void CopyFromWorkerNode(CopyStmt *copyStatement, char *completionTag);
 static void CopyToExistingShards(CopyStmt *copyStatement, char *completionTag);
+static uint64 CopyFromDataSource(CopyStmt *copyStatement, Relation distributedRelation,
+								 DestReceiver *dest, EState *executorState);
 static void CopyToNewShards(CopyStmt *copyStatement, char *completionTag, Oid relationId);
 static char MasterPartitionMethod(RangeVar *relation);
 static void RemoveMasterOptions(CopyStmt *copyStatement);
@@ -220,6 +270,14 @@ static void SendCopyDataToPlacement(StringInfo dataBuffer, int64 shardId,
 									MultiConnection *connection);
 static void ReportCopyError(MultiConnection *connection, PGresult *result);
 static uint32 AvailableColumnCount(TupleDesc tupleDescriptor);
+static int CreateTimeRangeShardForValue(CitusCopyDestReceiver *copyDest,
+										Datum partitionColumnValue);
+static int64 TimeRangeValue(Datum datum, Oid typeId);
+static Datum TimeRangeValueGetDatum(int64 timeRangeValue, Oid typeId);
+static void ResetShardRowDataArray(CitusCopyDestReceiver *copyDest);
+static CopyConnectionState * SharedCopyConnectionState(HTAB *connectionStateHash,
+													   ShardPlacement *placement,
+													   const char *userName);
 static int64 StartCopyToNewShard(ShardConnections *shardConnections,
 								 CopyStmt *copyStatement, bool useBinaryCopyFormat);
 static int64 MasterCreateEmptyShard(char *relationName);
@@ -246,15 +304,21 @@ static HTAB * CreateConnectionStateHash(MemoryContext memoryContext);
 static HTAB * CreateShardStateHash(MemoryContext memoryContext);
 static CopyConnectionState * GetConnectionState(HTAB *connectionStateHash,
 												MultiConnection *connection);
+static void FlushLocalCopyBuffer(CitusCopyDestReceiver *copyDest,
+								 CopyShardState *shardState);
+static void FlushLocalCopyBuffers(CitusCopyDestReceiver *copyDest);
+static int ReadFromLocalCopyBuffer(void *outBuffer, int minRead, int maxRead);
 static CopyShardState * GetShardState(uint64 shardId, HTAB *shardStateHash,
 									  HTAB *connectionStateHash, bool stopOnFailure,
-									  bool *found);
+									  bool useLocalCopy, bool *found);
 static MultiConnection * CopyGetPlacementConnection(ShardPlacement *placement,
+													HTAB *connectionStateHash,
 													bool stopOnFailure);
 static List * ConnectionStateList(HTAB *connectionStateHash);
 static void InitializeCopyShardState(CopyShardState *shardState,
 									 HTAB *connectionStateHash,
-									 uint64 shardId, bool stopOnFailure);
+									 uint64 shardId, bool stopOnFailure,
+									 bool useLocalCopy);
 static void StartPlacementStateCopyCommand(CopyPlacementState *placementState,
 										   CopyStmt *copyStatement,
 										   CopyOutState copyOutState);
@@ -270,12 +334,21 @@ static void CopySendString(CopyOutState outputState, const char *str);
 static void CopySendChar(CopyOutState outputState, char c);
 static void CopySendInt32(CopyOutState outputState, int32 val);
 static void CopySendInt16(CopyOutState outputState, int16 val);
+static void CopySendInt64(CopyOutState outputState, int64 val);
+static bool CopySendFixedWidthBinary(CopyOutState outputState, Oid sendFunctionId,
+									 Datum value);
 static void CopyAttributeOutText(CopyOutState outputState, char *string);
 static inline void CopyFlushOutput(CopyOutState outputState, char *start, char *pointer);
+static void SendCopyRowDataToPlacements(CitusCopyDestReceiver *copyDest, int64 shardId,
+										StringInfo rowData);
 static bool CitusSendTupleToPlacements(TupleTableSlot *slot,
 									   CitusCopyDestReceiver *copyDest);
-static uint64 ShardIdForTuple(CitusCopyDestReceiver *copyDest, Datum *columnValues,
-							  bool *columnNulls);
+static void UpdateCopyShardProgress(CitusCopyDestReceiver *copyDest, int shardIndex,
+									uint64 shardId, int64 rowCount, uint64 byteCount);
+static void BufferShardRowData(CitusCopyDestReceiver *copyDest, int shardIndex,
+							   const char *rowData, int rowLength);
+static void FlushCopyShardBatches(CitusCopyDestReceiver *copyDest);
+static void FlushCopyShardBatch(CitusCopyDestReceiver *copyDest, int shardIndex);
 
 /* CitusCopyDestReceiver functions */
 static void CitusCopyDestReceiverStartup(DestReceiver *copyDest, int operation,
@@ -434,36 +507,19 @@ CopyToExistingShards(CopyStmt *copyStatement, char *completionTag)
 	CitusCopyDestReceiver *copyDest = NULL;
 	DestReceiver *dest = NULL;
 
-	Relation copiedDistributedRelation = NULL;
-	Form_pg_class copiedDistributedRelationTuple = NULL;
 	List *columnNameList = NIL;
 	int partitionColumnIndex = INVALID_PARTITION_COLUMN_INDEX;
 
 	EState *executorState = NULL;
-	MemoryContext executorTupleContext = NULL;
-	ExprContext *executorExpressionContext = NULL;
 
 	char partitionMethod = 0;
 	bool stopOnFailure = false;
 
-	CopyState copyState = NULL;
 	uint64 processedRowCount = 0;
+	bool inputCopied = false;
 
-	ErrorContextCallback errorCallback;
-
-	/* allocate column values and nulls arrays */
 	Relation distributedRelation = heap_open(tableId, RowExclusiveLock);
 	TupleDesc tupleDescriptor = RelationGetDescr(distributedRelation);
-	uint32 columnCount = tupleDescriptor->natts;
-	Datum *columnValues = palloc0(columnCount * sizeof(Datum));
-	bool *columnNulls = palloc0(columnCount * sizeof(bool));
-
-	/* set up a virtual tuple table slot */
-	TupleTableSlot *tupleTableSlot = MakeSingleTupleTableSlotCompat(tupleDescriptor,
-																	&TTSOpsVirtual);
-	tupleTableSlot->tts_nvalid = columnCount;
-	tupleTableSlot->tts_values = columnValues;
-	tupleTableSlot->tts_isnull = columnNulls;
 
 	/* determine the partition column index in the tuple descriptor */
 	Var *partitionColumn = PartitionColumn(tableId, 0);
@@ -473,26 +529,9 @@ CopyToExistingShards(CopyStmt *copyStatement, char *completionTag)
 	}
 
 	/* build the list of column names for remote COPY statements */
-	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
-	{
-		Form_pg_attribute currentColumn = TupleDescAttr(tupleDescriptor, columnIndex);
-		char *columnName = NameStr(currentColumn->attname);
-
-		if (currentColumn->attisdropped
-#if PG_VERSION_NUM >= 120000
-			|| currentColumn->attgenerated == ATTRIBUTE_GENERATED_STORED
-#endif
-			)
-		{
-			continue;
-		}
-
-		columnNameList = lappend(columnNameList, columnName);
-	}
+	columnNameList = CopyColumnNameList(tupleDescriptor);
 
 	executorState = CreateExecutorState();
-	executorTupleContext = GetPerTupleMemoryContext(executorState);
-	executorExpressionContext = GetPerTupleExprContext(executorState);
 
 	partitionMethod = PartitionMethod(tableId);
 	if (partitionMethod == DISTRIBUTE_BY_NONE)
@@ -507,44 +546,85 @@ CopyToExistingShards(CopyStmt *copyStatement, char *completionTag)
 	dest->rStartup(dest, 0, tupleDescriptor);
 
 	/*
-	 * Below, we change a few fields in the Relation to control the behaviour
-	 * of BeginCopyFrom. However, we obviously should not do this in relcache
-	 * and therefore make a copy of the Relation.
+	 * Pass binary rows through without parsing them, or parse and route the rows
+	 * in parallel workers if possible. Otherwise, or if no workers could be
+	 * launched, parse the rows in this backend.
 	 */
-	copiedDistributedRelation = (Relation) palloc(sizeof(RelationData));
-	copiedDistributedRelationTuple = (Form_pg_class) palloc(CLASS_TUPLE_SIZE);
+	if (CanPassThroughBinaryCopy(copyStatement, copyDest))
+	{
+		processedRowCount = PassThroughBinaryCopy(copyStatement, copyDest);
+		inputCopied = true;
+	}
+	else if (CanCopyInParallel(copyStatement, distributedRelation))
+	{
+		inputCopied = ParallelCopyToExistingShards(copyStatement, copyDest,
+												   &processedRowCount);
+	}
 
-	/*
-	 * There is no need to deep copy everything. We will just deep copy of the fields
-	 * we will change.
-	 */
-	memcpy(copiedDistributedRelation, distributedRelation, sizeof(RelationData));
-	memcpy(copiedDistributedRelationTuple, distributedRelation->rd_rel,
-		   CLASS_TUPLE_SIZE);
+	if (!inputCopied)
+	{
+		processedRowCount = CopyFromDataSource(copyStatement, distributedRelation, dest,
+											   executorState);
+	}
 
-	copiedDistributedRelation->rd_rel = copiedDistributedRelationTuple;
-	copiedDistributedRelation->rd_att = CreateTupleDescCopyConstr(tupleDescriptor);
+	/* finish the COPY commands */
+	dest->rShutdown(dest);
+	dest->rDestroy(dest);
 
-	/*
-	 * BeginCopyFrom opens all partitions of given partitioned table with relation_open
-	 * and it expects its caller to close those relations. We do not have direct access
-	 * to opened relations, thus we are changing relkind of partitioned tables so that
-	 * Postgres will treat those tables as regular relations and will not open its
-	 * partitions.
-	 */
-	if (PartitionedTable(tableId))
+	FreeExecutorState(executorState);
+	heap_close(distributedRelation, NoLock);
+
+	/* mark failed placements as inactive */
+	MarkFailedShardPlacements();
+
+	CHECK_FOR_INTERRUPTS();
+
+	if (completionTag != NULL)
 	{
-		copiedDistributedRelationTuple->relkind = RELKIND_RELATION;
+		snprintf(completionTag, COMPLETION_TAG_BUFSIZE,
+				 "COPY " UINT64_FORMAT, processedRowCount);
 	}
+}
+
+
+/*
+ * CopyFromDataSource parses the rows of the data source of the given COPY
+ * statement and passes them to the given destination receiver. The function
+ * returns the number of rows it parsed.
+ */
+static uint64
+CopyFromDataSource(CopyStmt *copyStatement, Relation distributedRelation,
+				   DestReceiver *dest, EState *executorState)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(distributedRelation);
+	MemoryContext executorTupleContext = GetPerTupleMemoryContext(executorState);
+	ExprContext *executorExpressionContext = GetPerTupleExprContext(executorState);
+	uint64 processedRowCount = 0;
+
+	ErrorContextCallback errorCallback;
+
+	/* allocate column values and nulls arrays */
+	uint32 columnCount = tupleDescriptor->natts;
+	Datum *columnValues = palloc0(columnCount * sizeof(Datum));
+	bool *columnNulls = palloc0(columnCount * sizeof(bool));
+
+	/* set up a virtual tuple table slot */
+	TupleTableSlot *tupleTableSlot = MakeSingleTupleTableSlotCompat(tupleDescriptor,
+																	&TTSOpsVirtual);
+	tupleTableSlot->tts_nvalid = columnCount;
+	tupleTableSlot->tts_values = columnValues;
+	tupleTableSlot->tts_isnull = columnNulls;
+
+	Relation copiedDistributedRelation = CopyRelationForCopyFrom(distributedRelation);
 
 	/* initialize copy state to read from COPY data source */
-	copyState = BeginCopyFrom(NULL,
-							  copiedDistributedRelation,
-							  copyStatement->filename,
-							  copyStatement->is_program,
-							  NULL,
-							  copyStatement->attlist,
-							  copyStatement->options);
+	CopyState copyState = BeginCopyFrom(NULL,
+										copiedDistributedRelation,
+										copyStatement->filename,
+										copyStatement->is_program,
+										NULL,
+										copyStatement->attlist,
+										copyStatement->options);
 
 	/* set up callback to identify error line number */
 	errorCallback.callback = CopyFromErrorCallback;
@@ -582,24 +662,85 @@ CopyToExistingShards(CopyStmt *copyStatement, char *completionTag)
 	/* all lines have been copied, stop showing line number in errors */
 	error_context_stack = errorCallback.previous;
 
-	/* finish the COPY commands */
-	dest->rShutdown(dest);
-	dest->rDestroy(dest);
-
 	ExecDropSingleTupleTableSlot(tupleTableSlot);
-	FreeExecutorState(executorState);
-	heap_close(distributedRelation, NoLock);
 
-	/* mark failed placements as inactive */
-	MarkFailedShardPlacements();
+	return processedRowCount;
+}
 
-	CHECK_FOR_INTERRUPTS();
 
-	if (completionTag != NULL)
+/*
+ * CopyColumnNameList returns the names of the columns of the given tuple
+ * descriptor that are sent in COPY commands to the workers. Dropped and
+ * generated columns are skipped.
+ */
+List *
+CopyColumnNameList(TupleDesc tupleDescriptor)
+{
+	List *columnNameList = NIL;
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
 	{
-		snprintf(completionTag, COMPLETION_TAG_BUFSIZE,
-				 "COPY " UINT64_FORMAT, processedRowCount);
+		Form_pg_attribute currentColumn = TupleDescAttr(tupleDescriptor, columnIndex);
+		char *columnName = NameStr(currentColumn->attname);
+
+		if (currentColumn->attisdropped
+#if PG_VERSION_NUM >= 120000
+			|| currentColumn->attgenerated == ATTRIBUTE_GENERATED_STORED
+#endif
+			)
+		{
+			continue;
+		}
+
+		columnNameList = lappend(columnNameList, columnName);
+	}
+
+	return columnNameList;
+}
+
+
+/*
+ * CopyRelationForCopyFrom returns a shallow copy of the given distributed
+ * relation that can be passed to BeginCopyFrom to parse rows of the relation.
+ */
+Relation
+CopyRelationForCopyFrom(Relation distributedRelation)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(distributedRelation);
+
+	/*
+	 * Below, we change a few fields in the Relation to control the behaviour
+	 * of BeginCopyFrom. However, we obviously should not do this in relcache
+	 * and therefore make a copy of the Relation.
+	 */
+	Relation copiedDistributedRelation = (Relation) palloc(sizeof(RelationData));
+	Form_pg_class copiedDistributedRelationTuple =
+		(Form_pg_class) palloc(CLASS_TUPLE_SIZE);
+
+	/*
+	 * There is no need to deep copy everything. We will just deep copy of the fields
+	 * we will change.
+	 */
+	memcpy(copiedDistributedRelation, distributedRelation, sizeof(RelationData));
+	memcpy(copiedDistributedRelationTuple, distributedRelation->rd_rel,
+		   CLASS_TUPLE_SIZE);
+
+	copiedDistributedRelation->rd_rel = copiedDistributedRelationTuple;
+	copiedDistributedRelation->rd_att = CreateTupleDescCopyConstr(tupleDescriptor);
+
+	/*
+	 * BeginCopyFrom opens all partitions of given partitioned table with relation_open
+	 * and it expects its caller to close those relations. We do not have direct access
+	 * to opened relations, thus we are changing relkind of partitioned tables so that
+	 * Postgres will treat those tables as regular relations and will not open its
+	 * partitions.
+	 */
+	if (PartitionedTable(RelationGetRelid(distributedRelation)))
+	{
+		copiedDistributedRelationTuple->relkind = RELKIND_RELATION;
 	}
+
+	return copiedDistributedRelation;
 }
 
 
@@ -1664,11 +1805,16 @@ AppendCopyRowData(Datum *valueArray, bool *isNullArray, TupleDesc rowDescriptor,
 			if (!isNull)
 			{
 				FmgrInfo *outputFunctionPointer = &columnOutputFunctions[columnIndex];
-				bytea *outputBytes = SendFunctionCall(outputFunctionPointer, value);
 
-				CopySendInt32(rowOutputState, VARSIZE(outputBytes) - VARHDRSZ);
-				CopySendData(rowOutputState, VARDATA(outputBytes),
-							 VARSIZE(outputBytes) - VARHDRSZ);
+				if (!CopySendFixedWidthBinary(rowOutputState,
+											  outputFunctionPointer->fn_oid, value))
+				{
+					bytea *outputBytes = SendFunctionCall(outputFunctionPointer, value);
+
+					CopySendInt32(rowOutputState, VARSIZE(outputBytes) - VARHDRSZ);
+					CopySendData(rowOutputState, VARDATA(outputBytes),
+								 VARSIZE(outputBytes) - VARHDRSZ);
+				}
 			}
 			else
 			{
@@ -2018,6 +2164,94 @@ CopySendInt16(CopyOutState outputState, int16 val)
 }
 
 
+/* Append an int64 to the copy buffer in outputState. */
+static void
+CopySendInt64(CopyOutState outputState, int64 val)
+{
+	CopySendInt32(outputState, (int32) (val >> 32));
+	CopySendInt32(outputState, (int32) val);
+}
+
+
+/*
+ * CopySendFixedWidthBinary appends the length and binary representation of a
+ * value of a common fixed-width type to the copy buffer, if the given send
+ * function is that of such a type. The bytes are the same as those of the send
+ * function, but we avoid a function call and a palloc for every value, which
+ * adds up when copying large tables. Returns false for any other send function.
+ */
+static bool
+CopySendFixedWidthBinary(CopyOutState outputState, Oid sendFunctionId, Datum value)
+{
+	switch (sendFunctionId)
+	{
+		case F_BOOLSEND:
+		{
+			CopySendInt32(outputState, 1);
+			CopySendChar(outputState, DatumGetBool(value) ? 1 : 0);
+			return true;
+		}
+
+		case F_INT2SEND:
+		{
+			CopySendInt32(outputState, sizeof(int16));
+			CopySendInt16(outputState, DatumGetInt16(value));
+			return true;
+		}
+
+		case F_INT4SEND:
+		case F_DATE_SEND:
+		{
+			CopySendInt32(outputState, sizeof(int32));
+			CopySendInt32(outputState, DatumGetInt32(value));
+			return true;
+		}
+
+		case F_INT8SEND:
+		case F_TIMESTAMP_SEND:
+		case F_TIMESTAMPTZ_SEND:
+		{
+			CopySendInt32(outputState, sizeof(int64));
+			CopySendInt64(outputState, DatumGetInt64(value));
+			return true;
+		}
+
+		case F_FLOAT4SEND:
+		{
+			union
+			{
+				float4 floatValue;
+				int32 intValue;
+			} swap;
+
+			swap.floatValue = DatumGetFloat4(value);
+			CopySendInt32(outputState, sizeof(float4));
+			CopySendInt32(outputState, swap.intValue);
+			return true;
+		}
+
+		case F_FLOAT8SEND:
+		{
+			union
+			{
+				float8 floatValue;
+				int64 intValue;
+			} swap;
+
+			swap.floatValue = DatumGetFloat8(value);
+			CopySendInt32(outputState, sizeof(float8));
+			CopySendInt64(outputState, swap.intValue);
+			return true;
+		}
+
+		default:
+		{
+			return false;
+		}
+	}
+}
+
+
 /*
  * Send text representation of one column, with conversion and escaping.
  *
@@ -2162,6 +2396,7 @@ CreateCitusCopyDestReceiver(Oid tableId, List *columnNameList, int partitionColu
 	copyDest->stopOnFailure = stopOnFailure;
 	copyDest->intermediateResultIdPrefix = intermediateResultIdPrefix;
 	copyDest->memoryContext = CurrentMemoryContext;
+	copyDest->progressOperation = CITUS_OPERATION_COPY;
 
 	return copyDest;
 }
@@ -2192,11 +2427,21 @@ CitusCopyDestReceiverStartup(DestReceiver *dest, int operation,
 	char partitionMethod = '\0';
 
 
-	const char *delimiterCharacter = "\t";
-	const char *nullPrintCharacter = "\\N";
+	/*
+	 * Rows for placements on this node can be copied locally, unless an earlier
+	 * command in the transaction accessed placements over connections, which
+	 * the local copy would not see the changes of.
+	 */
+	copyDest->useLocalCopy = EnableLocalCopy && EnableLocalExecution &&
+							 copyDest->intermediateResultIdPrefix == NULL &&
+							 (LocalExecutionHappened ||
+							  !AnyConnectionAccessedPlacements());
 
-	/* Citus currently doesn't know how to handle COPY command locally */
-	ErrorIfLocalExecutionHappened();
+	/* without local copy, we cannot see the changes of an earlier local execution */
+	if (!copyDest->useLocalCopy)
+	{
+		ErrorIfLocalExecutionHappened();
+	}
 
 	/* look up table properties */
 	Relation distributedRelation = heap_open(tableId, RowExclusiveLock);
@@ -2206,9 +2451,13 @@ CitusCopyDestReceiverStartup(DestReceiver *dest, int operation,
 	copyDest->distributedRelation = distributedRelation;
 	copyDest->tupleDescriptor = inputTupleDescriptor;
 
+	/* shards of time range tables can be created while copying */
+	copyDest->createTimeRangeShards = copyDest->intermediateResultIdPrefix == NULL &&
+									  CanCreateTimeRangeShards(tableId);
+
 	/* load the list of shards and verify that we have shards to copy into */
 	List *shardIntervalList = LoadShardIntervalList(tableId);
-	if (shardIntervalList == NIL)
+	if (shardIntervalList == NIL && !copyDest->createTimeRangeShards)
 	{
 		if (partitionMethod == DISTRIBUTE_BY_HASH)
 		{
@@ -2246,7 +2495,10 @@ CitusCopyDestReceiverStartup(DestReceiver *dest, int operation,
 	 * Prevent concurrent UPDATE/DELETE on replication factor >1
 	 * (see AcquireExecutorMultiShardLocks() at multi_router_executor.c)
 	 */
-	SerializeNonCommutativeWrites(shardIntervalList, RowExclusiveLock);
+	if (shardIntervalList != NIL)
+	{
+		SerializeNonCommutativeWrites(shardIntervalList, RowExclusiveLock);
+	}
 
 	/* keep the table metadata to avoid looking it up for every tuple */
 	copyDest->tableMetadata = cacheEntry;
@@ -2260,30 +2512,9 @@ CitusCopyDestReceiverStartup(DestReceiver *dest, int operation,
 	}
 
 	/* define how tuples will be serialised */
-	CopyOutState copyOutState = (CopyOutState) palloc0(sizeof(CopyOutStateData));
-	copyOutState->delim = (char *) delimiterCharacter;
-	copyOutState->null_print = (char *) nullPrintCharacter;
-	copyOutState->null_print_client = (char *) nullPrintCharacter;
-	copyOutState->binary = CanUseBinaryCopyFormat(inputTupleDescriptor);
-	copyOutState->fe_msgbuf = makeStringInfo();
-	copyOutState->rowcontext = GetPerTupleMemoryContext(copyDest->executorState);
-	copyDest->copyOutState = copyOutState;
+	PrepareCopyRowSerialization(copyDest, inputTupleDescriptor);
 	copyDest->multiShardCopy = false;
 
-	/* prepare functions to call on received tuples */
-	{
-		TupleDesc destTupleDescriptor = distributedRelation->rd_att;
-		int columnCount = inputTupleDescriptor->natts;
-		Oid *finalTypeArray = palloc0(columnCount * sizeof(Oid));
-
-		copyDest->columnCoercionPaths =
-			ColumnCoercionPaths(destTupleDescriptor, inputTupleDescriptor,
-								tableId, columnNameList, finalTypeArray);
-
-		copyDest->columnOutputFunctions =
-			TypeOutputFunctions(columnCount, finalTypeArray, copyOutState->binary);
-	}
-
 	/* ensure the column names are properly quoted in the COPY statement */
 	foreach(columnNameCell, columnNameList)
 	{
@@ -2329,12 +2560,68 @@ CitusCopyDestReceiverStartup(DestReceiver *dest, int operation,
 	copyDest->shardStateHash = CreateShardStateHash(TopTransactionContext);
 	copyDest->connectionStateHash = CreateConnectionStateHash(TopTransactionContext);
 
+	/* copies into intermediate results are reported by the command that uses them */
+	if (copyDest->intermediateResultIdPrefix == NULL)
+	{
+		copyDest->progressMonitor =
+			StartShardOperationProgress(copyDest->progressOperation, tableId,
+										shardIntervalList);
+	}
+
 	RecordRelationAccessIfReferenceTable(tableId, PLACEMENT_ACCESS_DML);
 }
 
 
 /*
- * CitusCopyDestReceiverReceive implements the receiveSlot function of
+ * PrepareCopyRowSerialization sets up the state that is needed to find the
+ * shard of tuples with the given descriptor and to serialise them into COPY
+ * data for the workers. It is called when the receiver starts up, and by
+ * parallel COPY workers that only route and serialise rows.
+ */
+void
+PrepareCopyRowSerialization(CitusCopyDestReceiver *copyDest,
+							TupleDesc inputTupleDescriptor)
+{
+	Oid tableId = copyDest->distributedRelationId;
+	Relation distributedRelation = copyDest->distributedRelation;
+	int columnCount = inputTupleDescriptor->natts;
+
+	const char *delimiterCharacter = "\t";
+	const char *nullPrintCharacter = "\\N";
+
+	copyDest->tableMetadata = DistributedTableCacheEntry(tableId);
+	copyDest->tupleDescriptor = inputTupleDescriptor;
+
+	CopyOutState copyOutState = (CopyOutState) palloc0(sizeof(CopyOutStateData));
+	copyOutState->delim = (char *) delimiterCharacter;
+	copyOutState->null_print = (char *) nullPrintCharacter;
+	copyOutState->null_print_client = (char *) nullPrintCharacter;
+	copyOutState->binary = CanUseBinaryCopyFormat(inputTupleDescriptor);
+	copyOutState->fe_msgbuf = makeStringInfo();
+	copyOutState->rowcontext = GetPerTupleMemoryContext(copyDest->executorState);
+	copyDest->copyOutState = copyOutState;
+
+	int shardCount = copyDest->tableMetadata->shardIntervalArrayLength;
+	copyDest->shardRowDataArray = palloc0(shardCount * sizeof(StringInfo));
+	copyDest->pendingShardIndexArray = palloc0(shardCount * sizeof(int));
+	copyDest->pendingShardCount = 0;
+	copyDest->pendingRowDataSize = 0;
+
+	/* prepare functions to call on received tuples */
+	TupleDesc destTupleDescriptor = distributedRelation->rd_att;
+	Oid *finalTypeArray = palloc0(columnCount * sizeof(Oid));
+
+	copyDest->columnCoercionPaths =
+		ColumnCoercionPaths(destTupleDescriptor, inputTupleDescriptor,
+							tableId, copyDest->columnNameList, finalTypeArray);
+
+	copyDest->columnOutputFunctions =
+		TypeOutputFunctions(columnCount, finalTypeArray, copyOutState->binary);
+}
+
+
+/*
+ * CitusCopyDestReceiverReceive implements the receiveSlot function of
  * CitusCopyDestReceiver. It takes a TupleTableSlot and sends the contents to
  * the appropriate shard placement(s).
  */
@@ -2373,17 +2660,9 @@ static bool
 CitusSendTupleToPlacements(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest)
 {
 	TupleDesc tupleDescriptor = copyDest->tupleDescriptor;
-	CopyStmt *copyStatement = copyDest->copyStatement;
-
 	CopyOutState copyOutState = copyDest->copyOutState;
 	FmgrInfo *columnOutputFunctions = copyDest->columnOutputFunctions;
 	CopyCoercionData *columnCoercionPaths = copyDest->columnCoercionPaths;
-	ListCell *placementStateCell = NULL;
-	bool cachedShardStateFound = false;
-	bool firstTupleInShard = false;
-
-	bool stopOnFailure = copyDest->stopOnFailure;
-
 
 	EState *executorState = copyDest->executorState;
 	MemoryContext executorTupleContext = GetPerTupleMemoryContext(executorState);
@@ -2394,14 +2673,269 @@ CitusSendTupleToPlacements(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest
 	Datum *columnValues = slot->tts_values;
 	bool *columnNulls = slot->tts_isnull;
 
-	int64 shardId = ShardIdForTuple(copyDest, columnValues, columnNulls);
+	int shardIndex = ShardIndexForTuple(copyDest, columnValues, columnNulls);
+
+	/*
+	 * Serialise the tuple once for all placements. The output buffer of the
+	 * copy state is also used for binary headers and footers when placements
+	 * switch over, so the row is kept in the buffer of its shard.
+	 */
+	resetStringInfo(copyOutState->fe_msgbuf);
+	AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
+					  copyOutState, columnOutputFunctions, columnCoercionPaths);
+
+	MemoryContextSwitchTo(oldContext);
+
+	BufferShardRowData(copyDest, shardIndex, copyOutState->fe_msgbuf->data,
+					   copyOutState->fe_msgbuf->len);
+
+	/*
+	 * Release per tuple memory allocated in this function. If we're writing
+	 * the results of an INSERT ... SELECT then the SELECT execution will use
+	 * its own executor state and reset the per tuple expression context
+	 * separately.
+	 */
+	ResetPerTupleExprContext(executorState);
+
+	return true;
+}
+
+
+/*
+ * BufferShardRowData appends a row that is serialised in the COPY format of the
+ * receiver to the buffer of the shard at the given index, and sends the
+ * buffered rows once the shard or all shards together buffered enough of them.
+ */
+static void
+BufferShardRowData(CitusCopyDestReceiver *copyDest, int shardIndex,
+				   const char *rowData, int rowLength)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(copyDest->memoryContext);
+
+	StringInfo shardRowData = copyDest->shardRowDataArray[shardIndex];
+	if (shardRowData == NULL)
+	{
+		shardRowData = makeStringInfo();
+		copyDest->shardRowDataArray[shardIndex] = shardRowData;
+	}
+
+	if (shardRowData->len == 0)
+	{
+		copyDest->pendingShardIndexArray[copyDest->pendingShardCount] = shardIndex;
+		copyDest->pendingShardCount++;
+	}
+
+	appendBinaryStringInfo(shardRowData, rowData, rowLength);
+	copyDest->pendingRowDataSize += rowLength;
+
+	MemoryContextSwitchTo(oldContext);
+
+	UpdateCopyShardProgress(copyDest, shardIndex, INVALID_SHARD_ID, 1, rowLength);
+
+	if (shardRowData->len >= COPY_SHARD_BATCH_SIZE)
+	{
+		FlushCopyShardBatch(copyDest, shardIndex);
+	}
+	else if (copyDest->pendingRowDataSize >= COPY_BUFFERED_DATA_LIMIT)
+	{
+		FlushCopyShardBatches(copyDest);
+	}
+
+	copyDest->tuplesSent++;
+}
+
+
+/*
+ * FlushCopyShardBatches sends the rows that are buffered for each shard to the
+ * placements of that shard, in the order in which the shards first received a
+ * row since the last flush.
+ */
+static void
+FlushCopyShardBatches(CitusCopyDestReceiver *copyDest)
+{
+	ShardInterval **shardIntervalArray = copyDest->tableMetadata->sortedShardIntervalArray;
+
+	for (int pendingIndex = 0; pendingIndex < copyDest->pendingShardCount;
+		 pendingIndex++)
+	{
+		int shardIndex = copyDest->pendingShardIndexArray[pendingIndex];
+		StringInfo shardRowData = copyDest->shardRowDataArray[shardIndex];
+		uint64 shardId = shardIntervalArray[shardIndex]->shardId;
+
+		SendCopyRowDataToPlacements(copyDest, shardId, shardRowData);
+		resetStringInfo(shardRowData);
+	}
+
+	copyDest->pendingShardCount = 0;
+	copyDest->pendingRowDataSize = 0;
+}
+
+
+/*
+ * FlushCopyShardBatch sends the rows that are buffered for the shard at the
+ * given index to its placements, and removes the shard from the pending ones.
+ */
+static void
+FlushCopyShardBatch(CitusCopyDestReceiver *copyDest, int shardIndex)
+{
+	ShardInterval **shardIntervalArray = copyDest->tableMetadata->sortedShardIntervalArray;
+	StringInfo shardRowData = copyDest->shardRowDataArray[shardIndex];
+	uint64 shardId = shardIntervalArray[shardIndex]->shardId;
+
+	SendCopyRowDataToPlacements(copyDest, shardId, shardRowData);
+
+	copyDest->pendingRowDataSize -= shardRowData->len;
+	resetStringInfo(shardRowData);
+
+	for (int pendingIndex = 0; pendingIndex < copyDest->pendingShardCount;
+		 pendingIndex++)
+	{
+		if (copyDest->pendingShardIndexArray[pendingIndex] == shardIndex)
+		{
+			int lastPendingIndex = copyDest->pendingShardCount - 1;
+
+			copyDest->pendingShardIndexArray[pendingIndex] =
+				copyDest->pendingShardIndexArray[lastPendingIndex];
+			copyDest->pendingShardCount--;
+			break;
+		}
+	}
+}
+
+
+/*
+ * CitusSendCopyRowDataToShard sends rows that are already serialised in the
+ * COPY format of the receiver to the placements of the given shard. It is used
+ * when the rows are serialised by parallel COPY workers.
+ */
+void
+CitusSendCopyRowDataToShard(CitusCopyDestReceiver *copyDest, uint64 shardId,
+							StringInfo rowData, int64 rowCount)
+{
+	PG_TRY();
+	{
+		SendCopyRowDataToPlacements(copyDest, shardId, rowData);
+	}
+	PG_CATCH();
+	{
+		/*
+		 * We might be able to recover from errors with ROLLBACK TO SAVEPOINT,
+		 * so unclaim the connections before throwing errors.
+		 */
+		List *connectionStateList = ConnectionStateList(copyDest->connectionStateHash);
+		UnclaimCopyConnections(connectionStateList);
+
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	UpdateCopyShardProgress(copyDest, -1, shardId, rowCount, rowData->len);
+
+	copyDest->tuplesSent += rowCount;
+}
+
+
+/*
+ * UpdateCopyShardProgress adds the given number of rows and bytes to the step
+ * of the progress monitor of the copy for the shard at the given index in the
+ * sorted shard interval array, or for the given shard ID when no index is
+ * given. The steps follow the shard interval array as it was when the copy
+ * started, so shards that are created during the copy are not reported.
+ */
+static void
+UpdateCopyShardProgress(CitusCopyDestReceiver *copyDest, int shardIndex,
+						uint64 shardId, int64 rowCount, uint64 byteCount)
+{
+	ProgressMonitorData *monitor = copyDest->progressMonitor;
+	ShardOperationProgress *step = NULL;
+
+	if (monitor == NULL)
+	{
+		return;
+	}
+
+	if (shardIndex >= 0)
+	{
+		ShardInterval **shardIntervalArray =
+			copyDest->tableMetadata->sortedShardIntervalArray;
+		ShardOperationProgress *stepArray = (ShardOperationProgress *) monitor->steps;
+
+		shardId = shardIntervalArray[shardIndex]->shardId;
+
+		/* the step at the same index is the one for the shard, unless shards were added */
+		if (shardIndex < monitor->stepCount && stepArray[shardIndex].shardId == shardId)
+		{
+			step = &stepArray[shardIndex];
+		}
+	}
+
+	if (step == NULL)
+	{
+		step = FindShardOperationProgress(monitor, shardId);
+		if (step == NULL)
+		{
+			return;
+		}
+	}
+
+	step->status = SHARD_OPERATION_RUNNING;
+	step->rowsProcessed += rowCount;
+	step->bytesProcessed += byteCount;
+}
+
+
+/*
+ * CitusSendCopyRowToShardIndex buffers a single row that is already serialised
+ * in the COPY format of the receiver for the shard at the given index in the
+ * sorted shard interval array. It is used when binary input is passed through
+ * to the shards without parsing the rows.
+ */
+void
+CitusSendCopyRowToShardIndex(CitusCopyDestReceiver *copyDest, int shardIndex,
+							 const char *rowData, int rowLength)
+{
+	PG_TRY();
+	{
+		BufferShardRowData(copyDest, shardIndex, rowData, rowLength);
+	}
+	PG_CATCH();
+	{
+		/*
+		 * We might be able to recover from errors with ROLLBACK TO SAVEPOINT,
+		 * so unclaim the connections before throwing errors.
+		 */
+		List *connectionStateList = ConnectionStateList(copyDest->connectionStateHash);
+		UnclaimCopyConnections(connectionStateList);
+
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+}
+
+
+/*
+ * SendCopyRowDataToPlacements sends the given serialised rows to all the
+ * placements of the given shard. If a placement is not the active placement of
+ * its connection, the rows are buffered until it becomes the active one.
+ */
+static void
+SendCopyRowDataToPlacements(CitusCopyDestReceiver *copyDest, int64 shardId,
+							StringInfo rowData)
+{
+	CopyStmt *copyStatement = copyDest->copyStatement;
+	CopyOutState copyOutState = copyDest->copyOutState;
+	ListCell *placementStateCell = NULL;
+	bool cachedShardStateFound = false;
+	bool firstTupleInShard = false;
+
+	bool stopOnFailure = copyDest->stopOnFailure;
 
 	/* connections hash is kept in memory context */
-	MemoryContextSwitchTo(copyDest->memoryContext);
+	MemoryContext oldContext = MemoryContextSwitchTo(copyDest->memoryContext);
 
 	CopyShardState *shardState = GetShardState(shardId, copyDest->shardStateHash,
 											   copyDest->connectionStateHash,
-											   stopOnFailure,
+											   stopOnFailure, copyDest->useLocalCopy,
 											   &cachedShardStateFound);
 	if (!cachedShardStateFound)
 	{
@@ -2429,7 +2963,7 @@ CitusSendTupleToPlacements(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest
 		CopyConnectionState *connectionState = currentPlacementState->connectionState;
 		CopyPlacementState *activePlacementState = connectionState->activePlacementState;
 		bool switchToCurrentPlacement = false;
-		bool sendTupleOverConnection = false;
+		bool sendRowDataOverConnection = false;
 
 		if (activePlacementState == NULL)
 		{
@@ -2458,57 +2992,185 @@ CitusSendTupleToPlacements(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest
 									connectionState->connection);
 			resetStringInfo(currentPlacementState->data);
 
-			/* additionaly, we need to send the current tuple too */
-			sendTupleOverConnection = true;
+			/* additionaly, we need to send the current rows too */
+			sendRowDataOverConnection = true;
 		}
 		else if (currentPlacementState != activePlacementState)
 		{
 			/* buffer data */
-			StringInfo copyBuffer = copyOutState->fe_msgbuf;
-			resetStringInfo(copyBuffer);
-			AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
-							  copyOutState, columnOutputFunctions,
-							  columnCoercionPaths);
-			appendBinaryStringInfo(currentPlacementState->data, copyBuffer->data,
-								   copyBuffer->len);
+			appendBinaryStringInfo(currentPlacementState->data, rowData->data,
+								   rowData->len);
 		}
 		else
 		{
 			Assert(currentPlacementState == activePlacementState);
-			sendTupleOverConnection = true;
+			sendRowDataOverConnection = true;
 		}
 
-		if (sendTupleOverConnection)
+		if (sendRowDataOverConnection)
 		{
-			resetStringInfo(copyOutState->fe_msgbuf);
-			AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
-							  copyOutState, columnOutputFunctions, columnCoercionPaths);
-			SendCopyDataToPlacement(copyOutState->fe_msgbuf, shardId,
-									connectionState->connection);
+			SendCopyDataToPlacement(rowData, shardId, connectionState->connection);
+		}
+	}
+
+	if (shardState->hasLocalPlacement)
+	{
+		appendBinaryStringInfo(shardState->localCopyBuffer, rowData->data,
+							   rowData->len);
+
+		if (shardState->localCopyBuffer->len >= LOCAL_COPY_FLUSH_THRESHOLD)
+		{
+			FlushLocalCopyBuffer(copyDest, shardState);
 		}
 	}
 
 	MemoryContextSwitchTo(oldContext);
+}
 
-	copyDest->tuplesSent++;
 
-	/*
-	 * Release per tuple memory allocated in this function. If we're writing
-	 * the results of an INSERT ... SELECT then the SELECT execution will use
-	 * its own executor state and reset the per tuple expression context
-	 * separately.
-	 */
-	ResetPerTupleExprContext(executorState);
+/*
+ * FlushLocalCopyBuffer copies the rows that are buffered for the local
+ * placement of the given shard into the shard, using PostgreSQL's COPY with a
+ * data source callback that reads from the buffer. The rows are in the COPY
+ * format of the receiver, so binary headers and footers are added around them.
+ */
+static void
+FlushLocalCopyBuffer(CitusCopyDestReceiver *copyDest, CopyShardState *shardState)
+{
+	Oid relationId = copyDest->distributedRelationId;
+	CopyOutState copyOutState = copyDest->copyOutState;
+	bool binaryCopy = copyOutState->binary;
+	List *options = NIL;
+	List *columnNameList = NIL;
+	char *columnName = NULL;
 
-	return true;
+	if (shardState->localCopyBuffer->len == 0)
+	{
+		return;
+	}
+
+	MemoryContext localCopyContext =
+		AllocSetContextCreateExtended(CurrentMemoryContext,
+									  "FlushLocalCopyBuffer",
+									  ALLOCSET_DEFAULT_MINSIZE,
+									  ALLOCSET_DEFAULT_INITSIZE,
+									  ALLOCSET_DEFAULT_MAXSIZE);
+	MemoryContext oldContext = MemoryContextSwitchTo(localCopyContext);
+
+	char *shardName = get_rel_name(relationId);
+	AppendShardIdToName(&shardName, shardState->shardId);
+
+	Oid shardRelationId = get_relname_relid(shardName, get_rel_namespace(relationId));
+	if (!OidIsValid(shardRelationId))
+	{
+		ereport(ERROR, (errmsg("could not find the local shard %s", shardName)));
+	}
+
+	StringInfo copyData = makeStringInfo();
+	if (binaryCopy)
+	{
+		CopyOutStateData headerOutputState = *copyOutState;
+
+		headerOutputState.fe_msgbuf = copyData;
+		AppendCopyBinaryHeaders(&headerOutputState);
+		appendBinaryStringInfo(copyData, shardState->localCopyBuffer->data,
+							   shardState->localCopyBuffer->len);
+		AppendCopyBinaryFooters(&headerOutputState);
+
+		options = lappend(options, makeDefElem("format", (Node *) makeString("binary"),
+											   -1));
+	}
+	else
+	{
+		appendBinaryStringInfo(copyData, shardState->localCopyBuffer->data,
+							   shardState->localCopyBuffer->len);
+	}
+
+	/* the rows are already in the server encoding */
+	char *encodingName = pstrdup(GetDatabaseEncodingName());
+	options = lappend(options, makeDefElem("encoding", (Node *) makeString(encodingName),
+										   -1));
+
+	foreach_ptr(columnName, copyDest->columnNameList)
+	{
+		columnNameList = lappend(columnNameList, makeString(columnName));
+	}
+
+	Relation shard = heap_open(shardRelationId, RowExclusiveLock);
+	ParseState *parseState = make_parsestate(NULL);
+
+	LocalCopyBuffer = copyData;
+
+	CopyState copyState = BeginCopyFrom(parseState, shard, NULL, false,
+										ReadFromLocalCopyBuffer, columnNameList,
+										options);
+	CopyFrom(copyState);
+	EndCopyFrom(copyState);
+
+	LocalCopyBuffer = NULL;
+	LocalExecutionHappened = true;
+
+	free_parsestate(parseState);
+	heap_close(shard, NoLock);
+
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextDelete(localCopyContext);
+
+	resetStringInfo(shardState->localCopyBuffer);
 }
 
 
 /*
- * ShardIdForTuple returns id of the shard to which the given tuple belongs to.
+ * FlushLocalCopyBuffers copies the rows that are still buffered for local
+ * placements into their shards.
  */
-static uint64
-ShardIdForTuple(CitusCopyDestReceiver *copyDest, Datum *columnValues, bool *columnNulls)
+static void
+FlushLocalCopyBuffers(CitusCopyDestReceiver *copyDest)
+{
+	HASH_SEQ_STATUS status;
+	CopyShardState *shardState = NULL;
+
+	if (!copyDest->useLocalCopy)
+	{
+		return;
+	}
+
+	hash_seq_init(&status, copyDest->shardStateHash);
+
+	while ((shardState = (CopyShardState *) hash_seq_search(&status)) != NULL)
+	{
+		if (shardState->hasLocalPlacement)
+		{
+			FlushLocalCopyBuffer(copyDest, shardState);
+		}
+	}
+}
+
+
+/*
+ * ReadFromLocalCopyBuffer is the data source callback of local COPY. It copies
+ * up to maxRead bytes of LocalCopyBuffer into outBuffer and returns the number
+ * of bytes copied, which is 0 once the buffer is exhausted.
+ */
+static int
+ReadFromLocalCopyBuffer(void *outBuffer, int minRead, int maxRead)
+{
+	int availableBytes = LocalCopyBuffer->len - LocalCopyBuffer->cursor;
+	int bytesRead = Min(availableBytes, maxRead);
+
+	memcpy(outBuffer, LocalCopyBuffer->data + LocalCopyBuffer->cursor, bytesRead);
+	LocalCopyBuffer->cursor += bytesRead;
+
+	return bytesRead;
+}
+
+
+/*
+ * ShardIndexForTuple returns the index of the shard to which the given tuple
+ * belongs to in the sorted shard interval array of the table.
+ */
+int
+ShardIndexForTuple(CitusCopyDestReceiver *copyDest, Datum *columnValues, bool *columnNulls)
 {
 	int partitionColumnIndex = copyDest->partitionColumnIndex;
 	Datum partitionColumnValue = 0;
@@ -2547,22 +3209,221 @@ ShardIdForTuple(CitusCopyDestReceiver *copyDest, Datum *columnValues, bool *colu
 	}
 
 	/*
-	 * Find the shard interval and id for the partition column value for
+	 * Find the shard interval index for the partition column value for
 	 * non-reference tables.
 	 *
 	 * For reference table, this function blindly returns the tables single
 	 * shard.
 	 */
-	ShardInterval *shardInterval = FindShardInterval(partitionColumnValue,
-													 copyDest->tableMetadata);
-	if (shardInterval == NULL)
+	DistTableCacheEntry *cacheEntry = copyDest->tableMetadata;
+	if (cacheEntry->partitionMethod == DISTRIBUTE_BY_HASH)
+	{
+		partitionColumnValue =
+			HashPartitionColumnValue(cacheEntry->hashFunction,
+									 cacheEntry->partitionColumn->varcollid,
+									 partitionColumnValue);
+	}
+
+	int shardIndex = FindShardIntervalIndex(partitionColumnValue, cacheEntry);
+	if (shardIndex == INVALID_SHARD_INDEX && copyDest->createTimeRangeShards)
+	{
+		shardIndex = CreateTimeRangeShardForValue(copyDest, partitionColumnValue);
+	}
+
+	if (shardIndex == INVALID_SHARD_INDEX)
 	{
 		ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
 						errmsg("could not find shard for partition column "
 							   "value")));
 	}
 
-	return shardInterval->shardId;
+	return shardIndex;
+}
+
+
+/*
+ * CanCreateTimeRangeShards returns whether COPY creates the missing shards of
+ * the given table on demand. This is the case for range distributed tables
+ * with a date or timestamp partition column when citus.time_range_shard_interval
+ * is set.
+ */
+bool
+CanCreateTimeRangeShards(Oid relationId)
+{
+	if (TimeRangeShardInterval <= 0)
+	{
+		return false;
+	}
+
+	DistTableCacheEntry *cacheEntry = DistributedTableCacheEntry(relationId);
+	if (cacheEntry->partitionMethod != DISTRIBUTE_BY_RANGE)
+	{
+		return false;
+	}
+
+	Oid partitionColumnType = cacheEntry->partitionColumn->vartype;
+
+	return partitionColumnType == DATEOID || partitionColumnType == TIMESTAMPOID ||
+		   partitionColumnType == TIMESTAMPTZOID;
+}
+
+
+/*
+ * CreateTimeRangeShardForValue creates the shard that the given partition
+ * column value of a time range table falls into, and returns its index in the
+ * sorted shard interval array. The shard covers the time bucket of the value,
+ * where buckets are citus.time_range_shard_interval wide and aligned to
+ * 2000-01-01 00:00. The bucket is narrowed where it overlaps existing shards,
+ * such that the shards of the table remain disjoint and can be pruned with a
+ * binary search.
+ */
+static int
+CreateTimeRangeShardForValue(CitusCopyDestReceiver *copyDest, Datum partitionColumnValue)
+{
+	Oid relationId = copyDest->distributedRelationId;
+	Oid valueTypeId = copyDest->tableMetadata->partitionColumn->vartype;
+	int64 bucketWidth = (int64) TimeRangeShardInterval * USECS_PER_SEC;
+	MemoryContext oldContext = MemoryContextSwitchTo(copyDest->memoryContext);
+
+	if (valueTypeId == DATEOID)
+	{
+		bucketWidth = Max(TimeRangeShardInterval / SECS_PER_DAY, 1);
+
+		if (DATE_NOT_FINITE(DatumGetDateADT(partitionColumnValue)))
+		{
+			ereport(ERROR, (errmsg("cannot create a shard for an infinite date")));
+		}
+	}
+	else if (TIMESTAMP_NOT_FINITE(DatumGetTimestamp(partitionColumnValue)))
+	{
+		ereport(ERROR, (errmsg("cannot create a shard for an infinite timestamp")));
+	}
+
+	/* the buffered rows refer to shard indexes that change with the new shard */
+	FlushCopyShardBatches(copyDest);
+
+	/*
+	 * Serialize shard creation for the table, such that concurrent COPYs don't
+	 * create overlapping shards. Once we get the lock, another COPY might have
+	 * committed the shard we would create.
+	 */
+	LockRelationOid(relationId, ShareUpdateExclusiveLock);
+
+	DistTableCacheEntry *cacheEntry = DistributedTableCacheEntry(relationId);
+	copyDest->tableMetadata = cacheEntry;
+
+	int shardIndex = FindShardIntervalIndex(partitionColumnValue, cacheEntry);
+	if (shardIndex != INVALID_SHARD_INDEX)
+	{
+		ResetShardRowDataArray(copyDest);
+		MemoryContextSwitchTo(oldContext);
+
+		return shardIndex;
+	}
+
+	int64 value = TimeRangeValue(partitionColumnValue, valueTypeId);
+	int64 bucketOffset = value % bucketWidth;
+	if (bucketOffset < 0)
+	{
+		bucketOffset += bucketWidth;
+	}
+
+	int64 shardMinValue = value - bucketOffset;
+	int64 shardMaxValue = shardMinValue + (bucketWidth - 1);
+
+	/* every existing shard lies either entirely below or above the value */
+	for (int intervalIndex = 0; intervalIndex < cacheEntry->shardIntervalArrayLength;
+		 intervalIndex++)
+	{
+		ShardInterval *shardInterval = cacheEntry->sortedShardIntervalArray[intervalIndex];
+		int64 intervalMinValue = TimeRangeValue(shardInterval->minValue, valueTypeId);
+		int64 intervalMaxValue = TimeRangeValue(shardInterval->maxValue, valueTypeId);
+
+		if (intervalMaxValue < value && intervalMaxValue >= shardMinValue)
+		{
+			shardMinValue = intervalMaxValue + 1;
+		}
+		else if (intervalMinValue > value && intervalMinValue <= shardMaxValue)
+		{
+			shardMaxValue = intervalMinValue - 1;
+		}
+	}
+
+	Datum minValueDatum = TimeRangeValueGetDatum(shardMinValue, valueTypeId);
+	Datum maxValueDatum = TimeRangeValueGetDatum(shardMaxValue, valueTypeId);
+	text *minValueText = cstring_to_text(DatumToString(minValueDatum, valueTypeId));
+	text *maxValueText = cstring_to_text(DatumToString(maxValueDatum, valueTypeId));
+
+	uint64 shardId = CreateEmptyShardWithBounds(relationId, minValueText, maxValueText);
+
+	ereport(DEBUG1, (errmsg("created shard " UINT64_FORMAT " for the time range "
+							"from %s to %s", shardId, text_to_cstring(minValueText),
+							text_to_cstring(maxValueText))));
+
+	/* make the new shard visible and lock it like the shards at startup */
+	CommandCounterIncrement();
+
+	cacheEntry = DistributedTableCacheEntry(relationId);
+	copyDest->tableMetadata = cacheEntry;
+
+	ShardInterval *newShardInterval = LoadShardInterval(shardId);
+	List *newShardIntervalList = list_make1(newShardInterval);
+
+	LockShardListMetadata(newShardIntervalList, ShareLock);
+	SerializeNonCommutativeWrites(newShardIntervalList, RowExclusiveLock);
+
+	ResetShardRowDataArray(copyDest);
+	MemoryContextSwitchTo(oldContext);
+
+	return FindShardIntervalIndex(partitionColumnValue, cacheEntry);
+}
+
+
+/*
+ * TimeRangeValue returns the given date or timestamp as an integer, which is
+ * the number of days or microseconds since 2000-01-01 respectively.
+ */
+static int64
+TimeRangeValue(Datum datum, Oid typeId)
+{
+	if (typeId == DATEOID)
+	{
+		return (int64) DatumGetDateADT(datum);
+	}
+
+	return (int64) DatumGetTimestamp(datum);
+}
+
+
+/*
+ * TimeRangeValueGetDatum is the inverse of TimeRangeValue.
+ */
+static Datum
+TimeRangeValueGetDatum(int64 timeRangeValue, Oid typeId)
+{
+	if (typeId == DATEOID)
+	{
+		return DateADTGetDatum((DateADT) timeRangeValue);
+	}
+
+	return TimestampGetDatum((Timestamp) timeRangeValue);
+}
+
+
+/*
+ * ResetShardRowDataArray resizes the per-shard row buffers of the receiver to
+ * the current number of shards of the table. It should only be called when no
+ * rows are buffered.
+ */
+static void
+ResetShardRowDataArray(CitusCopyDestReceiver *copyDest)
+{
+	int shardCount = copyDest->tableMetadata->shardIntervalArrayLength;
+
+	Assert(copyDest->pendingShardCount == 0);
+
+	copyDest->shardRowDataArray = palloc0(shardCount * sizeof(StringInfo));
+	copyDest->pendingShardIndexArray = palloc0(shardCount * sizeof(int));
 }
 
 
@@ -2580,6 +3441,22 @@ CitusCopyDestReceiverShutdown(DestReceiver *destReceiver)
 	ListCell *connectionStateCell = NULL;
 	Relation distributedRelation = copyDest->distributedRelation;
 
+	PG_TRY();
+	{
+		/* send the rows that are still buffered, this may open new connections */
+		FlushCopyShardBatches(copyDest);
+
+		FlushLocalCopyBuffers(copyDest);
+	}
+	PG_CATCH();
+	{
+		List *connectionStateList = ConnectionStateList(connectionStateHash);
+		UnclaimCopyConnections(connectionStateList);
+
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
 	List *connectionStateList = ConnectionStateList(connectionStateHash);
 
 	PG_TRY();
@@ -2604,6 +3481,14 @@ CitusCopyDestReceiverShutdown(DestReceiver *destReceiver)
 	}
 	PG_END_TRY();
 
+	if (copyDest->progressMonitor != NULL)
+	{
+		SetShardOperationProgressStatus(copyDest->progressMonitor,
+										SHARD_OPERATION_DONE);
+		FinalizeCurrentProgressMonitor();
+		copyDest->progressMonitor = NULL;
+	}
+
 	heap_close(distributedRelation, NoLock);
 }
 
@@ -2682,7 +3567,9 @@ CitusCopyDestReceiverDestroy(DestReceiver *destReceiver)
 /*
  * IsCopyResultStmt determines whether the given copy statement is a
  * COPY "resultkey" FROM STDIN WITH (format result) statement, which is used
- * to copy query results from the coordinator into workers.
+ * to copy query results from the coordinator into workers, or a
+ * COPY "resultkey" TO STDOUT WITH (format result) statement, which is used
+ * by workers to fetch query results from each other.
  */
 bool
 IsCopyResultStmt(CopyStmt *copyStatement)
@@ -2729,13 +3616,23 @@ ProcessCopyStmt(CopyStmt *copyStatement, char *completionTag, const char *queryS
 {
 	/*
 	 * Handle special COPY "resultid" FROM STDIN WITH (format result) commands
-	 * for sending intermediate results to workers.
+	 * for sending intermediate results to workers, and COPY "resultid" TO
+	 * STDOUT WITH (format result) commands for fetching them from workers.
 	 */
 	if (IsCopyResultStmt(copyStatement))
 	{
 		const char *resultId = copyStatement->relation->relname;
 
-		ReceiveQueryResultViaCopy(resultId);
+		if (copyStatement->is_from)
+		{
+			bool decompress = CopyStatementRequestsCompression(copyStatement);
+
+			ReceiveQueryResultViaCopy(resultId, decompress);
+		}
+		else
+		{
+			SendQueryResultViaCopy(resultId);
+		}
 
 		return NULL;
 	}
@@ -2811,6 +3708,19 @@ ProcessCopyStmt(CopyStmt *copyStatement, char *completionTag, const char *queryS
 			}
 			else
 			{
+				Oid relationId = RangeVarGetRelid(copyStatement->relation, NoLock,
+												  false);
+
+				/* stream the copy data of the shards to the client if possible */
+				if (CanCopyToStdoutFromShards(copyStatement, relationId))
+				{
+					/* check permissions, we're bypassing postgres' normal checks */
+					CheckCopyPermissions(copyStatement);
+
+					CopyToStdoutFromShards(copyStatement, relationId, completionTag);
+					return NULL;
+				}
+
 				/*
 				 * The copy code only handles SELECTs in COPY ... TO on master tables,
 				 * as that can be done non-invasively. To handle COPY master_rel TO
@@ -3169,12 +4079,59 @@ GetConnectionState(HTAB *connectionStateHash, MultiConnection *connection)
 		connectionState->connection = connection;
 		connectionState->activePlacementState = NULL;
 		dlist_init(&connectionState->bufferedPlacementList);
+		connectionState->placementCount = 0;
 	}
 
 	return connectionState;
 }
 
 
+/*
+ * SharedCopyConnectionState returns the connection state of the COPY
+ * connection to the node of the given placement that has the fewest placements
+ * assigned, if COPY already uses citus.max_copy_connections_per_node
+ * connections to that node. Otherwise, it returns NULL.
+ */
+static CopyConnectionState *
+SharedCopyConnectionState(HTAB *connectionStateHash, ShardPlacement *placement,
+						  const char *userName)
+{
+	HASH_SEQ_STATUS status;
+	CopyConnectionState *connectionState = NULL;
+	CopyConnectionState *sharedConnectionState = NULL;
+	int nodeConnectionCount = 0;
+
+	hash_seq_init(&status, connectionStateHash);
+
+	while ((connectionState = (CopyConnectionState *) hash_seq_search(&status)) != NULL)
+	{
+		MultiConnection *connection = connectionState->connection;
+
+		if (strncmp(connection->hostname, placement->nodeName, MAX_NODE_LENGTH) != 0 ||
+			connection->port != placement->nodePort ||
+			strncmp(connection->user, userName, NAMEDATALEN) != 0)
+		{
+			continue;
+		}
+
+		nodeConnectionCount++;
+
+		if (sharedConnectionState == NULL ||
+			connectionState->placementCount < sharedConnectionState->placementCount)
+		{
+			sharedConnectionState = connectionState;
+		}
+	}
+
+	if (nodeConnectionCount < MaxCopyConnectionsPerNode)
+	{
+		return NULL;
+	}
+
+	return sharedConnectionState;
+}
+
+
 /*
  * ConnectionStateList returns all CopyConnectionState structures in
  * the given hash.
@@ -3207,14 +4164,15 @@ ConnectionStateList(HTAB *connectionStateHash)
  */
 static CopyShardState *
 GetShardState(uint64 shardId, HTAB *shardStateHash,
-			  HTAB *connectionStateHash, bool stopOnFailure, bool *found)
+			  HTAB *connectionStateHash, bool stopOnFailure, bool useLocalCopy,
+			  bool *found)
 {
 	CopyShardState *shardState = (CopyShardState *) hash_search(shardStateHash, &shardId,
 																HASH_ENTER, found);
 	if (!*found)
 	{
 		InitializeCopyShardState(shardState, connectionStateHash,
-								 shardId, stopOnFailure);
+								 shardId, stopOnFailure, useLocalCopy);
 	}
 
 	return shardState;
@@ -3224,12 +4182,14 @@ GetShardState(uint64 shardId, HTAB *shardStateHash,
 /*
  * InitializeCopyShardState initializes the given shardState. It finds all
  * placements for the given shardId, assignes connections to them, and
- * adds them to shardState->placementStateList.
+ * adds them to shardState->placementStateList. If useLocalCopy is true, a
+ * placement on the local node is not assigned a connection, and rows for it
+ * are copied locally instead.
  */
 static void
 InitializeCopyShardState(CopyShardState *shardState,
 						 HTAB *connectionStateHash, uint64 shardId,
-						 bool stopOnFailure)
+						 bool stopOnFailure, bool useLocalCopy)
 {
 	ListCell *placementCell = NULL;
 	int failedPlacementCount = 0;
@@ -3250,13 +4210,22 @@ InitializeCopyShardState(CopyShardState *shardState,
 
 	shardState->shardId = shardId;
 	shardState->placementStateList = NIL;
+	shardState->hasLocalPlacement = false;
+	shardState->localCopyBuffer = NULL;
 
 	foreach(placementCell, finalizedPlacementList)
 	{
 		ShardPlacement *placement = (ShardPlacement *) lfirst(placementCell);
 
+		if (useLocalCopy && placement->groupId == GetLocalGroupId())
+		{
+			shardState->hasLocalPlacement = true;
+			shardState->localCopyBuffer = makeStringInfo();
+			continue;
+		}
+
 		MultiConnection *connection =
-			CopyGetPlacementConnection(placement, stopOnFailure);
+			CopyGetPlacementConnection(placement, connectionStateHash, stopOnFailure);
 		if (connection == NULL)
 		{
 			failedPlacementCount++;
@@ -3275,6 +4244,8 @@ InitializeCopyShardState(CopyShardState *shardState,
 			RemoteTransactionBeginIfNecessary(connection);
 		}
 
+		connectionState->placementCount++;
+
 		CopyPlacementState *placementState = palloc0(sizeof(CopyPlacementState));
 		placementState->shardState = shardState;
 		placementState->data = makeStringInfo();
@@ -3315,7 +4286,8 @@ InitializeCopyShardState(CopyShardState *shardState,
  * then it reuses the connection. Otherwise, it requests a connection for placement.
  */
 static MultiConnection *
-CopyGetPlacementConnection(ShardPlacement *placement, bool stopOnFailure)
+CopyGetPlacementConnection(ShardPlacement *placement, HTAB *connectionStateHash,
+						   bool stopOnFailure)
 {
 	uint32 connectionFlags = FOR_DML;
 	char *nodeUser = CurrentUserName();
@@ -3335,6 +4307,24 @@ CopyGetPlacementConnection(ShardPlacement *placement, bool stopOnFailure)
 		return connection;
 	}
 
+	/*
+	 * Once COPY uses the maximum number of connections to the node, assign the
+	 * placement to one of them. Its rows are buffered while another placement's
+	 * COPY is active on the connection, see CopyConnectionState.
+	 */
+	if (MaxCopyConnectionsPerNode > 0 && MultiShardConnectionType != SEQUENTIAL_CONNECTION)
+	{
+		CopyConnectionState *sharedConnectionState =
+			SharedCopyConnectionState(connectionStateHash, placement, nodeUser);
+		if (sharedConnectionState != NULL)
+		{
+			connection = sharedConnectionState->connection;
+			AssignPlacementListToConnection(list_make1(placementAccess), connection);
+
+			return connection;
+		}
+	}
+
 	/*
 	 * For placements that haven't been assigned a connection by a previous command
 	 * in the current transaction, we use a separate connection per placement for
@@ -0,0 +1,1795 @@
+/*-------------------------------------------------------------------------
+ *
+ * parallel_copy.c
+ *    Routines for parsing and routing the rows of COPY ... FROM on hash,
+ *    range and reference tables in parallel workers.
+ *
+ * A regular COPY into a distributed table parses the input, evaluates the
+ * distribution column, finds the shard and serialises every row on a single
+ * backend, which limits ingestion to the speed of one core. When
+ * citus.max_parallel_copy_workers is set, the backend that runs the COPY (the
+ * leader) only reads the input and splits it into chunks of complete lines.
+ * The chunks are handed out to parallel workers over shared memory queues.
+ * Each worker parses its lines with the regular COPY machinery, finds the
+ * shard of every row and serialises the rows into per-shard batches, which it
+ * sends back to the leader. The leader owns all connections to the workers as
+ * part of its distributed transaction and forwards the batches to the shard
+ * placements without looking at individual rows.
+ *
+ * create_distributed_table uses the same design to copy the existing data of
+ * the local table, in which case the workers scan disjoint blocks of the table
+ * in a parallel scan instead of parsing lines received from the leader.
+ *
+ * Only text and csv input is split, since lines of binary input cannot be
+ * found without parsing it. Like COPY, the leader takes the first line end of
+ * the input to decide whether lines end in a newline or in a carriage return,
+ * such that the workers parse lines with the same line ends. Line numbers in
+ * parse errors refer to the lines parsed by the worker that raised the error,
+ * rather than to the input.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+
+#include "access/genam.h"
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "access/parallel.h"
+#if PG_VERSION_NUM >= 120000
+#include "access/tableam.h"
+#endif
+#include "access/xact.h"
+#include "catalog/indexing.h"
+#include "catalog/pg_constraint.h"
+#include "catalog/pg_type.h"
+#include "commands/copy.h"
+#include "commands/defrem.h"
+#include "distributed/commands/multi_copy.h"
+#include "distributed/commands/parallel_copy.h"
+#include "distributed/transmit.h"
+#include "distributed/version_compat.h"
+#include "executor/executor.h"
+#if PG_VERSION_NUM >= 120000
+#include "optimizer/optimizer.h"
+#else
+#include "optimizer/clauses.h"
+#endif
+#include "libpq/libpq.h"
+#include "mb/pg_wchar.h"
+#include "nodes/makefuncs.h"
+#if PG_VERSION_NUM >= 120000
+#include "nodes/pathnodes.h"
+#else
+#include "nodes/relation.h"
+#endif
+#include "rewrite/rewriteHandler.h"
+#include "storage/fd.h"
+#include "storage/latch.h"
+#include "storage/proc.h"
+#include "storage/shm_mq.h"
+#include "tcop/tcopprot.h"
+#include "utils/builtins.h"
+#include "utils/fmgroids.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/syscache.h"
+
+
+/* keys of the parallel COPY state in the table of contents of the segment */
+#define PARALLEL_COPY_KEY_SHARED UINT64CONST(0xC175000000000001)
+#define PARALLEL_COPY_KEY_OPTIONS UINT64CONST(0xC175000000000002)
+#define PARALLEL_COPY_KEY_INPUT_QUEUES UINT64CONST(0xC175000000000003)
+#define PARALLEL_COPY_KEY_OUTPUT_QUEUES UINT64CONST(0xC175000000000004)
+#define PARALLEL_COPY_KEY_SCAN UINT64CONST(0xC175000000000005)
+
+/* size of each of the shared memory queues between the leader and a worker */
+#define PARALLEL_COPY_QUEUE_SIZE (256 * 1024)
+
+/* minimum size of the chunks of lines that are handed out to workers */
+#define PARALLEL_COPY_CHUNK_SIZE (64 * 1024)
+
+/* size of the blocks in which the input is read from a file or program */
+#define PARALLEL_COPY_READ_SIZE (64 * 1024)
+
+/* size after which a worker sends the rows it serialised for a shard */
+#define PARALLEL_COPY_BATCH_SIZE (64 * 1024)
+
+
+/*
+ * ParallelCopyShared is the fixed-size state that the leader passes to the
+ * parallel workers.
+ */
+typedef struct ParallelCopyShared
+{
+	Oid relationId;
+	int partitionColumnIndex;
+} ParallelCopyShared;
+
+
+/*
+ * ParallelCopyBatchHeader precedes the serialised rows in every message sent
+ * by a worker to the leader.
+ */
+typedef struct ParallelCopyBatchHeader
+{
+	uint64 shardId;
+	int64 rowCount;
+} ParallelCopyBatchHeader;
+
+
+/*
+ * CopyLineEnd is the kind of line end of the input, which is taken from the
+ * first line end like CopyReadLineText does.
+ */
+typedef enum CopyLineEnd
+{
+	COPY_LINE_END_UNKNOWN,
+	COPY_LINE_END_NL,
+	COPY_LINE_END_CR,
+	COPY_LINE_END_CRNL
+} CopyLineEnd;
+
+
+/*
+ * ParallelCopyReader reads the input of a COPY in the leader and splits it
+ * into chunks of complete lines. The fields under "scan state" track where
+ * lines end, for which quotes and escapes need to be taken into account like
+ * CopyReadLineText does.
+ */
+typedef struct ParallelCopyReader
+{
+	/* source of the input; copyFile is NULL when reading from the frontend */
+	FILE *copyFile;
+	bool isProgram;
+	char *fileName;
+	StringInfo copyData;
+	bool frontendCopyDone;
+
+	/* input that has been read, but not yet handed out */
+	StringInfo inputData;
+	bool inputEnded;
+
+	/* format of the input */
+	bool csvMode;
+	char quoteChar;
+	char escapeChar;
+	bool skipHeaderLine;
+
+	/* scan state */
+	CopyLineEnd lineEnd;
+	int scanOffset;
+	int lineStart;
+	int completeLineLength;
+	bool inQuote;
+	bool lastWasEscape;
+	bool escapeNextChar;
+} ParallelCopyReader;
+
+
+/*
+ * ParallelCopyWorker is the leader's view of a single parallel worker.
+ */
+typedef struct ParallelCopyWorker
+{
+	shm_mq_handle *inputQueue;
+	shm_mq_handle *outputQueue;
+
+	/* chunk of lines that is being sent to the worker, empty if none */
+	StringInfo pendingChunk;
+
+	bool inputClosed;
+	bool inputRejected;
+	bool outputFinished;
+} ParallelCopyWorker;
+
+
+/*
+ * ParallelCopyWorkerInput is the worker's view of the chunks of lines it
+ * receives from the leader.
+ */
+typedef struct ParallelCopyWorkerInput
+{
+	shm_mq_handle *inputQueue;
+	char *chunk;
+	Size chunkLength;
+	Size chunkOffset;
+	bool reachedEnd;
+} ParallelCopyWorkerInput;
+
+
+/*
+ * ParallelCopyShardBatch holds the rows a worker serialised for a shard and
+ * has not yet sent to the leader.
+ */
+typedef struct ParallelCopyShardBatch
+{
+	uint64 shardId;
+	int64 rowCount;
+	StringInfo rowData;
+} ParallelCopyShardBatch;
+
+
+/* config variable managed via guc.c */
+int MaxParallelCopyWorkers = 0;
+
+/* input of the COPY in a parallel worker, used by the data source callback */
+static ParallelCopyWorkerInput *CurrentWorkerInput = NULL;
+
+
+/* local function forward declarations */
+static bool CopyOptionCanBeSerialized(DefElem *option);
+static bool CopyColumnsAreParallelSafe(CopyStmt *copyStatement,
+									   Relation distributedRelation);
+static bool ColumnInputIsParallelSafe(Oid typeId);
+static bool DomainConstraintsAreParallelSafe(Oid domainTypeId);
+static bool ExpressionIsParallelSafe(Node *expression);
+static StringInfo SerializeCopyOptions(List *optionList, List *columnNameList);
+static void DeserializeCopyOptions(char *serializedOptions, List **optionList,
+								   List **columnNameList);
+static char * DeserializeString(char **position);
+static ParallelCopyReader * BeginParallelCopyRead(CopyStmt *copyStatement,
+												  int columnCount);
+static void EndParallelCopyRead(ParallelCopyReader *reader);
+static bool ReadNextInputChunk(ParallelCopyReader *reader, StringInfo chunk);
+static bool ReadInputBlock(ParallelCopyReader *reader);
+static void ScanInputLines(ParallelCopyReader *reader);
+static bool IsEndOfCopyMarker(char *line, int lineLength);
+static bool SendChunksToWorker(ParallelCopyReader *reader, ParallelCopyWorker *worker);
+static bool ForwardWorkerBatches(ParallelCopyWorker *worker,
+								 CitusCopyDestReceiver *copyDest,
+								 uint64 *processedRowCount);
+static void WaitForParallelCopyWorkers(void);
+static int ReadParallelCopyInput(void *outbuf, int minread, int maxread);
+static void AddRowToShardBatch(CitusCopyDestReceiver *copyDest,
+							   ParallelCopyShardBatch *shardBatchArray,
+							   Datum *columnValues, bool *columnNulls,
+							   shm_mq_handle *outputQueue);
+static void SendShardBatch(shm_mq_handle *outputQueue, ParallelCopyShardBatch *batch);
+
+
+/*
+ * CanCopyInParallel returns whether the rows of the given COPY ... FROM can be
+ * parsed by parallel workers.
+ */
+bool
+CanCopyInParallel(CopyStmt *copyStatement, Relation distributedRelation)
+{
+	ListCell *optionCell = NULL;
+	int fileEncoding = pg_get_client_encoding();
+
+	if (MaxParallelCopyWorkers <= 0 || IsInParallelMode())
+	{
+		return false;
+	}
+
+	/* parallel workers cannot create the missing shards of time range tables */
+	if (CanCreateTimeRangeShards(RelationGetRelid(distributedRelation)))
+	{
+		return false;
+	}
+
+	/* only the frontend/backend protocol 3 copy sub-protocol is supported */
+	if (copyStatement->filename == NULL &&
+		(whereToSendOutput != DestRemote ||
+		 PG_PROTOCOL_MAJOR(FrontendProtocol) < 3))
+	{
+		return false;
+	}
+
+	foreach(optionCell, copyStatement->options)
+	{
+		DefElem *option = (DefElem *) lfirst(optionCell);
+
+		if (!CopyOptionCanBeSerialized(option))
+		{
+			return false;
+		}
+
+		/* lines of binary input cannot be found without parsing it */
+		if (strcmp(option->defname, "format") == 0 &&
+			strcmp(defGetString(option), "binary") == 0)
+		{
+			return false;
+		}
+		else if (strcmp(option->defname, "encoding") == 0)
+		{
+			fileEncoding = pg_char_to_encoding(defGetString(option));
+		}
+	}
+
+	/*
+	 * Lines are split on single bytes, which is not safe for encodings in which
+	 * the bytes of multi-byte characters can look like ASCII.
+	 */
+	if (fileEncoding < 0 || PG_ENCODING_IS_CLIENT_ONLY(fileEncoding))
+	{
+		return false;
+	}
+
+	return CopyColumnsAreParallelSafe(copyStatement, distributedRelation);
+}
+
+
+/*
+ * CopyOptionCanBeSerialized returns whether the given COPY option can be
+ * passed to the parallel workers. Options that take a list of columns are
+ * not passed, and the COPY is then done without parallel workers.
+ */
+static bool
+CopyOptionCanBeSerialized(DefElem *option)
+{
+	return option->arg == NULL || IsA(option->arg, String) ||
+		   IsA(option->arg, Integer);
+}
+
+
+/*
+ * CopyColumnsAreParallelSafe returns whether the rows of the COPY can be
+ * built in parallel workers. Workers call the input functions of the columns
+ * in the input, which includes checking the constraints of domain types, and
+ * evaluate the default values of the columns that are not in the column list
+ * of the COPY. All of these should be parallel safe. For instance, nextval()
+ * of a serial column cannot be evaluated during a parallel operation.
+ */
+static bool
+CopyColumnsAreParallelSafe(CopyStmt *copyStatement, Relation distributedRelation)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(distributedRelation);
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute column = TupleDescAttr(tupleDescriptor, columnIndex);
+		char *columnName = NameStr(column->attname);
+		bool columnInList = (copyStatement->attlist == NIL);
+		ListCell *attributeCell = NULL;
+
+		if (column->attisdropped)
+		{
+			continue;
+		}
+
+		foreach(attributeCell, copyStatement->attlist)
+		{
+			if (strcmp(strVal(lfirst(attributeCell)), columnName) == 0)
+			{
+				columnInList = true;
+				break;
+			}
+		}
+
+		if (columnInList)
+		{
+			if (!ColumnInputIsParallelSafe(column->atttypid))
+			{
+				return false;
+			}
+
+			continue;
+		}
+
+		Node *defaultExpression = build_column_default(distributedRelation,
+													   columnIndex + 1);
+		if (defaultExpression != NULL && !ExpressionIsParallelSafe(defaultExpression))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * ColumnInputIsParallelSafe returns whether values of the given type can be
+ * parsed in parallel workers, which requires the input function of the type to
+ * be parallel safe. The input functions of arrays and domains also call the
+ * input function of the element or base type, and domains check their
+ * constraints. Composite and range types are not checked in depth and are
+ * treated as unsafe.
+ */
+static bool
+ColumnInputIsParallelSafe(Oid typeId)
+{
+	Oid inputFunctionId = InvalidOid;
+	Oid typeIoParam = InvalidOid;
+	char typeType = get_typtype(typeId);
+
+	if (typeType != TYPTYPE_BASE && typeType != TYPTYPE_DOMAIN &&
+		typeType != TYPTYPE_ENUM)
+	{
+		return false;
+	}
+
+	getTypeInputInfo(typeId, &inputFunctionId, &typeIoParam);
+	if (func_parallel(inputFunctionId) != PROPARALLEL_SAFE)
+	{
+		return false;
+	}
+
+	if (typeType == TYPTYPE_DOMAIN)
+	{
+		HeapTuple typeTuple = SearchSysCache1(TYPEOID, ObjectIdGetDatum(typeId));
+		if (!HeapTupleIsValid(typeTuple))
+		{
+			elog(ERROR, "cache lookup failed for type %u", typeId);
+		}
+
+		Oid baseTypeId = ((Form_pg_type) GETSTRUCT(typeTuple))->typbasetype;
+		ReleaseSysCache(typeTuple);
+
+		return DomainConstraintsAreParallelSafe(typeId) &&
+			   ColumnInputIsParallelSafe(baseTypeId);
+	}
+
+	Oid elementTypeId = get_element_type(typeId);
+	if (OidIsValid(elementTypeId))
+	{
+		return ColumnInputIsParallelSafe(elementTypeId);
+	}
+
+	return true;
+}
+
+
+/*
+ * DomainConstraintsAreParallelSafe returns whether the CHECK constraints of
+ * the given domain, but not those of its base type, are parallel safe.
+ */
+static bool
+DomainConstraintsAreParallelSafe(Oid domainTypeId)
+{
+	ScanKeyData scanKey[1];
+	int scanKeyCount = 1;
+	bool constraintsAreSafe = true;
+
+	Relation pgConstraint = heap_open(ConstraintRelationId, AccessShareLock);
+
+	ScanKeyInit(&scanKey[0], Anum_pg_constraint_contypid, BTEqualStrategyNumber,
+				F_OIDEQ, ObjectIdGetDatum(domainTypeId));
+
+	SysScanDesc scanDescriptor = systable_beginscan(pgConstraint,
+													ConstraintTypidIndexId, true,
+													NULL, scanKeyCount, scanKey);
+
+	HeapTuple heapTuple = systable_getnext(scanDescriptor);
+	while (HeapTupleIsValid(heapTuple))
+	{
+		Form_pg_constraint constraintForm = (Form_pg_constraint) GETSTRUCT(heapTuple);
+		bool isNull = false;
+
+		if (constraintForm->contype == CONSTRAINT_CHECK)
+		{
+			Datum checkDatum = heap_getattr(heapTuple, Anum_pg_constraint_conbin,
+											RelationGetDescr(pgConstraint), &isNull);
+			if (!isNull)
+			{
+				Node *checkExpression = stringToNode(TextDatumGetCString(checkDatum));
+				if (!ExpressionIsParallelSafe(checkExpression))
+				{
+					constraintsAreSafe = false;
+					break;
+				}
+			}
+		}
+
+		heapTuple = systable_getnext(scanDescriptor);
+	}
+
+	systable_endscan(scanDescriptor);
+	heap_close(pgConstraint, AccessShareLock);
+
+	return constraintsAreSafe;
+}
+
+
+/*
+ * ExpressionIsParallelSafe returns whether the given expression may be
+ * evaluated in a parallel worker, using the same checks as the planner does
+ * for expressions in parallel plans. The planner state only makes
+ * is_parallel_safe() walk the expression, since there is no query around it.
+ */
+static bool
+ExpressionIsParallelSafe(Node *expression)
+{
+	PlannerGlobal plannerGlobal;
+	PlannerInfo plannerInfo;
+
+	memset(&plannerGlobal, 0, sizeof(plannerGlobal));
+	memset(&plannerInfo, 0, sizeof(plannerInfo));
+
+	plannerGlobal.type = T_PlannerGlobal;
+	plannerGlobal.maxParallelHazard = PROPARALLEL_UNSAFE;
+
+	plannerInfo.type = T_PlannerInfo;
+	plannerInfo.glob = &plannerGlobal;
+
+	return is_parallel_safe(&plannerInfo, expression);
+}
+
+
+/*
+ * ParallelCopyToExistingShards reads the input of the given COPY statement,
+ * and has parallel workers parse and route its rows. The serialised rows are
+ * sent to the shard placements through the given destination receiver,
+ * which should already be started. The function returns false without
+ * reading any input if no parallel workers could be launched, in which case
+ * the caller should parse the rows itself.
+ */
+bool
+ParallelCopyToExistingShards(CopyStmt *copyStatement, CitusCopyDestReceiver *copyDest,
+							 uint64 *processedRowCount)
+{
+	Relation distributedRelation = copyDest->distributedRelation;
+	TupleDesc tupleDescriptor = RelationGetDescr(distributedRelation);
+	List *workerOptionList = NIL;
+	ListCell *optionCell = NULL;
+	bool inputRejected = false;
+
+	/* raise errors in the options before starting to read input */
+	ProcessCopyOptions(NULL, NULL, true, copyStatement->options);
+
+	/* the leader skips the header line, so workers should not skip lines */
+	foreach(optionCell, copyStatement->options)
+	{
+		DefElem *option = (DefElem *) lfirst(optionCell);
+
+		if (strcmp(option->defname, "header") != 0)
+		{
+			workerOptionList = lappend(workerOptionList, option);
+		}
+	}
+
+	StringInfo serializedOptions = SerializeCopyOptions(workerOptionList,
+														copyStatement->attlist);
+
+	EnterParallelMode();
+
+	ParallelContext *parallelContext =
+		CreateParallelContextCompat("citus", "ParallelCopyWorkerMain",
+									MaxParallelCopyWorkers);
+	int workerCount = parallelContext->nworkers;
+	Size queueSpaceSize = mul_size(PARALLEL_COPY_QUEUE_SIZE, workerCount);
+
+	shm_toc_estimate_chunk(&parallelContext->estimator, sizeof(ParallelCopyShared));
+	shm_toc_estimate_chunk(&parallelContext->estimator, serializedOptions->len + 1);
+	shm_toc_estimate_chunk(&parallelContext->estimator, queueSpaceSize);
+	shm_toc_estimate_chunk(&parallelContext->estimator, queueSpaceSize);
+	shm_toc_estimate_keys(&parallelContext->estimator, 4);
+
+	InitializeParallelDSM(parallelContext);
+
+	ParallelCopyShared *shared =
+		shm_toc_allocate(parallelContext->toc, sizeof(ParallelCopyShared));
+	shared->relationId = copyDest->distributedRelationId;
+	shared->partitionColumnIndex = copyDest->partitionColumnIndex;
+	shm_toc_insert(parallelContext->toc, PARALLEL_COPY_KEY_SHARED, shared);
+
+	char *sharedOptions = shm_toc_allocate(parallelContext->toc,
+										   serializedOptions->len + 1);
+	memcpy(sharedOptions, serializedOptions->data, serializedOptions->len + 1);
+	shm_toc_insert(parallelContext->toc, PARALLEL_COPY_KEY_OPTIONS, sharedOptions);
+
+	char *inputQueueSpace = shm_toc_allocate(parallelContext->toc, queueSpaceSize);
+	char *outputQueueSpace = shm_toc_allocate(parallelContext->toc, queueSpaceSize);
+	shm_toc_insert(parallelContext->toc, PARALLEL_COPY_KEY_INPUT_QUEUES,
+				   inputQueueSpace);
+	shm_toc_insert(parallelContext->toc, PARALLEL_COPY_KEY_OUTPUT_QUEUES,
+				   outputQueueSpace);
+
+	shm_mq **inputQueues = palloc0(workerCount * sizeof(shm_mq *));
+	shm_mq **outputQueues = palloc0(workerCount * sizeof(shm_mq *));
+
+	for (int workerIndex = 0; workerIndex < workerCount; workerIndex++)
+	{
+		Size queueOffset = mul_size(PARALLEL_COPY_QUEUE_SIZE, workerIndex);
+
+		inputQueues[workerIndex] = shm_mq_create(inputQueueSpace + queueOffset,
+												 PARALLEL_COPY_QUEUE_SIZE);
+		shm_mq_set_sender(inputQueues[workerIndex], MyProc);
+
+		outputQueues[workerIndex] = shm_mq_create(outputQueueSpace + queueOffset,
+												  PARALLEL_COPY_QUEUE_SIZE);
+		shm_mq_set_receiver(outputQueues[workerIndex], MyProc);
+	}
+
+	LaunchParallelWorkers(parallelContext);
+
+	int launchedWorkerCount = parallelContext->nworkers_launched;
+	if (launchedWorkerCount == 0)
+	{
+		DestroyParallelContext(parallelContext);
+		ExitParallelMode();
+
+		return false;
+	}
+
+	ereport(DEBUG1, (errmsg("parsing COPY input using %d parallel workers",
+							launchedWorkerCount)));
+
+	ParallelCopyWorker *workerArray = palloc0(launchedWorkerCount *
+											  sizeof(ParallelCopyWorker));
+	for (int workerIndex = 0; workerIndex < launchedWorkerCount; workerIndex++)
+	{
+		ParallelCopyWorker *worker = &workerArray[workerIndex];
+		BackgroundWorkerHandle *workerHandle =
+			parallelContext->worker[workerIndex].bgwhandle;
+
+		worker->inputQueue = shm_mq_attach(inputQueues[workerIndex],
+										   parallelContext->seg, workerHandle);
+		worker->outputQueue = shm_mq_attach(outputQueues[workerIndex],
+											parallelContext->seg, workerHandle);
+		worker->pendingChunk = makeStringInfo();
+	}
+
+	int columnCount = list_length(copyStatement->attlist);
+	if (copyStatement->attlist == NIL)
+	{
+		columnCount = list_length(CopyColumnNameList(tupleDescriptor));
+	}
+
+	ParallelCopyReader *reader = BeginParallelCopyRead(copyStatement, columnCount);
+
+	/*
+	 * Hand out chunks of lines to the workers and forward the rows they send
+	 * back, until all workers have parsed all their input. Queues are used
+	 * without blocking, such that a worker that waits for the leader to read
+	 * its rows never keeps the leader from handing out input to others.
+	 */
+	while (true)
+	{
+		bool madeProgress = false;
+		bool allWorkersFinished = true;
+
+		for (int workerIndex = 0; workerIndex < launchedWorkerCount; workerIndex++)
+		{
+			ParallelCopyWorker *worker = &workerArray[workerIndex];
+
+			if (SendChunksToWorker(reader, worker))
+			{
+				madeProgress = true;
+			}
+
+			if (ForwardWorkerBatches(worker, copyDest, processedRowCount))
+			{
+				madeProgress = true;
+			}
+
+			if (worker->inputRejected)
+			{
+				inputRejected = true;
+			}
+
+			if (!worker->outputFinished)
+			{
+				allWorkersFinished = false;
+			}
+		}
+
+		if (allWorkersFinished)
+		{
+			break;
+		}
+
+		if (!madeProgress)
+		{
+			WaitForParallelCopyWorkers();
+		}
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	/* rethrow errors of the workers */
+	WaitForParallelWorkersToFinish(parallelContext);
+
+	if (inputRejected)
+	{
+		ereport(ERROR, (errmsg("parallel COPY worker exited before parsing all "
+							   "of its input")));
+	}
+
+	EndParallelCopyRead(reader);
+
+	DestroyParallelContext(parallelContext);
+	ExitParallelMode();
+
+	return true;
+}
+
+
+/*
+ * ParallelCopyLocalDataToShards has parallel workers scan the local data of
+ * the given distributed table with the active snapshot and route its rows.
+ * The serialised rows are sent to the shard placements through the given
+ * destination receiver, which should already be started. The function
+ * returns false without copying any rows if no parallel workers could be
+ * launched, in which case the caller should scan the table itself.
+ */
+bool
+ParallelCopyLocalDataToShards(Relation distributedRelation,
+							  CitusCopyDestReceiver *copyDest,
+							  uint64 *processedRowCount)
+{
+	Snapshot snapshot = GetActiveSnapshot();
+
+	/* parallel workers cannot read the local buffers of temporary tables */
+	if (MaxParallelCopyWorkers <= 0 || IsInParallelMode() ||
+		IsolationIsSerializable() || RelationUsesLocalBuffers(distributedRelation))
+	{
+		return false;
+	}
+
+	EnterParallelMode();
+
+	ParallelContext *parallelContext =
+		CreateParallelContextCompat("citus", "ParallelCopyLocalDataWorkerMain",
+									MaxParallelCopyWorkers);
+	int workerCount = parallelContext->nworkers;
+	Size queueSpaceSize = mul_size(PARALLEL_COPY_QUEUE_SIZE, workerCount);
+#if PG_VERSION_NUM >= 120000
+	Size parallelScanSize = table_parallelscan_estimate(distributedRelation, snapshot);
+#else
+	Size parallelScanSize = heap_parallelscan_estimate(snapshot);
+#endif
+
+	shm_toc_estimate_chunk(&parallelContext->estimator, sizeof(ParallelCopyShared));
+	shm_toc_estimate_chunk(&parallelContext->estimator, parallelScanSize);
+	shm_toc_estimate_chunk(&parallelContext->estimator, queueSpaceSize);
+	shm_toc_estimate_keys(&parallelContext->estimator, 3);
+
+	InitializeParallelDSM(parallelContext);
+
+	ParallelCopyShared *shared =
+		shm_toc_allocate(parallelContext->toc, sizeof(ParallelCopyShared));
+	shared->relationId = copyDest->distributedRelationId;
+	shared->partitionColumnIndex = copyDest->partitionColumnIndex;
+	shm_toc_insert(parallelContext->toc, PARALLEL_COPY_KEY_SHARED, shared);
+
+#if PG_VERSION_NUM >= 120000
+	ParallelTableScanDesc parallelScan =
+		shm_toc_allocate(parallelContext->toc, parallelScanSize);
+	table_parallelscan_initialize(distributedRelation, parallelScan, snapshot);
+#else
+	ParallelHeapScanDesc parallelScan =
+		shm_toc_allocate(parallelContext->toc, parallelScanSize);
+	heap_parallelscan_initialize(parallelScan, distributedRelation, snapshot);
+#endif
+	shm_toc_insert(parallelContext->toc, PARALLEL_COPY_KEY_SCAN, parallelScan);
+
+	char *outputQueueSpace = shm_toc_allocate(parallelContext->toc, queueSpaceSize);
+	shm_toc_insert(parallelContext->toc, PARALLEL_COPY_KEY_OUTPUT_QUEUES,
+				   outputQueueSpace);
+
+	shm_mq **outputQueues = palloc0(workerCount * sizeof(shm_mq *));
+
+	for (int workerIndex = 0; workerIndex < workerCount; workerIndex++)
+	{
+		Size queueOffset = mul_size(PARALLEL_COPY_QUEUE_SIZE, workerIndex);
+
+		outputQueues[workerIndex] = shm_mq_create(outputQueueSpace + queueOffset,
+												  PARALLEL_COPY_QUEUE_SIZE);
+		shm_mq_set_receiver(outputQueues[workerIndex], MyProc);
+	}
+
+	LaunchParallelWorkers(parallelContext);
+
+	int launchedWorkerCount = parallelContext->nworkers_launched;
+	if (launchedWorkerCount == 0)
+	{
+		DestroyParallelContext(parallelContext);
+		ExitParallelMode();
+
+		return false;
+	}
+
+	ereport(DEBUG1, (errmsg("scanning local data using %d parallel workers",
+							launchedWorkerCount)));
+
+	ParallelCopyWorker *workerArray = palloc0(launchedWorkerCount *
+											  sizeof(ParallelCopyWorker));
+	for (int workerIndex = 0; workerIndex < launchedWorkerCount; workerIndex++)
+	{
+		ParallelCopyWorker *worker = &workerArray[workerIndex];
+		BackgroundWorkerHandle *workerHandle =
+			parallelContext->worker[workerIndex].bgwhandle;
+
+		/* the workers find their rows in the parallel scan */
+		worker->inputClosed = true;
+		worker->outputQueue = shm_mq_attach(outputQueues[workerIndex],
+											parallelContext->seg, workerHandle);
+	}
+
+	/* forward the rows the workers send, until all workers have scanned the table */
+	while (true)
+	{
+		bool madeProgress = false;
+		bool allWorkersFinished = true;
+
+		for (int workerIndex = 0; workerIndex < launchedWorkerCount; workerIndex++)
+		{
+			ParallelCopyWorker *worker = &workerArray[workerIndex];
+
+			if (ForwardWorkerBatches(worker, copyDest, processedRowCount))
+			{
+				madeProgress = true;
+			}
+
+			if (!worker->outputFinished)
+			{
+				allWorkersFinished = false;
+			}
+		}
+
+		if (allWorkersFinished)
+		{
+			break;
+		}
+
+		if (!madeProgress)
+		{
+			WaitForParallelCopyWorkers();
+		}
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	/* rethrow errors of the workers */
+	WaitForParallelWorkersToFinish(parallelContext);
+
+	DestroyParallelContext(parallelContext);
+	ExitParallelMode();
+
+	return true;
+}
+
+
+/*
+ * WaitForParallelCopyWorkers waits until a parallel worker sets the latch of
+ * the leader, which happens when it sends to or reads from one of the queues.
+ */
+static void
+WaitForParallelCopyWorkers(void)
+{
+	int latchFlags = WL_LATCH_SET | WL_POSTMASTER_DEATH;
+
+	int rc = WaitLatch(MyLatch, latchFlags, -1L, PG_WAIT_EXTENSION);
+	ResetLatch(MyLatch);
+
+	/* emergency bailout if postmaster has died */
+	if (rc & WL_POSTMASTER_DEATH)
+	{
+		proc_exit(1);
+	}
+}
+
+
+/*
+ * SendChunksToWorker hands out a new chunk of lines to the given worker if it
+ * has none, and puts as much of the pending chunk in the input queue of the
+ * worker as fits. Once the input is exhausted, the queue is detached to let
+ * the worker know it has reached the end. The function returns whether any
+ * progress was made.
+ */
+static bool
+SendChunksToWorker(ParallelCopyReader *reader, ParallelCopyWorker *worker)
+{
+	StringInfo pendingChunk = worker->pendingChunk;
+	bool madeProgress = false;
+
+	if (worker->inputClosed)
+	{
+		return false;
+	}
+
+	if (pendingChunk->len == 0 && !reader->inputEnded)
+	{
+		ReadNextInputChunk(reader, pendingChunk);
+		madeProgress = true;
+	}
+
+	if (pendingChunk->len > 0)
+	{
+		shm_mq_result result = shm_mq_send(worker->inputQueue, pendingChunk->len,
+										   pendingChunk->data, true);
+		if (result == SHM_MQ_SUCCESS)
+		{
+			resetStringInfo(pendingChunk);
+			madeProgress = true;
+		}
+		else if (result == SHM_MQ_DETACHED)
+		{
+			/* the worker exited, the error is rethrown after all workers finish */
+			worker->inputClosed = true;
+			worker->inputRejected = true;
+
+			return true;
+		}
+	}
+
+	if (pendingChunk->len == 0 && reader->inputEnded)
+	{
+		shm_mq_detach(worker->inputQueue);
+		worker->inputClosed = true;
+		madeProgress = true;
+	}
+
+	return madeProgress;
+}
+
+
+/*
+ * ForwardWorkerBatches sends the batches of rows that are waiting in the
+ * output queue of the given worker to the shard placements. The function
+ * returns whether any batches were forwarded.
+ */
+static bool
+ForwardWorkerBatches(ParallelCopyWorker *worker, CitusCopyDestReceiver *copyDest,
+					 uint64 *processedRowCount)
+{
+	bool madeProgress = false;
+
+	while (!worker->outputFinished)
+	{
+		Size messageLength = 0;
+		void *messageData = NULL;
+		ParallelCopyBatchHeader batchHeader;
+
+		shm_mq_result result = shm_mq_receive(worker->outputQueue, &messageLength,
+											  &messageData, true);
+		if (result == SHM_MQ_WOULD_BLOCK)
+		{
+			break;
+		}
+		else if (result == SHM_MQ_DETACHED)
+		{
+			worker->outputFinished = true;
+			madeProgress = true;
+			break;
+		}
+
+		if (messageLength < sizeof(ParallelCopyBatchHeader))
+		{
+			ereport(ERROR, (errmsg("invalid message received from parallel COPY "
+								   "worker")));
+		}
+
+		memcpy(&batchHeader, messageData, sizeof(ParallelCopyBatchHeader));
+
+		/* refer to the rows in the queue rather than copying them */
+		StringInfoData rowData;
+		rowData.data = ((char *) messageData) + sizeof(ParallelCopyBatchHeader);
+		rowData.len = messageLength - sizeof(ParallelCopyBatchHeader);
+		rowData.maxlen = rowData.len;
+		rowData.cursor = 0;
+
+		CitusSendCopyRowDataToShard(copyDest, batchHeader.shardId, &rowData,
+									batchHeader.rowCount);
+
+		*processedRowCount += batchHeader.rowCount;
+		madeProgress = true;
+	}
+
+	return madeProgress;
+}
+
+
+/*
+ * BeginParallelCopyRead opens the data source of the given COPY statement in
+ * the leader. When reading from the frontend, the copy sub-protocol is started
+ * for the given number of columns.
+ */
+static ParallelCopyReader *
+BeginParallelCopyRead(CopyStmt *copyStatement, int columnCount)
+{
+	ParallelCopyReader *reader = palloc0(sizeof(ParallelCopyReader));
+	ListCell *optionCell = NULL;
+	char *quoteString = NULL;
+	char *escapeString = NULL;
+
+	foreach(optionCell, copyStatement->options)
+	{
+		DefElem *option = (DefElem *) lfirst(optionCell);
+
+		if (strcmp(option->defname, "format") == 0)
+		{
+			reader->csvMode = (strcmp(defGetString(option), "csv") == 0);
+		}
+		else if (strcmp(option->defname, "header") == 0)
+		{
+			reader->skipHeaderLine = defGetBoolean(option);
+		}
+		else if (strcmp(option->defname, "quote") == 0)
+		{
+			quoteString = defGetString(option);
+		}
+		else if (strcmp(option->defname, "escape") == 0)
+		{
+			escapeString = defGetString(option);
+		}
+	}
+
+	/* ProcessCopyOptions already checked the option values */
+	reader->quoteChar = (quoteString != NULL) ? quoteString[0] : '"';
+	reader->escapeChar = (escapeString != NULL) ? escapeString[0] : reader->quoteChar;
+
+	reader->inputData = makeStringInfo();
+	reader->copyData = makeStringInfo();
+	reader->fileName = copyStatement->filename;
+	reader->isProgram = copyStatement->is_program;
+
+	if (copyStatement->filename == NULL)
+	{
+		SendCopyInStart(false, columnCount);
+	}
+	else if (copyStatement->is_program)
+	{
+		reader->copyFile = OpenPipeStream(copyStatement->filename, PG_BINARY_R);
+		if (reader->copyFile == NULL)
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not execute command \"%s\": %m",
+								   copyStatement->filename)));
+		}
+	}
+	else
+	{
+		reader->copyFile = AllocateFile(copyStatement->filename, PG_BINARY_R);
+		if (reader->copyFile == NULL)
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not open file \"%s\" for reading: %m",
+								   copyStatement->filename)));
+		}
+	}
+
+	return reader;
+}
+
+
+/*
+ * EndParallelCopyRead closes the data source of the COPY.
+ */
+static void
+EndParallelCopyRead(ParallelCopyReader *reader)
+{
+	if (reader->copyFile == NULL)
+	{
+		return;
+	}
+
+	if (reader->isProgram)
+	{
+		int closeResult = ClosePipeStream(reader->copyFile);
+		if (closeResult == -1)
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not close pipe to external command: %m")));
+		}
+		else if (closeResult != 0)
+		{
+			ereport(ERROR, (errcode(ERRCODE_EXTERNAL_ROUTINE_EXCEPTION),
+							errmsg("program \"%s\" failed", reader->fileName),
+							errdetail_internal("%s", wait_result_to_str(closeResult))));
+		}
+	}
+	else if (FreeFile(reader->copyFile) != 0)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not close file \"%s\": %m", reader->fileName)));
+	}
+
+	reader->copyFile = NULL;
+}
+
+
+/*
+ * ReadNextInputChunk appends the next chunk of complete lines of the input to
+ * the given buffer, reading more input if needed. A chunk contains at least
+ * PARALLEL_COPY_CHUNK_SIZE bytes unless the input ends. The function returns
+ * false if there was no more input.
+ */
+static bool
+ReadNextInputChunk(ParallelCopyReader *reader, StringInfo chunk)
+{
+	StringInfo inputData = reader->inputData;
+
+	while (!reader->inputEnded &&
+		   reader->completeLineLength < PARALLEL_COPY_CHUNK_SIZE)
+	{
+		if (!ReadInputBlock(reader))
+		{
+			reader->inputEnded = true;
+			break;
+		}
+
+		ScanInputLines(reader);
+	}
+
+	int chunkLength = reader->completeLineLength;
+
+	if (reader->inputEnded)
+	{
+		/*
+		 * A final line without a newline may be the end-of-copy marker, or the
+		 * header line if there are no other lines.
+		 */
+		int finalLineLength = inputData->len - reader->lineStart;
+		if (reader->skipHeaderLine ||
+			IsEndOfCopyMarker(inputData->data + reader->lineStart, finalLineLength))
+		{
+			inputData->len = reader->lineStart;
+		}
+
+		chunkLength = inputData->len;
+	}
+
+	if (chunkLength == 0)
+	{
+		return false;
+	}
+
+	appendBinaryStringInfo(chunk, inputData->data, chunkLength);
+
+	/* keep the remaining incomplete line for the next chunk */
+	memmove(inputData->data, inputData->data + chunkLength,
+			inputData->len - chunkLength);
+	inputData->len -= chunkLength;
+	inputData->data[inputData->len] = '\0';
+
+	reader->scanOffset -= chunkLength;
+	reader->lineStart -= chunkLength;
+	reader->completeLineLength = 0;
+
+	return true;
+}
+
+
+/*
+ * ReadInputBlock appends the next block of input to the input buffer of the
+ * reader and returns false if the input has ended.
+ */
+static bool
+ReadInputBlock(ParallelCopyReader *reader)
+{
+	StringInfo inputData = reader->inputData;
+
+	if (reader->copyFile != NULL)
+	{
+		enlargeStringInfo(inputData, PARALLEL_COPY_READ_SIZE);
+
+		size_t bytesRead = fread(inputData->data + inputData->len, 1,
+								 PARALLEL_COPY_READ_SIZE, reader->copyFile);
+		if (ferror(reader->copyFile))
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not read from COPY file: %m")));
+		}
+
+		inputData->len += bytesRead;
+		inputData->data[inputData->len] = '\0';
+
+		return bytesRead > 0;
+	}
+
+	while (!reader->frontendCopyDone)
+	{
+		StringInfo copyData = reader->copyData;
+
+		resetStringInfo(copyData);
+		reader->frontendCopyDone = ReceiveCopyData(copyData);
+
+		if (copyData->len > 0)
+		{
+			appendBinaryStringInfo(inputData, copyData->data, copyData->len);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * ScanInputLines scans the part of the input buffer that has not been scanned
+ * yet for the ends of lines. Lines end in a carriage return if the first line
+ * end of the input is a bare carriage return, and in a newline otherwise.
+ * Line ends that are escaped in text format or that are in quoted values in
+ * csv format do not end a line. When the end-of-copy marker is found, the
+ * input is truncated before it and the remaining data from the frontend is
+ * discarded, like COPY does.
+ */
+static void
+ScanInputLines(ParallelCopyReader *reader)
+{
+	StringInfo inputData = reader->inputData;
+
+	while (reader->scanOffset < inputData->len)
+	{
+		char currentChar = inputData->data[reader->scanOffset];
+		reader->scanOffset++;
+
+		if (reader->csvMode)
+		{
+			if (reader->lastWasEscape)
+			{
+				reader->lastWasEscape = false;
+				continue;
+			}
+
+			if (reader->inQuote && currentChar == reader->escapeChar &&
+				reader->escapeChar != reader->quoteChar)
+			{
+				reader->lastWasEscape = true;
+				continue;
+			}
+
+			if (currentChar == reader->quoteChar)
+			{
+				reader->inQuote = !reader->inQuote;
+			}
+
+			if (reader->inQuote)
+			{
+				continue;
+			}
+		}
+		else
+		{
+			if (reader->escapeNextChar)
+			{
+				reader->escapeNextChar = false;
+				continue;
+			}
+
+			if (currentChar == '\\')
+			{
+				reader->escapeNextChar = true;
+				continue;
+			}
+		}
+
+		if (reader->lineEnd == COPY_LINE_END_UNKNOWN)
+		{
+			if (currentChar == '\r')
+			{
+				if (reader->scanOffset == inputData->len)
+				{
+					/* the kind of line end depends on the next byte */
+					reader->scanOffset--;
+					return;
+				}
+
+				bool nextIsNewline = (inputData->data[reader->scanOffset] == '\n');
+				reader->lineEnd = nextIsNewline ? COPY_LINE_END_CRNL : COPY_LINE_END_CR;
+			}
+			else if (currentChar == '\n')
+			{
+				reader->lineEnd = COPY_LINE_END_NL;
+			}
+		}
+
+		/*
+		 * Carriage returns in input with other line ends are left for the
+		 * worker, which raises the same error as COPY does.
+		 */
+		char lineEndChar = (reader->lineEnd == COPY_LINE_END_CR) ? '\r' : '\n';
+		if (currentChar != lineEndChar)
+		{
+			continue;
+		}
+
+		/* reached the end of a line */
+		char *line = inputData->data + reader->lineStart;
+		int lineLength = reader->scanOffset - reader->lineStart;
+
+		if (IsEndOfCopyMarker(line, lineLength))
+		{
+			inputData->len = reader->lineStart;
+			inputData->data[inputData->len] = '\0';
+			reader->scanOffset = inputData->len;
+			reader->completeLineLength = inputData->len;
+			reader->inputEnded = true;
+
+			while (reader->copyFile == NULL && !reader->frontendCopyDone)
+			{
+				resetStringInfo(reader->copyData);
+				reader->frontendCopyDone = ReceiveCopyData(reader->copyData);
+			}
+
+			return;
+		}
+
+		if (reader->skipHeaderLine)
+		{
+			/* drop the header line, which is always the first line */
+			memmove(inputData->data, inputData->data + reader->scanOffset,
+					inputData->len - reader->scanOffset);
+			inputData->len -= reader->scanOffset;
+			inputData->data[inputData->len] = '\0';
+
+			reader->scanOffset = 0;
+			reader->skipHeaderLine = false;
+			continue;
+		}
+
+		reader->lineStart = reader->scanOffset;
+		reader->completeLineLength = reader->scanOffset;
+	}
+}
+
+
+/*
+ * IsEndOfCopyMarker returns whether the given line, which may end in a line end,
+ * consists of the end-of-copy marker \. only.
+ */
+static bool
+IsEndOfCopyMarker(char *line, int lineLength)
+{
+	if (lineLength > 0 && line[lineLength - 1] == '\n')
+	{
+		lineLength--;
+	}
+
+	if (lineLength > 0 && line[lineLength - 1] == '\r')
+	{
+		lineLength--;
+	}
+
+	return lineLength == 2 && line[0] == '\\' && line[1] == '.';
+}
+
+
+/*
+ * SerializeCopyOptions serialises the given COPY options and column names into
+ * a string that is passed to the parallel workers. Every option is written as
+ * its name, a type character and its value, all terminated by a null byte.
+ */
+static StringInfo
+SerializeCopyOptions(List *optionList, List *columnNameList)
+{
+	StringInfo serializedOptions = makeStringInfo();
+	ListCell *optionCell = NULL;
+	ListCell *columnNameCell = NULL;
+
+	appendStringInfo(serializedOptions, "%d", list_length(optionList));
+	appendStringInfoChar(serializedOptions, '\0');
+
+	foreach(optionCell, optionList)
+	{
+		DefElem *option = (DefElem *) lfirst(optionCell);
+
+		appendStringInfoString(serializedOptions, option->defname);
+		appendStringInfoChar(serializedOptions, '\0');
+
+		if (option->arg == NULL)
+		{
+			appendStringInfoChar(serializedOptions, 'n');
+			appendStringInfoChar(serializedOptions, '\0');
+		}
+		else if (IsA(option->arg, Integer))
+		{
+			appendStringInfoChar(serializedOptions, 'i');
+			appendStringInfo(serializedOptions, "%ld", (long) intVal(option->arg));
+		}
+		else
+		{
+			appendStringInfoChar(serializedOptions, 's');
+			appendStringInfoString(serializedOptions, strVal(option->arg));
+		}
+
+		appendStringInfoChar(serializedOptions, '\0');
+	}
+
+	appendStringInfo(serializedOptions, "%d", list_length(columnNameList));
+	appendStringInfoChar(serializedOptions, '\0');
+
+	foreach(columnNameCell, columnNameList)
+	{
+		appendStringInfoString(serializedOptions, strVal(lfirst(columnNameCell)));
+		appendStringInfoChar(serializedOptions, '\0');
+	}
+
+	return serializedOptions;
+}
+
+
+/*
+ * DeserializeCopyOptions reconstructs the COPY options and column names that
+ * were serialised by SerializeCopyOptions.
+ */
+static void
+DeserializeCopyOptions(char *serializedOptions, List **optionList,
+					   List **columnNameList)
+{
+	char *position = serializedOptions;
+
+	int optionCount = pg_atoi(DeserializeString(&position), sizeof(int32), 0);
+	for (int optionIndex = 0; optionIndex < optionCount; optionIndex++)
+	{
+		char *optionName = DeserializeString(&position);
+		char *optionValue = DeserializeString(&position);
+		char optionType = optionValue[0];
+		Node *optionArgument = NULL;
+
+		if (optionType == 'i')
+		{
+			optionArgument = (Node *) makeInteger(pg_atoi(optionValue + 1,
+														  sizeof(int32), 0));
+		}
+		else if (optionType == 's')
+		{
+			optionArgument = (Node *) makeString(pstrdup(optionValue + 1));
+		}
+
+		*optionList = lappend(*optionList, makeDefElem(pstrdup(optionName),
+													   optionArgument, -1));
+	}
+
+	int columnCount = pg_atoi(DeserializeString(&position), sizeof(int32), 0);
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		char *columnName = DeserializeString(&position);
+
+		*columnNameList = lappend(*columnNameList, makeString(pstrdup(columnName)));
+	}
+}
+
+
+/*
+ * DeserializeString returns the null-terminated string at the given position
+ * and advances the position past it.
+ */
+static char *
+DeserializeString(char **position)
+{
+	char *string = *position;
+
+	*position += strlen(string) + 1;
+
+	return string;
+}
+
+
+/*
+ * ParallelCopyWorkerMain is the entry point of parallel COPY workers. A worker
+ * parses the lines it receives from the leader, finds the shard of every row,
+ * and sends the rows back in batches per shard in the COPY format that the
+ * leader uses for the shard placements.
+ */
+void
+ParallelCopyWorkerMain(dsm_segment *segment, shm_toc *toc)
+{
+	ParallelCopyShared *shared = shm_toc_lookup(toc, PARALLEL_COPY_KEY_SHARED, false);
+	char *serializedOptions = shm_toc_lookup(toc, PARALLEL_COPY_KEY_OPTIONS, false);
+	char *inputQueueSpace = shm_toc_lookup(toc, PARALLEL_COPY_KEY_INPUT_QUEUES, false);
+	char *outputQueueSpace = shm_toc_lookup(toc, PARALLEL_COPY_KEY_OUTPUT_QUEUES,
+											false);
+	Size queueOffset = mul_size(PARALLEL_COPY_QUEUE_SIZE, ParallelWorkerNumber);
+	List *optionList = NIL;
+	List *columnNameList = NIL;
+
+	shm_mq *inputQueue = (shm_mq *) (inputQueueSpace + queueOffset);
+	shm_mq_set_receiver(inputQueue, MyProc);
+
+	shm_mq *outputQueue = (shm_mq *) (outputQueueSpace + queueOffset);
+	shm_mq_set_sender(outputQueue, MyProc);
+
+	ParallelCopyWorkerInput *workerInput = palloc0(sizeof(ParallelCopyWorkerInput));
+	workerInput->inputQueue = shm_mq_attach(inputQueue, segment, NULL);
+	CurrentWorkerInput = workerInput;
+
+	shm_mq_handle *outputHandle = shm_mq_attach(outputQueue, segment, NULL);
+
+	DeserializeCopyOptions(serializedOptions, &optionList, &columnNameList);
+
+	/* the leader holds a RowExclusiveLock, which our lock group shares */
+	Relation distributedRelation = heap_open(shared->relationId, AccessShareLock);
+	TupleDesc tupleDescriptor = RelationGetDescr(distributedRelation);
+	uint32 columnCount = tupleDescriptor->natts;
+	Datum *columnValues = palloc0(columnCount * sizeof(Datum));
+	bool *columnNulls = palloc0(columnCount * sizeof(bool));
+
+	EState *executorState = CreateExecutorState();
+	MemoryContext executorTupleContext = GetPerTupleMemoryContext(executorState);
+	ExprContext *executorExpressionContext = GetPerTupleExprContext(executorState);
+
+	CitusCopyDestReceiver *copyDest =
+		CreateCitusCopyDestReceiver(shared->relationId,
+									CopyColumnNameList(tupleDescriptor),
+									shared->partitionColumnIndex, executorState,
+									false, NULL);
+	copyDest->distributedRelation = distributedRelation;
+	PrepareCopyRowSerialization(copyDest, tupleDescriptor);
+
+	/* batches are indexed by the index of their shard in the sorted shard array */
+	int shardCount = copyDest->tableMetadata->shardIntervalArrayLength;
+	ParallelCopyShardBatch *shardBatchArray =
+		palloc0(shardCount * sizeof(ParallelCopyShardBatch));
+
+	Relation copiedDistributedRelation = CopyRelationForCopyFrom(distributedRelation);
+	CopyState copyState = BeginCopyFrom(NULL, copiedDistributedRelation, NULL, false,
+										ReadParallelCopyInput, columnNameList,
+										optionList);
+
+	ErrorContextCallback errorCallback;
+	errorCallback.callback = CopyFromErrorCallback;
+	errorCallback.arg = (void *) copyState;
+	errorCallback.previous = error_context_stack;
+	error_context_stack = &errorCallback;
+
+	while (true)
+	{
+		ResetPerTupleExprContext(executorState);
+
+		MemoryContext oldContext = MemoryContextSwitchTo(executorTupleContext);
+
+		/* parse a row from the input */
+		bool nextRowFound = NextCopyFromCompat(copyState, executorExpressionContext,
+											   columnValues, columnNulls);
+
+		MemoryContextSwitchTo(oldContext);
+
+		if (!nextRowFound)
+		{
+			break;
+		}
+
+		CHECK_FOR_INTERRUPTS();
+
+		AddRowToShardBatch(copyDest, shardBatchArray, columnValues, columnNulls,
+						   outputHandle);
+	}
+
+	EndCopyFrom(copyState);
+
+	error_context_stack = errorCallback.previous;
+
+	/* send the remaining rows */
+	for (int shardIndex = 0; shardIndex < shardCount; shardIndex++)
+	{
+		SendShardBatch(outputHandle, &shardBatchArray[shardIndex]);
+	}
+
+	FreeExecutorState(executorState);
+	heap_close(distributedRelation, NoLock);
+
+	shm_mq_detach(outputHandle);
+	CurrentWorkerInput = NULL;
+}
+
+
+/*
+ * ReadParallelCopyInput is the data source callback of BeginCopyFrom in the
+ * parallel workers. It copies the chunks of lines received from the leader
+ * into the buffer of the COPY parser, and returns 0 once the leader has
+ * detached from the input queue.
+ */
+static int
+ReadParallelCopyInput(void *outbuf, int minread, int maxread)
+{
+	ParallelCopyWorkerInput *workerInput = CurrentWorkerInput;
+
+	while (workerInput->chunkOffset >= workerInput->chunkLength)
+	{
+		Size chunkLength = 0;
+		void *chunk = NULL;
+
+		if (workerInput->reachedEnd)
+		{
+			return 0;
+		}
+
+		shm_mq_result result = shm_mq_receive(workerInput->inputQueue, &chunkLength,
+											  &chunk, false);
+		if (result == SHM_MQ_DETACHED)
+		{
+			workerInput->reachedEnd = true;
+			return 0;
+		}
+
+		workerInput->chunk = (char *) chunk;
+		workerInput->chunkLength = chunkLength;
+		workerInput->chunkOffset = 0;
+	}
+
+	int bytesRead = Min(maxread, workerInput->chunkLength - workerInput->chunkOffset);
+	memcpy(outbuf, workerInput->chunk + workerInput->chunkOffset, bytesRead);
+	workerInput->chunkOffset += bytesRead;
+
+	return bytesRead;
+}
+
+
+/*
+ * ParallelCopyLocalDataWorkerMain is the entry point of the parallel workers
+ * that copy the local data of a table in create_distributed_table. A worker
+ * scans the blocks of the table that the parallel scan hands out to it, finds
+ * the shard of every row, and sends the rows to the leader in batches per
+ * shard in the COPY format that the leader uses for the shard placements.
+ */
+void
+ParallelCopyLocalDataWorkerMain(dsm_segment *segment, shm_toc *toc)
+{
+	ParallelCopyShared *shared = shm_toc_lookup(toc, PARALLEL_COPY_KEY_SHARED, false);
+	char *outputQueueSpace = shm_toc_lookup(toc, PARALLEL_COPY_KEY_OUTPUT_QUEUES,
+											false);
+#if PG_VERSION_NUM >= 120000
+	ParallelTableScanDesc parallelScan = shm_toc_lookup(toc, PARALLEL_COPY_KEY_SCAN,
+														false);
+#else
+	ParallelHeapScanDesc parallelScan = shm_toc_lookup(toc, PARALLEL_COPY_KEY_SCAN,
+													   false);
+#endif
+	Size queueOffset = mul_size(PARALLEL_COPY_QUEUE_SIZE, ParallelWorkerNumber);
+
+	shm_mq *outputQueue = (shm_mq *) (outputQueueSpace + queueOffset);
+	shm_mq_set_sender(outputQueue, MyProc);
+
+	shm_mq_handle *outputHandle = shm_mq_attach(outputQueue, segment, NULL);
+
+	/* the leader holds an ExclusiveLock, which our lock group shares */
+	Relation distributedRelation = heap_open(shared->relationId, AccessShareLock);
+	TupleDesc tupleDescriptor = RelationGetDescr(distributedRelation);
+
+	EState *executorState = CreateExecutorState();
+	MemoryContext executorTupleContext = GetPerTupleMemoryContext(executorState);
+
+	CitusCopyDestReceiver *copyDest =
+		CreateCitusCopyDestReceiver(shared->relationId,
+									CopyColumnNameList(tupleDescriptor),
+									shared->partitionColumnIndex, executorState,
+									false, NULL);
+	copyDest->distributedRelation = distributedRelation;
+	PrepareCopyRowSerialization(copyDest, tupleDescriptor);
+
+	/* batches are indexed by the index of their shard in the sorted shard array */
+	int shardCount = copyDest->tableMetadata->shardIntervalArrayLength;
+	ParallelCopyShardBatch *shardBatchArray =
+		palloc0(shardCount * sizeof(ParallelCopyShardBatch));
+
+#if PG_VERSION_NUM >= 120000
+	TupleTableSlot *slot = table_slot_create(distributedRelation, NULL);
+	TableScanDesc scan = table_beginscan_parallel(distributedRelation, parallelScan);
+#else
+	TupleTableSlot *slot = MakeSingleTupleTableSlotCompat(tupleDescriptor,
+														  &TTSOpsHeapTuple);
+	HeapScanDesc scan = heap_beginscan_parallel(distributedRelation, parallelScan);
+#endif
+
+	while (true)
+	{
+		ResetPerTupleExprContext(executorState);
+
+		MemoryContext oldContext = MemoryContextSwitchTo(executorTupleContext);
+
+#if PG_VERSION_NUM >= 120000
+		bool nextRowFound = table_scan_getnextslot(scan, ForwardScanDirection, slot);
+#else
+		HeapTuple tuple = heap_getnext(scan, ForwardScanDirection);
+		bool nextRowFound = (tuple != NULL);
+		if (nextRowFound)
+		{
+			ExecStoreTuple(tuple, slot, InvalidBuffer, false);
+		}
+#endif
+
+		if (nextRowFound)
+		{
+			slot_getallattrs(slot);
+		}
+
+		MemoryContextSwitchTo(oldContext);
+
+		if (!nextRowFound)
+		{
+			break;
+		}
+
+		CHECK_FOR_INTERRUPTS();
+
+		AddRowToShardBatch(copyDest, shardBatchArray, slot->tts_values,
+						   slot->tts_isnull, outputHandle);
+	}
+
+#if PG_VERSION_NUM >= 120000
+	table_endscan(scan);
+#else
+	heap_endscan(scan);
+#endif
+
+	/* send the remaining rows */
+	for (int shardIndex = 0; shardIndex < shardCount; shardIndex++)
+	{
+		SendShardBatch(outputHandle, &shardBatchArray[shardIndex]);
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+	FreeExecutorState(executorState);
+	heap_close(distributedRelation, NoLock);
+
+	shm_mq_detach(outputHandle);
+}
+
+
+/*
+ * AddRowToShardBatch serialises the given row into the batch of its shard, and
+ * sends the batch to the leader once it is large enough.
+ */
+static void
+AddRowToShardBatch(CitusCopyDestReceiver *copyDest,
+				   ParallelCopyShardBatch *shardBatchArray,
+				   Datum *columnValues, bool *columnNulls,
+				   shm_mq_handle *outputQueue)
+{
+	CopyOutState copyOutState = copyDest->copyOutState;
+	ShardInterval **shardIntervalArray = copyDest->tableMetadata->sortedShardIntervalArray;
+	MemoryContext executorTupleContext =
+		GetPerTupleMemoryContext(copyDest->executorState);
+
+	MemoryContext oldContext = MemoryContextSwitchTo(executorTupleContext);
+
+	int shardIndex = ShardIndexForTuple(copyDest, columnValues, columnNulls);
+
+	resetStringInfo(copyOutState->fe_msgbuf);
+	AppendCopyRowData(columnValues, columnNulls, copyDest->tupleDescriptor,
+					  copyOutState, copyDest->columnOutputFunctions,
+					  copyDest->columnCoercionPaths);
+
+	MemoryContextSwitchTo(oldContext);
+
+	ParallelCopyShardBatch *batch = &shardBatchArray[shardIndex];
+	if (batch->rowData == NULL)
+	{
+		batch->shardId = shardIntervalArray[shardIndex]->shardId;
+		batch->rowCount = 0;
+		batch->rowData = makeStringInfo();
+	}
+
+	appendBinaryStringInfo(batch->rowData, copyOutState->fe_msgbuf->data,
+						   copyOutState->fe_msgbuf->len);
+	batch->rowCount++;
+
+	if (batch->rowData->len >= PARALLEL_COPY_BATCH_SIZE)
+	{
+		SendShardBatch(outputQueue, batch);
+	}
+}
+
+
+/*
+ * SendShardBatch sends the rows of the given batch to the leader and empties
+ * the batch.
+ */
+static void
+SendShardBatch(shm_mq_handle *outputQueue, ParallelCopyShardBatch *batch)
+{
+	ParallelCopyBatchHeader batchHeader;
+	shm_mq_iovec messageParts[2];
+
+	if (batch->rowCount == 0)
+	{
+		return;
+	}
+
+	batchHeader.shardId = batch->shardId;
+	batchHeader.rowCount = batch->rowCount;
+
+	messageParts[0].data = (char *) &batchHeader;
+	messageParts[0].len = sizeof(ParallelCopyBatchHeader);
+	messageParts[1].data = batch->rowData->data;
+	messageParts[1].len = batch->rowData->len;
+
+	shm_mq_result result = shm_mq_sendv(outputQueue, messageParts, 2, false);
+	if (result != SHM_MQ_SUCCESS)
+	{
+		ereport(ERROR, (errmsg("could not send rows to the parallel COPY leader")));
+	}
+
+	resetStringInfo(batch->rowData);
+	batch->rowCount = 0;
+}
@@ -0,0 +1,686 @@
+/*-------------------------------------------------------------------------
+ *
+ * parallel_copy_to.c
+ *    Routines for streaming COPY ... TO STDOUT of distributed tables from
+ *    the shards in parallel.
+ *
+ * A COPY of a distributed table to STDOUT is normally replaced by a
+ * SELECT * over the table, whose result is gathered on the coordinator and
+ * serialised again in the COPY format. When
+ * citus.enable_parallel_copy_to_stdout is enabled, the coordinator instead
+ * runs COPY shard TO STDOUT with the same options over its connections to the
+ * workers, and forwards the copy data it receives to the client without
+ * decoding the rows. The shards behind a connection are copied one after the
+ * other, while all connections stream at the same time.
+ *
+ * Rows are sent to the client in the order in which they arrive, so the
+ * rows of different shards are interleaved.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "libpq-fe.h"
+#include "miscadmin.h"
+
+#include "access/heapam.h"
+#include "commands/copy.h"
+#include "commands/defrem.h"
+#include "distributed/citus_wait_events.h"
+#include "distributed/commands/multi_copy.h"
+#include "distributed/commands/parallel_copy_to.h"
+#include "distributed/connection_management.h"
+#include "distributed/listutils.h"
+#include "distributed/local_executor.h"
+#include "distributed/master_metadata_utility.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/multi_partitioning_utils.h"
+#include "distributed/placement_connection.h"
+#include "distributed/remote_commands.h"
+#include "distributed/remote_transaction.h"
+#include "distributed/transmit.h"
+#include "libpq/libpq.h"
+#include "mb/pg_wchar.h"
+#include "port/pg_bswap.h"
+#include "storage/latch.h"
+#include "tcop/tcopprot.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+
+
+/* length of the header of binary COPY data produced by the workers */
+#define BINARY_COPY_HEADER_LENGTH 19
+
+/* length of the trailer of binary COPY data */
+#define BINARY_COPY_TRAILER_LENGTH 2
+
+
+/*
+ * ShardCopyOutStream is a connection over which the shards behind it are
+ * copied to STDOUT one after the other.
+ */
+typedef struct ShardCopyOutStream
+{
+	MultiConnection *connection;
+
+	/* shards that are not yet copied, the first one is being copied */
+	List *shardIntervalList;
+
+	/* whether the binary header of the current shard was already received */
+	bool headerReceived;
+} ShardCopyOutStream;
+
+
+/* config variable managed via guc.c */
+bool EnableParallelCopyToStdout = false;
+
+
+/* local function forward declarations */
+static bool CopyOptionsCanBeForwarded(CopyStmt *copyStatement, bool *binaryFormat);
+static List * CreateShardCopyOutStreams(List *shardIntervalList);
+static StringInfo ShardCopyOutCommand(CopyStmt *copyStatement,
+									  ShardInterval *shardInterval);
+static void AppendCopyOption(StringInfo command, DefElem *option);
+static void StartShardCopyOut(ShardCopyOutStream *stream, CopyStmt *copyStatement);
+static void FinishShardCopyOut(ShardCopyOutStream *stream);
+static bool ForwardShardCopyData(ShardCopyOutStream *stream, bool binaryFormat,
+								 uint64 *processedRowCount, bool *copyDone);
+static void WaitForShardCopyData(List *streamList);
+static void SendBinaryCopyHeader(void);
+static void SendBinaryCopyTrailer(void);
+
+
+/*
+ * CanCopyToStdoutFromShards returns whether the given COPY distributed_table
+ * TO STDOUT can be done by forwarding the copy data of the shards.
+ */
+bool
+CanCopyToStdoutFromShards(CopyStmt *copyStatement, Oid relationId)
+{
+	bool binaryFormat = false;
+
+	if (!EnableParallelCopyToStdout || copyStatement->filename != NULL ||
+		copyStatement->is_from)
+	{
+		return false;
+	}
+
+	/* only the frontend/backend protocol 3 copy sub-protocol is supported */
+	if (whereToSendOutput != DestRemote || PG_PROTOCOL_MAJOR(FrontendProtocol) < 3)
+	{
+		return false;
+	}
+
+	/* the shards of partitioned tables cannot be copied to STDOUT themselves */
+	if (PartitionedTable(relationId))
+	{
+		return false;
+	}
+
+	/* connections to the local node would not see locally executed writes */
+	if (LocalExecutionHappened)
+	{
+		return false;
+	}
+
+	if (!CopyOptionsCanBeForwarded(copyStatement, &binaryFormat))
+	{
+		return false;
+	}
+
+	if (binaryFormat)
+	{
+		Relation distributedRelation = heap_open(relationId, AccessShareLock);
+		TupleDesc tupleDescriptor = RelationGetDescr(distributedRelation);
+		bool canUseBinaryFormat = CanUseBinaryCopyFormat(tupleDescriptor);
+
+		heap_close(distributedRelation, NoLock);
+
+		/*
+		 * Workers would send text values in the database encoding and the OIDs
+		 * of their own types in arrays and records.
+		 */
+		if (!canUseBinaryFormat || pg_get_client_encoding() != GetDatabaseEncoding())
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * CopyOptionsCanBeForwarded returns whether the options of the given COPY can be
+ * sent to the workers as they are, and whether the binary format is used. The
+ * header line would be repeated for every shard, so COPY with a header is done
+ * through a SELECT instead.
+ */
+static bool
+CopyOptionsCanBeForwarded(CopyStmt *copyStatement, bool *binaryFormat)
+{
+	DefElem *option = NULL;
+
+	foreach_ptr(option, copyStatement->options)
+	{
+		if (strcmp(option->defname, "header") == 0 && defGetBoolean(option))
+		{
+			return false;
+		}
+		else if (strcmp(option->defname, "format") == 0)
+		{
+			*binaryFormat = (strcmp(defGetString(option), "binary") == 0);
+		}
+
+		if (option->arg != NULL && !IsA(option->arg, String) &&
+			!IsA(option->arg, Integer) && !IsA(option->arg, List) &&
+			!IsA(option->arg, A_Star))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * CopyToStdoutFromShards copies the rows of all shards of the given distributed
+ * table to STDOUT by running the given COPY on the shards and forwarding the
+ * copy data the workers send.
+ */
+void
+CopyToStdoutFromShards(CopyStmt *copyStatement, Oid relationId, char *completionTag)
+{
+	List *shardIntervalList = LoadShardIntervalList(relationId);
+	List *connectionList = NIL;
+	bool binaryFormat = false;
+	uint64 processedRowCount = 0;
+	int columnCount = list_length(copyStatement->attlist);
+	ShardCopyOutStream *stream = NULL;
+
+	/* raise errors in the options before contacting the workers */
+	ProcessCopyOptions(NULL, NULL, false, copyStatement->options);
+	CopyOptionsCanBeForwarded(copyStatement, &binaryFormat);
+
+	if (columnCount == 0)
+	{
+		Relation distributedRelation = heap_open(relationId, AccessShareLock);
+		TupleDesc tupleDescriptor = RelationGetDescr(distributedRelation);
+
+		columnCount = list_length(CopyColumnNameList(tupleDescriptor));
+
+		heap_close(distributedRelation, NoLock);
+	}
+
+	List *streamList = CreateShardCopyOutStreams(shardIntervalList);
+	foreach_ptr(stream, streamList)
+	{
+		connectionList = lappend(connectionList, stream->connection);
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	foreach_ptr(stream, streamList)
+	{
+		if (PQstatus(stream->connection->pgConn) != CONNECTION_OK)
+		{
+			ReportConnectionError(stream->connection, ERROR);
+		}
+	}
+
+	RemoteTransactionsBeginIfNecessary(connectionList);
+
+	SendCopyOutStart(binaryFormat, columnCount);
+
+	if (binaryFormat)
+	{
+		SendBinaryCopyHeader();
+	}
+
+	foreach_ptr(stream, streamList)
+	{
+		StartShardCopyOut(stream, copyStatement);
+	}
+
+	List *activeStreamList = streamList;
+	while (activeStreamList != NIL)
+	{
+		List *remainingStreamList = NIL;
+		bool receivedData = false;
+
+		CHECK_FOR_INTERRUPTS();
+
+		foreach_ptr(stream, activeStreamList)
+		{
+			bool copyDone = false;
+
+			if (ForwardShardCopyData(stream, binaryFormat, &processedRowCount,
+									 &copyDone))
+			{
+				receivedData = true;
+			}
+
+			if (copyDone)
+			{
+				FinishShardCopyOut(stream);
+
+				stream->shardIntervalList = list_delete_first(stream->shardIntervalList);
+				if (stream->shardIntervalList == NIL)
+				{
+					continue;
+				}
+
+				StartShardCopyOut(stream, copyStatement);
+				receivedData = true;
+			}
+
+			remainingStreamList = lappend(remainingStreamList, stream);
+		}
+
+		activeStreamList = remainingStreamList;
+
+		if (!receivedData && activeStreamList != NIL)
+		{
+			WaitForShardCopyData(activeStreamList);
+		}
+	}
+
+	if (binaryFormat)
+	{
+		SendBinaryCopyTrailer();
+	}
+
+	SendCopyDone();
+
+	if (completionTag != NULL)
+	{
+		snprintf(completionTag, COMPLETION_TAG_BUFSIZE,
+				 "COPY " UINT64_FORMAT, processedRowCount);
+	}
+}
+
+
+/*
+ * CreateShardCopyOutStreams picks an active placement of each of the given
+ * shards and groups the shards by the connection that is used for their
+ * placement. Placements that were already accessed in the transaction are
+ * read over the connection that accessed them.
+ */
+static List *
+CreateShardCopyOutStreams(List *shardIntervalList)
+{
+	List *streamList = NIL;
+	ShardInterval *shardInterval = NULL;
+
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		uint64 shardId = shardInterval->shardId;
+		List *placementList = FinalizedShardPlacementList(shardId);
+		ShardCopyOutStream *shardStream = NULL;
+		ShardCopyOutStream *stream = NULL;
+
+		if (placementList == NIL)
+		{
+			ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+							errmsg("could not find any active placements for shard "
+								   UINT64_FORMAT, shardId)));
+		}
+
+		ShardPlacement *placement = (ShardPlacement *) linitial(placementList);
+		MultiConnection *connection = StartPlacementConnection(0, placement, NULL);
+
+		foreach_ptr(stream, streamList)
+		{
+			if (stream->connection == connection)
+			{
+				shardStream = stream;
+				break;
+			}
+		}
+
+		if (shardStream == NULL)
+		{
+			shardStream = palloc0(sizeof(ShardCopyOutStream));
+			shardStream->connection = connection;
+			streamList = lappend(streamList, shardStream);
+		}
+
+		shardStream->shardIntervalList = lappend(shardStream->shardIntervalList,
+												 shardInterval);
+	}
+
+	return streamList;
+}
+
+
+/*
+ * ShardCopyOutCommand returns the given COPY ... TO STDOUT for the given shard,
+ * with the same column list and options.
+ */
+static StringInfo
+ShardCopyOutCommand(CopyStmt *copyStatement, ShardInterval *shardInterval)
+{
+	StringInfo command = makeStringInfo();
+	StringInfo optionString = makeStringInfo();
+	char *shardQualifiedName = ConstructQualifiedShardName(shardInterval);
+	bool encodingGiven = false;
+	bool binaryFormat = false;
+	DefElem *option = NULL;
+
+	appendStringInfo(command, "COPY %s", shardQualifiedName);
+
+	if (copyStatement->attlist != NIL)
+	{
+		Value *columnName = NULL;
+		bool appendedFirstName = false;
+
+		foreach_ptr(columnName, copyStatement->attlist)
+		{
+			appendStringInfo(command, "%s%s", appendedFirstName ? ", " : " (",
+							 quote_identifier(strVal(columnName)));
+			appendedFirstName = true;
+		}
+
+		appendStringInfoString(command, ")");
+	}
+
+	appendStringInfoString(command, " TO STDOUT");
+
+	foreach_ptr(option, copyStatement->options)
+	{
+		if (strcmp(option->defname, "encoding") == 0)
+		{
+			encodingGiven = true;
+		}
+		else if (strcmp(option->defname, "format") == 0)
+		{
+			binaryFormat = (strcmp(defGetString(option), "binary") == 0);
+		}
+
+		if (optionString->len > 0)
+		{
+			appendStringInfoString(optionString, ", ");
+		}
+
+		AppendCopyOption(optionString, option);
+	}
+
+	/*
+	 * Connections to the workers use the database encoding, so let the workers
+	 * convert text and csv output to the encoding of the client.
+	 */
+	if (!encodingGiven && !binaryFormat)
+	{
+		if (optionString->len > 0)
+		{
+			appendStringInfoString(optionString, ", ");
+		}
+
+		appendStringInfo(optionString, "encoding %s",
+						 quote_literal_cstr(pg_get_client_encoding_name()));
+	}
+
+	if (optionString->len > 0)
+	{
+		appendStringInfo(command, " WITH (%s)", optionString->data);
+	}
+
+	return command;
+}
+
+
+/*
+ * AppendCopyOption appends the given option of a COPY statement to the given
+ * command.
+ */
+static void
+AppendCopyOption(StringInfo command, DefElem *option)
+{
+	appendStringInfoString(command, quote_identifier(option->defname));
+
+	if (option->arg == NULL)
+	{
+		return;
+	}
+	else if (IsA(option->arg, Integer))
+	{
+		appendStringInfo(command, " %ld", (long) intVal(option->arg));
+	}
+	else if (IsA(option->arg, A_Star))
+	{
+		appendStringInfoString(command, " *");
+	}
+	else if (IsA(option->arg, List))
+	{
+		Value *columnName = NULL;
+		bool appendedFirstName = false;
+
+		foreach_ptr(columnName, (List *) option->arg)
+		{
+			appendStringInfo(command, "%s%s", appendedFirstName ? ", " : " (",
+							 quote_identifier(strVal(columnName)));
+			appendedFirstName = true;
+		}
+
+		appendStringInfoString(command, ")");
+	}
+	else
+	{
+		appendStringInfo(command, " %s", quote_literal_cstr(defGetString(option)));
+	}
+}
+
+
+/*
+ * StartShardCopyOut sends the COPY ... TO STDOUT of the first shard of the
+ * given stream and waits for the worker to start sending copy data.
+ */
+static void
+StartShardCopyOut(ShardCopyOutStream *stream, CopyStmt *copyStatement)
+{
+	MultiConnection *connection = stream->connection;
+	ShardInterval *shardInterval = linitial(stream->shardIntervalList);
+	bool raiseInterrupts = true;
+
+	StringInfo command = ShardCopyOutCommand(copyStatement, shardInterval);
+	if (!SendRemoteCommand(connection, command->data))
+	{
+		ReportConnectionError(connection, ERROR);
+	}
+
+	PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+	if (PQresultStatus(result) != PGRES_COPY_OUT)
+	{
+		ReportResultError(connection, result, ERROR);
+	}
+
+	PQclear(result);
+
+	stream->headerReceived = false;
+}
+
+
+/*
+ * FinishShardCopyOut reads the result of the COPY of the current shard of the
+ * given stream once all of its copy data was received.
+ */
+static void
+FinishShardCopyOut(ShardCopyOutStream *stream)
+{
+	MultiConnection *connection = stream->connection;
+	bool raiseInterrupts = true;
+
+	PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+	if (PQresultStatus(result) != PGRES_COMMAND_OK)
+	{
+		ReportResultError(connection, result, ERROR);
+	}
+
+	PQclear(result);
+	ForgetResults(connection);
+}
+
+
+/*
+ * ForwardShardCopyData forwards the copy data that the given stream already
+ * received to the client, without blocking. Every copy data message of a
+ * worker contains a single row. The binary header and trailer of every shard
+ * are dropped, since the client receives a single header and trailer. The
+ * function returns whether any data was received, and sets copyDone once the
+ * COPY of the current shard is done.
+ */
+static bool
+ForwardShardCopyData(ShardCopyOutStream *stream, bool binaryFormat,
+					 uint64 *processedRowCount, bool *copyDone)
+{
+	PGconn *pgConn = stream->connection->pgConn;
+	StringInfoData copyData;
+	bool receivedData = false;
+
+	if (PQconsumeInput(pgConn) == 0)
+	{
+		ReportConnectionError(stream->connection, ERROR);
+	}
+
+	while (true)
+	{
+		char *receiveBuffer = NULL;
+		bool asynchronous = true;
+
+		int receiveLength = PQgetCopyData(pgConn, &receiveBuffer, asynchronous);
+		if (receiveLength == 0)
+		{
+			/* no complete row is available yet */
+			break;
+		}
+		else if (receiveLength == -1)
+		{
+			*copyDone = true;
+			break;
+		}
+		else if (receiveLength < 0)
+		{
+			ReportConnectionError(stream->connection, ERROR);
+		}
+
+		receivedData = true;
+
+		copyData.data = receiveBuffer;
+		copyData.len = receiveLength;
+		copyData.maxlen = receiveLength;
+		copyData.cursor = 0;
+
+		if (binaryFormat && !stream->headerReceived)
+		{
+			int headerLength = Min(copyData.len, BINARY_COPY_HEADER_LENGTH);
+
+			copyData.data += headerLength;
+			copyData.len -= headerLength;
+			stream->headerReceived = true;
+		}
+
+		if (binaryFormat && copyData.len == BINARY_COPY_TRAILER_LENGTH)
+		{
+			uint16 fieldCount = 0;
+
+			memcpy(&fieldCount, copyData.data, sizeof(fieldCount));
+			if ((int16) pg_ntoh16(fieldCount) == -1)
+			{
+				copyData.len = 0;
+			}
+		}
+
+		if (copyData.len > 0)
+		{
+			SendCopyData(&copyData);
+			(*processedRowCount)++;
+		}
+
+		PQfreemem(receiveBuffer);
+	}
+
+	return receivedData;
+}
+
+
+/*
+ * WaitForShardCopyData blocks until one of the connections of the given
+ * streams has more input, or the latch is set.
+ */
+static void
+WaitForShardCopyData(List *streamList)
+{
+	/* additional 2 is for postmaster and latch */
+	int eventSetSize = list_length(streamList) + 2;
+	WaitEventSet *waitEventSet = CreateWaitEventSet(CurrentMemoryContext,
+													eventSetSize);
+	WaitEvent *events = palloc0(eventSetSize * sizeof(WaitEvent));
+	ShardCopyOutStream *stream = NULL;
+
+	AddWaitEventToSet(waitEventSet, WL_POSTMASTER_DEATH, PGINVALID_SOCKET, NULL, NULL);
+	AddWaitEventToSet(waitEventSet, WL_LATCH_SET, PGINVALID_SOCKET, MyLatch, NULL);
+
+	foreach_ptr(stream, streamList)
+	{
+		int socket = PQsocket(stream->connection->pgConn);
+
+		AddWaitEventToSet(waitEventSet, WL_SOCKET_READABLE, socket, NULL, NULL);
+	}
+
+	int eventCount = WaitEventSetWait(waitEventSet, -1, events, eventSetSize,
+									  WAIT_EVENT_CITUS_REMOTE_RESULT);
+
+	for (int eventIndex = 0; eventIndex < eventCount; eventIndex++)
+	{
+		if (events[eventIndex].events & WL_POSTMASTER_DEATH)
+		{
+			ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
+		}
+
+		if (events[eventIndex].events & WL_LATCH_SET)
+		{
+			ResetLatch(MyLatch);
+		}
+	}
+
+	FreeWaitEventSet(waitEventSet);
+	pfree(events);
+}
+
+
+/*
+ * SendBinaryCopyHeader sends the header of binary COPY data to the client.
+ */
+static void
+SendBinaryCopyHeader(void)
+{
+	CopyOutStateData headerOutputState;
+
+	memset(&headerOutputState, 0, sizeof(headerOutputState));
+	headerOutputState.fe_msgbuf = makeStringInfo();
+	headerOutputState.rowcontext = CurrentMemoryContext;
+
+	AppendCopyBinaryHeaders(&headerOutputState);
+	SendCopyData(headerOutputState.fe_msgbuf);
+}
+
+
+/*
+ * SendBinaryCopyTrailer sends the trailer of binary COPY data to the client.
+ */
+static void
+SendBinaryCopyTrailer(void)
+{
+	CopyOutStateData footerOutputState;
+
+	memset(&footerOutputState, 0, sizeof(footerOutputState));
+	footerOutputState.fe_msgbuf = makeStringInfo();
+	footerOutputState.rowcontext = CurrentMemoryContext;
+
+	AppendCopyBinaryFooters(&footerOutputState);
+	SendCopyData(footerOutputState.fe_msgbuf);
+}
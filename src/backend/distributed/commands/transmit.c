@@ -16,6 +16,7 @@
 #include <unistd.h>
 
 #include "commands/defrem.h"
+#include "common/pg_lzcompress.h"
 #include "distributed/relay_utility.h"
 #include "distributed/transmit.h"
 #include "distributed/worker_protocol.h"
@@ -25,40 +26,51 @@
 #include "storage/fd.h"
 
 
-/* Local functions forward declarations */
-static void SendCopyInStart(void);
-static void SendCopyOutStart(void);
-static void SendCopyDone(void);
-static void SendCopyData(StringInfo fileBuffer);
-static bool ReceiveCopyData(StringInfo copyData);
+/*
+ * Minimum size of a block of data that is compressed before it is sent to
+ * another node, or DISABLE_TRANSMIT_COMPRESSION to not request compression.
+ * A node that is asked to send compressed data compresses all blocks of at
+ * least this size, or all blocks if it does not request compression itself.
+ */
+int TransmitCompressionThreshold = DISABLE_TRANSMIT_COMPRESSION;
 
 
 /*
  * RedirectCopyDataToRegularFile receives data from stdin using the standard copy
  * protocol. The function then creates or truncates a file with the given
- * filename, and appends received data to this file.
+ * filename, and appends received data to this file. If decompress is set, every
+ * copy data message is a frame created by AppendCompressedTransmitFrame.
  */
 void
-RedirectCopyDataToRegularFile(const char *filename)
+RedirectCopyDataToRegularFile(const char *filename, bool decompress)
 {
 	StringInfo copyData = makeStringInfo();
+	StringInfo decompressedData = makeStringInfo();
 	const int fileFlags = (O_APPEND | O_CREAT | O_RDWR | O_TRUNC | PG_BINARY);
 	const int fileMode = (S_IRUSR | S_IWUSR);
 	File fileDesc = FileOpenForTransmit(filename, fileFlags, fileMode);
 	FileCompat fileCompat = FileCompatFromFileStart(fileDesc);
 
-	SendCopyInStart();
+	SendCopyInStart(true, 0);
 
 	bool copyDone = ReceiveCopyData(copyData);
 	while (!copyDone)
 	{
+		StringInfo fileData = copyData;
+
+		if (decompress && copyData->len > 0)
+		{
+			DecompressTransmitFrame(copyData->data, copyData->len, decompressedData);
+			fileData = decompressedData;
+		}
+
 		/* if received data has contents, append to regular file */
-		if (copyData->len > 0)
+		if (fileData->len > 0)
 		{
-			int appended = FileWriteCompat(&fileCompat, copyData->data,
-										   copyData->len, PG_WAIT_IO);
+			int appended = FileWriteCompat(&fileCompat, fileData->data,
+										   fileData->len, PG_WAIT_IO);
 
-			if (appended != copyData->len)
+			if (appended != fileData->len)
 			{
 				ereport(ERROR, (errcode_for_file_access(),
 								errmsg("could not append to received file: %m")));
@@ -70,6 +82,7 @@ RedirectCopyDataToRegularFile(const char *filename)
 	}
 
 	FreeStringInfo(copyData);
+	FreeStringInfo(decompressedData);
 	FileClose(fileDesc);
 }
 
@@ -77,10 +90,11 @@ RedirectCopyDataToRegularFile(const char *filename)
 /*
  * SendRegularFile reads data from the given file, and sends these data to
  * stdout using the standard copy protocol. After all file data are sent, the
- * function ends the copy protocol and closes the file.
+ * function ends the copy protocol and closes the file. If compress is set, every
+ * block that is read from the file is sent as a compressed frame.
  */
 void
-SendRegularFile(const char *filename)
+SendRegularFile(const char *filename, bool compress)
 {
 	const uint32 fileBufferSize = 32768; /* 32 KB */
 	const int fileFlags = (O_RDONLY | PG_BINARY);
@@ -97,7 +111,9 @@ SendRegularFile(const char *filename)
 	StringInfo fileBuffer = makeStringInfo();
 	enlargeStringInfo(fileBuffer, fileBufferSize);
 
-	SendCopyOutStart();
+	StringInfo frameBuffer = makeStringInfo();
+
+	SendCopyOutStart(true, 0);
 
 	int readBytes = FileReadCompat(&fileCompat, fileBuffer->data, fileBufferSize,
 								   PG_WAIT_IO);
@@ -105,7 +121,17 @@ SendRegularFile(const char *filename)
 	{
 		fileBuffer->len = readBytes;
 
-		SendCopyData(fileBuffer);
+		if (compress)
+		{
+			resetStringInfo(frameBuffer);
+			AppendCompressedTransmitFrame(frameBuffer, fileBuffer->data,
+										  fileBuffer->len);
+			SendCopyData(frameBuffer);
+		}
+		else
+		{
+			SendCopyData(fileBuffer);
+		}
 
 		resetStringInfo(fileBuffer);
 		readBytes = FileReadCompat(&fileCompat, fileBuffer->data, fileBufferSize,
@@ -115,10 +141,126 @@ SendRegularFile(const char *filename)
 	SendCopyDone();
 
 	FreeStringInfo(fileBuffer);
+	FreeStringInfo(frameBuffer);
 	FileClose(fileDesc);
 }
 
 
+/*
+ * CopyStatementRequestsCompression returns whether the given COPY statement
+ * has the compression option, which means that the copy data is sent as
+ * frames created by AppendCompressedTransmitFrame.
+ */
+bool
+CopyStatementRequestsCompression(CopyStmt *copyStatement)
+{
+	ListCell *optionCell = NULL;
+
+	foreach(optionCell, copyStatement->options)
+	{
+		DefElem *defel = (DefElem *) lfirst(optionCell);
+
+		if (strncmp(defel->defname, TRANSMIT_COMPRESSION_OPTION, NAMEDATALEN) != 0)
+		{
+			continue;
+		}
+
+		char *compressionMethod = defGetString(defel);
+		if (strncmp(compressionMethod, TRANSMIT_COMPRESSION_METHOD, NAMEDATALEN) != 0)
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("compression method \"%s\" is not supported",
+								   compressionMethod)));
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
+
+/*
+ * AppendCompressedTransmitFrame appends a frame that holds the given data to
+ * the frame buffer. A frame consists of the uncompressed length, the compressed
+ * length and the compressed data. Frames are only created when the receiving
+ * side asked for compression, so the threshold only sets a minimum block size.
+ * Blocks that are smaller than citus.transmit_compression_threshold, or that
+ * do not compress well, are stored as is and have a compressed length of -1.
+ */
+void
+AppendCompressedTransmitFrame(StringInfo frame, const char *data, int length)
+{
+	int32 compressedLength = -1;
+
+	pq_sendint32(frame, length);
+
+	/* reserve space for the compressed length, which we only know afterwards */
+	int compressedLengthOffset = frame->len;
+	pq_sendint32(frame, compressedLength);
+
+	if (length >= TransmitCompressionThreshold)
+	{
+		enlargeStringInfo(frame, PGLZ_MAX_OUTPUT(length));
+
+		compressedLength = pglz_compress(data, length, frame->data + frame->len,
+										 PGLZ_strategy_default);
+	}
+
+	if (compressedLength < 0)
+	{
+		appendBinaryStringInfo(frame, data, length);
+		return;
+	}
+
+	uint32 networkCompressedLength = pg_hton32(compressedLength);
+	memcpy(frame->data + compressedLengthOffset, &networkCompressedLength,
+		   sizeof(uint32));
+
+	frame->len += compressedLength;
+	frame->data[frame->len] = '\0';
+}
+
+
+/*
+ * DecompressTransmitFrame replaces the contents of the output buffer with the
+ * data in a frame created by AppendCompressedTransmitFrame.
+ */
+void
+DecompressTransmitFrame(const char *frame, int frameLength, StringInfo output)
+{
+	StringInfoData frameData = { (char *) frame, frameLength, frameLength, 0 };
+
+	int32 rawLength = pq_getmsgint(&frameData, sizeof(int32));
+	int32 compressedLength = pq_getmsgint(&frameData, sizeof(int32));
+
+	resetStringInfo(output);
+
+	if (compressedLength < 0)
+	{
+		const char *rawData = pq_getmsgbytes(&frameData, rawLength);
+
+		appendBinaryStringInfo(output, rawData, rawLength);
+		return;
+	}
+
+	const char *compressedData = pq_getmsgbytes(&frameData, compressedLength);
+
+	enlargeStringInfo(output, rawLength);
+
+	int32 decompressedLength = pglz_decompress_compat(compressedData, compressedLength,
+													  output->data, rawLength);
+	if (decompressedLength != rawLength)
+	{
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+						errmsg("compressed data is corrupted")));
+	}
+
+	output->len = rawLength;
+	output->data[output->len] = '\0';
+}
+
+
 /* Helper function that deallocates string info object. */
 void
 FreeStringInfo(StringInfo stringInfo)
@@ -163,17 +305,22 @@ FileOpenForTransmit(const char *filename, int fileFlags, int fileMode)
 
 /*
  * SendCopyInStart sends the start copy in message to initiate receiving data
- * from stdin. The frontend should now send copy data.
+ * from stdin. The frontend should now send copy data. Text copies announce
+ * the number of columns they expect, like regular COPY ... FROM STDIN does.
  */
-static void
-SendCopyInStart(void)
+void
+SendCopyInStart(bool binaryFormat, int columnCount)
 {
 	StringInfoData copyInStart = { NULL, 0, 0, 0 };
-	const char copyFormat = 1; /* binary copy format */
+	const char copyFormat = binaryFormat ? 1 : 0;
 
 	pq_beginmessage(&copyInStart, 'G');
 	pq_sendbyte(&copyInStart, copyFormat);
-	pq_sendint(&copyInStart, 0, 2);
+	pq_sendint(&copyInStart, columnCount, 2);
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		pq_sendint(&copyInStart, copyFormat, 2);
+	}
 	pq_endmessage(&copyInStart);
 
 	/* flush here to ensure that FE knows it can send data */
@@ -188,22 +335,28 @@ SendCopyInStart(void)
 /*
  * SendCopyOutStart sends the start copy out message to initiate sending data to
  * stdout. After this message, the backend will continue by sending copy data.
+ * Text copies announce their number of columns, like regular COPY ... TO
+ * STDOUT does.
  */
-static void
-SendCopyOutStart(void)
+void
+SendCopyOutStart(bool binaryFormat, int columnCount)
 {
 	StringInfoData copyOutStart = { NULL, 0, 0, 0 };
-	const char copyFormat = 1; /* binary copy format */
+	const char copyFormat = binaryFormat ? 1 : 0;
 
 	pq_beginmessage(&copyOutStart, 'H');
 	pq_sendbyte(&copyOutStart, copyFormat);
-	pq_sendint(&copyOutStart, 0, 2);
+	pq_sendint(&copyOutStart, columnCount, 2);
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		pq_sendint(&copyOutStart, copyFormat, 2);
+	}
 	pq_endmessage(&copyOutStart);
 }
 
 
 /* Sends the copy-complete message. */
-static void
+void
 SendCopyDone(void)
 {
 	StringInfoData copyDone = { NULL, 0, 0, 0 };
@@ -221,7 +374,7 @@ SendCopyDone(void)
 
 
 /* Sends the copy data message to stdout. */
-static void
+void
 SendCopyData(StringInfo fileBuffer)
 {
 	StringInfoData copyData = { NULL, 0, 0, 0 };
@@ -240,7 +393,7 @@ SendCopyData(StringInfo fileBuffer)
  * If the received message does not conform to the copy protocol, the function
  * mirrors copy.c's error behavior.
  */
-static bool
+bool
 ReceiveCopyData(StringInfo copyData)
 {
 	bool copyDone = true;
@@ -34,6 +34,7 @@
 #include "access/xact.h"
 #include "catalog/catalog.h"
 #include "catalog/dependency.h"
+#include "catalog/pg_class.h"
 #include "commands/dbcommands.h"
 #include "commands/defrem.h"
 #include "commands/tablecmds.h"
@@ -49,12 +50,14 @@
 #include "distributed/metadata_sync.h"
 #include "distributed/multi_executor.h"
 #include "distributed/resource_lock.h"
+#include "distributed/shared_metadata_cache.h"
 #include "distributed/transmit.h"
 #include "distributed/version_compat.h"
 #include "distributed/worker_transaction.h"
 #include "lib/stringinfo.h"
 #include "nodes/parsenodes.h"
 #include "nodes/pg_list.h"
+#include "tcop/tcopprot.h"
 #include "tcop/utility.h"
 #include "utils/builtins.h"
 #include "utils/lsyscache.h"
@@ -63,6 +66,7 @@
 
 bool EnableDDLPropagation = true; /* ddl propagation is enabled */
 PropSetCmdBehavior PropagateSetCommands = PROPSETCMD_NONE; /* SET prop off */
+int MaxDDLExecutorPoolSize = 0; /* 0 means max_adaptive_executor_pool_size */
 static bool shouldInvalidateForeignKeyGraph = false;
 static int activeAlterTables = 0;
 static int activeDropSchemaOrDBs = 0;
@@ -70,6 +74,7 @@ static int activeDropSchemaOrDBs = 0;
 
 /* Local functions forward declarations for helper functions */
 static void ExecuteDistributedDDLJob(DDLJob *ddlJob);
+static void ExecuteDDLTaskList(List *taskList);
 static char * SetSearchPathToCurrentSearchPathCommand(void);
 static char * CurrentSearchPath(void);
 static void PostProcessUtility(Node *parsetree);
@@ -78,6 +83,7 @@ static List * PlanAlterOwnerStmt(AlterOwnerStmt *stmt, const char *queryString);
 static List * PlanAlterObjectDependsStmt(AlterObjectDependsStmt *stmt,
 										 const char *queryString);
 static bool IsDropSchemaOrDB(Node *parsetree);
+static bool UtilityStmtCannotAffectDistributedObjects(Node *parsetree);
 
 
 /*
@@ -142,6 +148,25 @@ multi_ProcessUtility(PlannedStmt *pstmt,
 		return;
 	}
 
+	if (UtilityStmtCannotAffectDistributedObjects(parsetree))
+	{
+		/*
+		 * Commands such as creating temporary tables or session-level SET are
+		 * frequent in some applications, skip copying the statement and the
+		 * metadata lookups for them.
+		 */
+		standard_ProcessUtility(pstmt, queryString, context,
+								params, queryEnv, dest, completionTag);
+
+		return;
+	}
+
+	/* DDL commands that are cached for tables may no longer be accurate */
+	if (GetCommandLogLevel(parsetree) == LOGSTMT_DDL)
+	{
+		AdvanceDDLGeneration();
+	}
+
 	bool checkCreateAlterExtensionVersion = IsCreateAlterExtensionUpdateCitusStmt(
 		parsetree);
 	if (EnableVersionChecks && checkCreateAlterExtensionVersion)
@@ -318,11 +343,14 @@ multi_ProcessUtility(PlannedStmt *pstmt,
 
 		if (copyStatement->is_from)
 		{
-			RedirectCopyDataToRegularFile(transmitPath->data);
+			RedirectCopyDataToRegularFile(transmitPath->data,
+										  CopyStatementRequestsCompression(
+											  copyStatement));
 		}
 		else
 		{
-			SendRegularFile(transmitPath->data);
+			SendRegularFile(transmitPath->data,
+							CopyStatementRequestsCompression(copyStatement));
 		}
 
 		/* Don't execute the faux copy statement */
@@ -878,6 +906,52 @@ multi_ProcessUtility(PlannedStmt *pstmt,
 }
 
 
+/*
+ * UtilityStmtCannotAffectDistributedObjects returns true if the given utility
+ * statement is known to not need any Citus processing, based only on the
+ * statement itself and without looking up any objects or metadata:
+ *
+ *   - SET and SHOW commands that are not propagated to the workers
+ *   - CREATE TEMPORARY TABLE (AS) without inheritance or partitioning, since
+ *     temporary tables can neither be distributed nor reference distributed
+ *     tables
+ */
+static bool
+UtilityStmtCannotAffectDistributedObjects(Node *parsetree)
+{
+	if (IsA(parsetree, VariableShowStmt))
+	{
+		return true;
+	}
+
+	if (IsA(parsetree, VariableSetStmt))
+	{
+		VariableSetStmt *setStmt = (VariableSetStmt *) parsetree;
+
+		return !(IsMultiStatementTransaction() && ShouldPropagateSetCommand(setStmt));
+	}
+
+	if (IsA(parsetree, CreateStmt))
+	{
+		CreateStmt *createStmt = (CreateStmt *) parsetree;
+
+		return createStmt->relation->relpersistence == RELPERSISTENCE_TEMP &&
+			   createStmt->inhRelations == NIL && createStmt->partbound == NULL &&
+			   createStmt->partspec == NULL;
+	}
+
+	if (IsA(parsetree, CreateTableAsStmt))
+	{
+		CreateTableAsStmt *createTableAsStmt = (CreateTableAsStmt *) parsetree;
+
+		return createTableAsStmt->relkind == OBJECT_TABLE &&
+			   createTableAsStmt->into->rel->relpersistence == RELPERSISTENCE_TEMP;
+	}
+
+	return false;
+}
+
+
 /*
  * IsDropSchemaOrDB returns true if parsetree represents DROP SCHEMA ...or
  * a DROP DATABASE.
@@ -1030,7 +1104,7 @@ ExecuteDistributedDDLJob(DDLJob *ddlJob)
 		}
 
 		/* use adaptive executor when enabled */
-		ExecuteUtilityTaskListWithoutResults(ddlJob->taskList);
+		ExecuteDDLTaskList(ddlJob->taskList);
 	}
 	else
 	{
@@ -1041,8 +1115,16 @@ ExecuteDistributedDDLJob(DDLJob *ddlJob)
 
 		PG_TRY();
 		{
-			/* use adaptive executor when enabled */
-			ExecuteUtilityTaskListWithoutResults(ddlJob->taskList);
+			if (ddlJob->concurrentIndexName != NULL &&
+				EnableConcurrentIndexBuildRetries)
+			{
+				ExecuteConcurrentIndexBuild(ddlJob);
+			}
+			else
+			{
+				/* use adaptive executor when enabled */
+				ExecuteDDLTaskList(ddlJob->taskList);
+			}
 
 			if (shouldSyncMetadata)
 			{
@@ -1077,6 +1159,35 @@ ExecuteDistributedDDLJob(DDLJob *ddlJob)
 }
 
 
+/*
+ * ExecuteDDLTaskList executes the shard tasks of a DDL command.
+ */
+static void
+ExecuteDDLTaskList(List *taskList)
+{
+	ExecuteTaskList(ROW_MODIFY_NONE, taskList, DDLTargetPoolSize());
+}
+
+
+/*
+ * DDLTargetPoolSize returns the number of connections per node that the shard
+ * tasks of DDL commands may use. DDL commands such as CREATE INDEX are often
+ * bound by the maintenance capacity of the workers rather than by the number
+ * of connections that queries should use, hence citus.max_ddl_executor_pool_size
+ * can size their pools separately.
+ */
+int
+DDLTargetPoolSize(void)
+{
+	if (MaxDDLExecutorPoolSize > 0)
+	{
+		return MaxDDLExecutorPoolSize;
+	}
+
+	return MaxAdaptiveExecutorPoolSize;
+}
+
+
 /*
  * SetSearchPathToCurrentSearchPathCommand generates a command which can
  * set the search path to the exact same search path that the issueing node
@@ -16,6 +16,8 @@
 #include "commands/vacuum.h"
 #include "distributed/commands.h"
 #include "distributed/commands/utility_hook.h"
+#include "distributed/listutils.h"
+#include "distributed/master_protocol.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_executor.h"
 #include "distributed/resource_lock.h"
@@ -38,8 +40,14 @@ typedef struct CitusVacuumParams
 } CitusVacuumParams;
 
 
+/* config variables managed via guc.c */
+int MaxVacuumExecutorPoolSize = 0; /* 0 means max_adaptive_executor_pool_size */
+bool EnableAnalyzeStatisticsCollection = false;
+
+
 /* Local functions forward declarations for processing distributed table commands */
 static bool IsDistributedVacuumStmt(int vacuumOptions, List *vacuumRelationIdList);
+static int VacuumTargetPoolSize(void);
 static List * VacuumTaskList(Oid relationId, CitusVacuumParams vacuumParams,
 							 List *vacuumColumnList);
 static StringInfo DeparseVacuumStmtPrefix(CitusVacuumParams vacuumParams);
@@ -69,7 +77,10 @@ ProcessVacuumStmt(VacuumStmt *vacuumStmt, const char *vacuumCommand)
 	CitusVacuumParams vacuumParams = VacuumStmtParams(vacuumStmt);
 	LOCKMODE lockMode = (vacuumParams.options & VACOPT_FULL) ? AccessExclusiveLock :
 						ShareUpdateExclusiveLock;
-	int executedVacuumCount = 0;
+	List *distributedRelationIdList = NIL;
+	List *vacuumTaskList = NIL;
+	Task *task = NULL;
+	int taskId = 1;
 
 	foreach(vacuumRelationCell, vacuumRelationList)
 	{
@@ -85,35 +96,79 @@ ProcessVacuumStmt(VacuumStmt *vacuumStmt, const char *vacuumCommand)
 		return;
 	}
 
-	/* execute vacuum on distributed tables */
+	/* collect the vacuum tasks of all distributed tables */
 	foreach(relationIdCell, relationIdList)
 	{
 		Oid relationId = lfirst_oid(relationIdCell);
 		if (IsDistributedTable(relationId))
 		{
-			/*
-			 * VACUUM commands cannot run inside a transaction block, so we use
-			 * the "bare" commit protocol without BEGIN/COMMIT. However, ANALYZE
-			 * commands can run inside a transaction block. Notice that we do this
-			 * once even if there are multiple distributed tables to be vacuumed.
-			 */
-			if (executedVacuumCount == 0 && (vacuumParams.options & VACOPT_VACUUM) != 0)
-			{
-				/* save old commit protocol to restore at xact end */
-				Assert(SavedMultiShardCommitProtocol == COMMIT_PROTOCOL_BARE);
-				SavedMultiShardCommitProtocol = MultiShardCommitProtocol;
-				MultiShardCommitProtocol = COMMIT_PROTOCOL_BARE;
-			}
-
 			List *vacuumColumnList = VacuumColumnList(vacuumStmt, relationIndex);
 			List *taskList = VacuumTaskList(relationId, vacuumParams, vacuumColumnList);
 
-			/* use adaptive executor when enabled */
-			ExecuteUtilityTaskListWithoutResults(taskList);
-			executedVacuumCount++;
+			vacuumTaskList = list_concat(vacuumTaskList, taskList);
+			distributedRelationIdList = lappend_oid(distributedRelationIdList,
+													relationId);
 		}
 		relationIndex++;
 	}
+
+	if (vacuumTaskList == NIL)
+	{
+		return;
+	}
+
+	/*
+	 * VACUUM commands cannot run inside a transaction block, so we use
+	 * the "bare" commit protocol without BEGIN/COMMIT. However, ANALYZE
+	 * commands can run inside a transaction block.
+	 */
+	if ((vacuumParams.options & VACOPT_VACUUM) != 0)
+	{
+		/* save old commit protocol to restore at xact end */
+		Assert(SavedMultiShardCommitProtocol == COMMIT_PROTOCOL_BARE);
+		SavedMultiShardCommitProtocol = MultiShardCommitProtocol;
+		MultiShardCommitProtocol = COMMIT_PROTOCOL_BARE;
+	}
+
+	/* task ids need to be unique within the execution */
+	foreach_ptr(task, vacuumTaskList)
+	{
+		task->taskId = taskId++;
+	}
+
+	/*
+	 * Execute the tasks of all tables at once, such that the shard placements
+	 * of the tables are vacuumed in parallel rather than one table at a time.
+	 */
+	ExecuteTaskList(ROW_MODIFY_NONE, vacuumTaskList, VacuumTargetPoolSize());
+
+	if ((vacuumParams.options & VACOPT_ANALYZE) != 0 &&
+		EnableAnalyzeStatisticsCollection)
+	{
+		Oid relationId = InvalidOid;
+
+		foreach_oid(relationId, distributedRelationIdList)
+		{
+			RecordTableStatistics(relationId);
+		}
+	}
+}
+
+
+/*
+ * VacuumTargetPoolSize returns the number of connections per node that the
+ * shard tasks of VACUUM and ANALYZE commands may use, which is the number of
+ * shard placements that are vacuumed concurrently on each node.
+ */
+static int
+VacuumTargetPoolSize(void)
+{
+	if (MaxVacuumExecutorPoolSize > 0)
+	{
+		return MaxVacuumExecutorPoolSize;
+	}
+
+	return MaxAdaptiveExecutorPoolSize;
 }
 
 
@@ -132,6 +132,22 @@ ProcessVariableSetStmt(VariableSetStmt *setStmt, const char *setStmtString)
 		MemoryContextSwitchTo(old_context);
 	}
 
+	/* the SET needs to apply within the active savepoints on the workers */
+	if (PropagateSavepointsLazily)
+	{
+		List *savepointConnectionList = NIL;
+
+		dlist_foreach(iter, &InProgressTransactions)
+		{
+			MultiConnection *connection =
+				dlist_container(MultiConnection, transactionNode, iter.cur);
+
+			savepointConnectionList = lappend(savepointConnectionList, connection);
+		}
+
+		RemoteTransactionsSyncSavepoints(savepointConnectionList);
+	}
+
 	/* send text of SET stmt to participating nodes... */
 	dlist_foreach(iter, &InProgressTransactions)
 	{
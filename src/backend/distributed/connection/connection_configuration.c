@@ -36,6 +36,24 @@ typedef struct ConnParamsInfo
  */
 static ConnParamsInfo ConnParams;
 
+/*
+ * TCP keepalive settings for connections to other nodes, unless configured
+ * otherwise in citus.node_conninfo. The operating system defaults usually
+ * only detect a failed node after more than two hours, while these detect a
+ * failed node within about two minutes, such that cached connections to it
+ * fail early.
+ */
+static const char *DefaultKeepaliveKeywords[] = {
+	"keepalives_idle",
+	"keepalives_interval",
+	"keepalives_count"
+};
+static const char *DefaultKeepaliveValues[] = {
+	"60",
+	"10",
+	"6"
+};
+
 /* helper functions for processing connection info */
 static Size CalculateMaxSize(void);
 static int uri_prefix_length(const char *connstr);
@@ -114,6 +132,27 @@ AddConnParam(const char *keyword, const char *value)
 }
 
 
+/*
+ * AddDefaultConnParams adds the default settings of libpq parameters that were
+ * not set explicitly to the global libpq settings. It is called after adding
+ * the settings from citus.node_conninfo.
+ */
+void
+AddDefaultConnParams(void)
+{
+	for (Index paramIndex = 0; paramIndex < lengthof(DefaultKeepaliveKeywords);
+		 paramIndex++)
+	{
+		const char *keyword = DefaultKeepaliveKeywords[paramIndex];
+
+		if (GetConnParam(keyword) == NULL)
+		{
+			AddConnParam(keyword, DefaultKeepaliveValues[paramIndex]);
+		}
+	}
+}
+
+
 /*
  * CheckConninfo is a building block to help implement check constraints and
  * other check hooks against libpq-like conninfo strings. In particular, the
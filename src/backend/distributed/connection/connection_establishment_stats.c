@@ -0,0 +1,513 @@
+/*-------------------------------------------------------------------------
+ *
+ * connection_establishment_stats.c
+ *   Keeps track of how the connections to remote nodes are established
+ *   across backends.
+ *
+ * Establishing a connection, especially with SSL, can be a large part of
+ * the latency of short queries. For each worker, we count the connection
+ * attempts and their outcome, keep a histogram of the time it took to
+ * establish the connections and count how often a cached connection could
+ * be used instead. The statistics are shown by the
+ * citus_connection_establishment_stats view.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include "catalog/pg_type.h"
+#include "distributed/connection_establishment_stats.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/tuplestore.h"
+#include "distributed/worker_manager.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/timestamp.h"
+#include "utils/tuplestore.h"
+
+
+#define CONNECTION_ESTABLISHMENT_STATS_COLUMNS 11
+
+/* number of histogram buckets, the last one counts the slower connections */
+#define CONNECTION_LATENCY_BUCKET_COUNT (lengthof(ConnectionLatencyBucketBounds) + 1)
+
+
+/* upper bounds of the connection latency histogram buckets, in milliseconds */
+static const int ConnectionLatencyBucketBounds[] = {
+	1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000
+};
+
+
+/* kinds of events that are counted for a worker */
+typedef enum ConnectionEvent
+{
+	CONNECTION_EVENT_ATTEMPT,
+	CONNECTION_EVENT_SUCCESS,
+	CONNECTION_EVENT_FAILURE,
+	CONNECTION_EVENT_TIMEOUT,
+	CONNECTION_EVENT_CACHE_HIT,
+	CONNECTION_EVENT_CACHE_MISS
+} ConnectionEvent;
+
+
+/*
+ * ConnectionEstablishmentStatsSharedData holds the lock that protects the
+ * shared hash of connection establishment stats.
+ */
+typedef struct ConnectionEstablishmentStatsSharedData
+{
+	int trancheId;
+	char *trancheName;
+
+	LWLock lock;
+} ConnectionEstablishmentStatsSharedData;
+
+
+/* the stats are kept per worker node */
+typedef struct ConnectionEstablishmentStatsHashKey
+{
+	char hostname[MAX_NODE_LENGTH];
+	int32 port;
+} ConnectionEstablishmentStatsHashKey;
+
+
+/* hash entry for the stats of a worker */
+typedef struct ConnectionEstablishmentStatsHashEntry
+{
+	ConnectionEstablishmentStatsHashKey key;
+
+	/* protects the counters, the hash lock only protects the entries */
+	slock_t mutex;
+
+	int64 attemptCount;
+	int64 successCount;
+	int64 failureCount;
+	int64 timeoutCount;
+	int64 cacheHitCount;
+	int64 cacheMissCount;
+
+	/* total time to establish the successful connections, in milliseconds */
+	double totalConnectTime;
+
+	int64 latencyBucketCounts[lengthof(ConnectionLatencyBucketBounds) + 1];
+} ConnectionEstablishmentStatsHashEntry;
+
+
+static HTAB *ConnectionEstablishmentStatsHash = NULL;
+static ConnectionEstablishmentStatsSharedData *ConnectionEstablishmentStatsState = NULL;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+
+static void RecordConnectionEvent(const char *hostname, int port, ConnectionEvent event,
+								  double connectTime);
+static ConnectionEstablishmentStatsHashEntry * FindOrCreateStatsEntry(
+	ConnectionEstablishmentStatsHashKey *key);
+static int ConnectionLatencyBucket(double connectTime);
+static void StoreAllConnectionEstablishmentStats(Tuplestorestate *tupleStore,
+												 TupleDesc tupleDescriptor);
+static size_t ConnectionEstablishmentStatsShmemSize(void);
+static void ConnectionEstablishmentStatsShmemInit(void);
+
+
+PG_FUNCTION_INFO_V1(citus_connection_establishment_stats);
+
+
+/*
+ * citus_connection_establishment_stats returns the connection establishment
+ * stats of all backends on this node, per remote node.
+ */
+Datum
+citus_connection_establishment_stats(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupleDescriptor = NULL;
+
+	CheckCitusVersion(ERROR);
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	StoreAllConnectionEstablishmentStats(tupleStore, tupleDescriptor);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupleStore);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * StoreAllConnectionEstablishmentStats writes the stats of all remote nodes
+ * to the tuple store.
+ */
+static void
+StoreAllConnectionEstablishmentStats(Tuplestorestate *tupleStore,
+									 TupleDesc tupleDescriptor)
+{
+	Datum values[CONNECTION_ESTABLISHMENT_STATS_COLUMNS];
+	bool isNulls[CONNECTION_ESTABLISHMENT_STATS_COLUMNS];
+	Datum boundDatums[lengthof(ConnectionLatencyBucketBounds)];
+	Datum bucketCountDatums[CONNECTION_LATENCY_BUCKET_COUNT];
+	HASH_SEQ_STATUS status;
+	ConnectionEstablishmentStatsHashEntry *entry = NULL;
+
+	if (ConnectionEstablishmentStatsHash == NULL)
+	{
+		return;
+	}
+
+	for (int boundIndex = 0; boundIndex < lengthof(ConnectionLatencyBucketBounds);
+		 boundIndex++)
+	{
+		boundDatums[boundIndex] = Int32GetDatum(ConnectionLatencyBucketBounds[boundIndex]);
+	}
+
+	/* we're reading all the entries, shared lock is enough */
+	LWLockAcquire(&ConnectionEstablishmentStatsState->lock, LW_SHARED);
+
+	hash_seq_init(&status, ConnectionEstablishmentStatsHash);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		ConnectionEstablishmentStatsHashEntry entryCopy;
+
+		/* copy the counters such that we do not allocate under the spinlock */
+		SpinLockAcquire(&entry->mutex);
+		entryCopy = *entry;
+		SpinLockRelease(&entry->mutex);
+
+		/* get ready for the next tuple */
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		for (int bucketIndex = 0; bucketIndex < CONNECTION_LATENCY_BUCKET_COUNT;
+			 bucketIndex++)
+		{
+			bucketCountDatums[bucketIndex] =
+				Int64GetDatum(entryCopy.latencyBucketCounts[bucketIndex]);
+		}
+
+		values[0] = PointerGetDatum(cstring_to_text(entryCopy.key.hostname));
+		values[1] = Int32GetDatum(entryCopy.key.port);
+		values[2] = Int64GetDatum(entryCopy.attemptCount);
+		values[3] = Int64GetDatum(entryCopy.successCount);
+		values[4] = Int64GetDatum(entryCopy.failureCount);
+		values[5] = Int64GetDatum(entryCopy.timeoutCount);
+		values[6] = Int64GetDatum(entryCopy.cacheHitCount);
+		values[7] = Int64GetDatum(entryCopy.cacheMissCount);
+		values[8] = Float8GetDatum(entryCopy.totalConnectTime);
+		values[9] = PointerGetDatum(construct_array(boundDatums,
+													lengthof(ConnectionLatencyBucketBounds),
+													INT4OID, sizeof(int32), true, 'i'));
+		values[10] = PointerGetDatum(construct_array(bucketCountDatums,
+													 CONNECTION_LATENCY_BUCKET_COUNT,
+													 INT8OID, sizeof(int64),
+													 FLOAT8PASSBYVAL, 'd'));
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	LWLockRelease(&ConnectionEstablishmentStatsState->lock);
+}
+
+
+/*
+ * RecordConnectionEstablishmentStart counts a connection attempt to the node
+ * of the given connection.
+ */
+void
+RecordConnectionEstablishmentStart(MultiConnection *connection)
+{
+	RecordConnectionEvent(connection->hostname, connection->port,
+						  CONNECTION_EVENT_ATTEMPT, 0.0);
+}
+
+
+/*
+ * RecordConnectionEstablishmentResult counts the outcome of establishing the
+ * given connection. Since the connection establishment can be driven from
+ * several places, only the first outcome of a connection is counted.
+ */
+void
+RecordConnectionEstablishmentResult(MultiConnection *connection,
+									ConnectionAttemptResult result)
+{
+	double connectTime = 0.0;
+	ConnectionEvent event = CONNECTION_EVENT_FAILURE;
+
+	if (connection->establishmentResultRecorded)
+	{
+		return;
+	}
+
+	connection->establishmentResultRecorded = true;
+
+	if (result == CONNECTION_ATTEMPT_SUCCEEDED)
+	{
+		long seconds = 0;
+		int microseconds = 0;
+
+		TimestampDifference(connection->connectionStart, GetCurrentTimestamp(),
+							&seconds, &microseconds);
+		connectTime = seconds * 1000.0 + microseconds / 1000.0;
+
+		event = CONNECTION_EVENT_SUCCESS;
+	}
+	else if (result == CONNECTION_ATTEMPT_TIMED_OUT)
+	{
+		event = CONNECTION_EVENT_TIMEOUT;
+	}
+
+	RecordConnectionEvent(connection->hostname, connection->port, event, connectTime);
+}
+
+
+/*
+ * RecordConnectionCacheLookup counts whether a cached connection to the given
+ * node could be used, or a new connection had to be established.
+ */
+void
+RecordConnectionCacheLookup(const char *hostname, int port, bool cacheHit)
+{
+	ConnectionEvent event = cacheHit ? CONNECTION_EVENT_CACHE_HIT :
+							CONNECTION_EVENT_CACHE_MISS;
+
+	RecordConnectionEvent(hostname, port, event, 0.0);
+}
+
+
+/*
+ * RecordConnectionEvent updates the stats of the given node for the event.
+ * If there is no space left for the node in shared memory, the event is not
+ * counted.
+ */
+static void
+RecordConnectionEvent(const char *hostname, int port, ConnectionEvent event,
+					  double connectTime)
+{
+	ConnectionEstablishmentStatsHashKey key;
+
+	if (ConnectionEstablishmentStatsHash == NULL)
+	{
+		return;
+	}
+
+	/* the key is compared byte-by-byte, so zero the padding */
+	memset(&key, 0, sizeof(key));
+	strlcpy(key.hostname, hostname, MAX_NODE_LENGTH);
+	key.port = port;
+
+	ConnectionEstablishmentStatsHashEntry *entry = FindOrCreateStatsEntry(&key);
+	if (entry == NULL)
+	{
+		return;
+	}
+
+	SpinLockAcquire(&entry->mutex);
+
+	switch (event)
+	{
+		case CONNECTION_EVENT_ATTEMPT:
+		{
+			entry->attemptCount++;
+			break;
+		}
+
+		case CONNECTION_EVENT_SUCCESS:
+		{
+			entry->successCount++;
+			entry->totalConnectTime += connectTime;
+			entry->latencyBucketCounts[ConnectionLatencyBucket(connectTime)]++;
+			break;
+		}
+
+		case CONNECTION_EVENT_FAILURE:
+		{
+			entry->failureCount++;
+			break;
+		}
+
+		case CONNECTION_EVENT_TIMEOUT:
+		{
+			entry->timeoutCount++;
+			break;
+		}
+
+		case CONNECTION_EVENT_CACHE_HIT:
+		{
+			entry->cacheHitCount++;
+			break;
+		}
+
+		case CONNECTION_EVENT_CACHE_MISS:
+		{
+			entry->cacheMissCount++;
+			break;
+		}
+	}
+
+	SpinLockRelease(&entry->mutex);
+
+	LWLockRelease(&ConnectionEstablishmentStatsState->lock);
+}
+
+
+/*
+ * FindOrCreateStatsEntry returns the stats entry for the given key with the
+ * hash lock held, such that the entry cannot be removed while the caller
+ * updates it. Since the entries are only created once per node, we first
+ * look for the entry with a shared lock. NULL is returned, without holding
+ * the lock, if there is no space left in the hash.
+ */
+static ConnectionEstablishmentStatsHashEntry *
+FindOrCreateStatsEntry(ConnectionEstablishmentStatsHashKey *key)
+{
+	LWLock *lock = &ConnectionEstablishmentStatsState->lock;
+	bool found = false;
+
+	LWLockAcquire(lock, LW_SHARED);
+
+	ConnectionEstablishmentStatsHashEntry *entry =
+		hash_search(ConnectionEstablishmentStatsHash, key, HASH_FIND, &found);
+	if (found)
+	{
+		return entry;
+	}
+
+	LWLockRelease(lock);
+	LWLockAcquire(lock, LW_EXCLUSIVE);
+
+	entry = hash_search(ConnectionEstablishmentStatsHash, key, HASH_ENTER_NULL, &found);
+	if (entry == NULL)
+	{
+		LWLockRelease(lock);
+		return NULL;
+	}
+
+	if (!found)
+	{
+		/* zero the counters, but keep the key */
+		memset(((char *) entry) + sizeof(ConnectionEstablishmentStatsHashKey), 0,
+			   sizeof(ConnectionEstablishmentStatsHashEntry) -
+			   sizeof(ConnectionEstablishmentStatsHashKey));
+		SpinLockInit(&entry->mutex);
+	}
+
+	return entry;
+}
+
+
+/*
+ * ConnectionLatencyBucket returns the index of the histogram bucket for a
+ * connection that took the given number of milliseconds to establish.
+ */
+static int
+ConnectionLatencyBucket(double connectTime)
+{
+	int bucketIndex = 0;
+
+	while (bucketIndex < lengthof(ConnectionLatencyBucketBounds) &&
+		   connectTime > ConnectionLatencyBucketBounds[bucketIndex])
+	{
+		bucketIndex++;
+	}
+
+	return bucketIndex;
+}
+
+
+/*
+ * InitializeConnectionEstablishmentStats requests the necessary shared memory
+ * from Postgres and sets up the shared memory startup hook.
+ */
+void
+InitializeConnectionEstablishmentStats(void)
+{
+	/* allocate shared memory */
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(ConnectionEstablishmentStatsShmemSize());
+	}
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = ConnectionEstablishmentStatsShmemInit;
+}
+
+
+/*
+ * ConnectionEstablishmentStatsShmemSize returns the size that should be
+ * allocated in shared memory for the connection establishment stats.
+ */
+static size_t
+ConnectionEstablishmentStatsShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(ConnectionEstablishmentStatsSharedData));
+
+	Size hashSize = hash_estimate_size(MaxWorkerNodesTracked,
+									   sizeof(ConnectionEstablishmentStatsHashEntry));
+
+	size = add_size(size, hashSize);
+
+	return size;
+}
+
+
+/*
+ * ConnectionEstablishmentStatsShmemInit initializes the shared memory used
+ * for keeping track of the connection establishment stats across backends.
+ */
+static void
+ConnectionEstablishmentStatsShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL info;
+
+	/* create (hostname, port) -> [stats] */
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(ConnectionEstablishmentStatsHashKey);
+	info.entrysize = sizeof(ConnectionEstablishmentStatsHashEntry);
+	info.hash = tag_hash;
+	uint32 hashFlags = (HASH_ELEM | HASH_FUNCTION);
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	ConnectionEstablishmentStatsState =
+		(ConnectionEstablishmentStatsSharedData *) ShmemInitStruct(
+			"Connection Establishment Stats Data",
+			sizeof(ConnectionEstablishmentStatsSharedData),
+			&alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		ConnectionEstablishmentStatsState->trancheId = LWLockNewTrancheId();
+		ConnectionEstablishmentStatsState->trancheName =
+			"Connection Establishment Stats Tranche";
+		LWLockRegisterTranche(ConnectionEstablishmentStatsState->trancheId,
+							  ConnectionEstablishmentStatsState->trancheName);
+
+		LWLockInitialize(&ConnectionEstablishmentStatsState->lock,
+						 ConnectionEstablishmentStatsState->trancheId);
+	}
+
+	ConnectionEstablishmentStatsHash =
+		ShmemInitHash("Connection Establishment Stats Hash", MaxWorkerNodesTracked,
+					  MaxWorkerNodesTracked, &info, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	Assert(ConnectionEstablishmentStatsHash != NULL);
+	Assert(ConnectionEstablishmentStatsState->trancheId != 0);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
@@ -16,24 +16,34 @@
 #include "miscadmin.h"
 
 #include "access/hash.h"
+#include "access/xact.h"
 #include "commands/dbcommands.h"
+#include "distributed/citus_wait_events.h"
+#include "distributed/connection_establishment_stats.h"
 #include "distributed/connection_management.h"
 #include "distributed/errormessage.h"
 #include "distributed/log_utils.h"
 #include "distributed/memutils.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/hash_helpers.h"
+#include "distributed/listutils.h"
 #include "distributed/placement_connection.h"
 #include "distributed/run_from_same_connection.h"
 #include "distributed/remote_commands.h"
+#include "distributed/remote_prepared_statements.h"
+#include "distributed/shared_connection_stats.h"
 #include "distributed/version_compat.h"
+#include "distributed/worker_manager.h"
 #include "mb/pg_wchar.h"
+#include "storage/ipc.h"
 #include "utils/hsearch.h"
 #include "utils/memutils.h"
 
 
 int NodeConnectionTimeout = 5000;
 int MaxCachedConnectionsPerWorker = 1;
+bool PrewarmWorkerConnectionsEnabled = false;
+int CachedConnectionProbeIdleTime = 0;
 
 HTAB *ConnectionHash = NULL;
 HTAB *ConnParamsHash = NULL;
@@ -49,8 +59,16 @@ static bool ShouldShutdownConnection(MultiConnection *connection, const int
 static void ResetConnection(MultiConnection *connection);
 static void DefaultCitusNoticeProcessor(void *arg, const char *message);
 static MultiConnection * FindAvailableConnection(dlist_head *connections, uint32 flags);
+static bool CachedConnectionHealthy(MultiConnection *connection);
+static bool ProbeConnection(MultiConnection *connection);
 static bool RemoteTransactionIdle(MultiConnection *connection);
 static int EventSetSizeForConnectionList(List *connections);
+static bool AcquireSharedConnectionSlot(ConnectionHashEntry *entry, uint32 flags,
+										bool *slotCounted);
+static void ReleaseSharedConnectionSlot(MultiConnection *connection);
+static void ReleaseAllSharedConnectionSlots(int code, Datum arg);
+static int NodeConnectionCount(const char *hostname, int32 port);
+static bool IsCitusInitiatedBackend(void);
 
 /* types for async connection management */
 enum MultiConnectionPhase
@@ -278,12 +296,133 @@ StartWorkerListConnections(List *workerNodeList, uint32 flags, const char *user,
 }
 
 
+/*
+ * Set once this session established its cached connections to the workers,
+ * and reset when pg_dist_node changes such that new nodes get connections too.
+ */
+static bool WorkerConnectionsPrewarmed = false;
+
+
+/*
+ * PrewarmWorkerConnections establishes citus.max_cached_conns_per_worker
+ * connections to every active primary node that this session does not have
+ * connections to yet, such that the first distributed queries of a new session
+ * do not pay for connection establishment. The connections are established in
+ * parallel, and are kept at the end of the transaction as regular cached
+ * connections.
+ *
+ * This is a no-op unless citus.prewarm_worker_connections is set, and is only
+ * done once per session and after each change to pg_dist_node.
+ */
+void
+PrewarmWorkerConnections(void)
+{
+	List *connectionList = NIL;
+	WorkerNode *workerNode = NULL;
+
+	if (!PrewarmWorkerConnectionsEnabled || WorkerConnectionsPrewarmed)
+	{
+		return;
+	}
+
+	if (!IsTransactionState() || IsAbortedTransactionBlockState() ||
+		IsCitusInitiatedBackend())
+	{
+		return;
+	}
+
+	/* do not retry on every query if connection establishment fails */
+	WorkerConnectionsPrewarmed = true;
+
+	int32 localGroupId = GetLocalGroupId();
+	List *workerNodeList = ActivePrimaryWorkerNodeList(NoLock);
+
+	foreach_ptr(workerNode, workerNodeList)
+	{
+		char *nodeName = workerNode->workerName;
+		int nodePort = workerNode->workerPort;
+
+		if (workerNode->groupId == localGroupId)
+		{
+			/* shards on the local node are accessed via local execution */
+			continue;
+		}
+
+		int connectionCount = NodeConnectionCount(nodeName, nodePort);
+		for (; connectionCount < MaxCachedConnectionsPerWorker; connectionCount++)
+		{
+			/* never wait for the shared pool just to prewarm */
+			uint32 connectionFlags = FORCE_NEW_CONNECTION | OPTIONAL_CONNECTION;
+
+			MultiConnection *connection =
+				StartNodeUserDatabaseConnection(connectionFlags, nodeName, nodePort,
+												NULL, NULL);
+			if (connection == NULL)
+			{
+				break;
+			}
+
+			connectionList = lappend(connectionList, connection);
+		}
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+}
+
+
+/*
+ * ResetWorkerConnectionsPrewarmed makes the next PrewarmWorkerConnections call
+ * establish connections to nodes that do not have any yet. It is called from the
+ * pg_dist_node invalidation callback, hence it only sets a flag.
+ */
+void
+ResetWorkerConnectionsPrewarmed(void)
+{
+	WorkerConnectionsPrewarmed = false;
+}
+
+
+/*
+ * NodeConnectionCount returns the number of connections this backend has to the
+ * given node for the current user and database.
+ */
+static int
+NodeConnectionCount(const char *hostname, int32 port)
+{
+	ConnectionHashKey key;
+	bool found = false;
+	dlist_iter iter;
+	int connectionCount = 0;
+
+	memset(&key, 0, sizeof(ConnectionHashKey));
+	strlcpy(key.hostname, hostname, MAX_NODE_LENGTH);
+	key.port = port;
+	strlcpy(key.user, CurrentUserName(), NAMEDATALEN);
+	strlcpy(key.database, CurrentDatabaseName(), NAMEDATALEN);
+
+	ConnectionHashEntry *entry = hash_search(ConnectionHash, &key, HASH_FIND, &found);
+	if (!found)
+	{
+		return 0;
+	}
+
+	dlist_foreach(iter, entry->connections)
+	{
+		connectionCount++;
+	}
+
+	return connectionCount;
+}
+
+
 /*
  * StartNodeUserDatabaseConnection() initiates a connection to a remote node.
  *
  * If user or database are NULL, the current session's defaults are used. The
  * following flags influence connection establishment behaviour:
  * - FORCE_NEW_CONNECTION - a new connection is required
+ * - OPTIONAL_CONNECTION - return NULL instead of waiting when a new
+ *   connection is needed, but the node reached citus.max_shared_pool_size
  *
  * The returned connection has only been initiated, not fully
  * established. That's useful to allow parallel connection establishment. If
@@ -348,6 +487,28 @@ StartNodeUserDatabaseConnection(uint32 flags, const char *hostname, int32 port,
 	{
 		/* check connection cache for a connection that's not already in use */
 		connection = FindAvailableConnection(entry->connections, flags);
+		while (connection != NULL)
+		{
+			FinishPendingCommitPrepared(connection);
+
+			/* a failed COMMIT PREPARED may have left the connection broken */
+			if (PQstatus(connection->pgConn) == CONNECTION_OK &&
+				CachedConnectionHealthy(connection))
+			{
+				break;
+			}
+
+			/* the node likely failed over, replace the connection by a new one */
+			ereport(DEBUG1, (errmsg("closing cached connection to %s:%d that is "
+									"no longer usable",
+									connection->hostname, connection->port)));
+
+			CloseConnection(connection);
+			connection = FindAvailableConnection(entry->connections, flags);
+		}
+
+		RecordConnectionCacheLookup(hostname, port, connection != NULL);
+
 		if (connection)
 		{
 			return connection;
@@ -356,9 +517,21 @@ StartNodeUserDatabaseConnection(uint32 flags, const char *hostname, int32 port,
 
 	/*
 	 * Either no caching desired, or no pre-established, non-claimed,
-	 * connection present. Initiate connection establishment.
+	 * connection present. Make sure that the node does not get more than
+	 * citus.max_shared_pool_size connections from this node and initiate
+	 * connection establishment.
 	 */
+	bool sharedConnectionCounterIncremented = false;
+	if (!AcquireSharedConnectionSlot(entry, flags, &sharedConnectionCounterIncremented))
+	{
+		/* only optional connections can be refused */
+		Assert(flags & OPTIONAL_CONNECTION);
+
+		return NULL;
+	}
+
 	connection = StartConnectionEstablishment(&key);
+	connection->sharedConnectionCounterIncremented = sharedConnectionCounterIncremented;
 
 	dlist_push_tail(entry->connections, &connection->connectionNode);
 
@@ -368,10 +541,133 @@ StartNodeUserDatabaseConnection(uint32 flags, const char *hostname, int32 port,
 }
 
 
+/*
+ * AcquireSharedConnectionSlot increments the shared connection counter for
+ * the node of the given hash entry before a new connection is established,
+ * and sets slotCounted to whether the connection needs to release the slot
+ * when it is closed.
+ *
+ * If the node already has citus.max_shared_pool_size connections from all
+ * backends, optional connections are refused by returning false. For other
+ * connections, we wait until another backend closes a connection to the
+ * node, and error out if that does not happen within
+ * citus.node_connection_timeout. We only wait when this backend does not
+ * have any connections to the node yet, otherwise we could end up waiting
+ * for connections that we hold ourselves.
+ */
+static bool
+AcquireSharedConnectionSlot(ConnectionHashEntry *entry, uint32 flags,
+							bool *slotCounted)
+{
+	static bool registeredExitCallback = false;
+	const char *hostname = entry->key.hostname;
+	int port = entry->key.port;
+
+	*slotCounted = false;
+
+	/*
+	 * Connections that are opened while throttling is disabled are not
+	 * counted, so they should not release a slot either if throttling gets
+	 * enabled while they are open.
+	 */
+	if (GetMaxSharedPoolSize() == DISABLE_CONNECTION_THROTTLING)
+	{
+		return true;
+	}
+
+	if (!registeredExitCallback)
+	{
+		/* release the slots of this backend if it exits with open connections */
+		before_shmem_exit(ReleaseAllSharedConnectionSlots, (Datum) 0);
+		registeredExitCallback = true;
+	}
+
+	if (flags & OPTIONAL_CONNECTION)
+	{
+		if (!TryToIncrementSharedConnectionCounter(hostname, port))
+		{
+			return false;
+		}
+	}
+	else if (dlist_is_empty(entry->connections))
+	{
+		if (!WaitLoopForSharedConnection(hostname, port))
+		{
+			ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+							errmsg("could not get a connection slot for %s:%d within "
+								   "%d ms", hostname, port, NodeConnectionTimeout),
+							errdetail("Connections to the node are limited to %d by "
+									  "citus.max_shared_pool_size.",
+									  GetMaxSharedPoolSize()),
+							errhint("Increase citus.max_shared_pool_size or reduce "
+									"the number of concurrent sessions.")));
+		}
+	}
+	else
+	{
+		IncrementSharedConnectionCounter(hostname, port);
+	}
+
+	*slotCounted = true;
+
+	return true;
+}
+
+
+/*
+ * ReleaseSharedConnectionSlot decrements the shared connection counter for
+ * the given connection, if it was counted and is not already released.
+ */
+static void
+ReleaseSharedConnectionSlot(MultiConnection *connection)
+{
+	if (!connection->sharedConnectionCounterIncremented)
+	{
+		return;
+	}
+
+	DecrementSharedConnectionCounter(connection->hostname, connection->port);
+	connection->sharedConnectionCounterIncremented = false;
+}
+
+
+/*
+ * ReleaseAllSharedConnectionSlots is a before_shmem_exit callback that
+ * releases the shared connection slots of all connections that are still
+ * open when the backend exits.
+ */
+static void
+ReleaseAllSharedConnectionSlots(int code, Datum arg)
+{
+	HASH_SEQ_STATUS status;
+	ConnectionHashEntry *entry;
+
+	if (ConnectionHash == NULL)
+	{
+		return;
+	}
+
+	hash_seq_init(&status, ConnectionHash);
+	while ((entry = (ConnectionHashEntry *) hash_seq_search(&status)) != 0)
+	{
+		dlist_iter iter;
+
+		dlist_foreach(iter, entry->connections)
+		{
+			MultiConnection *connection =
+				dlist_container(MultiConnection, connectionNode, iter.cur);
+
+			ReleaseSharedConnectionSlot(connection);
+		}
+	}
+}
+
+
 /* StartNodeUserDatabaseConnection() helper */
 static MultiConnection *
 FindAvailableConnection(dlist_head *connections, uint32 flags)
 {
+	MultiConnection *firstAvailableConnection = NULL;
 	dlist_iter iter;
 
 	dlist_foreach(iter, connections)
@@ -385,10 +681,140 @@ FindAvailableConnection(dlist_head *connections, uint32 flags)
 			continue;
 		}
 
-		return connection;
+		/*
+		 * Prefer the connection that already modified data in the transaction,
+		 * such that writes to the node stay on a single connection and the
+		 * transaction does not need 2PC for this node.
+		 */
+		if (ConnectionModifiedPlacement(connection))
+		{
+			return connection;
+		}
+
+		if (firstAvailableConnection == NULL)
+		{
+			firstAvailableConnection = connection;
+		}
+	}
+
+	return firstAvailableConnection;
+}
+
+
+/*
+ * CachedConnectionHealthy returns false if the given connection was idle in
+ * the cache for longer than citus.cached_connection_probe_idle_time and does
+ * not respond to a probe, such that it is not reused. Without a probe, the
+ * first command on a connection to a node that failed over would only fail
+ * after the TCP timeout. Connections that are already used by the current
+ * transaction are not probed.
+ */
+static bool
+CachedConnectionHealthy(MultiConnection *connection)
+{
+	if (CachedConnectionProbeIdleTime <= 0 || connection->cachedSince == 0 ||
+		connection->remoteTransaction.transactionState != REMOTE_TRANS_INVALID ||
+		!dlist_is_empty(&connection->referencedPlacements))
+	{
+		return true;
 	}
 
-	return NULL;
+	TimestampTz cachedSince = connection->cachedSince;
+
+	/* the connection is in use until the end of the transaction */
+	connection->cachedSince = 0;
+
+	if (!TimestampDifferenceExceeds(cachedSince, GetCurrentTimestamp(),
+									CachedConnectionProbeIdleTime))
+	{
+		return true;
+	}
+
+	return ProbeConnection(connection);
+}
+
+
+/*
+ * ProbeConnection sends an empty query over the given connection and returns
+ * whether the node responded within citus.node_connection_timeout, which is a
+ * single round trip that does not start a transaction on the node.
+ */
+static bool
+ProbeConnection(MultiConnection *connection)
+{
+	PGconn *pgConn = connection->pgConn;
+	bool responded = true;
+
+	if (PQstatus(pgConn) != CONNECTION_OK || PQisBusy(pgConn) ||
+		PQsendQuery(pgConn, "") == 0)
+	{
+		return false;
+	}
+
+	TimestampTz deadline = TimestampTzPlusMilliseconds(GetCurrentTimestamp(),
+													   NodeConnectionTimeout);
+
+	while (true)
+	{
+		int waitFlags = WL_POSTMASTER_DEATH | WL_LATCH_SET | WL_TIMEOUT;
+
+		int sendStatus = PQflush(pgConn);
+		if (sendStatus == -1)
+		{
+			return false;
+		}
+		else if (sendStatus == 1)
+		{
+			waitFlags |= WL_SOCKET_WRITEABLE;
+		}
+
+		if (PQconsumeInput(pgConn) == 0)
+		{
+			return false;
+		}
+
+		if (PQisBusy(pgConn))
+		{
+			waitFlags |= WL_SOCKET_READABLE;
+		}
+
+		if ((waitFlags & (WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE)) == 0)
+		{
+			break;
+		}
+
+		long timeout = DeadlineTimestampTzToTimeout(deadline);
+		if (timeout <= 0)
+		{
+			return false;
+		}
+
+		int rc = WaitLatchOrSocket(MyLatch, waitFlags, PQsocket(pgConn), timeout,
+								   WAIT_EVENT_CITUS_REMOTE_RESULT);
+		if (rc & WL_POSTMASTER_DEATH)
+		{
+			ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
+		}
+
+		if (rc & WL_LATCH_SET)
+		{
+			ResetLatch(MyLatch);
+			CHECK_FOR_INTERRUPTS();
+		}
+	}
+
+	PGresult *result = NULL;
+	while ((result = PQgetResult(pgConn)) != NULL)
+	{
+		if (PQresultStatus(result) != PGRES_EMPTY_QUERY)
+		{
+			responded = false;
+		}
+
+		PQclear(result);
+	}
+
+	return responded;
 }
 
 
@@ -437,6 +863,7 @@ CloseConnection(MultiConnection *connection)
 	/* close connection */
 	PQfinish(connection->pgConn);
 	connection->pgConn = NULL;
+	ReleaseSharedConnectionSlot(connection);
 
 	strlcpy(key.hostname, connection->hostname, MAX_NODE_LENGTH);
 	key.port = connection->port;
@@ -453,6 +880,7 @@ CloseConnection(MultiConnection *connection)
 		/* same for transaction state and shard/placement machinery */
 		CloseRemoteTransaction(connection);
 		CloseShardPlacementAssociation(connection);
+		FreeRemotePreparedStatements(connection);
 
 		/* we leave the per-host entry alive */
 		pfree(connection);
@@ -487,6 +915,7 @@ ShutdownConnection(MultiConnection *connection)
 	}
 	PQfinish(connection->pgConn);
 	connection->pgConn = NULL;
+	ReleaseSharedConnectionSlot(connection);
 }
 
 
@@ -507,12 +936,15 @@ MultiConnectionStatePoll(MultiConnectionPollState *connectionState)
 	if (status == CONNECTION_OK)
 	{
 		connectionState->phase = MULTI_CONNECTION_PHASE_CONNECTED;
+		RecordConnectionEstablishmentResult(connection,
+											CONNECTION_ATTEMPT_SUCCEEDED);
 		return true;
 	}
 	else if (status == CONNECTION_BAD)
 	{
 		/* FIXME: retries? */
 		connectionState->phase = MULTI_CONNECTION_PHASE_ERROR;
+		RecordConnectionEstablishmentResult(connection, CONNECTION_ATTEMPT_FAILED);
 		return true;
 	}
 	else
@@ -528,11 +960,14 @@ MultiConnectionStatePoll(MultiConnectionPollState *connectionState)
 	if (connectionState->pollmode == PGRES_POLLING_FAILED)
 	{
 		connectionState->phase = MULTI_CONNECTION_PHASE_ERROR;
+		RecordConnectionEstablishmentResult(connection, CONNECTION_ATTEMPT_FAILED);
 		return true;
 	}
 	else if (connectionState->pollmode == PGRES_POLLING_OK)
 	{
 		connectionState->phase = MULTI_CONNECTION_PHASE_CONNECTED;
+		RecordConnectionEstablishmentResult(connection,
+											CONNECTION_ATTEMPT_SUCCEEDED);
 		return true;
 	}
 	else
@@ -719,7 +1154,7 @@ FinishConnectionListEstablishment(List *multiConnectionList)
 		}
 
 		int eventCount = WaitEventSetWait(waitEventSet, timeout, events, waitCount,
-										  WAIT_EVENT_CLIENT_READ);
+										  WAIT_EVENT_CITUS_CONNECT);
 
 		for (int eventIndex = 0; eventIndex < eventCount; eventIndex++)
 		{
@@ -847,9 +1282,13 @@ CloseNotReadyMultiConnectionStates(List *connectionStates)
 			continue;
 		}
 
+		RecordConnectionEstablishmentResult(connection,
+											CONNECTION_ATTEMPT_TIMED_OUT);
+
 		/* close connection, otherwise we take up resource on the other side */
 		PQfinish(connection->pgConn);
 		connection->pgConn = NULL;
+		ReleaseSharedConnectionSlot(connection);
 	}
 }
 
@@ -966,6 +1405,8 @@ StartConnectionEstablishment(ConnectionHashKey *key)
 											  false);
 	connection->connectionStart = GetCurrentTimestamp();
 
+	RecordConnectionEstablishmentStart(connection);
+
 	/*
 	 * To avoid issues with interrupts not getting caught all our connections
 	 * are managed in a non-blocking manner. remote_commands.c provides
@@ -1061,6 +1502,7 @@ AfterXactHostConnectionHandling(ConnectionHashEntry *entry, bool isCommit)
 			/* unlink from list */
 			dlist_delete(iter.cur);
 
+			FreeRemotePreparedStatements(connection);
 			pfree(connection);
 		}
 		else
@@ -1087,20 +1529,12 @@ AfterXactHostConnectionHandling(ConnectionHashEntry *entry, bool isCommit)
 static bool
 ShouldShutdownConnection(MultiConnection *connection, const int cachedConnectionCount)
 {
-	bool isCitusInitiatedBackend = false;
-
 	/*
 	 * When we are in a backend that was created to serve an internal connection
 	 * from the coordinator or another worker, we disable connection caching to avoid
-	 * escalating the number of cached connections. We can recognize such backends
-	 * from their application name.
+	 * escalating the number of cached connections.
 	 */
-	if (application_name != NULL && strcmp(application_name, CITUS_APPLICATION_NAME) == 0)
-	{
-		isCitusInitiatedBackend = true;
-	}
-
-	return isCitusInitiatedBackend ||
+	return IsCitusInitiatedBackend() ||
 		   cachedConnectionCount >= MaxCachedConnectionsPerWorker ||
 		   connection->forceCloseAtTransactionEnd ||
 		   PQstatus(connection->pgConn) != CONNECTION_OK ||
@@ -1108,6 +1542,19 @@ ShouldShutdownConnection(MultiConnection *connection, const int cachedConnection
 }
 
 
+/*
+ * IsCitusInitiatedBackend returns whether the current backend was created to serve
+ * an internal connection from the coordinator or another worker. We can recognize
+ * such backends from their application name.
+ */
+static bool
+IsCitusInitiatedBackend(void)
+{
+	return application_name != NULL &&
+		   strcmp(application_name, CITUS_APPLICATION_NAME) == 0;
+}
+
+
 /*
  * ResetConnection preserves the given connection for later usage by
  * resetting its states.
@@ -1123,6 +1570,8 @@ ResetConnection(MultiConnection *connection)
 	connection->copyBytesWrittenSinceLastFlush = 0;
 
 	UnclaimConnection(connection);
+
+	connection->cachedSince = GetCurrentTimestamp();
 }
 
 
@@ -1146,6 +1595,12 @@ RemoteTransactionIdle(MultiConnection *connection)
 		return true;
 	}
 
+	/* COMMIT PREPARED leaves the connection idle once its result is consumed */
+	if (connection->commitPreparedPending)
+	{
+		return true;
+	}
+
 	return PQtransactionStatus(connection->pgConn) == PQTRANS_IDLE;
 }
 
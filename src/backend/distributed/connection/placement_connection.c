@@ -188,6 +188,7 @@ static ConnectionPlacementHashEntry * FindOrCreatePlacementEntry(
 	ShardPlacement *placement);
 static bool CanUseExistingConnection(uint32 flags, const char *userName,
 									 ConnectionReference *placementConnection);
+static bool PlacementOfNonReferenceTable(ShardPlacement *placement);
 static bool ConnectionAccessedDifferentPlacement(MultiConnection *connection,
 												 ShardPlacement *placement);
 static void AssociatePlacementWithShard(ConnectionPlacementHashEntry *placementEntry,
@@ -435,13 +436,36 @@ AssignPlacementListToConnection(List *placementAccessList, MultiConnection *conn
 			placementConnection->hadDML = true;
 		}
 
-		/* record the relation access */
-		Oid relationId = RelationIdForShard(placement->shardId);
-		RecordRelationAccessIfReferenceTable(relationId, accessType);
+		/*
+		 * Record the relation access. Only accesses to reference tables are
+		 * recorded, so we can skip looking up the relation for placements of
+		 * other tables.
+		 */
+		if (ShouldRecordRelationAccess() &&
+			!PlacementOfNonReferenceTable(placement))
+		{
+			Oid relationId = RelationIdForShard(placement->shardId);
+			RecordRelationAccessIfReferenceTable(relationId, accessType);
+		}
 	}
 }
 
 
+/*
+ * PlacementOfNonReferenceTable returns whether the partition method stored in
+ * the placement shows that it does not belong to a reference table. Placements
+ * that were not loaded from the metadata might not have the partition method
+ * set, in which case we return false.
+ */
+static bool
+PlacementOfNonReferenceTable(ShardPlacement *placement)
+{
+	return placement->partitionMethod == DISTRIBUTE_BY_HASH ||
+		   placement->partitionMethod == DISTRIBUTE_BY_RANGE ||
+		   placement->partitionMethod == DISTRIBUTE_BY_APPEND;
+}
+
+
 /*
  * GetConnectionIfPlacementAccessedInXact returns the connection over which
  * the placement has been access in the transaction. If not found, returns
@@ -689,10 +713,13 @@ FindOrCreatePlacementEntry(ShardPlacement *placement)
 
 			placementEntry->primaryConnection = (ConnectionReference *) conRef;
 		}
-	}
 
-	/* record association with shard, for invalidation */
-	AssociatePlacementWithShard(placementEntry, placement);
+		/*
+		 * Record association with shard, for invalidation. Entries live until
+		 * the end of the transaction, so this only needs to happen once.
+		 */
+		AssociatePlacementWithShard(placementEntry, placement);
+	}
 
 	return placementEntry;
 }
@@ -808,6 +835,45 @@ ConnectionModifiedPlacement(MultiConnection *connection)
 }
 
 
+/*
+ * FindModifyingConnectionForNode returns a connection to the given node that
+ * modified placements in the current transaction and is not claimed by an
+ * execution, or NULL if no such connection exists.
+ */
+MultiConnection *
+FindModifyingConnectionForNode(const char *hostname, int port, const char *userName)
+{
+	ConnectionHashKey key;
+	bool found = false;
+	dlist_iter iter;
+
+	memset(&key, 0, sizeof(ConnectionHashKey));
+	strlcpy(key.hostname, hostname, MAX_NODE_LENGTH);
+	key.port = port;
+	strlcpy(key.user, userName != NULL ? userName : CurrentUserName(), NAMEDATALEN);
+	strlcpy(key.database, CurrentDatabaseName(), NAMEDATALEN);
+
+	ConnectionHashEntry *entry = hash_search(ConnectionHash, &key, HASH_FIND, &found);
+	if (!found)
+	{
+		return NULL;
+	}
+
+	dlist_foreach(iter, entry->connections)
+	{
+		MultiConnection *connection =
+			dlist_container(MultiConnection, connectionNode, iter.cur);
+
+		if (!connection->claimedExclusively && ConnectionModifiedPlacement(connection))
+		{
+			return connection;
+		}
+	}
+
+	return NULL;
+}
+
+
 /*
  * ConnectionUsedForAnyPlacements returns true if the connection
  * has not been associated with any placement.
@@ -832,7 +898,6 @@ AssociatePlacementWithShard(ConnectionPlacementHashEntry *placementEntry,
 {
 	ConnectionShardHashKey shardKey;
 	bool found = false;
-	dlist_iter placementIter;
 
 	shardKey.shardId = placement->shardId;
 	ConnectionShardHashEntry *shardEntry = hash_search(ConnectionShardHash, &shardKey,
@@ -843,22 +908,9 @@ AssociatePlacementWithShard(ConnectionPlacementHashEntry *placementEntry,
 	}
 
 	/*
-	 * Check if placement is already associated with shard (happens if there's
-	 * multiple connections for a placement).  There'll usually only be few
-	 * placement per shard, so the price of iterating isn't large.
+	 * Placement entries are only associated when they are created, hence the
+	 * placement cannot already be in the list.
 	 */
-	dlist_foreach(placementIter, &shardEntry->placementConnections)
-	{
-		ConnectionPlacementHashEntry *currPlacementEntry =
-			dlist_container(ConnectionPlacementHashEntry, shardNode, placementIter.cur);
-
-		if (currPlacementEntry->key.placementId == placement->placementId)
-		{
-			return;
-		}
-	}
-
-	/* otherwise add */
 	dlist_push_tail(&shardEntry->placementConnections, &placementEntry->shardNode);
 }
 
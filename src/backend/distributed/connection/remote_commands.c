@@ -13,6 +13,7 @@
 
 #include "libpq-fe.h"
 
+#include "distributed/citus_wait_events.h"
 #include "distributed/connection_management.h"
 #include "distributed/errormessage.h"
 #include "distributed/log_utils.h"
@@ -32,7 +33,8 @@ bool LogRemoteCommands = false;
 
 static bool ClearResultsInternal(MultiConnection *connection, bool raiseErrors,
 								 bool discardWarnings);
-static bool FinishConnectionIO(MultiConnection *connection, bool raiseInterrupts);
+static bool FinishConnectionIO(MultiConnection *connection, bool raiseInterrupts,
+							   uint32 waitEventInfo);
 static WaitEventSet * BuildWaitEventSet(MultiConnection **allConnections,
 										int totalConnectionCount,
 										int pendingConnectionsStartIndex);
@@ -456,12 +458,13 @@ ExecuteOptionalRemoteCommand(MultiConnection *connection, const char *command,
  * and accepts a MultiConnection instead of a plain PGconn. It makes sure it can
  * send commands asynchronously without blocking (at the potential expense of
  * an additional memory allocation). The command string can only include a single
- * command since PQsendQueryParams() supports only that.
+ * command since PQsendQueryParams() supports only that. If binaryResults is
+ * true, the worker returns the result values in binary format.
  */
 int
 SendRemoteCommandParams(MultiConnection *connection, const char *command,
 						int parameterCount, const Oid *parameterTypes,
-						const char *const *parameterValues)
+						const char *const *parameterValues, bool binaryResults)
 {
 	PGconn *pgConn = connection->pgConn;
 
@@ -479,7 +482,69 @@ SendRemoteCommandParams(MultiConnection *connection, const char *command,
 	Assert(PQisnonblocking(pgConn));
 
 	int rc = PQsendQueryParams(pgConn, command, parameterCount, parameterTypes,
-							   parameterValues, NULL, NULL, 0);
+							   parameterValues, NULL, NULL, binaryResults ? 1 : 0);
+
+	return rc;
+}
+
+
+/*
+ * SendRemotePrepare is a PQsendPrepare wrapper that logs remote commands, and
+ * accepts a MultiConnection instead of a plain PGconn. It prepares the given
+ * command under the given statement name.
+ */
+int
+SendRemotePrepare(MultiConnection *connection, const char *statementName,
+				  const char *command, int parameterCount, const Oid *parameterTypes)
+{
+	PGconn *pgConn = connection->pgConn;
+
+	LogRemoteCommand(connection, command);
+
+	/*
+	 * Don't try to send command if connection is entirely gone
+	 * (PQisnonblocking() would crash).
+	 */
+	if (!pgConn || PQstatus(pgConn) != CONNECTION_OK)
+	{
+		return 0;
+	}
+
+	Assert(PQisnonblocking(pgConn));
+
+	int rc = PQsendPrepare(pgConn, statementName, command, parameterCount,
+						   parameterTypes);
+
+	return rc;
+}
+
+
+/*
+ * SendRemoteCommandPrepared is a PQsendQueryPrepared wrapper that accepts a
+ * MultiConnection instead of a plain PGconn. It executes the statement that
+ * was prepared under the given name with the given parameter values. If
+ * binaryResults is true, the worker returns the result values in binary format.
+ */
+int
+SendRemoteCommandPrepared(MultiConnection *connection, const char *statementName,
+						  int parameterCount, const char *const *parameterValues,
+						  bool binaryResults)
+{
+	PGconn *pgConn = connection->pgConn;
+
+	/*
+	 * Don't try to send command if connection is entirely gone
+	 * (PQisnonblocking() would crash).
+	 */
+	if (!pgConn || PQstatus(pgConn) != CONNECTION_OK)
+	{
+		return 0;
+	}
+
+	Assert(PQisnonblocking(pgConn));
+
+	int rc = PQsendQueryPrepared(pgConn, statementName, parameterCount,
+								 parameterValues, NULL, NULL, binaryResults ? 1 : 0);
 
 	return rc;
 }
@@ -578,7 +643,8 @@ GetRemoteCommandResult(MultiConnection *connection, bool raiseInterrupts)
 		return PQgetResult(connection->pgConn);
 	}
 
-	if (!FinishConnectionIO(connection, raiseInterrupts))
+	if (!FinishConnectionIO(connection, raiseInterrupts,
+							WAIT_EVENT_CITUS_REMOTE_RESULT))
 	{
 		/* some error(s) happened while doing the I/O, signal the callers */
 		if (PQstatus(pgConn) == CONNECTION_BAD)
@@ -639,7 +705,8 @@ PutRemoteCopyData(MultiConnection *connection, const char *buffer, int nbytes)
 	if (connection->copyBytesWrittenSinceLastFlush > MAX_PUT_COPY_DATA_BUFFER_SIZE)
 	{
 		connection->copyBytesWrittenSinceLastFlush = 0;
-		return FinishConnectionIO(connection, allowInterrupts);
+		return FinishConnectionIO(connection, allowInterrupts,
+								  WAIT_EVENT_CITUS_COPY_FLUSH);
 	}
 
 	return true;
@@ -675,7 +742,7 @@ PutRemoteCopyEnd(MultiConnection *connection, const char *errormsg)
 
 	connection->copyBytesWrittenSinceLastFlush = 0;
 
-	return FinishConnectionIO(connection, allowInterrupts);
+	return FinishConnectionIO(connection, allowInterrupts, WAIT_EVENT_CITUS_COPY_FLUSH);
 }
 
 
@@ -686,10 +753,13 @@ PutRemoteCopyEnd(MultiConnection *connection, const char *errormsg)
  * See GetRemoteCommandResult() for documentation of interrupt handling
  * behaviour.
  *
+ * The wait is reported as the given wait event.
+ *
  * Returns true if IO was successfully completed, false otherwise.
  */
 static bool
-FinishConnectionIO(MultiConnection *connection, bool raiseInterrupts)
+FinishConnectionIO(MultiConnection *connection, bool raiseInterrupts,
+				   uint32 waitEventInfo)
 {
 	PGconn *pgConn = connection->pgConn;
 	int sock = PQsocket(pgConn);
@@ -736,7 +806,7 @@ FinishConnectionIO(MultiConnection *connection, bool raiseInterrupts)
 			return true;
 		}
 
-		int rc = WaitLatchOrSocket(MyLatch, waitFlags, sock, 0, PG_WAIT_EXTENSION);
+		int rc = WaitLatchOrSocket(MyLatch, waitFlags, sock, 0, waitEventInfo);
 		if (rc & WL_POSTMASTER_DEATH)
 		{
 			ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
@@ -775,6 +845,19 @@ FinishConnectionIO(MultiConnection *connection, bool raiseInterrupts)
  */
 void
 WaitForAllConnections(List *connectionList, bool raiseInterrupts)
+{
+	WaitForAllConnectionsExtended(connectionList, raiseInterrupts,
+								  WAIT_EVENT_CITUS_REMOTE_RESULT);
+}
+
+
+/*
+ * WaitForAllConnectionsExtended is a version of WaitForAllConnections that
+ * reports the wait as the given wait event.
+ */
+void
+WaitForAllConnectionsExtended(List *connectionList, bool raiseInterrupts,
+							  uint32 waitEventInfo)
 {
 	int totalConnectionCount = list_length(connectionList);
 	int pendingConnectionsStartIndex = 0;
@@ -841,7 +924,7 @@ WaitForAllConnections(List *connectionList, bool raiseInterrupts)
 			/* wait for I/O events */
 			int eventCount = WaitEventSetWait(waitEventSet, timeout, events,
 											  pendingConnectionCount,
-											  WAIT_EVENT_CLIENT_READ);
+											  waitEventInfo);
 
 			/* process I/O events */
 			for (; eventIndex < eventCount; eventIndex++)
@@ -0,0 +1,250 @@
+/*-------------------------------------------------------------------------
+ *
+ * remote_prepared_statements.c
+ *
+ * Parameterized task queries are sent to the workers with the same query
+ * string on every execution of a prepared statement. Rather than having the
+ * worker parse and plan the query every time, the adaptive executor prepares
+ * the query once per connection and afterwards only sends the parameters.
+ * This file keeps track of the statements that are prepared on each
+ * connection.
+ *
+ * Prepared statements on the workers are not transactional, so they remain
+ * valid until the connection is closed. When a distributed table changes,
+ * the result type of a statement might change as well, which a prepared
+ * statement does not allow. We therefore stop using the statements that
+ * were prepared before the change and prepare the queries again under a
+ * new name.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/hash.h"
+#include "distributed/remote_prepared_statements.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+
+
+/*
+ * Upper bound on the number of statements that we prepare on a connection,
+ * including the ones that are no longer used. Further queries are sent
+ * without preparing them.
+ */
+#define MAX_REMOTE_PREPARED_STATEMENTS 1024
+
+
+/* config variable managed via guc.c */
+bool EnableWorkerPreparedStatements = true;
+
+/*
+ * Incremented whenever a distributed table changes, statements that were
+ * prepared before are not used anymore.
+ */
+static uint64 RemotePreparedStatementGeneration = 0;
+
+
+static void CreateRemotePreparedStatementHash(MultiConnection *connection);
+static uint32 RemotePreparedStatementHash(const void *key, Size keysize);
+static int RemotePreparedStatementCompare(const void *leftKey, const void *rightKey,
+										  Size keysize);
+
+
+/*
+ * FindRemotePreparedStatement returns the statement that was prepared on the
+ * connection for the given query string and parameter types, or NULL if the
+ * query has not been prepared yet or its statement should not be used anymore.
+ */
+RemotePreparedStatement *
+FindRemotePreparedStatement(MultiConnection *connection, const char *queryString,
+							int parameterCount, const Oid *parameterTypes)
+{
+	bool found = false;
+
+	if (connection->preparedStatementHash == NULL)
+	{
+		return NULL;
+	}
+
+	RemotePreparedStatement *statement =
+		(RemotePreparedStatement *) hash_search(connection->preparedStatementHash,
+												&queryString, HASH_FIND, &found);
+	if (!found)
+	{
+		return NULL;
+	}
+
+	if (statement->generation != RemotePreparedStatementGeneration)
+	{
+		/* a distributed table changed since the statement was prepared */
+		return NULL;
+	}
+
+	if (statement->parameterCount != parameterCount ||
+		memcmp(statement->parameterTypes, parameterTypes,
+			   parameterCount * sizeof(Oid)) != 0)
+	{
+		/* same query string used with differently typed parameters */
+		return NULL;
+	}
+
+	return statement;
+}
+
+
+/*
+ * CanPrepareRemoteStatement returns whether another statement may be prepared
+ * on the connection.
+ */
+bool
+CanPrepareRemoteStatement(MultiConnection *connection)
+{
+	return connection->preparedStatementCount < MAX_REMOTE_PREPARED_STATEMENTS;
+}
+
+
+/*
+ * NextRemotePreparedStatementName returns a statement name that has not been
+ * used on the connection yet.
+ */
+char *
+NextRemotePreparedStatementName(MultiConnection *connection)
+{
+	char *statementName = palloc0(NAMEDATALEN);
+
+	snprintf(statementName, NAMEDATALEN, "citus_stmt_%d",
+			 connection->preparedStatementCount++);
+
+	return statementName;
+}
+
+
+/*
+ * AddRemotePreparedStatement remembers that the given query string has been
+ * prepared on the connection under the given statement name. It should only
+ * be called once the worker reported that the statement was prepared.
+ */
+void
+AddRemotePreparedStatement(MultiConnection *connection, const char *statementName,
+						   const char *queryString, int parameterCount,
+						   const Oid *parameterTypes)
+{
+	bool found = false;
+
+	if (connection->preparedStatementHash == NULL)
+	{
+		CreateRemotePreparedStatementHash(connection);
+	}
+
+	RemotePreparedStatement *statement =
+		(RemotePreparedStatement *) hash_search(connection->preparedStatementHash,
+												&queryString, HASH_ENTER, &found);
+
+	if (!found)
+	{
+		/* the key should point to memory that lives as long as the entry */
+		statement->queryString = MemoryContextStrdup(ConnectionContext, queryString);
+	}
+	else
+	{
+		/* replaces a statement that is not used anymore, which we do not track */
+		pfree(statement->parameterTypes);
+	}
+
+	strlcpy(statement->statementName, statementName, NAMEDATALEN);
+	statement->parameterCount = parameterCount;
+	statement->parameterTypes =
+		MemoryContextAllocZero(ConnectionContext, Max(parameterCount, 1) * sizeof(Oid));
+	memcpy(statement->parameterTypes, parameterTypes, parameterCount * sizeof(Oid));
+	statement->generation = RemotePreparedStatementGeneration;
+}
+
+
+/*
+ * FreeRemotePreparedStatements frees the bookkeeping of the statements that
+ * were prepared on the connection, which is called when the connection is
+ * closed.
+ */
+void
+FreeRemotePreparedStatements(MultiConnection *connection)
+{
+	HASH_SEQ_STATUS status;
+	RemotePreparedStatement *statement = NULL;
+
+	if (connection->preparedStatementHash == NULL)
+	{
+		return;
+	}
+
+	hash_seq_init(&status, connection->preparedStatementHash);
+	while ((statement = hash_seq_search(&status)) != NULL)
+	{
+		pfree(statement->queryString);
+		pfree(statement->parameterTypes);
+	}
+
+	hash_destroy(connection->preparedStatementHash);
+	connection->preparedStatementHash = NULL;
+}
+
+
+/*
+ * InvalidateRemotePreparedStatements is called when a distributed table
+ * changes and stops the use of statements that were prepared before.
+ */
+void
+InvalidateRemotePreparedStatements(void)
+{
+	RemotePreparedStatementGeneration++;
+}
+
+
+/*
+ * CreateRemotePreparedStatementHash creates the hash that maps query strings
+ * to the statements prepared on the connection.
+ */
+static void
+CreateRemotePreparedStatementHash(MultiConnection *connection)
+{
+	HASHCTL info;
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(char *);
+	info.entrysize = sizeof(RemotePreparedStatement);
+	info.hash = RemotePreparedStatementHash;
+	info.match = RemotePreparedStatementCompare;
+	info.hcxt = ConnectionContext;
+	uint32 hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT | HASH_COMPARE);
+
+	connection->preparedStatementHash =
+		hash_create("citus remote prepared statements", 32, &info, hashFlags);
+}
+
+
+/*
+ * RemotePreparedStatementHash hashes the query string that the key points to.
+ */
+static uint32
+RemotePreparedStatementHash(const void *key, Size keysize)
+{
+	const char *queryString = *(const char **) key;
+
+	return hash_any((const unsigned char *) queryString, strlen(queryString));
+}
+
+
+/*
+ * RemotePreparedStatementCompare compares the query strings that the keys
+ * point to.
+ */
+static int
+RemotePreparedStatementCompare(const void *leftKey, const void *rightKey, Size keysize)
+{
+	const char *leftQueryString = *(const char **) leftKey;
+	const char *rightQueryString = *(const char **) rightKey;
+
+	return strcmp(leftQueryString, rightQueryString);
+}
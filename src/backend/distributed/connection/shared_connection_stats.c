@@ -0,0 +1,655 @@
+/*-------------------------------------------------------------------------
+ *
+ * shared_connection_stats.c
+ *   Keeps track of the number of connections to remote nodes across
+ *   backends.
+ *
+ * Connections are cached per backend in ConnectionHash, which means that
+ * the total number of connections that a node opens to a worker grows with
+ * the number of client sessions. The functions in this file count the
+ * connections that all backends on the node have open to each worker in
+ * shared memory, such that citus.max_shared_pool_size can be enforced
+ * across the whole node rather than per backend.
+ *
+ * Backends running with citus.execution_priority set to high register
+ * themselves in the entry of the node while they wait for a connection slot.
+ * As long as there are such waiters, other backends do not get new slots
+ * for that node, such that the slots that are released go to high priority
+ * executions first.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "pgstat.h"
+#include "miscadmin.h"
+
+#include "funcapi.h"
+#include "access/hash.h"
+#include "distributed/admission_control.h"
+#include "distributed/citus_wait_events.h"
+#include "distributed/connection_management.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/shared_connection_stats.h"
+#include "distributed/tuplestore.h"
+#include "distributed/worker_manager.h"
+#include "storage/condition_variable.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/timestamp.h"
+#include "utils/tuplestore.h"
+
+
+#define REMOTE_CONNECTION_STATS_COLUMNS 3
+
+
+/*
+ * ConnectionStatsSharedData holds the lock that protects the shared
+ * connection hash and the condition variable that backends waiting for
+ * a connection slot sleep on.
+ */
+typedef struct ConnectionStatsSharedData
+{
+	int sharedConnectionHashTrancheId;
+	char *sharedConnectionHashTrancheName;
+
+	LWLock sharedConnectionHashLock;
+	ConditionVariable waitersConditionVariable;
+} ConnectionStatsSharedData;
+
+
+/*
+ * The shared hash is keyed on the worker node, since the limit we want to
+ * enforce is the number of connections each worker node gets from this node.
+ */
+typedef struct SharedConnStatsHashKey
+{
+	char hostname[MAX_NODE_LENGTH];
+	int32 port;
+} SharedConnStatsHashKey;
+
+/* hash entry for per worker stats */
+typedef struct SharedConnStatsHashEntry
+{
+	SharedConnStatsHashKey key;
+
+	int connectionCount;
+
+	/* number of high priority backends waiting for a connection slot */
+	int highPriorityWaiterCount;
+} SharedConnStatsHashEntry;
+
+
+/*
+ * Controlled via a GUC, never access directly, use GetMaxSharedPoolSize().
+ * "0" means adjust MaxSharedPoolSize automatically by using MaxConnections.
+ * "-1" means do not apply connection throttling.
+ * Anything else means use that number.
+ */
+int MaxSharedPoolSize = 0;
+
+
+/* the following two structs are used for accessing shared memory */
+static HTAB *SharedConnStatsHash = NULL;
+static ConnectionStatsSharedData *ConnectionStatsSharedState = NULL;
+
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+
+/* local function declarations */
+static void StoreAllRemoteConnectionStats(Tuplestorestate *tupleStore, TupleDesc
+										  tupleDescriptor);
+static void LockConnectionSharedMemory(LWLockMode lockMode);
+static void UnLockConnectionSharedMemory(void);
+static void SharedConnectionStatsShmemInit(void);
+static size_t SharedConnectionStatsShmemSize(void);
+static void InitSharedConnStatsHashKey(SharedConnStatsHashKey *connKey,
+									   const char *hostname, int port);
+static void AdjustHighPriorityWaiterCount(const char *hostname, int port,
+										  int delta);
+
+
+PG_FUNCTION_INFO_V1(citus_remote_connection_stats);
+
+
+/*
+ * citus_remote_connection_stats returns all the available information about
+ * the connections that all the backends on this node have open to the remote
+ * nodes.
+ */
+Datum
+citus_remote_connection_stats(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupleDescriptor = NULL;
+
+	CheckCitusVersion(ERROR);
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	StoreAllRemoteConnectionStats(tupleStore, tupleDescriptor);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupleStore);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * StoreAllRemoteConnectionStats gets connections established from the current
+ * node to the remote nodes and writes them to the tuple store.
+ */
+static void
+StoreAllRemoteConnectionStats(Tuplestorestate *tupleStore, TupleDesc tupleDescriptor)
+{
+	Datum values[REMOTE_CONNECTION_STATS_COLUMNS];
+	bool isNulls[REMOTE_CONNECTION_STATS_COLUMNS];
+
+	/* we're reading all the entries, shared lock is enough */
+	LockConnectionSharedMemory(LW_SHARED);
+
+	HASH_SEQ_STATUS status;
+	SharedConnStatsHashEntry *connectionEntry = NULL;
+
+	hash_seq_init(&status, SharedConnStatsHash);
+	while ((connectionEntry = hash_seq_search(&status)) != 0)
+	{
+		/* get ready for the next tuple */
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		values[0] = PointerGetDatum(cstring_to_text(connectionEntry->key.hostname));
+		values[1] = Int32GetDatum(connectionEntry->key.port);
+		values[2] = Int32GetDatum(connectionEntry->connectionCount);
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	UnLockConnectionSharedMemory();
+}
+
+
+/*
+ * GetMaxSharedPoolSize is a wrapper around MaxSharedPoolSize which is controlled
+ * via a GUC.
+ *  "0" means adjust MaxSharedPoolSize automatically by using MaxConnections
+ *  "-1" means do not apply connection throttling
+ *  Anything else means use that number
+ */
+int
+GetMaxSharedPoolSize(void)
+{
+	if (MaxSharedPoolSize == ADJUST_POOLSIZE_AUTOMATICALLY)
+	{
+		return MaxConnections;
+	}
+
+	return MaxSharedPoolSize;
+}
+
+
+/*
+ * WaitLoopForSharedConnection tries to increment the shared connection
+ * counter for the given hostname/port. If the counter is already at the
+ * limit, the backend sleeps until another backend releases a connection
+ * to the same node. High priority backends announce themselves while they
+ * wait, such that they get the next slot that is released.
+ *
+ * Other backends may keep their connections to the node cached while they
+ * are idle, or may themselves wait for a slot on a node that we hold
+ * connections to. We therefore wait for at most citus.node_connection_timeout
+ * and return false if no slot was released in that time.
+ */
+bool
+WaitLoopForSharedConnection(const char *hostname, int port)
+{
+	ConditionVariable *waitersConditionVariable =
+		&ConnectionStatsSharedState->waitersConditionVariable;
+	bool highPriority = CurrentExecutionPriority == EXECUTION_PRIORITY_HIGH;
+	bool counterIncremented = false;
+
+	if (TryToIncrementSharedConnectionCounter(hostname, port))
+	{
+		return true;
+	}
+
+	TimestampTz waitStart = GetCurrentTimestamp();
+	TimestampTz deadline = TimestampTzPlusMilliseconds(waitStart, NodeConnectionTimeout);
+
+	if (highPriority)
+	{
+		AdjustHighPriorityWaiterCount(hostname, port, 1);
+	}
+
+	PG_TRY();
+	{
+		ConditionVariablePrepareToSleep(waitersConditionVariable);
+
+		while (true)
+		{
+			long secondsLeft = 0;
+			int microsecondsLeft = 0;
+
+			counterIncremented = TryToIncrementSharedConnectionCounter(hostname, port);
+			if (counterIncremented)
+			{
+				break;
+			}
+
+			TimestampDifference(GetCurrentTimestamp(), deadline, &secondsLeft,
+								&microsecondsLeft);
+
+			long timeoutMs = secondsLeft * 1000 + microsecondsLeft / 1000;
+			if (timeoutMs <= 0)
+			{
+				break;
+			}
+
+			/*
+			 * ConditionVariableSleep cannot time out, so we wait on our latch,
+			 * which ConditionVariableBroadcast sets when a slot is released.
+			 */
+			int rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+							   timeoutMs, WAIT_EVENT_CITUS_CONNECTION_SLOT);
+			ResetLatch(MyLatch);
+
+			/* emergency bailout if postmaster has died */
+			if (rc & WL_POSTMASTER_DEATH)
+			{
+				proc_exit(1);
+			}
+
+			CHECK_FOR_INTERRUPTS();
+
+			/* a broadcast removes us from the wait list, so get back on it */
+			ConditionVariablePrepareToSleep(waitersConditionVariable);
+		}
+
+		ConditionVariableCancelSleep();
+	}
+	PG_CATCH();
+	{
+		if (highPriority)
+		{
+			AdjustHighPriorityWaiterCount(hostname, port, -1);
+		}
+
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	if (highPriority)
+	{
+		AdjustHighPriorityWaiterCount(hostname, port, -1);
+	}
+
+	return counterIncremented;
+}
+
+
+/*
+ * AdjustHighPriorityWaiterCount changes the number of high priority backends
+ * that wait for a connection slot to the given node by delta. Normal priority
+ * backends that wait for the same node are woken up when the last high
+ * priority waiter leaves.
+ */
+static void
+AdjustHighPriorityWaiterCount(const char *hostname, int port, int delta)
+{
+	SharedConnStatsHashKey connKey;
+	bool entryFound = false;
+	bool wakeUpWaiters = false;
+
+	InitSharedConnStatsHashKey(&connKey, hostname, port);
+
+	LockConnectionSharedMemory(LW_EXCLUSIVE);
+
+	/* the entry may not exist if we could not allocate it while incrementing */
+	SharedConnStatsHashEntry *connectionEntry =
+		hash_search(SharedConnStatsHash, &connKey, HASH_FIND, &entryFound);
+	if (entryFound)
+	{
+		connectionEntry->highPriorityWaiterCount =
+			Max(connectionEntry->highPriorityWaiterCount + delta, 0);
+		wakeUpWaiters = connectionEntry->highPriorityWaiterCount == 0;
+	}
+
+	UnLockConnectionSharedMemory();
+
+	if (wakeUpWaiters)
+	{
+		ConditionVariableBroadcast(&ConnectionStatsSharedState->waitersConditionVariable);
+	}
+}
+
+
+/*
+ * TryToIncrementSharedConnectionCounter tries to increment the shared
+ * connection counter for the given hostname and port. It returns false
+ * if the node already has citus.max_shared_pool_size connections from
+ * this node.
+ *
+ * The function returns true if the counter is incremented or throttling
+ * is disabled. Backends that do not run with high priority do not get a slot
+ * while high priority backends wait for one.
+ */
+bool
+TryToIncrementSharedConnectionCounter(const char *hostname, int port)
+{
+	SharedConnStatsHashKey connKey;
+	bool counterIncremented = false;
+	bool entryFound = false;
+
+	if (GetMaxSharedPoolSize() == DISABLE_CONNECTION_THROTTLING)
+	{
+		/* connection throttling disabled */
+		return true;
+	}
+
+	InitSharedConnStatsHashKey(&connKey, hostname, port);
+
+	LockConnectionSharedMemory(LW_EXCLUSIVE);
+
+	/*
+	 * As the hash map is allocated in shared memory, it doesn't rely on palloc
+	 * for memory allocation, so we could get NULL via HASH_ENTER_NULL when there
+	 * is no space in the shared memory. That's why we prefer continuing the
+	 * execution instead of throwing an error.
+	 */
+	SharedConnStatsHashEntry *connectionEntry =
+		hash_search(SharedConnStatsHash, &connKey, HASH_ENTER_NULL, &entryFound);
+
+	if (!connectionEntry)
+	{
+		UnLockConnectionSharedMemory();
+
+		ereport(DEBUG4, (errmsg("no space left in the shared connection stats for "
+								"node %s:%d, not throttling the connection",
+								hostname, port)));
+
+		return true;
+	}
+
+	if (!entryFound)
+	{
+		/* we successfully allocated the entry for the first time, so initialize it */
+		connectionEntry->connectionCount = 0;
+		connectionEntry->highPriorityWaiterCount = 0;
+	}
+
+	/* leave the released slots to the high priority backends that wait for them */
+	bool yieldToHighPriority = connectionEntry->highPriorityWaiterCount > 0 &&
+							   CurrentExecutionPriority != EXECUTION_PRIORITY_HIGH;
+
+	if (!yieldToHighPriority &&
+		connectionEntry->connectionCount + 1 <= GetMaxSharedPoolSize())
+	{
+		connectionEntry->connectionCount++;
+		counterIncremented = true;
+	}
+
+	UnLockConnectionSharedMemory();
+
+	return counterIncremented;
+}
+
+
+/*
+ * IncrementSharedConnectionCounter increments the shared counter for the
+ * given hostname and port regardless of citus.max_shared_pool_size.
+ */
+void
+IncrementSharedConnectionCounter(const char *hostname, int port)
+{
+	SharedConnStatsHashKey connKey;
+	bool entryFound = false;
+
+	if (GetMaxSharedPoolSize() == DISABLE_CONNECTION_THROTTLING)
+	{
+		/* connection throttling disabled */
+		return;
+	}
+
+	InitSharedConnStatsHashKey(&connKey, hostname, port);
+
+	LockConnectionSharedMemory(LW_EXCLUSIVE);
+
+	SharedConnStatsHashEntry *connectionEntry =
+		hash_search(SharedConnStatsHash, &connKey, HASH_ENTER_NULL, &entryFound);
+
+	/* see TryToIncrementSharedConnectionCounter() for the details */
+	if (!connectionEntry)
+	{
+		UnLockConnectionSharedMemory();
+
+		ereport(DEBUG4, (errmsg("no space left in the shared connection stats for "
+								"node %s:%d, not tracking the connection",
+								hostname, port)));
+
+		return;
+	}
+
+	if (!entryFound)
+	{
+		connectionEntry->connectionCount = 0;
+		connectionEntry->highPriorityWaiterCount = 0;
+	}
+
+	connectionEntry->connectionCount += 1;
+
+	UnLockConnectionSharedMemory();
+}
+
+
+/*
+ * DecrementSharedConnectionCounter decrements the shared counter for the
+ * given hostname and port and wakes up the backends that wait for a
+ * connection slot.
+ */
+void
+DecrementSharedConnectionCounter(const char *hostname, int port)
+{
+	SharedConnStatsHashKey connKey;
+	bool entryFound = false;
+
+	InitSharedConnStatsHashKey(&connKey, hostname, port);
+
+	LockConnectionSharedMemory(LW_EXCLUSIVE);
+
+	SharedConnStatsHashEntry *connectionEntry =
+		hash_search(SharedConnStatsHash, &connKey, HASH_FIND, &entryFound);
+
+	/* the entry may not exist if we could not allocate it while incrementing */
+	if (entryFound && connectionEntry->connectionCount > 0)
+	{
+		connectionEntry->connectionCount -= 1;
+	}
+
+	UnLockConnectionSharedMemory();
+
+	ConditionVariableBroadcast(&ConnectionStatsSharedState->waitersConditionVariable);
+}
+
+
+/*
+ * GetSharedConnectionCount returns the number of connections that the backends
+ * on this node currently have open to the given node, as tracked for
+ * citus.max_shared_pool_size. The function returns 0 if the connections are
+ * not tracked because connection throttling is disabled.
+ */
+int
+GetSharedConnectionCount(const char *hostname, int port)
+{
+	SharedConnStatsHashKey connKey;
+	bool entryFound = false;
+	int connectionCount = 0;
+
+	if (GetMaxSharedPoolSize() == DISABLE_CONNECTION_THROTTLING)
+	{
+		return 0;
+	}
+
+	InitSharedConnStatsHashKey(&connKey, hostname, port);
+
+	LockConnectionSharedMemory(LW_SHARED);
+
+	SharedConnStatsHashEntry *connectionEntry =
+		hash_search(SharedConnStatsHash, &connKey, HASH_FIND, &entryFound);
+	if (entryFound)
+	{
+		connectionCount = connectionEntry->connectionCount;
+	}
+
+	UnLockConnectionSharedMemory();
+
+	return connectionCount;
+}
+
+
+/*
+ * InitSharedConnStatsHashKey fills the hash key for the given node. The key
+ * is zeroed first since the shared hash compares the keys byte-by-byte.
+ */
+static void
+InitSharedConnStatsHashKey(SharedConnStatsHashKey *connKey, const char *hostname,
+						   int port)
+{
+	if (strlen(hostname) > MAX_NODE_LENGTH)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("hostname exceeds the maximum length of %d",
+							   MAX_NODE_LENGTH)));
+	}
+
+	memset(connKey, 0, sizeof(SharedConnStatsHashKey));
+	strlcpy(connKey->hostname, hostname, MAX_NODE_LENGTH);
+	connKey->port = port;
+}
+
+
+/*
+ * LockConnectionSharedMemory is a utility function that should be used when
+ * accessing to the SharedConnStatsHash, which is in the shared memory.
+ */
+static void
+LockConnectionSharedMemory(LWLockMode lockMode)
+{
+	LWLockAcquire(&ConnectionStatsSharedState->sharedConnectionHashLock, lockMode);
+}
+
+
+/*
+ * UnLockConnectionSharedMemory is a utility function that should be used after
+ * LockConnectionSharedMemory().
+ */
+static void
+UnLockConnectionSharedMemory(void)
+{
+	LWLockRelease(&ConnectionStatsSharedState->sharedConnectionHashLock);
+}
+
+
+/*
+ * InitializeSharedConnectionStats requests the necessary shared memory
+ * from Postgres and sets up the shared memory startup hook.
+ */
+void
+InitializeSharedConnectionStats(void)
+{
+	/* allocate shared memory */
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(SharedConnectionStatsShmemSize());
+	}
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = SharedConnectionStatsShmemInit;
+}
+
+
+/*
+ * SharedConnectionStatsShmemSize returns the size that should be allocated
+ * on the shared memory for shared connection stats.
+ */
+static size_t
+SharedConnectionStatsShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(ConnectionStatsSharedData));
+
+	Size hashSize = hash_estimate_size(MaxWorkerNodesTracked,
+									   sizeof(SharedConnStatsHashEntry));
+
+	size = add_size(size, hashSize);
+
+	return size;
+}
+
+
+/*
+ * SharedConnectionStatsShmemInit initializes the shared memory used
+ * for keeping track of connection stats across backends.
+ */
+static void
+SharedConnectionStatsShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL info;
+
+	/* create (hostname, port) -> [counter] */
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(SharedConnStatsHashKey);
+	info.entrysize = sizeof(SharedConnStatsHashEntry);
+	info.hash = tag_hash;
+	uint32 hashFlags = (HASH_ELEM | HASH_FUNCTION);
+
+	/*
+	 * Currently the lock isn't required because allocation only happens at
+	 * startup in postmaster, but it doesn't hurt, and makes things more
+	 * consistent with other extensions.
+	 */
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	/* allocate space and initialize the shared state */
+	ConnectionStatsSharedState =
+		(ConnectionStatsSharedData *) ShmemInitStruct(
+			"Shared Connection Stats Data",
+			sizeof(ConnectionStatsSharedData),
+			&alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		ConnectionStatsSharedState->sharedConnectionHashTrancheId = LWLockNewTrancheId();
+		ConnectionStatsSharedState->sharedConnectionHashTrancheName =
+			"Shared Connection Tracking Hash Tranche";
+		LWLockRegisterTranche(ConnectionStatsSharedState->sharedConnectionHashTrancheId,
+							  ConnectionStatsSharedState->sharedConnectionHashTrancheName);
+
+		LWLockInitialize(&ConnectionStatsSharedState->sharedConnectionHashLock,
+						 ConnectionStatsSharedState->sharedConnectionHashTrancheId);
+
+		ConditionVariableInit(&ConnectionStatsSharedState->waitersConditionVariable);
+	}
+
+	/* allocate hash table */
+	SharedConnStatsHash =
+		ShmemInitHash("Shared Conn. Stats Hash", MaxWorkerNodesTracked,
+					  MaxWorkerNodesTracked, &info, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	Assert(SharedConnStatsHash != NULL);
+	Assert(ConnectionStatsSharedState->sharedConnectionHashTrancheId != 0);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
@@ -23,6 +23,7 @@
 #include "access/tupdesc.h"
 #include "catalog/dependency.h"
 #include "catalog/indexing.h"
+#include "catalog/pg_am.h"
 #include "catalog/namespace.h"
 #include "catalog/pg_attribute.h"
 #include "catalog/pg_authid.h"
@@ -444,6 +445,15 @@ pg_get_tableschemadef_string(Oid tableRelationId, bool includeSequenceDefaults)
 		char *partitioningInformation = GeneratePartitioningInformation(tableRelationId);
 		appendStringInfo(&buffer, " PARTITION BY %s ", partitioningInformation);
 	}
+#if PG_VERSION_NUM >= 120000
+	else if (relationKind == RELKIND_RELATION &&
+			 relation->rd_rel->relam != HEAP_TABLE_AM_OID)
+	{
+		/* shards use the same access method, e.g. of a columnar extension */
+		char *accessMethodName = get_am_name(relation->rd_rel->relam);
+		appendStringInfo(&buffer, " USING %s", quote_identifier(accessMethodName));
+	}
+#endif
 
 	/*
 	 * Add any reloptions (storage parameters) defined on the table in a WITH
@@ -0,0 +1,521 @@
+/*-------------------------------------------------------------------------
+ *
+ * fast_deparse_shard_query.c
+ *	  Lightweight deparsing of simple shard queries.
+ *
+ * deparse_shard_query() sets up the full ruleutils machinery for every shard
+ * query it deparses: it takes locks on the relations, overrides the search
+ * path, and builds the names of all range table entries and columns. For the
+ * single-row INSERTs that router queries send at a high rate, this is most of
+ * the time spent on deparsing. This file writes such queries directly, and
+ * produces the same query string as ruleutils would. Queries of any other
+ * shape, and queries that contain expressions or constants that we do not
+ * deparse here, are left to deparse_shard_query().
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include <ctype.h>
+
+#include "catalog/pg_type.h"
+#include "distributed/citus_ruleutils.h"
+#include "distributed/relay_utility.h"
+#include "lib/stringinfo.h"
+#include "nodes/nodeFuncs.h"
+#include "nodes/parsenodes.h"
+#include "nodes/pg_list.h"
+#include "parser/parser.h"
+#include "parser/parsetree.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+
+
+/* config variable managed via guc.c */
+bool EnableFastShardQueryDeparse = false;
+
+
+static bool FastDeparsableInsertQuery(Query *query, Oid distrelid, int64 shardid);
+static bool FastDeparsableExpression(Node *expression);
+static bool FastDeparsableConstType(Oid constType);
+static void AppendInsertQuery(StringInfo buffer, Query *query, int64 shardid);
+static void AppendReturningList(StringInfo buffer, Query *query);
+static void AppendExpression(StringInfo buffer, Node *expression, Oid relationId);
+static void AppendConst(StringInfo buffer, Const *constValue);
+static void AppendQuotedLiteral(StringInfo buffer, const char *value);
+
+
+/*
+ * FastDeparseShardQuery writes the query string of the given query on the given
+ * shard of distrelid into the buffer if the query is simple enough, and returns
+ * whether it did. The query string is the same as the one deparse_shard_query()
+ * builds, so callers fall back to that function if we return false.
+ *
+ * We currently only handle single-row INSERT ... VALUES commands without ON
+ * CONFLICT, whose values and RETURNING list consist of columns, constants,
+ * parameters and binary operators.
+ */
+bool
+FastDeparseShardQuery(Query *query, Oid distrelid, int64 shardid, StringInfo buffer)
+{
+	if (!EnableFastShardQueryDeparse)
+	{
+		return false;
+	}
+
+	if (!FastDeparsableInsertQuery(query, distrelid, shardid))
+	{
+		return false;
+	}
+
+	AppendInsertQuery(buffer, query, shardid);
+
+	return true;
+}
+
+
+/*
+ * FastDeparsableInsertQuery returns whether the given query is a single-row
+ * INSERT into the given shard that FastDeparseShardQuery can deparse.
+ */
+static bool
+FastDeparsableInsertQuery(Query *query, Oid distrelid, int64 shardid)
+{
+	ListCell *targetEntryCell = NULL;
+
+	if (query->commandType != CMD_INSERT || query->utilityStmt != NULL)
+	{
+		return false;
+	}
+
+	if (query->cteList != NIL || query->hasSubLinks || query->onConflict != NULL ||
+		query->override != OVERRIDING_NOT_SET)
+	{
+		return false;
+	}
+
+	/* multi-row INSERTs and INSERT ... SELECT have an additional range table entry */
+	if (list_length(query->rtable) != 1 || query->resultRelation != 1 ||
+		query->jointree == NULL || query->jointree->fromlist != NIL)
+	{
+		return false;
+	}
+
+	RangeTblEntry *rangeTableEntry = rt_fetch(query->resultRelation, query->rtable);
+	if (rangeTableEntry->rtekind != RTE_RELATION || rangeTableEntry->relid != distrelid ||
+		shardid <= 0)
+	{
+		return false;
+	}
+
+	foreach(targetEntryCell, query->targetList)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+
+		if (targetEntry->resjunk ||
+			!FastDeparsableExpression((Node *) targetEntry->expr))
+		{
+			return false;
+		}
+	}
+
+	foreach(targetEntryCell, query->returningList)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+
+		if (targetEntry->resjunk ||
+			!FastDeparsableExpression((Node *) targetEntry->expr))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * FastDeparsableExpression returns whether the given expression only consists
+ * of user columns of the target relation, constants of common built-in types,
+ * external parameters and binary operators.
+ */
+static bool
+FastDeparsableExpression(Node *expression)
+{
+	if (expression == NULL)
+	{
+		return false;
+	}
+
+	if (IsA(expression, Const))
+	{
+		Const *constValue = (Const *) expression;
+
+		/* we do not print COLLATE clauses */
+		if (OidIsValid(constValue->constcollid) &&
+			constValue->constcollid != get_typcollation(constValue->consttype))
+		{
+			return false;
+		}
+
+		return FastDeparsableConstType(constValue->consttype);
+	}
+	else if (IsA(expression, Param))
+	{
+		return ((Param *) expression)->paramkind == PARAM_EXTERN;
+	}
+	else if (IsA(expression, Var))
+	{
+		Var *column = (Var *) expression;
+
+		return column->varno == 1 && column->varlevelsup == 0 && column->varattno > 0;
+	}
+	else if (IsA(expression, OpExpr))
+	{
+		OpExpr *operatorExpression = (OpExpr *) expression;
+
+		if (list_length(operatorExpression->args) != 2)
+		{
+			return false;
+		}
+
+		return FastDeparsableExpression(linitial(operatorExpression->args)) &&
+			   FastDeparsableExpression(lsecond(operatorExpression->args));
+	}
+
+	return false;
+}
+
+
+/*
+ * FastDeparsableConstType returns whether we deparse constants of the given
+ * type. We only handle built-in types in pg_catalog, whose names do not depend
+ * on the search path.
+ */
+static bool
+FastDeparsableConstType(Oid constType)
+{
+	switch (constType)
+	{
+		case BOOLOID:
+		case INT2OID:
+		case INT4OID:
+		case INT8OID:
+		case NUMERICOID:
+		case FLOAT4OID:
+		case FLOAT8OID:
+		case TEXTOID:
+		case VARCHAROID:
+		case BPCHAROID:
+		case DATEOID:
+		case TIMESTAMPOID:
+		case TIMESTAMPTZOID:
+		case UUIDOID:
+		case JSONBOID:
+		{
+			return true;
+		}
+
+		default:
+		{
+			return false;
+		}
+	}
+}
+
+
+/*
+ * AppendInsertQuery appends the given INSERT command on the given shard to the
+ * buffer in the form of get_insert_query_def().
+ */
+static void
+AppendInsertQuery(StringInfo buffer, Query *query, int64 shardid)
+{
+	RangeTblEntry *rangeTableEntry = rt_fetch(query->resultRelation, query->rtable);
+	Oid relationId = rangeTableEntry->relid;
+	ListCell *targetEntryCell = NULL;
+	const char *separator = "";
+
+	char *relationName = get_rel_name(relationId);
+	if (relationName == NULL)
+	{
+		ereport(ERROR, (errmsg("cache lookup failed for relation %u", relationId)));
+	}
+
+	char *schemaName = get_namespace_name(get_rel_namespace(relationId));
+
+	AppendShardIdToName(&relationName, shardid);
+
+	appendStringInfo(buffer, "INSERT INTO %s ",
+					 quote_qualified_identifier(schemaName, relationName));
+
+	if (rangeTableEntry->alias != NULL)
+	{
+		appendStringInfo(buffer, "AS %s ",
+						 quote_identifier(rangeTableEntry->alias->aliasname));
+	}
+
+	if (query->targetList == NIL)
+	{
+		appendStringInfoString(buffer, "DEFAULT VALUES");
+		AppendReturningList(buffer, query);
+		return;
+	}
+
+	appendStringInfoChar(buffer, '(');
+
+	foreach(targetEntryCell, query->targetList)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+		char *columnName = get_attname(relationId, targetEntry->resno, false);
+
+		appendStringInfoString(buffer, separator);
+		appendStringInfoString(buffer, quote_identifier(columnName));
+
+		separator = ", ";
+	}
+
+	appendStringInfoString(buffer, ") VALUES (");
+
+	separator = "";
+	foreach(targetEntryCell, query->targetList)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+
+		appendStringInfoString(buffer, separator);
+		AppendExpression(buffer, (Node *) targetEntry->expr, relationId);
+
+		separator = ", ";
+	}
+
+	appendStringInfoChar(buffer, ')');
+
+	AppendReturningList(buffer, query);
+}
+
+
+/*
+ * AppendReturningList appends the RETURNING list of the given query to the
+ * buffer in the form of get_target_list(). Columns get an AS label if their
+ * output name differs from the column name, other expressions get one unless
+ * their output name is the default "?column?".
+ */
+static void
+AppendReturningList(StringInfo buffer, Query *query)
+{
+	RangeTblEntry *rangeTableEntry = rt_fetch(query->resultRelation, query->rtable);
+	Oid relationId = rangeTableEntry->relid;
+	ListCell *targetEntryCell = NULL;
+	const char *separator = " ";
+
+	if (query->returningList == NIL)
+	{
+		return;
+	}
+
+	appendStringInfoString(buffer, " RETURNING");
+
+	foreach(targetEntryCell, query->returningList)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+		Node *expression = (Node *) targetEntry->expr;
+		char *defaultName = "?column?";
+
+		appendStringInfoString(buffer, separator);
+		AppendExpression(buffer, expression, relationId);
+
+		if (IsA(expression, Var))
+		{
+			defaultName = get_attname(relationId, ((Var *) expression)->varattno,
+									  false);
+		}
+
+		if (targetEntry->resname != NULL &&
+			strcmp(defaultName, targetEntry->resname) != 0)
+		{
+			appendStringInfo(buffer, " AS %s", quote_identifier(targetEntry->resname));
+		}
+
+		separator = ", ";
+	}
+}
+
+
+/*
+ * AppendExpression appends an expression that passed FastDeparsableExpression()
+ * to the buffer. Columns are not prefixed by the relation name, since ruleutils
+ * only does so for queries with multiple range table entries.
+ */
+static void
+AppendExpression(StringInfo buffer, Node *expression, Oid relationId)
+{
+	switch (nodeTag(expression))
+	{
+		case T_Const:
+		{
+			AppendConst(buffer, (Const *) expression);
+			break;
+		}
+
+		case T_Param:
+		{
+			appendStringInfo(buffer, "$%d", ((Param *) expression)->paramid);
+			break;
+		}
+
+		case T_Var:
+		{
+			Var *column = (Var *) expression;
+			char *columnName = get_attname(relationId, column->varattno, false);
+
+			appendStringInfoString(buffer, quote_identifier(columnName));
+			break;
+		}
+
+		case T_OpExpr:
+		{
+			OpExpr *operatorExpression = (OpExpr *) expression;
+			Node *leftArgument = linitial(operatorExpression->args);
+			Node *rightArgument = lsecond(operatorExpression->args);
+
+			appendStringInfoChar(buffer, '(');
+			AppendExpression(buffer, leftArgument, relationId);
+			appendStringInfo(buffer, " %s ",
+							 generate_operator_name(operatorExpression->opno,
+													exprType(leftArgument),
+													exprType(rightArgument)));
+			AppendExpression(buffer, rightArgument, relationId);
+			appendStringInfoChar(buffer, ')');
+			break;
+		}
+
+		default:
+		{
+			ereport(ERROR, (errmsg("unrecognized node type: %d",
+								   (int) nodeTag(expression))));
+		}
+	}
+}
+
+
+/*
+ * AppendConst appends the given constant to the buffer in the form of
+ * get_const_expr() with showtype 0, that is with a type label unless the
+ * constant is implicitly of the right type when it is parsed.
+ */
+static void
+AppendConst(StringInfo buffer, Const *constValue)
+{
+	Oid typeOutputFunction = InvalidOid;
+	bool typeIsVarlena = false;
+	bool needsLabel = false;
+
+	if (constValue->constisnull)
+	{
+		appendStringInfo(buffer, "NULL::%s",
+						 format_type_with_typemod(constValue->consttype,
+												  constValue->consttypmod));
+		return;
+	}
+
+	getTypeOutputInfo(constValue->consttype, &typeOutputFunction, &typeIsVarlena);
+
+	char *valueString = OidOutputFunctionCall(typeOutputFunction,
+											  constValue->constvalue);
+
+	switch (constValue->consttype)
+	{
+		case INT4OID:
+		{
+			/* negative integers are quoted, otherwise they parse as an operator */
+			if (valueString[0] != '-')
+			{
+				appendStringInfoString(buffer, valueString);
+			}
+			else
+			{
+				appendStringInfo(buffer, "'%s'", valueString);
+				needsLabel = true;
+			}
+
+			break;
+		}
+
+		case NUMERICOID:
+		{
+			/* float-looking numerics without a sign parse as numeric */
+			if (isdigit((unsigned char) valueString[0]) &&
+				strcspn(valueString, "eE.") != strlen(valueString))
+			{
+				appendStringInfoString(buffer, valueString);
+			}
+			else
+			{
+				appendStringInfo(buffer, "'%s'", valueString);
+				needsLabel = true;
+			}
+
+			needsLabel |= (constValue->consttypmod >= 0);
+			break;
+		}
+
+		case BOOLOID:
+		{
+			if (strcmp(valueString, "t") == 0)
+			{
+				appendStringInfoString(buffer, "true");
+			}
+			else
+			{
+				appendStringInfoString(buffer, "false");
+			}
+
+			break;
+		}
+
+		default:
+		{
+			AppendQuotedLiteral(buffer, valueString);
+			needsLabel = true;
+			break;
+		}
+	}
+
+	pfree(valueString);
+
+	if (needsLabel)
+	{
+		appendStringInfo(buffer, "::%s",
+						 format_type_with_typemod(constValue->consttype,
+												  constValue->consttypmod));
+	}
+}
+
+
+/*
+ * AppendQuotedLiteral appends the given string as an SQL literal to the buffer
+ * in the same way as simple_quote_literal() in ruleutils, which never uses the
+ * E'' syntax.
+ */
+static void
+AppendQuotedLiteral(StringInfo buffer, const char *value)
+{
+	appendStringInfoChar(buffer, '\'');
+
+	for (const char *valuePointer = value; *valuePointer; valuePointer++)
+	{
+		char character = *valuePointer;
+
+		if (SQL_STR_DOUBLE(character, !standard_conforming_strings))
+		{
+			appendStringInfoChar(buffer, character);
+		}
+
+		appendStringInfoChar(buffer, character);
+	}
+
+	appendStringInfoChar(buffer, '\'');
+}
@@ -59,7 +59,9 @@
  * For each pool:
  * - ManageWorkPool evaluates whether to open additional connections
  *   based on the number unassigned tasks that are ready to execute
- *   and the targetPoolSize of the execution.
+ *   and the targetPoolSize of the execution. Only the first connection
+ *   of a pool is required, the remaining ones are optional and are not
+ *   opened when the worker reached citus.max_shared_pool_size.
  *
  * Poll all connections:
  * - We use a WaitEventSet that contains all (non-failed) connections
@@ -82,7 +84,39 @@
  *
  * When a connection is ready to execute a new task, it first checks its
  * own readyTaskQueue and otherwise takes a task from the worker pool's
- * readyTaskQueue (on a first-come-first-serve basis).
+ * readyTaskQueue (on a first-come-first-serve basis). When
+ * citus.execute_largest_shards_first is enabled, the worker pool's
+ * readyTaskQueue is instead kept in order of decreasing estimated task size,
+ * the sum of the lengths of the shards that a task accesses, such that the
+ * tasks that take longest start first and do not run alone at the end of the
+ * execution.
+ *
+ * When citus.enable_hedged_reads is enabled, a read-only task on a shard with
+ * multiple placements that takes longer than the estimated 95th percentile of
+ * the task durations on its worker is also started on the next placement.
+ * Whichever placement execution returns rows first provides the rows of the
+ * task, and the other one is cancelled once the execution is done. Hedging
+ * only happens outside of distributed transactions, such that cancelling a
+ * command does not abort a remote transaction.
+ *
+ * When citus.executor_task_batch_size is larger than 1, a connection may take
+ * several SELECT tasks, or several modify tasks of an execution that errors
+ * out on any failure anyway (e.g. multi-shard UPDATE/DELETE), from the queues
+ * at once and send them as a single multi-statement command. The results come
+ * back in the same order and are routed to the placement executions that are
+ * kept in the session's batchedTaskQueue. This saves a network round trip
+ * per task when there are many shards per worker.
+ *
+ * When citus.enable_streaming_results is enabled, a SELECT that runs outside
+ * of a transaction block does not run to completion before the first row is
+ * returned. Instead, CitusExecScan runs the main loop only until the next row
+ * has arrived. The same applies to the RETURNING rows of a modification when
+ * citus.sort_returning is off. When citus.enable_task_result_merge is enabled
+ * and the workers return the rows of every task in the order that the query
+ * needs, the planner leaves out the sort on the coordinator and the rows of
+ * each task are kept in a separate tuple store, from which they are merged in
+ * sort order (see NextMergedTuple). With citus.sort_returning, the workers
+ * likewise sort the RETURNING rows of each task, which are then merged.
  *
  * In cases where the tasks finish quickly (e.g. <1ms), a single
  * connection will often be sufficient to finish all tasks. It is
@@ -124,19 +158,31 @@
 #include "miscadmin.h"
 #include "pgstat.h"
 
+#include <math.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include "access/htup_details.h"
 #include "access/transam.h"
 #include "access/xact.h"
 #include "catalog/pg_type.h"
 #include "commands/dbcommands.h"
+#include "distributed/admission_control.h"
+#include "distributed/commands/multi_copy.h"
 #include "distributed/citus_custom_scan.h"
+#include "distributed/citus_wait_events.h"
+#include "distributed/connection_establishment_stats.h"
 #include "distributed/connection_management.h"
+#include "distributed/deparse_shard_query.h"
 #include "distributed/distributed_execution_locks.h"
+#include "distributed/intermediate_results.h"
 #include "distributed/local_executor.h"
+#include "distributed/metadata_cache.h"
 #include "distributed/multi_client_executor.h"
 #include "distributed/multi_executor.h"
+#include "distributed/multi_explain.h"
+#include "distributed/multi_logical_planner.h"
+#include "distributed/multi_master_planner.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/multi_resowner.h"
 #include "distributed/multi_server_executor.h"
@@ -144,19 +190,36 @@
 #include "distributed/placement_connection.h"
 #include "distributed/relation_access_tracking.h"
 #include "distributed/remote_commands.h"
+#include "distributed/remote_prepared_statements.h"
+#include "distributed/repartition_join_execution.h"
 #include "distributed/resource_lock.h"
+#include "distributed/shard_access_stats.h"
 #include "distributed/subplan_execution.h"
+#include "distributed/top_n_execution.h"
 #include "distributed/transaction_management.h"
+#include "distributed/worker_latency_stats.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/version_compat.h"
+#include "lib/binaryheap.h"
 #include "lib/ilist.h"
+#include "nodes/nodeFuncs.h"
+#include "parser/parse_oper.h"
 #include "storage/fd.h"
 #include "storage/latch.h"
+#include "storage/lmgr.h"
 #include "utils/int8.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
+#include "utils/sortsupport.h"
 #include "utils/timestamp.h"
 
+
+/* smallest work_mem of the tuple store of a task when merging task results */
+#define MIN_TASK_TUPLE_STORE_KB 64
+
+/* waitEventSetIndex of a session that is not in the wait event set */
+#define INVALID_WAIT_EVENT_SET_INDEX -1
+
 /*
  * DistributedExecution represents the execution of a distributed query
  * plan.
@@ -199,15 +262,12 @@ typedef struct DistributedExecution
 	bool connectionSetChanged;
 
 	/*
-	 * Flag to indiciate that the set of wait events we are interested
-	 * in might have changed and waitEventSet needs to be updated.
-	 *
-	 * Note that we set this flag whenever we assign a value to waitFlags,
-	 * but we don't check that the waitFlags is actually different from the
-	 * previous value. So we might have some false positives for this flag,
-	 * which is OK, because in this case ModifyWaitEvent() is noop.
+	 * Sessions that were created or whose wait flags changed since waitEventSet
+	 * was last updated. Only these sessions are added to or modified in the
+	 * wait event set, such that an iteration of the main loop does not need to
+	 * walk all sessions.
 	 */
-	bool waitFlagsChanged;
+	dlist_head waitFlagsChangedSessions;
 
 	/*
 	 * WaitEventSet used for waiting for I/O events.
@@ -221,6 +281,13 @@ typedef struct DistributedExecution
 	 */
 	WaitEventSet *waitEventSet;
 
+	/* events reported by WaitEventSetWait, sized for the wait event set */
+	WaitEvent *events;
+	int eventSetSize;
+
+	/* number of sessions in waitEventSet, which has room for eventSetSize - 2 */
+	int waitEventSetSessionCount;
+
 	/*
 	 * The number of connections we aim to open per worker.
 	 *
@@ -264,9 +331,84 @@ typedef struct DistributedExecution
 	 */
 	uint64 rowsProcessed;
 
+	/*
+	 * For SELECT commands whose rows only pass through a LIMIT on the
+	 * coordinator, the number of rows after which the remaining tasks can be
+	 * skipped. Zero if all tasks need to run to completion.
+	 */
+	uint64 rowLimit;
+
+	/* set once the remaining tasks were skipped */
+	bool stoppedEarly;
+
+	/* whether slow read-only tasks are started on another placement as well */
+	bool hedgeReads;
+
+	/* number of tasks that were started on a second placement */
+	int hedgedTaskCount;
+
+	/*
+	 * Set while the rows of a SELECT, or the RETURNING rows of a modification,
+	 * are returned as they arrive, in which case CitusExecScan runs the
+	 * execution until the next row is available.
+	 */
+	bool streaming;
+
+	/*
+	 * Order in which the workers return the rows of each task when the task
+	 * results are merged instead of sorted on the coordinator, NULL otherwise.
+	 */
+	Sort *mergeSortOrder;
+
+	/* work_mem of the tuple store of a task when merging task results */
+	int taskTupleStoreKB;
+
+	/* streams of rows that are returned while streaming or merging */
+	List *resultStreamList;
+
+	/* state of the merge of the result streams, if any */
+	struct TaskResultMerge *resultMerge;
+
 	/* statistics on distributed execution */
 	DistributedExecutionStats *executionStats;
 
+	/*
+	 * List of TaskResultDestination in task order when the rows of each task
+	 * go to a tuple store of its own, NIL otherwise.
+	 */
+	List *taskResultDestinationList;
+
+	/*
+	 * List of TaskExecutionInstrumentation to which the placement executions
+	 * are appended when they start, or NULL if the tasks are not instrumented.
+	 */
+	List **taskInstrumentationList;
+
+	/* time at which the execution started, for instrumentation */
+	instr_time startTime;
+
+	/*
+	 * Whether the task queries are wrapped such that they also return their
+	 * EXPLAIN ANALYZE output, in an additional column of the last row.
+	 */
+	bool tasksReturnExplainOutput;
+
+	/*
+	 * Whether the parameterized task queries are prepared on the worker
+	 * connections, such that later executions only send the parameters.
+	 */
+	bool prepareTaskQueries;
+
+	/*
+	 * Whether the workers return the rows in binary format, in which case we
+	 * build the tuples using the receive functions of the column types.
+	 */
+	bool binaryResults;
+	FmgrInfo *receiveFunctions;
+	Oid *receiveTypeIoParams;
+	Datum *columnValues;
+	bool *columnNulls;
+
 	/*
 	 * The following fields are used while receiving results from remote nodes.
 	 * We store this information here to avoid re-allocating it every time.
@@ -364,11 +506,21 @@ typedef struct WorkerPool
 	/* maximum number of connections we are allowed to open at once */
 	uint32 maxNewConnectionsPerCycle;
 
+	/*
+	 * Set when the worker already has citus.max_shared_pool_size connections
+	 * from all backends on this node. We then continue the execution with
+	 * the connections that are already in the pool.
+	 */
+	bool reachedSharedPoolLimit;
+
 	/*
 	 * This is only set in WorkerPoolFailed() function. Once a pool fails, we do not
 	 * use it anymore.
 	 */
 	bool failed;
+
+	/* task and connection latencies to the worker observed in this backend */
+	WorkerLatencyStats *latencyStats;
 } WorkerPool;
 
 struct TaskPlacementExecution;
@@ -405,17 +557,53 @@ typedef struct WorkerSession
 	/* task the worker should work on or NULL */
 	struct TaskPlacementExecution *currentTask;
 
+	/*
+	 * Tasks that were sent in the same command as currentTask and whose
+	 * results will arrive after the results of currentTask, in that order.
+	 */
+	dlist_head batchedTaskQueue;
+	int batchedTaskCount;
+
 	/*
 	 * The number of commands sent to the worker over the session. Excludes
 	 * distributed transaction related commands such as BEGIN/COMMIT etc.
 	 */
 	uint64 commandsSent;
 
-	/* index in the wait event set */
+	/* index in the wait event set, or INVALID_WAIT_EVENT_SET_INDEX */
 	int waitEventSetIndex;
 
+	/* membership in the execution's waitFlagsChangedSessions */
+	dlist_node waitFlagsChangedNode;
+	bool waitFlagsChanged;
+
 	/* events reported by the latest call to WaitEventSetWait */
 	int latestUnconsumedWaitEvents;
+
+	/*
+	 * Time in milliseconds it took to establish the connection for the session,
+	 * only measured when the tasks are instrumented. Zero for connections that
+	 * were already established before the execution.
+	 */
+	double connectTime;
+
+	/*
+	 * When the task query is being prepared on the connection, the statement
+	 * and parameters with which to execute it once the worker prepared it.
+	 * pendingStatementName is NULL otherwise.
+	 */
+	char *pendingStatementName;
+	char *pendingQueryString;
+	int pendingParameterCount;
+	Oid *pendingParameterTypes;
+	const char **pendingParameterValues;
+
+	/*
+	 * Number of results of the statements that began the remote transaction
+	 * or its savepoints and were sent in the same command as the current task,
+	 * which precede the results of the task.
+	 */
+	int pendingTransactionStatementCount;
 } WorkerSession;
 
 
@@ -458,6 +646,9 @@ typedef struct ShardCommandExecution
 	/* order in which the command should be replicated on replicas */
 	PlacementExecutionOrder executionOrder;
 
+	/* estimated size of the shards accessed by the task, 0 if not estimated */
+	uint64 estimatedSize;
+
 	/* executions of the command on the placements of the shard */
 	struct TaskPlacementExecution **placementExecutions;
 	int placementExecutionCount;
@@ -471,9 +662,74 @@ typedef struct ShardCommandExecution
 	 */
 	bool gotResults;
 
+	/* whether the task was started on a second placement while it was running */
+	bool hedged;
+
+	/*
+	 * When hedging reads, the placement execution that returned the first rows
+	 * of the task, whose rows are the ones that are kept.
+	 */
+	struct TaskPlacementExecution *resultPlacementExecution;
+
 	TaskExecutionState executionState;
+
+	/* rows of the task when task results are merged, NULL otherwise */
+	Tuplestorestate *tupleStore;
+
+	/*
+	 * When the tasks of different queries run in a single execution, the
+	 * columns of the task's rows and the statistics of its query. NULL if
+	 * the task's rows are described by the execution.
+	 */
+	AttInMetadata *attributeInputMetadata;
+	uint32 columnCount;
+	DistributedExecutionStats *executionStats;
 } ShardCommandExecution;
 
+
+/*
+ * TaskResultStream represents rows that the scan returns in the order in
+ * which they are stored.
+ */
+typedef struct TaskResultStream
+{
+	/* rows received so far */
+	Tuplestorestate *tupleStore;
+
+	/* number of rows read from the tuple store */
+	int64 readTupleCount;
+
+	/* task whose rows are in the tuple store, NULL if it has the rows of all tasks */
+	ShardCommandExecution *shardCommandExecution;
+
+	/* whether all the rows are already in the tuple store */
+	bool complete;
+
+	/* current row of the stream while merging */
+	TupleTableSlot *tupleSlot;
+} TaskResultStream;
+
+
+/*
+ * TaskResultMerge keeps the state of a k-way merge of result streams that
+ * are each sorted in the same order.
+ */
+typedef struct TaskResultMerge
+{
+	TaskResultStream **streams;
+	int streamCount;
+
+	/* sort keys of the merge, in terms of the columns of the scan */
+	SortSupport sortKeys;
+	int sortKeyCount;
+
+	/* heap of stream indexes, ordered by the current row of the stream */
+	binaryheap *heap;
+
+	/* whether the first row of every stream was fetched */
+	bool initialized;
+} TaskResultMerge;
+
 /*
  * TaskPlacementExecutionState indicates whether a command is running
  * on a shard placement, or finished or failed.
@@ -514,6 +770,9 @@ typedef struct TaskPlacementExecution
 	/* membership in ready-to-start assigned task queue of a particular session */
 	dlist_node sessionReadyQueueNode;
 
+	/* membership in the queue of tasks batched behind the current task of a session */
+	dlist_node sessionBatchedQueueNode;
+
 	/* membership in assigned task queue of worker */
 	dlist_node workerPendingQueueNode;
 
@@ -522,6 +781,12 @@ typedef struct TaskPlacementExecution
 
 	/* index in array of placement executions in a ShardCommandExecution */
 	int placementExecutionIndex;
+
+	/* timing and received data of the execution, NULL if not instrumented */
+	TaskExecutionInstrumentation *instrumentation;
+
+	/* time at which the command was sent, when tracking worker latencies */
+	TimestampTz startTime;
 } TaskPlacementExecution;
 
 
@@ -532,6 +797,24 @@ int MaxAdaptiveExecutorPoolSize = 16;
 /* GUC, number of ms to wait between opening connections to the same worker */
 int ExecutorSlowStartInterval = 10;
 
+/* GUC, maximum number of modify tasks sent in a single command over a session */
+int ExecutorTaskBatchSize = 1;
+
+/* GUC, determining whether the rows of a SELECT are returned as they arrive */
+bool EnableStreamingResults = false;
+
+/* GUC, determining whether the workers return task results in binary format */
+bool EnableBinaryProtocol = false;
+
+/* GUC, determining whether tasks on the largest shards are started first */
+bool ExecuteLargestShardsFirst = false;
+
+/* GUC, determining whether slow reads are started on another placement as well */
+bool EnableHedgedReads = false;
+
+/* GUC, determining whether BEGIN is sent in the same command as the first task */
+bool SendBeginWithFirstTask = false;
+
 
 /* local functions */
 static DistributedExecution * CreateDistributedExecution(RowModifyLevel modLevel,
@@ -542,15 +825,62 @@ static DistributedExecution * CreateDistributedExecution(RowModifyLevel modLevel
 														 Tuplestorestate *tupleStore,
 														 int targetPoolSize);
 static void StartDistributedExecution(DistributedExecution *execution);
+static bool ShouldExplainAnalyzeTasksDuringExecution(DistributedExecution *execution,
+													 List *jobIdList);
+static void WrapTasksForExplainAnalyze(DistributedExecution *execution);
+static Sort * SortedReturningMergeOrder(CitusScanState *scanState,
+										DistributedExecution *execution);
+static void WrapTasksForSortedReturning(DistributedExecution *execution,
+										Sort *sortOrder);
+static bool CanUseBinaryResultFormat(TupleDesc tupleDescriptor);
+static void SetupBinaryResults(DistributedExecution *execution);
+static void CheckBinaryResultColumnTypes(DistributedExecution *execution,
+										 PGresult *result);
+static HeapTuple BuildTupleFromBinaryValues(DistributedExecution *execution,
+											PGresult *result, int rowIndex);
 static void RunLocalExecution(CitusScanState *scanState, DistributedExecution *execution);
 static void RunDistributedExecution(DistributedExecution *execution);
+static bool RunDistributedExecutionStep(DistributedExecution *execution);
+static void FreeExecutionWaitEvents(DistributedExecution *execution);
+static uint32 DistributedExecutionWaitEvent(DistributedExecution *execution);
+static uint64 ExecuteLocalTasksForMerge(CitusScanState *scanState,
+										DistributedExecution *execution);
+static bool ShouldStreamResults(CitusScanState *scanState,
+								DistributedExecution *execution);
+static void StartStreamingExecution(CitusScanState *scanState,
+									DistributedExecution *execution);
+static void RunStreamingExecution(DistributedExecution *execution,
+								  TaskResultStream *stream);
+static void FinishStreamingExecution(DistributedExecution *execution);
+static Tuplestorestate * CreateTaskTupleStore(DistributedExecution *execution);
+static TaskResultStream * AddTaskResultStream(DistributedExecution *execution,
+											  Tuplestorestate *tupleStore,
+											  ShardCommandExecution *
+											  shardCommandExecution);
+static void EndTaskResultStreams(DistributedExecution *execution);
+static bool TaskResultStreamReady(DistributedExecution *execution,
+								  TaskResultStream *stream);
+static bool TaskResultStreamComplete(DistributedExecution *execution,
+									 TaskResultStream *stream);
+static bool FetchNextStreamTuple(DistributedExecution *execution,
+								 TaskResultStream *stream, TupleTableSlot *slot,
+								 bool copy);
+static TaskResultMerge * CreateTaskResultMerge(DistributedExecution *execution);
+static int CompareTaskResultStreams(Datum a, Datum b, void *arg);
+static TupleTableSlot * NextMergedTuple(DistributedExecution *execution);
+static void MergeTaskResultsIntoTupleStore(DistributedExecution *execution);
 static bool ShouldRunTasksSequentially(List *taskList);
 static void SequentialRunDistributedExecution(DistributedExecution *execution);
 
 static void FinishDistributedExecution(DistributedExecution *execution);
+static uint64 DistributedPlanRowLimit(DistributedPlan *distributedPlan);
+static bool ReachedRowLimit(DistributedExecution *execution);
+static void StopRunningPlacementExecutions(DistributedExecution *execution);
+static void StopRunningSessions(List *sessionList);
 static void CleanUpSessions(DistributedExecution *execution);
 
 static void LockPartitionsForDistributedPlan(DistributedPlan *distributedPlan);
+static void ExecuteRepartitionedCountDistinct(CitusScanState *scanState);
 static void AcquireExecutorShardLocksForExecution(DistributedExecution *execution);
 static void AdjustDistributedExecutionAfterLocalExecution(DistributedExecution *
 														  execution);
@@ -561,30 +891,66 @@ static bool TaskListRequires2PC(List *taskList);
 static bool SelectForUpdateOnReferenceTable(RowModifyLevel modLevel, List *taskList);
 static void AssignTasksToConnections(DistributedExecution *execution);
 static void UnclaimAllSessionConnections(List *sessionList);
+static void CancelRunningSessions(List *sessionList);
 static bool UseConnectionPerPlacement(void);
 static PlacementExecutionOrder ExecutionOrderForTask(RowModifyLevel modLevel, Task *task);
+static bool ShouldRouteReadsToSecondaries(DistributedExecution *execution);
+static ShardPlacement * SecondaryPlacementForRead(ShardPlacement *placement);
 static WorkerPool * FindOrCreateWorkerPool(DistributedExecution *execution,
 										   char *nodeName, int nodePort);
 static WorkerSession * FindOrCreateWorkerSession(WorkerPool *workerPool,
 												 MultiConnection *connection);
 static void ManageWorkerPool(WorkerPool *workerPool);
 static void CheckConnectionTimeout(WorkerPool *workerPool);
+static int WorthwhileNewConnectionCount(WorkerPool *workerPool,
+										int usableConnectionCount);
 static int UsableConnectionCount(WorkerPool *workerPool);
 static long NextEventTimeout(DistributedExecution *execution);
+static bool ShouldHedgeReads(DistributedExecution *execution);
+static void StartHedgedPlacementExecutions(DistributedExecution *execution);
+static long HedgeTimeout(TaskPlacementExecution *placementExecution, TimestampTz now);
+static TaskPlacementExecution * NextIdlePlacementExecution(
+	ShardCommandExecution *shardCommandExecution);
 static long MillisecondsBetweenTimestamps(TimestampTz startTime, TimestampTz endTime);
-static WaitEventSet * BuildWaitEventSet(List *sessionList);
-static void UpdateWaitEventSetFlags(WaitEventSet *waitEventSet, List *sessionList);
+static void RebuildWaitEventSet(DistributedExecution *execution);
+static bool UpdateWaitEventSet(DistributedExecution *execution);
+static void AddWaitFlagsChangedSession(WorkerSession *session);
 static TaskPlacementExecution * PopPlacementExecution(WorkerSession *session);
 static TaskPlacementExecution * PopAssignedPlacementExecution(WorkerSession *session);
+static uint64 EstimateTaskSize(Task *task);
+static uint64 EstimateShardSize(uint64 shardId);
+static void PushUnassignedPlacementExecution(WorkerPool *workerPool,
+											 TaskPlacementExecution *placementExecution);
 static TaskPlacementExecution * PopUnassignedPlacementExecution(WorkerPool *workerPool);
+static bool TaskQueriesSentAsSimpleQuery(DistributedExecution *execution);
+static bool CanSendBeginWithTask(DistributedExecution *execution);
 static bool StartPlacementExecutionOnSession(TaskPlacementExecution *placementExecution,
 											 WorkerSession *session);
+static int SendPreparedTaskQuery(WorkerSession *session, char *queryString,
+								 int parameterCount, Oid *parameterTypes,
+								 const char **parameterValues);
+static bool ExecutePendingPreparedStatement(WorkerSession *session);
+static bool IsExternParam(Node *node);
+static bool CanBatchTasksOnSession(WorkerSession *session,
+								   TaskPlacementExecution *placementExecution);
+static char * BuildBatchedQueryString(WorkerSession *session,
+									  TaskPlacementExecution *placementExecution);
+static void StartPlacementExecutionInstrumentation(TaskPlacementExecution *
+												   placementExecution,
+												   WorkerSession *session);
+static double ElapsedMilliseconds(instr_time startTime);
+static void MarkPlacementExecutionRunning(TaskPlacementExecution *placementExecution,
+										  WorkerSession *session);
+static bool AdvanceToNextBatchedTask(WorkerSession *session);
 static void ConnectionStateMachine(WorkerSession *session);
 static void Activate2PCIfModifyingTransactionExpandsToNewNode(WorkerSession *session);
 static bool TransactionModifiedDistributedTable(DistributedExecution *execution);
 static void TransactionStateMachine(WorkerSession *session);
 static void UpdateConnectionWaitFlags(WorkerSession *session, int waitFlags);
 static bool CheckConnectionReady(WorkerSession *session);
+static bool ShouldStoreRowsForCurrentTask(WorkerSession *session);
+static void SaveTaskExplainAnalyzeOutput(TaskPlacementExecution *placementExecution,
+										 char *explainOutput);
 static bool ReceiveResults(WorkerSession *session, bool storeRows);
 static void WorkerSessionFailed(WorkerSession *session);
 static void WorkerPoolFailed(WorkerPool *workerPool);
@@ -622,10 +988,14 @@ AdaptiveExecutor(CitusScanState *scanState)
 
 	Job *job = distributedPlan->workerJob;
 	List *taskList = job->taskList;
+	List *jobIdList = NIL;
 
 	/* we should only call this once before the scan finished */
 	Assert(!scanState->finishedRemoteScan);
 
+	/* wait until the role and tenant may run another distributed execution */
+	scanState->admittedExecution = AdmitDistributedExecution(job->partitionKeyValue);
+
 	/*
 	 * PostgreSQL takes locks on all partitions in the executor. It's not entirely
 	 * clear why this is necessary (instead of locking the parent during DDL), but
@@ -635,6 +1005,25 @@ AdaptiveExecutor(CitusScanState *scanState)
 
 	ExecuteSubPlans(distributedPlan);
 
+	if (distributedPlan->repartitionCountDistinct)
+	{
+		ExecuteRepartitionedCountDistinct(scanState);
+
+		return resultSlot;
+	}
+
+	if (job->dependentJobList != NIL)
+	{
+		/* run the map, fetch and merge tasks of repartition joins first */
+		taskList = ExecuteDependentTasks(taskList, job, &jobIdList);
+	}
+
+	if (ShouldPullTopNCandidates(distributedPlan, paramListInfo))
+	{
+		/* only pull the groups that can make it into the top-N */
+		taskList = TopNCandidateTaskList(distributedPlan, taskList);
+	}
+
 	if (MultiShardConnectionType == SEQUENTIAL_CONNECTION)
 	{
 		/* defer decision after ExecuteSubPlans() */
@@ -652,12 +1041,71 @@ AdaptiveExecutor(CitusScanState *scanState)
 		scanState->
 		tuplestorestate, targetPoolSize);
 
+	if (scanState->customScanState.ss.ps.instrument != NULL)
+	{
+		/* running under EXPLAIN ANALYZE, keep track of each task's execution */
+		execution->taskInstrumentationList = &scanState->taskInstrumentationList;
+		INSTR_TIME_SET_CURRENT(execution->startTime);
+
+		if (ShouldExplainAnalyzeTasksDuringExecution(execution, jobIdList))
+		{
+			/* avoid running the tasks again to get their EXPLAIN ANALYZE output */
+			WrapTasksForExplainAnalyze(execution);
+		}
+	}
+
+	if (EnableWorkerPreparedStatements && paramListInfo != NULL &&
+		paramListInfo->numParams > 0 && job->jobQuery != NULL &&
+		FindNodeCheck((Node *) job->jobQuery, IsExternParam))
+	{
+		/* the task queries refer to the parameters, which stay the same */
+		execution->prepareTaskQueries = true;
+	}
+
+	if (EnableBinaryProtocol && tupleDescriptor != NULL &&
+		!execution->tasksReturnExplainOutput &&
+		CanUseBinaryResultFormat(tupleDescriptor))
+	{
+		/* skip the text input functions of the column types */
+		SetupBinaryResults(execution);
+	}
+
+	if (distributedPlan->taskResultMergeOrder != NULL)
+	{
+		/* the rows of each task are kept apart and merged in sort order */
+		execution->mergeSortOrder = distributedPlan->taskResultMergeOrder;
+		execution->taskTupleStoreKB = Max(work_mem / Max(list_length(taskList), 1),
+										  MIN_TASK_TUPLE_STORE_KB);
+	}
+	else if (EnableTaskResultMerge && SortReturning && distributedPlan->hasReturning)
+	{
+		Sort *returningSortOrder = SortedReturningMergeOrder(scanState, execution);
+		if (returningSortOrder != NULL)
+		{
+			/* the workers sort the RETURNING rows of each task, which we merge */
+			WrapTasksForSortedReturning(execution, returningSortOrder);
+
+			execution->mergeSortOrder = returningSortOrder;
+			execution->taskTupleStoreKB = Max(work_mem / Max(list_length(taskList), 1),
+											  MIN_TASK_TUPLE_STORE_KB);
+		}
+	}
+
 	/*
 	 * Make sure that we acquire the appropriate locks even if the local tasks
 	 * are going to be executed with local execution.
 	 */
 	StartDistributedExecution(execution);
 
+	/*
+	 * Cancelling a task would abort the remote transaction block, so we only
+	 * stop early outside of coordinated transactions.
+	 */
+	if (!execution->isTransaction)
+	{
+		execution->rowLimit = DistributedPlanRowLimit(distributedPlan);
+	}
+
 	/* execute tasks local to the node (if any) */
 	if (list_length(execution->localTaskList) > 0)
 	{
@@ -667,6 +1115,14 @@ AdaptiveExecutor(CitusScanState *scanState)
 		AdjustDistributedExecutionAfterLocalExecution(execution);
 	}
 
+	if (jobIdList == NIL && ShouldStreamResults(scanState, execution))
+	{
+		/* CitusExecScan runs the execution while it returns rows */
+		StartStreamingExecution(scanState, execution);
+
+		return resultSlot;
+	}
+
 	if (ShouldRunTasksSequentially(execution->tasksToExecute))
 	{
 		SequentialRunDistributedExecution(execution);
@@ -676,6 +1132,19 @@ AdaptiveExecutor(CitusScanState *scanState)
 		RunDistributedExecution(execution);
 	}
 
+	if (execution->mergeSortOrder != NULL)
+	{
+		if (scanState->canStreamResults)
+		{
+			/* the scan returns the merged rows without storing them again */
+			scanState->distributedExecution = execution;
+		}
+		else
+		{
+			MergeTaskResultsIntoTupleStore(execution);
+		}
+	}
+
 	if (distributedPlan->modLevel != ROW_MODIFY_READONLY)
 	{
 		if (list_length(execution->localTaskList) == 0)
@@ -698,11 +1167,24 @@ AdaptiveExecutor(CitusScanState *scanState)
 
 	FinishDistributedExecution(execution);
 
-	if (SortReturning && distributedPlan->hasReturning)
+	if (jobIdList != NIL)
+	{
+		DoRepartitionCleanup(taskList, jobIdList);
+	}
+
+	if (SortReturning && distributedPlan->hasReturning &&
+		execution->mergeSortOrder == NULL)
 	{
 		SortTupleStore(scanState);
 	}
 
+	if (scanState->admittedExecution && scanState->distributedExecution == NULL)
+	{
+		/* the remaining rows are returned from the tuple store */
+		FinishAdmittedExecution();
+		scanState->admittedExecution = false;
+	}
+
 	return resultSlot;
 }
 
@@ -716,7 +1198,16 @@ AdaptiveExecutor(CitusScanState *scanState)
 static void
 RunLocalExecution(CitusScanState *scanState, DistributedExecution *execution)
 {
-	uint64 rowsProcessed = ExecuteLocalTaskList(scanState, execution->localTaskList);
+	uint64 rowsProcessed = 0;
+
+	if (execution->mergeSortOrder != NULL)
+	{
+		rowsProcessed = ExecuteLocalTasksForMerge(scanState, execution);
+	}
+	else
+	{
+		rowsProcessed = ExecuteLocalTaskList(scanState, execution->localTaskList);
+	}
 
 	LocalExecutionHappened = true;
 
@@ -731,6 +1222,37 @@ RunLocalExecution(CitusScanState *scanState, DistributedExecution *execution)
 }
 
 
+/*
+ * ExecuteLocalTasksForMerge executes the local tasks one at a time, such that
+ * the rows of each task end up in a separate tuple store which is merged with
+ * the results of the remote tasks.
+ */
+static uint64
+ExecuteLocalTasksForMerge(CitusScanState *scanState, DistributedExecution *execution)
+{
+	Tuplestorestate *scanTupleStore = scanState->tuplestorestate;
+	ListCell *taskCell = NULL;
+	uint64 rowsProcessed = 0;
+
+	foreach(taskCell, execution->localTaskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+		Tuplestorestate *taskTupleStore = CreateTaskTupleStore(execution);
+		TaskResultStream *stream = AddTaskResultStream(execution, taskTupleStore, NULL);
+
+		scanState->tuplestorestate = taskTupleStore;
+		rowsProcessed += ExecuteLocalTaskList(scanState, list_make1(task));
+
+		/* a local task returned all its rows once it ran */
+		stream->complete = true;
+	}
+
+	scanState->tuplestorestate = scanTupleStore;
+
+	return rowsProcessed;
+}
+
+
 /*
  * AdjustDistributedExecutionAfterLocalExecution simply updates the necessary fields of
  * the distributed execution.
@@ -809,86 +1331,372 @@ ExecuteTaskListExtended(RowModifyLevel modLevel, List *taskList,
 
 
 /*
- * CreateDistributedExecution creates a distributed execution data structure for
- * a distributed plan.
+ * ExecuteTaskListIntoTupleStores runs the read-only tasks of the given
+ * TaskResultDestination list in a single execution, which divides the
+ * connections among all tasks, and stores the rows of each task in the tuple
+ * store of its destination. This allows the tasks of independent queries to
+ * run concurrently rather than one query after the other. The tasks should
+ * not require local execution.
  */
-static DistributedExecution *
-CreateDistributedExecution(RowModifyLevel modLevel, List *taskList, bool hasReturning,
-						   ParamListInfo paramListInfo, TupleDesc tupleDescriptor,
-						   Tuplestorestate *tupleStore, int targetPoolSize)
+void
+ExecuteTaskListIntoTupleStores(List *taskResultDestinationList, int targetPoolSize)
 {
-	DistributedExecution *execution =
-		(DistributedExecution *) palloc0(sizeof(DistributedExecution));
+	List *taskList = NIL;
+	int maxColumnCount = 1;
+	ListCell *destinationCell = NULL;
 
-	execution->modLevel = modLevel;
-	execution->tasksToExecute = taskList;
-	execution->hasReturning = hasReturning;
+	ErrorIfLocalExecutionHappened();
 
-	execution->localTaskList = NIL;
-	execution->remoteTaskList = NIL;
+	foreach(destinationCell, taskResultDestinationList)
+	{
+		TaskResultDestination *destination =
+			(TaskResultDestination *) lfirst(destinationCell);
 
-	execution->executionStats =
-		(DistributedExecutionStats *) palloc0(sizeof(DistributedExecutionStats));
-	execution->paramListInfo = paramListInfo;
-	execution->tupleDescriptor = tupleDescriptor;
-	execution->tupleStore = tupleStore;
+		taskList = lappend(taskList, destination->task);
+		maxColumnCount = Max(maxColumnCount, destination->tupleDescriptor->natts);
+	}
 
-	execution->workerList = NIL;
-	execution->sessionList = NIL;
-	execution->targetPoolSize = targetPoolSize;
+	if (MultiShardConnectionType == SEQUENTIAL_CONNECTION)
+	{
+		targetPoolSize = 1;
+	}
 
-	execution->totalTaskCount = list_length(taskList);
-	execution->unfinishedTaskCount = list_length(taskList);
-	execution->rowsProcessed = 0;
+	DistributedExecution *execution =
+		CreateDistributedExecution(ROW_MODIFY_READONLY, taskList, false, NULL, NULL,
+								   NULL, targetPoolSize);
 
-	execution->raiseInterrupts = true;
+	Assert(list_length(execution->localTaskList) == 0);
 
-	execution->connectionSetChanged = false;
-	execution->waitFlagsChanged = false;
+	/* the columns of each row are described by the destination of its task */
+	execution->taskResultDestinationList = taskResultDestinationList;
+	execution->columnArray = (char **) palloc0(maxColumnCount * sizeof(char *));
 
-	/* allocate execution specific data once, on the ExecutorState memory context */
-	if (tupleDescriptor != NULL)
+	StartDistributedExecution(execution);
+	RunDistributedExecution(execution);
+	FinishDistributedExecution(execution);
+}
+
+
+/*
+ * ShouldExplainAnalyzeTasksDuringExecution returns whether the tasks of an
+ * execution under EXPLAIN ANALYZE can return their EXPLAIN ANALYZE output
+ * along with their results. This is only done for read-only tasks that are
+ * all executed remotely and whose parameters, if any, are embedded in the
+ * query strings. Otherwise, CitusExplainScan runs EXPLAIN ANALYZE for the
+ * tasks separately.
+ */
+static bool
+ShouldExplainAnalyzeTasksDuringExecution(DistributedExecution *execution,
+										 List *jobIdList)
+{
+	if (!ExplainAnalyzeInProgress())
 	{
-		execution->attributeInputMetadata = TupleDescGetAttInMetadata(tupleDescriptor);
-		execution->columnArray =
-			(char **) palloc0(tupleDescriptor->natts * sizeof(char *));
+		return false;
 	}
-	else
+
+	if (execution->modLevel != ROW_MODIFY_READONLY ||
+		execution->tupleDescriptor == NULL)
 	{
-		execution->attributeInputMetadata = NULL;
-		execution->columnArray = NULL;
+		return false;
 	}
 
-	if (ShouldExecuteTasksLocally(taskList))
+	if (jobIdList != NIL || list_length(execution->localTaskList) > 0)
 	{
-		bool readOnlyPlan = !TaskListModifiesDatabase(modLevel, taskList);
+		return false;
+	}
 
-		ExtractLocalAndRemoteTasks(readOnlyPlan, taskList, &execution->localTaskList,
-								   &execution->remoteTaskList);
+	if (execution->paramListInfo != NULL && execution->paramListInfo->numParams > 0)
+	{
+		/* the wrapped query string cannot refer to the parameters */
+		return false;
 	}
 
-	return execution;
+	return true;
 }
 
 
 /*
- * StartDistributedExecution sets up the coordinated transaction and 2PC for
- * the execution whenever necessary. It also keeps track of parallel relation
- * accesses to enforce restrictions that arise due to foreign keys to reference
- * tables.
+ * WrapTasksForExplainAnalyze replaces the tasks of the execution by copies
+ * whose queries also return the EXPLAIN ANALYZE output of the task. The
+ * original tasks are left intact, since they might be part of a cached plan.
  */
-void
-StartDistributedExecution(DistributedExecution *execution)
+static void
+WrapTasksForExplainAnalyze(DistributedExecution *execution)
 {
-	List *taskList = execution->tasksToExecute;
+	TupleDesc tupleDescriptor = execution->tupleDescriptor;
+	List *wrappedTaskList = NIL;
+	ListCell *taskCell = NULL;
 
-	if (MultiShardCommitProtocol != COMMIT_PROTOCOL_BARE)
+	foreach(taskCell, execution->tasksToExecute)
 	{
-		/*
-		 * In case localExecutionHappened, we simply force the executor to use 2PC.
-		 * The primary motivation is that at this point we're definitely expanding
-		 * the nodes participated in the transaction. And, by re-generating the
-		 * remote task lists during local query execution, we might prevent the adaptive
+		Task *task = (Task *) lfirst(taskCell);
+		Task *wrappedTask = copyObject(task);
+
+		wrappedTask->queryString = WrapQueryForExplainAnalyze(TaskQueryString(task),
+															  tupleDescriptor);
+		wrappedTaskList = lappend(wrappedTaskList, wrappedTask);
+	}
+
+	execution->tasksToExecute = wrappedTaskList;
+	execution->tasksReturnExplainOutput = true;
+
+	/* make room for the EXPLAIN output column */
+	execution->columnArray =
+		(char **) palloc0((tupleDescriptor->natts + 1) * sizeof(char *));
+}
+
+
+/*
+ * SortedReturningMergeOrder returns the order in which the RETURNING rows of the
+ * execution need to be sorted for citus.sort_returning, if the workers can sort
+ * the rows of each task such that the coordinator only merges them. Otherwise,
+ * the function returns NULL and the rows are sorted on the coordinator.
+ *
+ * The rows of local tasks and of tasks that run one after the other are not
+ * kept apart per task, so we only merge when all tasks run remotely in parallel.
+ */
+static Sort *
+SortedReturningMergeOrder(CitusScanState *scanState, DistributedExecution *execution)
+{
+	List *targetList = scanState->customScanState.ss.ps.plan->targetlist;
+	int columnCount = list_length(targetList);
+	ListCell *targetCell = NULL;
+	int columnIndex = 0;
+
+	if (execution->tupleDescriptor == NULL || columnCount == 0 ||
+		list_length(execution->localTaskList) > 0 ||
+		list_length(execution->tasksToExecute) == 0 ||
+		ShouldRunTasksSequentially(execution->tasksToExecute))
+	{
+		return NULL;
+	}
+
+	Sort *sortOrder = makeNode(Sort);
+	sortOrder->numCols = columnCount;
+	sortOrder->sortColIdx = (AttrNumber *) palloc(columnCount * sizeof(AttrNumber));
+	sortOrder->sortOperators = (Oid *) palloc(columnCount * sizeof(Oid));
+	sortOrder->collations = (Oid *) palloc(columnCount * sizeof(Oid));
+	sortOrder->nullsFirst = (bool *) palloc(columnCount * sizeof(bool));
+
+	/* sort by all columns in ascending order, the same as SortTupleStore */
+	foreach(targetCell, targetList)
+	{
+		TargetEntry *returningEntry = (TargetEntry *) lfirst(targetCell);
+		Oid sortOperator = InvalidOid;
+
+		get_sort_group_operators(exprType((Node *) returningEntry->expr),
+								 false, false, false,
+								 &sortOperator, NULL, NULL, NULL);
+		if (!OidIsValid(sortOperator))
+		{
+			/* let SortTupleStore report the error */
+			return NULL;
+		}
+
+		sortOrder->sortColIdx[columnIndex] = columnIndex + 1;
+		sortOrder->sortOperators[columnIndex] = sortOperator;
+		sortOrder->collations[columnIndex] = exprCollation((Node *) returningEntry->expr);
+		sortOrder->nullsFirst[columnIndex] = false;
+
+		columnIndex++;
+	}
+
+	return sortOrder;
+}
+
+
+/*
+ * WrapTasksForSortedReturning replaces the tasks of the execution by copies
+ * whose queries return the RETURNING rows in the given sort order, by running
+ * the modification in a CTE. As in WrapTasksForExplainAnalyze, the original
+ * tasks are left intact.
+ */
+static void
+WrapTasksForSortedReturning(DistributedExecution *execution, Sort *sortOrder)
+{
+	StringInfo orderByClause = makeStringInfo();
+	List *wrappedTaskList = NIL;
+	ListCell *taskCell = NULL;
+
+	/* the sort operators are the default ascending ones, so columns suffice */
+	for (int columnIndex = 0; columnIndex < sortOrder->numCols; columnIndex++)
+	{
+		appendStringInfo(orderByClause, "%s%d", columnIndex > 0 ? ", " : "",
+						 sortOrder->sortColIdx[columnIndex]);
+	}
+
+	foreach(taskCell, execution->tasksToExecute)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+		Task *wrappedTask = copyObject(task);
+
+		wrappedTask->queryString =
+			psprintf("WITH citus_returning AS (%s) SELECT * FROM citus_returning "
+					 "ORDER BY %s", TaskQueryString(task), orderByClause->data);
+		wrappedTaskList = lappend(wrappedTaskList, wrappedTask);
+	}
+
+	execution->tasksToExecute = wrappedTaskList;
+}
+
+
+/*
+ * CanUseBinaryResultFormat returns whether the rows of the given tuple
+ * descriptor can be returned by the workers in binary format. Apart from the
+ * checks done for binary COPY, the column types need binary receive functions
+ * on the coordinator.
+ */
+static bool
+CanUseBinaryResultFormat(TupleDesc tupleDescriptor)
+{
+	if (!CanUseBinaryCopyFormat(tupleDescriptor))
+	{
+		return false;
+	}
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+		Oid receiveFunctionId = InvalidOid;
+		Oid typeIoParam = InvalidOid;
+		int16 typeLength = 0;
+		bool typeByVal = false;
+		char typeAlign = 0;
+		char typeDelim = 0;
+
+		if (attribute->attisdropped)
+		{
+			continue;
+		}
+
+		get_type_io_data(attribute->atttypid, IOFunc_receive, &typeLength, &typeByVal,
+						 &typeAlign, &typeDelim, &typeIoParam, &receiveFunctionId);
+		if (!OidIsValid(receiveFunctionId))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * SetupBinaryResults makes the execution request binary results from the
+ * workers and looks up the receive functions of the column types, which
+ * CanUseBinaryResultFormat verified to exist.
+ */
+static void
+SetupBinaryResults(DistributedExecution *execution)
+{
+	TupleDesc tupleDescriptor = execution->tupleDescriptor;
+	int columnCount = tupleDescriptor->natts;
+
+	execution->binaryResults = true;
+	execution->receiveFunctions = palloc0(columnCount * sizeof(FmgrInfo));
+	execution->receiveTypeIoParams = palloc0(columnCount * sizeof(Oid));
+	execution->columnValues = palloc0(columnCount * sizeof(Datum));
+	execution->columnNulls = palloc0(columnCount * sizeof(bool));
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+		Oid receiveFunctionId = InvalidOid;
+
+		if (attribute->attisdropped)
+		{
+			continue;
+		}
+
+		getTypeBinaryInputInfo(attribute->atttypid, &receiveFunctionId,
+							   &execution->receiveTypeIoParams[columnIndex]);
+		fmgr_info(receiveFunctionId, &execution->receiveFunctions[columnIndex]);
+	}
+}
+
+
+/*
+ * CreateDistributedExecution creates a distributed execution data structure for
+ * a distributed plan.
+ */
+static DistributedExecution *
+CreateDistributedExecution(RowModifyLevel modLevel, List *taskList, bool hasReturning,
+						   ParamListInfo paramListInfo, TupleDesc tupleDescriptor,
+						   Tuplestorestate *tupleStore, int targetPoolSize)
+{
+	DistributedExecution *execution =
+		(DistributedExecution *) palloc0(sizeof(DistributedExecution));
+
+	execution->modLevel = modLevel;
+	execution->tasksToExecute = taskList;
+	execution->hasReturning = hasReturning;
+
+	execution->localTaskList = NIL;
+	execution->remoteTaskList = NIL;
+
+	execution->executionStats =
+		(DistributedExecutionStats *) palloc0(sizeof(DistributedExecutionStats));
+	execution->paramListInfo = paramListInfo;
+	execution->tupleDescriptor = tupleDescriptor;
+	execution->tupleStore = tupleStore;
+
+	execution->workerList = NIL;
+	execution->sessionList = NIL;
+	execution->targetPoolSize = targetPoolSize;
+
+	execution->totalTaskCount = list_length(taskList);
+	execution->unfinishedTaskCount = list_length(taskList);
+	execution->rowsProcessed = 0;
+	execution->rowLimit = 0;
+
+	execution->raiseInterrupts = true;
+
+	execution->connectionSetChanged = false;
+	dlist_init(&execution->waitFlagsChangedSessions);
+
+	/* allocate execution specific data once, on the ExecutorState memory context */
+	if (tupleDescriptor != NULL)
+	{
+		execution->attributeInputMetadata = TupleDescGetAttInMetadata(tupleDescriptor);
+		execution->columnArray =
+			(char **) palloc0(tupleDescriptor->natts * sizeof(char *));
+	}
+	else
+	{
+		execution->attributeInputMetadata = NULL;
+		execution->columnArray = NULL;
+	}
+
+	if (ShouldExecuteTasksLocally(taskList))
+	{
+		bool readOnlyPlan = !TaskListModifiesDatabase(modLevel, taskList);
+
+		ExtractLocalAndRemoteTasks(readOnlyPlan, taskList, &execution->localTaskList,
+								   &execution->remoteTaskList);
+	}
+
+	return execution;
+}
+
+
+/*
+ * StartDistributedExecution sets up the coordinated transaction and 2PC for
+ * the execution whenever necessary. It also keeps track of parallel relation
+ * accesses to enforce restrictions that arise due to foreign keys to reference
+ * tables.
+ */
+void
+StartDistributedExecution(DistributedExecution *execution)
+{
+	List *taskList = execution->tasksToExecute;
+
+	if (MultiShardCommitProtocol != COMMIT_PROTOCOL_BARE)
+	{
+		/*
+		 * In case localExecutionHappened, we simply force the executor to use 2PC.
+		 * The primary motivation is that at this point we're definitely expanding
+		 * the nodes participated in the transaction. And, by re-generating the
+		 * remote task lists during local query execution, we might prevent the adaptive
 		 * executor to kick-in 2PC (or even start coordinated transaction, that's why
 		 * we prefer adding this check here instead of
 		 * Activate2PCIfModifyingTransactionExpandsToNewNode()).
@@ -947,6 +1755,24 @@ StartDistributedExecution(DistributedExecution *execution)
 	 */
 	execution->isTransaction = InCoordinatedTransaction();
 
+	/* let all connections to a node read from the same snapshot */
+	if (execution->isTransaction && EnableSynchronizedSnapshots &&
+		list_length(taskList) > 1)
+	{
+		List *placementList = NIL;
+		ListCell *taskCell = NULL;
+
+		foreach(taskCell, taskList)
+		{
+			Task *task = (Task *) lfirst(taskCell);
+
+			placementList = list_concat(placementList,
+										list_copy(task->taskPlacementList));
+		}
+
+		ExportRemoteTransactionSnapshots(placementList);
+	}
+
 	/*
 	 * We should not record parallel access if the target pool size is less than 2.
 	 * The reason is that we define parallel access as at least two connections
@@ -1050,6 +1876,12 @@ DistributedExecutionRequiresRollback(DistributedExecution *execution)
 
 	if (ReadOnlyTask(task->taskType))
 	{
+		/* multi-shard reads need a transaction to share a snapshot */
+		if (EnableSynchronizedSnapshots && taskCount > 1)
+		{
+			return true;
+		}
+
 		return SelectOpensTransactionBlock && IsTransactionBlock();
 	}
 
@@ -1171,6 +2003,13 @@ ReadOnlyTask(TaskType taskType)
 		return true;
 	}
 
+	if (taskType == MAP_TASK || taskType == MAP_OUTPUT_FETCH_TASK ||
+		taskType == MERGE_TASK)
+	{
+		/* tasks of repartition joins only write intermediate files and tables */
+		return true;
+	}
+
 	return false;
 }
 
@@ -1211,10 +2050,45 @@ SelectForUpdateOnReferenceTable(RowModifyLevel modLevel, List *taskList)
 }
 
 
+/*
+ * ExecuteRepartitionedCountDistinct computes the count(DISTINCT) of a plan for
+ * which PlanRepartitionedCountDistinct decided to count the distinct values
+ * that the tasks return on the workers, and stores it as the only row of the
+ * scan.
+ */
+static void
+ExecuteRepartitionedCountDistinct(CitusScanState *scanState)
+{
+	DistributedPlan *distributedPlan = scanState->distributedPlan;
+	Job *job = distributedPlan->workerJob;
+	TargetEntry *distinctTargetEntry = linitial(job->jobQuery->targetList);
+	TupleDesc tupleDescriptor = ScanStateGetTupleDescriptor(scanState);
+	StringInfo resultIdPrefix = makeStringInfo();
+	Datum values[1];
+	bool nulls[1] = { false };
+
+	ereport(DEBUG1, (errmsg("repartitioning distinct values to count them on "
+							"the workers")));
+
+	appendStringInfo(resultIdPrefix, "count_distinct_" UINT64_FORMAT,
+					 distributedPlan->planId);
+
+	int64 distinctCount =
+		CountDistinctRedistributedTaskResults(resultIdPrefix->data, job->taskList,
+											  (Node *) distinctTargetEntry->expr);
+
+	scanState->tuplestorestate = tuplestore_begin_heap(true, false, work_mem);
+
+	values[0] = Int64GetDatum(distinctCount);
+	tuplestore_putvalues(scanState->tuplestorestate, tupleDescriptor, values, nulls);
+}
+
+
 /*
  * LockPartitionsForDistributedPlan ensures commands take locks on all partitions
  * of a distributed table that appears in the query. We do this primarily out of
- * consistency with PostgreSQL locking.
+ * consistency with PostgreSQL locking. For partitioned tables whose partitions
+ * were pruned on the coordinator, only the remaining partitions are locked.
  */
 static void
 LockPartitionsForDistributedPlan(DistributedPlan *distributedPlan)
@@ -1231,7 +2105,16 @@ LockPartitionsForDistributedPlan(DistributedPlan *distributedPlan)
 	 * DML case this also includes the target relation, but since we already
 	 * have a stronger lock this doesn't do any harm.
 	 */
-	LockPartitionsInRelationList(distributedPlan->relationIdList, AccessShareLock);
+	List *unprunedRelationIdList =
+		list_difference_oid(distributedPlan->relationIdList,
+							distributedPlan->prunedPartitionedRelationIdList);
+	LockPartitionsInRelationList(unprunedRelationIdList, AccessShareLock);
+
+	ListCell *partitionCell = NULL;
+	foreach(partitionCell, distributedPlan->partitionIdList)
+	{
+		LockRelationOid(lfirst_oid(partitionCell), AccessShareLock);
+	}
 }
 
 
@@ -1309,64 +2192,216 @@ FinishDistributedExecution(DistributedExecution *execution)
 
 
 /*
- * CleanUpSessions does any clean-up necessary for the session
- * used during the execution. We only reach the function after
- * successfully completing all the tasks and we expect no tasks
- * are still in progress.
+ * DistributedPlanRowLimit returns the number of rows after which a multi-shard
+ * SELECT can stop executing its tasks, or 0 if all the tasks need to run. That
+ * is the case when the master query only applies a constant LIMIT (and OFFSET)
+ * to the rows of the workers, such that every row received from a worker ends
+ * up as at most one row of the result.
  */
-static void
-CleanUpSessions(DistributedExecution *execution)
+static uint64
+DistributedPlanRowLimit(DistributedPlan *distributedPlan)
 {
-	List *sessionList = execution->sessionList;
-	ListCell *sessionCell = NULL;
+	Query *masterQuery = distributedPlan->masterQuery;
+	Job *workerJob = distributedPlan->workerJob;
+	int64 rowLimit = 0;
 
-	/* we get to this function only after successful executions */
-	Assert(!execution->failed && execution->unfinishedTaskCount == 0);
+	if (distributedPlan->modLevel != ROW_MODIFY_READONLY || masterQuery == NULL ||
+		list_length(workerJob->taskList) < 2)
+	{
+		return 0;
+	}
 
-	/* always trigger wait event set in the first round */
-	foreach(sessionCell, sessionList)
+	if (masterQuery->hasAggs || masterQuery->hasWindowFuncs ||
+		masterQuery->hasTargetSRFs || masterQuery->groupClause != NIL ||
+		masterQuery->havingQual != NULL || masterQuery->distinctClause != NIL ||
+		masterQuery->sortClause != NIL)
 	{
-		WorkerSession *session = lfirst(sessionCell);
+		return 0;
+	}
 
-		MultiConnection *connection = session->connection;
+	if (masterQuery->jointree != NULL && masterQuery->jointree->quals != NULL)
+	{
+		return 0;
+	}
 
-		ereport(DEBUG4, (errmsg("Total number of commands sent over the session %ld: %ld",
-								session->sessionId, session->commandsSent)));
+	Node *limitCount = masterQuery->limitCount;
+	if (limitCount == NULL || !IsA(limitCount, Const) ||
+		((Const *) limitCount)->constisnull)
+	{
+		return 0;
+	}
 
-		UnclaimConnection(connection);
+	rowLimit = DatumGetInt64(((Const *) limitCount)->constvalue);
+	if (rowLimit <= 0)
+	{
+		return 0;
+	}
 
-		if (connection->connectionState == MULTI_CONNECTION_CONNECTING ||
-			connection->connectionState == MULTI_CONNECTION_FAILED ||
-			connection->connectionState == MULTI_CONNECTION_LOST)
+	Node *limitOffset = masterQuery->limitOffset;
+	if (limitOffset != NULL)
+	{
+		if (!IsA(limitOffset, Const))
 		{
-			/*
-			 * We want the MultiConnection go away and not used in
-			 * the subsequent executions.
-			 *
-			 * We cannot get MULTI_CONNECTION_LOST via the ConnectionStateMachine,
-			 * but we might get it via the connection API and find us here before
-			 * changing any states in the ConnectionStateMachine.
-			 */
-			CloseConnection(connection);
+			return 0;
 		}
-		else if (connection->connectionState == MULTI_CONNECTION_CONNECTED)
-		{
-			RemoteTransaction *transaction = &(connection->remoteTransaction);
-			RemoteTransactionState transactionState = transaction->transactionState;
 
-			if (transactionState == REMOTE_TRANS_CLEARING_RESULTS)
+		if (!((Const *) limitOffset)->constisnull)
+		{
+			int64 rowOffset = DatumGetInt64(((Const *) limitOffset)->constvalue);
+			if (rowOffset > 0)
 			{
-				/*
-				 * We might have established the connection, and even sent BEGIN, but not
-				 * get to the point where we assigned a task to this specific connection
-				 * (because other connections in the pool already finished all the tasks).
-				 */
-				Assert(session->commandsSent == 0);
-
-				ClearResults(connection, false);
+				rowLimit += rowOffset;
 			}
-			else if (!(transactionState == REMOTE_TRANS_INVALID ||
-					   transactionState == REMOTE_TRANS_STARTED))
+		}
+	}
+
+	return (uint64) rowLimit;
+}
+
+
+/*
+ * ReachedRowLimit returns whether the execution received enough rows to skip
+ * its remaining tasks, and did not skip them yet.
+ */
+static bool
+ReachedRowLimit(DistributedExecution *execution)
+{
+	return execution->rowLimit > 0 && execution->rowsProcessed >= execution->rowLimit &&
+		   execution->unfinishedTaskCount > 0 && !execution->stoppedEarly;
+}
+
+
+/*
+ * StopRunningPlacementExecutions cancels the placement executions that are
+ * still in progress once the execution reached its row limit, and consumes
+ * their remaining results such that the connections can be used by the next
+ * commands. Placement executions that did not start are simply not executed.
+ */
+static void
+StopRunningPlacementExecutions(DistributedExecution *execution)
+{
+	ereport(DEBUG4, (errmsg("received " UINT64_FORMAT " rows, skipping the remaining "
+							"%d tasks", execution->rowsProcessed,
+							execution->unfinishedTaskCount)));
+
+	StopRunningSessions(execution->sessionList);
+
+	execution->stoppedEarly = true;
+}
+
+
+/*
+ * StopRunningSessions cancels the commands that are still running over the
+ * given sessions, and consumes their remaining results such that the
+ * connections can be used by the next commands.
+ */
+static void
+StopRunningSessions(List *sessionList)
+{
+	ListCell *sessionCell = NULL;
+
+	CancelRunningSessions(sessionList);
+
+	foreach(sessionCell, sessionList)
+	{
+		WorkerSession *session = lfirst(sessionCell);
+		MultiConnection *connection = session->connection;
+		RemoteTransaction *transaction = &(connection->remoteTransaction);
+
+		if (session->currentTask == NULL ||
+			connection->connectionState != MULTI_CONNECTION_CONNECTED)
+		{
+			continue;
+		}
+
+		/* the cancellation error, if any, is expected */
+		bool raiseInterrupts = true;
+		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+		while (result != NULL)
+		{
+			PQclear(result);
+
+			if (PQstatus(connection->pgConn) == CONNECTION_BAD)
+			{
+				break;
+			}
+
+			result = GetRemoteCommandResult(connection, raiseInterrupts);
+		}
+
+		if (PQstatus(connection->pgConn) == CONNECTION_BAD)
+		{
+			connection->connectionState = MULTI_CONNECTION_LOST;
+		}
+
+		session->currentTask = NULL;
+		dlist_init(&session->batchedTaskQueue);
+		session->batchedTaskCount = 0;
+		transaction->transactionState = REMOTE_TRANS_INVALID;
+	}
+}
+
+
+/*
+ * CleanUpSessions does any clean-up necessary for the session
+ * used during the execution. We only reach the function after
+ * successfully completing all the tasks and we expect no tasks
+ * are still in progress.
+ */
+static void
+CleanUpSessions(DistributedExecution *execution)
+{
+	List *sessionList = execution->sessionList;
+	ListCell *sessionCell = NULL;
+
+	/* we get to this function only after successful executions */
+	Assert(!execution->failed &&
+		   (execution->unfinishedTaskCount == 0 || execution->stoppedEarly));
+
+	/* always trigger wait event set in the first round */
+	foreach(sessionCell, sessionList)
+	{
+		WorkerSession *session = lfirst(sessionCell);
+
+		MultiConnection *connection = session->connection;
+
+		ereport(DEBUG4, (errmsg("Total number of commands sent over the session %ld: %ld",
+								session->sessionId, session->commandsSent)));
+
+		UnclaimConnection(connection);
+
+		if (connection->connectionState == MULTI_CONNECTION_CONNECTING ||
+			connection->connectionState == MULTI_CONNECTION_FAILED ||
+			connection->connectionState == MULTI_CONNECTION_LOST)
+		{
+			/*
+			 * We want the MultiConnection go away and not used in
+			 * the subsequent executions.
+			 *
+			 * We cannot get MULTI_CONNECTION_LOST via the ConnectionStateMachine,
+			 * but we might get it via the connection API and find us here before
+			 * changing any states in the ConnectionStateMachine.
+			 */
+			CloseConnection(connection);
+		}
+		else if (connection->connectionState == MULTI_CONNECTION_CONNECTED)
+		{
+			RemoteTransaction *transaction = &(connection->remoteTransaction);
+			RemoteTransactionState transactionState = transaction->transactionState;
+
+			if (transactionState == REMOTE_TRANS_CLEARING_RESULTS)
+			{
+				/*
+				 * We might have established the connection, and even sent BEGIN, but not
+				 * get to the point where we assigned a task to this specific connection
+				 * (because other connections in the pool already finished all the tasks).
+				 */
+				Assert(session->commandsSent == 0);
+
+				ClearResults(connection, false);
+			}
+			else if (!(transactionState == REMOTE_TRANS_INVALID ||
+					   transactionState == REMOTE_TRANS_STARTED))
 			{
 				/*
 				 * We don't have to handle anything else. Note that the execution
@@ -1395,6 +2430,37 @@ CleanUpSessions(DistributedExecution *execution)
 }
 
 
+/*
+ * CancelRunningSessions sends a cancellation request over each connection of
+ * the given sessions that is still running a command. The requests are sent
+ * to all workers before waiting for any of the commands to end, such that
+ * they stop their tasks at the same time rather than one after the other.
+ */
+static void
+CancelRunningSessions(List *sessionList)
+{
+	ListCell *sessionCell = NULL;
+
+	foreach(sessionCell, sessionList)
+	{
+		WorkerSession *session = lfirst(sessionCell);
+		MultiConnection *connection = session->connection;
+
+		if (session->currentTask == NULL ||
+			connection->connectionState != MULTI_CONNECTION_CONNECTED ||
+			connection->pgConn == NULL)
+		{
+			continue;
+		}
+
+		if (PQisBusy(connection->pgConn))
+		{
+			SendCancelationRequest(connection);
+		}
+	}
+}
+
+
 /*
  * UnclaimAllSessionConnections unclaims all of the connections for the given
  * sessionList.
@@ -1428,6 +2494,33 @@ AssignTasksToConnections(DistributedExecution *execution)
 
 	ListCell *taskCell = NULL;
 	ListCell *sessionCell = NULL;
+	ListCell *destinationCell = list_head(execution->taskResultDestinationList);
+	bool routeReadsToSecondaries = ShouldRouteReadsToSecondaries(execution);
+	int taskCount = list_length(taskList);
+	int totalPlacementCount = 0;
+	int taskIndex = 0;
+	int totalPlacementIndex = 0;
+
+	foreach(taskCell, taskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+
+		totalPlacementCount += list_length(task->taskPlacementList);
+	}
+
+	/*
+	 * Allocate the executions of all tasks and placements in bulk rather than
+	 * one by one, which avoids a lot of small allocations for executions with
+	 * many tasks. The executions live as long as the distributed execution.
+	 */
+	ShardCommandExecution *shardCommandExecutionArray =
+		(ShardCommandExecution *) palloc0(taskCount * sizeof(ShardCommandExecution));
+	TaskPlacementExecution *placementExecutionArray =
+		(TaskPlacementExecution *) palloc0(totalPlacementCount *
+										   sizeof(TaskPlacementExecution));
+	TaskPlacementExecution **placementExecutionPointerArray =
+		(TaskPlacementExecution **) palloc0(totalPlacementCount *
+											sizeof(TaskPlacementExecution *));
 
 	foreach(taskCell, taskList)
 	{
@@ -1437,27 +2530,69 @@ AssignTasksToConnections(DistributedExecution *execution)
 		int placementExecutionIndex = 0;
 		int placementExecutionCount = list_length(task->taskPlacementList);
 
+		/* tasks that are split over the executors are counted by the local executor */
+		if (!task->partiallyLocalOrRemote)
+		{
+			RecordTaskShardAccess(task);
+		}
+
 		/*
 		 * Execution of a command on a shard, which may have multiple replicas.
 		 */
 		ShardCommandExecution *shardCommandExecution =
-			(ShardCommandExecution *) palloc0(sizeof(ShardCommandExecution));
+			&shardCommandExecutionArray[taskIndex];
 		shardCommandExecution->task = task;
 		shardCommandExecution->executionOrder = ExecutionOrderForTask(modLevel, task);
+		if (ExecuteLargestShardsFirst)
+		{
+			shardCommandExecution->estimatedSize = EstimateTaskSize(task);
+		}
 		shardCommandExecution->executionState = TASK_EXECUTION_NOT_FINISHED;
 		shardCommandExecution->placementExecutions =
-			(TaskPlacementExecution **) palloc0(placementExecutionCount *
-												sizeof(TaskPlacementExecution *));
+			&placementExecutionPointerArray[totalPlacementIndex];
 		shardCommandExecution->placementExecutionCount = placementExecutionCount;
 
+		taskIndex++;
+
 		shardCommandExecution->expectResults =
 			(hasReturning && !task->partiallyLocalOrRemote) ||
 			modLevel == ROW_MODIFY_READONLY;
 
+		if (execution->mergeSortOrder != NULL)
+		{
+			/* keep the rows of the task apart, such that they can be merged */
+			shardCommandExecution->tupleStore = CreateTaskTupleStore(execution);
+			AddTaskResultStream(execution, shardCommandExecution->tupleStore,
+								shardCommandExecution);
+		}
+		else if (destinationCell != NULL)
+		{
+			TaskResultDestination *destination =
+				(TaskResultDestination *) lfirst(destinationCell);
+			TupleDesc tupleDescriptor = destination->tupleDescriptor;
+
+			Assert(destination->task == task);
+
+			/* the rows of the task belong to a query of their own */
+			shardCommandExecution->tupleStore = destination->tupleStore;
+			shardCommandExecution->attributeInputMetadata =
+				TupleDescGetAttInMetadata(tupleDescriptor);
+			shardCommandExecution->columnCount = tupleDescriptor->natts;
+			shardCommandExecution->executionStats = destination->executionStats;
+
+			destinationCell = lnext(destinationCell);
+		}
+
 		foreach(taskPlacementCell, task->taskPlacementList)
 		{
 			ShardPlacement *taskPlacement = (ShardPlacement *) lfirst(taskPlacementCell);
 			int connectionFlags = 0;
+
+			if (routeReadsToSecondaries)
+			{
+				taskPlacement = SecondaryPlacementForRead(taskPlacement);
+			}
+
 			char *nodeName = taskPlacement->nodeName;
 			int nodePort = taskPlacement->nodePort;
 			WorkerPool *workerPool = FindOrCreateWorkerPool(execution, nodeName,
@@ -1468,7 +2603,7 @@ AssignTasksToConnections(DistributedExecution *execution)
 			 * happen if the query is read-only and the shard has multiple placements.
 			 */
 			TaskPlacementExecution *placementExecution =
-				(TaskPlacementExecution *) palloc0(sizeof(TaskPlacementExecution));
+				&placementExecutionArray[totalPlacementIndex];
 			placementExecution->shardCommandExecution = shardCommandExecution;
 			placementExecution->shardPlacement = taskPlacement;
 			placementExecution->workerPool = workerPool;
@@ -1487,6 +2622,7 @@ AssignTasksToConnections(DistributedExecution *execution)
 				placementExecution;
 
 			placementExecutionIndex++;
+			totalPlacementIndex++;
 
 			List *placementAccessList = PlacementAccessListForTask(task, taskPlacement);
 
@@ -1498,6 +2634,25 @@ AssignTasksToConnections(DistributedExecution *execution)
 				connectionFlags,
 				placementAccessList,
 				NULL);
+
+			if (connection != NULL && !ConnectionModifiedPlacement(connection) &&
+				!ReadOnlyTask(task->taskType) && task->taskType != DDL_TASK &&
+				TransactionModifiedDistributedTable(execution))
+			{
+				/*
+				 * The placements were only read in this transaction. If another
+				 * connection already wrote to the same node, send the writes over
+				 * that connection instead, such that the node is modified over a
+				 * single connection and we do not need 2PC for it.
+				 */
+				MultiConnection *modifyingConnection =
+					FindModifyingConnectionForNode(nodeName, nodePort, NULL);
+				if (modifyingConnection != NULL)
+				{
+					connection = modifyingConnection;
+				}
+			}
+
 			if (connection != NULL)
 			{
 				/*
@@ -1542,8 +2697,7 @@ AssignTasksToConnections(DistributedExecution *execution)
 				if (placementExecutionReady)
 				{
 					/* task is ready to execute on any session */
-					dlist_push_tail(&workerPool->readyTaskQueue,
-									&placementExecution->workerReadyQueueNode);
+					PushUnassignedPlacementExecution(workerPool, placementExecution);
 
 					workerPool->readyTaskCount++;
 				}
@@ -1639,6 +2793,11 @@ ExecutionOrderForTask(RowModifyLevel modLevel, Task *task)
 		case MAP_TASK:
 		case MERGE_TASK:
 		case MAP_OUTPUT_FETCH_TASK:
+		{
+			/* tasks of repartition joins run on a single placement */
+			return EXECUTION_ORDER_ANY;
+		}
+
 		case MERGE_FETCH_TASK:
 		default:
 		{
@@ -1649,6 +2808,54 @@ ExecutionOrderForTask(RowModifyLevel modLevel, Task *task)
 }
 
 
+/*
+ * ShouldRouteReadsToSecondaries returns whether the placements of the tasks
+ * should be read from the secondaries of their groups. This is only done for
+ * read-only executions outside of transaction blocks when
+ * citus.use_secondary_nodes is 'prefer', since within a transaction block the
+ * reads have to see the writes of the transaction, which only the primaries do.
+ */
+static bool
+ShouldRouteReadsToSecondaries(DistributedExecution *execution)
+{
+	if (ReadFromSecondaries != USE_SECONDARY_NODES_PREFER)
+	{
+		return false;
+	}
+
+	if (IsMultiStatementTransaction() || InCoordinatedTransaction())
+	{
+		return false;
+	}
+
+	return !DistributedExecutionModifiesDatabase(execution);
+}
+
+
+/*
+ * SecondaryPlacementForRead returns a copy of the given placement that points
+ * to a secondary of the placement's group, or the placement itself if the group
+ * has no secondary with a small enough replay lag.
+ */
+static ShardPlacement *
+SecondaryPlacementForRead(ShardPlacement *placement)
+{
+	WorkerNode *secondaryNode = ReadableSecondaryNodeForGroup(placement->groupId);
+	if (secondaryNode == NULL)
+	{
+		return placement;
+	}
+
+	ShardPlacement *secondaryPlacement = CitusMakeNode(ShardPlacement);
+	CopyShardPlacement(placement, secondaryPlacement);
+	secondaryPlacement->nodeName = pstrdup(secondaryNode->workerName);
+	secondaryPlacement->nodePort = secondaryNode->workerPort;
+	secondaryPlacement->nodeId = secondaryNode->nodeId;
+
+	return secondaryPlacement;
+}
+
+
 /*
  * FindOrCreateWorkerPool gets the pool of connections for a particular worker.
  */
@@ -1674,6 +2881,7 @@ FindOrCreateWorkerPool(DistributedExecution *execution, char *nodeName, int node
 	workerPool->nodePort = nodePort;
 	workerPool->poolStartTime = 0;
 	workerPool->distributedExecution = execution;
+	workerPool->latencyStats = GetWorkerLatencyStats(nodeName, nodePort);
 
 	/* "open" connections aggressively when there are cached connections */
 	int nodeConnectionCount = MaxCachedConnectionsPerWorker;
@@ -1716,8 +2924,13 @@ FindOrCreateWorkerSession(WorkerPool *workerPool, MultiConnection *connection)
 	session->connection = connection;
 	session->workerPool = workerPool;
 	session->commandsSent = 0;
+	session->waitEventSetIndex = INVALID_WAIT_EVENT_SET_INDEX;
 	dlist_init(&session->pendingTaskQueue);
 	dlist_init(&session->readyTaskQueue);
+	dlist_init(&session->batchedTaskQueue);
+
+	/* the session is added to the wait event set in the next iteration */
+	AddWaitFlagsChangedSession(session);
 
 	/* keep track of how many connections are ready */
 	if (connection->connectionState == MULTI_CONNECTION_CONNECTED)
@@ -1828,137 +3041,54 @@ SequentialRunDistributedExecution(DistributedExecution *execution)
 void
 RunDistributedExecution(DistributedExecution *execution)
 {
-	WaitEvent *events = NULL;
-
 	AssignTasksToConnections(execution);
 
+	execution->hedgeReads = ShouldHedgeReads(execution);
+
 	PG_TRY();
 	{
 		bool cancellationReceived = false;
 
-		/* additional 2 is for postmaster and latch */
-		int eventSetSize = list_length(execution->sessionList) + 2;
-
 		/* always (re)build the wait event set the first time */
 		execution->connectionSetChanged = true;
 
 		while (execution->unfinishedTaskCount > 0 && !cancellationReceived)
 		{
-			int eventIndex = 0;
-			ListCell *workerCell = NULL;
-			long timeout = NextEventTimeout(execution);
-
-			foreach(workerCell, execution->workerList)
-			{
-				WorkerPool *workerPool = lfirst(workerCell);
-				ManageWorkerPool(workerPool);
-			}
-
-			if (execution->connectionSetChanged)
-			{
-				if (execution->waitEventSet != NULL)
-				{
-					FreeWaitEventSet(execution->waitEventSet);
-					execution->waitEventSet = NULL;
-				}
-
-				if (events != NULL)
-				{
-					/*
-					 * The execution might take a while, so explicitly free at this point
-					 * because we don't need anymore.
-					 */
-					pfree(events);
-					events = NULL;
-				}
-
-				execution->waitEventSet = BuildWaitEventSet(execution->sessionList);
-
-				/* recalculate (and allocate) since the sessions have changed */
-				eventSetSize = list_length(execution->sessionList) + 2;
-
-				events = palloc0(eventSetSize * sizeof(WaitEvent));
-
-				execution->connectionSetChanged = false;
-				execution->waitFlagsChanged = false;
-			}
-			else if (execution->waitFlagsChanged)
-			{
-				UpdateWaitEventSetFlags(execution->waitEventSet, execution->sessionList);
-				execution->waitFlagsChanged = false;
-			}
-
-			/* wait for I/O events */
-			int eventCount = WaitEventSetWait(execution->waitEventSet, timeout, events,
-											  eventSetSize, WAIT_EVENT_CLIENT_READ);
+			cancellationReceived = RunDistributedExecutionStep(execution);
 
-			/* process I/O events */
-			for (; eventIndex < eventCount; eventIndex++)
+			if (ReachedRowLimit(execution))
 			{
-				WaitEvent *event = &events[eventIndex];
-
-				if (event->events & WL_POSTMASTER_DEATH)
-				{
-					ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
-				}
-
-				if (event->events & WL_LATCH_SET)
-				{
-					ResetLatch(MyLatch);
-
-					if (execution->raiseInterrupts)
-					{
-						CHECK_FOR_INTERRUPTS();
-					}
-
-					if (InterruptHoldoffCount > 0 && (QueryCancelPending ||
-													  ProcDiePending))
-					{
-						/*
-						 * Break out of event loop immediately in case of cancellation.
-						 * We cannot use "return" here inside a PG_TRY() block since
-						 * then the exception stack won't be reset.
-						 */
-						cancellationReceived = true;
-						break;
-					}
-
-					continue;
-				}
-
-				WorkerSession *session = (WorkerSession *) event->user_data;
-				session->latestUnconsumedWaitEvents = event->events;
-
-				ConnectionStateMachine(session);
+				/* the master query does not need the rows of the remaining tasks */
+				StopRunningPlacementExecutions(execution);
+				break;
 			}
 		}
 
-		if (events != NULL)
+		if (execution->hedgedTaskCount > 0 && !execution->stoppedEarly)
 		{
-			pfree(events);
+			/* the placement executions that lost the race are still running */
+			StopRunningSessions(execution->sessionList);
 		}
 
-		if (execution->waitEventSet != NULL)
-		{
-			FreeWaitEventSet(execution->waitEventSet);
-			execution->waitEventSet = NULL;
-		}
+		FreeExecutionWaitEvents(execution);
 
 		CleanUpSessions(execution);
 	}
 	PG_CATCH();
 	{
+		/*
+		 * The remaining tasks are no longer needed, cancel all of them before
+		 * the abort handling gets to the connections one by one.
+		 */
+		CancelRunningSessions(execution->sessionList);
+
 		/*
 		 * We can still recover from error using ROLLBACK TO SAVEPOINT,
 		 * unclaim all connections to allow that.
 		 */
 		UnclaimAllSessionConnections(execution->sessionList);
 
-		if (execution->waitEventSet != NULL)
-		{
-			FreeWaitEventSet(execution->waitEventSet);
-			execution->waitEventSet = NULL;
-		}
+		FreeExecutionWaitEvents(execution);
 
 		PG_RE_THROW();
 	}
@@ -1967,1017 +3097,2596 @@ RunDistributedExecution(DistributedExecution *execution)
 
 
 /*
- * ManageWorkerPool ensures the worker pool has the appropriate number of connections
- * based on the number of pending tasks.
+ * RunDistributedExecutionStep runs a single iteration of the main loop of the
+ * execution: it manages the worker pools, waits for events on the connections
+ * and runs the connection state machine of the sessions that have an event.
+ * The function returns true if a cancellation was received while interrupts
+ * are held off, in which case the caller should stop the execution.
  */
-static void
-ManageWorkerPool(WorkerPool *workerPool)
+static bool
+RunDistributedExecutionStep(DistributedExecution *execution)
 {
-	DistributedExecution *execution = workerPool->distributedExecution;
-	int targetPoolSize = execution->targetPoolSize;
-	int initiatedConnectionCount = list_length(workerPool->sessionList);
-	int activeConnectionCount PG_USED_FOR_ASSERTS_ONLY =
-		workerPool->activeConnectionCount;
-	int idleConnectionCount PG_USED_FOR_ASSERTS_ONLY =
-		workerPool->idleConnectionCount;
-	int failedConnectionCount = workerPool->failedConnectionCount;
-	int readyTaskCount = workerPool->readyTaskCount;
-	int newConnectionCount = 0;
-
-	/* we should always have more (or equal) active connections than idle connections */
-	Assert(activeConnectionCount >= idleConnectionCount);
-
-	/* we should always have more (or equal) initiated connections than active connections */
-	Assert(initiatedConnectionCount >= activeConnectionCount);
+	int eventIndex = 0;
+	ListCell *workerCell = NULL;
+	if (execution->hedgeReads)
+	{
+		StartHedgedPlacementExecutions(execution);
+	}
 
-	/* we should never have less than 0 connections ever */
-	Assert(activeConnectionCount >= 0 && idleConnectionCount >= 0);
+	long timeout = NextEventTimeout(execution);
 
-	if (workerPool->failed)
+	foreach(workerCell, execution->workerList)
 	{
-		/* connection pool failed */
-		return;
+		WorkerPool *workerPool = lfirst(workerCell);
+		ManageWorkerPool(workerPool);
 	}
 
-	/* we might fail the execution or warn the user about connection timeouts */
-	if (workerPool->checkForPoolTimeout)
+	if (execution->waitEventSet == NULL)
 	{
-		CheckConnectionTimeout(workerPool);
+		execution->connectionSetChanged = true;
 	}
 
-	if (failedConnectionCount >= 1)
+	if (!execution->connectionSetChanged && !UpdateWaitEventSet(execution))
 	{
-		/* do not attempt to open more connections after one failed */
-		return;
+		/* the new sessions do not fit in the wait event set */
+		execution->connectionSetChanged = true;
 	}
 
-	if (UseConnectionPerPlacement())
+	if (execution->connectionSetChanged)
 	{
-		int unusedConnectionCount = workerPool->unusedConnectionCount;
-
-		/*
-		 * If force_max_query_parallelization is enabled then we ignore pool size
-		 * and idle connections. Instead, we open new connections as long as there
-		 * are more tasks than unused connections.
-		 */
-
-		newConnectionCount = Max(readyTaskCount - unusedConnectionCount, 0);
+		RebuildWaitEventSet(execution);
+		execution->connectionSetChanged = false;
 	}
-	else
-	{
-		/* cannot open more than targetPoolSize connections */
-		int maxNewConnectionCount = targetPoolSize - initiatedConnectionCount;
 
-		/* total number of connections that are (almost) available for tasks */
-		int usableConnectionCount = UsableConnectionCount(workerPool);
+	/* wait for I/O events */
+	int eventCount = WaitEventSetWait(execution->waitEventSet, timeout,
+									  execution->events, execution->eventSetSize,
+									  DistributedExecutionWaitEvent(execution));
 
-		/*
-		 * Number of additional connections we would need to run all ready tasks in
-		 * parallel.
-		 */
-		int newConnectionsForReadyTasks = readyTaskCount - usableConnectionCount;
+	/* process I/O events */
+	for (; eventIndex < eventCount; eventIndex++)
+	{
+		WaitEvent *event = &execution->events[eventIndex];
 
-		/*
-		 * Open enough connections to handle all tasks that are ready, but no more
-		 * than the target pool size.
-		 */
-		newConnectionCount = Min(newConnectionsForReadyTasks, maxNewConnectionCount);
+		if (event->events & WL_POSTMASTER_DEATH)
+		{
+			ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
+		}
 
-		if (newConnectionCount > 0 && ExecutorSlowStartInterval > 0)
+		if (event->events & WL_LATCH_SET)
 		{
-			TimestampTz now = GetCurrentTimestamp();
+			ResetLatch(MyLatch);
 
-			if (TimestampDifferenceExceeds(workerPool->lastConnectionOpenTime, now,
-										   ExecutorSlowStartInterval))
+			if (execution->raiseInterrupts)
 			{
-				newConnectionCount = Min(newConnectionCount,
-										 workerPool->maxNewConnectionsPerCycle);
-
-				/* increase the open rate every cycle (like TCP slow start) */
-				workerPool->maxNewConnectionsPerCycle += 1;
+				CHECK_FOR_INTERRUPTS();
 			}
-			else
+
+			if (InterruptHoldoffCount > 0 && (QueryCancelPending ||
+											  ProcDiePending))
 			{
-				/* wait a bit until opening more connections */
-				return;
+				/*
+				 * Break out of event loop immediately in case of cancellation.
+				 * The caller is inside a PG_TRY() block and stops the
+				 * execution.
+				 */
+				return true;
 			}
+
+			continue;
 		}
-	}
 
-	if (newConnectionCount <= 0)
-	{
-		return;
-	}
+		WorkerSession *session = (WorkerSession *) event->user_data;
+		session->latestUnconsumedWaitEvents = event->events;
 
-	ereport(DEBUG4, (errmsg("opening %d new connections to %s:%d", newConnectionCount,
-							workerPool->nodeName, workerPool->nodePort)));
+		ConnectionStateMachine(session);
+	}
 
-	for (int connectionIndex = 0; connectionIndex < newConnectionCount; connectionIndex++)
-	{
-		/* experimental: just to see the perf benefits of caching connections */
-		int connectionFlags = 0;
+	return false;
+}
 
-		/* open a new connection to the worker */
-		MultiConnection *connection = StartNodeUserDatabaseConnection(connectionFlags,
-																	  workerPool->nodeName,
-																	  workerPool->nodePort,
-																	  NULL, NULL);
 
-		/*
-		 * Assign the initial state in the connection state machine. The connection
-		 * may already be open, but ConnectionStateMachine will immediately detect
-		 * this.
-		 */
-		connection->connectionState = MULTI_CONNECTION_CONNECTING;
+/*
+ * DistributedExecutionWaitEvent returns the wait event under which the
+ * execution waits for I/O. While none of the sessions is running a command,
+ * the execution is still waiting for connections to be established.
+ */
+static uint32
+DistributedExecutionWaitEvent(DistributedExecution *execution)
+{
+	ListCell *sessionCell = NULL;
+	bool connecting = false;
 
-		/*
-		 * Ensure that subsequent calls to StartNodeUserDatabaseConnection get a
-		 * different connection.
-		 */
-		connection->claimedExclusively = true;
+	foreach(sessionCell, execution->sessionList)
+	{
+		WorkerSession *session = (WorkerSession *) lfirst(sessionCell);
 
-		/* create a session for the connection */
-		WorkerSession *session = FindOrCreateWorkerSession(workerPool, connection);
+		if (session->currentTask != NULL)
+		{
+			return WAIT_EVENT_CITUS_REMOTE_RESULT;
+		}
 
-		/* always poll the connection in the first round */
-		UpdateConnectionWaitFlags(session, WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+		if (session->connection->connectionState == MULTI_CONNECTION_CONNECTING)
+		{
+			connecting = true;
+		}
 	}
 
-	workerPool->lastConnectionOpenTime = GetCurrentTimestamp();
-	execution->connectionSetChanged = true;
+	return connecting ? WAIT_EVENT_CITUS_CONNECT : WAIT_EVENT_CITUS_REMOTE_RESULT;
 }
 
 
 /*
- * CheckConnectionTimeout makes sure that the execution enforces the connection
- * establishment timeout defined by the user (NodeConnectionTimeout).
- *
- * The rule is that if a worker pool has already initiated connection establishment
- * and has not succeeded to finish establishments that are necessary to execute tasks,
- * take an action. For the types of actions, see the comments in the function.
- *
- * Enforcing the timeout per pool (over per session) helps the execution to continue
- * even if we can establish a single connection as we expect to have target pool size
- * number of connections. In the end, the executor is capable of using one connection
- * to execute multiple tasks.
+ * FreeExecutionWaitEvents frees the wait event set of the execution and the
+ * array of events that is used to wait on it.
  */
 static void
-CheckConnectionTimeout(WorkerPool *workerPool)
+FreeExecutionWaitEvents(DistributedExecution *execution)
 {
-	DistributedExecution *execution = workerPool->distributedExecution;
-	TimestampTz poolStartTime = workerPool->poolStartTime;
-	TimestampTz now = GetCurrentTimestamp();
-
-	int initiatedConnectionCount = list_length(workerPool->sessionList);
-	int activeConnectionCount = workerPool->activeConnectionCount;
-	int requiredActiveConnectionCount = 1;
+	if (execution->events != NULL)
+	{
+		pfree(execution->events);
+		execution->events = NULL;
+		execution->eventSetSize = 0;
+	}
 
-	if (initiatedConnectionCount == 0)
+	if (execution->waitEventSet != NULL)
 	{
-		/* no connection has been planned for the pool yet */
-		Assert(poolStartTime == 0);
-		return;
+		FreeWaitEventSet(execution->waitEventSet);
+		execution->waitEventSet = NULL;
 	}
+}
 
-	/*
-	 * This is a special case where we assign tasks to sessions even before
-	 * the connections are established. So, make sure to apply similar
-	 * restrictions. In this case, make sure that we get all the connections
-	 * established.
-	 */
-	if (UseConnectionPerPlacement())
+
+/*
+ * ShouldStreamResults returns whether the rows of the execution can be returned
+ * to the scan while the execution is still running. We only do so for a SELECT
+ * outside of a transaction block, since the connections of the execution stay
+ * busy in between and other commands in the same transaction could not use them.
+ *
+ * The same holds for the RETURNING rows of a modification that is the only
+ * command of its transaction, unless the rows need to be sorted. The coordinated
+ * transaction of the modification only commits after the scan ended.
+ */
+static bool
+ShouldStreamResults(CitusScanState *scanState, DistributedExecution *execution)
+{
+	if (!EnableStreamingResults || !scanState->canStreamResults)
 	{
-		requiredActiveConnectionCount = initiatedConnectionCount;
+		return false;
 	}
 
-	if (TimestampDifferenceExceeds(poolStartTime, now, NodeConnectionTimeout))
+	if (execution->modLevel != ROW_MODIFY_READONLY)
 	{
-		if (activeConnectionCount < requiredActiveConnectionCount)
+		if (!execution->hasReturning || SortReturning)
 		{
-			int logLevel = WARNING;
-
-			/*
-			 * First fail the pool and create an opportunity to execute tasks
-			 * over other pools when tasks have more than one placement to execute.
-			 */
-			WorkerPoolFailed(workerPool);
-
-			/*
-			 * The enforcement is not always erroring out. For example, if a SELECT task
-			 * has two different placements, we'd warn the user, fail the pool and continue
-			 * with the next placement.
-			 */
-			if (execution->errorOnAnyFailure || execution->failed)
-			{
-				logLevel = ERROR;
-			}
-
-			ereport(logLevel, (errcode(ERRCODE_CONNECTION_FAILURE),
-							   errmsg("could not establish any connections to the node "
-									  "%s:%d after %u ms", workerPool->nodeName,
-									  workerPool->nodePort,
-									  NodeConnectionTimeout)));
+			return false;
 		}
-		else
+
+		if (list_length(execution->localTaskList) > 0)
 		{
-			/* stop interrupting WaitEventSetWait for timeouts */
-			workerPool->checkForPoolTimeout = false;
+			/* local tasks report their modified rows separately */
+			return false;
 		}
 	}
+	else if (execution->isTransaction)
+	{
+		return false;
+	}
+
+	if (IsMultiStatementTransaction() || IsSubTransaction() || FunctionCallLevel > 0)
+	{
+		/* other commands might need the connections before the scan ends */
+		return false;
+	}
+
+	if (list_length(execution->tasksToExecute) == 0)
+	{
+		/* all tasks were executed locally */
+		return false;
+	}
+
+	return !ShouldRunTasksSequentially(execution->tasksToExecute);
 }
 
 
 /*
- * UsableConnectionCount returns the number of connections in the worker pool
- * that are (soon to be) usable for sending commands, this includes both idle
- * connections and connections that are still establishing.
+ * StartStreamingExecution prepares the execution to be run by the calls of
+ * ReturnTupleFromDistributedExecution, which run the main loop until the next
+ * row is available.
  */
-static int
-UsableConnectionCount(WorkerPool *workerPool)
+static void
+StartStreamingExecution(CitusScanState *scanState, DistributedExecution *execution)
 {
-	int initiatedConnectionCount = list_length(workerPool->sessionList);
-	int activeConnectionCount = workerPool->activeConnectionCount;
-	int failedConnectionCount = workerPool->failedConnectionCount;
-	int idleConnectionCount = workerPool->idleConnectionCount;
+	AssignTasksToConnections(execution);
 
-	/* connections that are still establishing will soon be available for tasks */
-	int establishingConnectionCount =
-		initiatedConnectionCount - activeConnectionCount - failedConnectionCount;
+	if (execution->mergeSortOrder == NULL)
+	{
+		if (tuplestore_tuple_count(execution->tupleStore) == 0)
+		{
+			/*
+			 * The scan never goes back, so rows that it returned can be
+			 * trimmed from the tuple store. That keeps memory bounded by the
+			 * rows that arrived ahead of the scan instead of spilling the
+			 * whole result to disk. Rows of local tasks prevent changing the
+			 * flags, in which case we keep all rows.
+			 */
+			tuplestore_set_eflags(execution->tupleStore, 0);
+		}
 
-	int usableConnectionCount = idleConnectionCount + establishingConnectionCount;
+		/* rows are returned in the order in which they arrive */
+		AddTaskResultStream(execution, execution->tupleStore, NULL);
+	}
 
-	return usableConnectionCount;
+	/* always (re)build the wait event set the first time */
+	execution->connectionSetChanged = true;
+	execution->streaming = true;
+
+	scanState->distributedExecution = execution;
 }
 
 
 /*
- * NextEventTimeout finds the earliest time at which we need to interrupt
- * WaitEventSetWait because of a timeout and returns the number of milliseconds
- * until that event with a minimum of 1ms and a maximum of 1000ms.
+ * RunStreamingExecution runs the main loop of a streaming execution until the
+ * given stream has a row that was not read yet, or all its rows arrived. The
+ * execution is finished once all tasks are done or the remaining tasks are no
+ * longer needed.
  *
- * This code may be sensitive to clock jumps, but only has the effect of waking
- * up WaitEventSetWait slightly earlier to later.
+ * The wait event set is freed before returning, since we do not know whether
+ * the scan will be called again.
  */
-static long
-NextEventTimeout(DistributedExecution *execution)
+static void
+RunStreamingExecution(DistributedExecution *execution, TaskResultStream *stream)
 {
-	ListCell *workerCell = NULL;
-	TimestampTz now = GetCurrentTimestamp();
-	long eventTimeout = 1000; /* milliseconds */
-
-	foreach(workerCell, execution->workerList)
+	PG_TRY();
 	{
-		WorkerPool *workerPool = (WorkerPool *) lfirst(workerCell);
-
-		if (workerPool->failed)
+		while (!TaskResultStreamReady(execution, stream))
 		{
-			/* worker pool may have already timed out */
-			continue;
+			bool cancellationReceived = RunDistributedExecutionStep(execution);
+
+			if (cancellationReceived || ReachedRowLimit(execution))
+			{
+				/* the rows of the remaining tasks are not needed */
+				StopRunningPlacementExecutions(execution);
+			}
 		}
 
-		if (workerPool->poolStartTime != 0 && workerPool->checkForPoolTimeout)
+		FreeExecutionWaitEvents(execution);
+		execution->connectionSetChanged = true;
+
+		if (execution->unfinishedTaskCount == 0 || execution->stoppedEarly)
 		{
-			long timeSincePoolStartMs =
-				MillisecondsBetweenTimestamps(workerPool->poolStartTime, now);
-
-			/*
-			 * This could go into the negative if the connection timeout just passed.
-			 * In that case we want to wake up as soon as possible. Once the timeout
-			 * has been processed, checkForPoolTimeout will be false so we will skip
-			 * this check.
-			 */
-			long timeUntilConnectionTimeoutMs =
-				NodeConnectionTimeout - timeSincePoolStartMs;
-
-			if (timeUntilConnectionTimeoutMs < eventTimeout)
-			{
-				eventTimeout = timeUntilConnectionTimeoutMs;
-			}
+			FinishStreamingExecution(execution);
 		}
-
-		int initiatedConnectionCount = list_length(workerPool->sessionList);
+	}
+	PG_CATCH();
+	{
+		/*
+		 * The remaining tasks are no longer needed, cancel all of them before
+		 * the abort handling gets to the connections one by one.
+		 */
+		CancelRunningSessions(execution->sessionList);
 
 		/*
-		 * If there are connections to open we wait at most up to the end of the
-		 * current slow start interval.
+		 * We can still recover from error using ROLLBACK TO SAVEPOINT,
+		 * unclaim all connections to allow that.
 		 */
-		if (workerPool->readyTaskCount > UsableConnectionCount(workerPool) &&
-			initiatedConnectionCount < execution->targetPoolSize)
-		{
-			long timeSinceLastConnectMs =
-				MillisecondsBetweenTimestamps(workerPool->lastConnectionOpenTime, now);
-			long timeUntilSlowStartInterval =
-				ExecutorSlowStartInterval - timeSinceLastConnectMs;
+		UnclaimAllSessionConnections(execution->sessionList);
 
-			if (timeUntilSlowStartInterval < eventTimeout)
-			{
-				eventTimeout = timeUntilSlowStartInterval;
-			}
-		}
-	}
+		FreeExecutionWaitEvents(execution);
+		execution->streaming = false;
 
-	return Max(1, eventTimeout);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
 }
 
 
 /*
- * MillisecondsBetweenTimestamps is a helper to get the number of milliseconds
- * between timestamps when it is expected to be small enough to fit in a
- * long.
+ * FinishStreamingExecution releases the connections of a streaming execution
+ * once it no longer needs them.
  */
-static long
-MillisecondsBetweenTimestamps(TimestampTz startTime, TimestampTz endTime)
+static void
+FinishStreamingExecution(DistributedExecution *execution)
 {
-	long secs = 0;
-	int micros = 0;
+	if (!execution->streaming)
+	{
+		return;
+	}
 
-	TimestampDifference(startTime, endTime, &secs, &micros);
+	execution->streaming = false;
 
-	return secs * 1000 + micros / 1000;
+	CleanUpSessions(execution);
+	FinishDistributedExecution(execution);
 }
 
 
 /*
- * ConnectionStateMachine opens a connection and descends into the transaction
- * state machine when ready.
+ * ReturnTupleFromDistributedExecution returns the next row of a streaming
+ * execution or of an execution whose task results are merged, or an empty
+ * slot once all rows were returned. When the rows of the tasks are merged,
+ * the row that comes first in sort order is returned.
  */
-static void
-ConnectionStateMachine(WorkerSession *session)
+TupleTableSlot *
+ReturnTupleFromDistributedExecution(CitusScanState *scanState)
 {
-	WorkerPool *workerPool = session->workerPool;
-	DistributedExecution *execution = workerPool->distributedExecution;
-
-	MultiConnection *connection = session->connection;
-	MultiConnectionState currentState;
+	DistributedExecution *execution = scanState->distributedExecution;
+	TupleTableSlot *resultSlot = scanState->customScanState.ss.ps.ps_ResultTupleSlot;
 
-	do {
-		currentState = connection->connectionState;
-
-		switch (currentState)
+	if (execution->mergeSortOrder != NULL)
+	{
+		TupleTableSlot *mergedSlot = NextMergedTuple(execution);
+		if (mergedSlot == NULL)
 		{
-			case MULTI_CONNECTION_INITIAL:
-			{
-				/* simply iterate the state machine */
-				connection->connectionState = MULTI_CONNECTION_CONNECTING;
-				break;
-			}
+			return ExecClearTuple(resultSlot);
+		}
 
-			case MULTI_CONNECTION_CONNECTING:
-			{
-				ConnStatusType status = PQstatus(connection->pgConn);
-				if (status == CONNECTION_OK)
-				{
-					ereport(DEBUG4, (errmsg("established connection to %s:%d for "
-											"session %ld",
-											connection->hostname, connection->port,
-											session->sessionId)));
+		return ExecCopySlot(resultSlot, mergedSlot);
+	}
 
-					workerPool->activeConnectionCount++;
-					workerPool->idleConnectionCount++;
+	TaskResultStream *stream = (TaskResultStream *) linitial(
+		execution->resultStreamList);
+	bool copy = false;
 
-					UpdateConnectionWaitFlags(session,
-											  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+	bool fetchedTuple = FetchNextStreamTuple(execution, stream, resultSlot, copy);
+	if (!fetchedTuple && execution->modLevel != ROW_MODIFY_READONLY)
+	{
+		/* all RETURNING rows arrived, report the number of modified rows */
+		EState *executorState = ScanStateGetExecutorState(scanState);
 
-					connection->connectionState = MULTI_CONNECTION_CONNECTED;
-					break;
-				}
-				else if (status == CONNECTION_BAD)
-				{
-					connection->connectionState = MULTI_CONNECTION_FAILED;
-					break;
-				}
+		executorState->es_processed = execution->rowsProcessed;
+	}
 
-				PostgresPollingStatusType pollMode = PQconnectPoll(connection->pgConn);
-				if (pollMode == PGRES_POLLING_FAILED)
-				{
-					connection->connectionState = MULTI_CONNECTION_FAILED;
-				}
-				else if (pollMode == PGRES_POLLING_READING)
-				{
-					UpdateConnectionWaitFlags(session, WL_SOCKET_READABLE);
-				}
-				else if (pollMode == PGRES_POLLING_WRITING)
-				{
-					UpdateConnectionWaitFlags(session, WL_SOCKET_WRITEABLE);
-				}
-				else
-				{
-					ereport(DEBUG4, (errmsg("established connection to %s:%d for "
-											"session %ld",
-											connection->hostname, connection->port,
-											session->sessionId)));
+	return resultSlot;
+}
 
-					workerPool->activeConnectionCount++;
-					workerPool->idleConnectionCount++;
 
-					UpdateConnectionWaitFlags(session,
-											  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+/*
+ * EndStreamingExecution stops a streaming execution whose rows were not all
+ * read, for instance because of a LIMIT on the coordinator, and releases the
+ * tuple stores of the tasks.
+ */
+void
+EndStreamingExecution(CitusScanState *scanState)
+{
+	DistributedExecution *execution = scanState->distributedExecution;
 
-					connection->connectionState = MULTI_CONNECTION_CONNECTED;
-				}
+	if (execution == NULL)
+	{
+		return;
+	}
 
-				break;
+	if (execution->streaming)
+	{
+		if (execution->unfinishedTaskCount > 0 && !execution->stoppedEarly)
+		{
+			if (DistributedExecutionModifiesDatabase(execution))
+			{
+				/* modifications run to completion even when rows are not read */
+				TaskResultStream *stream = (TaskResultStream *) linitial(
+					execution->resultStreamList);
+				TupleTableSlot *slot = scanState->customScanState.ss.ps.ps_ResultTupleSlot;
+				bool copy = false;
+				bool fetchedTuple = true;
+
+				while (fetchedTuple)
+				{
+					fetchedTuple = FetchNextStreamTuple(execution, stream, slot, copy);
+				}
 			}
-
-			case MULTI_CONNECTION_CONNECTED:
+			else
 			{
-				/* connection is ready, run the transaction state machine */
-				TransactionStateMachine(session);
-				break;
+				StopRunningPlacementExecutions(execution);
 			}
+		}
 
-			case MULTI_CONNECTION_LOST:
-			{
-				/* managed to connect, but connection was lost */
-				workerPool->activeConnectionCount--;
+		FinishStreamingExecution(execution);
+	}
 
-				if (session->currentTask == NULL)
-				{
-					/* this was an idle connection */
-					workerPool->idleConnectionCount--;
-				}
+	EndTaskResultStreams(execution);
 
-				connection->connectionState = MULTI_CONNECTION_FAILED;
-				break;
-			}
+	scanState->distributedExecution = NULL;
+}
 
-			case MULTI_CONNECTION_FAILED:
-			{
-				/* connection failed or was lost */
-				int totalConnectionCount = list_length(workerPool->sessionList);
 
-				workerPool->failedConnectionCount++;
+/*
+ * CreateTaskTupleStore creates a tuple store for the rows of a single task,
+ * which gets a share of work_mem. The rows are read only once.
+ */
+static Tuplestorestate *
+CreateTaskTupleStore(DistributedExecution *execution)
+{
+	bool randomAccess = false;
+	bool interTransactions = false;
 
-				/* if the connection executed a critical command it should fail */
-				MarkRemoteTransactionFailed(connection, false);
+	Tuplestorestate *tupleStore = tuplestore_begin_heap(randomAccess, interTransactions,
+														execution->taskTupleStoreKB);
 
-				/* mark all assigned placement executions as failed */
-				WorkerSessionFailed(session);
+	/* the rows are merged in a single pass, which allows trimming merged rows */
+	tuplestore_set_eflags(tupleStore, 0);
 
-				if (workerPool->failedConnectionCount >= totalConnectionCount)
-				{
-					/*
-					 * All current connection attempts have failed.
-					 * Mark all unassigned placement executions as failed.
-					 *
-					 * We do not currently retry if the first connection
-					 * attempt fails.
-					 */
-					WorkerPoolFailed(workerPool);
-				}
+	return tupleStore;
+}
 
-				/*
-				 * The execution may have failed as a result of WorkerSessionFailed
-				 * or WorkerPoolFailed.
-				 */
-				if (execution->failed || execution->errorOnAnyFailure)
-				{
-					/* a task has failed due to this connection failure */
-					ReportConnectionError(connection, ERROR);
-				}
-				else
-				{
-					/* can continue with the remaining nodes */
-					ReportConnectionError(connection, WARNING);
-				}
 
-				/* remove the connection */
-				UnclaimConnection(connection);
+/*
+ * AddTaskResultStream adds a stream over the rows in the given tuple store to
+ * the result streams of the execution.
+ */
+static TaskResultStream *
+AddTaskResultStream(DistributedExecution *execution, Tuplestorestate *tupleStore,
+					ShardCommandExecution *shardCommandExecution)
+{
+	TaskResultStream *stream = (TaskResultStream *) palloc0(sizeof(TaskResultStream));
 
-				/*
-				 * We forcefully close the underlying libpq connection because
-				 * we don't want any subsequent execution (either subPlan executions
-				 * or new command executions within a transaction block) use the
-				 * connection.
-				 *
-				 * However, we prefer to keep the MultiConnection around until
-				 * the end of FinishDistributedExecution() to simplify the code.
-				 * Thus, we prefer ShutdownConnection() over CloseConnection().
-				 */
-				ShutdownConnection(connection);
+	stream->tupleStore = tupleStore;
+	stream->shardCommandExecution = shardCommandExecution;
 
-				/* remove connection from wait event set */
-				execution->connectionSetChanged = true;
+	execution->resultStreamList = lappend(execution->resultStreamList, stream);
 
-				/*
-				 * Reset the transaction state machine since CloseConnection()
-				 * relies on it and even if we're not inside a distributed transaction
-				 * we set the transaction state (e.g., REMOTE_TRANS_SENT_COMMAND).
-				 */
-				if (!connection->remoteTransaction.beginSent)
-				{
-					connection->remoteTransaction.transactionState =
-						REMOTE_TRANS_INVALID;
-				}
+	return stream;
+}
 
-				break;
-			}
 
-			default:
-			{
-				break;
-			}
+/*
+ * EndTaskResultStreams releases the tuple stores and slots of the result
+ * streams of the execution. The tuple store of the scan is released by the
+ * scan itself.
+ */
+static void
+EndTaskResultStreams(DistributedExecution *execution)
+{
+	ListCell *streamCell = NULL;
+
+	foreach(streamCell, execution->resultStreamList)
+	{
+		TaskResultStream *stream = (TaskResultStream *) lfirst(streamCell);
+
+		if (stream->tupleSlot != NULL)
+		{
+			ExecDropSingleTupleTableSlot(stream->tupleSlot);
+			stream->tupleSlot = NULL;
 		}
-	} while (connection->connectionState != currentState);
-}
 
+		if (stream->tupleStore != execution->tupleStore)
+		{
+			tuplestore_end(stream->tupleStore);
+		}
 
-/*
- * Activate2PCIfModifyingTransactionExpandsToNewNode sets the coordinated
- * transaction to use 2PC under the following circumstances:
- *     - We're already in a transaction block
- *     - At least one of the previous commands in the transaction block
- *       made a modification, which have not set 2PC itself because it
- *       was a single shard command
- *     - The input "session" is used for a distributed execution which
- *       modifies the database. However, the session (and hence the
- *       connection) is established to a different worker than the ones
- *       that is used previously in the transaction.
- *
- *  To give an example,
- *      BEGIN;
- *          -- assume that the following INSERT goes to worker-A
- *          -- also note that this single command does not activate
- *          -- 2PC itself since it is a single shard mofication
- *          INSERT INTO distributed_table (dist_key) VALUES (1);
- *
- *          -- do one more single shard UPDATE hitting the same
- *          shard (or worker node in general)
- *          -- this wouldn't activate 2PC, since we're operating on the
- *          -- same worker node that we've modified earlier
- *          -- so the executor would use the same connection
- *			UPDATE distributed_table SET value = 10 WHERE dist_key = 1;
- *
- *          -- now, do one more INSERT, which goes to worker-B
- *          -- At this point, this function would activate 2PC
- *          -- since we're now expanding to a new node
- *          -- for example, if this command were a SELECT, we wouldn't
- *          -- activate 2PC since we're only interested in modifications/DDLs
- *          INSERT INTO distributed_table (dist_key) VALUES (2);
+		if (stream->shardCommandExecution != NULL)
+		{
+			stream->shardCommandExecution->tupleStore = NULL;
+		}
+
+		stream->tupleStore = NULL;
+	}
+
+	execution->resultStreamList = NIL;
+	execution->resultMerge = NULL;
+}
+
+
+/*
+ * TaskResultStreamReady returns whether the next row of the stream can be read
+ * without running the execution, either because it arrived or because there
+ * are no more rows.
  */
-static void
-Activate2PCIfModifyingTransactionExpandsToNewNode(WorkerSession *session)
+static bool
+TaskResultStreamReady(DistributedExecution *execution, TaskResultStream *stream)
 {
-	if (MultiShardCommitProtocol != COMMIT_PROTOCOL_2PC)
-	{
-		/* we don't need 2PC, so no need to continue */
-		return;
-	}
+	return stream->readTupleCount < tuplestore_tuple_count(stream->tupleStore) ||
+		   TaskResultStreamComplete(execution, stream);
+}
 
-	DistributedExecution *execution = session->workerPool->distributedExecution;
-	if (TransactionModifiedDistributedTable(execution) &&
-		DistributedExecutionModifiesDatabase(execution) &&
-		!ConnectionModifiedPlacement(session->connection))
+
+/*
+ * TaskResultStreamComplete returns whether all rows of the stream are in its
+ * tuple store.
+ */
+static bool
+TaskResultStreamComplete(DistributedExecution *execution, TaskResultStream *stream)
+{
+	ShardCommandExecution *shardCommandExecution = stream->shardCommandExecution;
+
+	if (stream->complete || !execution->streaming ||
+		execution->unfinishedTaskCount == 0 || execution->stoppedEarly)
 	{
-		/*
-		 * We already did a modification, but not on the connection that we
-		 * just opened, which means we're now going to make modifications
-		 * over multiple connections. Activate 2PC!
-		 */
-		CoordinatedTransactionUse2PC();
+		return true;
 	}
+
+	return shardCommandExecution != NULL &&
+		   shardCommandExecution->executionState != TASK_EXECUTION_NOT_FINISHED;
 }
 
 
 /*
- * TransactionModifiedDistributedTable returns true if the current transaction already
- * executed a command which modified at least one distributed table in the current
- * transaction.
+ * FetchNextStreamTuple stores the next row of the stream in the given slot and
+ * returns true, or returns false if the stream has no more rows. During a
+ * streaming execution, the execution runs until the row arrives.
+ *
+ * We never read past the rows that are in the tuple store, since a read pointer
+ * that reached the end of a tuple store does not see the rows that are added
+ * afterwards.
  */
 static bool
-TransactionModifiedDistributedTable(DistributedExecution *execution)
+FetchNextStreamTuple(DistributedExecution *execution, TaskResultStream *stream,
+					 TupleTableSlot *slot, bool copy)
 {
+	bool forwardScanDirection = true;
+
+	if (!TaskResultStreamReady(execution, stream))
+	{
+		RunStreamingExecution(execution, stream);
+	}
+
+	if (stream->readTupleCount >= tuplestore_tuple_count(stream->tupleStore))
+	{
+		ExecClearTuple(slot);
+		return false;
+	}
+
+	tuplestore_gettupleslot(stream->tupleStore, forwardScanDirection, copy, slot);
+	stream->readTupleCount++;
+
 	/*
-	 * We need to explicitly check for isTransaction due to
-	 * citus.function_opens_transaction_block flag. When set to false, we
-	 * should not be pretending that we're in a coordinated transaction even
-	 * if XACT_MODIFICATION_DATA is set. That's why we implemented this workaround.
+	 * Free the rows that were already read, if the tuple store allows it. The
+	 * row that we just read is kept, since the slot might point into it.
 	 */
-	return execution->isTransaction && XactModificationLevel == XACT_MODIFICATION_DATA;
+	tuplestore_trim(stream->tupleStore);
+
+	return true;
 }
 
 
 /*
- * TransactionStateMachine manages the execution of tasks over a connection.
+ * CreateTaskResultMerge prepares the merge of the result streams of the
+ * execution, using the sort order in which the workers return the rows.
  */
-static void
-TransactionStateMachine(WorkerSession *session)
+static TaskResultMerge *
+CreateTaskResultMerge(DistributedExecution *execution)
 {
-	WorkerPool *workerPool = session->workerPool;
-	DistributedExecution *execution = workerPool->distributedExecution;
+	Sort *sortOrder = execution->mergeSortOrder;
+	int streamCount = list_length(execution->resultStreamList);
+	ListCell *streamCell = NULL;
+	int streamIndex = 0;
 
-	MultiConnection *connection = session->connection;
-	RemoteTransaction *transaction = &(connection->remoteTransaction);
-	RemoteTransactionState currentState;
+	TaskResultMerge *merge = (TaskResultMerge *) palloc0(sizeof(TaskResultMerge));
+	merge->streams = (TaskResultStream **) palloc0(streamCount *
+												   sizeof(TaskResultStream *));
+	merge->streamCount = streamCount;
 
-	do {
-		currentState = transaction->transactionState;
+	foreach(streamCell, execution->resultStreamList)
+	{
+		TaskResultStream *stream = (TaskResultStream *) lfirst(streamCell);
 
-		if (!CheckConnectionReady(session))
+		stream->tupleSlot = MakeSingleTupleTableSlotCompat(execution->tupleDescriptor,
+														   &TTSOpsMinimalTuple);
+		merge->streams[streamIndex++] = stream;
+	}
+
+	merge->sortKeyCount = sortOrder->numCols;
+	merge->sortKeys = (SortSupport) palloc0(sortOrder->numCols *
+											sizeof(SortSupportData));
+
+	for (int keyIndex = 0; keyIndex < sortOrder->numCols; keyIndex++)
+	{
+		SortSupport sortKey = &merge->sortKeys[keyIndex];
+
+		sortKey->ssup_cxt = CurrentMemoryContext;
+		sortKey->ssup_collation = sortOrder->collations[keyIndex];
+		sortKey->ssup_nulls_first = sortOrder->nullsFirst[keyIndex];
+		sortKey->ssup_attno = sortOrder->sortColIdx[keyIndex];
+		sortKey->abbreviate = false;
+
+		PrepareSortSupportFromOrderingOp(sortOrder->sortOperators[keyIndex], sortKey);
+	}
+
+	merge->heap = binaryheap_allocate(Max(streamCount, 1), CompareTaskResultStreams,
+									  merge);
+
+	return merge;
+}
+
+
+/*
+ * CompareTaskResultStreams compares the current rows of two result streams,
+ * given by their index. The result is inverted, since binaryheap is a heap
+ * with the largest element first and we want the smallest row first.
+ */
+static int
+CompareTaskResultStreams(Datum a, Datum b, void *arg)
+{
+	TaskResultMerge *merge = (TaskResultMerge *) arg;
+	TupleTableSlot *leftSlot = merge->streams[DatumGetInt32(a)]->tupleSlot;
+	TupleTableSlot *rightSlot = merge->streams[DatumGetInt32(b)]->tupleSlot;
+
+	for (int keyIndex = 0; keyIndex < merge->sortKeyCount; keyIndex++)
+	{
+		SortSupport sortKey = &merge->sortKeys[keyIndex];
+		AttrNumber attno = sortKey->ssup_attno;
+		bool leftIsNull = false;
+		bool rightIsNull = false;
+
+		Datum leftDatum = slot_getattr(leftSlot, attno, &leftIsNull);
+		Datum rightDatum = slot_getattr(rightSlot, attno, &rightIsNull);
+
+		int compare = ApplySortComparator(leftDatum, leftIsNull, rightDatum,
+										  rightIsNull, sortKey);
+		if (compare != 0)
 		{
-			/* connection is busy, no state transitions to make */
-			break;
+			INVERT_COMPARE_RESULT(compare);
+			return compare;
 		}
+	}
 
-		switch (currentState)
+	return 0;
+}
+
+
+/*
+ * NextMergedTuple returns a slot with the next row of the k-way merge of the
+ * sorted result streams, or NULL if all rows were returned.
+ */
+static TupleTableSlot *
+NextMergedTuple(DistributedExecution *execution)
+{
+	TaskResultMerge *merge = execution->resultMerge;
+
+	/* the rows stay in the slots of the streams while other streams are read */
+	bool copy = true;
+
+	if (merge == NULL)
+	{
+		merge = execution->resultMerge = CreateTaskResultMerge(execution);
+	}
+
+	if (!merge->initialized)
+	{
+		for (int streamIndex = 0; streamIndex < merge->streamCount; streamIndex++)
 		{
-			case REMOTE_TRANS_INVALID:
+			TaskResultStream *stream = merge->streams[streamIndex];
+
+			if (FetchNextStreamTuple(execution, stream, stream->tupleSlot, copy))
 			{
-				if (execution->isTransaction)
-				{
-					/* if we're expanding the nodes in a transaction, use 2PC */
-					Activate2PCIfModifyingTransactionExpandsToNewNode(session);
+				binaryheap_add_unordered(merge->heap, Int32GetDatum(streamIndex));
+			}
+		}
 
-					/* need to open a transaction block first */
-					StartRemoteTransactionBegin(connection);
+		binaryheap_build(merge->heap);
+		merge->initialized = true;
+	}
+	else if (!binaryheap_empty(merge->heap))
+	{
+		/* advance the stream of the row that was returned last */
+		int streamIndex = DatumGetInt32(binaryheap_first(merge->heap));
+		TaskResultStream *stream = merge->streams[streamIndex];
 
-					transaction->transactionState = REMOTE_TRANS_CLEARING_RESULTS;
-				}
-				else
-				{
-					TaskPlacementExecution *placementExecution = PopPlacementExecution(
-						session);
-					if (placementExecution == NULL)
-					{
-						/*
-						 * No tasks are ready to be executed at the moment. But we
-						 * still mark the socket readable to get any notices if exists.
-						 */
-						UpdateConnectionWaitFlags(session, WL_SOCKET_READABLE);
+		if (FetchNextStreamTuple(execution, stream, stream->tupleSlot, copy))
+		{
+			binaryheap_replace_first(merge->heap, Int32GetDatum(streamIndex));
+		}
+		else
+		{
+			binaryheap_remove_first(merge->heap);
+		}
+	}
 
-						break;
-					}
+	if (binaryheap_empty(merge->heap))
+	{
+		return NULL;
+	}
 
-					bool placementExecutionStarted =
-						StartPlacementExecutionOnSession(placementExecution, session);
-					if (!placementExecutionStarted)
-					{
-						/* no need to continue, connection is lost */
-						Assert(session->connection->connectionState ==
-							   MULTI_CONNECTION_LOST);
+	int streamIndex = DatumGetInt32(binaryheap_first(merge->heap));
 
-						return;
-					}
+	return merge->streams[streamIndex]->tupleSlot;
+}
 
-					transaction->transactionState = REMOTE_TRANS_SENT_COMMAND;
-				}
 
-				UpdateConnectionWaitFlags(session,
-										  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
-				break;
-			}
+/*
+ * MergeTaskResultsIntoTupleStore merges the rows of the tasks of an execution
+ * that ran to completion into the tuple store of the scan, for scans that may
+ * need to read the rows more than once.
+ */
+static void
+MergeTaskResultsIntoTupleStore(DistributedExecution *execution)
+{
+	TupleTableSlot *mergedSlot = NULL;
 
-			case REMOTE_TRANS_SENT_BEGIN:
-			case REMOTE_TRANS_CLEARING_RESULTS:
-			{
-				PGresult *result = PQgetResult(connection->pgConn);
-				if (result != NULL)
-				{
-					if (!IsResponseOK(result))
-					{
-						/* query failures are always hard errors */
-						ReportResultError(connection, result, ERROR);
-					}
+	while ((mergedSlot = NextMergedTuple(execution)) != NULL)
+	{
+		tuplestore_puttupleslot(execution->tupleStore, mergedSlot);
+	}
+
+	EndTaskResultStreams(execution);
+}
+
+
+/*
+ * ManageWorkerPool ensures the worker pool has the appropriate number of connections
+ * based on the number of pending tasks.
+ */
+static void
+ManageWorkerPool(WorkerPool *workerPool)
+{
+	DistributedExecution *execution = workerPool->distributedExecution;
+	int targetPoolSize = execution->targetPoolSize;
+	int initiatedConnectionCount = list_length(workerPool->sessionList);
+	int activeConnectionCount PG_USED_FOR_ASSERTS_ONLY =
+		workerPool->activeConnectionCount;
+	int idleConnectionCount PG_USED_FOR_ASSERTS_ONLY =
+		workerPool->idleConnectionCount;
+	int failedConnectionCount = workerPool->failedConnectionCount;
+	int readyTaskCount = workerPool->readyTaskCount;
+	int newConnectionCount = 0;
+
+	/* we should always have more (or equal) active connections than idle connections */
+	Assert(activeConnectionCount >= idleConnectionCount);
+
+	/* we should always have more (or equal) initiated connections than active connections */
+	Assert(initiatedConnectionCount >= activeConnectionCount);
+
+	/* we should never have less than 0 connections ever */
+	Assert(activeConnectionCount >= 0 && idleConnectionCount >= 0);
+
+	if (workerPool->failed)
+	{
+		/* connection pool failed */
+		return;
+	}
+
+	/* we might fail the execution or warn the user about connection timeouts */
+	if (workerPool->checkForPoolTimeout)
+	{
+		CheckConnectionTimeout(workerPool);
+	}
+
+	if (failedConnectionCount >= 1)
+	{
+		/* do not attempt to open more connections after one failed */
+		return;
+	}
+
+	if (workerPool->reachedSharedPoolLimit)
+	{
+		/* other backends use all the connections the worker may get */
+		return;
+	}
+
+	if (UseConnectionPerPlacement())
+	{
+		int unusedConnectionCount = workerPool->unusedConnectionCount;
+
+		/*
+		 * If force_max_query_parallelization is enabled then we ignore pool size
+		 * and idle connections. Instead, we open new connections as long as there
+		 * are more tasks than unused connections.
+		 */
+
+		newConnectionCount = Max(readyTaskCount - unusedConnectionCount, 0);
+	}
+	else
+	{
+		/* cannot open more than targetPoolSize connections */
+		int maxNewConnectionCount = targetPoolSize - initiatedConnectionCount;
+
+		/* total number of connections that are (almost) available for tasks */
+		int usableConnectionCount = UsableConnectionCount(workerPool);
+
+		/*
+		 * Number of additional connections we would need to run all ready tasks in
+		 * parallel.
+		 */
+		int newConnectionsForReadyTasks = readyTaskCount - usableConnectionCount;
+
+		/*
+		 * Open enough connections to handle all tasks that are ready, but no more
+		 * than the target pool size.
+		 */
+		newConnectionCount = Min(newConnectionsForReadyTasks, maxNewConnectionCount);
+
+		if (newConnectionCount > 0 && EnableAdaptiveSlowStart &&
+			usableConnectionCount > 0 &&
+			workerPool->latencyStats->taskCount > 0 &&
+			workerPool->latencyStats->connectCount > 0)
+		{
+			/* open as many connections as the observed latencies justify, at once */
+			newConnectionCount = Min(newConnectionCount,
+									 WorthwhileNewConnectionCount(workerPool,
+																  usableConnectionCount));
+		}
+		else if (newConnectionCount > 0 && ExecutorSlowStartInterval > 0)
+		{
+			TimestampTz now = GetCurrentTimestamp();
+
+			if (TimestampDifferenceExceeds(workerPool->lastConnectionOpenTime, now,
+										   ExecutorSlowStartInterval))
+			{
+				newConnectionCount = Min(newConnectionCount,
+										 workerPool->maxNewConnectionsPerCycle);
+
+				/* increase the open rate every cycle (like TCP slow start) */
+				workerPool->maxNewConnectionsPerCycle += 1;
+			}
+			else
+			{
+				/* wait a bit until opening more connections */
+				return;
+			}
+		}
+	}
+
+	if (newConnectionCount <= 0)
+	{
+		return;
+	}
+
+	ereport(DEBUG4, (errmsg("opening %d new connections to %s:%d", newConnectionCount,
+							workerPool->nodeName, workerPool->nodePort)));
+
+	int openedConnectionCount = 0;
+
+	for (int connectionIndex = 0; connectionIndex < newConnectionCount; connectionIndex++)
+	{
+		/* experimental: just to see the perf benefits of caching connections */
+		int connectionFlags = 0;
+
+		/*
+		 * The execution can finish over a single connection per worker, so
+		 * additional connections are optional unless the user explicitly asked
+		 * for a connection per placement.
+		 */
+		if (list_length(workerPool->sessionList) > 0 && !UseConnectionPerPlacement())
+		{
+			connectionFlags |= OPTIONAL_CONNECTION;
+		}
+
+		/* open a new connection to the worker */
+		MultiConnection *connection = StartNodeUserDatabaseConnection(connectionFlags,
+																	  workerPool->nodeName,
+																	  workerPool->nodePort,
+																	  NULL, NULL);
+		if (connection == NULL)
+		{
+			/* worker reached citus.max_shared_pool_size, use the existing sessions */
+			ereport(DEBUG4, (errmsg("%s:%d reached the shared pool limit, continuing "
+									"with %d connections", workerPool->nodeName,
+									workerPool->nodePort,
+									list_length(workerPool->sessionList))));
+
+			workerPool->reachedSharedPoolLimit = true;
+			break;
+		}
+
+		openedConnectionCount++;
+
+		/*
+		 * Assign the initial state in the connection state machine. The connection
+		 * may already be open, but ConnectionStateMachine will immediately detect
+		 * this.
+		 */
+		connection->connectionState = MULTI_CONNECTION_CONNECTING;
+
+		/*
+		 * Ensure that subsequent calls to StartNodeUserDatabaseConnection get a
+		 * different connection.
+		 */
+		connection->claimedExclusively = true;
+
+		/* create a session for the connection */
+		WorkerSession *session = FindOrCreateWorkerSession(workerPool, connection);
+
+		/* always poll the connection in the first round */
+		UpdateConnectionWaitFlags(session, WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+	}
+
+	if (openedConnectionCount == 0)
+	{
+		return;
+	}
+
+	/* the sessions are added to the wait event set by UpdateWaitEventSet */
+	workerPool->lastConnectionOpenTime = GetCurrentTimestamp();
+}
+
+
+/*
+ * WorthwhileNewConnectionCount estimates how many connections to open to the
+ * worker of the pool in addition to the usable ones, based on the average
+ * duration of a task and of establishing a connection to the worker.
+ *
+ * While a new connection is being established, the usable connections keep
+ * executing the ready tasks. A new connection is only worth opening if some
+ * tasks remain by the time it is established, and if its share of those
+ * tasks takes longer than establishing it. Hence, short tasks are executed
+ * over the usable connections, while for long tasks we open a connection for
+ * every ready task right away.
+ */
+static int
+WorthwhileNewConnectionCount(WorkerPool *workerPool, int usableConnectionCount)
+{
+	WorkerLatencyStats *latencyStats = workerPool->latencyStats;
+	double taskDuration = Max(latencyStats->taskDuration, 0.001);
+	double connectTime = Max(latencyStats->connectTime, 0.001);
+
+	double tasksDoneWhileConnecting = usableConnectionCount * connectTime / taskDuration;
+	double remainingTaskCount = workerPool->readyTaskCount - tasksDoneWhileConnecting;
+	if (remainingTaskCount <= 0)
+	{
+		return 0;
+	}
+
+	/* each connection should get at least one task */
+	double connectionsForTasks = ceil(remainingTaskCount);
+
+	/* each connection should spend more time on tasks than on connecting */
+	double connectionsForWork = floor(remainingTaskCount * taskDuration / connectTime);
+
+	double worthwhileConnectionCount = Min(connectionsForTasks, connectionsForWork);
+	if (worthwhileConnectionCount <= usableConnectionCount)
+	{
+		return 0;
+	}
+
+	/* bounded by the number of ready tasks */
+	return (int) worthwhileConnectionCount - usableConnectionCount;
+}
+
+
+/*
+ * CheckConnectionTimeout makes sure that the execution enforces the connection
+ * establishment timeout defined by the user (NodeConnectionTimeout).
+ *
+ * The rule is that if a worker pool has already initiated connection establishment
+ * and has not succeeded to finish establishments that are necessary to execute tasks,
+ * take an action. For the types of actions, see the comments in the function.
+ *
+ * Enforcing the timeout per pool (over per session) helps the execution to continue
+ * even if we can establish a single connection as we expect to have target pool size
+ * number of connections. In the end, the executor is capable of using one connection
+ * to execute multiple tasks.
+ */
+static void
+CheckConnectionTimeout(WorkerPool *workerPool)
+{
+	DistributedExecution *execution = workerPool->distributedExecution;
+	TimestampTz poolStartTime = workerPool->poolStartTime;
+	TimestampTz now = GetCurrentTimestamp();
+
+	int initiatedConnectionCount = list_length(workerPool->sessionList);
+	int activeConnectionCount = workerPool->activeConnectionCount;
+	int requiredActiveConnectionCount = 1;
+
+	if (initiatedConnectionCount == 0)
+	{
+		/* no connection has been planned for the pool yet */
+		Assert(poolStartTime == 0);
+		return;
+	}
+
+	/*
+	 * This is a special case where we assign tasks to sessions even before
+	 * the connections are established. So, make sure to apply similar
+	 * restrictions. In this case, make sure that we get all the connections
+	 * established.
+	 */
+	if (UseConnectionPerPlacement())
+	{
+		requiredActiveConnectionCount = initiatedConnectionCount;
+	}
+
+	if (TimestampDifferenceExceeds(poolStartTime, now, NodeConnectionTimeout))
+	{
+		if (activeConnectionCount < requiredActiveConnectionCount)
+		{
+			int logLevel = WARNING;
+			ListCell *sessionCell = NULL;
+
+			foreach(sessionCell, workerPool->sessionList)
+			{
+				WorkerSession *session = (WorkerSession *) lfirst(sessionCell);
+				MultiConnection *connection = session->connection;
+
+				if (connection->connectionState == MULTI_CONNECTION_CONNECTING)
+				{
+					RecordConnectionEstablishmentResult(connection,
+														CONNECTION_ATTEMPT_TIMED_OUT);
+				}
+			}
+
+			/*
+			 * First fail the pool and create an opportunity to execute tasks
+			 * over other pools when tasks have more than one placement to execute.
+			 */
+			WorkerPoolFailed(workerPool);
+
+			/*
+			 * The enforcement is not always erroring out. For example, if a SELECT task
+			 * has two different placements, we'd warn the user, fail the pool and continue
+			 * with the next placement.
+			 */
+			if (execution->errorOnAnyFailure || execution->failed)
+			{
+				logLevel = ERROR;
+			}
+
+			ereport(logLevel, (errcode(ERRCODE_CONNECTION_FAILURE),
+							   errmsg("could not establish any connections to the node "
+									  "%s:%d after %u ms", workerPool->nodeName,
+									  workerPool->nodePort,
+									  NodeConnectionTimeout)));
+		}
+		else
+		{
+			/* stop interrupting WaitEventSetWait for timeouts */
+			workerPool->checkForPoolTimeout = false;
+		}
+	}
+}
+
+
+/*
+ * UsableConnectionCount returns the number of connections in the worker pool
+ * that are (soon to be) usable for sending commands, this includes both idle
+ * connections and connections that are still establishing.
+ */
+static int
+UsableConnectionCount(WorkerPool *workerPool)
+{
+	int initiatedConnectionCount = list_length(workerPool->sessionList);
+	int activeConnectionCount = workerPool->activeConnectionCount;
+	int failedConnectionCount = workerPool->failedConnectionCount;
+	int idleConnectionCount = workerPool->idleConnectionCount;
+
+	/* connections that are still establishing will soon be available for tasks */
+	int establishingConnectionCount =
+		initiatedConnectionCount - activeConnectionCount - failedConnectionCount;
+
+	int usableConnectionCount = idleConnectionCount + establishingConnectionCount;
+
+	return usableConnectionCount;
+}
+
+
+/*
+ * NextEventTimeout finds the earliest time at which we need to interrupt
+ * WaitEventSetWait because of a timeout and returns the number of milliseconds
+ * until that event with a minimum of 1ms and a maximum of 1000ms.
+ *
+ * This code may be sensitive to clock jumps, but only has the effect of waking
+ * up WaitEventSetWait slightly earlier to later.
+ */
+static long
+NextEventTimeout(DistributedExecution *execution)
+{
+	ListCell *workerCell = NULL;
+	TimestampTz now = GetCurrentTimestamp();
+	long eventTimeout = 1000; /* milliseconds */
+
+	foreach(workerCell, execution->workerList)
+	{
+		WorkerPool *workerPool = (WorkerPool *) lfirst(workerCell);
+
+		if (workerPool->failed)
+		{
+			/* worker pool may have already timed out */
+			continue;
+		}
+
+		if (workerPool->poolStartTime != 0 && workerPool->checkForPoolTimeout)
+		{
+			long timeSincePoolStartMs =
+				MillisecondsBetweenTimestamps(workerPool->poolStartTime, now);
+
+			/*
+			 * This could go into the negative if the connection timeout just passed.
+			 * In that case we want to wake up as soon as possible. Once the timeout
+			 * has been processed, checkForPoolTimeout will be false so we will skip
+			 * this check.
+			 */
+			long timeUntilConnectionTimeoutMs =
+				NodeConnectionTimeout - timeSincePoolStartMs;
+
+			if (timeUntilConnectionTimeoutMs < eventTimeout)
+			{
+				eventTimeout = timeUntilConnectionTimeoutMs;
+			}
+		}
+
+		int initiatedConnectionCount = list_length(workerPool->sessionList);
+
+		/*
+		 * If there are connections to open we wait at most up to the end of the
+		 * current slow start interval.
+		 */
+		if (workerPool->readyTaskCount > UsableConnectionCount(workerPool) &&
+			initiatedConnectionCount < execution->targetPoolSize &&
+			!workerPool->reachedSharedPoolLimit)
+		{
+			long timeSinceLastConnectMs =
+				MillisecondsBetweenTimestamps(workerPool->lastConnectionOpenTime, now);
+			long timeUntilSlowStartInterval =
+				ExecutorSlowStartInterval - timeSinceLastConnectMs;
+
+			if (timeUntilSlowStartInterval < eventTimeout)
+			{
+				eventTimeout = timeUntilSlowStartInterval;
+			}
+		}
+	}
+
+	if (execution->hedgeReads)
+	{
+		ListCell *sessionCell = NULL;
+
+		/* wake up when the next running task should be hedged */
+		foreach(sessionCell, execution->sessionList)
+		{
+			WorkerSession *session = (WorkerSession *) lfirst(sessionCell);
+
+			if (session->currentTask == NULL)
+			{
+				continue;
+			}
+
+			long hedgeTimeout = HedgeTimeout(session->currentTask, now);
+			if (hedgeTimeout >= 0 && hedgeTimeout < eventTimeout)
+			{
+				eventTimeout = hedgeTimeout;
+			}
+		}
+	}
+
+	return Max(1, eventTimeout);
+}
+
+
+/*
+ * ShouldHedgeReads returns whether slow read-only tasks of the execution may
+ * be started on another placement as well. Hedging is limited to executions
+ * outside of distributed transactions, since cancelling the command that lost
+ * the race would otherwise abort the remote transaction, and to executions
+ * that do not stream their rows, since those pass on rows as they arrive.
+ */
+static bool
+ShouldHedgeReads(DistributedExecution *execution)
+{
+	return EnableHedgedReads && execution->modLevel == ROW_MODIFY_READONLY &&
+		   !execution->isTransaction && !execution->streaming;
+}
+
+
+/*
+ * StartHedgedPlacementExecutions starts the tasks that have been running for
+ * longer than the estimated 95th percentile of the task durations on their
+ * worker on the next placement as well.
+ */
+static void
+StartHedgedPlacementExecutions(DistributedExecution *execution)
+{
+	ListCell *sessionCell = NULL;
+	TimestampTz now = GetCurrentTimestamp();
+
+	foreach(sessionCell, execution->sessionList)
+	{
+		WorkerSession *session = (WorkerSession *) lfirst(sessionCell);
+		TaskPlacementExecution *placementExecution = session->currentTask;
+
+		if (placementExecution == NULL || HedgeTimeout(placementExecution, now) != 0)
+		{
+			continue;
+		}
+
+		ShardCommandExecution *shardCommandExecution =
+			placementExecution->shardCommandExecution;
+		TaskPlacementExecution *hedgedPlacementExecution =
+			NextIdlePlacementExecution(shardCommandExecution);
+
+		ereport(DEBUG4, (errmsg("task %u is slow on %s:%d, also starting it on %s:%d",
+								shardCommandExecution->task->taskId,
+								session->workerPool->nodeName,
+								session->workerPool->nodePort,
+								hedgedPlacementExecution->workerPool->nodeName,
+								hedgedPlacementExecution->workerPool->nodePort)));
+
+		shardCommandExecution->hedged = true;
+		execution->hedgedTaskCount++;
+
+		PlacementExecutionReady(hedgedPlacementExecution);
+	}
+}
+
+
+/*
+ * HedgeTimeout returns the number of milliseconds after which the given
+ * running placement execution should be hedged, 0 if it should be hedged
+ * now, or -1 if it should not be hedged at all.
+ */
+static long
+HedgeTimeout(TaskPlacementExecution *placementExecution, TimestampTz now)
+{
+	ShardCommandExecution *shardCommandExecution =
+		placementExecution->shardCommandExecution;
+
+	if (placementExecution->executionState != PLACEMENT_EXECUTION_RUNNING ||
+		placementExecution->startTime == 0 ||
+		shardCommandExecution->executionOrder != EXECUTION_ORDER_ANY ||
+		shardCommandExecution->executionState != TASK_EXECUTION_NOT_FINISHED ||
+		shardCommandExecution->hedged ||
+		shardCommandExecution->resultPlacementExecution != NULL)
+	{
+		return -1;
+	}
+
+	if (NextIdlePlacementExecution(shardCommandExecution) == NULL)
+	{
+		/* no other placement to start the task on */
+		return -1;
+	}
+
+	double taskDurationP95 =
+		EstimateWorkerTaskDurationP95(placementExecution->workerPool->latencyStats);
+	if (taskDurationP95 < 0)
+	{
+		return -1;
+	}
+
+	long runningTime = MillisecondsBetweenTimestamps(placementExecution->startTime,
+													 now);
+
+	return Max(0, (long) ceil(taskDurationP95) - runningTime);
+}
+
+
+/*
+ * NextIdlePlacementExecution returns the first placement execution of the
+ * task that was not started and is not ready to start, or NULL if there is
+ * none.
+ */
+static TaskPlacementExecution *
+NextIdlePlacementExecution(ShardCommandExecution *shardCommandExecution)
+{
+	int placementExecutionCount = shardCommandExecution->placementExecutionCount;
+
+	for (int placementExecutionIndex = 0;
+		 placementExecutionIndex < placementExecutionCount;
+		 placementExecutionIndex++)
+	{
+		TaskPlacementExecution *placementExecution =
+			shardCommandExecution->placementExecutions[placementExecutionIndex];
+
+		if (placementExecution->executionState == PLACEMENT_EXECUTION_NOT_READY)
+		{
+			return placementExecution;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * MillisecondsBetweenTimestamps is a helper to get the number of milliseconds
+ * between timestamps when it is expected to be small enough to fit in a
+ * long.
+ */
+static long
+MillisecondsBetweenTimestamps(TimestampTz startTime, TimestampTz endTime)
+{
+	long secs = 0;
+	int micros = 0;
+
+	TimestampDifference(startTime, endTime, &secs, &micros);
+
+	return secs * 1000 + micros / 1000;
+}
+
+
+/*
+ * ConnectionStateMachine opens a connection and descends into the transaction
+ * state machine when ready.
+ */
+static void
+ConnectionStateMachine(WorkerSession *session)
+{
+	WorkerPool *workerPool = session->workerPool;
+	DistributedExecution *execution = workerPool->distributedExecution;
+
+	MultiConnection *connection = session->connection;
+	MultiConnectionState currentState;
+
+	do {
+		currentState = connection->connectionState;
+
+		switch (currentState)
+		{
+			case MULTI_CONNECTION_INITIAL:
+			{
+				/* simply iterate the state machine */
+				connection->connectionState = MULTI_CONNECTION_CONNECTING;
+				break;
+			}
+
+			case MULTI_CONNECTION_CONNECTING:
+			{
+				ConnStatusType status = PQstatus(connection->pgConn);
+				if (status == CONNECTION_OK)
+				{
+					ereport(DEBUG4, (errmsg("established connection to %s:%d for "
+											"session %ld",
+											connection->hostname, connection->port,
+											session->sessionId)));
+
+					workerPool->activeConnectionCount++;
+					workerPool->idleConnectionCount++;
+
+					if (execution->taskInstrumentationList != NULL)
+					{
+						session->connectTime =
+							MillisecondsBetweenTimestamps(connection->connectionStart,
+														  GetCurrentTimestamp());
+					}
+
+					UpdateConnectionWaitFlags(session,
+											  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+
+					if (EnableAdaptiveSlowStart &&
+						!connection->establishmentResultRecorded)
+					{
+						/* connection was established for this execution */
+						RecordWorkerConnectTime(workerPool->latencyStats,
+												connection->connectionStart);
+					}
+
+					RecordConnectionEstablishmentResult(connection,
+														CONNECTION_ATTEMPT_SUCCEEDED);
+
+					connection->connectionState = MULTI_CONNECTION_CONNECTED;
+					break;
+				}
+				else if (status == CONNECTION_BAD)
+				{
+					RecordConnectionEstablishmentResult(connection,
+														CONNECTION_ATTEMPT_FAILED);
+
+					connection->connectionState = MULTI_CONNECTION_FAILED;
+					break;
+				}
+
+				PostgresPollingStatusType pollMode = PQconnectPoll(connection->pgConn);
+				if (pollMode == PGRES_POLLING_FAILED)
+				{
+					RecordConnectionEstablishmentResult(connection,
+														CONNECTION_ATTEMPT_FAILED);
+
+					connection->connectionState = MULTI_CONNECTION_FAILED;
+				}
+				else if (pollMode == PGRES_POLLING_READING)
+				{
+					UpdateConnectionWaitFlags(session, WL_SOCKET_READABLE);
+				}
+				else if (pollMode == PGRES_POLLING_WRITING)
+				{
+					UpdateConnectionWaitFlags(session, WL_SOCKET_WRITEABLE);
+				}
+				else
+				{
+					ereport(DEBUG4, (errmsg("established connection to %s:%d for "
+											"session %ld",
+											connection->hostname, connection->port,
+											session->sessionId)));
+
+					workerPool->activeConnectionCount++;
+					workerPool->idleConnectionCount++;
+
+					if (execution->taskInstrumentationList != NULL)
+					{
+						session->connectTime =
+							MillisecondsBetweenTimestamps(connection->connectionStart,
+														  GetCurrentTimestamp());
+					}
+
+					UpdateConnectionWaitFlags(session,
+											  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+
+					if (EnableAdaptiveSlowStart &&
+						!connection->establishmentResultRecorded)
+					{
+						/* connection was established for this execution */
+						RecordWorkerConnectTime(workerPool->latencyStats,
+												connection->connectionStart);
+					}
+
+					RecordConnectionEstablishmentResult(connection,
+														CONNECTION_ATTEMPT_SUCCEEDED);
+
+					connection->connectionState = MULTI_CONNECTION_CONNECTED;
+				}
+
+				break;
+			}
+
+			case MULTI_CONNECTION_CONNECTED:
+			{
+				/* connection is ready, run the transaction state machine */
+				TransactionStateMachine(session);
+				break;
+			}
+
+			case MULTI_CONNECTION_LOST:
+			{
+				/* managed to connect, but connection was lost */
+				workerPool->activeConnectionCount--;
+
+				if (session->currentTask == NULL)
+				{
+					/* this was an idle connection */
+					workerPool->idleConnectionCount--;
+				}
+
+				connection->connectionState = MULTI_CONNECTION_FAILED;
+				break;
+			}
+
+			case MULTI_CONNECTION_FAILED:
+			{
+				/* connection failed or was lost */
+				int totalConnectionCount = list_length(workerPool->sessionList);
+
+				workerPool->failedConnectionCount++;
+
+				/* if the connection executed a critical command it should fail */
+				MarkRemoteTransactionFailed(connection, false);
+
+				/* mark all assigned placement executions as failed */
+				WorkerSessionFailed(session);
+
+				if (workerPool->failedConnectionCount >= totalConnectionCount)
+				{
+					/*
+					 * All current connection attempts have failed.
+					 * Mark all unassigned placement executions as failed.
+					 *
+					 * We do not currently retry if the first connection
+					 * attempt fails.
+					 */
+					WorkerPoolFailed(workerPool);
+				}
+
+				/*
+				 * The execution may have failed as a result of WorkerSessionFailed
+				 * or WorkerPoolFailed.
+				 */
+				if (execution->failed || execution->errorOnAnyFailure)
+				{
+					/* a task has failed due to this connection failure */
+					ReportConnectionError(connection, ERROR);
+				}
+				else
+				{
+					/* can continue with the remaining nodes */
+					ReportConnectionError(connection, WARNING);
+				}
+
+				/* remove the connection */
+				UnclaimConnection(connection);
+
+				/*
+				 * We forcefully close the underlying libpq connection because
+				 * we don't want any subsequent execution (either subPlan executions
+				 * or new command executions within a transaction block) use the
+				 * connection.
+				 *
+				 * However, we prefer to keep the MultiConnection around until
+				 * the end of FinishDistributedExecution() to simplify the code.
+				 * Thus, we prefer ShutdownConnection() over CloseConnection().
+				 */
+				ShutdownConnection(connection);
+
+				/* remove connection from wait event set */
+				execution->connectionSetChanged = true;
+
+				/*
+				 * Reset the transaction state machine since CloseConnection()
+				 * relies on it and even if we're not inside a distributed transaction
+				 * we set the transaction state (e.g., REMOTE_TRANS_SENT_COMMAND).
+				 */
+				if (!connection->remoteTransaction.beginSent)
+				{
+					connection->remoteTransaction.transactionState =
+						REMOTE_TRANS_INVALID;
+				}
+
+				break;
+			}
+
+			default:
+			{
+				break;
+			}
+		}
+	} while (connection->connectionState != currentState);
+}
+
+
+/*
+ * Activate2PCIfModifyingTransactionExpandsToNewNode sets the coordinated
+ * transaction to use 2PC under the following circumstances:
+ *     - We're already in a transaction block
+ *     - At least one of the previous commands in the transaction block
+ *       made a modification, which have not set 2PC itself because it
+ *       was a single shard command
+ *     - The input "session" is used for a distributed execution which
+ *       modifies the database. However, the session (and hence the
+ *       connection) is established to a different worker than the ones
+ *       that is used previously in the transaction.
+ *
+ *  To give an example,
+ *      BEGIN;
+ *          -- assume that the following INSERT goes to worker-A
+ *          -- also note that this single command does not activate
+ *          -- 2PC itself since it is a single shard mofication
+ *          INSERT INTO distributed_table (dist_key) VALUES (1);
+ *
+ *          -- do one more single shard UPDATE hitting the same
+ *          shard (or worker node in general)
+ *          -- this wouldn't activate 2PC, since we're operating on the
+ *          -- same worker node that we've modified earlier
+ *          -- so the executor would use the same connection
+ *			UPDATE distributed_table SET value = 10 WHERE dist_key = 1;
+ *
+ *          -- now, do one more INSERT, which goes to worker-B
+ *          -- At this point, this function would activate 2PC
+ *          -- since we're now expanding to a new node
+ *          -- for example, if this command were a SELECT, we wouldn't
+ *          -- activate 2PC since we're only interested in modifications/DDLs
+ *          INSERT INTO distributed_table (dist_key) VALUES (2);
+ *
+ * Modifying the same worker over a second connection also requires 2PC, since
+ * committing two connections one after the other is not atomic. To avoid that,
+ * writes to a worker are sent over the connection that already modified the
+ * worker in the transaction whenever possible (see FindAvailableConnection()
+ * and AssignTasksToConnections()), such that transactions that only modify a
+ * single worker can commit with a single COMMIT.
+ */
+static void
+Activate2PCIfModifyingTransactionExpandsToNewNode(WorkerSession *session)
+{
+	if (MultiShardCommitProtocol != COMMIT_PROTOCOL_2PC)
+	{
+		/* we don't need 2PC, so no need to continue */
+		return;
+	}
+
+	DistributedExecution *execution = session->workerPool->distributedExecution;
+	if (TransactionModifiedDistributedTable(execution) &&
+		DistributedExecutionModifiesDatabase(execution) &&
+		!ConnectionModifiedPlacement(session->connection))
+	{
+		/*
+		 * We already did a modification, but not on the connection that we
+		 * just opened, which means we're now going to make modifications
+		 * over multiple connections. Activate 2PC!
+		 */
+		CoordinatedTransactionUse2PC();
+	}
+}
+
+
+/*
+ * TransactionModifiedDistributedTable returns true if the current transaction already
+ * executed a command which modified at least one distributed table in the current
+ * transaction.
+ */
+static bool
+TransactionModifiedDistributedTable(DistributedExecution *execution)
+{
+	/*
+	 * We need to explicitly check for isTransaction due to
+	 * citus.function_opens_transaction_block flag. When set to false, we
+	 * should not be pretending that we're in a coordinated transaction even
+	 * if XACT_MODIFICATION_DATA is set. That's why we implemented this workaround.
+	 */
+	return execution->isTransaction && XactModificationLevel == XACT_MODIFICATION_DATA;
+}
+
+
+/*
+ * TransactionStateMachine manages the execution of tasks over a connection.
+ */
+static void
+TransactionStateMachine(WorkerSession *session)
+{
+	WorkerPool *workerPool = session->workerPool;
+	DistributedExecution *execution = workerPool->distributedExecution;
+
+	MultiConnection *connection = session->connection;
+	RemoteTransaction *transaction = &(connection->remoteTransaction);
+	RemoteTransactionState currentState;
+
+	do {
+		currentState = transaction->transactionState;
+
+		if (!CheckConnectionReady(session))
+		{
+			/* connection is busy, no state transitions to make */
+			break;
+		}
+
+		switch (currentState)
+		{
+			case REMOTE_TRANS_INVALID:
+			{
+				if (execution->isTransaction)
+				{
+					/* if we're expanding the nodes in a transaction, use 2PC */
+					Activate2PCIfModifyingTransactionExpandsToNewNode(session);
+
+					TaskPlacementExecution *placementExecution = NULL;
+					if (CanSendBeginWithTask(execution))
+					{
+						placementExecution = PopPlacementExecution(session);
+					}
+
+					if (placementExecution != NULL)
+					{
+						/* open the transaction block in the same command as the task */
+						bool placementExecutionStarted =
+							StartPlacementExecutionOnSession(placementExecution, session);
+						if (!placementExecutionStarted)
+						{
+							/* no need to continue, connection is lost */
+							Assert(session->connection->connectionState ==
+								   MULTI_CONNECTION_LOST);
+
+							return;
+						}
+
+						transaction->transactionState = REMOTE_TRANS_SENT_COMMAND;
+					}
+					else
+					{
+						/* need to open a transaction block first */
+						StartRemoteTransactionBegin(connection);
+
+						transaction->transactionState = REMOTE_TRANS_CLEARING_RESULTS;
+					}
+				}
+				else
+				{
+					TaskPlacementExecution *placementExecution = PopPlacementExecution(
+						session);
+					if (placementExecution == NULL)
+					{
+						/*
+						 * No tasks are ready to be executed at the moment. But we
+						 * still mark the socket readable to get any notices if exists.
+						 */
+						UpdateConnectionWaitFlags(session, WL_SOCKET_READABLE);
+
+						break;
+					}
+
+					bool placementExecutionStarted =
+						StartPlacementExecutionOnSession(placementExecution, session);
+					if (!placementExecutionStarted)
+					{
+						/* no need to continue, connection is lost */
+						Assert(session->connection->connectionState ==
+							   MULTI_CONNECTION_LOST);
+
+						return;
+					}
+
+					transaction->transactionState = REMOTE_TRANS_SENT_COMMAND;
+				}
+
+				UpdateConnectionWaitFlags(session,
+										  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+				break;
+			}
+
+			case REMOTE_TRANS_SENT_BEGIN:
+			case REMOTE_TRANS_CLEARING_RESULTS:
+			{
+				PGresult *result = PQgetResult(connection->pgConn);
+				if (result != NULL)
+				{
+					if (!IsResponseOK(result))
+					{
+						/* query failures are always hard errors */
+						ReportResultError(connection, result, ERROR);
+					}
+
+					PQclear(result);
+
+					/* wake up WaitEventSetWait */
+					UpdateConnectionWaitFlags(session,
+											  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+
+					break;
+				}
+
+				if (session->currentTask != NULL)
+				{
+					TaskPlacementExecution *placementExecution = session->currentTask;
+					bool succeeded = true;
+
+					/*
+					 * Once we finished a task on a connection, we no longer
+					 * allow that connection to fail.
+					 */
+					MarkRemoteTransactionCritical(connection);
+
+					session->currentTask = NULL;
+
+					PlacementExecutionDone(placementExecution, succeeded);
+
+					/* connection is ready to use for executing commands */
+					workerPool->idleConnectionCount++;
+				}
+
+				/* connection needs to be writeable to send next command */
+				UpdateConnectionWaitFlags(session,
+										  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+
+				if (execution->isTransaction)
+				{
+					transaction->transactionState = REMOTE_TRANS_STARTED;
+				}
+				else
+				{
+					transaction->transactionState = REMOTE_TRANS_INVALID;
+				}
+				break;
+			}
+
+			case REMOTE_TRANS_STARTED:
+			{
+				if (!TaskQueriesSentAsSimpleQuery(execution) &&
+					RemoteTransactionSavepointsPending(connection))
+				{
+					/* savepoints cannot be sent in the same command as the task */
+					StartRemoteTransactionSavepointSync(connection);
+
+					transaction->transactionState = REMOTE_TRANS_CLEARING_RESULTS;
+					UpdateConnectionWaitFlags(session,
+											  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+					break;
+				}
+
+				TaskPlacementExecution *placementExecution = PopPlacementExecution(
+					session);
+				if (placementExecution == NULL)
+				{
+					/* no tasks are ready to be executed at the moment */
+					UpdateConnectionWaitFlags(session, WL_SOCKET_READABLE);
+					break;
+				}
+
+				bool placementExecutionStarted =
+					StartPlacementExecutionOnSession(placementExecution, session);
+				if (!placementExecutionStarted)
+				{
+					/* no need to continue, connection is lost */
+					Assert(session->connection->connectionState == MULTI_CONNECTION_LOST);
+
+					return;
+				}
+
+				transaction->transactionState = REMOTE_TRANS_SENT_COMMAND;
+				break;
+			}
+
+			case REMOTE_TRANS_SENT_COMMAND:
+			{
+				bool storeRows = ShouldStoreRowsForCurrentTask(session);
+
+				bool fetchDone = ReceiveResults(session, storeRows);
+				if (!fetchDone)
+				{
+					break;
+				}
+
+				/* ReceiveResults may have moved on to one of the batched tasks */
+				session->currentTask->shardCommandExecution->gotResults = true;
+				transaction->transactionState = REMOTE_TRANS_CLEARING_RESULTS;
+				break;
+			}
+
+			default:
+			{
+				break;
+			}
+		}
+	}
+	/* iterate in case we can perform multiple transitions at once */
+	while (transaction->transactionState != currentState);
+}
+
+
+/*
+ * ShouldStoreRowsForCurrentTask returns whether the rows returned for the
+ * current task of the session should be stored in the tuple store.
+ */
+static bool
+ShouldStoreRowsForCurrentTask(WorkerSession *session)
+{
+	ShardCommandExecution *shardCommandExecution =
+		session->currentTask->shardCommandExecution;
+
+	if (shardCommandExecution->gotResults)
+	{
+		/* already received results from another replica */
+		return false;
+	}
+
+	return shardCommandExecution->expectResults;
+}
+
+
+/*
+ * UpdateConnectionWaitFlags is a wrapper around setting waitFlags of the connection.
+ * The session is queued such that the next iteration of the main loop only needs
+ * to modify its event in the wait event set.
+ */
+static void
+UpdateConnectionWaitFlags(WorkerSession *session, int waitFlags)
+{
+	MultiConnection *connection = session->connection;
+	/* do not take any actions if the flags not changed */
+	if (connection->waitFlags == waitFlags)
+	{
+		return;
+	}
+
+	connection->waitFlags = waitFlags;
+
+	/* without signalling the execution, the flag changes won't be reflected */
+	AddWaitFlagsChangedSession(session);
+}
+
+
+/*
+ * AddWaitFlagsChangedSession queues the session for an update of its event in
+ * the wait event set of the execution, unless it is already queued.
+ */
+static void
+AddWaitFlagsChangedSession(WorkerSession *session)
+{
+	DistributedExecution *execution = session->workerPool->distributedExecution;
+
+	if (session->waitFlagsChanged)
+	{
+		return;
+	}
+
+	dlist_push_tail(&execution->waitFlagsChangedSessions,
+					&session->waitFlagsChangedNode);
+	session->waitFlagsChanged = true;
+}
+
+
+/*
+ * CheckConnectionReady returns true if the connection is ready to
+ * read or write, or false if it still has bytes to send/receive.
+ */
+static bool
+CheckConnectionReady(WorkerSession *session)
+{
+	MultiConnection *connection = session->connection;
+	int waitFlags = WL_SOCKET_READABLE;
+	bool connectionReady = false;
+
+	ConnStatusType status = PQstatus(connection->pgConn);
+	if (status == CONNECTION_BAD)
+	{
+		connection->connectionState = MULTI_CONNECTION_LOST;
+		return false;
+	}
+
+	/* try to send all pending data */
+	int sendStatus = PQflush(connection->pgConn);
+	if (sendStatus == -1)
+	{
+		connection->connectionState = MULTI_CONNECTION_LOST;
+		return false;
+	}
+	else if (sendStatus == 1)
+	{
+		/* more data to send, wait for socket to become writable */
+		waitFlags = waitFlags | WL_SOCKET_WRITEABLE;
+	}
+
+	if ((session->latestUnconsumedWaitEvents & WL_SOCKET_READABLE) != 0)
+	{
+		if (PQconsumeInput(connection->pgConn) == 0)
+		{
+			connection->connectionState = MULTI_CONNECTION_LOST;
+			return false;
+		}
+	}
+
+	if (!PQisBusy(connection->pgConn))
+	{
+		connectionReady = true;
+	}
+
+	UpdateConnectionWaitFlags(session, waitFlags);
+
+	/* don't consume input redundantly if we cycle back into CheckConnectionReady */
+	session->latestUnconsumedWaitEvents = 0;
+
+	return connectionReady;
+}
+
+
+/*
+ * PopPlacementExecution returns the next available assigned or unassigned
+ * placement execution for the given session.
+ */
+static TaskPlacementExecution *
+PopPlacementExecution(WorkerSession *session)
+{
+	WorkerPool *workerPool = session->workerPool;
+
+	TaskPlacementExecution *placementExecution = PopAssignedPlacementExecution(session);
+	if (placementExecution == NULL)
+	{
+		if (session->commandsSent > 0 && UseConnectionPerPlacement())
+		{
+			/*
+			 * Only send one command per connection if force_max_query_parallelisation
+			 * is enabled, unless it's an assigned placement execution.
+			 */
+			return NULL;
+		}
+
+		/* no more assigned tasks, pick an unassigned task */
+		placementExecution = PopUnassignedPlacementExecution(workerPool);
+	}
+
+	return placementExecution;
+}
+
+
+/*
+ * PopAssignedPlacementExecution finds an executable task from the queue of assigned tasks.
+ */
+static TaskPlacementExecution *
+PopAssignedPlacementExecution(WorkerSession *session)
+{
+	dlist_head *readyTaskQueue = &(session->readyTaskQueue);
+
+	if (dlist_is_empty(readyTaskQueue))
+	{
+		return NULL;
+	}
+
+	TaskPlacementExecution *placementExecution = dlist_container(TaskPlacementExecution,
+																 sessionReadyQueueNode,
+																 dlist_pop_head_node(
+																	 readyTaskQueue));
+
+	return placementExecution;
+}
+
+
+/*
+ * EstimateTaskSize returns the sum of the lengths that pg_dist_placement
+ * records for the shards that the task accesses, which is a rough estimate of
+ * how long the task takes. Shards without finalized placements count as 0.
+ */
+static uint64
+EstimateTaskSize(Task *task)
+{
+	ListCell *relationShardCell = NULL;
+	uint64 estimatedSize = 0;
+
+	if (task->relationShardList == NIL)
+	{
+		return EstimateShardSize(task->anchorShardId);
+	}
+
+	foreach(relationShardCell, task->relationShardList)
+	{
+		RelationShard *relationShard = (RelationShard *) lfirst(relationShardCell);
+		ListCell *previousCell = NULL;
+		bool shardSeenBefore = false;
+
+		/* self-joins access the same shard more than once */
+		foreach(previousCell, task->relationShardList)
+		{
+			RelationShard *previousShard = (RelationShard *) lfirst(previousCell);
+
+			if (previousCell == relationShardCell)
+			{
+				break;
+			}
+
+			if (previousShard->shardId == relationShard->shardId)
+			{
+				shardSeenBefore = true;
+				break;
+			}
+		}
+
+		if (!shardSeenBefore)
+		{
+			estimatedSize += EstimateShardSize(relationShard->shardId);
+		}
+	}
+
+	return estimatedSize;
+}
+
+
+/*
+ * EstimateShardSize returns the length that pg_dist_placement records for the
+ * given shard, or 0 if the shard has no finalized placements.
+ */
+static uint64
+EstimateShardSize(uint64 shardId)
+{
+	if (shardId == INVALID_SHARD_ID)
+	{
+		return 0;
+	}
+
+	List *shardPlacementList = FinalizedShardPlacementList(shardId);
+	if (shardPlacementList == NIL)
+	{
+		return 0;
+	}
+
+	ShardPlacement *shardPlacement = (ShardPlacement *) linitial(shardPlacementList);
+
+	return shardPlacement->shardLength;
+}
+
+
+/*
+ * PushUnassignedPlacementExecution adds a placement execution that is ready
+ * to run on any session to the queue of the worker pool. By default, the queue
+ * is first-in-first-out. When citus.execute_largest_shards_first is enabled,
+ * the placement execution is inserted after all placement executions of
+ * tasks that are estimated to be at least as large.
+ */
+static void
+PushUnassignedPlacementExecution(WorkerPool *workerPool,
+								 TaskPlacementExecution *placementExecution)
+{
+	dlist_head *readyTaskQueue = &(workerPool->readyTaskQueue);
+	dlist_node *readyQueueNode = &(placementExecution->workerReadyQueueNode);
+	dlist_iter iter;
+
+	if (!ExecuteLargestShardsFirst)
+	{
+		dlist_push_tail(readyTaskQueue, readyQueueNode);
+		return;
+	}
+
+	uint64 estimatedSize = placementExecution->shardCommandExecution->estimatedSize;
+
+	/* search from the tail, such that tasks of equal size keep their order */
+	dlist_reverse_foreach(iter, readyTaskQueue)
+	{
+		TaskPlacementExecution *queuedExecution =
+			dlist_container(TaskPlacementExecution, workerReadyQueueNode, iter.cur);
+
+		if (queuedExecution->shardCommandExecution->estimatedSize >= estimatedSize)
+		{
+			dlist_insert_after(iter.cur, readyQueueNode);
+			return;
+		}
+	}
+
+	dlist_push_head(readyTaskQueue, readyQueueNode);
+}
+
+
+/*
+ * PopAssignedPlacementExecution finds an executable task from the queue of assigned tasks.
+ */
+static TaskPlacementExecution *
+PopUnassignedPlacementExecution(WorkerPool *workerPool)
+{
+	dlist_head *readyTaskQueue = &(workerPool->readyTaskQueue);
+
+	if (dlist_is_empty(readyTaskQueue))
+	{
+		return NULL;
+	}
+
+	TaskPlacementExecution *placementExecution = dlist_container(TaskPlacementExecution,
+																 workerReadyQueueNode,
+																 dlist_pop_head_node(
+																	 readyTaskQueue));
+
+	workerPool->readyTaskCount--;
+
+	return placementExecution;
+}
+
+
+/*
+ * CanSendBeginWithTask returns whether the BEGIN of a remote transaction can be
+ * sent in the same command as the first task over a connection, which saves a
+ * round trip per connection. That requires the task to be sent as a simple
+ * query, since the extended protocol only allows a single statement.
+ */
+static bool
+CanSendBeginWithTask(DistributedExecution *execution)
+{
+	return SendBeginWithFirstTask && TaskQueriesSentAsSimpleQuery(execution) &&
+		   CanPrependRemoteTransactionBegin();
+}
+
+
+/*
+ * TaskQueriesSentAsSimpleQuery returns whether the task queries of the given
+ * execution are sent over the simple query protocol, which allows sending
+ * other statements in the same command.
+ */
+static bool
+TaskQueriesSentAsSimpleQuery(DistributedExecution *execution)
+{
+	return execution->paramListInfo == NULL && !execution->binaryResults;
+}
+
+
+/*
+ * StartPlacementExecutionOnSession gets a TaskPlacementExecition and
+ * WorkerSession, the task's query is sent to the worker via the session.
+ *
+ * The function does some bookkeeping such as associating the placement
+ * accesses with the connection and updating session's local variables. For
+ * details read the comments in the function.
+ *
+ * The function returns true if the query is successfully sent over the
+ * connection, otherwise false.
+ */
+static bool
+StartPlacementExecutionOnSession(TaskPlacementExecution *placementExecution,
+								 WorkerSession *session)
+{
+	WorkerPool *workerPool = session->workerPool;
+	DistributedExecution *execution = workerPool->distributedExecution;
+	ParamListInfo paramListInfo = execution->paramListInfo;
+	MultiConnection *connection = session->connection;
+	ShardCommandExecution *shardCommandExecution =
+		placementExecution->shardCommandExecution;
+	Task *task = shardCommandExecution->task;
+	char *queryString = TaskQueryString(task);
+	int querySent = 0;
 
-					PQclear(result);
+	if (session->commandsSent == 0)
+	{
+		/* first time we send a command, consider the connection used (not unused) */
+		workerPool->unusedConnectionCount--;
+	}
 
-					/* wake up WaitEventSetWait */
-					UpdateConnectionWaitFlags(session,
-											  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+	/* connection is going to be in use */
+	workerPool->idleConnectionCount--;
+	session->currentTask = placementExecution;
+	MarkPlacementExecutionRunning(placementExecution, session);
 
-					break;
-				}
+	bool batchTasks = CanBatchTasksOnSession(session, placementExecution);
+	if (batchTasks)
+	{
+		queryString = BuildBatchedQueryString(session, placementExecution);
+	}
 
-				if (session->currentTask != NULL)
-				{
-					TaskPlacementExecution *placementExecution = session->currentTask;
-					bool succeeded = true;
+	if (paramListInfo != NULL)
+	{
+		int parameterCount = paramListInfo->numParams;
+		Oid *parameterTypes = NULL;
+		const char **parameterValues = NULL;
 
-					/*
-					 * Once we finished a task on a connection, we no longer
-					 * allow that connection to fail.
-					 */
-					MarkRemoteTransactionCritical(connection);
+		/* force evaluation of bound params */
+		paramListInfo = copyParamList(paramListInfo);
 
-					session->currentTask = NULL;
+		ExtractParametersForRemoteExecution(paramListInfo, &parameterTypes,
+											&parameterValues);
 
-					PlacementExecutionDone(placementExecution, succeeded);
+		if (execution->prepareTaskQueries)
+		{
+			querySent = SendPreparedTaskQuery(session, queryString, parameterCount,
+											  parameterTypes, parameterValues);
+		}
+		else
+		{
+			querySent = SendRemoteCommandParams(connection, queryString,
+												parameterCount, parameterTypes,
+												parameterValues,
+												execution->binaryResults);
+		}
+	}
+	else if (execution->binaryResults && !batchTasks)
+	{
+		/* binary results can only be requested via the extended protocol */
+		querySent = SendRemoteCommandParams(connection, queryString, 0, NULL, NULL,
+											true);
+	}
+	else
+	{
+		int *transactionStatementCount = &session->pendingTransactionStatementCount;
 
-					/* connection is ready to use for executing commands */
-					workerPool->idleConnectionCount++;
-				}
+		if (connection->remoteTransaction.transactionState == REMOTE_TRANS_INVALID &&
+			execution->isTransaction)
+		{
+			/* TransactionStateMachine lets us open the transaction block */
+			queryString = PrependRemoteTransactionBegin(connection, queryString,
+														transactionStatementCount);
+		}
+		else if (RemoteTransactionSavepointsPending(connection))
+		{
+			/* savepoints that began since the connection was last used */
+			queryString = PrependRemoteTransactionSavepoints(connection, queryString,
+															 transactionStatementCount);
+		}
 
-				/* connection needs to be writeable to send next command */
-				UpdateConnectionWaitFlags(session,
-										  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+		querySent = SendRemoteCommand(connection, queryString);
+	}
 
-				if (execution->isTransaction)
-				{
-					transaction->transactionState = REMOTE_TRANS_STARTED;
-				}
-				else
-				{
-					transaction->transactionState = REMOTE_TRANS_INVALID;
-				}
-				break;
-			}
+	if (querySent == 0)
+	{
+		connection->connectionState = MULTI_CONNECTION_LOST;
+		return false;
+	}
 
-			case REMOTE_TRANS_STARTED:
-			{
-				TaskPlacementExecution *placementExecution = PopPlacementExecution(
-					session);
-				if (placementExecution == NULL)
-				{
-					/* no tasks are ready to be executed at the moment */
-					UpdateConnectionWaitFlags(session, WL_SOCKET_READABLE);
-					break;
-				}
+	if (session->pendingStatementName != NULL)
+	{
+		/* single row mode is set once we execute the prepared statement */
+		return true;
+	}
 
-				bool placementExecutionStarted =
-					StartPlacementExecutionOnSession(placementExecution, session);
-				if (!placementExecutionStarted)
-				{
-					/* no need to continue, connection is lost */
-					Assert(session->connection->connectionState == MULTI_CONNECTION_LOST);
+	int singleRowMode = PQsetSingleRowMode(connection->pgConn);
+	if (singleRowMode == 0)
+	{
+		connection->connectionState = MULTI_CONNECTION_LOST;
+		return false;
+	}
 
-					return;
-				}
+	return true;
+}
 
-				transaction->transactionState = REMOTE_TRANS_SENT_COMMAND;
-				break;
-			}
 
-			case REMOTE_TRANS_SENT_COMMAND:
-			{
-				TaskPlacementExecution *placementExecution = session->currentTask;
-				ShardCommandExecution *shardCommandExecution =
-					placementExecution->shardCommandExecution;
-				bool storeRows = shardCommandExecution->expectResults;
+/*
+ * SendPreparedTaskQuery sends a parameterized task query by executing the
+ * statement that was prepared for it on the connection of the session.
+ *
+ * If the query has not been prepared on the connection yet, we only send the
+ * PREPARE and remember the parameters, ReceiveResults executes the statement
+ * once the worker prepared it. When the connection already has too many
+ * prepared statements, the query is sent along with the parameters instead.
+ *
+ * The function returns 1 if the command is successfully sent, 0 otherwise.
+ */
+static int
+SendPreparedTaskQuery(WorkerSession *session, char *queryString, int parameterCount,
+					  Oid *parameterTypes, const char **parameterValues)
+{
+	MultiConnection *connection = session->connection;
+	bool binaryResults = session->workerPool->distributedExecution->binaryResults;
 
-				if (shardCommandExecution->gotResults)
-				{
-					/* already received results from another replica */
-					storeRows = false;
-				}
+	RemotePreparedStatement *statement =
+		FindRemotePreparedStatement(connection, queryString, parameterCount,
+									parameterTypes);
+	if (statement != NULL)
+	{
+		return SendRemoteCommandPrepared(connection, statement->statementName,
+										 parameterCount, parameterValues,
+										 binaryResults);
+	}
 
-				bool fetchDone = ReceiveResults(session, storeRows);
-				if (!fetchDone)
-				{
-					break;
-				}
+	if (!CanPrepareRemoteStatement(connection))
+	{
+		return SendRemoteCommandParams(connection, queryString, parameterCount,
+									   parameterTypes, parameterValues, binaryResults);
+	}
 
-				shardCommandExecution->gotResults = true;
-				transaction->transactionState = REMOTE_TRANS_CLEARING_RESULTS;
-				break;
-			}
+	char *statementName = NextRemotePreparedStatementName(connection);
 
-			default:
-			{
-				break;
-			}
-		}
+	int querySent = SendRemotePrepare(connection, statementName, queryString,
+									  parameterCount, parameterTypes);
+	if (querySent != 0)
+	{
+		session->pendingStatementName = statementName;
+		session->pendingQueryString = queryString;
+		session->pendingParameterCount = parameterCount;
+		session->pendingParameterTypes = parameterTypes;
+		session->pendingParameterValues = parameterValues;
 	}
-	/* iterate in case we can perform multiple transitions at once */
-	while (transaction->transactionState != currentState);
+
+	return querySent;
 }
 
 
 /*
- * UpdateConnectionWaitFlags is a wrapper around setting waitFlags of the connection.
+ * ExecutePendingPreparedStatement is called once the worker prepared the task
+ * query of the session and executes the prepared statement.
  *
- * This function might further improved in a sense that to use use ModifyWaitEvent on
- * waitFlag changes as opposed to what we do now: always rebuild the wait event sets.
- * Our initial benchmarks didn't show any significant performance improvements, but
- * good to keep in mind the potential improvements.
+ * The function returns true if the command is successfully sent, otherwise
+ * it marks the connection as lost and returns false.
  */
-static void
-UpdateConnectionWaitFlags(WorkerSession *session, int waitFlags)
+static bool
+ExecutePendingPreparedStatement(WorkerSession *session)
 {
 	MultiConnection *connection = session->connection;
-	DistributedExecution *execution = session->workerPool->distributedExecution;
+	bool binaryResults = session->workerPool->distributedExecution->binaryResults;
+	char *statementName = session->pendingStatementName;
+	int parameterCount = session->pendingParameterCount;
 
-	/* do not take any actions if the flags not changed */
-	if (connection->waitFlags == waitFlags)
+	AddRemotePreparedStatement(connection, statementName, session->pendingQueryString,
+							   parameterCount, session->pendingParameterTypes);
+
+	int querySent = SendRemoteCommandPrepared(connection, statementName,
+											  parameterCount,
+											  session->pendingParameterValues,
+											  binaryResults);
+
+	session->pendingStatementName = NULL;
+	session->pendingQueryString = NULL;
+	session->pendingParameterTypes = NULL;
+	session->pendingParameterValues = NULL;
+
+	if (querySent == 0 || PQsetSingleRowMode(connection->pgConn) == 0)
 	{
-		return;
+		connection->connectionState = MULTI_CONNECTION_LOST;
+		return false;
 	}
 
-	connection->waitFlags = waitFlags;
+	/* connection needs to be writeable to send the command */
+	UpdateConnectionWaitFlags(session, WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
 
-	/* without signalling the execution, the flag changes won't be reflected */
-	execution->waitFlagsChanged = true;
+	return true;
 }
 
 
 /*
- * CheckConnectionReady returns true if the connection is ready to
- * read or write, or false if it still has bytes to send/receive.
+ * IsExternParam returns true if the given node is a parameter whose value is
+ * supplied by the client.
  */
 static bool
-CheckConnectionReady(WorkerSession *session)
+IsExternParam(Node *node)
 {
-	MultiConnection *connection = session->connection;
-	int waitFlags = WL_SOCKET_READABLE;
-	bool connectionReady = false;
+	return IsA(node, Param) && ((Param *) node)->paramkind == PARAM_EXTERN;
+}
 
-	ConnStatusType status = PQstatus(connection->pgConn);
-	if (status == CONNECTION_BAD)
+
+/*
+ * CanBatchTasksOnSession returns whether the session may send additional
+ * tasks in the same command as the given placement execution.
+ *
+ * A multi-statement command stops at the first error, which means the
+ * commands that follow the failed one never run. We therefore only batch
+ * modify tasks when any failure fails the whole execution anyway and when
+ * the commands run in a transaction block. An error of a SELECT is always a
+ * hard error, and when the connection fails, the tasks that were batched
+ * along are retried on their other placements, so SELECT tasks can always
+ * be batched. Parameterized queries cannot be batched since the extended
+ * query protocol only allows a single statement.
+ *
+ * We send the tasks as separate statements rather than combining them into
+ * a UNION ALL, since the rows of each task need to be told apart, e.g. for
+ * merging task results or for instrumentation.
+ */
+static bool
+CanBatchTasksOnSession(WorkerSession *session, TaskPlacementExecution *placementExecution)
+{
+	DistributedExecution *execution = session->workerPool->distributedExecution;
+	Task *task = placementExecution->shardCommandExecution->task;
+
+	if (ExecutorTaskBatchSize <= 1)
 	{
-		connection->connectionState = MULTI_CONNECTION_LOST;
 		return false;
 	}
 
-	/* try to send all pending data */
-	int sendStatus = PQflush(connection->pgConn);
-	if (sendStatus == -1)
+	if (execution->paramListInfo != NULL)
 	{
-		connection->connectionState = MULTI_CONNECTION_LOST;
 		return false;
 	}
-	else if (sendStatus == 1)
+
+	if (UseConnectionPerPlacement())
 	{
-		/* more data to send, wait for socket to become writable */
-		waitFlags = waitFlags | WL_SOCKET_WRITEABLE;
+		/* the user wants one task per connection */
+		return false;
 	}
 
-	if ((session->latestUnconsumedWaitEvents & WL_SOCKET_READABLE) != 0)
+	if (task->taskType == SELECT_TASK)
 	{
-		if (PQconsumeInput(connection->pgConn) == 0)
-		{
-			connection->connectionState = MULTI_CONNECTION_LOST;
-			return false;
-		}
+		return execution->modLevel == ROW_MODIFY_READONLY;
 	}
 
-	if (!PQisBusy(connection->pgConn))
+	if (!execution->errorOnAnyFailure || !execution->isTransaction)
 	{
-		connectionReady = true;
+		return false;
 	}
 
-	UpdateConnectionWaitFlags(session, waitFlags);
-
-	/* don't consume input redundantly if we cycle back into CheckConnectionReady */
-	session->latestUnconsumedWaitEvents = 0;
-
-	return connectionReady;
+	/* modify tasks consist of a single statement, which we need to route results */
+	return task->taskType == MODIFY_TASK;
 }
 
 
 /*
- * PopPlacementExecution returns the next available assigned or unassigned
- * placement execution for the given session.
+ * BuildBatchedQueryString pops up to citus.executor_task_batch_size - 1
+ * additional tasks for the session, marks them as started and returns
+ * a multi-statement query string that contains the query of the given
+ * placement execution followed by the queries of the batched tasks.
  */
-static TaskPlacementExecution *
-PopPlacementExecution(WorkerSession *session)
+static char *
+BuildBatchedQueryString(WorkerSession *session,
+						TaskPlacementExecution *placementExecution)
 {
-	WorkerPool *workerPool = session->workerPool;
+	Task *task = placementExecution->shardCommandExecution->task;
+	StringInfo batchedQueryString = makeStringInfo();
 
-	TaskPlacementExecution *placementExecution = PopAssignedPlacementExecution(session);
-	if (placementExecution == NULL)
+	appendStringInfoString(batchedQueryString, TaskQueryString(task));
+
+	while (session->batchedTaskCount + 1 < ExecutorTaskBatchSize)
 	{
-		if (session->commandsSent > 0 && UseConnectionPerPlacement())
+		TaskPlacementExecution *nextPlacementExecution = PopPlacementExecution(session);
+		if (nextPlacementExecution == NULL)
 		{
-			/*
-			 * Only send one command per connection if force_max_query_parallelisation
-			 * is enabled, unless it's an assigned placement execution.
-			 */
-			return NULL;
+			break;
 		}
 
-		/* no more assigned tasks, pick an unassigned task */
-		placementExecution = PopUnassignedPlacementExecution(workerPool);
+		Task *nextTask = nextPlacementExecution->shardCommandExecution->task;
+
+		/* CanBatchTasksOnSession ensured that all tasks of the execution qualify */
+		Assert(nextTask->taskType == task->taskType);
+
+		MarkPlacementExecutionRunning(nextPlacementExecution, session);
+		dlist_push_tail(&session->batchedTaskQueue,
+						&nextPlacementExecution->sessionBatchedQueueNode);
+		session->batchedTaskCount++;
+
+		appendStringInfo(batchedQueryString, ";%s", TaskQueryString(nextTask));
+	}
+
+	ereport(DEBUG4, (errmsg("sending %d tasks in a single command over session %ld",
+							session->batchedTaskCount + 1,
+							session->sessionId)));
+
+	return batchedQueryString->data;
+}
+
+
+/*
+ * MarkPlacementExecutionRunning does the bookkeeping for a placement
+ * execution that is about to be sent over the session, either as the
+ * current task or as one of the batched tasks that follow it.
+ */
+static void
+MarkPlacementExecutionRunning(TaskPlacementExecution *placementExecution,
+							  WorkerSession *session)
+{
+	Task *task = placementExecution->shardCommandExecution->task;
+	ShardPlacement *taskPlacement = placementExecution->shardPlacement;
+	List *placementAccessList = PlacementAccessListForTask(task, taskPlacement);
+
+	/*
+	 * Make sure that subsequent commands on the same placement
+	 * use the same connection.
+	 */
+	AssignPlacementListToConnection(placementAccessList, session->connection);
+
+	if (session->workerPool->distributedExecution->taskInstrumentationList != NULL)
+	{
+		StartPlacementExecutionInstrumentation(placementExecution, session);
 	}
 
-	return placementExecution;
+	if (EnableAdaptiveSlowStart || session->workerPool->distributedExecution->hedgeReads)
+	{
+		placementExecution->startTime = GetCurrentTimestamp();
+	}
+
+	/* one more command is sent over the session */
+	session->commandsSent++;
+
+	placementExecution->executionState = PLACEMENT_EXECUTION_RUNNING;
 }
 
 
 /*
- * PopAssignedPlacementExecution finds an executable task from the queue of assigned tasks.
+ * StartPlacementExecutionInstrumentation starts keeping track of the timing
+ * and the received data of a placement execution that is sent over the given
+ * session, and adds it to the instrumented task executions.
  */
-static TaskPlacementExecution *
-PopAssignedPlacementExecution(WorkerSession *session)
+static void
+StartPlacementExecutionInstrumentation(TaskPlacementExecution *placementExecution,
+									   WorkerSession *session)
 {
-	dlist_head *readyTaskQueue = &(session->readyTaskQueue);
+	DistributedExecution *execution = session->workerPool->distributedExecution;
+	TaskExecutionInstrumentation *instrumentation =
+		(TaskExecutionInstrumentation *) palloc0(sizeof(TaskExecutionInstrumentation));
 
-	if (dlist_is_empty(readyTaskQueue))
+	instrumentation->task = placementExecution->shardCommandExecution->task;
+	instrumentation->nodeName = session->workerPool->nodeName;
+	instrumentation->nodePort = session->workerPool->nodePort;
+	instrumentation->queueTime = ElapsedMilliseconds(execution->startTime);
+	INSTR_TIME_SET_CURRENT(instrumentation->startTime);
+
+	/* attribute the connection establishment to the first task on it */
+	if (session->commandsSent == 0)
 	{
-		return NULL;
+		instrumentation->connectTime = session->connectTime;
 	}
 
-	TaskPlacementExecution *placementExecution = dlist_container(TaskPlacementExecution,
-																 sessionReadyQueueNode,
-																 dlist_pop_head_node(
-																	 readyTaskQueue));
+	placementExecution->instrumentation = instrumentation;
 
-	return placementExecution;
+	*execution->taskInstrumentationList =
+		lappend(*execution->taskInstrumentationList, instrumentation);
 }
 
 
 /*
- * PopAssignedPlacementExecution finds an executable task from the queue of assigned tasks.
+ * ElapsedMilliseconds returns the number of milliseconds since startTime.
  */
-static TaskPlacementExecution *
-PopUnassignedPlacementExecution(WorkerPool *workerPool)
+static double
+ElapsedMilliseconds(instr_time startTime)
 {
-	dlist_head *readyTaskQueue = &(workerPool->readyTaskQueue);
-
-	if (dlist_is_empty(readyTaskQueue))
-	{
-		return NULL;
-	}
-
-	TaskPlacementExecution *placementExecution = dlist_container(TaskPlacementExecution,
-																 workerReadyQueueNode,
-																 dlist_pop_head_node(
-																	 readyTaskQueue));
+	instr_time elapsedTime;
 
-	workerPool->readyTaskCount--;
+	INSTR_TIME_SET_CURRENT(elapsedTime);
+	INSTR_TIME_SUBTRACT(elapsedTime, startTime);
 
-	return placementExecution;
+	return INSTR_TIME_GET_MILLISEC(elapsedTime);
 }
 
 
 /*
- * StartPlacementExecutionOnSession gets a TaskPlacementExecition and
- * WorkerSession, the task's query is sent to the worker via the session.
- *
- * The function does some bookkeeping such as associating the placement
- * accesses with the connection and updating session's local variables. For
- * details read the comments in the function.
- *
- * The function returns true if the query is successfully sent over the
- * connection, otherwise false.
+ * AdvanceToNextBatchedTask is called when all results of the current task
+ * have been received. If there are batched tasks left on the session, the
+ * current task is marked as done, the next batched task becomes the current
+ * task and the function returns true. Otherwise, it returns false and the
+ * current task is handled by the transaction state machine as usual.
  */
 static bool
-StartPlacementExecutionOnSession(TaskPlacementExecution *placementExecution,
-								 WorkerSession *session)
+AdvanceToNextBatchedTask(WorkerSession *session)
 {
-	WorkerPool *workerPool = session->workerPool;
-	DistributedExecution *execution = workerPool->distributedExecution;
-	ParamListInfo paramListInfo = execution->paramListInfo;
-	MultiConnection *connection = session->connection;
-	ShardCommandExecution *shardCommandExecution =
-		placementExecution->shardCommandExecution;
-	Task *task = shardCommandExecution->task;
-	ShardPlacement *taskPlacement = placementExecution->shardPlacement;
-	List *placementAccessList = PlacementAccessListForTask(task, taskPlacement);
-	char *queryString = task->queryString;
-	int querySent = 0;
-
-	/*
-	 * Make sure that subsequent commands on the same placement
-	 * use the same connection.
-	 */
-	AssignPlacementListToConnection(placementAccessList, connection);
-
-	/* one more command is sent over the session */
-	session->commandsSent++;
+	TaskPlacementExecution *placementExecution = session->currentTask;
+	bool succeeded = true;
 
-	if (session->commandsSent == 1)
+	if (dlist_is_empty(&session->batchedTaskQueue))
 	{
-		/* first time we send a command, consider the connection used (not unused) */
-		workerPool->unusedConnectionCount--;
+		return false;
 	}
 
-	/* connection is going to be in use */
-	workerPool->idleConnectionCount--;
-	session->currentTask = placementExecution;
-	placementExecution->executionState = PLACEMENT_EXECUTION_RUNNING;
+	placementExecution->shardCommandExecution->gotResults = true;
 
-	if (paramListInfo != NULL)
-	{
-		int parameterCount = paramListInfo->numParams;
-		Oid *parameterTypes = NULL;
-		const char **parameterValues = NULL;
+	/* once we finished a task on a connection, we no longer allow it to fail */
+	MarkRemoteTransactionCritical(session->connection);
 
-		/* force evaluation of bound params */
-		paramListInfo = copyParamList(paramListInfo);
+	dlist_node *nextTaskNode = dlist_pop_head_node(&session->batchedTaskQueue);
+	session->currentTask = dlist_container(TaskPlacementExecution,
+										   sessionBatchedQueueNode, nextTaskNode);
+	session->batchedTaskCount--;
 
-		ExtractParametersForRemoteExecution(paramListInfo, &parameterTypes,
-											&parameterValues);
-		querySent = SendRemoteCommandParams(connection, queryString, parameterCount,
-											parameterTypes, parameterValues);
-	}
-	else
-	{
-		querySent = SendRemoteCommand(connection, queryString);
-	}
+	PlacementExecutionDone(placementExecution, succeeded);
 
-	if (querySent == 0)
-	{
-		connection->connectionState = MULTI_CONNECTION_LOST;
-		return false;
-	}
+	return true;
+}
 
-	int singleRowMode = PQsetSingleRowMode(connection->pgConn);
-	if (singleRowMode == 0)
+
+/*
+ * SaveTaskExplainAnalyzeOutput keeps the EXPLAIN ANALYZE output that the
+ * worker returned for the task in its instrumentation, where CitusExplainScan
+ * finds it.
+ */
+static void
+SaveTaskExplainAnalyzeOutput(TaskPlacementExecution *placementExecution,
+							 char *explainOutput)
+{
+	TaskExecutionInstrumentation *instrumentation = placementExecution->instrumentation;
+
+	if (instrumentation == NULL)
 	{
-		connection->connectionState = MULTI_CONNECTION_LOST;
-		return false;
+		return;
 	}
 
-	return true;
+	instrumentation->explainAnalyzeOutput =
+		MemoryContextStrdup(GetMemoryChunkContext(instrumentation), explainOutput);
 }
 
 
@@ -2998,13 +5707,18 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 	AttInMetadata *attributeInputMetadata = execution->attributeInputMetadata;
 	uint32 expectedColumnCount = 0;
 	char **columnArray = execution->columnArray;
-	Tuplestorestate *tupleStore = execution->tupleStore;
 
 	if (tupleDescriptor != NULL)
 	{
 		expectedColumnCount = tupleDescriptor->natts;
 	}
 
+	if (execution->tasksReturnExplainOutput)
+	{
+		/* the last column holds the EXPLAIN ANALYZE output of the task */
+		expectedColumnCount++;
+	}
+
 	/*
 	 * We use this context while converting each row fetched from remote node
 	 * into tuple. The context is reseted on every row, thus we create it at the
@@ -3024,13 +5738,41 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 		PGresult *result = PQgetResult(connection->pgConn);
 		if (result == NULL)
 		{
+			if (session->pendingStatementName != NULL)
+			{
+				/* the task query is prepared, now execute it */
+				ExecutePendingPreparedStatement(session);
+				break;
+			}
+
 			/* no more results, break out of loop and free allocated memory */
 			fetchDone = true;
 			break;
 		}
 
 		ExecStatusType resultStatus = PQresultStatus(result);
-		if (resultStatus == PGRES_COMMAND_OK)
+		if (session->pendingTransactionStatementCount > 0)
+		{
+			/* results of the statements that began the transaction or savepoints */
+			if (resultStatus == PGRES_COMMAND_OK || resultStatus == PGRES_TUPLES_OK)
+			{
+				session->pendingTransactionStatementCount--;
+			}
+			else if (resultStatus != PGRES_SINGLE_TUPLE)
+			{
+				ReportResultError(connection, result, ERROR);
+			}
+
+			PQclear(result);
+			continue;
+		}
+		else if (resultStatus == PGRES_COMMAND_OK && session->pendingStatementName != NULL)
+		{
+			/* result of the PREPARE, the rows follow once we execute it */
+			PQclear(result);
+			continue;
+		}
+		else if (resultStatus == PGRES_COMMAND_OK)
 		{
 			char *currentAffectedTupleString = PQcmdTuples(result);
 			int64 currentAffectedTupleCount = 0;
@@ -3048,6 +5790,13 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 
 			PQclear(result);
 
+			if (AdvanceToNextBatchedTask(session))
+			{
+				/* the next result belongs to the next batched task */
+				storeRows = ShouldStoreRowsForCurrentTask(session);
+				continue;
+			}
+
 			/* no more results, break out of loop and free allocated memory */
 			fetchDone = true;
 			break;
@@ -3061,6 +5810,13 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 			Assert(PQntuples(result) == 0);
 			PQclear(result);
 
+			if (AdvanceToNextBatchedTask(session))
+			{
+				/* the next result belongs to the next batched task */
+				storeRows = ShouldStoreRowsForCurrentTask(session);
+				continue;
+			}
+
 			fetchDone = true;
 			break;
 		}
@@ -3082,6 +5838,31 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 		rowsProcessed = PQntuples(result);
 		uint32 columnCount = PQnfields(result);
 
+		ShardCommandExecution *shardCommandExecution =
+			session->currentTask->shardCommandExecution;
+		if (execution->hedgeReads)
+		{
+			if (shardCommandExecution->resultPlacementExecution == NULL)
+			{
+				/* the first placement execution to return rows provides all rows */
+				shardCommandExecution->resultPlacementExecution = session->currentTask;
+			}
+			else if (shardCommandExecution->resultPlacementExecution !=
+					 session->currentTask)
+			{
+				/* the hedged task already receives rows from another placement */
+				PQclear(result);
+				continue;
+			}
+		}
+		if (shardCommandExecution->attributeInputMetadata != NULL)
+		{
+			/* the task belongs to one of several queries in the execution */
+			attributeInputMetadata = shardCommandExecution->attributeInputMetadata;
+			expectedColumnCount = shardCommandExecution->columnCount;
+			executionStats = shardCommandExecution->executionStats;
+		}
+
 		if (columnCount != expectedColumnCount)
 		{
 			ereport(ERROR, (errmsg("unexpected number of columns from worker: %d, "
@@ -3089,8 +5870,35 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 								   columnCount, expectedColumnCount)));
 		}
 
+		/* batched commands are always sent with the text protocol */
+		bool binaryResult = columnCount > 0 && PQfformat(result, 0) == 1;
+		if (binaryResult)
+		{
+			CheckBinaryResultColumnTypes(execution, result);
+		}
+
+		TaskExecutionInstrumentation *instrumentation =
+			session->currentTask->instrumentation;
+
+		/* merged task results are kept in a tuple store per task */
+		Tuplestorestate *tupleStore = shardCommandExecution->tupleStore;
+		if (tupleStore == NULL)
+		{
+			tupleStore = execution->tupleStore;
+		}
+
 		for (uint32 rowIndex = 0; rowIndex < rowsProcessed; rowIndex++)
 		{
+			if (execution->tasksReturnExplainOutput &&
+				!PQgetisnull(result, rowIndex, columnCount - 1))
+			{
+				/* the last row of the task only holds its EXPLAIN ANALYZE output */
+				SaveTaskExplainAnalyzeOutput(session->currentTask,
+											 PQgetvalue(result, rowIndex,
+														columnCount - 1));
+				continue;
+			}
+
 			memset(columnArray, 0, columnCount * sizeof(char *));
 
 			for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
@@ -3102,6 +5910,12 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 				else
 				{
 					columnArray[columnIndex] = PQgetvalue(result, rowIndex, columnIndex);
+					if (instrumentation != NULL)
+					{
+						instrumentation->byteCount += PQgetlength(result, rowIndex,
+																  columnIndex);
+					}
+
 					if (SubPlanLevel > 0 && executionStats != NULL)
 					{
 						executionStats->totalIntermediateResultSize += PQgetlength(result,
@@ -3118,8 +5932,15 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 			 */
 			MemoryContext oldContextPerRow = MemoryContextSwitchTo(ioContext);
 
-			HeapTuple heapTuple = BuildTupleFromCStrings(attributeInputMetadata,
-														 columnArray);
+			HeapTuple heapTuple = NULL;
+			if (binaryResult)
+			{
+				heapTuple = BuildTupleFromBinaryValues(execution, result, rowIndex);
+			}
+			else
+			{
+				heapTuple = BuildTupleFromCStrings(attributeInputMetadata, columnArray);
+			}
 
 			MemoryContextSwitchTo(oldContextPerRow);
 
@@ -3127,6 +5948,11 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 			MemoryContextReset(ioContext);
 
 			execution->rowsProcessed++;
+
+			if (instrumentation != NULL)
+			{
+				instrumentation->rowCount++;
+			}
 		}
 
 		PQclear(result);
@@ -3144,6 +5970,80 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 }
 
 
+/*
+ * CheckBinaryResultColumnTypes errors out if the worker returned a built-in
+ * type for a column that differs from the type we expect, since the binary
+ * values can only be read using the receive function of the same type. The
+ * OIDs of other types are not the same across nodes and cannot be compared.
+ */
+static void
+CheckBinaryResultColumnTypes(DistributedExecution *execution, PGresult *result)
+{
+	TupleDesc tupleDescriptor = execution->tupleDescriptor;
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+		Oid expectedTypeId = attribute->atttypid;
+		Oid resultTypeId = PQftype(result, columnIndex);
+
+		if (expectedTypeId < FirstNormalObjectId && resultTypeId != expectedTypeId)
+		{
+			ereport(ERROR, (errmsg("unexpected type of column %d from worker: %u, "
+								   "expected %u", columnIndex + 1, resultTypeId,
+								   expectedTypeId),
+							errhint("Disable citus.enable_binary_protocol to read "
+									"the result in text format.")));
+		}
+	}
+}
+
+
+/*
+ * BuildTupleFromBinaryValues builds a tuple from the binary values in the
+ * given row of the result using the receive functions of the column types.
+ */
+static HeapTuple
+BuildTupleFromBinaryValues(DistributedExecution *execution, PGresult *result,
+						   int rowIndex)
+{
+	TupleDesc tupleDescriptor = execution->tupleDescriptor;
+	Datum *columnValues = execution->columnValues;
+	bool *columnNulls = execution->columnNulls;
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+		FmgrInfo *receiveFunction = &execution->receiveFunctions[columnIndex];
+		Oid typeIoParam = execution->receiveTypeIoParams[columnIndex];
+		StringInfoData valueBuffer;
+
+		if (PQgetisnull(result, rowIndex, columnIndex))
+		{
+			/* receive functions of domains check the constraints on NULL */
+			columnValues[columnIndex] = ReceiveFunctionCall(receiveFunction, NULL,
+															typeIoParam,
+															attribute->atttypmod);
+			columnNulls[columnIndex] = true;
+			continue;
+		}
+
+		/* libpq terminates the value with a zero byte, as StringInfo expects */
+		valueBuffer.data = PQgetvalue(result, rowIndex, columnIndex);
+		valueBuffer.len = PQgetlength(result, rowIndex, columnIndex);
+		valueBuffer.maxlen = valueBuffer.len + 1;
+		valueBuffer.cursor = 0;
+
+		columnValues[columnIndex] = ReceiveFunctionCall(receiveFunction, &valueBuffer,
+														typeIoParam,
+														attribute->atttypmod);
+		columnNulls[columnIndex] = false;
+	}
+
+	return heap_form_tuple(tupleDescriptor, columnValues, columnNulls);
+}
+
+
 /*
  * WorkerPoolFailed marks a worker pool and all the placement executions scheduled
  * on it as failed.
@@ -3235,6 +6135,15 @@ WorkerSessionFailed(WorkerSession *session)
 		PlacementExecutionDone(placementExecution, succeeded);
 	}
 
+	dlist_foreach(iter, &session->batchedTaskQueue)
+	{
+		placementExecution =
+			dlist_container(TaskPlacementExecution, sessionBatchedQueueNode, iter.cur);
+
+		/* tasks sent in the same command as the active task also failed */
+		PlacementExecutionDone(placementExecution, succeeded);
+	}
+
 	dlist_foreach(iter, &session->pendingTaskQueue)
 	{
 		placementExecution =
@@ -3268,11 +6177,34 @@ PlacementExecutionDone(TaskPlacementExecution *placementExecution, bool succeede
 		placementExecution->shardCommandExecution;
 	TaskExecutionState executionState = shardCommandExecution->executionState;
 	bool failedPlacementExecutionIsOnPendingQueue = false;
+	TaskExecutionInstrumentation *instrumentation = placementExecution->instrumentation;
+
+	if (instrumentation != NULL)
+	{
+		instrumentation->executionTime = ElapsedMilliseconds(instrumentation->startTime);
+		instrumentation->finished = succeeded;
+	}
 
 	/* mark the placement execution as finished */
-	if (succeeded)
+	if (succeeded && shardCommandExecution->resultPlacementExecution != NULL &&
+		shardCommandExecution->resultPlacementExecution != placementExecution)
+	{
+		/*
+		 * The rows of the hedged task come from the other placement execution,
+		 * which still needs to finish. If it fails, so does the task, since
+		 * the rows of this placement execution were discarded.
+		 */
+		placementExecution->executionState = PLACEMENT_EXECUTION_FAILED;
+	}
+	else if (succeeded)
 	{
 		placementExecution->executionState = PLACEMENT_EXECUTION_FINISHED;
+
+		if (placementExecution->startTime != 0)
+		{
+			RecordWorkerTaskDuration(workerPool->latencyStats,
+									 placementExecution->startTime);
+		}
 	}
 	else
 	{
@@ -3355,6 +6287,38 @@ ScheduleNextPlacementExecution(TaskPlacementExecution *placementExecution, bool
 		placementExecution->shardCommandExecution;
 	PlacementExecutionOrder executionOrder = shardCommandExecution->executionOrder;
 
+	if (shardCommandExecution->hedged)
+	{
+		/*
+		 * Placement executions of a hedged task do not fail in planning order,
+		 * only start another placement once none of them is in progress.
+		 */
+		for (int placementExecutionIndex = 0;
+			 placementExecutionIndex < shardCommandExecution->placementExecutionCount;
+			 placementExecutionIndex++)
+		{
+			TaskPlacementExecution *otherPlacementExecution =
+				shardCommandExecution->placementExecutions[placementExecutionIndex];
+			TaskPlacementExecutionState otherExecutionState =
+				otherPlacementExecution->executionState;
+
+			if (otherExecutionState == PLACEMENT_EXECUTION_READY ||
+				otherExecutionState == PLACEMENT_EXECUTION_RUNNING)
+			{
+				return;
+			}
+		}
+
+		TaskPlacementExecution *nextPlacementExecution =
+			NextIdlePlacementExecution(shardCommandExecution);
+		if (nextPlacementExecution != NULL)
+		{
+			PlacementExecutionReady(nextPlacementExecution);
+		}
+
+		return;
+	}
+
 	if ((executionOrder == EXECUTION_ORDER_ANY && !succeeded) ||
 		executionOrder == EXECUTION_ORDER_SEQUENTIAL)
 	{
@@ -3453,8 +6417,7 @@ PlacementExecutionReady(TaskPlacementExecution *placementExecution)
 			dlist_delete(&placementExecution->workerPendingQueueNode);
 
 			/* add to ready-to-start task queue */
-			dlist_push_tail(&workerPool->readyTaskQueue,
-							&placementExecution->workerReadyQueueNode);
+			PushUnassignedPlacementExecution(workerPool, placementExecution);
 		}
 
 		workerPool->readyTaskCount++;
@@ -3548,26 +6511,38 @@ TaskExecutionStateMachine(ShardCommandExecution *shardCommandExecution)
 
 
 /*
- * BuildWaitEventSet creates a WaitEventSet for the given array of connections
- * which can be used to wait for any of the sockets to become read-ready or
- * write-ready.
+ * RebuildWaitEventSet replaces the wait event set of the execution with one
+ * that contains the sessions that currently have a socket to wait on. The set
+ * has room for as many new sessions as there are sessions now, such that the
+ * set only needs to be rebuilt when connections are closed or when the number
+ * of sessions doubles.
  */
-static WaitEventSet *
-BuildWaitEventSet(List *sessionList)
+static void
+RebuildWaitEventSet(DistributedExecution *execution)
 {
 	ListCell *sessionCell = NULL;
+	dlist_mutable_iter iter;
+
+	/*
+	 * The execution might take a while, so explicitly free the previous
+	 * events at this point because we don't need them anymore.
+	 */
+	FreeExecutionWaitEvents(execution);
 
 	/* additional 2 is for postmaster and latch */
-	int eventSetSize = list_length(sessionList) + 2;
+	int eventSetSize = 2 * list_length(execution->sessionList) + 2;
 
 	WaitEventSet *waitEventSet =
 		CreateWaitEventSet(CurrentMemoryContext, eventSetSize);
+	int sessionCount = 0;
 
-	foreach(sessionCell, sessionList)
+	foreach(sessionCell, execution->sessionList)
 	{
 		WorkerSession *session = lfirst(sessionCell);
 		MultiConnection *connection = session->connection;
 
+		session->waitEventSetIndex = INVALID_WAIT_EVENT_SET_INDEX;
+
 		if (connection->pgConn == NULL)
 		{
 			/* connection died earlier in the transaction */
@@ -3591,29 +6566,48 @@ BuildWaitEventSet(List *sessionList)
 												  sock,
 												  NULL, (void *) session);
 		session->waitEventSetIndex = waitEventSetIndex;
+		sessionCount++;
 	}
 
 	AddWaitEventToSet(waitEventSet, WL_POSTMASTER_DEATH, PGINVALID_SOCKET, NULL, NULL);
 	AddWaitEventToSet(waitEventSet, WL_LATCH_SET, PGINVALID_SOCKET, MyLatch, NULL);
 
-	return waitEventSet;
+	/* all sessions are up to date in the new wait event set */
+	dlist_foreach_modify(iter, &execution->waitFlagsChangedSessions)
+	{
+		WorkerSession *session =
+			dlist_container(WorkerSession, waitFlagsChangedNode, iter.cur);
+
+		dlist_delete(iter.cur);
+		session->waitFlagsChanged = false;
+	}
+
+	execution->waitEventSet = waitEventSet;
+	execution->eventSetSize = eventSetSize;
+	execution->waitEventSetSessionCount = sessionCount;
+	execution->events = palloc0(eventSetSize * sizeof(WaitEvent));
 }
 
 
 /*
- * UpdateWaitEventSetFlags modifies the given waitEventSet with the wait flags
- * for connections in the sessionList.
+ * UpdateWaitEventSet modifies the events of the sessions whose wait flags
+ * changed in the wait event set of the execution, and adds the sessions that
+ * are not yet in it. The function returns false if a session does not fit in
+ * the wait event set, in which case the caller should rebuild it.
  */
-static void
-UpdateWaitEventSetFlags(WaitEventSet *waitEventSet, List *sessionList)
+static bool
+UpdateWaitEventSet(DistributedExecution *execution)
 {
-	ListCell *sessionCell = NULL;
+	dlist_mutable_iter iter;
 
-	foreach(sessionCell, sessionList)
+	dlist_foreach_modify(iter, &execution->waitFlagsChangedSessions)
 	{
-		WorkerSession *session = lfirst(sessionCell);
+		WorkerSession *session =
+			dlist_container(WorkerSession, waitFlagsChangedNode, iter.cur);
 		MultiConnection *connection = session->connection;
-		int waitEventSetIndex = session->waitEventSetIndex;
+
+		dlist_delete(iter.cur);
+		session->waitFlagsChanged = false;
 
 		if (connection->pgConn == NULL)
 		{
@@ -3634,8 +6628,25 @@ UpdateWaitEventSetFlags(WaitEventSet *waitEventSet, List *sessionList)
 			continue;
 		}
 
-		ModifyWaitEvent(waitEventSet, waitEventSetIndex, connection->waitFlags, NULL);
+		if (session->waitEventSetIndex != INVALID_WAIT_EVENT_SET_INDEX)
+		{
+			ModifyWaitEvent(execution->waitEventSet, session->waitEventSetIndex,
+							connection->waitFlags, NULL);
+		}
+		else if (execution->waitEventSetSessionCount + 2 < execution->eventSetSize)
+		{
+			session->waitEventSetIndex =
+				AddWaitEventToSet(execution->waitEventSet, connection->waitFlags, sock,
+								  NULL, (void *) session);
+			execution->waitEventSetSessionCount++;
+		}
+		else
+		{
+			return false;
+		}
 	}
+
+	return true;
 }
 
 
@@ -0,0 +1,463 @@
+/*-------------------------------------------------------------------------
+ *
+ * admission_control.c
+ *   Limits the number of distributed executions that run concurrently for
+ *   a role or for a tenant.
+ *
+ * Without a limit, a role or a tenant that runs many expensive multi-shard
+ * queries at the same time can use up the connections and the worker
+ * resources that latency-sensitive queries need. When
+ * citus.max_executions_per_role or citus.max_executions_per_tenant is set,
+ * a distributed execution first takes a slot from counters that all backends
+ * on the node share and waits for a slot when the limit is reached. The
+ * tenant of an execution is the value of the distribution column of a router
+ * query, also used as the partition key in citus_query_stats().
+ *
+ * Executions with citus.execution_priority set to high are admitted without
+ * waiting, though they do take slots, such that latency-sensitive roles can
+ * be kept from queuing behind the others.
+ *
+ * A backend takes slots only for its outermost execution. Executions that run
+ * while the backend holds slots, such as the subplans of the execution, are
+ * part of that execution.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "pgstat.h"
+#include "miscadmin.h"
+
+#include "access/hash.h"
+#include "access/xact.h"
+#include "distributed/admission_control.h"
+#include "distributed/citus_wait_events.h"
+#include "distributed/master_metadata_utility.h"
+#include "mb/pg_wchar.h"
+#include "storage/condition_variable.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/hsearch.h"
+
+
+#define ADMISSION_CONTROL_KEY_LENGTH NAMEDATALEN
+#define MAX_EXECUTION_SLOT_KEYS 2
+
+
+/*
+ * AdmissionControlSharedData holds the lock that protects the shared
+ * execution slot hash and the condition variable that backends waiting for
+ * a slot sleep on.
+ */
+typedef struct AdmissionControlSharedData
+{
+	int executionSlotHashTrancheId;
+	char *executionSlotHashTrancheName;
+
+	LWLock executionSlotHashLock;
+	ConditionVariable waitersConditionVariable;
+} AdmissionControlSharedData;
+
+
+/*
+ * The executions of a role are counted in the entry with the role's userId
+ * and an empty partition key, those of a tenant in the entry with the tenant's
+ * partition key and InvalidOid as userId.
+ */
+typedef struct ExecutionSlotHashKey
+{
+	Oid databaseId;
+	Oid userId;
+	char partitionKey[ADMISSION_CONTROL_KEY_LENGTH];
+} ExecutionSlotHashKey;
+
+/* hash entry for per role and per tenant execution counts */
+typedef struct ExecutionSlotHashEntry
+{
+	ExecutionSlotHashKey key;
+
+	int executionCount;
+} ExecutionSlotHashEntry;
+
+
+/* config variables managed via guc.c */
+int MaxExecutionsPerRole = 0;
+int MaxExecutionsPerTenant = 0;
+int CurrentExecutionPriority = EXECUTION_PRIORITY_NORMAL;
+
+
+/* the following two structs are used for accessing shared memory */
+static HTAB *ExecutionSlotHash = NULL;
+static AdmissionControlSharedData *AdmissionControlSharedState = NULL;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+/* slots that the current backend holds, and the subtransaction that took them */
+static ExecutionSlotHashKey HeldSlotKeys[MAX_EXECUTION_SLOT_KEYS];
+static int HeldSlotKeyCount = 0;
+static bool HoldsExecutionSlots = false;
+static SubTransactionId HeldSlotSubTransactionId = InvalidSubTransactionId;
+
+
+/* local function declarations */
+static bool TryToAcquireExecutionSlots(ExecutionSlotHashKey *slotKeys,
+									   int *slotLimits, int slotKeyCount);
+static void ReleaseExecutionSlots(void);
+static size_t AdmissionControlShmemSize(void);
+static void AdmissionControlShmemInit(void);
+
+
+/*
+ * AdmitDistributedExecution waits until the current backend may start a
+ * distributed execution for the current role and, if the execution has a
+ * partition key, for the tenant with the given partition key value. It
+ * returns whether slots were taken for the execution, in which case the
+ * caller should call FinishAdmittedExecution once the execution finished.
+ */
+bool
+AdmitDistributedExecution(Const *partitionKeyValue)
+{
+	ExecutionSlotHashKey slotKeys[MAX_EXECUTION_SLOT_KEYS];
+	int slotLimits[MAX_EXECUTION_SLOT_KEYS];
+	int slotKeyCount = 0;
+
+	if (HoldsExecutionSlots)
+	{
+		/* the execution is part of the execution that holds the slots */
+		return false;
+	}
+
+	memset(slotKeys, 0, sizeof(slotKeys));
+
+	if (MaxExecutionsPerRole > 0)
+	{
+		slotKeys[slotKeyCount].databaseId = MyDatabaseId;
+		slotKeys[slotKeyCount].userId = GetUserId();
+		slotLimits[slotKeyCount] = MaxExecutionsPerRole;
+		slotKeyCount++;
+	}
+
+	if (MaxExecutionsPerTenant > 0 && partitionKeyValue != NULL &&
+		!partitionKeyValue->constisnull)
+	{
+		char *partitionKey = DatumToString(partitionKeyValue->constvalue,
+										   partitionKeyValue->consttype);
+		int partitionKeyLength = pg_mbcliplen(partitionKey, strlen(partitionKey),
+											  ADMISSION_CONTROL_KEY_LENGTH - 1);
+
+		slotKeys[slotKeyCount].databaseId = MyDatabaseId;
+		slotKeys[slotKeyCount].userId = InvalidOid;
+		memcpy(slotKeys[slotKeyCount].partitionKey, partitionKey, partitionKeyLength);
+		slotLimits[slotKeyCount] = MaxExecutionsPerTenant;
+		slotKeyCount++;
+	}
+
+	if (slotKeyCount == 0)
+	{
+		return false;
+	}
+
+	if (CurrentExecutionPriority == EXECUTION_PRIORITY_HIGH)
+	{
+		/* high priority executions take slots without waiting for them */
+		memset(slotLimits, 0, sizeof(slotLimits));
+	}
+
+	ConditionVariable *waitersConditionVariable =
+		&AdmissionControlSharedState->waitersConditionVariable;
+
+	if (!TryToAcquireExecutionSlots(slotKeys, slotLimits, slotKeyCount))
+	{
+		ConditionVariablePrepareToSleep(waitersConditionVariable);
+
+		while (!TryToAcquireExecutionSlots(slotKeys, slotLimits, slotKeyCount))
+		{
+			/* ConditionVariableSleep also checks for interrupts */
+			ConditionVariableSleep(waitersConditionVariable,
+								   WAIT_EVENT_CITUS_EXECUTION_SLOT);
+		}
+
+		ConditionVariableCancelSleep();
+	}
+
+	HoldsExecutionSlots = true;
+	HeldSlotSubTransactionId = GetCurrentSubTransactionId();
+
+	return true;
+}
+
+
+/*
+ * FinishAdmittedExecution releases the slots that AdmitDistributedExecution
+ * took for an execution that finished.
+ */
+void
+FinishAdmittedExecution(void)
+{
+	ReleaseExecutionSlots();
+}
+
+
+/*
+ * AdmissionControlAtXactEnd releases the slots of an execution that did not
+ * finish because the transaction ended, most likely due to an error.
+ */
+void
+AdmissionControlAtXactEnd(void)
+{
+	ReleaseExecutionSlots();
+}
+
+
+/*
+ * AdmissionControlAtSubXactEnd releases the slots of an execution that was
+ * started in an aborted subtransaction, and passes the slots taken in a
+ * committed subtransaction on to the parent transaction.
+ */
+void
+AdmissionControlAtSubXactEnd(bool isCommit, SubTransactionId subId,
+							 SubTransactionId parentSubId)
+{
+	if (!HoldsExecutionSlots || HeldSlotSubTransactionId != subId)
+	{
+		return;
+	}
+
+	if (isCommit)
+	{
+		HeldSlotSubTransactionId = parentSubId;
+	}
+	else
+	{
+		ReleaseExecutionSlots();
+	}
+}
+
+
+/*
+ * TryToAcquireExecutionSlots increments the execution counters of the given
+ * keys if none of them reached its limit, and returns whether it did. A limit
+ * of 0 means that the counter is incremented regardless of its value.
+ *
+ * Counters for which no space is left in shared memory are not tracked, like
+ * in TryToIncrementSharedConnectionCounter.
+ */
+static bool
+TryToAcquireExecutionSlots(ExecutionSlotHashKey *slotKeys, int *slotLimits,
+						   int slotKeyCount)
+{
+	ExecutionSlotHashEntry *slotEntries[MAX_EXECUTION_SLOT_KEYS];
+	bool limitReached = false;
+
+	LWLockAcquire(&AdmissionControlSharedState->executionSlotHashLock, LW_EXCLUSIVE);
+
+	for (int keyIndex = 0; keyIndex < slotKeyCount; keyIndex++)
+	{
+		bool entryFound = false;
+
+		slotEntries[keyIndex] = hash_search(ExecutionSlotHash, &slotKeys[keyIndex],
+											HASH_ENTER_NULL, &entryFound);
+
+		if (slotEntries[keyIndex] == NULL)
+		{
+			continue;
+		}
+
+		if (!entryFound)
+		{
+			slotEntries[keyIndex]->executionCount = 0;
+		}
+
+		if (slotLimits[keyIndex] > 0 &&
+			slotEntries[keyIndex]->executionCount >= slotLimits[keyIndex])
+		{
+			limitReached = true;
+		}
+	}
+
+	if (limitReached)
+	{
+		for (int keyIndex = 0; keyIndex < slotKeyCount; keyIndex++)
+		{
+			/* remove the entries that were added above */
+			if (slotEntries[keyIndex] != NULL &&
+				slotEntries[keyIndex]->executionCount == 0)
+			{
+				hash_search(ExecutionSlotHash, &slotKeys[keyIndex], HASH_REMOVE, NULL);
+			}
+		}
+
+		LWLockRelease(&AdmissionControlSharedState->executionSlotHashLock);
+
+		return false;
+	}
+
+	HeldSlotKeyCount = 0;
+
+	for (int keyIndex = 0; keyIndex < slotKeyCount; keyIndex++)
+	{
+		ExecutionSlotHashEntry *slotEntry = slotEntries[keyIndex];
+
+		if (slotEntry == NULL)
+		{
+			ereport(DEBUG4, (errmsg("no space left in the shared execution slots, "
+									"not limiting the execution")));
+			continue;
+		}
+
+		slotEntry->executionCount++;
+		HeldSlotKeys[HeldSlotKeyCount++] = slotKeys[keyIndex];
+	}
+
+	LWLockRelease(&AdmissionControlSharedState->executionSlotHashLock);
+
+	return true;
+}
+
+
+/*
+ * ReleaseExecutionSlots decrements the execution counters of the slots that
+ * the current backend holds, if any, and wakes up the backends that wait
+ * for a slot.
+ */
+static void
+ReleaseExecutionSlots(void)
+{
+	if (!HoldsExecutionSlots)
+	{
+		return;
+	}
+
+	LWLockAcquire(&AdmissionControlSharedState->executionSlotHashLock, LW_EXCLUSIVE);
+
+	for (int keyIndex = 0; keyIndex < HeldSlotKeyCount; keyIndex++)
+	{
+		bool entryFound = false;
+
+		ExecutionSlotHashEntry *slotEntry =
+			hash_search(ExecutionSlotHash, &HeldSlotKeys[keyIndex], HASH_FIND,
+						&entryFound);
+
+		if (!entryFound)
+		{
+			continue;
+		}
+
+		slotEntry->executionCount--;
+
+		if (slotEntry->executionCount <= 0)
+		{
+			/* free the entry for other roles and tenants */
+			hash_search(ExecutionSlotHash, &HeldSlotKeys[keyIndex], HASH_REMOVE,
+						NULL);
+		}
+	}
+
+	LWLockRelease(&AdmissionControlSharedState->executionSlotHashLock);
+
+	HoldsExecutionSlots = false;
+	HeldSlotKeyCount = 0;
+	HeldSlotSubTransactionId = InvalidSubTransactionId;
+
+	ConditionVariableBroadcast(&AdmissionControlSharedState->waitersConditionVariable);
+}
+
+
+/*
+ * InitializeAdmissionControl requests the necessary shared memory from
+ * Postgres and sets up the shared memory startup hook.
+ */
+void
+InitializeAdmissionControl(void)
+{
+	/* allocate shared memory */
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(AdmissionControlShmemSize());
+	}
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = AdmissionControlShmemInit;
+}
+
+
+/*
+ * AdmissionControlShmemSize returns the size that should be allocated on the
+ * shared memory for the execution slots. Every backend holds at most one
+ * slot for its role and one for its tenant.
+ */
+static size_t
+AdmissionControlShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(AdmissionControlSharedData));
+
+	Size hashSize = hash_estimate_size(MaxConnections * MAX_EXECUTION_SLOT_KEYS,
+									   sizeof(ExecutionSlotHashEntry));
+
+	size = add_size(size, hashSize);
+
+	return size;
+}
+
+
+/*
+ * AdmissionControlShmemInit initializes the shared memory used for keeping
+ * track of the execution slots across backends.
+ */
+static void
+AdmissionControlShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL info;
+	int maxEntryCount = MaxConnections * MAX_EXECUTION_SLOT_KEYS;
+
+	/* create (database, role, partition key) -> [counter] */
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(ExecutionSlotHashKey);
+	info.entrysize = sizeof(ExecutionSlotHashEntry);
+	info.hash = tag_hash;
+	uint32 hashFlags = (HASH_ELEM | HASH_FUNCTION);
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	/* allocate space and initialize the shared state */
+	AdmissionControlSharedState =
+		(AdmissionControlSharedData *) ShmemInitStruct(
+			"Admission Control Data",
+			sizeof(AdmissionControlSharedData),
+			&alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		AdmissionControlSharedState->executionSlotHashTrancheId = LWLockNewTrancheId();
+		AdmissionControlSharedState->executionSlotHashTrancheName =
+			"Execution Slot Hash Tranche";
+		LWLockRegisterTranche(AdmissionControlSharedState->executionSlotHashTrancheId,
+							  AdmissionControlSharedState->executionSlotHashTrancheName);
+
+		LWLockInitialize(&AdmissionControlSharedState->executionSlotHashLock,
+						 AdmissionControlSharedState->executionSlotHashTrancheId);
+
+		ConditionVariableInit(&AdmissionControlSharedState->waitersConditionVariable);
+	}
+
+	/* allocate hash table */
+	ExecutionSlotHash =
+		ShmemInitHash("Execution Slot Hash", maxEntryCount, maxEntryCount, &info,
+					  hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	Assert(ExecutionSlotHash != NULL);
+	Assert(AdmissionControlSharedState->executionSlotHashTrancheId != 0);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
@@ -11,15 +11,21 @@
 
 #include "miscadmin.h"
 
+#include "access/transam.h"
 #include "commands/copy.h"
+#include "distributed/admission_control.h"
 #include "distributed/backend_data.h"
 #include "distributed/citus_clauses.h"
 #include "distributed/citus_custom_scan.h"
 #include "distributed/deparse_shard_query.h"
 #include "distributed/distributed_execution_locks.h"
+#include "distributed/distributed_planner.h"
 #include "distributed/insert_select_executor.h"
 #include "distributed/insert_select_planner.h"
+#include "distributed/intermediate_result_scan.h"
+#include "distributed/master_metadata_utility.h"
 #include "distributed/multi_executor.h"
+#include "distributed/multi_join_order.h"
 #include "distributed/multi_server_executor.h"
 #include "distributed/multi_router_planner.h"
 #include "distributed/query_stats.h"
@@ -27,10 +33,15 @@
 #include "distributed/worker_protocol.h"
 #include "executor/executor.h"
 #include "nodes/makefuncs.h"
+#include "utils/inval.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
 
 
+/* config variable managed via guc.c */
+bool EnableRouterParameterPassing = false;
+
+
 /* functions for creating custom scan nodes */
 static Node * AdaptiveExecutorCreateScan(CustomScan *scan);
 static Node * TaskTrackerCreateScan(CustomScan *scan);
@@ -40,6 +51,12 @@ static Node * DelayedErrorCreateScan(CustomScan *scan);
 /* functions that are common to different scans */
 static void CitusBeginScan(CustomScanState *node, EState *estate, int eflags);
 static void CitusModifyBeginScan(CustomScanState *node, EState *estate, int eflags);
+static void CitusSelectBeginScan(CustomScanState *node, EState *estate, int eflags);
+static DistributedPlan * CopyDistributedPlanForExecution(DistributedPlan *originalPlan,
+														 bool copyJobQuery);
+static void ReloadTaskPlacementLists(List *taskList);
+static bool CanPassParametersToWorkers(ParamListInfo paramListInfo);
+static List * DistributionColumnResnoList(Query *jobQuery);
 static void CitusEndScan(CustomScanState *node);
 static void CitusReScan(CustomScanState *node);
 
@@ -107,6 +124,7 @@ RegisterCitusCustomScanMethods(void)
 	RegisterCustomScanMethods(&TaskTrackerCustomScanMethods);
 	RegisterCustomScanMethods(&CoordinatorInsertSelectCustomScanMethods);
 	RegisterCustomScanMethods(&DelayedErrorCustomScanMethods);
+	RegisterCustomScanMethods(&IntermediateResultCustomScanMethods);
 }
 
 
@@ -125,18 +143,35 @@ CitusBeginScan(CustomScanState *node, EState *estate, int eflags)
 
 	CitusScanState *scanState = (CitusScanState *) node;
 
+	INSTR_TIME_SET_CURRENT(scanState->startTime);
+
 #if PG_VERSION_NUM >= 120000
 	ExecInitResultSlot(&scanState->customScanState.ss.ps, &TTSOpsMinimalTuple);
 #endif
 
+	/* rows are only streamed when the scan never needs to go back */
+	scanState->canStreamResults =
+		(eflags & (EXEC_FLAG_BACKWARD | EXEC_FLAG_MARK | EXEC_FLAG_REWIND)) == 0;
+
 	distributedPlan = scanState->distributedPlan;
-	if (distributedPlan->modLevel == ROW_MODIFY_READONLY ||
-		distributedPlan->insertSelectSubquery != NULL)
+	if (distributedPlan->insertSelectSubquery != NULL)
 	{
 		/* no more action required */
 		return;
 	}
 
+	if (distributedPlan->modLevel == ROW_MODIFY_READONLY)
+	{
+		Job *workerJob = distributedPlan->workerJob;
+
+		if (workerJob != NULL && workerJob->deferredPruning)
+		{
+			CitusSelectBeginScan(node, estate, eflags);
+		}
+
+		return;
+	}
+
 	CitusModifyBeginScan(node, estate, eflags);
 }
 
@@ -159,12 +194,56 @@ CitusExecScan(CustomScanState *node)
 		scanState->finishedRemoteScan = true;
 	}
 
+	if (scanState->distributedExecution != NULL)
+	{
+		/* the execution is still running and returns rows as they arrive */
+		return ReturnTupleFromDistributedExecution(scanState);
+	}
+
 	TupleTableSlot *resultSlot = ReturnTupleFromTuplestore(scanState);
 
 	return resultSlot;
 }
 
 
+/*
+ * CitusSelectBeginScan performs the shard pruning of a fast path SELECT query
+ * that compares the distribution key with a parameter in a generic plan, or
+ * with an expression such as a stable function call. The parameters in the
+ * WHERE clause are replaced with their values and the expression is evaluated,
+ * such that the shard can be picked based on the value of the distribution key.
+ */
+static void
+CitusSelectBeginScan(CustomScanState *node, EState *estate, int eflags)
+{
+	CitusScanState *scanState = (CitusScanState *) node;
+	DeferredErrorMessage *planningError = NULL;
+
+	/*
+	 * We must not change the distributed plan since it may be reused across multiple
+	 * executions of a prepared statement, see CitusModifyBeginScan. The job query
+	 * is modified below, so it needs to be copied.
+	 */
+	DistributedPlan *distributedPlan = scanState->distributedPlan =
+		CopyDistributedPlanForExecution(scanState->distributedPlan, true);
+
+	Job *workerJob = distributedPlan->workerJob;
+	Query *jobQuery = workerJob->jobQuery;
+	ParamListInfo paramListInfo = estate->es_param_list_info;
+
+	jobQuery->jointree->quals =
+		ResolveExternalParams(jobQuery->jointree->quals, copyParamList(paramListInfo));
+
+	EvaluateFastPathDistributionKeyValue(jobQuery, &(scanState->customScanState.ss.ps));
+
+	PlanDeferredRouterSelectJob(workerJob, &planningError);
+	if (planningError != NULL)
+	{
+		RaiseDeferredError(planningError, ERROR);
+	}
+}
+
+
 /*
  * CitusModifyBeginScan first evaluates expressions in the query and then
  * performs shard pruning in case the partition column in an insert was
@@ -180,11 +259,16 @@ CitusModifyBeginScan(CustomScanState *node, EState *estate, int eflags)
 
 	/*
 	 * We must not change the distributed plan since it may be reused across multiple
-	 * executions of a prepared statement. Instead we create a deep copy that we only
-	 * use for the current execution.
+	 * executions of a prepared statement. Instead we create a copy that we only use
+	 * for the current execution. The job query is only modified when expressions
+	 * need to be evaluated on the coordinator.
 	 */
-	DistributedPlan *distributedPlan = scanState->distributedPlan = copyObject(
-		scanState->distributedPlan);
+	DistributedPlan *originalPlan = scanState->distributedPlan;
+	Job *originalJob = originalPlan->workerJob;
+	bool copyJobQuery = originalJob->requiresMasterEvaluation &&
+						originalJob->masterEvaluationResnoList == NIL;
+	DistributedPlan *distributedPlan = scanState->distributedPlan =
+		CopyDistributedPlanForExecution(originalPlan, copyJobQuery);
 
 	Job *workerJob = distributedPlan->workerJob;
 	Query *jobQuery = workerJob->jobQuery;
@@ -194,16 +278,51 @@ CitusModifyBeginScan(CustomScanState *node, EState *estate, int eflags)
 	{
 		PlanState *planState = &(scanState->customScanState.ss.ps);
 		EState *executorState = planState->state;
+		ParamListInfo paramListInfo = executorState->es_param_list_info;
+		List *resnoList = workerJob->masterEvaluationResnoList;
 
-		ExecuteMasterEvaluableFunctions(jobQuery, planState);
+		/*
+		 * Deferred pruning needs a constant distribution column value. Only
+		 * for single-row INSERTs can we evaluate it without also evaluating
+		 * the other parameters.
+		 */
+		bool passParameters = EnableRouterParameterPassing &&
+							  (resnoList != NIL || !workerJob->deferredPruning) &&
+							  CanPassParametersToWorkers(paramListInfo);
+
+		if (resnoList != NIL && passParameters)
+		{
+			/* parameters that are passed on only need to be evaluated for pruning */
+			resnoList = MutableTargetEntryResnos(jobQuery, resnoList);
+
+			if (workerJob->deferredPruning)
+			{
+				resnoList = list_concat(resnoList, DistributionColumnResnoList(jobQuery));
+			}
+		}
+
+		if (resnoList != NIL)
+		{
+			/* only some target entries need evaluation, leave the rest shared */
+			jobQuery = workerJob->jobQuery =
+				ExecuteMasterEvaluableTargetEntries(jobQuery, resnoList, planState);
+		}
+		else if (workerJob->masterEvaluationResnoList == NIL)
+		{
+			ExecuteMasterEvaluableFunctions(jobQuery, planState, passParameters);
+		}
 
 		/*
-		 * We've processed parameters in ExecuteMasterEvaluableFunctions and
-		 * don't need to send their values to workers, since they will be
-		 * represented as constants in the deparsed query. To avoid sending
-		 * parameter values, we set the parameter list to NULL.
+		 * Unless we pass them on, we've processed parameters in
+		 * ExecuteMasterEvaluableFunctions and don't need to send their values
+		 * to workers, since they will be represented as constants in the
+		 * deparsed query. To avoid sending parameter values, we set the
+		 * parameter list to NULL.
 		 */
-		executorState->es_param_list_info = NULL;
+		if (!passParameters)
+		{
+			executorState->es_param_list_info = NULL;
+		}
 
 		if (workerJob->deferredPruning)
 		{
@@ -227,6 +346,9 @@ CitusModifyBeginScan(CustomScanState *node, EState *estate, int eflags)
 	/* prevent concurrent placement changes */
 	AcquireMetadataLocks(taskList);
 
+	/* a shard move may have committed while we waited for the locks */
+	ReloadTaskPlacementLists(taskList);
+
 	/*
 	 * We are taking locks on partitions of partitioned tables. These locks are
 	 * necessary for locking tables that appear in the SELECT part of the query.
@@ -238,6 +360,146 @@ CitusModifyBeginScan(CustomScanState *node, EState *estate, int eflags)
 }
 
 
+/*
+ * ReloadTaskPlacementLists replaces the placements that the planner found for
+ * the given modify tasks with the current placements of their anchor shards.
+ * Shard moves replace placements while holding the shard metadata locks, so
+ * a modification that waited for a move would otherwise write to the source
+ * placement, which the move dropped.
+ */
+static void
+ReloadTaskPlacementLists(List *taskList)
+{
+	ListCell *taskCell = NULL;
+
+	/* see placement changes that committed while we waited for the locks */
+	AcceptInvalidationMessages();
+
+	foreach(taskCell, taskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+		List *placementList = NIL;
+
+		if (task->anchorShardId == INVALID_SHARD_ID)
+		{
+			continue;
+		}
+
+		placementList = FinalizedShardPlacementList(task->anchorShardId);
+		if (placementList != NIL)
+		{
+			task->taskPlacementList = placementList;
+		}
+	}
+}
+
+
+/*
+ * CanPassParametersToWorkers returns whether the given parameters can be sent
+ * to the workers along with shard queries that reference them as $n, instead
+ * of being evaluated into constants in the query strings. That keeps the query
+ * strings the same across executions, such that the workers can cache their
+ * plans and pg_stat_statements can group them.
+ *
+ * Parameters of some target entries might still be evaluated, after which the
+ * shard queries do not reference them. The workers then need their types, so
+ * we do not pass on parameters of custom types, which we send without a type.
+ * Parameter lists with dynamic parameters, such as those of PL/pgSQL, are not
+ * passed on either.
+ */
+static bool
+CanPassParametersToWorkers(ParamListInfo paramListInfo)
+{
+	if (paramListInfo == NULL)
+	{
+		return false;
+	}
+
+	if (paramListInfo->paramFetch != NULL)
+	{
+		return false;
+	}
+
+	for (int parameterIndex = 0; parameterIndex < paramListInfo->numParams;
+		 parameterIndex++)
+	{
+		if (paramListInfo->params[parameterIndex].ptype >= FirstNormalObjectId)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * DistributionColumnResnoList returns a list with the resno of the target entry
+ * of the distribution column of the INSERT job query, or NIL if the table does
+ * not have one.
+ */
+static List *
+DistributionColumnResnoList(Query *jobQuery)
+{
+	RangeTblEntry *resultRte = ExtractResultRelationRTE(jobQuery);
+	Var *partitionColumn = PartitionColumn(resultRte->relid, 1);
+
+	if (partitionColumn == NULL)
+	{
+		return NIL;
+	}
+
+	return list_make1_int(partitionColumn->varattno);
+}
+
+
+/*
+ * CopyDistributedPlanForExecution returns a copy of the given distributed plan
+ * that the begin scan functions can modify without affecting later executions
+ * of a cached plan.
+ *
+ * Deep copying the whole plan with copyObject() is expensive for plans with
+ * many tasks, while execution only replaces fields of the distributed plan,
+ * the worker job and the tasks rather than modifying the data they point to.
+ * We therefore only make shallow copies of those, and deep copy the job query
+ * only when the caller is going to modify it in place.
+ */
+static DistributedPlan *
+CopyDistributedPlanForExecution(DistributedPlan *originalPlan, bool copyJobQuery)
+{
+	Job *originalJob = originalPlan->workerJob;
+	List *taskList = NIL;
+	ListCell *taskCell = NULL;
+
+	DistributedPlan *distributedPlan = palloc(sizeof(DistributedPlan));
+	memcpy(distributedPlan, originalPlan, sizeof(DistributedPlan));
+
+	Job *workerJob = palloc(sizeof(Job));
+	memcpy(workerJob, originalJob, sizeof(Job));
+
+	foreach(taskCell, originalJob->taskList)
+	{
+		Task *originalTask = (Task *) lfirst(taskCell);
+
+		Task *task = palloc(sizeof(Task));
+		memcpy(task, originalTask, sizeof(Task));
+
+		taskList = lappend(taskList, task);
+	}
+
+	workerJob->taskList = taskList;
+
+	if (copyJobQuery)
+	{
+		workerJob->jobQuery = copyObject(originalJob->jobQuery);
+	}
+
+	distributedPlan->workerJob = workerJob;
+
+	return distributedPlan;
+}
+
+
 /*
  * AdaptiveExecutorCreateScan creates the scan state for the adaptive executor.
  */
@@ -252,6 +514,20 @@ AdaptiveExecutorCreateScan(CustomScan *scan)
 
 	scanState->customScanState.methods = &AdaptiveExecutorCustomExecMethods;
 
+	/*
+	 * The plan may have been cached outside of a transaction block, in which
+	 * case the adaptive executor cannot run its repartition jobs now.
+	 */
+	if (RepartitionJobsRequireTaskTracker(scanState->distributedPlan))
+	{
+		ereport(DEBUG1, (errmsg("cannot use adaptive executor with repartition jobs"),
+						 errhint("Since you enabled citus.enable_repartition_joins "
+								 "Citus chose to use task-tracker.")));
+
+		scanState->executorType = MULTI_EXECUTOR_TASK_TRACKER;
+		scanState->customScanState.methods = &TaskTrackerCustomExecMethods;
+	}
+
 	return (Node *) scanState;
 }
 
@@ -333,8 +609,13 @@ CitusEndScan(CustomScanState *node)
 	}
 
 	/* queryId is not set if pg_stat_statements is not installed */
-	if (queryId != 0)
+	if (queryId != 0 && StatStatementsTrack != STAT_STATEMENTS_TRACK_NONE)
 	{
+		instr_time executionTime;
+
+		INSTR_TIME_SET_CURRENT(executionTime);
+		INSTR_TIME_SUBTRACT(executionTime, scanState->startTime);
+
 		if (partitionKeyConst != NULL && executorType == MULTI_EXECUTOR_ADAPTIVE)
 		{
 			partitionKeyString = DatumToString(partitionKeyConst->constvalue,
@@ -342,7 +623,16 @@ CitusEndScan(CustomScanState *node)
 		}
 
 		/* queries without partition key are also recorded */
-		CitusQueryStatsExecutorsEntry(queryId, executorType, partitionKeyString);
+		CitusQueryStatsExecutorsEntry(queryId, executorType, partitionKeyString,
+									  INSTR_TIME_GET_MILLISEC(executionTime));
+	}
+
+	EndStreamingExecution(scanState);
+
+	if (scanState->admittedExecution)
+	{
+		FinishAdmittedExecution();
+		scanState->admittedExecution = false;
 	}
 
 	if (scanState->tuplestorestate)
@@ -0,0 +1,757 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_intermediate_results.c
+ *   Functions for writing and reading intermediate results in a
+ *   column-chunked binary format.
+ *
+ * A columnar intermediate result file starts with a header that contains
+ * a signature, the format version, and the type of each column:
+ *
+ *   signature (11 bytes), version (int32), column count (int16),
+ *   column type oids (int32 each)
+ *
+ * The header is followed by chunks of up to COLUMNAR_RESULT_CHUNK_ROW_COUNT
+ * rows. Each chunk starts with its row count and byte length, followed by
+ * a block per column:
+ *
+ *   row count (int32), chunk length (int32)
+ *   for each column:
+ *     column length (int32), has min/max (int8),
+ *     [min length (int32), min value, max length (int32), max value],
+ *     null bitmap ((row count + 7) / 8 bytes),
+ *     for each non-null row: value length (int32), value
+ *
+ * Values are encoded using the send function of the column type, the same
+ * encoding that COPY uses in binary format, such that no text conversion is
+ * needed. Since every column block starts with its length, readers can skip
+ * columns they do not need without decoding them, and the per-chunk minimum
+ * and maximum values allow readers to skip chunks altogether. A chunk with a
+ * row count of 0 marks the end of the file.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include "access/transam.h"
+#include "access/tupdesc.h"
+#include "catalog/pg_type.h"
+#include "distributed/intermediate_results.h"
+#include "fmgr.h"
+#include "libpq/pqformat.h"
+#include "storage/fd.h"
+#include "utils/builtins.h"
+#include "utils/datum.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/tuplestore.h"
+#include "utils/typcache.h"
+
+
+/* maximum number of rows in a chunk */
+#define COLUMNAR_RESULT_CHUNK_ROW_COUNT 10000
+
+/* flush a chunk early once its values take up this many bytes */
+#define COLUMNAR_RESULT_CHUNK_BYTE_COUNT (8 * 1024 * 1024)
+
+#define COLUMNAR_RESULT_FORMAT_VERSION 1
+#define COLUMNAR_RESULT_SIGNATURE_LENGTH 11
+
+
+/* signature at the start of every columnar intermediate result file */
+static const char ColumnarResultSignature[COLUMNAR_RESULT_SIGNATURE_LENGTH] =
+	"CITUSCOL\n\377";
+
+
+/* per-column state of a ColumnarResultWriter */
+typedef struct ColumnarResultColumn
+{
+	/* function to encode values and the function to compare them, if any */
+	FmgrInfo sendFunction;
+	FmgrInfo *compareFunction;
+	Oid collation;
+
+	/* null bitmap and encoded values of the rows in the current chunk */
+	bits8 *nullBitmap;
+	StringInfo valueBuffer;
+
+	/* minimum and maximum non-null value in the current chunk */
+	bool hasMinMax;
+	Datum minValue;
+	Datum maxValue;
+	bool typeByValue;
+	int typeLength;
+} ColumnarResultColumn;
+
+
+/* ColumnarResultWriter buffers rows and serializes them into chunks */
+struct ColumnarResultWriter
+{
+	TupleDesc tupleDescriptor;
+	ColumnarResultColumn *columns;
+
+	/* memory context for the minimum and maximum values of the current chunk */
+	MemoryContext chunkContext;
+
+	/* number of rows and value bytes in the current chunk */
+	uint32 chunkRowCount;
+	uint64 chunkByteCount;
+};
+
+
+/* ColumnarResultReader returns the rows of a columnar file one at a time */
+struct ColumnarResultReader
+{
+	char *fileName;
+	FILE *file;
+	TupleDesc tupleDescriptor;
+
+	/* functions to decode the values of each column */
+	FmgrInfo *receiveFunctions;
+	Oid *typeIOParams;
+
+	/* reusable buffers for the raw chunk and for a single value */
+	StringInfo chunkData;
+	StringInfo attributeBuffer;
+
+	/* decoded values of the current chunk, allocated in chunkContext */
+	MemoryContext chunkContext;
+	Datum **chunkValues;
+	bool **chunkNulls;
+	uint32 rowCount;
+	uint32 rowIndex;
+	bool reachedEnd;
+};
+
+
+static void UpdateChunkMinMax(ColumnarResultWriter *writer,
+							  ColumnarResultColumn *column, Datum value);
+static void ReadColumnarResultData(FILE *file, StringInfo buffer, int length,
+								   const char *fileName);
+static bool ReadColumnarResultChunk(ColumnarResultReader *reader);
+static void ReadColumnarResultHeader(FILE *file, TupleDesc tupleDescriptor,
+									 const char *fileName);
+static void ReadColumnarResultColumn(StringInfo chunkData, uint32 rowCount,
+									 Form_pg_attribute attribute,
+									 FmgrInfo *receiveFunction,
+									 Oid typeIOParam, StringInfo attributeBuffer,
+									 Datum *columnValues, bool *columnNulls);
+
+
+/*
+ * CreateColumnarResultWriter creates a writer that serializes tuples with the
+ * given tuple descriptor in the columnar format. All columns need to have
+ * binary send functions, which is guaranteed by CanUseBinaryCopyFormat.
+ */
+ColumnarResultWriter *
+CreateColumnarResultWriter(TupleDesc tupleDescriptor)
+{
+	int columnCount = tupleDescriptor->natts;
+
+	ColumnarResultWriter *writer = palloc0(sizeof(ColumnarResultWriter));
+	writer->tupleDescriptor = tupleDescriptor;
+	writer->columns = palloc0(columnCount * sizeof(ColumnarResultColumn));
+	writer->chunkContext = AllocSetContextCreate(CurrentMemoryContext,
+												 "Columnar Result Chunk Context",
+												 ALLOCSET_DEFAULT_SIZES);
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+		ColumnarResultColumn *column = &writer->columns[columnIndex];
+		Oid sendFunctionId = InvalidOid;
+		bool typeVarLength = false;
+
+		getTypeBinaryOutputInfo(attribute->atttypid, &sendFunctionId, &typeVarLength);
+		fmgr_info(sendFunctionId, &column->sendFunction);
+
+		/* types without a btree comparison function do not get min/max values */
+		TypeCacheEntry *typeEntry = lookup_type_cache(attribute->atttypid,
+													  TYPECACHE_CMP_PROC_FINFO);
+		if (OidIsValid(typeEntry->cmp_proc_finfo.fn_oid))
+		{
+			column->compareFunction = &typeEntry->cmp_proc_finfo;
+		}
+
+		column->collation = attribute->attcollation;
+		column->typeByValue = attribute->attbyval;
+		column->typeLength = attribute->attlen;
+		column->nullBitmap = palloc0((COLUMNAR_RESULT_CHUNK_ROW_COUNT + 7) / 8);
+		column->valueBuffer = makeStringInfo();
+	}
+
+	return writer;
+}
+
+
+/*
+ * ColumnarResultWriteHeader appends the file header to the given buffer.
+ */
+void
+ColumnarResultWriteHeader(ColumnarResultWriter *writer, StringInfo outputBuffer)
+{
+	TupleDesc tupleDescriptor = writer->tupleDescriptor;
+	int columnCount = tupleDescriptor->natts;
+
+	appendBinaryStringInfo(outputBuffer, ColumnarResultSignature,
+						   COLUMNAR_RESULT_SIGNATURE_LENGTH);
+	pq_sendint32(outputBuffer, COLUMNAR_RESULT_FORMAT_VERSION);
+	pq_sendint16(outputBuffer, columnCount);
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+
+		pq_sendint32(outputBuffer, attribute->atttypid);
+	}
+}
+
+
+/*
+ * ColumnarResultAppendRow adds a row to the current chunk and returns whether
+ * the chunk is full, in which case the caller should flush it using
+ * ColumnarResultFlushChunk before appending more rows.
+ *
+ * The caller is expected to call this function in a short-lived memory
+ * context, since the send functions allocate their output in it.
+ */
+bool
+ColumnarResultAppendRow(ColumnarResultWriter *writer, Datum *columnValues,
+						bool *columnNulls)
+{
+	int columnCount = writer->tupleDescriptor->natts;
+	uint32 rowIndex = writer->chunkRowCount;
+
+	Assert(rowIndex < COLUMNAR_RESULT_CHUNK_ROW_COUNT);
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		ColumnarResultColumn *column = &writer->columns[columnIndex];
+
+		if (columnNulls[columnIndex])
+		{
+			column->nullBitmap[rowIndex / 8] |= (1 << (rowIndex % 8));
+			continue;
+		}
+
+		Datum value = columnValues[columnIndex];
+		bytea *encodedValue = SendFunctionCall(&column->sendFunction, value);
+		int encodedLength = VARSIZE(encodedValue) - VARHDRSZ;
+
+		pq_sendint32(column->valueBuffer, encodedLength);
+		appendBinaryStringInfo(column->valueBuffer, VARDATA(encodedValue),
+							   encodedLength);
+
+		writer->chunkByteCount += encodedLength + sizeof(int32);
+
+		if (column->compareFunction != NULL)
+		{
+			UpdateChunkMinMax(writer, column, value);
+		}
+	}
+
+	writer->chunkRowCount++;
+
+	return writer->chunkRowCount >= COLUMNAR_RESULT_CHUNK_ROW_COUNT ||
+		   writer->chunkByteCount >= COLUMNAR_RESULT_CHUNK_BYTE_COUNT;
+}
+
+
+/*
+ * UpdateChunkMinMax updates the minimum and maximum value of a column in the
+ * current chunk with the given value.
+ */
+static void
+UpdateChunkMinMax(ColumnarResultWriter *writer, ColumnarResultColumn *column,
+				  Datum value)
+{
+	bool updateMin = true;
+	bool updateMax = true;
+
+	if (column->hasMinMax)
+	{
+		Datum minComparison = FunctionCall2Coll(column->compareFunction,
+												column->collation, value,
+												column->minValue);
+		Datum maxComparison = FunctionCall2Coll(column->compareFunction,
+												column->collation, value,
+												column->maxValue);
+
+		updateMin = DatumGetInt32(minComparison) < 0;
+		updateMax = DatumGetInt32(maxComparison) > 0;
+	}
+
+	if (!updateMin && !updateMax)
+	{
+		return;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(writer->chunkContext);
+
+	if (updateMin)
+	{
+		column->minValue = datumCopy(value, column->typeByValue, column->typeLength);
+	}
+
+	if (updateMax)
+	{
+		column->maxValue = datumCopy(value, column->typeByValue, column->typeLength);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	column->hasMinMax = true;
+}
+
+
+/*
+ * ColumnarResultFlushChunk appends the rows in the current chunk to the given
+ * buffer and starts a new chunk. It does nothing if the chunk is empty.
+ */
+void
+ColumnarResultFlushChunk(ColumnarResultWriter *writer, StringInfo outputBuffer)
+{
+	int columnCount = writer->tupleDescriptor->natts;
+	uint32 rowCount = writer->chunkRowCount;
+	int nullBitmapLength = (rowCount + 7) / 8;
+
+	if (rowCount == 0)
+	{
+		return;
+	}
+
+	StringInfo chunkBuffer = makeStringInfo();
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		ColumnarResultColumn *column = &writer->columns[columnIndex];
+		StringInfoData columnHeader;
+
+		initStringInfo(&columnHeader);
+		pq_sendbyte(&columnHeader, column->hasMinMax ? 1 : 0);
+
+		if (column->hasMinMax)
+		{
+			bytea *encodedMin = SendFunctionCall(&column->sendFunction,
+												 column->minValue);
+			bytea *encodedMax = SendFunctionCall(&column->sendFunction,
+												 column->maxValue);
+
+			pq_sendint32(&columnHeader, VARSIZE(encodedMin) - VARHDRSZ);
+			appendBinaryStringInfo(&columnHeader, VARDATA(encodedMin),
+								   VARSIZE(encodedMin) - VARHDRSZ);
+			pq_sendint32(&columnHeader, VARSIZE(encodedMax) - VARHDRSZ);
+			appendBinaryStringInfo(&columnHeader, VARDATA(encodedMax),
+								   VARSIZE(encodedMax) - VARHDRSZ);
+		}
+
+		int columnLength = columnHeader.len + nullBitmapLength + column->valueBuffer->len;
+
+		pq_sendint32(chunkBuffer, columnLength);
+		appendBinaryStringInfo(chunkBuffer, columnHeader.data, columnHeader.len);
+		appendBinaryStringInfo(chunkBuffer, (char *) column->nullBitmap,
+							   nullBitmapLength);
+		appendBinaryStringInfo(chunkBuffer, column->valueBuffer->data,
+							   column->valueBuffer->len);
+
+		pfree(columnHeader.data);
+
+		/* reset the column for the next chunk */
+		memset(column->nullBitmap, 0, nullBitmapLength);
+		resetStringInfo(column->valueBuffer);
+		column->hasMinMax = false;
+	}
+
+	pq_sendint32(outputBuffer, rowCount);
+	pq_sendint32(outputBuffer, chunkBuffer->len);
+	appendBinaryStringInfo(outputBuffer, chunkBuffer->data, chunkBuffer->len);
+
+	pfree(chunkBuffer->data);
+	pfree(chunkBuffer);
+
+	MemoryContextReset(writer->chunkContext);
+	writer->chunkRowCount = 0;
+	writer->chunkByteCount = 0;
+}
+
+
+/*
+ * ColumnarResultWriteFooter flushes any remaining rows and appends the end of
+ * file marker to the given buffer.
+ */
+void
+ColumnarResultWriteFooter(ColumnarResultWriter *writer, StringInfo outputBuffer)
+{
+	ColumnarResultFlushChunk(writer, outputBuffer);
+
+	pq_sendint32(outputBuffer, 0);
+}
+
+
+/*
+ * IsColumnarResultFile returns whether the file with the given name starts
+ * with the signature of a columnar intermediate result.
+ */
+bool
+IsColumnarResultFile(const char *fileName)
+{
+	char signature[COLUMNAR_RESULT_SIGNATURE_LENGTH];
+
+	FILE *file = AllocateFile(fileName, PG_BINARY_R);
+	if (file == NULL)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not open file \"%s\": %m", fileName)));
+	}
+
+	size_t bytesRead = fread(signature, 1, COLUMNAR_RESULT_SIGNATURE_LENGTH, file);
+
+	FreeFile(file);
+
+	return bytesRead == COLUMNAR_RESULT_SIGNATURE_LENGTH &&
+		   memcmp(signature, ColumnarResultSignature,
+				  COLUMNAR_RESULT_SIGNATURE_LENGTH) == 0;
+}
+
+
+/*
+ * ReadColumnarResultFileIntoTupleStore parses the chunks in a columnar
+ * intermediate result file according to the given tuple descriptor and
+ * stores the records in a tuple store.
+ */
+void
+ReadColumnarResultFileIntoTupleStore(char *fileName, TupleDesc tupleDescriptor,
+									 Tuplestorestate *tupstore)
+{
+	int columnCount = tupleDescriptor->natts;
+	Datum *rowValues = palloc0(columnCount * sizeof(Datum));
+	bool *rowNulls = palloc0(columnCount * sizeof(bool));
+
+	ColumnarResultReader *reader = BeginColumnarResultRead(fileName, tupleDescriptor);
+
+	while (ColumnarResultReadNextRow(reader, rowValues, rowNulls))
+	{
+		tuplestore_putvalues(tupstore, tupleDescriptor, rowValues, rowNulls);
+	}
+
+	EndColumnarResultRead(reader);
+
+	pfree(rowValues);
+	pfree(rowNulls);
+}
+
+
+/*
+ * BeginColumnarResultRead opens a columnar intermediate result file, checks
+ * its header against the given tuple descriptor, and returns a reader that
+ * returns the rows one at a time using ColumnarResultReadNextRow.
+ */
+ColumnarResultReader *
+BeginColumnarResultRead(char *fileName, TupleDesc tupleDescriptor)
+{
+	int columnCount = tupleDescriptor->natts;
+
+	ColumnarResultReader *reader = palloc0(sizeof(ColumnarResultReader));
+	reader->fileName = pstrdup(fileName);
+	reader->tupleDescriptor = tupleDescriptor;
+	reader->receiveFunctions = palloc0(columnCount * sizeof(FmgrInfo));
+	reader->typeIOParams = palloc0(columnCount * sizeof(Oid));
+	reader->chunkValues = palloc0(columnCount * sizeof(Datum *));
+	reader->chunkNulls = palloc0(columnCount * sizeof(bool *));
+	reader->chunkData = makeStringInfo();
+	reader->attributeBuffer = makeStringInfo();
+	reader->chunkContext = AllocSetContextCreate(CurrentMemoryContext,
+												 "Columnar Result Chunk Context",
+												 ALLOCSET_DEFAULT_SIZES);
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+		Oid receiveFunctionId = InvalidOid;
+
+		getTypeBinaryInputInfo(attribute->atttypid, &receiveFunctionId,
+							   &reader->typeIOParams[columnIndex]);
+		fmgr_info(receiveFunctionId, &reader->receiveFunctions[columnIndex]);
+	}
+
+	reader->file = AllocateFile(fileName, PG_BINARY_R);
+	if (reader->file == NULL)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not open file \"%s\": %m", fileName)));
+	}
+
+	ReadColumnarResultHeader(reader->file, tupleDescriptor, fileName);
+
+	return reader;
+}
+
+
+/*
+ * ColumnarResultReadNextRow stores the values of the next row in the given
+ * arrays and returns true, or returns false if there are no more rows. The
+ * values remain valid until the next chunk is read, which happens at most
+ * once per call.
+ */
+bool
+ColumnarResultReadNextRow(ColumnarResultReader *reader, Datum *rowValues,
+						  bool *rowNulls)
+{
+	int columnCount = reader->tupleDescriptor->natts;
+
+	if (reader->rowIndex >= reader->rowCount)
+	{
+		if (reader->reachedEnd || !ReadColumnarResultChunk(reader))
+		{
+			reader->reachedEnd = true;
+			return false;
+		}
+	}
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		rowValues[columnIndex] = reader->chunkValues[columnIndex][reader->rowIndex];
+		rowNulls[columnIndex] = reader->chunkNulls[columnIndex][reader->rowIndex];
+	}
+
+	reader->rowIndex++;
+
+	return true;
+}
+
+
+/*
+ * EndColumnarResultRead closes the file of the reader and frees its memory.
+ */
+void
+EndColumnarResultRead(ColumnarResultReader *reader)
+{
+	FreeFile(reader->file);
+	MemoryContextDelete(reader->chunkContext);
+
+	pfree(reader->chunkData->data);
+	pfree(reader->chunkData);
+	pfree(reader->attributeBuffer->data);
+	pfree(reader->attributeBuffer);
+	pfree(reader->receiveFunctions);
+	pfree(reader->typeIOParams);
+	pfree(reader->chunkValues);
+	pfree(reader->chunkNulls);
+	pfree(reader->fileName);
+	pfree(reader);
+}
+
+
+/*
+ * ReadColumnarResultChunk reads the next chunk of the file into the reusable
+ * chunk buffer and decodes its columns. It returns false when the end of file
+ * marker is reached.
+ */
+static bool
+ReadColumnarResultChunk(ColumnarResultReader *reader)
+{
+	TupleDesc tupleDescriptor = reader->tupleDescriptor;
+	int columnCount = tupleDescriptor->natts;
+	StringInfo chunkData = reader->chunkData;
+
+	CHECK_FOR_INTERRUPTS();
+
+	ReadColumnarResultData(reader->file, chunkData, sizeof(int32), reader->fileName);
+	uint32 rowCount = pq_getmsgint(chunkData, sizeof(int32));
+	if (rowCount == 0)
+	{
+		/* end of file marker */
+		return false;
+	}
+
+	ReadColumnarResultData(reader->file, chunkData, sizeof(int32), reader->fileName);
+	int chunkLength = pq_getmsgint(chunkData, sizeof(int32));
+
+	ReadColumnarResultData(reader->file, chunkData, chunkLength, reader->fileName);
+
+	/* values of the previous chunk are no longer needed */
+	MemoryContextReset(reader->chunkContext);
+
+	MemoryContext oldContext = MemoryContextSwitchTo(reader->chunkContext);
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+
+		reader->chunkValues[columnIndex] = palloc0(rowCount * sizeof(Datum));
+		reader->chunkNulls[columnIndex] = palloc0(rowCount * sizeof(bool));
+
+		ReadColumnarResultColumn(chunkData, rowCount, attribute,
+								 &reader->receiveFunctions[columnIndex],
+								 reader->typeIOParams[columnIndex],
+								 reader->attributeBuffer,
+								 reader->chunkValues[columnIndex],
+								 reader->chunkNulls[columnIndex]);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	reader->rowCount = rowCount;
+	reader->rowIndex = 0;
+
+	return true;
+}
+
+
+/*
+ * ReadColumnarResultData reads exactly length bytes from the file into the
+ * given buffer, replacing its contents, and errors out on a short read.
+ */
+static void
+ReadColumnarResultData(FILE *file, StringInfo buffer, int length, const char *fileName)
+{
+	resetStringInfo(buffer);
+	enlargeStringInfo(buffer, length);
+
+	size_t bytesRead = fread(buffer->data, 1, length, file);
+	if (bytesRead != (size_t) length)
+	{
+		if (ferror(file))
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not read file \"%s\": %m", fileName)));
+		}
+
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+						errmsg("unexpected end of intermediate result file \"%s\"",
+							   fileName)));
+	}
+
+	buffer->len = length;
+	buffer->data[length] = '\0';
+}
+
+
+/*
+ * ReadColumnarResultHeader reads the header of a columnar intermediate result
+ * file and checks that it matches the expected tuple descriptor. Type OIDs
+ * of user-defined types differ between nodes, so we only compare built-in
+ * types.
+ */
+static void
+ReadColumnarResultHeader(FILE *file, TupleDesc tupleDescriptor, const char *fileName)
+{
+	StringInfo headerData = makeStringInfo();
+	int columnCount = tupleDescriptor->natts;
+
+	ReadColumnarResultData(file, headerData, COLUMNAR_RESULT_SIGNATURE_LENGTH +
+						   sizeof(int32) + sizeof(int16), fileName);
+
+	if (memcmp(headerData->data, ColumnarResultSignature,
+			   COLUMNAR_RESULT_SIGNATURE_LENGTH) != 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("intermediate result file \"%s\" is not in columnar "
+							   "format", fileName)));
+	}
+
+	headerData->cursor = COLUMNAR_RESULT_SIGNATURE_LENGTH;
+
+	int formatVersion = pq_getmsgint(headerData, sizeof(int32));
+	if (formatVersion != COLUMNAR_RESULT_FORMAT_VERSION)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("unsupported columnar intermediate result version %d",
+							   formatVersion)));
+	}
+
+	int fileColumnCount = pq_getmsgint(headerData, sizeof(int16));
+	if (fileColumnCount != columnCount)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("intermediate result has %d columns, but the column "
+							   "definition list has %d columns", fileColumnCount,
+							   columnCount)));
+	}
+
+	ReadColumnarResultData(file, headerData, columnCount * sizeof(int32), fileName);
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+		Oid fileTypeId = pq_getmsgint(headerData, sizeof(int32));
+
+		if (fileTypeId < FirstNormalObjectId &&
+			attribute->atttypid < FirstNormalObjectId &&
+			fileTypeId != attribute->atttypid)
+		{
+			ereport(ERROR, (errcode(ERRCODE_DATATYPE_MISMATCH),
+							errmsg("column %d of the intermediate result has type %s, "
+								   "but type %s was expected", columnIndex + 1,
+								   format_type_be(fileTypeId),
+								   format_type_be(attribute->atttypid))));
+		}
+	}
+
+	pfree(headerData->data);
+	pfree(headerData);
+}
+
+
+/*
+ * ReadColumnarResultColumn decodes the block of a single column in a chunk
+ * into the given value and null arrays.
+ */
+static void
+ReadColumnarResultColumn(StringInfo chunkData, uint32 rowCount,
+						 Form_pg_attribute attribute, FmgrInfo *receiveFunction,
+						 Oid typeIOParam, StringInfo attributeBuffer,
+						 Datum *columnValues, bool *columnNulls)
+{
+	int columnLength = pq_getmsgint(chunkData, sizeof(int32));
+	int columnEnd = chunkData->cursor + columnLength;
+
+	bool hasMinMax = pq_getmsgbyte(chunkData) != 0;
+	if (hasMinMax)
+	{
+		/* skip the min/max values, all rows are returned */
+		int minLength = pq_getmsgint(chunkData, sizeof(int32));
+		pq_getmsgbytes(chunkData, minLength);
+
+		int maxLength = pq_getmsgint(chunkData, sizeof(int32));
+		pq_getmsgbytes(chunkData, maxLength);
+	}
+
+	const bits8 *nullBitmap = (const bits8 *) pq_getmsgbytes(chunkData,
+															  (rowCount + 7) / 8);
+
+	for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		if (nullBitmap[rowIndex / 8] & (1 << (rowIndex % 8)))
+		{
+			columnNulls[rowIndex] = true;
+			continue;
+		}
+
+		int valueLength = pq_getmsgint(chunkData, sizeof(int32));
+		const char *valueData = pq_getmsgbytes(chunkData, valueLength);
+
+		/* receive functions expect a null-terminated buffer */
+		resetStringInfo(attributeBuffer);
+		appendBinaryStringInfo(attributeBuffer, valueData, valueLength);
+
+		columnValues[rowIndex] = ReceiveFunctionCall(receiveFunction, attributeBuffer,
+													 typeIOParam, attribute->atttypmod);
+
+		if (attributeBuffer->cursor != attributeBuffer->len)
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+							errmsg("incorrect binary data format in intermediate "
+								   "result column %d", attribute->attnum)));
+		}
+	}
+
+	if (chunkData->cursor != columnEnd)
+	{
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+						errmsg("corrupted column block in intermediate result")));
+	}
+}
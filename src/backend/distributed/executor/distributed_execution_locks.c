@@ -17,6 +17,8 @@
 #include "distributed/transaction_management.h"
 
 
+static LOCKMODE MultiShardLockMode(Task *task);
+static void LockAnchorShardIdArrays(List *taskList);
 static bool RequiresConsistentSnapshot(Task *task);
 static void AcquireExecutorShardLockForRowModify(Task *task, RowModifyLevel modLevel);
 static void AcquireExecutorShardLocksForRelationRowLockList(List *relationRowLockList);
@@ -83,16 +85,25 @@ AcquireExecutorShardLocks(Task *task, RowModifyLevel modLevel)
  * in the same order on all placements. It does not conflict with
  * RowExclusiveLock, which is normally obtained by single-shard, commutative
  * writes.
+ *
+ * When citus.enable_shard_range_locks or citus.enable_table_shard_locks is
+ * enabled, the anchor shards are locked in bulk, such that ranges of
+ * consecutive shard ids or all shards of a table take a single lock.
  */
 void
 AcquireExecutorMultiShardLocks(List *taskList)
 {
 	ListCell *taskCell = NULL;
+	bool lockShardsInBulk = EnableShardRangeLocks || EnableTableShardLocks;
+
+	if (lockShardsInBulk)
+	{
+		LockAnchorShardIdArrays(taskList);
+	}
 
 	foreach(taskCell, taskList)
 	{
 		Task *task = (Task *) lfirst(taskCell);
-		LOCKMODE lockMode = NoLock;
 
 		if (task->anchorShardId == INVALID_SHARD_ID)
 		{
@@ -100,50 +111,19 @@ AcquireExecutorMultiShardLocks(List *taskList)
 			continue;
 		}
 
-		if (AllModificationsCommutative || list_length(task->taskPlacementList) == 1)
+		if (!lockShardsInBulk)
 		{
-			/*
-			 * When all writes are commutative then we only need to prevent multi-shard
-			 * commands from running concurrently with each other and with commands
-			 * that are explicitly non-commutative. When there is no replication then
-			 * we only need to prevent concurrent multi-shard commands.
-			 *
-			 * In either case, ShareUpdateExclusive has the desired effect, since
-			 * it conflicts with itself and ExclusiveLock (taken by non-commutative
-			 * writes).
-			 *
-			 * However, some users find this too restrictive, so we allow them to
-			 * reduce to a RowExclusiveLock when citus.enable_deadlock_prevention
-			 * is enabled, which lets multi-shard modifications run in parallel as
-			 * long as they all disable the GUC.
-			 */
+			LOCKMODE lockMode = MultiShardLockMode(task);
 
-			if (EnableDeadlockPrevention)
-			{
-				lockMode = ShareUpdateExclusiveLock;
-			}
-			else
-			{
-				lockMode = RowExclusiveLock;
-			}
-		}
-		else
-		{
 			/*
-			 * When there is replication, prevent all concurrent writes to the same
-			 * shards to ensure the writes are ordered.
+			 * If we are dealing with a partition we are also taking locks on parent
+			 * table to prevent deadlocks on concurrent operations on a partition and
+			 * its parent.
 			 */
-
-			lockMode = ExclusiveLock;
+			LockParentShardResourceIfPartition(task->anchorShardId, lockMode);
+			LockShardResource(task->anchorShardId, lockMode);
 		}
 
-		/*
-		 * If we are dealing with a partition we are also taking locks on parent table
-		 * to prevent deadlocks on concurrent operations on a partition and its parent.
-		 */
-		LockParentShardResourceIfPartition(task->anchorShardId, lockMode);
-		LockShardResource(task->anchorShardId, lockMode);
-
 		/*
 		 * If the task has a subselect, then we may need to lock the shards from which
 		 * the query selects as well to prevent the subselects from seeing different
@@ -164,6 +144,102 @@ AcquireExecutorMultiShardLocks(List *taskList)
 }
 
 
+/*
+ * MultiShardLockMode returns the lock mode in which AcquireExecutorMultiShardLocks
+ * locks the anchor shard of the given task.
+ */
+static LOCKMODE
+MultiShardLockMode(Task *task)
+{
+	if (AllModificationsCommutative || list_length(task->taskPlacementList) == 1)
+	{
+		/*
+		 * When all writes are commutative then we only need to prevent multi-shard
+		 * commands from running concurrently with each other and with commands
+		 * that are explicitly non-commutative. When there is no replication then
+		 * we only need to prevent concurrent multi-shard commands.
+		 *
+		 * In either case, ShareUpdateExclusive has the desired effect, since
+		 * it conflicts with itself and ExclusiveLock (taken by non-commutative
+		 * writes).
+		 *
+		 * However, some users find this too restrictive, so we allow them to
+		 * reduce to a RowExclusiveLock when citus.enable_deadlock_prevention
+		 * is enabled, which lets multi-shard modifications run in parallel as
+		 * long as they all disable the GUC.
+		 */
+
+		if (EnableDeadlockPrevention)
+		{
+			return ShareUpdateExclusiveLock;
+		}
+		else
+		{
+			return RowExclusiveLock;
+		}
+	}
+
+	/*
+	 * When there is replication, prevent all concurrent writes to the same
+	 * shards to ensure the writes are ordered.
+	 */
+	return ExclusiveLock;
+}
+
+
+/*
+ * LockAnchorShardIdArrays locks the anchor shards of the given multi-shard
+ * tasks, and the parent shards of anchor shards that are partitions, using
+ * LockShardIdArrayResources for each lock mode.
+ */
+static void
+LockAnchorShardIdArrays(List *taskList)
+{
+	uint64 *shardIdArrays[MAX_LOCKMODES] = { NULL };
+	int shardIdCounts[MAX_LOCKMODES] = { 0 };
+	int taskCount = list_length(taskList);
+	ListCell *taskCell = NULL;
+
+	foreach(taskCell, taskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+
+		if (task->anchorShardId == INVALID_SHARD_ID)
+		{
+			continue;
+		}
+
+		LOCKMODE lockMode = MultiShardLockMode(task);
+
+		/*
+		 * If we are dealing with a partition we are also taking locks on parent table
+		 * to prevent deadlocks on concurrent operations on a partition and its parent.
+		 */
+		LockParentShardResourceIfPartition(task->anchorShardId, lockMode);
+
+		if (shardIdArrays[lockMode] == NULL)
+		{
+			shardIdArrays[lockMode] = palloc0(taskCount * sizeof(uint64));
+		}
+
+		shardIdArrays[lockMode][shardIdCounts[lockMode]++] = task->anchorShardId;
+	}
+
+	for (LOCKMODE lockMode = NoLock; lockMode < MAX_LOCKMODES; lockMode++)
+	{
+		if (shardIdArrays[lockMode] == NULL)
+		{
+			continue;
+		}
+
+		LockShardIdArrayResources(shardIdArrays[lockMode], shardIdCounts[lockMode],
+								  lockMode);
+
+		pfree(shardIdArrays[lockMode]);
+	}
+}
+
+
 /*
  * RequiresConsistentSnapshot returns true if the given task need to take
  * the necessary locks to ensure that a subquery in the modify query
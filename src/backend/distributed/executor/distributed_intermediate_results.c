@@ -0,0 +1,565 @@
+/*-------------------------------------------------------------------------
+ *
+ * distributed_intermediate_results.c
+ *   Functions for repartitioning the results of a distributed query across
+ *   the nodes of the shards of a hash-distributed table.
+ *
+ * The results of the tasks are partitioned on the nodes where they run, one
+ * intermediate result per shard of the target table. The nodes of the target
+ * shard placements then fetch the fragments of their shards directly from the
+ * nodes that hold them, such that no rows pass through the coordinator.
+ *
+ * All intermediate results are stored in the directory of the distributed
+ * transaction, they are removed when that transaction ends.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include "catalog/pg_collation.h"
+#include "catalog/pg_type.h"
+#include "distributed/commands/multi_copy.h"
+#include "distributed/deparse_shard_query.h"
+#include "distributed/distributed_planner.h"
+#include "distributed/intermediate_results.h"
+#include "distributed/master_metadata_utility.h"
+#include "distributed/multi_executor.h"
+#include "distributed/multi_physical_planner.h"
+#include "distributed/transaction_management.h"
+#include "distributed/version_compat.h"
+#include "executor/executor.h"
+#include "lib/stringinfo.h"
+#include "nodes/nodeFuncs.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/ruleutils.h"
+#include "utils/tuplestore.h"
+
+
+/* number of columns returned by the partitioning tasks */
+#define PARTITION_TASK_RESULT_COLUMNS 3
+
+
+/* fragments of a target shard placement that reside on one other node */
+typedef struct NodeFragmentsTransfer
+{
+	ShardPlacement *sourcePlacement;
+	List *resultIdList;
+} NodeFragmentsTransfer;
+
+
+static List * PartitionTaskListResults(char *resultIdPrefix, List *selectTaskList,
+									   int partitionColumnIndex,
+									   DistTableCacheEntry *targetRelation);
+static char * HashRangeArrayLiteral(DistTableCacheEntry *targetRelation,
+									bool minValues);
+static List ** GroupFragmentsByTargetShard(List *fragmentList, int shardCount);
+static void FetchFragmentsToTargetPlacements(List **fragmentListArray,
+											 DistTableCacheEntry *targetRelation);
+static List * NodeFragmentsTransferList(List *fragmentList,
+										ShardPlacement *targetPlacement);
+static char * FetchFragmentsQueryString(NodeFragmentsTransfer *transfer);
+static char * CountDistinctFragmentsQueryString(List *fragmentList,
+												Node *distinctExpression);
+
+
+/*
+ * RedistributeTaskListResults partitions the results of the given SELECT
+ * tasks by the hash ranges of the shards of the target relation, and makes
+ * the nodes of all target shard placements fetch the fragments of their shard
+ * that were written on other nodes. The function returns an array with the
+ * list of fragments of each shard, in the order of sortedShardIntervalArray.
+ */
+List **
+RedistributeTaskListResults(char *resultIdPrefix, List *selectTaskList,
+							int partitionColumnIndex,
+							DistTableCacheEntry *targetRelation)
+{
+	int shardCount = targetRelation->shardIntervalArrayLength;
+
+	List *fragmentList = PartitionTaskListResults(resultIdPrefix, selectTaskList,
+												  partitionColumnIndex,
+												  targetRelation);
+	List **fragmentListArray = GroupFragmentsByTargetShard(fragmentList, shardCount);
+
+	FetchFragmentsToTargetPlacements(fragmentListArray, targetRelation);
+
+	return fragmentListArray;
+}
+
+
+/*
+ * CountDistinctRedistributedTaskResults returns the number of distinct
+ * non-NULL values that the given SELECT tasks return in their only column.
+ * The values are partitioned by the hash ranges of the shards of the anchor
+ * relation of the tasks, such that equal values of all tasks end up on the
+ * same node, where the values of each hash range are counted.
+ */
+int64
+CountDistinctRedistributedTaskResults(char *resultIdPrefix, List *selectTaskList,
+									  Node *distinctExpression)
+{
+	List *valueTaskList = NIL;
+	List *countTaskList = NIL;
+	ListCell *taskCell = NULL;
+	uint32 taskId = 1;
+	int64 distinctCount = 0;
+	bool goForward = true;
+	bool doCopy = false;
+
+	Task *firstTask = (Task *) linitial(selectTaskList);
+	ShardInterval *anchorShardInterval = LoadShardInterval(firstTask->anchorShardId);
+	DistTableCacheEntry *relation =
+		DistributedTableCacheEntry(anchorShardInterval->relationId);
+	ShardInterval **shardIntervalArray = relation->sortedShardIntervalArray;
+
+	/* NULL is not counted, and cannot be partitioned */
+	foreach(taskCell, selectTaskList)
+	{
+		Task *valueTask = copyObject((Task *) lfirst(taskCell));
+		StringInfo valueQuery = makeStringInfo();
+
+		appendStringInfo(valueQuery,
+						 "SELECT * FROM (%s) AS distinct_values(value) "
+						 "WHERE value IS NOT NULL", TaskQueryString(valueTask));
+		valueTask->queryString = valueQuery->data;
+		valueTask->queryTemplate = NULL;
+
+		valueTaskList = lappend(valueTaskList, valueTask);
+	}
+
+	List **fragmentListArray = RedistributeTaskListResults(resultIdPrefix, valueTaskList,
+														   0, relation);
+
+	for (int shardIndex = 0; shardIndex < relation->shardIntervalArrayLength;
+		 shardIndex++)
+	{
+		List *fragmentList = fragmentListArray[shardIndex];
+		uint64 shardId = shardIntervalArray[shardIndex]->shardId;
+
+		if (fragmentList == NIL)
+		{
+			continue;
+		}
+
+		char *queryString = CountDistinctFragmentsQueryString(fragmentList,
+															  distinctExpression);
+
+		/* the fragments have been fetched to the nodes of all placements */
+		Task *countTask = CreateBasicTask(INVALID_JOB_ID, taskId, SELECT_TASK,
+										  queryString);
+		countTask->anchorShardId = shardId;
+		countTask->taskPlacementList = FinalizedShardPlacementList(shardId);
+
+		countTaskList = lappend(countTaskList, countTask);
+		taskId++;
+	}
+
+	if (countTaskList == NIL)
+	{
+		return 0;
+	}
+
+#if PG_VERSION_NUM >= 120000
+	TupleDesc resultDescriptor = CreateTemplateTupleDesc(1);
+#else
+	TupleDesc resultDescriptor = CreateTemplateTupleDesc(1, false);
+#endif
+	TupleDescInitEntry(resultDescriptor, (AttrNumber) 1, "count", INT8OID, -1, 0);
+
+	Tuplestorestate *resultStore = tuplestore_begin_heap(false, false, work_mem);
+
+	ExecuteTaskListExtended(ROW_MODIFY_READONLY, countTaskList, resultDescriptor,
+							resultStore, false, MaxAdaptiveExecutorPoolSize);
+
+	TupleTableSlot *resultSlot = MakeSingleTupleTableSlotCompat(resultDescriptor,
+																&TTSOpsMinimalTuple);
+
+	while (tuplestore_gettupleslot(resultStore, goForward, doCopy, resultSlot))
+	{
+		bool isNull = false;
+
+		distinctCount += DatumGetInt64(slot_getattr(resultSlot, 1, &isNull));
+
+		ExecClearTuple(resultSlot);
+	}
+
+	ExecDropSingleTupleTableSlot(resultSlot);
+	tuplestore_end(resultStore);
+
+	return distinctCount;
+}
+
+
+/*
+ * CountDistinctFragmentsQueryString returns the query that counts the
+ * distinct values in the given fragments, which are all on the same node.
+ */
+static char *
+CountDistinctFragmentsQueryString(List *fragmentList, Node *distinctExpression)
+{
+	StringInfo queryString = makeStringInfo();
+	StringInfo columnDefinition = makeStringInfo();
+	ListCell *fragmentCell = NULL;
+	Oid columnType = exprType(distinctExpression);
+	Oid columnCollation = exprCollation(distinctExpression);
+	bool useBinaryCopyFormat = CanUseBinaryCopyFormatForType(columnType);
+
+	appendStringInfo(columnDefinition, "value %s",
+					 format_type_with_typemod(columnType,
+											  exprTypmod(distinctExpression)));
+
+	/* values are distinct according to the collation of the column */
+	if (OidIsValid(columnCollation) && columnCollation != DEFAULT_COLLATION_OID)
+	{
+		appendStringInfo(columnDefinition, " COLLATE %s",
+						 generate_collation_name(columnCollation));
+	}
+
+	appendStringInfoString(queryString, "SELECT count(DISTINCT value) FROM (");
+
+	foreach(fragmentCell, fragmentList)
+	{
+		DistributedResultFragment *fragment =
+			(DistributedResultFragment *) lfirst(fragmentCell);
+
+		appendStringInfo(queryString,
+						 "%sSELECT * FROM read_intermediate_result(%s, %s) "
+						 "AS intermediate_result(%s)",
+						 fragmentCell != list_head(fragmentList) ? " UNION ALL " : "",
+						 quote_literal_cstr(fragment->resultId),
+						 quote_literal_cstr(useBinaryCopyFormat ? "binary" : "text"),
+						 columnDefinition->data);
+	}
+
+	appendStringInfoString(queryString, ") AS distinct_values");
+
+	return queryString->data;
+}
+
+
+/*
+ * PartitionTaskListResults wraps the given SELECT tasks in calls to
+ * worker_partition_query_result and runs them, each on the first placement
+ * of its task. It returns the list of non-empty fragments that the tasks
+ * wrote.
+ */
+static List *
+PartitionTaskListResults(char *resultIdPrefix, List *selectTaskList,
+						 int partitionColumnIndex, DistTableCacheEntry *targetRelation)
+{
+	List *partitionTaskList = NIL;
+	List *fragmentList = NIL;
+	ListCell *taskCell = NULL;
+	int taskIndex = 0;
+	bool goForward = true;
+	bool doCopy = false;
+
+	char *minValuesLiteral = HashRangeArrayLiteral(targetRelation, true);
+	char *maxValuesLiteral = HashRangeArrayLiteral(targetRelation, false);
+	ShardPlacement **sourcePlacementArray =
+		palloc0(list_length(selectTaskList) * sizeof(ShardPlacement *));
+
+	foreach(taskCell, selectTaskList)
+	{
+		Task *selectTask = (Task *) lfirst(taskCell);
+		ShardPlacement *sourcePlacement =
+			(ShardPlacement *) linitial(selectTask->taskPlacementList);
+		StringInfo taskResultIdPrefix = makeStringInfo();
+		StringInfo partitionQuery = makeStringInfo();
+
+		appendStringInfo(taskResultIdPrefix, "%s_from_%d_to", resultIdPrefix,
+						 taskIndex);
+		appendStringInfo(partitionQuery,
+						 "SELECT %d, partition_index, rows_written "
+						 "FROM worker_partition_query_result(%s, %s, %d, %s, %s)",
+						 taskIndex, quote_literal_cstr(taskResultIdPrefix->data),
+						 quote_literal_cstr(TaskQueryString(selectTask)),
+						 partitionColumnIndex, minValuesLiteral, maxValuesLiteral);
+
+		/* we need to know on which node the fragments of the task end up */
+		Task *partitionTask = copyObject(selectTask);
+		partitionTask->queryString = partitionQuery->data;
+		partitionTask->queryTemplate = NULL;
+		partitionTask->taskPlacementList = list_make1(sourcePlacement);
+
+		partitionTaskList = lappend(partitionTaskList, partitionTask);
+		sourcePlacementArray[taskIndex] = sourcePlacement;
+
+		taskIndex++;
+	}
+
+	/*
+	 * The fragments are written into the directory of the distributed
+	 * transaction, so the workers need to run the tasks with our distributed
+	 * transaction ID.
+	 */
+	BeginOrContinueCoordinatedTransaction();
+
+#if PG_VERSION_NUM >= 120000
+	TupleDesc resultDescriptor = CreateTemplateTupleDesc(PARTITION_TASK_RESULT_COLUMNS);
+#else
+	TupleDesc resultDescriptor =
+		CreateTemplateTupleDesc(PARTITION_TASK_RESULT_COLUMNS, false);
+#endif
+	TupleDescInitEntry(resultDescriptor, (AttrNumber) 1, "task_index", INT4OID, -1, 0);
+	TupleDescInitEntry(resultDescriptor, (AttrNumber) 2, "partition_index", INT4OID,
+					   -1, 0);
+	TupleDescInitEntry(resultDescriptor, (AttrNumber) 3, "rows_written", INT8OID, -1,
+					   0);
+
+	Tuplestorestate *resultStore = tuplestore_begin_heap(false, false, work_mem);
+
+	ExecuteTaskListExtended(ROW_MODIFY_READONLY, partitionTaskList, resultDescriptor,
+							resultStore, false, MaxAdaptiveExecutorPoolSize);
+
+	TupleTableSlot *resultSlot = MakeSingleTupleTableSlotCompat(resultDescriptor,
+																&TTSOpsMinimalTuple);
+
+	while (tuplestore_gettupleslot(resultStore, goForward, doCopy, resultSlot))
+	{
+		bool isNull = false;
+		int sourceTaskIndex = DatumGetInt32(slot_getattr(resultSlot, 1, &isNull));
+		int partitionIndex = DatumGetInt32(slot_getattr(resultSlot, 2, &isNull));
+		int64 rowCount = DatumGetInt64(slot_getattr(resultSlot, 3, &isNull));
+
+		if (sourceTaskIndex < 0 || sourceTaskIndex >= taskIndex ||
+			partitionIndex < 0 ||
+			partitionIndex >= targetRelation->shardIntervalArrayLength)
+		{
+			ereport(ERROR, (errmsg("unexpected partition %d of task %d",
+								   partitionIndex, sourceTaskIndex)));
+		}
+
+		DistributedResultFragment *fragment = palloc0(sizeof(DistributedResultFragment));
+		StringInfo resultId = makeStringInfo();
+
+		appendStringInfo(resultId, "%s_from_%d_to_%d", resultIdPrefix,
+						 sourceTaskIndex, partitionIndex);
+
+		fragment->resultId = resultId->data;
+		fragment->sourcePlacement = sourcePlacementArray[sourceTaskIndex];
+		fragment->targetShardIndex = partitionIndex;
+		fragment->rowCount = rowCount;
+
+		fragmentList = lappend(fragmentList, fragment);
+
+		ExecClearTuple(resultSlot);
+	}
+
+	ExecDropSingleTupleTableSlot(resultSlot);
+	tuplestore_end(resultStore);
+
+	return fragmentList;
+}
+
+
+/*
+ * HashRangeArrayLiteral returns an int[] literal with the minimum or maximum
+ * hash values of the shards of the given relation.
+ */
+static char *
+HashRangeArrayLiteral(DistTableCacheEntry *targetRelation, bool minValues)
+{
+	ShardInterval **shardIntervalArray = targetRelation->sortedShardIntervalArray;
+	StringInfo arrayLiteral = makeStringInfo();
+
+	appendStringInfoString(arrayLiteral, "'{");
+
+	for (int shardIndex = 0; shardIndex < targetRelation->shardIntervalArrayLength;
+		 shardIndex++)
+	{
+		ShardInterval *shardInterval = shardIntervalArray[shardIndex];
+		Datum hashValue = minValues ? shardInterval->minValue : shardInterval->maxValue;
+
+		appendStringInfo(arrayLiteral, "%s%d", shardIndex > 0 ? "," : "",
+						 DatumGetInt32(hashValue));
+	}
+
+	appendStringInfoString(arrayLiteral, "}'::int[]");
+
+	return arrayLiteral->data;
+}
+
+
+/*
+ * GroupFragmentsByTargetShard returns an array that holds the list of
+ * fragments of each target shard.
+ */
+static List **
+GroupFragmentsByTargetShard(List *fragmentList, int shardCount)
+{
+	List **fragmentListArray = palloc0(shardCount * sizeof(List *));
+	ListCell *fragmentCell = NULL;
+
+	foreach(fragmentCell, fragmentList)
+	{
+		DistributedResultFragment *fragment =
+			(DistributedResultFragment *) lfirst(fragmentCell);
+		int shardIndex = fragment->targetShardIndex;
+
+		fragmentListArray[shardIndex] = lappend(fragmentListArray[shardIndex],
+												fragment);
+	}
+
+	return fragmentListArray;
+}
+
+
+/*
+ * FetchFragmentsToTargetPlacements runs a task on the node of every target
+ * shard placement for each other node that holds fragments of the shard,
+ * which copies these fragments to the node of the placement.
+ */
+static void
+FetchFragmentsToTargetPlacements(List **fragmentListArray,
+								 DistTableCacheEntry *targetRelation)
+{
+	ShardInterval **shardIntervalArray = targetRelation->sortedShardIntervalArray;
+	int shardCount = targetRelation->shardIntervalArrayLength;
+	List *fetchTaskList = NIL;
+	uint32 taskId = 1;
+
+	for (int shardIndex = 0; shardIndex < shardCount; shardIndex++)
+	{
+		List *fragmentList = fragmentListArray[shardIndex];
+		ShardInterval *shardInterval = shardIntervalArray[shardIndex];
+		uint64 shardId = shardInterval->shardId;
+		ListCell *placementCell = NULL;
+
+		if (fragmentList == NIL)
+		{
+			continue;
+		}
+
+		List *placementList = FinalizedShardPlacementList(shardId);
+
+		foreach(placementCell, placementList)
+		{
+			ShardPlacement *targetPlacement = (ShardPlacement *) lfirst(placementCell);
+			List *transferList = NodeFragmentsTransferList(fragmentList,
+														   targetPlacement);
+			ListCell *transferCell = NULL;
+
+			foreach(transferCell, transferList)
+			{
+				NodeFragmentsTransfer *transfer =
+					(NodeFragmentsTransfer *) lfirst(transferCell);
+
+				Task *fetchTask = CreateBasicTask(INVALID_JOB_ID, taskId, SELECT_TASK,
+												  FetchFragmentsQueryString(transfer));
+				fetchTask->anchorShardId = shardId;
+				fetchTask->taskPlacementList = list_make1(targetPlacement);
+
+				fetchTaskList = lappend(fetchTaskList, fetchTask);
+				taskId++;
+			}
+		}
+	}
+
+	if (fetchTaskList == NIL)
+	{
+		return;
+	}
+
+#if PG_VERSION_NUM >= 120000
+	TupleDesc resultDescriptor = CreateTemplateTupleDesc(1);
+#else
+	TupleDesc resultDescriptor = CreateTemplateTupleDesc(1, false);
+#endif
+	TupleDescInitEntry(resultDescriptor, (AttrNumber) 1, "bytes_fetched", INT8OID, -1,
+					   0);
+
+	Tuplestorestate *resultStore = tuplestore_begin_heap(false, false, work_mem);
+
+	ExecuteTaskListExtended(ROW_MODIFY_READONLY, fetchTaskList, resultDescriptor,
+							resultStore, false, MaxAdaptiveExecutorPoolSize);
+
+	tuplestore_end(resultStore);
+}
+
+
+/*
+ * NodeFragmentsTransferList returns, for every node other than the node of the
+ * given placement, the IDs of the given fragments that reside on that node.
+ */
+static List *
+NodeFragmentsTransferList(List *fragmentList, ShardPlacement *targetPlacement)
+{
+	List *transferList = NIL;
+	ListCell *fragmentCell = NULL;
+
+	foreach(fragmentCell, fragmentList)
+	{
+		DistributedResultFragment *fragment =
+			(DistributedResultFragment *) lfirst(fragmentCell);
+		ShardPlacement *sourcePlacement = fragment->sourcePlacement;
+		NodeFragmentsTransfer *nodeTransfer = NULL;
+		ListCell *transferCell = NULL;
+
+		/* fragments on the node of the placement can be read as they are */
+		if (sourcePlacement->nodeId == targetPlacement->nodeId)
+		{
+			continue;
+		}
+
+		foreach(transferCell, transferList)
+		{
+			NodeFragmentsTransfer *transfer =
+				(NodeFragmentsTransfer *) lfirst(transferCell);
+
+			if (transfer->sourcePlacement->nodeId == sourcePlacement->nodeId)
+			{
+				nodeTransfer = transfer;
+				break;
+			}
+		}
+
+		if (nodeTransfer == NULL)
+		{
+			nodeTransfer = palloc0(sizeof(NodeFragmentsTransfer));
+			nodeTransfer->sourcePlacement = sourcePlacement;
+
+			transferList = lappend(transferList, nodeTransfer);
+		}
+
+		nodeTransfer->resultIdList = lappend(nodeTransfer->resultIdList,
+											 fragment->resultId);
+	}
+
+	return transferList;
+}
+
+
+/*
+ * FetchFragmentsQueryString returns the query that fetches the fragments of
+ * the given transfer from their node.
+ */
+static char *
+FetchFragmentsQueryString(NodeFragmentsTransfer *transfer)
+{
+	ShardPlacement *sourcePlacement = transfer->sourcePlacement;
+	StringInfo queryString = makeStringInfo();
+	ListCell *resultIdCell = NULL;
+
+	appendStringInfoString(queryString, "SELECT fetch_intermediate_results(ARRAY[");
+
+	foreach(resultIdCell, transfer->resultIdList)
+	{
+		char *resultId = (char *) lfirst(resultIdCell);
+
+		appendStringInfo(queryString, "%s%s",
+						 resultIdCell != list_head(transfer->resultIdList) ? "," : "",
+						 quote_literal_cstr(resultId));
+	}
+
+	appendStringInfo(queryString, "]::text[], %s, %d)",
+					 quote_literal_cstr(sourcePlacement->nodeName),
+					 sourcePlacement->nodePort);
+
+	return queryString->data;
+}
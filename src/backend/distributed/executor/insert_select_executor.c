@@ -11,11 +11,14 @@
 #include "postgres.h"
 #include "miscadmin.h"
 
+#include "distributed/citus_custom_scan.h"
 #include "distributed/commands/multi_copy.h"
 #include "distributed/distributed_execution_locks.h"
 #include "distributed/insert_select_executor.h"
 #include "distributed/insert_select_planner.h"
+#include "distributed/intermediate_results.h"
 #include "distributed/local_executor.h"
+#include "distributed/master_metadata_utility.h"
 #include "distributed/multi_executor.h"
 #include "distributed/multi_partitioning_utils.h"
 #include "distributed/multi_physical_planner.h"
@@ -33,18 +36,38 @@
 #include "parser/parsetree.h"
 #include "tcop/pquery.h"
 #include "tcop/tcopprot.h"
+#include "utils/builtins.h"
 #include "utils/lsyscache.h"
 #include "utils/portal.h"
 #include "utils/snapmgr.h"
 
 
+/* Config variable managed via guc.c */
+bool EnableRepartitionedInsertSelect = false;
+
 /* depth of current insert/select executor. */
 static int insertSelectExecutorLevel = 0;
 
 
 static TupleTableSlot * CoordinatorInsertSelectExecScanInternal(CustomScanState *node);
 static void ExecuteSelectIntoRelation(Oid targetRelationId, List *insertTargetList,
-									  Query *selectQuery, EState *executorState);
+									  Query *selectQuery, EState *executorState,
+									  uint64 planId);
+static bool IsRedistributablePlan(PlannedStmt *selectPlan, Oid targetRelationId,
+								  int partitionColumnIndex, Query *selectQuery,
+								  ParamListInfo paramListInfo);
+static void ExecuteRepartitionedSelectIntoRelation(Oid targetRelationId,
+												   List *columnNameList,
+												   int partitionColumnIndex,
+												   Query *selectQuery,
+												   PlannedStmt *selectPlan,
+												   EState *executorState,
+												   char *resultIdPrefix);
+static char * InsertFromFragmentsQueryString(ShardInterval *shardInterval,
+											 List *columnNameList,
+											 List *selectTargetList,
+											 List *fragmentList);
+static List * NonJunkTargetList(List *targetList);
 static HTAB * ExecuteSelectIntoColocatedIntermediateResults(Oid targetRelationId,
 															List *insertTargetList,
 															Query *selectQuery,
@@ -190,7 +213,7 @@ CoordinatorInsertSelectExecScanInternal(CustomScanState *node)
 		else
 		{
 			ExecuteSelectIntoRelation(targetRelationId, insertTargetList, selectQuery,
-									  executorState);
+									  executorState, distributedPlan->planId);
 		}
 
 		scanState->finishedRemoteScan = true;
@@ -259,12 +282,17 @@ ExecuteSelectIntoColocatedIntermediateResults(Oid targetRelationId,
  * ExecuteSelectIntoRelation executes given SELECT query and inserts the
  * results into the target relation, which is assumed to be a distributed
  * table.
+ *
+ * When citus.enable_repartitioned_insert_select is on and the SELECT runs as
+ * a plain multi-shard query, the rows are repartitioned among the workers
+ * instead of being copied through the coordinator.
  */
 static void
 ExecuteSelectIntoRelation(Oid targetRelationId, List *insertTargetList,
-						  Query *selectQuery, EState *executorState)
+						  Query *selectQuery, EState *executorState, uint64 planId)
 {
 	ParamListInfo paramListInfo = executorState->es_param_list_info;
+	int cursorOptions = CURSOR_OPT_PARALLEL_OK;
 	bool stopOnFailure = false;
 
 	char partitionMethod = PartitionMethod(targetRelationId);
@@ -279,6 +307,27 @@ ExecuteSelectIntoRelation(Oid targetRelationId, List *insertTargetList,
 	int partitionColumnIndex = PartitionColumnIndexFromColumnList(targetRelationId,
 																  columnNameList);
 
+	/*
+	 * Make a copy of the query, since planning may scribble on it and we want
+	 * it to be replanned every time if it is stored in a prepared statement.
+	 */
+	Query *queryCopy = copyObject(selectQuery);
+
+	PlannedStmt *selectPlan = pg_plan_query(queryCopy, cursorOptions, paramListInfo);
+
+	if (EnableRepartitionedInsertSelect &&
+		IsRedistributablePlan(selectPlan, targetRelationId, partitionColumnIndex,
+							  selectQuery, paramListInfo))
+	{
+		char *resultIdPrefix = InsertSelectResultIdPrefix(planId);
+
+		ExecuteRepartitionedSelectIntoRelation(targetRelationId, columnNameList,
+											   partitionColumnIndex, selectQuery,
+											   selectPlan, executorState,
+											   resultIdPrefix);
+		return;
+	}
+
 	/* set up a DestReceiver that copies into the distributed table */
 	CitusCopyDestReceiver *copyDest = CreateCitusCopyDestReceiver(targetRelationId,
 																  columnNameList,
@@ -286,14 +335,7 @@ ExecuteSelectIntoRelation(Oid targetRelationId, List *insertTargetList,
 																  executorState,
 																  stopOnFailure, NULL);
 
-	/*
-	 * Make a copy of the query, since ExecuteQueryIntoDestReceiver may scribble on it
-	 * and we want it to be replanned every time if it is stored in a prepared
-	 * statement.
-	 */
-	Query *queryCopy = copyObject(selectQuery);
-
-	ExecuteQueryIntoDestReceiver(queryCopy, paramListInfo, (DestReceiver *) copyDest);
+	ExecutePlanIntoDestReceiver(selectPlan, paramListInfo, (DestReceiver *) copyDest);
 
 	executorState->es_processed = copyDest->tuplesSent;
 
@@ -301,6 +343,244 @@ ExecuteSelectIntoRelation(Oid targetRelationId, List *insertTargetList,
 }
 
 
+/*
+ * IsRedistributablePlan returns whether the rows of the given SELECT plan can
+ * be repartitioned among the workers by the shards of the target relation.
+ * This is the case when the plan consists of multiple shard queries whose
+ * results are returned as they are, and when these queries hash the partition
+ * column in the same way as the target relation.
+ */
+static bool
+IsRedistributablePlan(PlannedStmt *selectPlan, Oid targetRelationId,
+					  int partitionColumnIndex, Query *selectQuery,
+					  ParamListInfo paramListInfo)
+{
+	ListCell *taskCell = NULL;
+
+	if (PartitionMethod(targetRelationId) != DISTRIBUTE_BY_HASH ||
+		partitionColumnIndex < 0)
+	{
+		return false;
+	}
+
+	/* the shard queries are sent as they are, without parameters */
+	if (paramListInfo != NULL && paramListInfo->numParams > 0)
+	{
+		return false;
+	}
+
+	if (!IsCitusCustomScan(selectPlan->planTree))
+	{
+		return false;
+	}
+
+	DistributedPlan *distributedPlan =
+		GetDistributedPlan((CustomScan *) selectPlan->planTree);
+	Job *workerJob = distributedPlan->workerJob;
+
+	if (workerJob == NULL || distributedPlan->masterQuery != NULL ||
+		distributedPlan->repartitionCountDistinct ||
+		distributedPlan->subPlanList != NIL || workerJob->dependentJobList != NIL ||
+		workerJob->requiresMasterEvaluation || workerJob->deferredPruning ||
+		list_length(workerJob->taskList) < 2)
+	{
+		return false;
+	}
+
+	foreach(taskCell, workerJob->taskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+
+		if (task->taskType != SELECT_TASK || task->dependentTaskList != NIL ||
+			task->taskPlacementList == NIL)
+		{
+			return false;
+		}
+	}
+
+	List *selectTargetList = NonJunkTargetList(selectQuery->targetList);
+	if (partitionColumnIndex >= list_length(selectTargetList))
+	{
+		return false;
+	}
+
+	/* the workers hash the partition column with the hash function of its type */
+	Var *partitionColumn = PartitionColumn(targetRelationId, 0);
+	TargetEntry *partitionTargetEntry =
+		(TargetEntry *) list_nth(selectTargetList, partitionColumnIndex);
+	Node *partitionValueExpr = (Node *) partitionTargetEntry->expr;
+
+	return exprType(partitionValueExpr) == partitionColumn->vartype &&
+		   exprCollation(partitionValueExpr) == partitionColumn->varcollid;
+}
+
+
+/*
+ * ExecuteRepartitionedSelectIntoRelation runs the shard queries of the given
+ * SELECT plan such that each worker partitions its rows by the shards of the
+ * target relation. The nodes of the target shard placements fetch the parts
+ * of their shards from the other workers, and insert them into their shards.
+ */
+static void
+ExecuteRepartitionedSelectIntoRelation(Oid targetRelationId, List *columnNameList,
+									   int partitionColumnIndex, Query *selectQuery,
+									   PlannedStmt *selectPlan, EState *executorState,
+									   char *resultIdPrefix)
+{
+	DistributedPlan *distributedPlan =
+		GetDistributedPlan((CustomScan *) selectPlan->planTree);
+	List *selectTaskList = distributedPlan->workerJob->taskList;
+	DistTableCacheEntry *targetRelation = DistributedTableCacheEntry(targetRelationId);
+	ShardInterval **shardIntervalArray = targetRelation->sortedShardIntervalArray;
+	List *selectTargetList = NonJunkTargetList(selectQuery->targetList);
+	List *insertTaskList = NIL;
+	uint32 taskId = 1;
+
+	ereport(DEBUG1, (errmsg("Repartitioning INSERT ... SELECT results on workers")));
+
+	List **fragmentListArray = RedistributeTaskListResults(resultIdPrefix,
+														   selectTaskList,
+														   partitionColumnIndex,
+														   targetRelation);
+
+	for (int shardIndex = 0; shardIndex < targetRelation->shardIntervalArrayLength;
+		 shardIndex++)
+	{
+		ShardInterval *shardInterval = shardIntervalArray[shardIndex];
+		List *fragmentList = fragmentListArray[shardIndex];
+		uint64 shardId = shardInterval->shardId;
+
+		if (fragmentList == NIL)
+		{
+			continue;
+		}
+
+		char *queryString = InsertFromFragmentsQueryString(shardInterval,
+														   columnNameList,
+														   selectTargetList,
+														   fragmentList);
+
+		LockShardDistributionMetadata(shardId, ShareLock);
+
+		RelationShard *relationShard = CitusMakeNode(RelationShard);
+		relationShard->relationId = targetRelationId;
+		relationShard->shardId = shardId;
+
+		Task *modifyTask = CreateBasicTask(INVALID_JOB_ID, taskId, MODIFY_TASK,
+										   queryString);
+		modifyTask->anchorShardId = shardId;
+		modifyTask->taskPlacementList = FinalizedShardPlacementList(shardId);
+		modifyTask->relationShardList = list_make1(relationShard);
+		modifyTask->replicationModel = targetRelation->replicationModel;
+
+		insertTaskList = lappend(insertTaskList, modifyTask);
+		taskId++;
+	}
+
+	if (insertTaskList != NIL)
+	{
+		executorState->es_processed = ExecuteTaskList(ROW_MODIFY_COMMUTATIVE,
+													  insertTaskList,
+													  MaxAdaptiveExecutorPoolSize);
+	}
+
+	XactModificationLevel = XACT_MODIFICATION_DATA;
+}
+
+
+/*
+ * InsertFromFragmentsQueryString returns the query that inserts the rows of
+ * the given fragments into the given shard. The fragments have been written
+ * on, or fetched to, the nodes of all placements of the shard.
+ */
+static char *
+InsertFromFragmentsQueryString(ShardInterval *shardInterval, List *columnNameList,
+							   List *selectTargetList, List *fragmentList)
+{
+	StringInfo queryString = makeStringInfo();
+	StringInfo columnDefinitions = makeStringInfo();
+	ListCell *columnNameCell = NULL;
+	ListCell *targetEntryCell = NULL;
+	ListCell *fragmentCell = NULL;
+	bool useBinaryCopyFormat = true;
+	int columnIndex = 0;
+
+	appendStringInfo(queryString, "INSERT INTO %s (",
+					 ConstructQualifiedShardName(shardInterval));
+
+	foreach(columnNameCell, columnNameList)
+	{
+		char *columnName = (char *) lfirst(columnNameCell);
+
+		appendStringInfo(queryString, "%s%s", columnIndex > 0 ? ", " : "",
+						 quote_identifier(columnName));
+		columnIndex++;
+	}
+
+	appendStringInfoString(queryString, ") ");
+
+	/* the fragments hold the columns of the SELECT in its output format */
+	columnIndex = 0;
+	foreach(targetEntryCell, selectTargetList)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+		Node *columnExpr = (Node *) targetEntry->expr;
+		Oid columnType = exprType(columnExpr);
+
+		appendStringInfo(columnDefinitions, "%sintermediate_column_%d %s",
+						 columnIndex > 0 ? ", " : "", columnIndex,
+						 format_type_with_typemod(columnType, exprTypmod(columnExpr)));
+
+		if (!CanUseBinaryCopyFormatForType(columnType))
+		{
+			useBinaryCopyFormat = false;
+		}
+
+		columnIndex++;
+	}
+
+	foreach(fragmentCell, fragmentList)
+	{
+		DistributedResultFragment *fragment =
+			(DistributedResultFragment *) lfirst(fragmentCell);
+
+		appendStringInfo(queryString,
+						 "%sSELECT * FROM read_intermediate_result(%s, %s) "
+						 "AS intermediate_result(%s)",
+						 fragmentCell != list_head(fragmentList) ? " UNION ALL " : "",
+						 quote_literal_cstr(fragment->resultId),
+						 quote_literal_cstr(useBinaryCopyFormat ? "binary" : "text"),
+						 columnDefinitions->data);
+	}
+
+	return queryString->data;
+}
+
+
+/*
+ * NonJunkTargetList returns the entries of the given target list that are
+ * part of the query output.
+ */
+static List *
+NonJunkTargetList(List *targetList)
+{
+	List *nonJunkTargetList = NIL;
+	ListCell *targetEntryCell = NULL;
+
+	foreach(targetEntryCell, targetList)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+
+		if (!targetEntry->resjunk)
+		{
+			nonJunkTargetList = lappend(nonJunkTargetList, targetEntry);
+		}
+	}
+
+	return nonJunkTargetList;
+}
+
+
 /*
  * BuildColumnNameListForCopyStatement build the column name list given the insert
  * target list.
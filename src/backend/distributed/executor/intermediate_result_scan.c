@@ -0,0 +1,586 @@
+/*-------------------------------------------------------------------------
+ *
+ * intermediate_result_scan.c
+ *   Custom scan that streams rows from an intermediate result file.
+ *
+ * A read_intermediate_result call in the FROM clause is normally executed
+ * as a function scan, which materializes the whole result file into a tuple
+ * store before the first row is returned. When
+ * citus.enable_streaming_intermediate_results is enabled, we replace the
+ * function scan path with an IntermediateResultScan, which parses one row at
+ * a time from the file.
+ *
+ * Files in the COPY formats are memory-mapped and fed to the COPY parser
+ * through its data source callback, such that the rows are parsed straight
+ * from the page cache. Files in the columnar format are read one chunk at a
+ * time into a reusable buffer.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "postgres.h"
+
+#include "commands/copy.h"
+#include "distributed/commands/multi_copy.h"
+#include "distributed/intermediate_result_scan.h"
+#include "distributed/intermediate_results.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/multi_executor.h"
+#include "distributed/version_compat.h"
+#include "executor/executor.h"
+#include "nodes/extensible.h"
+#include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/pathnode.h"
+#if PG_VERSION_NUM >= 120000
+#include "optimizer/optimizer.h"
+#else
+#include "optimizer/var.h"
+#endif
+#include "optimizer/restrictinfo.h"
+#include "storage/fd.h"
+#include "utils/builtins.h"
+#include "utils/memutils.h"
+
+
+/* execution state of an IntermediateResultScan */
+typedef struct IntermediateResultScanState
+{
+	CustomScanState customScanState;
+
+	char *resultId;
+	char *fileName;
+	char *copyFormat;
+
+	/* reader for files in the columnar format */
+	bool columnarFormat;
+	ColumnarResultReader *columnarReader;
+
+	/* state for files in one of the COPY formats */
+	CopyState copyState;
+	char *mappedData;
+	size_t mappedSize;
+	size_t mappedOffset;
+
+	/* unmaps the file if the scan is not ended cleanly */
+	MemoryContextCallback unmapCallback;
+} IntermediateResultScanState;
+
+
+/* GUC to stream rows from intermediate result files */
+bool EnableStreamingIntermediateResults = false;
+
+/* scan state whose file the COPY data source callback reads from */
+static IntermediateResultScanState *CurrentCopySourceScanState = NULL;
+
+
+static bool CanStreamReadIntermediateResult(RelOptInfo *relOptInfo,
+											RangeTblEntry *rangeTableEntry);
+static Plan * IntermediateResultPlanCustomPath(PlannerInfo *root, RelOptInfo *rel,
+											   CustomPath *bestPath, List *tlist,
+											   List *clauses, List *customPlans);
+static Node * IntermediateResultCreateScan(CustomScan *scan);
+static void IntermediateResultBeginScan(CustomScanState *node, EState *estate,
+										int eflags);
+static TupleTableSlot * IntermediateResultExecScan(CustomScanState *node);
+static TupleTableSlot * IntermediateResultScanNext(ScanState *scanState);
+static bool IntermediateResultScanRecheck(ScanState *scanState, TupleTableSlot *slot);
+static void IntermediateResultEndScan(CustomScanState *node);
+static void IntermediateResultReScan(CustomScanState *node);
+static void StartIntermediateResultRead(IntermediateResultScanState *scanState);
+static void EndIntermediateResultRead(IntermediateResultScanState *scanState);
+static void MapIntermediateResultFile(IntermediateResultScanState *scanState);
+static void UnmapIntermediateResultFile(void *arg);
+static int ReadFromMappedResultFile(void *outbuf, int minread, int maxread);
+
+
+static CustomPathMethods IntermediateResultCustomPathMethods = {
+	.CustomName = "IntermediateResultScan",
+	.PlanCustomPath = IntermediateResultPlanCustomPath
+};
+
+CustomScanMethods IntermediateResultCustomScanMethods = {
+	"Citus Intermediate Result",
+	IntermediateResultCreateScan
+};
+
+static CustomExecMethods IntermediateResultCustomExecMethods = {
+	.CustomName = "IntermediateResultScan",
+	.BeginCustomScan = IntermediateResultBeginScan,
+	.ExecCustomScan = IntermediateResultExecScan,
+	.EndCustomScan = IntermediateResultEndScan,
+	.ReScanCustomScan = IntermediateResultReScan
+};
+
+
+/*
+ * AddIntermediateResultScanPath replaces the function scan path of a
+ * read_intermediate_result call with a path for an IntermediateResultScan,
+ * which keeps the row count and total cost estimate of the function scan,
+ * but can return the first row without reading the whole file.
+ */
+void
+AddIntermediateResultScanPath(PlannerInfo *root, RelOptInfo *relOptInfo,
+							  RangeTblEntry *rangeTableEntry)
+{
+	if (!EnableStreamingIntermediateResults)
+	{
+		return;
+	}
+
+	if (!CanStreamReadIntermediateResult(relOptInfo, rangeTableEntry))
+	{
+		return;
+	}
+
+	RangeTblFunction *rangeTableFunction = linitial(rangeTableEntry->functions);
+	FuncExpr *funcExpression = (FuncExpr *) rangeTableFunction->funcexpr;
+	Path *functionScanPath = (Path *) linitial(relOptInfo->pathlist);
+
+	CustomPath *customPath = makeNode(CustomPath);
+	customPath->path.pathtype = T_CustomScan;
+	customPath->path.parent = relOptInfo;
+	customPath->path.pathtarget = relOptInfo->reltarget;
+	customPath->path.param_info = NULL;
+	customPath->path.rows = functionScanPath->rows;
+	customPath->path.startup_cost = 0;
+	customPath->path.total_cost = functionScanPath->total_cost;
+	customPath->methods = &IntermediateResultCustomPathMethods;
+
+	/* the result ID and format arguments */
+	customPath->custom_private = list_copy(funcExpression->args);
+
+	relOptInfo->pathlist = NIL;
+	add_path(relOptInfo, (Path *) customPath);
+}
+
+
+/*
+ * CanStreamReadIntermediateResult returns whether the given range table entry
+ * is a plain read_intermediate_result call with constant arguments, whose
+ * columns are referenced only by regular column references.
+ */
+static bool
+CanStreamReadIntermediateResult(RelOptInfo *relOptInfo, RangeTblEntry *rangeTableEntry)
+{
+	ListCell *varCell = NULL;
+
+	if (rangeTableEntry->rtekind != RTE_FUNCTION ||
+		list_length(rangeTableEntry->functions) != 1 ||
+		rangeTableEntry->funcordinality)
+	{
+		return false;
+	}
+
+	if (!CitusHasBeenLoaded() || !CheckCitusVersion(DEBUG5))
+	{
+		/* read_intermediate_result may not exist */
+		return false;
+	}
+
+	RangeTblFunction *rangeTableFunction = linitial(rangeTableEntry->functions);
+	FuncExpr *funcExpression = (FuncExpr *) rangeTableFunction->funcexpr;
+	if (!IsA(funcExpression, FuncExpr) ||
+		funcExpression->funcid != CitusReadIntermediateResultFuncId())
+	{
+		return false;
+	}
+
+	Node *resultIdArgument = linitial(funcExpression->args);
+	Node *resultFormatArgument = lsecond(funcExpression->args);
+	if (!IsA(resultIdArgument, Const) || ((Const *) resultIdArgument)->constisnull ||
+		!IsA(resultFormatArgument, Const) ||
+		((Const *) resultFormatArgument)->constisnull)
+	{
+		/* parameters are only known at execution time */
+		return false;
+	}
+
+	if (relOptInfo->pathlist == NIL || relOptInfo->lateral_relids != NULL)
+	{
+		return false;
+	}
+
+	/* whole-row and system column references cannot be mapped to scan columns */
+	List *referencedExpressions = list_copy(relOptInfo->reltarget->exprs);
+	referencedExpressions = list_concat(referencedExpressions,
+										extract_actual_clauses(
+											relOptInfo->baserestrictinfo, false));
+
+	List *varList = pull_var_clause((Node *) referencedExpressions,
+									PVC_RECURSE_AGGREGATES |
+									PVC_RECURSE_WINDOWFUNCS |
+									PVC_RECURSE_PLACEHOLDERS);
+	foreach(varCell, varList)
+	{
+		Var *column = (Var *) lfirst(varCell);
+
+		if (column->varno == relOptInfo->relid && column->varattno <= 0)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * IntermediateResultPlanCustomPath creates a CustomScan for an
+ * IntermediateResultScan path. The scan produces all columns of the
+ * function, which are described by the custom scan target list.
+ */
+static Plan *
+IntermediateResultPlanCustomPath(PlannerInfo *root, RelOptInfo *rel,
+								 CustomPath *bestPath, List *tlist,
+								 List *clauses, List *customPlans)
+{
+	RangeTblEntry *rangeTableEntry = planner_rt_fetch(rel->relid, root);
+	RangeTblFunction *rangeTableFunction = linitial(rangeTableEntry->functions);
+	List *customScanTargetList = NIL;
+	AttrNumber columnNumber = 1;
+
+	ListCell *typeCell = NULL;
+	ListCell *typeModCell = NULL;
+	ListCell *collationCell = NULL;
+
+	forthree(typeCell, rangeTableFunction->funccoltypes,
+			 typeModCell, rangeTableFunction->funccoltypmods,
+			 collationCell, rangeTableFunction->funccolcollations)
+	{
+		Var *column = makeVar(rel->relid, columnNumber, lfirst_oid(typeCell),
+							  lfirst_int(typeModCell), lfirst_oid(collationCell), 0);
+		TargetEntry *targetEntry = makeTargetEntry((Expr *) column, columnNumber,
+												   NULL, false);
+
+		customScanTargetList = lappend(customScanTargetList, targetEntry);
+		columnNumber++;
+	}
+
+	CustomScan *customScan = makeNode(CustomScan);
+	customScan->methods = &IntermediateResultCustomScanMethods;
+	customScan->scan.plan.targetlist = tlist;
+	customScan->scan.plan.qual = extract_actual_clauses(clauses, false);
+	customScan->scan.scanrelid = 0;
+	customScan->custom_scan_tlist = customScanTargetList;
+	customScan->custom_private = bestPath->custom_private;
+
+	return (Plan *) customScan;
+}
+
+
+/*
+ * IntermediateResultCreateScan creates the execution state of an
+ * IntermediateResultScan.
+ */
+static Node *
+IntermediateResultCreateScan(CustomScan *scan)
+{
+	IntermediateResultScanState *scanState = palloc0(
+		sizeof(IntermediateResultScanState));
+
+	scanState->customScanState.ss.ps.type = T_CustomScanState;
+	scanState->customScanState.methods = &IntermediateResultCustomExecMethods;
+
+	return (Node *) scanState;
+}
+
+
+/*
+ * IntermediateResultBeginScan opens the intermediate result file.
+ */
+static void
+IntermediateResultBeginScan(CustomScanState *node, EState *estate, int eflags)
+{
+	IntermediateResultScanState *scanState = (IntermediateResultScanState *) node;
+	CustomScan *customScan = (CustomScan *) node->ss.ps.plan;
+	Const *resultIdConst = (Const *) linitial(customScan->custom_private);
+	Const *resultFormatConst = (Const *) lsecond(customScan->custom_private);
+	struct stat fileStat;
+
+	Datum copyFormatLabelDatum = DirectFunctionCall1(enum_out,
+													 resultFormatConst->constvalue);
+
+	scanState->resultId = TextDatumGetCString(resultIdConst->constvalue);
+	scanState->copyFormat = DatumGetCString(copyFormatLabelDatum);
+	scanState->fileName = QueryResultFileName(scanState->resultId);
+
+	if (eflags & EXEC_FLAG_EXPLAIN_ONLY)
+	{
+		/* the file might not exist when only explaining the query */
+		return;
+	}
+
+	int statOK = stat(scanState->fileName, &fileStat);
+	if (statOK != 0)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("result \"%s\" does not exist", scanState->resultId)));
+	}
+
+	scanState->columnarFormat = IsColumnarResultFile(scanState->fileName);
+	if (!scanState->columnarFormat)
+	{
+		MapIntermediateResultFile(scanState);
+	}
+
+	StartIntermediateResultRead(scanState);
+}
+
+
+/*
+ * MapIntermediateResultFile maps a file in one of the COPY formats into
+ * memory. The mapping is removed when the scan ends, or when the executor
+ * memory is released after an error.
+ */
+static void
+MapIntermediateResultFile(IntermediateResultScanState *scanState)
+{
+	EState *executorState = scanState->customScanState.ss.ps.state;
+	struct stat fileStat;
+
+	int fileDescriptor = OpenTransientFile(scanState->fileName, O_RDONLY | PG_BINARY);
+	if (fileDescriptor < 0)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not open file \"%s\": %m", scanState->fileName)));
+	}
+
+	if (fstat(fileDescriptor, &fileStat) != 0)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not stat file \"%s\": %m", scanState->fileName)));
+	}
+
+	scanState->mappedSize = fileStat.st_size;
+
+	/* empty files cannot be mapped, but there is nothing to read either */
+	if (scanState->mappedSize > 0)
+	{
+		void *mappedData = mmap(NULL, scanState->mappedSize, PROT_READ, MAP_SHARED,
+								fileDescriptor, 0);
+		if (mappedData == MAP_FAILED)
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not map file \"%s\": %m",
+								   scanState->fileName)));
+		}
+
+		scanState->mappedData = mappedData;
+
+		/* the file is parsed front to back */
+		(void) posix_madvise(mappedData, scanState->mappedSize,
+							 POSIX_MADV_SEQUENTIAL);
+
+		scanState->unmapCallback.func = UnmapIntermediateResultFile;
+		scanState->unmapCallback.arg = scanState;
+		MemoryContextRegisterResetCallback(executorState->es_query_cxt,
+										   &scanState->unmapCallback);
+	}
+
+	/* the mapping remains valid after closing the file */
+	CloseTransientFile(fileDescriptor);
+}
+
+
+/*
+ * UnmapIntermediateResultFile removes the memory mapping of the file, if any.
+ */
+static void
+UnmapIntermediateResultFile(void *arg)
+{
+	IntermediateResultScanState *scanState = (IntermediateResultScanState *) arg;
+
+	if (scanState->mappedData != NULL)
+	{
+		munmap(scanState->mappedData, scanState->mappedSize);
+		scanState->mappedData = NULL;
+	}
+
+	if (CurrentCopySourceScanState == scanState)
+	{
+		CurrentCopySourceScanState = NULL;
+	}
+}
+
+
+/*
+ * StartIntermediateResultRead prepares reading the file from the start.
+ */
+static void
+StartIntermediateResultRead(IntermediateResultScanState *scanState)
+{
+	TupleDesc tupleDescriptor =
+		scanState->customScanState.ss.ss_ScanTupleSlot->tts_tupleDescriptor;
+
+	if (scanState->columnarFormat)
+	{
+		scanState->columnarReader = BeginColumnarResultRead(scanState->fileName,
+															tupleDescriptor);
+		return;
+	}
+
+	/*
+	 * Trick BeginCopyFrom into using our tuple descriptor by pretending it belongs
+	 * to a relation.
+	 */
+	Relation stubRelation = StubRelation(tupleDescriptor);
+	int location = -1; /* "unknown" token location */
+	DefElem *copyOption = makeDefElem("format", (Node *) makeString(scanState->copyFormat),
+									  location);
+
+	scanState->mappedOffset = 0;
+
+	/* BeginCopyFrom already reads the header in binary format */
+	CurrentCopySourceScanState = scanState;
+
+	scanState->copyState = BeginCopyFrom(NULL, stubRelation, NULL, false,
+										 ReadFromMappedResultFile, NIL,
+										 list_make1(copyOption));
+}
+
+
+/*
+ * ReadFromMappedResultFile implements the COPY data source callback by copying
+ * the next part of the memory-mapped file of CurrentCopySourceScanState.
+ */
+static int
+ReadFromMappedResultFile(void *outbuf, int minread, int maxread)
+{
+	IntermediateResultScanState *scanState = CurrentCopySourceScanState;
+
+	Assert(scanState != NULL);
+
+	size_t remainingBytes = scanState->mappedSize - scanState->mappedOffset;
+	int bytesRead = (int) Min(remainingBytes, (size_t) maxread);
+
+	if (bytesRead > 0)
+	{
+		memcpy(outbuf, scanState->mappedData + scanState->mappedOffset, bytesRead);
+		scanState->mappedOffset += bytesRead;
+	}
+
+	return bytesRead;
+}
+
+
+/*
+ * IntermediateResultExecScan returns the next row of the result that passes
+ * the quals of the scan.
+ */
+static TupleTableSlot *
+IntermediateResultExecScan(CustomScanState *node)
+{
+	return ExecScan(&node->ss, (ExecScanAccessMtd) IntermediateResultScanNext,
+					(ExecScanRecheckMtd) IntermediateResultScanRecheck);
+}
+
+
+/*
+ * IntermediateResultScanNext parses the next row of the file into the scan
+ * tuple slot, which remains empty when there are no more rows.
+ */
+static TupleTableSlot *
+IntermediateResultScanNext(ScanState *scanState)
+{
+	IntermediateResultScanState *resultScanState =
+		(IntermediateResultScanState *) scanState;
+	TupleTableSlot *slot = scanState->ss_ScanTupleSlot;
+	ExprContext *expressionContext = scanState->ps.ps_ExprContext;
+	bool nextRowFound = false;
+
+	ExecClearTuple(slot);
+
+	/* the values only need to live until the next row is read */
+	MemoryContext oldContext =
+		MemoryContextSwitchTo(expressionContext->ecxt_per_tuple_memory);
+
+	if (resultScanState->columnarReader != NULL)
+	{
+		nextRowFound = ColumnarResultReadNextRow(resultScanState->columnarReader,
+												 slot->tts_values, slot->tts_isnull);
+	}
+	else
+	{
+		CurrentCopySourceScanState = resultScanState;
+
+		nextRowFound = NextCopyFromCompat(resultScanState->copyState,
+										  expressionContext, slot->tts_values,
+										  slot->tts_isnull);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	if (nextRowFound)
+	{
+		ExecStoreVirtualTuple(slot);
+	}
+
+	return slot;
+}
+
+
+/*
+ * IntermediateResultScanRecheck is called for EvalPlanQual rechecks, which
+ * do not apply to intermediate results.
+ */
+static bool
+IntermediateResultScanRecheck(ScanState *scanState, TupleTableSlot *slot)
+{
+	return true;
+}
+
+
+/*
+ * EndIntermediateResultRead stops reading the file, but keeps the memory
+ * mapping such that the read can be restarted.
+ */
+static void
+EndIntermediateResultRead(IntermediateResultScanState *scanState)
+{
+	if (scanState->columnarReader != NULL)
+	{
+		EndColumnarResultRead(scanState->columnarReader);
+		scanState->columnarReader = NULL;
+	}
+
+	if (scanState->copyState != NULL)
+	{
+		EndCopyFrom(scanState->copyState);
+		scanState->copyState = NULL;
+	}
+}
+
+
+/*
+ * IntermediateResultEndScan closes the file and removes the memory mapping.
+ */
+static void
+IntermediateResultEndScan(CustomScanState *node)
+{
+	IntermediateResultScanState *scanState = (IntermediateResultScanState *) node;
+
+	EndIntermediateResultRead(scanState);
+	UnmapIntermediateResultFile(scanState);
+}
+
+
+/*
+ * IntermediateResultReScan restarts reading the file from the start.
+ */
+static void
+IntermediateResultReScan(CustomScanState *node)
+{
+	IntermediateResultScanState *scanState = (IntermediateResultScanState *) node;
+
+	EndIntermediateResultRead(scanState);
+	StartIntermediateResultRead(scanState);
+
+	ExecScanReScan(&node->ss);
+}
@@ -18,13 +18,17 @@
 
 #include "catalog/pg_enum.h"
 #include "commands/copy.h"
+#include "distributed/citus_wait_events.h"
 #include "distributed/commands/multi_copy.h"
 #include "distributed/connection_management.h"
+#include "distributed/deferred_cleanup.h"
 #include "distributed/intermediate_results.h"
+#include "distributed/listutils.h"
 #include "distributed/master_metadata_utility.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_executor.h"
 #include "distributed/remote_commands.h"
+#include "distributed/shardinterval_utils.h"
 #include "distributed/transmit.h"
 #include "distributed/transaction_identifier.h"
 #include "distributed/tuplestore.h"
@@ -34,15 +38,20 @@
 #include "nodes/parsenodes.h"
 #include "nodes/primnodes.h"
 #include "storage/fd.h"
+#include "storage/latch.h"
 #include "tcop/tcopprot.h"
 #include "utils/builtins.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/syscache.h"
+#include "utils/timestamp.h"
 
 
 static bool CreatedResultsDirectory = false;
 
+/* GUC to write intermediate results in the columnar format */
+bool EnableColumnarIntermediateResults = false;
+
 
 /* CopyDestReceiver can be used to stream results into a distributed table */
 typedef struct RemoteFileDestReceiver
@@ -73,16 +82,42 @@ typedef struct RemoteFileDestReceiver
 	CopyOutState copyOutState;
 	FmgrInfo *columnOutputFunctions;
 
+	/* set when writing in the columnar format instead of COPY format */
+	ColumnarResultWriter *columnarWriter;
+
+	/* data that is not yet sent to the nodes when using compression */
+	StringInfo compressionBuffer;
+
+	/*
+	 * When partitionRelationId is set, each row is only sent to the nodes
+	 * that have a placement of the shard of the relation that the value of
+	 * the partition column hashes to. shardConnectionLists contains these
+	 * connections for each shard index.
+	 */
+	Oid partitionRelationId;
+	int partitionColumnIndex;
+	DistTableCacheEntry *partitionCacheEntry;
+	List **shardConnectionLists;
+
 	/* number of tuples sent */
 	uint64 tuplesSent;
+
+	/* number of bytes of the result before compression, for EXPLAIN ANALYZE */
+	uint64 bytesSent;
 } RemoteFileDestReceiver;
 
 
 static void RemoteFileDestReceiverStartup(DestReceiver *dest, int operation,
 										  TupleDesc inputTupleDescriptor);
-static StringInfo ConstructCopyResultStatement(const char *resultId);
+static StringInfo ConstructCopyResultStatement(const char *resultId, bool compress);
 static void WriteToLocalFile(StringInfo copyData, FileCompat *fileCompat);
 static bool RemoteFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest);
+static void SendResultData(RemoteFileDestReceiver *resultDest, StringInfo dataBuffer);
+static List ** ShardConnectionLists(DistTableCacheEntry *cacheEntry, List *nodeList,
+									List *connectionList);
+static List * RowConnectionList(RemoteFileDestReceiver *resultDest, Datum *columnValues,
+								bool *columnNulls);
+static void FlushCompressionBuffer(RemoteFileDestReceiver *resultDest);
 static void BroadcastCopyData(StringInfo dataBuffer, List *connectionList);
 static void SendCopyDataOverConnection(StringInfo dataBuffer,
 									   MultiConnection *connection);
@@ -91,13 +126,18 @@ static void RemoteFileDestReceiverDestroy(DestReceiver *destReceiver);
 
 static char * CreateIntermediateResultsDirectory(void);
 static char * IntermediateResultsDirectory(void);
-static char * QueryResultFileName(const char *resultId);
+static void BeginFetchTransaction(MultiConnection *connection);
+static uint64 FetchRemoteIntermediateResult(MultiConnection *connection,
+											char *resultId);
+static void WaitForCopyData(MultiConnection *connection);
 
 
 /* exports for SQL callable functions */
 PG_FUNCTION_INFO_V1(read_intermediate_result);
 PG_FUNCTION_INFO_V1(broadcast_intermediate_result);
 PG_FUNCTION_INFO_V1(create_intermediate_result);
+PG_FUNCTION_INFO_V1(link_intermediate_result);
+PG_FUNCTION_INFO_V1(fetch_intermediate_results);
 
 
 /*
@@ -182,6 +222,88 @@ create_intermediate_result(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * link_intermediate_result makes an existing intermediate result of the
+ * current distributed transaction available under a second result ID,
+ * without copying the data.
+ */
+Datum
+link_intermediate_result(PG_FUNCTION_ARGS)
+{
+	text *sourceResultIdText = PG_GETARG_TEXT_P(0);
+	char *sourceResultIdString = text_to_cstring(sourceResultIdText);
+	text *resultIdText = PG_GETARG_TEXT_P(1);
+	char *resultIdString = text_to_cstring(resultIdText);
+
+	CheckCitusVersion(ERROR);
+
+	LinkIntermediateResult(sourceResultIdString, resultIdString);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * fetch_intermediate_results copies the given intermediate results of the
+ * current distributed transaction from the given node into local files, such
+ * that read_intermediate_result can read them on this node. The function
+ * returns the number of bytes that were fetched.
+ *
+ * We read the results over a new connection that uses our distributed
+ * transaction ID, but which is not part of our coordinated transaction. The
+ * remote node only reads files, and the results remain owned by the session
+ * that wrote them.
+ */
+Datum
+fetch_intermediate_results(PG_FUNCTION_ARGS)
+{
+	ArrayType *resultIdObject = PG_GETARG_ARRAYTYPE_P(0);
+	int32 resultCount = ArrayObjectCount(resultIdObject);
+	text *nodeNameText = PG_GETARG_TEXT_P(1);
+	char *nodeName = text_to_cstring(nodeNameText);
+	int32 nodePort = PG_GETARG_INT32(2);
+	int connectionFlags = FORCE_NEW_CONNECTION;
+	uint64 totalBytesWritten = 0;
+
+	CheckCitusVersion(ERROR);
+
+	if (resultCount == 0)
+	{
+		PG_RETURN_INT64(0);
+	}
+
+	DistributedTransactionId *transactionId = GetCurrentDistributedTransactionId();
+	if (transactionId->transactionNumber == 0)
+	{
+		ereport(ERROR, (errmsg("fetch_intermediate_results can only be used in a "
+							   "distributed transaction")));
+	}
+
+	Datum *resultIdArray = DeconstructArrayObject(resultIdObject);
+
+	MultiConnection *connection = GetNodeConnection(connectionFlags, nodeName,
+													nodePort);
+	if (PQstatus(connection->pgConn) != CONNECTION_OK)
+	{
+		ReportConnectionError(connection, ERROR);
+	}
+
+	BeginFetchTransaction(connection);
+
+	for (int resultIndex = 0; resultIndex < resultCount; resultIndex++)
+	{
+		char *resultId = TextDatumGetCString(resultIdArray[resultIndex]);
+
+		totalBytesWritten += FetchRemoteIntermediateResult(connection, resultId);
+	}
+
+	/* the remote transaction only read files, so we can simply abort it */
+	CloseConnection(connection);
+
+	PG_RETURN_INT64(totalBytesWritten);
+}
+
+
 /*
  * CreateRemoteFileDestReceiver creates a DestReceiver that streams results
  * to a set of worker nodes. If the scope of the intermediate result is a
@@ -213,6 +335,40 @@ CreateRemoteFileDestReceiver(char *resultId, EState *executorState,
 }
 
 
+/*
+ * SetRemoteFileDestReceiverPartitioning makes the given RemoteFileDestReceiver
+ * send each row only to the nodes that have a placement of the shard of the
+ * given hash distributed table that the value in the given column hashes to.
+ * Rows with a NULL value are not sent, which is only correct when the result
+ * is joined on the distribution column of the table using equality. Since
+ * each node receives different rows, the data is neither compressed nor
+ * written in the columnar format.
+ */
+void
+SetRemoteFileDestReceiverPartitioning(DestReceiver *dest, Oid relationId,
+									  int partitionColumnIndex)
+{
+	RemoteFileDestReceiver *resultDest = (RemoteFileDestReceiver *) dest;
+
+	resultDest->partitionRelationId = relationId;
+	resultDest->partitionColumnIndex = partitionColumnIndex;
+}
+
+
+/*
+ * RemoteFileDestReceiverBytesSent returns the number of bytes of the result
+ * that the given RemoteFileDestReceiver sent so far, before compression. When
+ * the result is partitioned, each node only received a part of these bytes.
+ */
+uint64
+RemoteFileDestReceiverBytesSent(DestReceiver *dest)
+{
+	RemoteFileDestReceiver *resultDest = (RemoteFileDestReceiver *) dest;
+
+	return resultDest->bytesSent;
+}
+
+
 /*
  * RemoteFileDestReceiverStartup implements the rStartup interface of
  * RemoteFileDestReceiver. It opens connections to the nodes in initialNodeList,
@@ -249,6 +405,13 @@ RemoteFileDestReceiverStartup(DestReceiver *dest, int operation,
 	resultDest->columnOutputFunctions = ColumnOutputFunctions(inputTupleDescriptor,
 															  copyOutState->binary);
 
+	/* the columnar format relies on the binary send/receive functions */
+	if (EnableColumnarIntermediateResults && copyOutState->binary &&
+		!OidIsValid(resultDest->partitionRelationId))
+	{
+		resultDest->columnarWriter = CreateColumnarResultWriter(inputTupleDescriptor);
+	}
+
 	if (resultDest->writeLocalFile)
 	{
 		const int fileFlags = (O_APPEND | O_CREAT | O_RDWR | O_TRUNC | PG_BINARY);
@@ -288,11 +451,31 @@ RemoteFileDestReceiverStartup(DestReceiver *dest, int operation,
 	/* must open transaction blocks to use intermediate results */
 	RemoteTransactionsBeginIfNecessary(connectionList);
 
+	if (OidIsValid(resultDest->partitionRelationId))
+	{
+		DistTableCacheEntry *cacheEntry =
+			DistributedTableCacheEntry(resultDest->partitionRelationId);
+
+		resultDest->partitionCacheEntry = cacheEntry;
+		resultDest->shardConnectionLists = ShardConnectionLists(cacheEntry,
+																initialNodeList,
+																connectionList);
+	}
+
+	/* compress the data only once for all nodes */
+	bool compress = (TransmitCompressionThreshold != DISABLE_TRANSMIT_COMPRESSION &&
+					 connectionList != NIL &&
+					 !OidIsValid(resultDest->partitionRelationId));
+	if (compress)
+	{
+		resultDest->compressionBuffer = makeStringInfo();
+	}
+
 	foreach(connectionCell, connectionList)
 	{
 		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
 
-		StringInfo copyCommand = ConstructCopyResultStatement(resultId);
+		StringInfo copyCommand = ConstructCopyResultStatement(resultId, compress);
 
 		bool querySent = SendRemoteCommand(connection, copyCommand->data);
 		if (!querySent)
@@ -315,34 +498,48 @@ RemoteFileDestReceiverStartup(DestReceiver *dest, int operation,
 		PQclear(result);
 	}
 
-	if (copyOutState->binary)
+	resultDest->connectionList = connectionList;
+
+	if (resultDest->columnarWriter != NULL)
+	{
+		/* send the columnar file header */
+		resetStringInfo(copyOutState->fe_msgbuf);
+		ColumnarResultWriteHeader(resultDest->columnarWriter, copyOutState->fe_msgbuf);
+		SendResultData(resultDest, copyOutState->fe_msgbuf);
+
+		if (resultDest->writeLocalFile)
+		{
+			WriteToLocalFile(copyOutState->fe_msgbuf, &resultDest->fileCompat);
+		}
+	}
+	else if (copyOutState->binary)
 	{
 		/* send headers when using binary encoding */
 		resetStringInfo(copyOutState->fe_msgbuf);
 		AppendCopyBinaryHeaders(copyOutState);
-		BroadcastCopyData(copyOutState->fe_msgbuf, connectionList);
+		SendResultData(resultDest, copyOutState->fe_msgbuf);
 
 		if (resultDest->writeLocalFile)
 		{
 			WriteToLocalFile(copyOutState->fe_msgbuf, &resultDest->fileCompat);
 		}
 	}
-
-	resultDest->connectionList = connectionList;
 }
 
 
 /*
  * ConstructCopyResultStatement constructs the text of a COPY statement
- * for copying into a result file.
+ * for copying into a result file, optionally asking the receiving node
+ * to decompress the data.
  */
 static StringInfo
-ConstructCopyResultStatement(const char *resultId)
+ConstructCopyResultStatement(const char *resultId, bool compress)
 {
 	StringInfo command = makeStringInfo();
 
-	appendStringInfo(command, "COPY \"%s\" FROM STDIN WITH (format result)",
-					 resultId);
+	appendStringInfo(command, "COPY \"%s\" FROM STDIN WITH (format result%s)",
+					 resultId, compress ? ", compression '"
+					 TRANSMIT_COMPRESSION_METHOD "'" : "");
 
 	return command;
 }
@@ -360,7 +557,6 @@ RemoteFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
 
 	TupleDesc tupleDescriptor = resultDest->tupleDescriptor;
 
-	List *connectionList = resultDest->connectionList;
 	CopyOutState copyOutState = resultDest->copyOutState;
 	FmgrInfo *columnOutputFunctions = resultDest->columnOutputFunctions;
 
@@ -377,17 +573,46 @@ RemoteFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
 
 	resetStringInfo(copyData);
 
-	/* construct row in COPY format */
-	AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
-					  copyOutState, columnOutputFunctions, NULL);
+	if (resultDest->columnarWriter != NULL)
+	{
+		/* buffer the row and only send full chunks to the nodes */
+		bool chunkFull = ColumnarResultAppendRow(resultDest->columnarWriter,
+												 columnValues, columnNulls);
+		if (chunkFull)
+		{
+			ColumnarResultFlushChunk(resultDest->columnarWriter, copyData);
+		}
+	}
+	else
+	{
+		/* construct row in COPY format */
+		AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
+						  copyOutState, columnOutputFunctions, NULL);
+	}
 
-	/* send row to nodes */
-	BroadcastCopyData(copyData, connectionList);
+	if (resultDest->shardConnectionLists != NULL)
+	{
+		/* send row only to the nodes of its shard */
+		List *connectionList = RowConnectionList(resultDest, columnValues,
+												 columnNulls);
 
-	/* write to local file (if applicable) */
-	if (resultDest->writeLocalFile)
+		BroadcastCopyData(copyData, connectionList);
+
+		if (connectionList != NIL)
+		{
+			resultDest->bytesSent += copyData->len;
+		}
+	}
+	else if (copyData->len > 0)
 	{
-		WriteToLocalFile(copyOutState->fe_msgbuf, &resultDest->fileCompat);
+		/* send row to nodes */
+		SendResultData(resultDest, copyData);
+
+		/* write to local file (if applicable) */
+		if (resultDest->writeLocalFile)
+		{
+			WriteToLocalFile(copyOutState->fe_msgbuf, &resultDest->fileCompat);
+		}
 	}
 
 	MemoryContextSwitchTo(oldContext);
@@ -400,6 +625,77 @@ RemoteFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
 }
 
 
+/*
+ * ShardConnectionLists returns an array that contains the list of connections
+ * to the nodes with a placement of the shard for each shard index of the
+ * given distributed table. The connections in connectionList belong to the
+ * nodes in nodeList at the same position.
+ */
+static List **
+ShardConnectionLists(DistTableCacheEntry *cacheEntry, List *nodeList,
+					 List *connectionList)
+{
+	int shardCount = cacheEntry->shardIntervalArrayLength;
+	List **shardConnectionLists = palloc0(Max(shardCount, 1) * sizeof(List *));
+
+	for (int shardIndex = 0; shardIndex < shardCount; shardIndex++)
+	{
+		ShardInterval *shardInterval = cacheEntry->sortedShardIntervalArray[shardIndex];
+		List *placementList = ActiveShardPlacementList(shardInterval->shardId);
+		ShardPlacement *placement = NULL;
+
+		foreach_ptr(placement, placementList)
+		{
+			ListCell *nodeCell = NULL;
+			ListCell *connectionCell = NULL;
+
+			forboth(nodeCell, nodeList, connectionCell, connectionList)
+			{
+				WorkerNode *workerNode = (WorkerNode *) lfirst(nodeCell);
+
+				if (workerNode->nodeId == placement->nodeId)
+				{
+					shardConnectionLists[shardIndex] =
+						lappend(shardConnectionLists[shardIndex], lfirst(connectionCell));
+				}
+			}
+		}
+	}
+
+	return shardConnectionLists;
+}
+
+
+/*
+ * RowConnectionList returns the connections to the nodes that need the row
+ * with the given values of a partitioned intermediate result. Rows with a
+ * NULL partition column value never find a join partner and are not sent.
+ */
+static List *
+RowConnectionList(RemoteFileDestReceiver *resultDest, Datum *columnValues,
+				  bool *columnNulls)
+{
+	int partitionColumnIndex = resultDest->partitionColumnIndex;
+	DistTableCacheEntry *cacheEntry = resultDest->partitionCacheEntry;
+
+	if (columnNulls[partitionColumnIndex])
+	{
+		return NIL;
+	}
+
+	Datum hashedValue = HashPartitionColumnValue(cacheEntry->hashFunction,
+												 cacheEntry->partitionColumn->varcollid,
+												 columnValues[partitionColumnIndex]);
+	int shardIndex = FindShardIntervalIndex(hashedValue, cacheEntry);
+	if (shardIndex == INVALID_SHARD_INDEX)
+	{
+		return NIL;
+	}
+
+	return resultDest->shardConnectionLists[shardIndex];
+}
+
+
 /*
  * WriteToLocalResultsFile writes the bytes in a StringInfo to a local file.
  */
@@ -430,12 +726,24 @@ RemoteFileDestReceiverShutdown(DestReceiver *destReceiver)
 	List *connectionList = resultDest->connectionList;
 	CopyOutState copyOutState = resultDest->copyOutState;
 
-	if (copyOutState->binary)
+	if (resultDest->columnarWriter != NULL)
+	{
+		/* send the remaining rows and the end of file marker */
+		resetStringInfo(copyOutState->fe_msgbuf);
+		ColumnarResultWriteFooter(resultDest->columnarWriter, copyOutState->fe_msgbuf);
+		SendResultData(resultDest, copyOutState->fe_msgbuf);
+
+		if (resultDest->writeLocalFile)
+		{
+			WriteToLocalFile(copyOutState->fe_msgbuf, &resultDest->fileCompat);
+		}
+	}
+	else if (copyOutState->binary)
 	{
 		/* send footers when using binary encoding */
 		resetStringInfo(copyOutState->fe_msgbuf);
 		AppendCopyBinaryFooters(copyOutState);
-		BroadcastCopyData(copyOutState->fe_msgbuf, connectionList);
+		SendResultData(resultDest, copyOutState->fe_msgbuf);
 
 		if (resultDest->writeLocalFile)
 		{
@@ -443,6 +751,9 @@ RemoteFileDestReceiverShutdown(DestReceiver *destReceiver)
 		}
 	}
 
+	/* send any data that is still waiting to be compressed */
+	FlushCompressionBuffer(resultDest);
+
 	/* close the COPY input */
 	EndRemoteCopy(0, connectionList);
 
@@ -453,6 +764,60 @@ RemoteFileDestReceiverShutdown(DestReceiver *destReceiver)
 }
 
 
+/*
+ * SendResultData sends the given data to all nodes of the intermediate result.
+ * When compression is enabled, the data is buffered until a block of
+ * TRANSMIT_COMPRESSION_BLOCK_SIZE is complete, which is then compressed once
+ * and sent to all nodes.
+ */
+static void
+SendResultData(RemoteFileDestReceiver *resultDest, StringInfo dataBuffer)
+{
+	StringInfo compressionBuffer = resultDest->compressionBuffer;
+
+	resultDest->bytesSent += dataBuffer->len;
+
+	if (compressionBuffer == NULL)
+	{
+		BroadcastCopyData(dataBuffer, resultDest->connectionList);
+		return;
+	}
+
+	appendBinaryStringInfo(compressionBuffer, dataBuffer->data, dataBuffer->len);
+
+	if (compressionBuffer->len >= TRANSMIT_COMPRESSION_BLOCK_SIZE)
+	{
+		FlushCompressionBuffer(resultDest);
+	}
+}
+
+
+/*
+ * FlushCompressionBuffer sends the data in the compression buffer to all nodes
+ * as a single compressed frame.
+ */
+static void
+FlushCompressionBuffer(RemoteFileDestReceiver *resultDest)
+{
+	StringInfo compressionBuffer = resultDest->compressionBuffer;
+
+	if (compressionBuffer == NULL || compressionBuffer->len == 0)
+	{
+		return;
+	}
+
+	StringInfo frame = makeStringInfo();
+	AppendCompressedTransmitFrame(frame, compressionBuffer->data,
+								  compressionBuffer->len);
+
+	BroadcastCopyData(frame, resultDest->connectionList);
+
+	resetStringInfo(compressionBuffer);
+	pfree(frame->data);
+	pfree(frame);
+}
+
+
 /*
  * BroadcastCopyData sends copy data to all connections in a list.
  */
@@ -509,19 +874,42 @@ RemoteFileDestReceiverDestroy(DestReceiver *destReceiver)
  * ReceiveQueryResultViaCopy is called when a COPY "resultid" FROM
  * STDIN WITH (format result) command is received from the client.
  * The command is followed by the raw copy data stream, which is
- * redirected to a file.
+ * redirected to a file. If the command has the compression option,
+ * the stream consists of compressed frames.
  *
  * File names are automatically prefixed with the user OID. Users
  * are only allowed to read query results from their own directory.
  */
 void
-ReceiveQueryResultViaCopy(const char *resultId)
+ReceiveQueryResultViaCopy(const char *resultId, bool decompress)
 {
 	CreateIntermediateResultsDirectory();
 
 	const char *resultFileName = QueryResultFileName(resultId);
 
-	RedirectCopyDataToRegularFile(resultFileName);
+	RedirectCopyDataToRegularFile(resultFileName, decompress);
+}
+
+
+/*
+ * SendQueryResultViaCopy is called when a COPY "resultid" TO STDOUT
+ * WITH (format result) command is received from the client. The contents
+ * of the result file are sent back using the COPY protocol.
+ */
+void
+SendQueryResultViaCopy(const char *resultId)
+{
+	const char *resultFileName = QueryResultFileName(resultId);
+	struct stat fileStat;
+	bool compress = false;
+
+	if (stat(resultFileName, &fileStat) != 0)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("result \"%s\" does not exist", resultId)));
+	}
+
+	SendRegularFile(resultFileName, compress);
 }
 
 
@@ -565,7 +953,7 @@ CreateIntermediateResultsDirectory(void)
  * an intermediate result with the given key in the per transaction
  * result directory.
  */
-static char *
+char *
 QueryResultFileName(const char *resultId)
 {
 	StringInfo resultFileName = makeStringInfo();
@@ -646,7 +1034,7 @@ RemoveIntermediateResultsDirectory(void)
 		StringInfo resultsDirectory = makeStringInfo();
 		appendStringInfoString(resultsDirectory, IntermediateResultsDirectory());
 
-		CitusRemoveDirectory(resultsDirectory);
+		DeferredRemoveDirectory(resultsDirectory);
 
 		CreatedResultsDirectory = false;
 	}
@@ -673,6 +1061,173 @@ IntermediateResultSize(char *resultId)
 }
 
 
+/*
+ * LinkIntermediateResult creates a hard link to the file of the intermediate
+ * result with the given source ID, such that it can also be read under the
+ * given result ID. Any existing result with that ID is replaced.
+ */
+void
+LinkIntermediateResult(const char *sourceResultId, const char *resultId)
+{
+	char *sourceFileName = QueryResultFileName(sourceResultId);
+	char *resultFileName = QueryResultFileName(resultId);
+
+	if (unlink(resultFileName) != 0 && errno != ENOENT)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not remove file \"%s\": %m", resultFileName)));
+	}
+
+	if (link(sourceFileName, resultFileName) != 0)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not link file \"%s\" to \"%s\": %m",
+							   sourceFileName, resultFileName)));
+	}
+}
+
+
+/*
+ * BeginFetchTransaction opens a transaction block on the given connection and
+ * assigns it our distributed transaction ID, such that the remote node finds
+ * the intermediate results of our distributed transaction.
+ */
+static void
+BeginFetchTransaction(MultiConnection *connection)
+{
+	DistributedTransactionId *transactionId = GetCurrentDistributedTransactionId();
+	const char *timestamp = timestamptz_to_str(transactionId->timestamp);
+	StringInfo assignCommand = makeStringInfo();
+
+	appendStringInfo(assignCommand,
+					 "SELECT assign_distributed_transaction_id(%d, " UINT64_FORMAT
+					 ", '%s')",
+					 transactionId->initiatorNodeIdentifier,
+					 transactionId->transactionNumber, timestamp);
+
+	ExecuteCriticalRemoteCommand(connection, "BEGIN");
+	ExecuteCriticalRemoteCommand(connection, assignCommand->data);
+}
+
+
+/*
+ * FetchRemoteIntermediateResult copies the intermediate result with the given
+ * ID over the given connection into the local file of that result, and returns
+ * the number of bytes written.
+ */
+static uint64
+FetchRemoteIntermediateResult(MultiConnection *connection, char *resultId)
+{
+	const int fileFlags = (O_APPEND | O_CREAT | O_RDWR | O_TRUNC | PG_BINARY);
+	const int fileMode = (S_IRUSR | S_IWUSR);
+	PGconn *pgConn = connection->pgConn;
+	bool raiseInterrupts = true;
+	bool fetchDone = false;
+	uint64 bytesWritten = 0;
+	StringInfo copyData = makeStringInfo();
+	StringInfo copyCommand = makeStringInfo();
+
+	appendStringInfo(copyCommand, "COPY \"%s\" TO STDOUT WITH (format result)",
+					 resultId);
+
+	/* make sure the result ID is valid before we send it */
+	char *localFileName = QueryResultFileName(resultId);
+
+	if (!SendRemoteCommand(connection, copyCommand->data))
+	{
+		ReportConnectionError(connection, ERROR);
+	}
+
+	PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+	if (PQresultStatus(result) != PGRES_COPY_OUT)
+	{
+		ReportResultError(connection, result, ERROR);
+	}
+
+	PQclear(result);
+
+	CreateIntermediateResultsDirectory();
+
+	FileCompat fileCompat =
+		FileCompatFromFileStart(FileOpenForTransmit(localFileName, fileFlags,
+													fileMode));
+
+	while (!fetchDone)
+	{
+		char *receiveBuffer = NULL;
+		bool asynchronous = true;
+
+		int receiveLength = PQgetCopyData(pgConn, &receiveBuffer, asynchronous);
+		if (receiveLength > 0)
+		{
+			copyData->data = receiveBuffer;
+			copyData->len = receiveLength;
+
+			WriteToLocalFile(copyData, &fileCompat);
+			bytesWritten += receiveLength;
+
+			PQfreemem(receiveBuffer);
+		}
+		else if (receiveLength == 0)
+		{
+			/* no complete row is available yet */
+			WaitForCopyData(connection);
+		}
+		else if (receiveLength == -1)
+		{
+			fetchDone = true;
+		}
+		else
+		{
+			ReportConnectionError(connection, ERROR);
+		}
+	}
+
+	FileClose(fileCompat.fd);
+
+	result = GetRemoteCommandResult(connection, raiseInterrupts);
+	if (PQresultStatus(result) != PGRES_COMMAND_OK)
+	{
+		ReportResultError(connection, result, ERROR);
+	}
+
+	PQclear(result);
+	ForgetResults(connection);
+
+	return bytesWritten;
+}
+
+
+/*
+ * WaitForCopyData blocks until the given connection has more input during a
+ * COPY TO STDOUT, and reads that input.
+ */
+static void
+WaitForCopyData(MultiConnection *connection)
+{
+	PGconn *pgConn = connection->pgConn;
+	int waitFlags = WL_POSTMASTER_DEATH | WL_LATCH_SET | WL_SOCKET_READABLE;
+
+	int rc = WaitLatchOrSocket(MyLatch, waitFlags, PQsocket(pgConn), 0,
+							   WAIT_EVENT_CITUS_REMOTE_RESULT);
+	if (rc & WL_POSTMASTER_DEATH)
+	{
+		ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
+	}
+
+	if (rc & WL_LATCH_SET)
+	{
+		ResetLatch(MyLatch);
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	if (PQconsumeInput(pgConn) == 0)
+	{
+		ReportConnectionError(connection, ERROR);
+	}
+}
+
+
 /*
  * read_intermediate_result is a UDF that returns a COPY-formatted intermediate
  * result file as a set of records. The file is parsed according to the columns
@@ -680,6 +1235,9 @@ IntermediateResultSize(char *resultId)
  *
  * SELECT * FROM read_intermediate_result('foo', 'csv') AS (a int, b int)
  *
+ * Files that were written in the columnar format are recognised by their
+ * signature and read accordingly, regardless of the given format.
+ *
  * The file is read from the directory returned by IntermediateResultsDirectory,
  * which includes the user ID.
  *
@@ -713,7 +1271,15 @@ read_intermediate_result(PG_FUNCTION_ARGS)
 
 	Tuplestorestate *tupstore = SetupTuplestore(fcinfo, &tupleDescriptor);
 
-	ReadFileIntoTupleStore(resultFileName, copyFormatLabel, tupleDescriptor, tupstore);
+	if (IsColumnarResultFile(resultFileName))
+	{
+		ReadColumnarResultFileIntoTupleStore(resultFileName, tupleDescriptor, tupstore);
+	}
+	else
+	{
+		ReadFileIntoTupleStore(resultFileName, copyFormatLabel, tupleDescriptor,
+							   tupstore);
+	}
 
 	tuplestore_donestoring(tupstore);
 
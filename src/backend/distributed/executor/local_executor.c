@@ -73,11 +73,14 @@
 #include "miscadmin.h"
 
 #include "distributed/citus_custom_scan.h"
+#include "distributed/deparse_shard_query.h"
 #include "distributed/local_executor.h"
+#include "distributed/local_plan_cache.h"
 #include "distributed/multi_executor.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/relation_access_tracking.h"
 #include "distributed/remote_commands.h" /* to access LogRemoteCommands */
+#include "distributed/shard_access_stats.h"
 #include "distributed/transaction_management.h"
 #include "executor/tstoreReceiver.h"
 #include "executor/tuptable.h"
@@ -92,6 +95,7 @@
 
 /* controlled via a GUC */
 bool EnableLocalExecution = true;
+bool EnableLocalExecutionForMultiShardReads = false;
 bool LogLocalCommands = false;
 
 bool LocalExecutionHappened = false;
@@ -103,6 +107,7 @@ static void SplitLocalAndRemotePlacements(List *taskPlacementList,
 static uint64 ExecuteLocalTaskPlan(CitusScanState *scanState, PlannedStmt *taskPlan,
 								   char *queryString);
 static bool TaskAccessesLocalNode(Task *task);
+static bool TaskListIsLocalReadOnly(List *taskList);
 static void LogLocalCommand(const char *command);
 
 static void ExtractParametersForLocalExecution(ParamListInfo paramListInfo,
@@ -142,8 +147,7 @@ ExecuteLocalTaskList(CitusScanState *scanState, List *taskList)
 	{
 		Task *task = (Task *) lfirst(taskCell);
 
-		const char *shardQueryString = task->queryString;
-		Query *shardQuery = ParseQueryString(shardQueryString, parameterTypes, numParams);
+		const char *shardQueryString = TaskQueryString(task);
 
 		/*
 		 * We should not consider using CURSOR_OPT_FORCE_DISTRIBUTED in case of
@@ -154,19 +158,54 @@ ExecuteLocalTaskList(CitusScanState *scanState, List *taskList)
 		int cursorOptions = 0;
 
 		/*
-		 * Altough the shardQuery is local to this node, we prefer planner()
-		 * over standard_planner(). The primary reason for that is Citus itself
-		 * is not very tolarent standard_planner() calls that doesn't go through
-		 * distributed_planner() because of the way that restriction hooks are
-		 * implemented. So, let planner to call distributed_planner() which
-		 * eventually calls standard_planner().
+		 * Local tasks run one at a time, so let the planner use parallel workers
+		 * for reads on large shards. ExecuteLocalTaskPlan() runs the plan to
+		 * completion at once, which parallel plans require.
 		 */
-		PlannedStmt *localPlan = planner(shardQuery, cursorOptions, paramListInfo);
+		if (task->taskType == SELECT_TASK)
+		{
+			cursorOptions |= CURSOR_OPT_PARALLEL_OK;
+		}
+
+		/*
+		 * Prepared statements send the same parameterized shard query on every
+		 * execution, so try to reuse its plan and only bind the parameters.
+		 */
+		PlannedStmt *localPlan = NULL;
+		CachedPlan *cachedPlan = GetCachedLocalTaskPlan(shardQueryString,
+														parameterTypes, numParams,
+														cursorOptions, paramListInfo);
+		if (cachedPlan != NULL)
+		{
+			localPlan = linitial_node(PlannedStmt, cachedPlan->stmt_list);
+		}
+		else
+		{
+			Query *shardQuery = ParseQueryString(shardQueryString, parameterTypes,
+												 numParams);
+
+			/*
+			 * Altough the shardQuery is local to this node, we prefer planner()
+			 * over standard_planner(). The primary reason for that is Citus itself
+			 * is not very tolarent standard_planner() calls that doesn't go through
+			 * distributed_planner() because of the way that restriction hooks are
+			 * implemented. So, let planner to call distributed_planner() which
+			 * eventually calls standard_planner().
+			 */
+			localPlan = planner(shardQuery, cursorOptions, paramListInfo);
+		}
 
 		LogLocalCommand(shardQueryString);
 
+		RecordTaskShardAccess(task);
+
 		totalRowsProcessed +=
-			ExecuteLocalTaskPlan(scanState, localPlan, task->queryString);
+			ExecuteLocalTaskPlan(scanState, localPlan, TaskQueryString(task));
+
+		if (cachedPlan != NULL)
+		{
+			ReleaseCachedPlan(cachedPlan, true);
+		}
 	}
 
 	return totalRowsProcessed;
@@ -410,6 +449,20 @@ ShouldExecuteTasksLocally(List *taskList)
 		return !AnyConnectionAccessedPlacements();
 	}
 
+	if (!singleTask && EnableLocalExecutionForMultiShardReads &&
+		!IsMultiStatementTransaction() && TaskListIsLocalReadOnly(taskList))
+	{
+		/*
+		 * All tasks are reads on shards of this node, so a distributed execution
+		 * would only open connections to the node itself. Instead, we execute
+		 * the tasks locally, one at a time, each of which may use parallel
+		 * workers. We only do this outside of transaction blocks, such that
+		 * later commands in the transaction are not forced to use local
+		 * execution as well.
+		 */
+		return !AnyConnectionAccessedPlacements();
+	}
+
 	if (!singleTask)
 	{
 		/*
@@ -427,6 +480,29 @@ ShouldExecuteTasksLocally(List *taskList)
 }
 
 
+/*
+ * TaskListIsLocalReadOnly returns true if all tasks in the list are reads that
+ * can be answered from a placement on the node that we're executing the query.
+ */
+static bool
+TaskListIsLocalReadOnly(List *taskList)
+{
+	ListCell *taskCell = NULL;
+
+	foreach(taskCell, taskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+
+		if (task->taskType != SELECT_TASK || !TaskAccessesLocalNode(task))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
 /*
  * TaskAccessesLocalNode returns true if any placements of the task reside on the
  * node that we're executing the query.
@@ -0,0 +1,256 @@
+/*-------------------------------------------------------------------------
+ *
+ * local_plan_cache.c
+ *
+ * Prepared statements that are executed locally send the same parameterized
+ * query string to a given shard on every execution. Instead of parsing and
+ * planning that query string each time, we keep a backend-local cache of
+ * CachedPlanSources keyed by the shard query string and only bind the new
+ * parameter values on subsequent executions.
+ *
+ * The heavy lifting is done by PostgreSQL's plancache, which re-validates the
+ * plans on relation and catalog invalidations and decides between custom and
+ * generic plans the same way it does for regular prepared statements.
+ *
+ * Copyright (c) 2019, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/hash.h"
+#include "distributed/local_plan_cache.h"
+#include "nodes/nodeFuncs.h"
+#include "tcop/tcopprot.h"
+#include "tcop/utility.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "utils/resowner.h"
+
+
+/*
+ * Upper bound on the number of shard queries for which we keep a plan. Once
+ * it is reached we stop caching new shard queries rather than evicting, since
+ * a plan of an evicted entry might still be in use by an outer execution.
+ */
+#define MAX_LOCAL_PLAN_CACHE_ENTRIES 1024
+
+
+/* hash entry that maps a shard query string to its cached plan source */
+typedef struct LocalPlanCacheEntry
+{
+	/* hash key, must be the first field */
+	char *queryString;
+
+	CachedPlanSource *planSource;
+} LocalPlanCacheEntry;
+
+
+static HTAB *LocalPlanCache = NULL;
+
+
+static void InitializeLocalPlanCache(void);
+static uint32 LocalPlanCacheHash(const void *key, Size keysize);
+static int LocalPlanCacheCompare(const void *leftKey, const void *rightKey,
+								 Size keysize);
+static CachedPlanSource * CreateLocalTaskPlanSource(const char *queryString,
+													Oid *parameterTypes,
+													int numParams, int cursorOptions);
+static bool ParameterTypesMatch(CachedPlanSource *planSource, Oid *parameterTypes,
+								int numParams);
+static bool ContainsExternParamWalker(Node *node, void *context);
+
+
+/*
+ * GetCachedLocalTaskPlan returns a plan for the given shard query string with
+ * the given parameters bound, using (and populating) the local plan cache. The
+ * plan is registered with the current resource owner and the caller should
+ * release it via ReleaseCachedPlan(plan, true) once the execution finishes.
+ *
+ * The function returns NULL if the query is not worth or not safe to cache, in
+ * which case the caller should plan the query itself.
+ */
+CachedPlan *
+GetCachedLocalTaskPlan(const char *queryString, Oid *parameterTypes, int numParams,
+					   int cursorOptions, ParamListInfo paramListInfo)
+{
+	bool found = false;
+
+	/*
+	 * Without parameters, the values are embedded in the query string and
+	 * hence almost every execution would produce a new cache entry.
+	 */
+	if (numParams == 0)
+	{
+		return NULL;
+	}
+
+	if (LocalPlanCache == NULL)
+	{
+		InitializeLocalPlanCache();
+	}
+
+	LocalPlanCacheEntry *cacheEntry =
+		(LocalPlanCacheEntry *) hash_search(LocalPlanCache, &queryString, HASH_FIND,
+											&found);
+	if (!found)
+	{
+		if (hash_get_num_entries(LocalPlanCache) >= MAX_LOCAL_PLAN_CACHE_ENTRIES)
+		{
+			return NULL;
+		}
+
+		CachedPlanSource *planSource = CreateLocalTaskPlanSource(queryString,
+																 parameterTypes,
+																 numParams,
+																 cursorOptions);
+		if (planSource == NULL)
+		{
+			return NULL;
+		}
+
+		cacheEntry = (LocalPlanCacheEntry *) hash_search(LocalPlanCache, &queryString,
+														 HASH_ENTER, &found);
+
+		/* the key should point to memory that lives as long as the entry */
+		cacheEntry->queryString = MemoryContextStrdup(CacheMemoryContext, queryString);
+		cacheEntry->planSource = planSource;
+	}
+	else if (!ParameterTypesMatch(cacheEntry->planSource, parameterTypes, numParams))
+	{
+		/* same query string used with differently typed parameters */
+		return NULL;
+	}
+
+	return GetCachedPlan(cacheEntry->planSource, paramListInfo, true, NULL);
+}
+
+
+/*
+ * InitializeLocalPlanCache creates the hash that maps shard query strings to
+ * their plan sources.
+ */
+static void
+InitializeLocalPlanCache(void)
+{
+	HASHCTL info;
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(char *);
+	info.entrysize = sizeof(LocalPlanCacheEntry);
+	info.hash = LocalPlanCacheHash;
+	info.match = LocalPlanCacheCompare;
+	info.hcxt = CacheMemoryContext;
+	uint32 hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT | HASH_COMPARE);
+
+	LocalPlanCache = hash_create("citus local plan cache", 64, &info, hashFlags);
+}
+
+
+/*
+ * LocalPlanCacheHash hashes the query string that the key points to.
+ */
+static uint32
+LocalPlanCacheHash(const void *key, Size keysize)
+{
+	const char *queryString = *(const char **) key;
+
+	return hash_any((const unsigned char *) queryString, strlen(queryString));
+}
+
+
+/*
+ * LocalPlanCacheCompare compares the query strings that the keys point to.
+ */
+static int
+LocalPlanCacheCompare(const void *leftKey, const void *rightKey, Size keysize)
+{
+	const char *leftQueryString = *(const char **) leftKey;
+	const char *rightQueryString = *(const char **) rightKey;
+
+	return strcmp(leftQueryString, rightQueryString);
+}
+
+
+/*
+ * CreateLocalTaskPlanSource parses and analyzes the given shard query string
+ * and returns a saved CachedPlanSource for it. Queries that do not consist of a
+ * single statement referencing the parameters are not cached, and NULL is
+ * returned for them.
+ */
+static CachedPlanSource *
+CreateLocalTaskPlanSource(const char *queryString, Oid *parameterTypes, int numParams,
+						  int cursorOptions)
+{
+	List *parseTreeList = pg_parse_query(queryString);
+	if (list_length(parseTreeList) != 1)
+	{
+		return NULL;
+	}
+
+	RawStmt *rawStmt = (RawStmt *) linitial(parseTreeList);
+	CachedPlanSource *planSource =
+		CreateCachedPlan(rawStmt, queryString, CreateCommandTag(rawStmt->stmt));
+
+	List *queryTreeList = pg_analyze_and_rewrite(rawStmt, queryString, parameterTypes,
+												 numParams, NULL);
+	if (list_length(queryTreeList) != 1 ||
+		!ContainsExternParamWalker((Node *) linitial(queryTreeList), NULL))
+	{
+		DropCachedPlan(planSource);
+		return NULL;
+	}
+
+	CompleteCachedPlan(planSource, queryTreeList, NULL, parameterTypes, numParams,
+					   NULL, NULL, cursorOptions, false);
+	SaveCachedPlan(planSource);
+
+	return planSource;
+}
+
+
+/*
+ * ParameterTypesMatch returns true if the plan source was created for the
+ * given parameter types.
+ */
+static bool
+ParameterTypesMatch(CachedPlanSource *planSource, Oid *parameterTypes, int numParams)
+{
+	if (planSource->num_params != numParams)
+	{
+		return false;
+	}
+
+	return memcmp(planSource->param_types, parameterTypes,
+				  numParams * sizeof(Oid)) == 0;
+}
+
+
+/*
+ * ContainsExternParamWalker returns true if the given query tree references an
+ * external parameter. When the parameter values are already embedded into the
+ * shard query string, caching its plan would rarely pay off.
+ */
+static bool
+ContainsExternParamWalker(Node *node, void *context)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	if (IsA(node, Param))
+	{
+		Param *param = (Param *) node;
+
+		return param->paramkind == PARAM_EXTERN;
+	}
+
+	if (IsA(node, Query))
+	{
+		return query_tree_walker((Query *) node, ContainsExternParamWalker, context, 0);
+	}
+
+	return expression_tree_walker(node, ContainsExternParamWalker, context);
+}
@@ -26,6 +26,7 @@
 #include "distributed/placement_connection.h"
 #include "distributed/remote_commands.h"
 #include "distributed/subplan_execution.h"
+#include "distributed/transmit.h"
 
 #include <errno.h>
 #include <unistd.h>
@@ -266,6 +267,22 @@ MultiClientConnectionUp(int32 connectionId)
 }
 
 
+/*
+ * MultiClientSocket returns the socket descriptor of the given connection, or
+ * -1 if the connection is closed. Callers use the descriptor to wait for query
+ * results in a wait event set rather than polling the connection.
+ */
+int
+MultiClientSocket(int32 connectionId)
+{
+	Assert(connectionId != INVALID_CONNECTION_ID);
+	MultiConnection *connection = ClientConnectionArray[connectionId];
+	Assert(connection != NULL);
+
+	return PQsocket(connection->pgConn);
+}
+
+
 /* MultiClientSendQuery sends the given query over the given connection. */
 bool
 MultiClientSendQuery(int32 connectionId, const char *query)
@@ -508,11 +525,17 @@ MultiClientQueryStatus(int32 connectionId)
 }
 
 
-/* MultiClientCopyData copies data from the file. */
+/*
+ * MultiClientCopyData copies data from the file. If decompress is set, every copy
+ * data message is a frame created by AppendCompressedTransmitFrame, which is
+ * decompressed before it is appended to the file.
+ */
 CopyStatus
-MultiClientCopyData(int32 connectionId, int32 fileDescriptor, uint64 *returnBytesReceived)
+MultiClientCopyData(int32 connectionId, int32 fileDescriptor, uint64 *returnBytesReceived,
+					bool decompress)
 {
 	char *receiveBuffer = NULL;
+	StringInfo decompressedData = NULL;
 	const int asynchronous = 1;
 	CopyStatus copyStatus = CLIENT_INVALID_COPY;
 
@@ -531,20 +554,36 @@ MultiClientCopyData(int32 connectionId, int32 fileDescriptor, uint64 *returnByte
 		return CLIENT_COPY_FAILED;
 	}
 
+	if (decompress)
+	{
+		decompressedData = makeStringInfo();
+	}
+
 	/* receive copy data message in an asynchronous manner */
 	int receiveLength = PQgetCopyData(connection->pgConn, &receiveBuffer, asynchronous);
 	while (receiveLength > 0)
 	{
-		/* received copy data; append these data to file */
-		errno = 0;
+		char *fileData = receiveBuffer;
+		int fileDataLength = receiveLength;
 
 		if (returnBytesReceived)
 		{
 			*returnBytesReceived += receiveLength;
 		}
 
-		int appended = write(fileDescriptor, receiveBuffer, receiveLength);
-		if (appended != receiveLength)
+		if (decompress)
+		{
+			DecompressTransmitFrame(receiveBuffer, receiveLength, decompressedData);
+
+			fileData = decompressedData->data;
+			fileDataLength = decompressedData->len;
+		}
+
+		/* received copy data; append these data to file */
+		errno = 0;
+
+		int appended = write(fileDescriptor, fileData, fileDataLength);
+		if (appended != fileDataLength)
 		{
 			/* if write didn't set errno, assume problem is no disk space */
 			if (errno == 0)
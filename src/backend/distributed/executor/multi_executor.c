@@ -58,7 +58,6 @@ bool SortReturning = false;
 
 
 /* local function forward declarations */
-static Relation StubRelation(TupleDesc tupleDescriptor);
 static bool AlterTableConstraintCheck(QueryDesc *queryDesc);
 static bool IsLocalReferenceTableJoinPlan(PlannedStmt *plan);
 
@@ -423,7 +422,7 @@ SortTupleStore(CitusScanState *scanState)
  * relation corresponding to the data loaded from workers, we need to fake one.
  * We just need the bare minimal set of fields accessed by BeginCopyFrom().
  */
-static Relation
+Relation
 StubRelation(TupleDesc tupleDescriptor)
 {
 	Relation stubRelation = palloc0(sizeof(RelationData));
@@ -19,12 +19,14 @@
 
 #include <unistd.h>
 
+#include "distributed/deferred_cleanup.h"
 #include "distributed/multi_client_executor.h"
 #include "distributed/multi_executor.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/multi_resowner.h"
 #include "distributed/multi_server_executor.h"
 #include "distributed/subplan_execution.h"
+#include "distributed/transaction_management.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/log_utils.h"
 #include "utils/lsyscache.h"
@@ -91,8 +93,12 @@ JobExecutorType(DistributedPlan *distributedPlan)
 
 	if (executorType == MULTI_EXECUTOR_ADAPTIVE)
 	{
-		/* if we have repartition jobs with adaptive executor and repartition
-		 * joins are not enabled, error out. Otherwise, switch to task-tracker
+		/*
+		 * If we have repartition jobs with adaptive executor and repartition
+		 * joins are not enabled, error out. Otherwise, the adaptive executor
+		 * runs the repartition tasks, except in transaction blocks where the
+		 * merged tables would only be visible over a single connection, and
+		 * we switch to task-tracker.
 		 */
 		int dependentJobCount = list_length(job->dependentJobList);
 		if (dependentJobCount > 0)
@@ -105,6 +111,11 @@ JobExecutorType(DistributedPlan *distributedPlan)
 										"to enable repartitioning")));
 			}
 
+			if (!RepartitionJobsRequireTaskTracker(distributedPlan))
+			{
+				return MULTI_EXECUTOR_ADAPTIVE;
+			}
+
 			ereport(DEBUG1, (errmsg(
 								 "cannot use adaptive executor with repartition jobs"),
 							 errhint("Since you enabled citus.enable_repartition_joins "
@@ -131,6 +142,33 @@ JobExecutorType(DistributedPlan *distributedPlan)
 }
 
 
+/*
+ * RepartitionJobsRequireTaskTracker returns true if the given plan has
+ * repartition jobs that the adaptive executor cannot run in the current
+ * transaction state. JobExecutorType checks this at planning time, but cached
+ * plans can later be executed inside a transaction block, so the adaptive
+ * executor checks it again when the scan is created.
+ */
+bool
+RepartitionJobsRequireTaskTracker(DistributedPlan *distributedPlan)
+{
+	Job *job = distributedPlan->workerJob;
+
+	if (job == NULL || job->dependentJobList == NIL)
+	{
+		return false;
+	}
+
+	if (distributedPlan->modLevel != ROW_MODIFY_READONLY ||
+		distributedPlan->insertSelectSubquery != NULL)
+	{
+		return false;
+	}
+
+	return IsMultiStatementTransaction() || InCoordinatedTransaction();
+}
+
+
 /*
  * MaxMasterConnectionCount returns the number of connections a master can open.
  * A master cannot create more than a certain number of file descriptors (FDs).
@@ -155,7 +193,7 @@ void
 RemoveJobDirectory(uint64 jobId)
 {
 	StringInfo jobDirectoryName = MasterJobDirectoryName(jobId);
-	CitusRemoveDirectory(jobDirectoryName);
+	DeferredRemoveDirectory(jobDirectoryName);
 
 	ResourceOwnerForgetJobDirectory(CurrentResourceOwner, jobId);
 }
@@ -277,7 +315,10 @@ AdjustStateForFailure(TaskExecution *taskExecution)
 
 /*
  * CheckIfSizeLimitIsExceeded checks if the limit is exceeded by intermediate
- * results, if there is any.
+ * results, if there is any. When citus.intermediate_result_size_limit_action
+ * is spill, exceeding the limit is only reported once per execution: the rows
+ * are kept in tuple stores, which move to temporary files once they exceed
+ * work_mem, such that temp_file_limit bounds the disk usage instead.
  */
 bool
 CheckIfSizeLimitIsExceeded(DistributedExecutionStats *executionStats)
@@ -293,6 +334,21 @@ CheckIfSizeLimitIsExceeded(DistributedExecutionStats *executionStats)
 		return false;
 	}
 
+	if (IntermediateResultSizeLimitAction == INTERMEDIATE_RESULT_SIZE_LIMIT_SPILL)
+	{
+		if (!executionStats->sizeLimitReported)
+		{
+			ereport(DEBUG1, (errmsg("the intermediate result size exceeds "
+									"citus.max_intermediate_result_size (currently "
+									"%d kB), continuing on disk",
+									MaxIntermediateResult)));
+
+			executionStats->sizeLimitReported = true;
+		}
+
+		return false;
+	}
+
 	return true;
 }
 
@@ -313,5 +369,7 @@ ErrorSizeLimitIsExceeded()
 							  "into once place."),
 					errhint("To run the current query, set "
 							"citus.max_intermediate_result_size to a higher"
-							" value or -1 to disable.")));
+							" value or -1 to disable, or set "
+							"citus.intermediate_result_size_limit_action to "
+							"spill.")));
 }
@@ -28,6 +28,7 @@
 #include "distributed/citus_custom_scan.h"
 #include "distributed/citus_nodes.h"
 #include "distributed/connection_management.h"
+#include "distributed/deparse_shard_query.h"
 #include "distributed/distributed_execution_locks.h"
 #include "distributed/local_executor.h"
 #include "distributed/metadata_cache.h"
@@ -49,6 +50,7 @@
 
 int MaxAssignTaskBatchSize = 64; /* maximum number of tasks to assign per round */
 int MaxTaskStatusBatchSize = 64; /* maximum number of tasks status checks per round */
+bool EnableTaskStealing = true;  /* move waiting tasks to idle task trackers */
 
 
 /* TaskMapKey is used as a key in task hash */
@@ -125,6 +127,9 @@ static List * ConstrainedMergeTaskList(List *taskAndExecutionList, Task *task);
 static List * MergeTaskList(List *taskList);
 static void ReassignTaskList(List *taskList);
 static void ReassignMapFetchTaskList(List *mapFetchTaskList);
+static void StealWaitingTasks(HTAB *taskTrackerHash, List *taskAndExecutionList);
+static bool StealableTask(TaskTracker *taskTracker, Task *task);
+static int32 IdlePlacementIndex(HTAB *taskTrackerHash, Task *task);
 
 /* Local functions forward declarations to manage task trackers */
 static void ManageTaskTracker(TaskTracker *taskTracker);
@@ -232,6 +237,12 @@ MultiTaskTrackerExecute(Job *job)
 		uint32 healthyTrackerCount = 0;
 		double acceptableHealthyTrackerCount = 0.0;
 
+		/* hand tasks still waiting on busy trackers over to idle ones */
+		if (EnableTaskStealing)
+		{
+			StealWaitingTasks(taskTrackerHash, taskAndExecutionList);
+		}
+
 		/* first, loop around all tasks and manage them */
 		foreach(taskAndExecutionCell, taskAndExecutionList)
 		{
@@ -1373,7 +1384,7 @@ ManageTransmitExecution(TaskTracker *transmitTracker,
 			Assert(connectionId != INVALID_CONNECTION_ID);
 
 			CopyStatus copyStatus = MultiClientCopyData(connectionId, fileDescriptor,
-														&bytesReceived);
+														&bytesReceived, false);
 
 			if (SubPlanLevel > 0)
 			{
@@ -1575,7 +1586,7 @@ TrackerQueueSqlTask(TaskTracker *taskTracker, Task *task)
 	 */
 
 	StringInfo sqlTaskQueryString = makeStringInfo();
-	char *escapedTaskQueryString = quote_literal_cstr(task->queryString);
+	char *escapedTaskQueryString = quote_literal_cstr(TaskQueryString(task));
 
 	if (BinaryMasterCopyFormat)
 	{
@@ -1610,7 +1621,7 @@ TrackerQueueTask(TaskTracker *taskTracker, Task *task)
 	HTAB *taskStateHash = taskTracker->taskStateHash;
 
 	/* wrap a task assignment query outside the original query */
-	StringInfo taskAssignmentQuery = TaskAssignmentQuery(task, task->queryString);
+	StringInfo taskAssignmentQuery = TaskAssignmentQuery(task, TaskQueryString(task));
 
 	TrackerTaskState *taskState = TaskStateHashEnter(taskStateHash, task->jobId,
 													 task->taskId);
@@ -2074,6 +2085,168 @@ ReassignMapFetchTaskList(List *mapFetchTaskList)
 }
 
 
+/*
+ * StealWaitingTasks moves tasks that wait on a busy task tracker to an idle one.
+ * Placement based assignment binds each task to a task tracker up front; when
+ * one worker node is slower than the rest, its tasks pile up while the other
+ * trackers run out of work. For this, the function first counts the queued
+ * tasks on each tracker. It then walks over the tasks that have not started to
+ * run yet, and moves them to another placement whose tracker has nothing to do.
+ *
+ * The tracker we steal from may still start the task. We then simply disregard
+ * its results, and the job cleanup at the end of execution removes them.
+ */
+static void
+StealWaitingTasks(HTAB *taskTrackerHash, List *taskAndExecutionList)
+{
+	ListCell *taskAndExecutionCell = NULL;
+	HASH_SEQ_STATUS status;
+
+	hash_seq_init(&status, taskTrackerHash);
+
+	TaskTracker *taskTracker = (TaskTracker *) hash_seq_search(&status);
+	while (taskTracker != NULL)
+	{
+		taskTracker->queuedTaskCount = 0;
+
+		taskTracker = (TaskTracker *) hash_seq_search(&status);
+	}
+
+	foreach(taskAndExecutionCell, taskAndExecutionList)
+	{
+		Task *task = (Task *) lfirst(taskAndExecutionCell);
+		TaskExecution *taskExecution = task->taskExecution;
+		uint32 currentNodeIndex = taskExecution->currentNodeIndex;
+
+		if (taskExecution->taskStatusArray[currentNodeIndex] == EXEC_TASK_QUEUED)
+		{
+			taskTracker = ResolveTaskTracker(taskTrackerHash, task, taskExecution);
+			taskTracker->queuedTaskCount++;
+		}
+	}
+
+	foreach(taskAndExecutionCell, taskAndExecutionList)
+	{
+		Task *task = (Task *) lfirst(taskAndExecutionCell);
+		TaskExecution *taskExecution = task->taskExecution;
+		uint32 currentNodeIndex = taskExecution->currentNodeIndex;
+
+		taskTracker = ResolveTaskTracker(taskTrackerHash, task, taskExecution);
+
+		/* a tracker with a single task has no other task to run instead */
+		if (taskTracker->queuedTaskCount <= 1 || !StealableTask(taskTracker, task))
+		{
+			continue;
+		}
+
+		int32 idlePlacementIndex = IdlePlacementIndex(taskTrackerHash, task);
+		if (idlePlacementIndex == -1)
+		{
+			continue;
+		}
+
+		/* stop assigning the task to, and checking its status on, the busy tracker */
+		TrackerTaskState *taskState = TrackerTaskStateHashLookup(
+			taskTracker->taskStateHash, task);
+		taskState->status = TASK_CANCEL_REQUESTED;
+		taskTracker->queuedTaskCount--;
+
+		taskExecution->taskStatusArray[currentNodeIndex] = EXEC_TASK_UNASSIGNED;
+		taskExecution->currentNodeIndex = (uint32) idlePlacementIndex;
+		taskExecution->taskStatusArray[idlePlacementIndex] = EXEC_TASK_UNASSIGNED;
+
+		TaskTracker *idleTracker = ResolveTaskTracker(taskTrackerHash, task,
+													  taskExecution);
+		idleTracker->queuedTaskCount++;
+
+		ereport(DEBUG2, (errmsg("moving task %u from node \"%s:%u\" to idle node "
+								"\"%s:%u\"", task->taskId, taskTracker->workerName,
+								taskTracker->workerPort, idleTracker->workerName,
+								idleTracker->workerPort)));
+	}
+}
+
+
+/*
+ * StealableTask checks if the given task may move to another task tracker. We
+ * only move SQL and map tasks without any dependencies; all other tasks need to
+ * run on the same tracker as the rest of their constraint group. Further, the
+ * task must still wait on its tracker: either it is queued on our side, or the
+ * remote tracker has not scheduled it yet.
+ */
+static bool
+StealableTask(TaskTracker *taskTracker, Task *task)
+{
+	TaskExecution *taskExecution = task->taskExecution;
+	uint32 currentNodeIndex = taskExecution->currentNodeIndex;
+
+	if (task->taskType != SELECT_TASK && task->taskType != MAP_TASK)
+	{
+		return false;
+	}
+
+	if (task->dependentTaskList != NIL || taskExecution->nodeCount <= 1)
+	{
+		return false;
+	}
+
+	if (taskExecution->taskStatusArray[currentNodeIndex] != EXEC_TASK_QUEUED ||
+		taskExecution->transmitStatusArray[currentNodeIndex] != EXEC_TRANSMIT_UNASSIGNED)
+	{
+		return false;
+	}
+
+	/* a pending status check would overwrite the status we set below */
+	if (taskTracker->connectionBusy)
+	{
+		return false;
+	}
+
+	TaskStatus remoteTaskStatus = TrackerTaskStatus(taskTracker, task);
+	if (remoteTaskStatus != TASK_CLIENT_SIDE_QUEUED &&
+		remoteTaskStatus != TASK_ASSIGNED)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * IdlePlacementIndex looks for a placement of the given task whose task tracker
+ * is healthy, connected, and has no queued tasks. The function returns the
+ * index of the first such placement, or -1 if there is none.
+ */
+static int32
+IdlePlacementIndex(HTAB *taskTrackerHash, Task *task)
+{
+	TaskExecution *taskExecution = task->taskExecution;
+	ListCell *placementCell = NULL;
+	int32 placementIndex = 0;
+
+	foreach(placementCell, task->taskPlacementList)
+	{
+		ShardPlacement *placement = (ShardPlacement *) lfirst(placementCell);
+		TaskTracker *taskTracker = TrackerHashLookup(taskTrackerHash,
+													 placement->nodeName,
+													 placement->nodePort);
+
+		if (placementIndex != taskExecution->currentNodeIndex &&
+			taskTracker->queuedTaskCount == 0 &&
+			taskTracker->trackerStatus == TRACKER_CONNECTED &&
+			TrackerHealthy(taskTracker))
+		{
+			return placementIndex;
+		}
+
+		placementIndex++;
+	}
+
+	return -1;
+}
+
+
 /*
  * ManageTaskTracker manages tasks assigned to the given task tracker. For this,
  * the function coordinates access to the underlying connection. The function
@@ -0,0 +1,399 @@
+/*-------------------------------------------------------------------------
+ *
+ * partitioned_intermediate_results.c
+ *   Functions for writing partitioned intermediate results.
+ *
+ * worker_partition_query_result runs a query and splits its rows into one
+ * intermediate result per hash range, such that the nodes of the shards that
+ * own these ranges can fetch and read only the rows that belong to them.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#include "access/hash.h"
+#include "catalog/pg_am.h"
+#include "distributed/intermediate_results.h"
+#include "distributed/multi_executor.h"
+#include "distributed/shardinterval_utils.h"
+#include "distributed/transaction_management.h"
+#include "distributed/tuplestore.h"
+#include "distributed/worker_protocol.h"
+#include "executor/executor.h"
+#include "utils/builtins.h"
+
+
+/*
+ * PartitionedResultDestReceiver hashes the partition column of each tuple and
+ * forwards the tuple to the RemoteFileDestReceiver of the partition whose hash
+ * range contains the hashed value. Files are only created for partitions that
+ * receive rows.
+ */
+typedef struct PartitionedResultDestReceiver
+{
+	/* public DestReceiver interface */
+	DestReceiver pub;
+
+	/* partition files are named <resultIdPrefix>_<partition index> */
+	char *resultIdPrefix;
+
+	/* EState for per-tuple memory allocation */
+	EState *executorState;
+
+	/* the startup arguments, which we pass on to the partition receivers */
+	int operation;
+	TupleDesc tupleDescriptor;
+
+	/* position of the partition column in the tuples */
+	int partitionColumnIndex;
+	FmgrInfo *hashFunction;
+	Oid partitionColumnCollation;
+
+	/* sorted and non-overlapping hash ranges of the partitions */
+	int partitionCount;
+	int32 *partitionMinValues;
+	int32 *partitionMaxValues;
+
+	/* receivers of partitions that received rows, NULL for the others */
+	DestReceiver **partitionDestReceivers;
+	uint64 *partitionRowCounts;
+} PartitionedResultDestReceiver;
+
+
+static int32 * DeconstructHashRangeArray(ArrayType *rangeArrayObject);
+static DestReceiver * CreatePartitionedResultDestReceiver(char *resultIdPrefix,
+														  EState *executorState,
+														  int partitionColumnIndex,
+														  int partitionCount,
+														  int32 *partitionMinValues,
+														  int32 *partitionMaxValues);
+static void PartitionedResultDestReceiverStartup(DestReceiver *dest, int operation,
+												 TupleDesc inputTupleDescriptor);
+static bool PartitionedResultDestReceiverReceive(TupleTableSlot *slot,
+												 DestReceiver *dest);
+static int FindHashRangePartitionIndex(PartitionedResultDestReceiver *resultDest,
+									   int32 hashedValue);
+static void PartitionedResultDestReceiverShutdown(DestReceiver *dest);
+static void PartitionedResultDestReceiverDestroy(DestReceiver *dest);
+
+
+/* exports for SQL callable functions */
+PG_FUNCTION_INFO_V1(worker_partition_query_result);
+
+
+/*
+ * worker_partition_query_result runs the given query and writes each of its
+ * rows into the intermediate result of the partition whose hash range contains
+ * the hash of the value in the given partition column. The partitions are
+ * defined by arrays of the minimum and maximum hash values of each partition.
+ *
+ * The function returns the index and the row count of every partition that
+ * received rows, the intermediate result of such a partition is named
+ * <result_prefix>_<partition index>.
+ */
+Datum
+worker_partition_query_result(PG_FUNCTION_ARGS)
+{
+	text *resultIdPrefixText = PG_GETARG_TEXT_P(0);
+	char *resultIdPrefix = text_to_cstring(resultIdPrefixText);
+	text *queryText = PG_GETARG_TEXT_P(1);
+	char *queryString = text_to_cstring(queryText);
+	int partitionColumnIndex = PG_GETARG_INT32(2);
+	ArrayType *minValuesObject = PG_GETARG_ARRAYTYPE_P(3);
+	ArrayType *maxValuesObject = PG_GETARG_ARRAYTYPE_P(4);
+	ParamListInfo paramListInfo = NULL;
+	TupleDesc returnDescriptor = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	int partitionCount = ArrayObjectCount(minValuesObject);
+	if (ArrayObjectCount(maxValuesObject) != partitionCount)
+	{
+		ereport(ERROR, (errmsg("the number of min values and max values of the "
+							   "partitions must be equal")));
+	}
+
+	int32 *partitionMinValues = DeconstructHashRangeArray(minValuesObject);
+	int32 *partitionMaxValues = DeconstructHashRangeArray(maxValuesObject);
+
+	for (int partitionIndex = 0; partitionIndex < partitionCount; partitionIndex++)
+	{
+		if (partitionMinValues[partitionIndex] > partitionMaxValues[partitionIndex] ||
+			(partitionIndex > 0 &&
+			 partitionMinValues[partitionIndex] <=
+			 partitionMaxValues[partitionIndex - 1]))
+		{
+			ereport(ERROR, (errmsg("partition hash ranges must be sorted and must "
+								   "not overlap")));
+		}
+	}
+
+	/*
+	 * Make sure that this transaction has a distributed transaction ID.
+	 *
+	 * Intermediate results will be stored in a directory that is derived
+	 * from the distributed transaction ID.
+	 */
+	BeginOrContinueCoordinatedTransaction();
+
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &returnDescriptor);
+
+	EState *estate = CreateExecutorState();
+	PartitionedResultDestReceiver *resultDest =
+		(PartitionedResultDestReceiver *) CreatePartitionedResultDestReceiver(
+			resultIdPrefix, estate, partitionColumnIndex, partitionCount,
+			partitionMinValues, partitionMaxValues);
+
+	ExecuteQueryStringIntoDestReceiver(queryString, paramListInfo,
+									   (DestReceiver *) resultDest);
+
+	for (int partitionIndex = 0; partitionIndex < partitionCount; partitionIndex++)
+	{
+		uint64 rowCount = resultDest->partitionRowCounts[partitionIndex];
+		Datum values[2];
+		bool nulls[2];
+
+		if (rowCount == 0)
+		{
+			continue;
+		}
+
+		memset(nulls, false, sizeof(nulls));
+		values[0] = Int32GetDatum(partitionIndex);
+		values[1] = Int64GetDatum(rowCount);
+
+		tuplestore_putvalues(tupleStore, returnDescriptor, values, nulls);
+	}
+
+	tuplestore_donestoring(tupleStore);
+
+	resultDest->pub.rDestroy((DestReceiver *) resultDest);
+	FreeExecutorState(estate);
+
+	return (Datum) 0;
+}
+
+
+/*
+ * DeconstructHashRangeArray returns the elements of the given array of hash
+ * values as a C array.
+ */
+static int32 *
+DeconstructHashRangeArray(ArrayType *rangeArrayObject)
+{
+	int valueCount = ArrayObjectCount(rangeArrayObject);
+	Datum *valueArray = DeconstructArrayObject(rangeArrayObject);
+	int32 *hashValueArray = palloc0(valueCount * sizeof(int32));
+
+	for (int valueIndex = 0; valueIndex < valueCount; valueIndex++)
+	{
+		hashValueArray[valueIndex] = DatumGetInt32(valueArray[valueIndex]);
+	}
+
+	return hashValueArray;
+}
+
+
+/*
+ * CreatePartitionedResultDestReceiver creates a DestReceiver that writes the
+ * tuples it receives into the intermediate results of the given partitions.
+ */
+static DestReceiver *
+CreatePartitionedResultDestReceiver(char *resultIdPrefix, EState *executorState,
+									int partitionColumnIndex, int partitionCount,
+									int32 *partitionMinValues,
+									int32 *partitionMaxValues)
+{
+	PartitionedResultDestReceiver *resultDest =
+		palloc0(sizeof(PartitionedResultDestReceiver));
+
+	/* set up the DestReceiver function pointers */
+	resultDest->pub.receiveSlot = PartitionedResultDestReceiverReceive;
+	resultDest->pub.rStartup = PartitionedResultDestReceiverStartup;
+	resultDest->pub.rShutdown = PartitionedResultDestReceiverShutdown;
+	resultDest->pub.rDestroy = PartitionedResultDestReceiverDestroy;
+	resultDest->pub.mydest = DestCopyOut;
+
+	resultDest->resultIdPrefix = resultIdPrefix;
+	resultDest->executorState = executorState;
+	resultDest->partitionColumnIndex = partitionColumnIndex;
+	resultDest->partitionCount = partitionCount;
+	resultDest->partitionMinValues = partitionMinValues;
+	resultDest->partitionMaxValues = partitionMaxValues;
+	resultDest->partitionDestReceivers =
+		palloc0(partitionCount * sizeof(DestReceiver *));
+	resultDest->partitionRowCounts = palloc0(partitionCount * sizeof(uint64));
+
+	return (DestReceiver *) resultDest;
+}
+
+
+/*
+ * PartitionedResultDestReceiverStartup implements the rStartup interface of
+ * PartitionedResultDestReceiver. It looks up the hash function of the type of
+ * the partition column.
+ */
+static void
+PartitionedResultDestReceiverStartup(DestReceiver *dest, int operation,
+									 TupleDesc inputTupleDescriptor)
+{
+	PartitionedResultDestReceiver *resultDest = (PartitionedResultDestReceiver *) dest;
+	int partitionColumnIndex = resultDest->partitionColumnIndex;
+
+	if (partitionColumnIndex < 0 || partitionColumnIndex >= inputTupleDescriptor->natts)
+	{
+		ereport(ERROR, (errmsg("partition column index %d is out of range for a "
+							   "query with %d columns", partitionColumnIndex,
+							   inputTupleDescriptor->natts)));
+	}
+
+	Form_pg_attribute partitionColumn = TupleDescAttr(inputTupleDescriptor,
+													  partitionColumnIndex);
+
+	resultDest->operation = operation;
+	resultDest->tupleDescriptor = inputTupleDescriptor;
+	resultDest->hashFunction = GetFunctionInfo(partitionColumn->atttypid, HASH_AM_OID,
+											   HASHSTANDARD_PROC);
+	resultDest->partitionColumnCollation = partitionColumn->attcollation;
+}
+
+
+/*
+ * PartitionedResultDestReceiverReceive implements the receiveSlot interface
+ * of PartitionedResultDestReceiver. It forwards the tuple to the receiver of
+ * its partition, which is created when the partition gets its first tuple.
+ */
+static bool
+PartitionedResultDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
+{
+	PartitionedResultDestReceiver *resultDest = (PartitionedResultDestReceiver *) dest;
+	bool isNull = false;
+
+	Datum partitionValue = slot_getattr(slot, resultDest->partitionColumnIndex + 1,
+										&isNull);
+	if (isNull)
+	{
+		ereport(ERROR, (errcode(ERRCODE_NOT_NULL_VIOLATION),
+						errmsg("the partition column value cannot be NULL")));
+	}
+
+	Datum hashedValue = HashPartitionColumnValue(resultDest->hashFunction,
+												 resultDest->partitionColumnCollation,
+												 partitionValue);
+
+	int partitionIndex = FindHashRangePartitionIndex(resultDest,
+													 DatumGetInt32(hashedValue));
+	if (partitionIndex < 0)
+	{
+		ereport(ERROR, (errmsg("could not find a partition for hash value %d",
+							   DatumGetInt32(hashedValue))));
+	}
+
+	DestReceiver *partitionDest = resultDest->partitionDestReceivers[partitionIndex];
+	if (partitionDest == NULL)
+	{
+		StringInfo resultId = makeStringInfo();
+		List *nodeList = NIL;
+		bool writeLocalFile = true;
+
+		appendStringInfo(resultId, "%s_%d", resultDest->resultIdPrefix,
+						 partitionIndex);
+
+		partitionDest = CreateRemoteFileDestReceiver(resultId->data,
+													 resultDest->executorState,
+													 nodeList, writeLocalFile);
+		partitionDest->rStartup(partitionDest, resultDest->operation,
+								resultDest->tupleDescriptor);
+
+		resultDest->partitionDestReceivers[partitionIndex] = partitionDest;
+	}
+
+	partitionDest->receiveSlot(slot, partitionDest);
+	resultDest->partitionRowCounts[partitionIndex]++;
+
+	return true;
+}
+
+
+/*
+ * FindHashRangePartitionIndex returns the index of the partition whose hash
+ * range contains the given hash value, or -1 if there is no such partition.
+ */
+static int
+FindHashRangePartitionIndex(PartitionedResultDestReceiver *resultDest,
+							int32 hashedValue)
+{
+	int lowerBoundIndex = 0;
+	int upperBoundIndex = resultDest->partitionCount;
+
+	while (lowerBoundIndex < upperBoundIndex)
+	{
+		int middleIndex = lowerBoundIndex + (upperBoundIndex - lowerBoundIndex) / 2;
+
+		if (hashedValue < resultDest->partitionMinValues[middleIndex])
+		{
+			upperBoundIndex = middleIndex;
+		}
+		else if (hashedValue > resultDest->partitionMaxValues[middleIndex])
+		{
+			lowerBoundIndex = middleIndex + 1;
+		}
+		else
+		{
+			return middleIndex;
+		}
+	}
+
+	return -1;
+}
+
+
+/*
+ * PartitionedResultDestReceiverShutdown implements the rShutdown interface of
+ * PartitionedResultDestReceiver. It finishes the files of all partitions.
+ */
+static void
+PartitionedResultDestReceiverShutdown(DestReceiver *dest)
+{
+	PartitionedResultDestReceiver *resultDest = (PartitionedResultDestReceiver *) dest;
+
+	for (int partitionIndex = 0; partitionIndex < resultDest->partitionCount;
+		 partitionIndex++)
+	{
+		DestReceiver *partitionDest = resultDest->partitionDestReceivers[partitionIndex];
+		if (partitionDest != NULL)
+		{
+			partitionDest->rShutdown(partitionDest);
+		}
+	}
+}
+
+
+/*
+ * PartitionedResultDestReceiverDestroy frees the memory of the partition
+ * receivers and of the PartitionedResultDestReceiver itself.
+ */
+static void
+PartitionedResultDestReceiverDestroy(DestReceiver *dest)
+{
+	PartitionedResultDestReceiver *resultDest = (PartitionedResultDestReceiver *) dest;
+
+	for (int partitionIndex = 0; partitionIndex < resultDest->partitionCount;
+		 partitionIndex++)
+	{
+		DestReceiver *partitionDest = resultDest->partitionDestReceivers[partitionIndex];
+		if (partitionDest != NULL)
+		{
+			partitionDest->rDestroy(partitionDest);
+		}
+	}
+
+	pfree(resultDest->partitionDestReceivers);
+	pfree(resultDest->partitionRowCounts);
+	pfree(resultDest);
+}
@@ -8,63 +8,352 @@
  */
 
 #include "postgres.h"
+#include "miscadmin.h"
 
 #include "fmgr.h"
+#include "funcapi.h"
 
+#include "access/hash.h"
+#include "catalog/pg_authid.h"
+#include "distributed/metadata_cache.h"
 #include "distributed/query_stats.h"
+#include "distributed/tuplestore.h"
+#include "mb/pg_wchar.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/acl.h"
 #include "utils/builtins.h"
+#include "utils/hsearch.h"
 
-PG_FUNCTION_INFO_V1(citus_stat_statements_reset);
-PG_FUNCTION_INFO_V1(citus_query_stats);
-PG_FUNCTION_INFO_V1(citus_executor_name);
+#define CITUS_QUERY_STATS_COLUMNS 7
+#define CITUS_QUERY_STATS_KEY_LENGTH NAMEDATALEN
+
+
+/*
+ * QueryStatsSharedData holds the lock that protects the shared query stats
+ * hash. Entries are added and removed under an exclusive lock, while the
+ * counters of an existing entry are updated under a shared lock and the
+ * spinlock of the entry.
+ */
+typedef struct QueryStatsSharedData
+{
+	int queryStatsHashTrancheId;
+	char *queryStatsHashTrancheName;
 
+	LWLock queryStatsHashLock;
+} QueryStatsSharedData;
+
+
+/*
+ * The statistics are kept per query, executor and partition key such that the
+ * hot tenants of a query and the slow executors can be found. Queries without a
+ * partition key, e.g. multi-shard queries, have an empty partition key.
+ */
+typedef struct QueryStatsHashKey
+{
+	Oid userId;
+	Oid databaseId;
+	uint64 queryId;
+	MultiExecutorType executorType;
+	char partitionKey[CITUS_QUERY_STATS_KEY_LENGTH];
+} QueryStatsHashKey;
+
+/* hash entry for per query, executor and partition key stats */
+typedef struct QueryStatsHashEntry
+{
+	QueryStatsHashKey key;
 
+	slock_t mutex;             /* protects the counters below */
+	int64 calls;
+	double totalTime;          /* in milliseconds */
+} QueryStatsHashEntry;
+
+
+/* controlled via GUCs */
+int StatStatementsMax = 50000;
+int StatStatementsTrack = STAT_STATEMENTS_TRACK_NONE;
+
+
+/* the following two structs are used for accessing shared memory */
+static HTAB *QueryStatsHash = NULL;
+static QueryStatsSharedData *QueryStatsSharedState = NULL;
+
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+
+/* local function declarations */
+static void CitusQueryStatsShmemInit(void);
+static size_t CitusQueryStatsShmemSize(void);
+static void StoreAllQueryStats(Tuplestorestate *tupleStore, TupleDesc tupleDescriptor);
 static char * CitusExecutorName(MultiExecutorType executorType);
 
 
-/* placeholder for InitializeCitusQueryStats */
+PG_FUNCTION_INFO_V1(citus_stat_statements_reset);
+PG_FUNCTION_INFO_V1(citus_query_stats);
+PG_FUNCTION_INFO_V1(citus_executor_name);
+
+
+/*
+ * InitializeCitusQueryStats requests the necessary shared memory from Postgres
+ * and sets up the shared memory startup hook.
+ */
 void
 InitializeCitusQueryStats(void)
 {
-	/* placeholder for future implementation */
+	/* allocate shared memory */
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(CitusQueryStatsShmemSize());
+	}
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = CitusQueryStatsShmemInit;
+}
+
+
+/*
+ * CitusQueryStatsShmemSize returns the size that should be allocated on the
+ * shared memory for query stats.
+ */
+static size_t
+CitusQueryStatsShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(QueryStatsSharedData));
+
+	Size hashSize = hash_estimate_size(StatStatementsMax, sizeof(QueryStatsHashEntry));
+
+	size = add_size(size, hashSize);
+
+	return size;
 }
 
 
-/* placeholder for CitusQueryStatsExecutorsEntry */
+/*
+ * CitusQueryStatsShmemInit initializes the shared memory used for keeping
+ * track of query stats across backends.
+ */
+static void
+CitusQueryStatsShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL info;
+
+	/* create (user, database, query, executor, partition key) -> [counters] */
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(QueryStatsHashKey);
+	info.entrysize = sizeof(QueryStatsHashEntry);
+	info.hash = tag_hash;
+	uint32 hashFlags = (HASH_ELEM | HASH_FUNCTION);
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	QueryStatsSharedState =
+		(QueryStatsSharedData *) ShmemInitStruct("Citus Query Stats Data",
+												 sizeof(QueryStatsSharedData),
+												 &alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		QueryStatsSharedState->queryStatsHashTrancheId = LWLockNewTrancheId();
+		QueryStatsSharedState->queryStatsHashTrancheName = "Citus Query Stats Tranche";
+		LWLockRegisterTranche(QueryStatsSharedState->queryStatsHashTrancheId,
+							  QueryStatsSharedState->queryStatsHashTrancheName);
+
+		LWLockInitialize(&QueryStatsSharedState->queryStatsHashLock,
+						 QueryStatsSharedState->queryStatsHashTrancheId);
+	}
+
+	QueryStatsHash = ShmemInitHash("Citus Query Stats Hash", StatStatementsMax,
+								   StatStatementsMax, &info, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	Assert(QueryStatsHash != NULL);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+/*
+ * CitusQueryStatsExecutorsEntry records a call of the given query with the given
+ * executor and partition key, which took executionTime milliseconds. Once the
+ * hash is full, calls of new (query, executor, partition key) combinations are
+ * not recorded until the statistics are reset.
+ */
 void
 CitusQueryStatsExecutorsEntry(uint64 queryId, MultiExecutorType executorType,
-							  char *partitionKey)
+							  char *partitionKey, double executionTime)
 {
-	/* placeholder for future implementation */
+	QueryStatsHashKey key;
+	bool found = false;
+
+	if (StatStatementsTrack == STAT_STATEMENTS_TRACK_NONE || QueryStatsHash == NULL)
+	{
+		return;
+	}
+
+	memset(&key, 0, sizeof(key));
+	key.userId = GetUserId();
+	key.databaseId = MyDatabaseId;
+	key.queryId = queryId;
+	key.executorType = executorType;
+
+	if (partitionKey != NULL)
+	{
+		int partitionKeyLength = pg_mbcliplen(partitionKey, strlen(partitionKey),
+											  CITUS_QUERY_STATS_KEY_LENGTH - 1);
+
+		memcpy(key.partitionKey, partitionKey, partitionKeyLength);
+	}
+
+	/* most calls hit an existing entry, a shared lock is enough for those */
+	LWLockAcquire(&QueryStatsSharedState->queryStatsHashLock, LW_SHARED);
+
+	QueryStatsHashEntry *entry =
+		(QueryStatsHashEntry *) hash_search(QueryStatsHash, &key, HASH_FIND, &found);
+	if (!found)
+	{
+		LWLockRelease(&QueryStatsSharedState->queryStatsHashLock);
+		LWLockAcquire(&QueryStatsSharedState->queryStatsHashLock, LW_EXCLUSIVE);
+
+		/* another backend might have added the entry in the meantime */
+		entry = (QueryStatsHashEntry *) hash_search(QueryStatsHash, &key, HASH_FIND,
+													&found);
+		if (!found)
+		{
+			if (hash_get_num_entries(QueryStatsHash) >= StatStatementsMax)
+			{
+				LWLockRelease(&QueryStatsSharedState->queryStatsHashLock);
+				return;
+			}
+
+			entry = (QueryStatsHashEntry *) hash_search(QueryStatsHash, &key,
+														HASH_ENTER, &found);
+			SpinLockInit(&entry->mutex);
+			entry->calls = 0;
+			entry->totalTime = 0.0;
+		}
+	}
+
+	SpinLockAcquire(&entry->mutex);
+	entry->calls++;
+	entry->totalTime += executionTime;
+	SpinLockRelease(&entry->mutex);
+
+	LWLockRelease(&QueryStatsSharedState->queryStatsHashLock);
 }
 
 
 /*
- * placeholder function for citus_stat_statements_reset
+ * citus_stat_statements_reset removes all the collected query stats.
  */
 Datum
 citus_stat_statements_reset(PG_FUNCTION_ARGS)
 {
-	ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-					errmsg("citus_stat_statements_reset() is only supported on "
-						   "Citus Enterprise")));
+	HASH_SEQ_STATUS status;
+	QueryStatsHashEntry *entry = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	LWLockAcquire(&QueryStatsSharedState->queryStatsHashLock, LW_EXCLUSIVE);
+
+	hash_seq_init(&status, QueryStatsHash);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		hash_search(QueryStatsHash, &entry->key, HASH_REMOVE, NULL);
+	}
+
+	LWLockRelease(&QueryStatsSharedState->queryStatsHashLock);
+
 	PG_RETURN_VOID();
 }
 
 
 /*
- * placeholder function for citus_query_stats
+ * citus_query_stats returns the collected stats per query, executor and
+ * partition key. It is meant to be joined with pg_stat_statements on
+ * (queryid, userid, dbid), as citus_stat_statements does.
  */
 Datum
 citus_query_stats(PG_FUNCTION_ARGS)
 {
-	ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-					errmsg("citus_query_stats() is only supported on "
-						   "Citus Enterprise")));
+	TupleDesc tupleDescriptor = NULL;
+
+	CheckCitusVersion(ERROR);
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	StoreAllQueryStats(tupleStore, tupleDescriptor);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupleStore);
+
 	PG_RETURN_VOID();
 }
 
 
+/*
+ * StoreAllQueryStats writes the collected query stats to the tuple store. As in
+ * pg_stat_statements, the partition keys of other users' queries are only shown
+ * to superusers and members of pg_read_all_stats, since they might contain data.
+ */
+static void
+StoreAllQueryStats(Tuplestorestate *tupleStore, TupleDesc tupleDescriptor)
+{
+	Datum values[CITUS_QUERY_STATS_COLUMNS];
+	bool isNulls[CITUS_QUERY_STATS_COLUMNS];
+	HASH_SEQ_STATUS status;
+	QueryStatsHashEntry *entry = NULL;
+	Oid userId = GetUserId();
+	bool canSeeAllStats = is_member_of_role(userId, DEFAULT_ROLE_READ_ALL_STATS);
+
+	/* we're reading all the entries, shared lock is enough */
+	LWLockAcquire(&QueryStatsSharedState->queryStatsHashLock, LW_SHARED);
+
+	hash_seq_init(&status, QueryStatsHash);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		/* get ready for the next tuple */
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		SpinLockAcquire(&entry->mutex);
+		int64 calls = entry->calls;
+		double totalTime = entry->totalTime;
+		SpinLockRelease(&entry->mutex);
+
+		values[0] = UInt64GetDatum(entry->key.queryId);
+		values[1] = ObjectIdGetDatum(entry->key.userId);
+		values[2] = ObjectIdGetDatum(entry->key.databaseId);
+		values[3] = Int64GetDatum(entry->key.executorType);
+
+		if (entry->key.partitionKey[0] == '\0' ||
+			(!canSeeAllStats && entry->key.userId != userId))
+		{
+			isNulls[4] = true;
+		}
+		else
+		{
+			values[4] = CStringGetTextDatum(entry->key.partitionKey);
+		}
+
+		values[5] = Int64GetDatum(calls);
+		values[6] = Float8GetDatum(totalTime);
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	LWLockRelease(&QueryStatsSharedState->queryStatsHashLock);
+}
+
+
 /*
  * citus_executor_name is a UDF that returns the name of the executor
  * given the internal enum value.
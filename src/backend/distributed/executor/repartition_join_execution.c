@@ -0,0 +1,955 @@
+/*-------------------------------------------------------------------------
+ *
+ * repartition_join_execution.c
+ *
+ * Functions for running the map, fetch and merge tasks of repartition joins
+ * through the adaptive executor.
+ *
+ * The tasks of a repartition job form a directed acyclic graph: the top level
+ * tasks depend on merge tasks, merge tasks depend on map output fetch tasks,
+ * and those depend on map tasks. Map tasks partition the rows of a shard (or
+ * of a lower merge table) into files on the node they run on. Map output
+ * fetch tasks run on the node of their merge task and pull one partition file
+ * directly from the node of the map task. Merge tasks load the fetched files
+ * into a table in the schema of the job, which the upper tasks read from.
+ *
+ * We run the graph in rounds, each round executing all tasks whose
+ * dependencies completed in an earlier round. A task reads the outputs of its
+ * dependencies from its own node, so we run every task on the first node in
+ * its placement list; the planner assigns merge tasks and the tasks that read
+ * their tables the same placement list.
+ *
+ * When merge tasks only load the map outputs into their tables, we skip the
+ * partition files altogether: we first create the empty merge tables, and
+ * then have the map tasks copy each partition straight into its merge table.
+ * The fetch and merge tasks of such jobs then have nothing left to do.
+ *
+ * With citus.enable_repartition_cache, map tasks always write partition files,
+ * and we let them reuse the files of earlier runs of the same map task on
+ * unchanged data, see worker_repartition_cache.c.
+ *
+ * With citus.enable_repartition_join_filter, the map tasks of the right side
+ * of a dual partition join first build Bloom filters of their join keys. We
+ * combine these into one filter, which the map tasks of the left side use to
+ * skip rows without a join partner, see worker_join_filter.c.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/xact.h"
+#include "catalog/pg_type.h"
+#include "distributed/distributed_planner.h"
+#include "distributed/local_executor.h"
+#include "distributed/multi_executor.h"
+#include "distributed/multi_physical_planner.h"
+#include "distributed/repartition_join_execution.h"
+#include "distributed/transaction_management.h"
+#include "distributed/version_compat.h"
+#include "distributed/worker_manager.h"
+#include "distributed/worker_repartition_cache.h"
+#include "distributed/worker_transaction.h"
+#include "lib/stringinfo.h"
+#include "executor/executor.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/tuplestore.h"
+
+
+/* prefix of the merge queries that only load map outputs into a table */
+#define MERGE_FILES_INTO_TABLE_PREFIX "SELECT worker_merge_files_into_table"
+#define CREATE_TASK_TABLE_PREFIX "SELECT worker_create_task_table"
+
+/* lets the map task use the repartition cache of its node */
+#define ENABLE_REPARTITION_CACHE_COMMAND "SET LOCAL citus.enable_repartition_cache TO on;"
+
+
+/* key and entry of the hash that tracks the tasks of the job tree */
+typedef struct TaskHashKey
+{
+	uint64 jobId;
+	uint32 taskId;
+} TaskHashKey;
+
+typedef struct TaskHashEntry
+{
+	TaskHashKey key;
+	bool completed;
+
+	/* whether map tasks push their outputs into the table of this merge task */
+	bool pushTarget;
+
+	/* query of a map task that skips the rows that are not in its join filter */
+	char *joinFilteredQueryString;
+} TaskHashEntry;
+
+
+/* Config variable managed via guc.c */
+bool EnableRepartitionPush = true;
+
+
+static void EnsureRepartitionJoinsAllowed(void);
+static HTAB * CreateTaskHash(void);
+static TaskHashEntry * TaskHashLookup(HTAB *taskHash, Task *task, bool *found);
+static List * DependentTaskList(List *topLevelTaskList, HTAB *taskHash);
+static List * JobIdList(Job *topLevelJob);
+static List * PushMergeTaskList(List *taskList, HTAB *taskHash);
+static void CreatePushMergeTables(List *pushMergeTaskList);
+static void ApplyJoinFilters(List *taskList, HTAB *taskHash);
+static char * JoinFilterHexString(List *taskList, uint64 filterJobId);
+static void ExecuteTasksInDependencyOrder(List *taskList, HTAB *taskHash,
+										  List *pushMergeTaskList);
+static bool TaskDependenciesCompleted(Task *task, HTAB *taskHash);
+static bool TaskOutputIsPushed(Task *task, HTAB *taskHash);
+static Task * TaskOnFirstPlacement(Task *task, char *queryString);
+static char * DependentTaskQueryString(Task *task, List *pushMergeTaskList);
+static char * MapFetchTaskQueryString(Task *mapFetchTask, Task *mapTask);
+static char * PushMapTaskQueryString(Task *mapTask, List *pushMergeTaskList);
+
+
+/*
+ * ExecuteDependentTasks runs all tasks that the given top level tasks depend
+ * on, and returns copies of the top level tasks that are placed on the nodes
+ * that hold the outputs of these tasks. The function also returns the job ids
+ * of the job tree, whose intermediate files and tables DoRepartitionCleanup()
+ * removes once the top level tasks have finished.
+ */
+List *
+ExecuteDependentTasks(List *topLevelTaskList, Job *topLevelJob, List **jobIdList)
+{
+	List *placedTopLevelTaskList = NIL;
+	ListCell *taskCell = NULL;
+
+	EnsureRepartitionJoinsAllowed();
+
+	HTAB *taskHash = CreateTaskHash();
+	List *dependentTaskList = DependentTaskList(topLevelTaskList, taskHash);
+
+	*jobIdList = JobIdList(topLevelJob);
+
+	List *pushMergeTaskList = PushMergeTaskList(dependentTaskList, taskHash);
+	if (pushMergeTaskList != NIL)
+	{
+		CreatePushMergeTables(pushMergeTaskList);
+	}
+
+	ApplyJoinFilters(dependentTaskList, taskHash);
+
+	ExecuteTasksInDependencyOrder(dependentTaskList, taskHash, pushMergeTaskList);
+
+	foreach(taskCell, topLevelTaskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+
+		if (task->dependentTaskList == NIL)
+		{
+			placedTopLevelTaskList = lappend(placedTopLevelTaskList, task);
+			continue;
+		}
+
+		placedTopLevelTaskList = lappend(placedTopLevelTaskList,
+										 TaskOnFirstPlacement(task, task->queryString));
+	}
+
+	hash_destroy(taskHash);
+
+	return placedTopLevelTaskList;
+}
+
+
+/*
+ * DoRepartitionCleanup removes the job directories and job schemas of the
+ * given jobs from all nodes that ran tasks of the job tree. The cleanup runs
+ * through the adaptive executor, which reuses the connections of the query.
+ */
+void
+DoRepartitionCleanup(List *topLevelTaskList, List *jobIdList)
+{
+	List *cleanupTaskList = NIL;
+	List *nodeList = NIL;
+	StringInfo cleanupQuery = makeStringInfo();
+	ListCell *jobIdCell = NULL;
+	ListCell *taskCell = NULL;
+	uint32 cleanupTaskId = 1;
+
+	HTAB *taskHash = CreateTaskHash();
+	List *dependentTaskList = DependentTaskList(topLevelTaskList, taskHash);
+
+	hash_destroy(taskHash);
+
+	foreach(jobIdCell, jobIdList)
+	{
+		uint64 *jobIdPointer = (uint64 *) lfirst(jobIdCell);
+
+		appendStringInfo(cleanupQuery, "SELECT worker_repartition_cleanup("
+						 UINT64_FORMAT ");", *jobIdPointer);
+	}
+
+	foreach(taskCell, dependentTaskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+		ShardPlacement *taskPlacement = linitial(task->taskPlacementList);
+		ListCell *nodeCell = NULL;
+		bool nodeFound = false;
+
+		foreach(nodeCell, nodeList)
+		{
+			ShardPlacement *nodePlacement = (ShardPlacement *) lfirst(nodeCell);
+
+			if (nodePlacement->nodePort == taskPlacement->nodePort &&
+				strncmp(nodePlacement->nodeName, taskPlacement->nodeName,
+						WORKER_LENGTH) == 0)
+			{
+				nodeFound = true;
+				break;
+			}
+		}
+
+		if (nodeFound)
+		{
+			continue;
+		}
+
+		nodeList = lappend(nodeList, taskPlacement);
+
+		Task *cleanupTask = CreateBasicTask(INVALID_JOB_ID, cleanupTaskId++,
+											SELECT_TASK, cleanupQuery->data);
+		cleanupTask->taskPlacementList = list_make1(taskPlacement);
+
+		cleanupTaskList = lappend(cleanupTaskList, cleanupTask);
+	}
+
+	if (cleanupTaskList == NIL)
+	{
+		return;
+	}
+
+	if (LocalExecutionHappened)
+	{
+		/* the executor cannot run remote tasks after local execution */
+		SendBareOptionalCommandListToAllWorkersAsUser(list_make1(cleanupQuery->data),
+													  NULL);
+		return;
+	}
+
+	ExecuteTaskList(ROW_MODIFY_READONLY, cleanupTaskList, MaxAdaptiveExecutorPoolSize);
+}
+
+
+/*
+ * EnsureRepartitionJoinsAllowed errors out when the tasks of a repartition
+ * job would have to run inside a coordinated transaction. Merge tasks create
+ * their tables in a remote transaction, which the top level tasks would only
+ * see over the same connection.
+ */
+static void
+EnsureRepartitionJoinsAllowed(void)
+{
+	if (IsMultiStatementTransaction() || InCoordinatedTransaction())
+	{
+		ereport(ERROR, (errmsg("cannot run repartition joins with the adaptive "
+							   "executor inside a transaction block"),
+						errhint("Set citus.task_executor_type to \"task-tracker\".")));
+	}
+}
+
+
+/* CreateTaskHash creates the hash that tracks the tasks of a job tree. */
+static HTAB *
+CreateTaskHash(void)
+{
+	HASHCTL info;
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(TaskHashKey);
+	info.entrysize = sizeof(TaskHashEntry);
+	info.hash = tag_hash;
+	info.hcxt = CurrentMemoryContext;
+
+	return hash_create("Repartition Task Hash", 64, &info,
+					   HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+}
+
+
+/*
+ * TaskHashLookup finds or creates the entry of the given task in the task
+ * hash, and sets found to whether the entry already existed.
+ */
+static TaskHashEntry *
+TaskHashLookup(HTAB *taskHash, Task *task, bool *found)
+{
+	TaskHashKey taskKey;
+
+	memset(&taskKey, 0, sizeof(taskKey));
+	taskKey.jobId = task->jobId;
+	taskKey.taskId = task->taskId;
+
+	TaskHashEntry *taskEntry = hash_search(taskHash, &taskKey, HASH_ENTER, found);
+	if (!(*found))
+	{
+		taskEntry->completed = false;
+		taskEntry->pushTarget = false;
+		taskEntry->joinFilteredQueryString = NULL;
+	}
+
+	return taskEntry;
+}
+
+
+/*
+ * DependentTaskList walks over the dependencies of the given top level tasks,
+ * enters every task it finds into the task hash, and returns the tasks.
+ * Several tasks can depend on the same task, which we only return once.
+ */
+static List *
+DependentTaskList(List *topLevelTaskList, HTAB *taskHash)
+{
+	List *dependentTaskList = NIL;
+	List *taskQueue = NIL;
+	ListCell *taskCell = NULL;
+
+	foreach(taskCell, topLevelTaskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+
+		taskQueue = list_concat(taskQueue, list_copy(task->dependentTaskList));
+	}
+
+	while (taskQueue != NIL)
+	{
+		Task *task = (Task *) linitial(taskQueue);
+		bool found = false;
+
+		taskQueue = list_delete_first(taskQueue);
+
+		TaskHashLookup(taskHash, task, &found);
+		if (found)
+		{
+			continue;
+		}
+
+		dependentTaskList = lappend(dependentTaskList, task);
+		taskQueue = list_concat(taskQueue, list_copy(task->dependentTaskList));
+	}
+
+	return dependentTaskList;
+}
+
+
+/*
+ * JobIdList walks over all jobs in the given job tree and returns a list of
+ * pointers to their job identifiers.
+ */
+static List *
+JobIdList(Job *topLevelJob)
+{
+	List *jobIdList = NIL;
+	List *jobQueue = list_make1(topLevelJob);
+
+	while (jobQueue != NIL)
+	{
+		uint64 *jobIdPointer = (uint64 *) palloc0(sizeof(uint64));
+
+		Job *currentJob = (Job *) linitial(jobQueue);
+		jobQueue = list_delete_first(jobQueue);
+
+		(*jobIdPointer) = currentJob->jobId;
+		jobIdList = lappend(jobIdList, jobIdPointer);
+
+		jobQueue = list_concat(jobQueue, list_copy(currentJob->dependentJobList));
+	}
+
+	return jobIdList;
+}
+
+
+/*
+ * PushMergeTaskList returns the merge tasks among the given tasks that only
+ * load the map outputs into their table, and marks them in the task hash as
+ * the targets that map tasks push their outputs to. Merge tasks that also run
+ * a reduce query on the map outputs keep reading partition files, as do all
+ * merge tasks when map tasks cache their partition files.
+ */
+static List *
+PushMergeTaskList(List *taskList, HTAB *taskHash)
+{
+	List *pushMergeTaskList = NIL;
+	ListCell *taskCell = NULL;
+
+	if (!EnableRepartitionPush || EnableRepartitionCache)
+	{
+		return NIL;
+	}
+
+	foreach(taskCell, taskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+		bool found = false;
+
+		if (task->taskType != MERGE_TASK ||
+			strncmp(task->queryString, MERGE_FILES_INTO_TABLE_PREFIX,
+					strlen(MERGE_FILES_INTO_TABLE_PREFIX)) != 0)
+		{
+			continue;
+		}
+
+		TaskHashEntry *taskEntry = TaskHashLookup(taskHash, task, &found);
+		taskEntry->pushTarget = true;
+
+		pushMergeTaskList = lappend(pushMergeTaskList, task);
+	}
+
+	return pushMergeTaskList;
+}
+
+
+/*
+ * CreatePushMergeTables creates the job schemas and the empty tables of the
+ * given merge tasks, which have to exist before map tasks push into them. The
+ * merge query and the table creation function take the same arguments.
+ */
+static void
+CreatePushMergeTables(List *pushMergeTaskList)
+{
+	List *executionTaskList = NIL;
+	ListCell *taskCell = NULL;
+
+	foreach(taskCell, pushMergeTaskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+		StringInfo queryString = makeStringInfo();
+
+		appendStringInfo(queryString, "SELECT worker_create_schema(" UINT64_FORMAT
+						 ");" CREATE_TASK_TABLE_PREFIX "%s", task->jobId,
+						 task->queryString + strlen(MERGE_FILES_INTO_TABLE_PREFIX));
+
+		executionTaskList = lappend(executionTaskList,
+									TaskOnFirstPlacement(task, queryString->data));
+	}
+
+	ExecuteTaskList(ROW_MODIFY_READONLY, executionTaskList,
+					MaxAdaptiveExecutorPoolSize);
+}
+
+
+/*
+ * ApplyJoinFilters builds the join filters that the map tasks among the given
+ * tasks use, and enters the query of each of these map tasks with its filter
+ * into the task hash. Map tasks whose filter could not be built, or would not
+ * rule out enough rows, run their query without a filter.
+ */
+static void
+ApplyJoinFilters(List *taskList, HTAB *taskHash)
+{
+	List *filterJobIdList = NIL;
+	ListCell *taskCell = NULL;
+	ListCell *jobIdCell = NULL;
+
+	foreach(taskCell, taskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+		bool jobIdFound = false;
+
+		if (task->taskType != MAP_TASK || task->joinFilterJobId == INVALID_JOB_ID)
+		{
+			continue;
+		}
+
+		foreach(jobIdCell, filterJobIdList)
+		{
+			uint64 *jobIdPointer = (uint64 *) lfirst(jobIdCell);
+
+			if (*jobIdPointer == task->joinFilterJobId)
+			{
+				jobIdFound = true;
+				break;
+			}
+		}
+
+		if (!jobIdFound)
+		{
+			filterJobIdList = lappend(filterJobIdList, &task->joinFilterJobId);
+		}
+	}
+
+	foreach(jobIdCell, filterJobIdList)
+	{
+		uint64 filterJobId = *((uint64 *) lfirst(jobIdCell));
+
+		char *filterHexString = JoinFilterHexString(taskList, filterJobId);
+		if (filterHexString == NULL)
+		{
+			continue;
+		}
+
+		foreach(taskCell, taskList)
+		{
+			Task *task = (Task *) lfirst(taskCell);
+			StringInfo queryString = makeStringInfo();
+			bool found = false;
+
+			if (task->taskType != MAP_TASK || task->joinFilterJobId != filterJobId)
+			{
+				continue;
+			}
+
+			appendBinaryStringInfo(queryString, task->joinFilterMapQuery,
+								   task->joinFilterOffset);
+			appendStringInfoString(queryString, filterHexString);
+			appendStringInfoString(queryString,
+								   task->joinFilterMapQuery + task->joinFilterOffset);
+
+			TaskHashEntry *taskEntry = TaskHashLookup(taskHash, task, &found);
+			taskEntry->joinFilteredQueryString = queryString->data;
+		}
+	}
+}
+
+
+/*
+ * JoinFilterHexString runs the filter build queries of the map tasks of the
+ * given job, and returns the hex encoded union of their filters. The map
+ * tasks have to read shards, since we build the filters before running any
+ * other task. An empty side of an inner join gets a filter without any bits
+ * set. The function returns NULL if the filter cannot be built, or if more
+ * than half of its bits are set, in which case the filter would not rule out
+ * enough rows to pay for itself.
+ */
+static char *
+JoinFilterHexString(List *taskList, uint64 filterJobId)
+{
+	List *buildTaskList = NIL;
+	ListCell *taskCell = NULL;
+	bytea *filter = NULL;
+	const bool goForward = true;
+	const bool doCopy = false;
+
+	foreach(taskCell, taskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+
+		if (task->taskType != MAP_TASK || task->jobId != filterJobId)
+		{
+			continue;
+		}
+
+		if (task->joinFilterBuildQuery == NULL || task->dependentTaskList != NIL)
+		{
+			return NULL;
+		}
+
+		buildTaskList = lappend(buildTaskList,
+								TaskOnFirstPlacement(task, task->joinFilterBuildQuery));
+	}
+
+	if (buildTaskList == NIL)
+	{
+		return NULL;
+	}
+
+#if PG_VERSION_NUM >= 120000
+	TupleDesc resultDescriptor = CreateTemplateTupleDesc(1);
+#else
+	TupleDesc resultDescriptor = CreateTemplateTupleDesc(1, false);
+#endif
+	TupleDescInitEntry(resultDescriptor, (AttrNumber) 1, "join_filter", BYTEAOID, -1,
+					   0);
+
+	Tuplestorestate *resultStore = tuplestore_begin_heap(false, false, work_mem);
+
+	ExecuteTaskListExtended(ROW_MODIFY_READONLY, buildTaskList, resultDescriptor,
+							resultStore, false, MaxAdaptiveExecutorPoolSize);
+
+	TupleTableSlot *resultSlot = MakeSingleTupleTableSlotCompat(resultDescriptor,
+																&TTSOpsMinimalTuple);
+
+	while (tuplestore_gettupleslot(resultStore, goForward, doCopy, resultSlot))
+	{
+		bool isNull = false;
+
+		Datum filterDatum = slot_getattr(resultSlot, 1, &isNull);
+		if (isNull)
+		{
+			ExecClearTuple(resultSlot);
+			continue;
+		}
+
+		bytea *taskFilter = DatumGetByteaPCopy(filterDatum);
+
+		if (filter == NULL)
+		{
+			filter = taskFilter;
+		}
+		else if (VARSIZE_ANY_EXHDR(filter) == VARSIZE_ANY_EXHDR(taskFilter))
+		{
+			unsigned char *filterBits = (unsigned char *) VARDATA_ANY(filter);
+			unsigned char *taskFilterBits = (unsigned char *) VARDATA_ANY(taskFilter);
+
+			for (Size byteIndex = 0; byteIndex < VARSIZE_ANY_EXHDR(filter); byteIndex++)
+			{
+				filterBits[byteIndex] |= taskFilterBits[byteIndex];
+			}
+		}
+		else
+		{
+			ereport(ERROR, (errmsg("join filters of job " UINT64_FORMAT " have "
+								   "different sizes", filterJobId)));
+		}
+
+		ExecClearTuple(resultSlot);
+	}
+
+	ExecDropSingleTupleTableSlot(resultSlot);
+	tuplestore_end(resultStore);
+
+	if (filter == NULL)
+	{
+		/* no key of the other side can have a join partner */
+		return "00";
+	}
+
+	unsigned char *filterBits = (unsigned char *) VARDATA_ANY(filter);
+	Size filterSize = VARSIZE_ANY_EXHDR(filter);
+	uint64 setBitCount = 0;
+
+	for (Size byteIndex = 0; byteIndex < filterSize; byteIndex++)
+	{
+		for (unsigned char bits = filterBits[byteIndex]; bits != 0; bits &= bits - 1)
+		{
+			setBitCount++;
+		}
+	}
+
+	if (setBitCount * 2 > filterSize * BITS_PER_BYTE)
+	{
+		ereport(DEBUG1, (errmsg("not using the join filter of job " UINT64_FORMAT
+								", since " UINT64_FORMAT " of its " UINT64_FORMAT
+								" bits are set", filterJobId, setBitCount,
+								(uint64) (filterSize * BITS_PER_BYTE))));
+		return NULL;
+	}
+
+	char *filterHexString = (char *) palloc0(filterSize * 2 + 1);
+	hex_encode((char *) filterBits, (unsigned) filterSize, filterHexString);
+
+	return filterHexString;
+}
+
+
+/*
+ * ExecuteTasksInDependencyOrder runs the given tasks in rounds. Every round
+ * runs the tasks whose dependencies all completed in earlier rounds in
+ * parallel. Fetch and merge tasks whose outputs map tasks pushed complete
+ * without running anything.
+ */
+static void
+ExecuteTasksInDependencyOrder(List *taskList, HTAB *taskHash, List *pushMergeTaskList)
+{
+	List *remainingTaskList = taskList;
+	ListCell *taskCell = NULL;
+
+	while (remainingTaskList != NIL)
+	{
+		List *readyTaskList = NIL;
+		List *executionTaskList = NIL;
+		List *waitingTaskList = NIL;
+
+		foreach(taskCell, remainingTaskList)
+		{
+			Task *task = (Task *) lfirst(taskCell);
+
+			if (TaskDependenciesCompleted(task, taskHash))
+			{
+				readyTaskList = lappend(readyTaskList, task);
+			}
+			else
+			{
+				waitingTaskList = lappend(waitingTaskList, task);
+			}
+		}
+
+		if (readyTaskList == NIL)
+		{
+			ereport(ERROR, (errmsg("could not find a task to run in the repartition "
+								   "job tree")));
+		}
+
+		foreach(taskCell, readyTaskList)
+		{
+			Task *task = (Task *) lfirst(taskCell);
+
+			bool found = false;
+
+			if (TaskOutputIsPushed(task, taskHash))
+			{
+				continue;
+			}
+
+			TaskHashEntry *taskEntry = TaskHashLookup(taskHash, task, &found);
+			if (taskEntry->joinFilteredQueryString != NULL)
+			{
+				task = TaskOnFirstPlacement(task, taskEntry->joinFilteredQueryString);
+			}
+
+			char *queryString = DependentTaskQueryString(task, pushMergeTaskList);
+
+			executionTaskList = lappend(executionTaskList,
+										TaskOnFirstPlacement(task, queryString));
+		}
+
+		if (executionTaskList != NIL)
+		{
+			ExecuteTaskList(ROW_MODIFY_READONLY, executionTaskList,
+							MaxAdaptiveExecutorPoolSize);
+		}
+
+		foreach(taskCell, readyTaskList)
+		{
+			Task *task = (Task *) lfirst(taskCell);
+			bool found = false;
+
+			TaskHashEntry *taskEntry = TaskHashLookup(taskHash, task, &found);
+			taskEntry->completed = true;
+		}
+
+		remainingTaskList = waitingTaskList;
+	}
+}
+
+
+/*
+ * TaskDependenciesCompleted returns whether all tasks that the given task
+ * depends on have completed.
+ */
+static bool
+TaskDependenciesCompleted(Task *task, HTAB *taskHash)
+{
+	ListCell *dependentTaskCell = NULL;
+
+	foreach(dependentTaskCell, task->dependentTaskList)
+	{
+		Task *dependentTask = (Task *) lfirst(dependentTaskCell);
+		bool found = false;
+
+		TaskHashEntry *taskEntry = TaskHashLookup(taskHash, dependentTask, &found);
+		if (!taskEntry->completed)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * TaskOutputIsPushed returns whether the given task is a merge task, or a
+ * fetch task for a merge task, that map tasks push their outputs to.
+ */
+static bool
+TaskOutputIsPushed(Task *task, HTAB *taskHash)
+{
+	TaskHashKey mergeTaskKey;
+	bool found = false;
+
+	memset(&mergeTaskKey, 0, sizeof(mergeTaskKey));
+	mergeTaskKey.jobId = task->jobId;
+
+	if (task->taskType == MERGE_TASK)
+	{
+		mergeTaskKey.taskId = task->taskId;
+	}
+	else if (task->taskType == MAP_OUTPUT_FETCH_TASK)
+	{
+		mergeTaskKey.taskId = task->upstreamTaskId;
+	}
+	else
+	{
+		return false;
+	}
+
+	TaskHashEntry *mergeTaskEntry = hash_search(taskHash, &mergeTaskKey, HASH_FIND,
+												&found);
+
+	return found && mergeTaskEntry->pushTarget;
+}
+
+
+/*
+ * TaskOnFirstPlacement returns a shallow copy of the given task which runs
+ * the given query on the first placement of the task only. We copy the task
+ * rather than changing it, since the plan can be cached.
+ */
+static Task *
+TaskOnFirstPlacement(Task *task, char *queryString)
+{
+	Task *taskCopy = (Task *) palloc0(sizeof(Task));
+
+	*taskCopy = *task;
+	taskCopy->queryString = queryString;
+	taskCopy->taskPlacementList = list_make1(linitial(task->taskPlacementList));
+
+	return taskCopy;
+}
+
+
+/*
+ * DependentTaskQueryString returns the query that runs the given task of the
+ * job tree. Merge tasks first create their job schema, which the task tracker
+ * otherwise creates when it gets assigned the task, and map output fetch
+ * tasks need the node of their map task. Map tasks of jobs whose merge tasks
+ * are push targets get the merge tables to push their outputs to, and map
+ * tasks that may use the repartition cache enable it for their transaction.
+ */
+static char *
+DependentTaskQueryString(Task *task, List *pushMergeTaskList)
+{
+	switch (task->taskType)
+	{
+		case MAP_OUTPUT_FETCH_TASK:
+		{
+			Task *mapTask = (Task *) linitial(task->dependentTaskList);
+
+			return MapFetchTaskQueryString(task, mapTask);
+		}
+
+		case MERGE_TASK:
+		{
+			StringInfo queryString = makeStringInfo();
+
+			appendStringInfo(queryString, "SELECT worker_create_schema(" UINT64_FORMAT
+							 ");%s", task->jobId, task->queryString);
+
+			return queryString->data;
+		}
+
+		case MAP_TASK:
+		{
+			if (EnableRepartitionCache)
+			{
+				StringInfo queryString = makeStringInfo();
+
+				appendStringInfo(queryString, ENABLE_REPARTITION_CACHE_COMMAND "%s",
+								 task->queryString);
+
+				return queryString->data;
+			}
+
+			return PushMapTaskQueryString(task, pushMergeTaskList);
+		}
+
+		default:
+		{
+			ereport(ERROR, (errmsg("unsupported task type %d in repartition job",
+								   task->taskType)));
+		}
+	}
+}
+
+
+/*
+ * MapFetchTaskQueryString constructs the query that copies the partition file
+ * of the given map output fetch task from the node of its map task to the node
+ * of its merge task.
+ */
+static char *
+MapFetchTaskQueryString(Task *mapFetchTask, Task *mapTask)
+{
+	uint32 partitionFileId = mapFetchTask->partitionId;
+	uint32 mergeTaskId = mapFetchTask->upstreamTaskId;
+	ShardPlacement *mapTaskPlacement = linitial(mapTask->taskPlacementList);
+	StringInfo mapFetchQueryString = makeStringInfo();
+
+	Assert(mapFetchTask->taskType == MAP_OUTPUT_FETCH_TASK);
+	Assert(mapTask->taskType == MAP_TASK);
+
+	appendStringInfo(mapFetchQueryString, MAP_OUTPUT_FETCH_COMMAND,
+					 mapTask->jobId, mapTask->taskId, partitionFileId,
+					 mergeTaskId, /* fetch results to merge task */
+					 mapTaskPlacement->nodeName, mapTaskPlacement->nodePort);
+
+	return mapFetchQueryString->data;
+}
+
+
+/*
+ * PushMapTaskQueryString appends the push targets of the given map task to its
+ * partition query: the merge task id, node name and node port for each
+ * partition of the map task, with a task id of 0 for partitions that no merge
+ * task reads. If no merge task of the map task's job is a push target, the
+ * function returns the partition query unchanged.
+ */
+static char *
+PushMapTaskQueryString(Task *mapTask, List *pushMergeTaskList)
+{
+	uint32 partitionCount = 0;
+	ListCell *taskCell = NULL;
+
+	foreach(taskCell, pushMergeTaskList)
+	{
+		Task *mergeTask = (Task *) lfirst(taskCell);
+
+		if (mergeTask->jobId == mapTask->jobId)
+		{
+			partitionCount = Max(partitionCount, mergeTask->partitionId + 1);
+		}
+	}
+
+	if (partitionCount == 0)
+	{
+		return mapTask->queryString;
+	}
+
+	Task **mergeTaskArray = (Task **) palloc0(partitionCount * sizeof(Task *));
+
+	foreach(taskCell, pushMergeTaskList)
+	{
+		Task *mergeTask = (Task *) lfirst(taskCell);
+
+		if (mergeTask->jobId == mapTask->jobId)
+		{
+			mergeTaskArray[mergeTask->partitionId] = mergeTask;
+		}
+	}
+
+	StringInfo taskIdString = makeStringInfo();
+	StringInfo nodeNameString = makeStringInfo();
+	StringInfo nodePortString = makeStringInfo();
+
+	for (uint32 partitionId = 0; partitionId < partitionCount; partitionId++)
+	{
+		Task *mergeTask = mergeTaskArray[partitionId];
+		const char *separator = (partitionId > 0) ? ", " : "";
+
+		if (mergeTask == NULL)
+		{
+			appendStringInfo(taskIdString, "%s0", separator);
+			appendStringInfo(nodeNameString, "%s''", separator);
+			appendStringInfo(nodePortString, "%s0", separator);
+			continue;
+		}
+
+		ShardPlacement *mergeTaskPlacement = linitial(mergeTask->taskPlacementList);
+
+		appendStringInfo(taskIdString, "%s%u", separator, mergeTask->taskId);
+		appendStringInfo(nodeNameString, "%s%s", separator,
+						 quote_literal_cstr(mergeTaskPlacement->nodeName));
+		appendStringInfo(nodePortString, "%s%u", separator,
+						 mergeTaskPlacement->nodePort);
+	}
+
+	/* the partition query ends with the closing parenthesis of its arguments */
+	char *partitionQueryEnd = strrchr(mapTask->queryString, ')');
+	Assert(partitionQueryEnd != NULL);
+
+	StringInfo pushQueryString = makeStringInfo();
+	appendBinaryStringInfo(pushQueryString, mapTask->queryString,
+						   partitionQueryEnd - mapTask->queryString);
+	appendStringInfo(pushQueryString, ", ARRAY[%s]::integer[], ARRAY[%s]::text[], "
+					 "ARRAY[%s]::integer[])", taskIdString->data, nodeNameString->data,
+					 nodePortString->data);
+
+	return pushQueryString->data;
+}
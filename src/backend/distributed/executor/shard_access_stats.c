@@ -0,0 +1,397 @@
+/*-------------------------------------------------------------------------
+ *
+ * shard_access_stats.c
+ *    Number of reads and writes of each shard by distributed queries.
+ *
+ * The executors count the tasks they run per anchor shard in a shared hash,
+ * which shows the hot shards of a node in citus_shard_access. Each node only
+ * counts the tasks that it runs itself, so with synced metadata the counts of
+ * all nodes need to be added up to get the accesses of the cluster. The
+ * counts of the coordinator can be used by the rebalancer to balance the
+ * accesses instead of the number of shards over the nodes.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include "fmgr.h"
+#include "funcapi.h"
+
+#include "access/hash.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/shard_access_stats.h"
+#include "distributed/tuplestore.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+
+#define CITUS_SHARD_ACCESS_STATS_COLUMNS 3
+
+
+/*
+ * ShardAccessStatsSharedData holds the lock that protects the shared shard
+ * access hash. Entries are added and removed under an exclusive lock, while
+ * the counters of an existing entry are updated under a shared lock and the
+ * spinlock of the entry.
+ */
+typedef struct ShardAccessStatsSharedData
+{
+	int shardAccessHashTrancheId;
+	char *shardAccessHashTrancheName;
+
+	LWLock shardAccessHashLock;
+} ShardAccessStatsSharedData;
+
+
+/* shard IDs are only unique within a database */
+typedef struct ShardAccessHashKey
+{
+	Oid databaseId;
+	uint64 shardId;
+} ShardAccessHashKey;
+
+/* hash entry for the access counts of a shard */
+typedef struct ShardAccessHashEntry
+{
+	ShardAccessHashKey key;
+
+	slock_t mutex;             /* protects the counters below */
+	int64 readCount;
+	int64 writeCount;
+} ShardAccessHashEntry;
+
+
+/* controlled via GUCs */
+bool TrackShardAccess = false;
+int ShardAccessStatsMax = 100000;
+
+
+/* the following two structs are used for accessing shared memory */
+static HTAB *ShardAccessHash = NULL;
+static ShardAccessStatsSharedData *ShardAccessStatsSharedState = NULL;
+
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+
+/* local function declarations */
+static void ShardAccessStatsShmemInit(void);
+static size_t ShardAccessStatsShmemSize(void);
+static void RecordShardAccess(uint64 shardId, bool isWrite);
+static void StoreAllShardAccessStats(Tuplestorestate *tupleStore,
+									 TupleDesc tupleDescriptor);
+
+
+PG_FUNCTION_INFO_V1(citus_shard_access_stats);
+PG_FUNCTION_INFO_V1(citus_shard_access_stats_reset);
+
+
+/*
+ * InitializeShardAccessStats requests the necessary shared memory from
+ * Postgres and sets up the shared memory startup hook.
+ */
+void
+InitializeShardAccessStats(void)
+{
+	/* allocate shared memory */
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(ShardAccessStatsShmemSize());
+	}
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = ShardAccessStatsShmemInit;
+}
+
+
+/*
+ * ShardAccessStatsShmemSize returns the size that should be allocated on the
+ * shared memory for shard access stats.
+ */
+static size_t
+ShardAccessStatsShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(ShardAccessStatsSharedData));
+
+	Size hashSize = hash_estimate_size(ShardAccessStatsMax,
+									   sizeof(ShardAccessHashEntry));
+
+	size = add_size(size, hashSize);
+
+	return size;
+}
+
+
+/*
+ * ShardAccessStatsShmemInit initializes the shared memory used for keeping
+ * track of shard accesses across backends.
+ */
+static void
+ShardAccessStatsShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL info;
+
+	/* create (database, shard) -> [counters] */
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(ShardAccessHashKey);
+	info.entrysize = sizeof(ShardAccessHashEntry);
+	info.hash = tag_hash;
+	uint32 hashFlags = (HASH_ELEM | HASH_FUNCTION);
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	ShardAccessStatsSharedState =
+		(ShardAccessStatsSharedData *) ShmemInitStruct("Citus Shard Access Stats Data",
+													   sizeof(ShardAccessStatsSharedData),
+													   &alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		ShardAccessStatsSharedState->shardAccessHashTrancheId = LWLockNewTrancheId();
+		ShardAccessStatsSharedState->shardAccessHashTrancheName =
+			"Citus Shard Access Stats Tranche";
+		LWLockRegisterTranche(ShardAccessStatsSharedState->shardAccessHashTrancheId,
+							  ShardAccessStatsSharedState->shardAccessHashTrancheName);
+
+		LWLockInitialize(&ShardAccessStatsSharedState->shardAccessHashLock,
+						 ShardAccessStatsSharedState->shardAccessHashTrancheId);
+	}
+
+	ShardAccessHash = ShmemInitHash("Citus Shard Access Stats Hash",
+									ShardAccessStatsMax, ShardAccessStatsMax,
+									&info, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	Assert(ShardAccessHash != NULL);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+/*
+ * RecordTaskShardAccess counts a read or write of the anchor shard of the
+ * given task, if citus.track_shard_access is enabled. Only tasks that read or
+ * modify a shard are counted, so DDL commands and the tasks of repartition
+ * joins do not affect the counts.
+ */
+void
+RecordTaskShardAccess(Task *task)
+{
+	if (!TrackShardAccess || ShardAccessHash == NULL)
+	{
+		return;
+	}
+
+	if (task->anchorShardId == INVALID_SHARD_ID)
+	{
+		return;
+	}
+
+	if (task->taskType == SELECT_TASK)
+	{
+		RecordShardAccess(task->anchorShardId, false);
+	}
+	else if (task->taskType == MODIFY_TASK)
+	{
+		RecordShardAccess(task->anchorShardId, true);
+	}
+}
+
+
+/*
+ * RecordShardAccess counts a read or write of the given shard. Once the hash
+ * is full, accesses of shards that are not in the hash yet are not counted
+ * until the statistics are reset.
+ */
+static void
+RecordShardAccess(uint64 shardId, bool isWrite)
+{
+	ShardAccessHashKey key;
+	bool found = false;
+
+	memset(&key, 0, sizeof(key));
+	key.databaseId = MyDatabaseId;
+	key.shardId = shardId;
+
+	/* most calls hit an existing entry, a shared lock is enough for those */
+	LWLockAcquire(&ShardAccessStatsSharedState->shardAccessHashLock, LW_SHARED);
+
+	ShardAccessHashEntry *entry =
+		(ShardAccessHashEntry *) hash_search(ShardAccessHash, &key, HASH_FIND, &found);
+	if (!found)
+	{
+		LWLockRelease(&ShardAccessStatsSharedState->shardAccessHashLock);
+		LWLockAcquire(&ShardAccessStatsSharedState->shardAccessHashLock, LW_EXCLUSIVE);
+
+		/* another backend might have added the entry in the meantime */
+		entry = (ShardAccessHashEntry *) hash_search(ShardAccessHash, &key, HASH_FIND,
+													 &found);
+		if (!found)
+		{
+			if (hash_get_num_entries(ShardAccessHash) >= ShardAccessStatsMax)
+			{
+				LWLockRelease(&ShardAccessStatsSharedState->shardAccessHashLock);
+				return;
+			}
+
+			entry = (ShardAccessHashEntry *) hash_search(ShardAccessHash, &key,
+														 HASH_ENTER, &found);
+			SpinLockInit(&entry->mutex);
+			entry->readCount = 0;
+			entry->writeCount = 0;
+		}
+	}
+
+	SpinLockAcquire(&entry->mutex);
+	if (isWrite)
+	{
+		entry->writeCount++;
+	}
+	else
+	{
+		entry->readCount++;
+	}
+	SpinLockRelease(&entry->mutex);
+
+	LWLockRelease(&ShardAccessStatsSharedState->shardAccessHashLock);
+}
+
+
+/*
+ * ShardAccessCount returns the number of reads and writes of the given shard
+ * of the current database that were counted on this node.
+ */
+uint64
+ShardAccessCount(uint64 shardId)
+{
+	ShardAccessHashKey key;
+	bool found = false;
+	uint64 accessCount = 0;
+
+	if (ShardAccessHash == NULL)
+	{
+		return 0;
+	}
+
+	memset(&key, 0, sizeof(key));
+	key.databaseId = MyDatabaseId;
+	key.shardId = shardId;
+
+	LWLockAcquire(&ShardAccessStatsSharedState->shardAccessHashLock, LW_SHARED);
+
+	ShardAccessHashEntry *entry =
+		(ShardAccessHashEntry *) hash_search(ShardAccessHash, &key, HASH_FIND, &found);
+	if (found)
+	{
+		SpinLockAcquire(&entry->mutex);
+		accessCount = entry->readCount + entry->writeCount;
+		SpinLockRelease(&entry->mutex);
+	}
+
+	LWLockRelease(&ShardAccessStatsSharedState->shardAccessHashLock);
+
+	return accessCount;
+}
+
+
+/*
+ * citus_shard_access_stats_reset removes the shard access counts of all
+ * databases.
+ */
+Datum
+citus_shard_access_stats_reset(PG_FUNCTION_ARGS)
+{
+	HASH_SEQ_STATUS status;
+	ShardAccessHashEntry *entry = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	LWLockAcquire(&ShardAccessStatsSharedState->shardAccessHashLock, LW_EXCLUSIVE);
+
+	hash_seq_init(&status, ShardAccessHash);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		hash_search(ShardAccessHash, &entry->key, HASH_REMOVE, NULL);
+	}
+
+	LWLockRelease(&ShardAccessStatsSharedState->shardAccessHashLock);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * citus_shard_access_stats returns the number of reads and writes of each
+ * shard of the current database that were counted on this node.
+ */
+Datum
+citus_shard_access_stats(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupleDescriptor = NULL;
+
+	CheckCitusVersion(ERROR);
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	StoreAllShardAccessStats(tupleStore, tupleDescriptor);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupleStore);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * StoreAllShardAccessStats writes the shard access counts of the current
+ * database to the tuple store.
+ */
+static void
+StoreAllShardAccessStats(Tuplestorestate *tupleStore, TupleDesc tupleDescriptor)
+{
+	Datum values[CITUS_SHARD_ACCESS_STATS_COLUMNS];
+	bool isNulls[CITUS_SHARD_ACCESS_STATS_COLUMNS];
+	HASH_SEQ_STATUS status;
+	ShardAccessHashEntry *entry = NULL;
+
+	/* we're reading all the entries, shared lock is enough */
+	LWLockAcquire(&ShardAccessStatsSharedState->shardAccessHashLock, LW_SHARED);
+
+	hash_seq_init(&status, ShardAccessHash);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		if (entry->key.databaseId != MyDatabaseId)
+		{
+			continue;
+		}
+
+		/* get ready for the next tuple */
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		SpinLockAcquire(&entry->mutex);
+		int64 readCount = entry->readCount;
+		int64 writeCount = entry->writeCount;
+		SpinLockRelease(&entry->mutex);
+
+		values[0] = Int64GetDatum(entry->key.shardId);
+		values[1] = Int64GetDatum(readCount);
+		values[2] = Int64GetDatum(writeCount);
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	LWLockRelease(&ShardAccessStatsSharedState->shardAccessHashLock);
+}
@@ -10,25 +10,102 @@
 
 #include "postgres.h"
 
+#include "access/xact.h"
+#include "distributed/citus_custom_scan.h"
+#include "distributed/deparse_shard_query.h"
+#include "distributed/distributed_execution_locks.h"
+#include "distributed/distributed_planner.h"
 #include "distributed/intermediate_result_pruning.h"
 #include "distributed/intermediate_results.h"
+#include "distributed/local_executor.h"
 #include "distributed/multi_executor.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/recursive_planning.h"
 #include "distributed/subplan_execution.h"
 #include "distributed/transaction_management.h"
+#include "distributed/version_compat.h"
 #include "distributed/worker_manager.h"
 #include "executor/executor.h"
+#include "miscadmin.h"
+#include "utils/builtins.h"
+#include "utils/memutils.h"
+#include "utils/tuplestore.h"
 
 
 int MaxIntermediateResult = 1048576; /* maximum size in KB the intermediate result can grow to */
+int IntermediateResultSizeLimitAction = INTERMEDIATE_RESULT_SIZE_LIMIT_ERROR;
 /* when this is true, we enforce intermediate result size limit in all executors */
 int SubPlanLevel = 0;
 
+/* when this is true, subplans reuse equal results of the same transaction */
+bool EnableSubPlanResultReuse = false;
+
+/* when this is true, the tasks of independent subplans run concurrently */
+bool EnableParallelSubPlanExecution = false;
+
+/* lower bound on the work_mem share of the tuple store of a parallel task */
+#define MIN_PARALLEL_TASK_TUPLE_STORE_KB 64
+
+
+/*
+ * SubPlanResultCacheEntry describes an intermediate result written earlier in
+ * the current transaction, which a later subplan with the same query can use
+ * instead of executing and sending its own result.
+ */
+typedef struct SubPlanResultCacheEntry
+{
+	char *queryKey;
+	char *resultId;
+	List *nodeIdList;
+	bool hasLocalFile;
+	CommandId commandId;
+} SubPlanResultCacheEntry;
+
+
+/*
+ * ParallelSubPlan holds the rows of a subplan whose tasks were executed along
+ * with the tasks of other independent subplans, which are written to the
+ * intermediate result in place of executing the subplan.
+ */
+typedef struct ParallelSubPlan
+{
+	DistributedSubPlan *subPlan;
+	TupleDesc tupleDescriptor;
+
+	/* rows of each task of the subplan, in task order */
+	List *tupleStoreList;
+} ParallelSubPlan;
+
+
+/* results of the current transaction, allocated in TopTransactionContext */
+static List *SubPlanResultCache = NIL;
+
+
+static bool SubPlanResultIsReusable(DistributedSubPlan *subPlan);
+static bool ReuseSubPlanResult(DistributedSubPlan *subPlan, char *resultId,
+							   List *workerNodeList, bool writeLocalFile);
+static SubPlanResultCacheEntry * FindSubPlanResult(char *queryKey);
+static void CacheSubPlanResult(DistributedSubPlan *subPlan, char *resultId,
+							   List *workerNodeList, bool writeLocalFile);
+static void LinkIntermediateResultOnNodes(char *sourceResultId, char *resultId,
+										  List *workerNodeList);
+static Task * SingleTaskSubPlanTask(DistributedSubPlan *subPlan);
+static void TransferSingleTaskSubPlanResult(DistributedSubPlan *subPlan, Task *task,
+											char *resultId, List *workerNodeList);
+static List * ExecuteIndependentSubPlanTasks(List *subPlanList);
+static bool SubPlanReturnsTaskRows(DistributedSubPlan *subPlan);
+static bool SubPlanCanRunInParallel(DistributedSubPlan *subPlan);
+static ParallelSubPlan * FindParallelSubPlan(List *parallelSubPlanList,
+											 DistributedSubPlan *subPlan);
+static void SendTupleStoresToDestReceiver(ParallelSubPlan *parallelSubPlan,
+										  DestReceiver *dest);
+
 
 /*
  * ExecuteSubPlans executes a list of subplans from a distributed plan
- * by sequentially executing each plan from the top.
+ * by sequentially executing each plan from the top. When enabled, the tasks
+ * of independent subplans run in a single execution beforehand, in which case
+ * their rows are written to the intermediate results in the same order.
  */
 void
 ExecuteSubPlans(DistributedPlan *distributedPlan)
@@ -36,6 +113,7 @@ ExecuteSubPlans(DistributedPlan *distributedPlan)
 	uint64 planId = distributedPlan->planId;
 	List *subPlanList = distributedPlan->subPlanList;
 	ListCell *subPlanCell = NULL;
+	List *parallelSubPlanList = NIL;
 
 	if (subPlanList == NIL)
 	{
@@ -55,6 +133,11 @@ ExecuteSubPlans(DistributedPlan *distributedPlan)
 	 */
 	BeginOrContinueCoordinatedTransaction();
 
+	if (EnableParallelSubPlanExecution)
+	{
+		parallelSubPlanList = ExecuteIndependentSubPlanTasks(subPlanList);
+	}
+
 	foreach(subPlanCell, subPlanList)
 	{
 		DistributedSubPlan *subPlan = (DistributedSubPlan *) lfirst(subPlanCell);
@@ -90,15 +173,660 @@ ExecuteSubPlans(DistributedPlan *distributedPlan)
 			}
 		}
 
+		/* keep where the result goes for EXPLAIN ANALYZE */
+		subPlan->bytesSent = 0;
+		subPlan->remoteWorkerCount = list_length(workerNodeList);
+		subPlan->writeLocalFile = writeLocalFile;
+
+		if (ReuseSubPlanResult(subPlan, resultId, workerNodeList, writeLocalFile))
+		{
+			continue;
+		}
+
+		/*
+		 * The result of a single task is written on the node of the task, from
+		 * which the nodes that need the result fetch it, unless the task already
+		 * ran along with other subplans.
+		 */
+		Task *singleTask = SingleTaskSubPlanTask(subPlan);
+		if (singleTask != NULL && workerNodeList != NIL && !writeLocalFile &&
+			!LocalExecutionHappened &&
+			FindParallelSubPlan(parallelSubPlanList, subPlan) == NULL)
+		{
+			TransferSingleTaskSubPlanResult(subPlan, singleTask, resultId,
+											workerNodeList);
+			CacheSubPlanResult(subPlan, resultId, workerNodeList, writeLocalFile);
+			continue;
+		}
+
+		/*
+		 * A result that is joined on a distribution column is partitioned
+		 * among the nodes, unless another distributed plan in the plan tree
+		 * reads it as well.
+		 */
+		bool partitionResult = false;
+		if (OidIsValid(subPlan->partitionRelationId) && workerNodeList != NIL)
+		{
+			partitionResult = IntermediateResultUsedInSinglePlan(intermediateResultsHash,
+																 resultId);
+		}
+
 		SubPlanLevel++;
 		EState *estate = CreateExecutorState();
 		DestReceiver *copyDest = CreateRemoteFileDestReceiver(resultId, estate,
 															  workerNodeList,
 															  writeLocalFile);
 
-		ExecutePlanIntoDestReceiver(plannedStmt, params, copyDest);
+		if (partitionResult)
+		{
+			SetRemoteFileDestReceiverPartitioning(copyDest,
+												  subPlan->partitionRelationId,
+												  subPlan->partitionColumnIndex);
+		}
+
+		ParallelSubPlan *parallelSubPlan = FindParallelSubPlan(parallelSubPlanList,
+															   subPlan);
+		if (parallelSubPlan != NULL)
+		{
+			/* the tasks already ran, only write their rows */
+			SendTupleStoresToDestReceiver(parallelSubPlan, copyDest);
+		}
+		else
+		{
+			ExecutePlanIntoDestReceiver(plannedStmt, params, copyDest);
+		}
 
 		SubPlanLevel--;
+		subPlan->bytesSent = RemoteFileDestReceiverBytesSent(copyDest);
 		FreeExecutorState(estate);
+
+		/* nodes only have a part of a partitioned result, which is not reusable */
+		if (!partitionResult)
+		{
+			CacheSubPlanResult(subPlan, resultId, workerNodeList, writeLocalFile);
+		}
+	}
+}
+
+
+/*
+ * SubPlanResultIsReusable returns whether the result of the given subplan can
+ * be cached or taken from the cache. This requires the subplan's query to read
+ * the same data on each execution: the transaction uses a single snapshot and
+ * has not modified any distributed tables. Local modifications are detected
+ * through the command id of each cache entry.
+ */
+static bool
+SubPlanResultIsReusable(DistributedSubPlan *subPlan)
+{
+	if (!EnableSubPlanResultReuse || subPlan->queryKey == NULL)
+	{
+		return false;
+	}
+
+	if (!IsolationUsesXactSnapshot())
+	{
+		return false;
+	}
+
+	if (XactModificationLevel != XACT_MODIFICATION_NONE)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * ReuseSubPlanResult checks if an earlier subplan of the current transaction
+ * wrote the result of the same query to all nodes that need the result of the
+ * given subplan. If so, the function makes the earlier result available under
+ * the given result id on these nodes by linking the files, and returns true.
+ * Otherwise, the caller needs to execute the subplan.
+ */
+static bool
+ReuseSubPlanResult(DistributedSubPlan *subPlan, char *resultId, List *workerNodeList,
+				   bool writeLocalFile)
+{
+	ListCell *workerNodeCell = NULL;
+
+	if (!SubPlanResultIsReusable(subPlan))
+	{
+		return false;
+	}
+
+	SubPlanResultCacheEntry *cacheEntry = FindSubPlanResult(subPlan->queryKey);
+	if (cacheEntry == NULL || cacheEntry->commandId != GetCurrentCommandId(false))
+	{
+		return false;
+	}
+
+	if (writeLocalFile && !cacheEntry->hasLocalFile)
+	{
+		return false;
+	}
+
+	foreach(workerNodeCell, workerNodeList)
+	{
+		WorkerNode *workerNode = (WorkerNode *) lfirst(workerNodeCell);
+
+		if (!list_member_int(cacheEntry->nodeIdList, workerNode->nodeId))
+		{
+			return false;
+		}
+	}
+
+	/* the executor cannot run remote tasks after local execution */
+	if (workerNodeList != NIL && LocalExecutionHappened)
+	{
+		return false;
+	}
+
+	/* a cached plan that runs again uses the same result ids */
+	if (strcmp(cacheEntry->resultId, resultId) != 0)
+	{
+		LinkIntermediateResultOnNodes(cacheEntry->resultId, resultId, workerNodeList);
+
+		if (writeLocalFile)
+		{
+			LinkIntermediateResult(cacheEntry->resultId, resultId);
+		}
+	}
+
+	if ((LogIntermediateResults && IsLoggableLevel(DEBUG1)) ||
+		IsLoggableLevel(DEBUG4))
+	{
+		elog(DEBUG1, "Subplan %s reuses the result of subplan %s", resultId,
+			 cacheEntry->resultId);
+	}
+
+	return true;
+}
+
+
+/*
+ * FindSubPlanResult returns the cached result of the given subplan query, or
+ * NULL if there is none.
+ */
+static SubPlanResultCacheEntry *
+FindSubPlanResult(char *queryKey)
+{
+	ListCell *cacheEntryCell = NULL;
+
+	foreach(cacheEntryCell, SubPlanResultCache)
+	{
+		SubPlanResultCacheEntry *cacheEntry =
+			(SubPlanResultCacheEntry *) lfirst(cacheEntryCell);
+
+		if (strcmp(cacheEntry->queryKey, queryKey) == 0)
+		{
+			return cacheEntry;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * CacheSubPlanResult remembers the result that the given subplan wrote to the
+ * given nodes, such that later subplans of the same transaction can reuse it.
+ * A newer result of the same query replaces the older one.
+ */
+static void
+CacheSubPlanResult(DistributedSubPlan *subPlan, char *resultId, List *workerNodeList,
+				   bool writeLocalFile)
+{
+	ListCell *workerNodeCell = NULL;
+
+	if (!SubPlanResultIsReusable(subPlan))
+	{
+		return;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(TopTransactionContext);
+
+	SubPlanResultCacheEntry *cacheEntry = FindSubPlanResult(subPlan->queryKey);
+	if (cacheEntry == NULL)
+	{
+		cacheEntry = palloc0(sizeof(SubPlanResultCacheEntry));
+		cacheEntry->queryKey = pstrdup(subPlan->queryKey);
+
+		SubPlanResultCache = lappend(SubPlanResultCache, cacheEntry);
+	}
+
+	cacheEntry->resultId = pstrdup(resultId);
+	cacheEntry->nodeIdList = NIL;
+	cacheEntry->hasLocalFile = writeLocalFile;
+	cacheEntry->commandId = GetCurrentCommandId(false);
+
+	foreach(workerNodeCell, workerNodeList)
+	{
+		WorkerNode *workerNode = (WorkerNode *) lfirst(workerNodeCell);
+
+		cacheEntry->nodeIdList = lappend_int(cacheEntry->nodeIdList,
+											 workerNode->nodeId);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * LinkIntermediateResultOnNodes makes the intermediate result with the given
+ * source result id available under the given result id on the given nodes.
+ */
+static void
+LinkIntermediateResultOnNodes(char *sourceResultId, char *resultId,
+							  List *workerNodeList)
+{
+	List *linkTaskList = NIL;
+	ListCell *workerNodeCell = NULL;
+	uint32 linkTaskId = 1;
+
+	if (workerNodeList == NIL)
+	{
+		return;
+	}
+
+	StringInfo linkQuery = makeStringInfo();
+	appendStringInfo(linkQuery, "SELECT pg_catalog.link_intermediate_result(%s, %s)",
+					 quote_literal_cstr(sourceResultId), quote_literal_cstr(resultId));
+
+	foreach(workerNodeCell, workerNodeList)
+	{
+		WorkerNode *workerNode = (WorkerNode *) lfirst(workerNodeCell);
+
+		ShardPlacement *taskPlacement = CitusMakeNode(ShardPlacement);
+		taskPlacement->nodeName = workerNode->workerName;
+		taskPlacement->nodePort = workerNode->workerPort;
+		taskPlacement->nodeId = workerNode->nodeId;
+		taskPlacement->groupId = workerNode->groupId;
+
+		Task *linkTask = CreateBasicTask(INVALID_JOB_ID, linkTaskId++, SELECT_TASK,
+										 linkQuery->data);
+		linkTask->taskPlacementList = list_make1(taskPlacement);
+
+		linkTaskList = lappend(linkTaskList, linkTask);
+	}
+
+	ExecuteTaskList(ROW_MODIFY_READONLY, linkTaskList, MaxAdaptiveExecutorPoolSize);
+}
+
+
+/*
+ * SingleTaskSubPlanTask returns the task of the given subplan if its result
+ * can move between the workers: citus.enable_single_shard_join_transfer is
+ * enabled, and the subplan returns the rows of a single remote task as they
+ * are. Otherwise, the function returns NULL.
+ */
+static Task *
+SingleTaskSubPlanTask(DistributedSubPlan *subPlan)
+{
+	if (!EnableSingleShardJoinTransfer || !SubPlanReturnsTaskRows(subPlan))
+	{
+		return NULL;
+	}
+
+	CustomScan *customScan = (CustomScan *) subPlan->plan->planTree;
+	DistributedPlan *distributedPlan = GetDistributedPlan(customScan);
+	List *taskList = distributedPlan->workerJob->taskList;
+
+	if (list_length(taskList) != 1 || ShouldExecuteTasksLocally(taskList))
+	{
+		return NULL;
 	}
+
+	Task *task = (Task *) linitial(taskList);
+	if (task->taskPlacementList == NIL)
+	{
+		return NULL;
+	}
+
+	return task;
+}
+
+
+/*
+ * TransferSingleTaskSubPlanResult writes the result of the given task of a
+ * subplan into an intermediate result on the node of its first placement,
+ * and then lets the other nodes that need the result fetch it from there.
+ * The rows do not pass through the coordinator, which also means that the
+ * size limit of intermediate results does not apply to them.
+ */
+static void
+TransferSingleTaskSubPlanResult(DistributedSubPlan *subPlan, Task *task, char *resultId,
+								List *workerNodeList)
+{
+	CustomScan *customScan = (CustomScan *) subPlan->plan->planTree;
+	DistributedPlan *distributedPlan = GetDistributedPlan(customScan);
+	ShardPlacement *sourcePlacement = (ShardPlacement *) linitial(task->taskPlacementList);
+	List *fetchTaskList = NIL;
+	ListCell *workerNodeCell = NULL;
+	uint32 fetchTaskId = 1;
+
+	/* the partitions are locked as if the subplan ran on the coordinator */
+	LockPartitionsInRelationList(distributedPlan->relationIdList, AccessShareLock);
+
+	StringInfo createQuery = makeStringInfo();
+	appendStringInfo(createQuery,
+					 "SELECT pg_catalog.create_intermediate_result(%s, %s)",
+					 quote_literal_cstr(resultId),
+					 quote_literal_cstr(TaskQueryString(task)));
+
+	/* run on the connection that the transaction used for the shard, if any */
+	Task *createTask = CreateBasicTask(INVALID_JOB_ID, 1, SELECT_TASK,
+									   createQuery->data);
+	createTask->anchorShardId = task->anchorShardId;
+	createTask->relationShardList = task->relationShardList;
+	createTask->taskPlacementList = list_make1(sourcePlacement);
+
+	ExecuteTaskList(ROW_MODIFY_READONLY, list_make1(createTask),
+					MaxAdaptiveExecutorPoolSize);
+
+	StringInfo fetchQuery = makeStringInfo();
+	appendStringInfo(fetchQuery,
+					 "SELECT pg_catalog.fetch_intermediate_results(ARRAY[%s]::text[], "
+					 "%s, %d)", quote_literal_cstr(resultId),
+					 quote_literal_cstr(sourcePlacement->nodeName),
+					 sourcePlacement->nodePort);
+
+	foreach(workerNodeCell, workerNodeList)
+	{
+		WorkerNode *workerNode = (WorkerNode *) lfirst(workerNodeCell);
+
+		/* the node of the task already has the result */
+		if (workerNode->nodeId == sourcePlacement->nodeId)
+		{
+			continue;
+		}
+
+		ShardPlacement *taskPlacement = CitusMakeNode(ShardPlacement);
+		taskPlacement->nodeName = workerNode->workerName;
+		taskPlacement->nodePort = workerNode->workerPort;
+		taskPlacement->nodeId = workerNode->nodeId;
+		taskPlacement->groupId = workerNode->groupId;
+
+		Task *fetchTask = CreateBasicTask(INVALID_JOB_ID, fetchTaskId++, SELECT_TASK,
+										  fetchQuery->data);
+		fetchTask->taskPlacementList = list_make1(taskPlacement);
+
+		fetchTaskList = lappend(fetchTaskList, fetchTask);
+	}
+
+	if (fetchTaskList != NIL)
+	{
+		ExecuteTaskList(ROW_MODIFY_READONLY, fetchTaskList, MaxAdaptiveExecutorPoolSize);
+	}
+
+	if ((LogIntermediateResults && IsLoggableLevel(DEBUG1)) ||
+		IsLoggableLevel(DEBUG4))
+	{
+		elog(DEBUG1, "Subplan %s is written on %s:%d and fetched by %d nodes",
+			 resultId, sourcePlacement->nodeName, sourcePlacement->nodePort,
+			 list_length(fetchTaskList));
+	}
+}
+
+
+/*
+ * ExecuteIndependentSubPlanTasks runs the tasks of the subplans that neither
+ * read other intermediate results nor need any work on the coordinator other
+ * than collecting their rows in a single execution, such that the tasks of
+ * these subplans run concurrently. The function returns a ParallelSubPlan for
+ * each of these subplans, or NIL if there are fewer than two of them.
+ */
+static List *
+ExecuteIndependentSubPlanTasks(List *subPlanList)
+{
+	List *parallelSubPlanList = NIL;
+	List *taskResultDestinationList = NIL;
+	ListCell *subPlanCell = NULL;
+	int totalTaskCount = 0;
+
+	foreach(subPlanCell, subPlanList)
+	{
+		DistributedSubPlan *subPlan = (DistributedSubPlan *) lfirst(subPlanCell);
+
+		if (!SubPlanCanRunInParallel(subPlan))
+		{
+			continue;
+		}
+
+		ParallelSubPlan *parallelSubPlan = palloc0(sizeof(ParallelSubPlan));
+		parallelSubPlan->subPlan = subPlan;
+		parallelSubPlan->tupleDescriptor =
+			ExecCleanTypeFromTLCompat(subPlan->plan->planTree->targetlist);
+
+		parallelSubPlanList = lappend(parallelSubPlanList, parallelSubPlan);
+
+		CustomScan *customScan = (CustomScan *) subPlan->plan->planTree;
+		DistributedPlan *distributedPlan = GetDistributedPlan(customScan);
+		totalTaskCount += list_length(distributedPlan->workerJob->taskList);
+	}
+
+	if (list_length(parallelSubPlanList) < 2)
+	{
+		/* nothing runs concurrently that would not do so anyway */
+		return NIL;
+	}
+
+	int taskTupleStoreKB = Max(work_mem / Max(totalTaskCount, 1),
+							   MIN_PARALLEL_TASK_TUPLE_STORE_KB);
+	ListCell *parallelSubPlanCell = NULL;
+
+	foreach(parallelSubPlanCell, parallelSubPlanList)
+	{
+		ParallelSubPlan *parallelSubPlan = (ParallelSubPlan *) lfirst(
+			parallelSubPlanCell);
+		CustomScan *customScan = (CustomScan *) parallelSubPlan->subPlan->plan->planTree;
+		DistributedPlan *distributedPlan = GetDistributedPlan(customScan);
+		ListCell *taskCell = NULL;
+
+		/* the size limit applies to each intermediate result separately */
+		DistributedExecutionStats *executionStats =
+			palloc0(sizeof(DistributedExecutionStats));
+
+		/* the partitions are locked as if the subplan ran on its own */
+		LockPartitionsInRelationList(distributedPlan->relationIdList,
+									 AccessShareLock);
+
+		foreach(taskCell, distributedPlan->workerJob->taskList)
+		{
+			TaskResultDestination *destination =
+				palloc0(sizeof(TaskResultDestination));
+			destination->task = (Task *) lfirst(taskCell);
+			destination->tupleDescriptor = parallelSubPlan->tupleDescriptor;
+			destination->tupleStore = tuplestore_begin_heap(false, false,
+															taskTupleStoreKB);
+			destination->executionStats = executionStats;
+
+			taskResultDestinationList = lappend(taskResultDestinationList,
+												destination);
+			parallelSubPlan->tupleStoreList =
+				lappend(parallelSubPlan->tupleStoreList, destination->tupleStore);
+		}
+	}
+
+	if ((LogIntermediateResults && IsLoggableLevel(DEBUG1)) ||
+		IsLoggableLevel(DEBUG4))
+	{
+		elog(DEBUG1, "Executing the tasks of %d subplans concurrently",
+			 list_length(parallelSubPlanList));
+	}
+
+	SubPlanLevel++;
+	ExecuteTaskListIntoTupleStores(taskResultDestinationList,
+								   MaxAdaptiveExecutorPoolSize);
+	SubPlanLevel--;
+
+	return parallelSubPlanList;
+}
+
+
+/*
+ * SubPlanCanRunInParallel returns whether the tasks of the given subplan can
+ * run along with the tasks of other subplans, which is the case if the rows
+ * of its remote tasks make up its result. The results of single tasks that
+ * move between the workers are not collected on the coordinator at all.
+ */
+static bool
+SubPlanCanRunInParallel(DistributedSubPlan *subPlan)
+{
+	if (!SubPlanReturnsTaskRows(subPlan))
+	{
+		return false;
+	}
+
+	CustomScan *customScan = (CustomScan *) subPlan->plan->planTree;
+	DistributedPlan *distributedPlan = GetDistributedPlan(customScan);
+
+	if (ShouldExecuteTasksLocally(distributedPlan->workerJob->taskList))
+	{
+		return false;
+	}
+
+	/* an earlier result of the same query is reused without executing it */
+	if (SubPlanResultIsReusable(subPlan) && FindSubPlanResult(subPlan->queryKey) != NULL)
+	{
+		return false;
+	}
+
+	if (SingleTaskSubPlanTask(subPlan) != NULL)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * SubPlanReturnsTaskRows returns whether the given subplan is a read-only
+ * adaptive executor plan whose rows the coordinator returns as they are, and
+ * that does not depend on other subplans or the coordinator otherwise.
+ */
+static bool
+SubPlanReturnsTaskRows(DistributedSubPlan *subPlan)
+{
+	PlannedStmt *plannedStmt = subPlan->plan;
+	Plan *planTree = plannedStmt->planTree;
+	ListCell *targetEntryCell = NULL;
+
+	if (plannedStmt->commandType != CMD_SELECT || !IsCitusCustomScan(planTree))
+	{
+		return false;
+	}
+
+	CustomScan *customScan = (CustomScan *) planTree;
+	if (customScan->methods != &AdaptiveExecutorCustomScanMethods ||
+		planTree->qual != NIL || planTree->initPlan != NIL)
+	{
+		return false;
+	}
+
+	/* the rows of the tasks make up the result, all of it */
+	foreach(targetEntryCell, planTree->targetlist)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+
+		if (targetEntry->resjunk)
+		{
+			return false;
+		}
+	}
+
+	DistributedPlan *distributedPlan = GetDistributedPlan(customScan);
+	Job *workerJob = distributedPlan->workerJob;
+
+	if (distributedPlan->modLevel != ROW_MODIFY_READONLY ||
+		distributedPlan->insertSelectSubquery != NULL ||
+		distributedPlan->subPlanList != NIL ||
+		distributedPlan->usedSubPlanNodeList != NIL ||
+		distributedPlan->taskResultMergeOrder != NULL ||
+		distributedPlan->topNCount > 0)
+	{
+		return false;
+	}
+
+	if (workerJob == NULL || workerJob->dependentJobList != NIL ||
+		workerJob->requiresMasterEvaluation || workerJob->deferredPruning ||
+		workerJob->taskList == NIL)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * FindParallelSubPlan returns the ParallelSubPlan of the given subplan, or
+ * NULL if its tasks did not run in parallel with other subplans.
+ */
+static ParallelSubPlan *
+FindParallelSubPlan(List *parallelSubPlanList, DistributedSubPlan *subPlan)
+{
+	ListCell *parallelSubPlanCell = NULL;
+
+	foreach(parallelSubPlanCell, parallelSubPlanList)
+	{
+		ParallelSubPlan *parallelSubPlan = (ParallelSubPlan *) lfirst(
+			parallelSubPlanCell);
+
+		if (parallelSubPlan->subPlan == subPlan)
+		{
+			return parallelSubPlan;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * SendTupleStoresToDestReceiver sends the rows that the tasks of a parallel
+ * subplan returned to the given destination, in task order, and frees the
+ * tuple stores.
+ */
+static void
+SendTupleStoresToDestReceiver(ParallelSubPlan *parallelSubPlan, DestReceiver *dest)
+{
+	TupleDesc tupleDescriptor = parallelSubPlan->tupleDescriptor;
+	ListCell *tupleStoreCell = NULL;
+
+	TupleTableSlot *tupleSlot = MakeSingleTupleTableSlotCompat(tupleDescriptor,
+															   &TTSOpsMinimalTuple);
+
+	dest->rStartup(dest, CMD_SELECT, tupleDescriptor);
+
+	foreach(tupleStoreCell, parallelSubPlan->tupleStoreList)
+	{
+		Tuplestorestate *tupleStore = (Tuplestorestate *) lfirst(tupleStoreCell);
+
+		while (tuplestore_gettupleslot(tupleStore, true, false, tupleSlot))
+		{
+			dest->receiveSlot(tupleSlot, dest);
+		}
+
+		tuplestore_end(tupleStore);
+	}
+
+	dest->rShutdown(dest);
+
+	ExecDropSingleTupleTableSlot(tupleSlot);
+	parallelSubPlan->tupleStoreList = NIL;
+}
+
+
+/*
+ * ResetSubPlanResultCache forgets the results of the current transaction. The
+ * transaction callback calls it when the transaction ends, at which point the
+ * results are removed and the cache entries freed.
+ */
+void
+ResetSubPlanResultCache(void)
+{
+	SubPlanResultCache = NIL;
 }
@@ -0,0 +1,656 @@
+/*-------------------------------------------------------------------------
+ *
+ * top_n_execution.c
+ *
+ * Functions for pulling only the candidate groups of top-N queries.
+ *
+ * A query such as
+ *
+ *     SELECT key, sum(value) FROM table GROUP BY key ORDER BY 2 DESC LIMIT k
+ *
+ * that does not group by the distribution column normally pulls every group
+ * of every shard to the coordinator. When the planner marks such a plan (see
+ * PlanTopNCandidates()), the executor instead runs the worker query in three
+ * rounds, in the spirit of the threshold algorithm TPUT:
+ *
+ * 1. Every task returns its k groups with the largest partial sums. Summing
+ *    the partial sums of each group gives a lower bound for its total, as
+ *    long as no partial sum is negative. The k-th largest lower bound, tau,
+ *    is a lower bound for the total of each of the top-k groups.
+ * 2. A group whose total is at least tau has a partial sum of at least
+ *    tau / shardCount on at least one shard. Every task returns the groups
+ *    that pass this threshold.
+ * 3. The original worker query runs restricted to the groups of round 2,
+ *    and the master query computes the exact totals of these candidates.
+ *
+ * Whenever one of the assumptions does not hold, for instance because a
+ * partial sum is negative or there are fewer than k groups, the executor
+ * falls back to pulling all groups.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include <math.h>
+
+#include "access/htup_details.h"
+#include "access/tupdesc.h"
+#include "catalog/pg_type.h"
+#include "distributed/local_executor.h"
+#include "distributed/multi_executor.h"
+#include "distributed/multi_physical_planner.h"
+#include "distributed/top_n_execution.h"
+#include "distributed/transaction_management.h"
+#include "distributed/version_compat.h"
+#include "executor/tuptable.h"
+#include "lib/stringinfo.h"
+#include "nodes/nodeFuncs.h"
+#include "parser/parsetree.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/tuplestore.h"
+
+
+/*
+ * Upper bound on the number of candidate groups that we send back to the
+ * workers as literals. Beyond that we pull all groups.
+ */
+#define TOP_N_MAX_CANDIDATE_COUNT 10000
+
+/*
+ * Partial sums are compared as double precision values, which can round them
+ * slightly up. We lower the threshold by this fraction to stay on the safe
+ * side.
+ */
+#define TOP_N_THRESHOLD_MARGIN 1e-9
+
+
+/*
+ * TopNGroup is a group returned by one of the tasks in the first two rounds,
+ * identified by the text representations of its group columns.
+ */
+typedef struct TopNGroup
+{
+	char *groupKey;
+	char **groupValues;
+	double partialSum;
+	bool partialSumIsNull;
+} TopNGroup;
+
+
+static List * TopNRoundTaskList(List *taskList, char *queryPrefix, char *querySuffix);
+static Tuplestorestate * ExecuteTopNRound(List *taskList, TupleDesc tupleDescriptor);
+static TupleDesc TopNRoundTupleDesc(int groupColumnCount, bool includePartialSums);
+static char * TopNColumnName(DistributedPlan *distributedPlan, AttrNumber columnNumber);
+static char * TopNGroupColumnTextList(DistributedPlan *distributedPlan);
+static TopNGroup * ReadTopNGroups(Tuplestorestate *tupleStore, TupleDesc tupleDescriptor,
+								  int groupColumnCount, bool includePartialSums,
+								  int *groupCount, double *minimumPartialSum);
+static int CompareTopNGroupKeys(const void *left, const void *right);
+static int CompareDoublesDescending(const void *left, const void *right);
+static bool TopNLowerBound(TopNGroup *groupArray, int groupCount, uint64 topNCount,
+						   double *lowerBound);
+static char * TopNCandidateFilter(DistributedPlan *distributedPlan,
+								  TopNGroup *groupArray, int groupCount);
+static char * TopNGroupLiteral(DistributedPlan *distributedPlan, AttrNumber columnNumber,
+							   char *groupValue);
+
+
+/*
+ * ShouldPullTopNCandidates returns whether the executor should run the
+ * candidate rounds for the given plan. The candidate rounds run over
+ * separate connections without parameters, so we only use them for
+ * parameterless statements outside of transaction blocks that did not
+ * execute any tasks locally.
+ */
+bool
+ShouldPullTopNCandidates(DistributedPlan *distributedPlan, ParamListInfo paramListInfo)
+{
+	if (distributedPlan->topNCount == 0)
+	{
+		return false;
+	}
+
+	if (paramListInfo != NULL && paramListInfo->numParams > 0)
+	{
+		return false;
+	}
+
+	if (IsMultiStatementTransaction() || LocalExecutionHappened)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * TopNCandidateTaskList runs the first two candidate rounds for the given
+ * tasks, and returns the tasks of the final round, which only return the
+ * candidate groups. If it turns out that we cannot restrict the groups, the
+ * function returns the given task list.
+ */
+List *
+TopNCandidateTaskList(DistributedPlan *distributedPlan, List *taskList)
+{
+	int groupColumnCount = list_length(distributedPlan->topNGroupColumnList);
+	int shardCount = list_length(taskList);
+	char *sortColumnName = TopNColumnName(distributedPlan,
+										  distributedPlan->topNSortColumn);
+	char *groupColumnTextList = TopNGroupColumnTextList(distributedPlan);
+	StringInfo queryPrefix = makeStringInfo();
+	StringInfo querySuffix = makeStringInfo();
+	int groupCount = 0;
+	double minimumPartialSum = 0.0;
+	double lowerBound = 0.0;
+
+	/* round 1: the groups with the largest partial sums of each task */
+	appendStringInfo(queryPrefix,
+					 "SELECT %s, %s::float8, (min(%s) OVER ())::float8 FROM (",
+					 groupColumnTextList, sortColumnName, sortColumnName);
+	appendStringInfo(querySuffix,
+					 ") citus_top_n WHERE %s IS NOT NULL ORDER BY %s DESC LIMIT "
+					 UINT64_FORMAT, sortColumnName, sortColumnName,
+					 distributedPlan->topNCount);
+
+	TupleDesc roundOneTupleDesc = TopNRoundTupleDesc(groupColumnCount, true);
+	List *roundOneTaskList = TopNRoundTaskList(taskList, queryPrefix->data,
+											   querySuffix->data);
+	Tuplestorestate *roundOneStore = ExecuteTopNRound(roundOneTaskList,
+													  roundOneTupleDesc);
+	TopNGroup *roundOneGroups = ReadTopNGroups(roundOneStore, roundOneTupleDesc,
+											   groupColumnCount, true, &groupCount,
+											   &minimumPartialSum);
+	tuplestore_end(roundOneStore);
+
+	/* partial sums only give lower bounds when none of them is negative */
+	if (minimumPartialSum < 0.0 ||
+		!TopNLowerBound(roundOneGroups, groupCount, distributedPlan->topNCount,
+						&lowerBound))
+	{
+		return taskList;
+	}
+
+	double threshold = lowerBound / shardCount * (1.0 - TOP_N_THRESHOLD_MARGIN);
+	if (isnan(threshold) || isinf(threshold) || threshold <= 0.0)
+	{
+		return taskList;
+	}
+
+	/* round 2: the groups that pass the threshold on any of the tasks */
+	char thresholdString[64];
+	snprintf(thresholdString, sizeof(thresholdString), "%.17g", threshold);
+
+	resetStringInfo(queryPrefix);
+	resetStringInfo(querySuffix);
+	appendStringInfo(queryPrefix, "SELECT %s FROM (", groupColumnTextList);
+	appendStringInfo(querySuffix, ") citus_top_n WHERE %s >= %s",
+					 sortColumnName, thresholdString);
+
+	if (distributedPlan->topNNullsFirst)
+	{
+		/* groups without any value come first, and are candidates as well */
+		appendStringInfo(querySuffix, " OR %s IS NULL", sortColumnName);
+	}
+
+	TupleDesc roundTwoTupleDesc = TopNRoundTupleDesc(groupColumnCount, false);
+	List *roundTwoTaskList = TopNRoundTaskList(taskList, queryPrefix->data,
+											   querySuffix->data);
+	Tuplestorestate *roundTwoStore = ExecuteTopNRound(roundTwoTaskList,
+													  roundTwoTupleDesc);
+	TopNGroup *candidateGroups = ReadTopNGroups(roundTwoStore, roundTwoTupleDesc,
+												groupColumnCount, false, &groupCount,
+												NULL);
+	tuplestore_end(roundTwoStore);
+
+	char *candidateFilter = TopNCandidateFilter(distributedPlan, candidateGroups,
+												groupCount);
+	if (candidateFilter == NULL)
+	{
+		return taskList;
+	}
+
+	ereport(DEBUG1, (errmsg("pulling %d candidate groups for the top "
+							UINT64_FORMAT " groups", groupCount,
+							distributedPlan->topNCount)));
+
+	/* round 3: the worker query restricted to the candidate groups */
+	resetStringInfo(queryPrefix);
+	resetStringInfo(querySuffix);
+	appendStringInfoString(queryPrefix, "SELECT * FROM (");
+	appendStringInfo(querySuffix, ") citus_top_n WHERE %s", candidateFilter);
+
+	return TopNRoundTaskList(taskList, queryPrefix->data, querySuffix->data);
+}
+
+
+/*
+ * TopNRoundTaskList returns copies of the given tasks that run their query
+ * as a subquery between the given prefix and suffix.
+ */
+static List *
+TopNRoundTaskList(List *taskList, char *queryPrefix, char *querySuffix)
+{
+	List *roundTaskList = NIL;
+	ListCell *taskCell = NULL;
+
+	foreach(taskCell, taskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+		Task *roundTask = copyObject(task);
+		StringInfo queryString = makeStringInfo();
+
+		appendStringInfo(queryString, "%s%s%s", queryPrefix, TaskQueryString(task),
+						 querySuffix);
+
+		roundTask->queryString = queryString->data;
+		roundTask->queryTemplate = NULL;
+
+		roundTaskList = lappend(roundTaskList, roundTask);
+	}
+
+	return roundTaskList;
+}
+
+
+/*
+ * ExecuteTopNRound executes the given tasks and returns their rows in a new
+ * tuple store.
+ */
+static Tuplestorestate *
+ExecuteTopNRound(List *taskList, TupleDesc tupleDescriptor)
+{
+	bool randomAccess = false;
+	bool interTransactions = false;
+	bool hasReturning = false;
+	Tuplestorestate *tupleStore = tuplestore_begin_heap(randomAccess, interTransactions,
+														work_mem);
+
+	ExecuteTaskListExtended(ROW_MODIFY_READONLY, taskList, tupleDescriptor, tupleStore,
+							hasReturning, MaxAdaptiveExecutorPoolSize);
+
+	return tupleStore;
+}
+
+
+/*
+ * TopNRoundTupleDesc returns the tuple descriptor of the rows of the first
+ * two rounds: the text representations of the group columns, followed by
+ * the partial sum and the smallest partial sum of the task in round 1.
+ */
+static TupleDesc
+TopNRoundTupleDesc(int groupColumnCount, bool includePartialSums)
+{
+	int columnCount = groupColumnCount + (includePartialSums ? 2 : 0);
+	AttrNumber columnNumber = 1;
+
+#if PG_VERSION_NUM >= 120000
+	TupleDesc tupleDescriptor = CreateTemplateTupleDesc(columnCount);
+#else
+	TupleDesc tupleDescriptor = CreateTemplateTupleDesc(columnCount, false);
+#endif
+
+	for (columnNumber = 1; columnNumber <= groupColumnCount; columnNumber++)
+	{
+		TupleDescInitEntry(tupleDescriptor, columnNumber, NULL, TEXTOID, -1, 0);
+	}
+
+	if (includePartialSums)
+	{
+		TupleDescInitEntry(tupleDescriptor, columnNumber++, NULL, FLOAT8OID, -1, 0);
+		TupleDescInitEntry(tupleDescriptor, columnNumber++, NULL, FLOAT8OID, -1, 0);
+	}
+
+	return tupleDescriptor;
+}
+
+
+/*
+ * TopNColumnName returns the quoted name of the given output column of the
+ * worker query.
+ */
+static char *
+TopNColumnName(DistributedPlan *distributedPlan, AttrNumber columnNumber)
+{
+	Query *workerQuery = distributedPlan->workerJob->jobQuery;
+	TargetEntry *targetEntry = get_tle_by_resno(workerQuery->targetList, columnNumber);
+
+	Assert(targetEntry != NULL && targetEntry->resname != NULL);
+
+	return (char *) quote_identifier(targetEntry->resname);
+}
+
+
+/*
+ * TopNGroupColumnTextList returns the comma separated list of the group
+ * columns of the worker query, cast to text.
+ */
+static char *
+TopNGroupColumnTextList(DistributedPlan *distributedPlan)
+{
+	StringInfo columnList = makeStringInfo();
+	ListCell *groupColumnCell = NULL;
+
+	foreach(groupColumnCell, distributedPlan->topNGroupColumnList)
+	{
+		AttrNumber columnNumber = (AttrNumber) lfirst_int(groupColumnCell);
+
+		if (columnList->len > 0)
+		{
+			appendStringInfoString(columnList, ", ");
+		}
+
+		appendStringInfo(columnList, "%s::text",
+						 TopNColumnName(distributedPlan, columnNumber));
+	}
+
+	return columnList->data;
+}
+
+
+/*
+ * ReadTopNGroups reads the rows of a round into an array of groups. In round
+ * 1 it also returns the smallest partial sum that any of the tasks reported.
+ */
+static TopNGroup *
+ReadTopNGroups(Tuplestorestate *tupleStore, TupleDesc tupleDescriptor,
+			   int groupColumnCount, bool includePartialSums, int *groupCount,
+			   double *minimumPartialSum)
+{
+	TupleTableSlot *tupleSlot = MakeSingleTupleTableSlotCompat(tupleDescriptor,
+															   &TTSOpsMinimalTuple);
+	int64 rowCount = tuplestore_tuple_count(tupleStore);
+	TopNGroup *groupArray = palloc0(Max(rowCount, 1) * sizeof(TopNGroup));
+	int groupIndex = 0;
+
+	tuplestore_rescan(tupleStore);
+
+	while (tuplestore_gettupleslot(tupleStore, true, false, tupleSlot))
+	{
+		TopNGroup *group = &groupArray[groupIndex++];
+		StringInfo groupKey = makeStringInfo();
+
+		slot_getallattrs(tupleSlot);
+
+		group->groupValues = palloc0(groupColumnCount * sizeof(char *));
+
+		for (int columnIndex = 0; columnIndex < groupColumnCount; columnIndex++)
+		{
+			if (tupleSlot->tts_isnull[columnIndex])
+			{
+				appendStringInfoString(groupKey, "n;");
+				continue;
+			}
+
+			char *groupValue = TextDatumGetCString(tupleSlot->tts_values[columnIndex]);
+
+			/* the length prefix keeps keys of different groups apart */
+			appendStringInfo(groupKey, "%zu:%s;", strlen(groupValue), groupValue);
+			group->groupValues[columnIndex] = groupValue;
+		}
+
+		group->groupKey = groupKey->data;
+		group->partialSumIsNull = true;
+
+		if (includePartialSums)
+		{
+			int partialSumIndex = groupColumnCount;
+			int minimumIndex = groupColumnCount + 1;
+
+			if (!tupleSlot->tts_isnull[partialSumIndex])
+			{
+				group->partialSum =
+					DatumGetFloat8(tupleSlot->tts_values[partialSumIndex]);
+				group->partialSumIsNull = false;
+			}
+
+			if (!tupleSlot->tts_isnull[minimumIndex])
+			{
+				double taskMinimum = DatumGetFloat8(tupleSlot->tts_values[minimumIndex]);
+				*minimumPartialSum = Min(*minimumPartialSum, taskMinimum);
+			}
+		}
+
+		ExecClearTuple(tupleSlot);
+	}
+
+	ExecDropSingleTupleTableSlot(tupleSlot);
+
+	*groupCount = groupIndex;
+
+	return groupArray;
+}
+
+
+/*
+ * CompareTopNGroupKeys is a qsort comparator that orders groups by key.
+ */
+static int
+CompareTopNGroupKeys(const void *left, const void *right)
+{
+	const TopNGroup *leftGroup = (const TopNGroup *) left;
+	const TopNGroup *rightGroup = (const TopNGroup *) right;
+
+	return strcmp(leftGroup->groupKey, rightGroup->groupKey);
+}
+
+
+/*
+ * CompareDoublesDescending is a qsort comparator that orders doubles from
+ * large to small.
+ */
+static int
+CompareDoublesDescending(const void *left, const void *right)
+{
+	double leftValue = *((const double *) left);
+	double rightValue = *((const double *) right);
+
+	if (leftValue > rightValue)
+	{
+		return -1;
+	}
+	else if (leftValue < rightValue)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * TopNLowerBound sums the partial sums that the tasks returned for each group
+ * in round 1, and sets lowerBound to the k-th largest of these sums. It
+ * returns false when fewer than k groups have a value, in which case all
+ * groups make it into the result anyway.
+ */
+static bool
+TopNLowerBound(TopNGroup *groupArray, int groupCount, uint64 topNCount,
+			   double *lowerBound)
+{
+	double *groupSumArray = palloc0(Max(groupCount, 1) * sizeof(double));
+	int groupSumCount = 0;
+	int groupIndex = 0;
+
+	qsort(groupArray, groupCount, sizeof(TopNGroup), CompareTopNGroupKeys);
+
+	while (groupIndex < groupCount)
+	{
+		char *groupKey = groupArray[groupIndex].groupKey;
+		double groupSum = 0.0;
+		bool groupHasValue = false;
+
+		for (; groupIndex < groupCount &&
+			 strcmp(groupArray[groupIndex].groupKey, groupKey) == 0; groupIndex++)
+		{
+			if (!groupArray[groupIndex].partialSumIsNull)
+			{
+				groupSum += groupArray[groupIndex].partialSum;
+				groupHasValue = true;
+			}
+		}
+
+		if (groupHasValue)
+		{
+			groupSumArray[groupSumCount++] = groupSum;
+		}
+	}
+
+	if ((uint64) groupSumCount < topNCount)
+	{
+		return false;
+	}
+
+	qsort(groupSumArray, groupSumCount, sizeof(double), CompareDoublesDescending);
+
+	*lowerBound = groupSumArray[topNCount - 1];
+
+	return true;
+}
+
+
+/*
+ * TopNCandidateFilter returns the filter on the worker query that only keeps
+ * the given candidate groups. Groups with NULL values cannot be matched with
+ * IN, so they get a separate condition. The function returns NULL when there
+ * are too many candidates to make the filter worthwhile.
+ */
+static char *
+TopNCandidateFilter(DistributedPlan *distributedPlan, TopNGroup *groupArray,
+					int groupCount)
+{
+	List *groupColumnList = distributedPlan->topNGroupColumnList;
+	int groupColumnCount = list_length(groupColumnList);
+	StringInfo inList = makeStringInfo();
+	StringInfo nullConditions = makeStringInfo();
+	StringInfo candidateFilter = makeStringInfo();
+	ListCell *groupColumnCell = NULL;
+	int candidateCount = 0;
+
+	if (groupCount > TOP_N_MAX_CANDIDATE_COUNT)
+	{
+		return NULL;
+	}
+
+	qsort(groupArray, groupCount, sizeof(TopNGroup), CompareTopNGroupKeys);
+
+	for (int groupIndex = 0; groupIndex < groupCount; groupIndex++)
+	{
+		TopNGroup *group = &groupArray[groupIndex];
+		bool hasNullValue = false;
+		int columnIndex = 0;
+
+		/* several tasks can return the same group */
+		if (groupIndex > 0 &&
+			strcmp(groupArray[groupIndex - 1].groupKey, group->groupKey) == 0)
+		{
+			continue;
+		}
+
+		candidateCount++;
+
+		for (columnIndex = 0; columnIndex < groupColumnCount; columnIndex++)
+		{
+			if (group->groupValues[columnIndex] == NULL)
+			{
+				hasNullValue = true;
+			}
+		}
+
+		if (!hasNullValue)
+		{
+			appendStringInfoString(inList, inList->len > 0 ? ", (" : "(");
+		}
+		else
+		{
+			appendStringInfoString(nullConditions, " OR (");
+		}
+
+		columnIndex = 0;
+		foreach(groupColumnCell, groupColumnList)
+		{
+			AttrNumber columnNumber = (AttrNumber) lfirst_int(groupColumnCell);
+			char *groupValue = group->groupValues[columnIndex];
+
+			if (!hasNullValue)
+			{
+				appendStringInfo(inList, "%s%s", columnIndex > 0 ? ", " : "",
+								 TopNGroupLiteral(distributedPlan, columnNumber,
+												  groupValue));
+			}
+			else if (groupValue == NULL)
+			{
+				appendStringInfo(nullConditions, "%s%s IS NULL",
+								 columnIndex > 0 ? " AND " : "",
+								 TopNColumnName(distributedPlan, columnNumber));
+			}
+			else
+			{
+				appendStringInfo(nullConditions, "%s%s = %s",
+								 columnIndex > 0 ? " AND " : "",
+								 TopNColumnName(distributedPlan, columnNumber),
+								 TopNGroupLiteral(distributedPlan, columnNumber,
+												  groupValue));
+			}
+
+			columnIndex++;
+		}
+
+		appendStringInfoString(hasNullValue ? nullConditions : inList, ")");
+	}
+
+	if (candidateCount == 0)
+	{
+		return "false";
+	}
+
+	/* (column, ...) IN ((value, ...), ...) */
+	appendStringInfoChar(candidateFilter, '(');
+	foreach(groupColumnCell, groupColumnList)
+	{
+		AttrNumber columnNumber = (AttrNumber) lfirst_int(groupColumnCell);
+
+		appendStringInfo(candidateFilter, "%s%s",
+						 candidateFilter->len > 1 ? ", " : "",
+						 TopNColumnName(distributedPlan, columnNumber));
+	}
+
+	if (inList->len > 0)
+	{
+		appendStringInfo(candidateFilter, ") IN (%s)", inList->data);
+	}
+	else
+	{
+		/* only groups with NULL values, which the conditions below cover */
+		resetStringInfo(candidateFilter);
+		appendStringInfoString(candidateFilter, "false");
+	}
+
+	appendStringInfoString(candidateFilter, nullConditions->data);
+
+	return candidateFilter->data;
+}
+
+
+/*
+ * TopNGroupLiteral returns the given text representation of a value of the
+ * given group column as a literal of the type of the column.
+ */
+static char *
+TopNGroupLiteral(DistributedPlan *distributedPlan, AttrNumber columnNumber,
+				 char *groupValue)
+{
+	Query *workerQuery = distributedPlan->workerJob->jobQuery;
+	TargetEntry *targetEntry = get_tle_by_resno(workerQuery->targetList, columnNumber);
+	Node *groupExpression = (Node *) targetEntry->expr;
+	StringInfo literal = makeStringInfo();
+
+	appendStringInfo(literal, "%s::%s", quote_literal_cstr(groupValue),
+					 format_type_with_typemod(exprType(groupExpression),
+											  exprTypmod(groupExpression)));
+
+	return literal->data;
+}
@@ -0,0 +1,166 @@
+/*-------------------------------------------------------------------------
+ *
+ * worker_latency_stats.c
+ *
+ * The adaptive executor decides how many connections to open to a worker
+ * based on how long the tasks on that worker take compared to establishing
+ * a new connection. We keep a moving average of both per worker for the
+ * lifetime of the backend, such that each execution can make use of what
+ * the earlier executions in the session observed. The moving average of the
+ * deviation from the average task duration gives a rough estimate of how long
+ * the slowest tasks take, which is used to decide when to hedge a read.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include <math.h>
+
+#include "distributed/worker_latency_stats.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+
+
+/*
+ * Weight of a new measurement in the moving averages, which makes the
+ * averages follow changes in the workload after a few executions.
+ */
+#define LATENCY_SMOOTHING_FACTOR 0.2
+
+/* number of tasks that need to finish before we estimate the tail latency */
+#define MIN_PERCENTILE_SAMPLE_COUNT 20
+
+/*
+ * For roughly normally distributed durations, the 95th percentile lies about
+ * 1.645 standard deviations, or about 2 mean absolute deviations, above the
+ * mean.
+ */
+#define P95_MEAN_DEVIATION_COUNT 2.0
+
+
+/* config variable managed via guc.c */
+bool EnableAdaptiveSlowStart = false;
+
+/* latency statistics of the workers, created on first use */
+static HTAB *WorkerLatencyStatsHash = NULL;
+
+
+static double UpdateMovingAverage(double average, uint64 sampleCount, double value);
+
+
+/*
+ * GetWorkerLatencyStats returns the latency statistics of the given worker,
+ * which are kept for the lifetime of the backend.
+ */
+WorkerLatencyStats *
+GetWorkerLatencyStats(const char *hostname, int port)
+{
+	WorkerLatencyStatsKey key;
+	bool found = false;
+
+	if (WorkerLatencyStatsHash == NULL)
+	{
+		HASHCTL info;
+
+		memset(&info, 0, sizeof(info));
+		info.keysize = sizeof(WorkerLatencyStatsKey);
+		info.entrysize = sizeof(WorkerLatencyStats);
+		info.hcxt = TopMemoryContext;
+		uint32 hashFlags = (HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+		WorkerLatencyStatsHash = hash_create("citus worker latency stats", 32, &info,
+											 hashFlags);
+	}
+
+	memset(&key, 0, sizeof(key));
+	strlcpy(key.hostname, hostname, MAX_NODE_LENGTH);
+	key.port = port;
+
+	WorkerLatencyStats *stats =
+		(WorkerLatencyStats *) hash_search(WorkerLatencyStatsHash, &key, HASH_ENTER,
+										   &found);
+	if (!found)
+	{
+		stats->taskDuration = 0.0;
+		stats->taskDurationDeviation = 0.0;
+		stats->taskCount = 0;
+		stats->connectTime = 0.0;
+		stats->connectCount = 0;
+	}
+
+	return stats;
+}
+
+
+/*
+ * RecordWorkerTaskDuration adds the duration of a task that was sent to the
+ * worker at startTime and just finished.
+ */
+void
+RecordWorkerTaskDuration(WorkerLatencyStats *stats, TimestampTz startTime)
+{
+	double duration = (GetCurrentTimestamp() - startTime) / 1000.0;
+	double deviation = fabs(duration - stats->taskDuration);
+
+	if (stats->taskCount > 0)
+	{
+		stats->taskDurationDeviation =
+			UpdateMovingAverage(stats->taskDurationDeviation, stats->taskCount - 1,
+								deviation);
+	}
+
+	stats->taskDuration = UpdateMovingAverage(stats->taskDuration, stats->taskCount,
+											  duration);
+	stats->taskCount++;
+}
+
+
+/*
+ * RecordWorkerConnectTime adds the time it took to establish a connection to
+ * the worker, which started at startTime and just finished.
+ */
+void
+RecordWorkerConnectTime(WorkerLatencyStats *stats, TimestampTz startTime)
+{
+	double connectTime = (GetCurrentTimestamp() - startTime) / 1000.0;
+
+	stats->connectTime = UpdateMovingAverage(stats->connectTime, stats->connectCount,
+											 connectTime);
+	stats->connectCount++;
+}
+
+
+/*
+ * EstimateWorkerTaskDurationP95 returns a rough estimate of the 95th
+ * percentile of the durations of the tasks on the worker in milliseconds, or
+ * -1 if too few tasks finished to tell.
+ */
+double
+EstimateWorkerTaskDurationP95(WorkerLatencyStats *stats)
+{
+	if (stats->taskCount < MIN_PERCENTILE_SAMPLE_COUNT)
+	{
+		return -1.0;
+	}
+
+	return stats->taskDuration + P95_MEAN_DEVIATION_COUNT * stats->taskDurationDeviation;
+}
+
+
+/*
+ * UpdateMovingAverage returns the exponential moving average after adding the
+ * given value. The first value is taken as is.
+ */
+static double
+UpdateMovingAverage(double average, uint64 sampleCount, double value)
+{
+	if (sampleCount == 0)
+	{
+		return value;
+	}
+
+	return (1.0 - LATENCY_SMOOTHING_FACTOR) * average + LATENCY_SMOOTHING_FACTOR * value;
+}
@@ -32,7 +32,10 @@
 /* local functions forward declarations */
 static List * OpenConnectionsToAllWorkerNodes(LOCKMODE lockMode);
 static void BlockDistributedTransactions(void);
-static void CreateRemoteRestorePoints(char *restoreName, List *connectionList);
+static void UnblockDistributedTransactions(void);
+static void StartRemoteRestorePoints(char *restoreName, List *connectionList);
+static void FinishRemoteRestorePoints(List *connectionList);
+static void CloseConnectionList(List *connectionList);
 
 
 /* exports for SQL callable functions */
@@ -96,11 +99,24 @@ citus_create_restore_point(PG_FUNCTION_ARGS)
 	/* DANGER: finish as quickly as possible after this */
 	BlockDistributedTransactions();
 
-	/* do local restore point first to bail out early if something goes wrong */
+	/* send pg_create_restore_point to all nodes */
+	StartRemoteRestorePoints(restoreNameString, connectionList);
+
+	/* create the local restore point while the nodes create theirs */
 	XLogRecPtr localRestorePoint = XLogRestorePoint(restoreNameString);
 
-	/* run pg_create_restore_point on all nodes */
-	CreateRemoteRestorePoints(restoreNameString, connectionList);
+	/* wait for the restore points on all nodes */
+	FinishRemoteRestorePoints(connectionList);
+
+	/*
+	 * Distributed transactions that commit from here on commit after the
+	 * restore point on all nodes, so there is no need to block them until
+	 * the end of the transaction.
+	 */
+	UnblockDistributedTransactions();
+
+	/* closing connections can take a while, so we do it after unblocking */
+	CloseConnectionList(connectionList);
 
 	PG_RETURN_LSN(localRestorePoint);
 }
@@ -152,11 +168,24 @@ BlockDistributedTransactions(void)
 
 
 /*
- * CreateRemoteRestorePoints creates a restore point via each of the
- * connections in the list in parallel.
+ * UnblockDistributedTransactions releases the locks taken by
+ * BlockDistributedTransactions before the end of the transaction.
+ */
+static void
+UnblockDistributedTransactions(void)
+{
+	UnlockRelationOid(DistTransactionRelationId(), ExclusiveLock);
+	UnlockRelationOid(DistPartitionRelationId(), ExclusiveLock);
+	UnlockRelationOid(DistNodeRelationId(), ExclusiveLock);
+}
+
+
+/*
+ * StartRemoteRestorePoints sends the command to create a restore point over
+ * each of the connections in the list, without waiting for the results.
  */
 static void
-CreateRemoteRestorePoints(char *restoreName, List *connectionList)
+StartRemoteRestorePoints(char *restoreName, List *connectionList)
 {
 	ListCell *connectionCell = NULL;
 	int parameterCount = 1;
@@ -169,18 +198,33 @@ CreateRemoteRestorePoints(char *restoreName, List *connectionList)
 
 		int querySent = SendRemoteCommandParams(connection, CREATE_RESTORE_POINT_COMMAND,
 												parameterCount, parameterTypes,
-												parameterValues);
+												parameterValues, false);
 		if (querySent == 0)
 		{
 			ReportConnectionError(connection, ERROR);
 		}
 	}
+}
+
+
+/*
+ * FinishRemoteRestorePoints waits for the restore points started by
+ * StartRemoteRestorePoints on all connections in parallel, and errors out
+ * if any of them failed.
+ */
+static void
+FinishRemoteRestorePoints(List *connectionList)
+{
+	ListCell *connectionCell = NULL;
+	bool raiseInterrupts = true;
+
+	WaitForAllConnections(connectionList, raiseInterrupts);
 
 	foreach(connectionCell, connectionList)
 	{
 		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
 
-		PGresult *result = GetRemoteCommandResult(connection, true);
+		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
 		if (!IsResponseOK(result))
 		{
 			ReportResultError(connection, result, ERROR);
@@ -189,6 +233,22 @@ CreateRemoteRestorePoints(char *restoreName, List *connectionList)
 		PQclear(result);
 
 		ForgetResults(connection);
+	}
+}
+
+
+/*
+ * CloseConnectionList closes all connections in the list.
+ */
+static void
+CloseConnectionList(List *connectionList)
+{
+	ListCell *connectionCell = NULL;
+
+	foreach(connectionCell, connectionList)
+	{
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+
 		CloseConnection(connection);
 	}
 }
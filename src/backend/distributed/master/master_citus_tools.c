@@ -18,16 +18,22 @@
 
 #include "access/htup_details.h"
 #include "catalog/pg_type.h"
+#include "distributed/citus_wait_events.h"
 #include "distributed/connection_management.h"
+#include "distributed/master_protocol.h"
 #include "distributed/metadata_cache.h"
-#include "distributed/multi_server_executor.h"
+#include "distributed/multi_executor.h"
 #include "distributed/remote_commands.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/version_compat.h"
 #include "lib/stringinfo.h"
+#include "storage/latch.h"
 #include "utils/builtins.h"
+#include "utils/timestamp.h"
 
-#include "distributed/multi_client_executor.h"
+
+/* config variable managed via guc.c */
+int RunCommandTimeout = 0;
 
 
 PG_FUNCTION_INFO_V1(master_run_on_worker);
@@ -35,12 +41,6 @@ PG_FUNCTION_INFO_V1(master_run_on_worker);
 static int ParseCommandParameters(FunctionCallInfo fcinfo, StringInfo **nodeNameArray,
 								  int **nodePortsArray, StringInfo **commandStringArray,
 								  bool *parallel);
-static void ExecuteCommandsInParallelAndStoreResults(StringInfo *nodeNameArray,
-													 int *nodePortArray,
-													 StringInfo *commandStringArray,
-													 bool *statusArray,
-													 StringInfo *resultStringArray,
-													 int commmandCount);
 static bool GetConnectionStatusAndResult(MultiConnection *connection, bool *resultStatus,
 										 StringInfo queryResultString);
 static bool EvaluateQueryResult(MultiConnection *connection, PGresult *queryResult,
@@ -51,9 +51,10 @@ static void ExecuteCommandsAndStoreResults(StringInfo *nodeNameArray,
 										   StringInfo *commandStringArray,
 										   bool *statusArray,
 										   StringInfo *resultStringArray,
-										   int commmandCount);
-static bool ExecuteRemoteQueryOrCommand(char *nodeName, uint32 nodePort,
-										char *queryString, StringInfo queryResult);
+										   int commandCount, bool parallel);
+static void WaitForCommandResults(MultiConnection **connectionArray,
+								  TimestampTz *deadlineArray, int commandCount,
+								  int runningCount);
 static Tuplestorestate * CreateTupleStore(TupleDesc tupleDescriptor,
 										  StringInfo *nodeNameArray, int *nodePortArray,
 										  bool *statusArray,
@@ -120,17 +121,9 @@ master_run_on_worker(PG_FUNCTION_ARGS)
 		resultArray[commandIndex] = makeStringInfo();
 	}
 
-	if (parallelExecution)
-	{
-		ExecuteCommandsInParallelAndStoreResults(nodeNameArray, nodePortArray,
-												 commandStringArray,
-												 statusArray, resultArray, commandCount);
-	}
-	else
-	{
-		ExecuteCommandsAndStoreResults(nodeNameArray, nodePortArray, commandStringArray,
-									   statusArray, resultArray, commandCount);
-	}
+	ExecuteCommandsAndStoreResults(nodeNameArray, nodePortArray, commandStringArray,
+								   statusArray, resultArray, commandCount,
+								   parallelExecution);
 
 	/* let the caller know we're sending back a tuplestore */
 	rsinfo->returnMode = SFRM_Materialize;
@@ -200,123 +193,6 @@ ParseCommandParameters(FunctionCallInfo fcinfo, StringInfo **nodeNameArray,
 }
 
 
-/*
- * ExecuteCommandsInParellelAndStoreResults connects to each node specified in
- * nodeNameArray and nodePortArray, and executes command in commandStringArray
- * in parallel fashion. Execution success status and result is reported for
- * each command in statusArray and resultStringArray. Each array contains
- * commandCount items.
- */
-static void
-ExecuteCommandsInParallelAndStoreResults(StringInfo *nodeNameArray, int *nodePortArray,
-										 StringInfo *commandStringArray,
-										 bool *statusArray, StringInfo *resultStringArray,
-										 int commmandCount)
-{
-	MultiConnection **connectionArray =
-		palloc0(commmandCount * sizeof(MultiConnection *));
-	int finishedCount = 0;
-
-	/* start connections asynchronously */
-	for (int commandIndex = 0; commandIndex < commmandCount; commandIndex++)
-	{
-		char *nodeName = nodeNameArray[commandIndex]->data;
-		int nodePort = nodePortArray[commandIndex];
-		int connectionFlags = FORCE_NEW_CONNECTION;
-		connectionArray[commandIndex] =
-			StartNodeConnection(connectionFlags, nodeName, nodePort);
-	}
-
-	/* establish connections */
-	for (int commandIndex = 0; commandIndex < commmandCount; commandIndex++)
-	{
-		MultiConnection *connection = connectionArray[commandIndex];
-		StringInfo queryResultString = resultStringArray[commandIndex];
-		char *nodeName = nodeNameArray[commandIndex]->data;
-		int nodePort = nodePortArray[commandIndex];
-
-		FinishConnectionEstablishment(connection);
-
-		if (PQstatus(connection->pgConn) != CONNECTION_OK)
-		{
-			appendStringInfo(queryResultString, "failed to connect to %s:%d", nodeName,
-							 (int) nodePort);
-			statusArray[commandIndex] = false;
-			connectionArray[commandIndex] = NULL;
-			finishedCount++;
-		}
-		else
-		{
-			statusArray[commandIndex] = true;
-		}
-	}
-
-	/* send queries at once */
-	for (int commandIndex = 0; commandIndex < commmandCount; commandIndex++)
-	{
-		MultiConnection *connection = connectionArray[commandIndex];
-		char *queryString = commandStringArray[commandIndex]->data;
-		StringInfo queryResultString = resultStringArray[commandIndex];
-
-		/*
-		 * If we don't have a connection, nothing to send, error string should already
-		 * been filled.
-		 */
-		if (connection == NULL)
-		{
-			continue;
-		}
-
-		int querySent = SendRemoteCommand(connection, queryString);
-		if (querySent == 0)
-		{
-			StoreErrorMessage(connection, queryResultString);
-			statusArray[commandIndex] = false;
-			CloseConnection(connection);
-			connectionArray[commandIndex] = NULL;
-			finishedCount++;
-		}
-	}
-
-	/* check for query results */
-	while (finishedCount < commmandCount)
-	{
-		for (int commandIndex = 0; commandIndex < commmandCount; commandIndex++)
-		{
-			MultiConnection *connection = connectionArray[commandIndex];
-			StringInfo queryResultString = resultStringArray[commandIndex];
-			bool success = false;
-
-			if (connection == NULL)
-			{
-				continue;
-			}
-
-			bool queryFinished = GetConnectionStatusAndResult(connection, &success,
-															  queryResultString);
-
-			if (queryFinished)
-			{
-				finishedCount++;
-				statusArray[commandIndex] = success;
-				connectionArray[commandIndex] = NULL;
-				CloseConnection(connection);
-			}
-		}
-
-		CHECK_FOR_INTERRUPTS();
-
-		if (finishedCount < commmandCount)
-		{
-			long sleepIntervalPerCycle = RemoteTaskCheckInterval * 1000L;
-			pg_usleep(sleepIntervalPerCycle);
-		}
-	}
-
-	pfree(connectionArray);
-}
-
-
 /*
  * GetConnectionStatusAndResult checks the active connection and returns true if
  * query execution is finished (either success or fail).
@@ -455,65 +331,275 @@ StoreErrorMessage(MultiConnection *connection, StringInfo queryResultString)
 
 /*
  * ExecuteCommandsAndStoreResults connects to each node specified in
- * nodeNameArray and nodePortArray, and executes command in commandStringArray
- * in sequential order. Execution success status and result is reported for
- * each command in statusArray and resultStringArray. Each array contains
- * commandCount items.
+ * nodeNameArray and nodePortArray, and executes the command in
+ * commandStringArray over a new connection. Execution success status and
+ * result is reported for each command in statusArray and resultStringArray.
+ * Each array contains commandCount items.
+ *
+ * In parallel mode, commands are started as soon as their node has fewer than
+ * citus.max_adaptive_executor_pool_size commands in progress, such that a slow
+ * node only holds up the commands that run on it. Otherwise, the commands run
+ * one at a time. Commands that run for longer than citus.run_command_timeout
+ * are cancelled and reported as failed.
  */
 static void
 ExecuteCommandsAndStoreResults(StringInfo *nodeNameArray, int *nodePortArray,
 							   StringInfo *commandStringArray, bool *statusArray,
-							   StringInfo *resultStringArray, int commmandCount)
+							   StringInfo *resultStringArray, int commandCount,
+							   bool parallel)
 {
-	for (int commandIndex = 0; commandIndex < commmandCount; commandIndex++)
+	MultiConnection **connectionArray =
+		palloc0(commandCount * sizeof(MultiConnection *));
+	TimestampTz *deadlineArray = palloc0(commandCount * sizeof(TimestampTz));
+	bool *startedArray = palloc0(commandCount * sizeof(bool));
+	int *nodeIndexArray = palloc0(commandCount * sizeof(int));
+	int *nodeRunningCountArray = palloc0(commandCount * sizeof(int));
+	int maxNodeRunningCount = parallel ? MaxAdaptiveExecutorPoolSize : 1;
+	int nextCommandIndex = 0;
+	int runningCount = 0;
+	int finishedCount = 0;
+
+	/* number the distinct nodes, to track the commands in progress per node */
+	for (int commandIndex = 0; commandIndex < commandCount; commandIndex++)
+	{
+		nodeIndexArray[commandIndex] = commandIndex;
+
+		for (int otherIndex = 0; otherIndex < commandIndex; otherIndex++)
+		{
+			if (nodePortArray[otherIndex] == nodePortArray[commandIndex] &&
+				strcmp(nodeNameArray[otherIndex]->data,
+					   nodeNameArray[commandIndex]->data) == 0)
+			{
+				nodeIndexArray[commandIndex] = nodeIndexArray[otherIndex];
+				break;
+			}
+		}
+	}
+
+	while (finishedCount < commandCount)
 	{
-		char *nodeName = nodeNameArray[commandIndex]->data;
-		int32 nodePort = nodePortArray[commandIndex];
-		char *queryString = commandStringArray[commandIndex]->data;
-		StringInfo queryResultString = resultStringArray[commandIndex];
+		List *startedCommandList = NIL;
+		List *startedConnectionList = NIL;
+		ListCell *startedCommandCell = NULL;
+		bool commandFinished = false;
+
+		/* start the commands for which there is room, in order */
+		for (int commandIndex = nextCommandIndex; commandIndex < commandCount;
+			 commandIndex++)
+		{
+			int nodeIndex = nodeIndexArray[commandIndex];
+			char *nodeName = nodeNameArray[commandIndex]->data;
+			int nodePort = nodePortArray[commandIndex];
+			int connectionFlags = FORCE_NEW_CONNECTION;
+
+			if (!parallel && runningCount > 0)
+			{
+				break;
+			}
+
+			if (startedArray[commandIndex] ||
+				nodeRunningCountArray[nodeIndex] >= maxNodeRunningCount)
+			{
+				continue;
+			}
 
-		bool success = ExecuteRemoteQueryOrCommand(nodeName, nodePort, queryString,
-												   queryResultString);
+			connectionArray[commandIndex] =
+				StartNodeConnection(connectionFlags, nodeName, nodePort);
 
-		statusArray[commandIndex] = success;
+			if (RunCommandTimeout > 0)
+			{
+				deadlineArray[commandIndex] =
+					TimestampTzPlusMilliseconds(GetCurrentTimestamp(),
+												RunCommandTimeout);
+			}
+
+			startedArray[commandIndex] = true;
+			startedCommandList = lappend_int(startedCommandList, commandIndex);
+			startedConnectionList = lappend(startedConnectionList,
+											connectionArray[commandIndex]);
+
+			nodeRunningCountArray[nodeIndex]++;
+			runningCount++;
+		}
 
-		CHECK_FOR_INTERRUPTS();
+		/* skip over the commands that were started */
+		while (nextCommandIndex < commandCount && startedArray[nextCommandIndex])
+		{
+			nextCommandIndex++;
+		}
+
+		FinishConnectionListEstablishment(startedConnectionList);
+
+		foreach(startedCommandCell, startedCommandList)
+		{
+			int commandIndex = lfirst_int(startedCommandCell);
+			MultiConnection *connection = connectionArray[commandIndex];
+			char *queryString = commandStringArray[commandIndex]->data;
+			StringInfo queryResultString = resultStringArray[commandIndex];
+
+			if (PQstatus(connection->pgConn) != CONNECTION_OK)
+			{
+				appendStringInfo(queryResultString, "failed to connect to %s:%d",
+								 nodeNameArray[commandIndex]->data,
+								 nodePortArray[commandIndex]);
+			}
+			else if (SendRemoteCommand(connection, queryString) == 0)
+			{
+				StoreErrorMessage(connection, queryResultString);
+			}
+			else
+			{
+				continue;
+			}
+
+			statusArray[commandIndex] = false;
+			CloseConnection(connection);
+			connectionArray[commandIndex] = NULL;
+			nodeRunningCountArray[nodeIndexArray[commandIndex]]--;
+			runningCount--;
+			finishedCount++;
+			commandFinished = true;
+		}
+
+		/* collect the results of finished and timed out commands */
+		TimestampTz currentTime = GetCurrentTimestamp();
+
+		for (int commandIndex = 0; commandIndex < commandCount; commandIndex++)
+		{
+			MultiConnection *connection = connectionArray[commandIndex];
+			StringInfo queryResultString = resultStringArray[commandIndex];
+			bool success = false;
+
+			if (connection == NULL)
+			{
+				continue;
+			}
+
+			bool queryFinished = GetConnectionStatusAndResult(connection, &success,
+															  queryResultString);
+			if (!queryFinished && RunCommandTimeout > 0 &&
+				currentTime >= deadlineArray[commandIndex])
+			{
+				SendCancelationRequest(connection);
+
+				resetStringInfo(queryResultString);
+				appendStringInfo(queryResultString, "command timed out after %d ms",
+								 RunCommandTimeout);
+
+				queryFinished = true;
+			}
+
+			if (queryFinished)
+			{
+				statusArray[commandIndex] = success;
+				CloseConnection(connection);
+				connectionArray[commandIndex] = NULL;
+				nodeRunningCountArray[nodeIndexArray[commandIndex]]--;
+				runningCount--;
+				finishedCount++;
+				commandFinished = true;
+			}
+		}
+
+		if (!commandFinished && runningCount > 0)
+		{
+			WaitForCommandResults(connectionArray, deadlineArray, commandCount,
+								  runningCount);
+		}
 	}
+
+	pfree(connectionArray);
+	pfree(deadlineArray);
+	pfree(startedArray);
+	pfree(nodeIndexArray);
+	pfree(nodeRunningCountArray);
 }
 
 
 /*
- * ExecuteRemoteQueryOrCommand executes a query at specified remote node using
- * the calling user's credentials. The function returns the query status
- * (success/failure), and query result. The query is expected to return a single
- * target containing zero or one rows.
+ * WaitForCommandResults waits until one of the given connections has received
+ * data, needs to send more data, or reaches its deadline, while remaining
+ * responsive to cancellation.
  */
-static bool
-ExecuteRemoteQueryOrCommand(char *nodeName, uint32 nodePort, char *queryString,
-							StringInfo queryResultString)
+static void
+WaitForCommandResults(MultiConnection **connectionArray, TimestampTz *deadlineArray,
+					  int commandCount, int runningCount)
 {
-	int connectionFlags = FORCE_NEW_CONNECTION;
-	MultiConnection *connection =
-		GetNodeConnection(connectionFlags, nodeName, nodePort);
-	bool raiseInterrupts = true;
+	int eventSetSize = runningCount + 2;
+	long timeout = -1;
+
+	WaitEventSet *waitEventSet = CreateWaitEventSet(CurrentMemoryContext,
+													eventSetSize);
+	WaitEvent *events = palloc(eventSetSize * sizeof(WaitEvent));
+
+	AddWaitEventToSet(waitEventSet, WL_POSTMASTER_DEATH, PGINVALID_SOCKET, NULL,
+					  NULL);
+	AddWaitEventToSet(waitEventSet, WL_LATCH_SET, PGINVALID_SOCKET, MyLatch, NULL);
 
-	if (PQstatus(connection->pgConn) != CONNECTION_OK)
+	for (int commandIndex = 0; commandIndex < commandCount; commandIndex++)
 	{
-		appendStringInfo(queryResultString, "failed to connect to %s:%d", nodeName,
-						 (int) nodePort);
-		return false;
+		MultiConnection *connection = connectionArray[commandIndex];
+		int waitFlags = WL_SOCKET_READABLE;
+
+		if (connection == NULL)
+		{
+			continue;
+		}
+
+		pgsocket socket = PQsocket(connection->pgConn);
+		if (socket == PGINVALID_SOCKET)
+		{
+			/* a lost connection is noticed by GetConnectionStatusAndResult */
+			timeout = 0;
+			continue;
+		}
+
+		/* large commands may not have been sent fully */
+		if (PQflush(connection->pgConn) == 1)
+		{
+			waitFlags |= WL_SOCKET_WRITEABLE;
+		}
+
+		AddWaitEventToSet(waitEventSet, waitFlags, socket, NULL, connection);
+
+		if (RunCommandTimeout > 0)
+		{
+			long secs = 0;
+			int microsecs = 0;
+
+			TimestampDifference(GetCurrentTimestamp(), deadlineArray[commandIndex],
+								&secs, &microsecs);
+
+			long commandTimeout = secs * 1000 + microsecs / 1000;
+			if (timeout == -1 || commandTimeout < timeout)
+			{
+				timeout = commandTimeout;
+			}
+		}
 	}
 
-	SendRemoteCommand(connection, queryString);
-	PGresult *queryResult = GetRemoteCommandResult(connection, raiseInterrupts);
-	bool success = EvaluateQueryResult(connection, queryResult, queryResultString);
+	int eventCount = WaitEventSetWait(waitEventSet, timeout, events, eventSetSize,
+									  WAIT_EVENT_CITUS_REMOTE_RESULT);
 
-	PQclear(queryResult);
+	for (int eventIndex = 0; eventIndex < eventCount; eventIndex++)
+	{
+		WaitEvent *event = &events[eventIndex];
+
+		if (event->events & WL_POSTMASTER_DEATH)
+		{
+			ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
+		}
+
+		if (event->events & WL_LATCH_SET)
+		{
+			ResetLatch(MyLatch);
+		}
+	}
 
-	/* close the connection */
-	CloseConnection(connection);
+	FreeWaitEventSet(waitEventSet);
+	pfree(events);
 
-	return success;
+	CHECK_FOR_INTERRUPTS();
 }
 
 
@@ -99,7 +99,8 @@ master_create_worker_shards(PG_FUNCTION_ARGS)
  * metadata on the coordinator node to make this shard (and its placements)
  * visible. Note that the function assumes the table is hash partitioned and
  * calculates the min/max hash token ranges for each shard, giving them an equal
- * split of the hash space. Finally, function creates empty shard placements on
+ * split of the hash space. Units of citus.shard_unit_size adjacent shards are
+ * placed on the same nodes. Finally, function creates empty shard placements on
  * worker nodes.
  */
 void
@@ -193,9 +194,34 @@ CreateShardsWithRoundRobinPolicy(Oid distributedTableId, int32 shardCount,
 	/* set shard storage type according to relation type */
 	char shardStorageType = ShardStorageType(distributedTableId);
 
+	/* a new co-location group can go to the nodes with the most capacity */
+	List *utilizationList = NIL;
+	if (ShardPlacementPolicy == SHARD_PLACEMENT_LEAST_UTILIZED)
+	{
+		utilizationList = NodeUtilizationList(workerNodeList);
+	}
+
+	List *unitNodeList = NIL;
+
 	for (int64 shardIndex = 0; shardIndex < shardCount; shardIndex++)
 	{
-		uint32 roundRobinNodeIndex = shardIndex % workerNodeCount;
+		List *shardNodeList = workerNodeList;
+
+		/* the adjacent shards of a unit are placed on the same nodes */
+		int64 unitIndex = shardIndex / ShardUnitSize;
+		uint32 roundRobinNodeIndex = unitIndex % workerNodeCount;
+
+		if (utilizationList != NIL)
+		{
+			if (shardIndex % ShardUnitSize == 0)
+			{
+				unitNodeList = LeastUtilizedNodeList(utilizationList,
+													 replicationFactor);
+			}
+
+			shardNodeList = unitNodeList;
+			roundRobinNodeIndex = 0;
+		}
 
 		/* initialize the hash token space for this shard */
 		int32 shardMinHashToken = INT32_MIN + (shardIndex * hashTokenIncrement);
@@ -226,7 +252,7 @@ CreateShardsWithRoundRobinPolicy(Oid distributedTableId, int32 shardCount,
 		List *currentInsertedShardPlacements = InsertShardPlacementRows(
 			distributedTableId,
 			shardId,
-			workerNodeList,
+			shardNodeList,
 			roundRobinNodeIndex,
 			replicationFactor);
 		insertedShardPlacements = list_concat(insertedShardPlacements,
@@ -57,8 +57,40 @@
 #include "utils/fmgroids.h"
 #include "utils/inval.h"
 #include "utils/lsyscache.h"
+#include "utils/memutils.h"
 #include "utils/rel.h"
 #include "utils/syscache.h"
+#include "utils/timestamp.h"
+
+
+/* maximum length of the size function format strings in master_metadata_utility.h */
+#define MAX_SIZE_FUNCTION_LENGTH 64
+
+
+/*
+ * TableSizeCacheKey identifies a size computed by one of the size functions
+ * for a distributed table.
+ */
+typedef struct TableSizeCacheKey
+{
+	Oid relationId;
+	char sizeQuery[MAX_SIZE_FUNCTION_LENGTH];
+} TableSizeCacheKey;
+
+/* TableSizeCacheEntry keeps a computed size along with the time it was computed */
+typedef struct TableSizeCacheEntry
+{
+	TableSizeCacheKey key;
+
+	uint64 relationSize;
+	TimestampTz computedAt;
+} TableSizeCacheEntry;
+
+
+/* config variable managed via guc.c */
+int TableSizeCacheStaleness = 0;
+
+static HTAB *TableSizeCache = NULL;
 
 
 /* Local functions forward declarations */
@@ -68,8 +100,11 @@ static void RecordDistributedRelationDependencies(Oid distributedRelationId,
 static GroupShardPlacement * TupleToGroupShardPlacement(TupleDesc tupleDesc,
 														HeapTuple heapTuple);
 static uint64 DistributedTableSize(Oid relationId, char *sizeQuery);
-static uint64 DistributedTableSizeOnWorker(WorkerNode *workerNode, Oid relationId,
-										   char *sizeQuery);
+static uint64 DistributedTableSizeOnWorkers(List *workerNodeList, Oid relationId,
+											char *sizeQuery);
+static bool LookupCachedTableSize(Oid relationId, char *sizeQuery,
+								  uint64 *relationSize);
+static void StoreCachedTableSize(Oid relationId, char *sizeQuery, uint64 relationSize);
 static List * ShardIntervalsOnWorkerGroup(WorkerNode *workerNode, Oid relationId);
 static StringInfo GenerateSizeQueryOnMultiplePlacements(Oid distributedRelationId,
 														List *shardIntervalList,
@@ -156,11 +191,13 @@ citus_relation_size(PG_FUNCTION_ARGS)
  * DistributedTableSize is helper function for each kind of citus size functions.
  * It first checks whether the table is distributed and size query can be run on
  * it. Connection to each node has to be established to get the size of the table.
+ *
+ * When citus.table_size_cache_staleness is set, sizes that were computed by this
+ * backend less than that long ago are returned without querying the workers.
  */
 static uint64
 DistributedTableSize(Oid relationId, char *sizeQuery)
 {
-	ListCell *workerNodeCell = NULL;
 	uint64 totalRelationSize = 0;
 
 	if (XactModificationLevel == XACT_MODIFICATION_DATA)
@@ -180,16 +217,20 @@ DistributedTableSize(Oid relationId, char *sizeQuery)
 
 	ErrorIfNotSuitableToGetSize(relationId);
 
-	List *workerNodeList = ActiveReadableNodeList();
-
-	foreach(workerNodeCell, workerNodeList)
+	if (LookupCachedTableSize(relationId, sizeQuery, &totalRelationSize))
 	{
-		WorkerNode *workerNode = (WorkerNode *) lfirst(workerNodeCell);
-		uint64 relationSizeOnNode = DistributedTableSizeOnWorker(workerNode, relationId,
-																 sizeQuery);
-		totalRelationSize += relationSizeOnNode;
+		heap_close(relation, AccessShareLock);
+
+		return totalRelationSize;
 	}
 
+	List *workerNodeList = ActiveReadableNodeList();
+
+	totalRelationSize = DistributedTableSizeOnWorkers(workerNodeList, relationId,
+													  sizeQuery);
+
+	StoreCachedTableSize(relationId, sizeQuery, totalRelationSize);
+
 	heap_close(relation, AccessShareLock);
 
 	return totalRelationSize;
@@ -197,45 +238,165 @@ DistributedTableSize(Oid relationId, char *sizeQuery)
 
 
 /*
- * DistributedTableSizeOnWorker gets the workerNode and relationId to calculate
- * size of that relation on the given workerNode by summing up the size of each
- * shard placement.
+ * DistributedTableSizeOnWorkers calculates the size of the relation by sending
+ * a single query to each of the given workers that sums up the sizes of the
+ * shard placements on that worker. The queries are run in parallel.
  */
 static uint64
-DistributedTableSizeOnWorker(WorkerNode *workerNode, Oid relationId, char *sizeQuery)
+DistributedTableSizeOnWorkers(List *workerNodeList, Oid relationId, char *sizeQuery)
 {
-	char *workerNodeName = workerNode->workerName;
-	uint32 workerNodePort = workerNode->workerPort;
+	List *connectionList = NIL;
+	List *sizeQueryList = NIL;
+	WorkerNode *workerNode = NULL;
+	MultiConnection *connection = NULL;
 	uint32 connectionFlag = 0;
-	PGresult *result = NULL;
+	bool raiseInterrupts = true;
 	bool raiseErrors = true;
+	uint64 totalRelationSize = 0;
+
+	foreach_ptr(workerNode, workerNodeList)
+	{
+		List *shardIntervalsOnNode = ShardIntervalsOnWorkerGroup(workerNode,
+																 relationId);
+		if (shardIntervalsOnNode == NIL)
+		{
+			/* no need for a round trip to nodes without placements */
+			continue;
+		}
 
-	List *shardIntervalsOnNode = ShardIntervalsOnWorkerGroup(workerNode, relationId);
+		StringInfo tableSizeQuery =
+			GenerateSizeQueryOnMultiplePlacements(relationId, shardIntervalsOnNode,
+												  sizeQuery);
 
-	StringInfo tableSizeQuery = GenerateSizeQueryOnMultiplePlacements(relationId,
-																	  shardIntervalsOnNode,
-																	  sizeQuery);
+		connection = StartNodeConnection(connectionFlag, workerNode->workerName,
+										 workerNode->workerPort);
 
-	MultiConnection *connection = GetNodeConnection(connectionFlag, workerNodeName,
-													workerNodePort);
-	int queryResult = ExecuteOptionalRemoteCommand(connection, tableSizeQuery->data,
-												   &result);
+		connectionList = lappend(connectionList, connection);
+		sizeQueryList = lappend(sizeQueryList, tableSizeQuery->data);
+	}
 
-	if (queryResult != 0)
+	FinishConnectionListEstablishment(connectionList);
+
+	ListCell *connectionCell = NULL;
+	ListCell *sizeQueryCell = NULL;
+	forboth(connectionCell, connectionList, sizeQueryCell, sizeQueryList)
 	{
-		ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
-						errmsg("cannot get the size because of a connection error")));
+		connection = (MultiConnection *) lfirst(connectionCell);
+		char *tableSizeQuery = (char *) lfirst(sizeQueryCell);
+
+		if (PQstatus(connection->pgConn) != CONNECTION_OK ||
+			!SendRemoteCommand(connection, tableSizeQuery))
+		{
+			ReportConnectionError(connection, WARNING);
+
+			ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+							errmsg("cannot get the size because of a connection "
+								   "error")));
+		}
 	}
 
-	List *sizeList = ReadFirstColumnAsText(result);
-	StringInfo tableSizeStringInfo = (StringInfo) linitial(sizeList);
-	char *tableSizeString = tableSizeStringInfo->data;
-	uint64 tableSize = atol(tableSizeString);
+	foreach_ptr(connection, connectionList)
+	{
+		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+		if (!IsResponseOK(result))
+		{
+			ReportResultError(connection, result, WARNING);
+
+			ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+							errmsg("cannot get the size because of a connection "
+								   "error")));
+		}
+
+		List *sizeList = ReadFirstColumnAsText(result);
+		StringInfo tableSizeStringInfo = (StringInfo) linitial(sizeList);
+		char *tableSizeString = tableSizeStringInfo->data;
+		uint64 tableSize = atol(tableSizeString);
+
+		totalRelationSize += tableSize;
+
+		PQclear(result);
+		ClearResults(connection, raiseErrors);
+	}
+
+	return totalRelationSize;
+}
+
+
+/*
+ * LookupCachedTableSize sets relationSize to the size that this backend computed
+ * for the relation with the given size function, if it was computed less than
+ * citus.table_size_cache_staleness ago, and returns whether it did.
+ */
+static bool
+LookupCachedTableSize(Oid relationId, char *sizeQuery, uint64 *relationSize)
+{
+	TableSizeCacheKey key;
+	bool found = false;
+
+	if (TableSizeCacheStaleness <= 0 || TableSizeCache == NULL)
+	{
+		return false;
+	}
+
+	memset(&key, 0, sizeof(TableSizeCacheKey));
+	key.relationId = relationId;
+	strlcpy(key.sizeQuery, sizeQuery, MAX_SIZE_FUNCTION_LENGTH);
+
+	TableSizeCacheEntry *cacheEntry = hash_search(TableSizeCache, &key, HASH_FIND,
+												  &found);
+	if (!found)
+	{
+		return false;
+	}
+
+	if (TimestampDifferenceExceeds(cacheEntry->computedAt, GetCurrentTimestamp(),
+								   TableSizeCacheStaleness))
+	{
+		return false;
+	}
+
+	*relationSize = cacheEntry->relationSize;
+
+	return true;
+}
+
+
+/*
+ * StoreCachedTableSize remembers the size computed for the relation with the
+ * given size function, when citus.table_size_cache_staleness is set.
+ */
+static void
+StoreCachedTableSize(Oid relationId, char *sizeQuery, uint64 relationSize)
+{
+	TableSizeCacheKey key;
+	bool found = false;
+
+	if (TableSizeCacheStaleness <= 0)
+	{
+		return;
+	}
+
+	if (TableSizeCache == NULL)
+	{
+		HASHCTL info;
+
+		memset(&info, 0, sizeof(info));
+		info.keysize = sizeof(TableSizeCacheKey);
+		info.entrysize = sizeof(TableSizeCacheEntry);
+		info.hcxt = CacheMemoryContext;
+		uint32 hashFlags = (HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+		TableSizeCache = hash_create("citus table size cache", 32, &info, hashFlags);
+	}
 
-	PQclear(result);
-	ClearResults(connection, raiseErrors);
+	memset(&key, 0, sizeof(TableSizeCacheKey));
+	key.relationId = relationId;
+	strlcpy(key.sizeQuery, sizeQuery, MAX_SIZE_FUNCTION_LENGTH);
 
-	return tableSize;
+	TableSizeCacheEntry *cacheEntry = hash_search(TableSizeCache, &key, HASH_ENTER,
+												  &found);
+	cacheEntry->relationSize = relationSize;
+	cacheEntry->computedAt = GetCurrentTimestamp();
 }
 
 
@@ -254,10 +415,10 @@ GroupShardPlacementsForTableOnGroup(Oid relationId, int32 groupId)
 
 	for (int shardIndex = 0; shardIndex < shardIntervalArrayLength; shardIndex++)
 	{
+		int numberOfPlacements = 0;
 		GroupShardPlacement *placementArray =
-			distTableCacheEntry->arrayOfPlacementArrays[shardIndex];
-		int numberOfPlacements =
-			distTableCacheEntry->arrayOfPlacementArrayLengths[shardIndex];
+			CachedShardPlacementArray(distTableCacheEntry, shardIndex,
+									  &numberOfPlacements);
 
 		for (int placementIndex = 0; placementIndex < numberOfPlacements;
 			 placementIndex++)
@@ -291,10 +452,10 @@ ShardIntervalsOnWorkerGroup(WorkerNode *workerNode, Oid relationId)
 
 	for (int shardIndex = 0; shardIndex < shardIntervalArrayLength; shardIndex++)
 	{
+		int numberOfPlacements = 0;
 		GroupShardPlacement *placementArray =
-			distTableCacheEntry->arrayOfPlacementArrays[shardIndex];
-		int numberOfPlacements =
-			distTableCacheEntry->arrayOfPlacementArrayLengths[shardIndex];
+			CachedShardPlacementArray(distTableCacheEntry, shardIndex,
+									  &numberOfPlacements);
 
 		for (int placementIndex = 0; placementIndex < numberOfPlacements;
 			 placementIndex++)
@@ -9,6 +9,10 @@
  * one-phase or two-phase fashion, depending on the citus.multi_shard_commit_protocol
  * setting.
  *
+ * It also contains citus_batch_modify, which runs an update or delete query on
+ * each shard in batches of distribution column ranges, such that large purges
+ * do not have to lock and modify all rows in a single transaction.
+ *
  * Copyright (c) Citus Data, Inc.
  *
  *-------------------------------------------------------------------------
@@ -26,6 +30,7 @@
 #include "distributed/citus_clauses.h"
 #include "distributed/citus_ruleutils.h"
 #include "distributed/commands.h"
+#include "distributed/distributed_execution_locks.h"
 #include "distributed/listutils.h"
 #include "distributed/master_metadata_utility.h"
 #include "distributed/master_protocol.h"
@@ -33,7 +38,9 @@
 #include "distributed/metadata_sync.h"
 #include "distributed/multi_client_executor.h"
 #include "distributed/multi_executor.h"
+#include "distributed/multi_logical_planner.h"
 #include "distributed/multi_physical_planner.h"
+#include "distributed/multi_router_planner.h"
 #include "distributed/multi_server_executor.h"
 #include "distributed/distributed_planner.h"
 #include "distributed/pg_dist_shard.h"
@@ -41,9 +48,11 @@
 #include "distributed/resource_lock.h"
 #include "distributed/shardinterval_utils.h"
 #include "distributed/shard_pruning.h"
+#include "distributed/transaction_management.h"
 #include "distributed/version_compat.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/worker_transaction.h"
+#include "executor/executor.h"
 #include "optimizer/clauses.h"
 #if PG_VERSION_NUM >= 120000
 #include "optimizer/optimizer.h"
@@ -53,15 +62,51 @@
 #endif
 #include "optimizer/restrictinfo.h"
 #include "nodes/makefuncs.h"
+#include "parser/parse_oper.h"
+#include "pgstat.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
 #include "tcop/tcopprot.h"
 #include "utils/builtins.h"
 #include "utils/datum.h"
 #include "utils/inval.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
+#include "utils/typcache.h"
+
+
+/*
+ * BatchModifyShard keeps track of the progress of a batched modification on
+ * a single shard.
+ */
+typedef struct BatchModifyShard
+{
+	ShardInterval *shardInterval;
+
+	/* distribution column value up to which the shard has been modified */
+	Const *lowerBound;
+
+	/* upper bound of the current batch, NULL if it covers the rest of the shard */
+	Const *upperBound;
+
+	bool finished;
+} BatchModifyShard;
+
+
+static void ErrorIfUnsupportedBatchModify(Query *modifyQuery, Oid relationId);
+static uint64 ExecuteBatchModify(Query *modifyQuery, Oid relationId, int batchSize,
+								 int batchDelayMs);
+static void FindBatchUpperBounds(BatchModifyShard *shardArray, int shardCount,
+								 Query *modifyQuery, Var *partitionColumn,
+								 int batchSize);
+static List * BatchKeyRangeQuals(Var *partitionColumn, Const *lowerBound,
+								 Const *upperBound);
+static OpExpr * MakeColumnComparison(Var *column, Const *value, int strategyNumber);
+static void WaitForBatchDelay(int batchDelayMs);
 
 
 PG_FUNCTION_INFO_V1(master_modify_multiple_shards);
+PG_FUNCTION_INFO_V1(citus_batch_modify);
 
 
 /*
@@ -93,3 +138,510 @@ master_modify_multiple_shards(PG_FUNCTION_ARGS)
 
 	PG_RETURN_INT32(0);
 }
+
+
+/*
+ * citus_batch_modify takes in a DELETE or UPDATE query string on a distributed
+ * table and runs it on each shard in batches of at most batch_size rows, plus
+ * any rows that share the distribution column value at the end of the batch.
+ * The batches are formed by ranges of the distribution column, and one batch
+ * of each shard runs in parallel. When commit_each_batch is set, every batch
+ * commits on its own and the function cannot run in a transaction block. The
+ * function sleeps for batch_delay_ms between batches to throttle the load on
+ * the workers and their replicas.
+ *
+ * Rows that are added to an already processed range of a shard after its batch
+ * ran are not modified. The function returns the number of modified rows.
+ */
+Datum
+citus_batch_modify(PG_FUNCTION_ARGS)
+{
+	text *queryText = PG_GETARG_TEXT_P(0);
+	int batchSize = PG_GETARG_INT32(1);
+	bool commitEachBatch = PG_GETARG_BOOL(2);
+	int batchDelayMs = PG_GETARG_INT32(3);
+	char *queryString = text_to_cstring(queryText);
+	RawStmt *rawStmt = (RawStmt *) ParseTreeRawStmt(queryString);
+	Node *queryTreeNode = rawStmt->stmt;
+
+	CheckCitusVersion(ERROR);
+
+	if (!IsA(queryTreeNode, DeleteStmt) && !IsA(queryTreeNode, UpdateStmt))
+	{
+		ereport(ERROR, (errmsg("query \"%s\" is not a delete or update "
+							   "statement", ApplyLogRedaction(queryString))));
+	}
+
+	if (batchSize < 1)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("batch_size must be at least 1")));
+	}
+
+	if (batchDelayMs < 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("batch_delay_ms cannot be negative")));
+	}
+
+	if (commitEachBatch && IsMultiStatementTransaction())
+	{
+		ereport(ERROR, (errcode(ERRCODE_ACTIVE_SQL_TRANSACTION),
+						errmsg("citus_batch_modify cannot commit each batch inside "
+							   "a transaction block"),
+						errhint("Run the command outside of a transaction block or "
+								"set commit_each_batch to false.")));
+	}
+
+	List *queryTreeList = pg_analyze_and_rewrite(rawStmt, queryString, NULL, 0, NULL);
+	if (list_length(queryTreeList) != 1)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot modify in batches when the query is rewritten "
+							   "into multiple queries")));
+	}
+
+	Query *modifyQuery = (Query *) linitial(queryTreeList);
+	Oid relationId = ModifyQueryResultRelationId(modifyQuery);
+
+	EnsureModificationsCanRun();
+	ErrorIfUnsupportedBatchModify(modifyQuery, relationId);
+	ExecCheckRTPerms(modifyQuery->rtable, true);
+
+	/* evaluate stable functions once, such that all batches use the same values */
+	ExecuteMasterEvaluableFunctions(modifyQuery, NULL, false);
+
+	if (commitEachBatch)
+	{
+		/*
+		 * Use the "bare" commit protocol, such that the batch of each shard runs
+		 * without BEGIN/COMMIT and commits on its own. The old commit protocol
+		 * is restored at transaction end.
+		 */
+		Assert(SavedMultiShardCommitProtocol == COMMIT_PROTOCOL_BARE);
+		SavedMultiShardCommitProtocol = MultiShardCommitProtocol;
+		MultiShardCommitProtocol = COMMIT_PROTOCOL_BARE;
+	}
+	else
+	{
+		/*
+		 * Batches of a single shard would otherwise commit on their own, since
+		 * calling a C function does not open a transaction block on the workers.
+		 */
+		BeginOrContinueCoordinatedTransaction();
+	}
+
+	uint64 modifiedRowCount = ExecuteBatchModify(modifyQuery, relationId, batchSize,
+												 batchDelayMs);
+
+	PG_RETURN_INT64(modifiedRowCount);
+}
+
+
+/*
+ * ErrorIfUnsupportedBatchModify errors out if the given UPDATE or DELETE cannot
+ * be split into batches by ranges of the distribution column of the table.
+ */
+static void
+ErrorIfUnsupportedBatchModify(Query *modifyQuery, Oid relationId)
+{
+	if (!IsDistributedTable(relationId) ||
+		PartitionMethod(relationId) == DISTRIBUTE_BY_NONE)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot modify in batches"),
+						errdetail("Batched modifications require a distributed table "
+								  "with a distribution column.")));
+	}
+
+	if (modifyQuery->jointree->fromlist != NIL || modifyQuery->hasSubLinks ||
+		modifyQuery->cteList != NIL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot modify in batches"),
+						errdetail("Batched modifications cannot refer to other tables "
+								  "or contain subqueries.")));
+	}
+
+	if (modifyQuery->returningList != NIL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot modify in batches"),
+						errdetail("Batched modifications cannot have a RETURNING "
+								  "clause.")));
+	}
+
+	if (FindNodeCheck((Node *) modifyQuery, CitusIsVolatileFunction))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("functions used in batched modifications must not be "
+							   "VOLATILE")));
+	}
+
+	if (modifyQuery->commandType == CMD_UPDATE)
+	{
+		Var *partitionColumn = PartitionColumn(relationId, modifyQuery->resultRelation);
+		ListCell *targetEntryCell = NULL;
+
+		foreach(targetEntryCell, modifyQuery->targetList)
+		{
+			TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+
+			if (targetEntry->resno == partitionColumn->varattno)
+			{
+				ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+								errmsg("modifying the partition value of rows is not "
+									   "allowed")));
+			}
+		}
+	}
+}
+
+
+/*
+ * ExecuteBatchModify runs the given modification on the shards of the table
+ * that remain after pruning, in rounds. Each round first determines the upper
+ * bound of the next batch of every unfinished shard and then modifies the rows
+ * of all batches. The function returns the number of modified rows.
+ */
+static uint64
+ExecuteBatchModify(Query *modifyQuery, Oid relationId, int batchSize,
+				   int batchDelayMs)
+{
+	DistTableCacheEntry *cacheEntry = DistributedTableCacheEntry(relationId);
+	Index resultRelation = modifyQuery->resultRelation;
+	Var *partitionColumn = PartitionColumn(relationId, resultRelation);
+	RowModifyLevel modLevel = RowModifyLevelForQuery(modifyQuery);
+	List *whereClauseList = make_ands_implicit((Expr *) modifyQuery->jointree->quals);
+	List *shardIntervalList = PruneShards(relationId, resultRelation, whereClauseList,
+										  NULL);
+	int shardCount = list_length(shardIntervalList);
+	int remainingShardCount = shardCount;
+	ListCell *shardIntervalCell = NULL;
+	int shardIndex = 0;
+	uint64 modifiedRowCount = 0;
+
+	BatchModifyShard *shardArray = palloc0(Max(shardCount, 1) *
+										   sizeof(BatchModifyShard));
+
+	foreach(shardIntervalCell, shardIntervalList)
+	{
+		shardArray[shardIndex].shardInterval = lfirst(shardIntervalCell);
+		shardIndex++;
+	}
+
+	MemoryContext batchContext = AllocSetContextCreate(CurrentMemoryContext,
+													   "Batch Modify Context",
+													   ALLOCSET_DEFAULT_SIZES);
+
+	while (remainingShardCount > 0)
+	{
+		List *taskList = NIL;
+		uint32 taskId = 1;
+
+		MemoryContext oldContext = MemoryContextSwitchTo(batchContext);
+
+		FindBatchUpperBounds(shardArray, shardCount, modifyQuery, partitionColumn,
+							 batchSize);
+
+		for (shardIndex = 0; shardIndex < shardCount; shardIndex++)
+		{
+			BatchModifyShard *batchShard = &shardArray[shardIndex];
+			ShardInterval *shardInterval = batchShard->shardInterval;
+			uint64 shardId = shardInterval->shardId;
+			StringInfo queryString = makeStringInfo();
+
+			if (batchShard->finished)
+			{
+				continue;
+			}
+
+			Query *batchQuery = copyObject(modifyQuery);
+			List *rangeQualList = BatchKeyRangeQuals(partitionColumn,
+													 batchShard->lowerBound,
+													 batchShard->upperBound);
+			if (rangeQualList != NIL)
+			{
+				batchQuery->jointree->quals =
+					make_and_qual(batchQuery->jointree->quals,
+								  (Node *) make_ands_explicit(rangeQualList));
+			}
+
+			deparse_shard_query(batchQuery, relationId, shardId, queryString);
+
+			Task *task = CreateBasicTask(INVALID_JOB_ID, taskId, MODIFY_TASK,
+										 queryString->data);
+			task->anchorShardId = shardId;
+			task->taskPlacementList = FinalizedShardPlacementList(shardId);
+			task->replicationModel = cacheEntry->replicationModel;
+
+			taskList = lappend(taskList, task);
+			taskId++;
+		}
+
+		AcquireMetadataLocks(taskList);
+
+		modifiedRowCount += ExecuteTaskList(modLevel, taskList,
+											MaxAdaptiveExecutorPoolSize);
+
+		MemoryContextSwitchTo(oldContext);
+
+		/* move on to the next batch, the bounds need to outlive the batch context */
+		for (shardIndex = 0; shardIndex < shardCount; shardIndex++)
+		{
+			BatchModifyShard *batchShard = &shardArray[shardIndex];
+
+			if (batchShard->finished)
+			{
+				continue;
+			}
+
+			if (batchShard->upperBound == NULL)
+			{
+				batchShard->finished = true;
+				remainingShardCount--;
+			}
+			else
+			{
+				batchShard->lowerBound = copyObject(batchShard->upperBound);
+				batchShard->upperBound = NULL;
+			}
+		}
+
+		MemoryContextReset(batchContext);
+
+		if (remainingShardCount > 0 && batchDelayMs > 0)
+		{
+			WaitForBatchDelay(batchDelayMs);
+		}
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	MemoryContextDelete(batchContext);
+
+	return modifiedRowCount;
+}
+
+
+/*
+ * FindBatchUpperBounds sets the upper bound of the next batch of each
+ * unfinished shard, which is the batchSize-th distribution column value of the
+ * rows that match the modification and lie above the lower bound of the shard.
+ * If a shard has fewer matching rows left, its upper bound is left NULL and the
+ * next batch covers the rest of the shard.
+ */
+static void
+FindBatchUpperBounds(BatchModifyShard *shardArray, int shardCount, Query *modifyQuery,
+					 Var *partitionColumn, int batchSize)
+{
+	Oid columnType = partitionColumn->vartype;
+	Oid sortOperator = InvalidOid;
+	Oid equalityOperator = InvalidOid;
+	bool hashable = false;
+	List *taskList = NIL;
+	bool randomAccess = false;
+	bool interTransactions = false;
+	bool isNull = false;
+
+	get_sort_group_operators(columnType, true, true, false, &sortOperator,
+							 &equalityOperator, NULL, &hashable);
+
+	for (int shardIndex = 0; shardIndex < shardCount; shardIndex++)
+	{
+		BatchModifyShard *batchShard = &shardArray[shardIndex];
+		uint64 shardId = batchShard->shardInterval->shardId;
+		StringInfo queryString = makeStringInfo();
+
+		if (batchShard->finished)
+		{
+			continue;
+		}
+
+		/*
+		 * SELECT shardIndex, partitionColumn FROM shard WHERE <quals> AND
+		 * partitionColumn > lowerBound ORDER BY partitionColumn
+		 * OFFSET batchSize - 1 LIMIT 1
+		 */
+		Query *boundQuery = makeNode(Query);
+		boundQuery->commandType = CMD_SELECT;
+		boundQuery->querySource = QSRC_ORIGINAL;
+		boundQuery->canSetTag = true;
+		boundQuery->rtable = copyObject(modifyQuery->rtable);
+
+		Node *quals = copyObject(modifyQuery->jointree->quals);
+		List *rangeQualList = BatchKeyRangeQuals(partitionColumn,
+												 batchShard->lowerBound, NULL);
+		if (rangeQualList != NIL)
+		{
+			quals = make_and_qual(quals, (Node *) make_ands_explicit(rangeQualList));
+		}
+
+		RangeTblRef *rangeTableRef = makeNode(RangeTblRef);
+		rangeTableRef->rtindex = modifyQuery->resultRelation;
+		boundQuery->jointree = makeFromExpr(list_make1(rangeTableRef), quals);
+
+		TargetEntry *indexTargetEntry =
+			makeTargetEntry((Expr *) MakeInt4Constant(Int32GetDatum(shardIndex)), 1,
+							"shard_index", false);
+		TargetEntry *boundTargetEntry =
+			makeTargetEntry((Expr *) copyObject(partitionColumn), 2, "upper_bound",
+							false);
+		boundTargetEntry->ressortgroupref = 1;
+		boundQuery->targetList = list_make2(indexTargetEntry, boundTargetEntry);
+
+		SortGroupClause *sortClause = makeNode(SortGroupClause);
+		sortClause->tleSortGroupRef = 1;
+		sortClause->eqop = equalityOperator;
+		sortClause->sortop = sortOperator;
+		sortClause->nulls_first = false;
+		sortClause->hashable = hashable;
+		boundQuery->sortClause = list_make1(sortClause);
+
+		boundQuery->limitOffset = (Node *) makeConst(INT8OID, -1, InvalidOid,
+													 sizeof(int64),
+													 Int64GetDatum(batchSize - 1),
+													 false, FLOAT8PASSBYVAL);
+		boundQuery->limitCount = (Node *) makeConst(INT8OID, -1, InvalidOid,
+													sizeof(int64), Int64GetDatum(1),
+													false, FLOAT8PASSBYVAL);
+
+		deparse_shard_query(boundQuery, batchShard->shardInterval->relationId,
+							shardId, queryString);
+
+		Task *task = CreateBasicTask(INVALID_JOB_ID, shardIndex + 1, SELECT_TASK,
+									 queryString->data);
+		task->anchorShardId = shardId;
+		task->taskPlacementList = FinalizedShardPlacementList(shardId);
+
+		taskList = lappend(taskList, task);
+	}
+
+#if PG_VERSION_NUM >= 120000
+	TupleDesc tupleDescriptor = CreateTemplateTupleDesc(2);
+#else
+	TupleDesc tupleDescriptor = CreateTemplateTupleDesc(2, false);
+#endif
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 1, "shard_index", INT4OID, -1, 0);
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 2, "upper_bound", columnType,
+					   partitionColumn->vartypmod, 0);
+
+	Tuplestorestate *tupleStore = tuplestore_begin_heap(randomAccess,
+														interTransactions, work_mem);
+
+	ExecuteTaskListExtended(ROW_MODIFY_READONLY, taskList, tupleDescriptor,
+							tupleStore, false, MaxAdaptiveExecutorPoolSize);
+
+	int16 typeLength = 0;
+	bool typeByValue = false;
+	get_typlenbyval(columnType, &typeLength, &typeByValue);
+
+	TupleTableSlot *slot = MakeSingleTupleTableSlotCompat(tupleDescriptor,
+														  &TTSOpsMinimalTuple);
+
+	while (tuplestore_gettupleslot(tupleStore, true, false, slot))
+	{
+		int shardIndex = DatumGetInt32(slot_getattr(slot, 1, &isNull));
+		Datum upperBound = slot_getattr(slot, 2, &isNull);
+
+		Assert(shardIndex >= 0 && shardIndex < shardCount);
+
+		if (isNull)
+		{
+			continue;
+		}
+
+		shardArray[shardIndex].upperBound =
+			makeConst(columnType, partitionColumn->vartypmod,
+					  partitionColumn->varcollid, typeLength,
+					  datumCopy(upperBound, typeByValue, typeLength), false,
+					  typeByValue);
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+	tuplestore_end(tupleStore);
+}
+
+
+/*
+ * BatchKeyRangeQuals returns the list of quals that restrict the distribution
+ * column to the range above lowerBound and up to upperBound. A NULL bound
+ * leaves the range open on that side.
+ */
+static List *
+BatchKeyRangeQuals(Var *partitionColumn, Const *lowerBound, Const *upperBound)
+{
+	List *rangeQualList = NIL;
+
+	if (lowerBound != NULL)
+	{
+		OpExpr *lowerBoundExpr = MakeColumnComparison(partitionColumn, lowerBound,
+													  BTGreaterStrategyNumber);
+		rangeQualList = lappend(rangeQualList, lowerBoundExpr);
+	}
+
+	if (upperBound != NULL)
+	{
+		OpExpr *upperBoundExpr = MakeColumnComparison(partitionColumn, upperBound,
+													  BTLessEqualStrategyNumber);
+		rangeQualList = lappend(rangeQualList, upperBoundExpr);
+	}
+
+	return rangeQualList;
+}
+
+
+/*
+ * MakeColumnComparison returns "column <op> value" for the btree operator of
+ * the column type with the given strategy number.
+ */
+static OpExpr *
+MakeColumnComparison(Var *column, Const *value, int strategyNumber)
+{
+	TypeCacheEntry *typeEntry = lookup_type_cache(column->vartype,
+												  TYPECACHE_BTREE_OPFAMILY);
+	Oid operatorId = InvalidOid;
+
+	if (OidIsValid(typeEntry->btree_opf))
+	{
+		operatorId = get_opfamily_member(typeEntry->btree_opf,
+										 typeEntry->btree_opintype,
+										 typeEntry->btree_opintype, strategyNumber);
+	}
+
+	if (!OidIsValid(operatorId))
+	{
+		ereport(ERROR, (errcode(ERRCODE_UNDEFINED_FUNCTION),
+						errmsg("could not identify an ordering operator for type %s",
+							   format_type_be(column->vartype))));
+	}
+
+	OpExpr *comparisonExpr = (OpExpr *) make_opclause(operatorId, BOOLOID, false,
+													  (Expr *) copyObject(column),
+													  (Expr *) value, InvalidOid,
+													  column->varcollid);
+	comparisonExpr->opfuncid = get_opcode(operatorId);
+
+	return comparisonExpr;
+}
+
+
+/*
+ * WaitForBatchDelay sleeps for the given number of milliseconds between two
+ * batches while remaining responsive to cancellation.
+ */
+static void
+WaitForBatchDelay(int batchDelayMs)
+{
+	int rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+					   batchDelayMs, PG_WAIT_EXTENSION);
+	ResetLatch(MyLatch);
+
+	/* emergency bailout if postmaster has died */
+	if (rc & WL_POSTMASTER_DEATH)
+	{
+		proc_exit(1);
+	}
+
+	CHECK_FOR_INTERRUPTS();
+}
@@ -36,6 +36,7 @@
 #include "catalog/pg_index.h"
 #include "catalog/pg_type.h"
 #include "catalog/pg_namespace.h"
+#include "catalog/pg_sequence.h"
 #include "commands/sequence.h"
 #include "distributed/citus_ruleutils.h"
 #include "distributed/commands.h"
@@ -44,6 +45,7 @@
 #include "distributed/metadata_cache.h"
 #include "distributed/metadata_sync.h"
 #include "distributed/pg_dist_shard.h"
+#include "distributed/shared_metadata_cache.h"
 #include "distributed/worker_manager.h"
 #include "foreign/foreign.h"
 #include "lib/stringinfo.h"
@@ -53,22 +55,82 @@
 #include "utils/builtins.h"
 #include "utils/elog.h"
 #include "utils/fmgroids.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
 #include "utils/lsyscache.h"
+#include "utils/memutils.h"
 #include "utils/palloc.h"
 #include "utils/relcache.h"
 #include "utils/ruleutils.h"
+#include "utils/syscache.h"
 #include "utils/varlena.h"
 
 
+/*
+ * SequenceBlock is a range of values of a sequence that this backend reserved
+ * by a single call to nextval, and hands out without accessing the sequence.
+ */
+typedef struct SequenceBlock
+{
+	Oid sequenceId;     /* sequence from which the block was reserved */
+	int64 nextValue;    /* next value to hand out */
+	int64 lastValue;    /* last value of the block */
+} SequenceBlock;
+
+
+/* kinds of DDL command lists that are cached for tables */
+typedef enum TableDDLCommandType
+{
+	TABLE_CREATION_COMMANDS,
+	TABLE_CREATION_COMMANDS_WITH_SEQUENCE_DEFAULTS,
+	TABLE_INDEX_AND_CONSTRAINT_COMMANDS
+} TableDDLCommandType;
+
+/* hash key and entry of the table DDL command cache */
+typedef struct TableDDLCommandCacheKey
+{
+	Oid relationId;
+	TableDDLCommandType commandType;
+} TableDDLCommandCacheKey;
+
+typedef struct TableDDLCommandCacheEntry
+{
+	TableDDLCommandCacheKey key;
+	List *commandList;
+} TableDDLCommandCacheEntry;
+
+
 /* Shard related configuration */
 int ShardCount = 32;
+int ShardUnitSize = 1;          /* number of adjacent shards placed together */
 int ShardReplicationFactor = 1; /* desired replication factor for shards */
 int ShardMaxSize = 1048576;     /* maximum size in KB one shard can grow to */
 int ShardPlacementPolicy = SHARD_PLACEMENT_ROUND_ROBIN;
 int NextShardId = 0;
 int NextPlacementId = 0;
+bool EnableTableDDLCommandCache = false;
+
+/* blocks of shard and placement IDs that this backend can hand out */
+static SequenceBlock ShardIdBlock = { InvalidOid, 1, 0 };
+static SequenceBlock PlacementIdBlock = { InvalidOid, 1, 0 };
 
 static List * GetTableReplicaIdentityCommand(Oid relationId);
+static int64 NextValueFromSequenceBlock(Oid sequenceId, SequenceBlock *block);
+static List * BuildTableCreationCommands(Oid relationId, bool includeSequenceDefaults);
+static List * BuildTableIndexAndConstraintCommands(Oid relationId);
+static bool LookupTableDDLCommands(Oid relationId, TableDDLCommandType commandType,
+								   List **commandList);
+static void StoreTableDDLCommands(Oid relationId, TableDDLCommandType commandType,
+								  List *commandList);
+static void ResetTableDDLCommandCache(void);
+
+/*
+ * DDL commands of tables that this backend generated, which are valid as long
+ * as the DDL generation does not change.
+ */
+static HTAB *TableDDLCommandCache = NULL;
+static MemoryContext TableDDLCommandCacheContext = NULL;
+static uint64 TableDDLCommandCacheGeneration = 0;
 static Datum WorkerNodeGetDatum(WorkerNode *workerNode, TupleDesc tupleDescriptor);
 
 /* exports for SQL callable functions */
@@ -301,18 +363,15 @@ GetNextShardId()
 
 	text *sequenceName = cstring_to_text(SHARDID_SEQUENCE_NAME);
 	Oid sequenceId = ResolveRelationId(sequenceName, false);
-	Datum sequenceIdDatum = ObjectIdGetDatum(sequenceId);
 
 	GetUserIdAndSecContext(&savedUserId, &savedSecurityContext);
 	SetUserIdAndSecContext(CitusExtensionOwner(), SECURITY_LOCAL_USERID_CHANGE);
 
 	/* generate new and unique shardId from sequence */
-	Datum shardIdDatum = DirectFunctionCall1(nextval_oid, sequenceIdDatum);
+	shardId = NextValueFromSequenceBlock(sequenceId, &ShardIdBlock);
 
 	SetUserIdAndSecContext(savedUserId, savedSecurityContext);
 
-	shardId = DatumGetInt64(shardIdDatum);
-
 	return shardId;
 }
 
@@ -373,22 +432,86 @@ GetNextPlacementId(void)
 
 	text *sequenceName = cstring_to_text(PLACEMENTID_SEQUENCE_NAME);
 	Oid sequenceId = ResolveRelationId(sequenceName, false);
-	Datum sequenceIdDatum = ObjectIdGetDatum(sequenceId);
 
 	GetUserIdAndSecContext(&savedUserId, &savedSecurityContext);
 	SetUserIdAndSecContext(CitusExtensionOwner(), SECURITY_LOCAL_USERID_CHANGE);
 
 	/* generate new and unique placement id from sequence */
-	Datum placementIdDatum = DirectFunctionCall1(nextval_oid, sequenceIdDatum);
+	placementId = NextValueFromSequenceBlock(sequenceId, &PlacementIdBlock);
 
 	SetUserIdAndSecContext(savedUserId, savedSecurityContext);
 
-	placementId = DatumGetInt64(placementIdDatum);
-
 	return placementId;
 }
 
 
+/*
+ * NextValueFromSequenceBlock returns the next value of the given sequence,
+ * taking it from the block this backend reserved earlier if there is one.
+ *
+ * When the increment of the sequence is larger than 1, every value returned
+ * by nextval implicitly reserves the values up to the next value that nextval
+ * returns. In that case, we keep the values in between in a block that is
+ * private to this backend and hand them out without touching the sequence.
+ * Callers that use nextval directly, such as the default of a column, still
+ * get unique values. Bursts of shard creations from many sessions can thus be
+ * sped up with, for instance:
+ *
+ * ALTER SEQUENCE pg_dist_shardid_seq INCREMENT BY 64;
+ *
+ * Like values cached by a sequence, values of a block that are not used
+ * before the backend exits are never used. Since other backends may still
+ * hold blocks, lowering the increment again requires restarting the sequence
+ * beyond the last value plus the old increment.
+ */
+static int64
+NextValueFromSequenceBlock(Oid sequenceId, SequenceBlock *block)
+{
+	if (block->sequenceId == sequenceId && block->nextValue <= block->lastValue)
+	{
+		return block->nextValue++;
+	}
+
+	Datum sequenceIdDatum = ObjectIdGetDatum(sequenceId);
+	Datum valueDatum = DirectFunctionCall1(nextval_oid, sequenceIdDatum);
+	int64 value = DatumGetInt64(valueDatum);
+
+	/*
+	 * nextval holds a lock on the sequence until the end of the transaction,
+	 * which prevents the increment from changing after we call it.
+	 */
+	HeapTuple sequenceTuple = SearchSysCache1(SEQRELID, sequenceIdDatum);
+	if (!HeapTupleIsValid(sequenceTuple))
+	{
+		ereport(ERROR, (errmsg("cache lookup failed for sequence %u", sequenceId)));
+	}
+
+	Form_pg_sequence sequenceForm = (Form_pg_sequence) GETSTRUCT(sequenceTuple);
+	int64 increment = sequenceForm->seqincrement;
+	int64 maximumValue = sequenceForm->seqmax;
+
+	ReleaseSysCache(sequenceTuple);
+
+	block->sequenceId = sequenceId;
+	block->nextValue = value + 1;
+	block->lastValue = value;
+
+	if (increment > 1)
+	{
+		if (value <= maximumValue - (increment - 1))
+		{
+			block->lastValue = value + (increment - 1);
+		}
+		else
+		{
+			block->lastValue = maximumValue;
+		}
+	}
+
+	return value;
+}
+
+
 /*
  * master_get_round_robin_candidate_nodes is a stub UDF to make pg_upgrade
  * work flawlessly while upgrading servers from 6.1. This implementation
@@ -581,6 +704,34 @@ GetTableReplicaIdentityCommand(Oid relationId)
  */
 List *
 GetTableCreationCommands(Oid relationId, bool includeSequenceDefaults)
+{
+	TableDDLCommandType commandType = TABLE_CREATION_COMMANDS;
+	List *commandList = NIL;
+
+	if (includeSequenceDefaults)
+	{
+		commandType = TABLE_CREATION_COMMANDS_WITH_SEQUENCE_DEFAULTS;
+	}
+
+	if (LookupTableDDLCommands(relationId, commandType, &commandList))
+	{
+		return commandList;
+	}
+
+	commandList = BuildTableCreationCommands(relationId, includeSequenceDefaults);
+
+	StoreTableDDLCommands(relationId, commandType, commandList);
+
+	return commandList;
+}
+
+
+/*
+ * BuildTableCreationCommands generates the commands that
+ * GetTableCreationCommands returns.
+ */
+static List *
+BuildTableCreationCommands(Oid relationId, bool includeSequenceDefaults)
 {
 	List *tableDDLEventList = NIL;
 
@@ -638,6 +789,29 @@ GetTableCreationCommands(Oid relationId, bool includeSequenceDefaults)
  */
 List *
 GetTableIndexAndConstraintCommands(Oid relationId)
+{
+	TableDDLCommandType commandType = TABLE_INDEX_AND_CONSTRAINT_COMMANDS;
+	List *commandList = NIL;
+
+	if (LookupTableDDLCommands(relationId, commandType, &commandList))
+	{
+		return commandList;
+	}
+
+	commandList = BuildTableIndexAndConstraintCommands(relationId);
+
+	StoreTableDDLCommands(relationId, commandType, commandList);
+
+	return commandList;
+}
+
+
+/*
+ * BuildTableIndexAndConstraintCommands generates the commands that
+ * GetTableIndexAndConstraintCommands returns.
+ */
+static List *
+BuildTableIndexAndConstraintCommands(Oid relationId)
 {
 	List *indexDDLEventList = NIL;
 	ScanKeyData scanKey[1];
@@ -729,6 +903,136 @@ GetTableIndexAndConstraintCommands(Oid relationId)
 	return indexDDLEventList;
 }
 
+/*
+ * LookupTableDDLCommands sets commandList to a copy of the cached commands of
+ * the given kind for the given table and returns true, if the table DDL
+ * command cache is enabled and holds them.
+ *
+ * Cached commands cannot be invalidated by relcache invalidations, since
+ * those are sent for the table whenever its shards change, for instance for
+ * every new append shard. Instead, the whole cache is reset whenever the DDL
+ * generation changes, that is, whenever a DDL command runs in any backend.
+ */
+static bool
+LookupTableDDLCommands(Oid relationId, TableDDLCommandType commandType,
+					   List **commandList)
+{
+	TableDDLCommandCacheKey key;
+	bool foundInCache = false;
+	ListCell *commandCell = NULL;
+
+	if (!EnableTableDDLCommandCache)
+	{
+		return false;
+	}
+
+	uint64 ddlGeneration = CurrentDDLGeneration();
+
+	/* make sure the catalog caches reflect the changes of earlier DDL commands */
+	AcceptInvalidationMessages();
+
+	if (TableDDLCommandCache == NULL || ddlGeneration != TableDDLCommandCacheGeneration)
+	{
+		ResetTableDDLCommandCache();
+		TableDDLCommandCacheGeneration = ddlGeneration;
+
+		return false;
+	}
+
+	memset(&key, 0, sizeof(key));
+	key.relationId = relationId;
+	key.commandType = commandType;
+
+	TableDDLCommandCacheEntry *cacheEntry = hash_search(TableDDLCommandCache, &key,
+														HASH_FIND, &foundInCache);
+	if (!foundInCache)
+	{
+		return false;
+	}
+
+	/* callers may modify the list, so return a copy */
+	*commandList = NIL;
+	foreach(commandCell, cacheEntry->commandList)
+	{
+		char *command = (char *) lfirst(commandCell);
+
+		*commandList = lappend(*commandList, pstrdup(command));
+	}
+
+	return true;
+}
+
+
+/*
+ * StoreTableDDLCommands copies the given commands of the given kind for the
+ * given table into the table DDL command cache, if it is enabled.
+ */
+static void
+StoreTableDDLCommands(Oid relationId, TableDDLCommandType commandType,
+					  List *commandList)
+{
+	TableDDLCommandCacheKey key;
+	bool foundInCache = false;
+	ListCell *commandCell = NULL;
+
+	if (!EnableTableDDLCommandCache || TableDDLCommandCache == NULL)
+	{
+		return;
+	}
+
+	memset(&key, 0, sizeof(key));
+	key.relationId = relationId;
+	key.commandType = commandType;
+
+	MemoryContext oldContext = MemoryContextSwitchTo(TableDDLCommandCacheContext);
+
+	TableDDLCommandCacheEntry *cacheEntry = hash_search(TableDDLCommandCache, &key,
+														HASH_ENTER, &foundInCache);
+
+	cacheEntry->commandList = NIL;
+	foreach(commandCell, commandList)
+	{
+		char *command = (char *) lfirst(commandCell);
+
+		cacheEntry->commandList = lappend(cacheEntry->commandList, pstrdup(command));
+	}
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * ResetTableDDLCommandCache removes all entries from the table DDL command
+ * cache, creating the cache if it does not exist yet.
+ */
+static void
+ResetTableDDLCommandCache(void)
+{
+	HASHCTL info;
+
+	if (TableDDLCommandCacheContext == NULL)
+	{
+		TableDDLCommandCacheContext = AllocSetContextCreate(CacheMemoryContext,
+															"TableDDLCommandCacheContext",
+															ALLOCSET_DEFAULT_SIZES);
+	}
+	else
+	{
+		/* the hash itself lives in the memory context */
+		MemoryContextReset(TableDDLCommandCacheContext);
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(TableDDLCommandCacheKey);
+	info.entrysize = sizeof(TableDDLCommandCacheEntry);
+	info.hash = tag_hash;
+	info.hcxt = TableDDLCommandCacheContext;
+	uint32 hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+
+	TableDDLCommandCache = hash_create("citus table DDL command cache", 32, &info,
+									   hashFlags);
+}
+
 
 /*
  * ShardStorageType returns the shard storage type according to relation type.
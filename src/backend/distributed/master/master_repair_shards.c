@@ -3,7 +3,7 @@
  * master_repair_shards.c
  *
  * This file contains functions to repair unhealthy shard placements using data
- * from healthy ones.
+ * from healthy ones, and to move shard placements between nodes.
  *
  * Copyright (c) 2014-2016, Citus Data, Inc.
  *
@@ -27,7 +27,9 @@
 #include "distributed/metadata_cache.h"
 #include "distributed/metadata_sync.h"
 #include "distributed/multi_join_order.h"
+#include "distributed/multi_logical_replication.h"
 #include "distributed/multi_partitioning_utils.h"
+#include "distributed/multi_progress.h"
 #include "distributed/resource_lock.h"
 #include "distributed/worker_manager.h"
 #include "distributed/worker_protocol.h"
@@ -43,16 +45,36 @@
 #include "utils/palloc.h"
 
 
-#define TRANSFER_MODE_AUTOMATIC 'a'
-#define TRANSFER_MODE_FORCE_LOGICAL 'l'
-#define TRANSFER_MODE_BLOCK_WRITES 'b'
-
-
 /* local function forward declarations */
-static char LookupShardTransferMode(Oid shardReplicationModeOid);
 static void RepairShardPlacement(int64 shardId, char *sourceNodeName,
 								 int32 sourceNodePort, char *targetNodeName,
 								 int32 targetNodePort);
+static void MoveShardPlacement(int64 shardId, char *sourceNodeName,
+							   int32 sourceNodePort, char *targetNodeName,
+							   int32 targetNodePort, char shardReplicationMode);
+static ProgressMonitorData * StartShardPlacementProgress(CitusOperationType operationType,
+														 List *shardIntervalList,
+														 char *targetNodeName,
+														 int32 targetNodePort);
+static void EnsureShardCanBeMoved(ShardInterval *shardInterval, char *sourceNodeName,
+								  int32 sourceNodePort, char *targetNodeName,
+								  int32 targetNodePort);
+static List * CopyShardListCommandList(List *shardIntervalList, char *sourceNodeName,
+									   int32 sourceNodePort, bool includeData);
+static List * CopyShardTableCommandList(ShardInterval *shardInterval,
+										char *sourceNodeName, int32 sourceNodePort,
+										bool includeData);
+static void CopyShardListInParallel(List *shardIntervalList, char *sourceNodeName,
+									int32 sourceNodePort, char *targetNodeName,
+									int32 targetNodePort, char *tableOwner,
+									bool includeData);
+static void UpdateMovedPlacementMetadata(ShardInterval *shardInterval,
+										 char *sourceNodeName, int32 sourceNodePort,
+										 WorkerNode *targetNode,
+										 StringInfo syncedPlacementValues,
+										 StringInfo syncedPlacementIds);
+static void SyncMovedPlacementMetadata(StringInfo syncedPlacementValues,
+									   StringInfo syncedPlacementIds);
 static List * CopyPartitionShardsCommandList(ShardInterval *shardInterval,
 											 char *sourceNodeName,
 											 int32 sourceNodePort);
@@ -62,6 +84,9 @@ static void EnsureShardCanBeRepaired(int64 shardId, char *sourceNodeName,
 static List * RecreateTableDDLCommandList(Oid relationId);
 static List * WorkerApplyShardDDLCommandList(List *ddlCommandList, int64 shardId);
 
+/* config variable managed via guc.c */
+int MaxShardMoveConnections = 1;
+
 /* declarations for dynamic loading */
 PG_FUNCTION_INFO_V1(master_copy_shard_placement);
 PG_FUNCTION_INFO_V1(master_move_shard_placement);
@@ -119,14 +144,32 @@ master_copy_shard_placement(PG_FUNCTION_ARGS)
 
 /*
  * master_move_shard_placement moves given shard (and its co-located shards) from one
- * node to the other node.
+ * node to the other node, after which the placements on the source node are
+ * dropped. With logical replication, writes to the shards are only blocked
+ * while the target node catches up after the initial copy. Otherwise, writes
+ * are blocked while the data is copied.
  */
 Datum
 master_move_shard_placement(PG_FUNCTION_ARGS)
 {
-	ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-					errmsg("master_move_shard_placement() is only supported on "
-						   "Citus Enterprise")));
+	int64 shardId = PG_GETARG_INT64(0);
+	text *sourceNodeNameText = PG_GETARG_TEXT_P(1);
+	int32 sourceNodePort = PG_GETARG_INT32(2);
+	text *targetNodeNameText = PG_GETARG_TEXT_P(3);
+	int32 targetNodePort = PG_GETARG_INT32(4);
+	Oid shardReplicationModeOid = PG_GETARG_OID(5);
+	char shardReplicationMode = LookupShardTransferMode(shardReplicationModeOid);
+
+	char *sourceNodeName = text_to_cstring(sourceNodeNameText);
+	char *targetNodeName = text_to_cstring(targetNodeNameText);
+
+	EnsureCoordinator();
+	CheckCitusVersion(ERROR);
+
+	MoveShardPlacement(shardId, sourceNodeName, sourceNodePort, targetNodeName,
+					   targetNodePort, shardReplicationMode);
+
+	PG_RETURN_VOID();
 }
 
 
@@ -179,7 +222,7 @@ BlockWritesToShardList(List *shardList)
  * LookupShardTransferMode maps the oids of citus.shard_transfer_mode enum
  * values to a char.
  */
-static char
+char
 LookupShardTransferMode(Oid shardReplicationModeOid)
 {
 	char shardReplicationMode = 0;
@@ -314,9 +357,21 @@ RepairShardPlacement(int64 shardId, char *sourceNodeName, int32 sourceNodePort,
 	}
 
 	EnsureNoModificationsHaveBeenDone();
+
+	ProgressMonitorData *monitor =
+		StartShardPlacementProgress(CITUS_OPERATION_COPY_SHARD_PLACEMENT,
+									list_make1(shardInterval), targetNodeName,
+									targetNodePort);
+
 	SendCommandListToWorkerInSingleTransaction(targetNodeName, targetNodePort, tableOwner,
 											   ddlCommandList);
 
+	if (monitor != NULL)
+	{
+		SetShardOperationProgressStatus(monitor, SHARD_OPERATION_DONE);
+		FinalizeCurrentProgressMonitor();
+	}
+
 	/* after successful repair, we update shard state as healthy*/
 	List *placementList = ShardPlacementList(shardId);
 	ShardPlacement *placement = SearchShardPlacementInList(placementList, targetNodeName,
@@ -326,6 +381,510 @@ RepairShardPlacement(int64 shardId, char *sourceNodeName, int32 sourceNodePort,
 }
 
 
+/*
+ * MoveShardPlacement moves the placements of the given shard and its
+ * co-located shards from the source node to the target node.
+ *
+ * The shards are recreated on the target node in a separate transaction, like
+ * RepairShardPlacement does, after which the placement metadata is updated and
+ * the source placements are dropped as part of the current transaction. If the
+ * current transaction fails after the copy, the tables on the target node are
+ * left behind, but they are recreated when the move is retried. With
+ * citus.max_shard_move_connections above 1, the shards are copied over several
+ * connections in parallel, each in a transaction of its own.
+ *
+ * When logical replication is used, the shards are created empty and their
+ * data is replicated by LogicallyReplicateShards, which only blocks writes
+ * for the final catch up. Otherwise, writes are blocked for the whole copy.
+ */
+static void
+MoveShardPlacement(int64 shardId, char *sourceNodeName, int32 sourceNodePort,
+				   char *targetNodeName, int32 targetNodePort,
+				   char shardReplicationMode)
+{
+	ShardInterval *shardInterval = LoadShardInterval(shardId);
+	Oid distributedTableId = shardInterval->relationId;
+	ListCell *colocatedShardCell = NULL;
+
+	List *colocatedTableList = ColocatedTableList(distributedTableId);
+	ListCell *colocatedTableCell = NULL;
+
+	foreach(colocatedTableCell, colocatedTableList)
+	{
+		Oid colocatedTableId = lfirst_oid(colocatedTableCell);
+
+		/*
+		 * Prevent tables from being dropped or altered, and moves of the same
+		 * shards from running concurrently, without blocking writes.
+		 */
+		LockRelationOid(colocatedTableId, ShareUpdateExclusiveLock);
+
+		EnsureTableOwner(colocatedTableId);
+	}
+
+	/* the co-located shards are sorted by relation id, so we lock them in order */
+	List *colocatedShardList = ColocatedShardIntervalList(shardInterval);
+
+	bool useLogicalReplication = UseLogicalReplication(colocatedShardList,
+													   sourceNodeName, sourceNodePort,
+													   shardReplicationMode);
+	if (!useLogicalReplication)
+	{
+		BlockWritesToShardList(colocatedShardList);
+	}
+
+	EnsureShardCanBeMoved(shardInterval, sourceNodeName, sourceNodePort,
+						  targetNodeName, targetNodePort);
+
+	WorkerNode *targetNode = FindWorkerNode(targetNodeName, targetNodePort);
+	char *tableOwner = TableOwner(distributedTableId);
+	StringInfo syncedPlacementValues = makeStringInfo();
+	StringInfo syncedPlacementIds = makeStringInfo();
+	StringInfo droppedShardNames = makeStringInfo();
+
+	bool includeData = !useLogicalReplication;
+
+	EnsureNoModificationsHaveBeenDone();
+
+	ProgressMonitorData *monitor =
+		StartShardPlacementProgress(CITUS_OPERATION_MOVE_SHARD_PLACEMENT,
+									colocatedShardList, targetNodeName, targetNodePort);
+
+	if (MaxShardMoveConnections > 1)
+	{
+		CopyShardListInParallel(colocatedShardList, sourceNodeName, sourceNodePort,
+								targetNodeName, targetNodePort, tableOwner,
+								includeData);
+	}
+	else
+	{
+		List *copyCommandList = CopyShardListCommandList(colocatedShardList,
+														 sourceNodeName,
+														 sourceNodePort,
+														 includeData);
+
+		SendCommandListToWorkerInSingleTransaction(targetNodeName, targetNodePort,
+												   tableOwner, copyCommandList);
+	}
+
+	if (useLogicalReplication)
+	{
+		LogicallyReplicateShards(colocatedShardList, sourceNodeName, sourceNodePort,
+								 targetNodeName, targetNodePort);
+	}
+
+	if (monitor != NULL)
+	{
+		SetShardOperationProgressStatus(monitor, SHARD_OPERATION_DONE);
+		FinalizeCurrentProgressMonitor();
+	}
+
+	foreach(colocatedShardCell, colocatedShardList)
+	{
+		ShardInterval *colocatedShard = (ShardInterval *) lfirst(colocatedShardCell);
+		char *qualifiedShardName = ConstructQualifiedShardName(colocatedShard);
+
+		UpdateMovedPlacementMetadata(colocatedShard, sourceNodeName, sourceNodePort,
+									 targetNode, syncedPlacementValues,
+									 syncedPlacementIds);
+
+		/* partitions are dropped along with their parent */
+		if (PartitionTable(colocatedShard->relationId))
+		{
+			continue;
+		}
+
+		if (droppedShardNames->len > 0)
+		{
+			appendStringInfoString(droppedShardNames, ", ");
+		}
+
+		appendStringInfoString(droppedShardNames, qualifiedShardName);
+	}
+
+	/* update the metadata of all shards on the workers with a single command */
+	SyncMovedPlacementMetadata(syncedPlacementValues, syncedPlacementIds);
+
+	if (droppedShardNames->len > 0)
+	{
+		StringInfo dropShardCommand = makeStringInfo();
+
+		appendStringInfo(dropShardCommand, DROP_REGULAR_TABLE_COMMAND,
+						 droppedShardNames->data);
+
+		SendCommandToWorker(sourceNodeName, sourceNodePort, dropShardCommand->data);
+	}
+}
+
+
+/*
+ * StartShardPlacementProgress publishes the progress of copying the given
+ * shards to the target node, if citus.enable_operation_progress is enabled.
+ * The data is copied by the target node itself, so only the status of the
+ * shards is known and they are all marked as running from the start.
+ */
+static ProgressMonitorData *
+StartShardPlacementProgress(CitusOperationType operationType, List *shardIntervalList,
+							char *targetNodeName, int32 targetNodePort)
+{
+	ShardInterval *shardInterval = NULL;
+	int stepIndex = 0;
+
+	ShardInterval *firstShardInterval = (ShardInterval *) linitial(shardIntervalList);
+	ProgressMonitorData *monitor =
+		StartShardOperationProgress(operationType, firstShardInterval->relationId,
+									shardIntervalList);
+	if (monitor == NULL)
+	{
+		return NULL;
+	}
+
+	ShardOperationProgress *stepArray = (ShardOperationProgress *) monitor->steps;
+
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		ShardOperationProgress *step = &stepArray[stepIndex++];
+
+		/* co-located shards belong to different tables */
+		step->relationId = shardInterval->relationId;
+		strlcpy(step->nodeName, targetNodeName, WORKER_LENGTH);
+		step->nodePort = targetNodePort;
+		step->status = SHARD_OPERATION_RUNNING;
+	}
+
+	return monitor;
+}
+
+
+/*
+ * UseLogicalReplication returns whether the given co-located shards should be
+ * moved or split using logical replication in the given shard transfer mode.
+ * The auto mode uses logical replication when all tables have a replica
+ * identity and the source node has wal_level = logical, and falls back to
+ * blocking writes otherwise.
+ */
+bool
+UseLogicalReplication(List *shardIntervalList, char *sourceNodeName,
+					  int32 sourceNodePort, char shardReplicationMode)
+{
+	if (shardReplicationMode == TRANSFER_MODE_BLOCK_WRITES)
+	{
+		return false;
+	}
+
+	bool hasReplicaIdentity = ShardListHasReplicaIdentity(shardIntervalList);
+
+	if (shardReplicationMode == TRANSFER_MODE_FORCE_LOGICAL)
+	{
+		if (!hasReplicaIdentity)
+		{
+			ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+							errmsg("cannot use logical replication to move shards "
+								   "of tables without a replica identity"),
+							errhint("Add a primary key or a replica identity to the "
+									"tables, or use the block_writes shard transfer "
+									"mode.")));
+		}
+
+		return true;
+	}
+
+	if (!hasReplicaIdentity)
+	{
+		return false;
+	}
+
+	return NodeSupportsLogicalReplication(sourceNodeName, sourceNodePort);
+}
+
+
+/*
+ * EnsureShardCanBeMoved checks whether the co-located shards of the given
+ * shard can be moved from the source node to the target node. All of them
+ * should have a healthy placement on the source node and none of them should
+ * have a placement on the target node, which should be an active primary.
+ */
+static void
+EnsureShardCanBeMoved(ShardInterval *shardInterval, char *sourceNodeName,
+					  int32 sourceNodePort, char *targetNodeName, int32 targetNodePort)
+{
+	List *colocatedShardList = ColocatedShardIntervalList(shardInterval);
+	ListCell *colocatedShardCell = NULL;
+	bool missingSourceOk = false;
+	bool missingTargetOk = true;
+
+	if (PartitionMethod(shardInterval->relationId) == DISTRIBUTE_BY_NONE)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot move shard of a reference table"),
+						errdetail("Reference tables have a placement on every "
+								  "node.")));
+	}
+
+	WorkerNode *targetNode = FindWorkerNode(targetNodeName, targetNodePort);
+	if (targetNode == NULL || !targetNode->isActive || !NodeIsPrimary(targetNode))
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("target node %s:%d is not an active primary node",
+							   targetNodeName, targetNodePort)));
+	}
+
+	foreach(colocatedShardCell, colocatedShardList)
+	{
+		ShardInterval *colocatedShard = (ShardInterval *) lfirst(colocatedShardCell);
+		Oid relationId = colocatedShard->relationId;
+		List *shardPlacementList = ShardPlacementList(colocatedShard->shardId);
+
+		if (get_rel_relkind(relationId) == RELKIND_FOREIGN_TABLE)
+		{
+			char *relationName = get_rel_name(relationId);
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("cannot move shard"),
+							errdetail("Table %s is a foreign table. Moving "
+									  "shards backed by foreign tables is "
+									  "not supported.", relationName)));
+		}
+
+		ShardPlacement *sourcePlacement =
+			SearchShardPlacementInList(shardPlacementList, sourceNodeName,
+									   sourceNodePort, missingSourceOk);
+		if (sourcePlacement->shardState != FILE_FINALIZED)
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+							errmsg("source placement must be in finalized state")));
+		}
+
+		ShardPlacement *targetPlacement =
+			SearchShardPlacementInList(shardPlacementList, targetNodeName,
+									   targetNodePort, missingTargetOk);
+		if (targetPlacement != NULL)
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+							errmsg("shard " INT64_FORMAT " already has a placement "
+								   "on %s:%d", colocatedShard->shardId,
+								   targetNodeName, targetNodePort)));
+		}
+	}
+}
+
+
+/*
+ * CopyShardListCommandList returns the commands that recreate the given
+ * co-located shards on a node, optionally copying their data from the source
+ * node. The foreign keys are created after all shards, since they may
+ * reference each other.
+ */
+static List *
+CopyShardListCommandList(List *shardIntervalList, char *sourceNodeName,
+						 int32 sourceNodePort, bool includeData)
+{
+	List *copyCommandList = NIL;
+	List *foreignConstraintCommandList = NIL;
+	ListCell *shardIntervalCell = NULL;
+
+	foreach(shardIntervalCell, shardIntervalList)
+	{
+		ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
+
+		List *shardCommandList = CopyShardTableCommandList(shardInterval,
+														   sourceNodeName,
+														   sourceNodePort,
+														   includeData);
+		copyCommandList = list_concat(copyCommandList, shardCommandList);
+	}
+
+	foreach(shardIntervalCell, shardIntervalList)
+	{
+		ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
+
+		List *shardForeignConstraintCommandList =
+			CopyShardForeignConstraintCommandList(shardInterval);
+		foreignConstraintCommandList = list_concat(foreignConstraintCommandList,
+												   shardForeignConstraintCommandList);
+	}
+
+	return list_concat(copyCommandList, foreignConstraintCommandList);
+}
+
+
+/*
+ * CopyShardTableCommandList returns the commands that recreate the given shard,
+ * and its partitions if it is partitioned, on a node without foreign keys,
+ * optionally copying the data from the source node. Partitions are created
+ * along with their parent, so no commands are returned for them.
+ */
+static List *
+CopyShardTableCommandList(ShardInterval *shardInterval, char *sourceNodeName,
+						  int32 sourceNodePort, bool includeData)
+{
+	Oid relationId = shardInterval->relationId;
+
+	if (PartitionTable(relationId))
+	{
+		return NIL;
+	}
+
+	bool partitionedTable = PartitionedTableNoLock(relationId);
+	bool includeShardData = includeData && !partitionedTable;
+
+	List *copyCommandList = CopyShardCommandList(shardInterval, sourceNodeName,
+												 sourceNodePort, includeShardData);
+
+	/* see RepairShardPlacement for how partitioned tables are copied */
+	if (partitionedTable)
+	{
+		char *shardName = ConstructQualifiedShardName(shardInterval);
+		StringInfo copyShardDataCommand = makeStringInfo();
+
+		List *partitionCommandList =
+			CopyPartitionShardsCommandList(shardInterval, sourceNodeName,
+										   sourceNodePort);
+		copyCommandList = list_concat(copyCommandList, partitionCommandList);
+
+		if (!includeData)
+		{
+			return copyCommandList;
+		}
+
+		appendStringInfo(copyShardDataCommand, WORKER_APPEND_TABLE_TO_SHARD,
+						 quote_literal_cstr(shardName), /* table to append */
+						 quote_literal_cstr(shardName), /* remote table name */
+						 quote_literal_cstr(sourceNodeName), /* remote host */
+						 sourceNodePort); /* remote port */
+		copyCommandList = lappend(copyCommandList, copyShardDataCommand->data);
+	}
+
+	return copyCommandList;
+}
+
+
+/*
+ * CopyShardListInParallel recreates the given co-located shards on the target
+ * node, optionally copying their data from the source node, over up to
+ * citus.max_shard_move_connections connections in parallel. Each connection
+ * copies its shards in a transaction of its own. The foreign keys may
+ * reference any of the shards, so they are created once all connections are
+ * done, in a separate transaction.
+ */
+static void
+CopyShardListInParallel(List *shardIntervalList, char *sourceNodeName,
+						int32 sourceNodePort, char *targetNodeName, int32 targetNodePort,
+						char *tableOwner, bool includeData)
+{
+	List *commandListList = NIL;
+	List *foreignConstraintCommandList = NIL;
+	ShardInterval *shardInterval = NULL;
+
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		List *shardCommandList = CopyShardTableCommandList(shardInterval,
+														   sourceNodeName,
+														   sourceNodePort,
+														   includeData);
+		if (shardCommandList != NIL)
+		{
+			commandListList = lappend(commandListList, shardCommandList);
+		}
+
+		List *shardForeignConstraintCommandList =
+			CopyShardForeignConstraintCommandList(shardInterval);
+		foreignConstraintCommandList = list_concat(foreignConstraintCommandList,
+												   shardForeignConstraintCommandList);
+	}
+
+	SendCommandListsToWorkerInParallel(targetNodeName, targetNodePort, tableOwner,
+									   commandListList, MaxShardMoveConnections);
+
+	if (foreignConstraintCommandList != NIL)
+	{
+		SendCommandListToWorkerInSingleTransaction(targetNodeName, targetNodePort,
+												   tableOwner,
+												   foreignConstraintCommandList);
+	}
+}
+
+
+/*
+ * UpdateMovedPlacementMetadata replaces the placement of the given shard on
+ * the source node with a placement on the target node on the coordinator. If
+ * the metadata of the table is synced, the new placement is appended to the
+ * VALUES list in syncedPlacementValues and the old placement ID to
+ * syncedPlacementIds, which SyncMovedPlacementMetadata sends to the workers
+ * with metadata.
+ */
+static void
+UpdateMovedPlacementMetadata(ShardInterval *shardInterval, char *sourceNodeName,
+							 int32 sourceNodePort, WorkerNode *targetNode,
+							 StringInfo syncedPlacementValues,
+							 StringInfo syncedPlacementIds)
+{
+	uint64 shardId = shardInterval->shardId;
+	List *shardPlacementList = ShardPlacementList(shardId);
+	bool missingOk = false;
+
+	ShardPlacement *sourcePlacement = SearchShardPlacementInList(shardPlacementList,
+																 sourceNodeName,
+																 sourceNodePort,
+																 missingOk);
+
+	uint64 placementId = GetNextPlacementId();
+	InsertShardPlacementRow(shardId, placementId, FILE_FINALIZED,
+							sourcePlacement->shardLength, targetNode->groupId);
+	DeleteShardPlacementRow(sourcePlacement->placementId);
+
+	if (ShouldSyncTableMetadata(shardInterval->relationId))
+	{
+		if (syncedPlacementIds->len > 0)
+		{
+			appendStringInfoString(syncedPlacementValues, ", ");
+			appendStringInfoString(syncedPlacementIds, ", ");
+		}
+
+		appendStringInfo(syncedPlacementValues,
+						 "(" UINT64_FORMAT ", %d, " UINT64_FORMAT ", %d, "
+						 UINT64_FORMAT ")",
+						 shardId, FILE_FINALIZED, sourcePlacement->shardLength,
+						 targetNode->groupId, placementId);
+		appendStringInfo(syncedPlacementIds, UINT64_FORMAT,
+						 sourcePlacement->placementId);
+	}
+}
+
+
+/*
+ * SyncMovedPlacementMetadata replaces the placements of moved shards on the
+ * workers with metadata, as collected by UpdateMovedPlacementMetadata, using a
+ * single command such that the co-located shards of a move only need a single
+ * round trip to each worker.
+ */
+static void
+SyncMovedPlacementMetadata(StringInfo syncedPlacementValues,
+						   StringInfo syncedPlacementIds)
+{
+	StringInfo placementCommand = makeStringInfo();
+
+	if (syncedPlacementIds->len == 0)
+	{
+		return;
+	}
+
+	appendStringInfo(placementCommand,
+					 "WITH deleted_placements AS ("
+					 "DELETE FROM pg_dist_placement WHERE placementid IN (%s)) "
+					 "INSERT INTO pg_dist_placement "
+					 "(shardid, shardstate, shardlength, groupid, placementid) "
+					 "VALUES %s "
+					 "ON CONFLICT (placementid) DO UPDATE SET "
+					 "shardid = EXCLUDED.shardid, "
+					 "shardstate = EXCLUDED.shardstate, "
+					 "shardlength = EXCLUDED.shardlength, "
+					 "groupid = EXCLUDED.groupid",
+					 syncedPlacementIds->data, syncedPlacementValues->data);
+
+	SendCommandToWorkersWithMetadata(placementCommand->data);
+}
+
+
 /*
  * CopyPartitionShardsCommandList gets a shardInterval which is a shard that
  * belongs to partitioned table (this is asserted).
@@ -3,7 +3,18 @@
  * master_split_shards.c
  *
  * This file contains functions to split a shard according to a given
- * distribution column value.
+ * distribution column value, or into a given number of hash ranges.
+ *
+ * A hash shard is split along with its co-located shards. The new shards are
+ * created on the nodes of the old shards and filled from the old shards
+ * locally on those nodes, such that no data is sent over the network. Writes
+ * to the shards are blocked until the split commits.
+ *
+ * When a tenant is isolated and logical replication can be used, the new
+ * shards are instead filled in the background while writes continue, and the
+ * shard of the tenant can be placed on another node. Writes are then only
+ * blocked for the final catch up before the metadata of the whole co-location
+ * group is switched over to the new shards.
  *
  * Copyright (c) 2014-2017, Citus Data, Inc.
  *
@@ -13,23 +24,35 @@
 #include "postgres.h"
 #include "c.h"
 #include "fmgr.h"
+#include "miscadmin.h"
 
+#include "access/xact.h"
 #include "catalog/pg_class.h"
+#include "catalog/pg_type.h"
 #include "distributed/colocation_utils.h"
+#include "distributed/listutils.h"
+#include "distributed/master_metadata_utility.h"
 #include "distributed/master_protocol.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/metadata_sync.h"
+#include "distributed/multi_executor.h"
 #include "distributed/multi_join_order.h"
+#include "distributed/multi_logical_replication.h"
+#include "distributed/multi_partitioning_utils.h"
+#include "distributed/multi_physical_planner.h"
 #include "distributed/multi_router_planner.h"
 #include "distributed/pg_dist_partition.h"
 #include "distributed/pg_dist_shard.h"
 #include "distributed/remote_commands.h"
 #include "distributed/resource_lock.h"
+#include "distributed/shardinterval_utils.h"
 #include "distributed/worker_manager.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/worker_transaction.h"
 #include "nodes/pg_list.h"
+#include "storage/lmgr.h"
 #include "storage/lock.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/elog.h"
 #include "utils/errcodes.h"
@@ -37,21 +60,982 @@
 #include "utils/typcache.h"
 
 
+/* local function forward declarations */
+static void ErrorIfCannotSplitShard(ShardInterval *shardInterval);
+static List * SplitShardGroup(ShardInterval *shardInterval, int32 *splitMinValues,
+							  int32 *splitMaxValues, int splitCount);
+static List * NonBlockingSplitShardGroup(ShardInterval *shardInterval,
+										 int32 *splitMinValues, int32 *splitMaxValues,
+										 int splitCount, WorkerNode **splitNodes);
+static bool UseNonBlockingSplit(ShardInterval *shardInterval,
+								char shardReplicationMode);
+static WorkerNode * TenantTargetNode(char *nodeName, int32 nodePort);
+static List * InsertSplitShardMetadata(ShardInterval *shardInterval,
+									   List *placementList, WorkerNode **splitNodes,
+									   int32 *splitMinValues, int32 *splitMaxValues,
+									   int splitCount);
+static List * SplitShardNodeList(WorkerNode *sourceNode, WorkerNode **splitNodes,
+								 int splitCount);
+static List * CreateSplitShardCommandList(List *splitShardListList,
+										  WorkerNode **splitNodes, WorkerNode *node,
+										  bool createAllShards);
+static void SyncSplitShardMetadata(List *colocatedShardList, List *splitShardListList);
+static List * SplitShardCommandList(ShardInterval *shardInterval, List *splitShardList);
+static List * SplitShardForeignConstraintCommandList(List *splitShardList);
+static char * SplitShardDataCommand(ShardInterval *shardInterval,
+									ShardInterval *splitShardInterval);
+
+
 /* declarations for dynamic loading */
 PG_FUNCTION_INFO_V1(isolate_tenant_to_new_shard);
+PG_FUNCTION_INFO_V1(master_split_shard);
 PG_FUNCTION_INFO_V1(worker_hash);
 
 
 /*
  * isolate_tenant_to_new_shard isolates a tenant to its own shard by spliting
- * the current matching shard.
+ * the current matching shard into the hash ranges before, at and after the
+ * hash value of the tenant. The shards of co-located tables are split as
+ * well, which the caller has to confirm with the CASCADE option if there are
+ * any. The function returns the id of the new shard of the tenant in the
+ * given table.
+ *
+ * The shard of the tenant is placed on the given node, or on the node of the
+ * current shard if no node is given. Placing it on another node requires
+ * logical replication, which the shard transfer mode controls like it does
+ * for shard moves.
  */
 Datum
 isolate_tenant_to_new_shard(PG_FUNCTION_ARGS)
 {
-	ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-					errmsg("isolate_tenant_to_new_shard() is only supported on "
-						   "Citus Enterprise")));
+	int32 splitMinValues[3];
+	int32 splitMaxValues[3];
+	WorkerNode *splitNodes[3] = { NULL, NULL, NULL };
+	int splitCount = 0;
+	ShardInterval *tenantShardInterval = NULL;
+	WorkerNode *targetNode = NULL;
+	List *splitShardList = NIL;
+	ListCell *splitShardCell = NULL;
+
+	/* the target node is optional, the function is strict in other arguments */
+	if (PG_ARGISNULL(0) || PG_ARGISNULL(1) || PG_ARGISNULL(2) || PG_ARGISNULL(5))
+	{
+		PG_RETURN_NULL();
+	}
+
+	Oid relationId = PG_GETARG_OID(0);
+	Datum inputDatum = PG_GETARG_DATUM(1);
+	text *cascadeOptionText = PG_GETARG_TEXT_P(2);
+	Oid shardReplicationModeOid = PG_GETARG_OID(5);
+
+	EnsureCoordinator();
+	CheckCitusVersion(ERROR);
+
+	char shardReplicationMode = LookupShardTransferMode(shardReplicationModeOid);
+
+	if (PG_ARGISNULL(3) != PG_ARGISNULL(4))
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("node_name and node_port should be given together")));
+	}
+
+	if (!PG_ARGISNULL(3))
+	{
+		char *nodeName = text_to_cstring(PG_GETARG_TEXT_P(3));
+		int32 nodePort = PG_GETARG_INT32(4);
+
+		targetNode = TenantTargetNode(nodeName, nodePort);
+	}
+
+	DistTableCacheEntry *cacheEntry = DistributedTableCacheEntry(relationId);
+	char *relationName = get_rel_name(relationId);
+
+	if (cacheEntry->partitionMethod != DISTRIBUTE_BY_HASH)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot isolate tenant because tenant isolation is "
+							   "only supported for hash distributed tables")));
+	}
+
+	List *colocatedTableList = ColocatedTableList(relationId);
+	char *cascadeOption = text_to_cstring(cascadeOptionText);
+
+	if (list_length(colocatedTableList) > 1 &&
+		pg_strncasecmp(cascadeOption, "CASCADE", NAMEDATALEN) != 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("cannot isolate tenant because \"%s\" has colocated "
+							   "tables", relationName),
+						errhint("Use CASCADE option to isolate tenants for the "
+								"colocated tables too. Example usage: "
+								"isolate_tenant_to_new_shard('%s', tenant_id, "
+								"'CASCADE')", relationName)));
+	}
+
+	/* convert the tenant value to the type of the distribution column */
+	Var *distributionColumn = cacheEntry->partitionColumn;
+	Oid inputDataType = get_fn_expr_argtype(fcinfo->flinfo, 1);
+	char *tenantIdString = DatumToString(inputDatum, inputDataType);
+	Datum tenantIdDatum = StringToDatum(tenantIdString, distributionColumn->vartype);
+
+	int32 hashedValue = DatumGetInt32(FunctionCall1Coll(cacheEntry->hashFunction,
+														distributionColumn->varcollid,
+														tenantIdDatum));
+
+	ShardInterval *shardInterval = FindShardInterval(tenantIdDatum, cacheEntry);
+	if (shardInterval == NULL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+						errmsg("tenant does not have a shard")));
+	}
+
+	int32 shardMinValue = DatumGetInt32(shardInterval->minValue);
+	int32 shardMaxValue = DatumGetInt32(shardInterval->maxValue);
+
+	if (shardMinValue == shardMaxValue)
+	{
+		ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+						errmsg("table \"%s\" has already been isolated for the "
+							   "given value", relationName)));
+	}
+
+	if (shardMinValue < hashedValue)
+	{
+		splitMinValues[splitCount] = shardMinValue;
+		splitMaxValues[splitCount] = hashedValue - 1;
+		splitCount++;
+	}
+
+	int tenantSplitIndex = splitCount;
+	splitMinValues[splitCount] = hashedValue;
+	splitMaxValues[splitCount] = hashedValue;
+	splitNodes[splitCount] = targetNode;
+	splitCount++;
+
+	if (hashedValue < shardMaxValue)
+	{
+		splitMinValues[splitCount] = hashedValue + 1;
+		splitMaxValues[splitCount] = shardMaxValue;
+		splitCount++;
+	}
+
+	if (UseNonBlockingSplit(shardInterval, shardReplicationMode))
+	{
+		splitShardList = NonBlockingSplitShardGroup(shardInterval, splitMinValues,
+													splitMaxValues, splitCount,
+													splitNodes);
+	}
+	else
+	{
+		List *placementList = FinalizedShardPlacementList(shardInterval->shardId);
+
+		if (targetNode != NULL &&
+			SearchShardPlacementInList(placementList, targetNode->workerName,
+									   targetNode->workerPort, true) == NULL)
+		{
+			ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+							errmsg("cannot isolate tenant to node %s:%d without "
+								   "logical replication", targetNode->workerName,
+								   targetNode->workerPort),
+							errdetail("Isolating a tenant to another node requires "
+									  "a single shard placement, a replica "
+									  "identity on all co-located tables and "
+									  "wal_level = logical on the source node.")));
+		}
+
+		splitShardList = SplitShardGroup(shardInterval, splitMinValues,
+										 splitMaxValues, splitCount);
+	}
+
+	foreach(splitShardCell, splitShardList)
+	{
+		ShardInterval *splitShardInterval = (ShardInterval *) lfirst(splitShardCell);
+
+		if (splitShardInterval->shardIndex == tenantSplitIndex)
+		{
+			tenantShardInterval = splitShardInterval;
+		}
+	}
+
+	PG_RETURN_INT64(tenantShardInterval->shardId);
+}
+
+
+/*
+ * master_split_shard splits the given hash shard, along with its co-located
+ * shards, into the given number of shards that each cover an equal part of
+ * its hash range. The function returns the ids of the new shards that replace
+ * the given shard, in the order of their hash ranges.
+ */
+Datum
+master_split_shard(PG_FUNCTION_ARGS)
+{
+	uint64 shardId = PG_GETARG_INT64(0);
+	int32 splitCount = PG_GETARG_INT32(1);
+	ListCell *splitShardCell = NULL;
+	int splitIndex = 0;
+
+	EnsureCoordinator();
+	CheckCitusVersion(ERROR);
+
+	ShardInterval *shardInterval = LoadShardInterval(shardId);
+
+	if (PartitionMethod(shardInterval->relationId) != DISTRIBUTE_BY_HASH)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot split shard " UINT64_FORMAT, shardId),
+						errdetail("Splitting shards is only supported for hash "
+								  "distributed tables.")));
+	}
+
+	int64 shardMinValue = DatumGetInt32(shardInterval->minValue);
+	int64 shardMaxValue = DatumGetInt32(shardInterval->maxValue);
+	int64 hashTokenCount = shardMaxValue - shardMinValue + 1;
+
+	if (splitCount < 2 || splitCount > hashTokenCount)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("split count must be between 2 and the number of "
+							   "hash values of the shard, which is " INT64_FORMAT,
+							   hashTokenCount)));
+	}
+
+	int32 *splitMinValues = palloc0(splitCount * sizeof(int32));
+	int32 *splitMaxValues = palloc0(splitCount * sizeof(int32));
+	int64 hashTokenIncrement = hashTokenCount / splitCount;
+
+	/* the last shard also covers the remainder of the hash range */
+	for (splitIndex = 0; splitIndex < splitCount; splitIndex++)
+	{
+		splitMinValues[splitIndex] = (int32) (shardMinValue +
+											  splitIndex * hashTokenIncrement);
+		splitMaxValues[splitIndex] = (int32) (splitMinValues[splitIndex] +
+											  hashTokenIncrement - 1);
+	}
+
+	splitMaxValues[splitCount - 1] = (int32) shardMaxValue;
+
+	List *splitShardList = SplitShardGroup(shardInterval, splitMinValues,
+										   splitMaxValues, splitCount);
+
+	Datum *shardIdDatumArray = palloc0(splitCount * sizeof(Datum));
+
+	splitIndex = 0;
+	foreach(splitShardCell, splitShardList)
+	{
+		ShardInterval *splitShardInterval = (ShardInterval *) lfirst(splitShardCell);
+
+		shardIdDatumArray[splitIndex] = Int64GetDatum(splitShardInterval->shardId);
+		splitIndex++;
+	}
+
+	ArrayType *shardIdArray = construct_array(shardIdDatumArray, splitCount, INT8OID,
+											  sizeof(int64), FLOAT8PASSBYVAL, 'd');
+
+	PG_RETURN_ARRAYTYPE_P(shardIdArray);
+}
+
+
+/*
+ * ErrorIfCannotSplitShard errors out if the shards of the given table cannot
+ * be split.
+ */
+static void
+ErrorIfCannotSplitShard(ShardInterval *shardInterval)
+{
+	Oid relationId = shardInterval->relationId;
+	char *relationName = get_rel_name(relationId);
+
+	if (get_rel_relkind(relationId) == RELKIND_FOREIGN_TABLE)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot split shard"),
+						errdetail("Table %s is a foreign table. Splitting shards "
+								  "backed by foreign tables is not supported.",
+								  relationName)));
+	}
+
+	if (PartitionedTableNoLock(relationId) || PartitionTableNoLock(relationId))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot split shard"),
+						errdetail("Table %s is a partitioned table or a partition. "
+								  "Splitting shards of partitioned tables is not "
+								  "supported.", relationName)));
+	}
+
+	List *shardPlacementList = ShardPlacementList(shardInterval->shardId);
+	List *finalizedPlacementList = FinalizedShardPlacementList(shardInterval->shardId);
+
+	if (list_length(finalizedPlacementList) != list_length(shardPlacementList))
+	{
+		ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+						errmsg("cannot split shard " UINT64_FORMAT " because it has "
+							   "inactive placements", shardInterval->shardId),
+						errhint("Use master_copy_shard_placement to repair the "
+								"inactive placements first.")));
+	}
+}
+
+
+/*
+ * SplitShardGroup splits the given shard and its co-located shards into the
+ * given hash ranges, which should cover the hash range of the shard, and
+ * returns the new shards of the given shard's table in the order of the
+ * ranges. The shardIndex field of each of the returned shards holds the
+ * index of its range.
+ *
+ * The metadata of the old shards is replaced by that of the new shards, which
+ * get placements on the same nodes. Then a single task runs on each of those
+ * nodes to create the new shards, fill them from the old shards, create the
+ * foreign keys and drop the old shards. Since all of this happens as part of
+ * the current distributed transaction, a failed split leaves no trace.
+ */
+static List *
+SplitShardGroup(ShardInterval *shardInterval, int32 *splitMinValues,
+				int32 *splitMaxValues, int splitCount)
+{
+	List *splitShardListList = NIL;
+	List *commandList = NIL;
+	List *foreignConstraintCommandList = NIL;
+	List *returnedShardList = NIL;
+	ListCell *colocatedTableCell = NULL;
+	ListCell *colocatedShardCell = NULL;
+	ListCell *splitShardListCell = NULL;
+
+	List *colocatedTableList = ColocatedTableList(shardInterval->relationId);
+
+	foreach(colocatedTableCell, colocatedTableList)
+	{
+		Oid colocatedTableId = lfirst_oid(colocatedTableCell);
+
+		/* prevent tables from being dropped or altered, and concurrent splits */
+		LockRelationOid(colocatedTableId, ShareUpdateExclusiveLock);
+
+		EnsureTableOwner(colocatedTableId);
+	}
+
+	/* the co-located shards are sorted by relation id, so we lock them in order */
+	List *colocatedShardList = ColocatedShardIntervalList(shardInterval);
+
+	BlockWritesToShardList(colocatedShardList);
+
+	foreach(colocatedShardCell, colocatedShardList)
+	{
+		ShardInterval *colocatedShard = (ShardInterval *) lfirst(colocatedShardCell);
+
+		ErrorIfCannotSplitShard(colocatedShard);
+	}
+
+	/* co-located shards have their placements on the same nodes */
+	List *placementList = FinalizedShardPlacementList(shardInterval->shardId);
+
+	foreach(colocatedShardCell, colocatedShardList)
+	{
+		ShardInterval *colocatedShard = (ShardInterval *) lfirst(colocatedShardCell);
+
+		List *splitShardList = InsertSplitShardMetadata(colocatedShard, placementList,
+														NULL, splitMinValues,
+														splitMaxValues, splitCount);
+		splitShardListList = lappend(splitShardListList, splitShardList);
+
+		if (colocatedShard->relationId == shardInterval->relationId)
+		{
+			returnedShardList = splitShardList;
+		}
+	}
+
+	/* make the new shards visible to ShardIndex and ColocatedShardIdInRelation */
+	CommandCounterIncrement();
+
+	SyncSplitShardMetadata(colocatedShardList, splitShardListList);
+
+	forboth(colocatedShardCell, colocatedShardList, splitShardListCell,
+			splitShardListList)
+	{
+		ShardInterval *colocatedShard = (ShardInterval *) lfirst(colocatedShardCell);
+		List *splitShardList = (List *) lfirst(splitShardListCell);
+
+		List *splitCommandList = SplitShardCommandList(colocatedShard, splitShardList);
+		commandList = list_concat(commandList, splitCommandList);
+
+		foreignConstraintCommandList =
+			list_concat(foreignConstraintCommandList,
+						SplitShardForeignConstraintCommandList(splitShardList));
+	}
+
+	/* foreign keys may reference any of the new shards, so create them last */
+	commandList = list_concat(commandList, foreignConstraintCommandList);
+
+	foreach(colocatedShardCell, colocatedShardList)
+	{
+		ShardInterval *colocatedShard = (ShardInterval *) lfirst(colocatedShardCell);
+		StringInfo dropShardCommand = makeStringInfo();
+
+		appendStringInfo(dropShardCommand, DROP_REGULAR_TABLE_COMMAND,
+						 ConstructQualifiedShardName(colocatedShard));
+
+		commandList = lappend(commandList, dropShardCommand->data);
+	}
+
+	ShardInterval *firstSplitShard = (ShardInterval *) linitial(returnedShardList);
+
+	Task *task = CitusMakeNode(Task);
+	task->jobId = INVALID_JOB_ID;
+	task->taskId = 1;
+	task->taskType = DDL_TASK;
+	task->queryString = StringJoin(commandList, ';');
+	task->replicationModel = REPLICATION_MODEL_INVALID;
+	task->dependentTaskList = NIL;
+	task->anchorShardId = firstSplitShard->shardId;
+	task->taskPlacementList = placementList;
+
+	ExecuteUtilityTaskListWithoutResults(list_make1(task));
+
+	return returnedShardList;
+}
+
+
+/*
+ * NonBlockingSplitShardGroup splits the given shard and its co-located shards
+ * like SplitShardGroup, but uses logical replication to fill the new shards
+ * while writes to the old shards continue. The new shards of each hash range
+ * are placed on the corresponding node in splitNodes, or on the node of the
+ * old shards for NULL entries. The old shards should have a single placement.
+ *
+ * The new shards are created in separate transactions, so a failed split
+ * leaves them behind on the nodes, without metadata. A later attempt of the
+ * same split creates new shards with different ids and drops the replication
+ * objects of the failed attempt, as shard moves do.
+ */
+static List *
+NonBlockingSplitShardGroup(ShardInterval *shardInterval, int32 *splitMinValues,
+						   int32 *splitMaxValues, int splitCount,
+						   WorkerNode **splitNodes)
+{
+	List *splitShardListList = NIL;
+	List *returnedShardList = NIL;
+	List *taskList = NIL;
+	ListCell *colocatedTableCell = NULL;
+	ListCell *colocatedShardCell = NULL;
+	ListCell *splitShardListCell = NULL;
+	WorkerNode *node = NULL;
+	uint32 taskId = 1;
+
+	List *colocatedTableList = ColocatedTableList(shardInterval->relationId);
+
+	foreach(colocatedTableCell, colocatedTableList)
+	{
+		Oid colocatedTableId = lfirst_oid(colocatedTableCell);
+
+		/* prevent tables from being dropped or altered, and concurrent splits */
+		LockRelationOid(colocatedTableId, ShareUpdateExclusiveLock);
+
+		EnsureTableOwner(colocatedTableId);
+	}
+
+	List *colocatedShardList = ColocatedShardIntervalList(shardInterval);
+
+	foreach(colocatedShardCell, colocatedShardList)
+	{
+		ShardInterval *colocatedShard = (ShardInterval *) lfirst(colocatedShardCell);
+
+		ErrorIfCannotSplitShard(colocatedShard);
+	}
+
+	List *placementList = FinalizedShardPlacementList(shardInterval->shardId);
+	if (list_length(placementList) != 1)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot split shard " UINT64_FORMAT " using logical "
+							   "replication because it has multiple placements",
+							   shardInterval->shardId),
+						errhint("Use the block_writes shard transfer mode.")));
+	}
+
+	ShardPlacement *sourcePlacement = (ShardPlacement *) linitial(placementList);
+	WorkerNode *sourceNode = FindWorkerNode(sourcePlacement->nodeName,
+											sourcePlacement->nodePort);
+
+	/* use a single WorkerNode per node, such that nodes compare by pointer */
+	for (int splitIndex = 0; splitIndex < splitCount; splitIndex++)
+	{
+		WorkerNode *splitNode = splitNodes[splitIndex];
+
+		if (splitNode == NULL || splitNode->nodeId == sourceNode->nodeId)
+		{
+			splitNodes[splitIndex] = sourceNode;
+			continue;
+		}
+
+		for (int otherIndex = 0; otherIndex < splitIndex; otherIndex++)
+		{
+			if (splitNodes[otherIndex]->nodeId == splitNode->nodeId)
+			{
+				splitNodes[splitIndex] = splitNodes[otherIndex];
+				break;
+			}
+		}
+	}
+
+	foreach(colocatedShardCell, colocatedShardList)
+	{
+		ShardInterval *colocatedShard = (ShardInterval *) lfirst(colocatedShardCell);
+
+		List *splitShardList = InsertSplitShardMetadata(colocatedShard, placementList,
+														splitNodes, splitMinValues,
+														splitMaxValues, splitCount);
+		splitShardListList = lappend(splitShardListList, splitShardList);
+
+		if (colocatedShard->relationId == shardInterval->relationId)
+		{
+			returnedShardList = splitShardList;
+		}
+	}
+
+	/* make the new shards visible to ShardIndex and ColocatedShardIdInRelation */
+	CommandCounterIncrement();
+
+	/*
+	 * Create the new shards without foreign keys, which would slow down the
+	 * replication. The source node also gets empty stand-ins for the new
+	 * shards on other nodes, since its publications need local tables with
+	 * their names.
+	 */
+	List *splitNodeList = SplitShardNodeList(sourceNode, splitNodes, splitCount);
+	char *tableOwner = TableOwner(shardInterval->relationId);
+
+	EnsureNoModificationsHaveBeenDone();
+
+	foreach_ptr(node, splitNodeList)
+	{
+		bool createAllShards = (node == sourceNode);
+		List *createCommandList = CreateSplitShardCommandList(splitShardListList,
+															  splitNodes, node,
+															  createAllShards);
+
+		SendCommandListToWorkerInSingleTransaction(node->workerName, node->workerPort,
+												   tableOwner, createCommandList);
+	}
+
+	LogicallyReplicateSplitShards(colocatedShardList, splitShardListList, splitNodes,
+								  sourceNode);
+
+	SyncSplitShardMetadata(colocatedShardList, splitShardListList);
+
+	/*
+	 * Create the foreign keys and drop the old shards and the stand-ins as
+	 * part of the current distributed transaction, which switches over to
+	 * the new shards.
+	 */
+	foreach_ptr(node, splitNodeList)
+	{
+		List *commandList = NIL;
+		ShardInterval *anchorShard = (ShardInterval *) linitial(returnedShardList);
+
+		for (int splitIndex = 0; splitIndex < splitCount; splitIndex++)
+		{
+			if (splitNodes[splitIndex] == node)
+			{
+				anchorShard = (ShardInterval *) list_nth(returnedShardList, splitIndex);
+				break;
+			}
+		}
+
+		foreach(splitShardListCell, splitShardListList)
+		{
+			List *splitShardList = (List *) lfirst(splitShardListCell);
+			ShardInterval *splitShard = NULL;
+			int splitIndex = 0;
+
+			foreach_ptr(splitShard, splitShardList)
+			{
+				if (splitNodes[splitIndex] == node)
+				{
+					List *foreignConstraintCommandList =
+						SplitShardForeignConstraintCommandList(list_make1(splitShard));
+
+					commandList = list_concat(commandList,
+											  foreignConstraintCommandList);
+				}
+				else if (node == sourceNode)
+				{
+					StringInfo dropStandInCommand = makeStringInfo();
+
+					appendStringInfo(dropStandInCommand, DROP_REGULAR_TABLE_COMMAND,
+									 ConstructQualifiedShardName(splitShard));
+
+					commandList = lappend(commandList, dropStandInCommand->data);
+				}
+
+				splitIndex++;
+			}
+		}
+
+		if (node == sourceNode)
+		{
+			foreach(colocatedShardCell, colocatedShardList)
+			{
+				ShardInterval *colocatedShard =
+					(ShardInterval *) lfirst(colocatedShardCell);
+				StringInfo dropShardCommand = makeStringInfo();
+
+				appendStringInfo(dropShardCommand, DROP_REGULAR_TABLE_COMMAND,
+								 ConstructQualifiedShardName(colocatedShard));
+
+				commandList = lappend(commandList, dropShardCommand->data);
+			}
+		}
+
+		if (commandList == NIL)
+		{
+			continue;
+		}
+
+		Task *task = CitusMakeNode(Task);
+		task->jobId = INVALID_JOB_ID;
+		task->taskId = taskId++;
+		task->taskType = DDL_TASK;
+		task->queryString = StringJoin(commandList, ';');
+		task->replicationModel = REPLICATION_MODEL_INVALID;
+		task->dependentTaskList = NIL;
+		task->anchorShardId = anchorShard->shardId;
+
+		/* the old placement is still valid for the task on the source node */
+		if (node == sourceNode)
+		{
+			task->taskPlacementList = placementList;
+		}
+		else
+		{
+			task->taskPlacementList = FinalizedShardPlacementList(anchorShard->shardId);
+		}
+
+		taskList = lappend(taskList, task);
+	}
+
+	ExecuteUtilityTaskListWithoutResults(taskList);
+
+	return returnedShardList;
+}
+
+
+/*
+ * UseNonBlockingSplit returns whether the given shard and its co-located
+ * shards should be split using logical replication in the given shard
+ * transfer mode. Shards with multiple placements can only be split while
+ * blocking writes, and the auto mode falls back to that for them.
+ */
+static bool
+UseNonBlockingSplit(ShardInterval *shardInterval, char shardReplicationMode)
+{
+	List *placementList = FinalizedShardPlacementList(shardInterval->shardId);
+
+	if (shardReplicationMode == TRANSFER_MODE_BLOCK_WRITES)
+	{
+		return false;
+	}
+
+	if (list_length(placementList) != 1)
+	{
+		if (shardReplicationMode == TRANSFER_MODE_FORCE_LOGICAL)
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("cannot split shard " UINT64_FORMAT " using "
+								   "logical replication because it does not have "
+								   "exactly one healthy placement",
+								   shardInterval->shardId),
+							errhint("Use the block_writes shard transfer mode.")));
+		}
+
+		return false;
+	}
+
+	ShardPlacement *sourcePlacement = (ShardPlacement *) linitial(placementList);
+	List *colocatedShardList = ColocatedShardIntervalList(shardInterval);
+
+	return UseLogicalReplication(colocatedShardList, sourcePlacement->nodeName,
+								 sourcePlacement->nodePort, shardReplicationMode);
+}
+
+
+/*
+ * TenantTargetNode returns the worker node with the given name and port, and
+ * errors out if it cannot hold the shard of an isolated tenant.
+ */
+static WorkerNode *
+TenantTargetNode(char *nodeName, int32 nodePort)
+{
+	WorkerNode *targetNode = FindWorkerNode(nodeName, nodePort);
+
+	if (targetNode == NULL || !targetNode->isActive || !NodeIsPrimary(targetNode))
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("target node %s:%d is not an active primary node",
+							   nodeName, nodePort)));
+	}
+
+	return targetNode;
+}
+
+
+/*
+ * InsertSplitShardMetadata replaces the metadata of the given shard with that
+ * of new shards for each of the given hash ranges, and returns the new shards.
+ * The new shards get placements in the groups of the given placements, or in
+ * the groups of the corresponding nodes if splitNodes is given.
+ */
+static List *
+InsertSplitShardMetadata(ShardInterval *shardInterval, List *placementList,
+						 WorkerNode **splitNodes, int32 *splitMinValues,
+						 int32 *splitMaxValues, int splitCount)
+{
+	List *splitShardList = NIL;
+	ListCell *placementCell = NULL;
+	Oid relationId = shardInterval->relationId;
+
+	for (int splitIndex = 0; splitIndex < splitCount; splitIndex++)
+	{
+		ShardInterval *splitShardInterval = CitusMakeNode(ShardInterval);
+		uint64 splitShardId = GetNextShardId();
+
+		CopyShardInterval(shardInterval, splitShardInterval);
+		splitShardInterval->shardId = splitShardId;
+		splitShardInterval->minValue = Int32GetDatum(splitMinValues[splitIndex]);
+		splitShardInterval->maxValue = Int32GetDatum(splitMaxValues[splitIndex]);
+		splitShardInterval->shardIndex = splitIndex;
+
+		InsertShardRow(relationId, splitShardId, shardInterval->storageType,
+					   IntegerToText(splitMinValues[splitIndex]),
+					   IntegerToText(splitMaxValues[splitIndex]));
+
+		if (splitNodes != NULL)
+		{
+			const uint64 shardSize = 0;
+
+			InsertShardPlacementRow(splitShardId, INVALID_PLACEMENT_ID,
+									FILE_FINALIZED, shardSize,
+									splitNodes[splitIndex]->groupId);
+		}
+		else
+		{
+			foreach(placementCell, placementList)
+			{
+				ShardPlacement *placement = (ShardPlacement *) lfirst(placementCell);
+				const uint64 shardSize = 0;
+
+				InsertShardPlacementRow(splitShardId, INVALID_PLACEMENT_ID,
+										FILE_FINALIZED, shardSize,
+										placement->groupId);
+			}
+		}
+
+		splitShardList = lappend(splitShardList, splitShardInterval);
+	}
+
+	foreach(placementCell, ShardPlacementList(shardInterval->shardId))
+	{
+		ShardPlacement *placement = (ShardPlacement *) lfirst(placementCell);
+
+		DeleteShardPlacementRow(placement->placementId);
+	}
+
+	DeleteShardRow(shardInterval->shardId);
+
+	return splitShardList;
+}
+
+
+/*
+ * SplitShardNodeList returns the source node followed by the other nodes in
+ * splitNodes, without duplicates.
+ */
+static List *
+SplitShardNodeList(WorkerNode *sourceNode, WorkerNode **splitNodes, int splitCount)
+{
+	List *nodeList = list_make1(sourceNode);
+
+	for (int splitIndex = 0; splitIndex < splitCount; splitIndex++)
+	{
+		nodeList = list_append_unique_ptr(nodeList, splitNodes[splitIndex]);
+	}
+
+	return nodeList;
+}
+
+
+/*
+ * CreateSplitShardCommandList returns the commands that create the new shards
+ * that are placed on the given node, or all new shards if createAllShards is
+ * set, without their foreign keys and without data.
+ */
+static List *
+CreateSplitShardCommandList(List *splitShardListList, WorkerNode **splitNodes,
+							WorkerNode *node, bool createAllShards)
+{
+	List *commandList = NIL;
+	ListCell *splitShardListCell = NULL;
+
+	foreach(splitShardListCell, splitShardListList)
+	{
+		List *splitShardList = (List *) lfirst(splitShardListCell);
+		ShardInterval *firstSplitShard = (ShardInterval *) linitial(splitShardList);
+		ShardInterval *splitShard = NULL;
+		Oid relationId = firstSplitShard->relationId;
+		bool includeSequenceDefaults = false;
+		List *ddlCommandList = GetTableDDLEvents(relationId, includeSequenceDefaults);
+		int splitIndex = 0;
+
+		foreach_ptr(splitShard, splitShardList)
+		{
+			if (createAllShards || splitNodes[splitIndex] == node)
+			{
+				int shardIndex = ShardIndex(splitShard);
+				List *createCommandList =
+					WorkerCreateShardCommandList(relationId, shardIndex,
+												 splitShard->shardId, ddlCommandList,
+												 NIL);
+
+				commandList = list_concat(commandList, createCommandList);
+			}
+
+			splitIndex++;
+		}
+	}
+
+	return commandList;
+}
+
+
+/*
+ * SyncSplitShardMetadata replaces the metadata of the given old shards with
+ * that of the given new shards on the workers with metadata.
+ */
+static void
+SyncSplitShardMetadata(List *colocatedShardList, List *splitShardListList)
+{
+	List *commandList = NIL;
+	List *splitShardList = NIL;
+	ListCell *colocatedShardCell = NULL;
+	ListCell *splitShardListCell = NULL;
+	ListCell *commandCell = NULL;
+	ShardInterval *firstShardInterval = (ShardInterval *) linitial(colocatedShardList);
+
+	if (!ShouldSyncTableMetadata(firstShardInterval->relationId))
+	{
+		return;
+	}
+
+	foreach(colocatedShardCell, colocatedShardList)
+	{
+		ShardInterval *colocatedShard = (ShardInterval *) lfirst(colocatedShardCell);
+
+		commandList = list_concat(commandList, ShardDeleteCommandList(colocatedShard));
+	}
+
+	foreach(splitShardListCell, splitShardListList)
+	{
+		splitShardList = list_concat(splitShardList,
+									 list_copy((List *) lfirst(splitShardListCell)));
+	}
+
+	commandList = list_concat(commandList, ShardListInsertCommand(splitShardList));
+
+	foreach(commandCell, commandList)
+	{
+		char *command = (char *) lfirst(commandCell);
+
+		SendCommandToWorkersWithMetadata(command);
+	}
+}
+
+
+/*
+ * SplitShardCommandList returns the commands that create the given new shards
+ * of a table, without their foreign keys, and fill them with the rows of the
+ * given old shard that fall into their hash ranges.
+ */
+static List *
+SplitShardCommandList(ShardInterval *shardInterval, List *splitShardList)
+{
+	Oid relationId = shardInterval->relationId;
+	bool includeSequenceDefaults = false;
+	List *ddlCommandList = GetTableDDLEvents(relationId, includeSequenceDefaults);
+	List *commandList = NIL;
+	ListCell *splitShardCell = NULL;
+
+	foreach(splitShardCell, splitShardList)
+	{
+		ShardInterval *splitShardInterval = (ShardInterval *) lfirst(splitShardCell);
+		int shardIndex = ShardIndex(splitShardInterval);
+
+		List *createCommandList =
+			WorkerCreateShardCommandList(relationId, shardIndex,
+										 splitShardInterval->shardId, ddlCommandList,
+										 NIL);
+		commandList = list_concat(commandList, createCommandList);
+
+		commandList = lappend(commandList,
+							  SplitShardDataCommand(shardInterval, splitShardInterval));
+	}
+
+	return commandList;
+}
+
+
+/*
+ * SplitShardForeignConstraintCommandList returns the commands that create the
+ * foreign keys of the given new shards of a table.
+ */
+static List *
+SplitShardForeignConstraintCommandList(List *splitShardList)
+{
+	List *commandList = NIL;
+	ListCell *splitShardCell = NULL;
+
+	foreach(splitShardCell, splitShardList)
+	{
+		ShardInterval *splitShardInterval = (ShardInterval *) lfirst(splitShardCell);
+		Oid relationId = splitShardInterval->relationId;
+		int shardIndex = ShardIndex(splitShardInterval);
+		List *foreignConstraintCommandList =
+			GetTableForeignConstraintCommands(relationId);
+
+		List *constraintCommandList =
+			WorkerCreateShardCommandList(relationId, shardIndex,
+										 splitShardInterval->shardId, NIL,
+										 foreignConstraintCommandList);
+		commandList = list_concat(commandList, constraintCommandList);
+	}
+
+	return commandList;
+}
+
+
+/*
+ * SplitShardDataCommand returns the command that copies the rows of the given
+ * old shard that fall into the hash range of the given new shard, locally on
+ * the node of their placements.
+ */
+static char *
+SplitShardDataCommand(ShardInterval *shardInterval, ShardInterval *splitShardInterval)
+{
+	Oid relationId = shardInterval->relationId;
+	Var *distributionColumn = DistPartitionKey(relationId);
+	char *distributionColumnName = get_attname(relationId, distributionColumn->varattno,
+											   false);
+	StringInfo copyDataCommand = makeStringInfo();
+
+	appendStringInfo(copyDataCommand,
+					 "INSERT INTO %s SELECT * FROM %s WHERE "
+					 "pg_catalog.worker_hash(%s) BETWEEN %d AND %d",
+					 ConstructQualifiedShardName(splitShardInterval),
+					 ConstructQualifiedShardName(shardInterval),
+					 quote_identifier(distributionColumnName),
+					 DatumGetInt32(splitShardInterval->minValue),
+					 DatumGetInt32(splitShardInterval->maxValue));
+
+	return copyDataCommand->data;
 }
 
 
@@ -81,8 +1065,8 @@ worker_hash(PG_FUNCTION_ARGS)
 	fmgr_info_copy(hashFunction, &(typeEntry->hash_proc_finfo), CurrentMemoryContext);
 
 	/* calculate hash value */
-	Datum hashedValueDatum = FunctionCall1Coll(hashFunction, PG_GET_COLLATION(),
-											   valueDatum);
+	Datum hashedValueDatum = HashPartitionColumnValue(hashFunction, PG_GET_COLLATION(),
+													  valueDatum);
 
 	PG_RETURN_INT32(hashedValueDatum);
 }
@@ -22,9 +22,12 @@
 #include "access/htup_details.h"
 #include "access/xact.h"
 #include "commands/tablecmds.h"
+#include "commands/vacuum.h"
 #include "catalog/indexing.h"
 #include "catalog/namespace.h"
 #include "catalog/partition.h"
+#include "catalog/pg_collation.h"
+#include "catalog/pg_type.h"
 #include "distributed/citus_ruleutils.h"
 #include "distributed/colocation_utils.h"
 #include "distributed/commands.h"
@@ -35,6 +38,7 @@
 #include "distributed/multi_executor.h"
 #include "distributed/master_metadata_utility.h"
 #include "distributed/master_protocol.h"
+#include "distributed/metadata/shard_column_stats.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_join_order.h"
 #include "distributed/multi_partitioning_utils.h"
@@ -43,22 +47,101 @@
 #include "distributed/placement_connection.h"
 #include "distributed/relation_access_tracking.h"
 #include "distributed/remote_commands.h"
+#include "distributed/remote_transaction.h"
 #include "distributed/resource_lock.h"
 #include "distributed/transaction_management.h"
 #include "distributed/worker_manager.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/version_compat.h"
 #include "storage/lmgr.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/fmgroids.h"
 #include "utils/inval.h"
 #include "utils/lsyscache.h"
+#include "utils/memutils.h"
 #include "utils/syscache.h"
 #include "utils/rel.h"
+#include "utils/tuplestore.h"
+
+
+/*
+ * ShardAppendBatch holds the source tables that master_append_tables_to_shards
+ * appends to a single shard, and the statistics of the shard after the append.
+ */
+typedef struct ShardAppendBatch
+{
+	uint64 shardId;
+	ShardInterval *shardInterval;
+	char *shardQualifiedName;
+	List *shardPlacementList;
+	List *sourceTableNameList;
+
+	/* shard size after the append, if it could be fetched */
+	bool shardSizeKnown;
+	uint64 shardSize;
+
+	/* merged min/max values after the append, if they could be derived */
+	bool shardRangeKnown;
+	bool shardRangeExists;
+	Datum minValue;
+	Datum maxValue;
+} ShardAppendBatch;
+
+
+/*
+ * ConnectionCommandBatch holds the commands that are sent to a connection as a
+ * single multi-statement query string, such that all connections can work on
+ * their commands in parallel.
+ */
+typedef struct ConnectionCommandBatch
+{
+	MultiConnection *connection;
+	StringInfo commandString;
+	bool commandSent;
+
+	/* batches that the statements refer to, in the order of the statements */
+	List *shardAppendBatchList;
+} ConnectionCommandBatch;
+
+
+/*
+ * Shard creation tasks that CreateShardsOnWorkers collected since
+ * BeginBatchedShardCreation, which FinishBatchedShardCreation executes.
+ */
+static bool BatchingShardCreation = false;
+static bool BatchedShardCreationUsesExclusiveConnections = false;
+static List *BatchedShardCreateTaskList = NIL;
+static MemoryContext BatchedShardCreateContext = NULL;
 
 
 /* Local functions forward declarations */
 static List * RelationShardListForShardCreate(ShardInterval *shardInterval);
+static List * BatchShardCreateTasks(List *taskList, int poolSize);
+static void EnsureShardAppendable(ShardInterval *shardInterval);
+static ShardAppendBatch * FindShardAppendBatch(List *shardAppendBatchList,
+											   uint64 shardId);
+static int CompareShardAppendBatchesByShardId(const void *leftElement,
+											  const void *rightElement);
+static void AppendTablesToShardPlacements(List *shardAppendBatchList,
+										  char *sourceNodeName,
+										  uint32 sourceNodePort);
+static void UpdateShardAppendBatchStatistics(List *shardAppendBatchList,
+											 char *sourceNodeName,
+											 uint32 sourceNodePort);
+static void FetchShardAppendBatchSizes(List *shardAppendBatchList);
+static void FetchAppendedShardRanges(List *shardAppendBatchList, char *sourceNodeName,
+									 uint32 sourceNodePort);
+static void MergeAppendedShardRange(ShardAppendBatch *shardAppendBatch,
+									char *minValueString, char *maxValueString);
+static ConnectionCommandBatch * ConnectionCommandBatchForConnection(
+	List **commandBatchList, MultiConnection *connection);
+static void SendConnectionCommandBatches(List *commandBatchList);
+static void RecordShardStatistics(ShardInterval *shardInterval,
+								  List *shardPlacementList, uint64 shardSize,
+								  text *minValue, text *maxValue);
+static void UpdateShardPlacementLengths(List *shardPlacementList, uint64 shardLength);
+static void UpdateTableStatistics(Oid relationId);
 static bool WorkerShardStats(ShardPlacement *placement, Oid relationId,
 							 char *shardName, uint64 *shardSize,
 							 text **shardMinValue, text **shardMaxValue);
@@ -66,7 +149,9 @@ static bool WorkerShardStats(ShardPlacement *placement, Oid relationId,
 /* exports for SQL callable functions */
 PG_FUNCTION_INFO_V1(master_create_empty_shard);
 PG_FUNCTION_INFO_V1(master_append_table_to_shard);
+PG_FUNCTION_INFO_V1(master_append_tables_to_shards);
 PG_FUNCTION_INFO_V1(master_update_shard_statistics);
+PG_FUNCTION_INFO_V1(citus_update_table_statistics);
 
 
 /*
@@ -80,23 +165,56 @@ master_create_empty_shard(PG_FUNCTION_ARGS)
 {
 	text *relationNameText = PG_GETARG_TEXT_P(0);
 	char *relationName = text_to_cstring(relationNameText);
-	uint32 attemptableNodeCount = 0;
-	ObjectAddress tableAddress = { 0 };
-
-	uint32 candidateNodeIndex = 0;
-	List *candidateNodeList = NIL;
 	text *nullMinValue = NULL;
 	text *nullMaxValue = NULL;
-	char storageType = SHARD_STORAGE_TABLE;
 
 	Oid relationId = ResolveRelationId(relationNameText, false);
-	char relationKind = get_rel_relkind(relationId);
 
 	CheckCitusVersion(ERROR);
 
 	EnsureTablePermissions(relationId, ACL_INSERT);
 	CheckDistributedTable(relationId);
 
+	char partitionMethod = PartitionMethod(relationId);
+	if (partitionMethod == DISTRIBUTE_BY_HASH)
+	{
+		ereport(ERROR, (errmsg("relation \"%s\" is a hash partitioned table",
+							   relationName),
+						errdetail("We currently don't support creating shards "
+								  "on hash-partitioned tables")));
+	}
+	else if (partitionMethod == DISTRIBUTE_BY_NONE)
+	{
+		ereport(ERROR, (errmsg("relation \"%s\" is a reference table",
+							   relationName),
+						errdetail("We currently don't support creating shards "
+								  "on reference tables")));
+	}
+
+	uint64 shardId = CreateEmptyShardWithBounds(relationId, nullMinValue, nullMaxValue);
+
+	PG_RETURN_INT64(shardId);
+}
+
+
+/*
+ * CreateEmptyShardWithBounds creates an empty shard with the given min/max
+ * values for the given append or range distributed table, and creates its
+ * placements on the workers. The caller is expected to have checked the
+ * permissions on the table and its partition method.
+ */
+uint64
+CreateEmptyShardWithBounds(Oid relationId, text *shardMinValue, text *shardMaxValue)
+{
+	uint32 attemptableNodeCount = 0;
+	ObjectAddress tableAddress = { 0 };
+
+	uint32 candidateNodeIndex = 0;
+	List *candidateNodeList = NIL;
+	char storageType = SHARD_STORAGE_TABLE;
+
+	char relationKind = get_rel_relkind(relationId);
+
 	/*
 	 * distributed tables might have dependencies on different objects, since we create
 	 * shards for a distributed table via multiple sessions these objects will be created
@@ -132,22 +250,6 @@ master_create_empty_shard(PG_FUNCTION_ARGS)
 		}
 	}
 
-	char partitionMethod = PartitionMethod(relationId);
-	if (partitionMethod == DISTRIBUTE_BY_HASH)
-	{
-		ereport(ERROR, (errmsg("relation \"%s\" is a hash partitioned table",
-							   relationName),
-						errdetail("We currently don't support creating shards "
-								  "on hash-partitioned tables")));
-	}
-	else if (partitionMethod == DISTRIBUTE_BY_NONE)
-	{
-		ereport(ERROR, (errmsg("relation \"%s\" is a reference table",
-							   relationName),
-						errdetail("We currently don't support creating shards "
-								  "on reference tables")));
-	}
-
 	char replicationModel = TableReplicationModel(relationId);
 
 	EnsureReplicationSettings(relationId, replicationModel);
@@ -167,6 +269,12 @@ master_create_empty_shard(PG_FUNCTION_ARGS)
 		attemptableNodeCount = ShardReplicationFactor;
 	}
 
+	List *utilizationList = NIL;
+	if (ShardPlacementPolicy == SHARD_PLACEMENT_LEAST_UTILIZED)
+	{
+		utilizationList = NodeUtilizationList(workerNodeList);
+	}
+
 	/* first retrieve a list of random nodes for shard placements */
 	while (candidateNodeIndex < attemptableNodeCount)
 	{
@@ -185,6 +293,11 @@ master_create_empty_shard(PG_FUNCTION_ARGS)
 		{
 			candidateNode = WorkerGetRandomCandidateNode(candidateNodeList);
 		}
+		else if (ShardPlacementPolicy == SHARD_PLACEMENT_LEAST_UTILIZED)
+		{
+			candidateNode = WorkerGetLeastUtilizedCandidateNode(utilizationList,
+																candidateNodeList);
+		}
 		else
 		{
 			ereport(ERROR, (errmsg("unrecognized shard placement policy")));
@@ -200,12 +313,12 @@ master_create_empty_shard(PG_FUNCTION_ARGS)
 		candidateNodeIndex++;
 	}
 
-	InsertShardRow(relationId, shardId, storageType, nullMinValue, nullMaxValue);
+	InsertShardRow(relationId, shardId, storageType, shardMinValue, shardMaxValue);
 
 	CreateAppendDistributedShardPlacements(relationId, shardId, candidateNodeList,
 										   ShardReplicationFactor);
 
-	PG_RETURN_INT64(shardId);
+	return shardId;
 }
 
 
@@ -237,6 +350,202 @@ master_append_table_to_shard(PG_FUNCTION_ARGS)
 	ShardInterval *shardInterval = LoadShardInterval(shardId);
 	Oid relationId = shardInterval->relationId;
 
+	EnsureShardAppendable(shardInterval);
+
+	/* ensure that the shard placement metadata does not change during the append */
+	LockShardDistributionMetadata(shardId, ShareLock);
+
+	/* serialize appends to the same shard */
+	LockShardResource(shardId, ExclusiveLock);
+
+	/* get schame name of the target shard */
+	Oid shardSchemaOid = get_rel_namespace(relationId);
+	char *shardSchemaName = get_namespace_name(shardSchemaOid);
+
+	/* Build shard table name. */
+	char *shardTableName = get_rel_name(relationId);
+	AppendShardIdToName(&shardTableName, shardId);
+
+	char *shardQualifiedName = quote_qualified_identifier(shardSchemaName,
+														  shardTableName);
+
+	List *shardPlacementList = FinalizedShardPlacementList(shardId);
+	if (shardPlacementList == NIL)
+	{
+		ereport(ERROR, (errmsg("could not find any shard placements for shardId "
+							   UINT64_FORMAT, shardId),
+						errhint("Try running master_create_empty_shard() first")));
+	}
+
+	BeginOrContinueCoordinatedTransaction();
+
+	/* issue command to append table to each shard placement */
+	foreach(shardPlacementCell, shardPlacementList)
+	{
+		ShardPlacement *shardPlacement = (ShardPlacement *) lfirst(shardPlacementCell);
+		MultiConnection *connection = GetPlacementConnection(FOR_DML, shardPlacement,
+															 NULL);
+		PGresult *queryResult = NULL;
+
+		StringInfo workerAppendQuery = makeStringInfo();
+		appendStringInfo(workerAppendQuery, WORKER_APPEND_TABLE_TO_SHARD,
+						 quote_literal_cstr(shardQualifiedName),
+						 quote_literal_cstr(sourceTableName),
+						 quote_literal_cstr(sourceNodeName), sourceNodePort);
+
+		RemoteTransactionBeginIfNecessary(connection);
+
+		int executeResult = ExecuteOptionalRemoteCommand(connection,
+														 workerAppendQuery->data,
+														 &queryResult);
+		PQclear(queryResult);
+		ForgetResults(connection);
+
+		if (executeResult != 0)
+		{
+			MarkRemoteTransactionFailed(connection, false);
+		}
+	}
+
+	MarkFailedShardPlacements();
+
+	/* update shard statistics and get new shard size */
+	uint64 newShardSize = UpdateShardStatistics(shardId);
+
+	/* calculate ratio of current shard size compared to shard max size */
+	uint64 shardMaxSizeInBytes = (int64) ShardMaxSize * 1024L;
+	shardFillLevel = ((float4) newShardSize / (float4) shardMaxSizeInBytes);
+
+	PG_RETURN_FLOAT4(shardFillLevel);
+}
+
+
+/*
+ * master_append_tables_to_shards appends each of the given source tables to
+ * the shard at the same position of the shard id array, and returns the fill
+ * levels of the shards in the same order. Unlike calling
+ * master_append_table_to_shard once per table, all appends that go to the same
+ * worker are sent in a single round trip, and the workers process them in
+ * parallel. A shard may appear more than once to stage several tables into it.
+ *
+ * Shard statistics are only updated once per shard at the end. The new min/max
+ * values of append distributed shards are derived by merging the ranges of the
+ * (typically small) source tables into the current ranges of the shards, which
+ * avoids rescanning the shards. If a shard's current range is unknown or the
+ * source tables cannot be queried, we fall back to UpdateShardStatistics().
+ */
+Datum
+master_append_tables_to_shards(PG_FUNCTION_ARGS)
+{
+	ArrayType *shardIdArrayObject = PG_GETARG_ARRAYTYPE_P(0);
+	ArrayType *sourceTableNameArrayObject = PG_GETARG_ARRAYTYPE_P(1);
+	text *sourceNodeNameText = PG_GETARG_TEXT_P(2);
+	uint32 sourceNodePort = PG_GETARG_UINT32(3);
+
+	char *sourceNodeName = text_to_cstring(sourceNodeNameText);
+	List *shardAppendBatchList = NIL;
+	ShardAppendBatch *shardAppendBatch = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	int appendCount = ArrayObjectCount(shardIdArrayObject);
+	if (appendCount != ArrayObjectCount(sourceTableNameArrayObject))
+	{
+		ereport(ERROR, (errmsg("expected the same number of shard ids and source "
+							   "table names")));
+	}
+
+	Datum *shardIdDatumArray = DeconstructArrayObject(shardIdArrayObject);
+	Datum *sourceTableNameDatumArray = DeconstructArrayObject(sourceTableNameArrayObject);
+	ShardAppendBatch **appendBatchArray = palloc0(Max(appendCount, 1) *
+												  sizeof(ShardAppendBatch *));
+
+	for (int appendIndex = 0; appendIndex < appendCount; appendIndex++)
+	{
+		uint64 shardId = DatumGetInt64(shardIdDatumArray[appendIndex]);
+		char *sourceTableName =
+			TextDatumGetCString(sourceTableNameDatumArray[appendIndex]);
+
+		shardAppendBatch = FindShardAppendBatch(shardAppendBatchList, shardId);
+		if (shardAppendBatch == NULL)
+		{
+			shardAppendBatch = palloc0(sizeof(ShardAppendBatch));
+			shardAppendBatch->shardId = shardId;
+			shardAppendBatch->shardInterval = LoadShardInterval(shardId);
+
+			EnsureShardAppendable(shardAppendBatch->shardInterval);
+
+			shardAppendBatchList = lappend(shardAppendBatchList, shardAppendBatch);
+		}
+
+		shardAppendBatch->sourceTableNameList =
+			lappend(shardAppendBatch->sourceTableNameList, sourceTableName);
+		appendBatchArray[appendIndex] = shardAppendBatch;
+	}
+
+	/* lock the shards in a consistent order to avoid deadlocking other batches */
+	shardAppendBatchList = SortList(shardAppendBatchList,
+									CompareShardAppendBatchesByShardId);
+
+	foreach_ptr(shardAppendBatch, shardAppendBatchList)
+	{
+		uint64 shardId = shardAppendBatch->shardId;
+
+		/* ensure that the shard placement metadata does not change during the append */
+		LockShardDistributionMetadata(shardId, ShareLock);
+
+		/* serialize appends to the same shard */
+		LockShardResource(shardId, ExclusiveLock);
+
+		shardAppendBatch->shardQualifiedName =
+			ConstructQualifiedShardName(shardAppendBatch->shardInterval);
+		shardAppendBatch->shardPlacementList = FinalizedShardPlacementList(shardId);
+		if (shardAppendBatch->shardPlacementList == NIL)
+		{
+			ereport(ERROR, (errmsg("could not find any shard placements for shardId "
+								   UINT64_FORMAT, shardId),
+							errhint("Try running master_create_empty_shard() first")));
+		}
+	}
+
+	BeginOrContinueCoordinatedTransaction();
+
+	AppendTablesToShardPlacements(shardAppendBatchList, sourceNodeName, sourceNodePort);
+
+	MarkFailedShardPlacements();
+
+	UpdateShardAppendBatchStatistics(shardAppendBatchList, sourceNodeName,
+									 sourceNodePort);
+
+	/* calculate ratio of current shard sizes compared to shard max size */
+	uint64 shardMaxSizeInBytes = (int64) ShardMaxSize * 1024L;
+	Datum *shardFillLevelDatumArray = palloc0(Max(appendCount, 1) * sizeof(Datum));
+
+	for (int appendIndex = 0; appendIndex < appendCount; appendIndex++)
+	{
+		uint64 shardSize = appendBatchArray[appendIndex]->shardSize;
+		float4 shardFillLevel = ((float4) shardSize / (float4) shardMaxSizeInBytes);
+
+		shardFillLevelDatumArray[appendIndex] = Float4GetDatum(shardFillLevel);
+	}
+
+	ArrayType *shardFillLevelArray = DatumArrayToArrayType(shardFillLevelDatumArray,
+														   appendCount, FLOAT4OID);
+
+	PG_RETURN_ARRAYTYPE_P(shardFillLevelArray);
+}
+
+
+/*
+ * EnsureShardAppendable locks the distributed table of the given shard against
+ * being dropped, and errors out if the current user cannot append to the shard.
+ */
+static void
+EnsureShardAppendable(ShardInterval *shardInterval)
+{
+	uint64 shardId = shardInterval->shardId;
+	Oid relationId = shardInterval->relationId;
+
 	/* don't allow the table to be dropped */
 	LockRelationOid(relationId, AccessShareLock);
 
@@ -254,76 +563,477 @@ master_append_table_to_shard(PG_FUNCTION_ARGS)
 	char partitionMethod = PartitionMethod(relationId);
 	if (partitionMethod == DISTRIBUTE_BY_HASH || partitionMethod == DISTRIBUTE_BY_NONE)
 	{
-		ereport(ERROR, (errmsg("cannot append to shardId " UINT64_FORMAT, shardId),
-						errdetail("We currently don't support appending to shards "
-								  "in hash-partitioned or reference tables")));
+		ereport(ERROR, (errmsg("cannot append to shardId " UINT64_FORMAT, shardId),
+						errdetail("We currently don't support appending to shards "
+								  "in hash-partitioned or reference tables")));
+	}
+}
+
+
+/*
+ * FindShardAppendBatch returns the batch of the given shard in the list, or
+ * NULL if there is none.
+ */
+static ShardAppendBatch *
+FindShardAppendBatch(List *shardAppendBatchList, uint64 shardId)
+{
+	ShardAppendBatch *shardAppendBatch = NULL;
+
+	foreach_ptr(shardAppendBatch, shardAppendBatchList)
+	{
+		if (shardAppendBatch->shardId == shardId)
+		{
+			return shardAppendBatch;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * CompareShardAppendBatchesByShardId is a comparator for sorting shard append
+ * batches by their shard ids.
+ */
+static int
+CompareShardAppendBatchesByShardId(const void *leftElement, const void *rightElement)
+{
+	ShardAppendBatch *leftBatch = *((ShardAppendBatch **) leftElement);
+	ShardAppendBatch *rightBatch = *((ShardAppendBatch **) rightElement);
+
+	if (leftBatch->shardId > rightBatch->shardId)
+	{
+		return 1;
+	}
+	else if (leftBatch->shardId < rightBatch->shardId)
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * AppendTablesToShardPlacements appends the source tables of each batch to all
+ * placements of its shard. The append commands for a connection are combined
+ * into a single query string, and all connections are sent their commands
+ * before waiting for any of them. Connections on which an append fails have
+ * their transaction marked as failed, such that MarkFailedShardPlacements()
+ * marks the placements invalid afterwards.
+ */
+static void
+AppendTablesToShardPlacements(List *shardAppendBatchList, char *sourceNodeName,
+							  uint32 sourceNodePort)
+{
+	List *commandBatchList = NIL;
+	ShardAppendBatch *shardAppendBatch = NULL;
+	ConnectionCommandBatch *commandBatch = NULL;
+
+	foreach_ptr(shardAppendBatch, shardAppendBatchList)
+	{
+		char *quotedShardName = quote_literal_cstr(shardAppendBatch->shardQualifiedName);
+		ShardPlacement *shardPlacement = NULL;
+
+		foreach_ptr(shardPlacement, shardAppendBatch->shardPlacementList)
+		{
+			MultiConnection *connection = GetPlacementConnection(FOR_DML,
+																 shardPlacement,
+																 NULL);
+			char *sourceTableName = NULL;
+
+			commandBatch = ConnectionCommandBatchForConnection(&commandBatchList,
+															   connection);
+
+			foreach_ptr(sourceTableName, shardAppendBatch->sourceTableNameList)
+			{
+				appendStringInfo(commandBatch->commandString,
+								 WORKER_APPEND_TABLE_TO_SHARD ";", quotedShardName,
+								 quote_literal_cstr(sourceTableName),
+								 quote_literal_cstr(sourceNodeName), sourceNodePort);
+			}
+		}
+	}
+
+	SendConnectionCommandBatches(commandBatchList);
+
+	foreach_ptr(commandBatch, commandBatchList)
+	{
+		MultiConnection *connection = commandBatch->connection;
+		bool raiseInterrupts = true;
+		bool commandFailed = false;
+
+		if (!commandBatch->commandSent)
+		{
+			MarkRemoteTransactionFailed(connection, false);
+			continue;
+		}
+
+		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+		while (result != NULL)
+		{
+			if (!IsResponseOK(result))
+			{
+				ReportResultError(connection, result, WARNING);
+				commandFailed = true;
+			}
+
+			PQclear(result);
+			result = GetRemoteCommandResult(connection, raiseInterrupts);
+		}
+
+		if (commandFailed)
+		{
+			MarkRemoteTransactionFailed(connection, false);
+		}
+	}
+}
+
+
+/*
+ * UpdateShardAppendBatchStatistics records the size and min/max values of the
+ * shards that data got appended to in the metadata. Shards for which we could
+ * not fetch the size or derive the new range get their statistics from the
+ * placements via UpdateShardStatistics() instead.
+ */
+static void
+UpdateShardAppendBatchStatistics(List *shardAppendBatchList, char *sourceNodeName,
+								 uint32 sourceNodePort)
+{
+	ShardAppendBatch *shardAppendBatch = NULL;
+
+	/* the appends might have marked some of the placements invalid */
+	foreach_ptr(shardAppendBatch, shardAppendBatchList)
+	{
+		shardAppendBatch->shardPlacementList =
+			FinalizedShardPlacementList(shardAppendBatch->shardId);
+	}
+
+	FetchShardAppendBatchSizes(shardAppendBatchList);
+	FetchAppendedShardRanges(shardAppendBatchList, sourceNodeName, sourceNodePort);
+
+	foreach_ptr(shardAppendBatch, shardAppendBatchList)
+	{
+		ShardInterval *shardInterval = shardAppendBatch->shardInterval;
+		text *minValue = NULL;
+		text *maxValue = NULL;
+
+		if (!shardAppendBatch->shardSizeKnown || !shardAppendBatch->shardRangeKnown)
+		{
+			shardAppendBatch->shardSize = UpdateShardStatistics(shardAppendBatch->shardId);
+			continue;
+		}
+
+		if (shardAppendBatch->shardRangeExists)
+		{
+			Oid valueTypeId = shardInterval->valueTypeId;
+
+			minValue = cstring_to_text(DatumToString(shardAppendBatch->minValue,
+													 valueTypeId));
+			maxValue = cstring_to_text(DatumToString(shardAppendBatch->maxValue,
+													 valueTypeId));
+		}
+
+		RecordShardStatistics(shardInterval, shardAppendBatch->shardPlacementList,
+							  shardAppendBatch->shardSize, minValue, maxValue);
+	}
+}
+
+
+/*
+ * FetchShardAppendBatchSizes fetches the sizes of the shards in the given
+ * batches from one placement each, sending a single query string per worker.
+ */
+static void
+FetchShardAppendBatchSizes(List *shardAppendBatchList)
+{
+	List *commandBatchList = NIL;
+	ShardAppendBatch *shardAppendBatch = NULL;
+	ConnectionCommandBatch *commandBatch = NULL;
+
+	foreach_ptr(shardAppendBatch, shardAppendBatchList)
+	{
+		ShardPlacement *placement = linitial(shardAppendBatch->shardPlacementList);
+		char *quotedShardName = quote_literal_cstr(shardAppendBatch->shardQualifiedName);
+		int connectionFlags = 0;
+
+		MultiConnection *connection = GetPlacementConnection(connectionFlags, placement,
+															 NULL);
+
+		commandBatch = ConnectionCommandBatchForConnection(&commandBatchList,
+														   connection);
+
+		if (CStoreTable(shardAppendBatch->shardInterval->relationId))
+		{
+			appendStringInfo(commandBatch->commandString,
+							 SHARD_CSTORE_TABLE_SIZE_QUERY ";", quotedShardName);
+		}
+		else
+		{
+			appendStringInfo(commandBatch->commandString, SHARD_TABLE_SIZE_QUERY ";",
+							 quotedShardName);
+		}
+
+		commandBatch->shardAppendBatchList =
+			lappend(commandBatch->shardAppendBatchList, shardAppendBatch);
+	}
+
+	SendConnectionCommandBatches(commandBatchList);
+
+	foreach_ptr(commandBatch, commandBatchList)
+	{
+		MultiConnection *connection = commandBatch->connection;
+		ListCell *shardAppendBatchCell = list_head(commandBatch->shardAppendBatchList);
+		bool raiseInterrupts = true;
+
+		if (!commandBatch->commandSent)
+		{
+			continue;
+		}
+
+		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+		while (result != NULL)
+		{
+			if (!IsResponseOK(result))
+			{
+				ReportResultError(connection, result, WARNING);
+			}
+			else if (shardAppendBatchCell != NULL && PQntuples(result) == 1 &&
+					 !PQgetisnull(result, 0, 0))
+			{
+				char *tableSizeString = PQgetvalue(result, 0, 0);
+				char *tableSizeStringEnd = NULL;
+
+				shardAppendBatch = (ShardAppendBatch *) lfirst(shardAppendBatchCell);
+
+				errno = 0;
+				uint64 tableSize = pg_strtouint64(tableSizeString, &tableSizeStringEnd, 0);
+				if (errno == 0 && (*tableSizeStringEnd) == '\0')
+				{
+					shardAppendBatch->shardSize = tableSize;
+					shardAppendBatch->shardSizeKnown = true;
+				}
+			}
+
+			if (shardAppendBatchCell != NULL)
+			{
+				shardAppendBatchCell = lnext(shardAppendBatchCell);
+			}
+
+			PQclear(result);
+			result = GetRemoteCommandResult(connection, raiseInterrupts);
+		}
+	}
+}
+
+
+/*
+ * FetchAppendedShardRanges derives the min/max values of append distributed
+ * shards after the append by merging the ranges of the source tables into the
+ * current shard ranges. The ranges of all source tables are fetched from the
+ * source node with a single query. Shards of range distributed tables keep
+ * their ranges, and shards that have data but no range cannot be merged into
+ * and are left for UpdateShardStatistics() to rescan.
+ */
+static void
+FetchAppendedShardRanges(List *shardAppendBatchList, char *sourceNodeName,
+						 uint32 sourceNodePort)
+{
+	StringInfo rangeQuery = makeStringInfo();
+	List *rangeBatchList = NIL;
+	ShardAppendBatch *shardAppendBatch = NULL;
+	PGresult *queryResult = NULL;
+	const uint32 unusedTableId = 1;
+	int connectionFlags = 0;
+
+	foreach_ptr(shardAppendBatch, shardAppendBatchList)
+	{
+		ShardInterval *shardInterval = shardAppendBatch->shardInterval;
+		Oid relationId = shardInterval->relationId;
+		ShardPlacement *placement = linitial(shardAppendBatch->shardPlacementList);
+		char *sourceTableName = NULL;
+
+		if (PartitionMethod(relationId) != DISTRIBUTE_BY_APPEND)
+		{
+			/* we don't need min/max for non-append distributed tables */
+			shardAppendBatch->shardRangeKnown = true;
+			continue;
+		}
+
+		if (shardInterval->minValueExists && shardInterval->maxValueExists)
+		{
+			shardAppendBatch->shardRangeExists = true;
+			shardAppendBatch->minValue = shardInterval->minValue;
+			shardAppendBatch->maxValue = shardInterval->maxValue;
+		}
+		else if (placement->shardLength > 0)
+		{
+			/* the shard has data, but we don't know its range */
+			continue;
+		}
+
+		Var *partitionColumn = PartitionColumn(relationId, unusedTableId);
+		char *partitionColumnName = get_attname(relationId, partitionColumn->varattno,
+												false);
+		const char *quotedColumnName = quote_identifier(partitionColumnName);
+
+		foreach_ptr(sourceTableName, shardAppendBatch->sourceTableNameList)
+		{
+			if (rangeQuery->len > 0)
+			{
+				appendStringInfoString(rangeQuery, " UNION ALL ");
+			}
+
+			appendStringInfo(rangeQuery, "SELECT %d, min(%s)::text, max(%s)::text "
+										 "FROM %s", list_length(rangeBatchList),
+							 quotedColumnName, quotedColumnName, sourceTableName);
+		}
+
+		rangeBatchList = lappend(rangeBatchList, shardAppendBatch);
+	}
+
+	if (rangeBatchList == NIL)
+	{
+		return;
+	}
+
+	MultiConnection *connection = GetNodeConnection(connectionFlags, sourceNodeName,
+													sourceNodePort);
+
+	int executeResult = ExecuteOptionalRemoteCommand(connection, rangeQuery->data,
+													 &queryResult);
+	if (executeResult != 0)
+	{
+		/* leave the ranges unknown, such that the shards get rescanned */
+		return;
+	}
+
+	int rowCount = PQntuples(queryResult);
+	for (int rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		int batchIndex = pg_atoi(PQgetvalue(queryResult, rowIndex, 0), sizeof(int32), 0);
+
+		/* empty source tables and NULL values don't change the range */
+		if (PQgetisnull(queryResult, rowIndex, 1) || PQgetisnull(queryResult, rowIndex, 2))
+		{
+			continue;
+		}
+
+		shardAppendBatch = (ShardAppendBatch *) list_nth(rangeBatchList, batchIndex);
+
+		MergeAppendedShardRange(shardAppendBatch, PQgetvalue(queryResult, rowIndex, 1),
+								PQgetvalue(queryResult, rowIndex, 2));
+	}
+
+	PQclear(queryResult);
+	ForgetResults(connection);
+
+	foreach_ptr(shardAppendBatch, rangeBatchList)
+	{
+		shardAppendBatch->shardRangeKnown = true;
+	}
+}
+
+
+/*
+ * MergeAppendedShardRange widens the range of the given batch's shard such that
+ * it covers the given min/max values of an appended source table.
+ */
+static void
+MergeAppendedShardRange(ShardAppendBatch *shardAppendBatch, char *minValueString,
+						char *maxValueString)
+{
+	ShardInterval *shardInterval = shardAppendBatch->shardInterval;
+	DistTableCacheEntry *cacheEntry =
+		DistributedTableCacheEntry(shardInterval->relationId);
+	FmgrInfo *compareFunction = cacheEntry->shardIntervalCompareFunction;
+
+	Datum minValue = StringToDatum(minValueString, shardInterval->valueTypeId);
+	Datum maxValue = StringToDatum(maxValueString, shardInterval->valueTypeId);
+
+	if (!shardAppendBatch->shardRangeExists)
+	{
+		shardAppendBatch->shardRangeExists = true;
+		shardAppendBatch->minValue = minValue;
+		shardAppendBatch->maxValue = maxValue;
+		return;
 	}
 
-	/* ensure that the shard placement metadata does not change during the append */
-	LockShardDistributionMetadata(shardId, ShareLock);
-
-	/* serialize appends to the same shard */
-	LockShardResource(shardId, ExclusiveLock);
+	Datum minValueComparison = FunctionCall2Coll(compareFunction, DEFAULT_COLLATION_OID,
+												 minValue, shardAppendBatch->minValue);
+	if (DatumGetInt32(minValueComparison) < 0)
+	{
+		shardAppendBatch->minValue = minValue;
+	}
 
-	/* get schame name of the target shard */
-	Oid shardSchemaOid = get_rel_namespace(relationId);
-	char *shardSchemaName = get_namespace_name(shardSchemaOid);
+	Datum maxValueComparison = FunctionCall2Coll(compareFunction, DEFAULT_COLLATION_OID,
+												 maxValue, shardAppendBatch->maxValue);
+	if (DatumGetInt32(maxValueComparison) > 0)
+	{
+		shardAppendBatch->maxValue = maxValue;
+	}
+}
 
-	/* Build shard table name. */
-	char *shardTableName = get_rel_name(relationId);
-	AppendShardIdToName(&shardTableName, shardId);
 
-	char *shardQualifiedName = quote_qualified_identifier(shardSchemaName,
-														  shardTableName);
+/*
+ * ConnectionCommandBatchForConnection returns the command batch of the given
+ * connection in the list, and adds a new one to the list if there is none.
+ */
+static ConnectionCommandBatch *
+ConnectionCommandBatchForConnection(List **commandBatchList,
+									MultiConnection *connection)
+{
+	ConnectionCommandBatch *commandBatch = NULL;
 
-	List *shardPlacementList = FinalizedShardPlacementList(shardId);
-	if (shardPlacementList == NIL)
+	foreach_ptr(commandBatch, *commandBatchList)
 	{
-		ereport(ERROR, (errmsg("could not find any shard placements for shardId "
-							   UINT64_FORMAT, shardId),
-						errhint("Try running master_create_empty_shard() first")));
+		if (commandBatch->connection == connection)
+		{
+			return commandBatch;
+		}
 	}
 
-	BeginOrContinueCoordinatedTransaction();
+	commandBatch = palloc0(sizeof(ConnectionCommandBatch));
+	commandBatch->connection = connection;
+	commandBatch->commandString = makeStringInfo();
 
-	/* issue command to append table to each shard placement */
-	foreach(shardPlacementCell, shardPlacementList)
-	{
-		ShardPlacement *shardPlacement = (ShardPlacement *) lfirst(shardPlacementCell);
-		MultiConnection *connection = GetPlacementConnection(FOR_DML, shardPlacement,
-															 NULL);
-		PGresult *queryResult = NULL;
+	*commandBatchList = lappend(*commandBatchList, commandBatch);
 
-		StringInfo workerAppendQuery = makeStringInfo();
-		appendStringInfo(workerAppendQuery, WORKER_APPEND_TABLE_TO_SHARD,
-						 quote_literal_cstr(shardQualifiedName),
-						 quote_literal_cstr(sourceTableName),
-						 quote_literal_cstr(sourceNodeName), sourceNodePort);
+	return commandBatch;
+}
 
-		RemoteTransactionBeginIfNecessary(connection);
 
-		int executeResult = ExecuteOptionalRemoteCommand(connection,
-														 workerAppendQuery->data,
-														 &queryResult);
-		PQclear(queryResult);
-		ForgetResults(connection);
+/*
+ * SendConnectionCommandBatches begins the remote transactions of the given
+ * command batches if necessary, and sends each connection its query string
+ * without waiting for the results.
+ */
+static void
+SendConnectionCommandBatches(List *commandBatchList)
+{
+	List *connectionList = NIL;
+	ConnectionCommandBatch *commandBatch = NULL;
 
-		if (executeResult != 0)
-		{
-			MarkRemoteTransactionFailed(connection, false);
-		}
+	foreach_ptr(commandBatch, commandBatchList)
+	{
+		connectionList = lappend(connectionList, commandBatch->connection);
 	}
 
-	MarkFailedShardPlacements();
+	RemoteTransactionsBeginIfNecessary(connectionList);
 
-	/* update shard statistics and get new shard size */
-	uint64 newShardSize = UpdateShardStatistics(shardId);
+	foreach_ptr(commandBatch, commandBatchList)
+	{
+		MultiConnection *connection = commandBatch->connection;
 
-	/* calculate ratio of current shard size compared to shard max size */
-	uint64 shardMaxSizeInBytes = (int64) ShardMaxSize * 1024L;
-	shardFillLevel = ((float4) newShardSize / (float4) shardMaxSizeInBytes);
+		int querySent = SendRemoteCommand(connection, commandBatch->commandString->data);
+		if (querySent == 0)
+		{
+			ReportConnectionError(connection, WARNING);
+			continue;
+		}
 
-	PG_RETURN_FLOAT4(shardFillLevel);
+		commandBatch->commandSent = true;
+	}
 }
 
 
@@ -476,6 +1186,8 @@ InsertShardPlacementRows(Oid relationId, int64 shardId, List *workerNodeList,
  * CreateShardsOnWorkers creates shards on worker nodes given the shard placements
  * as a parameter The function  creates the shards via the executor. This means
  * that it can adopt the number of connections required to create the shards.
+ * Between BeginBatchedShardCreation and FinishBatchedShardCreation, the shards
+ * are only created by the latter.
  */
 void
 CreateShardsOnWorkers(Oid distributedRelationId, List *shardPlacements,
@@ -524,6 +1236,19 @@ CreateShardsOnWorkers(Oid distributedRelationId, List *shardPlacements,
 		taskList = lappend(taskList, task);
 	}
 
+	if (BatchingShardCreation)
+	{
+		MemoryContext oldContext = MemoryContextSwitchTo(BatchedShardCreateContext);
+
+		BatchedShardCreateTaskList = list_concat(BatchedShardCreateTaskList,
+												 copyObject(taskList));
+		BatchedShardCreationUsesExclusiveConnections |= useExclusiveConnection;
+
+		MemoryContextSwitchTo(oldContext);
+
+		return;
+	}
+
 	if (useExclusiveConnection)
 	{
 		/*
@@ -547,10 +1272,175 @@ CreateShardsOnWorkers(Oid distributedRelationId, List *shardPlacements,
 		poolSize = MaxAdaptiveExecutorPoolSize;
 	}
 
+	taskList = BatchShardCreateTasks(taskList, poolSize);
+
 	ExecuteTaskList(ROW_MODIFY_NONE, taskList, poolSize);
 }
 
 
+/*
+ * BeginBatchedShardCreation makes CreateShardsOnWorkers collect the shard
+ * creation tasks instead of executing them, such that the shards of many
+ * tables, such as the partitions of a partitioned table, can be created in
+ * a single execution in which each node creates many shards per round trip.
+ * Callers should call AbortBatchedShardCreation when they fail before
+ * FinishBatchedShardCreation.
+ */
+void
+BeginBatchedShardCreation(void)
+{
+	Assert(!BatchingShardCreation);
+
+	BatchedShardCreateContext = AllocSetContextCreate(CurrentMemoryContext,
+													  "Batched Shard Creation Context",
+													  ALLOCSET_DEFAULT_SIZES);
+	BatchedShardCreateTaskList = NIL;
+	BatchedShardCreationUsesExclusiveConnections = false;
+	BatchingShardCreation = true;
+}
+
+
+/*
+ * FinishBatchedShardCreation creates the shards whose creation was collected
+ * since BeginBatchedShardCreation. Since the tasks merely create empty shards,
+ * the nodes create them over as many connections as the executor may use.
+ */
+void
+FinishBatchedShardCreation(void)
+{
+	int poolSize = MaxAdaptiveExecutorPoolSize;
+
+	Assert(BatchingShardCreation);
+
+	List *taskList = BatchedShardCreateTaskList;
+	BatchingShardCreation = false;
+
+	if (BatchedShardCreationUsesExclusiveConnections)
+	{
+		/* subsequent commands in the transaction block use the same connections */
+		SetLocalForceMaxQueryParallelization();
+	}
+
+	if (taskList != NIL)
+	{
+		/* the tasks of separate tables were numbered separately */
+		taskList = BatchShardCreateTasks(taskList, poolSize);
+
+		ExecuteTaskList(ROW_MODIFY_NONE, taskList, poolSize);
+	}
+
+	AbortBatchedShardCreation();
+}
+
+
+/*
+ * AbortBatchedShardCreation discards the shard creation tasks that were
+ * collected since BeginBatchedShardCreation.
+ */
+void
+AbortBatchedShardCreation(void)
+{
+	if (BatchedShardCreateContext != NULL)
+	{
+		MemoryContextDelete(BatchedShardCreateContext);
+		BatchedShardCreateContext = NULL;
+	}
+
+	BatchedShardCreateTaskList = NIL;
+	BatchedShardCreationUsesExclusiveConnections = false;
+	BatchingShardCreation = false;
+}
+
+
+/*
+ * BatchShardCreateTasks merges the given shard creation tasks, which each
+ * create a single placement, into tasks that create up to
+ * SHARD_CREATE_BATCH_SIZE placements on the same node in a single round trip.
+ * The placements of a node are spread over at least poolSize tasks, such that
+ * the executor can still use all the connections it is allowed to open.
+ */
+static List *
+BatchShardCreateTasks(List *taskList, int poolSize)
+{
+	List *groupTaskListList = NIL;
+	List *batchedTaskList = NIL;
+	ListCell *taskCell = NULL;
+	ListCell *groupTaskListCell = NULL;
+	int taskId = 1;
+
+	/* group the tasks by the node of their placement, preserving their order */
+	foreach(taskCell, taskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+		ShardPlacement *placement = linitial(task->taskPlacementList);
+		bool foundGroup = false;
+
+		foreach(groupTaskListCell, groupTaskListList)
+		{
+			List *groupTaskList = lfirst(groupTaskListCell);
+			Task *groupTask = (Task *) linitial(groupTaskList);
+			ShardPlacement *groupPlacement = linitial(groupTask->taskPlacementList);
+
+			if (groupPlacement->groupId == placement->groupId)
+			{
+				lfirst(groupTaskListCell) = lappend(groupTaskList, task);
+				foundGroup = true;
+				break;
+			}
+		}
+
+		if (!foundGroup)
+		{
+			groupTaskListList = lappend(groupTaskListList, list_make1(task));
+		}
+	}
+
+	foreach(groupTaskListCell, groupTaskListList)
+	{
+		List *groupTaskList = lfirst(groupTaskListCell);
+		int groupTaskCount = list_length(groupTaskList);
+		int batchSize = (groupTaskCount + poolSize - 1) / poolSize;
+		Task *batchTask = NULL;
+		StringInfo batchQueryString = NULL;
+		int batchTaskCount = 0;
+
+		batchSize = Max(1, Min(batchSize, SHARD_CREATE_BATCH_SIZE));
+
+		foreach(taskCell, groupTaskList)
+		{
+			Task *task = (Task *) lfirst(taskCell);
+
+			if (batchTask == NULL)
+			{
+				/* the first task of a batch carries the merged commands */
+				batchTask = task;
+				batchTask->taskId = taskId++;
+				batchQueryString = makeStringInfo();
+				appendStringInfoString(batchQueryString, task->queryString);
+				batchTaskCount = 1;
+			}
+			else
+			{
+				appendStringInfoChar(batchQueryString, ';');
+				appendStringInfoString(batchQueryString, task->queryString);
+				batchTask->relationShardList =
+					list_concat(batchTask->relationShardList, task->relationShardList);
+				batchTaskCount++;
+			}
+
+			if (batchTaskCount == batchSize || lnext(taskCell) == NULL)
+			{
+				batchTask->queryString = batchQueryString->data;
+				batchedTaskList = lappend(batchedTaskList, batchTask);
+				batchTask = NULL;
+			}
+		}
+	}
+
+	return batchedTaskList;
+}
+
+
 /*
  * RelationShardListForShardCreate gets a shard interval and returns the placement
  * accesses that would happen when a placement of the shard interval is created.
@@ -760,8 +1650,6 @@ UpdateShardStatistics(int64 shardId)
 {
 	ShardInterval *shardInterval = LoadShardInterval(shardId);
 	Oid relationId = shardInterval->relationId;
-	char storageType = shardInterval->storageType;
-	char partitionType = PartitionMethod(relationId);
 	ListCell *shardPlacementCell = NULL;
 	bool statsOK = false;
 	uint64 shardSize = 0;
@@ -806,21 +1694,38 @@ UpdateShardStatistics(int64 shardId)
 						  errdetail("Setting shard statistics to NULL")));
 	}
 
+	RecordShardStatistics(shardInterval, shardPlacementList, shardSize, minValue,
+						  maxValue);
+
+	if (statsOK && PartitionMethod(relationId) == DISTRIBUTE_BY_APPEND)
+	{
+		UpdateShardColumnStatistics(relationId, shardId, shardQualifiedName,
+									shardPlacementList);
+	}
+
+	return shardSize;
+}
+
+
+/*
+ * RecordShardStatistics records the given shard size for each of the given
+ * placements, and for append-partitioned tables the given min/max values for
+ * the shard in the metadata.
+ */
+static void
+RecordShardStatistics(ShardInterval *shardInterval, List *shardPlacementList,
+					  uint64 shardSize, text *minValue, text *maxValue)
+{
+	uint64 shardId = shardInterval->shardId;
+	Oid relationId = shardInterval->relationId;
+	char storageType = shardInterval->storageType;
+	char partitionType = PartitionMethod(relationId);
+
 	/* make sure we don't process cancel signals */
 	HOLD_INTERRUPTS();
 
 	/* update metadata for each shard placement we appended to */
-	shardPlacementCell = NULL;
-	foreach(shardPlacementCell, shardPlacementList)
-	{
-		ShardPlacement *placement = (ShardPlacement *) lfirst(shardPlacementCell);
-		uint64 placementId = placement->placementId;
-		int32 groupId = placement->groupId;
-
-		DeleteShardPlacementRow(placementId);
-		InsertShardPlacementRow(shardId, placementId, FILE_FINALIZED, shardSize,
-								groupId);
-	}
+	UpdateShardPlacementLengths(shardPlacementList, shardSize);
 
 	/* only update shard min/max values for append-partitioned tables */
 	if (partitionType == DISTRIBUTE_BY_APPEND)
@@ -836,8 +1741,6 @@ UpdateShardStatistics(int64 shardId)
 	}
 
 	RESUME_INTERRUPTS();
-
-	return shardSize;
 }
 
 
@@ -949,6 +1852,228 @@ WorkerShardStats(ShardPlacement *placement, Oid relationId, char *shardName,
 }
 
 
+/*
+ * UpdateShardPlacementLengths records the given shard length in the metadata of
+ * each of the given shard placements.
+ */
+static void
+UpdateShardPlacementLengths(List *shardPlacementList, uint64 shardLength)
+{
+	ListCell *shardPlacementCell = NULL;
+
+	foreach(shardPlacementCell, shardPlacementList)
+	{
+		ShardPlacement *placement = (ShardPlacement *) lfirst(shardPlacementCell);
+		uint64 placementId = placement->placementId;
+		int32 groupId = placement->groupId;
+
+		DeleteShardPlacementRow(placementId);
+		InsertShardPlacementRow(placement->shardId, placementId, FILE_FINALIZED,
+								shardLength, groupId);
+	}
+}
+
+
+/*
+ * citus_update_table_statistics analyzes all shards of the given distributed
+ * table in parallel, and collects their statistics on the coordinator. Shard
+ * sizes go into pg_dist_placement, and the table's total page and row counts go
+ * into the pg_class entry of the coordinator's local table. This way, planning
+ * on the coordinator can use estimates that otherwise only exist on workers.
+ */
+Datum
+citus_update_table_statistics(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+
+	CheckCitusVersion(ERROR);
+	EnsureCoordinator();
+	EnsureTableOwner(relationId);
+	CheckDistributedTable(relationId);
+
+	UpdateTableStatistics(relationId);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * UpdateTableStatistics runs ANALYZE on every shard placement of the given table
+ * through the adaptive executor, and then records the resulting statistics on
+ * the coordinator.
+ */
+static void
+UpdateTableStatistics(Oid relationId)
+{
+	ListCell *shardIntervalCell = NULL;
+
+	/* same lock as ANALYZE, so that concurrent writes can go on */
+	LockRelationOid(relationId, ShareUpdateExclusiveLock);
+
+	List *shardIntervalList = LoadShardIntervalList(relationId);
+
+	/* grab shard lock before getting placement lists */
+	LockShardListMetadata(shardIntervalList, ShareLock);
+
+	List *analyzeTaskList = NIL;
+	uint32 taskId = 1;
+
+	foreach(shardIntervalCell, shardIntervalList)
+	{
+		ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
+		uint64 shardId = shardInterval->shardId;
+		char *shardQualifiedName = ConstructQualifiedShardName(shardInterval);
+		StringInfo analyzeCommand = makeStringInfo();
+
+		appendStringInfo(analyzeCommand, "ANALYZE %s", shardQualifiedName);
+
+		Task *analyzeTask = CitusMakeNode(Task);
+		analyzeTask->jobId = INVALID_JOB_ID;
+		analyzeTask->taskId = taskId;
+		analyzeTask->taskType = VACUUM_ANALYZE_TASK;
+		analyzeTask->queryString = analyzeCommand->data;
+		analyzeTask->replicationModel = REPLICATION_MODEL_INVALID;
+		analyzeTask->anchorShardId = shardId;
+		analyzeTask->taskPlacementList = FinalizedShardPlacementList(shardId);
+
+		analyzeTaskList = lappend(analyzeTaskList, analyzeTask);
+		taskId++;
+	}
+
+	ExecuteUtilityTaskListWithoutResults(analyzeTaskList);
+
+	RecordTableStatistics(relationId);
+}
+
+
+/*
+ * RecordTableStatistics reads back the size, page count, and row count of one
+ * placement per shard of the given table, as computed by the last ANALYZE on
+ * the workers, and records them on the coordinator. Shard sizes go into
+ * pg_dist_placement, and the table's total page and row counts go into the
+ * pg_class entry of the coordinator's local table.
+ */
+void
+RecordTableStatistics(Oid relationId)
+{
+	ListCell *shardIntervalCell = NULL;
+	BlockNumber tablePageCount = 0;
+	double tableRowCount = 0.0;
+	bool goForward = true;
+	bool doCopy = false;
+
+	/* same lock as ANALYZE, so that concurrent writes can go on */
+	Relation relation = heap_open(relationId, ShareUpdateExclusiveLock);
+
+	List *shardIntervalList = LoadShardIntervalList(relationId);
+
+	/* grab shard lock before getting placement lists */
+	LockShardListMetadata(shardIntervalList, ShareLock);
+
+	List *statisticsTaskList = NIL;
+	uint32 taskId = 1;
+
+	foreach(shardIntervalCell, shardIntervalList)
+	{
+		ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
+		uint64 shardId = shardInterval->shardId;
+		char *shardQualifiedName = ConstructQualifiedShardName(shardInterval);
+		char *quotedShardName = quote_literal_cstr(shardQualifiedName);
+		StringInfo shardSizeQuery = makeStringInfo();
+		StringInfo statisticsQuery = makeStringInfo();
+
+		if (CStoreTable(relationId))
+		{
+			appendStringInfo(shardSizeQuery, "cstore_table_size(%s)", quotedShardName);
+		}
+		else
+		{
+			appendStringInfo(shardSizeQuery, "pg_table_size(%s)", quotedShardName);
+		}
+
+		appendStringInfo(statisticsQuery, SHARD_STATISTICS_QUERY, shardId,
+						 shardSizeQuery->data, quotedShardName);
+
+		Task *statisticsTask = CitusMakeNode(Task);
+		statisticsTask->jobId = INVALID_JOB_ID;
+		statisticsTask->taskId = taskId;
+		statisticsTask->taskType = SELECT_TASK;
+		statisticsTask->queryString = statisticsQuery->data;
+		statisticsTask->replicationModel = REPLICATION_MODEL_INVALID;
+		statisticsTask->anchorShardId = shardId;
+		statisticsTask->taskPlacementList = FinalizedShardPlacementList(shardId);
+
+		statisticsTaskList = lappend(statisticsTaskList, statisticsTask);
+		taskId++;
+	}
+
+#if PG_VERSION_NUM >= 120000
+	TupleDesc tupleDescriptor = CreateTemplateTupleDesc(SHARD_STATISTICS_FIELDS);
+#else
+	TupleDesc tupleDescriptor = CreateTemplateTupleDesc(SHARD_STATISTICS_FIELDS, false);
+#endif
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 1, "shardid", INT8OID, -1, 0);
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 2, "shard_size", INT8OID, -1, 0);
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 3, "reltuples", FLOAT8OID, -1, 0);
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 4, "relpages", INT8OID, -1, 0);
+
+	Tuplestorestate *tupleStore = tuplestore_begin_heap(false, false, work_mem);
+
+	ExecuteTaskListExtended(ROW_MODIFY_READONLY, statisticsTaskList, tupleDescriptor,
+							tupleStore, false, MaxAdaptiveExecutorPoolSize);
+
+	TupleTableSlot *tupleTableSlot = MakeSingleTupleTableSlotCompat(tupleDescriptor,
+																	&TTSOpsMinimalTuple);
+
+	/* make sure we don't process cancel signals during the metadata update */
+	HOLD_INTERRUPTS();
+
+	bool hasTuple = tuplestore_gettupleslot(tupleStore, goForward, doCopy,
+											tupleTableSlot);
+	while (hasTuple)
+	{
+		bool isNull = false;
+
+		uint64 shardId = DatumGetInt64(slot_getattr(tupleTableSlot, 1, &isNull));
+		Datum shardSizeDatum = slot_getattr(tupleTableSlot, 2, &isNull);
+		uint64 shardSize = isNull ? 0 : DatumGetInt64(shardSizeDatum);
+		double shardRowCount = DatumGetFloat8(slot_getattr(tupleTableSlot, 3, &isNull));
+		int64 shardPageCount = DatumGetInt64(slot_getattr(tupleTableSlot, 4, &isNull));
+
+		UpdateShardPlacementLengths(FinalizedShardPlacementList(shardId), shardSize);
+
+		tableRowCount += shardRowCount;
+		tablePageCount += (BlockNumber) shardPageCount;
+
+		ExecClearTuple(tupleTableSlot);
+		hasTuple = tuplestore_gettupleslot(tupleStore, goForward, doCopy,
+										   tupleTableSlot);
+	}
+
+	ExecDropSingleTupleTableSlot(tupleTableSlot);
+	tuplestore_end(tupleStore);
+
+	/*
+	 * Like ANALYZE, we update the pg_class entry in place. We keep the flags
+	 * that describe the local table, which holds no data.
+	 */
+	vac_update_relstats(relation, tablePageCount, tableRowCount,
+						relation->rd_rel->relallvisible,
+						relation->rd_rel->relhasindex,
+						InvalidTransactionId, InvalidMultiXactId, false);
+
+	if (QueryCancelPending)
+	{
+		ereport(WARNING, (errmsg("cancel requests are ignored during metadata update")));
+		QueryCancelPending = false;
+	}
+
+	RESUME_INTERRUPTS();
+
+	heap_close(relation, NoLock);
+}
+
+
 /*
  * ForeignConstraintGetReferencedTableId parses given foreign constraint query and
  * extracts referenced table id from it.
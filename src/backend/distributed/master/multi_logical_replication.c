@@ -0,0 +1,1075 @@
+/*-------------------------------------------------------------------------
+ *
+ * multi_logical_replication.c
+ *
+ * This file contains functions to move shards between nodes using logical
+ * replication. The shards are first created on the target node, after which
+ * a subscription on the target node copies their data and then streams the
+ * changes made on the source node while the copy was in progress. Writes to
+ * the shards are only blocked for the final catch up, before the placement
+ * metadata is switched to the target node.
+ *
+ * Shards are split in a similar way, except that the changes to a shard that
+ * is split are routed into the new shards by the citus output plugin (see
+ * shard_split_decoder.c), since publications cannot filter rows. The initial
+ * data is copied from the snapshot exported by the replication slot, such
+ * that each new shard only receives its own hash range.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include "access/heapam.h"
+#include "catalog/pg_class.h"
+#include "distributed/citus_wait_events.h"
+#include "distributed/connection_management.h"
+#include "distributed/listutils.h"
+#include "distributed/master_protocol.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/multi_join_order.h"
+#include "distributed/multi_logical_replication.h"
+#include "distributed/multi_partitioning_utils.h"
+#include "distributed/remote_commands.h"
+#include "distributed/resource_lock.h"
+#include "distributed/shard_split_decoder.h"
+#include "lib/stringinfo.h"
+#include "pgstat.h"
+#include "storage/latch.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/relcache.h"
+
+
+/*
+ * SplitShardReplication holds the state of replicating the new shards of a
+ * split that are placed on one node.
+ */
+typedef struct SplitShardReplication
+{
+	WorkerNode *targetNode;
+
+	/* shards that are split, and the new shards on the target node they feed */
+	List *sourceShardList;
+	List *splitShardList;
+
+	/* the replication slot is named after the subscription */
+	char *publicationName;
+	char *subscriptionName;
+
+	MultiConnection *targetConnection;
+} SplitShardReplication;
+
+
+/* local function forward declarations */
+static MultiConnection * ReplicationConnection(char *nodeName, int nodePort);
+static char * SourceNodeConnectionInfo(char *sourceNodeName, int sourceNodePort);
+static List * SplitShardReplicationList(List *sourceShardList,
+										List *splitShardListList,
+										WorkerNode **splitNodes);
+static char * SplitShardObjectName(char *prefix, ShardInterval *shardInterval,
+								   WorkerNode *targetNode);
+static void CreateSplitShardPublication(MultiConnection *sourceConnection,
+										SplitShardReplication *replication);
+static void StartSplitShardReplication(MultiConnection *sourceConnection,
+									   WorkerNode *sourceNode,
+									   SplitShardReplication *replication);
+static void CopySplitShardData(MultiConnection *snapshotConnection,
+							   MultiConnection *targetConnection,
+							   ShardInterval *sourceShard, ShardInterval *splitShard,
+							   bool localCopy);
+static char * SplitShardSelectQuery(ShardInterval *sourceShard,
+									ShardInterval *splitShard);
+static void FinishSplitShardReplication(MultiConnection *sourceConnection,
+										SplitShardReplication *replication);
+static PGconn * ReplicationProtocolConnection(char *nodeName, int nodePort);
+static char * ExecuteReplicationCommand(PGconn *connection, char *command,
+										int columnIndex);
+static void StartRemoteCopy(MultiConnection *connection, char *copyCommand,
+							ExecStatusType copyStatus);
+static void FinishRemoteCopy(MultiConnection *connection);
+static void WaitForSocketReadable(pgsocket socket);
+static char * ExecuteRemoteQuery(MultiConnection *connection, char *query);
+static char * ShardMoveObjectName(char *prefix, List *shardIntervalList);
+static char * PublicationTableListString(List *shardIntervalList);
+static void DropShardMoveReplicationObjects(MultiConnection *sourceConnection,
+											MultiConnection *targetConnection,
+											char *publicationName,
+											char *subscriptionName);
+static void WaitForInitialDataCopy(MultiConnection *targetConnection,
+								   char *subscriptionName);
+static void WaitForReplicationCatchUp(MultiConnection *sourceConnection,
+									  char *subscriptionName);
+static void WaitForPollInterval(void);
+
+
+/*
+ * ShardListHasReplicaIdentity returns whether all of the given shards have a
+ * replica identity, which logical replication needs to replicate updates and
+ * deletes. Partitioned tables do not hold any data, so only their partitions
+ * are checked.
+ */
+bool
+ShardListHasReplicaIdentity(List *shardIntervalList)
+{
+	ListCell *shardIntervalCell = NULL;
+
+	foreach(shardIntervalCell, shardIntervalList)
+	{
+		ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
+		Oid relationId = shardInterval->relationId;
+
+		if (PartitionedTableNoLock(relationId))
+		{
+			continue;
+		}
+
+		Relation relation = heap_open(relationId, AccessShareLock);
+		bool hasReplicaIdentity =
+			relation->rd_rel->relreplident == REPLICA_IDENTITY_FULL ||
+			OidIsValid(RelationGetReplicaIndex(relation));
+		heap_close(relation, NoLock);
+
+		if (!hasReplicaIdentity)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * NodeSupportsLogicalReplication returns whether the given node is configured
+ * with wal_level = logical, which is needed to replicate shards from it.
+ */
+bool
+NodeSupportsLogicalReplication(char *nodeName, int nodePort)
+{
+	MultiConnection *connection = ReplicationConnection(nodeName, nodePort);
+	char *walLevel = ExecuteRemoteQuery(connection,
+										"SELECT pg_catalog.current_setting('wal_level')");
+
+	CloseConnection(connection);
+
+	return strcmp(walLevel, "logical") == 0;
+}
+
+
+/*
+ * LogicallyReplicateShards replicates the data of the given co-located shards
+ * from the source node to the target node, on which the shards should already
+ * have been created. The function returns after blocking writes to the shards
+ * and waiting for the target node to apply all changes, such that the caller
+ * can switch the placement metadata over to the target node in the current
+ * transaction.
+ *
+ * The publication and subscription used for the replication are named after
+ * the first shard, and any left behind by an earlier failed move of the same
+ * shards are dropped first.
+ */
+void
+LogicallyReplicateShards(List *shardIntervalList, char *sourceNodeName,
+						 int sourceNodePort, char *targetNodeName, int targetNodePort)
+{
+	StringInfo createPublicationCommand = makeStringInfo();
+	StringInfo createSubscriptionCommand = makeStringInfo();
+	StringInfo dropSubscriptionCommand = makeStringInfo();
+	StringInfo dropPublicationCommand = makeStringInfo();
+
+	char *publicationName = ShardMoveObjectName(SHARD_MOVE_PUBLICATION_PREFIX,
+												shardIntervalList);
+	char *subscriptionName = ShardMoveObjectName(SHARD_MOVE_SUBSCRIPTION_PREFIX,
+												 shardIntervalList);
+
+	MultiConnection *sourceConnection = ReplicationConnection(sourceNodeName,
+															  sourceNodePort);
+	MultiConnection *targetConnection = ReplicationConnection(targetNodeName,
+															  targetNodePort);
+
+	DropShardMoveReplicationObjects(sourceConnection, targetConnection,
+									publicationName, subscriptionName);
+
+	appendStringInfo(createPublicationCommand, "CREATE PUBLICATION %s FOR TABLE %s",
+					 quote_identifier(publicationName),
+					 PublicationTableListString(shardIntervalList));
+
+	ExecuteCriticalRemoteCommand(sourceConnection, createPublicationCommand->data);
+
+	char *connectionInfo = SourceNodeConnectionInfo(sourceNodeName, sourceNodePort);
+
+	/*
+	 * The apply workers run with session_replication_role = replica, so the
+	 * foreign keys between the shards do not get in the way of the copy.
+	 */
+	appendStringInfo(createSubscriptionCommand,
+					 "CREATE SUBSCRIPTION %s CONNECTION %s PUBLICATION %s "
+					 "WITH (copy_data = true, create_slot = true, enabled = true)",
+					 quote_identifier(subscriptionName),
+					 quote_literal_cstr(connectionInfo),
+					 quote_identifier(publicationName));
+
+	ExecuteCriticalRemoteCommand(targetConnection, createSubscriptionCommand->data);
+
+	WaitForInitialDataCopy(targetConnection, subscriptionName);
+
+	/* catch up without blocking writes first, to keep the final catch up short */
+	WaitForReplicationCatchUp(sourceConnection, subscriptionName);
+
+	BlockWritesToShardList(shardIntervalList);
+
+	WaitForReplicationCatchUp(sourceConnection, subscriptionName);
+
+	/* dropping the subscription also drops its replication slot */
+	appendStringInfo(dropSubscriptionCommand, "DROP SUBSCRIPTION %s",
+					 quote_identifier(subscriptionName));
+	appendStringInfo(dropPublicationCommand, "DROP PUBLICATION %s",
+					 quote_identifier(publicationName));
+
+	ExecuteCriticalRemoteCommand(targetConnection, dropSubscriptionCommand->data);
+	ExecuteCriticalRemoteCommand(sourceConnection, dropPublicationCommand->data);
+
+	CloseConnection(sourceConnection);
+	CloseConnection(targetConnection);
+}
+
+
+/*
+ * LogicallyReplicateSplitShards replicates the data of the given co-located
+ * shards on the source node into the new shards that they are split into,
+ * which should already have been created on the nodes given in splitNodes.
+ * Each entry of splitShardListList holds the new shards of the corresponding
+ * entry of sourceShardList, in the order of splitNodes. Like
+ * LogicallyReplicateShards, the function returns after blocking writes to the
+ * source shards and waiting for all changes to be applied.
+ *
+ * Every node that receives new shards gets its own publication, replication
+ * slot and subscription, which are named after the first source shard and the
+ * node, and any left behind by an earlier failed split are dropped first.
+ */
+void
+LogicallyReplicateSplitShards(List *sourceShardList, List *splitShardListList,
+							  WorkerNode **splitNodes, WorkerNode *sourceNode)
+{
+	SplitShardReplication *replication = NULL;
+
+	List *replicationList = SplitShardReplicationList(sourceShardList,
+													  splitShardListList,
+													  splitNodes);
+
+	MultiConnection *sourceConnection = ReplicationConnection(sourceNode->workerName,
+															  sourceNode->workerPort);
+
+	foreach_ptr(replication, replicationList)
+	{
+		WorkerNode *targetNode = replication->targetNode;
+
+		replication->targetConnection = ReplicationConnection(targetNode->workerName,
+															  targetNode->workerPort);
+
+		DropShardMoveReplicationObjects(sourceConnection, replication->targetConnection,
+										replication->publicationName,
+										replication->subscriptionName);
+
+		CreateSplitShardPublication(sourceConnection, replication);
+	}
+
+	foreach_ptr(replication, replicationList)
+	{
+		StartSplitShardReplication(sourceConnection, sourceNode, replication);
+	}
+
+	/* catch up without blocking writes first, to keep the final catch up short */
+	foreach_ptr(replication, replicationList)
+	{
+		WaitForReplicationCatchUp(sourceConnection, replication->subscriptionName);
+	}
+
+	BlockWritesToShardList(sourceShardList);
+
+	foreach_ptr(replication, replicationList)
+	{
+		WaitForReplicationCatchUp(sourceConnection, replication->subscriptionName);
+		FinishSplitShardReplication(sourceConnection, replication);
+
+		CloseConnection(replication->targetConnection);
+	}
+
+	CloseConnection(sourceConnection);
+}
+
+
+/*
+ * ReplicationConnection opens a new connection to the given node as the
+ * extension owner, since creating subscriptions requires superuser
+ * privileges. Commands on the connection run outside of the current
+ * transaction.
+ */
+static MultiConnection *
+ReplicationConnection(char *nodeName, int nodePort)
+{
+	int connectionFlags = FORCE_NEW_CONNECTION;
+
+	MultiConnection *connection =
+		GetNodeUserDatabaseConnection(connectionFlags, nodeName, nodePort,
+									  CitusExtensionOwnerName(), NULL);
+
+	if (PQstatus(connection->pgConn) != CONNECTION_OK)
+	{
+		ReportConnectionError(connection, ERROR);
+	}
+
+	return connection;
+}
+
+
+/*
+ * SourceNodeConnectionInfo returns the connection string with which the
+ * subscriptions of a shard move or split connect to the source node.
+ */
+static char *
+SourceNodeConnectionInfo(char *sourceNodeName, int sourceNodePort)
+{
+	StringInfo connectionInfo = makeStringInfo();
+
+	appendStringInfo(connectionInfo, "host=%s port=%d user=%s dbname=%s",
+					 quote_literal_cstr(sourceNodeName), sourceNodePort,
+					 quote_literal_cstr(CitusExtensionOwnerName()),
+					 quote_literal_cstr(CurrentDatabaseName()));
+
+	if (NodeConninfo != NULL && NodeConninfo[0] != '\0')
+	{
+		appendStringInfo(connectionInfo, " %s", NodeConninfo);
+	}
+
+	return connectionInfo->data;
+}
+
+
+/*
+ * SplitShardReplicationList groups the new shards of a split by the node they
+ * are placed on, and returns a SplitShardReplication for each of those nodes.
+ */
+static List *
+SplitShardReplicationList(List *sourceShardList, List *splitShardListList,
+						  WorkerNode **splitNodes)
+{
+	List *replicationList = NIL;
+	ShardInterval *firstSourceShard = (ShardInterval *) linitial(sourceShardList);
+	ListCell *sourceShardCell = NULL;
+	ListCell *splitShardListCell = NULL;
+
+	forboth(sourceShardCell, sourceShardList, splitShardListCell, splitShardListList)
+	{
+		ShardInterval *sourceShard = (ShardInterval *) lfirst(sourceShardCell);
+		List *splitShardList = (List *) lfirst(splitShardListCell);
+		ShardInterval *splitShard = NULL;
+		int splitIndex = 0;
+
+		foreach_ptr(splitShard, splitShardList)
+		{
+			WorkerNode *targetNode = splitNodes[splitIndex];
+			SplitShardReplication *replication = NULL;
+			SplitShardReplication *existingReplication = NULL;
+
+			foreach_ptr(existingReplication, replicationList)
+			{
+				if (existingReplication->targetNode->nodeId == targetNode->nodeId)
+				{
+					replication = existingReplication;
+					break;
+				}
+			}
+
+			if (replication == NULL)
+			{
+				replication = palloc0(sizeof(SplitShardReplication));
+				replication->targetNode = targetNode;
+				replication->publicationName =
+					SplitShardObjectName(SHARD_SPLIT_PUBLICATION_PREFIX,
+										 firstSourceShard, targetNode);
+				replication->subscriptionName =
+					SplitShardObjectName(SHARD_SPLIT_SUBSCRIPTION_PREFIX,
+										 firstSourceShard, targetNode);
+
+				replicationList = lappend(replicationList, replication);
+			}
+
+			replication->sourceShardList = lappend(replication->sourceShardList,
+												   sourceShard);
+			replication->splitShardList = lappend(replication->splitShardList,
+												  splitShard);
+
+			splitIndex++;
+		}
+	}
+
+	return replicationList;
+}
+
+
+/*
+ * SplitShardObjectName returns the name of a replication object used to split
+ * the given shard, which is the given prefix followed by the shard id and the
+ * id of the node that receives the new shards.
+ */
+static char *
+SplitShardObjectName(char *prefix, ShardInterval *shardInterval, WorkerNode *targetNode)
+{
+	StringInfo objectName = makeStringInfo();
+
+	appendStringInfo(objectName, "%s" UINT64_FORMAT "_%u", prefix,
+					 shardInterval->shardId, targetNode->nodeId);
+
+	return objectName->data;
+}
+
+
+/*
+ * CreateSplitShardPublication registers the routes of the changes to the
+ * source shards into the new shards with the output plugin on the source
+ * node, and creates the publication of the new shards. On a source node that
+ * does not hold the new shards, the publication is created on the empty
+ * tables that stand in for them.
+ */
+static void
+CreateSplitShardPublication(MultiConnection *sourceConnection,
+							SplitShardReplication *replication)
+{
+	StringInfo removeRoutesCommand = makeStringInfo();
+	StringInfo createPublicationCommand = makeStringInfo();
+	ListCell *sourceShardCell = NULL;
+	ListCell *splitShardCell = NULL;
+
+	appendStringInfo(removeRoutesCommand,
+					 "SELECT pg_catalog.worker_split_shard_remove_routes(%s)",
+					 quote_literal_cstr(replication->subscriptionName));
+
+	ExecuteCriticalRemoteCommand(sourceConnection, removeRoutesCommand->data);
+
+	forboth(sourceShardCell, replication->sourceShardList,
+			splitShardCell, replication->splitShardList)
+	{
+		ShardInterval *sourceShard = (ShardInterval *) lfirst(sourceShardCell);
+		ShardInterval *splitShard = (ShardInterval *) lfirst(splitShardCell);
+		Oid relationId = sourceShard->relationId;
+		StringInfo addRouteCommand = makeStringInfo();
+
+		Var *distributionColumn = DistPartitionKey(relationId);
+		char *columnName = get_attname(relationId, distributionColumn->varattno, false);
+
+		appendStringInfo(addRouteCommand,
+						 "SELECT pg_catalog.worker_split_shard_add_route"
+						 "(%s, %s, %s, %s, %d, %d)",
+						 quote_literal_cstr(replication->subscriptionName),
+						 quote_literal_cstr(ConstructQualifiedShardName(sourceShard)),
+						 quote_literal_cstr(ConstructQualifiedShardName(splitShard)),
+						 quote_literal_cstr(columnName),
+						 DatumGetInt32(splitShard->minValue),
+						 DatumGetInt32(splitShard->maxValue));
+
+		ExecuteCriticalRemoteCommand(sourceConnection, addRouteCommand->data);
+	}
+
+	appendStringInfo(createPublicationCommand, "CREATE PUBLICATION %s FOR TABLE %s",
+					 quote_identifier(replication->publicationName),
+					 PublicationTableListString(replication->splitShardList));
+
+	ExecuteCriticalRemoteCommand(sourceConnection, createPublicationCommand->data);
+}
+
+
+/*
+ * StartSplitShardReplication creates the replication slot of the given new
+ * shards, copies their initial data from the snapshot that the slot exports,
+ * and then creates the subscription that streams the changes made since.
+ */
+static void
+StartSplitShardReplication(MultiConnection *sourceConnection, WorkerNode *sourceNode,
+						   SplitShardReplication *replication)
+{
+	StringInfo createSlotCommand = makeStringInfo();
+	StringInfo setSnapshotCommand = makeStringInfo();
+	StringInfo createSubscriptionCommand = makeStringInfo();
+	char *sourceNodeName = sourceNode->workerName;
+	int sourceNodePort = sourceNode->workerPort;
+	bool localCopy = (replication->targetNode->nodeId == sourceNode->nodeId);
+
+	/* the slot is created over the replication protocol to export its snapshot */
+	appendStringInfo(createSlotCommand, "CREATE_REPLICATION_SLOT %s LOGICAL %s "
+										"EXPORT_SNAPSHOT",
+					 quote_identifier(replication->subscriptionName),
+					 SHARD_SPLIT_DECODER_PLUGIN);
+
+	PGconn *slotConnection = ReplicationProtocolConnection(sourceNodeName,
+														   sourceNodePort);
+
+	PG_TRY();
+	{
+		ListCell *sourceShardCell = NULL;
+		ListCell *splitShardCell = NULL;
+
+		char *snapshotName = ExecuteReplicationCommand(slotConnection,
+													   createSlotCommand->data, 2);
+
+		/* the snapshot remains valid while the slot connection stays idle */
+		MultiConnection *snapshotConnection = ReplicationConnection(sourceNodeName,
+																	sourceNodePort);
+
+		appendStringInfo(setSnapshotCommand, "SET TRANSACTION SNAPSHOT %s",
+						 quote_literal_cstr(snapshotName));
+
+		ExecuteCriticalRemoteCommand(snapshotConnection,
+									 "BEGIN ISOLATION LEVEL REPEATABLE READ");
+		ExecuteCriticalRemoteCommand(snapshotConnection, setSnapshotCommand->data);
+
+		forboth(sourceShardCell, replication->sourceShardList,
+				splitShardCell, replication->splitShardList)
+		{
+			ShardInterval *sourceShard = (ShardInterval *) lfirst(sourceShardCell);
+			ShardInterval *splitShard = (ShardInterval *) lfirst(splitShardCell);
+
+			CopySplitShardData(snapshotConnection, replication->targetConnection,
+							   sourceShard, splitShard, localCopy);
+		}
+
+		ExecuteCriticalRemoteCommand(snapshotConnection, "COMMIT");
+		CloseConnection(snapshotConnection);
+	}
+	PG_CATCH();
+	{
+		PQfinish(slotConnection);
+
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	PQfinish(slotConnection);
+
+	/* the data was already copied, so only stream changes from the slot */
+	appendStringInfo(createSubscriptionCommand,
+					 "CREATE SUBSCRIPTION %s CONNECTION %s PUBLICATION %s "
+					 "WITH (copy_data = false, create_slot = false, slot_name = %s, "
+					 "enabled = true)",
+					 quote_identifier(replication->subscriptionName),
+					 quote_literal_cstr(SourceNodeConnectionInfo(sourceNodeName,
+																 sourceNodePort)),
+					 quote_identifier(replication->publicationName),
+					 quote_literal_cstr(replication->subscriptionName));
+
+	ExecuteCriticalRemoteCommand(replication->targetConnection,
+								 createSubscriptionCommand->data);
+}
+
+
+/*
+ * CopySplitShardData copies the rows of the source shard that fall into the
+ * hash range of the given new shard, as seen by the transaction on the
+ * snapshot connection. New shards on the source node are filled with a local
+ * INSERT .. SELECT, others by relaying a COPY from the source node to the
+ * target node.
+ */
+static void
+CopySplitShardData(MultiConnection *snapshotConnection,
+				   MultiConnection *targetConnection, ShardInterval *sourceShard,
+				   ShardInterval *splitShard, bool localCopy)
+{
+	StringInfo copyCommand = makeStringInfo();
+	char *selectQuery = SplitShardSelectQuery(sourceShard, splitShard);
+	char *splitShardName = ConstructQualifiedShardName(splitShard);
+	PGconn *sourceConnection = snapshotConnection->pgConn;
+
+	if (localCopy)
+	{
+		appendStringInfo(copyCommand, "INSERT INTO %s %s", splitShardName,
+						 selectQuery);
+
+		ExecuteCriticalRemoteCommand(snapshotConnection, copyCommand->data);
+		return;
+	}
+
+	appendStringInfo(copyCommand, "COPY %s FROM STDIN", splitShardName);
+	StartRemoteCopy(targetConnection, copyCommand->data, PGRES_COPY_IN);
+
+	resetStringInfo(copyCommand);
+	appendStringInfo(copyCommand, "COPY (%s) TO STDOUT", selectQuery);
+	StartRemoteCopy(snapshotConnection, copyCommand->data, PGRES_COPY_OUT);
+
+	while (true)
+	{
+		char *receiveBuffer = NULL;
+		bool asynchronous = true;
+
+		int receiveLength = PQgetCopyData(sourceConnection, &receiveBuffer,
+										  asynchronous);
+		if (receiveLength == 0)
+		{
+			WaitForSocketReadable(PQsocket(sourceConnection));
+
+			if (PQconsumeInput(sourceConnection) == 0)
+			{
+				ReportConnectionError(snapshotConnection, ERROR);
+			}
+
+			continue;
+		}
+		else if (receiveLength == -1)
+		{
+			/* end of the copy */
+			break;
+		}
+		else if (receiveLength < 0)
+		{
+			ReportConnectionError(snapshotConnection, ERROR);
+		}
+
+		bool copySent = PutRemoteCopyData(targetConnection, receiveBuffer,
+										  receiveLength);
+		PQfreemem(receiveBuffer);
+
+		if (!copySent)
+		{
+			ReportConnectionError(targetConnection, ERROR);
+		}
+	}
+
+	FinishRemoteCopy(snapshotConnection);
+
+	if (!PutRemoteCopyEnd(targetConnection, NULL))
+	{
+		ReportConnectionError(targetConnection, ERROR);
+	}
+
+	FinishRemoteCopy(targetConnection);
+}
+
+
+/*
+ * SplitShardSelectQuery returns a query that selects the rows of the source
+ * shard that fall into the hash range of the given new shard.
+ */
+static char *
+SplitShardSelectQuery(ShardInterval *sourceShard, ShardInterval *splitShard)
+{
+	StringInfo selectQuery = makeStringInfo();
+	Oid relationId = sourceShard->relationId;
+
+	Var *distributionColumn = DistPartitionKey(relationId);
+	char *columnName = get_attname(relationId, distributionColumn->varattno, false);
+
+	appendStringInfo(selectQuery,
+					 "SELECT * FROM %s WHERE pg_catalog.worker_hash(%s) "
+					 "BETWEEN %d AND %d",
+					 ConstructQualifiedShardName(sourceShard),
+					 quote_identifier(columnName),
+					 DatumGetInt32(splitShard->minValue),
+					 DatumGetInt32(splitShard->maxValue));
+
+	return selectQuery->data;
+}
+
+
+/*
+ * FinishSplitShardReplication drops the subscription, the replication slot
+ * and the publication of the given new shards, and removes their routes from
+ * the source node.
+ */
+static void
+FinishSplitShardReplication(MultiConnection *sourceConnection,
+							SplitShardReplication *replication)
+{
+	StringInfo dropSubscriptionCommand = makeStringInfo();
+	StringInfo dropPublicationCommand = makeStringInfo();
+	StringInfo removeRoutesCommand = makeStringInfo();
+
+	/* dropping the subscription also drops its replication slot */
+	appendStringInfo(dropSubscriptionCommand, "DROP SUBSCRIPTION %s",
+					 quote_identifier(replication->subscriptionName));
+	appendStringInfo(dropPublicationCommand, "DROP PUBLICATION %s",
+					 quote_identifier(replication->publicationName));
+	appendStringInfo(removeRoutesCommand,
+					 "SELECT pg_catalog.worker_split_shard_remove_routes(%s)",
+					 quote_literal_cstr(replication->subscriptionName));
+
+	ExecuteCriticalRemoteCommand(replication->targetConnection,
+								 dropSubscriptionCommand->data);
+	ExecuteCriticalRemoteCommand(sourceConnection, dropPublicationCommand->data);
+	ExecuteCriticalRemoteCommand(sourceConnection, removeRoutesCommand->data);
+}
+
+
+/*
+ * ReplicationProtocolConnection opens a libpq connection to the given node
+ * that speaks the replication protocol, as the extension owner. Such
+ * connections are not managed by the connection cache, so the caller should
+ * close it with PQfinish, also on error.
+ */
+static PGconn *
+ReplicationProtocolConnection(char *nodeName, int nodePort)
+{
+	StringInfo connectionInfo = makeStringInfo();
+
+	appendStringInfo(connectionInfo, "%s replication=database",
+					 SourceNodeConnectionInfo(nodeName, nodePort));
+
+	PGconn *connection = PQconnectdb(connectionInfo->data);
+	if (PQstatus(connection) != CONNECTION_OK)
+	{
+		char *errorMessage = pchomp(PQerrorMessage(connection));
+
+		PQfinish(connection);
+
+		ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+						errmsg("could not open replication connection to %s:%d",
+							   nodeName, nodePort),
+						errdetail("%s", errorMessage)));
+	}
+
+	return connection;
+}
+
+
+/*
+ * ExecuteReplicationCommand runs the given replication command, which should
+ * return a single row, over the given replication connection and returns the
+ * value in the given column. The wait for the result can be cancelled.
+ */
+static char *
+ExecuteReplicationCommand(PGconn *connection, char *command, int columnIndex)
+{
+	if (!PQsendQuery(connection, command))
+	{
+		ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+						errmsg("could not send replication command"),
+						errdetail("%s", pchomp(PQerrorMessage(connection)))));
+	}
+
+	while (PQisBusy(connection))
+	{
+		WaitForSocketReadable(PQsocket(connection));
+
+		if (PQconsumeInput(connection) == 0)
+		{
+			ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+							errmsg("could not receive replication command result"),
+							errdetail("%s", pchomp(PQerrorMessage(connection)))));
+		}
+	}
+
+	PGresult *result = PQgetResult(connection);
+	if (PQresultStatus(result) != PGRES_TUPLES_OK || PQntuples(result) != 1 ||
+		PQnfields(result) <= columnIndex)
+	{
+		char *errorMessage = pchomp(PQerrorMessage(connection));
+
+		PQclear(result);
+
+		ereport(ERROR, (errmsg("replication command failed"),
+						errdetail("%s", errorMessage)));
+	}
+
+	char *value = pstrdup(PQgetvalue(result, 0, columnIndex));
+	PQclear(result);
+
+	/* consume the end of the command */
+	while ((result = PQgetResult(connection)) != NULL)
+	{
+		PQclear(result);
+	}
+
+	return value;
+}
+
+
+/*
+ * StartRemoteCopy sends the given COPY command over the given connection and
+ * checks that the node switched to the given copy mode.
+ */
+static void
+StartRemoteCopy(MultiConnection *connection, char *copyCommand,
+				ExecStatusType copyStatus)
+{
+	bool raiseInterrupts = true;
+
+	if (!SendRemoteCommand(connection, copyCommand))
+	{
+		ReportConnectionError(connection, ERROR);
+	}
+
+	PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+	if (PQresultStatus(result) != copyStatus)
+	{
+		ReportResultError(connection, result, ERROR);
+	}
+
+	PQclear(result);
+}
+
+
+/*
+ * FinishRemoteCopy waits for the result of a finished COPY over the given
+ * connection and checks that it succeeded.
+ */
+static void
+FinishRemoteCopy(MultiConnection *connection)
+{
+	bool raiseInterrupts = true;
+
+	PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+	if (!IsResponseOK(result))
+	{
+		ReportResultError(connection, result, ERROR);
+	}
+
+	PQclear(result);
+	ForgetResults(connection);
+}
+
+
+/*
+ * ExecuteRemoteQuery runs the given query, which should return a single
+ * value, over the given connection and returns the value.
+ */
+static char *
+ExecuteRemoteQuery(MultiConnection *connection, char *query)
+{
+	bool raiseInterrupts = true;
+
+	if (!SendRemoteCommand(connection, query))
+	{
+		ReportConnectionError(connection, ERROR);
+	}
+
+	PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+	if (!IsResponseOK(result))
+	{
+		ReportResultError(connection, result, ERROR);
+	}
+
+	if (PQntuples(result) != 1 || PQnfields(result) != 1)
+	{
+		ereport(ERROR, (errmsg("unexpected result from query on %s:%d",
+							   connection->hostname, connection->port),
+						errdetail("Query: %s", query)));
+	}
+
+	char *value = pstrdup(PQgetvalue(result, 0, 0));
+
+	PQclear(result);
+	ForgetResults(connection);
+
+	return value;
+}
+
+
+/*
+ * ShardMoveObjectName returns the name of a replication object used to move
+ * the given shards, which is the given prefix followed by the first shard id.
+ */
+static char *
+ShardMoveObjectName(char *prefix, List *shardIntervalList)
+{
+	ShardInterval *shardInterval = (ShardInterval *) linitial(shardIntervalList);
+	StringInfo objectName = makeStringInfo();
+
+	appendStringInfo(objectName, "%s" UINT64_FORMAT, prefix, shardInterval->shardId);
+
+	return objectName->data;
+}
+
+
+/*
+ * PublicationTableListString returns the comma separated names of the given
+ * shards to publish. Shards of partitioned tables are skipped, since their
+ * data is published through the shards of their partitions.
+ */
+static char *
+PublicationTableListString(List *shardIntervalList)
+{
+	StringInfo tableListString = makeStringInfo();
+	ListCell *shardIntervalCell = NULL;
+
+	foreach(shardIntervalCell, shardIntervalList)
+	{
+		ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
+
+		if (PartitionedTableNoLock(shardInterval->relationId))
+		{
+			continue;
+		}
+
+		if (tableListString->len > 0)
+		{
+			appendStringInfoString(tableListString, ", ");
+		}
+
+		appendStringInfoString(tableListString,
+							   ConstructQualifiedShardName(shardInterval));
+	}
+
+	return tableListString->data;
+}
+
+
+/*
+ * DropShardMoveReplicationObjects drops the subscription, the replication slot
+ * and the publication with the given names, if they exist. The subscription
+ * is detached from its slot before it is dropped, such that it can be dropped
+ * regardless of whether the slot still exists.
+ */
+static void
+DropShardMoveReplicationObjects(MultiConnection *sourceConnection,
+								MultiConnection *targetConnection,
+								char *publicationName, char *subscriptionName)
+{
+	StringInfo subscriptionExistsQuery = makeStringInfo();
+	StringInfo dropSlotCommand = makeStringInfo();
+	StringInfo dropPublicationCommand = makeStringInfo();
+
+	appendStringInfo(subscriptionExistsQuery,
+					 "SELECT count(*) FROM pg_catalog.pg_subscription "
+					 "WHERE subname = %s",
+					 quote_literal_cstr(subscriptionName));
+
+	char *subscriptionCount = ExecuteRemoteQuery(targetConnection,
+												 subscriptionExistsQuery->data);
+	if (strcmp(subscriptionCount, "0") != 0)
+	{
+		const char *quotedSubscriptionName = quote_identifier(subscriptionName);
+		StringInfo disableCommand = makeStringInfo();
+		StringInfo detachSlotCommand = makeStringInfo();
+		StringInfo dropSubscriptionCommand = makeStringInfo();
+
+		appendStringInfo(disableCommand, "ALTER SUBSCRIPTION %s DISABLE",
+						 quotedSubscriptionName);
+		appendStringInfo(detachSlotCommand,
+						 "ALTER SUBSCRIPTION %s SET (slot_name = NONE)",
+						 quotedSubscriptionName);
+		appendStringInfo(dropSubscriptionCommand, "DROP SUBSCRIPTION %s",
+						 quotedSubscriptionName);
+
+		ExecuteCriticalRemoteCommand(targetConnection, disableCommand->data);
+		ExecuteCriticalRemoteCommand(targetConnection, detachSlotCommand->data);
+		ExecuteCriticalRemoteCommand(targetConnection, dropSubscriptionCommand->data);
+	}
+
+	appendStringInfo(dropSlotCommand,
+					 "SELECT pg_catalog.pg_drop_replication_slot(slot_name) "
+					 "FROM pg_catalog.pg_replication_slots WHERE slot_name = %s",
+					 quote_literal_cstr(subscriptionName));
+	appendStringInfo(dropPublicationCommand, "DROP PUBLICATION IF EXISTS %s",
+					 quote_identifier(publicationName));
+
+	ExecuteCriticalRemoteCommand(sourceConnection, dropSlotCommand->data);
+	ExecuteCriticalRemoteCommand(sourceConnection, dropPublicationCommand->data);
+}
+
+
+/*
+ * WaitForInitialDataCopy waits until the subscription with the given name has
+ * copied the initial data of all of its tables.
+ */
+static void
+WaitForInitialDataCopy(MultiConnection *targetConnection, char *subscriptionName)
+{
+	StringInfo pendingCopyQuery = makeStringInfo();
+
+	appendStringInfo(pendingCopyQuery,
+					 "SELECT count(*) FROM pg_catalog.pg_subscription_rel r "
+					 "JOIN pg_catalog.pg_subscription s ON (r.srsubid = s.oid) "
+					 "WHERE s.subname = %s AND r.srsubstate <> 'r'",
+					 quote_literal_cstr(subscriptionName));
+
+	while (true)
+	{
+		char *pendingCopyCount = ExecuteRemoteQuery(targetConnection,
+													pendingCopyQuery->data);
+		if (strcmp(pendingCopyCount, "0") == 0)
+		{
+			break;
+		}
+
+		WaitForPollInterval();
+	}
+}
+
+
+/*
+ * WaitForReplicationCatchUp waits until the subscription with the given name
+ * has confirmed all changes made on the source node up to the time of the
+ * call.
+ */
+static void
+WaitForReplicationCatchUp(MultiConnection *sourceConnection, char *subscriptionName)
+{
+	StringInfo caughtUpQuery = makeStringInfo();
+
+	char *sourcePosition = ExecuteRemoteQuery(sourceConnection,
+											  "SELECT pg_catalog.pg_current_wal_lsn()");
+
+	appendStringInfo(caughtUpQuery,
+					 "SELECT confirmed_flush_lsn >= %s::pg_lsn "
+					 "FROM pg_catalog.pg_replication_slots WHERE slot_name = %s",
+					 quote_literal_cstr(sourcePosition),
+					 quote_literal_cstr(subscriptionName));
+
+	while (true)
+	{
+		char *caughtUp = ExecuteRemoteQuery(sourceConnection, caughtUpQuery->data);
+		if (strcmp(caughtUp, "t") == 0)
+		{
+			break;
+		}
+
+		WaitForPollInterval();
+	}
+}
+
+
+/*
+ * WaitForSocketReadable waits until the given socket becomes readable, while
+ * remaining responsive to cancellation.
+ */
+static void
+WaitForSocketReadable(pgsocket socket)
+{
+	int waitFlags = WL_LATCH_SET | WL_SOCKET_READABLE | WL_POSTMASTER_DEATH;
+
+	int rc = WaitLatchOrSocket(MyLatch, waitFlags, socket, -1L,
+							   WAIT_EVENT_CITUS_REMOTE_RESULT);
+	ResetLatch(MyLatch);
+
+	/* emergency bailout if postmaster has died */
+	if (rc & WL_POSTMASTER_DEATH)
+	{
+		proc_exit(1);
+	}
+
+	CHECK_FOR_INTERRUPTS();
+}
+
+
+/*
+ * WaitForPollInterval sleeps for LOGICAL_REPLICATION_POLL_INTERVAL_MS while
+ * remaining responsive to cancellation.
+ */
+static void
+WaitForPollInterval(void)
+{
+	int rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+					   LOGICAL_REPLICATION_POLL_INTERVAL_MS, PG_WAIT_EXTENSION);
+	ResetLatch(MyLatch);
+
+	/* emergency bailout if postmaster has died */
+	if (rc & WL_POSTMASTER_DEATH)
+	{
+		proc_exit(1);
+	}
+
+	CHECK_FOR_INTERRUPTS();
+}
@@ -4,6 +4,18 @@
  *
  * Function definitions for the shard rebalancer tool.
  *
+ * The rebalancer spreads the shard groups of co-located tables evenly over
+ * the nodes that should have shards, and moves all shards away from the
+ * nodes that should not. The cost of a node is the number of shard groups it
+ * holds or, with citus.rebalance_by_shard_access, the number of accesses of
+ * its shard groups that were counted on the coordinator. Units of
+ * citus.shard_unit_size adjacent shard groups are moved together.
+ *
+ * Each shard group move is run through master_move_shard_placement in its own
+ * transaction, over a connection to the local node, such that writes are only
+ * blocked for the shard group that is being moved. Moves that do not share a
+ * node run in parallel.
+ *
  * Copyright (c) 2019, Citus Data, Inc.
  *
  * $Id$
@@ -11,10 +23,1087 @@
  *-------------------------------------------------------------------------
  */
 
+#include "postgres.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#include <float.h>
+#include <math.h>
+
+#include "access/xact.h"
+#include "catalog/pg_type.h"
+#include "distributed/colocation_utils.h"
+#include "distributed/connection_management.h"
 #include "distributed/enterprise.h"
+#include "distributed/listutils.h"
+#include "distributed/master_metadata_utility.h"
+#include "distributed/master_protocol.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/multi_join_order.h"
+#include "distributed/multi_progress.h"
+#include "distributed/reference_table_utils.h"
+#include "distributed/remote_commands.h"
+#include "distributed/shard_access_stats.h"
+#include "distributed/task_tracker.h"
+#include "distributed/tuplestore.h"
+#include "distributed/worker_manager.h"
+#include "distributed/worker_protocol.h"
+#include "postmaster/postmaster.h"
+#include "storage/lmgr.h"
+#include "utils/builtins.h"
+#include "utils/inval.h"
+#include "utils/lsyscache.h"
+
+
+/* identifies the progress monitors of rebalance operations */
+#define REBALANCE_PROGRESS_MAGIC_NUMBER 1337
+
+/* states of a shard group move in the progress monitor */
+#define REBALANCE_PROGRESS_WAITING 0
+#define REBALANCE_PROGRESS_MOVING 1
+#define REBALANCE_PROGRESS_MOVED 2
+
+/* number of columns returned by get_rebalance_table_shards_plan */
+#define REBALANCE_PLAN_FIELDS 7
+
+/* number of columns returned by get_rebalance_progress */
+#define REBALANCE_PROGRESS_FIELDS 9
+
+
+/* RebalanceOptions holds the arguments of a rebalance operation */
+typedef struct RebalanceOptions
+{
+	List *relationIdList;       /* one table for each co-location group */
+	float4 threshold;
+	int32 maxShardMoves;
+	List *excludedShardIdList;  /* list of palloc'ed uint64 shard ids */
+	bool drainOnly;
+} RebalanceOptions;
+
+/* NodeFillState keeps the shard groups that a node holds during planning */
+typedef struct NodeFillState
+{
+	WorkerNode *node;
+	List *shardIntervalList;
+	double cost;                /* sum of the costs of the shard groups */
+} NodeFillState;
+
+/* ShardGroupSet holds the shard groups of a co-location group by shard index */
+typedef struct ShardGroupSet
+{
+	int shardCount;
+	ShardInterval **shardIntervalArray;
+	double *shardCostArray;
+} ShardGroupSet;
+
+/* PlacementUpdate describes the move of a shard group between two nodes */
+typedef struct PlacementUpdate
+{
+	ShardInterval *shardInterval;
+	uint64 shardSize;
+	WorkerNode *sourceNode;
+	WorkerNode *targetNode;
+	int progressIndex;
+} PlacementUpdate;
+
+/* PlacementUpdateProgress is a step of the progress monitor of a rebalance */
+typedef struct PlacementUpdateProgress
+{
+	Oid relationId;
+	uint64 shardId;
+	uint64 shardSize;
+	char sourceName[WORKER_LENGTH];
+	int sourcePort;
+	char targetName[WORKER_LENGTH];
+	int targetPort;
+	uint64 progress;
+} PlacementUpdateProgress;
+
+
+/* config variable managed via guc.c */
+bool RebalanceByShardAccess = false;
+
+
+/* local function forward declarations */
+static RebalanceOptions * RebalanceOptionsFromArguments(FunctionCallInfo fcinfo,
+														int drainOnlyArgument);
+static List * RebalancedRelationIdList(Oid relationId);
+static List * RebalancePlacementUpdates(RebalanceOptions *options);
+static List * ColocationGroupPlacementUpdates(Oid relationId, List *workerNodeList,
+											  RebalanceOptions *options,
+											  int maxShardMoves);
+static NodeFillState * FindNodeFillState(List *fillStateList, int32 groupId);
+static List * NextPlacementUpdates(List *fillStateList, double lowerCost,
+								   double upperCost, ShardGroupSet *shardGroupSet,
+								   RebalanceOptions *options);
+static List * MovableShardUnit(NodeFillState *sourceFillState,
+							   NodeFillState *targetFillState,
+							   ShardGroupSet *shardGroupSet, double maxUnitCost,
+							   List *excludedShardIdList);
+static bool ShardGroupExcluded(ShardInterval *shardInterval, List *excludedShardIdList);
+static double ShardGroupCost(ShardInterval *shardInterval);
+static int CompareNodeFillStatesByCost(const void *leftElement,
+									   const void *rightElement);
+static uint64 PlacementShardSize(ShardInterval *shardInterval, WorkerNode *node);
+static void RebalanceTableShards(RebalanceOptions *options, Oid shardTransferModeOid);
+static void ExecutePlacementUpdates(List *placementUpdateList, char *transferMode,
+									PlacementUpdateProgress *progressArray);
+static void ExecutePlacementUpdateBatch(List *placementUpdateList, char *transferMode,
+										PlacementUpdateProgress *progressArray);
+static MultiConnection * LocalNodeConnection(void);
 
-NOT_SUPPORTED_IN_COMMUNITY(rebalance_table_shards);
 NOT_SUPPORTED_IN_COMMUNITY(replicate_table_shards);
-NOT_SUPPORTED_IN_COMMUNITY(get_rebalance_table_shards_plan);
-NOT_SUPPORTED_IN_COMMUNITY(get_rebalance_progress);
-NOT_SUPPORTED_IN_COMMUNITY(master_drain_node);
+
+/* declarations for dynamic loading */
+PG_FUNCTION_INFO_V1(rebalance_table_shards);
+PG_FUNCTION_INFO_V1(get_rebalance_table_shards_plan);
+PG_FUNCTION_INFO_V1(get_rebalance_progress);
+PG_FUNCTION_INFO_V1(master_drain_node);
+
+
+/*
+ * rebalance_table_shards moves the shard groups of the given table, or of all
+ * distributed tables if no table is given, such that the number of shard
+ * groups of each node that should have shards is within threshold of the
+ * average, and moves all shards away from nodes that should not have shards.
+ */
+Datum
+rebalance_table_shards(PG_FUNCTION_ARGS)
+{
+	int drainOnlyArgument = 5;
+
+	EnsureCoordinator();
+	CheckCitusVersion(ERROR);
+	PreventInTransactionBlock(true, "rebalance_table_shards");
+
+	RebalanceOptions *options = RebalanceOptionsFromArguments(fcinfo,
+															  drainOnlyArgument);
+	Oid shardTransferModeOid = PG_GETARG_OID(4);
+
+	RebalanceTableShards(options, shardTransferModeOid);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * get_rebalance_table_shards_plan returns the shard group moves that
+ * rebalance_table_shards would do when called with the same arguments.
+ */
+Datum
+get_rebalance_table_shards_plan(PG_FUNCTION_ARGS)
+{
+	int drainOnlyArgument = 4;
+	ListCell *placementUpdateCell = NULL;
+	TupleDesc tupleDescriptor = NULL;
+
+	EnsureCoordinator();
+	CheckCitusVersion(ERROR);
+
+	RebalanceOptions *options = RebalanceOptionsFromArguments(fcinfo,
+															  drainOnlyArgument);
+	List *placementUpdateList = RebalancePlacementUpdates(options);
+
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	foreach(placementUpdateCell, placementUpdateList)
+	{
+		PlacementUpdate *placementUpdate = lfirst(placementUpdateCell);
+		ShardInterval *shardInterval = placementUpdate->shardInterval;
+		Datum values[REBALANCE_PLAN_FIELDS];
+		bool isNulls[REBALANCE_PLAN_FIELDS];
+
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		values[0] = ObjectIdGetDatum(shardInterval->relationId);
+		values[1] = Int64GetDatum(shardInterval->shardId);
+		values[2] = Int64GetDatum(placementUpdate->shardSize);
+		values[3] = CStringGetTextDatum(placementUpdate->sourceNode->workerName);
+		values[4] = Int32GetDatum(placementUpdate->sourceNode->workerPort);
+		values[5] = CStringGetTextDatum(placementUpdate->targetNode->workerName);
+		values[6] = Int32GetDatum(placementUpdate->targetNode->workerPort);
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	tuplestore_donestoring(tupleStore);
+
+	return (Datum) 0;
+}
+
+
+/*
+ * get_rebalance_progress returns the shard group moves of the ongoing
+ * rebalance operations, along with whether they are waiting (0), being moved
+ * (1) or moved (2).
+ */
+Datum
+get_rebalance_progress(PG_FUNCTION_ARGS)
+{
+	List *attachedDSMSegmentList = NIL;
+	ListCell *monitorCell = NULL;
+	TupleDesc tupleDescriptor = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	List *monitorList = ProgressMonitorList(REBALANCE_PROGRESS_MAGIC_NUMBER,
+											&attachedDSMSegmentList);
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	foreach(monitorCell, monitorList)
+	{
+		ProgressMonitorData *monitor = lfirst(monitorCell);
+		PlacementUpdateProgress *progressArray = monitor->steps;
+
+		for (int stepIndex = 0; stepIndex < monitor->stepCount; stepIndex++)
+		{
+			PlacementUpdateProgress *step = &progressArray[stepIndex];
+			Datum values[REBALANCE_PROGRESS_FIELDS];
+			bool isNulls[REBALANCE_PROGRESS_FIELDS];
+
+			memset(values, 0, sizeof(values));
+			memset(isNulls, false, sizeof(isNulls));
+
+			values[0] = Int32GetDatum(monitor->processId);
+			values[1] = ObjectIdGetDatum(step->relationId);
+			values[2] = Int64GetDatum(step->shardId);
+			values[3] = Int64GetDatum(step->shardSize);
+			values[4] = CStringGetTextDatum(step->sourceName);
+			values[5] = Int32GetDatum(step->sourcePort);
+			values[6] = CStringGetTextDatum(step->targetName);
+			values[7] = Int32GetDatum(step->targetPort);
+			values[8] = Int64GetDatum(step->progress);
+
+			tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+		}
+	}
+
+	tuplestore_donestoring(tupleStore);
+
+	DetachFromDSMSegments(attachedDSMSegmentList);
+
+	return (Datum) 0;
+}
+
+
+/*
+ * master_drain_node marks the given node as a node that should not have shards
+ * and moves all shards of distributed tables away from it.
+ */
+Datum
+master_drain_node(PG_FUNCTION_ARGS)
+{
+	text *nodeNameText = PG_GETARG_TEXT_P(0);
+	int32 nodePort = PG_GETARG_INT32(1);
+	Oid shardTransferModeOid = PG_GETARG_OID(2);
+	char *nodeName = text_to_cstring(nodeNameText);
+	StringInfo setPropertyCommand = makeStringInfo();
+
+	EnsureCoordinator();
+	CheckCitusVersion(ERROR);
+	PreventInTransactionBlock(true, "master_drain_node");
+
+	if (FindWorkerNode(nodeName, nodePort) == NULL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("node at \"%s:%u\" does not exist", nodeName,
+							   nodePort)));
+	}
+
+	/*
+	 * The shard moves run in separate transactions, so commit the property
+	 * change first and make sure that we see it ourselves.
+	 */
+	appendStringInfo(setPropertyCommand,
+					 "SELECT pg_catalog.master_set_node_property(%s, %d, "
+					 "'shouldhaveshards', false)",
+					 quote_literal_cstr(nodeName), nodePort);
+
+	MultiConnection *connection = LocalNodeConnection();
+	ExecuteCriticalRemoteCommand(connection, setPropertyCommand->data);
+	CloseConnection(connection);
+
+	AcceptInvalidationMessages();
+
+	RebalanceOptions *options = palloc0(sizeof(RebalanceOptions));
+	options->relationIdList = RebalancedRelationIdList(InvalidOid);
+	options->threshold = 0;
+	options->maxShardMoves = PG_INT32_MAX;
+	options->excludedShardIdList = NIL;
+	options->drainOnly = true;
+
+	RebalanceTableShards(options, shardTransferModeOid);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * RebalanceOptionsFromArguments reads the relation, threshold,
+ * max_shard_moves, excluded_shard_list and drain_only arguments shared by
+ * rebalance_table_shards and get_rebalance_table_shards_plan. Only the
+ * position of the drain_only argument differs between the two.
+ */
+static RebalanceOptions *
+RebalanceOptionsFromArguments(FunctionCallInfo fcinfo, int drainOnlyArgument)
+{
+	RebalanceOptions *options = palloc0(sizeof(RebalanceOptions));
+	Oid relationId = PG_ARGISNULL(0) ? InvalidOid : PG_GETARG_OID(0);
+
+	options->relationIdList = RebalancedRelationIdList(relationId);
+	options->threshold = PG_ARGISNULL(1) ? 0 : PG_GETARG_FLOAT4(1);
+	options->maxShardMoves = PG_ARGISNULL(2) ? PG_INT32_MAX : PG_GETARG_INT32(2);
+	options->drainOnly = PG_ARGISNULL(drainOnlyArgument) ? false :
+						 PG_GETARG_BOOL(drainOnlyArgument);
+
+	if (options->threshold < 0 || options->threshold > 1)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("threshold must be between 0 and 1")));
+	}
+
+	if (!PG_ARGISNULL(3))
+	{
+		ArrayType *excludedShardArray = PG_GETARG_ARRAYTYPE_P(3);
+		int excludedShardCount = ArrayObjectCount(excludedShardArray);
+		Datum *excludedShardDatumArray = DeconstructArrayObject(excludedShardArray);
+
+		for (int shardIndex = 0; shardIndex < excludedShardCount; shardIndex++)
+		{
+			uint64 *shardIdPointer = palloc0(sizeof(uint64));
+			*shardIdPointer = DatumGetInt64(excludedShardDatumArray[shardIndex]);
+
+			options->excludedShardIdList = lappend(options->excludedShardIdList,
+												   shardIdPointer);
+		}
+	}
+
+	return options;
+}
+
+
+/*
+ * RebalancedRelationIdList returns the tables whose shard groups are
+ * rebalanced, one table for each co-location group. If no relation is given,
+ * all distributed tables except reference tables are rebalanced.
+ */
+static List *
+RebalancedRelationIdList(Oid relationId)
+{
+	List *relationIdList = NIL;
+	List *colocationIdList = NIL;
+	ListCell *cacheEntryCell = NULL;
+
+	if (OidIsValid(relationId))
+	{
+		EnsureTableOwner(relationId);
+
+		if (PartitionMethod(relationId) == DISTRIBUTE_BY_NONE)
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("cannot rebalance shards of a reference table"),
+							errdetail("Reference tables have a placement on every "
+									  "node.")));
+		}
+
+		/* prevent the table from being dropped while planning */
+		LockRelationOid(relationId, AccessShareLock);
+
+		return list_make1_oid(relationId);
+	}
+
+	List *distributedTableList = DistributedTableList();
+
+	foreach(cacheEntryCell, distributedTableList)
+	{
+		DistTableCacheEntry *cacheEntry = lfirst(cacheEntryCell);
+		uint32 colocationId = cacheEntry->colocationId;
+
+		if (cacheEntry->partitionMethod == DISTRIBUTE_BY_NONE)
+		{
+			continue;
+		}
+
+		if (colocationId != INVALID_COLOCATION_ID)
+		{
+			if (list_member_int(colocationIdList, colocationId))
+			{
+				continue;
+			}
+
+			colocationIdList = lappend_int(colocationIdList, colocationId);
+		}
+
+		LockRelationOid(cacheEntry->relationId, AccessShareLock);
+
+		relationIdList = lappend_oid(relationIdList, cacheEntry->relationId);
+	}
+
+	return SortList(relationIdList, CompareOids);
+}
+
+
+/*
+ * RebalancePlacementUpdates plans the shard group moves of a rebalance
+ * operation with the given options.
+ */
+static List *
+RebalancePlacementUpdates(RebalanceOptions *options)
+{
+	List *placementUpdateList = NIL;
+	ListCell *relationIdCell = NULL;
+
+	List *workerNodeList = ActivePrimaryWorkerNodeList(NoLock);
+	workerNodeList = SortList(workerNodeList, CompareWorkerNodes);
+
+	foreach(relationIdCell, options->relationIdList)
+	{
+		Oid relationId = lfirst_oid(relationIdCell);
+		int remainingShardMoves = options->maxShardMoves -
+								  list_length(placementUpdateList);
+
+		if (remainingShardMoves <= 0)
+		{
+			break;
+		}
+
+		List *groupUpdateList = ColocationGroupPlacementUpdates(relationId,
+																workerNodeList,
+																options,
+																remainingShardMoves);
+		placementUpdateList = list_concat(placementUpdateList, groupUpdateList);
+	}
+
+	return placementUpdateList;
+}
+
+
+/*
+ * ColocationGroupPlacementUpdates plans at most maxShardMoves shard group
+ * moves for the co-location group of the given table. Shard groups are moved
+ * greedily from the node with the highest cost to the node with the lowest,
+ * until all nodes are within threshold of the average and the nodes that
+ * should not have shards are empty.
+ */
+static List *
+ColocationGroupPlacementUpdates(Oid relationId, List *workerNodeList,
+								RebalanceOptions *options, int maxShardMoves)
+{
+	List *fillStateList = NIL;
+	List *placementUpdateList = NIL;
+	ListCell *workerNodeCell = NULL;
+	ListCell *shardIntervalCell = NULL;
+	int targetNodeCount = 0;
+	double totalCost = 0.0;
+
+	foreach(workerNodeCell, workerNodeList)
+	{
+		WorkerNode *workerNode = lfirst(workerNodeCell);
+		NodeFillState *fillState = palloc0(sizeof(NodeFillState));
+
+		fillState->node = workerNode;
+		fillStateList = lappend(fillStateList, fillState);
+
+		if (workerNode->shouldHaveShards)
+		{
+			targetNodeCount++;
+		}
+	}
+
+	if (targetNodeCount == 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+						errmsg("there are no active primary nodes that should "
+							   "have shards"),
+						errhint("Use master_set_node_property to set the "
+								"shouldhaveshards property of a node.")));
+	}
+
+	List *shardIntervalList = LoadShardIntervalList(relationId);
+	int shardCount = list_length(shardIntervalList);
+
+	ShardGroupSet *shardGroupSet = palloc0(sizeof(ShardGroupSet));
+	shardGroupSet->shardCount = shardCount;
+	shardGroupSet->shardIntervalArray = palloc0(shardCount * sizeof(ShardInterval *));
+	shardGroupSet->shardCostArray = palloc0(shardCount * sizeof(double));
+
+	foreach(shardIntervalCell, shardIntervalList)
+	{
+		ShardInterval *shardInterval = lfirst(shardIntervalCell);
+		List *placementList = FinalizedShardPlacementList(shardInterval->shardId);
+		ListCell *placementCell = NULL;
+		double shardCost = ShardGroupCost(shardInterval);
+
+		shardGroupSet->shardIntervalArray[shardInterval->shardIndex] = shardInterval;
+		shardGroupSet->shardCostArray[shardInterval->shardIndex] = shardCost;
+
+		foreach(placementCell, placementList)
+		{
+			ShardPlacement *placement = lfirst(placementCell);
+			NodeFillState *fillState = FindNodeFillState(fillStateList,
+														 placement->groupId);
+
+			/* placements on other nodes cannot be moved */
+			if (fillState == NULL)
+			{
+				continue;
+			}
+
+			fillState->shardIntervalList = lappend(fillState->shardIntervalList,
+												   shardInterval);
+			fillState->cost += shardCost;
+			totalCost += shardCost;
+		}
+	}
+
+	double averageCost = totalCost / targetNodeCount;
+	double upperCost = ceil(averageCost * (1 + options->threshold));
+	double lowerCost = floor(averageCost * (1 - options->threshold));
+
+	while (list_length(placementUpdateList) < maxShardMoves)
+	{
+		List *unitUpdateList = NextPlacementUpdates(fillStateList, lowerCost, upperCost,
+													shardGroupSet, options);
+		if (unitUpdateList == NIL)
+		{
+			break;
+		}
+
+		placementUpdateList = list_concat(placementUpdateList, unitUpdateList);
+	}
+
+	return placementUpdateList;
+}
+
+
+/*
+ * FindNodeFillState returns the fill state of the node in the given group,
+ * or NULL if there is none.
+ */
+static NodeFillState *
+FindNodeFillState(List *fillStateList, int32 groupId)
+{
+	ListCell *fillStateCell = NULL;
+
+	foreach(fillStateCell, fillStateList)
+	{
+		NodeFillState *fillState = lfirst(fillStateCell);
+
+		if (fillState->node->groupId == groupId)
+		{
+			return fillState;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * NextPlacementUpdates picks the next shard unit move and applies it to the
+ * fill states, or returns NIL if no move improves the balance. A unit is a
+ * single shard group unless citus.shard_unit_size is set, and the returned
+ * list has a move for each of its shard groups. Units are not split, so the
+ * maximum number of moves can be exceeded by less than a unit.
+ *
+ * Nodes that should not have shards are emptied first. Otherwise, a unit is
+ * moved from the costliest node to the cheapest one if either is outside the
+ * bounds and the move narrows the gap between them.
+ */
+static List *
+NextPlacementUpdates(List *fillStateList, double lowerCost, double upperCost,
+					 ShardGroupSet *shardGroupSet, RebalanceOptions *options)
+{
+	List *sortedFillStateList = SortList(fillStateList, CompareNodeFillStatesByCost);
+	int fillStateCount = list_length(sortedFillStateList);
+
+	for (int sourceIndex = 0; sourceIndex < fillStateCount; sourceIndex++)
+	{
+		NodeFillState *sourceFillState = list_nth(sortedFillStateList, sourceIndex);
+		WorkerNode *sourceNode = sourceFillState->node;
+		double sourceCost = sourceFillState->cost;
+
+		if (sourceFillState->shardIntervalList == NIL)
+		{
+			break;
+		}
+
+		if (sourceNode->shouldHaveShards && options->drainOnly)
+		{
+			continue;
+		}
+
+		for (int targetIndex = fillStateCount - 1; targetIndex >= 0; targetIndex--)
+		{
+			NodeFillState *targetFillState = list_nth(sortedFillStateList,
+													  targetIndex);
+			double targetCost = targetFillState->cost;
+			double maxUnitCost = DBL_MAX;
+			ListCell *unitShardCell = NULL;
+			List *placementUpdateList = NIL;
+
+			if (targetFillState == sourceFillState ||
+				!targetFillState->node->shouldHaveShards)
+			{
+				continue;
+			}
+
+			if (sourceNode->shouldHaveShards)
+			{
+				bool outOfBounds = sourceCost > upperCost || targetCost < lowerCost;
+
+				/* targets are sorted, so the other targets are no better */
+				if (!outOfBounds)
+				{
+					break;
+				}
+
+				/* the move should narrow the gap between the nodes */
+				maxUnitCost = sourceCost - targetCost;
+			}
+
+			List *unitShardList = MovableShardUnit(sourceFillState, targetFillState,
+												   shardGroupSet, maxUnitCost,
+												   options->excludedShardIdList);
+			if (unitShardList == NIL)
+			{
+				continue;
+			}
+
+			foreach(unitShardCell, unitShardList)
+			{
+				ShardInterval *shardInterval = lfirst(unitShardCell);
+				int shardIndex = shardInterval->shardIndex;
+				double shardCost = shardGroupSet->shardCostArray[shardIndex];
+
+				PlacementUpdate *placementUpdate = palloc0(sizeof(PlacementUpdate));
+				placementUpdate->shardInterval = shardInterval;
+				placementUpdate->shardSize = PlacementShardSize(shardInterval,
+																sourceNode);
+				placementUpdate->sourceNode = sourceNode;
+				placementUpdate->targetNode = targetFillState->node;
+
+				sourceFillState->shardIntervalList =
+					list_delete_ptr(sourceFillState->shardIntervalList, shardInterval);
+				sourceFillState->cost -= shardCost;
+				targetFillState->shardIntervalList =
+					lappend(targetFillState->shardIntervalList, shardInterval);
+				targetFillState->cost += shardCost;
+
+				placementUpdateList = lappend(placementUpdateList, placementUpdate);
+			}
+
+			return placementUpdateList;
+		}
+	}
+
+	return NIL;
+}
+
+
+/*
+ * MovableShardUnit returns the movable shards of the first unit of the source
+ * node whose movable shards together cost less than maxUnitCost, or NIL if
+ * there is none. A unit consists of citus.shard_unit_size adjacent shards,
+ * and a shard is movable if it has no placement on the target node and it is
+ * not excluded from moves. Units are considered in the order in which the
+ * source node got their first shard.
+ */
+static List *
+MovableShardUnit(NodeFillState *sourceFillState, NodeFillState *targetFillState,
+				 ShardGroupSet *shardGroupSet, double maxUnitCost,
+				 List *excludedShardIdList)
+{
+	ListCell *shardIntervalCell = NULL;
+	int shardCount = shardGroupSet->shardCount;
+	bool *sourceShardArray = palloc0(shardCount * sizeof(bool));
+	bool *checkedUnitArray = palloc0(shardCount * sizeof(bool));
+
+	foreach(shardIntervalCell, sourceFillState->shardIntervalList)
+	{
+		ShardInterval *shardInterval = lfirst(shardIntervalCell);
+
+		sourceShardArray[shardInterval->shardIndex] = true;
+	}
+
+	foreach(shardIntervalCell, sourceFillState->shardIntervalList)
+	{
+		ShardInterval *shardInterval = lfirst(shardIntervalCell);
+		int unitIndex = shardInterval->shardIndex / ShardUnitSize;
+		int unitStartIndex = unitIndex * ShardUnitSize;
+		int unitEndIndex = Min(unitStartIndex + ShardUnitSize, shardCount);
+		List *unitShardList = NIL;
+		double unitCost = 0.0;
+
+		if (checkedUnitArray[unitIndex])
+		{
+			continue;
+		}
+
+		checkedUnitArray[unitIndex] = true;
+
+		for (int shardIndex = unitStartIndex; shardIndex < unitEndIndex; shardIndex++)
+		{
+			ShardInterval *unitShard = shardGroupSet->shardIntervalArray[shardIndex];
+
+			if (!sourceShardArray[shardIndex])
+			{
+				continue;
+			}
+
+			if (list_member_ptr(targetFillState->shardIntervalList, unitShard))
+			{
+				continue;
+			}
+
+			if (ShardGroupExcluded(unitShard, excludedShardIdList))
+			{
+				continue;
+			}
+
+			unitShardList = lappend(unitShardList, unitShard);
+			unitCost += shardGroupSet->shardCostArray[shardIndex];
+		}
+
+		if (unitShardList != NIL && unitCost < maxUnitCost)
+		{
+			return unitShardList;
+		}
+	}
+
+	return NIL;
+}
+
+
+/*
+ * ShardGroupExcluded returns whether the given shard or any of its
+ * co-located shards appears in the given list of excluded shard ids.
+ */
+static bool
+ShardGroupExcluded(ShardInterval *shardInterval, List *excludedShardIdList)
+{
+	ListCell *colocatedShardCell = NULL;
+
+	if (excludedShardIdList == NIL)
+	{
+		return false;
+	}
+
+	List *colocatedShardList = ColocatedShardIntervalList(shardInterval);
+
+	foreach(colocatedShardCell, colocatedShardList)
+	{
+		ShardInterval *colocatedShard = lfirst(colocatedShardCell);
+		ListCell *excludedShardIdCell = NULL;
+
+		foreach(excludedShardIdCell, excludedShardIdList)
+		{
+			uint64 *excludedShardId = lfirst(excludedShardIdCell);
+
+			if (*excludedShardId == colocatedShard->shardId)
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * ShardGroupCost returns the cost of the shard group of the given shard. It is
+ * 1 unless citus.rebalance_by_shard_access is enabled, in which case it is the
+ * number of accesses of the co-located shards that were counted on this node.
+ * Shard groups that were not accessed still cost 1, such that they are spread
+ * evenly as well.
+ */
+static double
+ShardGroupCost(ShardInterval *shardInterval)
+{
+	ListCell *colocatedShardCell = NULL;
+	uint64 accessCount = 0;
+
+	if (!RebalanceByShardAccess)
+	{
+		return 1.0;
+	}
+
+	List *colocatedShardList = ColocatedShardIntervalList(shardInterval);
+
+	foreach(colocatedShardCell, colocatedShardList)
+	{
+		ShardInterval *colocatedShard = lfirst(colocatedShardCell);
+
+		accessCount += ShardAccessCount(colocatedShard->shardId);
+	}
+
+	return Max(1.0, (double) accessCount);
+}
+
+
+/*
+ * CompareNodeFillStatesByCost orders nodes that should not have shards first,
+ * followed by the other nodes with the highest cost first. Ties are broken by
+ * node id to keep plans deterministic.
+ */
+static int
+CompareNodeFillStatesByCost(const void *leftElement, const void *rightElement)
+{
+	NodeFillState *leftFillState = *((NodeFillState **) leftElement);
+	NodeFillState *rightFillState = *((NodeFillState **) rightElement);
+
+	if (leftFillState->node->shouldHaveShards != rightFillState->node->shouldHaveShards)
+	{
+		return leftFillState->node->shouldHaveShards ? 1 : -1;
+	}
+
+	if (leftFillState->cost != rightFillState->cost)
+	{
+		return leftFillState->cost > rightFillState->cost ? -1 : 1;
+	}
+
+	if (leftFillState->node->nodeId < rightFillState->node->nodeId)
+	{
+		return -1;
+	}
+	else if (leftFillState->node->nodeId > rightFillState->node->nodeId)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * PlacementShardSize returns the size of the placement of the given shard on
+ * the given node as recorded in pg_dist_placement.
+ */
+static uint64
+PlacementShardSize(ShardInterval *shardInterval, WorkerNode *node)
+{
+	List *placementList = ShardPlacementList(shardInterval->shardId);
+	bool missingOk = true;
+
+	ShardPlacement *placement = SearchShardPlacementInList(placementList,
+														   node->workerName,
+														   node->workerPort,
+														   missingOk);
+	if (placement == NULL)
+	{
+		return 0;
+	}
+
+	return placement->shardLength;
+}
+
+
+/*
+ * RebalanceTableShards plans and runs the shard group moves of a rebalance
+ * operation, reporting their progress through a progress monitor.
+ */
+static void
+RebalanceTableShards(RebalanceOptions *options, Oid shardTransferModeOid)
+{
+	ListCell *placementUpdateCell = NULL;
+	Oid progressRelationId = InvalidOid;
+	PlacementUpdateProgress *progressArray = NULL;
+	int progressIndex = 0;
+
+	Datum transferModeDatum = DirectFunctionCall1(enum_out, shardTransferModeOid);
+	char *transferMode = DatumGetCString(transferModeDatum);
+
+	List *placementUpdateList = RebalancePlacementUpdates(options);
+	int placementUpdateCount = list_length(placementUpdateList);
+
+	if (placementUpdateCount == 0)
+	{
+		return;
+	}
+
+	if (list_length(options->relationIdList) == 1)
+	{
+		progressRelationId = linitial_oid(options->relationIdList);
+	}
+
+	ProgressMonitorData *monitor =
+		CreateProgressMonitor(REBALANCE_PROGRESS_MAGIC_NUMBER, placementUpdateCount,
+							  sizeof(PlacementUpdateProgress), progressRelationId);
+	if (monitor != NULL)
+	{
+		progressArray = (PlacementUpdateProgress *) monitor->steps;
+	}
+
+	foreach(placementUpdateCell, placementUpdateList)
+	{
+		PlacementUpdate *placementUpdate = lfirst(placementUpdateCell);
+
+		placementUpdate->progressIndex = progressIndex;
+
+		if (progressArray != NULL)
+		{
+			PlacementUpdateProgress *step = &progressArray[progressIndex];
+
+			step->relationId = placementUpdate->shardInterval->relationId;
+			step->shardId = placementUpdate->shardInterval->shardId;
+			step->shardSize = placementUpdate->shardSize;
+			strlcpy(step->sourceName, placementUpdate->sourceNode->workerName,
+					WORKER_LENGTH);
+			step->sourcePort = placementUpdate->sourceNode->workerPort;
+			strlcpy(step->targetName, placementUpdate->targetNode->workerName,
+					WORKER_LENGTH);
+			step->targetPort = placementUpdate->targetNode->workerPort;
+			step->progress = REBALANCE_PROGRESS_WAITING;
+		}
+
+		progressIndex++;
+	}
+
+	ExecutePlacementUpdates(placementUpdateList, transferMode, progressArray);
+
+	if (monitor != NULL)
+	{
+		FinalizeCurrentProgressMonitor();
+	}
+}
+
+
+/*
+ * ExecutePlacementUpdates runs the given shard group moves in batches of moves
+ * that do not share a source or a target node, such that the moves in a batch
+ * can run in parallel without competing for the same node.
+ */
+static void
+ExecutePlacementUpdates(List *placementUpdateList, char *transferMode,
+						PlacementUpdateProgress *progressArray)
+{
+	List *remainingUpdateList = placementUpdateList;
+
+	while (remainingUpdateList != NIL)
+	{
+		List *batchUpdateList = NIL;
+		List *deferredUpdateList = NIL;
+		List *busyNodeIdList = NIL;
+		ListCell *placementUpdateCell = NULL;
+
+		foreach(placementUpdateCell, remainingUpdateList)
+		{
+			PlacementUpdate *placementUpdate = lfirst(placementUpdateCell);
+			int sourceNodeId = placementUpdate->sourceNode->nodeId;
+			int targetNodeId = placementUpdate->targetNode->nodeId;
+
+			if (list_member_int(busyNodeIdList, sourceNodeId) ||
+				list_member_int(busyNodeIdList, targetNodeId))
+			{
+				deferredUpdateList = lappend(deferredUpdateList, placementUpdate);
+				continue;
+			}
+
+			batchUpdateList = lappend(batchUpdateList, placementUpdate);
+			busyNodeIdList = lappend_int(busyNodeIdList, sourceNodeId);
+			busyNodeIdList = lappend_int(busyNodeIdList, targetNodeId);
+		}
+
+		ExecutePlacementUpdateBatch(batchUpdateList, transferMode, progressArray);
+
+		remainingUpdateList = deferredUpdateList;
+	}
+}
+
+
+/*
+ * ExecutePlacementUpdateBatch runs master_move_shard_placement for each of the
+ * given shard group moves over its own connection to the local node, and
+ * waits for all of them to finish. Each move commits independently, and an
+ * error in any of them is rethrown.
+ */
+static void
+ExecutePlacementUpdateBatch(List *placementUpdateList, char *transferMode,
+							PlacementUpdateProgress *progressArray)
+{
+	List *connectionList = NIL;
+	ListCell *placementUpdateCell = NULL;
+	ListCell *connectionCell = NULL;
+	bool raiseInterrupts = true;
+
+	foreach(placementUpdateCell, placementUpdateList)
+	{
+		PlacementUpdate *placementUpdate = lfirst(placementUpdateCell);
+		WorkerNode *sourceNode = placementUpdate->sourceNode;
+		WorkerNode *targetNode = placementUpdate->targetNode;
+		StringInfo moveCommand = makeStringInfo();
+
+		appendStringInfo(moveCommand,
+						 "SELECT pg_catalog.master_move_shard_placement("
+						 UINT64_FORMAT ", %s, %u, %s, %u, %s)",
+						 placementUpdate->shardInterval->shardId,
+						 quote_literal_cstr(sourceNode->workerName),
+						 sourceNode->workerPort,
+						 quote_literal_cstr(targetNode->workerName),
+						 targetNode->workerPort,
+						 quote_literal_cstr(transferMode));
+
+		MultiConnection *connection = LocalNodeConnection();
+		if (!SendRemoteCommand(connection, moveCommand->data))
+		{
+			ReportConnectionError(connection, ERROR);
+		}
+
+		if (progressArray != NULL)
+		{
+			progressArray[placementUpdate->progressIndex].progress =
+				REBALANCE_PROGRESS_MOVING;
+		}
+
+		connectionList = lappend(connectionList, connection);
+	}
+
+	forboth(placementUpdateCell, placementUpdateList, connectionCell, connectionList)
+	{
+		PlacementUpdate *placementUpdate = lfirst(placementUpdateCell);
+		MultiConnection *connection = lfirst(connectionCell);
+
+		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+		if (!IsResponseOK(result))
+		{
+			ReportResultError(connection, result, ERROR);
+		}
+
+		PQclear(result);
+		ForgetResults(connection);
+		CloseConnection(connection);
+
+		if (progressArray != NULL)
+		{
+			progressArray[placementUpdate->progressIndex].progress =
+				REBALANCE_PROGRESS_MOVED;
+		}
+	}
+}
+
+
+/*
+ * LocalNodeConnection opens a new connection to the local node as the
+ * current user, to run commands outside of the current transaction.
+ */
+static MultiConnection *
+LocalNodeConnection(void)
+{
+	int connectionFlags = FORCE_NEW_CONNECTION;
+	char *userName = CurrentUserName();
+	char *databaseName = CurrentDatabaseName();
+
+	MultiConnection *connection =
+		GetNodeUserDatabaseConnection(connectionFlags, LOCAL_HOST_NAME,
+									  PostPortNumber, userName, databaseName);
+
+	if (PQstatus(connection->pgConn) != CONNECTION_OK)
+	{
+		ReportConnectionError(connection, ERROR);
+	}
+
+	return connection;
+}
@@ -15,9 +15,13 @@
 #include "miscadmin.h"
 
 #include "commands/dbcommands.h"
+#include "distributed/connection_management.h"
 #include "distributed/hash_helpers.h"
+#include "distributed/listutils.h"
+#include "distributed/master_metadata_utility.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_client_executor.h"
+#include "distributed/remote_commands.h"
 #include "distributed/worker_manager.h"
 #include "libpq/hba.h"
 #include "common/ip.h"
@@ -27,14 +31,51 @@
 #include "storage/ipc.h"
 #include "storage/lmgr.h"
 #include "storage/shmem.h"
+#include "utils/builtins.h"
 #include "utils/guc.h"
 #include "utils/hsearch.h"
 #include "utils/memutils.h"
+#include "utils/timestamp.h"
+
+
+/*
+ * Interval in milliseconds during which a measured replay lag of a secondary
+ * is reused, such that not every read-only query probes the secondaries.
+ */
+#define SECONDARY_REPLAY_LAG_CHECK_INTERVAL 1000
+
+/* a secondary that replayed all the WAL it received is not lagging behind */
+#define SECONDARY_REPLAY_LAG_QUERY \
+	"SELECT CASE WHEN pg_last_wal_receive_lsn() = pg_last_wal_replay_lsn() " \
+	"THEN 0 ELSE (extract(epoch FROM now() - pg_last_xact_replay_timestamp()) " \
+	"* 1000)::bigint END"
+
+/* disk space used by the database on a node, for least-utilized placement */
+#define NODE_DISK_USAGE_QUERY \
+	"SELECT pg_catalog.pg_database_size(pg_catalog.current_database())"
+
+
+/* replay lag of a secondary, as last measured by this backend */
+typedef struct SecondaryReplayLag
+{
+	uint32 nodeId;          /* hash key, must be the first field */
+	TimestampTz checkTime;  /* time of the last measurement */
+	bool lagKnown;          /* whether the last measurement succeeded */
+	int64 replayLag;        /* replay lag in milliseconds */
+} SecondaryReplayLag;
 
 
 /* Config variables managed via guc.c */
 char *WorkerListFileName;
 int MaxWorkerNodesTracked = 2048;    /* determines worker node hash table size */
+int MaxSecondaryReplayLag = -1;      /* in milliseconds, -1 means no bound */
+
+
+/* replay lags of the secondaries, created on first use */
+static HTAB *SecondaryReplayLagHash = NULL;
+
+/* used to spread read-only tasks over the secondaries of a group */
+static uint32 SecondaryNodeRoundRobinCounter = 0;
 
 
 /* Local functions forward declarations */
@@ -46,6 +87,9 @@ static bool OddNumber(uint32 number);
 static bool ListMember(List *currentList, WorkerNode *workerNode);
 static bool NodeIsPrimaryWorker(WorkerNode *node);
 static bool NodeIsReadableWorker(WorkerNode *node);
+static bool SecondaryReplayLagWithinBound(WorkerNode *workerNode);
+static bool MeasureSecondaryReplayLag(WorkerNode *workerNode, int64 *replayLag);
+static List * NodeDiskUsageList(List *workerNodeList);
 
 
 /* ------------------------------------------------------------
@@ -202,6 +246,188 @@ WorkerGetLocalFirstCandidateNode(List *currentNodeList)
 }
 
 
+/*
+ * NodeUtilizationList returns the estimated utilization of each of the given
+ * worker nodes, for use by WorkerGetLeastUtilizedCandidateNode. The estimate
+ * of a node is the disk space used by the database on the node, plus the
+ * average size of a placement in the cluster for each placement on the node.
+ * Counting the placements as well makes sure that placements which do not
+ * hold much data yet, such as those that were just created, also count
+ * towards the utilization of a node.
+ */
+List *
+NodeUtilizationList(List *workerNodeList)
+{
+	List *utilizationList = NIL;
+	uint64 totalDiskUsage = 0;
+	uint64 totalPlacementCount = 0;
+
+	List *diskUsageList = NodeDiskUsageList(workerNodeList);
+
+	ListCell *workerNodeCell = NULL;
+	ListCell *diskUsageCell = NULL;
+	forboth(workerNodeCell, workerNodeList, diskUsageCell, diskUsageList)
+	{
+		WorkerNode *workerNode = (WorkerNode *) lfirst(workerNodeCell);
+		uint64 *diskUsage = (uint64 *) lfirst(diskUsageCell);
+		List *placementList = AllShardPlacementsOnNodeGroup(workerNode->groupId);
+
+		NodeUtilization *utilization = palloc0(sizeof(NodeUtilization));
+		utilization->workerNode = workerNode;
+		utilization->diskUsage = *diskUsage;
+		utilization->placementCount = list_length(placementList);
+
+		totalDiskUsage += utilization->diskUsage;
+		totalPlacementCount += utilization->placementCount;
+
+		utilizationList = lappend(utilizationList, utilization);
+	}
+
+	/* count placements as 1 byte when there is no data, to break ties */
+	uint64 averagePlacementSize = 1;
+	if (totalPlacementCount > 0 && totalDiskUsage / totalPlacementCount > 0)
+	{
+		averagePlacementSize = totalDiskUsage / totalPlacementCount;
+	}
+
+	NodeUtilization *utilization = NULL;
+	foreach_ptr(utilization, utilizationList)
+	{
+		utilization->placementSize = averagePlacementSize;
+		utilization->estimatedSize = utilization->diskUsage +
+									 utilization->placementCount * averagePlacementSize;
+	}
+
+	return utilizationList;
+}
+
+
+/*
+ * WorkerGetLeastUtilizedCandidateNode takes in a list of node utilizations as
+ * returned by NodeUtilizationList and returns the node with the lowest
+ * estimated utilization that is not in the current node list. Since the
+ * returned node gets a new placement, its estimated utilization is increased
+ * by the average size of a placement, such that subsequent calls take the new
+ * placement into account.
+ *
+ * Note that the function returns null if all nodes are in the current list.
+ */
+WorkerNode *
+WorkerGetLeastUtilizedCandidateNode(List *utilizationList, List *currentNodeList)
+{
+	NodeUtilization *leastUtilized = NULL;
+	NodeUtilization *utilization = NULL;
+
+	foreach_ptr(utilization, utilizationList)
+	{
+		if (ListMember(currentNodeList, utilization->workerNode))
+		{
+			continue;
+		}
+
+		if (leastUtilized == NULL ||
+			utilization->estimatedSize < leastUtilized->estimatedSize)
+		{
+			leastUtilized = utilization;
+		}
+	}
+
+	if (leastUtilized == NULL)
+	{
+		return NULL;
+	}
+
+	leastUtilized->estimatedSize += leastUtilized->placementSize;
+
+	return leastUtilized->workerNode;
+}
+
+
+/*
+ * LeastUtilizedNodeList returns the given number of distinct nodes with the
+ * lowest estimated utilization, in order of increasing utilization, and
+ * accounts for a new placement on each of them.
+ */
+List *
+LeastUtilizedNodeList(List *utilizationList, int nodeCount)
+{
+	List *nodeList = NIL;
+
+	for (int nodeIndex = 0; nodeIndex < nodeCount; nodeIndex++)
+	{
+		WorkerNode *workerNode = WorkerGetLeastUtilizedCandidateNode(utilizationList,
+																	 nodeList);
+		if (workerNode == NULL)
+		{
+			break;
+		}
+
+		nodeList = lappend(nodeList, workerNode);
+	}
+
+	return nodeList;
+}
+
+
+/*
+ * NodeDiskUsageList returns the disk space used by the database on each of the
+ * given nodes, in the same order as the nodes. The nodes are queried in
+ * parallel.
+ */
+static List *
+NodeDiskUsageList(List *workerNodeList)
+{
+	List *connectionList = NIL;
+	List *diskUsageList = NIL;
+	WorkerNode *workerNode = NULL;
+	MultiConnection *connection = NULL;
+	uint32 connectionFlag = 0;
+	bool raiseInterrupts = true;
+	bool raiseErrors = true;
+
+	foreach_ptr(workerNode, workerNodeList)
+	{
+		connection = StartNodeConnection(connectionFlag, workerNode->workerName,
+										 workerNode->workerPort);
+
+		connectionList = lappend(connectionList, connection);
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	foreach_ptr(connection, connectionList)
+	{
+		if (PQstatus(connection->pgConn) != CONNECTION_OK ||
+			!SendRemoteCommand(connection, NODE_DISK_USAGE_QUERY))
+		{
+			ReportConnectionError(connection, ERROR);
+		}
+	}
+
+	foreach_ptr(connection, connectionList)
+	{
+		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+		if (!IsResponseOK(result))
+		{
+			ReportResultError(connection, result, ERROR);
+		}
+
+		List *diskUsageStringList = ReadFirstColumnAsText(result);
+		StringInfo diskUsageString = (StringInfo) linitial(diskUsageStringList);
+
+		uint64 *diskUsage = palloc0(sizeof(uint64));
+		*diskUsage = pg_strtouint64(diskUsageString->data, NULL, 10);
+
+		diskUsageList = lappend(diskUsageList, diskUsage);
+
+		PQclear(result);
+		ClearResults(connection, raiseErrors);
+	}
+
+	return diskUsageList;
+}
+
+
 /*
  * ClientHostAddress appends the connecting client's fully qualified hostname
  * to the given StringInfo. If there is no such connection or the connection is
@@ -473,6 +699,133 @@ NodeIsReadableWorker(WorkerNode *node)
 }
 
 
+/*
+ * ReadableSecondaryNodeForGroup returns a secondary of the given group that
+ * read-only tasks can be sent to when citus.use_secondary_nodes is 'prefer',
+ * or NULL if the group has no such secondary. Secondaries that are more than
+ * citus.max_secondary_replay_lag behind their primary are skipped, and the
+ * remaining ones are picked in turn to balance the reads across them.
+ */
+WorkerNode *
+ReadableSecondaryNodeForGroup(int32 groupId)
+{
+	List *candidateNodeList = NIL;
+	List *secondaryNodeList = FilterActiveNodeListFunc(NoLock, NodeIsSecondary);
+	WorkerNode *workerNode = NULL;
+
+	foreach_ptr(workerNode, secondaryNodeList)
+	{
+		if (workerNode->groupId != groupId)
+		{
+			continue;
+		}
+
+		if (!SecondaryReplayLagWithinBound(workerNode))
+		{
+			continue;
+		}
+
+		candidateNodeList = lappend(candidateNodeList, workerNode);
+	}
+
+	int candidateNodeCount = list_length(candidateNodeList);
+	if (candidateNodeCount == 0)
+	{
+		return NULL;
+	}
+
+	uint32 candidateIndex = SecondaryNodeRoundRobinCounter++ % candidateNodeCount;
+
+	return (WorkerNode *) list_nth(candidateNodeList, candidateIndex);
+}
+
+
+/*
+ * SecondaryReplayLagWithinBound returns whether the replay lag of the given
+ * secondary is within citus.max_secondary_replay_lag. The lag is measured
+ * at most once per SECONDARY_REPLAY_LAG_CHECK_INTERVAL, and secondaries whose
+ * lag could not be measured are considered to be too far behind.
+ */
+static bool
+SecondaryReplayLagWithinBound(WorkerNode *workerNode)
+{
+	bool found = false;
+
+	if (MaxSecondaryReplayLag < 0)
+	{
+		return true;
+	}
+
+	if (SecondaryReplayLagHash == NULL)
+	{
+		HASHCTL info;
+
+		memset(&info, 0, sizeof(info));
+		info.keysize = sizeof(uint32);
+		info.entrysize = sizeof(SecondaryReplayLag);
+		info.hcxt = TopMemoryContext;
+		uint32 hashFlags = (HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+		SecondaryReplayLagHash = hash_create("citus secondary replay lag", 32, &info,
+											 hashFlags);
+	}
+
+	SecondaryReplayLag *replayLag =
+		(SecondaryReplayLag *) hash_search(SecondaryReplayLagHash, &workerNode->nodeId,
+										   HASH_ENTER, &found);
+
+	TimestampTz now = GetCurrentTimestamp();
+	if (!found || TimestampDifferenceExceeds(replayLag->checkTime, now,
+											 SECONDARY_REPLAY_LAG_CHECK_INTERVAL))
+	{
+		replayLag->lagKnown = MeasureSecondaryReplayLag(workerNode,
+														&replayLag->replayLag);
+		replayLag->checkTime = now;
+	}
+
+	return replayLag->lagKnown && replayLag->replayLag <= MaxSecondaryReplayLag;
+}
+
+
+/*
+ * MeasureSecondaryReplayLag queries the replay lag of the given secondary over
+ * a dedicated connection, such that the probe does not interfere with the
+ * connections of the ongoing execution. The function returns false if the lag
+ * could not be determined.
+ */
+static bool
+MeasureSecondaryReplayLag(WorkerNode *workerNode, int64 *replayLag)
+{
+	PGresult *result = NULL;
+	bool raiseErrors = false;
+	bool lagKnown = false;
+
+	MultiConnection *connection = GetNodeConnection(FORCE_NEW_CONNECTION,
+													workerNode->workerName,
+													workerNode->workerPort);
+
+	int queryResult = ExecuteOptionalRemoteCommand(connection,
+												   SECONDARY_REPLAY_LAG_QUERY,
+												   &result);
+	if (queryResult == RESPONSE_OKAY && PQntuples(result) == 1 &&
+		!PQgetisnull(result, 0, 0))
+	{
+		*replayLag = strtoll(PQgetvalue(result, 0, 0), NULL, 10);
+		lagKnown = true;
+	}
+
+	if (result != NULL)
+	{
+		PQclear(result);
+		ClearResults(connection, raiseErrors);
+	}
+
+	CloseConnection(connection);
+
+	return lagKnown;
+}
+
+
 /*
  * PrimaryNodesNotInList scans through the worker node hash and returns a list of all
  * primary nodes which are not in currentList. It runs in O(n*m) but currentList is
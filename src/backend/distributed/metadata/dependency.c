@@ -16,15 +16,23 @@
 #include "access/skey.h"
 #include "catalog/dependency.h"
 #include "catalog/indexing.h"
+#include "catalog/pg_authid.h"
 #include "catalog/pg_class.h"
+#include "catalog/pg_collation.h"
 #include "catalog/pg_depend.h"
+#include "catalog/pg_namespace.h"
+#include "catalog/pg_proc.h"
 #include "catalog/pg_type.h"
 #include "distributed/commands/utility_hook.h"
+#include "distributed/listutils.h"
 #include "distributed/metadata/dependency.h"
 #include "distributed/metadata/distobject.h"
 #include "utils/fmgroids.h"
 #include "utils/hsearch.h"
+#include "utils/inval.h"
 #include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/syscache.h"
 
 /*
  * ObjectAddressCollector keeps track of collected ObjectAddresses. This can be used
@@ -44,6 +52,42 @@ typedef struct ObjectAddressCollector
 } ObjectAddressCollector;
 
 
+/*
+ * DependencyCacheEntry keeps the pg_depend entries of a single object, so that
+ * repeated walks over the same part of the dependency graph (e.g. when creating
+ * thousands of functions on the same types and schemas) do not rescan pg_depend.
+ *
+ * Entries are invalidated when the syscache entry (or relcache entry) of their
+ * object is invalidated, since every command that changes the dependencies of an
+ * object also updates its catalog row.
+ */
+typedef struct DependencyCacheEntry
+{
+	/* lookup key - must be first, objectSubId is always 0 */
+	ObjectAddress address;
+
+	/* syscache the object belongs to and the hash value of the object in it */
+	int cacheId;
+	uint32 hashValue;
+
+	/* list of Form_pg_depend, allocated in DependencyCacheContext */
+	List *pgDependEntries;
+} DependencyCacheEntry;
+
+
+/* config variable managed via guc.c */
+bool EnableDependencyCache = false;
+
+static HTAB *DependencyCacheHash = NULL;
+static MemoryContext DependencyCacheContext = NULL;
+
+/*
+ * DependencyCacheInvalidationCount is bumped by every invalidation, such that we
+ * do not cache entries that got invalidated while scanning pg_depend.
+ */
+static uint64 DependencyCacheInvalidationCount = 0;
+
+
 /* forward declarations for functions to interact with the ObjectAddressCollector */
 static void InitObjectAddressCollector(ObjectAddressCollector *collector);
 static void CollectObjectAddress(ObjectAddressCollector *collector, const
@@ -73,6 +117,17 @@ static void ApplyAddToDependencyList(ObjectAddressCollector *collector,
 static List * ExpandCitusSupportedTypes(ObjectAddressCollector *collector,
 										const ObjectAddress *target);
 
+/* forward declarations of functions to interact with the dependency cache */
+static List * PgDependEntriesForObject(const ObjectAddress *target);
+static List * ScanPgDependEntries(const ObjectAddress *target);
+static List * CopyPgDependEntryList(List *pgDependEntries);
+static void InitializeDependencyCache(void);
+static int DependencyCacheSysCacheId(Oid classId);
+static void InvalidateDependencyCacheCallback(Datum argument, int cacheId,
+											  uint32 hashValue);
+static void InvalidateDependencyCacheRelationCallback(Datum argument,
+													  Oid relationId);
+
 
 /*
  * GetDependenciesForObject returns a list of ObjectAddesses to be created in order
@@ -170,9 +225,6 @@ recurse_pg_depend(const ObjectAddress *target,
 				  void (*apply)(ObjectAddressCollector *collector, Form_pg_depend row),
 				  ObjectAddressCollector *collector)
 {
-	ScanKeyData key[2];
-	HeapTuple depTup = NULL;
-	List *pgDependEntries = NIL;
 	ListCell *pgDependCell = NULL;
 
 	if (TargetObjectVisited(collector, target))
@@ -186,28 +238,7 @@ recurse_pg_depend(const ObjectAddress *target,
 	/*
 	 * iterate the actual pg_depend catalog
 	 */
-	Relation depRel = heap_open(DependRelationId, AccessShareLock);
-
-	/* scan pg_depend for classid = $1 AND objid = $2 using pg_depend_depender_index */
-	ScanKeyInit(&key[0], Anum_pg_depend_classid, BTEqualStrategyNumber, F_OIDEQ,
-				ObjectIdGetDatum(target->classId));
-	ScanKeyInit(&key[1], Anum_pg_depend_objid, BTEqualStrategyNumber, F_OIDEQ,
-				ObjectIdGetDatum(target->objectId));
-	SysScanDesc depScan = systable_beginscan(depRel, DependDependerIndexId, true, NULL, 2,
-											 key);
-
-	while (HeapTupleIsValid(depTup = systable_getnext(depScan)))
-	{
-		Form_pg_depend pg_depend = (Form_pg_depend) GETSTRUCT(depTup);
-		Form_pg_depend pg_depend_copy = palloc0(sizeof(FormData_pg_depend));
-
-		*pg_depend_copy = *pg_depend;
-
-		pgDependEntries = lappend(pgDependEntries, pg_depend_copy);
-	}
-
-	systable_endscan(depScan);
-	relation_close(depRel, AccessShareLock);
+	List *pgDependEntries = PgDependEntriesForObject(target);
 
 	/*
 	 * concat expended entries if applicable
@@ -248,6 +279,316 @@ recurse_pg_depend(const ObjectAddress *target,
 }
 
 
+/*
+ * PgDependEntriesForObject returns a list of copies of the pg_depend entries of
+ * the target object. When citus.enable_dependency_cache is set, the entries are
+ * served from (and added to) a backend-local cache.
+ *
+ * The returned list is always allocated in the current memory context, since the
+ * cached entries might be invalidated while the caller recurses into them.
+ */
+static List *
+PgDependEntriesForObject(const ObjectAddress *target)
+{
+	ObjectAddress key = { 0 };
+	bool found = false;
+
+	int cacheId = DependencyCacheSysCacheId(target->classId);
+	if (!EnableDependencyCache || cacheId < 0)
+	{
+		return ScanPgDependEntries(target);
+	}
+
+	if (DependencyCacheHash == NULL)
+	{
+		InitializeDependencyCache();
+	}
+
+	/* pg_depend is scanned for all sub objects, hence the key ignores objectSubId */
+	ObjectAddressSet(key, target->classId, target->objectId);
+
+	/* make sure we see the changes of concurrent and earlier commands */
+	AcceptInvalidationMessages();
+
+	DependencyCacheEntry *cacheEntry = hash_search(DependencyCacheHash, &key,
+												   HASH_FIND, &found);
+	if (found)
+	{
+		return CopyPgDependEntryList(cacheEntry->pgDependEntries);
+	}
+
+	uint64 invalidationCount = DependencyCacheInvalidationCount;
+	List *pgDependEntries = ScanPgDependEntries(target);
+
+	if (invalidationCount != DependencyCacheInvalidationCount)
+	{
+		/* the entry might have been invalidated during the scan, do not cache it */
+		return pgDependEntries;
+	}
+
+	cacheEntry = hash_search(DependencyCacheHash, &key, HASH_ENTER, &found);
+	cacheEntry->cacheId = cacheId;
+	cacheEntry->hashValue = GetSysCacheHashValue1(cacheId,
+												  ObjectIdGetDatum(target->objectId));
+
+	MemoryContext oldContext = MemoryContextSwitchTo(DependencyCacheContext);
+	cacheEntry->pgDependEntries = CopyPgDependEntryList(pgDependEntries);
+	MemoryContextSwitchTo(oldContext);
+
+	return pgDependEntries;
+}
+
+
+/*
+ * ScanPgDependEntries scans pg_depend for the entries of the target object and
+ * returns a list of copies of them.
+ */
+static List *
+ScanPgDependEntries(const ObjectAddress *target)
+{
+	ScanKeyData key[2];
+	HeapTuple depTup = NULL;
+	List *pgDependEntries = NIL;
+
+	Relation depRel = heap_open(DependRelationId, AccessShareLock);
+
+	/* scan pg_depend for classid = $1 AND objid = $2 using pg_depend_depender_index */
+	ScanKeyInit(&key[0], Anum_pg_depend_classid, BTEqualStrategyNumber, F_OIDEQ,
+				ObjectIdGetDatum(target->classId));
+	ScanKeyInit(&key[1], Anum_pg_depend_objid, BTEqualStrategyNumber, F_OIDEQ,
+				ObjectIdGetDatum(target->objectId));
+	SysScanDesc depScan = systable_beginscan(depRel, DependDependerIndexId, true, NULL, 2,
+											 key);
+
+	while (HeapTupleIsValid(depTup = systable_getnext(depScan)))
+	{
+		Form_pg_depend pg_depend = (Form_pg_depend) GETSTRUCT(depTup);
+		Form_pg_depend pg_depend_copy = palloc0(sizeof(FormData_pg_depend));
+
+		*pg_depend_copy = *pg_depend;
+
+		pgDependEntries = lappend(pgDependEntries, pg_depend_copy);
+	}
+
+	systable_endscan(depScan);
+	relation_close(depRel, AccessShareLock);
+
+	return pgDependEntries;
+}
+
+
+/*
+ * CopyPgDependEntryList returns a copy of a list of Form_pg_depend entries in the
+ * current memory context.
+ */
+static List *
+CopyPgDependEntryList(List *pgDependEntries)
+{
+	List *copiedEntries = NIL;
+	Form_pg_depend pg_depend = NULL;
+
+	foreach_ptr(pg_depend, pgDependEntries)
+	{
+		Form_pg_depend pg_depend_copy = palloc0(sizeof(FormData_pg_depend));
+
+		*pg_depend_copy = *pg_depend;
+
+		copiedEntries = lappend(copiedEntries, pg_depend_copy);
+	}
+
+	return copiedEntries;
+}
+
+
+/*
+ * InitializeDependencyCache creates the dependency cache and registers the
+ * invalidation callbacks of the syscaches of the objects we cache. Callbacks
+ * cannot be unregistered, hence they are only registered on first use.
+ */
+static void
+InitializeDependencyCache(void)
+{
+	static bool registeredCallbacks = false;
+	HASHCTL info;
+
+	if (DependencyCacheContext == NULL)
+	{
+		DependencyCacheContext = AllocSetContextCreate(CacheMemoryContext,
+													   "DependencyCacheContext",
+													   ALLOCSET_DEFAULT_SIZES);
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(ObjectAddress);
+	info.entrysize = sizeof(DependencyCacheEntry);
+	info.hash = tag_hash;
+	info.hcxt = DependencyCacheContext;
+	uint32 hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+
+	DependencyCacheHash = hash_create("citus dependency cache", 64, &info, hashFlags);
+
+	if (!registeredCallbacks)
+	{
+		CacheRegisterSyscacheCallback(RELOID, InvalidateDependencyCacheCallback,
+									  (Datum) 0);
+		CacheRegisterSyscacheCallback(TYPEOID, InvalidateDependencyCacheCallback,
+									  (Datum) 0);
+		CacheRegisterSyscacheCallback(PROCOID, InvalidateDependencyCacheCallback,
+									  (Datum) 0);
+		CacheRegisterSyscacheCallback(NAMESPACEOID, InvalidateDependencyCacheCallback,
+									  (Datum) 0);
+		CacheRegisterSyscacheCallback(COLLOID, InvalidateDependencyCacheCallback,
+									  (Datum) 0);
+		CacheRegisterSyscacheCallback(AUTHOID, InvalidateDependencyCacheCallback,
+									  (Datum) 0);
+		CacheRegisterRelcacheCallback(InvalidateDependencyCacheRelationCallback,
+									  (Datum) 0);
+
+		registeredCallbacks = true;
+	}
+}
+
+
+/*
+ * DependencyCacheSysCacheId returns the id of the syscache that is invalidated
+ * whenever an object of the given catalog changes, or -1 if we do not cache the
+ * dependencies of objects in that catalog.
+ */
+static int
+DependencyCacheSysCacheId(Oid classId)
+{
+	switch (classId)
+	{
+		case RelationRelationId:
+		{
+			return RELOID;
+		}
+
+		case TypeRelationId:
+		{
+			return TYPEOID;
+		}
+
+		case ProcedureRelationId:
+		{
+			return PROCOID;
+		}
+
+		case NamespaceRelationId:
+		{
+			return NAMESPACEOID;
+		}
+
+		case CollationRelationId:
+		{
+			return COLLOID;
+		}
+
+		case AuthIdRelationId:
+		{
+			return AUTHOID;
+		}
+
+		default:
+		{
+			return -1;
+		}
+	}
+}
+
+
+/*
+ * InvalidateDependencyCacheCallback removes the cached pg_depend entries of the
+ * object whose syscache entry got invalidated. A hash value of 0 means that all
+ * entries of the syscache are invalidated.
+ */
+static void
+InvalidateDependencyCacheCallback(Datum argument, int cacheId, uint32 hashValue)
+{
+	DependencyCacheEntry *cacheEntry = NULL;
+	HASH_SEQ_STATUS status;
+
+	DependencyCacheInvalidationCount++;
+
+	if (DependencyCacheHash == NULL)
+	{
+		return;
+	}
+
+	hash_seq_init(&status, DependencyCacheHash);
+
+	while ((cacheEntry = (DependencyCacheEntry *) hash_seq_search(&status)) != NULL)
+	{
+		if (cacheEntry->cacheId != cacheId ||
+			(hashValue != 0 && cacheEntry->hashValue != hashValue))
+		{
+			continue;
+		}
+
+		list_free_deep(cacheEntry->pgDependEntries);
+		hash_search(DependencyCacheHash, &cacheEntry->address, HASH_REMOVE, NULL);
+	}
+}
+
+
+/*
+ * InvalidateDependencyCacheRelationCallback removes the cached pg_depend entries
+ * of a relation when its relcache entry is invalidated, since for instance
+ * changing the type of a column does not necessarily update pg_class. An
+ * InvalidOid relation invalidates the whole cache.
+ */
+static void
+InvalidateDependencyCacheRelationCallback(Datum argument, Oid relationId)
+{
+	ObjectAddress key = { 0 };
+	bool found = false;
+
+	if (relationId == InvalidOid)
+	{
+		ResetDependencyCache();
+		return;
+	}
+
+	DependencyCacheInvalidationCount++;
+
+	if (DependencyCacheHash == NULL)
+	{
+		return;
+	}
+
+	ObjectAddressSet(key, RelationRelationId, relationId);
+
+	DependencyCacheEntry *cacheEntry = hash_search(DependencyCacheHash, &key,
+												   HASH_FIND, &found);
+	if (found)
+	{
+		list_free_deep(cacheEntry->pgDependEntries);
+		hash_search(DependencyCacheHash, &key, HASH_REMOVE, NULL);
+	}
+}
+
+
+/*
+ * ResetDependencyCache drops all entries of the dependency cache. It is called
+ * whenever the distributed object cache gets invalidated as a whole.
+ */
+void
+ResetDependencyCache(void)
+{
+	DependencyCacheInvalidationCount++;
+
+	if (DependencyCacheHash == NULL)
+	{
+		return;
+	}
+
+	hash_destroy(DependencyCacheHash);
+	DependencyCacheHash = NULL;
+
+	MemoryContextReset(DependencyCacheContext);
+}
+
+
 /*
  * InitObjectAddressCollector takes a pointer to an already allocated (possibly stack)
  * ObjectAddressCollector struct. It makes sure this struct is ready to be used for object
@@ -25,6 +25,7 @@
 #include "catalog/pg_type.h"
 #include "citus_version.h"
 #include "commands/extension.h"
+#include "distributed/metadata/dependency.h"
 #include "distributed/metadata/distobject.h"
 #include "distributed/metadata/pg_dist_object.h"
 #include "distributed/metadata_cache.h"
@@ -246,7 +247,8 @@ UnmarkObjectDistributed(const ObjectAddress *address)
 
 /*
  * IsObjectDistributed returns if the object addressed is already distributed in the
- * cluster. This performs a local indexed lookup in pg_dist_object.
+ * cluster. This performs a local indexed lookup in pg_dist_object, or uses the
+ * distributed object cache when citus.enable_dependency_cache is set.
  */
 bool
 IsObjectDistributed(const ObjectAddress *address)
@@ -254,6 +256,15 @@ IsObjectDistributed(const ObjectAddress *address)
 	ScanKeyData key[3];
 	bool result = false;
 
+	if (EnableDependencyCache)
+	{
+		DistObjectCacheEntry *cacheEntry =
+			LookupDistObjectCacheEntry(address->classId, address->objectId,
+									   address->objectSubId);
+
+		return cacheEntry != NULL && cacheEntry->isDistributed;
+	}
+
 	Relation pgDistObjectRel = heap_open(DistObjectRelationId(), AccessShareLock);
 
 	/* scan pg_dist_object for classid = $1 AND objid = $2 AND objsubid = $3 via index */
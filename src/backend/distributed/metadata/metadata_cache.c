@@ -34,6 +34,7 @@
 #include "distributed/function_utils.h"
 #include "distributed/foreign_key_relationship.h"
 #include "distributed/master_metadata_utility.h"
+#include "distributed/metadata/dependency.h"
 #include "distributed/metadata/pg_dist_object.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_executor.h"
@@ -43,7 +44,10 @@
 #include "distributed/pg_dist_partition.h"
 #include "distributed/pg_dist_shard.h"
 #include "distributed/pg_dist_placement.h"
+#include "distributed/remote_prepared_statements.h"
 #include "distributed/shared_library_init.h"
+#include "distributed/shared_metadata_cache.h"
+#include "distributed/shard_pruning.h"
 #include "distributed/shardinterval_utils.h"
 #include "distributed/version_compat.h"
 #include "distributed/worker_manager.h"
@@ -189,6 +193,14 @@ static ShardCacheEntry * LookupShardCacheEntry(int64 shardId);
 static DistTableCacheEntry * LookupDistTableCacheEntry(Oid relationId);
 static void BuildDistTableCacheEntry(DistTableCacheEntry *cacheEntry);
 static void BuildCachedShardList(DistTableCacheEntry *cacheEntry);
+static void BuildShardValueArrays(DistTableCacheEntry *cacheEntry);
+static void BuildMaxValuePrefixIndexArray(DistTableCacheEntry *cacheEntry);
+static bool RefreshDistTableCacheEntry(DistTableCacheEntry *cacheEntry);
+static void MarkChangedShardPlacementsStale(void);
+static bool DistPartitionTupleMatches(DistTableCacheEntry *cacheEntry);
+static bool DistShardTuplesMatch(DistTableCacheEntry *cacheEntry);
+static void LoadShardPlacementArray(DistTableCacheEntry *cacheEntry, int shardIndex);
+static void BuildForeignKeyRelationLists(DistTableCacheEntry *cacheEntry);
 static ShardInterval ** SortShardIntervalArray(ShardInterval **shardIntervalArray,
 											   int shardCount,
 											   FmgrInfo *
@@ -199,6 +211,8 @@ static bool HasUninitializedShardInterval(ShardInterval **sortedShardIntervalArr
 static bool CheckInstalledVersion(int elevel);
 static char * AvailableExtensionVersion(void);
 static char * InstalledExtensionVersion(void);
+static int * BuildHashTokenShardIndexArray(ShardInterval **sortedShardIntervalArray,
+										   int shardCount);
 static bool HasOverlappingShardInterval(ShardInterval **shardIntervalArray,
 										int shardIntervalArrayLength,
 										FmgrInfo *shardIntervalSortCompareFunction);
@@ -403,6 +417,28 @@ RelationIdForShard(uint64 shardId)
 }
 
 
+/*
+ * RelationIdForShardIfExists returns the relationId of the given shardId, or
+ * InvalidOid if the shard does not exist.
+ */
+Oid
+RelationIdForShardIfExists(uint64 shardId)
+{
+	bool foundInCache = false;
+
+	InitializeCaches();
+
+	hash_search(DistShardCacheHash, &shardId, HASH_FIND, &foundInCache);
+
+	if (!foundInCache && !OidIsValid(LookupShardRelation(shardId, true)))
+	{
+		return InvalidOid;
+	}
+
+	return RelationIdForShard(shardId);
+}
+
+
 /*
  * ReferenceTableShardId returns true if the given shardId belongs to
  * a reference table.
@@ -432,10 +468,10 @@ LoadGroupShardPlacement(uint64 shardId, uint64 placementId)
 	/* the offset better be in a valid range */
 	Assert(shardEntry->shardIndex < tableEntry->shardIntervalArrayLength);
 
+	int numberOfPlacements = 0;
 	GroupShardPlacement *placementArray =
-		tableEntry->arrayOfPlacementArrays[shardEntry->shardIndex];
-	int numberOfPlacements =
-		tableEntry->arrayOfPlacementArrayLengths[shardEntry->shardIndex];
+		CachedShardPlacementArray(tableEntry, shardEntry->shardIndex,
+								  &numberOfPlacements);
 
 	for (int i = 0; i < numberOfPlacements; i++)
 	{
@@ -481,10 +517,10 @@ FindShardPlacementOnGroup(int32 groupId, uint64 shardId)
 
 	ShardCacheEntry *shardEntry = LookupShardCacheEntry(shardId);
 	DistTableCacheEntry *tableEntry = shardEntry->tableEntry;
+	int numberOfPlacements = 0;
 	GroupShardPlacement *placementArray =
-		tableEntry->arrayOfPlacementArrays[shardEntry->shardIndex];
-	int numberOfPlacements =
-		tableEntry->arrayOfPlacementArrayLengths[shardEntry->shardIndex];
+		CachedShardPlacementArray(tableEntry, shardEntry->shardIndex,
+								  &numberOfPlacements);
 
 	for (int placementIndex = 0; placementIndex < numberOfPlacements; placementIndex++)
 	{
@@ -615,6 +651,7 @@ LookupNodeForGroup(int32 groupId)
 	switch (ReadFromSecondaries)
 	{
 		case USE_SECONDARY_NODES_NEVER:
+		case USE_SECONDARY_NODES_PREFER:
 		{
 			ereport(ERROR, (errmsg("node group %d does not have a primary node",
 								   groupId)));
@@ -655,10 +692,10 @@ ShardPlacementList(uint64 shardId)
 	/* the offset better be in a valid range */
 	Assert(shardEntry->shardIndex < tableEntry->shardIntervalArrayLength);
 
+	int numberOfPlacements = 0;
 	GroupShardPlacement *placementArray =
-		tableEntry->arrayOfPlacementArrays[shardEntry->shardIndex];
-	int numberOfPlacements =
-		tableEntry->arrayOfPlacementArrayLengths[shardEntry->shardIndex];
+		CachedShardPlacementArray(tableEntry, shardEntry->shardIndex,
+								  &numberOfPlacements);
 
 	for (int i = 0; i < numberOfPlacements; i++)
 	{
@@ -850,6 +887,22 @@ LookupDistTableCacheEntry(Oid relationId)
 			return cacheEntry;
 		}
 
+		/* see BuildDistTableCacheEntry for why we hold interrupts */
+		HOLD_INTERRUPTS();
+
+		bool entryRefreshed = RefreshDistTableCacheEntry(cacheEntry);
+		if (entryRefreshed)
+		{
+			cacheEntry->isValid = true;
+		}
+
+		RESUME_INTERRUPTS();
+
+		if (entryRefreshed)
+		{
+			return cacheEntry;
+		}
+
 		/* free the content of old, invalid, entries */
 		ResetDistTableCacheEntry(cacheEntry);
 	}
@@ -1073,17 +1126,83 @@ BuildDistTableCacheEntry(DistTableCacheEntry *cacheEntry)
 
 		cacheEntry->hashFunction = hashFunction;
 
+		if (cacheEntry->shardIntervalArrayLength > 0)
+		{
+			BuildShardValueArrays(cacheEntry);
+		}
+
 		/* check the shard distribution for hash partitioned tables */
 		cacheEntry->hasUniformHashDistribution =
 			HasUniformHashDistribution(cacheEntry->sortedShardIntervalArray,
 									   cacheEntry->shardIntervalArrayLength);
+
+		if (!cacheEntry->hasUniformHashDistribution &&
+			!cacheEntry->hasOverlappingShardInterval &&
+			cacheEntry->shardIntervalArrayLength > 0)
+		{
+			cacheEntry->hashTokenShardIndexArray =
+				BuildHashTokenShardIndexArray(cacheEntry->sortedShardIntervalArray,
+											  cacheEntry->shardIntervalArrayLength);
+		}
 	}
 	else
 	{
 		cacheEntry->hashFunction = NULL;
 	}
 
-	oldContext = MemoryContextSwitchTo(MetadataCacheMemoryContext);
+	BuildForeignKeyRelationLists(cacheEntry);
+
+	heap_close(pgDistPartition, NoLock);
+}
+
+
+/*
+ * BuildShardValueArrays copies the hash token ranges of the sorted shard
+ * intervals of a hash distributed table into contiguous arrays, which the
+ * shard lookups search instead of dereferencing each ShardInterval.
+ */
+static void
+BuildShardValueArrays(DistTableCacheEntry *cacheEntry)
+{
+	int shardCount = cacheEntry->shardIntervalArrayLength;
+
+	int32 *minValueArray = MemoryContextAllocZero(MetadataCacheMemoryContext,
+												  shardCount * sizeof(int32));
+	int32 *maxValueArray = MemoryContextAllocZero(MetadataCacheMemoryContext,
+												  shardCount * sizeof(int32));
+
+	for (int shardIndex = 0; shardIndex < shardCount; shardIndex++)
+	{
+		ShardInterval *shardInterval = cacheEntry->sortedShardIntervalArray[shardIndex];
+
+		minValueArray[shardIndex] = DatumGetInt32(shardInterval->minValue);
+		maxValueArray[shardIndex] = DatumGetInt32(shardInterval->maxValue);
+	}
+
+	cacheEntry->sortedShardMinValueArray = minValueArray;
+	cacheEntry->sortedShardMaxValueArray = maxValueArray;
+}
+
+
+/*
+ * BuildForeignKeyRelationLists (re-)builds the lists of relations that the
+ * table of the cache entry is connected to via foreign keys.
+ */
+static void
+BuildForeignKeyRelationLists(DistTableCacheEntry *cacheEntry)
+{
+	if (cacheEntry->referencedRelationsViaForeignKey)
+	{
+		list_free(cacheEntry->referencedRelationsViaForeignKey);
+		cacheEntry->referencedRelationsViaForeignKey = NIL;
+	}
+	if (cacheEntry->referencingRelationsViaForeignKey)
+	{
+		list_free(cacheEntry->referencingRelationsViaForeignKey);
+		cacheEntry->referencingRelationsViaForeignKey = NIL;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(MetadataCacheMemoryContext);
 
 	cacheEntry->referencedRelationsViaForeignKey = ReferencedRelationIdList(
 		cacheEntry->relationId);
@@ -1091,8 +1210,320 @@ BuildDistTableCacheEntry(DistTableCacheEntry *cacheEntry)
 		cacheEntry->relationId);
 
 	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * RefreshDistTableCacheEntry revalidates an invalidated cache entry without
+ * rebuilding its shard intervals if neither the pg_dist_partition row nor
+ * the pg_dist_shard rows of the table changed, which is the common case when
+ * shards are moved or their statistics are updated. In that case, only the
+ * placements of the shards that LogShardPlacementChange logged are marked
+ * stale, and CachedShardPlacementArray reloads them when they are accessed.
+ * The function returns false if the entry needs to be rebuilt from scratch.
+ */
+static bool
+RefreshDistTableCacheEntry(DistTableCacheEntry *cacheEntry)
+{
+	if (!cacheEntry->isDistributedTable)
+	{
+		return false;
+	}
 
+	/*
+	 * Read the log before the catalogs, such that the placements we reload
+	 * are at least as recent as the changes we get from the log.
+	 */
+	MarkChangedShardPlacementsStale();
+
+	if (!DistPartitionTupleMatches(cacheEntry) || !DistShardTuplesMatch(cacheEntry))
+	{
+		return false;
+	}
+
+	BuildForeignKeyRelationLists(cacheEntry);
+
+	return true;
+}
+
+
+/*
+ * MarkChangedShardPlacementsStale marks the cached placements of the shards
+ * that were logged by LogShardPlacementChange as stale, such that they are
+ * reloaded when they are accessed next.
+ */
+static void
+MarkChangedShardPlacementsStale(void)
+{
+	int changedShardCount = 0;
+	bool allShardsChanged = false;
+
+	uint64 *changedShardIdArray = ReadShardPlacementChanges(&changedShardCount,
+															&allShardsChanged);
+
+	if (allShardsChanged)
+	{
+		DistTableCacheEntry *cacheEntry = NULL;
+		HASH_SEQ_STATUS status;
+
+		hash_seq_init(&status, DistTableCacheHash);
+
+		while ((cacheEntry = (DistTableCacheEntry *) hash_seq_search(&status)) != NULL)
+		{
+			for (int shardIndex = 0; shardIndex < cacheEntry->shardIntervalArrayLength;
+				 shardIndex++)
+			{
+				cacheEntry->arrayOfPlacementArrayIsStale[shardIndex] = true;
+			}
+		}
+	}
+
+	for (int changeIndex = 0; changeIndex < changedShardCount; changeIndex++)
+	{
+		uint64 shardId = changedShardIdArray[changeIndex];
+		bool foundInCache = false;
+
+		ShardCacheEntry *shardEntry = hash_search(DistShardCacheHash, &shardId,
+												  HASH_FIND, &foundInCache);
+		if (foundInCache)
+		{
+			DistTableCacheEntry *tableEntry = shardEntry->tableEntry;
+
+			tableEntry->arrayOfPlacementArrayIsStale[shardEntry->shardIndex] = true;
+		}
+	}
+
+	if (changedShardIdArray != NULL)
+	{
+		pfree(changedShardIdArray);
+	}
+}
+
+
+/*
+ * DistPartitionTupleMatches returns whether the pg_dist_partition row of the
+ * table still matches the cache entry.
+ */
+static bool
+DistPartitionTupleMatches(DistTableCacheEntry *cacheEntry)
+{
+	Datum datumArray[Natts_pg_dist_partition];
+	bool isNullArray[Natts_pg_dist_partition];
+	bool tupleMatches = true;
+
+	Relation pgDistPartition = heap_open(DistPartitionRelationId(), AccessShareLock);
+	HeapTuple distPartitionTuple =
+		LookupDistPartitionTuple(pgDistPartition, cacheEntry->relationId);
+
+	if (distPartitionTuple == NULL)
+	{
+		heap_close(pgDistPartition, NoLock);
+		return false;
+	}
+
+	TupleDesc tupleDescriptor = RelationGetDescr(pgDistPartition);
+	heap_deform_tuple(distPartitionTuple, tupleDescriptor, datumArray, isNullArray);
+
+	char partitionMethod =
+		DatumGetChar(datumArray[Anum_pg_dist_partition_partmethod - 1]);
+	if (partitionMethod != cacheEntry->partitionMethod)
+	{
+		tupleMatches = false;
+	}
+
+	if (isNullArray[Anum_pg_dist_partition_partkey - 1])
+	{
+		if (cacheEntry->partitionKeyString != NULL)
+		{
+			tupleMatches = false;
+		}
+	}
+	else
+	{
+		char *partitionKeyString =
+			TextDatumGetCString(datumArray[Anum_pg_dist_partition_partkey - 1]);
+
+		if (cacheEntry->partitionKeyString == NULL ||
+			strcmp(partitionKeyString, cacheEntry->partitionKeyString) != 0)
+		{
+			tupleMatches = false;
+		}
+	}
+
+	uint32 colocationId = INVALID_COLOCATION_ID;
+	if (!isNullArray[Anum_pg_dist_partition_colocationid - 1])
+	{
+		colocationId =
+			DatumGetUInt32(datumArray[Anum_pg_dist_partition_colocationid - 1]);
+	}
+
+	if (colocationId != cacheEntry->colocationId)
+	{
+		tupleMatches = false;
+	}
+
+	char replicationModel = 'c';
+	if (!isNullArray[Anum_pg_dist_partition_repmodel - 1])
+	{
+		replicationModel =
+			DatumGetChar(datumArray[Anum_pg_dist_partition_repmodel - 1]);
+	}
+
+	if (replicationModel != cacheEntry->replicationModel)
+	{
+		tupleMatches = false;
+	}
+
+	heap_freetuple(distPartitionTuple);
 	heap_close(pgDistPartition, NoLock);
+
+	return tupleMatches;
+}
+
+
+/*
+ * DistShardTuplesMatch returns whether the pg_dist_shard rows of the table
+ * describe exactly the shard intervals in the cache entry.
+ */
+static bool
+DistShardTuplesMatch(DistTableCacheEntry *cacheEntry)
+{
+	Oid columnTypeId = InvalidOid;
+	int32 columnTypeMod = -1;
+	Oid intervalTypeId = InvalidOid;
+	int32 intervalTypeMod = -1;
+	ListCell *distShardTupleCell = NULL;
+	bool tuplesMatch = true;
+
+	List *distShardTupleList = LookupDistShardTuples(cacheEntry->relationId);
+	if (list_length(distShardTupleList) != cacheEntry->shardIntervalArrayLength)
+	{
+		list_free_deep(distShardTupleList);
+		return false;
+	}
+
+	if (distShardTupleList == NIL)
+	{
+		return true;
+	}
+
+	GetPartitionTypeInputInfo(cacheEntry->partitionKeyString,
+							  cacheEntry->partitionMethod,
+							  &columnTypeId,
+							  &columnTypeMod,
+							  &intervalTypeId,
+							  &intervalTypeMod);
+
+	Relation distShardRelation = heap_open(DistShardRelationId(), AccessShareLock);
+	TupleDesc distShardTupleDesc = RelationGetDescr(distShardRelation);
+
+	foreach(distShardTupleCell, distShardTupleList)
+	{
+		HeapTuple shardTuple = lfirst(distShardTupleCell);
+		ShardInterval *shardInterval = TupleToShardInterval(shardTuple,
+															distShardTupleDesc,
+															intervalTypeId,
+															intervalTypeMod);
+		bool foundInCache = false;
+
+		ShardCacheEntry *shardEntry = hash_search(DistShardCacheHash,
+												  &shardInterval->shardId, HASH_FIND,
+												  &foundInCache);
+		if (!foundInCache || shardEntry->tableEntry != cacheEntry)
+		{
+			tuplesMatch = false;
+			break;
+		}
+
+		ShardInterval *cachedInterval =
+			cacheEntry->sortedShardIntervalArray[shardEntry->shardIndex];
+
+		if (shardInterval->storageType != cachedInterval->storageType ||
+			shardInterval->minValueExists != cachedInterval->minValueExists ||
+			shardInterval->maxValueExists != cachedInterval->maxValueExists)
+		{
+			tuplesMatch = false;
+			break;
+		}
+
+		if (shardInterval->minValueExists &&
+			(!datumIsEqual(shardInterval->minValue, cachedInterval->minValue,
+						   cachedInterval->valueByVal, cachedInterval->valueTypeLen) ||
+			 !datumIsEqual(shardInterval->maxValue, cachedInterval->maxValue,
+						   cachedInterval->valueByVal, cachedInterval->valueTypeLen)))
+		{
+			tuplesMatch = false;
+			break;
+		}
+	}
+
+	heap_close(distShardRelation, AccessShareLock);
+	list_free_deep(distShardTupleList);
+
+	return tuplesMatch;
+}
+
+
+/*
+ * CachedShardPlacementArray returns the placements of the shard at the given
+ * index of the cache entry and sets placementCount to their number. The
+ * placements are read from pg_dist_placement first if they have not been
+ * loaded yet or changed since they were loaded.
+ *
+ * The returned array points into the cache and must not be modified.
+ */
+GroupShardPlacement *
+CachedShardPlacementArray(DistTableCacheEntry *cacheEntry, int shardIndex,
+						  int *placementCount)
+{
+	Assert(shardIndex < cacheEntry->shardIntervalArrayLength);
+
+	if (cacheEntry->arrayOfPlacementArrayIsStale[shardIndex])
+	{
+		LoadShardPlacementArray(cacheEntry, shardIndex);
+	}
+
+	*placementCount = cacheEntry->arrayOfPlacementArrayLengths[shardIndex];
+
+	return cacheEntry->arrayOfPlacementArrays[shardIndex];
+}
+
+
+/*
+ * LoadShardPlacementArray reads the placements of the shard at the given
+ * index of the cache entry from pg_dist_placement.
+ */
+static void
+LoadShardPlacementArray(DistTableCacheEntry *cacheEntry, int shardIndex)
+{
+	ShardInterval *shardInterval = cacheEntry->sortedShardIntervalArray[shardIndex];
+	ListCell *placementCell = NULL;
+	int placementOffset = 0;
+
+	List *placementList = BuildShardPlacementList(shardInterval);
+	int numberOfPlacements = list_length(placementList);
+
+	MemoryContext oldContext = MemoryContextSwitchTo(MetadataCacheMemoryContext);
+	GroupShardPlacement *placementArray = palloc0(numberOfPlacements *
+												  sizeof(GroupShardPlacement));
+	foreach(placementCell, placementList)
+	{
+		GroupShardPlacement *srcPlacement =
+			(GroupShardPlacement *) lfirst(placementCell);
+
+		placementArray[placementOffset] = *srcPlacement;
+		placementOffset++;
+	}
+	MemoryContextSwitchTo(oldContext);
+
+	if (cacheEntry->arrayOfPlacementArrays[shardIndex] != NULL)
+	{
+		pfree(cacheEntry->arrayOfPlacementArrays[shardIndex]);
+	}
+
+	cacheEntry->arrayOfPlacementArrays[shardIndex] = placementArray;
+	cacheEntry->arrayOfPlacementArrayLengths[shardIndex] = numberOfPlacements;
+	cacheEntry->arrayOfPlacementArrayIsStale[shardIndex] = false;
 }
 
 
@@ -1119,7 +1550,23 @@ BuildCachedShardList(DistTableCacheEntry *cacheEntry)
 							  &intervalTypeId,
 							  &intervalTypeMod);
 
-	List *distShardTupleList = LookupDistShardTuples(cacheEntry->relationId);
+	List *distShardTupleList = NIL;
+	List **shardPlacementListArray = NULL;
+	uint64 sharedBuildId = 0;
+
+	/* the shards might have been read by another backend already */
+	AcceptInvalidationMessages();
+
+	bool foundInSharedCache = LookupSharedShardList(cacheEntry->relationId,
+													&distShardTupleList,
+													&shardPlacementListArray);
+	if (!foundInSharedCache)
+	{
+		/* register the build before reading the catalogs, see PublishSharedShardList */
+		sharedBuildId = BeginSharedShardListBuild(cacheEntry->relationId);
+		distShardTupleList = LookupDistShardTuples(cacheEntry->relationId);
+	}
+
 	int shardIntervalArrayLength = list_length(distShardTupleList);
 	if (shardIntervalArrayLength > 0)
 	{
@@ -1140,6 +1587,20 @@ BuildCachedShardList(DistTableCacheEntry *cacheEntry)
 			MemoryContextAllocZero(MetadataCacheMemoryContext,
 								   shardIntervalArrayLength *
 								   sizeof(int));
+		cacheEntry->arrayOfPlacementArrayIsStale =
+			MemoryContextAllocZero(MetadataCacheMemoryContext,
+								   shardIntervalArrayLength *
+								   sizeof(bool));
+
+		/*
+		 * Placements are loaded when they are first accessed, unless we are
+		 * going to publish them to the shared cache.
+		 */
+		if (sharedBuildId != 0)
+		{
+			shardPlacementListArray = palloc0(shardIntervalArrayLength *
+											  sizeof(List *));
+		}
 
 		foreach(distShardTupleCell, distShardTupleList)
 		{
@@ -1157,11 +1618,26 @@ BuildCachedShardList(DistTableCacheEntry *cacheEntry)
 
 			MemoryContextSwitchTo(oldContext);
 
-			heap_freetuple(shardTuple);
+			if (sharedBuildId != 0)
+			{
+				shardPlacementListArray[arrayIndex] =
+					BuildShardPlacementList(shardInterval);
+			}
+
+			/* remember the position in the tuple list until the array is sorted */
+			newShardInterval->shardIndex = arrayIndex;
 
 			arrayIndex++;
 		}
 
+		if (sharedBuildId != 0)
+		{
+			PublishSharedShardList(cacheEntry->relationId, sharedBuildId,
+								   distShardTupleList, shardPlacementListArray);
+		}
+
+		list_free_deep(distShardTupleList);
+
 		heap_close(distShardRelation, AccessShareLock);
 	}
 
@@ -1296,26 +1772,35 @@ BuildCachedShardList(DistTableCacheEntry *cacheEntry)
 		shardEntry->shardIndex = shardIndex;
 		shardEntry->tableEntry = cacheEntry;
 
-		/* build list of shard placements */
-		List *placementList = BuildShardPlacementList(shardInterval);
-		int numberOfPlacements = list_length(placementList);
-
-		/* and copy that list into the cache entry */
-		MemoryContext oldContext = MemoryContextSwitchTo(MetadataCacheMemoryContext);
-		GroupShardPlacement *placementArray = palloc0(numberOfPlacements *
-													  sizeof(GroupShardPlacement));
-		foreach(placementCell, placementList)
+		if (shardPlacementListArray == NULL)
 		{
-			GroupShardPlacement *srcPlacement =
-				(GroupShardPlacement *) lfirst(placementCell);
-
-			placementArray[placementOffset] = *srcPlacement;
-			placementOffset++;
+			/* defer loading the placements to CachedShardPlacementArray */
+			cacheEntry->arrayOfPlacementArrayIsStale[shardIndex] = true;
 		}
-		MemoryContextSwitchTo(oldContext);
+		else
+		{
+			/* look up the shard placements by the position in the tuple list */
+			List *placementList = shardPlacementListArray[shardInterval->shardIndex];
+			int numberOfPlacements = list_length(placementList);
+
+			/* and copy that list into the cache entry */
+			MemoryContext oldContext =
+				MemoryContextSwitchTo(MetadataCacheMemoryContext);
+			GroupShardPlacement *placementArray =
+				palloc0(numberOfPlacements * sizeof(GroupShardPlacement));
+			foreach(placementCell, placementList)
+			{
+				GroupShardPlacement *srcPlacement =
+					(GroupShardPlacement *) lfirst(placementCell);
+
+				placementArray[placementOffset] = *srcPlacement;
+				placementOffset++;
+			}
+			MemoryContextSwitchTo(oldContext);
 
-		cacheEntry->arrayOfPlacementArrays[shardIndex] = placementArray;
-		cacheEntry->arrayOfPlacementArrayLengths[shardIndex] = numberOfPlacements;
+			cacheEntry->arrayOfPlacementArrays[shardIndex] = placementArray;
+			cacheEntry->arrayOfPlacementArrayLengths[shardIndex] = numberOfPlacements;
+		}
 
 		/* store the shard index in the ShardInterval */
 		shardInterval->shardIndex = shardIndex;
@@ -1323,6 +1808,61 @@ BuildCachedShardList(DistTableCacheEntry *cacheEntry)
 
 	cacheEntry->shardColumnCompareFunction = shardColumnCompareFunction;
 	cacheEntry->shardIntervalCompareFunction = shardIntervalCompareFunction;
+
+	if ((cacheEntry->partitionMethod == DISTRIBUTE_BY_APPEND ||
+		 cacheEntry->partitionMethod == DISTRIBUTE_BY_RANGE) &&
+		cacheEntry->hasOverlappingShardInterval &&
+		cacheEntry->shardIntervalArrayLength > 0)
+	{
+		BuildMaxValuePrefixIndexArray(cacheEntry);
+	}
+}
+
+
+/*
+ * BuildMaxValuePrefixIndexArray builds the array that allows pruning the
+ * overlapping shards of an append or range distributed table without
+ * checking every shard. The shards are sorted by their min value, which
+ * means that the shards whose min value is below an upper bound form a
+ * prefix of the array. Similarly, all shards before the first one whose
+ * running max value exceeds a lower bound can be skipped.
+ */
+static void
+BuildMaxValuePrefixIndexArray(DistTableCacheEntry *cacheEntry)
+{
+	ShardInterval **sortedShardIntervalArray = cacheEntry->sortedShardIntervalArray;
+	int shardCount = cacheEntry->shardIntervalArrayLength;
+	FmgrInfo *compareFunction = cacheEntry->shardIntervalCompareFunction;
+	int initializedShardCount = 0;
+	int maxValueIndex = 0;
+
+	/* shards without min/max values are sorted to the end */
+	while (initializedShardCount < shardCount &&
+		   sortedShardIntervalArray[initializedShardCount]->minValueExists &&
+		   sortedShardIntervalArray[initializedShardCount]->maxValueExists)
+	{
+		initializedShardCount++;
+	}
+
+	int *prefixIndexArray = MemoryContextAllocZero(MetadataCacheMemoryContext,
+												   Max(initializedShardCount, 1) *
+												   sizeof(int));
+
+	for (int shardIndex = 0; shardIndex < initializedShardCount; shardIndex++)
+	{
+		Datum maxValue = sortedShardIntervalArray[maxValueIndex]->maxValue;
+		Datum shardMaxValue = sortedShardIntervalArray[shardIndex]->maxValue;
+
+		if (DatumGetInt32(CompareCall2(compareFunction, shardMaxValue, maxValue)) > 0)
+		{
+			maxValueIndex = shardIndex;
+		}
+
+		prefixIndexArray[shardIndex] = maxValueIndex;
+	}
+
+	cacheEntry->maxValuePrefixIndexArray = prefixIndexArray;
+	cacheEntry->initializedShardIntervalCount = initializedShardCount;
 }
 
 
@@ -1389,6 +1929,38 @@ HasUniformHashDistribution(ShardInterval **shardIntervalArray,
 }
 
 
+/*
+ * BuildHashTokenShardIndexArray builds the lookup table that maps the token
+ * ranges with a common prefix of HASH_TOKEN_LOOKUP_BITS bits to the index of
+ * the first shard whose maximum value is not below the start of the range.
+ * The given shard intervals must be sorted and must not overlap.
+ */
+static int *
+BuildHashTokenShardIndexArray(ShardInterval **sortedShardIntervalArray, int shardCount)
+{
+	int *shardIndexArray = MemoryContextAllocZero(MetadataCacheMemoryContext,
+												  HASH_TOKEN_LOOKUP_SIZE * sizeof(int));
+	int64 tokenRangeSize = HASH_TOKEN_COUNT / HASH_TOKEN_LOOKUP_SIZE;
+	int shardIndex = 0;
+
+	for (int rangeIndex = 0; rangeIndex < HASH_TOKEN_LOOKUP_SIZE; rangeIndex++)
+	{
+		int64 rangeMinHashToken = (int64) INT32_MIN + rangeIndex * tokenRangeSize;
+
+		while (shardIndex < shardCount &&
+			   DatumGetInt32(sortedShardIntervalArray[shardIndex]->maxValue) <
+			   rangeMinHashToken)
+		{
+			shardIndex++;
+		}
+
+		shardIndexArray[rangeIndex] = shardIndex;
+	}
+
+	return shardIndexArray;
+}
+
+
 /*
  * HasUninitializedShardInterval returns true if all the elements of the
  * sortedShardIntervalArray has min/max values. Callers of the function must
@@ -3243,6 +3815,27 @@ ResetDistTableCacheEntry(DistTableCacheEntry *cacheEntry)
 		pfree(cacheEntry->sortedShardIntervalArray);
 		cacheEntry->sortedShardIntervalArray = NULL;
 	}
+	if (cacheEntry->hashTokenShardIndexArray)
+	{
+		pfree(cacheEntry->hashTokenShardIndexArray);
+		cacheEntry->hashTokenShardIndexArray = NULL;
+	}
+	if (cacheEntry->sortedShardMinValueArray)
+	{
+		pfree(cacheEntry->sortedShardMinValueArray);
+		cacheEntry->sortedShardMinValueArray = NULL;
+	}
+	if (cacheEntry->sortedShardMaxValueArray)
+	{
+		pfree(cacheEntry->sortedShardMaxValueArray);
+		cacheEntry->sortedShardMaxValueArray = NULL;
+	}
+	if (cacheEntry->maxValuePrefixIndexArray)
+	{
+		pfree(cacheEntry->maxValuePrefixIndexArray);
+		cacheEntry->maxValuePrefixIndexArray = NULL;
+		cacheEntry->initializedShardIntervalCount = 0;
+	}
 	if (cacheEntry->arrayOfPlacementArrayLengths)
 	{
 		pfree(cacheEntry->arrayOfPlacementArrayLengths);
@@ -3253,6 +3846,11 @@ ResetDistTableCacheEntry(DistTableCacheEntry *cacheEntry)
 		pfree(cacheEntry->arrayOfPlacementArrays);
 		cacheEntry->arrayOfPlacementArrays = NULL;
 	}
+	if (cacheEntry->arrayOfPlacementArrayIsStale)
+	{
+		pfree(cacheEntry->arrayOfPlacementArrayIsStale);
+		cacheEntry->arrayOfPlacementArrayIsStale = NULL;
+	}
 	if (cacheEntry->referencedRelationsViaForeignKey)
 	{
 		list_free(cacheEntry->referencedRelationsViaForeignKey);
@@ -3274,15 +3872,34 @@ ResetDistTableCacheEntry(DistTableCacheEntry *cacheEntry)
 /*
  * InvalidateForeignRelationGraphCacheCallback invalidates the foreign key relation
  * graph and entire distributed cache entries.
+ *
+ * When the graph is maintained incrementally, invalidations of other relations
+ * mark their edges to be rebuilt instead, and only a full relcache reset causes
+ * the whole graph to be rebuilt.
  */
 static void
 InvalidateForeignRelationGraphCacheCallback(Datum argument, Oid relationId)
 {
 	if (relationId == MetadataCache.distColocationRelationId)
 	{
-		SetForeignConstraintRelationshipGraphInvalid();
+		if (!EnableIncrementalForeignKeyGraph)
+		{
+			SetForeignConstraintRelationshipGraphInvalid();
+		}
+
 		InvalidateDistTableCache();
 	}
+	else if (EnableIncrementalForeignKeyGraph)
+	{
+		if (relationId == InvalidOid)
+		{
+			SetForeignConstraintRelationshipGraphInvalid();
+		}
+		else
+		{
+			InvalidateForeignConstraintRelationshipGraphForRelation(relationId);
+		}
+	}
 }
 
 
@@ -3322,18 +3939,28 @@ InvalidateDistRelationCacheCallback(Datum argument, Oid relationId)
 	{
 		InvalidateDistTableCache();
 		InvalidateDistObjectCache();
+		InvalidateSharedShardList(InvalidOid);
+		InvalidateRemotePreparedStatements();
+		InvalidateShardSetCache(InvalidOid);
 	}
 	else
 	{
 		void *hashKey = (void *) &relationId;
 		bool foundInCache = false;
 
+		InvalidateSharedShardList(relationId);
 
 		DistTableCacheEntry *cacheEntry = hash_search(DistTableCacheHash, hashKey,
 													  HASH_FIND, &foundInCache);
 		if (foundInCache)
 		{
 			cacheEntry->isValid = false;
+
+			/* statements prepared on the workers might refer to the table */
+			InvalidateRemotePreparedStatements();
+
+			/* the shard indexes of the table may have changed */
+			InvalidateShardSetCache(relationId);
 		}
 
 		/*
@@ -3344,11 +3971,13 @@ InvalidateDistRelationCacheCallback(Datum argument, Oid relationId)
 		if (relationId == MetadataCache.distPartitionRelationId)
 		{
 			InvalidateMetadataSystemCache();
+			InvalidateSharedShardList(InvalidOid);
 		}
 
 		if (relationId == MetadataCache.distObjectRelationId)
 		{
 			InvalidateDistObjectCache();
+			ResetDependencyCache();
 		}
 	}
 }
@@ -3510,6 +4139,9 @@ InvalidateNodeRelationCacheCallback(Datum argument, Oid relationId)
 	if (relationId == InvalidOid || relationId == MetadataCache.distNodeRelationId)
 	{
 		workerNodeHashValid = false;
+
+		/* nodes might have been added, also prewarm connections to them */
+		ResetWorkerConnectionsPrewarmed();
 	}
 }
 
@@ -3885,6 +4517,9 @@ CitusInvalidateRelcacheByShardId(int64 shardId)
 	if (HeapTupleIsValid(heapTuple))
 	{
 		shardForm = (Form_pg_dist_shard) GETSTRUCT(heapTuple);
+
+		/* let other backends reload just the placements of this shard */
+		LogShardPlacementChange(shardId);
 		CitusInvalidateRelcacheByRelid(shardForm->logicalrelid);
 	}
 	else
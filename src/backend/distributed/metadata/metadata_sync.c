@@ -29,6 +29,7 @@
 #include "catalog/pg_type.h"
 #include "distributed/citus_ruleutils.h"
 #include "distributed/commands.h"
+#include "distributed/commands/multi_copy.h"
 #include "distributed/distribution_column.h"
 #include "distributed/listutils.h"
 #include "distributed/master_metadata_utility.h"
@@ -38,6 +39,7 @@
 #include "distributed/multi_join_order.h"
 #include "distributed/multi_partitioning_utils.h"
 #include "distributed/pg_dist_node.h"
+#include "distributed/relay_utility.h"
 #include "distributed/remote_commands.h"
 #include "distributed/worker_manager.h"
 #include "distributed/worker_transaction.h"
@@ -61,6 +63,33 @@ static char * SchemaOwnerName(Oid objectId);
 static bool HasMetadataWorkers(void);
 static List * DetachPartitionCommandList(void);
 static bool SyncMetadataSnapshotToNode(WorkerNode *workerNode, bool raiseOnError);
+static List * SyncedDistributedTableList(void);
+static List * MetadataCreateCommandList(bool includeShardMetadata);
+static bool SendMetadataSnapshotToNode(WorkerNode *workerNode, char *nodeUser,
+									   List *commandList, List *tableList,
+									   bool raiseOnError);
+static bool ExecuteMetadataSyncCommand(MultiConnection *connection, char *command,
+									   bool raiseOnError);
+static bool CopyShardMetadataToNode(MultiConnection *connection, List *tableList,
+									bool raiseOnError);
+static void AppendShardMetadataCopyData(List *tableList, CopyOutState shardCopyState,
+										CopyOutState placementCopyState);
+static CopyOutState BinaryCopyOutState(void);
+static bool SendCopyDataToNode(MultiConnection *connection, char *copyCommand,
+							   StringInfo copyData, bool raiseOnError);
+static MetadataSyncResult SyncMetadataSnapshotToNodesInParallel(List *workerNodeList);
+static List * SyncMetadataSnapshotToNodeBatch(List *workerNodeList,
+											  char *snapshotCommand,
+											  CopyOutState shardCopyState,
+											  CopyOutState placementCopyState);
+static List * ExecuteMetadataSyncCommandOnNodes(List *connectionList, char *command);
+static List * FinishMetadataSyncCommandOnNodes(List *connectionList);
+static List * SendCopyDataToNodes(List *connectionList, char *copyCommand,
+								  StringInfo copyData);
+
+/* config variables */
+bool EnableBinaryMetadataSync = true;
+int MaxConcurrentMetadataSyncs = 1;
 
 PG_FUNCTION_INFO_V1(start_metadata_sync_to_node);
 PG_FUNCTION_INFO_V1(stop_metadata_sync_to_node);
@@ -251,8 +280,12 @@ SyncMetadataSnapshotToNode(WorkerNode *workerNode, bool raiseOnError)
 	/* generate the queries which drop the metadata */
 	List *dropMetadataCommandList = MetadataDropCommands();
 
-	/* generate the queries which create the metadata from scratch */
-	List *createMetadataCommandList = MetadataCreateCommands();
+	/*
+	 * Generate the queries which create the metadata from scratch. When binary
+	 * metadata sync is enabled, the shard metadata is copied separately.
+	 */
+	bool includeShardMetadata = !EnableBinaryMetadataSync;
+	List *createMetadataCommandList = MetadataCreateCommandList(includeShardMetadata);
 
 	List *recreateMetadataSnapshotCommandList = list_make1(localGroupIdUpdateCommand);
 	recreateMetadataSnapshotCommandList = list_concat(recreateMetadataSnapshotCommandList,
@@ -260,6 +293,15 @@ SyncMetadataSnapshotToNode(WorkerNode *workerNode, bool raiseOnError)
 	recreateMetadataSnapshotCommandList = list_concat(recreateMetadataSnapshotCommandList,
 													  createMetadataCommandList);
 
+	if (EnableBinaryMetadataSync)
+	{
+		List *syncedTableList = SyncedDistributedTableList();
+
+		return SendMetadataSnapshotToNode(workerNode, extensionOwner,
+										  recreateMetadataSnapshotCommandList,
+										  syncedTableList, raiseOnError);
+	}
+
 	/*
 	 * Send the snapshot recreation commands in a single remote transaction and
 	 * if requested, error out in any kind of failure. Note that it is not
@@ -286,6 +328,303 @@ SyncMetadataSnapshotToNode(WorkerNode *workerNode, bool raiseOnError)
 }
 
 
+/*
+ * SendMetadataSnapshotToNode sends the given snapshot commands to the given
+ * worker, followed by the pg_dist_shard and pg_dist_placement rows of the given
+ * tables, all in a single transaction. The rows are sent using COPY in binary
+ * format, which is much cheaper than parsing and planning INSERT commands that
+ * contain all shards when there are many of them. If raiseOnError is false,
+ * failures are reported as warnings and the function returns false.
+ */
+static bool
+SendMetadataSnapshotToNode(WorkerNode *workerNode, char *nodeUser, List *commandList,
+						   List *tableList, bool raiseOnError)
+{
+	ListCell *commandCell = NULL;
+	int connectionFlags = FORCE_NEW_CONNECTION;
+	bool success = true;
+
+	MultiConnection *workerConnection =
+		GetNodeUserDatabaseConnection(connectionFlags, workerNode->workerName,
+									  workerNode->workerPort, nodeUser, NULL);
+
+	if (raiseOnError)
+	{
+		MarkRemoteTransactionCritical(workerConnection);
+	}
+
+	RemoteTransactionBegin(workerConnection);
+
+	foreach(commandCell, commandList)
+	{
+		char *commandString = lfirst(commandCell);
+
+		if (!ExecuteMetadataSyncCommand(workerConnection, commandString, raiseOnError))
+		{
+			success = false;
+			break;
+		}
+	}
+
+	if (success)
+	{
+		success = CopyShardMetadataToNode(workerConnection, tableList, raiseOnError);
+	}
+
+	if (success)
+	{
+		RemoteTransactionCommit(workerConnection);
+	}
+	else
+	{
+		RemoteTransactionAbort(workerConnection);
+	}
+
+	CloseConnection(workerConnection);
+
+	return success;
+}
+
+
+/*
+ * ExecuteMetadataSyncCommand executes the given command over the connection. If
+ * raiseOnError is false, a failure is reported as a warning and the function
+ * returns false.
+ */
+static bool
+ExecuteMetadataSyncCommand(MultiConnection *connection, char *command,
+						   bool raiseOnError)
+{
+	if (raiseOnError)
+	{
+		ExecuteCriticalRemoteCommand(connection, command);
+		return true;
+	}
+
+	return ExecuteOptionalRemoteCommand(connection, command, NULL) == RESPONSE_OKAY;
+}
+
+
+/*
+ * CopyShardMetadataToNode copies the pg_dist_shard and pg_dist_placement rows
+ * of the given tables over the connection.
+ *
+ * The logicalrelid column of pg_dist_shard holds a relation OID, which differs
+ * across nodes, so shard rows are copied into a temporary table with qualified
+ * relation names first, and inserted into pg_dist_shard from there.
+ */
+static bool
+CopyShardMetadataToNode(MultiConnection *connection, List *tableList,
+						bool raiseOnError)
+{
+	CopyOutState shardCopyState = BinaryCopyOutState();
+	CopyOutState placementCopyState = BinaryCopyOutState();
+
+	AppendShardMetadataCopyData(tableList, shardCopyState, placementCopyState);
+
+	if (!ExecuteMetadataSyncCommand(connection, CREATE_SHARD_SNAPSHOT_TABLE,
+									raiseOnError))
+	{
+		return false;
+	}
+
+	if (!SendCopyDataToNode(connection, COPY_SHARD_SNAPSHOT_TABLE,
+							shardCopyState->fe_msgbuf, raiseOnError))
+	{
+		return false;
+	}
+
+	if (!ExecuteMetadataSyncCommand(connection, INSERT_SHARDS_FROM_SNAPSHOT_TABLE,
+									raiseOnError))
+	{
+		return false;
+	}
+
+	return SendCopyDataToNode(connection, COPY_PLACEMENTS,
+							  placementCopyState->fe_msgbuf, raiseOnError);
+}
+
+
+/*
+ * AppendShardMetadataCopyData appends the rows of the temporary shard table and
+ * of pg_dist_placement for the shards of the given tables to the buffers of the
+ * given copy states, including the binary COPY headers and footers. Like
+ * ShardListInsertCommand, only finalized placements are included.
+ */
+static void
+AppendShardMetadataCopyData(List *tableList, CopyOutState shardCopyState,
+							CopyOutState placementCopyState)
+{
+	ListCell *tableCell = NULL;
+
+#if PG_VERSION_NUM >= 120000
+	TupleDesc shardTupleDesc = CreateTemplateTupleDesc(5);
+	TupleDesc placementTupleDesc = CreateTemplateTupleDesc(5);
+#else
+	TupleDesc shardTupleDesc = CreateTemplateTupleDesc(5, false);
+	TupleDesc placementTupleDesc = CreateTemplateTupleDesc(5, false);
+#endif
+
+	/* columns of the temporary shard table */
+	TupleDescInitEntry(shardTupleDesc, 1, NULL, TEXTOID, -1, 0);
+	TupleDescInitEntry(shardTupleDesc, 2, NULL, INT8OID, -1, 0);
+	TupleDescInitEntry(shardTupleDesc, 3, NULL, CHAROID, -1, 0);
+	TupleDescInitEntry(shardTupleDesc, 4, NULL, TEXTOID, -1, 0);
+	TupleDescInitEntry(shardTupleDesc, 5, NULL, TEXTOID, -1, 0);
+
+	/* columns of pg_dist_placement, in the order of COPY_PLACEMENTS */
+	TupleDescInitEntry(placementTupleDesc, 1, NULL, INT8OID, -1, 0);
+	TupleDescInitEntry(placementTupleDesc, 2, NULL, INT4OID, -1, 0);
+	TupleDescInitEntry(placementTupleDesc, 3, NULL, INT8OID, -1, 0);
+	TupleDescInitEntry(placementTupleDesc, 4, NULL, INT4OID, -1, 0);
+	TupleDescInitEntry(placementTupleDesc, 5, NULL, INT8OID, -1, 0);
+
+	FmgrInfo *shardOutputFunctions = ColumnOutputFunctions(shardTupleDesc, true);
+	FmgrInfo *placementOutputFunctions = ColumnOutputFunctions(placementTupleDesc,
+															   true);
+
+	AppendCopyBinaryHeaders(shardCopyState);
+	AppendCopyBinaryHeaders(placementCopyState);
+
+	foreach(tableCell, tableList)
+	{
+		DistTableCacheEntry *cacheEntry = (DistTableCacheEntry *) lfirst(tableCell);
+		char *qualifiedRelationName =
+			generate_qualified_relation_name(cacheEntry->relationId);
+		Datum relationNameDatum = CStringGetTextDatum(qualifiedRelationName);
+		List *shardIntervalList = LoadShardIntervalList(cacheEntry->relationId);
+		ListCell *shardIntervalCell = NULL;
+
+		foreach(shardIntervalCell, shardIntervalList)
+		{
+			ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
+			uint64 shardId = shardInterval->shardId;
+			Datum shardValues[5];
+			bool shardNulls[5];
+			ListCell *placementCell = NULL;
+
+			memset(shardNulls, false, sizeof(shardNulls));
+
+			shardValues[0] = relationNameDatum;
+			shardValues[1] = Int64GetDatum(shardId);
+			shardValues[2] = CharGetDatum(shardInterval->storageType);
+
+			if (shardInterval->minValueExists)
+			{
+				char *minValue = psprintf("%d", DatumGetInt32(shardInterval->minValue));
+				shardValues[3] = CStringGetTextDatum(minValue);
+			}
+			else
+			{
+				shardNulls[3] = true;
+			}
+
+			if (shardInterval->maxValueExists)
+			{
+				char *maxValue = psprintf("%d", DatumGetInt32(shardInterval->maxValue));
+				shardValues[4] = CStringGetTextDatum(maxValue);
+			}
+			else
+			{
+				shardNulls[4] = true;
+			}
+
+			AppendCopyRowData(shardValues, shardNulls, shardTupleDesc, shardCopyState,
+							  shardOutputFunctions, NULL);
+
+			List *placementList = FinalizedShardPlacementList(shardId);
+			foreach(placementCell, placementList)
+			{
+				ShardPlacement *placement = (ShardPlacement *) lfirst(placementCell);
+				Datum placementValues[5];
+				bool placementNulls[5];
+
+				memset(placementNulls, false, sizeof(placementNulls));
+
+				placementValues[0] = Int64GetDatum(shardId);
+				placementValues[1] = Int32GetDatum(FILE_FINALIZED);
+				placementValues[2] = Int64GetDatum(placement->shardLength);
+				placementValues[3] = Int32GetDatum(placement->groupId);
+				placementValues[4] = Int64GetDatum(placement->placementId);
+
+				AppendCopyRowData(placementValues, placementNulls, placementTupleDesc,
+								  placementCopyState, placementOutputFunctions, NULL);
+			}
+		}
+	}
+
+	AppendCopyBinaryFooters(shardCopyState);
+	AppendCopyBinaryFooters(placementCopyState);
+}
+
+
+/*
+ * BinaryCopyOutState returns a copy state for serializing rows in binary COPY
+ * format into its fe_msgbuf.
+ */
+static CopyOutState
+BinaryCopyOutState(void)
+{
+	CopyOutState copyOutState = (CopyOutState) palloc0(sizeof(CopyOutStateData));
+
+	copyOutState->binary = true;
+	copyOutState->fe_msgbuf = makeStringInfo();
+	copyOutState->rowcontext = CurrentMemoryContext;
+
+	return copyOutState;
+}
+
+
+/*
+ * SendCopyDataToNode runs the given COPY .. FROM STDIN command over the
+ * connection and sends it the given data. If raiseOnError is false, a failure
+ * is reported as a warning and the function returns false.
+ */
+static bool
+SendCopyDataToNode(MultiConnection *connection, char *copyCommand, StringInfo copyData,
+				   bool raiseOnError)
+{
+	int elevel = raiseOnError ? ERROR : WARNING;
+	bool raiseInterrupts = true;
+
+	if (!SendRemoteCommand(connection, copyCommand))
+	{
+		ReportConnectionError(connection, elevel);
+		return false;
+	}
+
+	PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+	if (PQresultStatus(result) != PGRES_COPY_IN)
+	{
+		ReportResultError(connection, result, elevel);
+		PQclear(result);
+		ForgetResults(connection);
+		return false;
+	}
+
+	PQclear(result);
+
+	if (!PutRemoteCopyData(connection, copyData->data, copyData->len) ||
+		!PutRemoteCopyEnd(connection, NULL))
+	{
+		ReportConnectionError(connection, elevel);
+		return false;
+	}
+
+	result = GetRemoteCommandResult(connection, raiseInterrupts);
+	bool success = (PQresultStatus(result) == PGRES_COMMAND_OK);
+	if (!success)
+	{
+		ReportResultError(connection, result, elevel);
+	}
+
+	PQclear(result);
+	ForgetResults(connection);
+
+	return success;
+}
+
+
 /*
  * SendOptionalCommandListToWorkerInTransaction sends the given command list to
  * the given worker in a single transaction. If any of the commands fail, it
@@ -348,9 +687,47 @@ SendOptionalCommandListToWorkerInTransaction(char *nodeName, int32 nodePort,
 List *
 MetadataCreateCommands(void)
 {
-	List *metadataSnapshotCommandList = NIL;
+	bool includeShardMetadata = true;
+
+	return MetadataCreateCommandList(includeShardMetadata);
+}
+
+
+/*
+ * SyncedDistributedTableList returns the cache entries of the distributed
+ * tables whose metadata is synced to metadata nodes.
+ */
+static List *
+SyncedDistributedTableList(void)
+{
 	List *distributedTableList = DistributedTableList();
 	List *propagatedTableList = NIL;
+	ListCell *distributedTableCell = NULL;
+
+	foreach(distributedTableCell, distributedTableList)
+	{
+		DistTableCacheEntry *cacheEntry =
+			(DistTableCacheEntry *) lfirst(distributedTableCell);
+		if (ShouldSyncTableMetadata(cacheEntry->relationId))
+		{
+			propagatedTableList = lappend(propagatedTableList, cacheEntry);
+		}
+	}
+
+	return propagatedTableList;
+}
+
+
+/*
+ * MetadataCreateCommandList implements MetadataCreateCommands. If
+ * includeShardMetadata is false, the commands that populate pg_dist_shard and
+ * pg_dist_placement are left out.
+ */
+static List *
+MetadataCreateCommandList(bool includeShardMetadata)
+{
+	List *metadataSnapshotCommandList = NIL;
+	List *propagatedTableList = SyncedDistributedTableList();
 	bool includeNodesFromOtherClusters = true;
 	List *workerNodeList = ReadDistNode(includeNodesFromOtherClusters);
 	ListCell *distributedTableCell = NULL;
@@ -364,17 +741,6 @@ MetadataCreateCommands(void)
 	metadataSnapshotCommandList = lappend(metadataSnapshotCommandList,
 										  nodeListInsertCommand);
 
-	/* create the list of tables whose metadata will be created */
-	foreach(distributedTableCell, distributedTableList)
-	{
-		DistTableCacheEntry *cacheEntry =
-			(DistTableCacheEntry *) lfirst(distributedTableCell);
-		if (ShouldSyncTableMetadata(cacheEntry->relationId))
-		{
-			propagatedTableList = lappend(propagatedTableList, cacheEntry);
-		}
-	}
-
 	/* create the tables, but not the metadata */
 	foreach(distributedTableCell, propagatedTableList)
 	{
@@ -451,6 +817,11 @@ MetadataCreateCommands(void)
 		metadataSnapshotCommandList = lappend(metadataSnapshotCommandList,
 											  truncateTriggerCreateCommand);
 
+		if (!includeShardMetadata)
+		{
+			continue;
+		}
+
 		/* add the pg_dist_shard{,placement} entries */
 		List *shardIntervalList = LoadShardIntervalList(clusteredTableId);
 		List *shardCreateCommandList = ShardListInsertCommand(shardIntervalList);
@@ -1286,6 +1657,7 @@ SyncMetadataToNodes(void)
 	}
 
 	List *workerList = ActivePrimaryWorkerNodeList(NoLock);
+	List *unsyncedWorkerList = NIL;
 
 	foreach(workerCell, workerList)
 	{
@@ -1293,19 +1665,291 @@ SyncMetadataToNodes(void)
 
 		if (workerNode->hasMetadata && !workerNode->metadataSynced)
 		{
-			bool raiseInterrupts = false;
+			unsyncedWorkerList = lappend(unsyncedWorkerList, workerNode);
+		}
+	}
 
-			if (!SyncMetadataSnapshotToNode(workerNode, raiseInterrupts))
-			{
-				result = METADATA_SYNC_FAILED_SYNC;
-			}
-			else
-			{
-				MarkNodeMetadataSynced(workerNode->workerName,
-									   workerNode->workerPort, true);
-			}
+	if (MaxConcurrentMetadataSyncs > 1 && list_length(unsyncedWorkerList) > 1)
+	{
+		return SyncMetadataSnapshotToNodesInParallel(unsyncedWorkerList);
+	}
+
+	foreach(workerCell, unsyncedWorkerList)
+	{
+		WorkerNode *workerNode = lfirst(workerCell);
+		bool raiseInterrupts = false;
+
+		if (!SyncMetadataSnapshotToNode(workerNode, raiseInterrupts))
+		{
+			result = METADATA_SYNC_FAILED_SYNC;
+		}
+		else
+		{
+			MarkNodeMetadataSynced(workerNode->workerName,
+								   workerNode->workerPort, true);
 		}
 	}
 
 	return result;
 }
+
+
+/*
+ * SyncMetadataSnapshotToNodesInParallel recreates the metadata snapshot on the
+ * given nodes like SyncMetadataSnapshotToNode does, but on up to
+ * citus.max_concurrent_metadata_syncs nodes at a time. The snapshot is only
+ * generated once, and all commands of the snapshot are sent to a node in a
+ * single round trip. Nodes on which the sync fails are reported as warnings
+ * and left unsynced, such that they are retried later.
+ */
+static MetadataSyncResult
+SyncMetadataSnapshotToNodesInParallel(List *workerNodeList)
+{
+	MetadataSyncResult result = METADATA_SYNC_SUCCESS;
+	CopyOutState shardCopyState = NULL;
+	CopyOutState placementCopyState = NULL;
+	ListCell *commandCell = NULL;
+
+	/* the snapshot is the same for all nodes, except for the local group id */
+	List *snapshotCommandList = MetadataDropCommands();
+
+	bool includeShardMetadata = !EnableBinaryMetadataSync;
+	snapshotCommandList = list_concat(snapshotCommandList,
+									  MetadataCreateCommandList(includeShardMetadata));
+
+	if (EnableBinaryMetadataSync)
+	{
+		List *syncedTableList = SyncedDistributedTableList();
+
+		shardCopyState = BinaryCopyOutState();
+		placementCopyState = BinaryCopyOutState();
+
+		AppendShardMetadataCopyData(syncedTableList, shardCopyState,
+									placementCopyState);
+
+		snapshotCommandList = lappend(snapshotCommandList, CREATE_SHARD_SNAPSHOT_TABLE);
+	}
+
+	StringInfo snapshotCommand = makeStringInfo();
+	foreach(commandCell, snapshotCommandList)
+	{
+		char *command = lfirst(commandCell);
+
+		appendStringInfo(snapshotCommand, "%s;\n", command);
+	}
+
+	int workerNodeCount = list_length(workerNodeList);
+	for (int batchStart = 0; batchStart < workerNodeCount;
+		 batchStart += MaxConcurrentMetadataSyncs)
+	{
+		int batchEnd = Min(batchStart + MaxConcurrentMetadataSyncs, workerNodeCount);
+		List *batchNodeList = NIL;
+
+		for (int nodeIndex = batchStart; nodeIndex < batchEnd; nodeIndex++)
+		{
+			batchNodeList = lappend(batchNodeList, list_nth(workerNodeList, nodeIndex));
+		}
+
+		List *syncedConnectionList =
+			SyncMetadataSnapshotToNodeBatch(batchNodeList, snapshotCommand->data,
+											shardCopyState, placementCopyState);
+
+		if (list_length(syncedConnectionList) < list_length(batchNodeList))
+		{
+			result = METADATA_SYNC_FAILED_SYNC;
+		}
+
+		MultiConnection *connection = NULL;
+		foreach_ptr(connection, syncedConnectionList)
+		{
+			MarkNodeMetadataSynced(connection->hostname, connection->port, true);
+			CloseConnection(connection);
+		}
+	}
+
+	return result;
+}
+
+
+/*
+ * SyncMetadataSnapshotToNodeBatch sends the given snapshot command to each of
+ * the given nodes in a transaction, followed by the shard metadata in the
+ * given copy states if binary metadata sync is used, and commits. Every step
+ * runs on all nodes in parallel. The function returns the connections to the
+ * nodes on which the sync succeeded.
+ */
+static List *
+SyncMetadataSnapshotToNodeBatch(List *workerNodeList, char *snapshotCommand,
+								CopyOutState shardCopyState,
+								CopyOutState placementCopyState)
+{
+	char *extensionOwner = CitusExtensionOwnerName();
+	int connectionFlags = FORCE_NEW_CONNECTION;
+	List *connectionList = NIL;
+	List *sentConnectionList = NIL;
+	WorkerNode *workerNode = NULL;
+	MultiConnection *connection = NULL;
+
+	foreach_ptr(workerNode, workerNodeList)
+	{
+		connection = StartNodeUserDatabaseConnection(connectionFlags,
+													 workerNode->workerName,
+													 workerNode->workerPort,
+													 extensionOwner, NULL);
+
+		connectionList = lappend(connectionList, connection);
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	ListCell *connectionCell = NULL;
+	ListCell *workerNodeCell = NULL;
+	forboth(connectionCell, connectionList, workerNodeCell, workerNodeList)
+	{
+		connection = (MultiConnection *) lfirst(connectionCell);
+		workerNode = (WorkerNode *) lfirst(workerNodeCell);
+
+		StringInfo command = makeStringInfo();
+		appendStringInfo(command, "BEGIN;\n%s;\n%s",
+						 LocalGroupIdUpdateCommand(workerNode->groupId),
+						 snapshotCommand);
+
+		if (PQstatus(connection->pgConn) != CONNECTION_OK ||
+			!SendRemoteCommand(connection, command->data))
+		{
+			ReportConnectionError(connection, WARNING);
+			CloseConnection(connection);
+			continue;
+		}
+
+		sentConnectionList = lappend(sentConnectionList, connection);
+	}
+
+	connectionList = FinishMetadataSyncCommandOnNodes(sentConnectionList);
+
+	if (EnableBinaryMetadataSync)
+	{
+		connectionList = SendCopyDataToNodes(connectionList, COPY_SHARD_SNAPSHOT_TABLE,
+											 shardCopyState->fe_msgbuf);
+		connectionList =
+			ExecuteMetadataSyncCommandOnNodes(connectionList,
+											  INSERT_SHARDS_FROM_SNAPSHOT_TABLE);
+		connectionList = SendCopyDataToNodes(connectionList, COPY_PLACEMENTS,
+											 placementCopyState->fe_msgbuf);
+	}
+
+	return ExecuteMetadataSyncCommandOnNodes(connectionList, "COMMIT");
+}
+
+
+/*
+ * ExecuteMetadataSyncCommandOnNodes sends the given command over all the given
+ * connections in parallel and returns the connections on which it succeeded.
+ * Failures are reported as warnings, and the failed connections are closed.
+ */
+static List *
+ExecuteMetadataSyncCommandOnNodes(List *connectionList, char *command)
+{
+	List *sentConnectionList = NIL;
+	MultiConnection *connection = NULL;
+
+	foreach_ptr(connection, connectionList)
+	{
+		if (!SendRemoteCommand(connection, command))
+		{
+			ReportConnectionError(connection, WARNING);
+			CloseConnection(connection);
+			continue;
+		}
+
+		sentConnectionList = lappend(sentConnectionList, connection);
+	}
+
+	return FinishMetadataSyncCommandOnNodes(sentConnectionList);
+}
+
+
+/*
+ * FinishMetadataSyncCommandOnNodes waits for the commands that were sent over
+ * the given connections and returns the connections on which they succeeded.
+ * Failures are reported as warnings, and the failed connections are closed.
+ */
+static List *
+FinishMetadataSyncCommandOnNodes(List *connectionList)
+{
+	List *succeededConnectionList = NIL;
+	MultiConnection *connection = NULL;
+	bool raiseInterrupts = true;
+	bool raiseErrors = false;
+
+	WaitForAllConnections(connectionList, raiseInterrupts);
+
+	foreach_ptr(connection, connectionList)
+	{
+		if (!ClearResults(connection, raiseErrors))
+		{
+			CloseConnection(connection);
+			continue;
+		}
+
+		succeededConnectionList = lappend(succeededConnectionList, connection);
+	}
+
+	return succeededConnectionList;
+}
+
+
+/*
+ * SendCopyDataToNodes runs the given COPY .. FROM STDIN command over all the
+ * given connections in parallel, and sends the given data to each of them.
+ * It returns the connections on which the COPY succeeded. Failures are
+ * reported as warnings, and the failed connections are closed.
+ */
+static List *
+SendCopyDataToNodes(List *connectionList, char *copyCommand, StringInfo copyData)
+{
+	List *sentConnectionList = NIL;
+	List *copyConnectionList = NIL;
+	MultiConnection *connection = NULL;
+	bool raiseInterrupts = true;
+
+	foreach_ptr(connection, connectionList)
+	{
+		if (!SendRemoteCommand(connection, copyCommand))
+		{
+			ReportConnectionError(connection, WARNING);
+			CloseConnection(connection);
+			continue;
+		}
+
+		sentConnectionList = lappend(sentConnectionList, connection);
+	}
+
+	WaitForAllConnections(sentConnectionList, raiseInterrupts);
+
+	foreach_ptr(connection, sentConnectionList)
+	{
+		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+		if (PQresultStatus(result) != PGRES_COPY_IN)
+		{
+			ReportResultError(connection, result, WARNING);
+			PQclear(result);
+			CloseConnection(connection);
+			continue;
+		}
+
+		PQclear(result);
+
+		if (!PutRemoteCopyData(connection, copyData->data, copyData->len) ||
+			!PutRemoteCopyEnd(connection, NULL))
+		{
+			ReportConnectionError(connection, WARNING);
+			CloseConnection(connection);
+			continue;
+		}
+
+		copyConnectionList = lappend(copyConnectionList, connection);
+	}
+
+	return FinishMetadataSyncCommandOnNodes(copyConnectionList);
+}
@@ -89,6 +89,8 @@ static WorkerNode * ModifiableWorkerNode(const char *nodeName, int32 nodePort);
 static void UpdateNodeLocation(int32 nodeId, char *newNodeName, int32 newNodePort);
 static bool UnsetMetadataSyncedForAll(void);
 static WorkerNode * SetShouldHaveShards(WorkerNode *workerNode, bool shouldHaveShards);
+static ShardInterval * ShardIntervalForDistributionArgument(FunctionCallInfo fcinfo);
+static WorkerNode * MetadataWorkerNodeForShard(uint64 shardId);
 
 /* declarations for dynamic loading */
 PG_FUNCTION_INFO_V1(master_add_node);
@@ -100,6 +102,7 @@ PG_FUNCTION_INFO_V1(master_disable_node);
 PG_FUNCTION_INFO_V1(master_activate_node);
 PG_FUNCTION_INFO_V1(master_update_node);
 PG_FUNCTION_INFO_V1(get_shard_id_for_distribution_column);
+PG_FUNCTION_INFO_V1(get_node_for_distribution_column);
 
 
 /*
@@ -509,7 +512,9 @@ NodeIsSecondary(WorkerNode *worker)
 bool
 NodeIsReadable(WorkerNode *workerNode)
 {
-	if (ReadFromSecondaries == USE_SECONDARY_NODES_NEVER &&
+	/* with 'prefer', the executor decides which reads go to secondaries */
+	if ((ReadFromSecondaries == USE_SECONDARY_NODES_NEVER ||
+		 ReadFromSecondaries == USE_SECONDARY_NODES_PREFER) &&
 		NodeIsPrimary(workerNode))
 	{
 		return true;
@@ -776,13 +781,75 @@ UpdateNodeLocation(int32 nodeId, char *newNodeName, int32 newNodePort)
 Datum
 get_shard_id_for_distribution_column(PG_FUNCTION_ARGS)
 {
-	ShardInterval *shardInterval = NULL;
+	CheckCitusVersion(ERROR);
+
+	ShardInterval *shardInterval = ShardIntervalForDistributionArgument(fcinfo);
+	if (shardInterval != NULL)
+	{
+		PG_RETURN_INT64(shardInterval->shardId);
+	}
+
+	PG_RETURN_INT64(0);
+}
+
+
+/*
+ * get_node_for_distribution_column function takes a distributed table name and a
+ * distribution value then returns the name and port of a worker node that has the
+ * shard which contains given value and has the metadata synced. Clients can connect
+ * to that node directly and run single shard queries on it, instead of going through
+ * the coordinator. If there is no such node, NULLs are returned and queries should
+ * be sent to the coordinator.
+ */
+Datum
+get_node_for_distribution_column(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupleDescriptor = NULL;
+	Datum values[2];
+	bool isNulls[2];
 
 	CheckCitusVersion(ERROR);
 
+	if (get_call_result_type(fcinfo, NULL, &tupleDescriptor) != TYPEFUNC_COMPOSITE)
+	{
+		ereport(ERROR, (errmsg("return type must be a row type")));
+	}
+
+	memset(values, 0, sizeof(values));
+	memset(isNulls, true, sizeof(isNulls));
+
+	ShardInterval *shardInterval = ShardIntervalForDistributionArgument(fcinfo);
+	if (shardInterval != NULL)
+	{
+		WorkerNode *workerNode = MetadataWorkerNodeForShard(shardInterval->shardId);
+		if (workerNode != NULL)
+		{
+			values[0] = CStringGetTextDatum(workerNode->workerName);
+			values[1] = Int32GetDatum(workerNode->workerPort);
+			memset(isNulls, false, sizeof(isNulls));
+		}
+	}
+
+	HeapTuple nodeTuple = heap_form_tuple(tupleDescriptor, values, isNulls);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(nodeTuple));
+}
+
+
+/*
+ * ShardIntervalForDistributionArgument returns the shard of the distributed table
+ * given as the first argument of the function that contains the distribution value
+ * given as the second argument. For reference tables, the distribution value is
+ * ignored. NULL is returned if there is no such shard.
+ */
+static ShardInterval *
+ShardIntervalForDistributionArgument(FunctionCallInfo fcinfo)
+{
+	ShardInterval *shardInterval = NULL;
+
 	/*
-	 * To have optional parameter as NULL, we defined this UDF as not strict, therefore
-	 * we need to check all parameters for NULL values.
+	 * To have optional parameter as NULL, we defined these UDFs as not strict,
+	 * therefore we need to check all parameters for NULL values.
 	 */
 	if (PG_ARGISNULL(0))
 	{
@@ -805,7 +872,7 @@ get_shard_id_for_distribution_column(PG_FUNCTION_ARGS)
 		List *shardIntervalList = LoadShardIntervalList(relationId);
 		if (shardIntervalList == NIL)
 		{
-			PG_RETURN_INT64(0);
+			return NULL;
 		}
 
 		shardInterval = (ShardInterval *) linitial(shardIntervalList);
@@ -843,12 +910,35 @@ get_shard_id_for_distribution_column(PG_FUNCTION_ARGS)
 							   "tables and reference tables.")));
 	}
 
-	if (shardInterval != NULL)
+	return shardInterval;
+}
+
+
+/*
+ * MetadataWorkerNodeForShard returns the first primary node that has an active
+ * placement of the given shard and that has the metadata synced, such that
+ * queries on the shard can be planned on it. NULL is returned if there is none.
+ */
+static WorkerNode *
+MetadataWorkerNodeForShard(uint64 shardId)
+{
+	List *placementList = FinalizedShardPlacementList(shardId);
+	ListCell *placementCell = NULL;
+
+	foreach(placementCell, placementList)
 	{
-		PG_RETURN_INT64(shardInterval->shardId);
+		ShardPlacement *placement = (ShardPlacement *) lfirst(placementCell);
+		WorkerNode *workerNode = FindWorkerNode(placement->nodeName,
+												placement->nodePort);
+
+		if (workerNode != NULL && workerNode->isActive && NodeIsPrimary(workerNode) &&
+			workerNode->hasMetadata && workerNode->metadataSynced)
+		{
+			return workerNode;
+		}
 	}
 
-	PG_RETURN_INT64(0);
+	return NULL;
 }
 
 
@@ -0,0 +1,970 @@
+/*-------------------------------------------------------------------------
+ *
+ * shard_column_stats.c
+ *    Routines for keeping min/max statistics of columns other than the
+ *    distribution column for the shards of append-distributed tables, and
+ *    for pruning shards using these statistics.
+ *
+ *    The columns to keep statistics for are listed in
+ *    citus.pg_dist_shard_statistics_column, and the statistics themselves
+ *    are stored in citus.pg_dist_shard_column_stats. The statistics are
+ *    refreshed whenever the shard statistics are updated, for instance by
+ *    master_append_table_to_shard() or master_update_shard_statistics().
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include "access/nbtree.h"
+#include "catalog/pg_type.h"
+#include "distributed/connection_management.h"
+#include "distributed/listutils.h"
+#include "distributed/master_metadata_utility.h"
+#include "distributed/metadata/shard_column_stats.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/placement_connection.h"
+#include "distributed/remote_commands.h"
+#include "distributed/worker_manager.h"
+#include "executor/spi.h"
+#include "nodes/nodeFuncs.h"
+#include "nodes/primnodes.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/typcache.h"
+
+
+/*
+ * ColumnStatisticsRestriction represents a restriction of the form
+ * column <op> constant from the WHERE clause, where the column has shard
+ * statistics and <op> is a btree comparison operator of the column type.
+ */
+typedef struct ColumnStatisticsRestriction
+{
+	AttrNumber attributeNumber;
+	Oid typeId;
+	Oid collationId;
+	int strategy;
+	Datum value;
+} ColumnStatisticsRestriction;
+
+
+/*
+ * ShardColumnStatistics represents a row of citus.pg_dist_shard_column_stats
+ * with the min/max values parsed into datums.
+ */
+typedef struct ShardColumnStatistics
+{
+	uint64 shardId;
+	bool valuesAreNull;
+	Datum minValue;
+	Datum maxValue;
+} ShardColumnStatistics;
+
+
+/* config variable managed via guc.c */
+bool EnableColumnStatisticsPruning = false;
+
+
+static AttrNumber ColumnAttributeNumber(Oid relationId, text *columnNameText);
+static List * ShardStatisticsColumnList(Oid relationId);
+static void FetchShardColumnStatistics(Oid relationId, List *attributeNumberList,
+									   char *shardQualifiedName,
+									   List *shardPlacementList,
+									   List **minValueList, List **maxValueList);
+static void ColumnRestrictionList(Node *node, Index rangeTableId,
+								  List **restrictionList);
+static ColumnStatisticsRestriction * ColumnRestriction(OpExpr *opClause,
+													   Index rangeTableId);
+static List * LoadShardColumnStatistics(Oid relationId, AttrNumber attributeNumber,
+										Oid typeId);
+static bool ShardMayMatchRestriction(ShardColumnStatistics *shardStatistics,
+									 ColumnStatisticsRestriction *restriction,
+									 FmgrInfo *compareFunction);
+static int CompareShardIds(const void *leftElement, const void *rightElement);
+static int ExecuteShardStatisticsCommand(char *query, int paramCount, Oid *paramTypes,
+										 Datum *paramValues, const char *paramNulls);
+
+
+PG_FUNCTION_INFO_V1(citus_add_shard_statistics_column);
+PG_FUNCTION_INFO_V1(citus_remove_shard_statistics_column);
+
+
+/*
+ * citus_add_shard_statistics_column makes Citus keep min/max statistics for
+ * the given column of the given append-distributed table. The statistics of
+ * existing shards are filled in the next time their statistics are updated.
+ */
+Datum
+citus_add_shard_statistics_column(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+	text *columnNameText = PG_GETARG_TEXT_P(1);
+
+	CheckCitusVersion(ERROR);
+	EnsureCoordinator();
+	EnsureTableOwner(relationId);
+
+	if (!IsDistributedTable(relationId) ||
+		PartitionMethod(relationId) != DISTRIBUTE_BY_APPEND)
+	{
+		char *relationName = get_rel_name(relationId);
+
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot keep shard statistics for \"%s\"", relationName),
+						errdetail("Shard statistics columns are only supported for "
+								  "append-distributed tables.")));
+	}
+
+	AttrNumber attributeNumber = ColumnAttributeNumber(relationId, columnNameText);
+	Oid typeId = get_atttype(relationId, attributeNumber);
+
+	TypeCacheEntry *typeEntry = lookup_type_cache(typeId, TYPECACHE_BTREE_OPFAMILY);
+	if (!OidIsValid(typeEntry->btree_opf))
+	{
+		ereport(ERROR, (errcode(ERRCODE_UNDEFINED_FUNCTION),
+						errmsg("data type %s has no default btree operator class",
+							   format_type_be(typeId)),
+						errdetail("Shard statistics can only be kept for columns "
+								  "whose values can be ordered.")));
+	}
+
+	char *insertQuery =
+		"INSERT INTO citus.pg_dist_shard_statistics_column (logicalrelid, attnum) "
+		"VALUES ($1, $2) ON CONFLICT DO NOTHING";
+	Oid paramTypes[2] = { REGCLASSOID, INT2OID };
+	Datum paramValues[2] = {
+		ObjectIdGetDatum(relationId),
+		Int16GetDatum(attributeNumber)
+	};
+
+	int spiStatus = ExecuteShardStatisticsCommand(insertQuery, 2, paramTypes,
+												  paramValues, NULL);
+	if (spiStatus < 0)
+	{
+		ereport(ERROR, (errmsg("failed to insert shard statistics column")));
+	}
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * citus_remove_shard_statistics_column stops keeping min/max statistics for
+ * the given column of the given table and removes the existing statistics.
+ */
+Datum
+citus_remove_shard_statistics_column(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+	text *columnNameText = PG_GETARG_TEXT_P(1);
+
+	CheckCitusVersion(ERROR);
+	EnsureCoordinator();
+	EnsureTableOwner(relationId);
+
+	AttrNumber attributeNumber = ColumnAttributeNumber(relationId, columnNameText);
+
+	Oid paramTypes[2] = { REGCLASSOID, INT2OID };
+	Datum paramValues[2] = {
+		ObjectIdGetDatum(relationId),
+		Int16GetDatum(attributeNumber)
+	};
+
+	char *deleteColumnQuery =
+		"DELETE FROM citus.pg_dist_shard_statistics_column "
+		"WHERE logicalrelid = $1 AND attnum = $2";
+	int spiStatus = ExecuteShardStatisticsCommand(deleteColumnQuery, 2, paramTypes,
+												  paramValues, NULL);
+	if (spiStatus < 0)
+	{
+		ereport(ERROR, (errmsg("failed to delete shard statistics column")));
+	}
+
+	char *deleteStatisticsQuery =
+		"DELETE FROM citus.pg_dist_shard_column_stats "
+		"WHERE logicalrelid = $1 AND attnum = $2";
+	spiStatus = ExecuteShardStatisticsCommand(deleteStatisticsQuery, 2, paramTypes,
+											  paramValues, NULL);
+	if (spiStatus < 0)
+	{
+		ereport(ERROR, (errmsg("failed to delete shard column statistics")));
+	}
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * ColumnAttributeNumber returns the attribute number of the column with the
+ * given name, and errors out if there is no such column.
+ */
+static AttrNumber
+ColumnAttributeNumber(Oid relationId, text *columnNameText)
+{
+	char *columnName = text_to_cstring(columnNameText);
+
+	AttrNumber attributeNumber = get_attnum(relationId, columnName);
+	if (attributeNumber == InvalidAttrNumber || attributeNumber < 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_UNDEFINED_COLUMN),
+						errmsg("column \"%s\" of relation \"%s\" does not exist",
+							   columnName, get_rel_name(relationId))));
+	}
+
+	return attributeNumber;
+}
+
+
+/*
+ * UpdateShardColumnStatistics fetches the min/max values of the statistics
+ * columns of the given table from one of the given placements of the shard,
+ * and replaces the statistics of the shard in the metadata. If fetching the
+ * statistics fails, the statistics of the shard are removed, which means the
+ * shard is never pruned using them.
+ */
+void
+UpdateShardColumnStatistics(Oid relationId, uint64 shardId, char *shardQualifiedName,
+							List *shardPlacementList)
+{
+	List *minValueList = NIL;
+	List *maxValueList = NIL;
+	ListCell *attributeNumberCell = NULL;
+	ListCell *minValueCell = NULL;
+	ListCell *maxValueCell = NULL;
+
+	List *attributeNumberList = ShardStatisticsColumnList(relationId);
+	if (attributeNumberList == NIL)
+	{
+		return;
+	}
+
+	FetchShardColumnStatistics(relationId, attributeNumberList, shardQualifiedName,
+							   shardPlacementList, &minValueList, &maxValueList);
+
+	char *deleteQuery =
+		"DELETE FROM citus.pg_dist_shard_column_stats WHERE shardid = $1";
+	Oid deleteParamTypes[1] = { INT8OID };
+	Datum deleteParamValues[1] = { Int64GetDatum(shardId) };
+
+	int spiStatus = ExecuteShardStatisticsCommand(deleteQuery, 1, deleteParamTypes,
+												  deleteParamValues, NULL);
+	if (spiStatus < 0)
+	{
+		ereport(ERROR, (errmsg("failed to delete shard column statistics")));
+	}
+
+	if (minValueList == NIL)
+	{
+		ereport(WARNING, (errmsg("could not get column statistics for shard %s",
+								 shardQualifiedName),
+						  errdetail("The shard will not be pruned using column "
+									"statistics.")));
+		return;
+	}
+
+	char *insertQuery =
+		"INSERT INTO citus.pg_dist_shard_column_stats "
+		"(logicalrelid, shardid, attnum, atttypid, minvalue, maxvalue) "
+		"VALUES ($1, $2, $3, $4, $5, $6)";
+	Oid insertParamTypes[6] = {
+		REGCLASSOID, INT8OID, INT2OID, OIDOID, TEXTOID, TEXTOID
+	};
+
+	forthree(attributeNumberCell, attributeNumberList, minValueCell, minValueList,
+			 maxValueCell, maxValueList)
+	{
+		AttrNumber attributeNumber = (AttrNumber) lfirst_int(attributeNumberCell);
+		char *minValue = (char *) lfirst(minValueCell);
+		char *maxValue = (char *) lfirst(maxValueCell);
+		char insertNulls[7] = "      ";
+
+		if (minValue == NULL || maxValue == NULL)
+		{
+			insertNulls[4] = 'n';
+			insertNulls[5] = 'n';
+		}
+
+		Datum insertParamValues[6] = {
+			ObjectIdGetDatum(relationId),
+			Int64GetDatum(shardId),
+			Int16GetDatum(attributeNumber),
+			ObjectIdGetDatum(get_atttype(relationId, attributeNumber)),
+			minValue != NULL ? CStringGetTextDatum(minValue) : (Datum) 0,
+			maxValue != NULL ? CStringGetTextDatum(maxValue) : (Datum) 0
+		};
+
+		spiStatus = ExecuteShardStatisticsCommand(insertQuery, 6, insertParamTypes,
+												  insertParamValues, insertNulls);
+		if (spiStatus < 0)
+		{
+			ereport(ERROR, (errmsg("failed to insert shard column statistics")));
+		}
+	}
+}
+
+
+/*
+ * ShardStatisticsColumnList returns the attribute numbers of the columns of
+ * the given table for which shard statistics are kept, skipping columns that
+ * have been dropped since.
+ */
+static List *
+ShardStatisticsColumnList(Oid relationId)
+{
+	List *attributeNumberList = NIL;
+	MemoryContext callerContext = CurrentMemoryContext;
+
+	char *selectQuery =
+		"SELECT attnum FROM citus.pg_dist_shard_statistics_column "
+		"WHERE logicalrelid = $1 ORDER BY attnum";
+	Oid paramTypes[1] = { REGCLASSOID };
+	Datum paramValues[1] = { ObjectIdGetDatum(relationId) };
+
+	int spiConnected = SPI_connect();
+	if (spiConnected != SPI_OK_CONNECT)
+	{
+		ereport(ERROR, (errmsg("could not connect to SPI manager")));
+	}
+
+	Oid savedUserId = InvalidOid;
+	int savedSecurityContext = 0;
+
+	GetUserIdAndSecContext(&savedUserId, &savedSecurityContext);
+	SetUserIdAndSecContext(CitusExtensionOwner(), SECURITY_LOCAL_USERID_CHANGE);
+
+	int spiStatus = SPI_execute_with_args(selectQuery, 1, paramTypes, paramValues,
+										  NULL, true, 0);
+
+	SetUserIdAndSecContext(savedUserId, savedSecurityContext);
+
+	if (spiStatus != SPI_OK_SELECT)
+	{
+		ereport(ERROR, (errmsg("failed to read shard statistics columns")));
+	}
+
+	for (uint64 rowIndex = 0; rowIndex < SPI_processed; rowIndex++)
+	{
+		HeapTuple heapTuple = SPI_tuptable->vals[rowIndex];
+		bool isNull = false;
+
+		Datum attributeNumberDatum = SPI_getbinval(heapTuple, SPI_tuptable->tupdesc,
+												   1, &isNull);
+		AttrNumber attributeNumber = DatumGetInt16(attributeNumberDatum);
+		char *columnName = get_attname(relationId, attributeNumber, true);
+
+		if (columnName == NULL)
+		{
+			/* column has been dropped */
+			continue;
+		}
+
+		MemoryContext spiContext = MemoryContextSwitchTo(callerContext);
+		attributeNumberList = lappend_int(attributeNumberList, attributeNumber);
+		MemoryContextSwitchTo(spiContext);
+	}
+
+	int spiFinished = SPI_finish();
+	if (spiFinished != SPI_OK_FINISH)
+	{
+		ereport(ERROR, (errmsg("could not disconnect from SPI manager")));
+	}
+
+	return attributeNumberList;
+}
+
+
+/*
+ * FetchShardColumnStatistics queries the min/max values of the given columns
+ * on the placements of the shard until it succeeds on one of them. The values
+ * are returned in their text representation, or NULL if the column only has
+ * NULL values. If the statistics cannot be fetched from any placement, both
+ * lists are set to NIL.
+ */
+static void
+FetchShardColumnStatistics(Oid relationId, List *attributeNumberList,
+						   char *shardQualifiedName, List *shardPlacementList,
+						   List **minValueList, List **maxValueList)
+{
+	StringInfo statisticsQuery = makeStringInfo();
+	ListCell *attributeNumberCell = NULL;
+	ShardPlacement *placement = NULL;
+
+	*minValueList = NIL;
+	*maxValueList = NIL;
+
+	appendStringInfoString(statisticsQuery, "SELECT ");
+
+	foreach(attributeNumberCell, attributeNumberList)
+	{
+		AttrNumber attributeNumber = (AttrNumber) lfirst_int(attributeNumberCell);
+		char *columnName = get_attname(relationId, attributeNumber, false);
+		const char *quotedColumnName = quote_identifier(columnName);
+
+		if (attributeNumberCell != list_head(attributeNumberList))
+		{
+			appendStringInfoString(statisticsQuery, ", ");
+		}
+
+		/*
+		 * Use ORDER BY rather than min()/max(), since not all types that have
+		 * a btree operator class have those aggregates.
+		 */
+		appendStringInfo(statisticsQuery,
+						 "(SELECT %s FROM %s WHERE %s IS NOT NULL ORDER BY %s LIMIT 1), "
+						 "(SELECT %s FROM %s WHERE %s IS NOT NULL "
+						 "ORDER BY %s DESC LIMIT 1)",
+						 quotedColumnName, shardQualifiedName, quotedColumnName,
+						 quotedColumnName, quotedColumnName, shardQualifiedName,
+						 quotedColumnName, quotedColumnName);
+	}
+
+	foreach_ptr(placement, shardPlacementList)
+	{
+		PGresult *queryResult = NULL;
+		int connectionFlags = 0;
+
+		MultiConnection *connection = GetPlacementConnection(connectionFlags, placement,
+															 NULL);
+
+		int executeCommand = ExecuteOptionalRemoteCommand(connection,
+														  statisticsQuery->data,
+														  &queryResult);
+		if (executeCommand != 0)
+		{
+			continue;
+		}
+
+		if (PQntuples(queryResult) != 1)
+		{
+			PQclear(queryResult);
+			ForgetResults(connection);
+			continue;
+		}
+
+		int columnCount = list_length(attributeNumberList);
+		for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+		{
+			int minValueIndex = 2 * columnIndex;
+			int maxValueIndex = 2 * columnIndex + 1;
+			char *minValue = NULL;
+			char *maxValue = NULL;
+
+			if (!PQgetisnull(queryResult, 0, minValueIndex) &&
+				!PQgetisnull(queryResult, 0, maxValueIndex))
+			{
+				minValue = pstrdup(PQgetvalue(queryResult, 0, minValueIndex));
+				maxValue = pstrdup(PQgetvalue(queryResult, 0, maxValueIndex));
+			}
+
+			*minValueList = lappend(*minValueList, minValue);
+			*maxValueList = lappend(*maxValueList, maxValue);
+		}
+
+		PQclear(queryResult);
+		ForgetResults(connection);
+
+		return;
+	}
+}
+
+
+/*
+ * DeleteShardColumnStatistics removes the shard statistics columns and the
+ * shard column statistics of the given table from the metadata.
+ */
+void
+DeleteShardColumnStatistics(Oid relationId)
+{
+	Oid paramTypes[1] = { REGCLASSOID };
+	Datum paramValues[1] = { ObjectIdGetDatum(relationId) };
+
+	char *deleteColumnQuery =
+		"DELETE FROM citus.pg_dist_shard_statistics_column WHERE logicalrelid = $1";
+	int spiStatus = ExecuteShardStatisticsCommand(deleteColumnQuery, 1, paramTypes,
+												  paramValues, NULL);
+	if (spiStatus < 0)
+	{
+		ereport(ERROR, (errmsg("failed to delete shard statistics columns")));
+	}
+
+	char *deleteStatisticsQuery =
+		"DELETE FROM citus.pg_dist_shard_column_stats WHERE logicalrelid = $1";
+	spiStatus = ExecuteShardStatisticsCommand(deleteStatisticsQuery, 1, paramTypes,
+											  paramValues, NULL);
+	if (spiStatus < 0)
+	{
+		ereport(ERROR, (errmsg("failed to delete shard column statistics")));
+	}
+}
+
+
+/*
+ * PruneShardsByColumnStatistics removes the shards from the given shard list
+ * whose column statistics prove that they cannot contain rows matching the
+ * top-level column <op> constant restrictions in the given WHERE clause list.
+ * Shards without statistics are always kept.
+ */
+List *
+PruneShardsByColumnStatistics(Oid relationId, Index rangeTableId,
+							  List *whereClauseList, List *shardIntervalList)
+{
+	List *restrictionList = NIL;
+	ColumnStatisticsRestriction *restriction = NULL;
+	uint64 *excludedShardIdArray = NULL;
+	int excludedShardCount = 0;
+	int excludedShardCapacity = 0;
+	List *remainingShardList = NIL;
+	ShardInterval *shardInterval = NULL;
+
+	if (!EnableColumnStatisticsPruning || shardIntervalList == NIL ||
+		PartitionMethod(relationId) != DISTRIBUTE_BY_APPEND)
+	{
+		return shardIntervalList;
+	}
+
+	ColumnRestrictionList((Node *) whereClauseList, rangeTableId, &restrictionList);
+	if (restrictionList == NIL)
+	{
+		return shardIntervalList;
+	}
+
+	foreach_ptr(restriction, restrictionList)
+	{
+		ShardColumnStatistics *shardStatistics = NULL;
+		TypeCacheEntry *typeEntry = lookup_type_cache(restriction->typeId,
+													  TYPECACHE_CMP_PROC_FINFO);
+
+		if (!OidIsValid(typeEntry->cmp_proc_finfo.fn_oid))
+		{
+			continue;
+		}
+
+		AttrNumber attributeNumber = restriction->attributeNumber;
+		List *shardStatisticsList = LoadShardColumnStatistics(relationId,
+															  attributeNumber,
+															  restriction->typeId);
+
+		foreach_ptr(shardStatistics, shardStatisticsList)
+		{
+			if (ShardMayMatchRestriction(shardStatistics, restriction,
+										 &typeEntry->cmp_proc_finfo))
+			{
+				continue;
+			}
+
+			if (excludedShardCount == excludedShardCapacity)
+			{
+				excludedShardCapacity = Max(16, 2 * excludedShardCapacity);
+
+				if (excludedShardIdArray == NULL)
+				{
+					excludedShardIdArray = palloc(excludedShardCapacity *
+												  sizeof(uint64));
+				}
+				else
+				{
+					excludedShardIdArray = repalloc(excludedShardIdArray,
+													excludedShardCapacity *
+													sizeof(uint64));
+				}
+			}
+
+			excludedShardIdArray[excludedShardCount++] = shardStatistics->shardId;
+		}
+	}
+
+	if (excludedShardCount == 0)
+	{
+		return shardIntervalList;
+	}
+
+	qsort(excludedShardIdArray, excludedShardCount, sizeof(uint64), CompareShardIds);
+
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		uint64 shardId = shardInterval->shardId;
+
+		if (bsearch(&shardId, excludedShardIdArray, excludedShardCount,
+					sizeof(uint64), CompareShardIds) == NULL)
+		{
+			remainingShardList = lappend(remainingShardList, shardInterval);
+		}
+	}
+
+	return remainingShardList;
+}
+
+
+/*
+ * ColumnRestrictionList walks the implicitly ANDed top-level clauses of the
+ * given expression and appends the restrictions that can be checked against
+ * the shard column statistics to the restriction list.
+ */
+static void
+ColumnRestrictionList(Node *node, Index rangeTableId, List **restrictionList)
+{
+	if (node == NULL)
+	{
+		return;
+	}
+
+	if (IsA(node, List))
+	{
+		Node *clause = NULL;
+
+		foreach_ptr(clause, (List *) node)
+		{
+			ColumnRestrictionList(clause, rangeTableId, restrictionList);
+		}
+	}
+	else if (IsA(node, BoolExpr) && ((BoolExpr *) node)->boolop == AND_EXPR)
+	{
+		ColumnRestrictionList((Node *) ((BoolExpr *) node)->args, rangeTableId,
+							  restrictionList);
+	}
+	else if (IsA(node, OpExpr))
+	{
+		ColumnStatisticsRestriction *restriction =
+			ColumnRestriction((OpExpr *) node, rangeTableId);
+
+		if (restriction != NULL)
+		{
+			*restrictionList = lappend(*restrictionList, restriction);
+		}
+	}
+}
+
+
+/*
+ * ColumnRestriction returns a restriction for the given operator clause if it
+ * compares a column of the given range table entry with a non-null constant
+ * of the same type using an operator of the default btree operator family of
+ * that type. Otherwise, it returns NULL.
+ */
+static ColumnStatisticsRestriction *
+ColumnRestriction(OpExpr *opClause, Index rangeTableId)
+{
+	Var *column = NULL;
+	Const *constant = NULL;
+	bool constantOnLeft = false;
+	Oid leftType = InvalidOid;
+	Oid rightType = InvalidOid;
+
+	if (list_length(opClause->args) != 2)
+	{
+		return NULL;
+	}
+
+	Node *leftOperand = (Node *) linitial(opClause->args);
+	Node *rightOperand = (Node *) lsecond(opClause->args);
+
+	if (IsA(leftOperand, Var) && IsA(rightOperand, Const))
+	{
+		column = (Var *) leftOperand;
+		constant = (Const *) rightOperand;
+	}
+	else if (IsA(leftOperand, Const) && IsA(rightOperand, Var))
+	{
+		column = (Var *) rightOperand;
+		constant = (Const *) leftOperand;
+		constantOnLeft = true;
+	}
+	else
+	{
+		return NULL;
+	}
+
+	if (column->varno != rangeTableId || column->varlevelsup != 0 ||
+		column->varattno <= 0 || constant->constisnull ||
+		constant->consttype != column->vartype)
+	{
+		return NULL;
+	}
+
+	/* the statistics are ordered using the collation of the column */
+	if (opClause->inputcollid != column->varcollid)
+	{
+		return NULL;
+	}
+
+	op_input_types(opClause->opno, &leftType, &rightType);
+	if (leftType != column->vartype || rightType != column->vartype)
+	{
+		return NULL;
+	}
+
+	TypeCacheEntry *typeEntry = lookup_type_cache(column->vartype,
+												  TYPECACHE_BTREE_OPFAMILY);
+	if (!OidIsValid(typeEntry->btree_opf))
+	{
+		return NULL;
+	}
+
+	int strategy = get_op_opfamily_strategy(opClause->opno, typeEntry->btree_opf);
+	if (strategy == InvalidStrategy)
+	{
+		return NULL;
+	}
+
+	/* normalize constant <op> column into column <op'> constant */
+	if (constantOnLeft)
+	{
+		switch (strategy)
+		{
+			case BTLessStrategyNumber:
+			{
+				strategy = BTGreaterStrategyNumber;
+				break;
+			}
+
+			case BTLessEqualStrategyNumber:
+			{
+				strategy = BTGreaterEqualStrategyNumber;
+				break;
+			}
+
+			case BTGreaterEqualStrategyNumber:
+			{
+				strategy = BTLessEqualStrategyNumber;
+				break;
+			}
+
+			case BTGreaterStrategyNumber:
+			{
+				strategy = BTLessStrategyNumber;
+				break;
+			}
+
+			default:
+			{
+				break;
+			}
+		}
+	}
+
+	ColumnStatisticsRestriction *restriction =
+		palloc0(sizeof(ColumnStatisticsRestriction));
+	restriction->attributeNumber = column->varattno;
+	restriction->typeId = column->vartype;
+	restriction->collationId = column->varcollid;
+	restriction->strategy = strategy;
+	restriction->value = constant->constvalue;
+
+	return restriction;
+}
+
+
+/*
+ * LoadShardColumnStatistics returns the statistics of the given column for
+ * the shards of the given table. Statistics that were collected while the
+ * column had a different type are skipped.
+ */
+static List *
+LoadShardColumnStatistics(Oid relationId, AttrNumber attributeNumber, Oid typeId)
+{
+	List *shardStatisticsList = NIL;
+	MemoryContext callerContext = CurrentMemoryContext;
+	Oid typeInputFunctionId = InvalidOid;
+	Oid typeIoParam = InvalidOid;
+
+	getTypeInputInfo(typeId, &typeInputFunctionId, &typeIoParam);
+
+	char *selectQuery =
+		"SELECT shardid, minvalue, maxvalue FROM citus.pg_dist_shard_column_stats "
+		"WHERE logicalrelid = $1 AND attnum = $2 AND atttypid = $3";
+	Oid paramTypes[3] = { REGCLASSOID, INT2OID, OIDOID };
+	Datum paramValues[3] = {
+		ObjectIdGetDatum(relationId),
+		Int16GetDatum(attributeNumber),
+		ObjectIdGetDatum(typeId)
+	};
+
+	int spiConnected = SPI_connect();
+	if (spiConnected != SPI_OK_CONNECT)
+	{
+		ereport(ERROR, (errmsg("could not connect to SPI manager")));
+	}
+
+	Oid savedUserId = InvalidOid;
+	int savedSecurityContext = 0;
+
+	GetUserIdAndSecContext(&savedUserId, &savedSecurityContext);
+	SetUserIdAndSecContext(CitusExtensionOwner(), SECURITY_LOCAL_USERID_CHANGE);
+
+	int spiStatus = SPI_execute_with_args(selectQuery, 3, paramTypes, paramValues,
+										  NULL, true, 0);
+
+	SetUserIdAndSecContext(savedUserId, savedSecurityContext);
+
+	if (spiStatus != SPI_OK_SELECT)
+	{
+		ereport(ERROR, (errmsg("failed to read shard column statistics")));
+	}
+
+	for (uint64 rowIndex = 0; rowIndex < SPI_processed; rowIndex++)
+	{
+		HeapTuple heapTuple = SPI_tuptable->vals[rowIndex];
+		TupleDesc tupleDescriptor = SPI_tuptable->tupdesc;
+		bool isNull = false;
+
+		Datum shardIdDatum = SPI_getbinval(heapTuple, tupleDescriptor, 1, &isNull);
+		char *minValueString = SPI_getvalue(heapTuple, tupleDescriptor, 2);
+		char *maxValueString = SPI_getvalue(heapTuple, tupleDescriptor, 3);
+
+		/* allocate the statistics in the caller's memory context */
+		MemoryContext spiContext = MemoryContextSwitchTo(callerContext);
+
+		ShardColumnStatistics *shardStatistics = palloc0(sizeof(ShardColumnStatistics));
+		shardStatistics->shardId = DatumGetInt64(shardIdDatum);
+
+		if (minValueString == NULL || maxValueString == NULL)
+		{
+			shardStatistics->valuesAreNull = true;
+		}
+		else
+		{
+			shardStatistics->minValue = OidInputFunctionCall(typeInputFunctionId,
+															 minValueString,
+															 typeIoParam, -1);
+			shardStatistics->maxValue = OidInputFunctionCall(typeInputFunctionId,
+															 maxValueString,
+															 typeIoParam, -1);
+		}
+
+		shardStatisticsList = lappend(shardStatisticsList, shardStatistics);
+
+		MemoryContextSwitchTo(spiContext);
+	}
+
+	int spiFinished = SPI_finish();
+	if (spiFinished != SPI_OK_FINISH)
+	{
+		ereport(ERROR, (errmsg("could not disconnect from SPI manager")));
+	}
+
+	return shardStatisticsList;
+}
+
+
+/*
+ * ShardMayMatchRestriction returns false if the given statistics prove that
+ * the shard has no rows matching the given restriction, and true otherwise.
+ * A shard for which the column only contains NULLs never matches, since all
+ * btree comparison operators are strict.
+ */
+static bool
+ShardMayMatchRestriction(ShardColumnStatistics *shardStatistics,
+						 ColumnStatisticsRestriction *restriction,
+						 FmgrInfo *compareFunction)
+{
+	if (shardStatistics->valuesAreNull)
+	{
+		return false;
+	}
+
+	Oid collationId = restriction->collationId;
+	int minCompare = DatumGetInt32(FunctionCall2Coll(compareFunction, collationId,
+													 shardStatistics->minValue,
+													 restriction->value));
+	int maxCompare = DatumGetInt32(FunctionCall2Coll(compareFunction, collationId,
+													 shardStatistics->maxValue,
+													 restriction->value));
+
+	switch (restriction->strategy)
+	{
+		case BTLessStrategyNumber:
+		{
+			return minCompare < 0;
+		}
+
+		case BTLessEqualStrategyNumber:
+		{
+			return minCompare <= 0;
+		}
+
+		case BTEqualStrategyNumber:
+		{
+			return minCompare <= 0 && maxCompare >= 0;
+		}
+
+		case BTGreaterEqualStrategyNumber:
+		{
+			return maxCompare >= 0;
+		}
+
+		case BTGreaterStrategyNumber:
+		{
+			return maxCompare > 0;
+		}
+
+		default:
+		{
+			return true;
+		}
+	}
+}
+
+
+/*
+ * CompareShardIds is a comparator for sorting and searching arrays of
+ * shard ids.
+ */
+static int
+CompareShardIds(const void *leftElement, const void *rightElement)
+{
+	uint64 leftShardId = *((const uint64 *) leftElement);
+	uint64 rightShardId = *((const uint64 *) rightElement);
+
+	if (leftShardId > rightShardId)
+	{
+		return 1;
+	}
+	else if (leftShardId < rightShardId)
+	{
+		return -1;
+	}
+	else
+	{
+		return 0;
+	}
+}
+
+
+/*
+ * ExecuteShardStatisticsCommand executes the given modification with the
+ * given parameters as the extension owner, since regular users are not allowed to
+ * write to the tables in the citus schema.
+ */
+static int
+ExecuteShardStatisticsCommand(char *query, int paramCount, Oid *paramTypes,
+							  Datum *paramValues, const char *paramNulls)
+{
+	Oid savedUserId = InvalidOid;
+	int savedSecurityContext = 0;
+
+	int spiConnected = SPI_connect();
+	if (spiConnected != SPI_OK_CONNECT)
+	{
+		ereport(ERROR, (errmsg("could not connect to SPI manager")));
+	}
+
+	GetUserIdAndSecContext(&savedUserId, &savedSecurityContext);
+	SetUserIdAndSecContext(CitusExtensionOwner(), SECURITY_LOCAL_USERID_CHANGE);
+
+	int spiStatus = SPI_execute_with_args(query, paramCount, paramTypes, paramValues,
+										  paramNulls, false, 0);
+
+	SetUserIdAndSecContext(savedUserId, savedSecurityContext);
+
+	int spiFinished = SPI_finish();
+	if (spiFinished != SPI_OK_FINISH)
+	{
+		ereport(ERROR, (errmsg("could not disconnect from SPI manager")));
+	}
+
+	return spiStatus;
+}
@@ -0,0 +1,850 @@
+/*-------------------------------------------------------------------------
+ *
+ * shared_metadata_cache.c
+ *   Keeps the pg_dist_shard and pg_dist_placement rows of distributed tables
+ *   in shared memory, such that backends do not each have to scan the
+ *   catalogs to build their metadata cache.
+ *
+ * Building a DistTableCacheEntry requires an index scan on pg_dist_shard and
+ * one index scan on pg_dist_placement per shard. For tables with many shards,
+ * this makes the first query of every new connection slow. When
+ * citus.shared_metadata_cache_size is set, the first backend that builds the
+ * entry for a table copies the rows it read into shared memory, and other
+ * backends copy them from there instead of scanning the catalogs.
+ *
+ * A shared entry is removed whenever a backend processes a relcache
+ * invalidation for its table. To avoid publishing rows that were read before
+ * a concurrent change was committed, a backend registers a build id for the
+ * table before scanning the catalogs and only publishes the rows if the
+ * entry still carries that id, that is, if no invalidation of the table was
+ * processed in the meantime. Transactions that have been assigned a
+ * transaction id may have modified the catalogs, so they neither use nor
+ * publish shared entries.
+ *
+ * In addition, backends log the shards whose placements they change in a
+ * small ring buffer. When a backend processes the resulting invalidation of
+ * a table, it uses the log to reload only the placements of those shards
+ * instead of rebuilding the whole cache entry.
+ *
+ * Finally, the shared state holds a DDL generation, which every DDL command
+ * advances. Backends use it to tell whether DDL commands they cached for
+ * tables may be stale, since the relcache invalidations that would otherwise
+ * signal this are also sent for every change to the shards of a table.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include "access/htup_details.h"
+#include "access/transam.h"
+#include "access/xact.h"
+#include "access/xlog.h"
+#include "distributed/master_metadata_utility.h"
+#include "distributed/shared_metadata_cache.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/procarray.h"
+#include "storage/shmem.h"
+#include "utils/hsearch.h"
+#include "utils/resowner.h"
+
+
+/* maximum number of distributed tables in the shared hash */
+#define SHARED_METADATA_CACHE_MAX_TABLES 8192
+
+/* number of placement changes that are kept in the log */
+#define SHARD_PLACEMENT_CHANGE_LOG_SIZE 4096
+
+
+/*
+ * ShardPlacementChange records that a transaction changed the placements of
+ * a shard.
+ */
+typedef struct ShardPlacementChange
+{
+	Oid databaseId;
+	TransactionId transactionId;
+	uint64 shardId;
+} ShardPlacementChange;
+
+
+/*
+ * SharedMetadataCacheData holds the lock that protects the shared hash and
+ * the data area, which stores the rows of the cached tables. Space in the
+ * data area is handed out sequentially and only reclaimed when the whole
+ * cache is reset after it fills up. The placement change log is a ring
+ * buffer with its own lock, which is used regardless of whether the data
+ * area is enabled.
+ */
+typedef struct SharedMetadataCacheData
+{
+	int trancheId;
+	char *trancheName;
+	LWLock lock;
+	LWLock placementChangeLock;
+
+	/* number of changes ever logged, the next change goes to count % size */
+	uint64 placementChangeCount;
+	ShardPlacementChange placementChangeLog[SHARD_PLACEMENT_CHANGE_LOG_SIZE];
+
+	/* advanced by every DDL command, and again when its transaction ends */
+	pg_atomic_uint64 ddlGeneration;
+
+	uint64 nextBuildId;
+	Size dataSize;
+	Size usedSize;
+	char data[FLEXIBLE_ARRAY_MEMBER];
+} SharedMetadataCacheData;
+
+
+/* the shared hash is keyed on the table, which is only unique per database */
+typedef struct SharedShardListKey
+{
+	Oid databaseId;
+	Oid relationId;
+} SharedShardListKey;
+
+/* hash entry for the shards of a table */
+typedef struct SharedShardListEntry
+{
+	SharedShardListKey key;
+
+	/* id of the last backend that started to build the entry */
+	uint64 buildId;
+
+	/* whether the rows have been published */
+	bool isValid;
+
+	/* location of the SharedShardData array in the data area */
+	Size dataOffset;
+	int shardCount;
+} SharedShardListEntry;
+
+/*
+ * SharedShardData describes where the pg_dist_shard tuple and the placements
+ * of a shard are stored, relative to the start of the entry's data.
+ */
+typedef struct SharedShardData
+{
+	Size tupleOffset;
+	uint32 tupleLength;
+	Size placementOffset;
+	int placementCount;
+} SharedShardData;
+
+
+/* configuration for the size of the data area in kB, 0 disables the cache */
+int SharedMetadataCacheSize = 0;
+
+
+/* the following two structs are used for accessing shared memory */
+static HTAB *SharedShardListHash = NULL;
+static SharedMetadataCacheData *SharedMetadataCacheState = NULL;
+
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+/* position in the placement change log of the oldest unprocessed change */
+static uint64 NextPlacementChange = 0;
+
+/*
+ * Set when unprocessed changes were overwritten, until all transactions that
+ * started before PlacementChangesLostHorizon have finished.
+ */
+static bool PlacementChangesLost = false;
+static TransactionId PlacementChangesLostHorizon = InvalidTransactionId;
+
+/* whether the DDL generation needs to be advanced when the transaction ends */
+static bool DDLGenerationAdvancePending = false;
+static bool RegisteredDDLGenerationCallback = false;
+
+
+/* local function declarations */
+static bool SharedMetadataCacheEnabled(void);
+static void InitSharedShardListKey(SharedShardListKey *key, Oid relationId);
+static Size SharedShardListSize(List *shardTupleList, List **shardPlacementListArray);
+static void ResetSharedShardLists(void);
+static size_t SharedMetadataCacheShmemSize(void);
+static void SharedMetadataCacheShmemInit(void);
+static void DDLGenerationReleaseCallback(ResourceReleasePhase phase, bool isCommit,
+										 bool isTopLevel, void *arg);
+
+
+/*
+ * LookupSharedShardList copies the pg_dist_shard tuples and the placements of
+ * the shards of the given table from shared memory if they were published by
+ * another backend. The placement lists are returned in an array that follows
+ * the order of the tuple list. The function returns false if the table is not
+ * in the shared cache, in which case the caller has to read the catalogs.
+ */
+bool
+LookupSharedShardList(Oid relationId, List **shardTupleList,
+					  List ***shardPlacementListArray)
+{
+	SharedShardListKey key;
+	bool foundInCache = false;
+
+	if (!SharedMetadataCacheEnabled())
+	{
+		return false;
+	}
+
+	InitSharedShardListKey(&key, relationId);
+
+	LWLockAcquire(&SharedMetadataCacheState->lock, LW_SHARED);
+
+	SharedShardListEntry *entry = hash_search(SharedShardListHash, &key, HASH_FIND,
+											  &foundInCache);
+	if (!foundInCache || !entry->isValid)
+	{
+		LWLockRelease(&SharedMetadataCacheState->lock);
+
+		return false;
+	}
+
+	char *entryData = SharedMetadataCacheState->data + entry->dataOffset;
+	SharedShardData *shardDataArray = (SharedShardData *) entryData;
+	int shardCount = entry->shardCount;
+
+	*shardTupleList = NIL;
+	*shardPlacementListArray = palloc0(Max(shardCount, 1) * sizeof(List *));
+
+	for (int shardIndex = 0; shardIndex < shardCount; shardIndex++)
+	{
+		SharedShardData *shardData = &shardDataArray[shardIndex];
+		List *placementList = NIL;
+
+		/* allocate the tuple in one chunk, like heap_copytuple does */
+		HeapTuple shardTuple = palloc0(HEAPTUPLESIZE + shardData->tupleLength);
+		shardTuple->t_len = shardData->tupleLength;
+		ItemPointerSetInvalid(&(shardTuple->t_self));
+		shardTuple->t_tableOid = InvalidOid;
+		shardTuple->t_data = (HeapTupleHeader) ((char *) shardTuple + HEAPTUPLESIZE);
+		memcpy(shardTuple->t_data, entryData + shardData->tupleOffset,
+			   shardData->tupleLength);
+
+		*shardTupleList = lappend(*shardTupleList, shardTuple);
+
+		GroupShardPlacement *placementArray =
+			(GroupShardPlacement *) (entryData + shardData->placementOffset);
+
+		for (int placementIndex = 0; placementIndex < shardData->placementCount;
+			 placementIndex++)
+		{
+			GroupShardPlacement *placement = palloc(sizeof(GroupShardPlacement));
+			*placement = placementArray[placementIndex];
+
+			placementList = lappend(placementList, placement);
+		}
+
+		(*shardPlacementListArray)[shardIndex] = placementList;
+	}
+
+	LWLockRelease(&SharedMetadataCacheState->lock);
+
+	return true;
+}
+
+
+/*
+ * BeginSharedShardListBuild registers that the current backend is about to
+ * read the shards of the given table from the catalogs and returns the id
+ * that PublishSharedShardList needs to publish them. The function needs to
+ * be called before the catalogs are read. It returns 0 if the rows cannot
+ * be published.
+ */
+uint64
+BeginSharedShardListBuild(Oid relationId)
+{
+	SharedShardListKey key;
+	bool foundInCache = false;
+
+	if (!SharedMetadataCacheEnabled())
+	{
+		return 0;
+	}
+
+	InitSharedShardListKey(&key, relationId);
+
+	LWLockAcquire(&SharedMetadataCacheState->lock, LW_EXCLUSIVE);
+
+	SharedShardListEntry *entry = hash_search(SharedShardListHash, &key,
+											  HASH_ENTER_NULL, &foundInCache);
+	if (entry == NULL)
+	{
+		/* the hash is full, start over */
+		ResetSharedShardLists();
+
+		entry = hash_search(SharedShardListHash, &key, HASH_ENTER_NULL,
+							&foundInCache);
+		if (entry == NULL)
+		{
+			LWLockRelease(&SharedMetadataCacheState->lock);
+
+			return 0;
+		}
+	}
+
+	uint64 buildId = ++SharedMetadataCacheState->nextBuildId;
+
+	entry->buildId = buildId;
+	entry->isValid = false;
+	entry->dataOffset = 0;
+	entry->shardCount = 0;
+
+	LWLockRelease(&SharedMetadataCacheState->lock);
+
+	return buildId;
+}
+
+
+/*
+ * PublishSharedShardList copies the given pg_dist_shard tuples and the
+ * placement lists in the corresponding array into shared memory, unless the
+ * table was invalidated since BeginSharedShardListBuild returned the given
+ * build id.
+ */
+void
+PublishSharedShardList(Oid relationId, uint64 buildId, List *shardTupleList,
+					   List **shardPlacementListArray)
+{
+	SharedShardListKey key;
+	bool foundInCache = false;
+	ListCell *shardTupleCell = NULL;
+	int shardIndex = 0;
+
+	if (buildId == 0 || !SharedMetadataCacheEnabled())
+	{
+		return;
+	}
+
+	Size entrySize = SharedShardListSize(shardTupleList, shardPlacementListArray);
+	if (entrySize > SharedMetadataCacheState->dataSize)
+	{
+		/* the table does not fit into the cache at all */
+		return;
+	}
+
+	InitSharedShardListKey(&key, relationId);
+
+	LWLockAcquire(&SharedMetadataCacheState->lock, LW_EXCLUSIVE);
+
+	SharedShardListEntry *entry = hash_search(SharedShardListHash, &key, HASH_FIND,
+											  &foundInCache);
+	if (!foundInCache || entry->buildId != buildId)
+	{
+		/* the table was invalidated or someone else is building it */
+		LWLockRelease(&SharedMetadataCacheState->lock);
+
+		return;
+	}
+
+	if (SharedMetadataCacheState->usedSize + entrySize >
+		SharedMetadataCacheState->dataSize)
+	{
+		/* the data area is full, start over and let the next backend publish */
+		ResetSharedShardLists();
+
+		LWLockRelease(&SharedMetadataCacheState->lock);
+
+		return;
+	}
+
+	Size dataOffset = SharedMetadataCacheState->usedSize;
+	char *entryData = SharedMetadataCacheState->data + dataOffset;
+	SharedShardData *shardDataArray = (SharedShardData *) entryData;
+	int shardCount = list_length(shardTupleList);
+
+	Size nextOffset = MAXALIGN(shardCount * sizeof(SharedShardData));
+
+	foreach(shardTupleCell, shardTupleList)
+	{
+		HeapTuple shardTuple = (HeapTuple) lfirst(shardTupleCell);
+		List *placementList = shardPlacementListArray[shardIndex];
+		SharedShardData *shardData = &shardDataArray[shardIndex];
+		ListCell *placementCell = NULL;
+		int placementIndex = 0;
+
+		shardData->tupleOffset = nextOffset;
+		shardData->tupleLength = shardTuple->t_len;
+		memcpy(entryData + nextOffset, shardTuple->t_data, shardTuple->t_len);
+		nextOffset += MAXALIGN(shardTuple->t_len);
+
+		shardData->placementOffset = nextOffset;
+		shardData->placementCount = list_length(placementList);
+
+		GroupShardPlacement *placementArray =
+			(GroupShardPlacement *) (entryData + nextOffset);
+
+		foreach(placementCell, placementList)
+		{
+			GroupShardPlacement *placement =
+				(GroupShardPlacement *) lfirst(placementCell);
+
+			placementArray[placementIndex] = *placement;
+			placementIndex++;
+		}
+
+		nextOffset += MAXALIGN(placementIndex * sizeof(GroupShardPlacement));
+
+		shardIndex++;
+	}
+
+	Assert(nextOffset == entrySize);
+
+	SharedMetadataCacheState->usedSize += entrySize;
+
+	entry->dataOffset = dataOffset;
+	entry->shardCount = shardCount;
+	entry->isValid = true;
+
+	LWLockRelease(&SharedMetadataCacheState->lock);
+}
+
+
+/*
+ * InvalidateSharedShardList removes the shared entry of the given table, or
+ * the entries of all tables in the current database if relationId is
+ * InvalidOid. It is called from the relcache invalidation callback, so it
+ * has to be cheap for tables that are not in the cache.
+ */
+void
+InvalidateSharedShardList(Oid relationId)
+{
+	SharedShardListKey key;
+	bool foundInCache = false;
+
+	if (SharedMetadataCacheSize == 0 || SharedShardListHash == NULL)
+	{
+		return;
+	}
+
+	if (relationId == InvalidOid)
+	{
+		HASH_SEQ_STATUS status;
+		SharedShardListEntry *entry = NULL;
+
+		LWLockAcquire(&SharedMetadataCacheState->lock, LW_EXCLUSIVE);
+
+		hash_seq_init(&status, SharedShardListHash);
+
+		while ((entry = (SharedShardListEntry *) hash_seq_search(&status)) != NULL)
+		{
+			if (entry->key.databaseId == MyDatabaseId)
+			{
+				hash_search(SharedShardListHash, &entry->key, HASH_REMOVE, NULL);
+			}
+		}
+
+		LWLockRelease(&SharedMetadataCacheState->lock);
+
+		return;
+	}
+
+	InitSharedShardListKey(&key, relationId);
+
+	/* most invalidations are for tables that are not in the cache */
+	LWLockAcquire(&SharedMetadataCacheState->lock, LW_SHARED);
+	hash_search(SharedShardListHash, &key, HASH_FIND, &foundInCache);
+	LWLockRelease(&SharedMetadataCacheState->lock);
+
+	if (!foundInCache)
+	{
+		return;
+	}
+
+	LWLockAcquire(&SharedMetadataCacheState->lock, LW_EXCLUSIVE);
+	hash_search(SharedShardListHash, &key, HASH_REMOVE, NULL);
+	LWLockRelease(&SharedMetadataCacheState->lock);
+}
+
+
+/*
+ * LogShardPlacementChange records that the current transaction changed the
+ * placements of the given shard. The caller also needs to invalidate the
+ * distributed table, whose invalidation makes other backends read the log.
+ */
+void
+LogShardPlacementChange(uint64 shardId)
+{
+	if (SharedMetadataCacheState == NULL)
+	{
+		return;
+	}
+
+	LWLockAcquire(&SharedMetadataCacheState->placementChangeLock, LW_EXCLUSIVE);
+
+	uint64 changeIndex = SharedMetadataCacheState->placementChangeCount %
+						 SHARD_PLACEMENT_CHANGE_LOG_SIZE;
+	ShardPlacementChange *change =
+		&SharedMetadataCacheState->placementChangeLog[changeIndex];
+
+	change->databaseId = MyDatabaseId;
+	change->transactionId = GetTopTransactionIdIfAny();
+	change->shardId = shardId;
+
+	SharedMetadataCacheState->placementChangeCount++;
+
+	LWLockRelease(&SharedMetadataCacheState->placementChangeLock);
+}
+
+
+/*
+ * ReadShardPlacementChanges returns the IDs of the shards in the current
+ * database whose placements were changed since the last call. Changes by
+ * transactions that are still in progress are returned again on the next
+ * call, since reloading their placements before they commit shows the old
+ * rows.
+ *
+ * If the log does not contain all changes that might not have been seen
+ * yet, allShardsChanged is set and the caller has to assume that all
+ * placements changed. That happens when the log wrapped around or on a hot
+ * standby, since the log is not replicated.
+ */
+uint64 *
+ReadShardPlacementChanges(int *changedShardCount, bool *allShardsChanged)
+{
+	int changedShardIndex = 0;
+
+	*changedShardCount = 0;
+	*allShardsChanged = false;
+
+	if (SharedMetadataCacheState == NULL || RecoveryInProgress())
+	{
+		*allShardsChanged = true;
+
+		return NULL;
+	}
+
+	LWLockAcquire(&SharedMetadataCacheState->placementChangeLock, LW_SHARED);
+
+	uint64 changeCount = SharedMetadataCacheState->placementChangeCount;
+	if (changeCount - NextPlacementChange > SHARD_PLACEMENT_CHANGE_LOG_SIZE)
+	{
+		/* changes by running transactions might have been overwritten */
+		PlacementChangesLost = true;
+		PlacementChangesLostHorizon = ReadNewTransactionId();
+
+		NextPlacementChange = changeCount - SHARD_PLACEMENT_CHANGE_LOG_SIZE;
+	}
+
+	uint64 *changedShardIdArray =
+		palloc0(Max(changeCount - NextPlacementChange, 1) * sizeof(uint64));
+	uint64 firstUnfinishedChange = changeCount;
+
+	for (uint64 changeIndex = NextPlacementChange; changeIndex < changeCount;
+		 changeIndex++)
+	{
+		uint64 logIndex = changeIndex % SHARD_PLACEMENT_CHANGE_LOG_SIZE;
+		ShardPlacementChange *change =
+			&SharedMetadataCacheState->placementChangeLog[logIndex];
+
+		if (change->databaseId != MyDatabaseId)
+		{
+			continue;
+		}
+
+		changedShardIdArray[changedShardIndex++] = change->shardId;
+
+		if (firstUnfinishedChange == changeCount &&
+			TransactionIdIsInProgress(change->transactionId))
+		{
+			firstUnfinishedChange = changeIndex;
+		}
+	}
+
+	NextPlacementChange = firstUnfinishedChange;
+
+	LWLockRelease(&SharedMetadataCacheState->placementChangeLock);
+
+	*changedShardCount = changedShardIndex;
+
+	if (PlacementChangesLost)
+	{
+		*allShardsChanged = true;
+
+		/*
+		 * Once the transactions whose changes might have been lost finished,
+		 * the placements that the caller reloads after this call are current.
+		 */
+		if (!TransactionIdPrecedes(GetOldestActiveTransactionId(),
+								   PlacementChangesLostHorizon))
+		{
+			PlacementChangesLost = false;
+		}
+	}
+
+	return changedShardIdArray;
+}
+
+
+/*
+ * CurrentDDLGeneration returns the current DDL generation. Since DDL commands
+ * of other backends advance the generation again only after they sent their
+ * invalidations, callers that process invalidations after reading the
+ * generation see all changes of DDL commands that ended before that point.
+ */
+uint64
+CurrentDDLGeneration(void)
+{
+	uint64 ddlGeneration = pg_atomic_read_u64(&SharedMetadataCacheState->ddlGeneration);
+
+	/* make sure invalidations are read after the generation */
+	pg_memory_barrier();
+
+	return ddlGeneration;
+}
+
+
+/*
+ * AdvanceDDLGeneration advances the DDL generation because the current
+ * transaction runs a DDL command. The generation is advanced once more when
+ * the transaction ends, such that state that other backends cached before
+ * the changes became visible, or that the current backend cached while they
+ * were not committed yet, is not used afterwards.
+ */
+void
+AdvanceDDLGeneration(void)
+{
+	if (!RegisteredDDLGenerationCallback)
+	{
+		RegisterResourceReleaseCallback(DDLGenerationReleaseCallback, NULL);
+		RegisteredDDLGenerationCallback = true;
+	}
+
+	pg_atomic_fetch_add_u64(&SharedMetadataCacheState->ddlGeneration, 1);
+
+	DDLGenerationAdvancePending = true;
+}
+
+
+/*
+ * DDLGenerationReleaseCallback advances the DDL generation at the end of a
+ * transaction that ran a DDL command, after the invalidations of the
+ * transaction were sent and its locks were released. It also advances the
+ * generation when a subtransaction aborts, since its DDL commands are undone.
+ */
+static void
+DDLGenerationReleaseCallback(ResourceReleasePhase phase, bool isCommit,
+							 bool isTopLevel, void *arg)
+{
+	if (phase != RESOURCE_RELEASE_AFTER_LOCKS || !DDLGenerationAdvancePending)
+	{
+		return;
+	}
+
+	if (!isTopLevel && isCommit)
+	{
+		/* committed subtransactions become visible with their parent */
+		return;
+	}
+
+	pg_atomic_fetch_add_u64(&SharedMetadataCacheState->ddlGeneration, 1);
+
+	if (isTopLevel)
+	{
+		DDLGenerationAdvancePending = false;
+	}
+}
+
+
+/*
+ * SharedMetadataCacheEnabled returns whether the current backend can use
+ * the shared metadata cache.
+ */
+static bool
+SharedMetadataCacheEnabled(void)
+{
+	if (SharedMetadataCacheSize == 0 || SharedShardListHash == NULL)
+	{
+		return false;
+	}
+
+	/*
+	 * A transaction that has a transaction id might have changed the shard
+	 * metadata, in which case the catalogs show uncommitted rows and the
+	 * shared entries do not reflect its own changes.
+	 */
+	if (TransactionIdIsValid(GetTopTransactionIdIfAny()))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * InitSharedShardListKey fills the hash key of the given table in the
+ * current database.
+ */
+static void
+InitSharedShardListKey(SharedShardListKey *key, Oid relationId)
+{
+	/* zero out the padding, since the key is hashed as a whole */
+	memset(key, 0, sizeof(SharedShardListKey));
+
+	key->databaseId = MyDatabaseId;
+	key->relationId = relationId;
+}
+
+
+/*
+ * SharedShardListSize returns the number of bytes in the data area that the
+ * given tuples and placement lists take up.
+ */
+static Size
+SharedShardListSize(List *shardTupleList, List **shardPlacementListArray)
+{
+	ListCell *shardTupleCell = NULL;
+	int shardIndex = 0;
+
+	Size entrySize = MAXALIGN(list_length(shardTupleList) * sizeof(SharedShardData));
+
+	foreach(shardTupleCell, shardTupleList)
+	{
+		HeapTuple shardTuple = (HeapTuple) lfirst(shardTupleCell);
+		int placementCount = list_length(shardPlacementListArray[shardIndex]);
+
+		entrySize += MAXALIGN(shardTuple->t_len);
+		entrySize += MAXALIGN(placementCount * sizeof(GroupShardPlacement));
+
+		shardIndex++;
+	}
+
+	return entrySize;
+}
+
+
+/*
+ * ResetSharedShardLists removes all entries from the shared hash and frees
+ * the data area. The caller needs to hold the lock in exclusive mode.
+ */
+static void
+ResetSharedShardLists(void)
+{
+	HASH_SEQ_STATUS status;
+	SharedShardListEntry *entry = NULL;
+
+	hash_seq_init(&status, SharedShardListHash);
+
+	while ((entry = (SharedShardListEntry *) hash_seq_search(&status)) != NULL)
+	{
+		hash_search(SharedShardListHash, &entry->key, HASH_REMOVE, NULL);
+	}
+
+	SharedMetadataCacheState->usedSize = 0;
+}
+
+
+/*
+ * InitializeSharedMetadataCache requests the necessary shared memory
+ * from Postgres and sets up the shared memory startup hook.
+ */
+void
+InitializeSharedMetadataCache(void)
+{
+	/* allocate shared memory */
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(SharedMetadataCacheShmemSize());
+	}
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = SharedMetadataCacheShmemInit;
+}
+
+
+/*
+ * SharedMetadataCacheShmemSize returns the size that should be allocated
+ * on the shared memory for the shared metadata cache.
+ */
+static size_t
+SharedMetadataCacheShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, offsetof(SharedMetadataCacheData, data));
+
+	if (SharedMetadataCacheSize > 0)
+	{
+		Size dataSize = mul_size(SharedMetadataCacheSize, 1024);
+		Size hashSize = hash_estimate_size(SHARED_METADATA_CACHE_MAX_TABLES,
+										   sizeof(SharedShardListEntry));
+
+		size = add_size(size, dataSize);
+		size = add_size(size, hashSize);
+	}
+
+	return size;
+}
+
+
+/*
+ * SharedMetadataCacheShmemInit initializes the shared memory used for
+ * sharing shard metadata across backends.
+ */
+static void
+SharedMetadataCacheShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL info;
+
+	Size dataSize = (Size) SharedMetadataCacheSize * 1024;
+
+	/* create (database, table) -> [shard rows] */
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(SharedShardListKey);
+	info.entrysize = sizeof(SharedShardListEntry);
+	info.hash = tag_hash;
+	uint32 hashFlags = (HASH_ELEM | HASH_FUNCTION);
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	/* allocate space and initialize the shared state */
+	SharedMetadataCacheState =
+		(SharedMetadataCacheData *) ShmemInitStruct(
+			"Shared Metadata Cache Data",
+			add_size(offsetof(SharedMetadataCacheData, data), dataSize),
+			&alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		SharedMetadataCacheState->trancheId = LWLockNewTrancheId();
+		SharedMetadataCacheState->trancheName = "Shared Metadata Cache Tranche";
+		LWLockRegisterTranche(SharedMetadataCacheState->trancheId,
+							  SharedMetadataCacheState->trancheName);
+
+		LWLockInitialize(&SharedMetadataCacheState->lock,
+						 SharedMetadataCacheState->trancheId);
+		LWLockInitialize(&SharedMetadataCacheState->placementChangeLock,
+						 SharedMetadataCacheState->trancheId);
+
+		SharedMetadataCacheState->placementChangeCount = 0;
+		pg_atomic_init_u64(&SharedMetadataCacheState->ddlGeneration, 0);
+
+		SharedMetadataCacheState->nextBuildId = 0;
+		SharedMetadataCacheState->dataSize = dataSize;
+		SharedMetadataCacheState->usedSize = 0;
+	}
+
+	/* allocate hash table */
+	if (SharedMetadataCacheSize > 0)
+	{
+		SharedShardListHash =
+			ShmemInitHash("Shared Metadata Cache Hash", SHARED_METADATA_CACHE_MAX_TABLES,
+						  SHARED_METADATA_CACHE_MAX_TABLES, &info, hashFlags);
+	}
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
@@ -0,0 +1,333 @@
+/*-------------------------------------------------------------------------
+ *
+ * cte_inline.c
+ *	  For multi-shard queries, Citus can only recursively plan CTEs. Instead,
+ *	  with the functions defined in this file, single-reference, side-effect
+ *	  free CTEs can be inlined into the query tree, which often allows the
+ *	  query to be pushed down to the workers without going through an
+ *	  intermediate result on the coordinator.
+ *
+ *	  The inlining logic follows the one in PostgreSQL 12's planner, which
+ *	  keeps its functions static, hence we have our own copy here.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "distributed/cte_inline.h"
+#include "distributed/version_compat.h"
+#include "nodes/nodeFuncs.h"
+#if PG_VERSION_NUM >= 120000
+#include "optimizer/optimizer.h"
+#else
+#include "optimizer/clauses.h"
+#endif
+#include "rewrite/rewriteManip.h"
+
+
+/* controlled via GUC */
+bool EnableCTEInlining = false;
+
+
+/* context for InlineCTEWalker */
+typedef struct InlineCTEWalkerContext
+{
+	const char *ctename;    /* name and relative level of target CTE */
+	int levelsup;
+	int refcount;           /* number of remaining references */
+	Query *ctequery;        /* query to substitute */
+} InlineCTEWalkerContext;
+
+
+static void InlineCTEsInQueryTree(Query *query);
+static bool RecursivelyInlineCTEWalker(Node *node, void *context);
+static bool QueryTreeContainsInlinableCTEWalker(Node *node, void *context);
+static bool CTEIsInlinable(CommonTableExpr *cte);
+static bool ContainsDMLWalker(Node *node, void *context);
+static void InlineCTE(Query *mainQuery, CommonTableExpr *cte);
+static bool InlineCTEWalker(Node *node, InlineCTEWalkerContext *context);
+
+
+/*
+ * RecursivelyInlineCtesInQueryTree inlines all the inlinable CTEs in the
+ * given query tree, including the CTEs of its subqueries.
+ */
+void
+RecursivelyInlineCtesInQueryTree(Query *query)
+{
+	RecursivelyInlineCTEWalker((Node *) query, NULL);
+}
+
+
+/*
+ * RecursivelyInlineCTEWalker inlines the CTEs of every query it encounters
+ * and then descends into the resulting query tree, so that the CTEs of the
+ * just inlined CTE queries are also inlined.
+ */
+static bool
+RecursivelyInlineCTEWalker(Node *node, void *context)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	if (IsA(node, Query))
+	{
+		Query *query = (Query *) node;
+
+		InlineCTEsInQueryTree(query);
+
+		return query_tree_walker(query, RecursivelyInlineCTEWalker, context, 0);
+	}
+
+	return expression_tree_walker(node, RecursivelyInlineCTEWalker, context);
+}
+
+
+/*
+ * InlineCTEsInQueryTree inlines the inlinable CTEs of the given query, but
+ * not the CTEs of its subqueries, and removes them from its cteList.
+ */
+static void
+InlineCTEsInQueryTree(Query *query)
+{
+	ListCell *cteCell = NULL;
+
+	/* iterate on a copy of the list since we remove the inlined CTEs */
+	List *copyOfCteList = list_copy(query->cteList);
+	foreach(cteCell, copyOfCteList)
+	{
+		CommonTableExpr *cte = (CommonTableExpr *) lfirst(cteCell);
+
+		if (!CTEIsInlinable(cte))
+		{
+			continue;
+		}
+
+		elog(DEBUG1, "CTE %s is going to be inlined via distributed planning",
+			 cte->ctename);
+
+		InlineCTE(query, cte);
+
+		cte->cterefcount = 0;
+		query->cteList = list_delete_ptr(query->cteList, cte);
+	}
+}
+
+
+/*
+ * QueryTreeContainsInlinableCTE returns true if the given query tree has at
+ * least one CTE that can be inlined.
+ */
+bool
+QueryTreeContainsInlinableCTE(Query *queryTree)
+{
+	return QueryTreeContainsInlinableCTEWalker((Node *) queryTree, NULL);
+}
+
+
+/*
+ * QueryTreeContainsInlinableCTEWalker is the walker for
+ * QueryTreeContainsInlinableCTE.
+ */
+static bool
+QueryTreeContainsInlinableCTEWalker(Node *node, void *context)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	if (IsA(node, Query))
+	{
+		Query *query = (Query *) node;
+		ListCell *cteCell = NULL;
+
+		foreach(cteCell, query->cteList)
+		{
+			CommonTableExpr *cte = (CommonTableExpr *) lfirst(cteCell);
+
+			if (CTEIsInlinable(cte))
+			{
+				return true;
+			}
+		}
+
+		return query_tree_walker(query, QueryTreeContainsInlinableCTEWalker, context,
+								 0);
+	}
+
+	return expression_tree_walker(node, QueryTreeContainsInlinableCTEWalker, context);
+}
+
+
+/*
+ * CTEIsInlinable returns true if inlining the given CTE does not change the
+ * semantics of the query. We only inline CTEs that are referenced once, since
+ * otherwise the same subquery would be evaluated multiple times. Similar to
+ * PostgreSQL, recursive CTEs, CTEs with side effects and, on PostgreSQL 12,
+ * CTEs marked as MATERIALIZED are never inlined.
+ */
+static bool
+CTEIsInlinable(CommonTableExpr *cte)
+{
+	Query *cteQuery = (Query *) cte->ctequery;
+
+#if PG_VERSION_NUM >= 120000
+	if (cte->ctematerialized == CTEMaterializeAlways)
+	{
+		return false;
+	}
+#endif
+
+	if (cte->cterefcount != 1 || cte->cterecursive)
+	{
+		return false;
+	}
+
+	if (cteQuery->commandType != CMD_SELECT || ContainsDMLWalker((Node *) cteQuery, NULL))
+	{
+		return false;
+	}
+
+	if (contain_volatile_functions((Node *) cteQuery))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * ContainsDMLWalker returns true if the given query tree contains a
+ * data-modifying command or a row locking clause, which both make it unsafe
+ * to move the query around.
+ */
+static bool
+ContainsDMLWalker(Node *node, void *context)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	if (IsA(node, Query))
+	{
+		Query *query = (Query *) node;
+
+		if (query->commandType != CMD_SELECT || query->rowMarks != NIL)
+		{
+			return true;
+		}
+
+		return query_tree_walker(query, ContainsDMLWalker, context, 0);
+	}
+
+	return expression_tree_walker(node, ContainsDMLWalker, context);
+}
+
+
+/*
+ * InlineCTE converts all the RTE_CTE references to the given CTE in the main
+ * query into RTE_SUBQUERY entries on the CTE query.
+ */
+static void
+InlineCTE(Query *mainQuery, CommonTableExpr *cte)
+{
+	InlineCTEWalkerContext context;
+
+	context.ctename = cte->ctename;
+
+	/* start at -1 since the walker increments it on the main query */
+	context.levelsup = -1;
+	context.refcount = cte->cterefcount;
+	context.ctequery = castNode(Query, cte->ctequery);
+
+	(void) InlineCTEWalker((Node *) mainQuery, &context);
+
+	/* we should have replaced all the references */
+	Assert(context.refcount == 0);
+}
+
+
+/*
+ * InlineCTEWalker is the walker for InlineCTE.
+ */
+static bool
+InlineCTEWalker(Node *node, InlineCTEWalkerContext *context)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	if (IsA(node, Query))
+	{
+		Query *query = (Query *) node;
+#if PG_VERSION_NUM >= 120000
+		int flags = QTW_EXAMINE_RTES_AFTER;
+#else
+		int flags = QTW_EXAMINE_RTES_BEFORE;
+#endif
+
+		context->levelsup++;
+
+		/*
+		 * Visit the query's RTE nodes after their contents, so that we do not
+		 * descend into the newly inlined CTE query, where possible.
+		 */
+		(void) query_tree_walker(query, InlineCTEWalker, context, flags);
+
+		context->levelsup--;
+
+		return false;
+	}
+	else if (IsA(node, RangeTblEntry))
+	{
+		RangeTblEntry *rte = (RangeTblEntry *) node;
+
+		if (rte->rtekind == RTE_CTE &&
+			strcmp(rte->ctename, context->ctename) == 0 &&
+			rte->ctelevelsup == context->levelsup)
+		{
+			/*
+			 * Found a reference to replace. Generate a copy of the CTE query
+			 * with appropriate level adjustment for outer references, unless
+			 * this is the last reference.
+			 */
+			Query *newQuery = context->ctequery;
+
+			if (--context->refcount > 0)
+			{
+				newQuery = copyObject(newQuery);
+			}
+
+			if (context->levelsup > 0)
+			{
+				IncrementVarSublevelsUp((Node *) newQuery, context->levelsup, 1);
+			}
+
+			/* convert the RTE_CTE RTE into a RTE_SUBQUERY */
+			rte->rtekind = RTE_SUBQUERY;
+			rte->subquery = newQuery;
+			rte->security_barrier = false;
+
+			/* zero out CTE-specific fields */
+			rte->ctename = NULL;
+			rte->ctelevelsup = 0;
+			rte->self_reference = false;
+			rte->coltypes = NIL;
+			rte->coltypmods = NIL;
+			rte->colcollations = NIL;
+		}
+
+		return false;
+	}
+
+	return expression_tree_walker(node, InlineCTEWalker, context);
+}
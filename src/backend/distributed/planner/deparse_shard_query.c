@@ -20,6 +20,7 @@
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/multi_router_planner.h"
+#include "distributed/planning_phases.h"
 #include "distributed/version_compat.h"
 #include "lib/stringinfo.h"
 #include "nodes/makefuncs.h"
@@ -29,12 +30,31 @@
 #include "nodes/pg_list.h"
 #include "parser/parsetree.h"
 #include "storage/lock.h"
+#include "utils/builtins.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
 
 
+/*
+ * Shard query templates contain SHARD_NAME_PLACEHOLDER_PREFIX followed by the
+ * relation id in place of the shard name of each relation.
+ */
+#define SHARD_NAME_PLACEHOLDER_PREFIX "citus_shard_name_placeholder_"
+
+
+/* context for ReplaceRelationsWithPlaceholders */
+typedef struct ShardNamePlaceholderContext
+{
+	List *relationIdList;
+	int placeholderCount;
+} ShardNamePlaceholderContext;
+
+
 static void UpdateTaskQueryString(Query *query, Oid distributedTableId,
 								  RangeTblEntry *valuesRTE, Task *task);
+static bool ReplaceRelationsWithPlaceholders(Node *node,
+											 ShardNamePlaceholderContext *context);
+static int CountShardNamePlaceholders(char *queryTemplate);
 static void ConvertRteToSubqueryWithEmptyResult(RangeTblEntry *rte);
 
 
@@ -72,7 +92,19 @@ RebuildQueryStrings(Query *originalQuery, List *taskList)
 
 			/* there are no restrictions to add for reference tables */
 			char partitionMethod = PartitionMethod(shardInterval->relationId);
-			if (partitionMethod != DISTRIBUTE_BY_NONE)
+			Var *referenceTableColumn = NULL;
+			if (partitionMethod == DISTRIBUTE_BY_HASH)
+			{
+				referenceTableColumn = ReferenceTableSelectPartitionColumn(query);
+			}
+
+			if (referenceTableColumn != NULL)
+			{
+				/* SELECT only reads from reference tables, filter on the hash range */
+				AddHashRangeRestrictionToSelect(copiedSubquery, referenceTableColumn,
+												shardInterval);
+			}
+			else if (partitionMethod != DISTRIBUTE_BY_NONE)
 			{
 				AddShardIntervalRestrictionToSelect(copiedSubquery, shardInterval);
 			}
@@ -129,6 +161,9 @@ UpdateTaskQueryString(Query *query, Oid distributedTableId, RangeTblEntry *value
 {
 	StringInfo queryString = makeStringInfo();
 	List *oldValuesLists = NIL;
+	instr_time phaseStartTime;
+
+	BeginPlanningPhase(&phaseStartTime);
 
 	if (valuesRTE != NULL)
 	{
@@ -143,11 +178,17 @@ UpdateTaskQueryString(Query *query, Oid distributedTableId, RangeTblEntry *value
 	 * For INSERT queries, we only have one relation to update, so we can
 	 * use deparse_shard_query(). For UPDATE and DELETE queries, we may have
 	 * subqueries and joins, so we use relation shard list to update shard
-	 * names and call pg_get_query_def() directly.
+	 * names and call pg_get_query_def() directly. Simple single-row INSERTs
+	 * are written without going through ruleutils, if enabled.
 	 */
 	if (query->commandType == CMD_INSERT)
 	{
-		deparse_shard_query(query, distributedTableId, task->anchorShardId, queryString);
+		if (!FastDeparseShardQuery(query, distributedTableId, task->anchorShardId,
+								   queryString))
+		{
+			deparse_shard_query(query, distributedTableId, task->anchorShardId,
+								queryString);
+		}
 	}
 	else
 	{
@@ -163,6 +204,8 @@ UpdateTaskQueryString(Query *query, Oid distributedTableId, RangeTblEntry *value
 	}
 
 	task->queryString = queryString->data;
+
+	EndPlanningPhase(PLANNING_PHASE_DEPARSE, &phaseStartTime);
 }
 
 
@@ -250,6 +293,214 @@ UpdateRelationToShardNames(Node *node, List *relationShardList)
 }
 
 
+/*
+ * DeparseShardQueryTemplate deparses the given query once with placeholders in
+ * place of the shard names of the given relations, such that the query strings
+ * of tasks that only differ in their shards can be built with
+ * InstantiateShardQueryTemplate() instead of deparsing the query per task.
+ * Relations that are not in the list are replaced by empty subqueries, as in
+ * UpdateRelationToShardNames().
+ *
+ * The function returns NULL if the placeholders cannot be told apart from the
+ * rest of the query string, for instance because a literal contains one.
+ */
+char *
+DeparseShardQueryTemplate(Query *query, List *relationIdList)
+{
+	StringInfo queryString = makeStringInfo();
+	ShardNamePlaceholderContext context;
+	instr_time phaseStartTime;
+
+	Query *templateQuery = copyObject(query);
+
+	context.relationIdList = relationIdList;
+	context.placeholderCount = 0;
+
+	ReplaceRelationsWithPlaceholders((Node *) templateQuery, &context);
+
+	/* see QueryPushdownTaskCreate() */
+	if (templateQuery->jointree->quals != NULL &&
+		IsA(templateQuery->jointree->quals, List))
+	{
+		templateQuery->jointree->quals = (Node *) make_ands_explicit(
+			(List *) templateQuery->jointree->quals);
+	}
+
+	BeginPlanningPhase(&phaseStartTime);
+	pg_get_query_def(templateQuery, queryString);
+	EndPlanningPhase(PLANNING_PHASE_DEPARSE, &phaseStartTime);
+
+	if (CountShardNamePlaceholders(queryString->data) != context.placeholderCount)
+	{
+		return NULL;
+	}
+
+	return queryString->data;
+}
+
+
+/*
+ * ReplaceRelationsWithPlaceholders walks over the query tree and gives the
+ * relations in the context a placeholder as their shard name. It is the
+ * counterpart of UpdateRelationToShardNames() for shard query templates.
+ */
+static bool
+ReplaceRelationsWithPlaceholders(Node *node, ShardNamePlaceholderContext *context)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	/* want to look at all RTEs, even in subqueries, CTEs and such */
+	if (IsA(node, Query))
+	{
+		return query_tree_walker((Query *) node, ReplaceRelationsWithPlaceholders,
+								 context, QTW_EXAMINE_RTES_BEFORE);
+	}
+
+	if (!IsA(node, RangeTblEntry))
+	{
+		return expression_tree_walker(node, ReplaceRelationsWithPlaceholders,
+									  context);
+	}
+
+	RangeTblEntry *newRte = (RangeTblEntry *) node;
+
+	if (newRte->rtekind != RTE_RELATION)
+	{
+		return false;
+	}
+
+	Oid relationId = newRte->relid;
+	if (!list_member_oid(context->relationIdList, relationId))
+	{
+		ConvertRteToSubqueryWithEmptyResult(newRte);
+		return false;
+	}
+
+	StringInfo placeholderName = makeStringInfo();
+	appendStringInfo(placeholderName, SHARD_NAME_PLACEHOLDER_PREFIX "%u", relationId);
+
+	Oid schemaId = get_rel_namespace(relationId);
+	char *schemaName = get_namespace_name(schemaId);
+
+	ModifyRangeTblExtraData(newRte, CITUS_RTE_SHARD, schemaName, placeholderName->data,
+							NIL);
+
+	context->placeholderCount++;
+
+	return false;
+}
+
+
+/*
+ * CountShardNamePlaceholders returns the number of shard name placeholders in
+ * the given query template.
+ */
+static int
+CountShardNamePlaceholders(char *queryTemplate)
+{
+	int placeholderCount = 0;
+	char *placeholder = strstr(queryTemplate, SHARD_NAME_PLACEHOLDER_PREFIX);
+
+	while (placeholder != NULL)
+	{
+		placeholderCount++;
+
+		placeholder = strstr(placeholder + strlen(SHARD_NAME_PLACEHOLDER_PREFIX),
+							 SHARD_NAME_PLACEHOLDER_PREFIX);
+	}
+
+	return placeholderCount;
+}
+
+
+/*
+ * InstantiateShardQueryTemplate builds the query string of a task from a
+ * template created by DeparseShardQueryTemplate(), by substituting the shard
+ * names of the relations in the relation shard list for the placeholders.
+ */
+char *
+InstantiateShardQueryTemplate(char *queryTemplate, List *relationShardList)
+{
+	StringInfo queryString = makeStringInfo();
+	char *templatePosition = queryTemplate;
+	int placeholderPrefixLength = strlen(SHARD_NAME_PLACEHOLDER_PREFIX);
+
+	char *placeholder = strstr(templatePosition, SHARD_NAME_PLACEHOLDER_PREFIX);
+	while (placeholder != NULL)
+	{
+		char *relationIdEnd = NULL;
+		RelationShard *relationShard = NULL;
+		ListCell *relationShardCell = NULL;
+
+		appendBinaryStringInfo(queryString, templatePosition,
+							   placeholder - templatePosition);
+
+		Oid relationId = (Oid) strtoul(placeholder + placeholderPrefixLength,
+									   &relationIdEnd, 10);
+
+		foreach(relationShardCell, relationShardList)
+		{
+			relationShard = (RelationShard *) lfirst(relationShardCell);
+
+			if (relationShard->relationId == relationId)
+			{
+				break;
+			}
+
+			relationShard = NULL;
+		}
+
+		if (relationShard == NULL)
+		{
+			ereport(ERROR, (errmsg("could not find the shard of relation %u in the "
+								   "task", relationId)));
+		}
+
+		char *shardName = get_rel_name(relationId);
+		AppendShardIdToName(&shardName, relationShard->shardId);
+
+		appendStringInfoString(queryString, quote_identifier(shardName));
+
+		templatePosition = relationIdEnd;
+		placeholder = strstr(templatePosition, SHARD_NAME_PLACEHOLDER_PREFIX);
+	}
+
+	appendStringInfoString(queryString, templatePosition);
+
+	return queryString->data;
+}
+
+
+/*
+ * TaskQueryString returns the query string of the given task. Tasks that were
+ * created from a query template only get their query string when it is first
+ * needed, which avoids building the query strings of tasks that never run. The
+ * result is kept in the memory context of the task, such that tasks of cached
+ * plans keep a valid query string across executions.
+ */
+char *
+TaskQueryString(Task *task)
+{
+	if (task->queryString != NULL || task->queryTemplate == NULL)
+	{
+		return task->queryString;
+	}
+
+	char *queryString = InstantiateShardQueryTemplate(task->queryTemplate,
+													  task->relationShardList);
+
+	ereport(DEBUG4, (errmsg("distributed statement: %s",
+							ApplyLogRedaction(queryString))));
+
+	task->queryString = MemoryContextStrdup(GetMemoryChunkContext(task), queryString);
+
+	return task->queryString;
+}
+
+
 /*
  * ConvertRteToSubqueryWithEmptyResult converts given relation RTE into
  * subquery RTE that returns no results.
@@ -14,14 +14,20 @@
 #include <limits.h>
 
 #include "access/htup_details.h"
+#include "catalog/pg_am.h"
 #include "catalog/pg_class.h"
+#include "catalog/pg_namespace.h"
 #include "catalog/pg_proc.h"
 #include "catalog/pg_type.h"
+#include "commands/defrem.h"
 #include "distributed/citus_nodefuncs.h"
 #include "distributed/citus_nodes.h"
+#include "distributed/connection_management.h"
+#include "distributed/cte_inline.h"
 #include "distributed/function_call_delegation.h"
 #include "distributed/insert_select_planner.h"
 #include "distributed/intermediate_result_pruning.h"
+#include "distributed/intermediate_result_scan.h"
 #include "distributed/intermediate_results.h"
 #include "distributed/master_protocol.h"
 #include "distributed/metadata_cache.h"
@@ -34,6 +40,8 @@
 #include "distributed/multi_physical_planner.h"
 #include "distributed/multi_master_planner.h"
 #include "distributed/multi_router_planner.h"
+#include "distributed/multi_server_executor.h"
+#include "distributed/planning_phases.h"
 #include "distributed/query_utils.h"
 #include "distributed/recursive_planning.h"
 #include "distributed/shardinterval_utils.h"
@@ -50,6 +58,7 @@
 #else
 #include "optimizer/cost.h"
 #endif
+#include "optimizer/clauses.h"
 #include "optimizer/pathnode.h"
 #include "optimizer/planner.h"
 #include "utils/builtins.h"
@@ -63,8 +72,19 @@ static List *plannerRestrictionContextList = NIL;
 int MultiTaskQueryLogLevel = MULTI_TASK_QUERY_INFO_OFF; /* multi-task query log level */
 static uint64 NextPlanId = 1;
 
+/* config variables managed via guc.c */
+bool EnableCoordinatorPartitionPruning = false;
+bool EnableRepartitionedCountDistinct = false;
+
 
 static bool ListContainsDistributedTableRTE(List *rangeTableList);
+static void PrunePartitionsForDistributedPlan(DistributedPlan *distributedPlan,
+											  PlannerRestrictionContext *
+											  plannerRestrictionContext);
+static void PlanRepartitionedCountDistinct(DistributedPlan *distributedPlan,
+										   Query *originalQuery);
+static bool IsCountDistinctAggregate(Node *node);
+static bool IsExternParamNode(Node *node);
 static bool IsUpdateOrDelete(Query *query);
 static PlannedStmt * CreateDistributedPlannedStmt(uint64 planId, PlannedStmt *localPlan,
 												  Query *originalQuery, Query *query,
@@ -87,6 +107,19 @@ static void AdjustPartitioningForDistributedPlanning(List *rangeTableList,
 													 bool setPartitionedTablesInherited);
 static PlannedStmt * FinalizePlan(PlannedStmt *localPlan,
 								  DistributedPlan *distributedPlan);
+static PlannedStmt * InlineCtesAndCreateDistributedPlannedStmt(uint64 planId,
+																PlannedStmt *localPlan,
+																Query *originalQuery,
+																Query *query,
+																ParamListInfo params,
+																PlannerRestrictionContext
+																*restrictionContext);
+static PlannedStmt * TryCreateDistributedPlannedStmt(uint64 planId,
+													 PlannedStmt *localPlan,
+													 Query *originalQuery, Query *query,
+													 ParamListInfo boundParams,
+													 PlannerRestrictionContext *
+													 plannerRestrictionContext);
 static PlannedStmt * FinalizeNonRouterPlan(PlannedStmt *localPlan,
 										   DistributedPlan *distributedPlan,
 										   CustomScan *customScan);
@@ -118,6 +151,8 @@ distributed_planner(Query *parse, int cursorOptions, ParamListInfo boundParams)
 	bool setPartitionedTablesInherited = false;
 	List *rangeTableList = ExtractRangeTableEntryList(parse);
 	int rteIdCounter = 1;
+	uint64 planId = 0;
+	instr_time phaseStartTime;
 
 	if (cursorOptions & CURSOR_OPT_FORCE_DISTRIBUTED)
 	{
@@ -142,6 +177,9 @@ distributed_planner(Query *parse, int cursorOptions, ParamListInfo boundParams)
 		{
 			needsDistributedPlanning = ListContainsDistributedTableRTE(rangeTableList);
 		}
+
+		/* the first query of a session establishes cached worker connections */
+		PrewarmWorkerConnections();
 	}
 
 	if (needsDistributedPlanning)
@@ -186,6 +224,8 @@ distributed_planner(Query *parse, int cursorOptions, ParamListInfo boundParams)
 	PlannerRestrictionContext *plannerRestrictionContext =
 		CreateAndPushPlannerRestrictionContext();
 
+	BeginPlanningPhaseStats();
+
 	PG_TRY();
 	{
 		/*
@@ -199,11 +239,15 @@ distributed_planner(Query *parse, int cursorOptions, ParamListInfo boundParams)
 
 		if (needsDistributedPlanning && FastPathRouterQuery(originalQuery))
 		{
+			BeginPlanningPhase(&phaseStartTime);
 			result = FastPathPlanner(originalQuery, parse, boundParams);
+			EndPlanningPhase(PLANNING_PHASE_FAST_PATH_PLANNER, &phaseStartTime);
 		}
 		else
 		{
+			BeginPlanningPhase(&phaseStartTime);
 			result = standard_planner(parse, cursorOptions, boundParams);
+			EndPlanningPhase(PLANNING_PHASE_STANDARD_PLANNER, &phaseStartTime);
 
 			if (needsDistributedPlanning)
 			{
@@ -215,10 +259,30 @@ distributed_planner(Query *parse, int cursorOptions, ParamListInfo boundParams)
 
 		if (needsDistributedPlanning)
 		{
-			uint64 planId = NextPlanId++;
+			PlannedStmt *inlinedPlan = NULL;
 
-			result = CreateDistributedPlannedStmt(planId, result, originalQuery, parse,
-												  boundParams, plannerRestrictionContext);
+			planId = NextPlanId++;
+
+			if (EnableCTEInlining && QueryTreeContainsInlinableCTE(originalQuery))
+			{
+				inlinedPlan =
+					InlineCtesAndCreateDistributedPlannedStmt(planId, result,
+															  originalQuery, parse,
+															  boundParams,
+															  plannerRestrictionContext);
+			}
+
+			if (inlinedPlan != NULL)
+			{
+				result = inlinedPlan;
+			}
+			else
+			{
+				/* CTE inlining is disabled or failed, recursively plan the CTEs */
+				result = CreateDistributedPlannedStmt(planId, result, originalQuery,
+													  parse, boundParams,
+													  plannerRestrictionContext);
+			}
 
 			setPartitionedTablesInherited = true;
 			AdjustPartitioningForDistributedPlanning(rangeTableList,
@@ -246,6 +310,7 @@ distributed_planner(Query *parse, int cursorOptions, ParamListInfo boundParams)
 	PG_CATCH();
 	{
 		PopPlannerRestrictionContext();
+		AbortPlanningPhaseStats();
 		PG_RE_THROW();
 	}
 	PG_END_TRY();
@@ -253,6 +318,8 @@ distributed_planner(Query *parse, int cursorOptions, ParamListInfo boundParams)
 	/* remove the context from the context list */
 	PopPlannerRestrictionContext();
 
+	EndPlanningPhaseStats(planId);
+
 	/*
 	 * In some cases, for example; parameterized SQL functions, we may miss that
 	 * there is a need for distributed planning. Such cases only become clear after
@@ -435,6 +502,57 @@ AdjustPartitioningForDistributedPlanning(List *rangeTableList,
 }
 
 
+/*
+ * PrunePartitionsForDistributedPlan finds the partitions of the distributed
+ * partitioned tables that the plan reads which may contain rows that satisfy
+ * the filters on the tables, such that the executor only needs to lock those
+ * partitions, as PostgreSQL does after pruning partitions. The tasks still
+ * target the shards of the parent, on which the workers prune the partition
+ * shards themselves. The target of a modification is not pruned, since
+ * updates may move rows into other partitions.
+ */
+static void
+PrunePartitionsForDistributedPlan(DistributedPlan *distributedPlan,
+								  PlannerRestrictionContext *plannerRestrictionContext)
+{
+	RelationRestrictionContext *relationRestrictionContext =
+		plannerRestrictionContext->relationRestrictionContext;
+	ListCell *relationRestrictionCell = NULL;
+
+	if (distributedPlan->planningError != NULL)
+	{
+		return;
+	}
+
+	foreach(relationRestrictionCell,
+			relationRestrictionContext->relationRestrictionList)
+	{
+		RelationRestriction *relationRestriction =
+			(RelationRestriction *) lfirst(relationRestrictionCell);
+		Oid relationId = relationRestriction->relationId;
+
+		if (!relationRestriction->distributedRelation ||
+			relationId == distributedPlan->targetRelationId ||
+			!PartitionedTable(relationId))
+		{
+			continue;
+		}
+
+		/* relations that appear several times need the partitions of each */
+		List *partitionIdList =
+			PartitionListMatchingRestrictions(relationId, relationRestriction->index,
+											  relationRestriction->relOptInfo->
+											  baserestrictinfo);
+
+		distributedPlan->partitionIdList =
+			list_concat_unique_oid(distributedPlan->partitionIdList, partitionIdList);
+		distributedPlan->prunedPartitionedRelationIdList =
+			list_append_unique_oid(distributedPlan->prunedPartitionedRelationIdList,
+								   relationId);
+	}
+}
+
+
 /*
  * AssignRTEIdentity assigns the given rteIdentifier to the given range table
  * entry.
@@ -526,6 +644,100 @@ IsModifyDistributedPlan(DistributedPlan *distributedPlan)
 }
 
 
+/*
+ * InlineCtesAndCreateDistributedPlannedStmt inlines the inlinable CTEs of the
+ * query and tries to create a distributed plan for the resulting query tree.
+ * Multi-shard queries can otherwise only recursively plan CTEs, in which case
+ * the CTE results are materialized on the coordinator and broadcast to the
+ * workers, even when the CTE could have been pushed down along with the rest
+ * of the query.
+ *
+ * The function returns NULL if the inlined query cannot be planned, in which
+ * case the caller should fall back to planning the original query, where the
+ * CTEs are recursively planned.
+ */
+static PlannedStmt *
+InlineCtesAndCreateDistributedPlannedStmt(uint64 planId, PlannedStmt *localPlan,
+										  Query *originalQuery, Query *query,
+										  ParamListInfo boundParams,
+										  PlannerRestrictionContext *
+										  plannerRestrictionContext)
+{
+	/*
+	 * The original query is needed as is in case we fall back to recursive
+	 * planning, hence we inline the CTEs on a copy.
+	 */
+	Query *copyOfOriginalQuery = copyObject(originalQuery);
+	RecursivelyInlineCtesInQueryTree(copyOfOriginalQuery);
+
+	/* after inlining, we shouldn't have any inlinable CTEs left */
+	Assert(!QueryTreeContainsInlinableCTE(copyOfOriginalQuery));
+
+#if PG_VERSION_NUM < 120000
+
+	/*
+	 * On PostgreSQL 12, standard_planner() inlines the same CTEs on the query,
+	 * but on earlier versions the CTEs are kept as is. Since an inlined CTE
+	 * turns into a subquery, the query goes through the query pushdown
+	 * planning, for which the relevant query tree is the original query. So,
+	 * pass the inlined query instead of keeping the planner's CTE scans.
+	 */
+	query = copyObject(copyOfOriginalQuery);
+#endif
+
+	return TryCreateDistributedPlannedStmt(planId, localPlan, copyOfOriginalQuery,
+										   query, boundParams, plannerRestrictionContext);
+}
+
+
+/*
+ * TryCreateDistributedPlannedStmt is a wrapper around CreateDistributedPlannedStmt
+ * that returns NULL instead of throwing an error when the query cannot be
+ * planned. The planner restriction context is restored to its state before the
+ * call in that case, since distributed planning might have replaced it while
+ * re-planning the query.
+ */
+static PlannedStmt *
+TryCreateDistributedPlannedStmt(uint64 planId, PlannedStmt *localPlan,
+								Query *originalQuery, Query *query,
+								ParamListInfo boundParams,
+								PlannerRestrictionContext *plannerRestrictionContext)
+{
+	MemoryContext savedContext = CurrentMemoryContext;
+	PlannerRestrictionContext savedRestrictionContext = *plannerRestrictionContext;
+	PlannedStmt *result = NULL;
+
+	PG_TRY();
+	{
+		result = CreateDistributedPlannedStmt(planId, localPlan, originalQuery, query,
+											  boundParams, plannerRestrictionContext);
+	}
+	PG_CATCH();
+	{
+		MemoryContextSwitchTo(savedContext);
+		ErrorData *edata = CopyErrorData();
+
+		/* don't try to intercept PANIC or FATAL, let those breeze past us */
+		if (edata->elevel != ERROR)
+		{
+			PG_RE_THROW();
+		}
+
+		FlushErrorState();
+
+		ereport(DEBUG1, (errmsg("could not plan the query with inlined CTEs, "
+								"falling back to recursive planning"),
+						 errdetail("%s", edata->message)));
+
+		*plannerRestrictionContext = savedRestrictionContext;
+		result = NULL;
+	}
+	PG_END_TRY();
+
+	return result;
+}
+
+
 /*
  * CreateDistributedPlannedStmt encapsulates the logic needed to transform a particular
  * query into a distributed plan that is encapsulated by a PlannedStmt.
@@ -593,6 +805,11 @@ CreateDistributedPlannedStmt(uint64 planId, PlannedStmt *localPlan, Query *origi
 	/* remember the plan's identifier for identifying subplans */
 	distributedPlan->planId = planId;
 
+	if (EnableCoordinatorPartitionPruning)
+	{
+		PrunePartitionsForDistributedPlan(distributedPlan, plannerRestrictionContext);
+	}
+
 	/* create final plan by combining local plan with distributed plan */
 	PlannedStmt *resultPlan = FinalizePlan(localPlan, distributedPlan);
 
@@ -632,12 +849,15 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 {
 	DistributedPlan *distributedPlan = NULL;
 	bool hasCtes = originalQuery->cteList != NIL;
+	instr_time phaseStartTime;
 
 
 	if (IsModifyCommand(originalQuery))
 	{
 		EnsureModificationsCanRun();
 
+		BeginPlanningPhase(&phaseStartTime);
+
 		Oid targetRelationId = ModifyQueryResultRelationId(query);
 		EnsurePartitionTableNotReplicated(targetRelationId);
 
@@ -658,11 +878,28 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 		}
 		else
 		{
-			/* modifications are always routed through the same planner/executor */
-			distributedPlan =
-				CreateModifyPlan(originalQuery, query, plannerRestrictionContext);
+			if (!hasUnresolvedParams && IsLargeMultiRowInsert(originalQuery))
+			{
+				/* copy the rows instead of deparsing them into shard queries */
+				distributedPlan = CreateMultiRowInsertCopyPlan(planId, originalQuery);
+
+				if (distributedPlan->planningError != NULL)
+				{
+					RaiseDeferredError(distributedPlan->planningError, DEBUG1);
+					distributedPlan = NULL;
+				}
+			}
+
+			if (distributedPlan == NULL)
+			{
+				/* modifications are always routed through the same planner/executor */
+				distributedPlan =
+					CreateModifyPlan(originalQuery, query, plannerRestrictionContext);
+			}
 		}
 
+		EndPlanningPhase(PLANNING_PHASE_MODIFY_PLANNER, &phaseStartTime);
+
 		/* the functions above always return a plan, possibly with an error */
 		Assert(distributedPlan);
 
@@ -686,8 +923,11 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 		 * produce distributed query plans.
 		 */
 
+		BeginPlanningPhase(&phaseStartTime);
 		distributedPlan = CreateRouterPlan(originalQuery, query,
 										   plannerRestrictionContext);
+		EndPlanningPhase(PLANNING_PHASE_ROUTER_PLANNER, &phaseStartTime);
+
 		if (distributedPlan->planningError == NULL)
 		{
 			FinalizeDistributedPlan(distributedPlan, originalQuery);
@@ -729,12 +969,33 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 	originalQuery = (Query *) ResolveExternalParams((Node *) originalQuery,
 													boundParams);
 
+	/*
+	 * Grouping by a non-distribution column may be moved into a subquery that
+	 * is repartitioned by the group key, such that the final aggregation also
+	 * happens on the workers. Filters on the results of such a subquery are
+	 * applied as part of its HAVING clause on the workers as well. Similarly,
+	 * aggregates on a UNION ALL subquery may be computed partially in each of
+	 * its branches. The query then needs to be replanned below.
+	 */
+	bool repartitionAggregation = WrapAggregationForRepartitioning(originalQuery);
+	if (PushDownQualsIntoAggregationSubquery(originalQuery))
+	{
+		repartitionAggregation = true;
+	}
+
+	if (PushDownAggregatesIntoUnionAll(originalQuery))
+	{
+		repartitionAggregation = true;
+	}
+
 	/*
 	 * Plan subqueries and CTEs that cannot be pushed down by recursively
 	 * calling the planner and return the resulting plans to subPlanList.
 	 */
+	BeginPlanningPhase(&phaseStartTime);
 	List *subPlanList = GenerateSubplansForSubqueriesAndCTEs(planId, originalQuery,
 															 plannerRestrictionContext);
+	EndPlanningPhase(PLANNING_PHASE_RECURSIVE_PLANNING, &phaseStartTime);
 
 	/*
 	 * If subqueries were recursively planned then we need to replan the query
@@ -749,7 +1010,7 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 	 * the CTEs are referenced then there are no subplans, but we still want
 	 * to retry the router planner.
 	 */
-	if (list_length(subPlanList) > 0 || hasCtes)
+	if (list_length(subPlanList) > 0 || hasCtes || repartitionAggregation)
 	{
 		Query *newQuery = copyObject(originalQuery);
 		bool setPartitionedTablesInherited = false;
@@ -774,7 +1035,9 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 		 * being contiguous.
 		 */
 
+		BeginPlanningPhase(&phaseStartTime);
 		standard_planner(newQuery, 0, boundParams);
+		EndPlanningPhase(PLANNING_PHASE_STANDARD_PLANNER, &phaseStartTime);
 
 		/* overwrite the old transformed query with the new transformed query */
 		memcpy(query, newQuery, sizeof(Query));
@@ -786,6 +1049,11 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 
 		FinalizeDistributedPlan(distributedPlan, originalQuery);
 
+		if (EnableIntermediateResultPartitioning)
+		{
+			AssignSubPlanResultPartitioning(planId, distributedPlan, originalQuery);
+		}
+
 		return distributedPlan;
 	}
 
@@ -809,9 +1077,11 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 	query->cteList = NIL;
 	Assert(originalQuery->cteList == NIL);
 
+	BeginPlanningPhase(&phaseStartTime);
 	MultiTreeRoot *logicalPlan = MultiLogicalPlanCreate(originalQuery, query,
 														plannerRestrictionContext);
 	MultiLogicalPlanOptimize(logicalPlan);
+	EndPlanningPhase(PLANNING_PHASE_LOGICAL_OPTIMIZER, &phaseStartTime);
 
 	/*
 	 * This check is here to make it likely that all node types used in
@@ -823,18 +1093,135 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 	CheckNodeIsDumpable((Node *) logicalPlan);
 
 	/* Create the physical plan */
+	BeginPlanningPhase(&phaseStartTime);
 	distributedPlan = CreatePhysicalDistributedPlan(logicalPlan,
 													plannerRestrictionContext);
+	EndPlanningPhase(PLANNING_PHASE_PHYSICAL_PLANNER, &phaseStartTime);
 
 	/* distributed plan currently should always succeed or error out */
 	Assert(distributedPlan && distributedPlan->planningError == NULL);
 
+	if (EnableRepartitionedCountDistinct)
+	{
+		PlanRepartitionedCountDistinct(distributedPlan, originalQuery);
+	}
+
 	FinalizeDistributedPlan(distributedPlan, originalQuery);
 
 	return distributedPlan;
 }
 
 
+/*
+ * PlanRepartitionedCountDistinct checks whether the given plan only computes
+ * an exact count(DISTINCT) on a column other than the distribution column, for
+ * which the workers return the distinct values of each shard that the master
+ * query then counts. In that case, the plan is changed to repartition those
+ * values among the workers by their hash, such that the workers can count the
+ * values of each hash range and only the counts reach the coordinator.
+ */
+static void
+PlanRepartitionedCountDistinct(DistributedPlan *distributedPlan, Query *originalQuery)
+{
+	Job *workerJob = distributedPlan->workerJob;
+
+	if (distributedPlan->masterQuery == NULL || workerJob == NULL ||
+		workerJob->dependentJobList != NIL || workerJob->taskList == NIL ||
+		TaskExecutorType != MULTI_EXECUTOR_ADAPTIVE ||
+		CountDistinctErrorRate != DISABLE_DISTINCT_APPROXIMATION)
+	{
+		return;
+	}
+
+	/* the query should only return the count */
+	if (originalQuery->groupClause != NIL || originalQuery->havingQual != NULL ||
+		originalQuery->sortClause != NIL || originalQuery->limitCount != NULL ||
+		originalQuery->limitOffset != NULL || originalQuery->distinctClause != NIL ||
+		originalQuery->hasWindowFuncs || originalQuery->groupingSets != NIL ||
+		list_length(originalQuery->targetList) != 1)
+	{
+		return;
+	}
+
+	TargetEntry *targetEntry = (TargetEntry *) linitial(originalQuery->targetList);
+	if (!IsCountDistinctAggregate((Node *) targetEntry->expr))
+	{
+		return;
+	}
+
+	/* the workers should return the distinct values rather than counts */
+	Query *workerQuery = workerJob->jobQuery;
+	if (workerQuery == NULL || workerQuery->groupClause == NIL ||
+		list_length(workerQuery->targetList) != 1)
+	{
+		return;
+	}
+
+	TargetEntry *workerTargetEntry = (TargetEntry *) linitial(workerQuery->targetList);
+	Oid columnType = exprType((Node *) workerTargetEntry->expr);
+
+	if (contain_agg_clause((Node *) workerTargetEntry->expr) ||
+		!OidIsValid(GetDefaultOpClass(columnType, HASH_AM_OID)))
+	{
+		return;
+	}
+
+	/* the task queries are wrapped, so they cannot refer to parameters */
+	if (FindNodeCheck((Node *) workerQuery, IsExternParamNode))
+	{
+		return;
+	}
+
+	/* the values are repartitioned by the hash ranges of the anchor shards */
+	Task *firstTask = (Task *) linitial(workerJob->taskList);
+	ShardInterval *anchorShardInterval = LoadShardInterval(firstTask->anchorShardId);
+	if (PartitionMethod(anchorShardInterval->relationId) != DISTRIBUTE_BY_HASH)
+	{
+		return;
+	}
+
+	distributedPlan->repartitionCountDistinct = true;
+	distributedPlan->masterQuery = NULL;
+}
+
+
+/*
+ * IsCountDistinctAggregate returns whether the given node is a count(DISTINCT)
+ * aggregate on a single expression without a filter.
+ */
+static bool
+IsCountDistinctAggregate(Node *node)
+{
+	if (!IsA(node, Aggref))
+	{
+		return false;
+	}
+
+	Aggref *aggregate = (Aggref *) node;
+	if (aggregate->aggdistinct == NIL || aggregate->aggfilter != NULL ||
+		list_length(aggregate->args) != 1)
+	{
+		return false;
+	}
+
+	char *aggregateName = get_func_name(aggregate->aggfnoid);
+	Oid aggregateNamespace = get_func_namespace(aggregate->aggfnoid);
+
+	return aggregateNamespace == PG_CATALOG_NAMESPACE &&
+		   strncmp(aggregateName, "count", NAMEDATALEN) == 0;
+}
+
+
+/*
+ * IsExternParamNode returns true if the given node is an external parameter.
+ */
+static bool
+IsExternParamNode(Node *node)
+{
+	return IsA(node, Param) && ((Param *) node)->paramkind == PARAM_EXTERN;
+}
+
+
 /*
  * FinalizeDistributedPlan is the final step of distributed planning. The function
  * currently only implements some optimizations for intermediate result(s) pruning.
@@ -1500,6 +1887,7 @@ multi_relation_restriction_hook(PlannerInfo *root, RelOptInfo *relOptInfo,
 	DistTableCacheEntry *cacheEntry = NULL;
 
 	AdjustReadIntermediateResultCost(rte, relOptInfo);
+	AddIntermediateResultScanPath(root, relOptInfo, rte);
 
 	if (rte->rtekind != RTE_RELATION)
 	{
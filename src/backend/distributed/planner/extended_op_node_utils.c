@@ -34,6 +34,9 @@ static bool PartitionColumnInTableList(Var *column, List *tableNodeList);
 static bool ShouldPullDistinctColumn(bool repartitionSubquery,
 									 bool groupedByDisjointPartitionColumn,
 									 bool hasNonPartitionColumnDistinctAgg);
+static bool ShouldPushDownGroupAndHaving(MultiExtendedOp *extendedOpNode,
+										 bool groupedByDisjointPartitionColumn,
+										 bool repartitionSubquery);
 
 
 /*
@@ -70,6 +73,10 @@ BuildExtendedOpNodeProperties(MultiExtendedOp *extendedOpNode)
 	 */
 	bool pushDownWindowFunctions = extendedOpNode->hasWindowFuncs;
 
+	bool pushDownGroupAndHaving =
+		ShouldPushDownGroupAndHaving(extendedOpNode, groupedByDisjointPartitionColumn,
+									 repartitionSubquery);
+
 	extendedOpNodeProperties.groupedByDisjointPartitionColumn =
 		groupedByDisjointPartitionColumn;
 	extendedOpNodeProperties.repartitionSubquery = repartitionSubquery;
@@ -77,6 +84,7 @@ BuildExtendedOpNodeProperties(MultiExtendedOp *extendedOpNode)
 		hasNonPartitionColumnDistinctAgg;
 	extendedOpNodeProperties.pullDistinctColumns = pullDistinctColumns;
 	extendedOpNodeProperties.pushDownWindowFunctions = pushDownWindowFunctions;
+	extendedOpNodeProperties.pushDownGroupAndHaving = pushDownGroupAndHaving;
 
 	return extendedOpNodeProperties;
 }
@@ -281,3 +289,37 @@ ShouldPullDistinctColumn(bool repartitionSubquery,
 
 	return false;
 }
+
+
+/*
+ * ShouldPushDownGroupAndHaving returns true if the workers can compute the
+ * final aggregates and apply the HAVING clause, such that the coordinator does
+ * not need to combine the aggregates. That is the case when the query is grouped
+ * by a partition column whose values are disjoint across shards, since all rows
+ * of a group are then in the result of a single task. We do not do this when the
+ * rows of a table are re-partitioned, since a group might then span tasks.
+ */
+static bool
+ShouldPushDownGroupAndHaving(MultiExtendedOp *extendedOpNode,
+							 bool groupedByDisjointPartitionColumn,
+							 bool repartitionSubquery)
+{
+	if (!EnableGroupPushdown || !groupedByDisjointPartitionColumn || repartitionSubquery)
+	{
+		return false;
+	}
+
+	if (extendedOpNode->hasWindowFuncs)
+	{
+		return false;
+	}
+
+	List *partitionNodeList = FindNodesOfType((MultiNode *) extendedOpNode,
+											  T_MultiPartition);
+	if (partitionNodeList != NIL)
+	{
+		return false;
+	}
+
+	return true;
+}
@@ -34,6 +34,7 @@
  */
 #include "postgres.h"
 
+#include "distributed/citus_clauses.h"
 #include "distributed/distributed_planner.h"
 #include "distributed/multi_physical_planner.h" /* only to use some utility functions */
 #include "distributed/metadata_cache.h"
@@ -56,8 +57,16 @@
 bool EnableFastPathRouterPlanner = true;
 
 static bool ColumnAppearsMultipleTimes(Node *quals, Var *distributionKey);
-static bool ConjunctionContainsColumnFilter(Node *node, Var *column);
-static bool DistKeyInSimpleOpExpression(Expr *clause, Var *distColumn);
+static bool ConjunctionContainsColumnFilter(Node *node, Var *column,
+											bool allowExecutionTimeValue);
+static bool DistKeyInSimpleOpExpression(Expr *clause, Var *distColumn,
+										bool allowExecutionTimeValue);
+static bool IsExecutionTimeValue(Node *node);
+static bool IsExternParamNode(Node *node);
+static void FoldDistributionKeyValue(Query *query);
+static Node ** DistributionKeyValueOperand(Query *query);
+static OpExpr * ConjunctionColumnFilter(Node *node, Var *column);
+static Node ** ColumnFilterValueOperand(OpExpr *opExpr, Var *column);
 
 
 /*
@@ -86,6 +95,12 @@ FastPathPlanner(Query *originalQuery, Query *parse, ParamListInfo boundParams)
 		ResolveExternalParams((Node *) originalQuery->jointree->quals,
 							  copyParamList(boundParams));
 
+	/*
+	 * The distribution key may be compared with an expression on the
+	 * resolved parameters, which we want to prune on like on a constant.
+	 */
+	FoldDistributionKeyValue(originalQuery);
+
 	/*
 	 * Citus planner relies on some of the transformations on constant
 	 * evaluation on the parse tree.
@@ -243,8 +258,15 @@ FastPathRouterQuery(Query *query)
 	 *
 	 *	This is to simplify both of the individual checks and omit various edge cases
 	 *	that might arise with multiple distribution keys in the quals.
+	 *
+	 *	For SELECT queries, VALUE can also be an expression that can only be
+	 *	evaluated at execution time, such as a stable function call. The shard
+	 *	pruning for those queries is deferred to the executor.
 	 */
-	if (ConjunctionContainsColumnFilter(quals, distributionKey) &&
+	bool allowExecutionTimeValue = query->commandType == CMD_SELECT;
+
+	if (ConjunctionContainsColumnFilter(quals, distributionKey,
+										allowExecutionTimeValue) &&
 		!ColumnAppearsMultipleTimes(quals, distributionKey))
 	{
 		return true;
@@ -254,6 +276,101 @@ FastPathRouterQuery(Query *query)
 }
 
 
+/*
+ * FastPathRequiresDeferredPruning returns true if the distribution key of the
+ * given fast path router query is not compared with a constant. This is the
+ * case for the generic plans of prepared statements, where the value of the
+ * parameter is only known at execution time, and for the filters on stable
+ * expressions such as function calls, which are evaluated by the executor.
+ */
+bool
+FastPathRequiresDeferredPruning(Query *query)
+{
+	Assert(FastPathRouterQuery(query));
+
+	Node **valueOperand = DistributionKeyValueOperand(query);
+	if (valueOperand == NULL)
+	{
+		return false;
+	}
+
+	return !IsA(strip_implicit_coercions(*valueOperand), Const);
+}
+
+
+/*
+ * EvaluateFastPathDistributionKeyValue evaluates the expression that the
+ * distribution key of the given fast path router query is compared with, and
+ * replaces it with the resulting constant such that the shard can be pruned.
+ * The other filters are left as they are, since they may be evaluated for
+ * each row on the worker.
+ */
+void
+EvaluateFastPathDistributionKeyValue(Query *query, PlanState *planState)
+{
+	Node **valueOperand = DistributionKeyValueOperand(query);
+	if (valueOperand == NULL)
+	{
+		return;
+	}
+
+	*valueOperand = PartiallyEvaluateExpression(*valueOperand, planState);
+}
+
+
+/*
+ * FoldDistributionKeyValue simplifies the expression that the distribution
+ * key of the given fast path router query is compared with, such that it
+ * becomes a constant unless it contains stable functions or parameters
+ * without a value.
+ */
+static void
+FoldDistributionKeyValue(Query *query)
+{
+	Node **valueOperand = DistributionKeyValueOperand(query);
+	if (valueOperand == NULL)
+	{
+		return;
+	}
+
+	*valueOperand = eval_const_expressions(NULL, *valueOperand);
+}
+
+
+/*
+ * DistributionKeyValueOperand returns a pointer to the operand that the
+ * distribution key of the given fast path router query is compared with in
+ * its quals, such that the caller can replace it. The function returns NULL
+ * for reference tables.
+ */
+static Node **
+DistributionKeyValueOperand(Query *query)
+{
+	Node *quals = query->jointree->quals;
+
+	/* fast path router queries are on a single table */
+	RangeTblEntry *rangeTableEntry = (RangeTblEntry *) linitial(query->rtable);
+	Var *distributionKey = PartitionColumn(rangeTableEntry->relid, 1);
+	if (!distributionKey)
+	{
+		return NULL;
+	}
+
+	if (quals != NULL && IsA(quals, List))
+	{
+		quals = (Node *) make_ands_explicit((List *) quals);
+	}
+
+	OpExpr *columnFilter = ConjunctionColumnFilter(quals, distributionKey);
+	if (columnFilter == NULL)
+	{
+		return NULL;
+	}
+
+	return ColumnFilterValueOperand(columnFilter, distributionKey);
+}
+
+
 /*
  * ColumnAppearsMultipleTimes returns true if the given input
  * appears more than once in the quals.
@@ -290,7 +407,7 @@ ColumnAppearsMultipleTimes(Node *quals, Var *distributionKey)
  * if the match expression has an AND relation with the rest of the expression tree.
  */
 static bool
-ConjunctionContainsColumnFilter(Node *node, Var *column)
+ConjunctionContainsColumnFilter(Node *node, Var *column, bool allowExecutionTimeValue)
 {
 	if (node == NULL)
 	{
@@ -301,7 +418,8 @@ ConjunctionContainsColumnFilter(Node *node, Var *column)
 	{
 		OpExpr *opExpr = (OpExpr *) node;
 		bool distKeyInSimpleOpExpression =
-			DistKeyInSimpleOpExpression((Expr *) opExpr, column);
+			DistKeyInSimpleOpExpression((Expr *) opExpr, column,
+										allowExecutionTimeValue);
 
 		if (!distKeyInSimpleOpExpression)
 		{
@@ -332,7 +450,8 @@ ConjunctionContainsColumnFilter(Node *node, Var *column)
 		{
 			Node *argumentNode = (Node *) lfirst(argumentCell);
 
-			if (ConjunctionContainsColumnFilter(argumentNode, column))
+			if (ConjunctionContainsColumnFilter(argumentNode, column,
+												allowExecutionTimeValue))
 			{
 				return true;
 			}
@@ -343,13 +462,97 @@ ConjunctionContainsColumnFilter(Node *node, Var *column)
 }
 
 
+/*
+ * ConjunctionColumnFilter returns the operator expression in the top level
+ * conjunction of the given expression tree that compares the column with an
+ * expression without columns, or NULL if there is none. The caller is expected
+ * to have checked that the comparison is an equality via
+ * ConjunctionContainsColumnFilter().
+ */
+static OpExpr *
+ConjunctionColumnFilter(Node *node, Var *column)
+{
+	if (node == NULL)
+	{
+		return NULL;
+	}
+
+	if (IsA(node, OpExpr))
+	{
+		OpExpr *opExpr = (OpExpr *) node;
+
+		if (list_length(opExpr->args) != 2)
+		{
+			return NULL;
+		}
+
+		Node *leftOperand = strip_implicit_coercions(get_leftop((Expr *) opExpr));
+		Node *rightOperand = strip_implicit_coercions(get_rightop((Expr *) opExpr));
+
+		if (equal(leftOperand, column) && !contain_var_clause(rightOperand))
+		{
+			return opExpr;
+		}
+		else if (equal(rightOperand, column) && !contain_var_clause(leftOperand))
+		{
+			return opExpr;
+		}
+
+		return NULL;
+	}
+	else if (IsA(node, BoolExpr))
+	{
+		BoolExpr *boolExpr = (BoolExpr *) node;
+		ListCell *argumentCell = NULL;
+
+		if (boolExpr->boolop != AND_EXPR)
+		{
+			return NULL;
+		}
+
+		foreach(argumentCell, boolExpr->args)
+		{
+			Node *argumentNode = (Node *) lfirst(argumentCell);
+			OpExpr *columnFilter = ConjunctionColumnFilter(argumentNode, column);
+
+			if (columnFilter != NULL)
+			{
+				return columnFilter;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * ColumnFilterValueOperand returns a pointer to the operand of the given
+ * column filter that the column is compared with.
+ */
+static Node **
+ColumnFilterValueOperand(OpExpr *opExpr, Var *column)
+{
+	Node *leftOperand = strip_implicit_coercions(linitial(opExpr->args));
+
+	if (IsA(leftOperand, Var) && equal(leftOperand, column))
+	{
+		return (Node **) &lsecond(opExpr->args);
+	}
+
+	return (Node **) &linitial(opExpr->args);
+}
+
+
 /*
  * DistKeyInSimpleOpExpression checks whether given expression is a simple operator
  * expression with either (dist_key = param) or (dist_key = const). Note that the
- * operands could be in the reverse order as well.
+ * operands could be in the reverse order as well. If allowExecutionTimeValue is
+ * true, the dist_key may also be compared with an expression that can only be
+ * evaluated at execution time, see IsExecutionTimeValue().
  */
 static bool
-DistKeyInSimpleOpExpression(Expr *clause, Var *distColumn)
+DistKeyInSimpleOpExpression(Expr *clause, Var *distColumn, bool allowExecutionTimeValue)
 {
 	Node *leftOperand = NULL;
 	Node *rightOperand = NULL;
@@ -392,6 +595,16 @@ DistKeyInSimpleOpExpression(Expr *clause, Var *distColumn)
 		constantClause = (Const *) leftOperand;
 		columnInExpr = (Var *) rightOperand;
 	}
+	else if (allowExecutionTimeValue && IsA(leftOperand, Var) &&
+			 IsExecutionTimeValue(rightOperand))
+	{
+		columnInExpr = (Var *) leftOperand;
+	}
+	else if (allowExecutionTimeValue && IsA(rightOperand, Var) &&
+			 IsExecutionTimeValue(leftOperand))
+	{
+		columnInExpr = (Var *) rightOperand;
+	}
 	else
 	{
 		return false;
@@ -413,3 +626,39 @@ DistKeyInSimpleOpExpression(Expr *clause, Var *distColumn)
 
 	return equal(distColumn, columnInExpr);
 }
+
+
+/*
+ * IsExecutionTimeValue returns true if the given expression does not depend on
+ * the rows of the table and evaluates to the same value for the whole query,
+ * such that it can be evaluated once by the executor before shard pruning.
+ * This holds for expressions without columns and volatile functions that
+ * contain parameters or stable functions. Expressions that only consist of
+ * immutable functions on constants are folded by the regular planner.
+ */
+static bool
+IsExecutionTimeValue(Node *node)
+{
+	if (contain_var_clause(node))
+	{
+		return false;
+	}
+
+	if (FindNodeCheck(node, CitusIsVolatileFunction))
+	{
+		return false;
+	}
+
+	return FindNodeCheck(node, IsExternParamNode) ||
+		   FindNodeCheck(node, CitusIsMutableFunction);
+}
+
+
+/*
+ * IsExternParamNode returns true if the given node is an external parameter.
+ */
+static bool
+IsExternParamNode(Node *node)
+{
+	return IsA(node, Param) && ((Param *) node)->paramkind == PARAM_EXTERN;
+}
@@ -40,11 +40,11 @@
 #include "nodes/primnodes.h"
 #include "optimizer/clauses.h"
 #include "parser/parse_coerce.h"
-#if PG_VERSION_NUM >= 120000
 #include "parser/parsetree.h"
-#endif
 #include "miscadmin.h"
 #include "tcop/dest.h"
+#include "utils/array.h"
+#include "utils/fmgroids.h"
 #include "utils/lsyscache.h"
 #include "utils/syscache.h"
 
@@ -54,7 +54,33 @@ struct ParamWalkerContext
 	ParamKind paramKind;
 };
 
+/*
+ * DelegatedCallBatch describes the rows of a batched function call that are
+ * sent to a single worker.
+ */
+typedef struct DelegatedCallBatch
+{
+	int32 nodeId;
+	List *placementList;
+	uint64 anchorShardId;
+
+	/* positions of the rows of the batch in the unnested arrays */
+	List *rowIndexList;
+} DelegatedCallBatch;
+
 static bool contain_param_walker(Node *node, void *context);
+static FuncExpr * FromClauseFunctionCall(Query *query, Index rtIndex);
+static DistributedPlan * TryToDelegateBatchedFunctionCall(Query *query,
+														  FuncExpr *funcExpr,
+														  DistObjectCacheEntry *procedure,
+														  DistTableCacheEntry *distTable,
+														  Index rtIndex,
+														  bool *hasExternParam);
+static List * UnnestArrayConstList(RangeTblEntry *rangeTableEntry,
+								   bool *hasExternParam);
+static DelegatedCallBatch * DelegatedCallBatchForNode(List **batchList, int32 nodeId);
+static Const * ArraySliceConst(Const *arrayConst, List *rowIndexList);
+static DistributedPlan * CreateFunctionCallDelegationPlan(Query *query, List *taskList);
 
 /*
  * contain_param_walker scans node for Param nodes.
@@ -113,9 +139,8 @@ TryToDelegateFunctionCall(Query *query, bool *hasExternParam)
 	WorkerNode *workerNode = NULL;
 	StringInfo queryString = NULL;
 	Task *task = NULL;
-	Job *job = NULL;
-	DistributedPlan *distributedPlan = NULL;
 	struct ParamWalkerContext walkerParamContext = { 0 };
+	Index fromFunctionRtIndex = 0;
 
 	/* set hasExternParam now in case of early exit */
 	*hasExternParam = false;
@@ -160,6 +185,31 @@ TryToDelegateFunctionCall(Query *query, bool *hasExternParam)
 
 	if (joinTree->fromlist != NIL)
 	{
+		if (list_length(joinTree->fromlist) != 1)
+		{
+			/* e.g. SELECT ... FROM rel1, rel2. */
+			return NULL;
+		}
+
+		RangeTblRef *reference = linitial(joinTree->fromlist);
+		if (!IsA(reference, RangeTblRef))
+		{
+			/*
+			 * e.g. IsA(reference, JoinExpr). This is explicit join expressions
+			 * like INNER JOIN, NATURAL JOIN, ...
+			 */
+			return NULL;
+		}
+
+		RangeTblEntry *rtentry = rt_fetch(reference->rtindex, query->rtable);
+		if (rtentry->rtekind == RTE_FUNCTION)
+		{
+			/*
+			 * Either SELECT * FROM func(...), or a batched call such as
+			 * SELECT func(a, b) FROM unnest($1, $2) AS u(a, b).
+			 */
+			fromFunctionRtIndex = reference->rtindex;
+		}
 #if PG_VERSION_NUM >= 120000
 
 		/*
@@ -168,56 +218,49 @@ TryToDelegateFunctionCall(Query *query, bool *hasExternParam)
 		 * replace_empty_jointree() which replaces empty fromlist with a list of
 		 * single RTE_RESULT RangleTableRef node.
 		 */
-		if (list_length(joinTree->fromlist) == 1)
+		else if (rtentry->rtekind != RTE_RESULT)
 		{
-			RangeTblRef *reference = linitial(joinTree->fromlist);
-
-			if (IsA(reference, RangeTblRef))
-			{
-				RangeTblEntry *rtentry = rt_fetch(reference->rtindex, query->rtable);
-				if (rtentry->rtekind != RTE_RESULT)
-				{
-					/* e.g. SELECT f() FROM rel */
-					return NULL;
-				}
-			}
-			else
-			{
-				/*
-				 * e.g. IsA(reference, JoinExpr). This is explicit join expressions
-				 * like INNER JOIN, NATURAL JOIN, ...
-				 */
-				return NULL;
-			}
+			/* e.g. SELECT f() FROM rel */
+			return NULL;
 		}
+#else
 		else
 		{
-			/* e.g. SELECT ... FROM rel1, rel2. */
-			Assert(list_length(joinTree->fromlist) > 1);
+			/* query has a FROM section */
 			return NULL;
 		}
-#else
-
-		/* query has a FROM section */
-		return NULL;
 #endif
 	}
 
 	targetList = query->targetList;
-	if (list_length(query->targetList) != 1)
+	if (fromFunctionRtIndex != 0)
 	{
-		/* multiple target list items */
-		return NULL;
+		funcExpr = FromClauseFunctionCall(query, fromFunctionRtIndex);
+		if (funcExpr != NULL)
+		{
+			/* SELECT * FROM func(...), which is delegated as a whole */
+			fromFunctionRtIndex = 0;
+		}
 	}
 
-	targetEntry = (TargetEntry *) linitial(targetList);
-	if (!IsA(targetEntry->expr, FuncExpr))
+	if (funcExpr == NULL)
 	{
-		/* target list item is not a function call */
-		return NULL;
+		if (list_length(query->targetList) != 1)
+		{
+			/* multiple target list items */
+			return NULL;
+		}
+
+		targetEntry = (TargetEntry *) linitial(targetList);
+		if (!IsA(targetEntry->expr, FuncExpr))
+		{
+			/* target list item is not a function call */
+			return NULL;
+		}
+
+		funcExpr = (FuncExpr *) targetEntry->expr;
 	}
 
-	funcExpr = (FuncExpr *) targetEntry->expr;
 	procedure = LookupDistObjectCacheEntry(ProcedureRelationId, funcExpr->funcid, 0);
 	if (procedure == NULL || !procedure->isDistributed)
 	{
@@ -268,6 +311,13 @@ TryToDelegateFunctionCall(Query *query, bool *hasExternParam)
 		return NULL;
 	}
 
+	if (fromFunctionRtIndex != 0)
+	{
+		/* the distribution argument values come from the FROM clause */
+		return TryToDelegateBatchedFunctionCall(query, funcExpr, procedure, distTable,
+												fromFunctionRtIndex, hasExternParam);
+	}
+
 	partitionValue = (Const *) list_nth(funcExpr->args, procedure->distributionArgIndex);
 
 	if (IsA(partitionValue, Param))
@@ -376,12 +426,395 @@ TryToDelegateFunctionCall(Query *query, bool *hasExternParam)
 	task->anchorShardId = shardInterval->shardId;
 	task->replicationModel = distTable->replicationModel;
 
-	job = CitusMakeNode(Job);
+	return CreateFunctionCallDelegationPlan(query, list_make1(task));
+}
+
+
+/*
+ * FromClauseFunctionCall returns the function call in the FROM clause of
+ * queries of the form SELECT ... FROM func(...), where the target list only
+ * consists of the output columns of the function. Otherwise, it returns NULL.
+ */
+static FuncExpr *
+FromClauseFunctionCall(Query *query, Index rtIndex)
+{
+	RangeTblEntry *rangeTableEntry = rt_fetch(rtIndex, query->rtable);
+	ListCell *targetEntryCell = NULL;
+
+	if (rangeTableEntry->funcordinality ||
+		list_length(rangeTableEntry->functions) != 1)
+	{
+		/* WITH ORDINALITY or ROWS FROM (...) with multiple functions */
+		return NULL;
+	}
+
+	RangeTblFunction *rangeTableFunction = linitial(rangeTableEntry->functions);
+	if (!IsA(rangeTableFunction->funcexpr, FuncExpr))
+	{
+		return NULL;
+	}
+
+	foreach(targetEntryCell, query->targetList)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+		Var *column = (Var *) targetEntry->expr;
+
+		if (!IsA(column, Var) || column->varno != rtIndex || column->varlevelsup != 0)
+		{
+			/* e.g. SELECT func2(a) FROM func1(...) AS f(a) */
+			return NULL;
+		}
+	}
+
+	return (FuncExpr *) rangeTableFunction->funcexpr;
+}
+
+
+/*
+ * TryToDelegateBatchedFunctionCall delegates calls of the form
+ * SELECT func(a, b) FROM unnest($1, $2) AS u(a, b), where the distribution
+ * argument of func is taken from one of the unnested arrays. The rows are
+ * grouped by the worker that holds the shard for their distribution argument
+ * and each worker gets a single call over the rows in its group. The results
+ * of all workers are returned as the result of the query.
+ */
+static DistributedPlan *
+TryToDelegateBatchedFunctionCall(Query *query, FuncExpr *funcExpr,
+								 DistObjectCacheEntry *procedure,
+								 DistTableCacheEntry *distTable, Index rtIndex,
+								 bool *hasExternParam)
+{
+	RangeTblEntry *rangeTableEntry = rt_fetch(rtIndex, query->rtable);
+	Var *partitionColumn = distTable->partitionColumn;
+	struct ParamWalkerContext walkerParamContext = { 0 };
+	List *batchList = NIL;
+	List *taskList = NIL;
+	ListCell *batchCell = NULL;
+	int16 typeLength = 0;
+	bool typeByValue = false;
+	char typeAlignment = 0;
+	Datum *partitionValueArray = NULL;
+	bool *partitionNullArray = NULL;
+	int partitionValueCount = 0;
+	CopyCoercionData coercionData;
+
+	Var *partitionArgument = (Var *) list_nth(funcExpr->args,
+											  procedure->distributionArgIndex);
+	if (!IsA(partitionArgument, Var) || partitionArgument->varno != rtIndex ||
+		partitionArgument->varlevelsup != 0)
+	{
+		ereport(DEBUG1, (errmsg("distribution argument of a batched function call "
+								"must be a column of unnest()")));
+		return NULL;
+	}
+
+	(void) expression_tree_walker((Node *) funcExpr->args, contain_param_walker,
+								  &walkerParamContext);
+	if (walkerParamContext.hasParam)
+	{
+		if (walkerParamContext.paramKind == PARAM_EXTERN)
+		{
+			/* Don't log a message, we should end up here again without a parameter */
+			*hasExternParam = true;
+		}
+		else
+		{
+			ereport(DEBUG1, (errmsg("arguments in a distributed function must "
+									"not contain subqueries")));
+		}
+		return NULL;
+	}
+
+	List *arrayConstList = UnnestArrayConstList(rangeTableEntry, hasExternParam);
+	if (arrayConstList == NIL)
+	{
+		return NULL;
+	}
+
+	if (ExecutingInsertSelect())
+	{
+		ereport(DEBUG1, (errmsg("not pushing down function calls in INSERT ... SELECT")));
+		return NULL;
+	}
+
+	if (GeneratingSubplans())
+	{
+		ereport(DEBUG1, (errmsg(
+							 "not pushing down function calls in CTEs or Subqueries")));
+		return NULL;
+	}
+
+	/* each unnest() call returns a single column, so attnos map to calls */
+	Const *partitionArrayConst = (Const *) list_nth(arrayConstList,
+													partitionArgument->varattno - 1);
+	Oid partitionValueType = partitionArgument->vartype;
+
+	get_typlenbyvalalign(partitionValueType, &typeLength, &typeByValue,
+						 &typeAlignment);
+	deconstruct_array(DatumGetArrayTypeP(partitionArrayConst->constvalue),
+					  partitionValueType, typeLength, typeByValue, typeAlignment,
+					  &partitionValueArray, &partitionNullArray, &partitionValueCount);
+
+	if (partitionValueType != partitionColumn->vartype)
+	{
+		ConversionPathForTypes(partitionValueType, partitionColumn->vartype,
+							   &coercionData);
+	}
+
+	for (int rowIndex = 0; rowIndex < partitionValueCount; rowIndex++)
+	{
+		Datum partitionValueDatum = partitionValueArray[rowIndex];
+
+		if (partitionNullArray[rowIndex])
+		{
+			ereport(DEBUG1, (errmsg("distribution argument value must not be null")));
+			return NULL;
+		}
+
+		if (partitionValueType != partitionColumn->vartype)
+		{
+			partitionValueDatum = CoerceColumnValue(partitionValueDatum, &coercionData);
+		}
+
+		ShardInterval *shardInterval = FindShardInterval(partitionValueDatum, distTable);
+		if (shardInterval == NULL)
+		{
+			ereport(DEBUG1, (errmsg("cannot push down call, failed to find shard "
+									"interval")));
+			return NULL;
+		}
+
+		List *placementList = FinalizedShardPlacementList(shardInterval->shardId);
+		if (list_length(placementList) != 1)
+		{
+			/* punt on this for now */
+			ereport(DEBUG1, (errmsg("cannot push down function call for replicated "
+									"distributed tables")));
+			return NULL;
+		}
+
+		ShardPlacement *placement = (ShardPlacement *) linitial(placementList);
+		WorkerNode *workerNode = FindWorkerNode(placement->nodeName,
+												placement->nodePort);
+		if (workerNode == NULL || !workerNode->hasMetadata ||
+			!workerNode->metadataSynced)
+		{
+			ereport(DEBUG1, (errmsg("the worker node does not have metadata")));
+			return NULL;
+		}
+
+		DelegatedCallBatch *batch = DelegatedCallBatchForNode(&batchList,
+															  workerNode->nodeId);
+		if (batch->placementList == NIL)
+		{
+			batch->placementList = placementList;
+			batch->anchorShardId = shardInterval->shardId;
+		}
+
+		batch->rowIndexList = lappend_int(batch->rowIndexList, rowIndex);
+	}
+
+	ereport(DEBUG1, (errmsg("pushing down the function call in %d batches",
+							list_length(batchList))));
+
+	foreach(batchCell, batchList)
+	{
+		DelegatedCallBatch *batch = (DelegatedCallBatch *) lfirst(batchCell);
+		Query *batchQuery = copyObject(query);
+		RangeTblEntry *batchRangeTableEntry = rt_fetch(rtIndex, batchQuery->rtable);
+		ListCell *functionCell = NULL;
+		ListCell *arrayConstCell = NULL;
+		StringInfo queryString = makeStringInfo();
+
+		/* replace the arrays with the slices that belong to the batch */
+		forboth(functionCell, batchRangeTableEntry->functions,
+				arrayConstCell, arrayConstList)
+		{
+			RangeTblFunction *rangeTableFunction =
+				(RangeTblFunction *) lfirst(functionCell);
+			FuncExpr *unnestExpr = (FuncExpr *) rangeTableFunction->funcexpr;
+			Const *arrayConst = (Const *) lfirst(arrayConstCell);
+
+			linitial(unnestExpr->args) = ArraySliceConst(arrayConst,
+														 batch->rowIndexList);
+		}
+
+		pg_get_query_def(batchQuery, queryString);
+
+		Task *task = CitusMakeNode(Task);
+		task->taskType = SELECT_TASK;
+		task->queryString = queryString->data;
+		task->taskPlacementList = batch->placementList;
+		task->anchorShardId = batch->anchorShardId;
+		task->replicationModel = distTable->replicationModel;
+
+		taskList = lappend(taskList, task);
+	}
+
+	return CreateFunctionCallDelegationPlan(query, taskList);
+}
+
+
+/*
+ * UnnestArrayConstList returns the constant array arguments of the unnest()
+ * calls that a batched function call iterates over, in the order of the
+ * output columns. It returns NIL if the FROM clause is not a list of unnest()
+ * calls over one-dimensional constant arrays of the same length.
+ */
+static List *
+UnnestArrayConstList(RangeTblEntry *rangeTableEntry, bool *hasExternParam)
+{
+	List *arrayConstList = NIL;
+	ListCell *functionCell = NULL;
+	int arrayLength = -1;
+
+	if (rangeTableEntry->funcordinality)
+	{
+		ereport(DEBUG1, (errmsg("cannot push down batched function calls "
+								"WITH ORDINALITY")));
+		return NIL;
+	}
+
+	foreach(functionCell, rangeTableEntry->functions)
+	{
+		RangeTblFunction *rangeTableFunction = (RangeTblFunction *) lfirst(functionCell);
+		FuncExpr *unnestExpr = (FuncExpr *) rangeTableFunction->funcexpr;
+
+		if (!IsA(unnestExpr, FuncExpr) || unnestExpr->funcid != F_ARRAY_UNNEST ||
+			rangeTableFunction->funccolcount != 1)
+		{
+			ereport(DEBUG1, (errmsg("batched function calls can only iterate over "
+									"unnest() of arrays of scalar types")));
+			return NIL;
+		}
+
+		Const *arrayConst = (Const *) linitial(unnestExpr->args);
+		if (IsA(arrayConst, Param) &&
+			((Param *) arrayConst)->paramkind == PARAM_EXTERN)
+		{
+			/* Don't log a message, we should end up here again without a parameter */
+			*hasExternParam = true;
+			return NIL;
+		}
+
+		if (!IsA(arrayConst, Const) || arrayConst->constisnull)
+		{
+			ereport(DEBUG1, (errmsg("arrays in a batched function call must be "
+									"constants")));
+			return NIL;
+		}
+
+		ArrayType *array = DatumGetArrayTypeP(arrayConst->constvalue);
+		int currentArrayLength = ArrayGetNItems(ARR_NDIM(array), ARR_DIMS(array));
+		if (ARR_NDIM(array) > 1 ||
+			(arrayLength >= 0 && currentArrayLength != arrayLength))
+		{
+			/* unnest() would pad the shorter arrays with NULLs */
+			ereport(DEBUG1, (errmsg("arrays in a batched function call must be "
+									"one-dimensional and of the same length")));
+			return NIL;
+		}
+
+		arrayLength = currentArrayLength;
+		arrayConstList = lappend(arrayConstList, arrayConst);
+	}
+
+	if (arrayLength <= 0)
+	{
+		/* nothing to push down */
+		return NIL;
+	}
+
+	return arrayConstList;
+}
+
+
+/*
+ * DelegatedCallBatchForNode returns the batch of the given node from the batch
+ * list, and appends a new batch to the list if there is none yet.
+ */
+static DelegatedCallBatch *
+DelegatedCallBatchForNode(List **batchList, int32 nodeId)
+{
+	ListCell *batchCell = NULL;
+
+	foreach(batchCell, *batchList)
+	{
+		DelegatedCallBatch *batch = (DelegatedCallBatch *) lfirst(batchCell);
+
+		if (batch->nodeId == nodeId)
+		{
+			return batch;
+		}
+	}
+
+	DelegatedCallBatch *batch = palloc0(sizeof(DelegatedCallBatch));
+	batch->nodeId = nodeId;
+
+	*batchList = lappend(*batchList, batch);
+
+	return batch;
+}
+
+
+/*
+ * ArraySliceConst returns a constant array that consists of the elements of the
+ * given one-dimensional constant array at the given positions.
+ */
+static Const *
+ArraySliceConst(Const *arrayConst, List *rowIndexList)
+{
+	ArrayType *array = DatumGetArrayTypeP(arrayConst->constvalue);
+	Oid elementType = ARR_ELEMTYPE(array);
+	int16 typeLength = 0;
+	bool typeByValue = false;
+	char typeAlignment = 0;
+	Datum *elementArray = NULL;
+	bool *nullArray = NULL;
+	int elementCount = 0;
+	ListCell *rowIndexCell = NULL;
+	int sliceLength = list_length(rowIndexList);
+	int sliceIndex = 0;
+	int lowerBound = 1;
+
+	get_typlenbyvalalign(elementType, &typeLength, &typeByValue, &typeAlignment);
+	deconstruct_array(array, elementType, typeLength, typeByValue, typeAlignment,
+					  &elementArray, &nullArray, &elementCount);
+
+	Datum *sliceElementArray = palloc0(sliceLength * sizeof(Datum));
+	bool *sliceNullArray = palloc0(sliceLength * sizeof(bool));
+
+	foreach(rowIndexCell, rowIndexList)
+	{
+		int rowIndex = lfirst_int(rowIndexCell);
+
+		sliceElementArray[sliceIndex] = elementArray[rowIndex];
+		sliceNullArray[sliceIndex] = nullArray[rowIndex];
+		sliceIndex++;
+	}
+
+	ArrayType *slice = construct_md_array(sliceElementArray, sliceNullArray, 1,
+										  &sliceLength, &lowerBound, elementType,
+										  typeLength, typeByValue, typeAlignment);
+
+	return makeConst(arrayConst->consttype, arrayConst->consttypmod,
+					 arrayConst->constcollid, -1, PointerGetDatum(slice), false, false);
+}
+
+
+/*
+ * CreateFunctionCallDelegationPlan returns a distributed plan that sends the
+ * given function call tasks to the workers and returns their results.
+ */
+static DistributedPlan *
+CreateFunctionCallDelegationPlan(Query *query, List *taskList)
+{
+	Job *job = CitusMakeNode(Job);
 	job->jobId = UniqueJobId();
 	job->jobQuery = query;
-	job->taskList = list_make1(task);
+	job->taskList = taskList;
 
-	distributedPlan = CitusMakeNode(DistributedPlan);
+	DistributedPlan *distributedPlan = CitusMakeNode(DistributedPlan);
 	distributedPlan->workerJob = job;
 	distributedPlan->masterQuery = NULL;
 	distributedPlan->routerExecutable = true;
@@ -47,6 +47,13 @@
 #include "utils/rel.h"
 
 
+/* controls pushdown of INSERT ... SELECT from reference tables */
+bool EnableReferenceTableInsertSelectPushdown = false;
+
+/* number of VALUES rows from which a multi-row INSERT is copied into the shards */
+int MultiRowInsertCopyThreshold = DISABLE_MULTI_ROW_INSERT_COPY;
+
+
 static DistributedPlan * CreateDistributedInsertSelectPlan(Query *originalQuery,
 														   PlannerRestrictionContext *
 														   plannerRestrictionContext);
@@ -71,6 +78,7 @@ static DeferredErrorMessage * InsertPartitionColumnMatchesSelect(Query *query,
 static DistributedPlan * CreateCoordinatorInsertSelectPlan(uint64 planId, Query *parse);
 static DeferredErrorMessage * CoordinatorInsertSelectSupported(Query *insertSelectQuery);
 static Query * WrapSubquery(Query *subquery);
+static void WrapInsertValuesInSubquery(Query *insertQuery);
 static bool CheckInsertSelectQuery(Query *query);
 static List * TwoPhaseInsertSelectTaskList(Oid targetRelationId, Query *insertSelectQuery,
 										   char *resultIdPrefix);
@@ -372,6 +380,32 @@ DistributedInsertSelectSupported(Query *queryTree, RangeTblEntry *insertRte,
 								 NULL, NULL);
 		}
 	}
+	else if (allReferenceTables && EnableReferenceTableInsertSelectPushdown)
+	{
+		/*
+		 * Every node has a copy of the reference tables, so each target shard
+		 * can be filled from its own node as long as we can restrict the SELECT
+		 * to the hash range of the shard.
+		 */
+		if (targetPartitionMethod != DISTRIBUTE_BY_HASH)
+		{
+			return DeferredError(ERRCODE_FEATURE_NOT_SUPPORTED,
+								 "INSERT ... SELECT from reference tables can only be "
+								 "pushed down into hash distributed tables",
+								 NULL, NULL);
+		}
+
+		if (ReferenceTableSelectPartitionColumn(queryTree) == NULL)
+		{
+			return DeferredError(ERRCODE_FEATURE_NOT_SUPPORTED,
+								 "cannot push down INSERT ... SELECT from reference "
+								 "tables",
+								 "The target table's partition column should "
+								 "correspond to a column of a reference table with "
+								 "the same data type in the subquery.",
+								 NULL);
+		}
+	}
 	else
 	{
 		/* ensure that INSERT's partition column comes from SELECT's partition column */
@@ -499,6 +533,13 @@ RouterModifyTaskForShardInterval(Query *originalQuery, ShardInterval *shardInter
 	{
 		AddShardIntervalRestrictionToSelect(copiedSubquery, shardInterval);
 	}
+	else if (cacheEntry->partitionMethod == DISTRIBUTE_BY_HASH)
+	{
+		Var *selectPartitionColumn = ReferenceTableSelectPartitionColumn(copiedQuery);
+
+		AddHashRangeRestrictionToSelect(copiedSubquery, selectPartitionColumn,
+										shardInterval);
+	}
 
 	/* mark that we don't want the router planner to generate dummy hosts/queries */
 	bool replacePrunedQueryWithDummy = false;
@@ -1103,6 +1144,200 @@ InsertPartitionColumnMatchesSelect(Query *query, RangeTblEntry *insertRte,
 }
 
 
+/*
+ * ReferenceTableSelectPartitionColumn returns the column in the SELECT target
+ * list of the given INSERT ... SELECT that provides the partition column value
+ * of the target table, if that is a plain column of a reference table in the
+ * SELECT with the same data type as the partition column. Otherwise, the
+ * function returns NULL.
+ *
+ * The returned Var points into the target list of the SELECT, such that the
+ * caller can use it to restrict the SELECT to the hash range of a shard.
+ */
+Var *
+ReferenceTableSelectPartitionColumn(Query *insertSelectQuery)
+{
+	RangeTblEntry *insertRte = ExtractResultRelationRTE(insertSelectQuery);
+	RangeTblEntry *subqueryRte = ExtractSelectRangeTableEntry(insertSelectQuery);
+	Query *subquery = subqueryRte->subquery;
+	Var *insertPartitionColumn = PartitionColumn(insertRte->relid, 1);
+	ListCell *targetEntryCell = NULL;
+
+	if (insertPartitionColumn == NULL)
+	{
+		return NULL;
+	}
+
+	foreach(targetEntryCell, insertSelectQuery->targetList)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+
+		if (targetEntry->resno != insertPartitionColumn->varattno)
+		{
+			continue;
+		}
+
+		/* a non-Var means that the column requires casting or has a default */
+		if (!IsA(targetEntry->expr, Var))
+		{
+			return NULL;
+		}
+
+		Var *insertVar = (Var *) targetEntry->expr;
+		TargetEntry *subqueryTargetEntry = list_nth(subquery->targetList,
+													insertVar->varattno - 1);
+		if (!IsA(subqueryTargetEntry->expr, Var))
+		{
+			return NULL;
+		}
+
+		Var *selectColumn = (Var *) subqueryTargetEntry->expr;
+		if (selectColumn->varlevelsup != 0 ||
+			selectColumn->vartype != insertPartitionColumn->vartype)
+		{
+			return NULL;
+		}
+
+		RangeTblEntry *selectRte = rt_fetch(selectColumn->varno, subquery->rtable);
+		if (selectRte->rtekind != RTE_RELATION ||
+			!IsDistributedTable(selectRte->relid) ||
+			PartitionMethod(selectRte->relid) != DISTRIBUTE_BY_NONE)
+		{
+			return NULL;
+		}
+
+		return selectColumn;
+	}
+
+	return NULL;
+}
+
+
+/*
+ * IsLargeMultiRowInsert returns true if the given query is a multi-row INSERT
+ * into a distributed table with at least citus.multi_row_insert_copy_threshold
+ * rows, such that it is cheaper to copy the rows into the shards than to deparse
+ * them into a multi-row INSERT per shard.
+ */
+bool
+IsLargeMultiRowInsert(Query *query)
+{
+	if (MultiRowInsertCopyThreshold == DISABLE_MULTI_ROW_INSERT_COPY)
+	{
+		return false;
+	}
+
+	RangeTblEntry *valuesRte = ExtractDistributedInsertValuesRTE(query);
+	if (valuesRte == NULL)
+	{
+		return false;
+	}
+
+	if (list_length(valuesRte->values_lists) < MultiRowInsertCopyThreshold)
+	{
+		return false;
+	}
+
+	RangeTblEntry *insertRte = ExtractResultRelationRTE(query);
+	if (!IsDistributedTable(insertRte->relid) ||
+		PartitionMethod(insertRte->relid) == DISTRIBUTE_BY_APPEND)
+	{
+		return false;
+	}
+
+	/* the VALUES list should be the only entry in FROM */
+	List *fromList = query->jointree->fromlist;
+	if (list_length(fromList) != 1 || !IsA(linitial(fromList), RangeTblRef))
+	{
+		return false;
+	}
+
+	RangeTblRef *reference = (RangeTblRef *) linitial(fromList);
+
+	return rt_fetch(reference->rtindex, query->rtable) == valuesRte;
+}
+
+
+/*
+ * CreateMultiRowInsertCopyPlan creates a plan for a large multi-row INSERT that,
+ * instead of sending a multi-row INSERT with the deparsed rows to each shard,
+ * evaluates the VALUES list on the coordinator and copies the rows into the
+ * shards. The INSERT is rewritten into the equivalent INSERT ... SELECT from
+ * the VALUES list, such that ON CONFLICT and RETURNING are handled through a
+ * set of intermediate results in the same way as for INSERT ... SELECT via the
+ * coordinator.
+ */
+DistributedPlan *
+CreateMultiRowInsertCopyPlan(uint64 planId, Query *originalQuery)
+{
+	Query *insertSelectQuery = copyObject(originalQuery);
+
+	WrapInsertValuesInSubquery(insertSelectQuery);
+
+	return CreateCoordinatorInsertSelectPlan(planId, insertSelectQuery);
+}
+
+
+/*
+ * WrapInsertValuesInSubquery replaces the VALUES range table entry of a multi-row
+ * INSERT with a subquery that selects all columns of the VALUES list, which
+ * turns the INSERT into an INSERT ... SELECT. The target list of the INSERT does
+ * not change since the subquery returns the columns in the same order.
+ */
+static void
+WrapInsertValuesInSubquery(Query *insertQuery)
+{
+	ParseState *pstate = make_parsestate(NULL);
+	RangeTblRef *valuesReference = linitial(insertQuery->jointree->fromlist);
+	ListCell *rangeTableCell = list_nth_cell(insertQuery->rtable,
+											 valuesReference->rtindex - 1);
+	RangeTblEntry *valuesRte = (RangeTblEntry *) lfirst(rangeTableCell);
+	List *targetList = NIL;
+	ListCell *columnNameCell = NULL;
+	AttrNumber columnNumber = 1;
+
+	Assert(valuesRte->rtekind == RTE_VALUES);
+
+	Query *valuesQuery = makeNode(Query);
+	valuesQuery->commandType = CMD_SELECT;
+	valuesQuery->querySource = QSRC_ORIGINAL;
+	valuesQuery->canSetTag = true;
+	valuesQuery->hasSubLinks = insertQuery->hasSubLinks;
+	valuesQuery->rtable = list_make1(valuesRte);
+
+	RangeTblRef *newRangeTableRef = makeNode(RangeTblRef);
+	newRangeTableRef->rtindex = 1;
+	valuesQuery->jointree = makeFromExpr(list_make1(newRangeTableRef), NULL);
+
+	/* select all columns of the VALUES list */
+	foreach(columnNameCell, valuesRte->eref->colnames)
+	{
+		char *columnName = strVal(lfirst(columnNameCell));
+		int columnIndex = columnNumber - 1;
+
+		Var *column = makeVar(1, columnNumber,
+							  list_nth_oid(valuesRte->coltypes, columnIndex),
+							  list_nth_int(valuesRte->coltypmods, columnIndex),
+							  list_nth_oid(valuesRte->colcollations, columnIndex), 0);
+
+		TargetEntry *targetEntry = makeTargetEntry((Expr *) column, columnNumber,
+												   pstrdup(columnName), false);
+		targetList = lappend(targetList, targetEntry);
+
+		columnNumber++;
+	}
+
+	valuesQuery->targetList = targetList;
+
+	Alias *selectAlias = makeAlias("citus_insert_values", NIL);
+	RangeTblEntry *subqueryRte = addRangeTableEntryForSubquery(pstate, valuesQuery,
+															   selectAlias, false,
+															   true);
+
+	lfirst(rangeTableCell) = subqueryRte;
+}
+
+
 /*
  * CreateCoordinatorInsertSelectPlan creates a query plan for a SELECT into a
  * distributed table. The query plan can also be executed on a worker in MX.
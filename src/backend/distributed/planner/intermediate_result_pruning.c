@@ -5,7 +5,9 @@
  *
  * We only send intermediate results of subqueries and CTEs to worker nodes
  * that use them in the remainder of the distributed plan to avoid unnecessary
- * network traffic.
+ * network traffic. When the result is only joined on the distribution column
+ * of a hash distributed table, each node only gets the rows that belong to
+ * its shards.
  *
  * Copyright (c) Citus Data, Inc.
  *
@@ -13,23 +15,70 @@
  */
 
 #include "distributed/citus_custom_scan.h"
+#include "distributed/distributed_planner.h"
 #include "distributed/intermediate_result_pruning.h"
 #include "distributed/listutils.h"
 #include "distributed/log_utils.h"
 #include "distributed/metadata_cache.h"
+#include "distributed/multi_join_order.h"
+#include "distributed/multi_logical_planner.h"
 #include "distributed/query_utils.h"
+#include "distributed/recursive_planning.h"
 #include "distributed/worker_manager.h"
+#include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/clauses.h"
+#include "parser/parse_relation.h"
+#include "parser/parsetree.h"
 #include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/typcache.h"
 
 /* controlled via GUC, used mostly for testing */
 bool LogIntermediateResults = false;
 
+/* controlled via GUC */
+bool EnableIntermediateResultPartitioning = false;
+
+
+/*
+ * ResultPartitioningContext is used to find the distribution column that an
+ * intermediate result is joined on.
+ */
+typedef struct ResultPartitioningContext
+{
+	char *resultId;
+
+	/* set when a join on a distribution column is found */
+	Oid relationId;
+	int columnIndex;
+} ResultPartitioningContext;
+
+
 static List * AppendAllAccessedWorkerNodes(List *workerNodeList,
 										   DistributedPlan *distributedPlan,
 										   int workerNodeCount);
+static List * AppendTaskListWorkerNodes(List *workerNodeList, List *taskList,
+										int workerNodeCount);
 static IntermediateResultsHashEntry * SearchIntermediateResult(HTAB
 															   *intermediateResultsHash,
 															   char *resultId);
+static int IntermediateResultReferenceCount(List *rangeTableList, char *resultId);
+static bool FindResultPartitioningWalker(Node *node,
+										 ResultPartitioningContext *context);
+static bool FindResultPartitioningInQuery(Query *query,
+										  ResultPartitioningContext *context);
+static List * InnerJoinQualList(Node *joinTreeNode);
+static bool QualJoinsResultOnDistributionColumn(Query *query, Node *qual,
+												ResultPartitioningContext *context);
+static bool VarsJoinResultOnDistributionColumn(Query *query, Var *distributedVar,
+											   Var *resultVar, Oid operatorId,
+											   ResultPartitioningContext *context);
+static Oid DistributionColumnRelationId(Query *query, Var *column, Oid operatorId,
+										Oid comparedType);
+static int ResultColumnIndex(Query *query, Var *column, char *resultId);
+static int ResultColumnIndexInSubquery(Query *subquery, AttrNumber attributeNumber,
+									   char *resultId);
 
 
 /*
@@ -101,12 +150,18 @@ RecordSubplanExecutionsOnNodes(HTAB *intermediateResultsHash,
 		IntermediateResultsHashEntry *entry = SearchIntermediateResult(
 			intermediateResultsHash, resultId);
 
-		/* no need to traverse the whole plan if all the workers are hit */
+		entry->usingPlanCount++;
+
+		/*
+		 * No need to traverse the whole plan if all the workers are hit. The
+		 * other subplans used in this plan might still be sent to fewer nodes,
+		 * so we continue with them.
+		 */
 		if (list_length(entry->nodeIdList) == workerNodeCount)
 		{
 			elog(DEBUG4, "Subplan %s is used in all workers", resultId);
 
-			break;
+			continue;
 		}
 		else
 		{
@@ -154,6 +209,21 @@ AppendAllAccessedWorkerNodes(List *workerNodeList, DistributedPlan *distributedP
 							 workerNodeCount)
 {
 	List *taskList = distributedPlan->workerJob->taskList;
+
+	return AppendTaskListWorkerNodes(workerNodeList, taskList, workerNodeCount);
+}
+
+
+/*
+ * AppendTaskListWorkerNodes appends the nodes of all placements of the given
+ * tasks to the list, as well as the nodes of the tasks they depend on. The
+ * map tasks of a repartition job read the shards of the job's query, which may
+ * refer to intermediate results, on different nodes than the tasks that merge
+ * their outputs.
+ */
+static List *
+AppendTaskListWorkerNodes(List *workerNodeList, List *taskList, int workerNodeCount)
+{
 	ListCell *taskCell = NULL;
 
 	foreach(taskCell, taskList)
@@ -171,12 +241,469 @@ AppendAllAccessedWorkerNodes(List *workerNodeList, DistributedPlan *distributedP
 				return workerNodeList;
 			}
 		}
+
+		if (task->dependentTaskList != NIL)
+		{
+			workerNodeList = AppendTaskListWorkerNodes(workerNodeList,
+													   task->dependentTaskList,
+													   workerNodeCount);
+
+			if (list_length(workerNodeList) == workerNodeCount)
+			{
+				return workerNodeList;
+			}
+		}
 	}
 
 	return workerNodeList;
 }
 
 
+/*
+ * AssignSubPlanResultPartitioning finds the subplans of a distributed plan
+ * whose results are only joined on the distribution column of a hash
+ * distributed table in the given query, and records that table and the
+ * joined column of the result in the subplan. Such results do not need to be
+ * broadcast to all nodes that run the query. Instead, the executor sends each
+ * node only the rows that fall into the shards it has placements of, since
+ * none of the other rows can find a join partner on that node.
+ *
+ * The result must be referenced exactly once in the query, and the join
+ * needs to be an equality in the WHERE clause, in an inner join or in an
+ * IN (...) sublink, such that rows without a join partner never contribute
+ * to the query result.
+ */
+void
+AssignSubPlanResultPartitioning(uint64 planId, DistributedPlan *distributedPlan,
+								Query *originalQuery)
+{
+	List *rangeTableList = NIL;
+	DistributedSubPlan *subPlan = NULL;
+
+	if (distributedPlan->subPlanList == NIL)
+	{
+		return;
+	}
+
+	/* the tasks of repartition joins do not map to the shards of the tables */
+	Job *workerJob = distributedPlan->workerJob;
+	if (workerJob == NULL || workerJob->dependentJobList != NIL)
+	{
+		return;
+	}
+
+	ExtractRangeTableEntryWalker((Node *) originalQuery, &rangeTableList);
+
+	foreach_ptr(subPlan, distributedPlan->subPlanList)
+	{
+		char *resultId = GenerateResultId(planId, subPlan->subPlanId);
+		ResultPartitioningContext context;
+
+		/* results of the HAVING clause are read on the coordinator */
+		if (!list_member(distributedPlan->usedSubPlanNodeList, makeString(resultId)))
+		{
+			continue;
+		}
+
+		if (IntermediateResultReferenceCount(rangeTableList, resultId) != 1)
+		{
+			continue;
+		}
+
+		memset(&context, 0, sizeof(ResultPartitioningContext));
+		context.resultId = resultId;
+		context.relationId = InvalidOid;
+
+		if (FindResultPartitioningWalker((Node *) originalQuery, &context))
+		{
+			subPlan->partitionRelationId = context.relationId;
+			subPlan->partitionColumnIndex = context.columnIndex;
+
+			ereport(DEBUG2, (errmsg("intermediate result %s is partitioned by the "
+									"shards of %s", resultId,
+									get_rel_name(context.relationId))));
+		}
+	}
+}
+
+
+/*
+ * IntermediateResultReferenceCount returns the number of read_intermediate_result
+ * calls on the given result in the list of range table entries.
+ */
+static int
+IntermediateResultReferenceCount(List *rangeTableList, char *resultId)
+{
+	RangeTblEntry *rangeTableEntry = NULL;
+	int referenceCount = 0;
+
+	foreach_ptr(rangeTableEntry, rangeTableList)
+	{
+		if (rangeTableEntry->rtekind != RTE_FUNCTION)
+		{
+			continue;
+		}
+
+		char *rteResultId = FindIntermediateResultIdIfExists(rangeTableEntry);
+		if (rteResultId != NULL && strcmp(rteResultId, resultId) == 0)
+		{
+			referenceCount++;
+		}
+	}
+
+	return referenceCount;
+}
+
+
+/*
+ * FindResultPartitioningWalker walks over the query tree and returns true
+ * once it finds a query that joins the intermediate result on a distribution
+ * column.
+ */
+static bool
+FindResultPartitioningWalker(Node *node, ResultPartitioningContext *context)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	if (IsA(node, Query))
+	{
+		Query *query = (Query *) node;
+
+		if (FindResultPartitioningInQuery(query, context))
+		{
+			return true;
+		}
+
+		return query_tree_walker(query, FindResultPartitioningWalker, context, 0);
+	}
+
+	return expression_tree_walker(node, FindResultPartitioningWalker, context);
+}
+
+
+/*
+ * FindResultPartitioningInQuery returns true if one of the filters in the
+ * WHERE clause or in the inner joins of the query joins the intermediate
+ * result on a distribution column.
+ */
+static bool
+FindResultPartitioningInQuery(Query *query, ResultPartitioningContext *context)
+{
+	Node *qual = NULL;
+
+	if (query->commandType != CMD_SELECT || query->jointree == NULL)
+	{
+		return false;
+	}
+
+	List *qualList = make_ands_implicit((Expr *) query->jointree->quals);
+	qualList = list_concat(qualList, InnerJoinQualList((Node *) query->jointree));
+
+	foreach_ptr(qual, qualList)
+	{
+		if (QualJoinsResultOnDistributionColumn(query, qual, context))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * InnerJoinQualList returns the filters of all inner joins in the join tree.
+ */
+static List *
+InnerJoinQualList(Node *joinTreeNode)
+{
+	List *qualList = NIL;
+
+	if (joinTreeNode == NULL)
+	{
+		return NIL;
+	}
+
+	if (IsA(joinTreeNode, FromExpr))
+	{
+		FromExpr *fromExpr = (FromExpr *) joinTreeNode;
+		Node *fromNode = NULL;
+
+		foreach_ptr(fromNode, fromExpr->fromlist)
+		{
+			qualList = list_concat(qualList, InnerJoinQualList(fromNode));
+		}
+	}
+	else if (IsA(joinTreeNode, JoinExpr))
+	{
+		JoinExpr *joinExpr = (JoinExpr *) joinTreeNode;
+
+		if (joinExpr->jointype == JOIN_INNER)
+		{
+			qualList = make_ands_implicit((Expr *) joinExpr->quals);
+		}
+
+		qualList = list_concat(qualList, InnerJoinQualList(joinExpr->larg));
+		qualList = list_concat(qualList, InnerJoinQualList(joinExpr->rarg));
+	}
+
+	return qualList;
+}
+
+
+/*
+ * QualJoinsResultOnDistributionColumn returns true if the given filter is an
+ * equality between the distribution column of a hash distributed table and a
+ * column of the intermediate result, either directly or via IN (...).
+ */
+static bool
+QualJoinsResultOnDistributionColumn(Query *query, Node *qual,
+									ResultPartitioningContext *context)
+{
+	if (IsA(qual, OpExpr))
+	{
+		OpExpr *opExpr = (OpExpr *) qual;
+
+		if (list_length(opExpr->args) != 2)
+		{
+			return false;
+		}
+
+		Node *leftArg = linitial(opExpr->args);
+		Node *rightArg = lsecond(opExpr->args);
+		if (!IsA(leftArg, Var) || !IsA(rightArg, Var))
+		{
+			return false;
+		}
+
+		return VarsJoinResultOnDistributionColumn(query, (Var *) leftArg,
+												  (Var *) rightArg, opExpr->opno,
+												  context) ||
+			   VarsJoinResultOnDistributionColumn(query, (Var *) rightArg,
+												  (Var *) leftArg, opExpr->opno,
+												  context);
+	}
+	else if (IsA(qual, SubLink))
+	{
+		SubLink *subLink = (SubLink *) qual;
+
+		if (subLink->subLinkType != ANY_SUBLINK || !IsA(subLink->testexpr, OpExpr))
+		{
+			return false;
+		}
+
+		OpExpr *opExpr = (OpExpr *) subLink->testexpr;
+		if (list_length(opExpr->args) != 2)
+		{
+			return false;
+		}
+
+		Node *leftArg = linitial(opExpr->args);
+		Node *rightArg = lsecond(opExpr->args);
+		if (!IsA(leftArg, Var) || !IsA(rightArg, Param))
+		{
+			return false;
+		}
+
+		Var *distributedVar = (Var *) leftArg;
+		Param *param = (Param *) rightArg;
+		if (param->paramkind != PARAM_SUBLINK)
+		{
+			return false;
+		}
+
+		Oid relationId = DistributionColumnRelationId(query, distributedVar,
+													  opExpr->opno, param->paramtype);
+		if (!OidIsValid(relationId))
+		{
+			return false;
+		}
+
+		Query *subquery = (Query *) subLink->subselect;
+		int columnIndex = ResultColumnIndexInSubquery(subquery, param->paramid,
+													  context->resultId);
+		if (columnIndex < 0)
+		{
+			return false;
+		}
+
+		context->relationId = relationId;
+		context->columnIndex = columnIndex;
+
+		return true;
+	}
+
+	return false;
+}
+
+
+/*
+ * VarsJoinResultOnDistributionColumn returns true if distributedVar is the
+ * distribution column of a hash distributed table and resultVar is a column
+ * of the intermediate result that is compared to it using the given operator.
+ */
+static bool
+VarsJoinResultOnDistributionColumn(Query *query, Var *distributedVar, Var *resultVar,
+								   Oid operatorId, ResultPartitioningContext *context)
+{
+	if (resultVar->varlevelsup != 0)
+	{
+		return false;
+	}
+
+	Oid relationId = DistributionColumnRelationId(query, distributedVar, operatorId,
+												  resultVar->vartype);
+	if (!OidIsValid(relationId))
+	{
+		return false;
+	}
+
+	int columnIndex = ResultColumnIndex(query, resultVar, context->resultId);
+	if (columnIndex < 0)
+	{
+		return false;
+	}
+
+	context->relationId = relationId;
+	context->columnIndex = columnIndex;
+
+	return true;
+}
+
+
+/*
+ * DistributionColumnRelationId returns the hash distributed table whose
+ * distribution column is the given column of the query, if the column is
+ * compared to a value of the same type using the equality operator of the
+ * type. Only then do equal values hash to the same shard. Otherwise, the
+ * function returns InvalidOid.
+ */
+static Oid
+DistributionColumnRelationId(Query *query, Var *column, Oid operatorId,
+							 Oid comparedType)
+{
+	if (column->varlevelsup != 0)
+	{
+		return InvalidOid;
+	}
+
+	RangeTblEntry *rangeTableEntry = rt_fetch(column->varno, query->rtable);
+	if (rangeTableEntry->rtekind != RTE_RELATION ||
+		!IsDistributedTable(rangeTableEntry->relid) ||
+		PartitionMethod(rangeTableEntry->relid) != DISTRIBUTE_BY_HASH)
+	{
+		return InvalidOid;
+	}
+
+	Var *partitionColumn = DistPartitionKey(rangeTableEntry->relid);
+	if (column->varattno != partitionColumn->varattno ||
+		comparedType != partitionColumn->vartype)
+	{
+		return InvalidOid;
+	}
+
+	TypeCacheEntry *typeEntry = lookup_type_cache(partitionColumn->vartype,
+												  TYPECACHE_EQ_OPR);
+	if (operatorId != typeEntry->eq_opr)
+	{
+		return InvalidOid;
+	}
+
+	return rangeTableEntry->relid;
+}
+
+
+/*
+ * ResultColumnIndex returns the index of the column of the intermediate
+ * result that the given column refers to, or -1 if the column does not refer
+ * to the intermediate result.
+ */
+static int
+ResultColumnIndex(Query *query, Var *column, char *resultId)
+{
+	RangeTblEntry *rangeTableEntry = rt_fetch(column->varno, query->rtable);
+
+	if (rangeTableEntry->rtekind == RTE_FUNCTION)
+	{
+		char *rteResultId = FindIntermediateResultIdIfExists(rangeTableEntry);
+		if (rteResultId == NULL || strcmp(rteResultId, resultId) != 0)
+		{
+			return -1;
+		}
+
+		return column->varattno - 1;
+	}
+	else if (rangeTableEntry->rtekind == RTE_SUBQUERY)
+	{
+		return ResultColumnIndexInSubquery(rangeTableEntry->subquery, column->varattno,
+										   resultId);
+	}
+
+	return -1;
+}
+
+
+/*
+ * ResultColumnIndexInSubquery returns the index of the intermediate result
+ * column that is the given output column of the subquery, if the subquery
+ * merely reads the intermediate result as recursive planning generates it.
+ * Otherwise, the function returns -1.
+ */
+static int
+ResultColumnIndexInSubquery(Query *subquery, AttrNumber attributeNumber,
+							char *resultId)
+{
+	if (subquery->commandType != CMD_SELECT || subquery->setOperations != NULL ||
+		subquery->groupClause != NIL || subquery->distinctClause != NIL ||
+		subquery->havingQual != NULL || subquery->limitCount != NULL ||
+		subquery->limitOffset != NULL || subquery->hasAggs ||
+		subquery->hasWindowFuncs || subquery->hasTargetSRFs ||
+		subquery->hasSubLinks || subquery->cteList != NIL ||
+		list_length(subquery->rtable) != 1 || subquery->jointree == NULL ||
+		subquery->jointree->quals != NULL)
+	{
+		return -1;
+	}
+
+	TargetEntry *targetEntry = get_tle_by_resno(subquery->targetList, attributeNumber);
+	if (targetEntry == NULL || targetEntry->resjunk || !IsA(targetEntry->expr, Var))
+	{
+		return -1;
+	}
+
+	Var *column = (Var *) targetEntry->expr;
+	if (column->varlevelsup != 0)
+	{
+		return -1;
+	}
+
+	RangeTblEntry *rangeTableEntry = rt_fetch(column->varno, subquery->rtable);
+	if (rangeTableEntry->rtekind != RTE_FUNCTION)
+	{
+		return -1;
+	}
+
+	return ResultColumnIndex(subquery, column, resultId);
+}
+
+
+/*
+ * IntermediateResultUsedInSinglePlan returns true if only one of the distributed
+ * plans of the plan tree reads the given intermediate result.
+ */
+bool
+IntermediateResultUsedInSinglePlan(HTAB *intermediateResultsHash, char *resultId)
+{
+	IntermediateResultsHashEntry *entry =
+		SearchIntermediateResult(intermediateResultsHash, resultId);
+
+	return entry->usingPlanCount == 1;
+}
+
+
 /*
  * MakeIntermediateResultHTAB is a helper method that creates a Hash Table that
  * stores information on the intermediate result.
@@ -250,6 +777,7 @@ SearchIntermediateResult(HTAB *intermediateResultsHash, char *resultId)
 	if (!found)
 	{
 		entry->nodeIdList = NIL;
+		entry->usingPlanCount = 0;
 	}
 
 	return entry;
@@ -11,9 +11,11 @@
 #include "libpq-fe.h"
 #include "miscadmin.h"
 
+#include "access/stratnum.h"
 #include "access/xact.h"
 #include "catalog/namespace.h"
 #include "catalog/pg_class.h"
+#include "catalog/pg_type.h"
 #include "commands/copy.h"
 #include "commands/createas.h"
 #include "commands/dbcommands.h"
@@ -22,8 +24,10 @@
 #include "optimizer/cost.h"
 #include "distributed/citus_nodefuncs.h"
 #include "distributed/connection_management.h"
+#include "distributed/deparse_shard_query.h"
 #include "distributed/insert_select_planner.h"
 #include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
 #include "distributed/multi_client_executor.h"
 #include "distributed/multi_executor.h"
 #include "distributed/multi_explain.h"
@@ -34,8 +38,10 @@
 #include "distributed/distributed_planner.h"
 #include "distributed/multi_server_executor.h"
 #include "distributed/remote_commands.h"
+#include "distributed/tuplestore.h"
 #include "distributed/recursive_planning.h"
 #include "distributed/placement_connection.h"
+#include "distributed/planning_phases.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/version_compat.h"
 #include "lib/stringinfo.h"
@@ -44,6 +50,7 @@
 #include "nodes/print.h"
 #include "optimizer/clauses.h"
 #include "optimizer/planner.h"
+#include "parser/parsetree.h"
 #include "portability/instr_time.h"
 #include "tcop/dest.h"
 #include "tcop/tcopprot.h"
@@ -66,6 +73,18 @@ bool ExplainDistributedQueries = true;
 bool ExplainAllTasks = false;
 
 
+/* number of task executions shown by EXPLAIN ANALYZE, unless all tasks are shown */
+#define EXPLAIN_TASK_EXECUTION_COUNT 5
+
+
+/*
+ * EXPLAIN command whose ANALYZE is in progress, if any. The adaptive executor
+ * uses its options to fetch the EXPLAIN ANALYZE output of the tasks while
+ * executing them.
+ */
+static ExplainState *CurrentExplainAnalyzeState = NULL;
+
+
 /* Result for a single remote EXPLAIN command */
 typedef struct RemoteExplainPlan
 {
@@ -74,17 +93,80 @@ typedef struct RemoteExplainPlan
 } RemoteExplainPlan;
 
 
+/* Aggregated task executions on a single worker, for EXPLAIN ANALYZE */
+typedef struct WorkerExecutionSummary
+{
+	char *nodeName;
+	int nodePort;
+	int taskCount;
+	int newConnectionCount;
+	double connectTime;
+	double executionTime;
+	double maxExecutionTime;
+	uint64 rowCount;
+	uint64 byteCount;
+} WorkerExecutionSummary;
+
+
+/*
+ * ExplainAnalyzeDestReceiver stores the rows of a query executed by
+ * worker_execute_query_explain_analyze in a tuple store, leaving the
+ * trailing EXPLAIN output column empty.
+ */
+typedef struct ExplainAnalyzeDestReceiver
+{
+	/* public DestReceiver interface */
+	DestReceiver pub;
+
+	Tuplestorestate *tupleStore;
+	TupleDesc tupleDescriptor;
+
+	/* values and nulls of the row that is stored */
+	Datum *values;
+	bool *nulls;
+} ExplainAnalyzeDestReceiver;
+
+
 /* Explain functions for distributed queries */
 static void ExplainSubPlans(DistributedPlan *distributedPlan, ExplainState *es);
-static void ExplainJob(Job *job, ExplainState *es);
+static void ExplainSubPlanResult(DistributedSubPlan *subPlan, ExplainState *es);
+static void ExplainJob(Job *job, List *taskInstrumentationList, ExplainState *es);
+static void ExplainTaskResultMerge(CustomScanState *node, Sort *mergeSortOrder,
+								   ExplainState *es);
 static void ExplainMapMergeJob(MapMergeJob *mapMergeJob, ExplainState *es);
-static void ExplainTaskList(List *taskList, ExplainState *es);
+static void ExplainTaskList(List *taskList, List *taskInstrumentationList,
+							ExplainState *es);
+static RemoteExplainPlan * SavedExplainAnalyzePlan(Task *task,
+												   List *taskInstrumentationList);
 static RemoteExplainPlan * RemoteExplain(Task *task, ExplainState *es);
 static void ExplainTask(Task *task, int placementIndex, List *explainOutputList,
 						ExplainState *es);
 static void ExplainTaskPlacement(ShardPlacement *taskPlacement, List *explainOutputList,
 								 ExplainState *es);
 static StringInfo BuildRemoteExplainQuery(char *queryString, ExplainState *es);
+static const char * ExplainFormatName(ExplainFormat format);
+static ExplainFormat ExplainFormatFromName(const char *formatName);
+static void ExplainAnalyzeQuery(Query *query, const char *queryString,
+								DestReceiver *dest, ExplainState *es);
+static DestReceiver * CreateExplainAnalyzeDestReceiver(Tuplestorestate *tupleStore,
+													   TupleDesc tupleDescriptor);
+static void ExplainAnalyzeDestStartup(DestReceiver *dest, int operation,
+									  TupleDesc inputTupleDescriptor);
+static bool ExplainAnalyzeDestReceive(TupleTableSlot *slot, DestReceiver *dest);
+static void ExplainAnalyzeDestShutdown(DestReceiver *dest);
+static void ExplainAnalyzeDestDestroy(DestReceiver *dest);
+static void ExplainTaskExecutions(List *instrumentationList, ExplainState *es);
+static void ExplainTaskExecution(TaskExecutionInstrumentation *instrumentation,
+								 ExplainState *es);
+static List * WorkerExecutionSummaryList(List *instrumentationList);
+static void ExplainWorkerExecutionSummary(WorkerExecutionSummary *summary,
+										  ExplainState *es);
+static int CompareTaskExecutionsByTime(const void *leftElement,
+									   const void *rightElement);
+static int CompareTaskExecutionsBySize(const void *leftElement,
+									   const void *rightElement);
+static int CompareWorkerExecutionSummaries(const void *leftElement,
+										   const void *rightElement);
 
 /* Static Explain functions copied from explain.c */
 static void ExplainOneQuery(Query *query, int cursorOptions,
@@ -93,6 +175,9 @@ static void ExplainOneQuery(Query *query, int cursorOptions,
 							QueryEnvironment *queryEnv);
 
 
+PG_FUNCTION_INFO_V1(worker_execute_query_explain_analyze);
+
+
 /*
  * CitusExplainScan is a custom scan explain callback function which is used to
  * print explain information of a Citus plan which includes both master and
@@ -119,12 +204,77 @@ CitusExplainScan(CustomScanState *node, List *ancestors, struct ExplainState *es
 		ExplainSubPlans(distributedPlan, es);
 	}
 
-	ExplainJob(distributedPlan->workerJob, es);
+	if (distributedPlan->taskResultMergeOrder != NULL)
+	{
+		ExplainTaskResultMerge(node, distributedPlan->taskResultMergeOrder, es);
+	}
+
+	ExplainJob(distributedPlan->workerJob, scanState->taskInstrumentationList, es);
+
+	if (es->analyze && es->summary && scanState->taskInstrumentationList != NIL)
+	{
+		ExplainTaskExecutions(scanState->taskInstrumentationList, es);
+	}
+
+	if (es->summary)
+	{
+		ExplainPlanningPhaseStats(distributedPlan->planId, es);
+	}
 
 	ExplainCloseGroup("Distributed Query", "Distributed Query", true, es);
 }
 
 
+/*
+ * ExplainTaskResultMerge shows the columns on which the sorted rows of the
+ * tasks are merged, in place of the sort on the coordinator. Like the sort
+ * key of a Sort node, a column is followed by its ordering options when they
+ * differ from the default.
+ */
+static void
+ExplainTaskResultMerge(CustomScanState *node, Sort *mergeSortOrder, ExplainState *es)
+{
+	CustomScan *customScan = (CustomScan *) node->ss.ps.plan;
+	List *mergeKeyList = NIL;
+
+	for (int columnIndex = 0; columnIndex < mergeSortOrder->numCols; columnIndex++)
+	{
+		AttrNumber columnNumber = mergeSortOrder->sortColIdx[columnIndex];
+		TargetEntry *targetEntry = get_tle_by_resno(customScan->custom_scan_tlist,
+													columnNumber);
+		bool nullsFirst = mergeSortOrder->nullsFirst[columnIndex];
+		bool reverse = false;
+		Oid operatorFamily = InvalidOid;
+		Oid operatorInputType = InvalidOid;
+		int16 strategy = 0;
+
+		StringInfo mergeKey = makeStringInfo();
+		appendStringInfoString(mergeKey, quote_identifier(targetEntry->resname));
+
+		if (get_ordering_op_properties(mergeSortOrder->sortOperators[columnIndex],
+									   &operatorFamily, &operatorInputType, &strategy) &&
+			strategy == BTGreaterStrategyNumber)
+		{
+			appendStringInfoString(mergeKey, " DESC");
+			reverse = true;
+		}
+
+		if (nullsFirst && !reverse)
+		{
+			appendStringInfoString(mergeKey, " NULLS FIRST");
+		}
+		else if (!nullsFirst && reverse)
+		{
+			appendStringInfoString(mergeKey, " NULLS LAST");
+		}
+
+		mergeKeyList = lappend(mergeKeyList, mergeKey->data);
+	}
+
+	ExplainPropertyList("Merge Key", mergeKeyList, es);
+}
+
+
 /*
  * CoordinatorInsertSelectExplainScan is a custom scan explain callback function
  * which is used to print explain information of a Citus plan for an INSERT INTO
@@ -193,6 +343,11 @@ ExplainSubPlans(DistributedPlan *distributedPlan, ExplainState *es)
 		INSTR_TIME_SET_CURRENT(planduration);
 		INSTR_TIME_SUBTRACT(planduration, planduration);
 
+		if (es->analyze)
+		{
+			ExplainSubPlanResult(subPlan, es);
+		}
+
 		ExplainOnePlan(plan, into, es, queryString, params, NULL, &planduration);
 
 		if (es->format == EXPLAIN_FORMAT_TEXT)
@@ -205,13 +360,42 @@ ExplainSubPlans(DistributedPlan *distributedPlan, ExplainState *es)
 }
 
 
+/*
+ * ExplainSubPlanResult shows the size of the intermediate result that the
+ * given subplan wrote during the execution and where it was written to.
+ */
+static void
+ExplainSubPlanResult(DistributedSubPlan *subPlan, ExplainState *es)
+{
+	StringInfo destination = makeStringInfo();
+
+	ExplainPropertyInteger("Intermediate Data Size", "bytes", subPlan->bytesSent, es);
+
+	if (subPlan->remoteWorkerCount > 0 && subPlan->writeLocalFile)
+	{
+		appendStringInfo(destination, "Send to %u nodes, write locally",
+						 subPlan->remoteWorkerCount);
+	}
+	else if (subPlan->writeLocalFile)
+	{
+		appendStringInfoString(destination, "Write locally");
+	}
+	else
+	{
+		appendStringInfo(destination, "Send to %u nodes", subPlan->remoteWorkerCount);
+	}
+
+	ExplainPropertyText("Result Destination", destination->data, es);
+}
+
+
 /*
  * ExplainJob shows the EXPLAIN output for a Job in the physical plan of
  * a distributed query by showing the remote EXPLAIN for the first task,
  * or all tasks if citus.explain_all_tasks is on.
  */
 static void
-ExplainJob(Job *job, ExplainState *es)
+ExplainJob(Job *job, List *taskInstrumentationList, ExplainState *es)
 {
 	List *dependentJobList = job->dependentJobList;
 	int dependentJobCount = list_length(dependentJobList);
@@ -248,7 +432,7 @@ ExplainJob(Job *job, ExplainState *es)
 	{
 		ExplainOpenGroup("Tasks", "Tasks", false, es);
 
-		ExplainTaskList(taskList, es);
+		ExplainTaskList(taskList, taskInstrumentationList, es);
 
 		ExplainCloseGroup("Tasks", "Tasks", false, es);
 	}
@@ -328,10 +512,12 @@ ExplainMapMergeJob(MapMergeJob *mapMergeJob, ExplainState *es)
 
 /*
  * ExplainTaskList shows the remote EXPLAIN for the first task in taskList,
- * or all tasks if citus.explain_all_tasks is on.
+ * or all tasks if citus.explain_all_tasks is on. Under EXPLAIN ANALYZE, we
+ * use the output that the workers returned along with the results of the
+ * tasks where possible, rather than running the tasks a second time.
  */
 static void
-ExplainTaskList(List *taskList, ExplainState *es)
+ExplainTaskList(List *taskList, List *taskInstrumentationList, ExplainState *es)
 {
 	ListCell *taskCell = NULL;
 	ListCell *remoteExplainCell = NULL;
@@ -344,7 +530,18 @@ ExplainTaskList(List *taskList, ExplainState *es)
 	{
 		Task *task = (Task *) lfirst(taskCell);
 
-		RemoteExplainPlan *remoteExplain = RemoteExplain(task, es);
+		RemoteExplainPlan *remoteExplain = NULL;
+
+		if (es->analyze)
+		{
+			remoteExplain = SavedExplainAnalyzePlan(task, taskInstrumentationList);
+		}
+
+		if (remoteExplain == NULL)
+		{
+			remoteExplain = RemoteExplain(task, es);
+		}
+
 		remoteExplainList = lappend(remoteExplainList, remoteExplain);
 
 		if (!ExplainAllTasks)
@@ -365,6 +562,75 @@ ExplainTaskList(List *taskList, ExplainState *es)
 }
 
 
+/*
+ * SavedExplainAnalyzePlan returns the EXPLAIN ANALYZE output that a worker
+ * returned for the given task during the execution, or NULL if the output
+ * was not fetched during the execution.
+ */
+static RemoteExplainPlan *
+SavedExplainAnalyzePlan(Task *task, List *taskInstrumentationList)
+{
+	ListCell *instrumentationCell = NULL;
+
+	foreach(instrumentationCell, taskInstrumentationList)
+	{
+		TaskExecutionInstrumentation *instrumentation =
+			(TaskExecutionInstrumentation *) lfirst(instrumentationCell);
+		Task *executedTask = instrumentation->task;
+		ListCell *placementCell = NULL;
+		int placementIndex = 0;
+
+		/* the executed task is a copy of the task with a wrapped query */
+		if (instrumentation->explainAnalyzeOutput == NULL ||
+			executedTask->taskId != task->taskId ||
+			executedTask->anchorShardId != task->anchorShardId)
+		{
+			continue;
+		}
+
+		foreach(placementCell, task->taskPlacementList)
+		{
+			ShardPlacement *taskPlacement = (ShardPlacement *) lfirst(placementCell);
+
+			if (strcmp(taskPlacement->nodeName, instrumentation->nodeName) == 0 &&
+				taskPlacement->nodePort == instrumentation->nodePort)
+			{
+				RemoteExplainPlan *remotePlan =
+					(RemoteExplainPlan *) palloc0(sizeof(RemoteExplainPlan));
+				char *lineStart = instrumentation->explainAnalyzeOutput;
+
+				remotePlan->placementIndex = placementIndex;
+
+				/* split the output into lines, like the rows of a remote EXPLAIN */
+				while (*lineStart != '\0')
+				{
+					char *lineEnd = strchr(lineStart, '\n');
+					StringInfo explainOutputLine = makeStringInfo();
+
+					if (lineEnd == NULL)
+					{
+						lineEnd = lineStart + strlen(lineStart);
+					}
+
+					appendBinaryStringInfo(explainOutputLine, lineStart,
+										   lineEnd - lineStart);
+					remotePlan->explainOutputList =
+						lappend(remotePlan->explainOutputList, explainOutputLine);
+
+					lineStart = (*lineEnd == '\n') ? lineEnd + 1 : lineEnd;
+				}
+
+				return remotePlan;
+			}
+
+			placementIndex++;
+		}
+	}
+
+	return NULL;
+}
+
+
 /*
  * RemoteExplain fetches the remote EXPLAIN output for a single
  * task. It tries each shard placement until one succeeds or all
@@ -378,7 +644,7 @@ RemoteExplain(Task *task, ExplainState *es)
 
 	RemoteExplainPlan *remotePlan = (RemoteExplainPlan *) palloc0(
 		sizeof(RemoteExplainPlan));
-	StringInfo explainQuery = BuildRemoteExplainQuery(task->queryString, es);
+	StringInfo explainQuery = BuildRemoteExplainQuery(TaskQueryString(task), es);
 
 	/*
 	 * Use a coordinated transaction to ensure that we open a transaction block
@@ -562,43 +828,316 @@ ExplainTaskPlacement(ShardPlacement *taskPlacement, List *explainOutputList,
 
 
 /*
- * BuildRemoteExplainQuery returns an EXPLAIN query string
- * to run on a worker node which explicitly contains all
- * the options in the explain state.
+ * ExplainTaskExecutions shows how the tasks of the distributed query were
+ * executed during EXPLAIN ANALYZE: the slowest task executions, or all of them
+ * if citus.explain_all_tasks is on, followed by aggregates per worker, such
+ * that skewed shards and slow workers stand out. Without TIMING, the task
+ * executions that received the most data are shown instead.
  */
-static StringInfo
-BuildRemoteExplainQuery(char *queryString, ExplainState *es)
+static void
+ExplainTaskExecutions(List *instrumentationList, ExplainState *es)
 {
-	StringInfo explainQuery = makeStringInfo();
-	char *formatStr = NULL;
+	int taskExecutionCount = list_length(instrumentationList);
+	int shownTaskExecutionCount = taskExecutionCount;
+	ListCell *instrumentationCell = NULL;
+	ListCell *summaryCell = NULL;
 
-	switch (es->format)
+	if (es->timing)
 	{
-		case EXPLAIN_FORMAT_XML:
+		instrumentationList = SortList(instrumentationList,
+									   CompareTaskExecutionsByTime);
+	}
+	else
+	{
+		instrumentationList = SortList(instrumentationList,
+									   CompareTaskExecutionsBySize);
+	}
+
+	ExplainOpenGroup("Task Executions", "Task Executions", true, es);
+
+	if (ExplainAllTasks || taskExecutionCount <= EXPLAIN_TASK_EXECUTION_COUNT)
+	{
+		ExplainPropertyText("Task Executions Shown", "All", es);
+	}
+	else
+	{
+		StringInfo shownText = makeStringInfo();
+
+		shownTaskExecutionCount = EXPLAIN_TASK_EXECUTION_COUNT;
+		appendStringInfo(shownText, "%s %d of %d", es->timing ? "Slowest" : "Largest",
+						 shownTaskExecutionCount, taskExecutionCount);
+
+		ExplainPropertyText("Task Executions Shown", shownText->data, es);
+	}
+
+	ExplainOpenGroup("Executions", "Executions", false, es);
+
+	foreach(instrumentationCell, instrumentationList)
+	{
+		TaskExecutionInstrumentation *instrumentation =
+			(TaskExecutionInstrumentation *) lfirst(instrumentationCell);
+
+		if (shownTaskExecutionCount-- == 0)
 		{
-			formatStr = "XML";
 			break;
 		}
 
-		case EXPLAIN_FORMAT_JSON:
+		ExplainTaskExecution(instrumentation, es);
+	}
+
+	ExplainCloseGroup("Executions", "Executions", false, es);
+
+	ExplainOpenGroup("Workers", "Workers", false, es);
+
+	foreach(summaryCell, WorkerExecutionSummaryList(instrumentationList))
+	{
+		WorkerExecutionSummary *summary = (WorkerExecutionSummary *) lfirst(summaryCell);
+
+		ExplainWorkerExecutionSummary(summary, es);
+	}
+
+	ExplainCloseGroup("Workers", "Workers", false, es);
+
+	ExplainCloseGroup("Task Executions", "Task Executions", true, es);
+}
+
+
+/*
+ * ExplainTaskExecution shows the timing and the received data of a single
+ * task execution on a placement.
+ */
+static void
+ExplainTaskExecution(TaskExecutionInstrumentation *instrumentation, ExplainState *es)
+{
+	StringInfo nodeAddress = makeStringInfo();
+
+	ExplainOpenGroup("Task Execution", NULL, true, es);
+
+	if (es->format == EXPLAIN_FORMAT_TEXT)
+	{
+		appendStringInfoSpaces(es->str, es->indent * 2);
+		appendStringInfo(es->str, "->  Task Execution\n");
+		es->indent += 3;
+	}
+
+	appendStringInfo(nodeAddress, "host=%s port=%d", instrumentation->nodeName,
+					 instrumentation->nodePort);
+
+	ExplainPropertyInteger("Shard", NULL, instrumentation->task->anchorShardId, es);
+	ExplainPropertyText("Node", nodeAddress->data, es);
+
+	if (es->timing)
+	{
+		ExplainPropertyFloat("Connection Time", "ms", instrumentation->connectTime, 3,
+							 es);
+		ExplainPropertyFloat("Queue Time", "ms", instrumentation->queueTime, 3, es);
+		ExplainPropertyFloat("Execution Time", "ms", instrumentation->executionTime, 3,
+							 es);
+	}
+
+	ExplainPropertyInteger("Rows Received", NULL, instrumentation->rowCount, es);
+	ExplainPropertyInteger("Bytes Received", "bytes", instrumentation->byteCount, es);
+
+	if (!instrumentation->finished)
+	{
+		ExplainPropertyText("Error", "Task execution failed on this node.", es);
+	}
+
+	ExplainCloseGroup("Task Execution", NULL, true, es);
+
+	if (es->format == EXPLAIN_FORMAT_TEXT)
+	{
+		es->indent -= 3;
+	}
+}
+
+
+/*
+ * WorkerExecutionSummaryList aggregates the given task executions per worker
+ * and returns the aggregates ordered by worker.
+ */
+static List *
+WorkerExecutionSummaryList(List *instrumentationList)
+{
+	List *summaryList = NIL;
+	ListCell *instrumentationCell = NULL;
+
+	foreach(instrumentationCell, instrumentationList)
+	{
+		TaskExecutionInstrumentation *instrumentation =
+			(TaskExecutionInstrumentation *) lfirst(instrumentationCell);
+		WorkerExecutionSummary *summary = NULL;
+		ListCell *summaryCell = NULL;
+
+		foreach(summaryCell, summaryList)
 		{
-			formatStr = "JSON";
-			break;
+			WorkerExecutionSummary *candidate =
+				(WorkerExecutionSummary *) lfirst(summaryCell);
+
+			if (candidate->nodePort == instrumentation->nodePort &&
+				strcmp(candidate->nodeName, instrumentation->nodeName) == 0)
+			{
+				summary = candidate;
+				break;
+			}
 		}
 
-		case EXPLAIN_FORMAT_YAML:
+		if (summary == NULL)
 		{
-			formatStr = "YAML";
-			break;
+			summary = (WorkerExecutionSummary *) palloc0(sizeof(WorkerExecutionSummary));
+			summary->nodeName = instrumentation->nodeName;
+			summary->nodePort = instrumentation->nodePort;
+
+			summaryList = lappend(summaryList, summary);
 		}
 
-		default:
+		summary->taskCount++;
+		summary->executionTime += instrumentation->executionTime;
+		summary->maxExecutionTime = Max(summary->maxExecutionTime,
+										instrumentation->executionTime);
+		summary->rowCount += instrumentation->rowCount;
+		summary->byteCount += instrumentation->byteCount;
+
+		if (instrumentation->connectTime > 0)
 		{
-			formatStr = "TEXT";
-			break;
+			summary->newConnectionCount++;
+			summary->connectTime += instrumentation->connectTime;
 		}
 	}
 
+	return SortList(summaryList, CompareWorkerExecutionSummaries);
+}
+
+
+/*
+ * ExplainWorkerExecutionSummary shows the aggregated task executions on a
+ * single worker.
+ */
+static void
+ExplainWorkerExecutionSummary(WorkerExecutionSummary *summary, ExplainState *es)
+{
+	StringInfo nodeAddress = makeStringInfo();
+
+	ExplainOpenGroup("Worker", NULL, true, es);
+
+	if (es->format == EXPLAIN_FORMAT_TEXT)
+	{
+		appendStringInfoSpaces(es->str, es->indent * 2);
+		appendStringInfo(es->str, "->  Worker\n");
+		es->indent += 3;
+	}
+
+	appendStringInfo(nodeAddress, "host=%s port=%d", summary->nodeName,
+					 summary->nodePort);
+
+	ExplainPropertyText("Node", nodeAddress->data, es);
+	ExplainPropertyInteger("Task Count", NULL, summary->taskCount, es);
+
+	if (es->timing)
+	{
+		ExplainPropertyInteger("New Connections", NULL, summary->newConnectionCount,
+							   es);
+		ExplainPropertyFloat("Connection Time", "ms", summary->connectTime, 3, es);
+		ExplainPropertyFloat("Execution Time", "ms", summary->executionTime, 3, es);
+		ExplainPropertyFloat("Max Execution Time", "ms", summary->maxExecutionTime, 3,
+							 es);
+	}
+
+	ExplainPropertyInteger("Rows Received", NULL, summary->rowCount, es);
+	ExplainPropertyInteger("Bytes Received", "bytes", summary->byteCount, es);
+
+	ExplainCloseGroup("Worker", NULL, true, es);
+
+	if (es->format == EXPLAIN_FORMAT_TEXT)
+	{
+		es->indent -= 3;
+	}
+}
+
+
+/*
+ * CompareTaskExecutionsByTime orders task executions from the slowest to the
+ * fastest.
+ */
+static int
+CompareTaskExecutionsByTime(const void *leftElement, const void *rightElement)
+{
+	const TaskExecutionInstrumentation *left =
+		*((const TaskExecutionInstrumentation **) leftElement);
+	const TaskExecutionInstrumentation *right =
+		*((const TaskExecutionInstrumentation **) rightElement);
+
+	if (left->executionTime > right->executionTime)
+	{
+		return -1;
+	}
+	else if (left->executionTime < right->executionTime)
+	{
+		return 1;
+	}
+
+	return CompareTaskExecutionsBySize(leftElement, rightElement);
+}
+
+
+/*
+ * CompareTaskExecutionsBySize orders task executions by the amount of received
+ * data, from the largest to the smallest, and by shard for equal sizes.
+ */
+static int
+CompareTaskExecutionsBySize(const void *leftElement, const void *rightElement)
+{
+	const TaskExecutionInstrumentation *left =
+		*((const TaskExecutionInstrumentation **) leftElement);
+	const TaskExecutionInstrumentation *right =
+		*((const TaskExecutionInstrumentation **) rightElement);
+
+	if (left->byteCount != right->byteCount)
+	{
+		return left->byteCount > right->byteCount ? -1 : 1;
+	}
+
+	if (left->task->anchorShardId != right->task->anchorShardId)
+	{
+		return left->task->anchorShardId < right->task->anchorShardId ? -1 : 1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * CompareWorkerExecutionSummaries orders worker aggregates by node name and port.
+ */
+static int
+CompareWorkerExecutionSummaries(const void *leftElement, const void *rightElement)
+{
+	const WorkerExecutionSummary *left =
+		*((const WorkerExecutionSummary **) leftElement);
+	const WorkerExecutionSummary *right =
+		*((const WorkerExecutionSummary **) rightElement);
+
+	int nameCompare = strcmp(left->nodeName, right->nodeName);
+	if (nameCompare != 0)
+	{
+		return nameCompare;
+	}
+
+	return left->nodePort - right->nodePort;
+}
+
+
+/*
+ * BuildRemoteExplainQuery returns an EXPLAIN query string
+ * to run on a worker node which explicitly contains all
+ * the options in the explain state.
+ */
+static StringInfo
+BuildRemoteExplainQuery(char *queryString, ExplainState *es)
+{
+	StringInfo explainQuery = makeStringInfo();
+	const char *formatStr = ExplainFormatName(es->format);
+
 	appendStringInfo(explainQuery,
 					 "EXPLAIN (ANALYZE %s, VERBOSE %s, "
 					 "COSTS %s, BUFFERS %s, TIMING %s, SUMMARY %s, "
@@ -616,6 +1155,423 @@ BuildRemoteExplainQuery(char *queryString, ExplainState *es)
 }
 
 
+/*
+ * ExplainFormatName returns the name of the given EXPLAIN format as used in
+ * the FORMAT option.
+ */
+static const char *
+ExplainFormatName(ExplainFormat format)
+{
+	switch (format)
+	{
+		case EXPLAIN_FORMAT_XML:
+		{
+			return "XML";
+		}
+
+		case EXPLAIN_FORMAT_JSON:
+		{
+			return "JSON";
+		}
+
+		case EXPLAIN_FORMAT_YAML:
+		{
+			return "YAML";
+		}
+
+		default:
+		{
+			return "TEXT";
+		}
+	}
+}
+
+
+/*
+ * ExplainFormatFromName returns the EXPLAIN format with the given name, which
+ * is matched case-insensitively like the FORMAT option of EXPLAIN.
+ */
+static ExplainFormat
+ExplainFormatFromName(const char *formatName)
+{
+	if (pg_strcasecmp(formatName, "text") == 0)
+	{
+		return EXPLAIN_FORMAT_TEXT;
+	}
+	else if (pg_strcasecmp(formatName, "xml") == 0)
+	{
+		return EXPLAIN_FORMAT_XML;
+	}
+	else if (pg_strcasecmp(formatName, "json") == 0)
+	{
+		return EXPLAIN_FORMAT_JSON;
+	}
+	else if (pg_strcasecmp(formatName, "yaml") == 0)
+	{
+		return EXPLAIN_FORMAT_YAML;
+	}
+
+	ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					errmsg("unrecognized value for EXPLAIN option \"format\": \"%s\"",
+						   formatName)));
+}
+
+
+/*
+ * CitusExplainOneQuery is the ExplainOneQuery_hook of Citus. It keeps track
+ * of the EXPLAIN ANALYZE command that is in progress, such that the adaptive
+ * executor can fetch the EXPLAIN ANALYZE output of the tasks while executing
+ * them, and otherwise plans and explains the query like ExplainOneQuery().
+ */
+void
+CitusExplainOneQuery(Query *query, int cursorOptions, IntoClause *into,
+					 ExplainState *es, const char *queryString, ParamListInfo params,
+					 QueryEnvironment *queryEnv)
+{
+	ExplainState *savedExplainAnalyzeState = CurrentExplainAnalyzeState;
+	instr_time planStart;
+	instr_time planDuration;
+
+	INSTR_TIME_SET_CURRENT(planStart);
+
+	PlannedStmt *plan = pg_plan_query(query, cursorOptions, params);
+
+	INSTR_TIME_SET_CURRENT(planDuration);
+	INSTR_TIME_SUBTRACT(planDuration, planStart);
+
+	CurrentExplainAnalyzeState = es->analyze ? es : NULL;
+
+	PG_TRY();
+	{
+		ExplainOnePlan(plan, into, es, queryString, params, queryEnv, &planDuration);
+	}
+	PG_CATCH();
+	{
+		CurrentExplainAnalyzeState = savedExplainAnalyzeState;
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	CurrentExplainAnalyzeState = savedExplainAnalyzeState;
+}
+
+
+/*
+ * ExplainAnalyzeInProgress returns whether the current query is executed by
+ * an EXPLAIN ANALYZE command, in which case WrapQueryForExplainAnalyze can
+ * be used to fetch the EXPLAIN ANALYZE output of the tasks.
+ */
+bool
+ExplainAnalyzeInProgress(void)
+{
+	return CurrentExplainAnalyzeState != NULL;
+}
+
+
+/*
+ * WrapQueryForExplainAnalyze wraps a task query in a call to
+ * worker_execute_query_explain_analyze using the options of the EXPLAIN
+ * ANALYZE command in progress. The wrapped query returns the rows of the
+ * task query, which have the given tuple descriptor, with an additional
+ * text column that is NULL in all rows but the last one, which holds the
+ * EXPLAIN ANALYZE output of the task query.
+ */
+char *
+WrapQueryForExplainAnalyze(const char *queryString, TupleDesc tupleDescriptor)
+{
+	ExplainState *es = CurrentExplainAnalyzeState;
+	StringInfo wrappedQuery = makeStringInfo();
+	StringInfo columnDefinitionList = makeStringInfo();
+
+	Assert(es != NULL);
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+
+		appendStringInfo(columnDefinitionList, "field_%d %s, ", columnIndex,
+						 format_type_with_typemod(attribute->atttypid,
+												  attribute->atttypmod));
+	}
+
+	appendStringInfoString(columnDefinitionList, "explain_analyze_output text");
+
+	appendStringInfo(wrappedQuery,
+					 "SELECT * FROM worker_execute_query_explain_analyze(%s, "
+					 "%s, %s, %s, %s, %s, %s) AS (%s)",
+					 quote_literal_cstr(queryString),
+					 es->verbose ? "true" : "false",
+					 es->costs ? "true" : "false",
+					 es->buffers ? "true" : "false",
+					 es->timing ? "true" : "false",
+					 es->summary ? "true" : "false",
+					 quote_literal_cstr(ExplainFormatName(es->format)),
+					 columnDefinitionList->data);
+
+	return wrappedQuery->data;
+}
+
+
+/*
+ * worker_execute_query_explain_analyze executes the given query under EXPLAIN
+ * ANALYZE with the given options. It returns the rows of the query, followed
+ * by a row that only holds the EXPLAIN output in the last column, such that
+ * the coordinator gets both the results and the plan of a task from a single
+ * execution.
+ */
+Datum
+worker_execute_query_explain_analyze(PG_FUNCTION_ARGS)
+{
+	char *queryString = text_to_cstring(PG_GETARG_TEXT_P(0));
+	char *formatName = text_to_cstring(PG_GETARG_TEXT_P(6));
+	TupleDesc tupleDescriptor = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	ExplainState *es = NewExplainState();
+	es->analyze = true;
+	es->verbose = PG_GETARG_BOOL(1);
+	es->costs = PG_GETARG_BOOL(2);
+	es->buffers = PG_GETARG_BOOL(3);
+	es->timing = PG_GETARG_BOOL(4);
+	es->summary = PG_GETARG_BOOL(5);
+	es->format = ExplainFormatFromName(formatName);
+
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+	int explainOutputColumn = tupleDescriptor->natts - 1;
+
+	if (explainOutputColumn < 0 ||
+		TupleDescAttr(tupleDescriptor, explainOutputColumn)->atttypid != TEXTOID)
+	{
+		ereport(ERROR, (errmsg("last column of the result should be of type text "
+							   "to hold the EXPLAIN output")));
+	}
+
+	Query *query = ParseQueryString(queryString, NULL, 0);
+	if (query->commandType != CMD_SELECT)
+	{
+		ereport(ERROR, (errmsg("can only explain SELECT queries along with "
+							   "their results")));
+	}
+
+	DestReceiver *dest = CreateExplainAnalyzeDestReceiver(tupleStore, tupleDescriptor);
+
+	ExplainAnalyzeQuery(query, queryString, dest, es);
+
+	Datum *values = (Datum *) palloc0(tupleDescriptor->natts * sizeof(Datum));
+	bool *nulls = (bool *) palloc0(tupleDescriptor->natts * sizeof(bool));
+
+	memset(nulls, true, tupleDescriptor->natts * sizeof(bool));
+	values[explainOutputColumn] = CStringGetTextDatum(es->str->data);
+	nulls[explainOutputColumn] = false;
+
+	tuplestore_putvalues(tupleStore, tupleDescriptor, values, nulls);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupleStore);
+
+	return (Datum) 0;
+}
+
+
+/*
+ * ExplainAnalyzeQuery plans and executes the given query with instrumentation,
+ * sends its rows to the given DestReceiver and writes the EXPLAIN output to
+ * es->str. It follows ExplainOnePlan(), which discards the rows.
+ */
+static void
+ExplainAnalyzeQuery(Query *query, const char *queryString, DestReceiver *dest,
+					ExplainState *es)
+{
+	int instrumentOptions = 0;
+	instr_time planStart;
+	instr_time planDuration;
+	instr_time executionStart;
+	instr_time executionDuration;
+	instr_time cleanupStart;
+	instr_time cleanupDuration;
+
+	if (es->timing)
+	{
+		instrumentOptions |= INSTRUMENT_TIMER;
+	}
+	else
+	{
+		instrumentOptions |= INSTRUMENT_ROWS;
+	}
+
+	if (es->buffers)
+	{
+		instrumentOptions |= INSTRUMENT_BUFFERS;
+	}
+
+	INSTR_TIME_SET_CURRENT(planStart);
+
+	PlannedStmt *plan = pg_plan_query(query, CURSOR_OPT_PARALLEL_OK, NULL);
+
+	INSTR_TIME_SET_CURRENT(planDuration);
+	INSTR_TIME_SUBTRACT(planDuration, planStart);
+
+	INSTR_TIME_SET_CURRENT(executionStart);
+
+	/* create a copy of the snapshot such that the query sees earlier changes */
+	PushCopiedSnapshot(GetActiveSnapshot());
+	UpdateActiveSnapshotCommandId();
+
+	QueryDesc *queryDesc = CreateQueryDesc(plan, queryString, GetActiveSnapshot(),
+										   InvalidSnapshot, dest, NULL, NULL,
+										   instrumentOptions);
+
+	ExecutorStart(queryDesc, 0);
+	ExecutorRun(queryDesc, ForwardScanDirection, 0L, true);
+	ExecutorFinish(queryDesc);
+
+	INSTR_TIME_SET_CURRENT(executionDuration);
+	INSTR_TIME_SUBTRACT(executionDuration, executionStart);
+
+	ExplainBeginOutput(es);
+	ExplainOpenGroup("Query", NULL, true, es);
+
+	ExplainPrintPlan(es, queryDesc);
+
+	if (es->summary)
+	{
+		ExplainPropertyFloat("Planning Time", "ms",
+							 INSTR_TIME_GET_MILLISEC(planDuration), 3, es);
+	}
+
+	ExplainPrintTriggers(es, queryDesc);
+
+	INSTR_TIME_SET_CURRENT(cleanupStart);
+
+	ExecutorEnd(queryDesc);
+	FreeQueryDesc(queryDesc);
+	PopActiveSnapshot();
+
+	INSTR_TIME_SET_CURRENT(cleanupDuration);
+	INSTR_TIME_SUBTRACT(cleanupDuration, cleanupStart);
+
+	if (es->summary)
+	{
+		ExplainPropertyFloat("Execution Time", "ms",
+							 INSTR_TIME_GET_MILLISEC(executionDuration) +
+							 INSTR_TIME_GET_MILLISEC(cleanupDuration), 3, es);
+	}
+
+	ExplainCloseGroup("Query", NULL, true, es);
+	ExplainEndOutput(es);
+}
+
+
+/*
+ * CreateExplainAnalyzeDestReceiver creates a DestReceiver that stores the rows
+ * of the query in the given tuple store, which has one more column than the
+ * query to hold the EXPLAIN output.
+ */
+static DestReceiver *
+CreateExplainAnalyzeDestReceiver(Tuplestorestate *tupleStore, TupleDesc tupleDescriptor)
+{
+	ExplainAnalyzeDestReceiver *explainDest =
+		(ExplainAnalyzeDestReceiver *) palloc0(sizeof(ExplainAnalyzeDestReceiver));
+
+	explainDest->pub.receiveSlot = ExplainAnalyzeDestReceive;
+	explainDest->pub.rStartup = ExplainAnalyzeDestStartup;
+	explainDest->pub.rShutdown = ExplainAnalyzeDestShutdown;
+	explainDest->pub.rDestroy = ExplainAnalyzeDestDestroy;
+	explainDest->pub.mydest = DestTuplestore;
+
+	explainDest->tupleStore = tupleStore;
+	explainDest->tupleDescriptor = tupleDescriptor;
+	explainDest->values = (Datum *) palloc0(tupleDescriptor->natts * sizeof(Datum));
+	explainDest->nulls = (bool *) palloc0(tupleDescriptor->natts * sizeof(bool));
+
+	return (DestReceiver *) explainDest;
+}
+
+
+/*
+ * ExplainAnalyzeDestStartup checks that the rows of the query match the
+ * columns that the caller expects, apart from the EXPLAIN output column.
+ */
+static void
+ExplainAnalyzeDestStartup(DestReceiver *dest, int operation,
+						  TupleDesc inputTupleDescriptor)
+{
+	ExplainAnalyzeDestReceiver *explainDest = (ExplainAnalyzeDestReceiver *) dest;
+	TupleDesc tupleDescriptor = explainDest->tupleDescriptor;
+	int columnCount = inputTupleDescriptor->natts;
+
+	if (columnCount != tupleDescriptor->natts - 1)
+	{
+		ereport(ERROR, (errmsg("query returns %d columns, expected %d",
+							   columnCount, tupleDescriptor->natts - 1)));
+	}
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute inputAttribute =
+			TupleDescAttr(inputTupleDescriptor, columnIndex);
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+
+		if (inputAttribute->atttypid != attribute->atttypid)
+		{
+			ereport(ERROR, (errmsg("column %d of the query is of type %s, expected %s",
+								   columnIndex + 1,
+								   format_type_be(inputAttribute->atttypid),
+								   format_type_be(attribute->atttypid))));
+		}
+	}
+}
+
+
+/*
+ * ExplainAnalyzeDestReceive stores a row of the query in the tuple store.
+ */
+static bool
+ExplainAnalyzeDestReceive(TupleTableSlot *slot, DestReceiver *dest)
+{
+	ExplainAnalyzeDestReceiver *explainDest = (ExplainAnalyzeDestReceiver *) dest;
+	TupleDesc tupleDescriptor = explainDest->tupleDescriptor;
+	int columnCount = tupleDescriptor->natts - 1;
+
+	slot_getallattrs(slot);
+
+	memcpy(explainDest->values, slot->tts_values, columnCount * sizeof(Datum));
+	memcpy(explainDest->nulls, slot->tts_isnull, columnCount * sizeof(bool));
+	explainDest->nulls[columnCount] = true;
+
+	tuplestore_putvalues(explainDest->tupleStore, tupleDescriptor,
+						 explainDest->values, explainDest->nulls);
+
+	return true;
+}
+
+
+/*
+ * ExplainAnalyzeDestShutdown is called at the end of the execution, there is
+ * nothing to do since the caller owns the tuple store.
+ */
+static void
+ExplainAnalyzeDestShutdown(DestReceiver *dest)
+{
+	/* nothing to do */
+}
+
+
+/*
+ * ExplainAnalyzeDestDestroy frees the DestReceiver.
+ */
+static void
+ExplainAnalyzeDestDestroy(DestReceiver *dest)
+{
+	ExplainAnalyzeDestReceiver *explainDest = (ExplainAnalyzeDestReceiver *) dest;
+
+	pfree(explainDest->values);
+	pfree(explainDest->nulls);
+	pfree(explainDest);
+}
+
+
 /* below are private functions copied from explain.c */
 
 
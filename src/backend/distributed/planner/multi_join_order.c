@@ -19,6 +19,7 @@
 #include "access/htup_details.h"
 #include "catalog/pg_am.h"
 #include "distributed/listutils.h"
+#include "distributed/master_metadata_utility.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_join_order.h"
 #include "distributed/multi_physical_planner.h"
@@ -42,6 +43,8 @@
 /* Config variables managed via guc.c */
 bool LogMultiJoinOrder = false; /* print join order as a debugging aid */
 bool EnableSingleHashRepartitioning = false;
+bool EnableCostBasedJoinOrder = false;
+int BroadcastJoinSizeLimit = 0; /* in KB, 0 disables broadcast partition joins */
 
 /* Function pointer type definition for join rule evaluation functions */
 typedef JoinOrderNode *(*RuleEvalFunction) (JoinOrderNode *currentJoinNode,
@@ -62,6 +65,9 @@ static List * BestJoinOrder(List *candidateJoinOrders);
 static List * FewestOfJoinRuleType(List *candidateJoinOrders, JoinRuleType ruleType);
 static uint32 JoinRuleTypeCount(List *joinOrder, JoinRuleType ruleTypeToCount);
 static List * LatestLargeDataTransfer(List *candidateJoinOrders);
+static List * LeastDataTransfer(List *candidateJoinOrders);
+static uint64 JoinOrderDataTransferSize(List *joinOrder);
+static uint64 TableDataSize(TableEntry *tableEntry);
 static void PrintJoinOrderList(List *joinOrder);
 static uint32 LargeDataTransferLocation(List *joinOrder);
 static List * TableEntryListDifference(List *lhsTableList, List *rhsTableList);
@@ -84,6 +90,10 @@ static JoinOrderNode * SinglePartitionJoin(JoinOrderNode *joinNode,
 										   TableEntry *candidateTable,
 										   List *applicableJoinClauses,
 										   JoinType joinType);
+static JoinOrderNode * BroadcastPartitionJoin(JoinOrderNode *joinNode,
+											  TableEntry *candidateTable,
+											  List *applicableJoinClauses,
+											  JoinType joinType);
 static JoinOrderNode * DualPartitionJoin(JoinOrderNode *joinNode,
 										 TableEntry *candidateTable,
 										 List *applicableJoinClauses,
@@ -427,7 +437,19 @@ BestJoinOrder(List *candidateJoinOrders)
 	}
 
 	/*
-	 * If there is a tie, we pick candidate join orders where large data
+	 * If there is a tie, we pick candidate join orders that are estimated to
+	 * transfer the fewest bytes, based on the shard statistics in the metadata.
+	 * This way, we repartition the small dimension table of a star schema rather
+	 * than the fact table. When no statistics are available, all candidates
+	 * tie and the next heuristic decides.
+	 */
+	if (EnableCostBasedJoinOrder)
+	{
+		candidateJoinOrders = LeastDataTransfer(candidateJoinOrders);
+	}
+
+	/*
+	 * If there still is a tie, we pick candidate join orders where large data
 	 * transfers happen at later stages of query execution. This results in more
 	 * data being filtered via joins, selections, and projections earlier on.
 	 */
@@ -556,6 +578,7 @@ LargeDataTransferLocation(List *joinOrder)
 		/* we consider the following join rules to cause large data transfers */
 		if (joinRuleType == SINGLE_HASH_PARTITION_JOIN ||
 			joinRuleType == SINGLE_RANGE_PARTITION_JOIN ||
+			joinRuleType == BROADCAST_PARTITION_JOIN ||
 			joinRuleType == DUAL_PARTITION_JOIN ||
 			joinRuleType == CARTESIAN_PRODUCT)
 		{
@@ -569,6 +592,120 @@ LargeDataTransferLocation(List *joinOrder)
 }
 
 
+/*
+ * LeastDataTransfer finds and returns the join orders that are estimated to
+ * transfer the fewest bytes across the network.
+ */
+static List *
+LeastDataTransfer(List *candidateJoinOrders)
+{
+	List *leastJoinOrders = NIL;
+	uint64 leastTransferSize = PG_UINT64_MAX;
+	ListCell *joinOrderCell = NULL;
+
+	foreach(joinOrderCell, candidateJoinOrders)
+	{
+		List *joinOrder = (List *) lfirst(joinOrderCell);
+		uint64 transferSize = JoinOrderDataTransferSize(joinOrder);
+
+		if (transferSize == leastTransferSize)
+		{
+			leastJoinOrders = lappend(leastJoinOrders, joinOrder);
+		}
+		else if (transferSize < leastTransferSize)
+		{
+			leastJoinOrders = list_make1(joinOrder);
+			leastTransferSize = transferSize;
+		}
+	}
+
+	return leastJoinOrders;
+}
+
+
+/*
+ * JoinOrderDataTransferSize estimates the number of bytes the given join order
+ * moves across the network. Single partition joins move the side that is not
+ * the anchor table, broadcast partition joins move the new table once for each
+ * shard of the anchor table, dual partition joins and cartesian products move
+ * both. As we have no estimates for join results, we use the total size of the
+ * tables joined so far as the size of the left-hand side.
+ */
+static uint64
+JoinOrderDataTransferSize(List *joinOrder)
+{
+	uint64 transferSize = 0;
+	uint64 joinedTableSize = 0;
+	ListCell *joinOrderNodeCell = NULL;
+
+	foreach(joinOrderNodeCell, joinOrder)
+	{
+		JoinOrderNode *joinOrderNode = (JoinOrderNode *) lfirst(joinOrderNodeCell);
+		JoinRuleType joinRuleType = joinOrderNode->joinRuleType;
+		uint64 tableSize = TableDataSize(joinOrderNode->tableEntry);
+
+		if (joinRuleType == SINGLE_HASH_PARTITION_JOIN ||
+			joinRuleType == SINGLE_RANGE_PARTITION_JOIN)
+		{
+			/* if the new table is the anchor, we repartition the joined tables */
+			if (joinOrderNode->anchorTable == joinOrderNode->tableEntry)
+			{
+				transferSize += joinedTableSize;
+			}
+			else
+			{
+				transferSize += tableSize;
+			}
+		}
+		else if (joinRuleType == BROADCAST_PARTITION_JOIN)
+		{
+			Oid anchorRelationId = joinOrderNode->anchorTable->relationId;
+			DistTableCacheEntry *anchorCacheEntry =
+				DistributedTableCacheEntry(anchorRelationId);
+
+			transferSize += tableSize * anchorCacheEntry->shardIntervalArrayLength;
+		}
+		else if (joinRuleType == DUAL_PARTITION_JOIN ||
+				 joinRuleType == CARTESIAN_PRODUCT)
+		{
+			transferSize += joinedTableSize + tableSize;
+		}
+
+		joinedTableSize += tableSize;
+	}
+
+	return transferSize;
+}
+
+
+/*
+ * TableDataSize sums up the shard lengths recorded in pg_dist_placement for the
+ * given table. These lengths are only kept up to date for append distributed
+ * tables, and are zero otherwise.
+ */
+static uint64
+TableDataSize(TableEntry *tableEntry)
+{
+	uint64 tableSize = 0;
+	ListCell *shardIntervalCell = NULL;
+
+	List *shardIntervalList = LoadShardIntervalList(tableEntry->relationId);
+	foreach(shardIntervalCell, shardIntervalList)
+	{
+		ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
+		List *placementList = FinalizedShardPlacementList(shardInterval->shardId);
+
+		if (placementList != NIL)
+		{
+			ShardPlacement *placement = (ShardPlacement *) linitial(placementList);
+			tableSize += placement->shardLength;
+		}
+	}
+
+	return tableSize;
+}
+
+
 /* Prints the join order list and join rules for debugging purposes. */
 static void
 PrintJoinOrderList(List *joinOrder)
@@ -731,6 +868,7 @@ JoinRuleEvalFunction(JoinRuleType ruleType)
 		RuleEvalFunctionArray[LOCAL_PARTITION_JOIN] = &LocalJoin;
 		RuleEvalFunctionArray[SINGLE_RANGE_PARTITION_JOIN] = &SinglePartitionJoin;
 		RuleEvalFunctionArray[SINGLE_HASH_PARTITION_JOIN] = &SinglePartitionJoin;
+		RuleEvalFunctionArray[BROADCAST_PARTITION_JOIN] = &BroadcastPartitionJoin;
 		RuleEvalFunctionArray[DUAL_PARTITION_JOIN] = &DualPartitionJoin;
 		RuleEvalFunctionArray[CARTESIAN_PRODUCT] = &CartesianProduct;
 
@@ -759,6 +897,7 @@ JoinRuleName(JoinRuleType ruleType)
 			strdup("single hash partition join");
 		RuleNameArray[SINGLE_RANGE_PARTITION_JOIN] =
 			strdup("single range partition join");
+		RuleNameArray[BROADCAST_PARTITION_JOIN] = strdup("broadcast partition join");
 		RuleNameArray[DUAL_PARTITION_JOIN] = strdup("dual partition join");
 		RuleNameArray[CARTESIAN_PRODUCT] = strdup("cartesian product");
 
@@ -1047,6 +1186,82 @@ SinglePartitionJoinClause(Var *partitionColumn, List *applicableJoinClauses)
 }
 
 
+/*
+ * BroadcastPartitionJoin evaluates if the candidate table is small enough to be
+ * copied in full next to each shard of the anchor table, as determined by the
+ * shard sizes in the metadata and citus.broadcast_join_size_limit. If so, the
+ * workers send the candidate table's rows to the merge tasks of all anchor
+ * shards, and the join keeps the current partition column and anchor table;
+ * unlike a dual partition join, the anchor table does not move. Otherwise, the
+ * function returns null.
+ */
+static JoinOrderNode *
+BroadcastPartitionJoin(JoinOrderNode *currentJoinNode, TableEntry *candidateTable,
+					   List *applicableJoinClauses, JoinType joinType)
+{
+	TableEntry *currentAnchorTable = currentJoinNode->anchorTable;
+	JoinRuleType currentJoinRuleType = currentJoinNode->joinRuleType;
+	uint64 sizeLimit = (uint64) BroadcastJoinSizeLimit * 1024L;
+
+	if (BroadcastJoinSizeLimit == 0)
+	{
+		return NULL;
+	}
+
+	/* the candidate's rows are seen once per anchor shard, so only inner joins */
+	if (IS_OUTER_JOIN(joinType))
+	{
+		return NULL;
+	}
+
+	/* without an anchor table, we do not know where to send the rows */
+	if (currentAnchorTable == NULL || currentJoinNode->partitionColumn == NULL ||
+		currentJoinRuleType == DUAL_PARTITION_JOIN ||
+		currentJoinRuleType == CARTESIAN_PRODUCT)
+	{
+		return NULL;
+	}
+
+	/* reference tables already exist on all nodes */
+	if (PartitionMethod(candidateTable->relationId) == DISTRIBUTE_BY_NONE)
+	{
+		return NULL;
+	}
+
+	if (DualPartitionJoinClause(applicableJoinClauses) == NULL)
+	{
+		return NULL;
+	}
+
+	/*
+	 * Each merge task is joined only with the anchor shards whose intervals
+	 * overlap its own, which needs to be exactly one shard for the rows not to
+	 * be repeated in the result.
+	 */
+	DistTableCacheEntry *anchorCacheEntry =
+		DistributedTableCacheEntry(currentAnchorTable->relationId);
+	if (anchorCacheEntry->partitionMethod == DISTRIBUTE_BY_NONE ||
+		anchorCacheEntry->shardIntervalArrayLength == 0 ||
+		anchorCacheEntry->hasUninitializedShardInterval ||
+		anchorCacheEntry->hasOverlappingShardInterval)
+	{
+		return NULL;
+	}
+
+	/* a size of zero means that we have no statistics for the table */
+	uint64 candidateTableSize = TableDataSize(candidateTable);
+	if (candidateTableSize == 0 || candidateTableSize > sizeLimit)
+	{
+		return NULL;
+	}
+
+	return MakeJoinOrderNode(candidateTable, BROADCAST_PARTITION_JOIN,
+							 currentJoinNode->partitionColumn,
+							 currentJoinNode->partitionMethod,
+							 currentAnchorTable);
+}
+
+
 /*
  * DualPartitionJoin evaluates if a join clause exists between "tables in the
  * join order" and the candidate table. If such a clause exists, both tables can
@@ -34,6 +34,7 @@
 #include "distributed/multi_logical_planner.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/pg_dist_partition.h"
+#include "distributed/tdigest_extension.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/version_compat.h"
 #include "nodes/makefuncs.h"
@@ -50,6 +51,7 @@
 #include "parser/parse_coerce.h"
 #include "parser/parse_oper.h"
 #include "parser/parsetree.h"
+#include "utils/builtins.h"
 #include "utils/fmgroids.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
@@ -59,6 +61,10 @@
 /* Config variable managed via guc.c */
 int LimitClauseRowFetchCount = -1; /* number of rows to fetch from each task */
 double CountDistinctErrorRate = 0.0; /* precision of count(distinct) approximate */
+bool CountDistinctSparseSketches = false; /* send compact partial hll sketches */
+bool EnableGroupPushdown = false;    /* compute disjoint groups on the workers */
+bool EnablePartialArrayAggregates = false; /* merge ordered partial arrays */
+int PercentileApproximationCompression = 0; /* tdigest compression for percentile_cont */
 
 
 typedef struct MasterAggregateWalkerContext
@@ -190,6 +196,8 @@ static void ApplyExtendedOpNodes(MultiExtendedOp *originalNode,
 								 MultiExtendedOp *masterNode,
 								 MultiExtendedOp *workerNode);
 static void TransformSubqueryNode(MultiTable *subqueryNode);
+static void TransformWindowSubqueryNode(MultiTable *subqueryNode);
+static Node * MasterWindowColumnMutator(Node *originalNode, List *workerColumnList);
 static MultiExtendedOp * MasterExtendedOpNode(MultiExtendedOp *originalOpNode,
 											  ExtendedOpNodeProperties *
 											  extendedOpNodeProperties);
@@ -199,6 +207,8 @@ static Expr * MasterAggregateExpression(Aggref *originalAggregate,
 										MasterAggregateWalkerContext *walkerContext);
 static Expr * MasterAverageExpression(Oid sumAggregateType, Oid countAggregateType,
 									  AttrNumber *columnId);
+static Expr * MasterSortedArrayMergeExpression(Aggref *originalAggregate,
+											   AttrNumber *columnId);
 static Expr * AddTypeConversion(Node *originalAggregate, Node *newExpression);
 static MultiExtendedOp * WorkerExtendedOpNode(MultiExtendedOp *originalOpNode,
 											  ExtendedOpNodeProperties *
@@ -250,12 +260,19 @@ static bool WorkerAggregateWalker(Node *node,
 								  WorkerAggregateWalkerContext *walkerContext);
 static List * WorkerAggregateExpressionList(Aggref *originalAggregate,
 											WorkerAggregateWalkerContext *walkerContextry);
+static List * WorkerSortedArrayAggregates(Aggref *originalAggregate,
+										  bool skipNullValues);
 static AggregateType GetAggregateType(Aggref *aggregatExpression);
 static Oid AggregateArgumentType(Aggref *aggregate);
 static bool AggregateEnabledCustom(Aggref *aggregateExpression);
+static AggregateType TDigestAggregateType(Aggref *aggregateExpression);
+static bool PercentileContApproximationEnabled(Aggref *aggregateExpression);
+static bool IsTDigestPercentileAggregate(AggregateType aggregateType);
+static Expr * TDigestMasterArgument(Aggref *aggregate, AggregateType aggregateType);
 static Oid CitusFunctionOidWithSignature(char *functionName, int numargs, Oid *argtypes);
 static Oid WorkerPartialAggOid(void);
 static Oid CoordCombineAggOid(void);
+static Oid CoordMergeSortedAggOid(void);
 static Oid AggregateFunctionOid(const char *functionName, Oid inputType);
 static Oid TypeOid(Oid schemaId, const char *typeName);
 static SortGroupClause * CreateSortGroupClause(Var *column);
@@ -269,6 +286,11 @@ static Const * MakeIntegerConstInt64(int64 integerValue);
 /* Local functions forward declarations for aggregate expression checks */
 static void ErrorIfContainsUnsupportedAggregate(MultiNode *logicalPlanNode);
 static void ErrorIfUnsupportedArrayAggregate(Aggref *arrayAggregateExpression);
+static void ErrorIfUnsupportedStringAggregate(Aggref *stringAggregateExpression);
+static void ErrorIfUnsupportedOrderedAggregate(Aggref *aggregateExpression,
+											   const char *aggregateName);
+static void ErrorIfUnsupportedTDigestAggregate(Aggref *aggregateExpression,
+											   AggregateType aggregateType);
 static void ErrorIfUnsupportedJsonAggregate(AggregateType type,
 											Aggref *aggregateExpression);
 static void ErrorIfUnsupportedAggregateDistinct(Aggref *aggregateExpression,
@@ -1285,6 +1307,12 @@ TransformSubqueryNode(MultiTable *subqueryNode)
 	MultiNode *collectNode = ChildNode((MultiUnaryNode *) extendedOpNode);
 	MultiNode *collectChildNode = ChildNode((MultiUnaryNode *) collectNode);
 
+	if (extendedOpNode->hasWindowFuncs)
+	{
+		TransformWindowSubqueryNode(subqueryNode);
+		return;
+	}
+
 	ExtendedOpNodeProperties extendedOpNodeProperties =
 		BuildExtendedOpNodeProperties(extendedOpNode);
 	MultiExtendedOp *masterExtendedOpNode =
@@ -1342,6 +1370,156 @@ TransformSubqueryNode(MultiTable *subqueryNode)
 }
 
 
+/*
+ * TransformWindowSubqueryNode splits the extended operator node of a subquery
+ * with window functions that are not partitioned by the distribution column.
+ * The worker operator node returns each column that the target list refers to,
+ * and we repartition these rows by a column that all PARTITION BY clauses
+ * contain. The master operator node then evaluates the window functions over
+ * the repartitioned rows, where each merge task sees whole window partitions.
+ */
+static void
+TransformWindowSubqueryNode(MultiTable *subqueryNode)
+{
+	MultiExtendedOp *extendedOpNode =
+		(MultiExtendedOp *) ChildNode((MultiUnaryNode *) subqueryNode);
+	MultiNode *collectNode = ChildNode((MultiUnaryNode *) extendedOpNode);
+	MultiNode *collectChildNode = ChildNode((MultiUnaryNode *) collectNode);
+	List *targetEntryList = extendedOpNode->targetList;
+	List *workerColumnList = NIL;
+	List *workerTargetEntryList = NIL;
+	List *masterTargetEntryList = NIL;
+	ListCell *columnCell = NULL;
+	ListCell *targetEntryCell = NULL;
+	AttrNumber workerColumnId = 1;
+	AttrNumber partitionColumnId = InvalidAttrNumber;
+
+	Var *repartitionColumn = WindowRepartitionColumn(extendedOpNode->windowClause,
+													 targetEntryList);
+	if (repartitionColumn == NULL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot run this subquery"),
+						errdetail("Window functions in subqueries should be "
+								  "partitioned by a column of the relation")));
+	}
+
+	/* the workers return each referenced column once */
+	List *columnList = pull_var_clause_default((Node *) targetEntryList);
+	foreach(columnCell, columnList)
+	{
+		Var *column = (Var *) lfirst(columnCell);
+		StringInfo columnNameString = makeStringInfo();
+
+		if (list_member(workerColumnList, column))
+		{
+			continue;
+		}
+
+		if (equal(column, repartitionColumn))
+		{
+			partitionColumnId = workerColumnId;
+		}
+
+		appendStringInfo(columnNameString, WORKER_COLUMN_FORMAT, workerColumnId);
+
+		TargetEntry *workerTargetEntry = makeTargetEntry((Expr *) copyObject(column),
+														 workerColumnId,
+														 columnNameString->data,
+														 false);
+
+		workerColumnList = lappend(workerColumnList, column);
+		workerTargetEntryList = lappend(workerTargetEntryList, workerTargetEntry);
+		workerColumnId++;
+	}
+
+	Assert(partitionColumnId != InvalidAttrNumber);
+
+	/* the master evaluates the original target list over the worker columns */
+	foreach(targetEntryCell, targetEntryList)
+	{
+		TargetEntry *originalTargetEntry = (TargetEntry *) lfirst(targetEntryCell);
+		TargetEntry *masterTargetEntry = flatCopyTargetEntry(originalTargetEntry);
+
+		masterTargetEntry->expr =
+			(Expr *) MasterWindowColumnMutator((Node *) originalTargetEntry->expr,
+											   workerColumnList);
+
+		masterTargetEntryList = lappend(masterTargetEntryList, masterTargetEntry);
+	}
+
+	MultiExtendedOp *workerExtendedOpNode = CitusMakeNode(MultiExtendedOp);
+	workerExtendedOpNode->targetList = workerTargetEntryList;
+
+	MultiExtendedOp *masterExtendedOpNode = CitusMakeNode(MultiExtendedOp);
+	masterExtendedOpNode->targetList = masterTargetEntryList;
+	masterExtendedOpNode->windowClause = extendedOpNode->windowClause;
+	masterExtendedOpNode->hasWindowFuncs = true;
+
+	/*
+	 * Similar to partitioning by a function expression, the partition column
+	 * only needs to carry the type and the position of the worker column.
+	 */
+	Index tableId = 0;
+	Index columnLevelSup = 0;
+	Var *partitionColumn = makeVar(tableId, partitionColumnId,
+								   repartitionColumn->vartype,
+								   repartitionColumn->vartypmod,
+								   repartitionColumn->varcollid, columnLevelSup);
+
+	MultiPartition *partitionNode = CitusMakeNode(MultiPartition);
+	partitionNode->partitionColumn = partitionColumn;
+
+	SetChild((MultiUnaryNode *) subqueryNode, (MultiNode *) masterExtendedOpNode);
+	SetChild((MultiUnaryNode *) masterExtendedOpNode, (MultiNode *) partitionNode);
+	SetChild((MultiUnaryNode *) partitionNode, (MultiNode *) collectNode);
+	SetChild((MultiUnaryNode *) collectNode, (MultiNode *) workerExtendedOpNode);
+	SetChild((MultiUnaryNode *) workerExtendedOpNode, (MultiNode *) collectChildNode);
+}
+
+
+/*
+ * MasterWindowColumnMutator replaces the columns in the given expression with
+ * references to the matching columns that the worker operator node returns.
+ */
+static Node *
+MasterWindowColumnMutator(Node *originalNode, List *workerColumnList)
+{
+	if (originalNode == NULL)
+	{
+		return NULL;
+	}
+
+	if (IsA(originalNode, Var))
+	{
+		const uint32 masterTableId = 1; /* one table on the master node */
+		Var *newColumn = copyObject((Var *) originalNode);
+		AttrNumber columnId = 1;
+		ListCell *workerColumnCell = NULL;
+
+		foreach(workerColumnCell, workerColumnList)
+		{
+			if (equal(lfirst(workerColumnCell), originalNode))
+			{
+				break;
+			}
+
+			columnId++;
+		}
+
+		Assert(columnId <= list_length(workerColumnList));
+
+		newColumn->varno = masterTableId;
+		newColumn->varattno = columnId;
+
+		return (Node *) newColumn;
+	}
+
+	return expression_tree_mutator(originalNode, MasterWindowColumnMutator,
+								   (void *) workerColumnList);
+}
+
+
 /*
  * MasterExtendedOpNode creates the master extended operator node from the given
  * target entries. The function walks over these target entries; and for entries
@@ -1351,12 +1529,15 @@ TransformSubqueryNode(MultiTable *subqueryNode)
  * Note that the function logically depends on the worker extended operator node
  * function. If the target entry does not contain aggregate functions, we assume
  * all work is done on the worker side, and create a column that references the
- * worker nodes' results.
+ * worker nodes' results. The same holds for all target entries when the workers
+ * compute the groups and apply the having clause, in which case the master node
+ * does not group the results either.
  */
 static MultiExtendedOp *
 MasterExtendedOpNode(MultiExtendedOp *originalOpNode,
 					 ExtendedOpNodeProperties *extendedOpNodeProperties)
 {
+	bool pushDownGroupAndHaving = extendedOpNodeProperties->pushDownGroupAndHaving;
 	List *targetEntryList = originalOpNode->targetList;
 	List *newTargetEntryList = NIL;
 	ListCell *targetEntryCell = NULL;
@@ -1383,7 +1564,7 @@ MasterExtendedOpNode(MultiExtendedOp *originalOpNode,
 		 * if the aggregate belongs to a window function, it is not mutated, but pushed
 		 * down to worker as it is. Master query should treat that as a Var.
 		 */
-		if (hasAggregates && !hasWindowFunction)
+		if (hasAggregates && !hasWindowFunction && !pushDownGroupAndHaving)
 		{
 			Node *newNode = MasterAggregateMutator((Node *) originalExpression,
 												   walkerContext);
@@ -1414,14 +1595,15 @@ MasterExtendedOpNode(MultiExtendedOp *originalOpNode,
 		newTargetEntryList = lappend(newTargetEntryList, newTargetEntry);
 	}
 
-	if (originalHavingQual != NULL)
+	if (originalHavingQual != NULL && !pushDownGroupAndHaving)
 	{
 		newHavingQual = MasterAggregateMutator(originalHavingQual, walkerContext);
 	}
 
 	MultiExtendedOp *masterExtendedOpNode = CitusMakeNode(MultiExtendedOp);
 	masterExtendedOpNode->targetList = newTargetEntryList;
-	masterExtendedOpNode->groupClauseList = originalOpNode->groupClauseList;
+	masterExtendedOpNode->groupClauseList =
+		pushDownGroupAndHaving ? NIL : originalOpNode->groupClauseList;
 	masterExtendedOpNode->sortClauseList = originalOpNode->sortClauseList;
 	masterExtendedOpNode->distinctClause = originalOpNode->distinctClause;
 	masterExtendedOpNode->hasDistinctOn = originalOpNode->hasDistinctOn;
@@ -1679,6 +1861,58 @@ MasterAggregateExpression(Aggref *originalAggregate,
 
 		newMasterExpression = (Expr *) coalesceExpr;
 	}
+	else if ((aggregateType == AGGREGATE_ARRAY_AGG ||
+			  aggregateType == AGGREGATE_STRING_AGG) && originalAggregate->aggorder)
+	{
+		/*
+		 * Ordered array_agg() and string_agg() are computed on the workers as
+		 * sorted arrays of values and of their sort keys. We merge these arrays
+		 * by their keys on the master, and turn the result into a string for
+		 * string_agg(). Workers already left out NULL values of string_agg(),
+		 * so array_to_string() returns NULL exactly when string_agg() does.
+		 */
+		newMasterExpression =
+			MasterSortedArrayMergeExpression(originalAggregate, &walkerContext->columnId);
+
+		if (aggregateType == AGGREGATE_STRING_AGG)
+		{
+			TargetEntry *delimiterArgument = lsecond(originalAggregate->args);
+			Oid collationId = exprCollation((Node *) originalAggregate);
+			List *arrayToStringArgs = list_make2(newMasterExpression,
+												 copyObject(delimiterArgument->expr));
+
+			newMasterExpression = (Expr *) makeFuncExpr(F_ARRAY_TO_TEXT, TEXTOID,
+														 arrayToStringArgs, collationId,
+														 collationId,
+														 COERCE_EXPLICIT_CALL);
+		}
+	}
+	else if (aggregateType == AGGREGATE_STRING_AGG)
+	{
+		/*
+		 * string_agg() without an order is computed on the workers, and the
+		 * partial strings are concatenated with string_agg() using the same
+		 * constant delimiter on the master.
+		 */
+		Oid workerReturnType = exprType((Node *) originalAggregate);
+		int32 workerReturnTypeMod = exprTypmod((Node *) originalAggregate);
+		Oid workerCollationId = exprCollation((Node *) originalAggregate);
+		TargetEntry *delimiterArgument = lsecond(originalAggregate->args);
+
+		Var *column = makeVar(masterTableId, walkerContext->columnId, workerReturnType,
+							  workerReturnTypeMod, workerCollationId, columnLevelsUp);
+		walkerContext->columnId++;
+
+		Aggref *newMasterAggregate = copyObject(originalAggregate);
+		newMasterAggregate->aggdistinct = NIL;
+		newMasterAggregate->aggfilter = NULL;
+		newMasterAggregate->args =
+			list_make2(makeTargetEntry((Expr *) column, 1, NULL, false),
+					   makeTargetEntry(copyObject(delimiterArgument->expr), 2, NULL,
+									   false));
+
+		newMasterExpression = (Expr *) newMasterAggregate;
+	}
 	else if (aggregateType == AGGREGATE_ARRAY_AGG ||
 			 aggregateType == AGGREGATE_JSONB_AGG ||
 			 aggregateType == AGGREGATE_JSONB_OBJECT_AGG ||
@@ -1819,6 +2053,91 @@ MasterAggregateExpression(Aggref *originalAggregate,
 
 		newMasterExpression = (Expr *) unionAggregate;
 	}
+	else if (aggregateType == AGGREGATE_TDIGEST_COMBINE ||
+			 aggregateType == AGGREGATE_TDIGEST_ADD_DOUBLE)
+	{
+		/*
+		 * Workers run the original aggregate and return tdigest sketches of
+		 * their shards, which we merge on the master using tdigest(tdigest).
+		 */
+		Oid tdigestType = TDigestExtensionTypeOid();
+		Oid unionFunctionId = TDigestExtensionAggTDigest1();
+
+		Var *tdigestColumn = makeVar(masterTableId, walkerContext->columnId,
+									 tdigestType, -1, InvalidOid, columnLevelsUp);
+		walkerContext->columnId++;
+
+		TargetEntry *tdigestTargetEntry = makeTargetEntry((Expr *) tdigestColumn,
+														  argumentId, NULL, false);
+
+		Aggref *unionAggregate = makeNode(Aggref);
+		unionAggregate->aggfnoid = unionFunctionId;
+		unionAggregate->aggtype = tdigestType;
+		unionAggregate->args = list_make1(tdigestTargetEntry);
+		unionAggregate->aggkind = AGGKIND_NORMAL;
+		unionAggregate->aggfilter = NULL;
+		unionAggregate->aggtranstype = InvalidOid;
+		unionAggregate->aggargtypes = list_make1_oid(tdigestType);
+		unionAggregate->aggsplit = AGGSPLIT_SIMPLE;
+
+		newMasterExpression = (Expr *) unionAggregate;
+	}
+	else if (IsTDigestPercentileAggregate(aggregateType))
+	{
+		/*
+		 * Workers return a tdigest sketch per group, and we compute the
+		 * requested percentiles (or ranks, for tdigest_percentile_of) over the
+		 * merged sketches using the two-argument tdigest aggregates.
+		 */
+		const AttrNumber secondArgumentId = 2;
+		Oid tdigestType = TDigestExtensionTypeOid();
+		Oid percentileFunctionId = InvalidOid;
+
+		Expr *masterArgument =
+			copyObject(TDigestMasterArgument(originalAggregate, aggregateType));
+		Oid masterArgumentType = exprType((Node *) masterArgument);
+		bool masterArgumentIsArray = (masterArgumentType == FLOAT8ARRAYOID);
+
+		if (aggregateType == AGGREGATE_TDIGEST_PERCENTILE_OF_ADD_DOUBLE ||
+			aggregateType == AGGREGATE_TDIGEST_PERCENTILE_OF_ADD_DOUBLEARRAY ||
+			aggregateType == AGGREGATE_TDIGEST_PERCENTILE_OF_TDIGEST_DOUBLE ||
+			aggregateType == AGGREGATE_TDIGEST_PERCENTILE_OF_TDIGEST_DOUBLEARRAY)
+		{
+			percentileFunctionId = masterArgumentIsArray ?
+								   TDigestExtensionAggTDigestPercentileOf2a() :
+								   TDigestExtensionAggTDigestPercentileOf2();
+		}
+		else
+		{
+			percentileFunctionId = masterArgumentIsArray ?
+								   TDigestExtensionAggTDigestPercentile2a() :
+								   TDigestExtensionAggTDigestPercentile2();
+		}
+
+		Var *tdigestColumn = makeVar(masterTableId, walkerContext->columnId,
+									 tdigestType, -1, InvalidOid, columnLevelsUp);
+		walkerContext->columnId++;
+
+		TargetEntry *tdigestTargetEntry = makeTargetEntry((Expr *) tdigestColumn,
+														  argumentId, NULL, false);
+		TargetEntry *masterArgumentTargetEntry = makeTargetEntry(masterArgument,
+																 secondArgumentId,
+																 NULL, false);
+
+		Aggref *percentileAggregate = makeNode(Aggref);
+		percentileAggregate->aggfnoid = percentileFunctionId;
+		percentileAggregate->aggtype = get_func_rettype(percentileFunctionId);
+		percentileAggregate->args = list_make2(tdigestTargetEntry,
+											   masterArgumentTargetEntry);
+		percentileAggregate->aggkind = AGGKIND_NORMAL;
+		percentileAggregate->aggfilter = NULL;
+		percentileAggregate->aggtranstype = InvalidOid;
+		percentileAggregate->aggargtypes = list_make2_oid(tdigestType,
+														  masterArgumentType);
+		percentileAggregate->aggsplit = AGGSPLIT_SIMPLE;
+
+		newMasterExpression = (Expr *) percentileAggregate;
+	}
 	else if (aggregateType == AGGREGATE_CUSTOM)
 	{
 		HeapTuple aggTuple =
@@ -2011,6 +2330,67 @@ MasterAverageExpression(Oid sumAggregateType, Oid countAggregateType,
 }
 
 
+/*
+ * MasterSortedArrayMergeExpression creates a coord_merge_sorted_agg() aggregate
+ * over the two worker columns that WorkerSortedArrayAggregates creates for an
+ * ordered array_agg() or string_agg(). The aggregate merges the sorted partial
+ * arrays of values of all workers by their sort keys, using the sort operator
+ * and NULLS FIRST setting of the original aggregate's ORDER BY.
+ */
+static Expr *
+MasterSortedArrayMergeExpression(Aggref *originalAggregate, AttrNumber *columnId)
+{
+	const uint32 masterTableId = 1;
+	const int32 defaultTypeMod = -1;
+	const Index defaultLevelsUp = 0;
+
+	SortGroupClause *sortClause = linitial(originalAggregate->aggorder);
+	TargetEntry *valueArgument = linitial(originalAggregate->args);
+	TargetEntry *sortArgument = get_sortgroupclause_tle(sortClause,
+														originalAggregate->args);
+
+	Oid valueArrayType = get_array_type(exprType((Node *) valueArgument->expr));
+	Oid keyArrayType = get_array_type(exprType((Node *) sortArgument->expr));
+	Oid valueArrayCollationId = get_typcollation(valueArrayType);
+	Oid keyArrayCollationId = get_typcollation(keyArrayType);
+
+	Var *valueColumn = makeVar(masterTableId, (*columnId), valueArrayType,
+							   defaultTypeMod, valueArrayCollationId, defaultLevelsUp);
+	(*columnId)++;
+
+	Var *keyColumn = makeVar(masterTableId, (*columnId), keyArrayType,
+							 defaultTypeMod, keyArrayCollationId, defaultLevelsUp);
+	(*columnId)++;
+
+	Const *sortOperatorConst = makeConst(OIDOID, -1, InvalidOid, sizeof(Oid),
+										 ObjectIdGetDatum(sortClause->sortop),
+										 false, true);
+	Node *nullsFirstConst = makeBoolConst(sortClause->nulls_first, false);
+
+	List *mergeArguments =
+		list_make4(makeTargetEntry((Expr *) valueColumn, 1, NULL, false),
+				   makeTargetEntry((Expr *) keyColumn, 2, NULL, false),
+				   makeTargetEntry((Expr *) sortOperatorConst, 3, NULL, false),
+				   makeTargetEntry((Expr *) nullsFirstConst, 4, NULL, false));
+
+	/* keys are compared using the collation of the original sort expression */
+	Aggref *mergeAggregate = makeNode(Aggref);
+	mergeAggregate->aggfnoid = CoordMergeSortedAggOid();
+	mergeAggregate->aggtype = valueArrayType;
+	mergeAggregate->aggcollid = valueArrayCollationId;
+	mergeAggregate->inputcollid = exprCollation((Node *) sortArgument->expr);
+	mergeAggregate->args = mergeArguments;
+	mergeAggregate->aggkind = AGGKIND_NORMAL;
+	mergeAggregate->aggtranstype = INTERNALOID;
+	mergeAggregate->aggargtypes = list_make4_oid(valueArrayType, keyArrayType,
+												 OIDOID, BOOLOID);
+	mergeAggregate->aggsplit = AGGSPLIT_SIMPLE;
+	mergeAggregate->location = -1;
+
+	return (Expr *) mergeAggregate;
+}
+
+
 /*
  * AddTypeConversion checks if the given expressions generate the same types. If
  * they don't, the function adds a type conversion function on top of the new
@@ -2136,12 +2516,28 @@ WorkerExtendedOpNode(MultiExtendedOp *originalOpNode,
 									   originalSortClauseList,
 									   originalTargetEntryList);
 
-		ProcessLimitOrderByForWorkerQuery(limitOrderByReference, originalLimitCount,
-										  originalLimitOffset, originalSortClauseList,
-										  originalGroupClauseList,
-										  originalTargetEntryList,
-										  &queryOrderByLimit,
-										  &queryTargetList);
+		if (extendedOpNodeProperties->pushDownGroupAndHaving)
+		{
+			/*
+			 * The worker target list has the original target entries, so the
+			 * sort clauses can refer to them as they are.
+			 */
+			queryOrderByLimit.workerLimitCount =
+				WorkerLimitCount(originalLimitCount, originalLimitOffset,
+								 limitOrderByReference);
+			queryOrderByLimit.workerSortClauseList =
+				WorkerSortClauseList(originalLimitCount, originalGroupClauseList,
+									 originalSortClauseList, limitOrderByReference);
+		}
+		else
+		{
+			ProcessLimitOrderByForWorkerQuery(limitOrderByReference, originalLimitCount,
+											  originalLimitOffset, originalSortClauseList,
+											  originalGroupClauseList,
+											  originalTargetEntryList,
+											  &queryOrderByLimit,
+											  &queryTargetList);
+		}
 	}
 
 	/* finally, fill the extended op node with the data we gathered */
@@ -2177,6 +2573,10 @@ WorkerExtendedOpNode(MultiExtendedOp *originalOpNode,
  * functions as-is. As we implement pull-to-master window functions, we should
  * revisit here as well.
  *
+ * When the workers compute the groups and apply the having clause, the target
+ * entries are sent as they are, since the aggregates are not combined on the
+ * coordinator.
+ *
  * The function also handles count distinct operator if it is used in repartition
  * subqueries or on non-partition columns (e.g., cannot be pushed down). Each
  * column in count distinct aggregate is added to target list, and group by
@@ -2215,9 +2615,11 @@ ProcessTargetListForWorkerQuery(List *targetEntryList,
 		/*
 		 * If the expression uses aggregates inside window function contain agg
 		 * clause still returns true. We want to make sure it is not a part of
-		 * window function before we proceed.
+		 * window function before we proceed. When the workers compute the groups,
+		 * the aggregates are sent as they are.
 		 */
-		if (hasAggregates && !hasWindowFunction)
+		if (hasAggregates && !hasWindowFunction &&
+			!extendedOpNodeProperties->pushDownGroupAndHaving)
 		{
 			WorkerAggregateWalker((Node *) originalExpression, workerAggContext);
 
@@ -2269,18 +2671,23 @@ ProcessHavingClauseForWorkerQuery(Node *originalHavingQual,
 
 	*workerHavingQual = NULL;
 
-	WorkerAggregateWalkerContext *workerAggContext = palloc0(
-		sizeof(WorkerAggregateWalkerContext));
-	workerAggContext->expressionList = NIL;
-	workerAggContext->pullDistinctColumns = extendedOpNodeProperties->pullDistinctColumns;
-	workerAggContext->createGroupByClause = false;
+	/* the coordinator only applies the having clause if the workers do not */
+	if (!extendedOpNodeProperties->pushDownGroupAndHaving)
+	{
+		WorkerAggregateWalkerContext *workerAggContext = palloc0(
+			sizeof(WorkerAggregateWalkerContext));
+		workerAggContext->expressionList = NIL;
+		workerAggContext->pullDistinctColumns =
+			extendedOpNodeProperties->pullDistinctColumns;
+		workerAggContext->createGroupByClause = false;
 
-	WorkerAggregateWalker(originalHavingQual, workerAggContext);
-	List *newExpressionList = workerAggContext->expressionList;
+		WorkerAggregateWalker(originalHavingQual, workerAggContext);
+		List *newExpressionList = workerAggContext->expressionList;
 
-	ExpandWorkerTargetEntry(newExpressionList, targetEntry,
-							workerAggContext->createGroupByClause,
-							queryTargetList, queryGroupClause);
+		ExpandWorkerTargetEntry(newExpressionList, targetEntry,
+								workerAggContext->createGroupByClause,
+								queryTargetList, queryGroupClause);
+	}
 
 	/*
 	 * If grouped by a partition column whose values are shards have disjoint sets
@@ -2294,7 +2701,8 @@ ProcessHavingClauseForWorkerQuery(Node *originalHavingQual,
 	 *
 	 */
 	if (extendedOpNodeProperties->groupedByDisjointPartitionColumn ||
-		extendedOpNodeProperties->pushDownWindowFunctions)
+		extendedOpNodeProperties->pushDownWindowFunctions ||
+		extendedOpNodeProperties->pushDownGroupAndHaving)
 	{
 		/*
 		 * We converted the having expression to a list in subquery pushdown
@@ -2798,11 +3206,17 @@ WorkerAggregateExpressionList(Aggref *originalAggregate,
 		/*
 		 * If the original aggregate is a count(distinct) approximation, we want
 		 * to compute hll_add_agg(hll_hash(var), storageSize) on worker nodes.
+		 *
+		 * With citus.count_distinct_sparse_sketches, we also pass the register
+		 * width, an automatic explicit threshold and sparse storage, such that
+		 * the sketches of groups with few distinct values are sent as a list of
+		 * hashes or of non-zero registers instead of all registers, regardless
+		 * of the hll defaults that are set on the workers.
 		 */
 		const AttrNumber firstArgumentId = 1;
 		const AttrNumber secondArgumentId = 2;
 		const int hashArgumentCount = 2;
-		const int addArgumentCount = 2;
+		const int addArgumentCount = CountDistinctSparseSketches ? 5 : 2;
 
 
 		/* init hll_hash() related variables */
@@ -2841,6 +3255,25 @@ WorkerAggregateExpressionList(Aggref *originalAggregate,
 		List *addAggregateArgumentList = list_make2(hashedColumnArgument,
 													storageSizeArgument);
 
+		if (CountDistinctSparseSketches)
+		{
+			Const *registerWidthConst = MakeIntegerConst(HLL_DEFAULT_REGISTER_WIDTH);
+			Const *explicitThresholdConst =
+				MakeIntegerConstInt64(HLL_AUTO_EXPLICIT_THRESHOLD);
+			Const *sparseOnConst = MakeIntegerConst(1);
+
+			addAggregateArgumentList =
+				lappend(addAggregateArgumentList,
+						makeTargetEntry((Expr *) registerWidthConst, 3, NULL, false));
+			addAggregateArgumentList =
+				lappend(addAggregateArgumentList,
+						makeTargetEntry((Expr *) explicitThresholdConst, 4, NULL,
+										false));
+			addAggregateArgumentList =
+				lappend(addAggregateArgumentList,
+						makeTargetEntry((Expr *) sparseOnConst, 5, NULL, false));
+		}
+
 		Aggref *addAggregateFunction = makeNode(Aggref);
 		addAggregateFunction->aggfnoid = addFunctionId;
 		addAggregateFunction->aggtype = hllType;
@@ -2851,6 +3284,20 @@ WorkerAggregateExpressionList(Aggref *originalAggregate,
 
 		workerAggregateList = lappend(workerAggregateList, addAggregateFunction);
 	}
+	else if ((aggregateType == AGGREGATE_ARRAY_AGG ||
+			  aggregateType == AGGREGATE_STRING_AGG) && originalAggregate->aggorder)
+	{
+		/*
+		 * For ordered array_agg() and string_agg(), workers send the values in
+		 * the requested order along with the sort keys of these values, which
+		 * the master then uses to merge the sorted arrays. string_agg() skips
+		 * NULL values, so we leave them out of the arrays.
+		 */
+		bool skipNullValues = (aggregateType == AGGREGATE_STRING_AGG);
+
+		workerAggregateList = WorkerSortedArrayAggregates(originalAggregate,
+														  skipNullValues);
+	}
 	else if (aggregateType == AGGREGATE_AVERAGE)
 	{
 		/*
@@ -2888,6 +3335,64 @@ WorkerAggregateExpressionList(Aggref *originalAggregate,
 		workerAggregateList = lappend(workerAggregateList, sumAggregate);
 		workerAggregateList = lappend(workerAggregateList, countAggregate);
 	}
+	else if (IsTDigestPercentileAggregate(aggregateType))
+	{
+		/*
+		 * For percentile aggregates we only build a tdigest sketch of each
+		 * group on the worker nodes, and leave computing the percentiles to the
+		 * master. The sketch is built with tdigest(value, compression) from
+		 * raw values, or with tdigest(tdigest) when merging stored sketches.
+		 */
+		Aggref *sketchAggregate = copyObject(originalAggregate);
+		Oid tdigestType = TDigestExtensionTypeOid();
+		List *sketchArgumentList = NIL;
+
+		if (aggregateType == AGGREGATE_PERCENTILE_CONT_APPROXIMATE)
+		{
+			const AttrNumber firstArgumentId = 1;
+			const AttrNumber secondArgumentId = 2;
+			TargetEntry *sortArgument = (TargetEntry *) linitial(originalAggregate->args);
+			Const *compressionConst = MakeIntegerConst(PercentileApproximationCompression);
+
+			sketchArgumentList =
+				list_make2(makeTargetEntry(copyObject(sortArgument->expr),
+										   firstArgumentId, NULL, false),
+						   makeTargetEntry((Expr *) compressionConst,
+										   secondArgumentId, NULL, false));
+		}
+		else if (list_length(originalAggregate->args) == 3)
+		{
+			/* (value, compression, percentiles) variants add raw values */
+			sketchArgumentList = list_make2(copyObject(linitial(originalAggregate->args)),
+											copyObject(lsecond(originalAggregate->args)));
+		}
+		else
+		{
+			/* (tdigest, percentiles) variants merge stored sketches */
+			sketchArgumentList = list_make1(copyObject(linitial(originalAggregate->args)));
+		}
+
+		if (list_length(sketchArgumentList) == 2)
+		{
+			sketchAggregate->aggfnoid = TDigestExtensionAggTDigest2();
+			sketchAggregate->aggargtypes = list_make2_oid(FLOAT8OID, INT4OID);
+		}
+		else
+		{
+			sketchAggregate->aggfnoid = TDigestExtensionAggTDigest1();
+			sketchAggregate->aggargtypes = list_make1_oid(tdigestType);
+		}
+
+		sketchAggregate->aggtype = tdigestType;
+		sketchAggregate->args = sketchArgumentList;
+		sketchAggregate->aggdirectargs = NIL;
+		sketchAggregate->aggorder = NIL;
+		sketchAggregate->aggkind = AGGKIND_NORMAL;
+		sketchAggregate->aggtranstype = InvalidOid;
+		sketchAggregate->aggsplit = AGGSPLIT_SIMPLE;
+
+		workerAggregateList = lappend(workerAggregateList, sketchAggregate);
+	}
 	else if (aggregateType == AGGREGATE_CUSTOM)
 	{
 		HeapTuple aggTuple =
@@ -2964,6 +3469,80 @@ WorkerAggregateExpressionList(Aggref *originalAggregate,
 }
 
 
+/*
+ * WorkerSortedArrayAggregates returns the worker aggregates for an array_agg()
+ * or string_agg() with an ORDER BY on a single expression. The first aggregate
+ * collects the values into an array in the requested order, and the second one
+ * collects their sort keys into an array in the same order. When skipNullValues
+ * is set, rows with a NULL value are left out of both arrays.
+ */
+static List *
+WorkerSortedArrayAggregates(Aggref *originalAggregate, bool skipNullValues)
+{
+	SortGroupClause *sortClause = linitial(originalAggregate->aggorder);
+	TargetEntry *valueArgument = linitial(originalAggregate->args);
+	TargetEntry *sortArgument = get_sortgroupclause_tle(sortClause,
+														originalAggregate->args);
+	Oid valueType = exprType((Node *) valueArgument->expr);
+	Oid keyType = exprType((Node *) sortArgument->expr);
+	Oid arrayAggregateId = AggregateFunctionOid(AggregateNames[AGGREGATE_ARRAY_AGG],
+												ANYNONARRAYOID);
+	Expr *aggregateFilter = copyObject(originalAggregate->aggfilter);
+
+	if (skipNullValues)
+	{
+		NullTest *nullTest = makeNode(NullTest);
+		nullTest->arg = copyObject(valueArgument->expr);
+		nullTest->nulltesttype = IS_NOT_NULL;
+		nullTest->argisrow = false;
+		nullTest->location = -1;
+
+		if (aggregateFilter == NULL)
+		{
+			aggregateFilter = (Expr *) nullTest;
+		}
+		else
+		{
+			aggregateFilter = make_andclause(list_make2(aggregateFilter, nullTest));
+		}
+	}
+
+	/* array_agg(value ORDER BY key), where the key may be the value itself */
+	List *valueArgumentList = list_make1(copyObject(valueArgument));
+	if (sortArgument != valueArgument)
+	{
+		TargetEntry *sortArgumentCopy = copyObject(sortArgument);
+		sortArgumentCopy->resno = 2;
+
+		valueArgumentList = lappend(valueArgumentList, sortArgumentCopy);
+	}
+
+	Aggref *valueAggregate = copyObject(originalAggregate);
+	valueAggregate->aggfnoid = arrayAggregateId;
+	valueAggregate->aggtype = get_array_type(valueType);
+	valueAggregate->args = valueArgumentList;
+	valueAggregate->aggorder = list_make1(copyObject(sortClause));
+	valueAggregate->aggdistinct = NIL;
+	valueAggregate->aggfilter = aggregateFilter;
+	valueAggregate->aggtranstype = InvalidOid;
+	valueAggregate->aggargtypes = list_make1_oid(valueType);
+	valueAggregate->aggsplit = AGGSPLIT_SIMPLE;
+
+	/* array_agg(key ORDER BY key) */
+	TargetEntry *keyArgument = copyObject(sortArgument);
+	keyArgument->resno = 1;
+
+	Aggref *keyAggregate = copyObject(valueAggregate);
+	keyAggregate->aggtype = get_array_type(keyType);
+	keyAggregate->aggcollid = exprCollation((Node *) sortArgument->expr);
+	keyAggregate->inputcollid = exprCollation((Node *) sortArgument->expr);
+	keyAggregate->args = list_make1(keyArgument);
+	keyAggregate->aggargtypes = list_make1_oid(keyType);
+
+	return list_make2(valueAggregate, keyAggregate);
+}
+
+
 /*
  * GetAggregateType scans pg_catalog.pg_proc for the given aggregate oid, and
  * finds the aggregate's name. The function then matches the aggregate's name to
@@ -2995,6 +3574,20 @@ GetAggregateType(Aggref *aggregateExpression)
 		}
 	}
 
+	/*
+	 * tdigest aggregates all start with the "tdigest" prefix, so we only look
+	 * up their oids when the name gives us a reason to.
+	 */
+	if (strncmp(aggregateProcName, "tdigest", strlen("tdigest")) == 0 ||
+		strncmp(aggregateProcName, "percentile_cont", NAMEDATALEN) == 0)
+	{
+		AggregateType tdigestAggregateType = TDigestAggregateType(aggregateExpression);
+		if (tdigestAggregateType != AGGREGATE_INVALID_FIRST)
+		{
+			return tdigestAggregateType;
+		}
+	}
+
 	if (AggregateEnabledCustom(aggregateExpression))
 	{
 		return AGGREGATE_CUSTOM;
@@ -3004,6 +3597,153 @@ GetAggregateType(Aggref *aggregateExpression)
 }
 
 
+/*
+ * TDigestAggregateType returns the aggregate type of the given tdigest
+ * aggregate, or of percentile_cont when it is approximated through tdigest.
+ * The function returns AGGREGATE_INVALID_FIRST for all other aggregates.
+ */
+static AggregateType
+TDigestAggregateType(Aggref *aggregateExpression)
+{
+	Oid aggFunctionId = aggregateExpression->aggfnoid;
+
+	if (aggregateExpression->aggkind == AGGKIND_ORDERED_SET)
+	{
+		if (PercentileContApproximationEnabled(aggregateExpression))
+		{
+			return AGGREGATE_PERCENTILE_CONT_APPROXIMATE;
+		}
+
+		return AGGREGATE_INVALID_FIRST;
+	}
+
+	if (aggFunctionId == TDigestExtensionAggTDigest1())
+	{
+		return AGGREGATE_TDIGEST_COMBINE;
+	}
+
+	if (aggFunctionId == TDigestExtensionAggTDigest2())
+	{
+		return AGGREGATE_TDIGEST_ADD_DOUBLE;
+	}
+
+	if (aggFunctionId == TDigestExtensionAggTDigestPercentile3())
+	{
+		return AGGREGATE_TDIGEST_PERCENTILE_ADD_DOUBLE;
+	}
+
+	if (aggFunctionId == TDigestExtensionAggTDigestPercentile3a())
+	{
+		return AGGREGATE_TDIGEST_PERCENTILE_ADD_DOUBLEARRAY;
+	}
+
+	if (aggFunctionId == TDigestExtensionAggTDigestPercentile2())
+	{
+		return AGGREGATE_TDIGEST_PERCENTILE_TDIGEST_DOUBLE;
+	}
+
+	if (aggFunctionId == TDigestExtensionAggTDigestPercentile2a())
+	{
+		return AGGREGATE_TDIGEST_PERCENTILE_TDIGEST_DOUBLEARRAY;
+	}
+
+	if (aggFunctionId == TDigestExtensionAggTDigestPercentileOf3())
+	{
+		return AGGREGATE_TDIGEST_PERCENTILE_OF_ADD_DOUBLE;
+	}
+
+	if (aggFunctionId == TDigestExtensionAggTDigestPercentileOf3a())
+	{
+		return AGGREGATE_TDIGEST_PERCENTILE_OF_ADD_DOUBLEARRAY;
+	}
+
+	if (aggFunctionId == TDigestExtensionAggTDigestPercentileOf2())
+	{
+		return AGGREGATE_TDIGEST_PERCENTILE_OF_TDIGEST_DOUBLE;
+	}
+
+	if (aggFunctionId == TDigestExtensionAggTDigestPercentileOf2a())
+	{
+		return AGGREGATE_TDIGEST_PERCENTILE_OF_TDIGEST_DOUBLEARRAY;
+	}
+
+	return AGGREGATE_INVALID_FIRST;
+}
+
+
+/*
+ * PercentileContApproximationEnabled returns whether the given ordered-set
+ * aggregate is a percentile_cont over double precision values that we may
+ * replace with a tdigest approximation. This requires the approximation to
+ * be enabled, the tdigest extension to be installed, and the requested
+ * fractions not to depend on any column.
+ */
+static bool
+PercentileContApproximationEnabled(Aggref *aggregateExpression)
+{
+	if (PercentileApproximationCompression == DISABLE_PERCENTILE_APPROXIMATION)
+	{
+		return false;
+	}
+
+	if (get_func_namespace(aggregateExpression->aggfnoid) != PG_CATALOG_NAMESPACE ||
+		list_length(aggregateExpression->args) != 1 ||
+		list_length(aggregateExpression->aggdirectargs) != 1)
+	{
+		return false;
+	}
+
+	TargetEntry *sortArgument = (TargetEntry *) linitial(aggregateExpression->args);
+	if (exprType((Node *) sortArgument->expr) != FLOAT8OID)
+	{
+		return false;
+	}
+
+	Node *fractionArgument = (Node *) linitial(aggregateExpression->aggdirectargs);
+	Oid fractionType = exprType(fractionArgument);
+	if ((fractionType != FLOAT8OID && fractionType != FLOAT8ARRAYOID) ||
+		contain_var_clause(fractionArgument) ||
+		contain_agg_clause(fractionArgument))
+	{
+		return false;
+	}
+
+	return OidIsValid(TDigestExtensionAggTDigest2());
+}
+
+
+/*
+ * IsTDigestPercentileAggregate returns whether the given aggregate type
+ * computes percentiles or ranks from a tdigest sketch, which means that the
+ * worker nodes build the sketch and the master computes the final value.
+ */
+static bool
+IsTDigestPercentileAggregate(AggregateType aggregateType)
+{
+	return aggregateType >= AGGREGATE_TDIGEST_PERCENTILE_ADD_DOUBLE &&
+		   aggregateType <= AGGREGATE_PERCENTILE_CONT_APPROXIMATE;
+}
+
+
+/*
+ * TDigestMasterArgument returns the argument of a tdigest percentile
+ * aggregate that is evaluated on the master, that is the requested
+ * percentiles or values. These always come last in the argument list, or are
+ * the direct argument of percentile_cont.
+ */
+static Expr *
+TDigestMasterArgument(Aggref *aggregate, AggregateType aggregateType)
+{
+	if (aggregateType == AGGREGATE_PERCENTILE_CONT_APPROXIMATE)
+	{
+		return (Expr *) linitial(aggregate->aggdirectargs);
+	}
+
+	TargetEntry *lastArgument = (TargetEntry *) llast(aggregate->args);
+	return lastArgument->expr;
+}
+
+
 /* Extracts the type of the argument over which the aggregate is operating. */
 static Oid
 AggregateArgumentType(Aggref *aggregate)
@@ -3053,7 +3793,14 @@ AggregateEnabledCustom(Aggref *aggregateExpression)
 	}
 	Form_pg_type typeform = (Form_pg_type) GETSTRUCT(typeTuple);
 
-	bool supportsSafeCombine = typeform->typtype != TYPTYPE_PSEUDO;
+	/*
+	 * Pseudo-typed transition states cannot be sent as text, except for
+	 * INTERNAL states which the aggregate knows how to (de)serialize.
+	 */
+	bool supportsSafeCombine = typeform->typtype != TYPTYPE_PSEUDO ||
+							   (aggform->aggtranstype == INTERNALOID &&
+								aggform->aggserialfn != InvalidOid &&
+								aggform->aggdeserialfn != InvalidOid);
 
 	ReleaseSysCache(aggTuple);
 	ReleaseSysCache(typeTuple);
@@ -3177,6 +3924,24 @@ CoordCombineAggOid()
 }
 
 
+/*
+ * CoordMergeSortedAggOid looks up oid of pg_catalog.coord_merge_sorted_agg
+ */
+static Oid
+CoordMergeSortedAggOid()
+{
+	Oid argtypes[] = {
+		ANYARRAYOID,
+		ANYOID,
+		OIDOID,
+		BOOLOID,
+	};
+
+	return CitusFunctionOidWithSignature(COORD_MERGE_SORTED_AGGREGATE_NAME, 4,
+										 argtypes);
+}
+
+
 /*
  * TypeOid looks for a type that has the given name and schema, and returns the
  * corresponding type's oid.
@@ -3360,6 +4125,10 @@ ErrorIfContainsUnsupportedAggregate(MultiNode *logicalPlanNode)
 		{
 			ErrorIfUnsupportedArrayAggregate(aggregateExpression);
 		}
+		else if (aggregateType == AGGREGATE_STRING_AGG)
+		{
+			ErrorIfUnsupportedStringAggregate(aggregateExpression);
+		}
 		else if (aggregateType == AGGREGATE_JSONB_AGG ||
 				 aggregateType == AGGREGATE_JSON_AGG)
 		{
@@ -3370,6 +4139,10 @@ ErrorIfContainsUnsupportedAggregate(MultiNode *logicalPlanNode)
 		{
 			ErrorIfUnsupportedJsonAggregate(aggregateType, aggregateExpression);
 		}
+		else if (IsTDigestPercentileAggregate(aggregateType))
+		{
+			ErrorIfUnsupportedTDigestAggregate(aggregateExpression, aggregateType);
+		}
 		else if (aggregateExpression->aggdistinct)
 		{
 			ErrorIfUnsupportedAggregateDistinct(aggregateExpression, logicalPlanNode);
@@ -3378,6 +4151,39 @@ ErrorIfContainsUnsupportedAggregate(MultiNode *logicalPlanNode)
 }
 
 
+/*
+ * ErrorIfUnsupportedTDigestAggregate checks if we can split the tdigest
+ * percentile aggregate into sketches built on the worker nodes and a
+ * percentile computation on the master. If we cannot, this function errors.
+ */
+static void
+ErrorIfUnsupportedTDigestAggregate(Aggref *aggregateExpression,
+								   AggregateType aggregateType)
+{
+	char *aggregateName = get_func_name(aggregateExpression->aggfnoid);
+
+	if (aggregateExpression->aggdistinct ||
+		(aggregateExpression->aggorder && aggregateExpression->aggkind !=
+		 AGGKIND_ORDERED_SET))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot compute aggregate (%s)", aggregateName),
+						errdetail("DISTINCT and ORDER BY are not supported in "
+								  "tdigest aggregates")));
+	}
+
+	Node *masterArgument = (Node *) TDigestMasterArgument(aggregateExpression,
+														  aggregateType);
+	if (contain_var_clause(masterArgument) || contain_agg_clause(masterArgument))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot compute aggregate (%s)", aggregateName),
+						errdetail("Percentiles passed to tdigest aggregates cannot "
+								  "reference columns")));
+	}
+}
+
+
 /*
  * ErrorIfUnsupportedArrayAggregate checks if we can transform the array aggregate
  * expression and push it down to the worker node. If we cannot transform the
@@ -3386,8 +4192,8 @@ ErrorIfContainsUnsupportedAggregate(MultiNode *logicalPlanNode)
 static void
 ErrorIfUnsupportedArrayAggregate(Aggref *arrayAggregateExpression)
 {
-	/* if array_agg has order by, we error out */
-	if (arrayAggregateExpression->aggorder)
+	/* if array_agg has order by, we error out unless we can merge sorted arrays */
+	if (arrayAggregateExpression->aggorder && !EnablePartialArrayAggregates)
 	{
 		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
 						errmsg("array_agg with order by is unsupported")));
@@ -3399,6 +4205,101 @@ ErrorIfUnsupportedArrayAggregate(Aggref *arrayAggregateExpression)
 		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
 						errmsg("array_agg (distinct) is unsupported")));
 	}
+
+	if (arrayAggregateExpression->aggorder)
+	{
+		ErrorIfUnsupportedOrderedAggregate(arrayAggregateExpression, "array_agg");
+	}
+}
+
+
+/*
+ * ErrorIfUnsupportedStringAggregate checks if we can compute the string_agg
+ * expression partially on the worker nodes. We can only do so when
+ * citus.enable_partial_array_aggregates is enabled and the delimiter is the
+ * same for all rows. If we cannot, this function errors.
+ */
+static void
+ErrorIfUnsupportedStringAggregate(Aggref *stringAggregateExpression)
+{
+	if (!EnablePartialArrayAggregates)
+	{
+		ereport(ERROR, (errmsg("unsupported aggregate function %s", "string_agg")));
+	}
+
+	/* if string_agg has distinct, we error out */
+	if (stringAggregateExpression->aggdistinct)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("string_agg (distinct) is unsupported")));
+	}
+
+	TargetEntry *delimiterArgument = lsecond(stringAggregateExpression->args);
+	Node *delimiterExpression = (Node *) delimiterArgument->expr;
+	if (contain_var_clause(delimiterExpression) ||
+		contain_agg_clause(delimiterExpression) ||
+		contain_volatile_functions(delimiterExpression))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot compute aggregate (string_agg)"),
+						errdetail("The delimiter of string_agg must be a constant")));
+	}
+
+	if (stringAggregateExpression->aggorder)
+	{
+		/* the master turns the merged array into a string with array_to_string */
+		TargetEntry *valueArgument = linitial(stringAggregateExpression->args);
+		if (exprType((Node *) valueArgument->expr) != TEXTOID)
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("string_agg on bytea with order by is "
+								   "unsupported")));
+		}
+
+		ErrorIfUnsupportedOrderedAggregate(stringAggregateExpression, "string_agg");
+	}
+}
+
+
+/*
+ * ErrorIfUnsupportedOrderedAggregate checks if we can compute the ordered
+ * array_agg or string_agg expression as sorted partial arrays on the worker
+ * nodes, which the master merges by their sort keys. This requires the
+ * aggregate to be ordered by a single expression whose type has an array
+ * type. If it is not, this function errors.
+ */
+static void
+ErrorIfUnsupportedOrderedAggregate(Aggref *aggregateExpression,
+								   const char *aggregateName)
+{
+	if (list_length(aggregateExpression->aggorder) > 1)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("%s with order by on multiple expressions is "
+							   "unsupported", aggregateName)));
+	}
+
+	SortGroupClause *sortClause = linitial(aggregateExpression->aggorder);
+	TargetEntry *valueArgument = linitial(aggregateExpression->args);
+	TargetEntry *sortArgument = get_sortgroupclause_tle(sortClause,
+														aggregateExpression->args);
+	Oid valueType = exprType((Node *) valueArgument->expr);
+	Oid keyType = exprType((Node *) sortArgument->expr);
+
+	/* array_agg of arrays creates a multi-dimensional array */
+	if (type_is_array(valueType))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("%s of arrays with order by is unsupported",
+							   aggregateName)));
+	}
+
+	if (get_array_type(keyType) == InvalidOid)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("%s with order by on type %s is unsupported",
+							   aggregateName, format_type_be(keyType))));
+	}
 }
 
 
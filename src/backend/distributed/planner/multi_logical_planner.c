@@ -69,7 +69,15 @@ typedef MultiNode *(*RuleApplyFunction) (MultiNode *leftNode, MultiNode *rightNo
 
 static RuleApplyFunction RuleApplyFunctionArray[JOIN_RULE_LAST] = { 0 }; /* join rules */
 
+/* Config variable managed via guc.c */
+bool EnableWindowFunctionRepartition = false;
+
 /* Local functions forward declarations */
+static bool WindowFunctionsCanBeRepartitioned(Query *queryTree);
+static MultiNode * MultiNodeTreeInternal(Query *queryTree, bool repartitionSubquery);
+static DeferredErrorMessage * DeferErrorIfQueryNotSupportedInternal(Query *queryTree,
+																	bool
+																	repartitionSubquery);
 static bool AllTargetExpressionsAreColumnReferences(List *targetEntryList);
 static FieldSelect * CompositeFieldRecursive(Expr *expression, Query *query);
 static bool FullCompositeFieldList(List *compositeFieldList);
@@ -110,6 +118,10 @@ static MultiNode * ApplySingleHashPartitionJoin(MultiNode *leftNode,
 static MultiJoin * ApplySinglePartitionJoin(MultiNode *leftNode, MultiNode *rightNode,
 											Var *partitionColumn, JoinType joinType,
 											List *joinClauses);
+static MultiNode * ApplyBroadcastPartitionJoin(MultiNode *leftNode,
+											   MultiNode *rightNode,
+											   Var *partitionColumn, JoinType joinType,
+											   List *joinClauses);
 static MultiNode * ApplyDualPartitionJoin(MultiNode *leftNode, MultiNode *rightNode,
 										  Var *partitionColumn, JoinType joinType,
 										  List *joinClauses);
@@ -195,7 +207,8 @@ FindNodeCheck(Node *node, bool (*check)(Node *))
  *   - Only a single RTE_RELATION exists, which means only a single table
  *     name is specified on the whole query
  *   - No sublinks exists in the subquery
- *   - No window functions in the subquery
+ *   - No window functions in the subquery, unless they can be evaluated after
+ *     repartitioning the relation by their PARTITION BY clauses
  *
  * Note that the caller should still call DeferErrorIfUnsupportedSubqueryRepartition()
  * to ensure that Citus supports the subquery. Also, this function is designed to run
@@ -213,8 +226,8 @@ SingleRelationRepartitionSubquery(Query *queryTree)
 		return false;
 	}
 
-	/* we don't support window functions */
-	if (queryTree->hasWindowFuncs)
+	/* we only support window functions that we can repartition by */
+	if (queryTree->hasWindowFuncs && !WindowFunctionsCanBeRepartitioned(queryTree))
 	{
 		return false;
 	}
@@ -237,7 +250,7 @@ SingleRelationRepartitionSubquery(Query *queryTree)
 	{
 		return true;
 	}
-	else if (rangeTableEntry->rtekind == RTE_SUBQUERY)
+	else if (rangeTableEntry->rtekind == RTE_SUBQUERY && !queryTree->hasWindowFuncs)
 	{
 		Query *subqueryTree = rangeTableEntry->subquery;
 
@@ -248,6 +261,110 @@ SingleRelationRepartitionSubquery(Query *queryTree)
 }
 
 
+/*
+ * WindowFunctionsCanBeRepartitioned returns true if the window functions of
+ * the given query can be evaluated on the workers after repartitioning the
+ * rows of its relation by a column that all PARTITION BY clauses contain. We
+ * only do this for queries that do nothing other than evaluating the window
+ * functions on the columns of the relation, since the workers ship these
+ * columns as is.
+ */
+static bool
+WindowFunctionsCanBeRepartitioned(Query *queryTree)
+{
+	ListCell *columnCell = NULL;
+
+	if (!EnableWindowFunctionRepartition)
+	{
+		return false;
+	}
+
+	if (queryTree->hasAggs || queryTree->groupClause != NIL ||
+		queryTree->groupingSets != NIL || queryTree->havingQual != NULL ||
+		queryTree->distinctClause != NIL || queryTree->sortClause != NIL ||
+		queryTree->limitCount != NULL || queryTree->limitOffset != NULL ||
+		queryTree->hasTargetSRFs)
+	{
+		return false;
+	}
+
+	if (WindowRepartitionColumn(queryTree->windowClause, queryTree->targetList) == NULL)
+	{
+		return false;
+	}
+
+	/* system columns and whole-row references cannot be shipped as columns */
+	List *columnList = pull_var_clause_default((Node *) queryTree->targetList);
+	foreach(columnCell, columnList)
+	{
+		Var *column = (Var *) lfirst(columnCell);
+		if (column->varattno <= 0)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * WindowRepartitionColumn returns a column of the relation that PARTITION BY
+ * clauses of all the given window clauses contain. Rows that belong to the
+ * same window partition then have the same value for this column, and hence
+ * end up in the same merge task when we repartition by it. The function
+ * returns NULL if there is no such column.
+ */
+Var *
+WindowRepartitionColumn(List *windowClauseList, List *targetEntryList)
+{
+	ListCell *targetEntryCell = NULL;
+
+	if (windowClauseList == NIL)
+	{
+		return NULL;
+	}
+
+	WindowClause *firstWindowClause = (WindowClause *) linitial(windowClauseList);
+	List *firstPartitionTargetList =
+		GroupTargetEntryList(firstWindowClause->partitionClause, targetEntryList);
+
+	foreach(targetEntryCell, firstPartitionTargetList)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+		Var *column = (Var *) targetEntry->expr;
+		bool partitionedByColumn = true;
+		ListCell *windowClauseCell = NULL;
+
+		if (!IsA(column, Var) || column->varattno <= 0 || column->varlevelsup > 0)
+		{
+			continue;
+		}
+
+		foreach(windowClauseCell, windowClauseList)
+		{
+			WindowClause *windowClause = (WindowClause *) lfirst(windowClauseCell);
+			List *partitionTargetList =
+				GroupTargetEntryList(windowClause->partitionClause, targetEntryList);
+			List *partitionExpressionList = get_tlist_exprs(partitionTargetList, false);
+
+			if (!list_member(partitionExpressionList, column))
+			{
+				partitionedByColumn = false;
+				break;
+			}
+		}
+
+		if (partitionedByColumn)
+		{
+			return column;
+		}
+	}
+
+	return NULL;
+}
+
+
 /*
  * TargetListOnPartitionColumn checks if at least one target list entry is on
  * partition column.
@@ -621,6 +738,19 @@ SubqueryEntryList(Query *queryTree)
  */
 MultiNode *
 MultiNodeTree(Query *queryTree)
+{
+	return MultiNodeTreeInternal(queryTree, false);
+}
+
+
+/*
+ * MultiNodeTreeInternal builds the logical plan for MultiNodeTree. The
+ * repartitionSubquery flag is set for subqueries that are planned through the
+ * single relation repartition path, for which we can evaluate window functions
+ * after repartitioning.
+ */
+static MultiNode *
+MultiNodeTreeInternal(Query *queryTree, bool repartitionSubquery)
 {
 	List *rangeTableList = queryTree->rtable;
 	List *targetEntryList = queryTree->targetList;
@@ -633,8 +763,8 @@ MultiNodeTree(Query *queryTree)
 	MultiNode *currentTopNode = NULL;
 
 	/* verify we can perform distributed planning on this query */
-	DeferredErrorMessage *unsupportedQueryError = DeferErrorIfQueryNotSupported(
-		queryTree);
+	DeferredErrorMessage *unsupportedQueryError =
+		DeferErrorIfQueryNotSupportedInternal(queryTree, repartitionSubquery);
 	if (unsupportedQueryError != NULL)
 	{
 		RaiseDeferredError(unsupportedQueryError, ERROR);
@@ -695,7 +825,7 @@ MultiNodeTree(Query *queryTree)
 		}
 
 		/* recursively create child nested multitree */
-		MultiNode *subqueryExtendedNode = MultiNodeTree(subqueryTree);
+		MultiNode *subqueryExtendedNode = MultiNodeTreeInternal(subqueryTree, true);
 
 		SetChild((MultiUnaryNode *) subqueryCollectNode, (MultiNode *) subqueryNode);
 		SetChild((MultiUnaryNode *) subqueryNode, subqueryExtendedNode);
@@ -825,6 +955,19 @@ FindIntermediateResultIdIfExists(RangeTblEntry *rte)
  */
 DeferredErrorMessage *
 DeferErrorIfQueryNotSupported(Query *queryTree)
+{
+	return DeferErrorIfQueryNotSupportedInternal(queryTree, false);
+}
+
+
+/*
+ * DeferErrorIfQueryNotSupportedInternal implements DeferErrorIfQueryNotSupported.
+ * For subqueries that are planned via repartitioning, it also allows window
+ * functions that are evaluated after repartitioning by their PARTITION BY
+ * clauses.
+ */
+static DeferredErrorMessage *
+DeferErrorIfQueryNotSupportedInternal(Query *queryTree, bool repartitionSubquery)
 {
 	char *errorMessage = NULL;
 	bool preconditionsSatisfied = true;
@@ -848,7 +991,8 @@ DeferErrorIfQueryNotSupported(Query *queryTree)
 	}
 
 	if (queryTree->hasWindowFuncs &&
-		!SafeToPushdownWindowFunction(queryTree, &errorInfo))
+		!SafeToPushdownWindowFunction(queryTree, &errorInfo) &&
+		!(repartitionSubquery && WindowFunctionsCanBeRepartitioned(queryTree)))
 	{
 		preconditionsSatisfied = false;
 		errorMessage = "could not run distributed query because the window "
@@ -1055,13 +1199,20 @@ DeferErrorIfUnsupportedSubqueryRepartition(Query *subqueryTree)
 	bool preconditionsSatisfied = true;
 	List *joinTreeTableIndexList = NIL;
 
-	if (!subqueryTree->hasAggs)
+	/*
+	 * Window functions that we can repartition by are evaluated on the workers
+	 * after repartitioning, and do not need to be grouped.
+	 */
+	bool repartitionWindowFunctions = subqueryTree->hasWindowFuncs &&
+									  WindowFunctionsCanBeRepartitioned(subqueryTree);
+
+	if (!subqueryTree->hasAggs && !repartitionWindowFunctions)
 	{
 		preconditionsSatisfied = false;
 		errorDetail = "Subqueries without aggregates are not supported yet";
 	}
 
-	if (subqueryTree->groupClause == NIL)
+	if (subqueryTree->groupClause == NIL && !repartitionWindowFunctions)
 	{
 		preconditionsSatisfied = false;
 		errorDetail = "Subqueries without group by clause are not supported yet";
@@ -2006,6 +2157,8 @@ JoinRuleApplyFunction(JoinRuleType ruleType)
 			&ApplySingleHashPartitionJoin;
 		RuleApplyFunctionArray[SINGLE_RANGE_PARTITION_JOIN] =
 			&ApplySingleRangePartitionJoin;
+		RuleApplyFunctionArray[BROADCAST_PARTITION_JOIN] =
+			&ApplyBroadcastPartitionJoin;
 		RuleApplyFunctionArray[DUAL_PARTITION_JOIN] = &ApplyDualPartitionJoin;
 		RuleApplyFunctionArray[CARTESIAN_PRODUCT] = &ApplyCartesianProduct;
 
@@ -2179,6 +2332,62 @@ ApplySinglePartitionJoin(MultiNode *leftNode, MultiNode *rightNode,
 }
 
 
+/*
+ * ApplyBroadcastPartitionJoin creates a new MultiJoin node that joins the left
+ * and right node. The function adds a MultiPartition node on top of the right
+ * node, which sends all of the right node's rows to the merge task of each shard
+ * of the table that the given partition column belongs to. The left node is not
+ * repartitioned.
+ */
+static MultiNode *
+ApplyBroadcastPartitionJoin(MultiNode *leftNode, MultiNode *rightNode,
+							Var *partitionColumn, JoinType joinType,
+							List *applicableJoinClauses)
+{
+	/* find the appropriate join clause */
+	OpExpr *joinClause = DualPartitionJoinClause(applicableJoinClauses);
+	Assert(joinClause != NULL);
+
+	Var *leftColumn = LeftColumnOrNULL(joinClause);
+	Var *rightColumn = RightColumnOrNULL(joinClause);
+	Assert(leftColumn != NULL);
+	Assert(rightColumn != NULL);
+
+	List *rightTableIdList = OutputTableIdList(rightNode);
+	uint32 rightTableId = (uint32) linitial_int(rightTableIdList);
+	Assert(list_length(rightTableIdList) == 1);
+
+	/*
+	 * Rows are not split on the partition column, we only keep the right
+	 * table's join column to build the partition job around.
+	 */
+	MultiPartition *partitionNode = CitusMakeNode(MultiPartition);
+	if (leftColumn->varno == rightTableId)
+	{
+		partitionNode->partitionColumn = leftColumn;
+	}
+	else
+	{
+		partitionNode->partitionColumn = rightColumn;
+	}
+	partitionNode->splitPointTableId = partitionColumn->varno;
+
+	MultiCollect *collectNode = CitusMakeNode(MultiCollect);
+	SetChild((MultiUnaryNode *) partitionNode, rightNode);
+	SetChild((MultiUnaryNode *) collectNode, (MultiNode *) partitionNode);
+
+	MultiJoin *joinNode = CitusMakeNode(MultiJoin);
+	joinNode->joinRuleType = BROADCAST_PARTITION_JOIN;
+	joinNode->joinType = joinType;
+	joinNode->joinClauseList = applicableJoinClauses;
+
+	SetLeftChild((MultiBinaryNode *) joinNode, leftNode);
+	SetRightChild((MultiBinaryNode *) joinNode, (MultiNode *) collectNode);
+
+	return (MultiNode *) joinNode;
+}
+
+
 /*
  * ApplyDualPartitionJoin creates a new MultiJoin node that joins the left and
  * right node. The function also adds two MultiPartition operators on top of
@@ -15,6 +15,7 @@
 
 #include "catalog/pg_type.h"
 #include "commands/extension.h"
+#include "distributed/citus_custom_scan.h"
 #include "distributed/citus_ruleutils.h"
 #include "distributed/function_utils.h"
 #include "distributed/listutils.h"
@@ -38,6 +39,7 @@
 #else
 #include "optimizer/var.h"
 #endif
+#include "parser/parsetree.h"
 #include "utils/builtins.h"
 #include "utils/guc.h"
 #include "utils/memutils.h"
@@ -46,9 +48,16 @@
 #include "utils/lsyscache.h"
 
 
+/* GUC, determining whether sorted task results are merged on the coordinator */
+bool EnableTaskResultMerge = false;
+
+
 static List * MasterTargetList(List *workerTargetList);
-static PlannedStmt * BuildSelectStatement(Query *masterQuery, List *masterTargetList,
+static PlannedStmt * BuildSelectStatement(DistributedPlan *distributedPlan,
+										  List *masterTargetList,
 										  CustomScan *remoteScan);
+static bool CanMergeTaskResults(DistributedPlan *distributedPlan, CustomScan *remoteScan,
+								Plan *topLevelPlan, Sort *sortPlan);
 static Agg * BuildAggregatePlan(PlannerInfo *root, Query *masterQuery, Plan *subPlan);
 static bool HasDistinctAggregate(Query *masterQuery);
 static bool UseGroupAggregateWithHLL(Query *masterQuery);
@@ -76,7 +85,8 @@ MasterNodeSelectPlan(DistributedPlan *distributedPlan, CustomScan *remoteScan)
 	List *workerTargetList = workerJob->jobQuery->targetList;
 	List *masterTargetList = MasterTargetList(workerTargetList);
 
-	PlannedStmt *masterSelectPlan = BuildSelectStatement(masterQuery, masterTargetList,
+	PlannedStmt *masterSelectPlan = BuildSelectStatement(distributedPlan,
+														 masterTargetList,
 														 remoteScan);
 
 	return masterSelectPlan;
@@ -138,8 +148,11 @@ MasterTargetList(List *workerTargetList)
  * and limit plans on top of the scan statement if necessary.
  */
 static PlannedStmt *
-BuildSelectStatement(Query *masterQuery, List *masterTargetList, CustomScan *remoteScan)
+BuildSelectStatement(DistributedPlan *distributedPlan, List *masterTargetList,
+					 CustomScan *remoteScan)
 {
+	Query *masterQuery = distributedPlan->masterQuery;
+
 	/* top level select query should have only one range table entry */
 	Assert(list_length(masterQuery->rtable) == 1);
 	Agg *aggregationPlan = NULL;
@@ -239,7 +252,17 @@ BuildSelectStatement(Query *masterQuery, List *masterTargetList, CustomScan *rem
 		sortPlan->plan.total_cost = 0;
 		sortPlan->plan.plan_rows = 0;
 
-		topLevelPlan = (Plan *) sortPlan;
+		if (CanMergeTaskResults(distributedPlan, remoteScan, topLevelPlan, sortPlan))
+		{
+			/* the executor merges the sorted rows of the tasks instead */
+			sortPlan->plan.lefttree = NULL;
+			sortPlan->plan.targetlist = NIL;
+			distributedPlan->taskResultMergeOrder = sortPlan;
+		}
+		else
+		{
+			topLevelPlan = (Plan *) sortPlan;
+		}
 	}
 
 	/*
@@ -359,6 +382,77 @@ FinalizeStatement(PlannerInfo *root, PlannedStmt *result, Plan *top_plan)
 }
 
 
+/*
+ * CanMergeTaskResults returns whether the rows of the tasks can be merged by
+ * the adaptive executor instead of being sorted by the given sort plan. That
+ * is the case when the sort is directly on top of the custom scan and the
+ * workers sort the rows of each task on the same columns in the same order,
+ * which happens when the ORDER BY is pushed down along with the LIMIT.
+ *
+ * If so, the columns of the sort plan are changed to refer to the columns of
+ * the custom scan.
+ */
+static bool
+CanMergeTaskResults(DistributedPlan *distributedPlan, CustomScan *remoteScan,
+					Plan *topLevelPlan, Sort *sortPlan)
+{
+	Query *workerQuery = distributedPlan->workerJob->jobQuery;
+	List *workerSortClauseList = workerQuery->sortClause;
+	List *scanTargetList = remoteScan->scan.plan.targetlist;
+
+	if (!EnableTaskResultMerge ||
+		remoteScan->methods != &AdaptiveExecutorCustomScanMethods ||
+		topLevelPlan != &remoteScan->scan.plan ||
+		distributedPlan->masterQuery->hasDistinctOn ||
+		list_length(workerSortClauseList) < sortPlan->numCols)
+	{
+		return false;
+	}
+
+	AttrNumber *scanColumnIndexes = palloc0(sortPlan->numCols * sizeof(AttrNumber));
+
+	for (int columnIndex = 0; columnIndex < sortPlan->numCols; columnIndex++)
+	{
+		TargetEntry *sortTargetEntry =
+			get_tle_by_resno(scanTargetList, sortPlan->sortColIdx[columnIndex]);
+		SortGroupClause *workerSortClause = (SortGroupClause *) list_nth(
+			workerSortClauseList, columnIndex);
+		TargetEntry *workerTargetEntry =
+			get_sortgroupclause_tle(workerSortClause, workerQuery->targetList);
+
+		if (sortTargetEntry == NULL || !IsA(sortTargetEntry->expr, Var))
+		{
+			return false;
+		}
+
+		/* the column of the scan is the column of the worker query at that position */
+		Var *scanColumn = (Var *) sortTargetEntry->expr;
+		if (workerTargetEntry->resjunk ||
+			workerTargetEntry->resno != scanColumn->varattno)
+		{
+			return false;
+		}
+
+		if (workerSortClause->sortop != sortPlan->sortOperators[columnIndex] ||
+			workerSortClause->nulls_first != sortPlan->nullsFirst[columnIndex] ||
+			exprCollation((Node *) workerTargetEntry->expr) !=
+			sortPlan->collations[columnIndex])
+		{
+			return false;
+		}
+
+		scanColumnIndexes[columnIndex] = scanColumn->varattno;
+	}
+
+	for (int columnIndex = 0; columnIndex < sortPlan->numCols; columnIndex++)
+	{
+		sortPlan->sortColIdx[columnIndex] = scanColumnIndexes[columnIndex];
+	}
+
+	return true;
+}
+
+
 /*
  * BuildAggregatePlan creates and returns an aggregate plan. This aggregate plan
  * builds aggreation and grouping operators (if any) that are to be executed on
@@ -26,6 +26,8 @@
 #include "access/xlog.h"
 #include "catalog/pg_aggregate.h"
 #include "catalog/pg_am.h"
+#include "catalog/pg_collation.h"
+#include "catalog/pg_namespace.h"
 #include "catalog/pg_operator.h"
 #include "catalog/pg_type.h"
 #include "commands/defrem.h"
@@ -43,12 +45,15 @@
 #include "distributed/multi_logical_optimizer.h"
 #include "distributed/multi_logical_planner.h"
 #include "distributed/multi_physical_planner.h"
+#include "distributed/multi_server_executor.h"
 #include "distributed/log_utils.h"
 #include "distributed/pg_dist_partition.h"
 #include "distributed/pg_dist_shard.h"
+#include "distributed/planning_phases.h"
 #include "distributed/query_pushdown_planning.h"
 #include "distributed/shardinterval_utils.h"
 #include "distributed/shard_pruning.h"
+#include "distributed/shared_connection_stats.h"
 #include "distributed/task_tracker.h"
 #include "distributed/worker_manager.h"
 #include "distributed/worker_protocol.h"
@@ -64,6 +69,7 @@
 #include "optimizer/var.h"
 #endif
 #include "optimizer/restrictinfo.h"
+#include "optimizer/tlist.h"
 #include "parser/parse_relation.h"
 #include "parser/parsetree.h"
 #include "utils/builtins.h"
@@ -79,6 +85,9 @@
 /* Policy to use when assigning tasks to worker nodes */
 int TaskAssignmentPolicy = TASK_ASSIGNMENT_GREEDY;
 bool EnableUniqueJobIds = true;
+bool EnableTopNPushdown = false;
+bool EnableRepartitionJoinFilter = false;
+int RepartitionJoinFilterSize = 64;
 
 
 /*
@@ -89,6 +98,19 @@ bool EnableUniqueJobIds = true;
 static List *OperatorCache = NIL;
 
 
+/*
+ * PlacementLoad is used for ordering placements in the least-loaded task
+ * assignment policy.
+ */
+typedef struct PlacementLoad
+{
+	ShardPlacement *placement;
+	bool isLocal;
+	int connectionCount;
+	int roundRobinIndex;
+} PlacementLoad;
+
+
 /* Local functions forward declarations for job creation */
 static Job * BuildJobTree(MultiTreeRoot *multiTree);
 static MultiNode * LeftMostNode(MultiTreeRoot *multiTree);
@@ -135,6 +157,10 @@ static ArrayType * SplitPointObject(ShardInterval **shardIntervalArray,
 
 /* Local functions forward declarations for task list creation and helper functions */
 static bool DistributedPlanRouterExecutable(DistributedPlan *distributedPlan);
+static void PlanTopNCandidates(DistributedPlan *distributedPlan);
+static Aggref * TopNSortAggregate(Expr *sortExpression);
+static bool IsTopNSumAggregate(Aggref *aggregate);
+static bool TopNGroupColumnTypeSupported(Var *groupColumn);
 static Job * BuildJobTreeTaskList(Job *jobTree,
 								  PlannerRestrictionContext *plannerRestrictionContext);
 static void ErrorIfUnsupportedShardDistribution(Query *query);
@@ -142,7 +168,8 @@ static Task * QueryPushdownTaskCreate(Query *originalQuery, int shardIndex,
 									  RelationRestrictionContext *restrictionContext,
 									  uint32 taskId,
 									  TaskType taskType,
-									  bool modifyRequiresMasterEvaluation);
+									  bool modifyRequiresMasterEvaluation,
+									  char *queryTemplate);
 static bool ShardIntervalsEqual(FmgrInfo *comparisonFunction,
 								ShardInterval *firstInterval,
 								ShardInterval *secondInterval);
@@ -163,6 +190,10 @@ static JoinSequenceNode * JoinSequenceArray(List *rangeTableFragmentsList,
 											Query *jobQuery, List *dependentJobList);
 static bool PartitionedOnColumn(Var *column, List *rangeTableList,
 								List *dependentJobList);
+static Index BroadcastAnchorRangeTableId(Index rangeTableId, List *rangeTableList,
+										 List *dependentJobList,
+										 JoinSequenceNode *joinSequenceArray,
+										 uint32 joinedTableCount);
 static void CheckJoinBetweenColumns(OpExpr *joinClause);
 static List * FindRangeTableFragmentsList(List *rangeTableFragmentsList, int taskId);
 static bool JoinPrunable(RangeTableFragment *leftFragment,
@@ -185,6 +216,7 @@ static Task * GreedyAssignTask(WorkerNode *workerNode, List *taskList,
 static List * ReorderAndAssignTaskList(List *taskList,
 									   List * (*reorderFunction)(Task *, List *));
 static int CompareTasksByShardId(const void *leftElement, const void *rightElement);
+static int ComparePlacementLoad(const void *leftElement, const void *rightElement);
 static List * ActiveShardPlacementLists(List *taskList);
 static List * ActivePlacementList(List *placementList);
 static List * LeftRotateList(List *list, uint32 rotateCount);
@@ -192,7 +224,14 @@ static List * FindDependentMergeTaskList(Task *sqlTask);
 static List * AssignDualHashTaskList(List *taskList);
 static void AssignDataFetchDependencies(List *taskList);
 static uint32 TaskListHighestTaskId(List *taskList);
+static bool JoinFilterApplicable(MultiJoin *joinNode, MapMergeJob *leftMapMergeJob,
+								 MapMergeJob *rightMapMergeJob);
+static bool TargetListColumnNameUnique(List *targetList, char *columnName);
 static List * MapTaskList(MapMergeJob *mapMergeJob, List *filterTaskList);
+static char * MapTaskQueryString(MapMergeJob *mapMergeJob, uint64 jobId, uint32 taskId,
+								 char *filterQueryEscapedText, char *partitionColumnName);
+static char * JoinFilterArgument(char *filterQueryString, char *partitionColumnName,
+								 int *filterOffset);
 static char * ColumnName(Var *column, List *rangeTableList);
 static StringInfo SplitPointArrayString(ArrayType *splitPointObject,
 										Oid columnType, int32 columnTypeMod);
@@ -200,9 +239,10 @@ static List * MergeTaskList(MapMergeJob *mapMergeJob, List *mapTaskList,
 							uint32 taskIdIndex);
 static StringInfo ColumnNameArrayString(uint32 columnCount, uint64 generatingJobId);
 static StringInfo ColumnTypeArrayString(List *targetEntryList);
-static StringInfo MergeTableQueryString(uint32 taskIdIndex, List *targetEntryList);
+static StringInfo MergeColumnDefinitionString(List *targetEntryList);
 static StringInfo IntermediateTableQueryString(uint64 jobId, uint32 taskIdIndex,
-											   Query *reduceQuery);
+											   Query *reduceQuery,
+											   List *targetEntryList);
 static uint32 FinalTargetEntryCount(List *targetEntryList);
 static bool CoPlacedShardIntervals(ShardInterval *firstInterval,
 								   ShardInterval *secondInterval);
@@ -234,10 +274,266 @@ CreatePhysicalDistributedPlan(MultiTreeRoot *multiTree,
 	distributedPlan->routerExecutable = DistributedPlanRouterExecutable(distributedPlan);
 	distributedPlan->modLevel = ROW_MODIFY_READONLY;
 
+	PlanTopNCandidates(distributedPlan);
+
 	return distributedPlan;
 }
 
 
+/*
+ * PlanTopNCandidates checks whether the master query returns the first k
+ * groups in descending order of a sum (or count) of a worker column, with
+ * the groups spread over the workers. For such queries the executor can
+ * first ask every task for its top-k groups, derive a threshold that each of
+ * the top-k groups exceeds on at least one shard, and then only pull the
+ * groups that pass it. The function records what the executor needs for
+ * that in the distributed plan.
+ */
+static void
+PlanTopNCandidates(DistributedPlan *distributedPlan)
+{
+	Query *masterQuery = distributedPlan->masterQuery;
+	Job *workerJob = distributedPlan->workerJob;
+	Query *workerQuery = workerJob->jobQuery;
+	List *groupColumnList = NIL;
+	ListCell *groupClauseCell = NULL;
+
+	distributedPlan->topNCount = 0;
+
+	if (!EnableTopNPushdown || distributedPlan->routerExecutable ||
+		workerJob->dependentJobList != NIL || list_length(workerJob->taskList) < 2)
+	{
+		return;
+	}
+
+	/* the master has to combine the groups and return only the first of them */
+	if (masterQuery->groupClause == NIL || masterQuery->sortClause == NIL ||
+		masterQuery->havingQual != NULL || masterQuery->distinctClause != NIL ||
+		masterQuery->hasWindowFuncs || masterQuery->limitCount == NULL ||
+		!IsA(masterQuery->limitCount, Const) ||
+		(masterQuery->limitOffset != NULL && !IsA(masterQuery->limitOffset, Const)))
+	{
+		return;
+	}
+
+	/* the workers have to return all their groups, unfiltered */
+	if (workerQuery->limitCount != NULL || workerQuery->sortClause != NIL ||
+		workerQuery->havingQual != NULL ||
+		list_length(workerQuery->groupClause) != list_length(masterQuery->groupClause))
+	{
+		return;
+	}
+
+	Const *limitConst = (Const *) masterQuery->limitCount;
+	if (limitConst->constisnull || DatumGetInt64(limitConst->constvalue) <= 0)
+	{
+		return;
+	}
+
+	int64 topNCount = DatumGetInt64(limitConst->constvalue);
+	if (masterQuery->limitOffset != NULL)
+	{
+		Const *offsetConst = (Const *) masterQuery->limitOffset;
+		if (!offsetConst->constisnull)
+		{
+			topNCount += Max(DatumGetInt64(offsetConst->constvalue), 0);
+		}
+	}
+
+	/* the first sort key needs to be a descending sum over a worker column */
+	SortGroupClause *sortClause = (SortGroupClause *) linitial(masterQuery->sortClause);
+	TargetEntry *sortTargetEntry = get_sortgroupclause_tle(sortClause,
+														   masterQuery->targetList);
+	Aggref *sortAggregate = TopNSortAggregate(sortTargetEntry->expr);
+	if (sortAggregate == NULL || !IsTopNSumAggregate(sortAggregate))
+	{
+		return;
+	}
+
+	Oid opfamily = InvalidOid;
+	Oid opcintype = InvalidOid;
+	int16 strategy = 0;
+	if (!get_ordering_op_properties(sortClause->sortop, &opfamily, &opcintype,
+									&strategy) ||
+		strategy != BTGreaterStrategyNumber)
+	{
+		return;
+	}
+
+	TargetEntry *aggregateArgument = (TargetEntry *) linitial(sortAggregate->args);
+	if (!IsA(aggregateArgument->expr, Var))
+	{
+		return;
+	}
+
+	Var *sortColumn = (Var *) aggregateArgument->expr;
+	TargetEntry *workerSortEntry = get_tle_by_resno(workerQuery->targetList,
+													sortColumn->varattno);
+	if (workerSortEntry == NULL || workerSortEntry->resjunk ||
+		!IsA(workerSortEntry->expr, Aggref) ||
+		!IsTopNSumAggregate((Aggref *) workerSortEntry->expr))
+	{
+		return;
+	}
+
+	Oid partialType = exprType((Node *) workerSortEntry->expr);
+	if (partialType != INT8OID && partialType != NUMERICOID &&
+		partialType != FLOAT4OID && partialType != FLOAT8OID)
+	{
+		return;
+	}
+
+	/* the master groups need to be the groups of the workers */
+	foreach(groupClauseCell, masterQuery->groupClause)
+	{
+		SortGroupClause *groupClause = (SortGroupClause *) lfirst(groupClauseCell);
+		TargetEntry *groupTargetEntry = get_sortgroupclause_tle(groupClause,
+																masterQuery->targetList);
+		if (!IsA(groupTargetEntry->expr, Var) ||
+			!TopNGroupColumnTypeSupported((Var *) groupTargetEntry->expr))
+		{
+			return;
+		}
+
+		Var *groupColumn = (Var *) groupTargetEntry->expr;
+		TargetEntry *workerGroupEntry = get_tle_by_resno(workerQuery->targetList,
+														 groupColumn->varattno);
+		if (workerGroupEntry == NULL || workerGroupEntry->resjunk ||
+			workerGroupEntry->ressortgroupref == 0 ||
+			get_sortgroupref_clause_noerr(workerGroupEntry->ressortgroupref,
+										  workerQuery->groupClause) == NULL)
+		{
+			return;
+		}
+
+		groupColumnList = list_append_unique_int(groupColumnList, groupColumn->varattno);
+	}
+
+	if (list_length(groupColumnList) != list_length(workerQuery->groupClause))
+	{
+		return;
+	}
+
+	distributedPlan->topNCount = (uint64) topNCount;
+	distributedPlan->topNSortColumn = sortColumn->varattno;
+	distributedPlan->topNGroupColumnList = groupColumnList;
+	distributedPlan->topNNullsFirst = sortClause->nulls_first;
+}
+
+
+/*
+ * TopNSortAggregate returns the aggregate that the given master sort
+ * expression orders by, looking through the casts and the coalesce that the
+ * logical optimizer adds around combined sums and counts. These keep the
+ * order of non-NULL values. The function returns NULL for other expressions.
+ */
+static Aggref *
+TopNSortAggregate(Expr *sortExpression)
+{
+	Node *expression = (Node *) sortExpression;
+
+	while (expression != NULL)
+	{
+		if (IsA(expression, Aggref))
+		{
+			return (Aggref *) expression;
+		}
+		else if (IsA(expression, CoerceViaIO))
+		{
+			expression = (Node *) ((CoerceViaIO *) expression)->arg;
+		}
+		else if (IsA(expression, RelabelType))
+		{
+			expression = (Node *) ((RelabelType *) expression)->arg;
+		}
+		else if (IsA(expression, FuncExpr) &&
+				 ((FuncExpr *) expression)->funcformat != COERCE_EXPLICIT_CALL &&
+				 list_length(((FuncExpr *) expression)->args) == 1)
+		{
+			expression = (Node *) linitial(((FuncExpr *) expression)->args);
+		}
+		else if (IsA(expression, CoalesceExpr) &&
+				 list_length(((CoalesceExpr *) expression)->args) == 2 &&
+				 IsA(lsecond(((CoalesceExpr *) expression)->args), Const))
+		{
+			/* count() is combined as coalesce(sum(count)::bigint, 0) */
+			expression = (Node *) linitial(((CoalesceExpr *) expression)->args);
+		}
+		else
+		{
+			return NULL;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * IsTopNSumAggregate returns whether the given aggregate is a plain
+ * pg_catalog.sum() or pg_catalog.count(), whose partial results per shard
+ * add up to the result of the group.
+ */
+static bool
+IsTopNSumAggregate(Aggref *aggregate)
+{
+	if (aggregate->aggdistinct != NIL || aggregate->aggorder != NIL ||
+		aggregate->aggkind != AGGKIND_NORMAL ||
+		get_func_namespace(aggregate->aggfnoid) != PG_CATALOG_NAMESPACE)
+	{
+		return false;
+	}
+
+	char *aggregateName = get_func_name(aggregate->aggfnoid);
+	if (strncmp(aggregateName, "sum", NAMEDATALEN) == 0)
+	{
+		return list_length(aggregate->args) == 1;
+	}
+
+	return strncmp(aggregateName, "count", NAMEDATALEN) == 0;
+}
+
+
+/*
+ * TopNGroupColumnTypeSupported returns whether values of the given group
+ * column are equal exactly when their text representations are equal. The
+ * executor identifies groups across tasks by their text representations, and
+ * passes them back to the workers as literals.
+ */
+static bool
+TopNGroupColumnTypeSupported(Var *groupColumn)
+{
+	switch (groupColumn->vartype)
+	{
+		case BOOLOID:
+		case INT2OID:
+		case INT4OID:
+		case INT8OID:
+		case OIDOID:
+		case DATEOID:
+		case TIMESTAMPOID:
+		case UUIDOID:
+		{
+			return true;
+		}
+
+		case TEXTOID:
+		case VARCHAROID:
+		{
+			/* nondeterministic collations consider different strings equal */
+			return groupColumn->varcollid == InvalidOid ||
+				   groupColumn->varcollid == DEFAULT_COLLATION_OID ||
+				   groupColumn->varcollid == C_COLLATION_OID;
+		}
+
+		default:
+		{
+			return false;
+		}
+	}
+}
+
+
 /*
  * DistributedPlanRouterExecutable returns true if the input distributedPlan is
  * router executable.
@@ -325,6 +621,7 @@ BuildJobTree(MultiTreeRoot *multiTree)
 			MultiJoin *joinNode = (MultiJoin *) currentNode;
 			if (joinNode->joinRuleType == SINGLE_HASH_PARTITION_JOIN ||
 				joinNode->joinRuleType == SINGLE_RANGE_PARTITION_JOIN ||
+				joinNode->joinRuleType == BROADCAST_PARTITION_JOIN ||
 				joinNode->joinRuleType == DUAL_PARTITION_JOIN)
 			{
 				boundaryNodeJobType = JOIN_MAP_MERGE_JOB;
@@ -353,6 +650,8 @@ BuildJobTree(MultiTreeRoot *multiTree)
 
 			PartitionType partitionType = PARTITION_INVALID_FIRST;
 			Oid baseRelationId = InvalidOid;
+			MapMergeJob *leftMapMergeJob = NULL;
+			MapMergeJob *rightMapMergeJob = NULL;
 
 			if (joinNode->joinRuleType == SINGLE_RANGE_PARTITION_JOIN)
 			{
@@ -364,6 +663,11 @@ BuildJobTree(MultiTreeRoot *multiTree)
 				partitionType = SINGLE_HASH_PARTITION_TYPE;
 				baseRelationId = RangePartitionJoinBaseRelationId(joinNode);
 			}
+			else if (joinNode->joinRuleType == BROADCAST_PARTITION_JOIN)
+			{
+				partitionType = BROADCAST_PARTITION_TYPE;
+				baseRelationId = RangePartitionJoinBaseRelationId(joinNode);
+			}
 			else if (joinNode->joinRuleType == DUAL_PARTITION_JOIN)
 			{
 				partitionType = DUAL_HASH_PARTITION_TYPE;
@@ -387,6 +691,8 @@ BuildJobTree(MultiTreeRoot *multiTree)
 				/* reset dependent job list */
 				loopDependentJobList = NIL;
 				loopDependentJobList = list_make1(mapMergeJob);
+
+				leftMapMergeJob = mapMergeJob;
 			}
 
 			if (CitusIsA(rightChildNode, MultiPartition))
@@ -407,6 +713,20 @@ BuildJobTree(MultiTreeRoot *multiTree)
 
 				/* append to the dependent job list for on-going dependencies */
 				loopDependentJobList = lappend(loopDependentJobList, mapMergeJob);
+
+				rightMapMergeJob = mapMergeJob;
+			}
+
+			/*
+			 * The right side of a join is always a base table, which usually is
+			 * the filtered side of selective joins. We let its map tasks build a
+			 * filter of their join keys, which the left side's map tasks use to
+			 * skip rows before partitioning them.
+			 */
+			if (JoinFilterApplicable(joinNode, leftMapMergeJob, rightMapMergeJob))
+			{
+				leftMapMergeJob->joinFilterJobId = rightMapMergeJob->job.jobId;
+				rightMapMergeJob->joinFilterSource = true;
 			}
 		}
 		else if (boundaryNodeJobType == SUBQUERY_MAP_MERGE_JOB)
@@ -797,6 +1117,8 @@ BuildReduceQuery(MultiExtendedOp *extendedOpNode, List *dependentJobList)
 	reduceQuery->limitCount = extendedOpNode->limitCount;
 	reduceQuery->havingQual = extendedOpNode->havingQual;
 	reduceQuery->hasAggs = contain_agg_clause((Node *) targetList);
+	reduceQuery->windowClause = extendedOpNode->windowClause;
+	reduceQuery->hasWindowFuncs = extendedOpNode->hasWindowFuncs;
 
 	return reduceQuery;
 }
@@ -1907,8 +2229,9 @@ BuildMapMergeJob(Query *jobQuery, List *dependentJobList, Var *partitionKey,
 		mapMergeJob->partitionType = DUAL_HASH_PARTITION_TYPE;
 		mapMergeJob->partitionCount = partitionCount;
 	}
-	else if (partitionType == SINGLE_HASH_PARTITION_TYPE || partitionType ==
-			 RANGE_PARTITION_TYPE)
+	else if (partitionType == SINGLE_HASH_PARTITION_TYPE ||
+			 partitionType == RANGE_PARTITION_TYPE ||
+			 partitionType == BROADCAST_PARTITION_TYPE)
 	{
 		DistTableCacheEntry *cache = DistributedTableCacheEntry(baseRelationId);
 		uint32 shardCount = cache->shardIntervalArrayLength;
@@ -2112,8 +2435,10 @@ QueryPushdownSqlTaskList(Query *query, uint64 jobId,
 	ListCell *restrictionCell = NULL;
 	uint32 taskIdIndex = 1; /* 0 is reserved for invalid taskId */
 	int shardCount = 0;
-	bool *taskRequiredForShardIndex = NULL;
+	bool foundDistributedTable = false;
+	Bitmapset *taskRequiredShardIndexSet = NULL;
 	ListCell *prunedRelationShardCell = NULL;
+	int shardIndex = -1;
 
 	/* error if shards are not co-partitioned */
 	ErrorIfUnsupportedShardDistribution(query);
@@ -2124,10 +2449,6 @@ QueryPushdownSqlTaskList(Query *query, uint64 jobId,
 							   "router executor is disabled")));
 	}
 
-	/* defaults to be used if this is a reference table-only query */
-	int minShardOffset = 0;
-	int maxShardOffset = 0;
-
 	forboth(prunedRelationShardCell, prunedRelationShardList,
 			restrictionCell, relationRestrictionContext->relationRestrictionList)
 	{
@@ -2150,59 +2471,58 @@ QueryPushdownSqlTaskList(Query *query, uint64 jobId,
 								   "match")));
 		}
 
-		if (taskRequiredForShardIndex == NULL)
-		{
-			shardCount = cacheEntry->shardIntervalArrayLength;
-			taskRequiredForShardIndex = (bool *) palloc0(shardCount);
-
-			/* there is a distributed table, find the shard range */
-			minShardOffset = shardCount;
-			maxShardOffset = -1;
-		}
+		shardCount = cacheEntry->shardIntervalArrayLength;
+		foundDistributedTable = true;
 
 		foreach(shardIntervalCell, prunedShardList)
 		{
 			ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
-			int shardIndex = shardInterval->shardIndex;
-
-			taskRequiredForShardIndex[shardIndex] = true;
-
-			if (shardIndex < minShardOffset)
-			{
-				minShardOffset = shardIndex;
-			}
 
-			if (shardIndex > maxShardOffset)
-			{
-				maxShardOffset = shardIndex;
-			}
+			taskRequiredShardIndexSet = bms_add_member(taskRequiredShardIndexSet,
+													   shardInterval->shardIndex);
 		}
 	}
 
+	/* a reference table-only query has a single task */
+	if (!foundDistributedTable)
+	{
+		taskRequiredShardIndexSet = bms_make_singleton(0);
+	}
+
 	/*
-	 * To avoid iterating through all shards indexes we keep the minimum and maximum
-	 * offsets of shards that were not pruned away. This optimisation is primarily
-	 * relevant for queries on range-distributed tables that, due to range filters,
-	 * prune to a small number of adjacent shards.
-	 *
-	 * In other cases, such as an OR condition on a hash-distributed table, we may
-	 * still visit most or all shards even if some of them were pruned away. However,
-	 * given that hash-distributed tables typically only have a few shards the
-	 * iteration is still very fast.
+	 * The tasks of a SELECT only differ in the shards they access, so deparse
+	 * the query once and fill in the shard names of each task.
 	 */
-	for (int shardOffset = minShardOffset; shardOffset <= maxShardOffset; shardOffset++)
+	char *queryTemplate = NULL;
+	if (taskType == SELECT_TASK && bms_num_members(taskRequiredShardIndexSet) > 1)
 	{
-		if (taskRequiredForShardIndex != NULL && !taskRequiredForShardIndex[shardOffset])
+		List *relationIdList = NIL;
+
+		foreach(restrictionCell, relationRestrictionContext->relationRestrictionList)
 		{
-			/* this shard index is pruned away for all relations */
-			continue;
+			RelationRestriction *relationRestriction =
+				(RelationRestriction *) lfirst(restrictionCell);
+
+			relationIdList = lappend_oid(relationIdList,
+										 relationRestriction->relationId);
 		}
 
-		Task *subqueryTask = QueryPushdownTaskCreate(query, shardOffset,
+		queryTemplate = DeparseShardQueryTemplate(query, relationIdList);
+	}
+
+	/*
+	 * Only visit the shard indexes that were not pruned away for all relations,
+	 * which keeps the cost proportional to the number of tasks even for tables
+	 * with many shards.
+	 */
+	while ((shardIndex = bms_next_member(taskRequiredShardIndexSet, shardIndex)) >= 0)
+	{
+		Task *subqueryTask = QueryPushdownTaskCreate(query, shardIndex,
 													 relationRestrictionContext,
 													 taskIdIndex,
 													 taskType,
-													 modifyRequiresMasterEvaluation);
+													 modifyRequiresMasterEvaluation,
+													 queryTemplate);
 		subqueryTask->jobId = jobId;
 		sqlTaskList = lappend(sqlTaskList, subqueryTask);
 
@@ -2340,10 +2660,9 @@ ErrorIfUnsupportedShardDistribution(Query *query)
 static Task *
 QueryPushdownTaskCreate(Query *originalQuery, int shardIndex,
 						RelationRestrictionContext *restrictionContext, uint32 taskId,
-						TaskType taskType, bool modifyRequiresMasterEvaluation)
+						TaskType taskType, bool modifyRequiresMasterEvaluation,
+						char *queryTemplate)
 {
-	Query *taskQuery = copyObject(originalQuery);
-
 	StringInfo queryString = makeStringInfo();
 	ListCell *restrictionCell = NULL;
 	List *taskShardList = NIL;
@@ -2353,6 +2672,7 @@ QueryPushdownTaskCreate(Query *originalQuery, int shardIndex,
 	bool modifyWithSubselect = false;
 	RangeTblEntry *resultRangeTable = NULL;
 	Oid resultRelationOid = InvalidOid;
+	instr_time phaseStartTime;
 
 	/*
 	 * If it is a modify query with sub-select, we need to set result relation shard's id
@@ -2421,29 +2741,41 @@ QueryPushdownTaskCreate(Query *originalQuery, int shardIndex,
 							   "shards in the query")));
 	}
 
-	/*
-	 * Augment the relations in the query with the shard IDs.
-	 */
-	UpdateRelationToShardNames((Node *) taskQuery, relationShardList);
+	Task *subqueryTask = CreateBasicTask(jobId, taskId, taskType, NULL);
 
-	/*
-	 * Ands are made implicit during shard pruning, as predicate comparison and
-	 * refutation depend on it being so. We need to make them explicit again so
-	 * that the query string is generated as (...) AND (...) as opposed to
-	 * (...), (...).
-	 */
-	if (taskQuery->jointree->quals != NULL && IsA(taskQuery->jointree->quals, List))
+	if (queryTemplate != NULL)
 	{
-		taskQuery->jointree->quals = (Node *) make_ands_explicit(
-			(List *) taskQuery->jointree->quals);
+		Assert(taskType == SELECT_TASK);
+
+		/* the query string is filled in when the task is executed */
+		subqueryTask->queryTemplate = queryTemplate;
 	}
+	else if ((taskType == MODIFY_TASK && !modifyRequiresMasterEvaluation) ||
+			 taskType == SELECT_TASK)
+	{
+		Query *taskQuery = copyObject(originalQuery);
 
-	Task *subqueryTask = CreateBasicTask(jobId, taskId, taskType, NULL);
+		/*
+		 * Augment the relations in the query with the shard IDs.
+		 */
+		UpdateRelationToShardNames((Node *) taskQuery, relationShardList);
 
-	if ((taskType == MODIFY_TASK && !modifyRequiresMasterEvaluation) ||
-		taskType == SELECT_TASK)
-	{
+		/*
+		 * Ands are made implicit during shard pruning, as predicate comparison and
+		 * refutation depend on it being so. We need to make them explicit again so
+		 * that the query string is generated as (...) AND (...) as opposed to
+		 * (...), (...).
+		 */
+		if (taskQuery->jointree->quals != NULL && IsA(taskQuery->jointree->quals, List))
+		{
+			taskQuery->jointree->quals = (Node *) make_ands_explicit(
+				(List *) taskQuery->jointree->quals);
+		}
+
+		BeginPlanningPhase(&phaseStartTime);
 		pg_get_query_def(taskQuery, queryString);
+		EndPlanningPhase(PLANNING_PHASE_DEPARSE, &phaseStartTime);
+
 		ereport(DEBUG4, (errmsg("distributed statement: %s",
 								ApplyLogRedaction(queryString->data))));
 		subqueryTask->queryString = queryString->data;
@@ -2629,6 +2961,7 @@ SqlTaskList(Job *job)
 	uint64 jobId = job->jobId;
 	bool anchorRangeTableBasedAssignment = false;
 	uint32 anchorRangeTableId = 0;
+	instr_time phaseStartTime;
 
 	Query *jobQuery = job->jobQuery;
 	List *rangeTableList = jobQuery->rtable;
@@ -2702,7 +3035,9 @@ SqlTaskList(Job *job)
 
 		/* transform the updated task query to a SQL query string */
 		StringInfo sqlQueryString = makeStringInfo();
+		BeginPlanningPhase(&phaseStartTime);
 		pg_get_query_def(taskQuery, sqlQueryString);
+		EndPlanningPhase(PLANNING_PHASE_DEPARSE, &phaseStartTime);
 
 		Task *sqlTask = CreateBasicTask(jobId, taskIdIndex, SELECT_TASK,
 										sqlQueryString->data);
@@ -3545,6 +3880,21 @@ JoinSequenceArray(List *rangeTableFragmentsList, Query *jobQuery, List *dependen
 			}
 		}
 
+		/*
+		 * Each merge task of a broadcast partition job holds all rows of the
+		 * broadcast table, so we always prune it against the table whose shards
+		 * the merge tasks correspond to, regardless of the join clauses.
+		 */
+		Index broadcastAnchorRangeTableId =
+			BroadcastAnchorRangeTableId(nextRangeTableId, rangeTableList,
+										dependentJobList, joinSequenceArray,
+										joinedTableCount);
+		if (broadcastAnchorRangeTableId != 0)
+		{
+			existingRangeTableId = broadcastAnchorRangeTableId;
+			applyJoinPruning = true;
+		}
+
 		/* set next joining range table's info in the join sequence */
 		JoinSequenceNode *nextJoinSequenceNode = &joinSequenceArray[joinedTableCount];
 		if (applyJoinPruning)
@@ -3565,6 +3915,55 @@ JoinSequenceArray(List *rangeTableFragmentsList, Query *jobQuery, List *dependen
 }
 
 
+/*
+ * BroadcastAnchorRangeTableId checks if the given range table is the output of
+ * a broadcast partition job. If so, the function returns the id of an already
+ * joined range table of the job's base relation, whose shards the job's merge
+ * tasks correspond to. Otherwise, the function returns 0.
+ */
+static Index
+BroadcastAnchorRangeTableId(Index rangeTableId, List *rangeTableList,
+							List *dependentJobList, JoinSequenceNode *joinSequenceArray,
+							uint32 joinedTableCount)
+{
+	RangeTblEntry *rangeTableEntry = rt_fetch(rangeTableId, rangeTableList);
+	if (GetRangeTblKind(rangeTableEntry) != CITUS_RTE_REMOTE_QUERY)
+	{
+		return 0;
+	}
+
+	Job *job = JobForRangeTable(dependentJobList, rangeTableEntry);
+	if (!CitusIsA(job, MapMergeJob))
+	{
+		return 0;
+	}
+
+	MapMergeJob *mapMergeJob = (MapMergeJob *) job;
+	if (mapMergeJob->partitionType != BROADCAST_PARTITION_TYPE)
+	{
+		return 0;
+	}
+
+	Assert(mapMergeJob->sortedShardIntervalArrayLength > 0);
+	Oid baseRelationId = mapMergeJob->sortedShardIntervalArray[0]->relationId;
+
+	for (uint32 joinedTableIndex = 0; joinedTableIndex < joinedTableCount;
+		 joinedTableIndex++)
+	{
+		Index joinedRangeTableId = joinSequenceArray[joinedTableIndex].rangeTableId;
+		RangeTblEntry *joinedTableEntry = rt_fetch(joinedRangeTableId, rangeTableList);
+
+		if (GetRangeTblKind(joinedTableEntry) == CITUS_RTE_RELATION &&
+			joinedTableEntry->relid == baseRelationId)
+		{
+			return joinedRangeTableId;
+		}
+	}
+
+	ereport(ERROR, (errmsg("could not find the table to join broadcast rows with")));
+}
+
+
 /*
  * PartitionedOnColumn finds the given column's range table entry, and checks if
  * that range table is partitioned on the given column. Note that since reference
@@ -4127,6 +4526,80 @@ PruneSqlTaskDependencies(List *sqlTaskList)
 }
 
 
+/*
+ * JoinFilterApplicable returns whether the map tasks of the left job of the
+ * given join can filter their rows with the join keys of the right job. We
+ * only filter inner dual partition joins, whose partition columns hash the
+ * same way, and need to be able to refer to the partition columns by name
+ * in the outputs of the filter queries.
+ */
+static bool
+JoinFilterApplicable(MultiJoin *joinNode, MapMergeJob *leftMapMergeJob,
+					 MapMergeJob *rightMapMergeJob)
+{
+	if (!EnableRepartitionJoinFilter || TaskExecutorType != MULTI_EXECUTOR_ADAPTIVE)
+	{
+		return false;
+	}
+
+	if (joinNode->joinRuleType != DUAL_PARTITION_JOIN ||
+		joinNode->joinType != JOIN_INNER)
+	{
+		return false;
+	}
+
+	if (leftMapMergeJob == NULL || rightMapMergeJob == NULL)
+	{
+		return false;
+	}
+
+	Var *leftColumn = leftMapMergeJob->partitionColumn;
+	Var *rightColumn = rightMapMergeJob->partitionColumn;
+	if (leftColumn->vartype != rightColumn->vartype ||
+		leftColumn->varcollid != rightColumn->varcollid)
+	{
+		return false;
+	}
+
+	Query *leftQuery = leftMapMergeJob->job.jobQuery;
+	Query *rightQuery = rightMapMergeJob->job.jobQuery;
+	if (leftQuery->groupClause != NIL || rightQuery->groupClause != NIL)
+	{
+		return false;
+	}
+
+	char *leftColumnName = ColumnName(leftColumn, leftQuery->rtable);
+	char *rightColumnName = ColumnName(rightColumn, rightQuery->rtable);
+
+	return TargetListColumnNameUnique(leftQuery->targetList, leftColumnName) &&
+		   TargetListColumnNameUnique(rightQuery->targetList, rightColumnName);
+}
+
+
+/*
+ * TargetListColumnNameUnique returns whether exactly one entry of the given
+ * target list has the given column name.
+ */
+static bool
+TargetListColumnNameUnique(List *targetList, char *columnName)
+{
+	ListCell *targetEntryCell = NULL;
+	int matchCount = 0;
+
+	foreach(targetEntryCell, targetList)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+
+		if (targetEntry->resname != NULL && strcmp(targetEntry->resname, columnName) == 0)
+		{
+			matchCount++;
+		}
+	}
+
+	return matchCount == 1;
+}
+
+
 /*
  * MapTaskList creates a list of map tasks for the given MapMerge job. For this,
  * the function walks over each filter task (sql task) in the given filter task
@@ -4141,9 +4614,6 @@ MapTaskList(MapMergeJob *mapMergeJob, List *filterTaskList)
 	List *rangeTableList = filterQuery->rtable;
 	ListCell *filterTaskCell = NULL;
 	Var *partitionColumn = mapMergeJob->partitionColumn;
-	Oid partitionColumnType = partitionColumn->vartype;
-	char *partitionColumnTypeFullName = format_type_be_qualified(partitionColumnType);
-	int32 partitionColumnTypeMod = partitionColumn->vartypmod;
 	char *partitionColumnName = NULL;
 
 	List *groupClauseList = filterQuery->groupClause;
@@ -4156,6 +4626,15 @@ MapTaskList(MapMergeJob *mapMergeJob, List *filterTaskList)
 
 		partitionColumnName = groupByTargetEntry->resname;
 	}
+	else if (mapMergeJob->reduceQuery != NULL)
+	{
+		/* subqueries with window functions partition by a worker column */
+		TargetEntry *partitionTargetEntry =
+			(TargetEntry *) list_nth(filterQuery->targetList,
+									 partitionColumn->varattno - 1);
+
+		partitionColumnName = partitionTargetEntry->resname;
+	}
 	else
 	{
 		partitionColumnName = ColumnName(partitionColumn, rangeTableList);
@@ -4168,57 +4647,42 @@ MapTaskList(MapMergeJob *mapMergeJob, List *filterTaskList)
 		uint32 taskId = filterTask->taskId;
 
 		/* wrap repartition query string around filter query string */
-		StringInfo mapQueryString = makeStringInfo();
 		char *filterQueryString = filterTask->queryString;
 		char *filterQueryEscapedText = quote_literal_cstr(filterQueryString);
 
-		PartitionType partitionType = mapMergeJob->partitionType;
-		if (partitionType == RANGE_PARTITION_TYPE)
-		{
-			ShardInterval **intervalArray = mapMergeJob->sortedShardIntervalArray;
-			uint32 intervalCount = mapMergeJob->partitionCount;
-
-			ArrayType *splitPointObject = SplitPointObject(intervalArray, intervalCount);
-			StringInfo splitPointString = SplitPointArrayString(splitPointObject,
-																partitionColumnType,
-																partitionColumnTypeMod);
+		/* convert filter query task into map task */
+		Task *mapTask = filterTask;
+		mapTask->queryString = MapTaskQueryString(mapMergeJob, jobId, taskId,
+												  filterQueryEscapedText,
+												  partitionColumnName);
+		mapTask->taskType = MAP_TASK;
 
-			appendStringInfo(mapQueryString, RANGE_PARTITION_COMMAND, jobId, taskId,
-							 filterQueryEscapedText, partitionColumnName,
-							 partitionColumnTypeFullName, splitPointString->data);
-		}
-		else if (partitionType == SINGLE_HASH_PARTITION_TYPE)
+		if (mapMergeJob->joinFilterJobId != INVALID_JOB_ID)
 		{
-			ShardInterval **intervalArray = mapMergeJob->sortedShardIntervalArray;
-			uint32 intervalCount = mapMergeJob->partitionCount;
-
-			ArrayType *splitPointObject = SplitPointObject(intervalArray, intervalCount);
-			StringInfo splitPointString = SplitPointArrayString(splitPointObject,
-																partitionColumnType,
-																partitionColumnTypeMod);
-			appendStringInfo(mapQueryString, HASH_PARTITION_COMMAND, jobId, taskId,
-							 filterQueryEscapedText, partitionColumnName,
-							 partitionColumnTypeFullName, splitPointString->data);
+			int filterOffset = 0;
+			char *filterArgument = JoinFilterArgument(filterQueryString,
+													  partitionColumnName,
+													  &filterOffset);
+			char *filterMapQuery = MapTaskQueryString(mapMergeJob, jobId, taskId,
+													  filterArgument,
+													  partitionColumnName);
+
+			mapTask->joinFilterJobId = mapMergeJob->joinFilterJobId;
+			mapTask->joinFilterMapQuery = filterMapQuery;
+			mapTask->joinFilterOffset = (int) (strstr(filterMapQuery, filterArgument) -
+											   filterMapQuery) + filterOffset;
 		}
-		else
+
+		if (mapMergeJob->joinFilterSource)
 		{
-			uint32 partitionCount = mapMergeJob->partitionCount;
-			ShardInterval **intervalArray =
-				GenerateSyntheticShardIntervalArray(partitionCount);
-			ArrayType *splitPointObject = SplitPointObject(intervalArray,
-														   mapMergeJob->partitionCount);
-			StringInfo splitPointString =
-				SplitPointArrayString(splitPointObject, INT4OID, get_typmodin(INT4OID));
+			StringInfo filterBuildQuery = makeStringInfo();
 
-			appendStringInfo(mapQueryString, HASH_PARTITION_COMMAND, jobId, taskId,
-							 filterQueryEscapedText, partitionColumnName,
-							 partitionColumnTypeFullName, splitPointString->data);
-		}
+			appendStringInfo(filterBuildQuery, JOIN_FILTER_BUILD_QUERY,
+							 quote_identifier(partitionColumnName),
+							 RepartitionJoinFilterSize * 1024, filterQueryString);
 
-		/* convert filter query task into map task */
-		Task *mapTask = filterTask;
-		mapTask->queryString = mapQueryString->data;
-		mapTask->taskType = MAP_TASK;
+			mapTask->joinFilterBuildQuery = filterBuildQuery->data;
+		}
 
 		mapTaskList = lappend(mapTaskList, mapTask);
 	}
@@ -4227,6 +4691,101 @@ MapTaskList(MapMergeJob *mapMergeJob, List *filterTaskList)
 }
 
 
+/*
+ * MapTaskQueryString wraps the repartition function call of the given job
+ * around the given filter query argument.
+ */
+static char *
+MapTaskQueryString(MapMergeJob *mapMergeJob, uint64 jobId, uint32 taskId,
+				   char *filterQueryEscapedText, char *partitionColumnName)
+{
+	StringInfo mapQueryString = makeStringInfo();
+	Var *partitionColumn = mapMergeJob->partitionColumn;
+	Oid partitionColumnType = partitionColumn->vartype;
+	char *partitionColumnTypeFullName = format_type_be_qualified(partitionColumnType);
+	int32 partitionColumnTypeMod = partitionColumn->vartypmod;
+
+	PartitionType partitionType = mapMergeJob->partitionType;
+	if (partitionType == RANGE_PARTITION_TYPE)
+	{
+		ShardInterval **intervalArray = mapMergeJob->sortedShardIntervalArray;
+		uint32 intervalCount = mapMergeJob->partitionCount;
+
+		ArrayType *splitPointObject = SplitPointObject(intervalArray, intervalCount);
+		StringInfo splitPointString = SplitPointArrayString(splitPointObject,
+															partitionColumnType,
+															partitionColumnTypeMod);
+
+		appendStringInfo(mapQueryString, RANGE_PARTITION_COMMAND, jobId, taskId,
+						 filterQueryEscapedText, partitionColumnName,
+						 partitionColumnTypeFullName, splitPointString->data);
+	}
+	else if (partitionType == SINGLE_HASH_PARTITION_TYPE)
+	{
+		ShardInterval **intervalArray = mapMergeJob->sortedShardIntervalArray;
+		uint32 intervalCount = mapMergeJob->partitionCount;
+
+		ArrayType *splitPointObject = SplitPointObject(intervalArray, intervalCount);
+		StringInfo splitPointString = SplitPointArrayString(splitPointObject,
+															partitionColumnType,
+															partitionColumnTypeMod);
+		appendStringInfo(mapQueryString, HASH_PARTITION_COMMAND, jobId, taskId,
+						 filterQueryEscapedText, partitionColumnName,
+						 partitionColumnTypeFullName, splitPointString->data);
+	}
+	else if (partitionType == BROADCAST_PARTITION_TYPE)
+	{
+		/* every partition receives all rows, so we only need their count */
+		appendStringInfo(mapQueryString, BROADCAST_PARTITION_COMMAND, jobId,
+						 taskId, filterQueryEscapedText,
+						 mapMergeJob->partitionCount);
+	}
+	else
+	{
+		uint32 partitionCount = mapMergeJob->partitionCount;
+		ShardInterval **intervalArray =
+			GenerateSyntheticShardIntervalArray(partitionCount);
+		ArrayType *splitPointObject = SplitPointObject(intervalArray,
+													   mapMergeJob->partitionCount);
+		StringInfo splitPointString =
+			SplitPointArrayString(splitPointObject, INT4OID, get_typmodin(INT4OID));
+
+		appendStringInfo(mapQueryString, HASH_PARTITION_COMMAND, jobId, taskId,
+						 filterQueryEscapedText, partitionColumnName,
+						 partitionColumnTypeFullName, splitPointString->data);
+	}
+
+	return mapQueryString->data;
+}
+
+
+/*
+ * JoinFilterArgument returns the filter query argument of a map task that
+ * skips the rows whose partition column is not in a join filter. The filter
+ * is concatenated into the query as a hex string at filterOffset of the
+ * argument by the executor; as planned, the argument holds an empty filter.
+ */
+static char *
+JoinFilterArgument(char *filterQueryString, char *partitionColumnName,
+				   int *filterOffset)
+{
+	StringInfo queryPrefix = makeStringInfo();
+	StringInfo querySuffix = makeStringInfo();
+	StringInfo filterArgument = makeStringInfo();
+
+	appendStringInfo(queryPrefix, JOIN_FILTER_QUERY_PREFIX, filterQueryString);
+	appendStringInfo(querySuffix, JOIN_FILTER_QUERY_SUFFIX,
+					 quote_identifier(partitionColumnName));
+
+	/* the hex string needs no escaping, so we can add it between two literals */
+	appendStringInfo(filterArgument, "%s || '", quote_literal_cstr(queryPrefix->data));
+	*filterOffset = filterArgument->len;
+	appendStringInfo(filterArgument, "' || %s", quote_literal_cstr(querySuffix->data));
+
+	return filterArgument->data;
+}
+
+
 /*
  * GenerateSyntheticShardIntervalArray returns a shard interval pointer array
  * which has a uniform hash distribution for the given input partitionCount.
@@ -4408,7 +4967,8 @@ MergeTaskList(MapMergeJob *mapMergeJob, List *mapTaskList, uint32 taskIdIndex)
 		initialPartitionId = 1;
 		partitionCount = partitionCount + 1;
 	}
-	else if (mapMergeJob->partitionType == SINGLE_HASH_PARTITION_TYPE)
+	else if (mapMergeJob->partitionType == SINGLE_HASH_PARTITION_TYPE ||
+			 mapMergeJob->partitionType == BROADCAST_PARTITION_TYPE)
 	{
 		initialPartitionId = 0;
 	}
@@ -4439,12 +4999,11 @@ MergeTaskList(MapMergeJob *mapMergeJob, List *mapTaskList, uint32 taskIdIndex)
 		}
 		else
 		{
-			StringInfo mergeTableQueryString =
-				MergeTableQueryString(taskIdIndex, targetEntryList);
-			char *escapedMergeTableQueryString =
-				quote_literal_cstr(mergeTableQueryString->data);
+			/* the reduce query reads the fetched files without a merge table */
+			char *escapedMergeTableQueryString = quote_literal_cstr("");
 			StringInfo intermediateTableQueryString =
-				IntermediateTableQueryString(jobId, taskIdIndex, reduceQuery);
+				IntermediateTableQueryString(jobId, taskIdIndex, reduceQuery,
+											 targetEntryList);
 			char *escapedIntermediateTableQueryString =
 				quote_literal_cstr(intermediateTableQueryString->data);
 			StringInfo mergeAndRunQueryString = makeStringInfo();
@@ -4489,7 +5048,8 @@ MergeTaskList(MapMergeJob *mapMergeJob, List *mapTaskList, uint32 taskIdIndex)
 
 			mergeTask->shardInterval = mergeTaskIntervals[mergeTaskIntervalId];
 		}
-		else if (mapMergeJob->partitionType == SINGLE_HASH_PARTITION_TYPE)
+		else if (mapMergeJob->partitionType == SINGLE_HASH_PARTITION_TYPE ||
+				 mapMergeJob->partitionType == BROADCAST_PARTITION_TYPE)
 		{
 			int32 mergeTaskIntervalId = partitionId;
 			ShardInterval **mergeTaskIntervals = mapMergeJob->sortedShardIntervalArray;
@@ -4864,6 +5424,10 @@ AssignAnchorShardTaskList(List *taskList)
 	{
 		assignedTaskList = RoundRobinAssignTaskList(taskList);
 	}
+	else if (TaskAssignmentPolicy == TASK_ASSIGNMENT_LEAST_LOADED)
+	{
+		assignedTaskList = LeastLoadedAssignTaskList(taskList);
+	}
 
 	Assert(assignedTaskList != NIL);
 	return assignedTaskList;
@@ -5078,6 +5642,90 @@ RoundRobinReorder(Task *task, List *placementList)
 }
 
 
+/*
+ * LeastLoadedAssignTaskList assigns each of the given tasks to the placement
+ * that is local, or else on the node with the fewest open connections.
+ */
+List *
+LeastLoadedAssignTaskList(List *taskList)
+{
+	taskList = ReorderAndAssignTaskList(taskList, LeastLoadedReorder);
+
+	return taskList;
+}
+
+
+/*
+ * LeastLoadedReorder implements the core of the least-loaded assignment policy.
+ * It prefers a placement on the local node, which local execution can read
+ * without a connection. The other placements are ordered by the number of
+ * connections that the backends on this node currently have open to their
+ * node, which approximates how many tasks are queued there. Nodes with an
+ * equal number of connections keep their round-robin order.
+ */
+List *
+LeastLoadedReorder(Task *task, List *placementList)
+{
+	int32 localGroupId = GetLocalGroupId();
+	int placementCount = list_length(placementList);
+	List *reorderedPlacementList = NIL;
+	ListCell *placementCell = NULL;
+	int placementIndex = 0;
+
+	PlacementLoad *placementLoadArray = palloc0(placementCount * sizeof(PlacementLoad));
+
+	placementList = RoundRobinReorder(task, placementList);
+	foreach(placementCell, placementList)
+	{
+		ShardPlacement *placement = (ShardPlacement *) lfirst(placementCell);
+		PlacementLoad *placementLoad = &placementLoadArray[placementIndex];
+
+		placementLoad->placement = placement;
+		placementLoad->isLocal = (placement->groupId == localGroupId);
+		placementLoad->connectionCount =
+			GetSharedConnectionCount(placement->nodeName, placement->nodePort);
+		placementLoad->roundRobinIndex = placementIndex;
+
+		placementIndex++;
+	}
+
+	qsort(placementLoadArray, placementCount, sizeof(PlacementLoad),
+		  ComparePlacementLoad);
+
+	for (placementIndex = 0; placementIndex < placementCount; placementIndex++)
+	{
+		reorderedPlacementList = lappend(reorderedPlacementList,
+										 placementLoadArray[placementIndex].placement);
+	}
+
+	return reorderedPlacementList;
+}
+
+
+/*
+ * ComparePlacementLoad orders placements by whether they are local, by the
+ * number of connections to their node and by their round-robin order.
+ */
+static int
+ComparePlacementLoad(const void *leftElement, const void *rightElement)
+{
+	const PlacementLoad *leftLoad = (const PlacementLoad *) leftElement;
+	const PlacementLoad *rightLoad = (const PlacementLoad *) rightElement;
+
+	if (leftLoad->isLocal != rightLoad->isLocal)
+	{
+		return leftLoad->isLocal ? -1 : 1;
+	}
+
+	if (leftLoad->connectionCount != rightLoad->connectionCount)
+	{
+		return leftLoad->connectionCount - rightLoad->connectionCount;
+	}
+
+	return leftLoad->roundRobinIndex - rightLoad->roundRobinIndex;
+}
+
+
 /*
  * ReorderAndAssignTaskList finds the placements for a task based on its anchor
  * shard id and then sorts them by insertion time. If reorderFunction is given,
@@ -5445,22 +6093,16 @@ TaskListHighestTaskId(List *taskList)
 
 
 /*
- * MergeTableQueryString builds a query string which creates a merge task table
- * within the job's schema, which should have already been created by the task
- * tracker protocol.
+ * MergeColumnDefinitionString builds the column definitions of the rows that
+ * map tasks write into the partition files of a merge task.
  */
 static StringInfo
-MergeTableQueryString(uint32 taskIdIndex, List *targetEntryList)
+MergeColumnDefinitionString(List *targetEntryList)
 {
-	StringInfo taskTableName = TaskTableName(taskIdIndex);
-	StringInfo mergeTableQueryString = makeStringInfo();
-	StringInfo mergeTableName = makeStringInfo();
 	StringInfo columnsString = makeStringInfo();
 	ListCell *targetEntryCell = NULL;
 	uint32 columnIndex = 0;
 
-	appendStringInfo(mergeTableName, "%s%s", taskTableName->data, MERGE_TABLE_SUFFIX);
-
 	uint32 columnCount = (uint32) list_length(targetEntryList);
 
 	foreach(targetEntryCell, targetEntryList)
@@ -5485,25 +6127,27 @@ MergeTableQueryString(uint32 taskIdIndex, List *targetEntryList)
 		}
 	}
 
-	appendStringInfo(mergeTableQueryString, CREATE_TABLE_COMMAND, mergeTableName->data,
-					 columnsString->data);
-
-	return mergeTableQueryString;
+	return columnsString;
 }
 
 
 /*
  * IntermediateTableQueryString builds a query string which creates a task table
- * by running reduce query on already created merge table.
+ * by running reduce query on the fetched partition files of the merge task.
+ * The reduce query reads from a CTE named after the merge table, which returns
+ * the rows of the files through worker_read_task_files().
  */
 static StringInfo
-IntermediateTableQueryString(uint64 jobId, uint32 taskIdIndex, Query *reduceQuery)
+IntermediateTableQueryString(uint64 jobId, uint32 taskIdIndex, Query *reduceQuery,
+							 List *targetEntryList)
 {
 	StringInfo taskTableName = TaskTableName(taskIdIndex);
 	StringInfo intermediateTableQueryString = makeStringInfo();
 	StringInfo mergeTableName = makeStringInfo();
 	StringInfo columnsString = makeStringInfo();
 	StringInfo taskReduceQueryString = makeStringInfo();
+	StringInfo mergeFilesQueryString = makeStringInfo();
+	StringInfo mergeColumnsString = MergeColumnDefinitionString(targetEntryList);
 	Query *taskReduceQuery = copyObject(reduceQuery);
 	ListCell *columnNameCell = NULL;
 	uint32 columnIndex = 0;
@@ -5539,9 +6183,13 @@ IntermediateTableQueryString(uint64 jobId, uint32 taskIdIndex, Query *reduceQuer
 
 	pg_get_query_def(taskReduceQuery, taskReduceQueryString);
 
+	appendStringInfo(mergeFilesQueryString, READ_TASK_FILES_QUERY, mergeTableName->data,
+					 jobId, taskIdIndex, mergeTableName->data, mergeColumnsString->data,
+					 taskReduceQueryString->data);
+
 	appendStringInfo(intermediateTableQueryString, CREATE_TABLE_AS_COMMAND,
 					 taskTableName->data, columnsString->data,
-					 taskReduceQueryString->data);
+					 mergeFilesQueryString->data);
 
 	return intermediateTableQueryString;
 }
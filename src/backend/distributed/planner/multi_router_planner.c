@@ -38,6 +38,7 @@
 #include "distributed/multi_physical_planner.h"
 #include "distributed/multi_router_planner.h"
 #include "distributed/multi_server_executor.h"
+#include "distributed/planning_phases.h"
 #include "distributed/listutils.h"
 #include "distributed/citus_ruleutils.h"
 #include "distributed/query_pushdown_planning.h"
@@ -346,7 +347,6 @@ AddShardIntervalRestrictionToSelect(Query *subqery, ShardInterval *shardInterval
 	List *targetList = subqery->targetList;
 	ListCell *targetEntryCell = NULL;
 	Var *targetPartitionColumnVar = NULL;
-	List *boundExpressionList = NIL;
 
 	/* iterate through the target entries */
 	foreach(targetEntryCell, targetList)
@@ -364,6 +364,22 @@ AddShardIntervalRestrictionToSelect(Query *subqery, ShardInterval *shardInterval
 	/* we should have found target partition column */
 	Assert(targetPartitionColumnVar != NULL);
 
+	AddHashRangeRestrictionToSelect(subqery, targetPartitionColumnVar, shardInterval);
+}
+
+
+/*
+ * AddHashRangeRestrictionToSelect adds the hash range boundaries of the given
+ * shardInterval on the given column of the subquery, which need not be a
+ * partition column. This allows restricting a SELECT on reference tables to
+ * the rows that belong to a shard of a hash-distributed table.
+ */
+void
+AddHashRangeRestrictionToSelect(Query *subqery, Var *targetPartitionColumnVar,
+								ShardInterval *shardInterval)
+{
+	List *boundExpressionList = NIL;
+
 	Oid integer4GEoperatorId = get_opfamily_member(INTEGER_BTREE_FAM_OID, INT4OID,
 												   INT4OID,
 												   BTGreaterEqualStrategyNumber);
@@ -1439,10 +1455,64 @@ RouterInsertJob(Query *originalQuery, Query *query, DeferredErrorMessage **plann
 	job->deferredPruning = deferredPruning;
 	job->partitionKeyValue = partitionKeyValue;
 
+	if (requiresMasterEvaluation && !isMultiRowInsert)
+	{
+		/* find the target entries to evaluate once, rather than on every execution */
+		job->masterEvaluationResnoList = MasterEvaluableTargetEntryResnos(originalQuery);
+	}
+
 	return job;
 }
 
 
+/*
+ * PlanDeferredRouterSelectJob builds the task list of a fast path SELECT job
+ * whose shard pruning is deferred to the executor, see RouterJob(). The
+ * parameters in the job query must already be resolved at this point.
+ */
+void
+PlanDeferredRouterSelectJob(Job *job, DeferredErrorMessage **planningError)
+{
+	Query *jobQuery = job->jobQuery;
+	uint64 shardId = INVALID_SHARD_ID;
+	List *placementList = NIL;
+	List *relationShardList = NIL;
+	List *prunedShardIntervalListList = NIL;
+	bool isMultiShardModifyQuery = false;
+	Const *partitionKeyValue = NULL;
+	bool replacePrunedQueryWithDummy = true;
+
+	/*
+	 * Fast path router queries are pruned based on their quals, the restriction
+	 * context is only used for multi-shard modifications.
+	 */
+	PlannerRestrictionContext *plannerRestrictionContext = NULL;
+
+	Assert(jobQuery->commandType == CMD_SELECT);
+
+	(*planningError) = PlanRouterQuery(jobQuery, plannerRestrictionContext,
+									   &placementList, &shardId, &relationShardList,
+									   &prunedShardIntervalListList,
+									   replacePrunedQueryWithDummy,
+									   &isMultiShardModifyQuery,
+									   &partitionKeyValue);
+	if (*planningError)
+	{
+		return;
+	}
+
+	job->taskList = SingleShardSelectTaskList(jobQuery, job->jobId, relationShardList,
+											  placementList, shardId);
+	job->partitionKeyValue = partitionKeyValue;
+
+	if (shardId != INVALID_SHARD_ID)
+	{
+		ReorderTaskPlacementsByTaskAssignmentPolicy(job, TaskAssignmentPolicy,
+													placementList);
+	}
+}
+
+
 /*
  * CreateJob returns a new Job for the given query.
  */
@@ -1643,6 +1713,25 @@ RouterJob(Query *originalQuery, PlannerRestrictionContext *plannerRestrictionCon
 	/* router planner should create task even if it doesn't hit a shard at all */
 	bool replacePrunedQueryWithDummy = true;
 
+	if (originalQuery->commandType == CMD_SELECT &&
+		FastPathRouterQuery(originalQuery) &&
+		FastPathRequiresDeferredPruning(originalQuery))
+	{
+		/*
+		 * The distribution key is compared with a parameter that has no value
+		 * yet, which happens when planning a generic plan for a prepared
+		 * statement, or with an expression that is evaluated at execution
+		 * time. We defer shard pruning to the executor such that the plan can
+		 * be cached and reused for any value of the distribution key.
+		 */
+		Job *job = CreateJob(originalQuery);
+		job->deferredPruning = true;
+
+		ereport(DEBUG2, (errmsg("Deferred pruning for a fast-path router query")));
+
+		return job;
+	}
+
 	/* check if this query requires master evaluation */
 	bool requiresMasterEvaluation = RequiresMasterEvaluation(originalQuery);
 
@@ -1723,6 +1812,8 @@ RouterJob(Query *originalQuery, PlannerRestrictionContext *plannerRestrictionCon
  *
  * Supported Types
  * - TASK_ASSIGNMENT_ROUND_ROBIN round robin schedule queries among placements
+ * - TASK_ASSIGNMENT_LEAST_LOADED prefer the local placement, then the placement
+ *   on the node with the fewest open connections
  *
  * By default it does not reorder the task list, implying a first-replica strategy.
  */
@@ -1758,6 +1849,27 @@ ReorderTaskPlacementsByTaskAssignmentPolicy(Job *job,
 		List *reorderedPlacementList = RoundRobinReorder(task, placementList);
 		task->taskPlacementList = reorderedPlacementList;
 
+		ShardPlacement *primaryPlacement = (ShardPlacement *) linitial(
+			reorderedPlacementList);
+		ereport(DEBUG3, (errmsg("assigned task %u to node %s:%u", task->taskId,
+								primaryPlacement->nodeName,
+								primaryPlacement->nodePort)));
+	}
+	else if (taskAssignmentPolicy == TASK_ASSIGNMENT_LEAST_LOADED)
+	{
+		/* we hit a single shard on router plans */
+		Assert(list_length(job->taskList) == 1);
+		Task *task = (Task *) linitial(job->taskList);
+
+		/*
+		 * Unlike round-robin, we keep the coordinator placement, since reading
+		 * it locally does not add load to any of the worker nodes.
+		 */
+		Assert(ReadOnlyTask(task->taskType));
+
+		List *reorderedPlacementList = LeastLoadedReorder(task, placementList);
+		task->taskPlacementList = reorderedPlacementList;
+
 		ShardPlacement *primaryPlacement = (ShardPlacement *) linitial(
 			reorderedPlacementList);
 		ereport(DEBUG3, (errmsg("assigned task %u to node %s:%u", task->taskId,
@@ -1810,9 +1922,13 @@ SingleShardSelectTaskList(Query *query, uint64 jobId, List *relationShardList,
 	Task *task = CreateTask(SELECT_TASK);
 	StringInfo queryString = makeStringInfo();
 	List *relationRowLockList = NIL;
+	instr_time phaseStartTime;
 
 	RowLocksOnRelations((Node *) query, &relationRowLockList);
+
+	BeginPlanningPhase(&phaseStartTime);
 	pg_get_query_def(query, queryString);
+	EndPlanningPhase(PLANNING_PHASE_DEPARSE, &phaseStartTime);
 
 	task->queryString = queryString->data;
 	task->anchorShardId = shardId;
@@ -1877,6 +1993,7 @@ SingleShardModifyTaskList(Query *query, uint64 jobId, List *relationShardList,
 	Task *task = CreateTask(MODIFY_TASK);
 	StringInfo queryString = makeStringInfo();
 	List *rangeTableList = NIL;
+	instr_time phaseStartTime;
 
 	ExtractRangeTableEntryWalker((Node *) query, &rangeTableList);
 	RangeTblEntry *updateOrDeleteRTE = GetUpdateOrDeleteRTE(query);
@@ -1893,7 +2010,9 @@ SingleShardModifyTaskList(Query *query, uint64 jobId, List *relationShardList,
 							   "and modify a reference table")));
 	}
 
+	BeginPlanningPhase(&phaseStartTime);
 	pg_get_query_def(query, queryString);
+	EndPlanningPhase(PLANNING_PHASE_DEPARSE, &phaseStartTime);
 
 	task->queryString = queryString->data;
 	task->anchorShardId = shardId;
@@ -2525,7 +2644,6 @@ BuildRoutesForInsert(Query *query, DeferredErrorMessage **planningError)
 		{
 			Datum partitionValue = partitionValueConst->constvalue;
 
-			cacheEntry = DistributedTableCacheEntry(distributedTableId);
 			ShardInterval *shardInterval = FindShardInterval(partitionValue, cacheEntry);
 			if (shardInterval != NULL)
 			{
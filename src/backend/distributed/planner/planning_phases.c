@@ -0,0 +1,303 @@
+/*-------------------------------------------------------------------------
+ *
+ * planning_phases.c
+ *
+ * Routines for measuring the time spent in the phases of distributed
+ * planning, such as the router planner, recursive planning of subqueries and
+ * CTEs and the logical and physical planners, together with the number of
+ * shards that shard pruning considered and kept. The measurements of the last
+ * planned query are shown in EXPLAIN when citus.explain_planning_phases is
+ * enabled, and logged when citus.log_planning_phases is enabled.
+ *
+ * Only the outermost call of the distributed planner is measured. Planning
+ * of subqueries and CTEs goes through the planner again, and that time is
+ * accounted to recursive planning of the outer query.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "distributed/planning_phases.h"
+#include "lib/stringinfo.h"
+
+
+/*
+ * PlanningPhaseStats contains the measurements of a single planned query.
+ * The phase times are inclusive, deparsing happens within the other phases.
+ */
+typedef struct PlanningPhaseStats
+{
+	/* identifier of the distributed plan, 0 if the query is not distributed */
+	uint64 planId;
+
+	instr_time startTime;
+	instr_time totalTime;
+	instr_time phaseTime[PLANNING_PHASE_COUNT];
+	int phaseCount[PLANNING_PHASE_COUNT];
+
+	/* number of PruneShards() calls and the shards they considered and kept */
+	int pruningCount;
+	int64 candidateShardCount;
+	int64 remainingShardCount;
+} PlanningPhaseStats;
+
+
+/* config variables managed via guc.c */
+bool LogPlanningPhases = false;
+bool ExplainPlanningPhases = false;
+
+
+static const char *PlanningPhaseNames[PLANNING_PHASE_COUNT] = {
+	"Standard Planner",
+	"Fast Path Planner",
+	"Router Planner",
+	"Modify Planner",
+	"Recursive Planning",
+	"Logical Optimizer",
+	"Physical Planner",
+	"Deparse"
+};
+
+/* measurements of the query that is planned or was planned last */
+static PlanningPhaseStats CurrentPlanningPhaseStats;
+
+/* nesting level of the distributed planner, and whether it is measured */
+static int PlanningNestingLevel = 0;
+static bool PlanningPhaseStatsActive = false;
+
+
+/* local function forward declarations */
+static bool MeasuringPlanningPhases(void);
+static void LogPlanningPhaseStats(PlanningPhaseStats *stats);
+
+
+/*
+ * BeginPlanningPhaseStats is called when the distributed planner is entered.
+ * When one of the planning phase settings is enabled, the outermost call
+ * resets the measurements and starts the clock for the total planning time.
+ */
+void
+BeginPlanningPhaseStats(void)
+{
+	PlanningNestingLevel++;
+
+	if (PlanningNestingLevel > 1)
+	{
+		return;
+	}
+
+	PlanningPhaseStatsActive = LogPlanningPhases || ExplainPlanningPhases;
+	if (!PlanningPhaseStatsActive)
+	{
+		return;
+	}
+
+	memset(&CurrentPlanningPhaseStats, 0, sizeof(PlanningPhaseStats));
+	INSTR_TIME_SET_CURRENT(CurrentPlanningPhaseStats.startTime);
+}
+
+
+/*
+ * EndPlanningPhaseStats is called when the distributed planner returns. The
+ * outermost call records the total planning time under the identifier of the
+ * distributed plan, such that EXPLAIN can tell whether the measurements
+ * belong to the plan it shows, and logs them if requested.
+ */
+void
+EndPlanningPhaseStats(uint64 planId)
+{
+	PlanningNestingLevel--;
+
+	if (PlanningNestingLevel > 0 || !PlanningPhaseStatsActive)
+	{
+		return;
+	}
+
+	PlanningPhaseStatsActive = false;
+
+	PlanningPhaseStats *stats = &CurrentPlanningPhaseStats;
+
+	INSTR_TIME_SET_CURRENT(stats->totalTime);
+	INSTR_TIME_SUBTRACT(stats->totalTime, stats->startTime);
+	stats->planId = planId;
+
+	if (LogPlanningPhases && planId != 0)
+	{
+		LogPlanningPhaseStats(stats);
+	}
+}
+
+
+/*
+ * AbortPlanningPhaseStats is called when the distributed planner throws an
+ * error, the measurements of the query are discarded.
+ */
+void
+AbortPlanningPhaseStats(void)
+{
+	PlanningNestingLevel--;
+
+	if (PlanningNestingLevel > 0)
+	{
+		return;
+	}
+
+	PlanningPhaseStatsActive = false;
+	CurrentPlanningPhaseStats.planId = 0;
+}
+
+
+/*
+ * MeasuringPlanningPhases returns whether the planning phases of the current
+ * call of the distributed planner are measured.
+ */
+static bool
+MeasuringPlanningPhases(void)
+{
+	return PlanningPhaseStatsActive && PlanningNestingLevel == 1;
+}
+
+
+/*
+ * BeginPlanningPhase stores the start time of a planning phase in the given
+ * variable, if the planning phases are measured.
+ */
+void
+BeginPlanningPhase(instr_time *phaseStartTime)
+{
+	if (!MeasuringPlanningPhases())
+	{
+		return;
+	}
+
+	INSTR_TIME_SET_CURRENT(*phaseStartTime);
+}
+
+
+/*
+ * EndPlanningPhase adds the time since the given start time to the given
+ * planning phase, if the planning phases are measured.
+ */
+void
+EndPlanningPhase(PlanningPhase phase, instr_time *phaseStartTime)
+{
+	instr_time phaseEndTime;
+
+	if (!MeasuringPlanningPhases())
+	{
+		return;
+	}
+
+	INSTR_TIME_SET_CURRENT(phaseEndTime);
+	INSTR_TIME_ACCUM_DIFF(CurrentPlanningPhaseStats.phaseTime[phase], phaseEndTime,
+						  *phaseStartTime);
+	CurrentPlanningPhaseStats.phaseCount[phase]++;
+}
+
+
+/*
+ * RecordShardPruning records a call of PruneShards() that considered and kept
+ * the given number of shards. Unlike the phase times, shard pruning is also
+ * counted for subqueries and CTEs that are planned separately.
+ */
+void
+RecordShardPruning(int candidateShardCount, int remainingShardCount)
+{
+	if (!PlanningPhaseStatsActive)
+	{
+		return;
+	}
+
+	CurrentPlanningPhaseStats.pruningCount++;
+	CurrentPlanningPhaseStats.candidateShardCount += candidateShardCount;
+	CurrentPlanningPhaseStats.remainingShardCount += remainingShardCount;
+}
+
+
+/*
+ * ExplainPlanningPhaseStats shows the time spent in each of the phases that
+ * planning the distributed plan with the given identifier went through, as
+ * long as that plan is the one planned last and citus.explain_planning_phases
+ * is enabled. Nothing is shown for plans that were taken from the plan cache.
+ */
+void
+ExplainPlanningPhaseStats(uint64 planId, ExplainState *es)
+{
+	PlanningPhaseStats *stats = &CurrentPlanningPhaseStats;
+
+	if (!ExplainPlanningPhases || planId == 0 || stats->planId != planId)
+	{
+		return;
+	}
+
+	ExplainOpenGroup("Planning Phases", "Planning Phases", true, es);
+
+	if (es->format == EXPLAIN_FORMAT_TEXT)
+	{
+		appendStringInfoSpaces(es->str, es->indent * 2);
+		appendStringInfo(es->str, "Planning Phases:\n");
+		es->indent++;
+	}
+
+	ExplainPropertyFloat("Total Time", "ms",
+						 INSTR_TIME_GET_MILLISEC(stats->totalTime), 3, es);
+
+	for (int phase = 0; phase < PLANNING_PHASE_COUNT; phase++)
+	{
+		if (stats->phaseCount[phase] == 0)
+		{
+			continue;
+		}
+
+		StringInfo phaseLabel = makeStringInfo();
+		appendStringInfo(phaseLabel, "%s Time", PlanningPhaseNames[phase]);
+
+		ExplainPropertyFloat(phaseLabel->data, "ms",
+							 INSTR_TIME_GET_MILLISEC(stats->phaseTime[phase]), 3, es);
+	}
+
+	ExplainPropertyInteger("Shard Pruning Calls", NULL, stats->pruningCount, es);
+	ExplainPropertyInteger("Shards Considered", NULL, stats->candidateShardCount, es);
+	ExplainPropertyInteger("Shards Remaining", NULL, stats->remainingShardCount, es);
+
+	if (es->format == EXPLAIN_FORMAT_TEXT)
+	{
+		es->indent--;
+	}
+
+	ExplainCloseGroup("Planning Phases", "Planning Phases", true, es);
+}
+
+
+/*
+ * LogPlanningPhaseStats logs the time spent in each planning phase and the
+ * shard pruning counts of a distributed query.
+ */
+static void
+LogPlanningPhaseStats(PlanningPhaseStats *stats)
+{
+	StringInfo phaseDetail = makeStringInfo();
+
+	for (int phase = 0; phase < PLANNING_PHASE_COUNT; phase++)
+	{
+		if (stats->phaseCount[phase] == 0)
+		{
+			continue;
+		}
+
+		appendStringInfo(phaseDetail, "%s: %.3f ms, ", PlanningPhaseNames[phase],
+						 INSTR_TIME_GET_MILLISEC(stats->phaseTime[phase]));
+	}
+
+	appendStringInfo(phaseDetail, "Shard Pruning: %d calls, " INT64_FORMAT
+					 " of " INT64_FORMAT " shards remaining",
+					 stats->pruningCount, stats->remainingShardCount,
+					 stats->candidateShardCount);
+
+	ereport(LOG, (errmsg("distributed planning took %.3f ms",
+						 INSTR_TIME_GET_MILLISEC(stats->totalTime)),
+				  errdetail("%s", phaseDetail->data)));
+}
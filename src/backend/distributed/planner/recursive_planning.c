@@ -52,8 +52,10 @@
 #include "postgres.h"
 #include "funcapi.h"
 
+#include "access/sysattr.h"
 #include "catalog/pg_type.h"
 #include "catalog/pg_class.h"
+#include "catalog/pg_namespace.h"
 #include "distributed/citus_nodes.h"
 #include "distributed/citus_ruleutils.h"
 #include "distributed/commands/multi_copy.h"
@@ -61,20 +63,36 @@
 #include "distributed/errormessage.h"
 #include "distributed/log_utils.h"
 #include "distributed/metadata_cache.h"
+#include "distributed/multi_join_order.h"
+#include "distributed/multi_logical_optimizer.h"
 #include "distributed/multi_logical_planner.h"
 #include "distributed/multi_router_planner.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/multi_server_executor.h"
 #include "distributed/query_colocation_checker.h"
 #include "distributed/query_pushdown_planning.h"
+#include "distributed/query_utils.h"
 #include "distributed/recursive_planning.h"
 #include "distributed/relation_restriction_equivalence.h"
 #include "distributed/log_utils.h"
+#include "distributed/shard_pruning.h"
+#include "distributed/subplan_execution.h"
 #include "distributed/version_compat.h"
 #include "lib/stringinfo.h"
+#if PG_VERSION_NUM >= 120000
+#include "optimizer/optimizer.h"
+#else
+#include "optimizer/clauses.h"
+#include "optimizer/var.h"
+#endif
 #include "optimizer/planner.h"
 #include "optimizer/prep.h"
+#include "parser/parse_clause.h"
+#include "parser/parse_coerce.h"
+#include "parser/parse_func.h"
+#include "parser/parse_oper.h"
 #include "parser/parsetree.h"
+#include "rewrite/rewriteManip.h"
 #include "nodes/makefuncs.h"
 #include "nodes/nodeFuncs.h"
 #include "nodes/nodes.h"
@@ -87,11 +105,44 @@
 #endif
 #include "utils/builtins.h"
 #include "utils/guc.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
 
 
 /* track depth of current recursive planner query */
 static int recursivePlanningDepth = 0;
 
+/* when this is true, correlated EXISTS subqueries are decorrelated */
+bool EnableSubqueryDecorrelation = false;
+
+/* when this is true, grouping by non-distribution columns uses repartitioning */
+bool EnableRepartitionAggregation = false;
+
+/* when this is true, aggregates and UNION deduplication move into union branches */
+bool EnableUnionAggregatePushdown = false;
+
+/* when this is true, single shard sides of non-colocated joins move between workers */
+bool EnableSingleShardJoinTransfer = false;
+
+/*
+ * UnionAllAggregateContext is used to replace the aggregates of a query on a
+ * UNION ALL subquery with final aggregates over the partial aggregates that
+ * the branches of the subquery compute.
+ */
+typedef struct UnionAllAggregateContext
+{
+	Index unionRangeTableIndex;
+
+	/* columns of the UNION ALL subquery in the GROUP BY of the query */
+	List *groupColumnList;
+
+	/* aggregates of the query, which the branches compute partially */
+	List *aggregateList;
+
+	/* whether a final aggregate could not be built */
+	bool failed;
+} UnionAllAggregateContext;
+
 /*
  * RecursivePlanningContext is used to recursively plan subqueries
  * and CTEs, pull results to the coordinator, and push it back into
@@ -104,6 +155,9 @@ typedef struct RecursivePlanningContext
 	bool allDistributionKeysInQueryAreEqual; /* used for some optimizations */
 	List *subPlanList;
 	PlannerRestrictionContext *plannerRestrictionContext;
+
+	/* subquery that is planned via repartitioning instead */
+	Query *repartitionSubquery;
 } RecursivePlanningContext;
 
 
@@ -155,8 +209,43 @@ static bool RecursivelyPlanAllSubqueries(Node *node,
 static DeferredErrorMessage * RecursivelyPlanCTEs(Query *query,
 												  RecursivePlanningContext *context);
 static bool RecursivelyPlanSubqueryWalker(Node *node, RecursivePlanningContext *context);
+static Query * RepartitionSubquery(Query *query);
+static bool AggregationCanBeRepartitioned(Query *query);
+static bool AggregatesCanBeRepartitioned(Query *query);
+static bool SubqueryAcceptsHavingQuals(Query *subquery);
+static bool QualCanBePushedIntoHaving(Node *qual, Index rangeTableIndex,
+									  Query *subquery);
+static bool UnionAllLeafList(Node *node, List **leafIndexList);
+static bool UnionAllLeafColumnsMatch(Query *unionQuery, List *leafIndexList);
+static bool AggregateCanBeSplitAcrossUnionAll(Aggref *aggregate);
+static Node * ReplaceUnionAllAggregatesMutator(Node *node,
+											   UnionAllAggregateContext *context);
+static Expr * FinalUnionAllAggregate(Aggref *partialAggregate, Var *partialColumn);
+static Query * PartialAggregateLeafQuery(RangeTblEntry *leafRangeTableEntry,
+										 Index unionRangeTableIndex,
+										 List *partialExpressionList,
+										 List *columnNameList, List *groupClauseList);
+static void SetUnionColumnTypes(Node *node, List *partialExpressionList);
+static bool IsUnionOnlySetOperation(Node *node);
+static void DeduplicateUnionLeafQueries(Query *query, Node *node,
+										bool parentDeduplicates);
 static bool ShouldRecursivelyPlanSubquery(Query *subquery,
 										  RecursivePlanningContext *context);
+static void RecursivelyPlanSingleShardRelations(Query *query,
+												RecursivePlanningContext *context);
+static void InnerJoinRangeTableIndexList(Node *joinNode, List **rangeTableIndexList);
+static List * SingleRelationQualList(List *qualList, Index rangeTableIndex);
+static bool OnlyUserColumnsReferenced(Query *query, Index rangeTableIndex);
+static Query * WrapRelationIntoFilteredSubquery(RangeTblEntry *rangeTableEntry,
+												 List *qualList);
+static void RecursivelyPlanCorrelatedSubqueriesInWhere(Query *query,
+														RecursivePlanningContext *
+														context);
+static Node * DecorrelateExistsSubquery(Query *query, Node *qual,
+										RecursivePlanningContext *context);
+static bool SubqueryCanBeDecorrelated(Query *subquery);
+static bool IsDistributionColumnReference(Node *node, List *rangeTableList);
+static bool ExpressionContainsReferencesToOuterQuery(Node *node);
 static bool AllDistributionKeysInSubqueryAreEqual(Query *subquery,
 												  PlannerRestrictionContext *
 												  restrictionContext);
@@ -169,6 +258,8 @@ static void RecursivelyPlanSubquery(Query *subquery,
 									RecursivePlanningContext *planningContext);
 static DistributedSubPlan * CreateDistributedSubPlan(uint32 subPlanId,
 													 Query *subPlanQuery);
+static char * SubPlanQueryKey(Query *subPlanQuery);
+static bool IsParam(Node *node);
 static bool CteReferenceListWalker(Node *node, CteReferenceWalkerContext *context);
 static bool ContainsReferencesToOuterQuery(Query *query);
 static bool ContainsReferencesToOuterQueryWalker(Node *node,
@@ -200,6 +291,7 @@ GenerateSubplansForSubqueriesAndCTEs(uint64 planId, Query *originalQuery,
 	context.planId = planId;
 	context.subPlanList = NIL;
 	context.plannerRestrictionContext = plannerRestrictionContext;
+	context.repartitionSubquery = RepartitionSubquery(originalQuery);
 
 	/*
 	 * Calculating the distribution key equality upfront is a trade-off for us.
@@ -281,6 +373,16 @@ RecursivelyPlanSubqueriesAndCTEs(Query *query, RecursivePlanningContext *context
 	/* make sure function calls in joins are executed in the coordinator */
 	WrapFunctionsInSubqueries(query);
 
+	/*
+	 * Correlated subqueries cannot be recursively planned, so we first turn
+	 * [NOT] EXISTS subqueries that are not correlated on the distribution
+	 * columns into uncorrelated ones and plan them.
+	 */
+	if (EnableSubqueryDecorrelation)
+	{
+		RecursivelyPlanCorrelatedSubqueriesInWhere(query, context);
+	}
+
 	/* descend into subqueries */
 	query_tree_walker(query, RecursivelyPlanSubqueryWalker, context, 0);
 
@@ -296,6 +398,16 @@ RecursivelyPlanSubqueriesAndCTEs(Query *query, RecursivePlanningContext *context
 
 	if (ShouldRecursivelyPlanSetOperation(query, context))
 	{
+		/*
+		 * UNION removes duplicates anyway, so each branch can send only its
+		 * distinct rows to the coordinator.
+		 */
+		if (EnableUnionAggregatePushdown &&
+			IsUnionOnlySetOperation(query->setOperations))
+		{
+			DeduplicateUnionLeafQueries(query, query->setOperations, false);
+		}
+
 		RecursivelyPlanSetOperations(query, (Node *) query->setOperations, context);
 	}
 
@@ -319,6 +431,17 @@ RecursivelyPlanSubqueriesAndCTEs(Query *query, RecursivePlanningContext *context
 		RecursivelyPlanNonColocatedSubqueries(query, context);
 	}
 
+	/*
+	 * Distributed tables that are filtered down to a single shard and joined
+	 * with tables they are not colocated with are moved to the nodes of the
+	 * other tables, rather than repartitioning the join.
+	 */
+	if (EnableSingleShardJoinTransfer && context->level == 0 &&
+		!context->allDistributionKeysInQueryAreEqual)
+	{
+		RecursivelyPlanSingleShardRelations(query, context);
+	}
+
 	return NULL;
 }
 
@@ -905,188 +1028,1864 @@ ShouldRecursivelyPlanSubquery(Query *subquery, RecursivePlanningContext *context
 		 */
 		return false;
 	}
+	else if (subquery == context->repartitionSubquery)
+	{
+		/*
+		 * The window functions or the final aggregates of the subquery are
+		 * evaluated on the workers after repartitioning.
+		 */
+		return false;
+	}
 
 	return true;
 }
 
 
 /*
- * AllDistributionKeysInSubqueryAreEqual is a wrapper function
- * for AllDistributionKeysInQueryAreEqual(). Here, we filter the
- * planner restrictions for the given subquery and do the restriction
- * equality checks on the filtered restriction.
+ * RecursivelyPlanSingleShardRelations recursively plans the distributed tables
+ * of the given query whose filters in the WHERE clause prune them to a single
+ * shard, as long as another distributed table remains in the query. Each of
+ * these tables is replaced by a subquery that applies its filters, such that
+ * the subplan is a router query. The subplan executor then lets the nodes
+ * that need the result fetch it directly from the node of the shard, and the
+ * remaining tables are joined with it without repartitioning.
+ *
+ * We only consider tables that are inner joined with the rest of the query,
+ * since the filters of the WHERE clause may not be applied before an outer
+ * join. Tables whose system columns or whole rows the query uses keep being
+ * planned as they are.
  */
-static bool
-AllDistributionKeysInSubqueryAreEqual(Query *subquery,
-									  PlannerRestrictionContext *restrictionContext)
+static void
+RecursivelyPlanSingleShardRelations(Query *query, RecursivePlanningContext *context)
 {
-	/* we don't support distribution eq. checks for CTEs yet */
-	if (subquery->cteList != NIL)
+	List *rangeTableIndexList = NIL;
+	List *singleShardIndexList = NIL;
+	ListCell *rangeTableIndexCell = NULL;
+	ListCell *rangeTableCell = NULL;
+	int distributedTableCount = 0;
+
+	if (query->commandType != CMD_SELECT || query->hasSubLinks ||
+		query->setOperations != NULL)
 	{
-		return false;
+		return;
 	}
 
-	PlannerRestrictionContext *filteredRestrictionContext =
-		FilterPlannerRestrictionForQuery(restrictionContext, subquery);
+	foreach(rangeTableCell, query->rtable)
+	{
+		RangeTblEntry *rangeTableEntry = (RangeTblEntry *) lfirst(rangeTableCell);
 
-	bool allDistributionKeysInSubqueryAreEqual =
-		AllDistributionKeysInQueryAreEqual(subquery, filteredRestrictionContext);
-	if (!allDistributionKeysInSubqueryAreEqual)
+		if (rangeTableEntry->rtekind == RTE_RELATION &&
+			IsDistributedTable(rangeTableEntry->relid) &&
+			PartitionMethod(rangeTableEntry->relid) != DISTRIBUTE_BY_NONE)
+		{
+			distributedTableCount++;
+		}
+	}
+
+	if (distributedTableCount < 2)
 	{
-		return false;
+		return;
 	}
 
-	return true;
+	List *qualList = make_ands_implicit((Expr *) query->jointree->quals);
+
+	InnerJoinRangeTableIndexList((Node *) query->jointree, &rangeTableIndexList);
+
+	foreach(rangeTableIndexCell, rangeTableIndexList)
+	{
+		Index rangeTableIndex = (Index) lfirst_int(rangeTableIndexCell);
+		RangeTblEntry *rangeTableEntry = rt_fetch(rangeTableIndex, query->rtable);
+
+		if (rangeTableEntry->rtekind != RTE_RELATION ||
+			!IsDistributedTable(rangeTableEntry->relid) ||
+			PartitionMethod(rangeTableEntry->relid) == DISTRIBUTE_BY_NONE)
+		{
+			continue;
+		}
+
+		if (!OnlyUserColumnsReferenced(query, rangeTableIndex))
+		{
+			continue;
+		}
+
+		List *relationQualList = SingleRelationQualList(qualList, rangeTableIndex);
+		if (relationQualList == NIL)
+		{
+			continue;
+		}
+
+		/* the filters refer to the table as the only entry of the subquery */
+		List *prunedShardList = PruneShards(rangeTableEntry->relid, 1,
+											relationQualList, NULL);
+		if (list_length(prunedShardList) != 1)
+		{
+			continue;
+		}
+
+		singleShardIndexList = lappend_int(singleShardIndexList, rangeTableIndex);
+	}
+
+	foreach(rangeTableIndexCell, singleShardIndexList)
+	{
+		Index rangeTableIndex = (Index) lfirst_int(rangeTableIndexCell);
+		RangeTblEntry *rangeTableEntry = rt_fetch(rangeTableIndex, query->rtable);
+
+		/* keep one distributed table for the other tables to be joined with */
+		if (distributedTableCount < 2)
+		{
+			break;
+		}
+
+		List *relationQualList = SingleRelationQualList(qualList, rangeTableIndex);
+		Query *subquery = WrapRelationIntoFilteredSubquery(rangeTableEntry,
+														   relationQualList);
+
+		rangeTableEntry->rtekind = RTE_SUBQUERY;
+		rangeTableEntry->subquery = subquery;
+		rangeTableEntry->relid = InvalidOid;
+		rangeTableEntry->relkind = 0;
+		rangeTableEntry->tablesample = NULL;
+		rangeTableEntry->inh = false;
+		rangeTableEntry->values_lists = NIL;
+
+		RecursivelyPlanSubquery(subquery, context);
+
+		distributedTableCount--;
+	}
 }
 
 
 /*
- * ShouldRecursivelyPlanSetOperation determines whether the leaf queries of a
- * set operations tree need to be recursively planned in order to support the
- * query as a whole.
+ * InnerJoinRangeTableIndexList adds the range table indexes of the entries in
+ * the given join tree that are only inner joined with the other entries to
+ * the given list.
  */
-static bool
-ShouldRecursivelyPlanSetOperation(Query *query, RecursivePlanningContext *context)
+static void
+InnerJoinRangeTableIndexList(Node *joinNode, List **rangeTableIndexList)
 {
-	SetOperationStmt *setOperations = (SetOperationStmt *) query->setOperations;
-	if (setOperations == NULL)
+	if (joinNode == NULL)
 	{
-		return false;
+		return;
 	}
 
-	if (context->level == 0)
+	if (IsA(joinNode, RangeTblRef))
 	{
-		/*
-		 * We cannot push down top-level set operation. Recursively plan the
-		 * leaf nodes such that it becomes a router query.
-		 */
-		return true;
-	}
+		RangeTblRef *rangeTableRef = (RangeTblRef *) joinNode;
 
-	if (setOperations->op != SETOP_UNION)
-	{
-		/*
-		 * We can only push down UNION operaionts, plan other set operations
-		 * recursively.
-		 */
-		return true;
+		*rangeTableIndexList = lappend_int(*rangeTableIndexList,
+										   rangeTableRef->rtindex);
 	}
+	else if (IsA(joinNode, FromExpr))
+	{
+		FromExpr *fromExpr = (FromExpr *) joinNode;
+		ListCell *fromCell = NULL;
 
-	if (DeferErrorIfUnsupportedUnionQuery(query) != NULL)
+		foreach(fromCell, fromExpr->fromlist)
+		{
+			InnerJoinRangeTableIndexList((Node *) lfirst(fromCell), rangeTableIndexList);
+		}
+	}
+	else if (IsA(joinNode, JoinExpr))
 	{
-		/*
-		 * If at least one leaf query in the union is recurring, then all
-		 * leaf nodes need to be recurring.
-		 */
-		return true;
+		JoinExpr *joinExpr = (JoinExpr *) joinNode;
+
+		if (joinExpr->jointype == JOIN_INNER)
+		{
+			InnerJoinRangeTableIndexList(joinExpr->larg, rangeTableIndexList);
+			InnerJoinRangeTableIndexList(joinExpr->rarg, rangeTableIndexList);
+		}
 	}
+}
 
-	PlannerRestrictionContext *filteredRestrictionContext =
-		FilterPlannerRestrictionForQuery(context->plannerRestrictionContext, query);
-	if (!SafeToPushdownUnionSubquery(filteredRestrictionContext))
+
+/*
+ * SingleRelationQualList returns copies of the given filters that only refer
+ * to the range table entry with the given index, with their columns changed
+ * to refer to the first range table entry. Filters with volatile functions
+ * are skipped, since they should be evaluated once per row of the join.
+ */
+static List *
+SingleRelationQualList(List *qualList, Index rangeTableIndex)
+{
+	List *relationQualList = NIL;
+	ListCell *qualCell = NULL;
+
+	foreach(qualCell, qualList)
 	{
-		/*
-		 * The distribution column is not in the same place in all sides
-		 * of the union, meaning we cannot determine distribution column
-		 * equivalence. Recursive planning is necessary.
-		 */
-		return true;
+		Node *qual = (Node *) lfirst(qualCell);
+		Relids qualRelids = pull_varnos(qual);
+
+		if (!bms_equal(qualRelids, bms_make_singleton(rangeTableIndex)) ||
+			contain_volatile_functions(qual))
+		{
+			continue;
+		}
+
+		Node *relationQual = copyObject(qual);
+		ChangeVarNodes(relationQual, rangeTableIndex, 1, 0);
+
+		relationQualList = lappend(relationQualList, relationQual);
 	}
 
-	return false;
+	return relationQualList;
 }
 
 
 /*
- * RecursivelyPlanSetOperations descends into a tree of set operations
- * (e.g. UNION, INTERSECTS) and recursively plans all leaf nodes that
- * contain distributed tables.
+ * OnlyUserColumnsReferenced returns whether the given query only refers to
+ * the user columns of the range table entry with the given index, but not to
+ * its system columns or its whole row.
  */
-static void
-RecursivelyPlanSetOperations(Query *query, Node *node,
-							 RecursivePlanningContext *context)
+static bool
+OnlyUserColumnsReferenced(Query *query, Index rangeTableIndex)
 {
-	if (IsA(node, SetOperationStmt))
-	{
-		SetOperationStmt *setOperations = (SetOperationStmt *) node;
+	Bitmapset *attributeSet = NULL;
+	int attributeIndex = -1;
 
-		RecursivelyPlanSetOperations(query, setOperations->larg, context);
-		RecursivelyPlanSetOperations(query, setOperations->rarg, context);
-	}
-	else if (IsA(node, RangeTblRef))
+	pull_varattnos((Node *) query->targetList, rangeTableIndex, &attributeSet);
+	pull_varattnos((Node *) query->jointree, rangeTableIndex, &attributeSet);
+	pull_varattnos(query->havingQual, rangeTableIndex, &attributeSet);
+
+	while ((attributeIndex = bms_next_member(attributeSet, attributeIndex)) >= 0)
 	{
-		RangeTblRef *rangeTableRef = (RangeTblRef *) node;
-		RangeTblEntry *rangeTableEntry = rt_fetch(rangeTableRef->rtindex,
-												  query->rtable);
-		Query *subquery = rangeTableEntry->subquery;
+		AttrNumber attributeNumber = attributeIndex + FirstLowInvalidHeapAttributeNumber;
 
-		if (rangeTableEntry->rtekind == RTE_SUBQUERY &&
-			QueryContainsDistributedTableRTE(subquery))
+		if (attributeNumber <= 0)
 		{
-			RecursivelyPlanSubquery(subquery, context);
+			return false;
 		}
 	}
-	else
+
+	return true;
+}
+
+
+/*
+ * WrapRelationIntoFilteredSubquery returns a subquery that selects all columns
+ * of the relation of the given range table entry that pass the given filters.
+ * Dropped columns are selected as NULL, such that the columns of the subquery
+ * have the attribute numbers of the relation.
+ */
+static Query *
+WrapRelationIntoFilteredSubquery(RangeTblEntry *rangeTableEntry, List *qualList)
+{
+	Query *subquery = makeNode(Query);
+	RangeTblRef *rangeTableRef = makeNode(RangeTblRef);
+	List *targetList = NIL;
+
+	subquery->commandType = CMD_SELECT;
+
+	/* we copy the input entry to preserve its permissions and identity */
+	RangeTblEntry *relationRangeTableEntry = copyObject(rangeTableEntry);
+	subquery->rtable = list_make1(relationRangeTableEntry);
+
+	rangeTableRef->rtindex = 1;
+	subquery->jointree = makeFromExpr(list_make1(rangeTableRef),
+									  (Node *) make_ands_explicit(qualList));
+
+	Relation relation = RelationIdGetRelation(rangeTableEntry->relid);
+	TupleDesc tupleDescriptor = RelationGetDescr(relation);
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
 	{
-		ereport(ERROR, (errmsg("unexpected node type (%d) while "
-							   "expecting set operations or "
-							   "range table references", nodeTag(node))));
+		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
+		AttrNumber attributeNumber = columnIndex + 1;
+		Expr *columnExpression = NULL;
+		char *columnName = NULL;
+
+		if (attributeForm->attisdropped)
+		{
+			columnExpression = (Expr *) makeNullConst(INT4OID, -1, InvalidOid);
+			columnName = psprintf("dropped_column_%d", attributeNumber);
+		}
+		else
+		{
+			columnExpression = (Expr *) makeVar(rangeTableRef->rtindex, attributeNumber,
+												attributeForm->atttypid,
+												attributeForm->atttypmod,
+												attributeForm->attcollation, 0);
+			columnName = pstrdup(NameStr(attributeForm->attname));
+		}
+
+		TargetEntry *targetEntry = makeTargetEntry(columnExpression, attributeNumber,
+												   columnName, false);
+		targetList = lappend(targetList, targetEntry);
 	}
+
+	RelationClose(relation);
+
+	subquery->targetList = targetList;
+
+	return subquery;
 }
 
 
 /*
- * IsLocalTableRTE gets a node and returns true if the node
- * is a range table relation entry that points to a local
- * relation (i.e., not a distributed relation).
+ * RepartitionSubquery returns the FROM subquery of the given query if we plan
+ * it via repartitioning instead of pulling all of its rows to the coordinator.
+ * That is the case for subqueries whose window functions are evaluated after
+ * repartitioning by their PARTITION BY clauses, and for subqueries whose final
+ * aggregation happens after repartitioning by their GROUP BY clause. With the
+ * adaptive executor, this requires repartition joins to be enabled. The
+ * function returns NULL otherwise.
  */
-static bool
-IsLocalTableRTE(Node *node)
+static Query *
+RepartitionSubquery(Query *query)
 {
-	if (node == NULL)
+	List *rangeTableIndexList = NIL;
+
+	if (!EnableWindowFunctionRepartition && !EnableRepartitionAggregation)
 	{
-		return false;
+		return NULL;
 	}
 
-	if (!IsA(node, RangeTblEntry))
+	if (TaskExecutorType != MULTI_EXECUTOR_TASK_TRACKER && !EnableRepartitionJoins)
 	{
-		return false;
+		return NULL;
 	}
 
-	RangeTblEntry *rangeTableEntry = (RangeTblEntry *) node;
-	if (rangeTableEntry->rtekind != RTE_RELATION)
+	if (query->commandType != CMD_SELECT || !SingleRelationRepartitionSubquery(query))
 	{
-		return false;
+		return NULL;
 	}
 
-	if (rangeTableEntry->relkind == RELKIND_VIEW)
+	ExtractRangeTableIndexWalker((Node *) query->jointree, &rangeTableIndexList);
+
+	int rangeTableIndex = linitial_int(rangeTableIndexList);
+	RangeTblEntry *rangeTableEntry = rt_fetch(rangeTableIndex, query->rtable);
+	if (rangeTableEntry->rtekind != RTE_SUBQUERY)
 	{
-		return false;
+		return NULL;
 	}
 
-	Oid relationId = rangeTableEntry->relid;
-	if (IsDistributedTable(relationId))
+	Query *subquery = rangeTableEntry->subquery;
+	bool repartitionAggregation = EnableRepartitionAggregation && subquery->hasAggs &&
+								  AggregatesCanBeRepartitioned(subquery);
+	if (!subquery->hasWindowFuncs && !repartitionAggregation)
 	{
-		return false;
+		return NULL;
 	}
 
-	/* local table found */
-	return true;
+	if (DeferErrorIfUnsupportedSubqueryRepartition(subquery) != NULL)
+	{
+		return NULL;
+	}
+
+	return subquery;
 }
 
 
 /*
- * RecursivelyPlanQuery recursively plans a query, replaces it with a
- * result query and returns the subplan.
+ * WrapAggregationForRepartitioning moves the grouping of the given query into
+ * a FROM subquery if the query groups a single distributed table by columns
+ * other than its distribution column, such that
  *
- * Before we recursively plan the given subquery, we should ensure
- * that the subquery doesn't contain any references to the outer
- * queries (i.e., such queries cannot be separately planned). In
- * that case, the function doesn't recursively plan the input query
- * and immediately returns. Later, the planner decides on what to do
- * with the query.
- */
-static void
+ *   SELECT <targets> FROM t WHERE <quals> GROUP BY g HAVING <having>
+ *   ORDER BY <sort> LIMIT <limit>
+ *
+ * becomes
+ *
+ *   SELECT <columns> FROM
+ *     (SELECT <targets> FROM t WHERE <quals> GROUP BY g HAVING <having>) s
+ *   ORDER BY <sort> LIMIT <limit>
+ *
+ * The subquery is then planned via repartitioning: the workers compute the
+ * partial aggregates of their shards, hash partition them by the group key,
+ * and the merge tasks compute the final aggregates such that the coordinator
+ * only receives the final groups. The function returns true if it modified
+ * the query in place.
+ */
+bool
+WrapAggregationForRepartitioning(Query *query)
+{
+	List *outerTargetList = NIL;
+	List *columnNameList = NIL;
+	ListCell *targetEntryCell = NULL;
+
+	if (!AggregationCanBeRepartitioned(query))
+	{
+		return false;
+	}
+
+	Query *subquery = copyObject(query);
+	subquery->sortClause = NIL;
+	subquery->distinctClause = NIL;
+	subquery->hasDistinctOn = false;
+	subquery->limitCount = NULL;
+	subquery->limitOffset = NULL;
+
+	/*
+	 * The subquery returns all target entries, including the ones that only
+	 * exist for ORDER BY, and the outer query refers to them by position.
+	 */
+	foreach(targetEntryCell, subquery->targetList)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+		Node *expression = (Node *) targetEntry->expr;
+		StringInfo columnNameString = makeStringInfo();
+
+		appendStringInfo(columnNameString, WORKER_COLUMN_FORMAT, targetEntry->resno);
+
+		TargetEntry *outerTargetEntry =
+			flatCopyTargetEntry(list_nth(query->targetList, targetEntry->resno - 1));
+		outerTargetEntry->expr = (Expr *) makeVar(1, targetEntry->resno,
+												  exprType(expression),
+												  exprTypmod(expression),
+												  exprCollation(expression), 0);
+		outerTargetList = lappend(outerTargetList, outerTargetEntry);
+
+		targetEntry->resname = columnNameString->data;
+		targetEntry->resjunk = false;
+		columnNameList = lappend(columnNameList, makeString(columnNameString->data));
+	}
+
+	RangeTblEntry *rangeTableEntry = makeNode(RangeTblEntry);
+	rangeTableEntry->rtekind = RTE_SUBQUERY;
+	rangeTableEntry->subquery = subquery;
+	rangeTableEntry->alias = makeAlias("worker_subquery", NIL);
+	rangeTableEntry->eref = makeAlias("worker_subquery", columnNameList);
+	rangeTableEntry->inFromCl = true;
+
+	RangeTblRef *rangeTableRef = makeNode(RangeTblRef);
+	rangeTableRef->rtindex = 1;
+
+	query->rtable = list_make1(rangeTableEntry);
+	query->jointree = makeFromExpr(list_make1(rangeTableRef), NULL);
+	query->targetList = outerTargetList;
+	query->groupClause = NIL;
+	query->havingQual = NULL;
+	query->hasAggs = false;
+
+	ereport(DEBUG1, (errmsg("grouping by a non-distribution column via "
+							"repartitioning")));
+
+	return true;
+}
+
+
+/*
+ * PushDownQualsIntoAggregationSubquery moves the filters of the given query on
+ * the results of a FROM subquery whose final aggregation can happen after
+ * repartitioning into the HAVING clause of that subquery, such that
+ *
+ *   SELECT <columns> FROM (SELECT ... GROUP BY g) s WHERE <quals on s>
+ *
+ * becomes
+ *
+ *   SELECT <columns> FROM (SELECT ... GROUP BY g HAVING <quals>) s
+ *
+ * The merge tasks that compute the final aggregates then apply these filters,
+ * such that the coordinator only receives the groups that pass them. We only
+ * move filters that the PostgreSQL planner would also push into the subquery.
+ * The function returns true if it modified the query in place.
+ */
+bool
+PushDownQualsIntoAggregationSubquery(Query *query)
+{
+	List *pushedDownQualList = NIL;
+	List *remainingQualList = NIL;
+	ListCell *qualCell = NULL;
+
+	if (!EnableRepartitionAggregation)
+	{
+		return false;
+	}
+
+	if (TaskExecutorType != MULTI_EXECUTOR_TASK_TRACKER && !EnableRepartitionJoins)
+	{
+		return false;
+	}
+
+	if (query->commandType != CMD_SELECT || query->setOperations != NULL ||
+		query->jointree == NULL || query->jointree->quals == NULL)
+	{
+		return false;
+	}
+
+	List *fromList = query->jointree->fromlist;
+	if (list_length(fromList) != 1 || !IsA(linitial(fromList), RangeTblRef))
+	{
+		return false;
+	}
+
+	Index rangeTableIndex = ((RangeTblRef *) linitial(fromList))->rtindex;
+	RangeTblEntry *rangeTableEntry = rt_fetch(rangeTableIndex, query->rtable);
+	if (rangeTableEntry->rtekind != RTE_SUBQUERY ||
+		!SubqueryAcceptsHavingQuals(rangeTableEntry->subquery))
+	{
+		return false;
+	}
+
+	Query *subquery = rangeTableEntry->subquery;
+	List *qualList = make_ands_implicit((Expr *) query->jointree->quals);
+
+	foreach(qualCell, qualList)
+	{
+		Node *qual = (Node *) lfirst(qualCell);
+
+		if (!QualCanBePushedIntoHaving(qual, rangeTableIndex, subquery))
+		{
+			remainingQualList = lappend(remainingQualList, qual);
+			continue;
+		}
+
+		/* replace references to the subquery with its target expressions */
+		Node *havingQual = ReplaceVarsFromTargetList(qual, rangeTableIndex, 0,
+													 rangeTableEntry,
+													 subquery->targetList,
+													 REPLACEVARS_REPORT_ERROR, 0,
+													 NULL);
+		pushedDownQualList = lappend(pushedDownQualList, havingQual);
+	}
+
+	if (pushedDownQualList == NIL)
+	{
+		return false;
+	}
+
+	if (subquery->havingQual != NULL)
+	{
+		pushedDownQualList = lcons(subquery->havingQual, pushedDownQualList);
+	}
+
+	subquery->havingQual = (Node *) make_ands_explicit(pushedDownQualList);
+
+	if (remainingQualList != NIL)
+	{
+		query->jointree->quals = (Node *) make_ands_explicit(remainingQualList);
+	}
+	else
+	{
+		query->jointree->quals = NULL;
+	}
+
+	ereport(DEBUG1, (errmsg("pushing down filters into the having clause of a "
+							"repartitioned subquery")));
+
+	return true;
+}
+
+
+/*
+ * SubqueryAcceptsHavingQuals returns true if the given subquery has a final
+ * aggregation that can happen after repartitioning, and filtering its results
+ * is the same as adding the filters to its HAVING clause. That is not the case
+ * when the subquery applies a LIMIT, DISTINCT, window functions or set
+ * returning functions after the aggregation.
+ */
+static bool
+SubqueryAcceptsHavingQuals(Query *subquery)
+{
+	if (!subquery->hasAggs || subquery->groupClause == NIL ||
+		subquery->groupingSets != NIL || subquery->setOperations != NULL ||
+		subquery->limitCount != NULL || subquery->limitOffset != NULL ||
+		subquery->distinctClause != NIL || subquery->hasWindowFuncs ||
+		subquery->hasTargetSRFs || subquery->rowMarks != NIL)
+	{
+		return false;
+	}
+
+	return AggregatesCanBeRepartitioned(subquery);
+}
+
+
+/*
+ * QualCanBePushedIntoHaving returns true if the given filter of the outer query
+ * only refers to columns of the subquery at the given range table index whose
+ * target expressions are not volatile, and is not volatile itself, such that
+ * evaluating it in the HAVING clause of the subquery gives the same result.
+ */
+static bool
+QualCanBePushedIntoHaving(Node *qual, Index rangeTableIndex, Query *subquery)
+{
+	ListCell *columnCell = NULL;
+
+	if (contain_volatile_functions(qual) || checkExprHasSubLink(qual))
+	{
+		return false;
+	}
+
+	List *columnList = pull_var_clause_default(qual);
+	if (columnList == NIL)
+	{
+		return false;
+	}
+
+	foreach(columnCell, columnList)
+	{
+		Var *column = (Var *) lfirst(columnCell);
+
+		/* whole-row references cannot be replaced by a single expression */
+		if (column->varno != rangeTableIndex || column->varattno <= 0)
+		{
+			return false;
+		}
+
+		TargetEntry *targetEntry = get_tle_by_resno(subquery->targetList,
+													column->varattno);
+		if (targetEntry == NULL ||
+			contain_volatile_functions((Node *) targetEntry->expr))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * PushDownAggregatesIntoUnionAll moves the aggregation of the given query on a
+ * UNION ALL subquery into the branches of the subquery, such that
+ *
+ *   SELECT g, count(*), max(v) FROM (<q1> UNION ALL <q2>) u GROUP BY g
+ *
+ * becomes
+ *
+ *   SELECT g, sum(c)::bigint, max(m) FROM
+ *     (SELECT g, count(*) c, max(v) m FROM (<q1>) q1 GROUP BY g
+ *      UNION ALL
+ *      SELECT g, count(*) c, max(v) m FROM (<q2>) q2 GROUP BY g) u
+ *   GROUP BY g
+ *
+ * When the branches are not colocated, each of them is recursively planned,
+ * and the workers then aggregate the rows of each branch instead of sending
+ * all of them through the coordinator. This only applies to queries grouped by
+ * columns of the subquery whose aggregates can be combined from the partial
+ * aggregates of the branches. The function returns true if it modified the
+ * query in place.
+ */
+bool
+PushDownAggregatesIntoUnionAll(Query *query)
+{
+	UnionAllAggregateContext context;
+	List *leafIndexList = NIL;
+	List *partialGroupClauseList = NIL;
+	List *columnNameList = NIL;
+	ListCell *cell = NULL;
+
+	if (!EnableUnionAggregatePushdown)
+	{
+		return false;
+	}
+
+	if (query->commandType != CMD_SELECT || !query->hasAggs ||
+		query->groupingSets != NIL || query->cteList != NIL ||
+		query->setOperations != NULL || query->hasSubLinks ||
+		query->hasWindowFuncs || query->hasTargetSRFs || query->rowMarks != NIL ||
+		query->jointree == NULL || query->jointree->quals != NULL)
+	{
+		return false;
+	}
+
+	List *fromList = query->jointree->fromlist;
+	if (list_length(fromList) != 1 || !IsA(linitial(fromList), RangeTblRef))
+	{
+		return false;
+	}
+
+	Index unionRangeTableIndex = ((RangeTblRef *) linitial(fromList))->rtindex;
+	RangeTblEntry *unionRangeTableEntry = rt_fetch(unionRangeTableIndex, query->rtable);
+	if (unionRangeTableEntry->rtekind != RTE_SUBQUERY)
+	{
+		return false;
+	}
+
+	Query *unionQuery = unionRangeTableEntry->subquery;
+	if (unionQuery->setOperations == NULL || unionQuery->cteList != NIL ||
+		unionQuery->sortClause != NIL || unionQuery->limitCount != NULL ||
+		unionQuery->limitOffset != NULL || unionQuery->rowMarks != NIL)
+	{
+		return false;
+	}
+
+	if (!UnionAllLeafList(unionQuery->setOperations, &leafIndexList) ||
+		!UnionAllLeafColumnsMatch(unionQuery, leafIndexList))
+	{
+		return false;
+	}
+
+	memset(&context, 0, sizeof(context));
+	context.unionRangeTableIndex = unionRangeTableIndex;
+
+	/* the branches group by the columns that the query groups by */
+	foreach(cell, query->groupClause)
+	{
+		SortGroupClause *groupClause = (SortGroupClause *) lfirst(cell);
+		TargetEntry *groupTargetEntry = get_sortgroupclause_tle(groupClause,
+																query->targetList);
+		Var *groupColumn = (Var *) groupTargetEntry->expr;
+
+		if (!IsA(groupColumn, Var) || groupColumn->varno != unionRangeTableIndex ||
+			groupColumn->varlevelsup != 0 || groupColumn->varattno <= 0)
+		{
+			return false;
+		}
+
+		if (list_member(context.groupColumnList, groupColumn))
+		{
+			continue;
+		}
+
+		SortGroupClause *partialGroupClause = copyObject(groupClause);
+		partialGroupClause->tleSortGroupRef = list_length(context.groupColumnList) + 1;
+
+		context.groupColumnList = lappend(context.groupColumnList, groupColumn);
+		partialGroupClauseList = lappend(partialGroupClauseList, partialGroupClause);
+	}
+
+	/* the branches compute each distinct aggregate of the query once */
+	List *expressionList = pull_var_clause((Node *) query->targetList,
+										   PVC_INCLUDE_AGGREGATES);
+	expressionList = list_concat(expressionList,
+								 pull_var_clause(query->havingQual,
+												 PVC_INCLUDE_AGGREGATES));
+	foreach(cell, expressionList)
+	{
+		Node *expression = (Node *) lfirst(cell);
+
+		if (IsA(expression, Aggref))
+		{
+			if (!AggregateCanBeSplitAcrossUnionAll((Aggref *) expression))
+			{
+				return false;
+			}
+
+			context.aggregateList = list_append_unique(context.aggregateList,
+													   expression);
+		}
+		else if (!list_member(context.groupColumnList, expression))
+		{
+			return false;
+		}
+	}
+
+	List *partialExpressionList = list_concat(list_copy(context.groupColumnList),
+											  list_copy(context.aggregateList));
+	for (int columnIndex = 1; columnIndex <= list_length(partialExpressionList);
+		 columnIndex++)
+	{
+		StringInfo columnNameString = makeStringInfo();
+		appendStringInfo(columnNameString, WORKER_COLUMN_FORMAT, columnIndex);
+
+		columnNameList = lappend(columnNameList, makeString(columnNameString->data));
+	}
+
+	/* build the final aggregates before modifying anything */
+	List *targetList =
+		(List *) ReplaceUnionAllAggregatesMutator((Node *) query->targetList,
+												  &context);
+	Node *havingQual = ReplaceUnionAllAggregatesMutator(query->havingQual, &context);
+	if (context.failed)
+	{
+		return false;
+	}
+
+	foreach(cell, leafIndexList)
+	{
+		int leafIndex = lfirst_int(cell);
+		RangeTblEntry *leafRangeTableEntry = rt_fetch(leafIndex, unionQuery->rtable);
+		Query *leafQuery = PartialAggregateLeafQuery(leafRangeTableEntry,
+													 unionRangeTableIndex,
+													 partialExpressionList,
+													 columnNameList,
+													 partialGroupClauseList);
+
+		RangeTblEntry *partialRangeTableEntry = makeNode(RangeTblEntry);
+		partialRangeTableEntry->rtekind = RTE_SUBQUERY;
+		partialRangeTableEntry->subquery = leafQuery;
+		partialRangeTableEntry->eref = makeAlias(leafRangeTableEntry->eref->aliasname,
+												 columnNameList);
+		partialRangeTableEntry->inFromCl = false;
+
+		lfirst(list_nth_cell(unionQuery->rtable, leafIndex - 1)) =
+			partialRangeTableEntry;
+	}
+
+	/* the output of a set operation refers to its leftmost leaf */
+	int leftmostLeafIndex = linitial_int(leafIndexList);
+	List *unionTargetList = NIL;
+	int columnIndex = 0;
+	foreach(cell, partialExpressionList)
+	{
+		Node *partialExpression = (Node *) lfirst(cell);
+		char *columnName = strVal(list_nth(columnNameList, columnIndex));
+
+		columnIndex++;
+
+		Var *unionColumn = makeVar(leftmostLeafIndex, columnIndex,
+								   exprType(partialExpression),
+								   exprTypmod(partialExpression),
+								   exprCollation(partialExpression), 0);
+		unionTargetList = lappend(unionTargetList,
+								  makeTargetEntry((Expr *) unionColumn, columnIndex,
+												  columnName, false));
+	}
+
+	unionQuery->targetList = unionTargetList;
+	SetUnionColumnTypes(unionQuery->setOperations, partialExpressionList);
+
+	unionRangeTableEntry->eref = makeAlias(unionRangeTableEntry->eref->aliasname,
+										   columnNameList);
+	if (unionRangeTableEntry->alias != NULL)
+	{
+		unionRangeTableEntry->alias =
+			makeAlias(unionRangeTableEntry->alias->aliasname, NIL);
+	}
+
+	query->targetList = targetList;
+	query->havingQual = havingQual;
+
+	ereport(DEBUG1, (errmsg("pushing down aggregates into the branches of a "
+							"union all subquery")));
+
+	return true;
+}
+
+
+/*
+ * UnionAllLeafList appends the range table indexes of the leaves of the given
+ * set operations tree to leafIndexList, from left to right, and returns false
+ * if the tree contains any set operation other than UNION ALL.
+ */
+static bool
+UnionAllLeafList(Node *node, List **leafIndexList)
+{
+	if (IsA(node, SetOperationStmt))
+	{
+		SetOperationStmt *setOperations = (SetOperationStmt *) node;
+
+		if (setOperations->op != SETOP_UNION || !setOperations->all)
+		{
+			return false;
+		}
+
+		return UnionAllLeafList(setOperations->larg, leafIndexList) &&
+			   UnionAllLeafList(setOperations->rarg, leafIndexList);
+	}
+	else if (IsA(node, RangeTblRef))
+	{
+		*leafIndexList = lappend_int(*leafIndexList, ((RangeTblRef *) node)->rtindex);
+		return true;
+	}
+
+	return false;
+}
+
+
+/*
+ * UnionAllLeafColumnsMatch returns true if the output columns of all leaves
+ * of the given UNION ALL query are subqueries whose columns have the types of
+ * the columns of the set operation, such that the columns of the query on the
+ * union can refer to the same columns of each leaf.
+ */
+static bool
+UnionAllLeafColumnsMatch(Query *unionQuery, List *leafIndexList)
+{
+	SetOperationStmt *setOperations = (SetOperationStmt *) unionQuery->setOperations;
+	ListCell *leafIndexCell = NULL;
+
+	foreach(leafIndexCell, leafIndexList)
+	{
+		RangeTblEntry *leafRangeTableEntry = rt_fetch(lfirst_int(leafIndexCell),
+													  unionQuery->rtable);
+		ListCell *columnTypeCell = NULL;
+		AttrNumber columnNumber = 0;
+
+		if (leafRangeTableEntry->rtekind != RTE_SUBQUERY)
+		{
+			return false;
+		}
+
+		foreach(columnTypeCell, setOperations->colTypes)
+		{
+			Oid columnType = lfirst_oid(columnTypeCell);
+
+			columnNumber++;
+
+			TargetEntry *targetEntry =
+				get_tle_by_resno(leafRangeTableEntry->subquery->targetList,
+								 columnNumber);
+			if (targetEntry == NULL || targetEntry->resjunk ||
+				exprType((Node *) targetEntry->expr) != columnType)
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * AggregateCanBeSplitAcrossUnionAll returns true if the given aggregate is a
+ * built-in aggregate whose result over a union can be computed from its
+ * results over the branches of the union.
+ */
+static bool
+AggregateCanBeSplitAcrossUnionAll(Aggref *aggregate)
+{
+	const char *splittableAggregateNames[] = {
+		"count", "sum", "min", "max", "bool_and", "bool_or", "every",
+		"bit_and", "bit_or"
+	};
+
+	if (aggregate->agglevelsup != 0 || aggregate->aggkind != AGGKIND_NORMAL ||
+		aggregate->aggdistinct != NIL || aggregate->aggorder != NIL ||
+		aggregate->aggfilter != NULL || aggregate->aggdirectargs != NIL ||
+		get_func_namespace(aggregate->aggfnoid) != PG_CATALOG_NAMESPACE)
+	{
+		return false;
+	}
+
+	char *aggregateName = get_func_name(aggregate->aggfnoid);
+	for (int nameIndex = 0; nameIndex < lengthof(splittableAggregateNames);
+		 nameIndex++)
+	{
+		if (strncmp(aggregateName, splittableAggregateNames[nameIndex],
+					NAMEDATALEN) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * ReplaceUnionAllAggregatesMutator replaces the aggregates of a query on a
+ * UNION ALL subquery with final aggregates over the columns that hold the
+ * partial aggregates of the branches, and the grouped columns of the subquery
+ * with the columns that hold them after the rewrite. It sets context->failed
+ * if no final aggregate can be built.
+ */
+static Node *
+ReplaceUnionAllAggregatesMutator(Node *node, UnionAllAggregateContext *context)
+{
+	if (node == NULL)
+	{
+		return NULL;
+	}
+
+	if (IsA(node, Aggref))
+	{
+		Aggref *aggregate = (Aggref *) node;
+		int aggregateIndex = 0;
+		ListCell *aggregateCell = NULL;
+
+		foreach(aggregateCell, context->aggregateList)
+		{
+			if (equal(lfirst(aggregateCell), aggregate))
+			{
+				break;
+			}
+
+			aggregateIndex++;
+		}
+
+		Assert(aggregateIndex < list_length(context->aggregateList));
+
+		AttrNumber partialColumnNumber = list_length(context->groupColumnList) +
+										 aggregateIndex + 1;
+		Var *partialColumn = makeVar(context->unionRangeTableIndex, partialColumnNumber,
+									 exprType(node), exprTypmod(node),
+									 exprCollation(node), 0);
+
+		Expr *finalAggregate = FinalUnionAllAggregate(aggregate, partialColumn);
+		if (finalAggregate == NULL)
+		{
+			context->failed = true;
+			return copyObject(node);
+		}
+
+		return (Node *) finalAggregate;
+	}
+	else if (IsA(node, Var))
+	{
+		Var *column = (Var *) node;
+		AttrNumber groupColumnNumber = 0;
+		ListCell *groupColumnCell = NULL;
+
+		if (column->varno != context->unionRangeTableIndex || column->varlevelsup != 0)
+		{
+			return copyObject(node);
+		}
+
+		foreach(groupColumnCell, context->groupColumnList)
+		{
+			Var *groupColumn = (Var *) lfirst(groupColumnCell);
+
+			groupColumnNumber++;
+
+			if (groupColumn->varattno == column->varattno)
+			{
+				Var *newColumn = copyObject(column);
+				newColumn->varattno = groupColumnNumber;
+				newColumn->varoattno = groupColumnNumber;
+
+				return (Node *) newColumn;
+			}
+		}
+
+		context->failed = true;
+		return copyObject(node);
+	}
+
+	return expression_tree_mutator(node, ReplaceUnionAllAggregatesMutator,
+								   (void *) context);
+}
+
+
+/*
+ * FinalUnionAllAggregate returns the aggregate that combines the partial
+ * results of the given aggregate in the given column, cast to the type of the
+ * given aggregate. Counts and sums add up through sum(), and the other
+ * aggregates combine their own results. The function returns NULL if there is
+ * no such aggregate or cast.
+ */
+static Expr *
+FinalUnionAllAggregate(Aggref *partialAggregate, Var *partialColumn)
+{
+	Oid partialType = partialColumn->vartype;
+	char *aggregateName = get_func_name(partialAggregate->aggfnoid);
+
+	Aggref *finalAggregate = copyObject(partialAggregate);
+	finalAggregate->args = list_make1(makeTargetEntry((Expr *) partialColumn, 1, NULL,
+													  false));
+	finalAggregate->aggargtypes = list_make1_oid(partialType);
+	finalAggregate->aggstar = false;
+	finalAggregate->aggtranstype = InvalidOid;
+
+	if (strncmp(aggregateName, "count", NAMEDATALEN) == 0 ||
+		strncmp(aggregateName, "sum", NAMEDATALEN) == 0)
+	{
+		List *sumFunctionName = list_make2(makeString("pg_catalog"), makeString("sum"));
+
+		finalAggregate->aggfnoid = LookupFuncName(sumFunctionName, 1, &partialType,
+												  true);
+		if (finalAggregate->aggfnoid == InvalidOid)
+		{
+			return NULL;
+		}
+
+		finalAggregate->aggtype = get_func_rettype(finalAggregate->aggfnoid);
+	}
+
+	if (finalAggregate->aggtype == partialAggregate->aggtype)
+	{
+		return (Expr *) finalAggregate;
+	}
+
+	/* for instance, sum(bigint) returns numeric, but count() returns bigint */
+	return (Expr *) coerce_to_target_type(NULL, (Node *) finalAggregate,
+										  finalAggregate->aggtype,
+										  partialAggregate->aggtype,
+										  exprTypmod((Node *) partialAggregate),
+										  COERCION_EXPLICIT, COERCE_IMPLICIT_CAST,
+										  -1);
+}
+
+
+/*
+ * PartialAggregateLeafQuery returns a query that computes the grouped columns
+ * and the partial aggregates in partialExpressionList over the given leaf of a
+ * UNION ALL subquery. The expressions refer to the columns of the subquery at
+ * unionRangeTableIndex, which are the same as the columns of the leaf.
+ */
+static Query *
+PartialAggregateLeafQuery(RangeTblEntry *leafRangeTableEntry,
+						  Index unionRangeTableIndex, List *partialExpressionList,
+						  List *columnNameList, List *groupClauseList)
+{
+	List *targetList = NIL;
+	ListCell *cell = NULL;
+	AttrNumber columnNumber = 0;
+	int groupColumnCount = list_length(groupClauseList);
+
+	foreach(cell, partialExpressionList)
+	{
+		Node *partialExpression = copyObject(lfirst(cell));
+		char *columnName = strVal(list_nth(columnNameList, columnNumber));
+
+		columnNumber++;
+
+		/* the leaf is the only range table entry of the new query */
+		ChangeVarNodes(partialExpression, unionRangeTableIndex, 1, 0);
+
+		TargetEntry *targetEntry = makeTargetEntry((Expr *) partialExpression,
+												   columnNumber, columnName, false);
+		if (columnNumber <= groupColumnCount)
+		{
+			targetEntry->ressortgroupref = columnNumber;
+		}
+
+		targetList = lappend(targetList, targetEntry);
+	}
+
+	RangeTblRef *rangeTableRef = makeNode(RangeTblRef);
+	rangeTableRef->rtindex = 1;
+
+	Query *leafQuery = makeNode(Query);
+	leafQuery->commandType = CMD_SELECT;
+	leafQuery->querySource = QSRC_ORIGINAL;
+	leafQuery->canSetTag = true;
+	leafQuery->rtable = list_make1(copyObject(leafRangeTableEntry));
+	leafQuery->jointree = makeFromExpr(list_make1(rangeTableRef), NULL);
+	leafQuery->targetList = targetList;
+	leafQuery->groupClause = copyObject(groupClauseList);
+	leafQuery->hasAggs = true;
+
+	return leafQuery;
+}
+
+
+/*
+ * SetUnionColumnTypes sets the column types of all set operations in the given
+ * tree to the types of the given expressions.
+ */
+static void
+SetUnionColumnTypes(Node *node, List *partialExpressionList)
+{
+	ListCell *cell = NULL;
+
+	if (!IsA(node, SetOperationStmt))
+	{
+		return;
+	}
+
+	SetOperationStmt *setOperations = (SetOperationStmt *) node;
+	setOperations->colTypes = NIL;
+	setOperations->colTypmods = NIL;
+	setOperations->colCollations = NIL;
+
+	foreach(cell, partialExpressionList)
+	{
+		Node *partialExpression = (Node *) lfirst(cell);
+
+		setOperations->colTypes = lappend_oid(setOperations->colTypes,
+											  exprType(partialExpression));
+		setOperations->colTypmods = lappend_int(setOperations->colTypmods,
+												exprTypmod(partialExpression));
+		setOperations->colCollations = lappend_oid(setOperations->colCollations,
+												   exprCollation(partialExpression));
+	}
+
+	SetUnionColumnTypes(setOperations->larg, partialExpressionList);
+	SetUnionColumnTypes(setOperations->rarg, partialExpressionList);
+}
+
+
+/*
+ * AggregationCanBeRepartitioned returns true if the final aggregation of the
+ * given query can happen on the workers after repartitioning its groups. This
+ * requires the query to group a single distributed table by expressions that
+ * do not include its distribution column, in a way that the repartition
+ * subquery planner supports.
+ */
+static bool
+AggregationCanBeRepartitioned(Query *query)
+{
+	List *rangeTableIndexList = NIL;
+
+	if (!EnableRepartitionAggregation)
+	{
+		return false;
+	}
+
+	if (TaskExecutorType != MULTI_EXECUTOR_TASK_TRACKER && !EnableRepartitionJoins)
+	{
+		return false;
+	}
+
+	if (query->commandType != CMD_SELECT || !query->hasAggs ||
+		query->groupClause == NIL || query->groupingSets != NIL ||
+		query->cteList != NIL || query->setOperations != NULL ||
+		query->hasSubLinks || query->hasWindowFuncs || query->hasTargetSRFs ||
+		query->rowMarks != NIL)
+	{
+		return false;
+	}
+
+	ExtractRangeTableIndexWalker((Node *) query->jointree, &rangeTableIndexList);
+	if (list_length(rangeTableIndexList) != 1)
+	{
+		return false;
+	}
+
+	int rangeTableIndex = linitial_int(rangeTableIndexList);
+	RangeTblEntry *rangeTableEntry = rt_fetch(rangeTableIndex, query->rtable);
+	if (rangeTableEntry->rtekind != RTE_RELATION ||
+		!IsDistributedTable(rangeTableEntry->relid) ||
+		PartitionMethod(rangeTableEntry->relid) == DISTRIBUTE_BY_NONE)
+	{
+		return false;
+	}
+
+	/* grouping by the distribution column is pushed down as a whole */
+	Var *partitionColumn = PartitionColumn(rangeTableEntry->relid, rangeTableIndex);
+	if (GroupedByColumn(query->groupClause, query->targetList, partitionColumn))
+	{
+		return false;
+	}
+
+	/* the repartitioning happens on the first group by expression */
+	List *groupTargetEntryList = GroupTargetEntryList(query->groupClause,
+													  query->targetList);
+	TargetEntry *groupByTargetEntry = (TargetEntry *) linitial(groupTargetEntryList);
+	if (!IsA(groupByTargetEntry->expr, Var) && !IsA(groupByTargetEntry->expr, FuncExpr))
+	{
+		return false;
+	}
+
+	return AggregatesCanBeRepartitioned(query);
+}
+
+
+/*
+ * AggregatesCanBeRepartitioned returns false if the given query contains an
+ * aggregate with DISTINCT or ORDER BY, which we do not split into partial and
+ * final aggregates on repartitioned groups.
+ */
+static bool
+AggregatesCanBeRepartitioned(Query *query)
+{
+	ListCell *expressionCell = NULL;
+
+	List *expressionList = pull_var_clause((Node *) query->targetList,
+										   PVC_INCLUDE_AGGREGATES);
+	expressionList = list_concat(expressionList,
+								 pull_var_clause(query->havingQual,
+												 PVC_INCLUDE_AGGREGATES));
+
+	foreach(expressionCell, expressionList)
+	{
+		Node *expression = (Node *) lfirst(expressionCell);
+
+		if (IsA(expression, Aggref))
+		{
+			Aggref *aggregateExpression = (Aggref *) expression;
+
+			if (aggregateExpression->aggdistinct != NIL ||
+				aggregateExpression->aggorder != NIL)
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * RecursivelyPlanCorrelatedSubqueriesInWhere decorrelates the [NOT] EXISTS
+ * subqueries among the top-level conjuncts of the WHERE clause of the given
+ * query and recursively plans them. A subquery of the form
+ *
+ *   EXISTS (SELECT ... FROM t WHERE t.x = o.y AND <filters>)
+ *
+ * is replaced by the semi join
+ *
+ *   o.y IN (SELECT t.x FROM t WHERE <filters> GROUP BY t.x)
+ *
+ * and NOT EXISTS by the anti join (o.y IS NULL OR NOT o.y IN (...)), where
+ * the subquery also filters out NULL values of t.x. This only happens when the
+ * subquery contains a distributed table and the single correlated equality is
+ * not between distribution columns, in which case the subquery can be pushed
+ * down as is.
+ */
+static void
+RecursivelyPlanCorrelatedSubqueriesInWhere(Query *query,
+										   RecursivePlanningContext *context)
+{
+	ListCell *qualCell = NULL;
+	List *newQualList = NIL;
+	bool decorrelated = false;
+
+	if (query->commandType != CMD_SELECT || query->jointree == NULL ||
+		query->jointree->quals == NULL)
+	{
+		return;
+	}
+
+	List *qualList = make_ands_implicit((Expr *) query->jointree->quals);
+	foreach(qualCell, qualList)
+	{
+		Node *qual = (Node *) lfirst(qualCell);
+
+		Node *newQual = DecorrelateExistsSubquery(query, qual, context);
+		if (newQual != NULL)
+		{
+			qual = newQual;
+			decorrelated = true;
+		}
+
+		newQualList = lappend(newQualList, qual);
+	}
+
+	if (decorrelated)
+	{
+		query->jointree->quals = (Node *) make_ands_explicit(newQualList);
+	}
+}
+
+
+/*
+ * DecorrelateExistsSubquery turns the given qual into an uncorrelated
+ * semi or anti join as described in RecursivelyPlanCorrelatedSubqueriesInWhere
+ * and recursively plans the subquery. The function returns the new qual, or
+ * NULL if the qual is left as is.
+ */
+static Node *
+DecorrelateExistsSubquery(Query *query, Node *qual, RecursivePlanningContext *context)
+{
+	bool negated = false;
+	ListCell *subqueryQualCell = NULL;
+	List *remainingQualList = NIL;
+	OpExpr *correlatedQual = NULL;
+	Var *outerColumn = NULL;
+	Node *innerExpression = NULL;
+
+	if (IsA(qual, BoolExpr) && ((BoolExpr *) qual)->boolop == NOT_EXPR)
+	{
+		qual = (Node *) linitial(((BoolExpr *) qual)->args);
+		negated = true;
+	}
+
+	if (!IsA(qual, SubLink) || ((SubLink *) qual)->subLinkType != EXISTS_SUBLINK)
+	{
+		return NULL;
+	}
+
+	Query *existsSubquery = (Query *) ((SubLink *) qual)->subselect;
+	if (!SubqueryCanBeDecorrelated(existsSubquery))
+	{
+		return NULL;
+	}
+
+	/* we rewrite a copy, such that the qual stays intact if we give up */
+	Query *subquery = copyObject(existsSubquery);
+
+	/* find the single equality that refers to the outer query */
+	List *subqueryQualList = make_ands_implicit((Expr *) subquery->jointree->quals);
+	foreach(subqueryQualCell, subqueryQualList)
+	{
+		Node *subqueryQual = (Node *) lfirst(subqueryQualCell);
+
+		if (!ExpressionContainsReferencesToOuterQuery(subqueryQual))
+		{
+			remainingQualList = lappend(remainingQualList, subqueryQual);
+			continue;
+		}
+
+		if (correlatedQual != NULL || !IsA(subqueryQual, OpExpr) ||
+			list_length(((OpExpr *) subqueryQual)->args) != 2)
+		{
+			return NULL;
+		}
+
+		correlatedQual = (OpExpr *) subqueryQual;
+	}
+
+	if (correlatedQual == NULL)
+	{
+		return NULL;
+	}
+
+	Node *leftArg = (Node *) linitial(correlatedQual->args);
+	Node *rightArg = (Node *) lsecond(correlatedQual->args);
+	Oid operatorId = correlatedQual->opno;
+
+	if (IsA(rightArg, Var) && ((Var *) rightArg)->varlevelsup == 1)
+	{
+		outerColumn = (Var *) rightArg;
+		innerExpression = leftArg;
+	}
+	else if (IsA(leftArg, Var) && ((Var *) leftArg)->varlevelsup == 1)
+	{
+		/* the outer column goes on the left of the IN */
+		outerColumn = (Var *) leftArg;
+		innerExpression = rightArg;
+		operatorId = get_commutator(operatorId);
+	}
+	else
+	{
+		return NULL;
+	}
+
+	if (ExpressionContainsReferencesToOuterQuery(innerExpression) ||
+		contain_volatile_functions(innerExpression) ||
+		!OidIsValid(operatorId) || !op_strict(operatorId) ||
+		!op_mergejoinable(operatorId, outerColumn->vartype))
+	{
+		return NULL;
+	}
+
+	if (IsDistributionColumnReference(innerExpression, subquery->rtable) &&
+		IsDistributionColumnReference((Node *) outerColumn, query->rtable))
+	{
+		/* the subquery is joined on the distribution column, push it down */
+		return NULL;
+	}
+
+	Oid innerType = exprType(innerExpression);
+	Oid sortOperatorId = InvalidOid;
+	Oid equalityOperatorId = InvalidOid;
+	bool hashable = false;
+
+	get_sort_group_operators(innerType, false, false, false, &sortOperatorId,
+							 &equalityOperatorId, NULL, &hashable);
+	if (!OidIsValid(equalityOperatorId) ||
+		(!OidIsValid(sortOperatorId) && !hashable))
+	{
+		/* cannot group the values of the inner expression */
+		return NULL;
+	}
+
+	if (negated)
+	{
+		/* a NULL in the subquery would make NOT IN fail for all rows */
+		NullTest *innerNullTest = makeNode(NullTest);
+		innerNullTest->arg = (Expr *) copyObject(innerExpression);
+		innerNullTest->nulltesttype = IS_NOT_NULL;
+		innerNullTest->argisrow = false;
+		innerNullTest->location = -1;
+
+		remainingQualList = lappend(remainingQualList, innerNullTest);
+	}
+
+	subquery->jointree->quals = NULL;
+	if (remainingQualList != NIL)
+	{
+		subquery->jointree->quals = (Node *) make_ands_explicit(remainingQualList);
+	}
+
+	/* return each value of the inner expression once */
+	TargetEntry *targetEntry = makeTargetEntry((Expr *) innerExpression, 1,
+											   pstrdup("exists_key"), false);
+	targetEntry->ressortgroupref = 1;
+
+	SortGroupClause *groupClause = makeNode(SortGroupClause);
+	groupClause->tleSortGroupRef = 1;
+	groupClause->eqop = equalityOperatorId;
+	groupClause->sortop = sortOperatorId;
+	groupClause->nulls_first = false;
+	groupClause->hashable = hashable;
+
+	subquery->targetList = list_make1(targetEntry);
+	subquery->groupClause = list_make1(groupClause);
+	subquery->distinctClause = NIL;
+	subquery->hasDistinctOn = false;
+	subquery->sortClause = NIL;
+
+	if (ContainsReferencesToOuterQuery(subquery))
+	{
+		/* other parts of the subquery, such as its FROM clause, are correlated */
+		return NULL;
+	}
+
+	elog(DEBUG2, "decorrelating %sEXISTS subquery into a semi join",
+		 negated ? "NOT " : "");
+
+	Var *outerColumnInQuery = copyObject(outerColumn);
+	outerColumnInQuery->varlevelsup = 0;
+
+	Param *innerParam = makeNode(Param);
+	innerParam->paramkind = PARAM_SUBLINK;
+	innerParam->paramid = 1;
+	innerParam->paramtype = innerType;
+	innerParam->paramtypmod = exprTypmod(innerExpression);
+	innerParam->paramcollid = exprCollation(innerExpression);
+	innerParam->location = -1;
+
+	Expr *testExpression = make_opclause(operatorId, BOOLOID, false,
+										 (Expr *) outerColumnInQuery,
+										 (Expr *) innerParam,
+										 correlatedQual->opcollid,
+										 correlatedQual->inputcollid);
+	((OpExpr *) testExpression)->opfuncid = get_opcode(operatorId);
+
+	SubLink *semiJoinSublink = makeNode(SubLink);
+	semiJoinSublink->subLinkType = ANY_SUBLINK;
+	semiJoinSublink->subLinkId = 0;
+	semiJoinSublink->testexpr = (Node *) testExpression;
+	semiJoinSublink->operName = list_make1(makeString(get_opname(operatorId)));
+	semiJoinSublink->subselect = (Node *) subquery;
+	semiJoinSublink->location = -1;
+
+	RecursivelyPlanSubquery(subquery, context);
+
+	if (!negated)
+	{
+		return (Node *) semiJoinSublink;
+	}
+
+	NullTest *outerNullTest = makeNode(NullTest);
+	outerNullTest->arg = (Expr *) copyObject(outerColumnInQuery);
+	outerNullTest->nulltesttype = IS_NULL;
+	outerNullTest->argisrow = false;
+	outerNullTest->location = -1;
+
+	return (Node *) make_orclause(list_make2(outerNullTest,
+											 make_notclause((Expr *) semiJoinSublink)));
+}
+
+
+/*
+ * SubqueryCanBeDecorrelated returns whether the result of the given EXISTS
+ * subquery only depends on whether its WHERE clause matches any rows, and
+ * whether it reads at least one distributed table.
+ */
+static bool
+SubqueryCanBeDecorrelated(Query *subquery)
+{
+	if (subquery->commandType != CMD_SELECT || subquery->setOperations != NULL ||
+		subquery->cteList != NIL || subquery->hasAggs || subquery->hasWindowFuncs ||
+		subquery->hasTargetSRFs || subquery->hasModifyingCTE ||
+		subquery->hasForUpdate || subquery->groupClause != NIL ||
+		subquery->groupingSets != NIL || subquery->havingQual != NULL ||
+		subquery->limitCount != NULL || subquery->limitOffset != NULL)
+	{
+		return false;
+	}
+
+	if (subquery->jointree == NULL || subquery->jointree->quals == NULL)
+	{
+		return false;
+	}
+
+	return FindNodeCheckInRangeTableList(subquery->rtable, IsDistributedTableRTE);
+}
+
+
+/*
+ * IsDistributionColumnReference returns whether the given expression is the
+ * distribution column of a distributed table in the given range table.
+ */
+static bool
+IsDistributionColumnReference(Node *node, List *rangeTableList)
+{
+	if (!IsA(node, Var))
+	{
+		return false;
+	}
+
+	Var *column = (Var *) node;
+	RangeTblEntry *rangeTableEntry = rt_fetch(column->varno, rangeTableList);
+	if (rangeTableEntry->rtekind != RTE_RELATION ||
+		!IsDistributedTable(rangeTableEntry->relid))
+	{
+		return false;
+	}
+
+	Var *partitionColumn = DistPartitionKey(rangeTableEntry->relid);
+
+	return partitionColumn != NULL && partitionColumn->varattno == column->varattno;
+}
+
+
+/*
+ * ExpressionContainsReferencesToOuterQuery determines whether the given
+ * expression of a query refers to any outer query.
+ */
+static bool
+ExpressionContainsReferencesToOuterQuery(Node *node)
+{
+	VarLevelsUpWalkerContext context = { 0 };
+
+	return ContainsReferencesToOuterQueryWalker(node, &context);
+}
+
+
+/*
+ * AllDistributionKeysInSubqueryAreEqual is a wrapper function
+ * for AllDistributionKeysInQueryAreEqual(). Here, we filter the
+ * planner restrictions for the given subquery and do the restriction
+ * equality checks on the filtered restriction.
+ */
+static bool
+AllDistributionKeysInSubqueryAreEqual(Query *subquery,
+									  PlannerRestrictionContext *restrictionContext)
+{
+	/* we don't support distribution eq. checks for CTEs yet */
+	if (subquery->cteList != NIL)
+	{
+		return false;
+	}
+
+	PlannerRestrictionContext *filteredRestrictionContext =
+		FilterPlannerRestrictionForQuery(restrictionContext, subquery);
+
+	bool allDistributionKeysInSubqueryAreEqual =
+		AllDistributionKeysInQueryAreEqual(subquery, filteredRestrictionContext);
+	if (!allDistributionKeysInSubqueryAreEqual)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * ShouldRecursivelyPlanSetOperation determines whether the leaf queries of a
+ * set operations tree need to be recursively planned in order to support the
+ * query as a whole.
+ */
+static bool
+ShouldRecursivelyPlanSetOperation(Query *query, RecursivePlanningContext *context)
+{
+	SetOperationStmt *setOperations = (SetOperationStmt *) query->setOperations;
+	if (setOperations == NULL)
+	{
+		return false;
+	}
+
+	if (context->level == 0)
+	{
+		/*
+		 * We cannot push down top-level set operation. Recursively plan the
+		 * leaf nodes such that it becomes a router query.
+		 */
+		return true;
+	}
+
+	if (setOperations->op != SETOP_UNION)
+	{
+		/*
+		 * We can only push down UNION operaionts, plan other set operations
+		 * recursively.
+		 */
+		return true;
+	}
+
+	if (DeferErrorIfUnsupportedUnionQuery(query) != NULL)
+	{
+		/*
+		 * If at least one leaf query in the union is recurring, then all
+		 * leaf nodes need to be recurring.
+		 */
+		return true;
+	}
+
+	PlannerRestrictionContext *filteredRestrictionContext =
+		FilterPlannerRestrictionForQuery(context->plannerRestrictionContext, query);
+	if (!SafeToPushdownUnionSubquery(filteredRestrictionContext))
+	{
+		/*
+		 * The distribution column is not in the same place in all sides
+		 * of the union, meaning we cannot determine distribution column
+		 * equivalence. Recursive planning is necessary.
+		 */
+		return true;
+	}
+
+	return false;
+}
+
+
+/*
+ * RecursivelyPlanSetOperations descends into a tree of set operations
+ * (e.g. UNION, INTERSECTS) and recursively plans all leaf nodes that
+ * contain distributed tables.
+ */
+static void
+RecursivelyPlanSetOperations(Query *query, Node *node,
+							 RecursivePlanningContext *context)
+{
+	if (IsA(node, SetOperationStmt))
+	{
+		SetOperationStmt *setOperations = (SetOperationStmt *) node;
+
+		RecursivelyPlanSetOperations(query, setOperations->larg, context);
+		RecursivelyPlanSetOperations(query, setOperations->rarg, context);
+	}
+	else if (IsA(node, RangeTblRef))
+	{
+		RangeTblRef *rangeTableRef = (RangeTblRef *) node;
+		RangeTblEntry *rangeTableEntry = rt_fetch(rangeTableRef->rtindex,
+												  query->rtable);
+		Query *subquery = rangeTableEntry->subquery;
+
+		if (rangeTableEntry->rtekind == RTE_SUBQUERY &&
+			QueryContainsDistributedTableRTE(subquery))
+		{
+			RecursivelyPlanSubquery(subquery, context);
+		}
+	}
+	else
+	{
+		ereport(ERROR, (errmsg("unexpected node type (%d) while "
+							   "expecting set operations or "
+							   "range table references", nodeTag(node))));
+	}
+}
+
+
+/*
+ * IsUnionOnlySetOperation returns true if the given tree of set operations
+ * only consists of UNION and UNION ALL operations.
+ */
+static bool
+IsUnionOnlySetOperation(Node *node)
+{
+	if (IsA(node, SetOperationStmt))
+	{
+		SetOperationStmt *setOperations = (SetOperationStmt *) node;
+
+		return setOperations->op == SETOP_UNION &&
+			   IsUnionOnlySetOperation(setOperations->larg) &&
+			   IsUnionOnlySetOperation(setOperations->rarg);
+	}
+
+	return IsA(node, RangeTblRef);
+}
+
+
+/*
+ * DeduplicateUnionLeafQueries adds a DISTINCT clause to the leaf queries of a
+ * tree of UNION operations whose duplicates are removed by a UNION above them,
+ * such that the duplicates are removed on the workers when the leaf queries
+ * are recursively planned, rather than sent to the coordinator. Only simple
+ * leaf queries that contain distributed tables are deduplicated.
+ */
+static void
+DeduplicateUnionLeafQueries(Query *query, Node *node, bool parentDeduplicates)
+{
+	if (IsA(node, SetOperationStmt))
+	{
+		SetOperationStmt *setOperations = (SetOperationStmt *) node;
+		bool deduplicates = parentDeduplicates || !setOperations->all;
+
+		DeduplicateUnionLeafQueries(query, setOperations->larg, deduplicates);
+		DeduplicateUnionLeafQueries(query, setOperations->rarg, deduplicates);
+
+		return;
+	}
+
+	if (!parentDeduplicates || !IsA(node, RangeTblRef))
+	{
+		return;
+	}
+
+	RangeTblEntry *rangeTableEntry = rt_fetch(((RangeTblRef *) node)->rtindex,
+											  query->rtable);
+	if (rangeTableEntry->rtekind != RTE_SUBQUERY)
+	{
+		return;
+	}
+
+	Query *leafQuery = rangeTableEntry->subquery;
+	if (leafQuery->commandType != CMD_SELECT || leafQuery->distinctClause != NIL ||
+		leafQuery->hasAggs || leafQuery->groupClause != NIL ||
+		leafQuery->groupingSets != NIL || leafQuery->havingQual != NULL ||
+		leafQuery->sortClause != NIL || leafQuery->limitCount != NULL ||
+		leafQuery->limitOffset != NULL || leafQuery->hasWindowFuncs ||
+		leafQuery->hasTargetSRFs || leafQuery->setOperations != NULL ||
+		leafQuery->rowMarks != NIL ||
+		!QueryContainsDistributedTableRTE(leafQuery))
+	{
+		return;
+	}
+
+	List *distinctClauseList = NIL;
+	ListCell *targetEntryCell = NULL;
+	foreach(targetEntryCell, leafQuery->targetList)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+		Oid sortOperator = InvalidOid;
+		Oid equalityOperator = InvalidOid;
+		bool hashable = false;
+
+		if (targetEntry->resjunk)
+		{
+			return;
+		}
+
+		get_sort_group_operators(exprType((Node *) targetEntry->expr),
+								 false, true, false,
+								 &sortOperator, &equalityOperator, NULL,
+								 &hashable);
+
+		SortGroupClause *distinctClause = makeNode(SortGroupClause);
+		distinctClause->eqop = equalityOperator;
+		distinctClause->sortop = sortOperator;
+		distinctClause->nulls_first = false;
+		distinctClause->hashable = hashable;
+
+		distinctClauseList = lappend(distinctClauseList, distinctClause);
+	}
+
+	/* only assign the references once we know all columns can be compared */
+	ListCell *distinctClauseCell = NULL;
+	forboth(targetEntryCell, leafQuery->targetList,
+			distinctClauseCell, distinctClauseList)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+		SortGroupClause *distinctClause = (SortGroupClause *) lfirst(distinctClauseCell);
+
+		distinctClause->tleSortGroupRef = assignSortGroupRef(targetEntry,
+															 leafQuery->targetList);
+	}
+
+	leafQuery->distinctClause = distinctClauseList;
+}
+
+
+/*
+ * IsLocalTableRTE gets a node and returns true if the node
+ * is a range table relation entry that points to a local
+ * relation (i.e., not a distributed relation).
+ */
+static bool
+IsLocalTableRTE(Node *node)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	if (!IsA(node, RangeTblEntry))
+	{
+		return false;
+	}
+
+	RangeTblEntry *rangeTableEntry = (RangeTblEntry *) node;
+	if (rangeTableEntry->rtekind != RTE_RELATION)
+	{
+		return false;
+	}
+
+	if (rangeTableEntry->relkind == RELKIND_VIEW)
+	{
+		return false;
+	}
+
+	Oid relationId = rangeTableEntry->relid;
+	if (IsDistributedTable(relationId))
+	{
+		return false;
+	}
+
+	/* local table found */
+	return true;
+}
+
+
+/*
+ * RecursivelyPlanQuery recursively plans a query, replaces it with a
+ * result query and returns the subplan.
+ *
+ * Before we recursively plan the given subquery, we should ensure
+ * that the subquery doesn't contain any references to the outer
+ * queries (i.e., such queries cannot be separately planned). In
+ * that case, the function doesn't recursively plan the input query
+ * and immediately returns. Later, the planner decides on what to do
+ * with the query.
+ */
+static void
 RecursivelyPlanSubquery(Query *subquery, RecursivePlanningContext *planningContext)
 {
 	uint64 planId = planningContext->planId;
@@ -1166,6 +2965,9 @@ CreateDistributedSubPlan(uint32 subPlanId, Query *subPlanQuery)
 	}
 
 	DistributedSubPlan *subPlan = CitusMakeNode(DistributedSubPlan);
+
+	/* deparse before planning, since the planner scribbles on the query */
+	subPlan->queryKey = SubPlanQueryKey(subPlanQuery);
 	subPlan->plan = planner(subPlanQuery, cursorOptions, NULL);
 	subPlan->subPlanId = subPlanId;
 
@@ -1173,6 +2975,53 @@ CreateDistributedSubPlan(uint32 subPlanId, Query *subPlanQuery)
 }
 
 
+/*
+ * SubPlanQueryKey returns the deparsed subplan query, which is used to find
+ * the result of an earlier subplan that ran the same query in the current
+ * transaction. We return NULL if running the query again could give a
+ * different result on the same snapshot.
+ */
+static char *
+SubPlanQueryKey(Query *subPlanQuery)
+{
+	if (!EnableSubPlanResultReuse)
+	{
+		return NULL;
+	}
+
+	if (subPlanQuery->commandType != CMD_SELECT || subPlanQuery->hasModifyingCTE)
+	{
+		return NULL;
+	}
+
+	if (contain_volatile_functions((Node *) subPlanQuery))
+	{
+		return NULL;
+	}
+
+	/* parameter values may differ between executions of a cached plan */
+	if (FindNodeCheck((Node *) subPlanQuery, IsParam))
+	{
+		return NULL;
+	}
+
+	StringInfo queryKey = makeStringInfo();
+	pg_get_query_def(subPlanQuery, queryKey);
+
+	return queryKey->data;
+}
+
+
+/*
+ * IsParam returns whether the given node is a Param.
+ */
+static bool
+IsParam(Node *node)
+{
+	return IsA(node, Param);
+}
+
+
 /*
  * CteReferenceListWalker finds all references to CTEs in the top level of a query
  * and adds them to context->cteReferenceList.
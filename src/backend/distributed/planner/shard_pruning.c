@@ -15,12 +15,19 @@
  *
  * We use the distributive property for constraints of the form P AND (Q OR R)
  * to rewrite it to (P AND Q) OR (P AND R) by copying constraints from parent
- * to "child" pruning instances. However, we do not distribute nested
- * expressions. While (P OR Q) AND (R OR S) is logically equivalent to (P AND
- * R) OR (P AND S) OR (Q AND R) OR (Q AND S), in our implementation it becomes
- * P OR Q OR R OR S. This is acceptable since this will always result in a
- * superset of shards.  If this proves to be a issue in practice, a more
- * complete algorithm could be implemented.
+ * to "child" pruning instances. Nested expressions are distributed as well,
+ * (P OR Q) AND (R OR S) becomes (P AND R) OR (P AND S) OR (Q AND R) OR (Q AND
+ * S), by continuing each child instance with the ORed expressions that have
+ * not been distributed yet. Since the number of instances grows exponentially
+ * with the number of ORed expressions, we stop distributing once
+ * citus.max_shard_pruning_instances is reached and the remaining expressions
+ * become separate instances, i.e. P OR Q OR R OR S. This is acceptable since
+ * this will always result in a superset of shards.
+ *
+ * Large IN lists on the partition column of a hash-partitioned table are an
+ * exception. Rather than adding a pruning instance per element, each element
+ * is hashed once into a set of shard indexes, which is cached per table and
+ * list since dashboards tend to send the same lists over and over.
  *
  * We then evaluate each non-partial pruning instance in the disjunction
  * through the following, increasingly expensive, steps:
@@ -50,16 +57,19 @@
 
 #include "distributed/shard_pruning.h"
 
+#include "access/hash.h"
 #include "access/nbtree.h"
 #include "catalog/pg_am.h"
 #include "catalog/pg_collation.h"
 #include "catalog/pg_type.h"
 #include "distributed/metadata_cache.h"
+#include "distributed/metadata/shard_column_stats.h"
 #include "distributed/distributed_planner.h"
 #include "distributed/multi_join_order.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/shardinterval_utils.h"
 #include "distributed/pg_dist_partition.h"
+#include "distributed/planning_phases.h"
 #include "distributed/version_compat.h"
 #include "distributed/worker_protocol.h"
 #include "nodes/nodeFuncs.h"
@@ -69,9 +79,24 @@
 #include "parser/parse_coerce.h"
 #include "utils/arrayaccess.h"
 #include "utils/catcache.h"
+#include "utils/hsearch.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 
+/*
+ * Number of elements from which an IN list on the distribution column of a
+ * hash-distributed table is pruned via a set of shard indexes, rather than
+ * via a pruning instance per element.
+ */
+#define SAOP_SHARD_SET_MIN_ELEMENTS 64
+
+/* maximum number of IN lists for which the set of shard indexes is cached */
+#define MAX_SHARD_SET_CACHE_ENTRIES 64
+
+
+/* config variable managed via guc.c */
+int MaxShardPruningInstances = 64;
+
 /*
  * A pruning instance is a set of ANDed constraints on a partition key.
  */
@@ -104,6 +129,13 @@ typedef struct PruningInstance
 	 */
 	Const *hashedEqualConsts;
 
+	/*
+	 * Indexes of the shards that can contain matching rows, if constrained by
+	 * a large IN list on a hash-partitioned table. The set is never modified
+	 * in place, since it is shared with copies of the instance.
+	 */
+	Bitmapset *shardIndexSet;
+
 	/*
 	 * Types of constraints not understood.  We could theoretically try more
 	 * expensive methods of pruning if any such restrictions are found.
@@ -156,6 +188,7 @@ typedef FunctionCallInfoData FunctionCall2InfoData;
  */
 typedef struct ClauseWalkerContext
 {
+	DistTableCacheEntry *cacheEntry;
 	Var *partitionColumn;
 	char partitionMethod;
 
@@ -171,6 +204,15 @@ typedef struct ClauseWalkerContext
 	/* PruningInstance currently being built, all elegible constraints are added here */
 	PruningInstance *currentPruningInstance;
 
+	/*
+	 * ORed expressions found while building the current PruningInstance,
+	 * which are distributed once all its ANDed constraints are known.
+	 */
+	List *pendingDisjunctions;
+
+	/* number of PruningInstances the expressions have been expanded into */
+	int expandedInstanceCount;
+
 	/*
 	 * Information about function calls we need to perform. Re-using the same
 	 * FunctionCall2InfoData, instead of using FunctionCall2Coll, is often
@@ -180,6 +222,30 @@ typedef struct ClauseWalkerContext
 	FunctionCall2InfoData compareIntervalFunctionCall;
 } ClauseWalkerContext;
 
+/*
+ * The sets of shard indexes for large IN lists are cached per table and
+ * array, since the same lists are frequently sent by dashboards.
+ */
+typedef struct ShardSetCacheKey
+{
+	Oid relationId;
+	uint32 arrayHash;
+} ShardSetCacheKey;
+
+typedef struct ShardSetCacheEntry
+{
+	/* hash key, must be the first field */
+	ShardSetCacheKey key;
+
+	ArrayType *array;
+	Bitmapset *shardIndexSet;
+} ShardSetCacheEntry;
+
+
+static HTAB *ShardSetCache = NULL;
+static MemoryContext ShardSetCacheContext = NULL;
+
+
 static void PrunableExpressions(Node *originalNode, ClauseWalkerContext *context);
 static bool PrunableExpressionsWalker(Node *originalNode, ClauseWalkerContext *context);
 static void AddPartitionKeyRestrictionToInstance(ClauseWalkerContext *context,
@@ -192,9 +258,22 @@ static void AddSAOPartitionKeyRestrictionToInstance(ClauseWalkerContext *context
 													arrayOperatorExpression);
 static void AddHashRestrictionToInstance(ClauseWalkerContext *context, OpExpr *opClause,
 										 Var *varClause, Const *constantClause);
-static void AddNewConjuction(ClauseWalkerContext *context, OpExpr *op);
+static void AddShardIndexSetRestrictionToInstance(ClauseWalkerContext *context,
+												  ArrayType *array);
+static Bitmapset * ShardIndexSetForArray(DistTableCacheEntry *cacheEntry,
+										 ArrayType *array);
+static Bitmapset * BuildShardIndexSet(DistTableCacheEntry *cacheEntry,
+									  ArrayType *array);
+static void InitializeShardSetCache(void);
+static List * PruneWithShardIndexSet(DistTableCacheEntry *cacheEntry,
+									 ClauseWalkerContext *context,
+									 PruningInstance *prune);
+static void AddNewConjuction(ClauseWalkerContext *context, Node *op);
+static void DistributePendingDisjunctions(ClauseWalkerContext *context);
 static PruningInstance * CopyPartialPruningInstance(PruningInstance *sourceInstance);
 static List * ShardArrayToList(ShardInterval **shardArray, int length);
+static List * ShardIndexSetToList(DistTableCacheEntry *cacheEntry,
+								  Bitmapset *shardIndexSet);
 static List * DeepCopyShardIntervalList(List *originalShardIntervalList);
 static int PerformValueCompare(FunctionCallInfo compareFunctionCall, Datum a,
 							   Datum b);
@@ -205,6 +284,15 @@ static List * PruneOne(DistTableCacheEntry *cacheEntry, ClauseWalkerContext *con
 static List * PruneWithBoundaries(DistTableCacheEntry *cacheEntry,
 								  ClauseWalkerContext *context,
 								  PruningInstance *prune);
+static List * PruneOverlappingWithBoundaries(DistTableCacheEntry *cacheEntry,
+											 ClauseWalkerContext *context,
+											 PruningInstance *prune);
+static int OverlappingUpperShardBoundary(DistTableCacheEntry *cacheEntry,
+										 FunctionCallInfo compareFunction,
+										 Datum upperBound, bool includeMin);
+static int OverlappingLowerShardBoundary(DistTableCacheEntry *cacheEntry,
+										 FunctionCallInfo compareFunction,
+										 Datum lowerBound, bool includeMax);
 static List * ExhaustivePrune(DistTableCacheEntry *cacheEntry,
 							  ClauseWalkerContext *context,
 							  PruningInstance *prune);
@@ -241,6 +329,7 @@ PruneShards(Oid relationId, Index rangeTableId, List *whereClauseList,
 	ClauseWalkerContext context = { 0 };
 	ListCell *pruneCell;
 	List *prunedList = NIL;
+	Bitmapset *prunedShardIndexSet = NULL;
 	bool foundRestriction = false;
 	bool foundPartitionColumnValue = false;
 	Const *singlePartitionValueConst = NULL;
@@ -254,6 +343,7 @@ PruneShards(Oid relationId, Index rangeTableId, List *whereClauseList,
 	/* always return empty result if WHERE clause is of the form: false (AND ..) */
 	if (ContainsFalseClause(whereClauseList))
 	{
+		RecordShardPruning(shardCount, 0);
 		return NIL;
 	}
 
@@ -266,6 +356,7 @@ PruneShards(Oid relationId, Index rangeTableId, List *whereClauseList,
 	}
 
 
+	context.cacheEntry = cacheEntry;
 	context.partitionMethod = partitionMethod;
 	context.partitionColumn = PartitionColumn(relationId, rangeTableId);
 	context.currentPruningInstance = palloc0(sizeof(PruningInstance));
@@ -331,13 +422,14 @@ PruneShards(Oid relationId, Index rangeTableId, List *whereClauseList,
 		if (context.partitionMethod == DISTRIBUTE_BY_HASH)
 		{
 			if (!prune->evaluatesToFalse && !prune->equalConsts &&
-				!prune->hashedEqualConsts)
+				!prune->hashedEqualConsts && prune->shardIndexSet == NULL)
 			{
 				/* if hash-partitioned and no equals constraints, return all shards */
 				foundRestriction = false;
 				break;
 			}
-			else if (partitionValueConst != NULL && prune->equalConsts != NULL)
+			else if (partitionValueConst != NULL && prune->equalConsts != NULL &&
+					 !prune->evaluatesToFalse)
 			{
 				if (!foundPartitionColumnValue)
 				{
@@ -358,28 +450,32 @@ PruneShards(Oid relationId, Index rangeTableId, List *whereClauseList,
 		}
 
 		List *pruneOneList = PruneOne(cacheEntry, &context, prune);
+		ListCell *shardCell = NULL;
 
-		if (prunedList)
-		{
-			/*
-			 * We can use list_union_ptr, which is a lot faster than doing
-			 * comparing shards by value, because all the ShardIntervals are
-			 * guaranteed to be from
-			 * DistTableCacheEntry->sortedShardIntervalArray (thus having the
-			 * same pointer values).
-			 */
-			prunedList = list_union_ptr(prunedList, pruneOneList);
-		}
-		else
+		/*
+		 * All the ShardIntervals are from
+		 * DistTableCacheEntry->sortedShardIntervalArray, so we can union the
+		 * results of the instances via their index in that array, rather than
+		 * by comparing lists of shards.
+		 */
+		foreach(shardCell, pruneOneList)
 		{
-			prunedList = pruneOneList;
+			ShardInterval *shardInterval = (ShardInterval *) lfirst(shardCell);
+
+			prunedShardIndexSet = bms_add_member(prunedShardIndexSet,
+												 shardInterval->shardIndex);
 		}
+
 		foundRestriction = true;
 	}
 
-	/* found no valid restriction, build list of all shards */
-	if (!foundRestriction)
+	if (foundRestriction)
+	{
+		prunedList = ShardIndexSetToList(cacheEntry, prunedShardIndexSet);
+	}
+	else
 	{
+		/* found no valid restriction, build list of all shards */
 		prunedList = ShardArrayToList(cacheEntry->sortedShardIntervalArray,
 									  cacheEntry->shardIntervalArrayLength);
 	}
@@ -397,6 +493,12 @@ PruneShards(Oid relationId, Index rangeTableId, List *whereClauseList,
 		}
 	}
 
+	/* skip shards whose column statistics rule out any matching rows */
+	prunedList = PruneShardsByColumnStatistics(relationId, rangeTableId,
+											   whereClauseList, prunedList);
+
+	RecordShardPruning(shardCount, list_length(prunedList));
+
 	/*
 	 * Deep copy list, so it's independent of the DistTableCacheEntry
 	 * contents.
@@ -451,7 +553,9 @@ PrunableExpressions(Node *node, ClauseWalkerContext *context)
 	 * expressions - that allows us to find all ANDed expressions, before
 	 * recursing into an ORed expression.
 	 */
+	context->expandedInstanceCount = 1;
 	PrunableExpressionsWalker(node, context);
+	DistributePendingDisjunctions(context);
 
 	/*
 	 * Process all pending instances.  While processing, new ones might be
@@ -475,6 +579,7 @@ PrunableExpressions(Node *node, ClauseWalkerContext *context)
 
 		context->currentPruningInstance = newPrune;
 		PrunableExpressionsWalker(instance->continueAt, context);
+		DistributePendingDisjunctions(context);
 		context->currentPruningInstance = NULL;
 	}
 }
@@ -505,6 +610,18 @@ PrunableExpressionsWalker(Node *node, ClauseWalkerContext *context)
 
 		if (boolExpr->boolop == NOT_EXPR)
 		{
+			PruningInstance *prune = context->currentPruningInstance;
+
+			/*
+			 * We don't look into NOT expressions, but the instance still has
+			 * to be used for pruning, see the handling of unknown expressions.
+			 */
+			if (!prune->addedToPruningInstances)
+			{
+				context->pruningInstances = lappend(context->pruningInstances, prune);
+				prune->addedToPruningInstances = true;
+			}
+
 			return false;
 		}
 		else if (boolExpr->boolop == AND_EXPR)
@@ -514,24 +631,16 @@ PrunableExpressionsWalker(Node *node, ClauseWalkerContext *context)
 		}
 		else if (boolExpr->boolop == OR_EXPR)
 		{
-			ListCell *opCell = NULL;
-
 			/*
-			 * "Queue" partial pruning instances.  This is used to convert
+			 * "Queue" the ORed expression.  This is used to convert
 			 * expressions like (A AND (B OR C) AND D) into (A AND B AND D),
-			 * (A AND C AND D), with A, B, C, D being restrictions.  When the
-			 * OR is encountered, a reference to the partially built
-			 * PruningInstance (containing A at this point), is added to
-			 * context->pendingInstances once for B and once for C.  Once a
-			 * full tree-walk completed, PrunableExpressions() will complete
-			 * the pending instances, which'll now also know about restriction
-			 * D, by calling PrunableExpressionsWalker() once for B and once
-			 * for C.
+			 * (A AND C AND D), with A, B, C, D being restrictions.  Once the
+			 * tree-walk of the partially built PruningInstance completed, and
+			 * it contains A and D, DistributePendingDisjunctions() adds it to
+			 * context->pendingInstances once for B and once for C.
 			 */
-			foreach(opCell, boolExpr->args)
-			{
-				AddNewConjuction(context, lfirst(opCell));
-			}
+			context->pendingDisjunctions = lappend(context->pendingDisjunctions,
+												   boolExpr);
 
 			return false;
 		}
@@ -636,6 +745,7 @@ AddSAOPartitionKeyRestrictionToInstance(ClauseWalkerContext *context,
 	bool usingEqualityOperator = OperatorImplementsEquality(
 		arrayOperatorExpression->opno);
 	Expr *arrayArgument = (Expr *) lsecond(arrayOperatorExpression->args);
+	List *arrayEqualityOpList = NIL;
 
 	/* checking for partcol = ANY(const, value, s); or partcol IN (const,b,c); */
 	if (usingEqualityOperator && strippedLeftOpExpression != NULL &&
@@ -659,6 +769,18 @@ AddSAOPartitionKeyRestrictionToInstance(ClauseWalkerContext *context,
 
 		/* get the necessary information from array type to iterate over it */
 		Oid elementType = ARR_ELEMTYPE(array);
+
+		/* large IN lists on hash-partitioned tables directly become a shard set */
+		if (context->partitionMethod == DISTRIBUTE_BY_HASH &&
+			arrayOperatorExpression->useOr &&
+			elementType == context->partitionColumn->vartype &&
+			ArrayGetNItems(ARR_NDIM(array), ARR_DIMS(array)) >=
+			SAOP_SHARD_SET_MIN_ELEMENTS)
+		{
+			AddShardIndexSetRestrictionToInstance(context, array);
+			return;
+		}
+
 		get_typlenbyvalalign(elementType,
 							 &typlen,
 							 &typbyval,
@@ -683,7 +805,16 @@ AddSAOPartitionKeyRestrictionToInstance(ClauseWalkerContext *context,
 			arrayEqualityOp->location = -1;
 			arrayEqualityOp->args = list_make2(strippedLeftOpExpression, constElement);
 
-			AddNewConjuction(context, arrayEqualityOp);
+			arrayEqualityOpList = lappend(arrayEqualityOpList, arrayEqualityOp);
+		}
+
+		/* partcol IN (a, b) is treated the same as partcol = a OR partcol = b */
+		if (arrayEqualityOpList != NIL)
+		{
+			Expr *disjunction = make_orclause(arrayEqualityOpList);
+
+			context->pendingDisjunctions = lappend(context->pendingDisjunctions,
+												   disjunction);
 		}
 	}
 
@@ -699,16 +830,81 @@ AddSAOPartitionKeyRestrictionToInstance(ClauseWalkerContext *context,
 
 
 /*
- * AddNewConjuction adds the OpExpr to pending instance list of context
+ * DistributePendingDisjunctions distributes the current pruning instance over
+ * the ORed expressions found while building it. For the first ORed expression,
+ * a pending instance is added for each of its arguments, which continues with
+ * the argument and all remaining ORed expressions, such that those are
+ * distributed over each of the new instances in turn.
+ *
+ * Once distributing the first expression would exceed MaxShardPruningInstances,
+ * pending instances are added for each argument of each ORed expression
+ * instead, which only continue with the argument itself.
+ */
+static void
+DistributePendingDisjunctions(ClauseWalkerContext *context)
+{
+	List *disjunctionList = context->pendingDisjunctions;
+	ListCell *disjunctionCell = NULL;
+	ListCell *argumentCell = NULL;
+
+	context->pendingDisjunctions = NIL;
+
+	if (disjunctionList == NIL)
+	{
+		return;
+	}
+
+	BoolExpr *firstDisjunction = (BoolExpr *) linitial(disjunctionList);
+	List *remainingDisjunctionList = list_copy_tail(disjunctionList, 1);
+	int newInstanceCount = list_length(firstDisjunction->args) - 1;
+
+	if (remainingDisjunctionList == NIL ||
+		context->expandedInstanceCount + newInstanceCount <= MaxShardPruningInstances)
+	{
+		context->expandedInstanceCount += newInstanceCount;
+
+		foreach(argumentCell, firstDisjunction->args)
+		{
+			Node *argument = (Node *) lfirst(argumentCell);
+
+			if (remainingDisjunctionList != NIL)
+			{
+				/* a list is treated as an AND by PrunableExpressionsWalker */
+				argument = (Node *) lcons(argument,
+										  list_copy(remainingDisjunctionList));
+			}
+
+			AddNewConjuction(context, argument);
+		}
+
+		return;
+	}
+
+	foreach(disjunctionCell, disjunctionList)
+	{
+		BoolExpr *disjunction = (BoolExpr *) lfirst(disjunctionCell);
+
+		context->expandedInstanceCount += list_length(disjunction->args) - 1;
+
+		foreach(argumentCell, disjunction->args)
+		{
+			AddNewConjuction(context, (Node *) lfirst(argumentCell));
+		}
+	}
+}
+
+
+/*
+ * AddNewConjuction adds the expression to pending instance list of context
  * as conjunction as partial instance.
  */
 static void
-AddNewConjuction(ClauseWalkerContext *context, OpExpr *op)
+AddNewConjuction(ClauseWalkerContext *context, Node *op)
 {
 	PendingPruningInstance *instance = palloc0(sizeof(PendingPruningInstance));
 
 	instance->instance = context->currentPruningInstance;
-	instance->continueAt = (Node *) op;
+	instance->continueAt = op;
 
 	/*
 	 * Signal that this instance is not to be used for pruning on
@@ -991,6 +1187,28 @@ ShardArrayToList(ShardInterval **shardArray, int length)
 }
 
 
+/*
+ * ShardIndexSetToList builds a list of the shards in the given set of indexes
+ * into the sorted shard interval array of the table, in the order of that
+ * array.
+ */
+static List *
+ShardIndexSetToList(DistTableCacheEntry *cacheEntry, Bitmapset *shardIndexSet)
+{
+	List *shardIntervalList = NIL;
+	int shardIndex = -1;
+
+	while ((shardIndex = bms_next_member(shardIndexSet, shardIndex)) >= 0)
+	{
+		ShardInterval *shardInterval = cacheEntry->sortedShardIntervalArray[shardIndex];
+
+		shardIntervalList = lappend(shardIntervalList, shardInterval);
+	}
+
+	return shardIntervalList;
+}
+
+
 /*
  * DeepCopyShardIntervalList copies originalShardIntervalList and the
  * contained ShardIntervals, into a new list.
@@ -1016,6 +1234,242 @@ DeepCopyShardIntervalList(List *originalShardIntervalList)
 }
 
 
+/*
+ * AddShardIndexSetRestrictionToInstance restricts the current pruning instance
+ * to the shards that contain any of the values in the given array, which must
+ * be of the type of the partition column of a hash-partitioned table.
+ */
+static void
+AddShardIndexSetRestrictionToInstance(ClauseWalkerContext *context, ArrayType *array)
+{
+	PruningInstance *prune = context->currentPruningInstance;
+	Bitmapset *shardIndexSet = ShardIndexSetForArray(context->cacheEntry, array);
+
+	if (!prune->addedToPruningInstances)
+	{
+		context->pruningInstances = lappend(context->pruningInstances, prune);
+		prune->addedToPruningInstances = true;
+	}
+
+	if (prune->shardIndexSet == NULL)
+	{
+		prune->shardIndexSet = shardIndexSet;
+	}
+	else
+	{
+		prune->shardIndexSet = bms_intersect(prune->shardIndexSet, shardIndexSet);
+	}
+
+	if (bms_is_empty(prune->shardIndexSet))
+	{
+		prune->evaluatesToFalse = true;
+	}
+
+	prune->hasValidConstraint = true;
+}
+
+
+/*
+ * ShardIndexSetForArray returns the set of indexes of the shards that contain
+ * the values in the given array, using the cache of previously built sets.
+ * The returned set is allocated in the current memory context.
+ */
+static Bitmapset *
+ShardIndexSetForArray(DistTableCacheEntry *cacheEntry, ArrayType *array)
+{
+	ShardSetCacheKey cacheKey;
+	bool found = false;
+
+	if (ShardSetCache == NULL)
+	{
+		InitializeShardSetCache();
+	}
+
+	memset(&cacheKey, 0, sizeof(cacheKey));
+	cacheKey.relationId = cacheEntry->relationId;
+	cacheKey.arrayHash = DatumGetUInt32(hash_any((unsigned char *) array,
+												 VARSIZE(array)));
+
+	ShardSetCacheEntry *cacheEntryForArray =
+		(ShardSetCacheEntry *) hash_search(ShardSetCache, &cacheKey, HASH_FIND,
+										   &found);
+	if (found && VARSIZE(cacheEntryForArray->array) == VARSIZE(array) &&
+		memcmp(cacheEntryForArray->array, array, VARSIZE(array)) == 0)
+	{
+		return bms_copy(cacheEntryForArray->shardIndexSet);
+	}
+
+	Bitmapset *shardIndexSet = BuildShardIndexSet(cacheEntry, array);
+
+	if (!found && hash_get_num_entries(ShardSetCache) >= MAX_SHARD_SET_CACHE_ENTRIES)
+	{
+		/* rather than tracking usage, start over once the cache is full */
+		InvalidateShardSetCache(InvalidOid);
+		InitializeShardSetCache();
+	}
+
+	if (found)
+	{
+		/* hash collision, replace the entry of the other array */
+		pfree(cacheEntryForArray->array);
+		bms_free(cacheEntryForArray->shardIndexSet);
+	}
+	else
+	{
+		cacheEntryForArray =
+			(ShardSetCacheEntry *) hash_search(ShardSetCache, &cacheKey, HASH_ENTER,
+											   &found);
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(ShardSetCacheContext);
+
+	cacheEntryForArray->array = (ArrayType *) palloc(VARSIZE(array));
+	memcpy(cacheEntryForArray->array, array, VARSIZE(array));
+	cacheEntryForArray->shardIndexSet = bms_copy(shardIndexSet);
+
+	MemoryContextSwitchTo(oldContext);
+
+	return shardIndexSet;
+}
+
+
+/*
+ * BuildShardIndexSet hashes each of the values in the given array once and
+ * returns the set of indexes of the shards that they fall into.
+ */
+static Bitmapset *
+BuildShardIndexSet(DistTableCacheEntry *cacheEntry, ArrayType *array)
+{
+	Bitmapset *shardIndexSet = NULL;
+	Datum arrayElement = 0;
+	bool isNull = false;
+
+	ArrayIterator arrayIterator = array_create_iterator(array, 0, NULL);
+	while (array_iterate(arrayIterator, &arrayElement, &isNull))
+	{
+		/* NULL never equals the partition column */
+		if (isNull)
+		{
+			continue;
+		}
+
+		ShardInterval *shardInterval = FindShardInterval(arrayElement, cacheEntry);
+		if (shardInterval != NULL)
+		{
+			shardIndexSet = bms_add_member(shardIndexSet, shardInterval->shardIndex);
+		}
+	}
+
+	array_free_iterator(arrayIterator);
+
+	return shardIndexSet;
+}
+
+
+/*
+ * InitializeShardSetCache creates the hash that maps IN lists to the sets of
+ * shard indexes they prune to.
+ */
+static void
+InitializeShardSetCache(void)
+{
+	HASHCTL info;
+
+	if (ShardSetCacheContext == NULL)
+	{
+		ShardSetCacheContext = AllocSetContextCreate(CacheMemoryContext,
+													 "ShardSetCacheContext",
+													 ALLOCSET_DEFAULT_SIZES);
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(ShardSetCacheKey);
+	info.entrysize = sizeof(ShardSetCacheEntry);
+	info.hash = tag_hash;
+	info.hcxt = ShardSetCacheContext;
+	uint32 hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+
+	ShardSetCache = hash_create("citus shard set cache", 32, &info, hashFlags);
+}
+
+
+/*
+ * InvalidateShardSetCache removes the cached shard sets of the given table,
+ * or of all tables if relationId is InvalidOid, since the shard indexes change
+ * whenever the shards of the table change.
+ */
+void
+InvalidateShardSetCache(Oid relationId)
+{
+	HASH_SEQ_STATUS status;
+	ShardSetCacheEntry *cacheEntry = NULL;
+
+	if (ShardSetCache == NULL)
+	{
+		return;
+	}
+
+	if (relationId == InvalidOid)
+	{
+		/* the hash itself lives in the memory context */
+		MemoryContextReset(ShardSetCacheContext);
+		ShardSetCache = NULL;
+		return;
+	}
+
+	hash_seq_init(&status, ShardSetCache);
+	while ((cacheEntry = (ShardSetCacheEntry *) hash_seq_search(&status)) != NULL)
+	{
+		if (cacheEntry->key.relationId != relationId)
+		{
+			continue;
+		}
+
+		pfree(cacheEntry->array);
+		bms_free(cacheEntry->shardIndexSet);
+
+		/* removing the current entry is allowed during a sequential scan */
+		hash_search(ShardSetCache, &cacheEntry->key, HASH_REMOVE, NULL);
+	}
+}
+
+
+/*
+ * PruneWithShardIndexSet returns the shards in the shard index set of the
+ * given pruning instance that also match its other constraints.
+ */
+static List *
+PruneWithShardIndexSet(DistTableCacheEntry *cacheEntry, ClauseWalkerContext *context,
+					   PruningInstance *prune)
+{
+	List *remainingShardList = NIL;
+
+	if (prune->equalConsts || prune->hashedEqualConsts)
+	{
+		PruningInstance equalityInstance = *prune;
+		List *equalityShardList = NIL;
+		ListCell *shardCell = NULL;
+
+		equalityInstance.shardIndexSet = NULL;
+		equalityShardList = PruneOne(cacheEntry, context, &equalityInstance);
+
+		foreach(shardCell, equalityShardList)
+		{
+			ShardInterval *shardInterval = (ShardInterval *) lfirst(shardCell);
+
+			if (bms_is_member(shardInterval->shardIndex, prune->shardIndexSet))
+			{
+				remainingShardList = lappend(remainingShardList, shardInterval);
+			}
+		}
+
+		return remainingShardList;
+	}
+
+	return ShardIndexSetToList(cacheEntry, prune->shardIndexSet);
+}
+
+
 /*
  * PruneOne returns all shards in the table that match a single
  * PruningInstance.
@@ -1032,6 +1486,12 @@ PruneOne(DistTableCacheEntry *cacheEntry, ClauseWalkerContext *context,
 		return NIL;
 	}
 
+	/* a large IN list already determined the candidate shards */
+	if (prune->shardIndexSet != NULL)
+	{
+		return PruneWithShardIndexSet(cacheEntry, context, prune);
+	}
+
 	/*
 	 * For an equal constraints, if there's no overlapping shards (always the
 	 * case for hash and range partitioning, sometimes for append), can
@@ -1131,6 +1591,19 @@ PruneOne(DistTableCacheEntry *cacheEntry, ClauseWalkerContext *context,
 		return PruneWithBoundaries(cacheEntry, context, prune);
 	}
 
+	/*
+	 * Overlapping shards are sorted by their min value as well, and we keep
+	 * track of the running max value, which allows us to narrow down the
+	 * range of shards to check.
+	 */
+	if (cacheEntry->maxValuePrefixIndexArray != NULL && (
+			prune->equalConsts ||
+			prune->greaterConsts || prune->greaterEqualConsts ||
+			prune->lessConsts || prune->lessEqualConsts))
+	{
+		return PruneOverlappingWithBoundaries(cacheEntry, context, prune);
+	}
+
 	/*
 	 * Brute force: Check each shard.
 	 */
@@ -1140,11 +1613,32 @@ PruneOne(DistTableCacheEntry *cacheEntry, ClauseWalkerContext *context,
 
 /*
  * PerformCompare invokes comparator with prepared values, check for
- * unexpected NULL returns.
+ * unexpected NULL returns. The comparators of integer, date and timestamp
+ * columns are evaluated inline rather than through fmgr.
  */
 static int
 PerformCompare(FunctionCallInfo compareFunctionCall)
 {
+	switch (DatumCompareKindForFunction(compareFunctionCall->flinfo->fn_oid))
+	{
+		case DATUM_COMPARE_INT32:
+		{
+			return CompareInt32Datums(fcGetArgValue(compareFunctionCall, 0),
+									  fcGetArgValue(compareFunctionCall, 1));
+		}
+
+		case DATUM_COMPARE_INT64:
+		{
+			return CompareInt64Datums(fcGetArgValue(compareFunctionCall, 0),
+									  fcGetArgValue(compareFunctionCall, 1));
+		}
+
+		default:
+		{
+			break;
+		}
+	}
+
 	Datum result = FunctionCallInvoke(compareFunctionCall);
 
 	if (compareFunctionCall->isnull)
@@ -1438,6 +1932,176 @@ PruneWithBoundaries(DistTableCacheEntry *cacheEntry, ClauseWalkerContext *contex
 }
 
 
+/*
+ * PruneOverlappingWithBoundaries returns the shards of a table with
+ * overlapping shards that match the constraints of the pruning instance.
+ *
+ * Since the shards are sorted by their min value, the shards that can match
+ * the upper bounds precede the first shard whose min value exceeds them.
+ * Since the running max value of the shards never decreases, the shards that
+ * precede the first one whose running max value reaches the lower bounds
+ * cannot match. Only the shards in between are checked one by one, which for
+ * shards that are mostly in order (e.g. time series) are close to the ones
+ * that match. Shards without min/max values always match.
+ */
+static List *
+PruneOverlappingWithBoundaries(DistTableCacheEntry *cacheEntry,
+							   ClauseWalkerContext *context, PruningInstance *prune)
+{
+	List *remainingShardList = NIL;
+	int shardCount = cacheEntry->shardIntervalArrayLength;
+	ShardInterval **sortedShardIntervalArray = cacheEntry->sortedShardIntervalArray;
+	FunctionCallInfo compareFunctionCall = (FunctionCallInfo) &
+										   context->compareIntervalFunctionCall;
+	int lowerBoundIndex = 0;
+	int upperBoundIndex = cacheEntry->initializedShardIntervalCount;
+
+	if (prune->equalConsts)
+	{
+		Datum value = prune->equalConsts->constvalue;
+
+		lowerBoundIndex = Max(lowerBoundIndex,
+							  OverlappingLowerShardBoundary(cacheEntry,
+															compareFunctionCall,
+															value, true));
+		upperBoundIndex = Min(upperBoundIndex,
+							  OverlappingUpperShardBoundary(cacheEntry,
+															compareFunctionCall,
+															value, true));
+	}
+	if (prune->greaterEqualConsts)
+	{
+		Datum value = prune->greaterEqualConsts->constvalue;
+
+		lowerBoundIndex = Max(lowerBoundIndex,
+							  OverlappingLowerShardBoundary(cacheEntry,
+															compareFunctionCall,
+															value, true));
+	}
+	if (prune->greaterConsts)
+	{
+		Datum value = prune->greaterConsts->constvalue;
+
+		lowerBoundIndex = Max(lowerBoundIndex,
+							  OverlappingLowerShardBoundary(cacheEntry,
+															compareFunctionCall,
+															value, false));
+	}
+	if (prune->lessEqualConsts)
+	{
+		Datum value = prune->lessEqualConsts->constvalue;
+
+		upperBoundIndex = Min(upperBoundIndex,
+							  OverlappingUpperShardBoundary(cacheEntry,
+															compareFunctionCall,
+															value, true));
+	}
+	if (prune->lessConsts)
+	{
+		Datum value = prune->lessConsts->constvalue;
+
+		upperBoundIndex = Min(upperBoundIndex,
+							  OverlappingUpperShardBoundary(cacheEntry,
+															compareFunctionCall,
+															value, false));
+	}
+
+	for (int curIdx = lowerBoundIndex; curIdx < upperBoundIndex; curIdx++)
+	{
+		ShardInterval *curInterval = sortedShardIntervalArray[curIdx];
+
+		if (!ExhaustivePruneOne(curInterval, context, prune))
+		{
+			remainingShardList = lappend(remainingShardList, curInterval);
+		}
+	}
+
+	/* NULL boundaries can't be compared to, the shards always match */
+	for (int curIdx = cacheEntry->initializedShardIntervalCount; curIdx < shardCount;
+		 curIdx++)
+	{
+		remainingShardList = lappend(remainingShardList,
+									 sortedShardIntervalArray[curIdx]);
+	}
+
+	return remainingShardList;
+}
+
+
+/*
+ * OverlappingUpperShardBoundary returns the index of the first shard whose
+ * min value is larger than the given upper bound, or equal to it if
+ * includeMin is false. The shards from that index on cannot match.
+ */
+static int
+OverlappingUpperShardBoundary(DistTableCacheEntry *cacheEntry,
+							  FunctionCallInfo compareFunction, Datum upperBound,
+							  bool includeMin)
+{
+	ShardInterval **sortedShardIntervalArray = cacheEntry->sortedShardIntervalArray;
+	int lowerIndex = 0;
+	int upperIndex = cacheEntry->initializedShardIntervalCount;
+
+	while (lowerIndex < upperIndex)
+	{
+		int middleIndex = lowerIndex + ((upperIndex - lowerIndex) / 2);
+		int compareResult =
+			PerformValueCompare(compareFunction,
+								sortedShardIntervalArray[middleIndex]->minValue,
+								upperBound);
+
+		if (compareResult < 0 || (includeMin && compareResult == 0))
+		{
+			lowerIndex = middleIndex + 1;
+		}
+		else
+		{
+			upperIndex = middleIndex;
+		}
+	}
+
+	return lowerIndex;
+}
+
+
+/*
+ * OverlappingLowerShardBoundary returns the index of the first shard up to
+ * which the largest max value is larger than the given lower bound, or equal
+ * to it if includeMax is true. The shards before that index cannot match.
+ */
+static int
+OverlappingLowerShardBoundary(DistTableCacheEntry *cacheEntry,
+							  FunctionCallInfo compareFunction, Datum lowerBound,
+							  bool includeMax)
+{
+	ShardInterval **sortedShardIntervalArray = cacheEntry->sortedShardIntervalArray;
+	int *maxValuePrefixIndexArray = cacheEntry->maxValuePrefixIndexArray;
+	int lowerIndex = 0;
+	int upperIndex = cacheEntry->initializedShardIntervalCount;
+
+	while (lowerIndex < upperIndex)
+	{
+		int middleIndex = lowerIndex + ((upperIndex - lowerIndex) / 2);
+		int maxValueIndex = maxValuePrefixIndexArray[middleIndex];
+		int compareResult =
+			PerformValueCompare(compareFunction,
+								sortedShardIntervalArray[maxValueIndex]->maxValue,
+								lowerBound);
+
+		if (compareResult > 0 || (includeMax && compareResult == 0))
+		{
+			upperIndex = middleIndex;
+		}
+		else
+		{
+			lowerIndex = middleIndex + 1;
+		}
+	}
+
+	return lowerIndex;
+}
+
+
 /*
  * ExhaustivePrune returns a list of shards matching PruningInstances
  * constraints, by simply checking them for each individual shard.
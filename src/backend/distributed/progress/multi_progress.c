@@ -12,19 +12,42 @@
 #include "pgstat.h"
 
 #include "distributed/function_utils.h"
+#include "distributed/listutils.h"
+#include "distributed/master_metadata_utility.h"
+#include "distributed/metadata_cache.h"
 #include "distributed/multi_progress.h"
+#include "distributed/tuplestore.h"
 #include "distributed/version_compat.h"
 #include "storage/dsm.h"
 #include "utils/builtins.h"
 
 
+/* number of columns returned by citus_progress */
+#define SHARD_OPERATION_PROGRESS_FIELDS 9
+
+
+/* config variable managed via guc.c */
+bool EnableOperationProgress = false;
+
 /* dynamic shared memory handle of the current progress */
 static uint64 currentProgressDSMHandle = DSM_HANDLE_INVALID;
 
+/* names of the operations and states, in the order of their enums */
+static const char *CitusOperationTypeNames[] = {
+	"copy", "create distributed table", "copy shard placement",
+	"move shard placement", "create index"
+};
+static const char *ShardOperationStatusNames[] = {
+	"waiting", "running", "done", "failed"
+};
+
 static ProgressMonitorData * MonitorDataFromDSMHandle(dsm_handle dsmHandle,
 													  dsm_segment **attachedSegment);
 
 
+PG_FUNCTION_INFO_V1(citus_progress);
+
+
 /*
  * CreateProgressMonitor is used to create a place to store progress information related
  * to long running processes. The function creates a dynamic shared memory segment
@@ -237,3 +260,191 @@ DetachFromDSMSegments(List *dsmSegmentList)
 		dsm_detach(dsmSegment);
 	}
 }
+
+
+/*
+ * ProgressMonitorActive returns whether the current backend publishes the
+ * progress of a command. Since a backend can only publish one progress
+ * monitor at a time, operations that run as part of another operation report
+ * their progress only when the outer operation does not.
+ */
+bool
+ProgressMonitorActive(void)
+{
+	if (currentProgressDSMHandle == DSM_HANDLE_INVALID)
+	{
+		return false;
+	}
+
+	/* the segment is detached when the transaction of the command aborts */
+	return dsm_find_mapping(currentProgressDSMHandle) != NULL;
+}
+
+
+/*
+ * CreateShardOperationProgressMonitor creates a progress monitor for the given
+ * operation on the given distributed table with stepCount steps, which are
+ * shown by citus_progress. The caller fills in the shard of each step.
+ */
+ProgressMonitorData *
+CreateShardOperationProgressMonitor(CitusOperationType operationType, Oid relationId,
+									int stepCount)
+{
+	ProgressMonitorData *monitor =
+		CreateProgressMonitor(SHARD_OPERATION_PROGRESS_MAGIC_NUMBER, stepCount,
+							  sizeof(ShardOperationProgress), relationId);
+	if (monitor == NULL)
+	{
+		return NULL;
+	}
+
+	ShardOperationProgress *stepArray = (ShardOperationProgress *) monitor->steps;
+	memset(stepArray, 0, stepCount * sizeof(ShardOperationProgress));
+
+	for (int stepIndex = 0; stepIndex < stepCount; stepIndex++)
+	{
+		stepArray[stepIndex].operationType = operationType;
+		stepArray[stepIndex].relationId = relationId;
+		stepArray[stepIndex].status = SHARD_OPERATION_WAITING;
+	}
+
+	return monitor;
+}
+
+
+/*
+ * StartShardOperationProgress creates a progress monitor for the given
+ * operation with a step for each of the given shards, in the same order, if
+ * citus.enable_operation_progress is enabled and the backend does not already
+ * publish the progress of another operation. Otherwise, it returns NULL.
+ */
+ProgressMonitorData *
+StartShardOperationProgress(CitusOperationType operationType, Oid relationId,
+							List *shardIntervalList)
+{
+	ShardInterval *shardInterval = NULL;
+	int stepIndex = 0;
+
+	if (!EnableOperationProgress || shardIntervalList == NIL || ProgressMonitorActive())
+	{
+		return NULL;
+	}
+
+	ProgressMonitorData *monitor =
+		CreateShardOperationProgressMonitor(operationType, relationId,
+											list_length(shardIntervalList));
+	if (monitor == NULL)
+	{
+		return NULL;
+	}
+
+	ShardOperationProgress *stepArray = (ShardOperationProgress *) monitor->steps;
+
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		stepArray[stepIndex++].shardId = shardInterval->shardId;
+	}
+
+	return monitor;
+}
+
+
+/*
+ * FindShardOperationProgress returns the step of the given progress monitor
+ * for the given shard, or NULL if there is none.
+ */
+ShardOperationProgress *
+FindShardOperationProgress(ProgressMonitorData *monitor, uint64 shardId)
+{
+	ShardOperationProgress *stepArray = (ShardOperationProgress *) monitor->steps;
+
+	for (int stepIndex = 0; stepIndex < monitor->stepCount; stepIndex++)
+	{
+		if (stepArray[stepIndex].shardId == shardId)
+		{
+			return &stepArray[stepIndex];
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * SetShardOperationProgressStatus sets the status of all the steps of the
+ * given progress monitor.
+ */
+void
+SetShardOperationProgressStatus(ProgressMonitorData *monitor,
+								ShardOperationStatus status)
+{
+	ShardOperationProgress *stepArray = (ShardOperationProgress *) monitor->steps;
+
+	for (int stepIndex = 0; stepIndex < monitor->stepCount; stepIndex++)
+	{
+		stepArray[stepIndex].status = status;
+	}
+}
+
+
+/*
+ * citus_progress returns the progress of the ongoing distributed operations
+ * on this node, with a row for each shard or shard placement they work on.
+ */
+Datum
+citus_progress(PG_FUNCTION_ARGS)
+{
+	List *attachedDSMSegmentList = NIL;
+	ProgressMonitorData *monitor = NULL;
+	TupleDesc tupleDescriptor = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	List *monitorList = ProgressMonitorList(SHARD_OPERATION_PROGRESS_MAGIC_NUMBER,
+											&attachedDSMSegmentList);
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	foreach_ptr(monitor, monitorList)
+	{
+		ShardOperationProgress *stepArray = (ShardOperationProgress *) monitor->steps;
+
+		for (int stepIndex = 0; stepIndex < monitor->stepCount; stepIndex++)
+		{
+			ShardOperationProgress *step = &stepArray[stepIndex];
+			Datum values[SHARD_OPERATION_PROGRESS_FIELDS];
+			bool isNulls[SHARD_OPERATION_PROGRESS_FIELDS];
+
+			memset(values, 0, sizeof(values));
+			memset(isNulls, false, sizeof(isNulls));
+
+			values[0] = Int32GetDatum(monitor->processId);
+			values[1] = CStringGetTextDatum(
+				CitusOperationTypeNames[step->operationType]);
+			values[2] = ObjectIdGetDatum(step->relationId);
+			values[3] = Int64GetDatum(step->shardId);
+
+			if (step->nodePort != 0)
+			{
+				values[4] = CStringGetTextDatum(step->nodeName);
+				values[5] = Int32GetDatum(step->nodePort);
+			}
+			else
+			{
+				isNulls[4] = true;
+				isNulls[5] = true;
+			}
+
+			values[6] = CStringGetTextDatum(ShardOperationStatusNames[step->status]);
+			values[7] = Int64GetDatum(step->rowsProcessed);
+			values[8] = Int64GetDatum(step->bytesProcessed);
+
+			tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+		}
+	}
+
+	tuplestore_donestoring(tupleStore);
+
+	DetachFromDSMSegments(attachedDSMSegmentList);
+
+	return (Datum) 0;
+}
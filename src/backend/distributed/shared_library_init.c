@@ -19,43 +19,78 @@
 #include "citus_version.h"
 #include "commands/explain.h"
 #include "executor/executor.h"
+#include "distributed/admission_control.h"
 #include "distributed/backend_data.h"
+#include "distributed/citus_custom_scan.h"
 #include "distributed/citus_nodefuncs.h"
+#include "distributed/citus_ruleutils.h"
 #include "distributed/commands.h"
+#include "distributed/commands/binary_copy.h"
 #include "distributed/commands/multi_copy.h"
+#include "distributed/commands/parallel_copy.h"
+#include "distributed/commands/parallel_copy_to.h"
 #include "distributed/commands/utility_hook.h"
+#include "distributed/connection_establishment_stats.h"
 #include "distributed/connection_management.h"
+#include "distributed/cte_inline.h"
+#include "distributed/deferred_cleanup.h"
 #include "distributed/distributed_deadlock_detection.h"
+#include "distributed/foreign_key_relationship.h"
+#include "distributed/insert_select_executor.h"
+#include "distributed/insert_select_planner.h"
 #include "distributed/intermediate_result_pruning.h"
+#include "distributed/intermediate_result_scan.h"
+#include "distributed/intermediate_results.h"
 #include "distributed/local_executor.h"
 #include "distributed/maintenanced.h"
+#include "distributed/memory_usage.h"
 #include "distributed/master_metadata_utility.h"
 #include "distributed/master_protocol.h"
+#include "distributed/metadata/dependency.h"
+#include "distributed/metadata/shard_column_stats.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/metadata_sync.h"
 #include "distributed/multi_executor.h"
 #include "distributed/multi_explain.h"
 #include "distributed/multi_join_order.h"
 #include "distributed/multi_logical_optimizer.h"
+#include "distributed/multi_logical_planner.h"
+#include "distributed/multi_master_planner.h"
+#include "distributed/multi_progress.h"
 #include "distributed/distributed_planner.h"
 #include "distributed/multi_router_planner.h"
 #include "distributed/multi_server_executor.h"
 #include "distributed/pg_dist_partition.h"
 #include "distributed/placement_connection.h"
+#include "distributed/planning_phases.h"
 #include "distributed/relation_access_tracking.h"
 #include "distributed/run_from_same_connection.h"
 #include "distributed/query_pushdown_planning.h"
 #include "distributed/time_constants.h"
+#include "distributed/transmit.h"
 #include "distributed/query_stats.h"
+#include "distributed/recursive_planning.h"
+#include "distributed/reference_table_utils.h"
 #include "distributed/remote_commands.h"
+#include "distributed/remote_prepared_statements.h"
+#include "distributed/remote_transaction.h"
+#include "distributed/repartition_join_execution.h"
+#include "distributed/resource_lock.h"
+#include "distributed/shared_connection_stats.h"
 #include "distributed/shared_library_init.h"
+#include "distributed/shared_metadata_cache.h"
+#include "distributed/shard_access_stats.h"
+#include "distributed/shard_pruning.h"
+#include "distributed/shard_split_decoder.h"
 #include "distributed/statistics_collection.h"
 #include "distributed/subplan_execution.h"
 #include "distributed/task_tracker.h"
 #include "distributed/transaction_management.h"
 #include "distributed/transaction_recovery.h"
+#include "distributed/worker_latency_stats.h"
 #include "distributed/worker_manager.h"
 #include "distributed/worker_protocol.h"
+#include "distributed/worker_repartition_cache.h"
 #include "distributed/worker_shard_visibility.h"
 #include "port/atomics.h"
 #include "postmaster/postmaster.h"
@@ -101,10 +136,17 @@ static const struct config_enum_entry propagate_set_commands_options[] = {
 };
 
 
+static const struct config_enum_entry stat_statements_track_options[] = {
+	{ "none", STAT_STATEMENTS_TRACK_NONE, false },
+	{ "all", STAT_STATEMENTS_TRACK_ALL, false },
+	{ NULL, 0, false }
+};
+
 static const struct config_enum_entry task_assignment_policy_options[] = {
 	{ "greedy", TASK_ASSIGNMENT_GREEDY, false },
 	{ "first-replica", TASK_ASSIGNMENT_FIRST_REPLICA, false },
 	{ "round-robin", TASK_ASSIGNMENT_ROUND_ROBIN, false },
+	{ "least-loaded", TASK_ASSIGNMENT_LEAST_LOADED, false },
 	{ NULL, 0, false }
 };
 
@@ -121,16 +163,24 @@ static const struct config_enum_entry task_executor_type_options[] = {
 	{ NULL, 0, false }
 };
 
+static const struct config_enum_entry intermediate_result_size_limit_action_options[] = {
+	{ "error", INTERMEDIATE_RESULT_SIZE_LIMIT_ERROR, false },
+	{ "spill", INTERMEDIATE_RESULT_SIZE_LIMIT_SPILL, false },
+	{ NULL, 0, false }
+};
+
 static const struct config_enum_entry shard_placement_policy_options[] = {
 	{ "local-node-first", SHARD_PLACEMENT_LOCAL_NODE_FIRST, false },
 	{ "round-robin", SHARD_PLACEMENT_ROUND_ROBIN, false },
 	{ "random", SHARD_PLACEMENT_RANDOM, false },
+	{ "least-utilized", SHARD_PLACEMENT_LEAST_UTILIZED, false },
 	{ NULL, 0, false }
 };
 
 static const struct config_enum_entry use_secondary_nodes_options[] = {
 	{ "never", USE_SECONDARY_NODES_NEVER, false },
 	{ "always", USE_SECONDARY_NODES_ALWAYS, false },
+	{ "prefer", USE_SECONDARY_NODES_PREFER, false },
 	{ NULL, 0, false }
 };
 
@@ -156,6 +206,12 @@ static const struct config_enum_entry multi_shard_modify_connection_options[] =
 	{ NULL, 0, false }
 };
 
+static const struct config_enum_entry execution_priority_options[] = {
+	{ "normal", EXECUTION_PRIORITY_NORMAL, false },
+	{ "high", EXECUTION_PRIORITY_HIGH, false },
+	{ NULL, 0, false }
+};
+
 /* *INDENT-ON* */
 
 
@@ -228,6 +284,7 @@ _PG_init(void)
 	set_join_pathlist_hook = multi_join_restriction_hook;
 	ExecutorStart_hook = CitusExecutorStart;
 	ExecutorRun_hook = CitusExecutorRun;
+	ExplainOneQuery_hook = CitusExplainOneQuery;
 
 	/* register hook for error messages */
 	emit_log_hook = multi_log_hook;
@@ -242,7 +299,13 @@ _PG_init(void)
 	InitializeBackendManagement();
 	InitializeConnectionManagement();
 	InitPlacementConnectionManagement();
+	InitializeSharedConnectionStats();
+	InitializeAdmissionControl();
+	InitializeConnectionEstablishmentStats();
+	InitializeSharedMetadataCache();
 	InitializeCitusQueryStats();
+	InitializeShardAccessStats();
+	InitializeShardSplitDecoder();
 
 	/* enable modification of pg_catalog tables during pg_upgrade */
 	if (IsBinaryUpgrade)
@@ -433,6 +496,70 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_local_execution_for_multi_shard_reads",
+		gettext_noop("Enables local execution of multi-shard reads that only "
+					 "access shards on the current node."),
+		gettext_noop("By default, such reads connect to the current node once for "
+					 "each shard to read the shards in parallel. When enabled, the "
+					 "shards are read locally one at a time, where each read may "
+					 "use parallel workers. This only applies outside of "
+					 "transaction blocks."),
+		&EnableLocalExecutionForMultiShardReads,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_local_copy",
+		gettext_noop("Enables copying rows into shards on the local node without "
+					 "a connection."),
+		gettext_noop("When enabled, COPY into a distributed table copies the rows "
+					 "for shard placements on the node that runs the COPY directly "
+					 "into the shards, and only opens connections for the other "
+					 "placements. This is useful when clients spread COPY over all "
+					 "nodes of a cluster with synced metadata. It requires "
+					 "citus.enable_local_execution."),
+		&EnableLocalCopy,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_binary_copy_passthrough",
+		gettext_noop("Passes binary COPY input rows through to the shards "
+					 "without parsing them"),
+		gettext_noop("When enabled, COPY ... FROM with binary input into a hash "
+					 "distributed or reference table only decodes the "
+					 "distribution column of every row to find its shard, and "
+					 "sends the row to the shard as it arrived. This requires "
+					 "the input to contain all columns of the table and the "
+					 "columns to be sent to the workers in binary. The other "
+					 "values are then only checked by the workers."),
+		&EnableBinaryCopyPassthrough,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_parallel_copy_to_stdout",
+		gettext_noop("Streams COPY ... TO STDOUT of distributed tables from the "
+					 "shards in parallel"),
+		gettext_noop("When enabled, COPY of a distributed table TO STDOUT runs "
+					 "the COPY on the shards over one connection per worker and "
+					 "forwards the copy data to the client, instead of running a "
+					 "SELECT over the table and serialising its result on the "
+					 "coordinator. Rows of different shards are interleaved. "
+					 "COPY with a header line is still done through a SELECT."),
+		&EnableParallelCopyToStdout,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_single_hash_repartition_joins",
 		gettext_noop("Enables single hash repartitioning between hash "
@@ -444,6 +571,84 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_binary_protocol",
+		gettext_noop("Enables requesting the results of tasks in binary format"),
+		gettext_noop("When enabled, the workers return the rows of a task in binary "
+					 "format if all column types have binary send and receive "
+					 "functions, which avoids parsing the values on the "
+					 "coordinator. The worker needs to return the same built-in "
+					 "types as the coordinator expects."),
+		&EnableBinaryProtocol,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_cost_based_join_order",
+		gettext_noop("Breaks ties between join orders by estimated data transfer."),
+		gettext_noop("Among join orders that need the same kinds of "
+					 "repartitioning, the planner by default prefers those "
+					 "that repartition late. When enabled, it first prefers "
+					 "join orders that are estimated to move the fewest bytes, "
+					 "using the shard sizes recorded in the metadata."),
+		&EnableCostBasedJoinOrder,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_coordinator_partition_pruning",
+		gettext_noop("Prunes partitions of distributed partitioned tables on the "
+					 "coordinator."),
+		gettext_noop("Queries on distributed partitioned tables are sent to the "
+					 "shards of the parent table, on which the workers prune the "
+					 "partitions. The coordinator still locks all partitions of "
+					 "the table for every query. When enabled, the coordinator "
+					 "uses the partition bounds and the filters of the query to "
+					 "only lock the partitions that may contain matching rows."),
+		&EnableCoordinatorPartitionPruning,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_repartitioned_count_distinct",
+		gettext_noop("Counts distinct values on the workers after repartitioning "
+					 "them."),
+		gettext_noop("An exact count(DISTINCT) on a column other than the "
+					 "distribution column normally sends the distinct values of "
+					 "each shard to the coordinator, which counts them. When "
+					 "enabled, queries that only compute such a count instead "
+					 "repartition the distinct values among the workers by "
+					 "their hash, such that the workers count them and the "
+					 "coordinator only adds up the counts."),
+		&EnableRepartitionedCountDistinct,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.broadcast_join_size_limit",
+		gettext_noop("Sets the maximum size of tables that repartition joins "
+					 "broadcast."),
+		gettext_noop("When a distributed table would otherwise be joined "
+					 "through a dual partition join and its shards are "
+					 "recorded to be at most this size in total, the workers "
+					 "send a full copy of the table next to each shard of the "
+					 "table it joins with, which then does not move. Shard "
+					 "sizes are kept for append distributed tables and by "
+					 "citus_update_table_statistics(). 0 disables broadcasts."),
+		&BroadcastJoinSizeLimit,
+		0, 0, (INT_MAX / 1024), /* result stored in int variable */
+		PGC_USERSET,
+		GUC_UNIT_KB | GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_fast_path_router_planner",
 		gettext_noop("Enables fast path router planner"),
@@ -454,6 +659,103 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_fast_shard_query_deparse",
+		gettext_noop("Deparses simple shard queries without the full ruleutils code"),
+		gettext_noop("Router INSERT commands are deparsed for every shard they "
+					 "go to, and often for every execution. When enabled, "
+					 "single-row INSERT commands with only constants, parameters "
+					 "and simple expressions are written directly, which is much "
+					 "cheaper and yields the same query string. Other commands "
+					 "are deparsed as usual."),
+		&EnableFastShardQueryDeparse,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_cte_inlining",
+		gettext_noop("Enables inlining CTEs into the distributed query"),
+		gettext_noop("Multi-shard queries recursively plan their CTEs, meaning "
+					 "the CTE results are collected on the coordinator and "
+					 "broadcast to the workers. When enabled, CTEs that are "
+					 "referenced once and do not have side effects are first "
+					 "inlined into the query, which often allows pushing them "
+					 "down. If the inlined query cannot be planned, the CTEs are "
+					 "recursively planned as before."),
+		&EnableCTEInlining,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_subquery_decorrelation",
+		gettext_noop("Enables decorrelating EXISTS subqueries in the WHERE clause"),
+		gettext_noop("Correlated subqueries cannot be recursively planned, so "
+					 "queries with an EXISTS or NOT EXISTS subquery that is not "
+					 "correlated on the distribution columns cannot be planned. "
+					 "When enabled, such subqueries with a single correlated "
+					 "equality are turned into IN subqueries that group the "
+					 "matching values, which are recursively planned."),
+		&EnableSubqueryDecorrelation,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_single_shard_join_transfer",
+		gettext_noop("Moves single shard sides of non-colocated joins between "
+					 "workers."),
+		gettext_noop("When a distributed table is filtered down to a single shard "
+					 "and joined with tables it is not colocated with, the table "
+					 "is planned as a subquery whose result goes to the nodes of "
+					 "the other tables, rather than repartitioning the join. The "
+					 "nodes fetch such results of a single task directly from the "
+					 "node that computed them, without passing them through the "
+					 "coordinator, so citus.max_intermediate_result_size does not "
+					 "apply to them."),
+		&EnableSingleShardJoinTransfer,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_shard_pruning_instances",
+		gettext_noop("Sets the maximum number of ANDed combinations that nested "
+					 "OR clauses are expanded into during shard pruning."),
+		gettext_noop("Filters of the form (P OR Q) AND (R OR S) are expanded into "
+					 "(P AND R) OR (P AND S) OR (Q AND R) OR (Q AND S) to prune "
+					 "shards precisely. Since the number of combinations grows "
+					 "exponentially with the number of OR clauses, the expansion "
+					 "stops at this limit, after which the OR clauses are pruned "
+					 "separately, which may select more shards than necessary."),
+		&MaxShardPruningInstances,
+		64, 1, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_column_statistics_pruning",
+		gettext_noop("Enables pruning shards of append-distributed tables using "
+					 "column statistics"),
+		gettext_noop("When enabled, restrictions on columns that were added using "
+					 "citus_add_shard_statistics_column() are compared to the "
+					 "min/max values of those columns in each shard, and shards "
+					 "that cannot contain matching rows are skipped. The "
+					 "statistics are refreshed by master_update_shard_statistics() "
+					 "and when appending to a shard, so they must be refreshed "
+					 "after modifying the shards in other ways."),
+		&EnableColumnStatisticsPruning,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.override_table_visibility",
 		gettext_noop("Enables replacing occurencens of pg_catalog.pg_table_visible() "
@@ -480,6 +782,23 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.track_foreign_key_relation_accesses_only",
+		gettext_noop("Only tracks accesses to relations that have foreign keys."),
+		gettext_noop("Citus keeps track of the relations accessed in a transaction "
+					 "block to detect conflicting accesses between reference tables "
+					 "and the distributed tables referencing them. When enabled, "
+					 "only the accesses to relations that are part of a foreign key "
+					 "relationship are tracked, which keeps the overhead low in long "
+					 "transactions that touch many other tables. Accesses that "
+					 "happen before a foreign key is created in the same "
+					 "transaction are then not taken into account."),
+		&TrackForeignKeyRelationAccessesOnly,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 
 	DefineCustomBoolVariable(
 		"citus.subquery_pushdown",
@@ -512,6 +831,18 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.log_planning_phases",
+		gettext_noop("Logs the time spent in each phase of distributed planning"),
+		gettext_noop("When enabled, the time spent in each phase of planning a "
+					 "distributed query and the shard pruning counts are logged "
+					 "in the server log."),
+		&LogPlanningPhases,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.log_local_commands",
 		gettext_noop("Log queries that are executed locally, can be overriden by "
@@ -533,6 +864,121 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_intermediate_result_partitioning",
+		gettext_noop("Sends each node only the part of an intermediate result "
+					 "that its shards need"),
+		gettext_noop("When the result of a subquery or CTE is only joined on "
+					 "the distribution column of a hash distributed table, the "
+					 "rows are partitioned by the shards of that table and each "
+					 "node only receives the rows of the shards it has placements "
+					 "of, instead of the full result."),
+		&EnableIntermediateResultPartitioning,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_streaming_results",
+		gettext_noop("Enables returning the rows of a multi-shard SELECT as they "
+					 "arrive from the workers"),
+		gettext_noop("When enabled, a SELECT that runs outside of a transaction "
+					 "block returns rows while the tasks are still running, instead "
+					 "of after all tasks finished. The same applies to the RETURNING "
+					 "rows of a single modification when citus.sort_returning is "
+					 "off."),
+		&EnableStreamingResults,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_worker_prepared_statements",
+		gettext_noop("Enables preparing parameterized task queries on the workers"),
+		gettext_noop("When enabled, the executor prepares the query of a task that "
+					 "contains parameters once per worker connection and afterwards "
+					 "only sends the parameter values. Disable this setting when "
+					 "connecting to the workers through a pooler that does not "
+					 "keep prepared statements, such as pgbouncer in transaction "
+					 "pooling mode."),
+		&EnableWorkerPreparedStatements,
+		true,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_task_result_merge",
+		gettext_noop("Enables merging the sorted results of tasks on the coordinator"),
+		gettext_noop("When the ORDER BY of a multi-shard SELECT is pushed down to the "
+					 "workers along with the LIMIT, the rows of each task are already "
+					 "sorted. When enabled, the coordinator merges the rows of the "
+					 "tasks in sort order instead of sorting all rows again. With "
+					 "citus.sort_returning, the workers also sort the RETURNING "
+					 "rows of each task, which are then merged."),
+		&EnableTaskResultMerge,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_streaming_intermediate_results",
+		gettext_noop("Enables reading intermediate results one row at a time"),
+		gettext_noop("When enabled, read_intermediate_result calls with constant "
+					 "arguments are executed by a custom scan that parses rows "
+					 "straight from the memory-mapped result file, instead of "
+					 "materializing the whole result before returning the first "
+					 "row. The setting applies to the node that reads the result."),
+		&EnableStreamingIntermediateResults,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_columnar_intermediate_results",
+		gettext_noop("Enables writing intermediate results in a columnar format"),
+		gettext_noop("When enabled, intermediate results whose columns all support "
+					 "binary encoding are written in chunks of binary encoded "
+					 "columns instead of the COPY format. All nodes need to run a "
+					 "Citus version that can read this format."),
+		&EnableColumnarIntermediateResults,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_intermediate_result_reuse",
+		gettext_noop("Enables reusing subplan results within a transaction"),
+		gettext_noop("When enabled, a subplan that runs the same query as an "
+					 "earlier subplan in a REPEATABLE READ or SERIALIZABLE "
+					 "transaction that has not modified any data links to the "
+					 "earlier result on each node instead of executing the "
+					 "query and broadcasting its result again."),
+		&EnableSubPlanResultReuse,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_parallel_subplan_execution",
+		gettext_noop("Runs the tasks of independent subplans concurrently"),
+		gettext_noop("When enabled, the tasks of subplans that do not read the "
+					 "results of other subplans and whose rows the coordinator "
+					 "returns as they are run in a single distributed execution "
+					 "before the intermediate results are written, instead of "
+					 "one subplan after the other."),
+		&EnableParallelSubPlanExecution,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.log_distributed_deadlock_detection",
 		gettext_noop("Log distributed deadlock detection related processing in "
@@ -569,6 +1015,20 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.explain_planning_phases",
+		gettext_noop("Shows the time spent in each phase of distributed planning "
+					 "in Explain."),
+		gettext_noop("When enabled, the summary of Explain for distributed "
+					 "queries includes the time spent in each phase of "
+					 "distributed planning and the number of shards that "
+					 "were considered and kept by shard pruning."),
+		&ExplainPlanningPhases,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.all_modifications_commutative",
 		gettext_noop("Bypasses commutativity checks when enabled"),
@@ -592,6 +1052,54 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		ErrorIfNotASuitableDeadlockFactor, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_parallel_maintenance_tasks",
+		gettext_noop("Runs each periodic maintenance task in its own background "
+					 "worker."),
+		gettext_noop("By default, the maintenance daemon of each database runs "
+					 "distributed deadlock detection, 2PC recovery, metadata "
+					 "sync and statistics collection one after the other, such "
+					 "that a slow task delays the others. When enabled, each "
+					 "task runs in a separate background worker with its own "
+					 "interval, which requires additional worker processes per "
+					 "database. Tasks for which no worker can be started are "
+					 "still run by the maintenance daemon."),
+		&EnableParallelMaintenanceTasks,
+		false,
+		PGC_SIGHUP,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_deferred_cleanup",
+		gettext_noop("Removes job directories and intermediate results in the "
+					 "background."),
+		gettext_noop("Job directories of the task-tracker executor and the "
+					 "intermediate results of a transaction are normally "
+					 "removed when the query or transaction ends, which takes "
+					 "long when they contain many files. When enabled, they are "
+					 "moved aside instead and the maintenance daemon removes "
+					 "them at the rate set by "
+					 "citus.deferred_cleanup_files_per_second."),
+		&EnableDeferredCleanup,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.deferred_cleanup_files_per_second",
+		gettext_noop("Sets the maximum number of files that deferred cleanup "
+					 "removes per second."),
+		gettext_noop("Limiting the rate at which the maintenance daemon removes "
+					 "files avoids I/O latency spikes when large job "
+					 "directories or intermediate results are removed."),
+		&DeferredCleanupFilesPerSecond,
+		1000, 1, INT_MAX,
+		PGC_SIGHUP,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.recover_2pc_interval",
 		gettext_noop("Sets the time to wait between recovering 2PCs."),
@@ -630,6 +1138,43 @@ RegisterCitusConfigVariables(void)
 		GUC_UNIT_MS | GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_binary_metadata_sync",
+		gettext_noop("Copies shard metadata to metadata nodes in binary format"),
+		gettext_noop("When enabled, the pg_dist_shard and pg_dist_placement rows "
+					 "of a metadata snapshot are sent to metadata nodes using "
+					 "COPY in binary format, instead of as INSERT commands."),
+		&EnableBinaryMetadataSync,
+		true,
+		PGC_USERSET,
+		GUC_NO_SHOW_ALL,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_table_ddl_cache",
+		gettext_noop("Caches the DDL commands of distributed tables."),
+		gettext_noop("When enabled, the commands that recreate a distributed table "
+					 "for its shards are generated once and reused for creating "
+					 "and repairing shards, until the next DDL command runs."),
+		&EnableTableDDLCommandCache,
+		false,
+		PGC_USERSET,
+		GUC_NO_SHOW_ALL,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_concurrent_metadata_syncs",
+		gettext_noop("Sets the maximum number of nodes to sync metadata to at once."),
+		gettext_noop("When metadata needs to be synced to multiple metadata nodes, "
+					 "for instance after master_update_node, the maintenance daemon "
+					 "syncs the metadata to up to this many nodes in parallel. When "
+					 "set to 1, nodes are synced one at a time."),
+		&MaxConcurrentMetadataSyncs,
+		1, 1, 1000,
+		PGC_SIGHUP,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.select_opens_transaction_block",
 		gettext_noop("Open transaction blocks for SELECT commands"),
@@ -693,6 +1238,86 @@ RegisterCitusConfigVariables(void)
 		GUC_UNIT_MS | GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_adaptive_slow_start",
+		gettext_noop("Enables sizing connection pools by the observed task latency"),
+		gettext_noop("When enabled, the executor keeps track of how long tasks and "
+					 "connection establishment take on each worker for the duration "
+					 "of the session. Once it knows both, it opens only as many "
+					 "connections as the ready tasks justify and opens them at once, "
+					 "instead of waiting citus.executor_slow_start_interval between "
+					 "connection attempts."),
+		&EnableAdaptiveSlowStart,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.executor_task_batch_size",
+		gettext_noop("Sets the maximum number of tasks the executor sends in a "
+					 "single command over a connection"),
+		gettext_noop("When a multi-shard query has many shards per worker node, "
+					 "the executor spends most of its time waiting for a network "
+					 "round trip per task. When this setting is larger than 1, the "
+					 "executor sends up to the configured number of tasks as a "
+					 "single multi-statement command over a connection. Tasks of "
+					 "a modification are only combined if the command runs in a "
+					 "transaction block and any failure fails the whole command."),
+		&ExecutorTaskBatchSize,
+		1, 1, INT_MAX,
+		PGC_USERSET,
+		GUC_NO_SHOW_ALL,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.send_begin_with_first_task",
+		gettext_noop("Sends the BEGIN of a transaction block in the same command as "
+					 "the first task over a connection"),
+		gettext_noop("In a transaction block, the executor first sends BEGIN and "
+					 "assign_distributed_transaction_id() over each connection and "
+					 "waits for them to complete before sending the first task, "
+					 "which costs a network round trip per connection. When "
+					 "enabled, they are sent in a single command with the first "
+					 "task, unless the task has parameters or the transaction "
+					 "has savepoints or SET LOCAL commands to restore."),
+		&SendBeginWithFirstTask,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.execute_largest_shards_first",
+		gettext_noop("Starts the tasks on the largest shards first"),
+		gettext_noop("By default, the executor starts the tasks of a multi-shard "
+					 "query on a worker node in the order of the task list. When "
+					 "enabled, the tasks that can run over any connection are "
+					 "started in order of decreasing shard size, as recorded in "
+					 "pg_dist_placement, such that the slowest tasks do not "
+					 "start last and delay the whole query."),
+		&ExecuteLargestShardsFirst,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_hedged_reads",
+		gettext_noop("Starts slow reads on another shard placement as well"),
+		gettext_noop("When enabled, a read-only task on a shard with multiple "
+					 "placements, such as a reference table shard, that takes "
+					 "longer than the estimated 95th percentile of the task "
+					 "durations on its worker node is also started on the next "
+					 "placement, and the rows of whichever placement responds "
+					 "first are used. Reads inside transaction blocks are not "
+					 "hedged."),
+		&EnableHedgedReads,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_deadlock_prevention",
 		gettext_noop("Avoids deadlocks by preventing concurrent multi-shard commands"),
@@ -708,6 +1333,38 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_shard_range_locks",
+		gettext_noop("Locks ranges of consecutive shards with a single lock"),
+		gettext_noop("Multi-shard commands take a lock on every shard they modify, "
+					 "which can fill the lock table for tables with many shards. "
+					 "When enabled, shards in a range of 64 consecutive shard ids "
+					 "that are all locked by a command are locked with a single "
+					 "range lock, at the cost of an additional lock for commands "
+					 "on a single shard. This setting needs to be the same on all "
+					 "nodes."),
+		&EnableShardRangeLocks,
+		false,
+		PGC_POSTMASTER,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_table_shard_locks",
+		gettext_noop("Locks all shards of a distributed table with a single lock"),
+		gettext_noop("When enabled, multi-shard commands that lock all shards of a "
+					 "distributed table, on the coordinator or on workers with "
+					 "metadata, take a single lock for the table instead of a lock "
+					 "per shard, at the cost of an additional lock for commands on "
+					 "a single shard. This setting takes precedence over "
+					 "citus.enable_shard_range_locks and needs to be the same on all "
+					 "nodes."),
+		&EnableTableShardLocks,
+		false,
+		PGC_POSTMASTER,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_ddl_propagation",
 		gettext_noop("Enables propagating DDL statements to worker shards"),
@@ -718,6 +1375,93 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_analyze_statistics_collection",
+		gettext_noop("Records shard statistics on the coordinator after ANALYZE"),
+		gettext_noop("When enabled, ANALYZE and VACUUM ANALYZE of a distributed "
+					 "table read back the size, page count and row count of its "
+					 "shards, and store them in pg_dist_placement and in the "
+					 "pg_class entry of the table on the coordinator, like "
+					 "citus_update_table_statistics() does."),
+		&EnableAnalyzeStatisticsCollection,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_batched_truncate",
+		gettext_noop("Truncates all shards of a table on a node in one command"),
+		gettext_noop("By default, a TRUNCATE of a distributed table sends one "
+					 "command per shard placement. When enabled, and no shard "
+					 "placements were accessed earlier in the transaction, one "
+					 "TRUNCATE listing all shards of the table is sent to each "
+					 "node instead, which saves round trips and lock "
+					 "acquisitions, in particular in sequential mode."),
+		&EnableBatchedTruncate,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_concurrent_index_build_retries",
+		gettext_noop("Retries the shards on which CREATE INDEX CONCURRENTLY failed"),
+		gettext_noop("By default, a failure on one shard aborts CREATE INDEX "
+					 "CONCURRENTLY on all shards and leaves invalid indexes "
+					 "behind. When enabled, the shard indexes are built over "
+					 "dedicated connections, a failed shard build is cleaned up "
+					 "and retried once without affecting the other shards, and "
+					 "the progress of the builds is shown by "
+					 "get_index_build_progress()."),
+		&EnableConcurrentIndexBuildRetries,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_operation_progress",
+		gettext_noop("Publishes the progress of distributed operations per shard"),
+		gettext_noop("When enabled, COPY into distributed tables, "
+					 "create_distributed_table and shard copies and moves publish "
+					 "the number of rows and bytes they processed and the status "
+					 "of each shard, which are shown in the citus_progress view."),
+		&EnableOperationProgress,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_dependency_cache",
+		gettext_noop("Caches the dependencies of objects when propagating them."),
+		gettext_noop("Before an object is created on the workers, Citus walks "
+					 "pg_depend to find its dependencies that are not yet "
+					 "distributed. When enabled, the pg_depend entries of the "
+					 "visited objects and their pg_dist_object records are "
+					 "cached in the backend, which avoids repeating the same "
+					 "catalog scans when many objects sharing the same "
+					 "dependencies are created."),
+		&EnableDependencyCache,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_incremental_foreign_key_graph",
+		gettext_noop("Maintains the foreign key graph incrementally."),
+		gettext_noop("By default, every change to a foreign key invalidates the "
+					 "cached foreign key graph and the next query that needs it "
+					 "rebuilds it from pg_constraint. When enabled, only the "
+					 "edges of the relations that were changed are rebuilt."),
+		&EnableIncrementalForeignKeyGraph,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_object_propagation",
 		gettext_noop("Enables propagating object creation for more complex objects, "
@@ -760,6 +1504,55 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_synchronized_snapshots",
+		gettext_noop("Makes all connections to a node read from the same snapshot"),
+		gettext_noop("A multi-shard query uses several connections to each node, "
+					 "each of which takes its own snapshot, such that the shards "
+					 "on a node can be read at different points in time. When "
+					 "enabled, remote transactions use REPEATABLE READ, and "
+					 "multi-shard queries export the snapshot of one transaction "
+					 "per node, which the other connections to the node import. "
+					 "The snapshots of all nodes are taken in parallel, but are "
+					 "not synchronized across nodes. Modifications in such "
+					 "transactions may fail with serialization errors."),
+		&EnableSynchronizedSnapshots,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.propagate_savepoints_lazily",
+		gettext_noop("Sends savepoints only to connections that are used within them"),
+		gettext_noop("By default, SAVEPOINT, RELEASE SAVEPOINT and ROLLBACK TO "
+					 "SAVEPOINT are sent to every connection that participates in "
+					 "the transaction right away, which costs a round trip per "
+					 "connection for every savepoint. When enabled, savepoints "
+					 "are only sent to a connection when it is used by a later "
+					 "command, in the same command where possible, and rolled "
+					 "back only on connections that established them. This "
+					 "should not be changed within a transaction."),
+		&PropagateSavepointsLazily,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.propagate_statement_timeout",
+		gettext_noop("Sends statement_timeout to the workers in remote transactions"),
+		gettext_noop("When enabled, remote transactions set the statement_timeout "
+					 "of the coordinator on the workers, such that commands on the "
+					 "workers stop by themselves once the statement on the "
+					 "coordinator timed out, even when the cancellation of the "
+					 "statement does not reach the worker right away."),
+		&PropagateStatementTimeout,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_router_execution",
 		gettext_noop("Enables router execution"),
@@ -770,6 +1563,22 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_router_parameter_passing",
+		gettext_noop("Sends parameters of router modifications to the workers"),
+		gettext_noop("Router modifications that contain functions the coordinator "
+					 "evaluates, or whose shard is only known at execution time, "
+					 "normally have their parameters inlined as constants into "
+					 "the shard queries. The query text then differs for every "
+					 "value, which defeats plan caching and pg_stat_statements "
+					 "normalization on the workers. When enabled, parameters are "
+					 "kept as $n in the shard queries and sent along with them."),
+		&EnableRouterParameterPassing,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.shard_count",
 		gettext_noop("Sets the number of shards for a new hash-partitioned table"
@@ -781,6 +1590,23 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.shard_unit_size",
+		gettext_noop("Sets the number of adjacent shards of a new hash-partitioned "
+					 "table that are placed on the same node."),
+		gettext_noop("Tables can be created with many small shards, such that new "
+					 "nodes can take over whole shards instead of requiring shard "
+					 "splits. When this is set to more than 1, the shards are "
+					 "grouped into units of adjacent hash ranges, which are placed "
+					 "on the nodes in a round-robin fashion and moved as a whole "
+					 "by the rebalancer. The rebalancer uses the current value, so "
+					 "it should be the same as when the tables were created."),
+		&ShardUnitSize,
+		1, 1, MAX_SHARD_COUNT,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.shard_replication_factor",
 		gettext_noop("Sets the replication factor for shards."),
@@ -834,6 +1660,106 @@ RegisterCitusConfigVariables(void)
 		GUC_UNIT_KB | GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomEnumVariable(
+		"citus.intermediate_result_size_limit_action",
+		gettext_noop("Sets what happens when intermediate results exceed "
+					 "citus.max_intermediate_result_size."),
+		gettext_noop("With error, the query is aborted. With spill, the query "
+					 "continues and the intermediate results are kept in "
+					 "temporary files once they exceed work_mem, whose total "
+					 "size is limited by temp_file_limit."),
+		&IntermediateResultSizeLimitAction,
+		INTERMEDIATE_RESULT_SIZE_LIMIT_ERROR,
+		intermediate_result_size_limit_action_options,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.transmit_compression_threshold",
+		gettext_noop("Sets the minimum size of a block of data that is compressed "
+					 "before it is sent to another node."),
+		gettext_noop("When set to a value other than -1, intermediate results that "
+					 "are broadcast to workers and files that are fetched for "
+					 "repartition joins are requested in compressed blocks. The "
+					 "sending node compresses the blocks that are at least as large "
+					 "as its own setting, or all blocks if its setting is -1. All "
+					 "nodes need to run a Citus version that supports compression."),
+		&TransmitCompressionThreshold,
+		DISABLE_TRANSMIT_COMPRESSION, DISABLE_TRANSMIT_COMPRESSION, INT_MAX,
+		PGC_USERSET,
+		GUC_UNIT_BYTE | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_parallel_copy_workers",
+		gettext_noop("Sets the maximum number of parallel workers that parse the "
+					 "rows of a COPY into a distributed table"),
+		gettext_noop("When set to a value greater than 0, COPY ... FROM in text or "
+					 "csv format on hash, range and reference tables reads and splits "
+					 "the input into chunks of lines on the coordinator, and parses, "
+					 "routes and serialises the rows in up to this many parallel "
+					 "workers. The workers are taken from max_worker_processes and "
+					 "max_parallel_workers. When no worker can be launched, the COPY "
+					 "parses the rows itself. create_distributed_table also uses up "
+					 "to this many parallel workers to scan and serialise the rows "
+					 "of the existing local data."),
+		&MaxParallelCopyWorkers,
+		0, 0, 1024,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.time_range_shard_interval",
+		gettext_noop("Sets the width of the shards that COPY creates for range "
+					 "distributed tables with a time partition column"),
+		gettext_noop("When set to a value greater than 0, COPY into a range "
+					 "distributed table whose partition column is a date or "
+					 "timestamp creates the missing shard of a row instead of "
+					 "erroring out. The new shard covers the time bucket of the "
+					 "row, with buckets of this width aligned to 2000-01-01, and "
+					 "is narrowed where it would overlap existing shards. Dates use "
+					 "buckets of whole days."),
+		&TimeRangeShardInterval,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_UNIT_S | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_copy_connections_per_node",
+		gettext_noop("Sets the maximum number of connections COPY opens to a node"),
+		gettext_noop("By default, COPY into a distributed table opens a connection "
+					 "per shard placement, which for tables with many shards per "
+					 "node requires many connections. When set to a value greater "
+					 "than 0, placements beyond this number of connections share "
+					 "the existing connections to their node, and the rows of a "
+					 "placement are buffered while another placement's COPY is "
+					 "active on the same connection."),
+		&MaxCopyConnectionsPerNode,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.multi_row_insert_copy_threshold",
+		gettext_noop("Sets the number of rows from which a multi-row INSERT is "
+					 "copied into the shards."),
+		gettext_noop("A multi-row INSERT into a distributed table normally sends a "
+					 "multi-row INSERT with the deparsed rows of each shard to the "
+					 "workers. When set to a value other than -1, a multi-row "
+					 "INSERT with at least this many rows instead evaluates the "
+					 "rows on the coordinator and copies them into the shards, "
+					 "like INSERT ... SELECT via the coordinator. ON CONFLICT and "
+					 "RETURNING are handled through intermediate results."),
+		&MultiRowInsertCopyThreshold,
+		DISABLE_MULTI_ROW_INSERT_COPY, DISABLE_MULTI_ROW_INSERT_COPY, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.max_adaptive_executor_pool_size",
 		gettext_noop("Sets the maximum number of connections per worker node used by "
@@ -852,6 +1778,131 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.max_ddl_executor_pool_size",
+		gettext_noop("Sets the maximum number of connections per worker node used by "
+					 "the adaptive executor to propagate DDL commands to shards"),
+		gettext_noop("Commands such as CREATE INDEX run one task per shard and are "
+					 "usually bound by the maintenance capacity of the workers. "
+					 "This setting allows them to open a different number of "
+					 "connections per worker than other multi-shard commands. "
+					 "When set to 0, citus.max_adaptive_executor_pool_size is used."),
+		&MaxDDLExecutorPoolSize,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_vacuum_executor_pool_size",
+		gettext_noop("Sets the maximum number of connections per worker node used by "
+					 "the adaptive executor to propagate VACUUM and ANALYZE"),
+		gettext_noop("VACUUM and ANALYZE of distributed tables run one task per "
+					 "shard placement, and the shard placements of all tables in "
+					 "the command are processed at once. This setting limits the "
+					 "number of placements that are vacuumed concurrently on each "
+					 "worker, and thereby the I/O load that the command puts on "
+					 "it. When set to 0, citus.max_adaptive_executor_pool_size "
+					 "is used."),
+		&MaxVacuumExecutorPoolSize,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_reference_table_copy_connections",
+		gettext_noop("Sets the maximum number of connections used to copy reference "
+					 "tables to a new node"),
+		gettext_noop("When a node is activated, the reference tables are copied to "
+					 "it one at a time over a separate connection each. When set "
+					 "to a value greater than 1, the reference tables are instead "
+					 "spread over up to this many connections that copy them in "
+					 "parallel, and each connection sends the commands for all "
+					 "of its tables at once rather than waiting for each command "
+					 "to finish."),
+		&MaxReferenceTableCopyConnections,
+		1, 1, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_shard_move_connections",
+		gettext_noop("Sets the maximum number of connections used to copy the "
+					 "co-located shards of a shard move"),
+		gettext_noop("A shard move copies the shard together with all shards "
+					 "that are co-located with it, by default one after the other "
+					 "in a single transaction. When set to a value greater than 1, "
+					 "the shards are instead spread over up to this many "
+					 "connections that copy them in parallel, and the foreign keys "
+					 "between them are created once all shards are copied."),
+		&MaxShardMoveConnections,
+		1, 1, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_shared_pool_size",
+		gettext_noop("Sets the maximum number of connections allowed per worker node "
+					 "across all the backends from this node. Setting to -1 disables "
+					 "connections throttling. Setting to 0 makes it auto-adjust, meaning "
+					 "equal to max_connections on the coordinator."),
+		gettext_noop("As a rule of thumb, the value should be at most equal to the "
+					 "max_connections on the remote nodes. When a backend needs a new "
+					 "connection to a worker node that already has this many "
+					 "connections from this node, it waits until another backend "
+					 "closes one."),
+		&MaxSharedPoolSize,
+		0, -1, INT_MAX,
+		PGC_SIGHUP,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_executions_per_role",
+		gettext_noop("Sets the maximum number of concurrent distributed executions "
+					 "of a role on this node. Setting to 0 disables the limit."),
+		gettext_noop("Distributed executions of the role that would exceed the "
+					 "limit wait until another execution of the role finishes. The "
+					 "limit is typically set for a role with ALTER ROLE ... SET, "
+					 "all sessions of a role are expected to use the same value."),
+		&MaxExecutionsPerRole,
+		0, 0, INT_MAX,
+		PGC_SUSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_executions_per_tenant",
+		gettext_noop("Sets the maximum number of concurrent distributed executions "
+					 "for a single distribution column value on this node. Setting "
+					 "to 0 disables the limit."),
+		gettext_noop("Router queries on a tenant that would exceed the limit wait "
+					 "until another query on the same distribution column value "
+					 "finishes."),
+		&MaxExecutionsPerTenant,
+		0, 0, INT_MAX,
+		PGC_SUSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomEnumVariable(
+		"citus.execution_priority",
+		gettext_noop("Sets the priority class of distributed executions."),
+		gettext_noop("Executions with high priority do not wait for the limits "
+					 "of citus.max_executions_per_role and "
+					 "citus.max_executions_per_tenant, though they count towards "
+					 "them, such that latency-sensitive roles are not held up by "
+					 "the queries of other roles."),
+		&CurrentExecutionPriority,
+		EXECUTION_PRIORITY_NORMAL,
+		execution_priority_options,
+		PGC_SUSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.max_worker_nodes_tracked",
 		gettext_noop("Sets the maximum number of worker nodes that are tracked."),
@@ -866,6 +1917,111 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.shared_metadata_cache_size",
+		gettext_noop("Sets the amount of shared memory for caching shard metadata."),
+		gettext_noop("When set, the shard and placement rows that a backend reads "
+					 "to build its metadata cache for a distributed table are "
+					 "kept in shared memory, and other backends copy them from "
+					 "there instead of scanning pg_dist_shard and "
+					 "pg_dist_placement. This reduces the time that new "
+					 "connections spend on their first query when there are "
+					 "many shards. 0 disables the shared cache."),
+		&SharedMetadataCacheSize,
+		0, 0, (INT_MAX / 1024), /* result stored in int variable */
+		PGC_POSTMASTER,
+		GUC_UNIT_KB | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.memory_usage_report_interval",
+		gettext_noop("Sets how often backends report the memory used by Citus."),
+		gettext_noop("When set, each backend measures the memory used by its "
+					 "Citus memory contexts, such as the metadata cache and the "
+					 "connection hash, at the end of a transaction if this "
+					 "time has passed since the last report. The reports of "
+					 "all backends are shown by citus_backend_memory_usage(). "
+					 "0 disables the reports."),
+		&MemoryUsageReportInterval,
+		0, 0, 7 * MS_PER_DAY,
+		PGC_SIGHUP,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.stat_statements_max",
+		gettext_noop("Determines maximum number of statements tracked by "
+					 "citus_stat_statements."),
+		gettext_noop("Statistics are kept per query, executor and partition key "
+					 "in a shared hash table. This configuration value limits the "
+					 "size of the hash table. Once it is full, new entries are not "
+					 "added until citus_stat_statements_reset() is called."),
+		&StatStatementsMax,
+		50000, 1000, 10000000,
+		PGC_POSTMASTER,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomEnumVariable(
+		"citus.stat_statements_track",
+		gettext_noop("Enables tracking of distributed queries in "
+					 "citus_stat_statements."),
+		gettext_noop("When set to all, the number of calls and the execution "
+					 "time of distributed queries are recorded per query, "
+					 "executor and partition key. Queries are identified by the "
+					 "query id of pg_stat_statements, which needs to be loaded "
+					 "for statistics to be collected."),
+		&StatStatementsTrack,
+		STAT_STATEMENTS_TRACK_NONE,
+		stat_statements_track_options,
+		PGC_SUSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.track_shard_access",
+		gettext_noop("Counts the reads and writes of each shard by distributed "
+					 "queries."),
+		gettext_noop("When enabled, the executors count the tasks they run on this "
+					 "node per shard, which are shown in citus_shard_access and "
+					 "can be used by the rebalancer to spread hot shards over the "
+					 "nodes."),
+		&TrackShardAccess,
+		false,
+		PGC_SUSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.shard_access_stats_max",
+		gettext_noop("Determines maximum number of shards tracked by "
+					 "citus_shard_access."),
+		gettext_noop("Accesses are counted per shard in a shared hash table. This "
+					 "configuration value limits the size of the hash table. Once "
+					 "it is full, accesses of new shards are not counted until "
+					 "citus_shard_access_stats_reset() is called."),
+		&ShardAccessStatsMax,
+		100000, 1000, 10000000,
+		PGC_POSTMASTER,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.rebalance_by_shard_access",
+		gettext_noop("Balances the shard accesses instead of the number of shards "
+					 "over the nodes"),
+		gettext_noop("By default, the rebalancer spreads the shard groups of "
+					 "co-located tables evenly over the nodes. When enabled, the "
+					 "cost of a shard group is the number of reads and writes of "
+					 "its shards that were counted on this node, but at least 1, "
+					 "such that hot shard groups are spread over the "
+					 "nodes. This requires citus.track_shard_access."),
+		&RebalanceByShardAccess,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.remote_task_check_interval",
 		gettext_noop("Sets the frequency at which we check job statuses."),
@@ -879,6 +2035,20 @@ RegisterCitusConfigVariables(void)
 		GUC_UNIT_MS | GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.run_command_timeout",
+		gettext_noop("Sets the maximum time a command of master_run_on_worker "
+					 "may take."),
+		gettext_noop("Commands sent to workers by master_run_on_worker and the "
+					 "run_command_on_* functions that take longer than this are "
+					 "cancelled, and reported as failed in their result row. "
+					 "A value of 0 disables the timeout."),
+		&RunCommandTimeout,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.task_tracker_delay",
 		gettext_noop("Task tracker sleep time between task management rounds."),
@@ -907,6 +2077,38 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.prewarm_worker_connections",
+		gettext_noop("Establishes cached connections to all workers when a "
+					 "session starts."),
+		gettext_noop("When enabled, the first query of a session and the first "
+					 "query after a node is added establish "
+					 "citus.max_cached_conns_per_worker connections to each "
+					 "active primary node in parallel. Subsequent distributed "
+					 "queries can then use these connections instead of "
+					 "establishing new ones."),
+		&PrewarmWorkerConnectionsEnabled,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.cached_connection_probe_idle_time",
+		gettext_noop("Sets the idle time after which cached connections are probed "
+					 "before they are used again."),
+		gettext_noop("After a node failed over, the first command on a cached "
+					 "connection to the node only fails after the TCP timeout. "
+					 "When set, a cached connection that was idle for longer "
+					 "than this is first probed with a single round trip, and "
+					 "replaced by a new connection if the node does not respond "
+					 "within citus.node_connection_timeout. 0 disables probing."),
+		&CachedConnectionProbeIdleTime,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.max_assign_task_batch_size",
 		gettext_noop("Sets the maximum number of tasks to assign per round."),
@@ -954,8 +2156,9 @@ RegisterCitusConfigVariables(void)
 		gettext_noop("Worker nodes allow for table data to be repartitioned "
 					 "into multiple text files, much like Hadoop's Map "
 					 "command. This configuration value sets the buffer size "
-					 "to use per partition operation. After the buffer fills "
-					 "up, we flush the repartitioned data into text files."),
+					 "to use per partition operation, which the partitions "
+					 "share. After the buffers fill up, we flush the largest "
+					 "partition buffer into its text file."),
 		&PartitionBufferSize,
 		8192, 0, (INT_MAX / 1024), /* result stored in int variable */
 		PGC_USERSET,
@@ -987,6 +2190,35 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_group_pushdown",
+		gettext_noop("Enables computing aggregates of disjoint groups on the workers"),
+		gettext_noop("When a multi-shard query is grouped by the distribution "
+					 "column, all rows of a group are in the same shard. When "
+					 "enabled, the workers then compute the final aggregates and "
+					 "apply the HAVING clause, and the coordinator does not "
+					 "combine the aggregates of the shards."),
+		&EnableGroupPushdown,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_partial_array_aggregates",
+		gettext_noop("Enables computing string_agg and ordered array_agg partially "
+					 "on the workers"),
+		gettext_noop("When enabled, the workers compute string_agg and array_agg "
+					 "with an ORDER BY on a single expression for the rows of "
+					 "their shards, and the coordinator concatenates the partial "
+					 "strings or merges the sorted partial arrays, instead of "
+					 "erroring out on these aggregates."),
+		&EnablePartialArrayAggregates,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomRealVariable(
 		"citus.count_distinct_error_rate",
 		gettext_noop("Desired error rate when calculating count(distinct) "
@@ -1000,6 +2232,53 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.count_distinct_sparse_sketches",
+		gettext_noop("Sends compact partial sketches for count(distinct) "
+					 "approximations."),
+		gettext_noop("When enabled, the workers build the partial hll sketches "
+					 "of count(distinct) approximations with explicit and sparse "
+					 "storage, regardless of the hll defaults on the workers. "
+					 "Sketches of groups with few distinct values are then much "
+					 "smaller than the dense sketches whose size is determined "
+					 "by citus.count_distinct_error_rate."),
+		&CountDistinctSparseSketches,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.percentile_approximation_compression",
+		gettext_noop("Compression used when approximating percentile_cont "
+					 "through the tdigest extension."),
+		gettext_noop("When set, percentile_cont over double precision values "
+					 "is computed from t-digest sketches that the workers build "
+					 "with this compression, instead of pulling all rows to the "
+					 "coordinator. Larger values give more accurate results. "
+					 "0 disables approximations for percentile_cont."),
+		&PercentileApproximationCompression,
+		0, 0, 10000,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.async_commit_prepared",
+		gettext_noop("Returns from two-phase commits without waiting for "
+					 "COMMIT PREPARED on the workers."),
+		gettext_noop("Once the local transaction has committed, the prepared "
+					 "transactions on the workers are certain to be committed, "
+					 "either by COMMIT PREPARED or by 2PC recovery. When enabled, "
+					 "the coordinator does not wait for COMMIT PREPARED to "
+					 "finish, which saves a round trip per commit. Queries over "
+					 "other connections may then briefly not see the changes."),
+		&AsyncCommitPrepared,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomEnumVariable(
 		"citus.multi_shard_commit_protocol",
 		gettext_noop("Sets the commit protocol for commands modifying multiple shards."),
@@ -1037,8 +2316,10 @@ RegisterCitusConfigVariables(void)
 					 "use when making these assignments. The greedy policy aims to "
 					 "evenly distribute tasks across worker nodes, first-replica just "
 					 "assigns tasks in the order shard placements were created, "
-					 "and the round-robin policy assigns tasks to worker nodes in "
-					 "a round-robin fashion."),
+					 "the round-robin policy assigns tasks to worker nodes in "
+					 "a round-robin fashion, and the least-loaded policy prefers "
+					 "a local placement and otherwise the node that this node has "
+					 "the fewest open connections to."),
 		&TaskAssignmentPolicy,
 		TASK_ASSIGNMENT_GREEDY,
 		task_assignment_policy_options,
@@ -1060,6 +2341,22 @@ RegisterCitusConfigVariables(void)
 		GUC_SUPERUSER_ONLY,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.table_size_cache_staleness",
+		gettext_noop("Sets how long the sizes returned by the citus size functions "
+					 "can be reused."),
+		gettext_noop("citus_table_size(), citus_relation_size() and "
+					 "citus_total_relation_size() query all workers to compute the "
+					 "size of a distributed table. When set to a positive value, a "
+					 "size that was computed by the same session less than the given "
+					 "time ago is returned without contacting the workers. 0 "
+					 "disables caching."),
+		&TableSizeCacheStaleness,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomEnumVariable(
 		"citus.task_executor_type",
 		gettext_noop("Sets the executor type to be used for distributed queries."),
@@ -1087,6 +2384,179 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_repartition_aggregation",
+		gettext_noop("Enables repartitioning groups for the final aggregation"),
+		gettext_noop("When grouping a distributed table by columns other than its "
+					 "distribution column, the workers send the partial "
+					 "aggregates of each shard to the coordinator, which then "
+					 "computes the final aggregates. For a large number of "
+					 "groups, that is almost as much data as the table itself. "
+					 "When enabled, such queries hash partition the partial "
+					 "aggregates by the group key among the workers, which "
+					 "compute the final aggregates, and the coordinator only "
+					 "receives the final groups. With the adaptive executor, "
+					 "this requires citus.enable_repartition_joins."),
+		&EnableRepartitionAggregation,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_union_aggregate_pushdown",
+		gettext_noop("Enables computing aggregates and UNION deduplication in the "
+					 "branches of a UNION"),
+		gettext_noop("When a union of subqueries that are not colocated is "
+					 "recursively planned, all rows of each subquery are sent "
+					 "to the coordinator. When enabled, aggregates on a UNION "
+					 "ALL subquery are computed partially in each branch, and "
+					 "the branches of a UNION send only their distinct rows."),
+		&EnableUnionAggregatePushdown,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_window_function_repartition",
+		gettext_noop("Enables repartitioning subqueries by their window partitions"),
+		gettext_noop("Window functions whose PARTITION BY clause does not contain "
+					 "the distribution column are evaluated on the coordinator "
+					 "after pulling all rows of the subquery. When enabled, a "
+					 "subquery on a single table whose window functions are all "
+					 "partitioned by the same column is instead repartitioned by "
+					 "that column, and the merge tasks evaluate the window "
+					 "functions on the workers. With the adaptive executor, this "
+					 "requires citus.enable_repartition_joins."),
+		&EnableWindowFunctionRepartition,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_repartition_push",
+		gettext_noop("Pushes map outputs of repartition joins into merge tables."),
+		gettext_noop("When the adaptive executor runs a repartition join, map "
+					 "tasks by default copy the rows of each partition straight "
+					 "into the table of the merge task that reads the partition. "
+					 "When disabled, map tasks write partition files to disk, "
+					 "which the nodes of the merge tasks fetch and load."),
+		&EnableRepartitionPush,
+		true,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_repartition_cache",
+		gettext_noop("Reuses the map outputs of repartition joins on unchanged data."),
+		gettext_noop("When enabled, map tasks of repartition joins keep their "
+					 "partition files in a cache on the worker, and later runs of "
+					 "the same map task reuse the files as long as the shards "
+					 "that the map task read did not change. Checking for changes "
+					 "reads all pages of these shards. Map tasks then always write "
+					 "partition files rather than pushing their outputs into "
+					 "merge tables."),
+		&EnableRepartitionCache,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_repartition_join_filter",
+		gettext_noop("Filters the rows of dual partition joins with Bloom filters "
+					 "of the join keys."),
+		gettext_noop("When enabled, the map tasks of the right side of an inner "
+					 "dual partition join first build a Bloom filter of their "
+					 "join keys, and the map tasks of the left side then skip the "
+					 "rows that cannot have a join partner before partitioning "
+					 "them. This takes an extra scan of the right side, and pays "
+					 "off for selective joins. Filters that do not rule out "
+					 "enough keys are not used."),
+		&EnableRepartitionJoinFilter,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.repartition_join_filter_size",
+		gettext_noop("Sets the size of the Bloom filters of repartition joins."),
+		gettext_noop("Larger filters rule out more rows for joins with many "
+					 "distinct keys, but are sent to the workers as part of "
+					 "every map task of the filtered side."),
+		&RepartitionJoinFilterSize,
+		64, 1, 16384,
+		PGC_USERSET,
+		GUC_UNIT_KB | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_repartitioned_insert_select",
+		gettext_noop("Repartitions INSERT ... SELECT results among the workers."),
+		gettext_noop("An INSERT ... SELECT whose SELECT cannot be pushed down to "
+					 "the shards of the target table normally copies all selected "
+					 "rows through the coordinator. When enabled, and the SELECT "
+					 "runs as a plain multi-shard query, each worker partitions "
+					 "its rows by the shards of the hash-distributed target "
+					 "table, and the nodes of the target shards fetch their rows "
+					 "directly from the other workers."),
+		&EnableRepartitionedInsertSelect,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_reference_table_insert_select_pushdown",
+		gettext_noop("Pushes down INSERT ... SELECT from reference tables into "
+					 "distributed tables."),
+		gettext_noop("An INSERT ... SELECT that only reads from reference tables "
+					 "normally copies all selected rows through the coordinator. "
+					 "When enabled, and the SELECT provides the distribution "
+					 "column of the hash-distributed target table as a plain "
+					 "column, each target shard is filled on its own node from "
+					 "the local copy of the reference tables, restricted to the "
+					 "hash range of the shard. Rows with a NULL distribution "
+					 "column are skipped rather than rejected."),
+		&EnableReferenceTableInsertSelectPushdown,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_task_stealing",
+		gettext_noop("Moves waiting task-tracker tasks to idle worker nodes."),
+		gettext_noop("The task-tracker executor assigns each task to a worker "
+					 "node that has a placement of the task's shard. When "
+					 "enabled, tasks that still wait on a busy node move to "
+					 "another placement whose node has no queued tasks, so "
+					 "that one slow node does not hold up the whole job."),
+		&EnableTaskStealing,
+		true,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_top_n_pushdown",
+		gettext_noop("Pulls only the candidate groups of multi-shard top-N queries."),
+		gettext_noop("Queries that order groups by a sum or count in descending "
+					 "order and have a limit normally pull all groups to the "
+					 "coordinator. When enabled, Citus first asks the workers for "
+					 "their top groups to find the groups that can make it into "
+					 "the result, and only pulls these groups. This takes two "
+					 "extra rounds of queries to the workers."),
+		&EnableTopNPushdown,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomEnumVariable(
 		"citus.shard_placement_policy",
 		gettext_noop("Sets the policy to use when choosing nodes for shard placement."),
@@ -1096,7 +2566,10 @@ RegisterCitusConfigVariables(void)
 					 "first replica on the client node and chooses others randomly. "
 					 "The round-robin policy aims to distribute shards evenly across "
 					 "the cluster by selecting nodes in a round-robin fashion."
-					 "The random policy picks all workers randomly."),
+					 "The random policy picks all workers randomly. The "
+					 "least-utilized policy picks the workers with the least disk "
+					 "usage and shard placements, also for new co-location groups "
+					 "of hash distributed tables."),
 		&ShardPlacementPolicy,
 		SHARD_PLACEMENT_ROUND_ROBIN, shard_placement_policy_options,
 		PGC_USERSET,
@@ -1106,13 +2579,33 @@ RegisterCitusConfigVariables(void)
 	DefineCustomEnumVariable(
 		"citus.use_secondary_nodes",
 		gettext_noop("Sets the policy to use when choosing nodes for SELECT queries."),
-		NULL,
+		gettext_noop("The never policy sends all queries to the primaries, and the "
+					 "always policy sends them to the secondaries and disallows "
+					 "writes. The prefer policy sends read-only queries outside "
+					 "of transaction blocks to the secondaries of each group, "
+					 "falling back to the primary when no secondary is within "
+					 "citus.max_secondary_replay_lag, and all other queries to "
+					 "the primaries."),
 		&ReadFromSecondaries,
 		USE_SECONDARY_NODES_NEVER, use_secondary_nodes_options,
 		PGC_SU_BACKEND,
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.max_secondary_replay_lag",
+		gettext_noop("Sets the maximum replay lag of secondaries that read-only "
+					 "queries are sent to."),
+		gettext_noop("When citus.use_secondary_nodes is 'prefer', secondaries "
+					 "that are further behind their primary are skipped. The "
+					 "lag of each secondary is measured at most once per second. "
+					 "-1 disables the check."),
+		&MaxSecondaryReplayLag,
+		-1, -1, INT_MAX,
+		PGC_USERSET,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomEnumVariable(
 		"citus.multi_task_query_log_level",
 		gettext_noop("Sets the level of multi task query execution log messages"),
@@ -1403,6 +2896,8 @@ NodeConninfoGucAssignHook(const char *newval, void *extra)
 		AddConnParam(option->keyword, option->val);
 	}
 
+	AddDefaultConnParams();
+
 	PQconninfoFree(optionArray);
 }
 
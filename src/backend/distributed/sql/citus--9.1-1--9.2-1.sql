@@ -0,0 +1,553 @@
+CREATE FUNCTION pg_catalog.citus_remote_connection_stats(
+    OUT hostname text,
+    OUT port int,
+    OUT connection_count_to_node int)
+RETURNS SETOF RECORD
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_remote_connection_stats$$;
+COMMENT ON FUNCTION pg_catalog.citus_remote_connection_stats(
+    OUT hostname text,
+    OUT port int,
+    OUT connection_count_to_node int)
+IS 'returns the number of connections that the backends on this node have open to each remote node';
+
+CREATE FUNCTION pg_catalog.worker_create_schema(bigint)
+    RETURNS void
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$worker_create_schema$$;
+COMMENT ON FUNCTION pg_catalog.worker_create_schema(bigint)
+    IS 'create the schema of a repartition job';
+
+CREATE FUNCTION pg_catalog.worker_repartition_cleanup(bigint)
+    RETURNS void
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$worker_repartition_cleanup$$;
+COMMENT ON FUNCTION pg_catalog.worker_repartition_cleanup(bigint)
+    IS 'remove the intermediate files and tables of a repartition job';
+
+CREATE FUNCTION pg_catalog.worker_create_task_table(bigint, integer, text[], text[])
+    RETURNS void
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$worker_create_task_table$$;
+COMMENT ON FUNCTION pg_catalog.worker_create_task_table(bigint, integer, text[], text[])
+    IS 'create the empty table of a merge task in its job schema';
+
+CREATE FUNCTION pg_catalog.worker_range_partition_table(bigint, integer, text, text,
+                                                        oid, anyarray, integer[],
+                                                        text[], integer[])
+    RETURNS void
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$worker_range_partition_table$$;
+COMMENT ON FUNCTION pg_catalog.worker_range_partition_table(bigint, integer, text, text,
+                                                            oid, anyarray, integer[],
+                                                            text[], integer[])
+    IS 'range partition query results and push them into merge tables';
+
+CREATE FUNCTION pg_catalog.worker_hash_partition_table(bigint, integer, text, text,
+                                                       oid, anyarray, integer[],
+                                                       text[], integer[])
+    RETURNS void
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$worker_hash_partition_table$$;
+COMMENT ON FUNCTION pg_catalog.worker_hash_partition_table(bigint, integer, text, text,
+                                                           oid, anyarray, integer[],
+                                                           text[], integer[])
+    IS 'hash partition query results and push them into merge tables';
+
+CREATE FUNCTION pg_catalog.worker_read_task_files(job_id bigint, task_id integer)
+    RETURNS SETOF record
+    LANGUAGE C STRICT VOLATILE PARALLEL SAFE
+    AS 'MODULE_PATHNAME', $$worker_read_task_files$$;
+COMMENT ON FUNCTION pg_catalog.worker_read_task_files(bigint, integer)
+    IS 'read the files fetched for a merge task and return them as a set of records';
+
+CREATE FUNCTION pg_catalog.citus_update_table_statistics(relation regclass)
+    RETURNS void
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$citus_update_table_statistics$$;
+COMMENT ON FUNCTION pg_catalog.citus_update_table_statistics(regclass)
+    IS 'analyze the shards of a distributed table and record their statistics on the coordinator';
+
+CREATE FUNCTION pg_catalog.worker_broadcast_partition_table(job_id bigint,
+                                                            task_id integer,
+                                                            filter_query text,
+                                                            partition_count integer)
+    RETURNS void
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$worker_broadcast_partition_table$$;
+COMMENT ON FUNCTION pg_catalog.worker_broadcast_partition_table(bigint, integer, text,
+                                                                integer)
+    IS 'write all query results to each of the given number of partitions';
+
+CREATE FUNCTION pg_catalog.worker_broadcast_partition_table(bigint, integer, text,
+                                                            integer, integer[],
+                                                            text[], integer[])
+    RETURNS void
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$worker_broadcast_partition_table$$;
+COMMENT ON FUNCTION pg_catalog.worker_broadcast_partition_table(bigint, integer, text,
+                                                                integer, integer[],
+                                                                text[], integer[])
+    IS 'write all query results to each partition and push them into merge tables';
+
+CREATE FUNCTION pg_catalog.link_intermediate_result(source_result_id text,
+                                                    result_id text)
+    RETURNS void
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$link_intermediate_result$$;
+COMMENT ON FUNCTION pg_catalog.link_intermediate_result(text, text)
+    IS 'make an intermediate result available under another result id';
+
+CREATE FUNCTION pg_catalog.master_split_shard(shard_id bigint,
+                                              split_count integer DEFAULT 2)
+    RETURNS bigint[]
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$master_split_shard$$;
+COMMENT ON FUNCTION pg_catalog.master_split_shard(bigint, integer)
+    IS 'split a hash shard and its colocated shards into equal hash ranges';
+
+CREATE FUNCTION pg_catalog.citus_dist_stat_activity(only_active boolean,
+    OUT query_hostname text, OUT query_hostport int, OUT master_query_host_name text,
+    OUT master_query_host_port int, OUT transaction_number int8,
+    OUT transaction_stamp timestamptz, OUT datid oid, OUT datname name, OUT pid int,
+    OUT usesysid oid, OUT usename name, OUT application_name text, OUT client_addr INET,
+    OUT client_hostname TEXT, OUT client_port int, OUT backend_start timestamptz,
+    OUT xact_start timestamptz, OUT query_start timestamptz,
+    OUT state_change timestamptz, OUT wait_event_type text, OUT wait_event text,
+    OUT state text, OUT backend_xid xid, OUT backend_xmin xid, OUT query text,
+    OUT backend_type text)
+    RETURNS SETOF RECORD
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$citus_dist_stat_activity$$;
+COMMENT ON FUNCTION pg_catalog.citus_dist_stat_activity(boolean)
+    IS 'returns distributed transaction activity on distributed tables, optionally only for active backends';
+
+CREATE FUNCTION pg_catalog.citus_worker_stat_activity(only_active boolean,
+    OUT query_hostname text, OUT query_hostport int, OUT master_query_host_name text,
+    OUT master_query_host_port int, OUT transaction_number int8,
+    OUT transaction_stamp timestamptz, OUT datid oid, OUT datname name, OUT pid int,
+    OUT usesysid oid, OUT usename name, OUT application_name text, OUT client_addr INET,
+    OUT client_hostname TEXT, OUT client_port int, OUT backend_start timestamptz,
+    OUT xact_start timestamptz, OUT query_start timestamptz,
+    OUT state_change timestamptz, OUT wait_event_type text, OUT wait_event text,
+    OUT state text, OUT backend_xid xid, OUT backend_xmin xid, OUT query text,
+    OUT backend_type text)
+    RETURNS SETOF RECORD
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$citus_worker_stat_activity$$;
+COMMENT ON FUNCTION pg_catalog.citus_worker_stat_activity(boolean)
+    IS 'returns distributed transaction activity on shards of distributed tables, optionally only for active backends';
+
+CREATE FUNCTION get_node_for_distribution_column(table_name regclass,
+                                                 distribution_value "any" DEFAULT NULL,
+                                                 OUT nodename text,
+                                                 OUT nodeport int)
+    RETURNS record
+    LANGUAGE C
+    AS 'MODULE_PATHNAME', $$get_node_for_distribution_column$$;
+COMMENT ON FUNCTION get_node_for_distribution_column(table_name regclass, distribution_value "any")
+    IS 'return a worker node with metadata that has the shard which contains given value';
+
+-- add execution times to citus_query_stats() and citus_stat_statements
+DROP VIEW pg_catalog.citus_stat_statements;
+DROP FUNCTION pg_catalog.citus_stat_statements();
+DROP FUNCTION pg_catalog.citus_query_stats();
+
+CREATE FUNCTION pg_catalog.citus_query_stats(OUT queryid bigint,
+											 OUT userid oid,
+											 OUT dbid oid,
+											 OUT executor bigint,
+											 OUT partition_key text,
+											 OUT calls bigint,
+											 OUT total_time double precision)
+RETURNS SETOF record
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_query_stats$$;
+COMMENT ON FUNCTION pg_catalog.citus_query_stats()
+    IS 'returns the number of calls and the execution time of distributed queries per executor and partition key';
+
+CREATE FUNCTION pg_catalog.citus_stat_statements(OUT queryid bigint,
+												 OUT userid oid,
+												 OUT dbid oid,
+												 OUT query text,
+												 OUT executor bigint,
+												 OUT partition_key text,
+												 OUT calls bigint,
+												 OUT total_time double precision)
+RETURNS SETOF record
+LANGUAGE plpgsql
+AS $citus_stat_statements$
+BEGIN
+ IF EXISTS (
+ 	SELECT extname FROM pg_extension
+ 	WHERE extname = 'pg_stat_statements')
+ THEN
+ 	RETURN QUERY SELECT pss.queryid, pss.userid, pss.dbid, pss.query, cqs.executor,
+ 						cqs.partition_key, cqs.calls, cqs.total_time
+ 				 FROM pg_stat_statements(true) pss
+ 				 	JOIN citus_query_stats() cqs
+ 				 	USING (queryid, userid, dbid);
+ ELSE
+    RAISE EXCEPTION 'pg_stat_statements is not installed'
+    	USING HINT = 'install pg_stat_statements extension and try again';
+ END IF;
+END;
+$citus_stat_statements$;
+
+CREATE VIEW citus.citus_stat_statements AS
+SELECT
+  queryid,
+  userid,
+  dbid,
+  query,
+  pg_catalog.citus_executor_name(executor::int) AS executor,
+  partition_key,
+  calls,
+  total_time
+FROM pg_catalog.citus_stat_statements();
+ALTER VIEW citus.citus_stat_statements SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.citus_stat_statements TO public;
+
+CREATE FUNCTION pg_catalog.worker_execute_query_explain_analyze(
+    query text,
+    verbose boolean,
+    costs boolean,
+    buffers boolean,
+    timing boolean,
+    summary boolean,
+    format text)
+RETURNS SETOF record
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$worker_execute_query_explain_analyze$$;
+COMMENT ON FUNCTION pg_catalog.worker_execute_query_explain_analyze(text, boolean, boolean, boolean, boolean, boolean, text)
+    IS 'execute a query under EXPLAIN ANALYZE and return its rows followed by the EXPLAIN output';
+
+CREATE FUNCTION pg_catalog.citus_backend_wait_event(pid int)
+RETURNS text
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_backend_wait_event$$;
+COMMENT ON FUNCTION pg_catalog.citus_backend_wait_event(int)
+    IS 'returns the wait event of a backend, including the names of Citus wait events';
+
+CREATE FUNCTION pg_catalog.citus_connection_establishment_stats(
+    OUT nodename text,
+    OUT nodeport int,
+    OUT connection_attempts bigint,
+    OUT connections_established bigint,
+    OUT connection_failures bigint,
+    OUT connection_timeouts bigint,
+    OUT cache_hits bigint,
+    OUT cache_misses bigint,
+    OUT total_connect_time double precision,
+    OUT latency_bucket_bounds int[],
+    OUT latency_bucket_counts bigint[])
+RETURNS SETOF RECORD
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_connection_establishment_stats$$;
+COMMENT ON FUNCTION pg_catalog.citus_connection_establishment_stats()
+    IS 'returns statistics on the connections established to the remote nodes';
+
+CREATE VIEW citus.citus_connection_establishment_stats AS
+SELECT
+  nodename,
+  nodeport,
+  connection_attempts,
+  connections_established,
+  connection_failures,
+  connection_timeouts,
+  cache_hits,
+  cache_misses,
+  cache_hits::double precision / NULLIF(cache_hits + cache_misses, 0) AS cache_hit_rate,
+  total_connect_time / NULLIF(connections_established, 0) AS mean_connect_time,
+  latency_bucket_bounds,
+  latency_bucket_counts
+FROM pg_catalog.citus_connection_establishment_stats();
+ALTER VIEW citus.citus_connection_establishment_stats SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.citus_connection_establishment_stats TO public;
+
+CREATE FUNCTION pg_catalog.worker_partition_query_result(result_prefix text,
+                                                         query text,
+                                                         partition_column_index int,
+                                                         partition_min_values int[],
+                                                         partition_max_values int[],
+                                                         OUT partition_index int,
+                                                         OUT rows_written bigint)
+    RETURNS SETOF record
+    LANGUAGE C STRICT VOLATILE
+    AS 'MODULE_PATHNAME', $$worker_partition_query_result$$;
+COMMENT ON FUNCTION pg_catalog.worker_partition_query_result(text, text, int, int[],
+                                                             int[])
+    IS 'execute a query and partition its results into intermediate results by hash ranges';
+
+CREATE FUNCTION pg_catalog.fetch_intermediate_results(result_ids text[],
+                                                      node_name text,
+                                                      node_port int)
+    RETURNS bigint
+    LANGUAGE C STRICT VOLATILE
+    AS 'MODULE_PATHNAME', $$fetch_intermediate_results$$;
+COMMENT ON FUNCTION pg_catalog.fetch_intermediate_results(text[], text, int)
+    IS 'copy intermediate results of the current distributed transaction from a remote node';
+
+CREATE FUNCTION pg_catalog.citus_batch_modify(query text,
+                                              batch_size int DEFAULT 10000,
+                                              commit_each_batch bool DEFAULT true,
+                                              batch_delay_ms int DEFAULT 0)
+    RETURNS bigint
+    LANGUAGE C STRICT VOLATILE
+    AS 'MODULE_PATHNAME', $$citus_batch_modify$$;
+COMMENT ON FUNCTION pg_catalog.citus_batch_modify(text, int, bool, int)
+    IS 'run an update or delete on each shard in batches of distribution column ranges';
+
+CREATE FUNCTION pg_catalog.get_index_build_progress()
+  RETURNS TABLE(sessionid integer,
+                table_name regclass,
+                shardid bigint,
+                nodename text,
+                nodeport int,
+                progress bigint)
+  AS 'MODULE_PATHNAME'
+  LANGUAGE C STRICT;
+COMMENT ON FUNCTION pg_catalog.get_index_build_progress()
+    IS 'provides progress information about the ongoing concurrent index builds';
+
+CREATE FUNCTION pg_catalog.master_append_tables_to_shards(shard_ids bigint[],
+                                                          source_table_names text[],
+                                                          source_node_name text,
+                                                          source_node_port integer)
+    RETURNS real[]
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$master_append_tables_to_shards$$;
+COMMENT ON FUNCTION pg_catalog.master_append_tables_to_shards(bigint[], text[], text,
+                                                              integer)
+    IS 'append given tables to the given shards in one batch and update metadata';
+
+CREATE TABLE citus.pg_dist_shard_statistics_column (
+    logicalrelid regclass NOT NULL,
+    attnum int2 NOT NULL,
+    CONSTRAINT pg_dist_shard_statistics_column_pkey PRIMARY KEY (logicalrelid, attnum)
+);
+
+CREATE TABLE citus.pg_dist_shard_column_stats (
+    logicalrelid regclass NOT NULL,
+    shardid bigint NOT NULL,
+    attnum int2 NOT NULL,
+    atttypid oid NOT NULL,
+    minvalue text,
+    maxvalue text,
+    CONSTRAINT pg_dist_shard_column_stats_pkey PRIMARY KEY (shardid, attnum)
+);
+CREATE INDEX pg_dist_shard_column_stats_logicalrelid_index
+    ON citus.pg_dist_shard_column_stats (logicalrelid);
+
+CREATE FUNCTION pg_catalog.citus_add_shard_statistics_column(table_name regclass,
+                                                             column_name text)
+    RETURNS void
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$citus_add_shard_statistics_column$$;
+COMMENT ON FUNCTION pg_catalog.citus_add_shard_statistics_column(regclass, text)
+    IS 'keep min/max statistics of the given column for the shards of the given table';
+
+CREATE FUNCTION pg_catalog.citus_remove_shard_statistics_column(table_name regclass,
+                                                                column_name text)
+    RETURNS void
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$citus_remove_shard_statistics_column$$;
+COMMENT ON FUNCTION pg_catalog.citus_remove_shard_statistics_column(regclass, text)
+    IS 'stop keeping min/max statistics of the given column for the given table';
+
+DROP FUNCTION pg_catalog.isolate_tenant_to_new_shard(regclass, "any", text);
+CREATE FUNCTION pg_catalog.isolate_tenant_to_new_shard(
+    table_name regclass,
+    tenant_id "any",
+    cascade_option text DEFAULT '',
+    node_name text DEFAULT NULL,
+    node_port int DEFAULT NULL,
+    shard_transfer_mode citus.shard_transfer_mode DEFAULT 'auto')
+    RETURNS bigint
+    LANGUAGE C
+    AS 'MODULE_PATHNAME', $$isolate_tenant_to_new_shard$$;
+COMMENT ON FUNCTION pg_catalog.isolate_tenant_to_new_shard(regclass, "any", text, text,
+                                                          int,
+                                                          citus.shard_transfer_mode)
+    IS 'isolate a tenant to its own shard, optionally on another node';
+
+CREATE FUNCTION pg_catalog.worker_split_shard_add_route(slot_name text,
+                                                        source_shard regclass,
+                                                        target_shard regclass,
+                                                        column_name text,
+                                                        min_hash_value int,
+                                                        max_hash_value int)
+    RETURNS void
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$worker_split_shard_add_route$$;
+COMMENT ON FUNCTION pg_catalog.worker_split_shard_add_route(text, regclass, regclass,
+                                                           text, int, int)
+    IS 'route changes to a hash range of a shard into a new shard';
+REVOKE ALL ON FUNCTION pg_catalog.worker_split_shard_add_route(text, regclass, regclass,
+                                                              text, int, int)
+    FROM PUBLIC;
+
+CREATE FUNCTION pg_catalog.worker_split_shard_remove_routes(slot_name text)
+    RETURNS void
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$worker_split_shard_remove_routes$$;
+COMMENT ON FUNCTION pg_catalog.worker_split_shard_remove_routes(text)
+    IS 'remove the shard split routes of a replication slot';
+REVOKE ALL ON FUNCTION pg_catalog.worker_split_shard_remove_routes(text) FROM PUBLIC;
+
+CREATE FUNCTION pg_catalog.create_distributed_partitions(parent_table regclass,
+                                                         partition_names text[],
+                                                         partition_bounds text[])
+    RETURNS void
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$create_distributed_partitions$$;
+COMMENT ON FUNCTION pg_catalog.create_distributed_partitions(regclass, text[], text[])
+    IS 'create partitions of a distributed partitioned table and their shards in batches';
+
+-- Support infrastructure for merging sorted partial arrays of ordered aggregates
+CREATE FUNCTION pg_catalog.coord_merge_sorted_agg_sfunc(internal, anyarray, "any", oid, boolean)
+RETURNS internal
+AS 'MODULE_PATHNAME'
+LANGUAGE C PARALLEL SAFE;
+COMMENT ON FUNCTION pg_catalog.coord_merge_sorted_agg_sfunc(internal, anyarray, "any", oid, boolean)
+    IS 'transition function for coord_merge_sorted_agg';
+
+CREATE FUNCTION pg_catalog.coord_merge_sorted_agg_ffunc(internal, anyarray, "any", oid, boolean)
+RETURNS anyarray
+AS 'MODULE_PATHNAME'
+LANGUAGE C PARALLEL SAFE;
+COMMENT ON FUNCTION pg_catalog.coord_merge_sorted_agg_ffunc(internal, anyarray, "any", oid, boolean)
+    IS 'finalizer for coord_merge_sorted_agg';
+
+-- select coord_merge_sorted_agg(values, keys, sortop, nullsfirst)
+-- equivalent to
+-- select array_agg(value order by key using sortop) over the elements of all
+-- values and keys arrays, given that each pair of arrays is sorted by key
+CREATE AGGREGATE pg_catalog.coord_merge_sorted_agg(anyarray, "any", oid, boolean) (
+    STYPE = internal,
+    SFUNC = pg_catalog.coord_merge_sorted_agg_sfunc,
+    FINALFUNC = pg_catalog.coord_merge_sorted_agg_ffunc,
+    FINALFUNC_EXTRA
+);
+COMMENT ON AGGREGATE pg_catalog.coord_merge_sorted_agg(anyarray, "any", oid, boolean)
+    IS 'support aggregate for merging sorted partial arrays of ordered aggregates from workers';
+
+CREATE FUNCTION pg_catalog.citus_memory_usage(
+    OUT context_name text,
+    OUT category text,
+    OUT total_bytes bigint,
+    OUT used_bytes bigint,
+    OUT free_bytes bigint,
+    OUT context_count int)
+RETURNS SETOF RECORD
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_memory_usage$$;
+COMMENT ON FUNCTION pg_catalog.citus_memory_usage()
+    IS 'returns the memory used by the Citus memory contexts of the current backend';
+
+CREATE FUNCTION pg_catalog.citus_backend_memory_usage(
+    OUT pid int,
+    OUT metadata_cache_bytes bigint,
+    OUT connection_bytes bigint,
+    OUT transaction_bytes bigint,
+    OUT execution_bytes bigint,
+    OUT total_bytes bigint,
+    OUT report_time timestamptz)
+RETURNS SETOF RECORD
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_backend_memory_usage$$;
+COMMENT ON FUNCTION pg_catalog.citus_backend_memory_usage()
+    IS 'returns the memory used by Citus in each backend, as last reported by the backend';
+
+CREATE FUNCTION pg_catalog.citus_progress(
+    OUT pid int,
+    OUT operation text,
+    OUT table_name regclass,
+    OUT shardid bigint,
+    OUT nodename text,
+    OUT nodeport int,
+    OUT status text,
+    OUT rows_processed bigint,
+    OUT bytes_processed bigint)
+RETURNS SETOF RECORD
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_progress$$;
+COMMENT ON FUNCTION pg_catalog.citus_progress()
+    IS 'returns the progress of the ongoing distributed operations per shard';
+
+CREATE VIEW citus.citus_progress AS
+SELECT * FROM pg_catalog.citus_progress();
+ALTER VIEW citus.citus_progress SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.citus_progress TO public;
+
+CREATE FUNCTION pg_catalog.citus_shard_access_stats(
+    OUT shardid bigint,
+    OUT reads bigint,
+    OUT writes bigint)
+RETURNS SETOF RECORD
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_shard_access_stats$$;
+COMMENT ON FUNCTION pg_catalog.citus_shard_access_stats()
+    IS 'returns the number of reads and writes of each shard counted on this node';
+
+CREATE FUNCTION pg_catalog.citus_shard_access_stats_reset()
+RETURNS VOID
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_shard_access_stats_reset$$;
+COMMENT ON FUNCTION pg_catalog.citus_shard_access_stats_reset()
+    IS 'removes the shard access counts of this node';
+REVOKE ALL ON FUNCTION pg_catalog.citus_shard_access_stats_reset() FROM PUBLIC;
+
+CREATE VIEW citus.citus_shard_access AS
+SELECT
+    s.logicalrelid AS table_name,
+    a.shardid,
+    a.reads,
+    a.writes,
+    a.reads + a.writes AS total_accesses
+FROM pg_catalog.citus_shard_access_stats() a
+JOIN pg_catalog.pg_dist_shard s USING (shardid);
+ALTER VIEW citus.citus_shard_access SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.citus_shard_access TO public;
+
+CREATE FUNCTION pg_catalog.worker_repartition_cache_reset()
+    RETURNS void
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$worker_repartition_cache_reset$$;
+COMMENT ON FUNCTION pg_catalog.worker_repartition_cache_reset()
+    IS 'remove the cached map outputs of repartition joins on this node';
+REVOKE ALL ON FUNCTION pg_catalog.worker_repartition_cache_reset() FROM PUBLIC;
+
+CREATE FUNCTION pg_catalog.worker_join_filter_agg_sfunc(internal, anyelement, integer)
+    RETURNS internal
+    LANGUAGE C PARALLEL SAFE
+    AS 'MODULE_PATHNAME', $$worker_join_filter_agg_sfunc$$;
+COMMENT ON FUNCTION pg_catalog.worker_join_filter_agg_sfunc(internal, anyelement, integer)
+    IS 'transition function for worker_join_filter_agg';
+
+CREATE FUNCTION pg_catalog.worker_join_filter_agg_final(internal)
+    RETURNS bytea
+    LANGUAGE C PARALLEL SAFE
+    AS 'MODULE_PATHNAME', $$worker_join_filter_agg_final$$;
+COMMENT ON FUNCTION pg_catalog.worker_join_filter_agg_final(internal)
+    IS 'finalizer for worker_join_filter_agg';
+
+-- select worker_join_filter_agg(key, size) builds a Bloom filter of size bytes
+-- from the join keys of one side of a repartition join
+CREATE AGGREGATE pg_catalog.worker_join_filter_agg(anyelement, integer) (
+    STYPE = internal,
+    SFUNC = pg_catalog.worker_join_filter_agg_sfunc,
+    FINALFUNC = pg_catalog.worker_join_filter_agg_final
+);
+COMMENT ON AGGREGATE pg_catalog.worker_join_filter_agg(anyelement, integer)
+    IS 'build a Bloom filter of the join keys of a repartition join';
+
+CREATE FUNCTION pg_catalog.worker_join_filter_contains(bytea, anyelement)
+    RETURNS boolean
+    LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE
+    AS 'MODULE_PATHNAME', $$worker_join_filter_contains$$;
+COMMENT ON FUNCTION pg_catalog.worker_join_filter_contains(bytea, anyelement)
+    IS 'check whether a join key may be in a Bloom filter of a repartition join';
+
+REVOKE ALL ON FUNCTION pg_catalog.worker_join_filter_agg_sfunc FROM PUBLIC;
+REVOKE ALL ON FUNCTION pg_catalog.worker_join_filter_agg_final FROM PUBLIC;
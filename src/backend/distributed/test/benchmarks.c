@@ -0,0 +1,310 @@
+/*-------------------------------------------------------------------------
+ *
+ * test/src/benchmarks.c
+ *
+ * This file contains functions that repeatedly run planner hot paths of
+ * Citus, such as shard pruning and planning of router queries, and report
+ * the average time per iteration. They are used by the benchmark suite in
+ * src/test/bench.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "c.h"
+#include "fmgr.h"
+#include "miscadmin.h"
+
+#include "access/stratnum.h"
+#include "distributed/citus_ruleutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/master_metadata_utility.h"
+#include "distributed/multi_join_order.h"
+#include "distributed/multi_physical_planner.h"
+#include "distributed/shard_pruning.h"
+#include "distributed/shardinterval_utils.h"
+#include "executor/instrument.h"
+#if PG_VERSION_NUM >= 120000
+#include "nodes/nodeFuncs.h"
+#endif
+#include "nodes/parsenodes.h"
+#include "nodes/pg_list.h"
+#include "nodes/primnodes.h"
+#include "optimizer/clauses.h"
+#include "tcop/tcopprot.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+
+
+/* local function forward declarations */
+static Datum PartitionValueFromText(Oid distributedTableId, text *valueText);
+static Query * ParseSingleQuery(char *queryString);
+static void CheckIterationCount(int iterationCount);
+static float8 MicrosecondsPerIteration(instr_time startTime, int iterationCount);
+
+
+/* declarations for dynamic loading */
+PG_FUNCTION_INFO_V1(benchmark_prune_shards);
+PG_FUNCTION_INFO_V1(benchmark_find_shard_interval);
+PG_FUNCTION_INFO_V1(benchmark_plan_query);
+PG_FUNCTION_INFO_V1(benchmark_deparse_shard_query);
+
+
+/*
+ * benchmark_prune_shards prunes the shards of the given distributed table the
+ * given number of times using an equality restriction on the distribution
+ * column with the given value, and returns the average time per iteration in
+ * microseconds.
+ */
+Datum
+benchmark_prune_shards(PG_FUNCTION_ARGS)
+{
+	Oid distributedTableId = PG_GETARG_OID(0);
+	text *valueText = PG_GETARG_TEXT_P(1);
+	int iterationCount = PG_GETARG_INT32(2);
+	Index rangeTableId = 1;
+	instr_time startTime;
+
+	CheckIterationCount(iterationCount);
+
+	Var *partitionColumn = PartitionColumn(distributedTableId, rangeTableId);
+	OpExpr *equalityExpression = MakeOpExpression(partitionColumn,
+												  BTEqualStrategyNumber);
+	Const *rightConst = (Const *) get_rightop((Expr *) equalityExpression);
+
+	rightConst->constvalue = PartitionValueFromText(distributedTableId, valueText);
+	rightConst->constisnull = false;
+	rightConst->constbyval = get_typbyval(rightConst->consttype);
+
+	List *whereClauseList = list_make1(equalityExpression);
+
+	MemoryContext iterationContext = AllocSetContextCreate(CurrentMemoryContext,
+														   "Benchmark Iteration",
+														   ALLOCSET_DEFAULT_SIZES);
+	MemoryContext oldContext = MemoryContextSwitchTo(iterationContext);
+
+	INSTR_TIME_SET_CURRENT(startTime);
+
+	for (int iteration = 0; iteration < iterationCount; iteration++)
+	{
+		PruneShards(distributedTableId, rangeTableId, whereClauseList, NULL);
+
+		MemoryContextReset(iterationContext);
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	float8 microseconds = MicrosecondsPerIteration(startTime, iterationCount);
+
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextDelete(iterationContext);
+
+	PG_RETURN_FLOAT8(microseconds);
+}
+
+
+/*
+ * benchmark_find_shard_interval looks up the shard of the given distributed
+ * table that contains the given value the given number of times, and returns
+ * the average time per iteration in microseconds.
+ */
+Datum
+benchmark_find_shard_interval(PG_FUNCTION_ARGS)
+{
+	Oid distributedTableId = PG_GETARG_OID(0);
+	text *valueText = PG_GETARG_TEXT_P(1);
+	int iterationCount = PG_GETARG_INT32(2);
+	instr_time startTime;
+
+	CheckIterationCount(iterationCount);
+
+	DistTableCacheEntry *cacheEntry = DistributedTableCacheEntry(distributedTableId);
+	Datum partitionValue = PartitionValueFromText(distributedTableId, valueText);
+
+	INSTR_TIME_SET_CURRENT(startTime);
+
+	for (int iteration = 0; iteration < iterationCount; iteration++)
+	{
+		FindShardInterval(partitionValue, cacheEntry);
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	PG_RETURN_FLOAT8(MicrosecondsPerIteration(startTime, iterationCount));
+}
+
+
+/*
+ * benchmark_plan_query plans the given query the given number of times and
+ * returns the average planning time per iteration in microseconds. The query
+ * is parsed and analyzed once, but copied before each planning since the
+ * planner modifies it, so the time includes copying the query tree.
+ */
+Datum
+benchmark_plan_query(PG_FUNCTION_ARGS)
+{
+	char *queryString = text_to_cstring(PG_GETARG_TEXT_P(0));
+	int iterationCount = PG_GETARG_INT32(1);
+	int cursorOptions = 0;
+	instr_time startTime;
+
+	CheckIterationCount(iterationCount);
+
+	Query *query = ParseSingleQuery(queryString);
+
+	MemoryContext iterationContext = AllocSetContextCreate(CurrentMemoryContext,
+														   "Benchmark Iteration",
+														   ALLOCSET_DEFAULT_SIZES);
+	MemoryContext oldContext = MemoryContextSwitchTo(iterationContext);
+
+	INSTR_TIME_SET_CURRENT(startTime);
+
+	for (int iteration = 0; iteration < iterationCount; iteration++)
+	{
+		Query *queryCopy = copyObject(query);
+
+		pg_plan_query(queryCopy, cursorOptions, NULL);
+
+		MemoryContextReset(iterationContext);
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	float8 microseconds = MicrosecondsPerIteration(startTime, iterationCount);
+
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextDelete(iterationContext);
+
+	PG_RETURN_FLOAT8(microseconds);
+}
+
+
+/*
+ * benchmark_deparse_shard_query deparses the given query on a distributed
+ * table for the first shard of the given table the given number of times, and
+ * returns the average time per iteration in microseconds.
+ */
+Datum
+benchmark_deparse_shard_query(PG_FUNCTION_ARGS)
+{
+	Oid distributedTableId = PG_GETARG_OID(0);
+	char *queryString = text_to_cstring(PG_GETARG_TEXT_P(1));
+	int iterationCount = PG_GETARG_INT32(2);
+	instr_time startTime;
+
+	CheckIterationCount(iterationCount);
+
+	DistTableCacheEntry *cacheEntry = DistributedTableCacheEntry(distributedTableId);
+	if (cacheEntry->shardIntervalArrayLength == 0)
+	{
+		ereport(ERROR, (errmsg("table \"%s\" has no shards",
+							   get_rel_name(distributedTableId))));
+	}
+
+	uint64 shardId = cacheEntry->sortedShardIntervalArray[0]->shardId;
+	Query *query = ParseSingleQuery(queryString);
+
+	MemoryContext iterationContext = AllocSetContextCreate(CurrentMemoryContext,
+														   "Benchmark Iteration",
+														   ALLOCSET_DEFAULT_SIZES);
+	MemoryContext oldContext = MemoryContextSwitchTo(iterationContext);
+
+	INSTR_TIME_SET_CURRENT(startTime);
+
+	for (int iteration = 0; iteration < iterationCount; iteration++)
+	{
+		StringInfo shardQueryString = makeStringInfo();
+
+		deparse_shard_query(query, distributedTableId, shardId, shardQueryString);
+
+		MemoryContextReset(iterationContext);
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	float8 microseconds = MicrosecondsPerIteration(startTime, iterationCount);
+
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextDelete(iterationContext);
+
+	PG_RETURN_FLOAT8(microseconds);
+}
+
+
+/*
+ * PartitionValueFromText converts the given text into a value of the type of
+ * the distribution column of the given table.
+ */
+static Datum
+PartitionValueFromText(Oid distributedTableId, text *valueText)
+{
+	Index rangeTableId = 1;
+	Oid typeInputFunctionId = InvalidOid;
+	Oid typeIoParam = InvalidOid;
+
+	Var *partitionColumn = PartitionColumn(distributedTableId, rangeTableId);
+	if (partitionColumn == NULL)
+	{
+		ereport(ERROR, (errmsg("table \"%s\" has no distribution column",
+							   get_rel_name(distributedTableId))));
+	}
+
+	getTypeInputInfo(partitionColumn->vartype, &typeInputFunctionId, &typeIoParam);
+
+	return OidInputFunctionCall(typeInputFunctionId, text_to_cstring(valueText),
+								typeIoParam, partitionColumn->vartypmod);
+}
+
+
+/*
+ * ParseSingleQuery parses and analyzes the given query string, which should
+ * contain a single query without parameters.
+ */
+static Query *
+ParseSingleQuery(char *queryString)
+{
+	List *parseTreeList = pg_parse_query(queryString);
+	if (list_length(parseTreeList) != 1)
+	{
+		ereport(ERROR, (errmsg("benchmarks can only run a single query")));
+	}
+
+	RawStmt *parseTree = (RawStmt *) linitial(parseTreeList);
+	List *queryTreeList = pg_analyze_and_rewrite(parseTree, queryString, NULL, 0,
+												 NULL);
+	if (list_length(queryTreeList) != 1)
+	{
+		ereport(ERROR, (errmsg("benchmarks can only run a single query")));
+	}
+
+	return (Query *) linitial(queryTreeList);
+}
+
+
+/*
+ * CheckIterationCount errors out if the given iteration count is not positive.
+ */
+static void
+CheckIterationCount(int iterationCount)
+{
+	if (iterationCount <= 0)
+	{
+		ereport(ERROR, (errmsg("iteration count must be positive")));
+	}
+}
+
+
+/*
+ * MicrosecondsPerIteration returns the average number of microseconds that
+ * the given number of iterations took since the given start time.
+ */
+static float8
+MicrosecondsPerIteration(instr_time startTime, int iterationCount)
+{
+	instr_time elapsedTime;
+
+	INSTR_TIME_SET_CURRENT(elapsedTime);
+	INSTR_TIME_SUBTRACT(elapsedTime, startTime);
+
+	return INSTR_TIME_GET_MICROSEC(elapsedTime) / (float8) iterationCount;
+}
@@ -365,9 +365,13 @@ StoreAllActiveTransactions(Tuplestorestate *tupleStore, TupleDesc tupleDescripto
 		showAllTransactions = true;
 	}
 
-	/* we're reading all distributed transactions, prevent new backends */
-	LockBackendSharedMemory(LW_SHARED);
-
+	/*
+	 * We do not take the backend shared memory lock here. Every entry is read
+	 * under its own spinlock, which gives a consistent view of each backend,
+	 * and monitoring does not need a consistent view across backends. This
+	 * way frequent calls (e.g., via citus_dist_stat_activity) do not block
+	 * backends from starting while the rows are written to the tuplestore.
+	 */
 	for (int backendIndex = 0; backendIndex < MaxBackends; ++backendIndex)
 	{
 		BackendData *currentBackend =
@@ -433,8 +437,6 @@ StoreAllActiveTransactions(Tuplestorestate *tupleStore, TupleDesc tupleDescripto
 		memset(values, 0, sizeof(values));
 		memset(isNulls, false, sizeof(isNulls));
 	}
-
-	UnlockBackendSharedMemory();
 }
 
 
@@ -626,6 +628,10 @@ InitializeBackendData(void)
 	/* zero out the backend data */
 	UnSetDistributedTransactionId();
 
+	SpinLockAcquire(&MyBackendData->mutex);
+	memset(&MyBackendData->memoryUsage, 0, sizeof(CitusMemoryUsage));
+	SpinLockRelease(&MyBackendData->mutex);
+
 	UnlockBackendSharedMemory();
 }
 
@@ -812,6 +818,23 @@ GetBackendDataForProc(PGPROC *proc, BackendData *result)
 }
 
 
+/*
+ * SetBackendMemoryUsage stores the memory used by Citus in this backend in its
+ * backend data, such that other backends can see it.
+ */
+void
+SetBackendMemoryUsage(CitusMemoryUsage *memoryUsage)
+{
+	/* backend does not exist if the extension is not created */
+	if (MyBackendData)
+	{
+		SpinLockAcquire(&MyBackendData->mutex);
+		MyBackendData->memoryUsage = *memoryUsage;
+		SpinLockRelease(&MyBackendData->mutex);
+	}
+}
+
+
 /*
  * CancelTransactionDueToDeadlock cancels the input proc and also marks the backend
  * data with this information.
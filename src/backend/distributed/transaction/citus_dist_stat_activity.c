@@ -154,7 +154,7 @@ FROM \
 	get_all_active_transactions() AS dist_txs(database_id, process_id, initiator_node_identifier, worker_query, transaction_number, transaction_stamp) \
 	ON pg_stat_activity.pid = dist_txs.process_id \
 WHERE \
-	dist_txs.worker_query = false;"
+	dist_txs.worker_query = false"
 
 #define CITUS_WORKER_STAT_ACTIVITY_QUERY \
 	"\
@@ -190,7 +190,7 @@ FROM \
 WHERE \
 	pg_stat_activity.application_name = 'citus' \
 	AND \
-	pg_stat_activity.query NOT ILIKE '%stat_activity%';"
+	pg_stat_activity.query NOT ILIKE '%stat_activity%'"
 
 typedef struct CitusDistStat
 {
@@ -226,8 +226,17 @@ typedef struct CitusDistStat
 } CitusDistStat;
 
 
+/*
+ * Condition appended to the stat queries above when only active backends are
+ * requested. Backends without a state (e.g., background workers) are kept.
+ */
+#define CITUS_STAT_ACTIVITY_ONLY_ACTIVE_FILTER \
+	" AND pg_stat_activity.state IS DISTINCT FROM 'idle'"
+
+
 /* local forward declarations */
 static List * CitusStatActivity(const char *statQuery);
+static char * CitusStatActivityQuery(const char *baseQuery, FunctionCallInfo fcinfo);
 static void ReturnCitusDistStats(List *citusStatsList, FunctionCallInfo fcinfo);
 static CitusDistStat * ParseCitusDistStat(PGresult *result, int64 rowIndex);
 static void ReplaceInitiatorNodeIdentifier(int initiator_node_identifier,
@@ -265,13 +274,17 @@ PG_FUNCTION_INFO_V1(citus_worker_stat_activity);
  * citus_dist_stat_activity connects to all nodes in the cluster and returns
  * pg_stat_activity like result set but only consisting of queries that are
  * on the distributed tables and inside distributed transactions.
+ *
+ * The function optionally takes an only_active argument, in which case idle
+ * backends are filtered out on the nodes themselves.
  */
 Datum
 citus_dist_stat_activity(PG_FUNCTION_ARGS)
 {
 	CheckCitusVersion(ERROR);
 
-	List *citusDistStatStatements = CitusStatActivity(CITUS_DIST_STAT_ACTIVITY_QUERY);
+	char *statQuery = CitusStatActivityQuery(CITUS_DIST_STAT_ACTIVITY_QUERY, fcinfo);
+	List *citusDistStatStatements = CitusStatActivity(statQuery);
 
 	ReturnCitusDistStats(citusDistStatStatements, fcinfo);
 
@@ -283,13 +296,17 @@ citus_dist_stat_activity(PG_FUNCTION_ARGS)
  * citus_worker_stat_activity connects to all nodes in the cluster and returns
  * pg_stat_activity like result set but only consisting of queries that are
  * on the shards of distributed tables and inside distributed transactions.
+ *
+ * Like citus_dist_stat_activity, the function optionally takes an only_active
+ * argument. This skips the idle connections that coordinators keep cached.
  */
 Datum
 citus_worker_stat_activity(PG_FUNCTION_ARGS)
 {
 	CheckCitusVersion(ERROR);
 
-	List *citusWorkerStatStatements = CitusStatActivity(CITUS_WORKER_STAT_ACTIVITY_QUERY);
+	char *statQuery = CitusStatActivityQuery(CITUS_WORKER_STAT_ACTIVITY_QUERY, fcinfo);
+	List *citusWorkerStatStatements = CitusStatActivity(statQuery);
 
 	ReturnCitusDistStats(citusWorkerStatStatements, fcinfo);
 
@@ -297,6 +314,27 @@ citus_worker_stat_activity(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * CitusStatActivityQuery returns the stat query to send to the nodes, adding
+ * the filters that are given as arguments to the stat activity functions such
+ * that the nodes only return the rows that are asked for.
+ */
+static char *
+CitusStatActivityQuery(const char *baseQuery, FunctionCallInfo fcinfo)
+{
+	StringInfo statQuery = makeStringInfo();
+
+	appendStringInfoString(statQuery, baseQuery);
+
+	if (PG_NARGS() > 0 && PG_GETARG_BOOL(0))
+	{
+		appendStringInfoString(statQuery, CITUS_STAT_ACTIVITY_ONLY_ACTIVE_FILTER);
+	}
+
+	return statQuery->data;
+}
+
+
 /*
  * CitusStatActivity gets the stats query, connects to each node in the
  * cluster, executes the query and parses the results. The function returns
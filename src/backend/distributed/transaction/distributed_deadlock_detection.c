@@ -38,6 +38,16 @@ typedef struct QueuedTransactionNode
 } QueuedTransactionNode;
 
 
+/* used only for finding the strongly connected components of the wait graph */
+typedef struct ComponentSearchFrame
+{
+	TransactionNode *transactionNode;
+
+	/* next outgoing edge of the transaction node to follow */
+	ListCell *nextWaitsForCell;
+} ComponentSearchFrame;
+
+
 /* GUC, determining whether debug messages for deadlock detection sent to LOG */
 bool LogDistributedDeadlockDetection = false;
 
@@ -51,7 +61,10 @@ static void PrependOutgoingNodesToQueue(TransactionNode *queuedTransactionNode,
 static void BuildDeadlockPathList(QueuedTransactionNode *cycledTransactionNode,
 								  TransactionNode **transactionNodeStack,
 								  List **deadlockPath);
-static void ResetVisitedFields(HTAB *adjacencyList);
+static void ResetVisitedFields(List *transactionNodeList);
+static List * AssignCycleComponents(HTAB *adjacencyList);
+static List * PopComponent(TransactionNode *rootTransactionNode,
+						   TransactionNode **componentStack, int *componentStackSize);
 static bool AssociateDistributedTransactionWithBackendProc(TransactionNode *
 														   transactionNode);
 static TransactionNode * GetOrCreateTransactionNode(HTAB *adjacencyList,
@@ -93,9 +106,17 @@ check_distributed_deadlocks(PG_FUNCTION_ARGS)
  * distributed deadlock. Upon finding a deadlock, the youngest
  * participant backend is cancelled.
  *
+ * Before searching, the strongly connected components of the graph are
+ * determined. Only transactions that are part of a component with a
+ * cycle can be in a deadlock, and the DFS never needs to leave the
+ * component of the starting transaction. Under lock contention most
+ * waiting transactions are not part of any cycle, so this avoids
+ * searching the whole graph once for each of them.
+ *
  * The complexity of the algorithm is O(N) for each distributed
- * transaction that's checked for deadlocks. Note that there exists
- *  0 to MaxBackends number of transactions.
+ * transaction that's checked for deadlocks, where N is the size of
+ * the component that the transaction belongs to. Note that there
+ * exists 0 to MaxBackends number of transactions.
  *
  * The function returns true if a deadlock is found. Otherwise, returns
  * false.
@@ -124,6 +145,13 @@ CheckForDistributedDeadlocks(void)
 
 	int edgeCount = waitGraph->edgeCount;
 
+	List *componentList = AssignCycleComponents(adjacencyLists);
+	if (componentList == NIL)
+	{
+		/* without a cycle in the wait graph there cannot be a deadlock */
+		return false;
+	}
+
 	/*
 	 * We iterate on transaction nodes and search for deadlocks where the
 	 * starting node is the given transaction node.
@@ -145,7 +173,16 @@ CheckForDistributedDeadlocks(void)
 			continue;
 		}
 
-		ResetVisitedFields(adjacencyLists);
+		/* transactions that are not part of a cycle cannot be in a deadlock */
+		if (transactionNode->componentId == INVALID_COMPONENT_ID)
+		{
+			continue;
+		}
+
+		/* the search does not leave the component, only reset the visited fields */
+		List *componentNodeList = list_nth(componentList,
+										   transactionNode->componentId - 1);
+		ResetVisitedFields(componentNodeList);
 
 		bool deadlockFound = CheckDeadlockForTransactionNode(transactionNode,
 															 maxStackDepth,
@@ -294,6 +331,9 @@ CheckDeadlockForTransactionNode(TransactionNode *startingTransactionNode,
 /*
  * PrependOutgoingNodesToQueue prepends the waiters of the input transaction nodes to the
  * toBeVisitedNodes.
+ *
+ * Waiters in a different strongly connected component are skipped, since
+ * there is no path from them back to the input transaction node.
  */
 static void
 PrependOutgoingNodesToQueue(TransactionNode *transactionNode, int currentStackDepth,
@@ -309,6 +349,12 @@ PrependOutgoingNodesToQueue(TransactionNode *transactionNode, int currentStackDe
 	{
 		TransactionNode *waitForTransaction =
 			(TransactionNode *) lfirst(currentWaitForCell);
+
+		if (waitForTransaction->componentId != transactionNode->componentId)
+		{
+			continue;
+		}
+
 		QueuedTransactionNode *queuedNode = palloc0(sizeof(QueuedTransactionNode));
 
 		queuedNode->transactionNode = waitForTransaction;
@@ -340,22 +386,181 @@ BuildDeadlockPathList(QueuedTransactionNode *cycledTransactionNode,
 
 
 /*
- * ResetVisitedFields goes over all the elements of the input adjacency list
- * and sets transactionVisited to false.
+ * ResetVisitedFields goes over all the elements of the input transaction node
+ * list and sets transactionVisited to false.
  */
 static void
-ResetVisitedFields(HTAB *adjacencyList)
+ResetVisitedFields(List *transactionNodeList)
 {
-	HASH_SEQ_STATUS status;
-	TransactionNode *resetNode = NULL;
+	ListCell *transactionNodeCell = NULL;
 
 	/* reset all visited fields */
+	foreach(transactionNodeCell, transactionNodeList)
+	{
+		TransactionNode *resetNode = (TransactionNode *) lfirst(transactionNodeCell);
+
+		resetNode->transactionVisited = false;
+	}
+}
+
+
+/*
+ * AssignCycleComponents finds the strongly connected components of the wait
+ * graph using Tarjan's algorithm, without recursion since the graph may
+ * contain as many transactions as there are backends in the cluster.
+ *
+ * Every component that contains a cycle gets a componentId, starting from 1,
+ * and the function returns a list with the list of transaction nodes of each
+ * of those components. Transactions that are not part of any cycle keep
+ * INVALID_COMPONENT_ID.
+ */
+static List *
+AssignCycleComponents(HTAB *adjacencyList)
+{
+	HASH_SEQ_STATUS status;
+	TransactionNode *transactionNode = NULL;
+	List *componentList = NIL;
+	int searchIndex = 0;
+	int frameCount = 0;
+	int componentStackSize = 0;
+
+	long transactionCount = hash_get_num_entries(adjacencyList);
+	if (transactionCount == 0)
+	{
+		return NIL;
+	}
+
+	ComponentSearchFrame *frameStack = palloc0(transactionCount *
+											   sizeof(ComponentSearchFrame));
+	TransactionNode **componentStack = palloc0(transactionCount *
+											   sizeof(TransactionNode *));
+
 	hash_seq_init(&status, adjacencyList);
+	while ((transactionNode = (TransactionNode *) hash_seq_search(&status)) != 0)
+	{
+		transactionNode->componentId = INVALID_COMPONENT_ID;
+		transactionNode->componentSearchIndex = -1;
+		transactionNode->componentLowLink = -1;
+		transactionNode->onComponentStack = false;
+	}
 
-	while ((resetNode = (TransactionNode *) hash_seq_search(&status)) != 0)
+	hash_seq_init(&status, adjacencyList);
+	while ((transactionNode = (TransactionNode *) hash_seq_search(&status)) != 0)
 	{
-		resetNode->transactionVisited = false;
+		if (transactionNode->componentSearchIndex >= 0)
+		{
+			/* already visited from another transaction */
+			continue;
+		}
+
+		TransactionNode *nextTransactionNode = transactionNode;
+
+		while (nextTransactionNode != NULL || frameCount > 0)
+		{
+			if (nextTransactionNode != NULL)
+			{
+				/* start visiting a transaction */
+				nextTransactionNode->componentSearchIndex = searchIndex;
+				nextTransactionNode->componentLowLink = searchIndex;
+				searchIndex++;
+
+				componentStack[componentStackSize++] = nextTransactionNode;
+				nextTransactionNode->onComponentStack = true;
+
+				frameStack[frameCount].transactionNode = nextTransactionNode;
+				frameStack[frameCount].nextWaitsForCell =
+					list_head(nextTransactionNode->waitsFor);
+				frameCount++;
+
+				nextTransactionNode = NULL;
+				continue;
+			}
+
+			ComponentSearchFrame *frame = &frameStack[frameCount - 1];
+			TransactionNode *currentNode = frame->transactionNode;
+
+			if (frame->nextWaitsForCell != NULL)
+			{
+				TransactionNode *waitForTransaction =
+					(TransactionNode *) lfirst(frame->nextWaitsForCell);
+
+				frame->nextWaitsForCell = lnext(frame->nextWaitsForCell);
+
+				if (waitForTransaction->componentSearchIndex < 0)
+				{
+					nextTransactionNode = waitForTransaction;
+				}
+				else if (waitForTransaction->onComponentStack)
+				{
+					currentNode->componentLowLink =
+						Min(currentNode->componentLowLink,
+							waitForTransaction->componentSearchIndex);
+				}
+
+				continue;
+			}
+
+			/* all outgoing edges are followed, finish the transaction */
+			frameCount--;
+
+			if (currentNode->componentLowLink == currentNode->componentSearchIndex)
+			{
+				List *componentNodeList = PopComponent(currentNode, componentStack,
+													   &componentStackSize);
+
+				/* single transactions only form a cycle when waiting for themselves */
+				if (list_length(componentNodeList) > 1 ||
+					list_member_ptr(currentNode->waitsFor, currentNode))
+				{
+					ListCell *componentNodeCell = NULL;
+
+					componentList = lappend(componentList, componentNodeList);
+
+					foreach(componentNodeCell, componentNodeList)
+					{
+						TransactionNode *componentNode = lfirst(componentNodeCell);
+
+						componentNode->componentId = list_length(componentList);
+					}
+				}
+			}
+
+			if (frameCount > 0)
+			{
+				TransactionNode *parentNode = frameStack[frameCount - 1].transactionNode;
+
+				parentNode->componentLowLink = Min(parentNode->componentLowLink,
+												   currentNode->componentLowLink);
+			}
+		}
 	}
+
+	pfree(frameStack);
+	pfree(componentStack);
+
+	return componentList;
+}
+
+
+/*
+ * PopComponent pops the transaction nodes of the strongly connected component
+ * with the given root off the component stack and returns them as a list.
+ */
+static List *
+PopComponent(TransactionNode *rootTransactionNode, TransactionNode **componentStack,
+			 int *componentStackSize)
+{
+	List *componentNodeList = NIL;
+	TransactionNode *componentNode = NULL;
+
+	do {
+		componentNode = componentStack[--(*componentStackSize)];
+		componentNode->onComponentStack = false;
+
+		componentNodeList = lappend(componentNodeList, componentNode);
+	} while (componentNode != rootTransactionNode);
+
+	return componentNodeList;
 }
 
 
@@ -509,6 +714,7 @@ GetOrCreateTransactionNode(HTAB *adjacencyList, DistributedTransactionId *transa
 	{
 		transactionNode->waitsFor = NIL;
 		transactionNode->initiatorProc = NULL;
+		transactionNode->componentId = INVALID_COMPONENT_ID;
 	}
 
 	return transactionNode;
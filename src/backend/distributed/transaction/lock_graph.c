@@ -47,6 +47,7 @@ typedef struct PROCStack
 static void AddWaitEdgeFromResult(WaitGraph *waitGraph, PGresult *result, int rowIndex);
 static void ReturnWaitGraph(WaitGraph *waitGraph, FunctionCallInfo fcinfo);
 static WaitGraph * BuildLocalWaitGraph(void);
+static bool AnyDistributedTransactionWaitingForLock(int totalProcs);
 static bool IsProcessWaitingForSafeOperations(PGPROC *proc);
 static void LockLockData(void);
 static void UnlockLockData(void);
@@ -352,6 +353,18 @@ BuildLocalWaitGraph(void)
 	waitGraph->edgeCount = 0;
 	waitGraph->edges = (WaitEdge *) palloc(waitGraph->allocatedSize * sizeof(WaitEdge));
 
+	/*
+	 * Locking the lock data blocks all lock acquisitions on this node, and
+	 * the deadlock detector asks for the wait edges every check interval.
+	 * Skip it when no distributed transaction is waiting for a lock, which
+	 * we can check without holding the locks. A wait that starts right after
+	 * the check is seen by the next check, as deadlocks do not go away.
+	 */
+	if (!AnyDistributedTransactionWaitingForLock(totalProcs))
+	{
+		return waitGraph;
+	}
+
 	remaining.procs = (PGPROC **) palloc(sizeof(PGPROC *) * totalProcs);
 	remaining.procAdded = (bool *) palloc0(sizeof(bool *) * totalProcs);
 	remaining.procCount = 0;
@@ -439,6 +452,38 @@ BuildLocalWaitGraph(void)
 }
 
 
+/*
+ * AnyDistributedTransactionWaitingForLock returns whether any backend that
+ * is in a distributed transaction is waiting for a lock. The function does
+ * not lock the lock data, so the answer may be outdated by the time it
+ * returns.
+ */
+static bool
+AnyDistributedTransactionWaitingForLock(int totalProcs)
+{
+	for (int curBackend = 0; curBackend < totalProcs; curBackend++)
+	{
+		PGPROC *currentProc = &ProcGlobal->allProcs[curBackend];
+		BackendData currentBackendData;
+
+		/* skip if the PGPROC slot is unused or the process is not blocked */
+		if (currentProc->pid == 0 || !IsProcessWaitingForLock(currentProc))
+		{
+			continue;
+		}
+
+		GetBackendDataForProc(currentProc, &currentBackendData);
+
+		if (IsInDistributedTransaction(&currentBackendData))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
 /*
  * IsProcessWaitingForSafeOperations returns true if the given PROC
  * waiting on relation extension locks, page locks or speculative locks.
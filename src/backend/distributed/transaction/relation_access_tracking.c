@@ -31,18 +31,10 @@
 
 /* Config variables managed via guc.c */
 bool EnforceForeignKeyRestrictions = true;
+bool TrackForeignKeyRelationAccessesOnly = false;
 
 #define PARALLEL_MODE_FLAG_OFFSET 3
 
-/* simply set parallel bits as defined below for select, dml and ddl */
-#define PARALLEL_ACCESS_MASK (int) (0 | \
-									(1 << (PLACEMENT_ACCESS_SELECT + \
-										   PARALLEL_MODE_FLAG_OFFSET)) | \
-									(1 << (PLACEMENT_ACCESS_DML + \
-										   PARALLEL_MODE_FLAG_OFFSET)) | \
-									(1 << (PLACEMENT_ACCESS_DDL + \
-										   PARALLEL_MODE_FLAG_OFFSET)))
-
 
 /*
  * Hash table mapping relations to the
@@ -80,6 +72,12 @@ typedef struct RelationAccessHashEntry
 
 static HTAB *RelationAccessHash;
 
+/*
+ * Set when any relation is accessed in parallel in the current transaction, so
+ * that ParallelQueryExecutedInTransaction() does not need to scan the hash.
+ */
+static bool ParallelRelationAccessInTransaction = false;
+
 
 /* functions related to access recording */
 static void RecordRelationAccessBase(Oid relationId, ShardPlacementAccessType accessType);
@@ -94,6 +92,7 @@ static void RecordParallelRelationAccess(Oid relationId, ShardPlacementAccessTyp
 										 placementAccess);
 static void RecordParallelRelationAccessToCache(Oid relationId,
 												ShardPlacementAccessType placementAccess);
+static bool RelationAccessTrackingRequired(Oid relationId);
 
 /* functions related to access conflict checks */
 static char * PlacementAccessTypeToText(ShardPlacementAccessType accessType);
@@ -123,6 +122,8 @@ void
 ResetRelationAccessHash()
 {
 	hash_delete_all(RelationAccessHash);
+
+	ParallelRelationAccessInTransaction = false;
 }
 
 
@@ -245,6 +246,11 @@ RecordPlacementAccessToCache(Oid relationId, ShardPlacementAccessType accessType
 	RelationAccessHashKey hashKey;
 	bool found = false;
 
+	if (!RelationAccessTrackingRequired(relationId))
+	{
+		return;
+	}
+
 	hashKey.relationId = relationId;
 
 	RelationAccessHashEntry *hashEntry = hash_search(RelationAccessHash, &hashKey,
@@ -259,6 +265,34 @@ RecordPlacementAccessToCache(Oid relationId, ShardPlacementAccessType accessType
 }
 
 
+/*
+ * RelationAccessTrackingRequired returns whether the accesses to the given
+ * relation should be kept in RelationAccessHash.
+ *
+ * The accesses are only inspected for relations that are part of a foreign key
+ * relationship, hence when citus.track_foreign_key_relation_accesses_only is set
+ * we skip all other relations to keep the hash small in long transactions.
+ */
+static bool
+RelationAccessTrackingRequired(Oid relationId)
+{
+	if (!TrackForeignKeyRelationAccessesOnly)
+	{
+		return true;
+	}
+
+	if (!IsDistributedTable(relationId))
+	{
+		return false;
+	}
+
+	DistTableCacheEntry *cacheEntry = DistributedTableCacheEntry(relationId);
+
+	return cacheEntry->referencedRelationsViaForeignKey != NIL ||
+		   cacheEntry->referencingRelationsViaForeignKey != NIL;
+}
+
+
 /*
  * RecordParallelRelationAccessForTaskList gets a task list and records
  * the necessary parallel relation accesses for the task list.
@@ -526,6 +560,13 @@ RecordParallelRelationAccessToCache(Oid relationId,
 	RelationAccessHashKey hashKey;
 	bool found = false;
 
+	ParallelRelationAccessInTransaction = true;
+
+	if (!RelationAccessTrackingRequired(relationId))
+	{
+		return;
+	}
+
 	hashKey.relationId = relationId;
 
 	RelationAccessHashEntry *hashEntry = hash_search(RelationAccessHash, &hashKey,
@@ -551,30 +592,12 @@ RecordParallelRelationAccessToCache(Oid relationId,
 bool
 ParallelQueryExecutedInTransaction(void)
 {
-	HASH_SEQ_STATUS status;
-
-	if (!ShouldRecordRelationAccess() || RelationAccessHash == NULL)
+	if (!ShouldRecordRelationAccess())
 	{
 		return false;
 	}
 
-	hash_seq_init(&status, RelationAccessHash);
-
-	RelationAccessHashEntry *hashEntry = (RelationAccessHashEntry *) hash_seq_search(
-		&status);
-	while (hashEntry != NULL)
-	{
-		int relationAccessMode = hashEntry->relationAccessMode;
-		if ((relationAccessMode & PARALLEL_ACCESS_MASK))
-		{
-			hash_seq_term(&status);
-			return true;
-		}
-
-		hashEntry = (RelationAccessHashEntry *) hash_seq_search(&status);
-	}
-
-	return false;
+	return ParallelRelationAccessInTransaction;
 }
 
 
@@ -16,6 +16,7 @@
 
 #include "access/xact.h"
 #include "distributed/backend_data.h"
+#include "distributed/citus_wait_events.h"
 #include "distributed/connection_management.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/remote_commands.h"
@@ -24,6 +25,7 @@
 #include "distributed/transaction_management.h"
 #include "distributed/transaction_recovery.h"
 #include "distributed/worker_manager.h"
+#include "storage/proc.h"
 #include "utils/builtins.h"
 #include "utils/hsearch.h"
 
@@ -31,6 +33,19 @@
 #define PREPARED_TRANSACTION_NAME_FORMAT "citus_%u_%u_"UINT64_FORMAT "_%u"
 
 
+/* GUC, determining whether to wait for COMMIT PREPARED to finish on the workers */
+bool AsyncCommitPrepared = false;
+
+/* GUC, determining whether to send statement_timeout along with remote BEGINs */
+bool PropagateStatementTimeout = false;
+
+/* GUC, determining whether savepoints are only sent to connections that use them */
+bool PropagateSavepointsLazily = false;
+
+/* GUC, determining whether all connections to a node share the same snapshot */
+bool EnableSynchronizedSnapshots = false;
+
+
 static void StartRemoteTransactionSavepointBegin(MultiConnection *connection,
 												 SubTransactionId subId);
 static void FinishRemoteTransactionSavepointBegin(MultiConnection *connection,
@@ -45,7 +60,19 @@ static void FinishRemoteTransactionSavepointRollback(MultiConnection *connection
 													 SubTransactionId subId);
 
 static void Assign2PCIdentifier(MultiConnection *connection);
+static void LogPreparedTransactionRecords(List *connectionList);
 static void WarnAboutLeakedPreparedTransaction(MultiConnection *connection, bool commit);
+static StringInfo RemoteTransactionBeginCommand(MultiConnection *connection,
+												int *statementCount);
+static StringInfo RemoteTransactionSavepointSyncCommand(MultiConnection *connection,
+														int *statementCount);
+static void RecordEstablishedSubXact(RemoteTransaction *transaction,
+									 SubTransactionId subId);
+static void ForgetEstablishedSubXactsAbove(RemoteTransaction *transaction,
+										   SubTransactionId subId, bool keepSubXact);
+static MultiConnection * SnapshotConnectionForNode(const char *nodeName, int nodePort,
+												   const char *database,
+												   bool requireExportedSnapshot);
 
 
 /*
@@ -56,6 +83,73 @@ static void WarnAboutLeakedPreparedTransaction(MultiConnection *connection, bool
  */
 void
 StartRemoteTransactionBegin(struct MultiConnection *connection)
+{
+	RemoteTransaction *transaction = &connection->remoteTransaction;
+	int statementCount = 0;
+
+	StringInfo beginAndSetDistributedTransactionId =
+		RemoteTransactionBeginCommand(connection, &statementCount);
+
+	if (!SendRemoteCommand(connection, beginAndSetDistributedTransactionId->data))
+	{
+		const bool raiseErrors = true;
+
+		HandleRemoteTransactionConnectionError(connection, raiseErrors);
+	}
+
+	transaction->beginSent = true;
+}
+
+
+/*
+ * CanPrependRemoteTransactionBegin returns whether the commands that begin a
+ * remote transaction consist of a known number of statements, which is the
+ * case unless they need to restore savepoints or SET commands of the
+ * transaction.
+ */
+bool
+CanPrependRemoteTransactionBegin(void)
+{
+	return ActiveSubXactContexts() == NIL &&
+		   (activeSetStmts == NULL || activeSetStmts->len == 0);
+}
+
+
+/*
+ * PrependRemoteTransactionBegin marks the remote transaction on the given
+ * connection as being started, and returns the given command prefixed with
+ * the statements that begin the transaction, such that the caller can send
+ * both in a single round trip. The number of results of the prefix is stored
+ * in beginStatementCount, the caller needs to skip them before reading the
+ * results of the command. The caller needs to check that
+ * CanPrependRemoteTransactionBegin() is true.
+ */
+char *
+PrependRemoteTransactionBegin(struct MultiConnection *connection, const char *command,
+							  int *beginStatementCount)
+{
+	RemoteTransaction *transaction = &connection->remoteTransaction;
+
+	Assert(CanPrependRemoteTransactionBegin());
+
+	StringInfo beginAndCommand = RemoteTransactionBeginCommand(connection,
+															   beginStatementCount);
+	appendStringInfoString(beginAndCommand, command);
+
+	transaction->beginSent = true;
+
+	return beginAndCommand->data;
+}
+
+
+/*
+ * RemoteTransactionBeginCommand marks the remote transaction on the given
+ * connection as being started and returns the statements that begin it. The
+ * number of statements is stored in statementCount, not counting SAVEPOINT and
+ * SET commands that restore the state of the transaction.
+ */
+static StringInfo
+RemoteTransactionBeginCommand(MultiConnection *connection, int *statementCount)
 {
 	RemoteTransaction *transaction = &connection->remoteTransaction;
 	StringInfo beginAndSetDistributedTransactionId = makeStringInfo();
@@ -73,8 +167,51 @@ StartRemoteTransactionBegin(struct MultiConnection *connection)
 	 * side might have been changed, and that would cause problematic
 	 * behaviour.
 	 */
-	appendStringInfoString(beginAndSetDistributedTransactionId,
-						   "BEGIN TRANSACTION ISOLATION LEVEL READ COMMITTED;");
+	if (!EnableSynchronizedSnapshots)
+	{
+		appendStringInfoString(beginAndSetDistributedTransactionId,
+							   "BEGIN TRANSACTION ISOLATION LEVEL READ COMMITTED;");
+		*statementCount = 1;
+	}
+	else
+	{
+		/*
+		 * All commands of the transaction read from the snapshot of its first
+		 * command, which is the snapshot of another transaction on the same
+		 * node if that exported its snapshot.
+		 */
+		appendStringInfoString(beginAndSetDistributedTransactionId,
+							   "BEGIN TRANSACTION ISOLATION LEVEL REPEATABLE READ;");
+		*statementCount = 1;
+
+		const bool requireExportedSnapshot = true;
+		MultiConnection *snapshotConnection =
+			SnapshotConnectionForNode(connection->hostname, connection->port,
+									  connection->database, requireExportedSnapshot);
+		if (snapshotConnection != NULL)
+		{
+			char *snapshotName =
+				snapshotConnection->remoteTransaction.exportedSnapshot;
+
+			appendStringInfo(beginAndSetDistributedTransactionId,
+							 "SET TRANSACTION SNAPSHOT %s;",
+							 quote_literal_cstr(snapshotName));
+			(*statementCount)++;
+		}
+	}
+
+	/*
+	 * Let the remote statements time out by themselves, in case the cancellation
+	 * of the statement on the coordinator does not reach the worker. The worker
+	 * statements start after the coordinator statement, so they time out later.
+	 * SET LOCAL commands of the transaction follow and take precedence.
+	 */
+	if (PropagateStatementTimeout && StatementTimeout > 0)
+	{
+		appendStringInfo(beginAndSetDistributedTransactionId,
+						 "SET LOCAL statement_timeout TO %d;", StatementTimeout);
+		(*statementCount)++;
+	}
 
 	/*
 	 * Append BEGIN and assign_distributed_transaction_id() statements into a single command
@@ -90,6 +227,7 @@ StartRemoteTransactionBegin(struct MultiConnection *connection)
 					 distributedTransactionId->initiatorNodeIdentifier,
 					 distributedTransactionId->transactionNumber,
 					 timestamp);
+	(*statementCount)++;
 
 	/* append context for in-progress SAVEPOINTs for this transaction */
 	List *activeSubXacts = ActiveSubXactContexts();
@@ -110,6 +248,8 @@ StartRemoteTransactionBegin(struct MultiConnection *connection)
 		appendStringInfo(beginAndSetDistributedTransactionId,
 						 "SAVEPOINT savepoint_%u;", subXactState->subId);
 		transaction->lastQueuedSubXact = subXactState->subId;
+
+		RecordEstablishedSubXact(transaction, subXactState->subId);
 	}
 
 	/* we've pushed into deepest subxact: apply in-progress SET context */
@@ -118,14 +258,7 @@ StartRemoteTransactionBegin(struct MultiConnection *connection)
 		appendStringInfoString(beginAndSetDistributedTransactionId, activeSetStmts->data);
 	}
 
-	if (!SendRemoteCommand(connection, beginAndSetDistributedTransactionId->data))
-	{
-		const bool raiseErrors = true;
-
-		HandleRemoteTransactionConnectionError(connection, raiseErrors);
-	}
-
-	transaction->beginSent = true;
+	return beginAndSetDistributedTransactionId;
 }
 
 
@@ -464,7 +597,9 @@ RemoteTransactionAbort(MultiConnection *connection)
 
 /*
  * StartRemoteTransactionPrepare initiates preparing the transaction in a
- * non-blocking manner.
+ * non-blocking manner. The caller is responsible for logging the prepared
+ * transaction in pg_dist_transaction through LogPreparedTransactionRecords
+ * before the local transaction commits.
  */
 void
 StartRemoteTransactionPrepare(struct MultiConnection *connection)
@@ -484,13 +619,6 @@ StartRemoteTransactionPrepare(struct MultiConnection *connection)
 
 	Assign2PCIdentifier(connection);
 
-	/* log transactions to workers in pg_dist_transaction */
-	WorkerNode *workerNode = FindWorkerNode(connection->hostname, connection->port);
-	if (workerNode != NULL)
-	{
-		LogTransactionRecord(workerNode->groupId, transaction->preparedName);
-	}
-
 	initStringInfo(&command);
 	appendStringInfo(&command, "PREPARE TRANSACTION %s",
 					 quote_literal_cstr(transaction->preparedName));
@@ -558,6 +686,7 @@ void
 RemoteTransactionPrepare(struct MultiConnection *connection)
 {
 	StartRemoteTransactionPrepare(connection);
+	LogPreparedTransactionRecords(list_make1(connection));
 	FinishRemoteTransactionPrepare(connection);
 }
 
@@ -645,6 +774,180 @@ RemoteTransactionsBeginIfNecessary(List *connectionList)
 
 		FinishRemoteTransactionBegin(connection);
 	}
+
+	/* savepoints that began since the connection was last used */
+	RemoteTransactionsSyncSavepoints(connectionList);
+}
+
+
+/*
+ * ExportRemoteTransactionSnapshots exports the snapshot of a remote transaction
+ * on each node of the given placements that does not have one yet, such that
+ * the transactions that other connections to the same node begin afterwards
+ * read from the same snapshot, see RemoteTransactionBeginCommand. A snapshot
+ * is exported by a connection that already participates in the transaction if
+ * there is one, since it already read from its snapshot, or a new connection
+ * otherwise. All snapshots are exported in parallel, such that they are taken
+ * at almost the same time on all nodes.
+ *
+ * Failures to export a snapshot only result in a warning, the connections to
+ * the node then read from their own snapshots.
+ */
+void
+ExportRemoteTransactionSnapshots(List *placementList)
+{
+	const bool raiseInterrupts = true;
+	const bool requireExportedSnapshot = false;
+	char *database = CurrentDatabaseName();
+	List *connectionList = NIL;
+	List *newConnectionList = NIL;
+	ListCell *placementCell = NULL;
+	ListCell *connectionCell = NULL;
+
+	if (!InCoordinatedTransaction())
+	{
+		return;
+	}
+
+	foreach(placementCell, placementList)
+	{
+		ShardPlacement *placement = (ShardPlacement *) lfirst(placementCell);
+		bool nodeListed = false;
+
+		foreach(connectionCell, connectionList)
+		{
+			MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+
+			if (strncmp(connection->hostname, placement->nodeName,
+						MAX_NODE_LENGTH) == 0 &&
+				connection->port == placement->nodePort)
+			{
+				nodeListed = true;
+				break;
+			}
+		}
+
+		if (nodeListed)
+		{
+			continue;
+		}
+
+		MultiConnection *connection =
+			SnapshotConnectionForNode(placement->nodeName, placement->nodePort,
+									  database, requireExportedSnapshot);
+		if (connection != NULL &&
+			connection->remoteTransaction.exportedSnapshot[0] != '\0')
+		{
+			/* the node already has a snapshot */
+			continue;
+		}
+
+		if (connection == NULL)
+		{
+			connection = StartNodeConnection(0, placement->nodeName,
+											 placement->nodePort);
+			newConnectionList = lappend(newConnectionList, connection);
+		}
+
+		connectionList = lappend(connectionList, connection);
+	}
+
+	if (connectionList == NIL)
+	{
+		return;
+	}
+
+	FinishConnectionListEstablishment(newConnectionList);
+	RemoteTransactionsBeginIfNecessary(connectionList);
+
+	foreach(connectionCell, connectionList)
+	{
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+
+		if (connection->remoteTransaction.transactionFailed)
+		{
+			continue;
+		}
+
+		if (!SendRemoteCommand(connection, "SELECT pg_export_snapshot()"))
+		{
+			const bool raiseErrors = false;
+
+			HandleRemoteTransactionConnectionError(connection, raiseErrors);
+		}
+	}
+
+	WaitForAllConnections(connectionList, raiseInterrupts);
+
+	foreach(connectionCell, connectionList)
+	{
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+		RemoteTransaction *transaction = &connection->remoteTransaction;
+		const bool raiseErrors = false;
+
+		if (transaction->transactionFailed)
+		{
+			continue;
+		}
+
+		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+		if (!IsResponseOK(result) || PQntuples(result) != 1)
+		{
+			HandleRemoteTransactionResultError(connection, result, raiseErrors);
+		}
+		else
+		{
+			strlcpy(transaction->exportedSnapshot, PQgetvalue(result, 0, 0),
+					NAMEDATALEN);
+		}
+
+		PQclear(result);
+		ForgetResults(connection);
+	}
+}
+
+
+/*
+ * SnapshotConnectionForNode returns a connection to the given node and
+ * database that participates in the current transaction and can export or
+ * already exported its snapshot, or NULL if there is none. When
+ * requireExportedSnapshot is true, only a connection that exported its
+ * snapshot is returned.
+ */
+static MultiConnection *
+SnapshotConnectionForNode(const char *nodeName, int nodePort, const char *database,
+						  bool requireExportedSnapshot)
+{
+	MultiConnection *snapshotConnection = NULL;
+	dlist_iter iter;
+
+	dlist_foreach(iter, &InProgressTransactions)
+	{
+		MultiConnection *connection = dlist_container(MultiConnection, transactionNode,
+													  iter.cur);
+		RemoteTransaction *transaction = &connection->remoteTransaction;
+
+		if (transaction->transactionFailed ||
+			transaction->transactionState != REMOTE_TRANS_STARTED ||
+			connection->port != nodePort ||
+			strncmp(connection->hostname, nodeName, MAX_NODE_LENGTH) != 0 ||
+			strncmp(connection->database, database, NAMEDATALEN) != 0)
+		{
+			continue;
+		}
+
+		if (transaction->exportedSnapshot[0] != '\0')
+		{
+			return connection;
+		}
+
+		if (snapshotConnection == NULL && !requireExportedSnapshot)
+		{
+			snapshotConnection = connection;
+		}
+	}
+
+	return snapshotConnection;
 }
 
 
@@ -814,8 +1117,16 @@ CoordinatedRemoteTransactionsPrepare(void)
 		connectionList = lappend(connectionList, connection);
 	}
 
+	/*
+	 * Log the prepared transactions while the workers are preparing them.
+	 * The records only become visible when the local transaction commits,
+	 * which is what tells recovery to commit the prepared transactions.
+	 */
+	LogPreparedTransactionRecords(connectionList);
+
 	bool raiseInterrupts = true;
-	WaitForAllConnections(connectionList, raiseInterrupts);
+	WaitForAllConnectionsExtended(connectionList, raiseInterrupts,
+								  WAIT_EVENT_CITUS_TWO_PHASE_PREPARE);
 
 	/* Wait for result */
 	dlist_foreach(iter, &InProgressTransactions)
@@ -873,6 +1184,24 @@ CoordinatedRemoteTransactionsCommit(void)
 		}
 
 		StartRemoteTransactionCommit(connection);
+
+		/*
+		 * The local transaction has already committed at this point, so the
+		 * prepared transaction will be committed by recovery if COMMIT
+		 * PREPARED does not succeed. When citus.async_commit_prepared is
+		 * enabled we therefore do not wait for the result, but consume it
+		 * when the connection is used next. That requires the command to be
+		 * sent entirely, otherwise we wait for the result as usual.
+		 */
+		if (AsyncCommitPrepared &&
+			transaction->transactionState == REMOTE_TRANS_2PC_COMMITTING &&
+			PQflush(connection->pgConn) == 0)
+		{
+			connection->commitPreparedPending = true;
+			transaction->transactionState = REMOTE_TRANS_COMMITTED;
+			continue;
+		}
+
 		connectionList = lappend(connectionList, connection);
 	}
 
@@ -900,6 +1229,39 @@ CoordinatedRemoteTransactionsCommit(void)
 }
 
 
+/*
+ * FinishPendingCommitPrepared consumes the result of a COMMIT PREPARED that
+ * was sent over the given connection without waiting for it, if any. It is
+ * called before a cached connection is used again. A failure only results in
+ * a warning, since recovery commits the prepared transaction later on.
+ */
+void
+FinishPendingCommitPrepared(MultiConnection *connection)
+{
+	const bool raiseInterrupts = false;
+
+	if (!connection->commitPreparedPending)
+	{
+		return;
+	}
+
+	connection->commitPreparedPending = false;
+
+	PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+	if (!IsResponseOK(result))
+	{
+		ReportResultError(connection, result, WARNING);
+		ereport(WARNING, (errmsg("failed to commit prepared transaction on %s:%d",
+								 connection->hostname, connection->port),
+						  errdetail("The transaction will be committed by "
+									"recover_prepared_transactions().")));
+	}
+
+	PQclear(result);
+	ForgetResults(connection);
+}
+
+
 /*
  * CoordinatedRemoteTransactionsAbort performs distributed transactions
  * handling at abort time.
@@ -965,6 +1327,12 @@ CoordinatedRemoteTransactionsSavepointBegin(SubTransactionId subId)
 	const bool raiseInterrupts = true;
 	List *connectionList = NIL;
 
+	if (PropagateSavepointsLazily)
+	{
+		/* the savepoint is sent along with the next command on each connection */
+		return;
+	}
+
 	/* asynchronously send SAVEPOINT */
 	dlist_foreach(iter, &InProgressTransactions)
 	{
@@ -998,6 +1366,7 @@ CoordinatedRemoteTransactionsSavepointBegin(SubTransactionId subId)
 		if (!transaction->transactionFailed)
 		{
 			transaction->lastSuccessfulSubXact = subId;
+			RecordEstablishedSubXact(transaction, subId);
 		}
 	}
 }
@@ -1011,9 +1380,19 @@ CoordinatedRemoteTransactionsSavepointBegin(SubTransactionId subId)
 void
 CoordinatedRemoteTransactionsSavepointRelease(SubTransactionId subId)
 {
-	dlist_iter iter;
 	const bool raiseInterrupts = true;
 	List *connectionList = NIL;
+	ListCell *connectionCell = NULL;
+	dlist_iter iter;
+
+	if (PropagateSavepointsLazily)
+	{
+		/*
+		 * Releasing the savepoint on the workers is not urgent, the next
+		 * command on each connection that established it releases it first.
+		 */
+		return;
+	}
 
 	/* asynchronously send RELEASE SAVEPOINT */
 	dlist_foreach(iter, &InProgressTransactions)
@@ -1021,7 +1400,8 @@ CoordinatedRemoteTransactionsSavepointRelease(SubTransactionId subId)
 		MultiConnection *connection = dlist_container(MultiConnection, transactionNode,
 													  iter.cur);
 		RemoteTransaction *transaction = &connection->remoteTransaction;
-		if (transaction->transactionFailed)
+		if (transaction->transactionFailed ||
+			!list_member_int(transaction->establishedSubXacts, subId))
 		{
 			continue;
 		}
@@ -1033,10 +1413,9 @@ CoordinatedRemoteTransactionsSavepointRelease(SubTransactionId subId)
 	WaitForAllConnections(connectionList, raiseInterrupts);
 
 	/* and wait for the results */
-	dlist_foreach(iter, &InProgressTransactions)
+	foreach(connectionCell, connectionList)
 	{
-		MultiConnection *connection = dlist_container(MultiConnection, transactionNode,
-													  iter.cur);
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
 		RemoteTransaction *transaction = &connection->remoteTransaction;
 		if (transaction->transactionFailed)
 		{
@@ -1044,6 +1423,8 @@ CoordinatedRemoteTransactionsSavepointRelease(SubTransactionId subId)
 		}
 
 		FinishRemoteTransactionSavepointRelease(connection, subId);
+
+		ForgetEstablishedSubXactsAbove(transaction, subId, false);
 	}
 }
 
@@ -1067,6 +1448,13 @@ CoordinatedRemoteTransactionsSavepointRollback(SubTransactionId subId)
 													  iter.cur);
 		RemoteTransaction *transaction = &connection->remoteTransaction;
 
+		/* with lazy savepoints, connections may not have used the savepoint */
+		if (PropagateSavepointsLazily &&
+			!list_member_int(transaction->establishedSubXacts, subId))
+		{
+			continue;
+		}
+
 		/* cancel any ongoing queries before issuing rollback */
 		SendCancelationRequest(connection);
 
@@ -1108,7 +1496,241 @@ CoordinatedRemoteTransactionsSavepointRollback(SubTransactionId subId)
 			continue;
 		}
 
+		if (PropagateSavepointsLazily &&
+			!list_member_int(transaction->establishedSubXacts, subId))
+		{
+			continue;
+		}
+
 		FinishRemoteTransactionSavepointRollback(connection, subId);
+
+		/* the savepoint itself remains after rolling back to it */
+		ForgetEstablishedSubXactsAbove(transaction, subId, true);
+	}
+}
+
+
+/*
+ * RemoteTransactionSavepointsPending returns whether savepoints were started,
+ * released or rolled back since the last command over the given connection,
+ * and citus.propagate_savepoints_lazily is enabled, such that the savepoints
+ * on the connection need to be brought in line with the active savepoints
+ * before the next command.
+ */
+bool
+RemoteTransactionSavepointsPending(struct MultiConnection *connection)
+{
+	RemoteTransaction *transaction = &connection->remoteTransaction;
+
+	if (!PropagateSavepointsLazily || transaction->transactionFailed ||
+		transaction->transactionState != REMOTE_TRANS_STARTED)
+	{
+		return false;
+	}
+
+	List *activeSubXacts = ActiveSubXacts();
+	bool savepointsPending = !equal(activeSubXacts, transaction->establishedSubXacts);
+
+	list_free(activeSubXacts);
+
+	return savepointsPending;
+}
+
+
+/*
+ * PrependRemoteTransactionSavepoints returns the given command prefixed with
+ * the savepoint commands that bring the savepoints on the connection in line
+ * with the active savepoints, such that the caller can send both in a single
+ * round trip. The number of results of the prefix is stored in
+ * savepointStatementCount, the caller needs to skip them before reading the
+ * results of the command.
+ */
+char *
+PrependRemoteTransactionSavepoints(struct MultiConnection *connection,
+								   const char *command, int *savepointStatementCount)
+{
+	StringInfo savepointsAndCommand =
+		RemoteTransactionSavepointSyncCommand(connection, savepointStatementCount);
+
+	appendStringInfoString(savepointsAndCommand, command);
+
+	return savepointsAndCommand->data;
+}
+
+
+/*
+ * StartRemoteTransactionSavepointSync sends the savepoint commands that bring
+ * the savepoints on the connection in line with the active savepoints in a
+ * non-blocking manner. The caller needs to clear the results.
+ */
+void
+StartRemoteTransactionSavepointSync(struct MultiConnection *connection)
+{
+	int statementCount = 0;
+
+	StringInfo savepointCommand = RemoteTransactionSavepointSyncCommand(connection,
+																		&statementCount);
+
+	if (!SendRemoteCommand(connection, savepointCommand->data))
+	{
+		const bool raiseErrors = true;
+
+		HandleRemoteTransactionConnectionError(connection, raiseErrors);
+	}
+}
+
+
+/*
+ * RemoteTransactionsSyncSavepoints brings the savepoints on the given
+ * connections in line with the active savepoints, for connections that are
+ * about to be used by a command, and waits for all of them to finish.
+ */
+void
+RemoteTransactionsSyncSavepoints(List *connectionList)
+{
+	const bool raiseInterrupts = true;
+	List *syncedConnectionList = NIL;
+	ListCell *connectionCell = NULL;
+
+	foreach(connectionCell, connectionList)
+	{
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+
+		if (RemoteTransactionSavepointsPending(connection))
+		{
+			StartRemoteTransactionSavepointSync(connection);
+			syncedConnectionList = lappend(syncedConnectionList, connection);
+		}
+	}
+
+	if (syncedConnectionList == NIL)
+	{
+		return;
+	}
+
+	WaitForAllConnections(syncedConnectionList, raiseInterrupts);
+
+	foreach(connectionCell, syncedConnectionList)
+	{
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+		RemoteTransaction *transaction = &connection->remoteTransaction;
+		const bool raiseErrors = true;
+
+		if (transaction->transactionFailed)
+		{
+			continue;
+		}
+
+		ClearResults(connection, raiseErrors);
+	}
+
+	list_free(syncedConnectionList);
+}
+
+
+/*
+ * RemoteTransactionSavepointSyncCommand returns the commands that bring the
+ * savepoints on the given connection in line with the active savepoints, and
+ * stores the number of commands in statementCount. Savepoints that were
+ * released or rolled back since the connection was last used are released on
+ * the connection, along with any savepoints nested in them, and active
+ * savepoints that it did not establish yet are started.
+ */
+static StringInfo
+RemoteTransactionSavepointSyncCommand(MultiConnection *connection, int *statementCount)
+{
+	RemoteTransaction *transaction = &connection->remoteTransaction;
+	StringInfo savepointCommand = makeStringInfo();
+	List *activeSubXacts = ActiveSubXacts();
+	ListCell *activeSubXactCell = list_head(activeSubXacts);
+	ListCell *establishedSubXactCell = list_head(transaction->establishedSubXacts);
+
+	*statementCount = 0;
+
+	/* skip the savepoints that are active and established */
+	while (activeSubXactCell != NULL && establishedSubXactCell != NULL &&
+		   lfirst_int(activeSubXactCell) == lfirst_int(establishedSubXactCell))
+	{
+		activeSubXactCell = lnext(activeSubXactCell);
+		establishedSubXactCell = lnext(establishedSubXactCell);
+	}
+
+	/* releasing the outermost stale savepoint also releases those nested in it */
+	if (establishedSubXactCell != NULL)
+	{
+		appendStringInfo(savepointCommand, "RELEASE SAVEPOINT savepoint_%u;",
+						 (SubTransactionId) lfirst_int(establishedSubXactCell));
+		(*statementCount)++;
+	}
+
+	for (; activeSubXactCell != NULL; activeSubXactCell = lnext(activeSubXactCell))
+	{
+		appendStringInfo(savepointCommand, "SAVEPOINT savepoint_%u;",
+						 (SubTransactionId) lfirst_int(activeSubXactCell));
+		(*statementCount)++;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(TopTransactionContext);
+	list_free(transaction->establishedSubXacts);
+	transaction->establishedSubXacts = list_copy(activeSubXacts);
+	MemoryContextSwitchTo(oldContext);
+
+	if (activeSubXacts != NIL)
+	{
+		transaction->lastQueuedSubXact = llast_int(activeSubXacts);
+		transaction->lastSuccessfulSubXact = transaction->lastQueuedSubXact;
+	}
+
+	list_free(activeSubXacts);
+
+	return savepointCommand;
+}
+
+
+/*
+ * RecordEstablishedSubXact records that the savepoint of the given
+ * sub-transaction was established over the connection of the given remote
+ * transaction.
+ */
+static void
+RecordEstablishedSubXact(RemoteTransaction *transaction, SubTransactionId subId)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(TopTransactionContext);
+
+	transaction->establishedSubXacts = lappend_int(transaction->establishedSubXacts,
+												   subId);
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * ForgetEstablishedSubXactsAbove forgets the savepoints of the given remote
+ * transaction that are nested in the savepoint of the given sub-transaction,
+ * as well as that savepoint itself unless keepSubXact is true.
+ */
+static void
+ForgetEstablishedSubXactsAbove(RemoteTransaction *transaction, SubTransactionId subId,
+							   bool keepSubXact)
+{
+	ListCell *subXactCell = NULL;
+	int subXactCount = 0;
+
+	foreach(subXactCell, transaction->establishedSubXacts)
+	{
+		if ((SubTransactionId) lfirst_int(subXactCell) == subId)
+		{
+			if (keepSubXact)
+			{
+				subXactCount++;
+			}
+
+			transaction->establishedSubXacts =
+				list_truncate(transaction->establishedSubXacts, subXactCount);
+			return;
+		}
+
+		subXactCount++;
 	}
 }
 
@@ -1281,6 +1903,42 @@ CheckRemoteTransactionsHealth(void)
 }
 
 
+/*
+ * LogPreparedTransactionRecords logs the transactions that are being prepared
+ * over the given connections in pg_dist_transaction, in a single batch.
+ * Connections to nodes that are not in the metadata are skipped.
+ */
+static void
+LogPreparedTransactionRecords(List *connectionList)
+{
+	List *groupIdList = NIL;
+	List *transactionNameList = NIL;
+	ListCell *connectionCell = NULL;
+
+	foreach(connectionCell, connectionList)
+	{
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+		RemoteTransaction *transaction = &connection->remoteTransaction;
+
+		if (transaction->transactionState != REMOTE_TRANS_PREPARING)
+		{
+			continue;
+		}
+
+		WorkerNode *workerNode = FindWorkerNode(connection->hostname, connection->port);
+		if (workerNode == NULL)
+		{
+			continue;
+		}
+
+		groupIdList = lappend_int(groupIdList, workerNode->groupId);
+		transactionNameList = lappend(transactionNameList, transaction->preparedName);
+	}
+
+	LogTransactionRecordList(groupIdList, transactionNameList);
+}
+
+
 /*
  * Assign2PCIdentifier computes the 2PC transaction name to use for a
  * transaction. Every prepared transaction should get a new name, i.e. this
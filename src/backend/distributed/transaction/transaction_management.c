@@ -19,11 +19,13 @@
 
 #include "access/twophase.h"
 #include "access/xact.h"
+#include "distributed/admission_control.h"
 #include "distributed/backend_data.h"
 #include "distributed/connection_management.h"
 #include "distributed/hash_helpers.h"
 #include "distributed/intermediate_results.h"
 #include "distributed/local_executor.h"
+#include "distributed/memory_usage.h"
 #include "distributed/multi_executor.h"
 #include "distributed/transaction_management.h"
 #include "distributed/placement_connection.h"
@@ -246,11 +248,14 @@ CoordinatedTransactionCallback(XactEvent event, void *arg)
 			CurrentCoordinatedTransactionState = COORD_TRANS_NONE;
 			XactModificationLevel = XACT_MODIFICATION_NONE;
 			LocalExecutionHappened = false;
+			ResetSubPlanResultCache();
 			dlist_init(&InProgressTransactions);
 			activeSetStmts = NULL;
 			CoordinatedTransactionUses2PC = false;
+			AdmissionControlAtXactEnd();
 
 			UnSetDistributedTransactionId();
+			ReportCitusMemoryUsage();
 
 			/* empty the CommitContext to ensure we're not leaking memory */
 			MemoryContextSwitchTo(previousContext);
@@ -300,10 +305,12 @@ CoordinatedTransactionCallback(XactEvent event, void *arg)
 			CurrentCoordinatedTransactionState = COORD_TRANS_NONE;
 			XactModificationLevel = XACT_MODIFICATION_NONE;
 			LocalExecutionHappened = false;
+			ResetSubPlanResultCache();
 			dlist_init(&InProgressTransactions);
 			activeSetStmts = NULL;
 			CoordinatedTransactionUses2PC = false;
 			FunctionCallLevel = 0;
+			AdmissionControlAtXactEnd();
 
 			/*
 			 * We should reset SubPlanLevel in case a transaction is aborted,
@@ -339,6 +346,7 @@ CoordinatedTransactionCallback(XactEvent event, void *arg)
 			 * ids on the worker nodes.
 			 */
 			RemoveIntermediateResultsDirectory();
+			ResetSubPlanResultCache();
 
 			UnSetDistributedTransactionId();
 			break;
@@ -476,6 +484,8 @@ CoordinatedSubTransactionCallback(SubXactEvent event, SubTransactionId subId,
 				CoordinatedRemoteTransactionsSavepointRelease(subId);
 			}
 			PopSubXact(subId);
+
+			AdmissionControlAtSubXactEnd(true, subId, parentSubid);
 			break;
 		}
 
@@ -487,6 +497,7 @@ CoordinatedSubTransactionCallback(SubXactEvent event, SubTransactionId subId,
 			}
 			PopSubXact(subId);
 
+			AdmissionControlAtSubXactEnd(false, subId, parentSubid);
 			UnsetCitusNoticeLevel();
 			break;
 		}
@@ -49,13 +49,54 @@
 PG_FUNCTION_INFO_V1(recover_prepared_transactions);
 
 
+/*
+ * RecoveryCommand is a COMMIT PREPARED or ROLLBACK PREPARED command that
+ * transaction recovery sends to a worker.
+ */
+typedef struct RecoveryCommand
+{
+	char *command;
+
+	/* recovery record to delete once the command succeeded, if any */
+	ItemPointer recordTid;
+} RecoveryCommand;
+
+
+/*
+ * WorkerRecoveryState keeps track of the recovery of the prepared
+ * transactions on a single worker.
+ */
+typedef struct WorkerRecoveryState
+{
+	WorkerNode *workerNode;
+	MultiConnection *connection;
+
+	/* prepared transactions observed before and after the snapshot */
+	HTAB *pendingTransactionSet;
+	HTAB *recheckTransactionSet;
+
+	/* scan of the recovery records of the worker's group */
+	SysScanDesc scanDescriptor;
+
+	/* commands to send to the worker, and the next one to send */
+	List *recoveryCommandList;
+	ListCell *nextCommandCell;
+
+	bool recoveryFailed;
+} WorkerRecoveryState;
+
+
 /* Local functions forward declarations */
-static int RecoverWorkerTransactions(WorkerNode *workerNode);
-static List * PendingWorkerTransactionList(MultiConnection *connection);
+static List * OpenWorkerRecoveryConnections(List *workerList);
+static void FetchPendingWorkerTransactions(List *workerStateList, bool recheck);
+static void PlanWorkerTransactionRecovery(WorkerRecoveryState *workerState,
+										  Relation pgDistTransaction,
+										  HTAB *activeTransactionNumberSet);
+static int ExecuteRecoveryCommands(List *workerStateList, Relation pgDistTransaction);
+static RecoveryCommand * MakeRecoveryCommand(char *transactionName, bool shouldCommit,
+											 ItemPointer recordTid);
 static bool IsTransactionInProgress(HTAB *activeTransactionNumberSet,
 									char *preparedTransactionName);
-static bool RecoverPreparedTransactionOnWorker(MultiConnection *connection,
-											   char *transactionName, bool shouldCommit);
 
 
 /*
@@ -81,23 +122,51 @@ recover_prepared_transactions(PG_FUNCTION_ARGS)
 void
 LogTransactionRecord(int32 groupId, char *transactionName)
 {
-	Datum values[Natts_pg_dist_transaction];
-	bool isNulls[Natts_pg_dist_transaction];
+	LogTransactionRecordList(list_make1_int(groupId), list_make1(transactionName));
+}
 
-	/* form new transaction tuple */
-	memset(values, 0, sizeof(values));
-	memset(isNulls, false, sizeof(isNulls));
 
-	values[Anum_pg_dist_transaction_groupid - 1] = Int32GetDatum(groupId);
-	values[Anum_pg_dist_transaction_gid - 1] = CStringGetTextDatum(transactionName);
+/*
+ * LogTransactionRecordList registers a list of transactions, given as a list
+ * of group ids and a list of transaction names of the same length, in
+ * pg_dist_transaction. The records are inserted with a single open of the
+ * relation and become durable along with the current transaction.
+ */
+void
+LogTransactionRecordList(List *groupIdList, List *transactionNameList)
+{
+	ListCell *groupIdCell = NULL;
+	ListCell *transactionNameCell = NULL;
 
-	/* open transaction relation and insert new tuple */
-	Relation pgDistTransaction = heap_open(DistTransactionRelationId(), RowExclusiveLock);
+	Assert(list_length(groupIdList) == list_length(transactionNameList));
 
+	if (groupIdList == NIL)
+	{
+		return;
+	}
+
+	/* open transaction relation and insert new tuples */
+	Relation pgDistTransaction = heap_open(DistTransactionRelationId(), RowExclusiveLock);
 	TupleDesc tupleDescriptor = RelationGetDescr(pgDistTransaction);
-	HeapTuple heapTuple = heap_form_tuple(tupleDescriptor, values, isNulls);
 
-	CatalogTupleInsert(pgDistTransaction, heapTuple);
+	forboth(groupIdCell, groupIdList, transactionNameCell, transactionNameList)
+	{
+		int32 groupId = lfirst_int(groupIdCell);
+		char *transactionName = (char *) lfirst(transactionNameCell);
+		Datum values[Natts_pg_dist_transaction];
+		bool isNulls[Natts_pg_dist_transaction];
+
+		/* form new transaction tuple */
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		values[Anum_pg_dist_transaction_groupid - 1] = Int32GetDatum(groupId);
+		values[Anum_pg_dist_transaction_gid - 1] = CStringGetTextDatum(transactionName);
+
+		HeapTuple heapTuple = heap_form_tuple(tupleDescriptor, values, isNulls);
+
+		CatalogTupleInsert(pgDistTransaction, heapTuple);
+	}
 
 	CommandCounterIncrement();
 
@@ -109,74 +178,46 @@ LogTransactionRecord(int32 groupId, char *transactionName)
 /*
  * RecoverTwoPhaseCommits recovers any pending prepared
  * transactions started by this node on other nodes.
+ *
+ * The workers are recovered in parallel. We first find out which prepared
+ * transactions need to be committed or aborted on each of the workers, and
+ * then send the COMMIT/ROLLBACK PREPARED commands to all workers at once,
+ * such that the time recovery takes is bounded by the slowest worker rather
+ * than the sum over all workers.
  */
 int
 RecoverTwoPhaseCommits(void)
 {
-	ListCell *workerNodeCell = NULL;
-	int recoveredTransactionCount = 0;
-
-	List *workerList = ActivePrimaryNodeList(NoLock);
-
-	foreach(workerNodeCell, workerList)
-	{
-		WorkerNode *workerNode = (WorkerNode *) lfirst(workerNodeCell);
-
-		recoveredTransactionCount += RecoverWorkerTransactions(workerNode);
-	}
-
-	return recoveredTransactionCount;
-}
-
-
-/*
- * RecoverWorkerTransactions recovers any pending prepared transactions
- * started by this node on the specified worker.
- */
-static int
-RecoverWorkerTransactions(WorkerNode *workerNode)
-{
-	int recoveredTransactionCount = 0;
-
-	int32 groupId = workerNode->groupId;
-	char *nodeName = workerNode->workerName;
-	int nodePort = workerNode->workerPort;
-
-
+	ListCell *workerStateCell = NULL;
 	ScanKeyData scanKey[1];
 	int scanKeyCount = 1;
 	bool indexOK = true;
-	HeapTuple heapTuple = NULL;
-
-	HASH_SEQ_STATUS status;
 
-	bool recoveryFailed = false;
-
-	int connectionFlags = 0;
-	MultiConnection *connection = GetNodeConnection(connectionFlags, nodeName, nodePort);
-	if (connection->pgConn == NULL || PQstatus(connection->pgConn) != CONNECTION_OK)
-	{
-		ereport(WARNING, (errmsg("transaction recovery cannot connect to %s:%d",
-								 nodeName, nodePort)));
-
-		return 0;
-	}
+	List *workerList = ActivePrimaryNodeList(NoLock);
 
 	MemoryContext localContext = AllocSetContextCreateExtended(CurrentMemoryContext,
-															   "RecoverWorkerTransactions",
+															   "RecoverTwoPhaseCommits",
 															   ALLOCSET_DEFAULT_MINSIZE,
 															   ALLOCSET_DEFAULT_INITSIZE,
 															   ALLOCSET_DEFAULT_MAXSIZE);
 
 	MemoryContext oldContext = MemoryContextSwitchTo(localContext);
 
+	List *workerStateList = OpenWorkerRecoveryConnections(workerList);
+	if (workerStateList == NIL)
+	{
+		MemoryContextSwitchTo(oldContext);
+		MemoryContextDelete(localContext);
+
+		return 0;
+	}
+
 	/* take table lock first to avoid running concurrently */
 	Relation pgDistTransaction = heap_open(DistTransactionRelationId(),
 										   ShareUpdateExclusiveLock);
-	TupleDesc tupleDescriptor = RelationGetDescr(pgDistTransaction);
 
 	/*
-	 * We're going to check the list of prepared transactions on the worker,
+	 * We're going to check the list of prepared transactions on the workers,
 	 * but some of those prepared transactions might belong to ongoing
 	 * distributed transactions.
 	 *
@@ -205,34 +246,207 @@ RecoverWorkerTransactions(WorkerNode *workerNode)
 	 * We therefore observe the set of prepared transactions one more time in
 	 * step 4. The aforementioned transactions would show up in Q, but not in
 	 * P. We can skip those transactions and recover them later.
+	 *
+	 * Each step is performed for all workers before moving on to the next
+	 * step, which preserves the order for every individual worker.
 	 */
 
-	/* find stale prepared transactions on the remote node */
-	List *pendingTransactionList = PendingWorkerTransactionList(connection);
-	HTAB *pendingTransactionSet = ListToHashSet(pendingTransactionList, NAMEDATALEN,
-												true);
+	/* find stale prepared transactions on the remote nodes */
+	bool recheck = false;
+	FetchPendingWorkerTransactions(workerStateList, recheck);
 
 	/* find in-progress distributed transactions */
 	List *activeTransactionNumberList = ActiveDistributedTransactionNumbers();
 	HTAB *activeTransactionNumberSet = ListToHashSet(activeTransactionNumberList,
 													 sizeof(uint64), false);
 
-	/* scan through all recovery records of the current worker */
-	ScanKeyInit(&scanKey[0], Anum_pg_dist_transaction_groupid,
-				BTEqualStrategyNumber, F_INT4EQ, Int32GetDatum(groupId));
+	/* get a snapshot of the recovery records of each worker */
+	foreach(workerStateCell, workerStateList)
+	{
+		WorkerRecoveryState *workerState = lfirst(workerStateCell);
+		int32 groupId = workerState->workerNode->groupId;
+
+		ScanKeyInit(&scanKey[0], Anum_pg_dist_transaction_groupid,
+					BTEqualStrategyNumber, F_INT4EQ, Int32GetDatum(groupId));
+
+		workerState->scanDescriptor = systable_beginscan(pgDistTransaction,
+														 DistTransactionGroupIndexId(),
+														 indexOK, NULL, scanKeyCount,
+														 scanKey);
+	}
+
+	/* find stale prepared transactions on the remote nodes once more */
+	recheck = true;
+	FetchPendingWorkerTransactions(workerStateList, recheck);
+
+	foreach(workerStateCell, workerStateList)
+	{
+		WorkerRecoveryState *workerState = lfirst(workerStateCell);
+
+		PlanWorkerTransactionRecovery(workerState, pgDistTransaction,
+									  activeTransactionNumberSet);
+
+		systable_endscan(workerState->scanDescriptor);
+		workerState->scanDescriptor = NULL;
+	}
+
+	int recoveredTransactionCount = ExecuteRecoveryCommands(workerStateList,
+															pgDistTransaction);
+
+	heap_close(pgDistTransaction, NoLock);
+
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextDelete(localContext);
+
+	return recoveredTransactionCount;
+}
+
+
+/*
+ * OpenWorkerRecoveryConnections establishes connections to all workers in
+ * parallel and returns a recovery state for each worker that we could connect
+ * to. We warn about the other workers and recover them on the next run.
+ */
+static List *
+OpenWorkerRecoveryConnections(List *workerList)
+{
+	List *connectionList = NIL;
+	List *workerStateList = NIL;
+	ListCell *workerNodeCell = NULL;
+	ListCell *connectionCell = NULL;
+
+	foreach(workerNodeCell, workerList)
+	{
+		WorkerNode *workerNode = (WorkerNode *) lfirst(workerNodeCell);
+		int connectionFlags = 0;
+
+		MultiConnection *connection = StartNodeConnection(connectionFlags,
+														  workerNode->workerName,
+														  workerNode->workerPort);
+
+		connectionList = lappend(connectionList, connection);
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	forboth(workerNodeCell, workerList, connectionCell, connectionList)
+	{
+		WorkerNode *workerNode = (WorkerNode *) lfirst(workerNodeCell);
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+
+		if (connection->pgConn == NULL ||
+			PQstatus(connection->pgConn) != CONNECTION_OK)
+		{
+			ereport(WARNING, (errmsg("transaction recovery cannot connect to %s:%d",
+									 workerNode->workerName, workerNode->workerPort)));
+
+			continue;
+		}
+
+		WorkerRecoveryState *workerState = palloc0(sizeof(WorkerRecoveryState));
+		workerState->workerNode = workerNode;
+		workerState->connection = connection;
+
+		workerStateList = lappend(workerStateList, workerState);
+	}
+
+	return workerStateList;
+}
+
+
+/*
+ * FetchPendingWorkerTransactions finds the pending prepared transactions that
+ * were started by this node on each of the workers, querying all workers in
+ * parallel. The transaction names are stored in the recheck set of the worker
+ * states if recheck is true, and in the pending set otherwise.
+ */
+static void
+FetchPendingWorkerTransactions(List *workerStateList, bool recheck)
+{
+	StringInfo command = makeStringInfo();
+	bool raiseInterrupts = true;
+	int coordinatorId = GetLocalGroupId();
+	List *connectionList = NIL;
+	ListCell *workerStateCell = NULL;
+
+	appendStringInfo(command, "SELECT gid FROM pg_prepared_xacts "
+							  "WHERE gid LIKE 'citus\\_%d\\_%%'",
+					 coordinatorId);
+
+	foreach(workerStateCell, workerStateList)
+	{
+		WorkerRecoveryState *workerState = lfirst(workerStateCell);
+		MultiConnection *connection = workerState->connection;
 
-	/* get a snapshot of pg_dist_transaction */
-	SysScanDesc scanDescriptor = systable_beginscan(pgDistTransaction,
-													DistTransactionGroupIndexId(),
-													indexOK,
-													NULL, scanKeyCount, scanKey);
+		int querySent = SendRemoteCommand(connection, command->data);
+		if (querySent == 0)
+		{
+			ReportConnectionError(connection, ERROR);
+		}
+
+		connectionList = lappend(connectionList, connection);
+	}
 
-	/* find stale prepared transactions on the remote node */
-	List *recheckTransactionList = PendingWorkerTransactionList(connection);
-	HTAB *recheckTransactionSet = ListToHashSet(recheckTransactionList, NAMEDATALEN,
-												true);
+	WaitForAllConnections(connectionList, raiseInterrupts);
 
-	while (HeapTupleIsValid(heapTuple = systable_getnext(scanDescriptor)))
+	foreach(workerStateCell, workerStateList)
+	{
+		WorkerRecoveryState *workerState = lfirst(workerStateCell);
+		MultiConnection *connection = workerState->connection;
+
+		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+		if (!IsResponseOK(result))
+		{
+			ReportResultError(connection, result, ERROR);
+		}
+
+		List *transactionNameList = ReadFirstColumnAsText(result);
+		List *transactionNames = NIL;
+		ListCell *transactionNameCell = NULL;
+
+		foreach(transactionNameCell, transactionNameList)
+		{
+			StringInfo transactionName = (StringInfo) lfirst(transactionNameCell);
+
+			transactionNames = lappend(transactionNames, transactionName->data);
+		}
+
+		PQclear(result);
+		ForgetResults(connection);
+
+		HTAB *transactionSet = ListToHashSet(transactionNames, NAMEDATALEN, true);
+		if (recheck)
+		{
+			workerState->recheckTransactionSet = transactionSet;
+		}
+		else
+		{
+			workerState->pendingTransactionSet = transactionSet;
+		}
+	}
+}
+
+
+/*
+ * PlanWorkerTransactionRecovery goes through the recovery records of a worker
+ * and decides which of its prepared transactions to commit or abort. Records
+ * for which no prepared transaction exists are deleted right away, the other
+ * records are deleted once the prepared transaction has been committed.
+ */
+static void
+PlanWorkerTransactionRecovery(WorkerRecoveryState *workerState,
+							  Relation pgDistTransaction,
+							  HTAB *activeTransactionNumberSet)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(pgDistTransaction);
+	HTAB *pendingTransactionSet = workerState->pendingTransactionSet;
+	HTAB *recheckTransactionSet = workerState->recheckTransactionSet;
+	HeapTuple heapTuple = NULL;
+	HASH_SEQ_STATUS status;
+	char *pendingTransactionName = NULL;
+
+	while (HeapTupleIsValid(heapTuple =
+								systable_getnext(workerState->scanDescriptor)))
 	{
 		bool isNull = false;
 		bool foundPreparedTransactionBeforeCommit = false;
@@ -269,33 +483,24 @@ RecoverWorkerTransactions(WorkerNode *workerNode)
 		{
 			/*
 			 * The transaction was committed, but the prepared transaction still exists
-			 * on the worker. Try committing it.
+			 * on the worker. Try committing it, and delete the recovery record
+			 * once that succeeded.
 			 *
 			 * We double check that the recovery record exists both before and after
 			 * checking ActiveDistributedTransactionNumbers(), since we may have
 			 * observed a prepared transaction that was committed immediately after.
 			 */
 			bool shouldCommit = true;
-			bool commitSucceeded = RecoverPreparedTransactionOnWorker(connection,
-																	  transactionName,
-																	  shouldCommit);
-			if (!commitSucceeded)
-			{
-				/*
-				 * Failed to commit on the current worker. Stop without throwing
-				 * an error to allow recover_prepared_transactions to continue with
-				 * other workers.
-				 */
-				recoveryFailed = true;
-				break;
-			}
+			ItemPointer recordTid = (ItemPointer) palloc(sizeof(ItemPointerData));
+			ItemPointerCopy(&heapTuple->t_self, recordTid);
 
-			recoveredTransactionCount++;
+			RecoveryCommand *recoveryCommand = MakeRecoveryCommand(transactionName,
+																   shouldCommit,
+																   recordTid);
+			workerState->recoveryCommandList =
+				lappend(workerState->recoveryCommandList, recoveryCommand);
 
-			/*
-			 * We successfully committed the prepared transaction, safe to delete
-			 * the recovery record.
-			 */
+			continue;
 		}
 		else if (foundPreparedTransactionAfterCommit)
 		{
@@ -343,94 +548,150 @@ RecoverWorkerTransactions(WorkerNode *workerNode)
 		simple_heap_delete(pgDistTransaction, &heapTuple->t_self);
 	}
 
-	systable_endscan(scanDescriptor);
-	heap_close(pgDistTransaction, NoLock);
+	/*
+	 * All remaining prepared transactions that are not part of an in-progress
+	 * distributed transaction should be aborted since we did not find a recovery
+	 * record, which implies the disributed transaction aborted.
+	 */
+	hash_seq_init(&status, pendingTransactionSet);
 
-	if (!recoveryFailed)
+	while ((pendingTransactionName = hash_seq_search(&status)) != NULL)
 	{
-		char *pendingTransactionName = NULL;
-		bool abortSucceeded = true;
+		bool isTransactionInProgress = IsTransactionInProgress(
+			activeTransactionNumberSet,
+			pendingTransactionName);
+		if (isTransactionInProgress)
+		{
+			continue;
+		}
+
+		bool shouldCommit = false;
+		RecoveryCommand *recoveryCommand = MakeRecoveryCommand(pendingTransactionName,
+															   shouldCommit, NULL);
+		workerState->recoveryCommandList =
+			lappend(workerState->recoveryCommandList, recoveryCommand);
+	}
+
+	workerState->nextCommandCell = list_head(workerState->recoveryCommandList);
+}
 
-		/*
-		 * All remaining prepared transactions that are not part of an in-progress
-		 * distributed transaction should be aborted since we did not find a recovery
-		 * record, which implies the disributed transaction aborted.
-		 */
-		hash_seq_init(&status, pendingTransactionSet);
 
-		while ((pendingTransactionName = hash_seq_search(&status)) != NULL)
+/*
+ * ExecuteRecoveryCommands sends the recovery commands to the workers. Every
+ * round sends the next command to each of the workers that have commands
+ * left and then waits for all of them, such that the workers recover in
+ * parallel. If a command fails on a worker, we stop recovering that worker
+ * without throwing an error to continue with the other workers. The function
+ * returns the number of recovered transactions.
+ */
+static int
+ExecuteRecoveryCommands(List *workerStateList, Relation pgDistTransaction)
+{
+	int recoveredTransactionCount = 0;
+	bool raiseInterrupts = true;
+
+	while (true)
+	{
+		List *connectionList = NIL;
+		List *activeStateList = NIL;
+		ListCell *workerStateCell = NULL;
+
+		foreach(workerStateCell, workerStateList)
 		{
-			bool isTransactionInProgress = IsTransactionInProgress(
-				activeTransactionNumberSet,
-				pendingTransactionName);
-			if (isTransactionInProgress)
+			WorkerRecoveryState *workerState = lfirst(workerStateCell);
+			MultiConnection *connection = workerState->connection;
+
+			if (workerState->recoveryFailed || workerState->nextCommandCell == NULL)
 			{
 				continue;
 			}
 
-			bool shouldCommit = false;
-			abortSucceeded = RecoverPreparedTransactionOnWorker(connection,
-																pendingTransactionName,
-																shouldCommit);
-			if (!abortSucceeded)
+			RecoveryCommand *recoveryCommand = lfirst(workerState->nextCommandCell);
+
+			int querySent = SendRemoteCommand(connection, recoveryCommand->command);
+			if (querySent == 0)
 			{
-				hash_seq_term(&status);
-				break;
+				ReportConnectionError(connection, WARNING);
+				workerState->recoveryFailed = true;
+				continue;
 			}
 
-			recoveredTransactionCount++;
+			connectionList = lappend(connectionList, connection);
+			activeStateList = lappend(activeStateList, workerState);
 		}
-	}
 
-	MemoryContextSwitchTo(oldContext);
-	MemoryContextDelete(localContext);
+		if (activeStateList == NIL)
+		{
+			break;
+		}
+
+		WaitForAllConnections(connectionList, raiseInterrupts);
+
+		foreach(workerStateCell, activeStateList)
+		{
+			WorkerRecoveryState *workerState = lfirst(workerStateCell);
+			MultiConnection *connection = workerState->connection;
+			RecoveryCommand *recoveryCommand = lfirst(workerState->nextCommandCell);
+
+			PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+			if (!IsResponseOK(result))
+			{
+				ReportResultError(connection, result, WARNING);
+				workerState->recoveryFailed = true;
+			}
+			else
+			{
+				ereport(LOG, (errmsg("recovered a prepared transaction on %s:%d",
+									 connection->hostname, connection->port),
+							  errcontext("%s", recoveryCommand->command)));
+
+				if (recoveryCommand->recordTid != NULL)
+				{
+					/* the prepared transaction committed, delete the record */
+					simple_heap_delete(pgDistTransaction, recoveryCommand->recordTid);
+				}
+
+				recoveredTransactionCount++;
+			}
+
+			PQclear(result);
+			ForgetResults(connection);
+
+			workerState->nextCommandCell = lnext(workerState->nextCommandCell);
+		}
+	}
 
 	return recoveredTransactionCount;
 }
 
 
 /*
- * PendingWorkerTransactionList returns a list of pending prepared
- * transactions on a remote node that were started by this node.
+ * MakeRecoveryCommand creates a command that commits the prepared transaction
+ * if shouldCommit is true, and aborts it otherwise.
  */
-static List *
-PendingWorkerTransactionList(MultiConnection *connection)
+static RecoveryCommand *
+MakeRecoveryCommand(char *transactionName, bool shouldCommit, ItemPointer recordTid)
 {
 	StringInfo command = makeStringInfo();
-	bool raiseInterrupts = true;
-	List *transactionNames = NIL;
-	int coordinatorId = GetLocalGroupId();
-
-	appendStringInfo(command, "SELECT gid FROM pg_prepared_xacts "
-							  "WHERE gid LIKE 'citus\\_%d\\_%%'",
-					 coordinatorId);
-
-	int querySent = SendRemoteCommand(connection, command->data);
-	if (querySent == 0)
-	{
-		ReportConnectionError(connection, ERROR);
-	}
 
-	PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
-	if (!IsResponseOK(result))
+	if (shouldCommit)
 	{
-		ReportResultError(connection, result, ERROR);
+		/* should have committed this prepared transaction */
+		appendStringInfo(command, "COMMIT PREPARED %s",
+						 quote_literal_cstr(transactionName));
 	}
-
-	int rowCount = PQntuples(result);
-
-	for (int rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	else
 	{
-		const int columnIndex = 0;
-		char *transactionName = PQgetvalue(result, rowIndex, columnIndex);
-
-		transactionNames = lappend(transactionNames, pstrdup(transactionName));
+		/* should have aborted this prepared transaction */
+		appendStringInfo(command, "ROLLBACK PREPARED %s",
+						 quote_literal_cstr(transactionName));
 	}
 
-	PQclear(result);
-	ForgetResults(connection);
+	RecoveryCommand *recoveryCommand = palloc0(sizeof(RecoveryCommand));
+	recoveryCommand->command = command->data;
+	recoveryCommand->recordTid = recordTid;
 
-	return transactionNames;
+	return recoveryCommand;
 }
 
 
@@ -461,49 +722,3 @@ IsTransactionInProgress(HTAB *activeTransactionNumberSet, char *preparedTransact
 
 	return isTransactionInProgress;
 }
-
-
-/*
- * RecoverPreparedTransactionOnWorker recovers a single prepared transaction over
- * the given connection. If shouldCommit is true we send
- */
-static bool
-RecoverPreparedTransactionOnWorker(MultiConnection *connection, char *transactionName,
-								   bool shouldCommit)
-{
-	StringInfo command = makeStringInfo();
-	PGresult *result = NULL;
-	bool raiseInterrupts = false;
-
-	if (shouldCommit)
-	{
-		/* should have committed this prepared transaction */
-		appendStringInfo(command, "COMMIT PREPARED %s",
-						 quote_literal_cstr(transactionName));
-	}
-	else
-	{
-		/* should have aborted this prepared transaction */
-		appendStringInfo(command, "ROLLBACK PREPARED %s",
-						 quote_literal_cstr(transactionName));
-	}
-
-	int executeCommand = ExecuteOptionalRemoteCommand(connection, command->data, &result);
-	if (executeCommand == QUERY_SEND_FAILED)
-	{
-		return false;
-	}
-	if (executeCommand == RESPONSE_NOT_OKAY)
-	{
-		return false;
-	}
-
-	PQclear(result);
-	ClearResults(connection, raiseInterrupts);
-
-	ereport(LOG, (errmsg("recovered a prepared transaction on %s:%d",
-						 connection->hostname, connection->port),
-				  errcontext("%s", command->data)));
-
-	return true;
-}
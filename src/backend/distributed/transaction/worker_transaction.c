@@ -310,7 +310,7 @@ SendCommandToWorkersParamsInternal(TargetWorkerSet targetWorkerSet, const char *
 		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
 
 		int querySent = SendRemoteCommandParams(connection, command, parameterCount,
-												parameterTypes, parameterValues);
+												parameterTypes, parameterValues, false);
 		if (querySent == 0)
 		{
 			ReportConnectionError(connection, ERROR);
@@ -384,6 +384,127 @@ SendCommandListToWorkerInSingleTransaction(const char *nodeName, int32 nodePort,
 }
 
 
+/*
+ * SendCommandListsToWorkerInParallel sends the given command lists to the
+ * given worker over at most connectionCount new connections in parallel. The
+ * command lists are spread over the connections, and each connection sends all
+ * of its commands as a single multi-statement query, such that the worker does
+ * not wait for a round trip between the commands. Similar to
+ * SendCommandListToWorkerInSingleTransaction, each connection runs its commands
+ * in a single transaction, which is committed independently of the coordinated
+ * transaction.
+ */
+void
+SendCommandListsToWorkerInParallel(const char *nodeName, int32 nodePort,
+								   const char *nodeUser, List *commandListList,
+								   int connectionCount)
+{
+	List *connectionList = NIL;
+	ListCell *connectionCell = NULL;
+	ListCell *commandListCell = NULL;
+	int connectionFlags = FORCE_NEW_CONNECTION;
+	int commandListIndex = 0;
+	int connectionIndex = 0;
+
+	connectionCount = Min(connectionCount, list_length(commandListList));
+	if (connectionCount <= 0)
+	{
+		return;
+	}
+
+	StringInfo *commandStringArray = palloc0(connectionCount * sizeof(StringInfo));
+	for (connectionIndex = 0; connectionIndex < connectionCount; connectionIndex++)
+	{
+		commandStringArray[connectionIndex] = makeStringInfo();
+	}
+
+	/* spread the command lists over the connections */
+	foreach(commandListCell, commandListList)
+	{
+		List *commandList = (List *) lfirst(commandListCell);
+		StringInfo commandString =
+			commandStringArray[commandListIndex % connectionCount];
+		ListCell *commandCell = NULL;
+
+		foreach(commandCell, commandList)
+		{
+			char *command = (char *) lfirst(commandCell);
+
+			appendStringInfo(commandString, "%s;", command);
+		}
+
+		commandListIndex++;
+	}
+
+	/* open connections in parallel */
+	for (connectionIndex = 0; connectionIndex < connectionCount; connectionIndex++)
+	{
+		MultiConnection *connection = StartNodeUserDatabaseConnection(connectionFlags,
+																	  nodeName, nodePort,
+																	  nodeUser, NULL);
+
+		MarkRemoteTransactionCritical(connection);
+
+		connectionList = lappend(connectionList, connection);
+	}
+
+	/* finish opening connections */
+	FinishConnectionListEstablishment(connectionList);
+
+	RemoteTransactionListBegin(connectionList);
+
+	/* send commands in parallel */
+	connectionIndex = 0;
+	foreach(connectionCell, connectionList)
+	{
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+		char *commandString = commandStringArray[connectionIndex]->data;
+
+		int querySent = SendRemoteCommand(connection, commandString);
+		if (querySent == 0)
+		{
+			ReportConnectionError(connection, ERROR);
+		}
+
+		connectionIndex++;
+	}
+
+	/* get results, there is one per command */
+	foreach(connectionCell, connectionList)
+	{
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+		bool raiseInterrupts = true;
+		PGresult *result = NULL;
+
+		while ((result = GetRemoteCommandResult(connection, raiseInterrupts)) != NULL)
+		{
+			if (!IsResponseOK(result))
+			{
+				ReportResultError(connection, result, ERROR);
+			}
+
+			PQclear(result);
+		}
+	}
+
+	/* commit in parallel */
+	foreach(connectionCell, connectionList)
+	{
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+
+		StartRemoteTransactionCommit(connection);
+	}
+
+	foreach(connectionCell, connectionList)
+	{
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+
+		FinishRemoteTransactionCommit(connection);
+		CloseConnection(connection);
+	}
+}
+
+
 /*
  * ErrorIfAnyMetadataNodeOutOfSync raises an error if any of the given
  * metadata nodes are out of sync. It is safer to avoid metadata changing
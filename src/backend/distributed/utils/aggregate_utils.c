@@ -8,6 +8,16 @@
  * calling finalfunc on workers, instead passing state to coordinator where
  * it uses combinefunc in coord_combine_agg & applying finalfunc only at end.
  *
+ * Transition state crosses the wire as text. Aggregates with an INTERNAL
+ * transition state are shipped in the binary form produced by their
+ * serialfunc, which is sent as bytea text and handed to deserialfunc on the
+ * coordinator, so neither side has to go through a type's output and input
+ * functions for them.
+ *
+ * Ordered array_agg and string_agg have no combinefunc. For those, workers
+ * send the values in the requested order along with an array of their sort
+ * keys, and coord_merge_sorted_agg merges the sorted arrays of all workers.
+ *
  * Copyright Citus Data, Inc.
  *
  *-------------------------------------------------------------------------
@@ -21,10 +31,14 @@
 #include "catalog/pg_proc.h"
 #include "catalog/pg_type.h"
 #include "distributed/version_compat.h"
+#include "lib/binaryheap.h"
+#include "parser/parse_coerce.h"
 #include "utils/acl.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/datum.h"
 #include "utils/lsyscache.h"
+#include "utils/sortsupport.h"
 #include "utils/syscache.h"
 #include "fmgr.h"
 #include "miscadmin.h"
@@ -34,6 +48,8 @@ PG_FUNCTION_INFO_V1(worker_partial_agg_sfunc);
 PG_FUNCTION_INFO_V1(worker_partial_agg_ffunc);
 PG_FUNCTION_INFO_V1(coord_combine_agg_sfunc);
 PG_FUNCTION_INFO_V1(coord_combine_agg_ffunc);
+PG_FUNCTION_INFO_V1(coord_merge_sorted_agg_sfunc);
+PG_FUNCTION_INFO_V1(coord_merge_sorted_agg_ffunc);
 
 /*
  * internal type for support aggregates to pass transition state alongside
@@ -50,6 +66,41 @@ typedef struct StypeBox
 	bool valueInit;
 } StypeBox;
 
+/*
+ * SortedArrayRun is a partial array of values that a worker sorted by their
+ * keys, along with the position of the next element to merge.
+ */
+typedef struct SortedArrayRun
+{
+	Datum *values;
+	bool *valueNulls;
+	Datum *keys;
+	bool *keyNulls;
+	int elementCount;
+	int position;
+} SortedArrayRun;
+
+/*
+ * internal type of coord_merge_sorted_agg that collects the sorted partial
+ * arrays of a group until they are merged by the finalfunc
+ */
+typedef struct SortedArrayMergeState
+{
+	Oid valueType;
+	int16 valueTypeLen;
+	bool valueTypeByVal;
+	char valueTypeAlign;
+	Oid keyType;
+	int16 keyTypeLen;
+	bool keyTypeByVal;
+	char keyTypeAlign;
+	SortSupportData sortSupport;
+	SortedArrayRun **runs;
+	int runCount;
+	int runCapacity;
+	int elementCount;
+} SortedArrayMergeState;
+
 static HeapTuple GetAggregateForm(Oid oid, Form_pg_aggregate *form);
 static HeapTuple GetProcForm(Oid oid, Form_pg_proc *form);
 static HeapTuple GetTypeForm(Oid oid, Form_pg_type *form);
@@ -60,6 +111,15 @@ static void InitializeStypeBox(FunctionCallInfo fcinfo, StypeBox *box, HeapTuple
 static void HandleTransition(StypeBox *box, FunctionCallInfo fcinfo,
 							 FunctionCallInfo innerFcinfo);
 static void HandleStrictUninit(StypeBox *box, FunctionCallInfo fcinfo, Datum value);
+static Datum SerializeTransitionState(StypeBox *box, Oid serialfunc,
+									  FunctionCallInfo fcinfo, bool *isNull);
+static Datum DeserializeTransitionState(Oid deserialfunc, Datum serializedState,
+										bool serializedStateNull,
+										FunctionCallInfo fcinfo, bool *isNull);
+static SortedArrayMergeState * CreateSortedArrayMergeState(FunctionCallInfo fcinfo);
+static void AddSortedArrayRun(SortedArrayMergeState *state, ArrayType *valueArray,
+							  ArrayType *keyArray);
+static int CompareSortedArrayRuns(Datum leftRunIndex, Datum rightRunIndex, void *arg);
 
 /*
  * GetAggregateForm loads corresponding tuple & Form_pg_aggregate for oid
@@ -268,6 +328,80 @@ HandleStrictUninit(StypeBox *box, FunctionCallInfo fcinfo, Datum value)
 }
 
 
+/*
+ * SerializeTransitionState calls the aggregate's serialfunc on the INTERNAL
+ * transition state in box and returns the resulting bytea in its text form,
+ * which is what worker_partial_agg_ffunc sends to the coordinator.
+ */
+static Datum
+SerializeTransitionState(StypeBox *box, Oid serialfunc, FunctionCallInfo fcinfo,
+						 bool *isNull)
+{
+	LOCAL_FCINFO(innerFcinfo, 1);
+	FmgrInfo info;
+
+	fmgr_info(serialfunc, &info);
+	if (info.fn_strict && box->valueNull)
+	{
+		*isNull = true;
+		return (Datum) 0;
+	}
+
+	InitFunctionCallInfoData(*innerFcinfo, &info, 1, fcinfo->fncollation,
+							 fcinfo->context, fcinfo->resultinfo);
+	fcSetArgExt(innerFcinfo, 0, box->value, box->valueNull);
+
+	Datum serializedState = FunctionCallInvoke(innerFcinfo);
+	if (innerFcinfo->isnull)
+	{
+		*isNull = true;
+		return (Datum) 0;
+	}
+
+	*isNull = false;
+	return DirectFunctionCall1(byteaout, serializedState);
+}
+
+
+/*
+ * DeserializeTransitionState turns the text form of a bytea built by
+ * SerializeTransitionState back into an INTERNAL transition state using the
+ * aggregate's deserialfunc. As in nodeAgg.c, the second argument of
+ * deserialfunc is a dummy that is only there to make the signature safe.
+ */
+static Datum
+DeserializeTransitionState(Oid deserialfunc, Datum serializedState,
+						   bool serializedStateNull, FunctionCallInfo fcinfo,
+						   bool *isNull)
+{
+	LOCAL_FCINFO(innerFcinfo, 2);
+	FmgrInfo info;
+
+	fmgr_info(deserialfunc, &info);
+	if (info.fn_strict && serializedStateNull)
+	{
+		*isNull = true;
+		return (Datum) 0;
+	}
+
+	Datum byteaState = (Datum) 0;
+	if (!serializedStateNull)
+	{
+		byteaState = DirectFunctionCall1(byteain, serializedState);
+	}
+
+	InitFunctionCallInfoData(*innerFcinfo, &info, 2, fcinfo->fncollation,
+							 fcinfo->context, fcinfo->resultinfo);
+	fcSetArgExt(innerFcinfo, 0, byteaState, serializedStateNull);
+	fcSetArgExt(innerFcinfo, 1, (Datum) 0, false);
+
+	Datum value = FunctionCallInvoke(innerFcinfo);
+	*isNull = innerFcinfo->isnull;
+
+	return value;
+}
+
+
 /*
  * worker_partial_agg_sfunc advances transition state,
  * essentially implementing the following pseudocode:
@@ -355,6 +489,8 @@ worker_partial_agg_sfunc(PG_FUNCTION_ARGS)
  * essentially implementing the following pseudocode:
  *
  * (box) -> text
+ * if box.agg.stype = internal:
+ *     return byteaout(box.agg.serialfunc(box.value))
  * return box.agg.stype.output(box.value)
  */
 Datum
@@ -380,7 +516,7 @@ worker_partial_agg_ffunc(PG_FUNCTION_ARGS)
 							"worker_partial_agg_ffunc expects an aggregate with COMBINEFUNC")));
 	}
 
-	if (aggform->aggtranstype == INTERNALOID)
+	if (aggform->aggtranstype == INTERNALOID && aggform->aggserialfn == InvalidOid)
 	{
 		ereport(ERROR,
 				(errmsg(
@@ -388,8 +524,21 @@ worker_partial_agg_ffunc(PG_FUNCTION_ARGS)
 	}
 
 	Oid transtype = aggform->aggtranstype;
+	Oid serialfunc = aggform->aggserialfn;
 	ReleaseSysCache(aggtuple);
 
+	if (transtype == INTERNALOID)
+	{
+		bool resultNull = false;
+		Datum result = SerializeTransitionState(box, serialfunc, fcinfo, &resultNull);
+
+		if (resultNull)
+		{
+			PG_RETURN_NULL();
+		}
+		PG_RETURN_DATUM(result);
+	}
+
 	getTypeOutputInfo(transtype, &typoutput, &typIsVarlena);
 
 	fmgr_info(typoutput, &info);
@@ -415,7 +564,10 @@ worker_partial_agg_ffunc(PG_FUNCTION_ARGS)
  *
  * (box, agg, text) -> box
  * box.agg = agg
- * box.value = agg.combine(box.value, agg.stype.input(text))
+ * if agg.stype = internal:
+ *     box.value = agg.combine(box.value, agg.deserialfunc(byteain(text)))
+ * else:
+ *     box.value = agg.combine(box.value, agg.stype.input(text))
  * return box
  */
 Datum
@@ -447,7 +599,7 @@ coord_combine_agg_sfunc(PG_FUNCTION_ARGS)
 							"coord_combine_agg_sfunc expects an aggregate with COMBINEFUNC")));
 	}
 
-	if (aggform->aggtranstype == INTERNALOID)
+	if (aggform->aggtranstype == INTERNALOID && aggform->aggdeserialfn == InvalidOid)
 	{
 		ereport(ERROR,
 				(errmsg(
@@ -455,6 +607,7 @@ coord_combine_agg_sfunc(PG_FUNCTION_ARGS)
 	}
 
 	Oid combine = aggform->aggcombinefn;
+	Oid deserialfunc = aggform->aggdeserialfn;
 
 	if (PG_ARGISNULL(0))
 	{
@@ -471,26 +624,34 @@ coord_combine_agg_sfunc(PG_FUNCTION_ARGS)
 	}
 
 	bool valueNull = PG_ARGISNULL(2);
-	HeapTuple transtypetuple = GetTypeForm(box->transtype, &transtypeform);
-	Oid ioparam = getTypeIOParam(transtypetuple);
-	Oid deserial = transtypeform->typinput;
-	ReleaseSysCache(transtypetuple);
-
-	fmgr_info(deserial, &info);
-	if (valueNull && info.fn_strict)
+	if (box->transtype == INTERNALOID)
 	{
-		value = (Datum) 0;
+		value = DeserializeTransitionState(deserialfunc, PG_GETARG_DATUM(2), valueNull,
+										   fcinfo, &valueNull);
 	}
 	else
 	{
-		InitFunctionCallInfoData(*innerFcinfo, &info, 3, fcinfo->fncollation,
-								 fcinfo->context, fcinfo->resultinfo);
-		fcSetArgExt(innerFcinfo, 0, PG_GETARG_DATUM(2), valueNull);
-		fcSetArg(innerFcinfo, 1, ObjectIdGetDatum(ioparam));
-		fcSetArg(innerFcinfo, 2, Int32GetDatum(-1)); /* typmod */
+		HeapTuple transtypetuple = GetTypeForm(box->transtype, &transtypeform);
+		Oid ioparam = getTypeIOParam(transtypetuple);
+		Oid deserial = transtypeform->typinput;
+		ReleaseSysCache(transtypetuple);
 
-		value = FunctionCallInvoke(innerFcinfo);
-		valueNull = innerFcinfo->isnull;
+		fmgr_info(deserial, &info);
+		if (valueNull && info.fn_strict)
+		{
+			value = (Datum) 0;
+		}
+		else
+		{
+			InitFunctionCallInfoData(*innerFcinfo, &info, 3, fcinfo->fncollation,
+									 fcinfo->context, fcinfo->resultinfo);
+			fcSetArgExt(innerFcinfo, 0, PG_GETARG_DATUM(2), valueNull);
+			fcSetArg(innerFcinfo, 1, ObjectIdGetDatum(ioparam));
+			fcSetArg(innerFcinfo, 2, Int32GetDatum(-1)); /* typmod */
+
+			value = FunctionCallInvoke(innerFcinfo);
+			valueNull = innerFcinfo->isnull;
+		}
 	}
 
 	fmgr_info(combine, &info);
@@ -595,3 +756,240 @@ coord_combine_agg_ffunc(PG_FUNCTION_ARGS)
 	fcinfo->isnull = innerFcinfo->isnull;
 	return result;
 }
+
+
+/*
+ * coord_merge_sorted_agg_sfunc adds the sorted partial array of values of a
+ * worker and the array of their sort keys to the state, essentially
+ * implementing the following pseudocode:
+ *
+ * (state, values, keys, sortop, nullsfirst) -> state
+ * state.runs += (values, keys)
+ * return state
+ */
+Datum
+coord_merge_sorted_agg_sfunc(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggregateContext;
+	SortedArrayMergeState *state = NULL;
+
+	if (!AggCheckCallContext(fcinfo, &aggregateContext))
+	{
+		elog(ERROR, "coord_merge_sorted_agg_sfunc called from non aggregate context");
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(aggregateContext);
+
+	if (PG_ARGISNULL(0))
+	{
+		state = CreateSortedArrayMergeState(fcinfo);
+	}
+	else
+	{
+		state = (SortedArrayMergeState *) PG_GETARG_POINTER(0);
+	}
+
+	/* workers send NULL for groups that have no rows on their shards */
+	if (!PG_ARGISNULL(1) && !PG_ARGISNULL(2))
+	{
+		ArrayType *valueArray = DatumGetArrayTypePCopy(PG_GETARG_DATUM(1));
+		ArrayType *keyArray = DatumGetArrayTypePCopy(PG_GETARG_DATUM(2));
+
+		AddSortedArrayRun(state, valueArray, keyArray);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	PG_RETURN_POINTER(state);
+}
+
+
+/*
+ * CreateSortedArrayMergeState creates the state of coord_merge_sorted_agg in
+ * the current memory context, which should be the aggregate context. Keys are
+ * compared with the sort operator and NULLS FIRST setting passed to the
+ * aggregate, using the collation of the aggregate.
+ */
+static SortedArrayMergeState *
+CreateSortedArrayMergeState(FunctionCallInfo fcinfo)
+{
+	Oid valueArrayType = get_fn_expr_argtype(fcinfo->flinfo, 1);
+	Oid keyArrayType = get_fn_expr_argtype(fcinfo->flinfo, 2);
+	Oid sortOperator = PG_GETARG_OID(3);
+	bool nullsFirst = PG_GETARG_BOOL(4);
+	Oid leftInputType = InvalidOid;
+	Oid rightInputType = InvalidOid;
+
+	SortedArrayMergeState *state = palloc0(sizeof(SortedArrayMergeState));
+	state->valueType = get_element_type(valueArrayType);
+	state->keyType = get_element_type(keyArrayType);
+
+	if (state->valueType == InvalidOid || state->keyType == InvalidOid)
+	{
+		ereport(ERROR, (errcode(ERRCODE_DATATYPE_MISMATCH),
+						errmsg("coord_merge_sorted_agg expects arrays of values "
+							   "and of sort keys")));
+	}
+
+	/* make sure the comparison function of the operator can handle the keys */
+	op_input_types(sortOperator, &leftInputType, &rightInputType);
+	if (!IsBinaryCoercible(state->keyType, leftInputType) ||
+		!IsBinaryCoercible(state->keyType, rightInputType))
+	{
+		ereport(ERROR, (errcode(ERRCODE_DATATYPE_MISMATCH),
+						errmsg("operator %u cannot sort keys of type %s",
+							   sortOperator, format_type_be(state->keyType))));
+	}
+
+	get_typlenbyvalalign(state->valueType, &state->valueTypeLen,
+						 &state->valueTypeByVal, &state->valueTypeAlign);
+	get_typlenbyvalalign(state->keyType, &state->keyTypeLen,
+						 &state->keyTypeByVal, &state->keyTypeAlign);
+
+	state->sortSupport.ssup_cxt = CurrentMemoryContext;
+	state->sortSupport.ssup_collation = PG_GET_COLLATION();
+	state->sortSupport.ssup_nulls_first = nullsFirst;
+	PrepareSortSupportFromOrderingOp(sortOperator, &state->sortSupport);
+
+	state->runCapacity = 8;
+	state->runs = palloc0(state->runCapacity * sizeof(SortedArrayRun *));
+
+	return state;
+}
+
+
+/*
+ * AddSortedArrayRun deconstructs the given arrays of values and keys into a
+ * new run of the state. The elements of the run point into the arrays, which
+ * should therefore live as long as the state.
+ */
+static void
+AddSortedArrayRun(SortedArrayMergeState *state, ArrayType *valueArray,
+				  ArrayType *keyArray)
+{
+	int keyCount = 0;
+
+	SortedArrayRun *run = palloc0(sizeof(SortedArrayRun));
+
+	deconstruct_array(valueArray, state->valueType, state->valueTypeLen,
+					  state->valueTypeByVal, state->valueTypeAlign,
+					  &run->values, &run->valueNulls, &run->elementCount);
+	deconstruct_array(keyArray, state->keyType, state->keyTypeLen,
+					  state->keyTypeByVal, state->keyTypeAlign,
+					  &run->keys, &run->keyNulls, &keyCount);
+
+	if (keyCount != run->elementCount)
+	{
+		ereport(ERROR, (errcode(ERRCODE_ARRAY_SUBSCRIPT_ERROR),
+						errmsg("partial array of %d values has %d sort keys",
+							   run->elementCount, keyCount)));
+	}
+
+	if (run->elementCount == 0)
+	{
+		return;
+	}
+
+	if (state->runCount == state->runCapacity)
+	{
+		state->runCapacity *= 2;
+		state->runs = repalloc(state->runs,
+							   state->runCapacity * sizeof(SortedArrayRun *));
+	}
+
+	state->runs[state->runCount++] = run;
+	state->elementCount += run->elementCount;
+}
+
+
+/*
+ * coord_merge_sorted_agg_ffunc merges the sorted partial arrays of values in
+ * the state by their keys, essentially implementing the following pseudocode:
+ *
+ * (state, ...) -> values
+ * return merge(state.runs) ordered by key using sortop, nullsfirst
+ *
+ * Each run is already sorted, so we merge them with a binary heap over the
+ * runs, like a MergeAppend does.
+ */
+Datum
+coord_merge_sorted_agg_ffunc(PG_FUNCTION_ARGS)
+{
+	SortedArrayMergeState *state =
+		(SortedArrayMergeState *) (PG_ARGISNULL(0) ? NULL : PG_GETARG_POINTER(0));
+
+	if (state == NULL || state->elementCount == 0)
+	{
+		PG_RETURN_NULL();
+	}
+
+	Datum *values = palloc(state->elementCount * sizeof(Datum));
+	bool *valueNulls = palloc(state->elementCount * sizeof(bool));
+	int elementIndex = 0;
+
+	binaryheap *runHeap = binaryheap_allocate(state->runCount, CompareSortedArrayRuns,
+											  state);
+
+	/* the finalfunc may be called more than once, so start from scratch */
+	for (int runIndex = 0; runIndex < state->runCount; runIndex++)
+	{
+		state->runs[runIndex]->position = 0;
+		binaryheap_add_unordered(runHeap, Int32GetDatum(runIndex));
+	}
+
+	binaryheap_build(runHeap);
+
+	while (!binaryheap_empty(runHeap))
+	{
+		int runIndex = DatumGetInt32(binaryheap_first(runHeap));
+		SortedArrayRun *run = state->runs[runIndex];
+
+		values[elementIndex] = run->values[run->position];
+		valueNulls[elementIndex] = run->valueNulls[run->position];
+		elementIndex++;
+
+		run->position++;
+		if (run->position < run->elementCount)
+		{
+			binaryheap_replace_first(runHeap, Int32GetDatum(runIndex));
+		}
+		else
+		{
+			binaryheap_remove_first(runHeap);
+		}
+	}
+
+	Assert(elementIndex == state->elementCount);
+
+	int dimensions[1] = { state->elementCount };
+	int lowerBounds[1] = { 1 };
+	ArrayType *mergedArray = construct_md_array(values, valueNulls, 1, dimensions,
+												lowerBounds, state->valueType,
+												state->valueTypeLen,
+												state->valueTypeByVal,
+												state->valueTypeAlign);
+
+	PG_RETURN_ARRAYTYPE_P(mergedArray);
+}
+
+
+/*
+ * CompareSortedArrayRuns compares the next keys of the two given runs of a
+ * SortedArrayMergeState. binaryheap keeps the largest element first, so we
+ * invert the result to merge the runs in the order of the sort operator.
+ */
+static int
+CompareSortedArrayRuns(Datum leftRunIndex, Datum rightRunIndex, void *arg)
+{
+	SortedArrayMergeState *state = (SortedArrayMergeState *) arg;
+	SortedArrayRun *leftRun = state->runs[DatumGetInt32(leftRunIndex)];
+	SortedArrayRun *rightRun = state->runs[DatumGetInt32(rightRunIndex)];
+
+	int compare = ApplySortComparator(leftRun->keys[leftRun->position],
+									  leftRun->keyNulls[leftRun->position],
+									  rightRun->keys[rightRun->position],
+									  rightRun->keyNulls[rightRun->position],
+									  &state->sortSupport);
+
+	return -compare;
+}
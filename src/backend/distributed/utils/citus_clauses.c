@@ -26,8 +26,23 @@
 #include "utils/lsyscache.h"
 
 
+/*
+ * MasterEvaluationContext is the context of PartiallyEvaluateExpressionMutator.
+ * When keepExternParams is set, only expressions that contain mutable functions
+ * are evaluated, and external parameters are otherwise left in place.
+ */
+typedef struct MasterEvaluationContext
+{
+	PlanState *planState;
+	bool keepExternParams;
+} MasterEvaluationContext;
+
+
 /* private function declarations */
+static Node * PartiallyEvaluateExpressionMutator(Node *expression,
+												 MasterEvaluationContext *context);
 static bool IsVarNode(Node *node);
+static bool RequiresMasterEvaluationNode(Node *node);
 static Expr * citus_evaluate_expr(Expr *expr, Oid result_type, int32 result_typmod,
 								  Oid result_collation, PlanState *planState);
 static bool CitusIsVolatileFunctionIdChecker(Oid func_id, void *context);
@@ -48,12 +63,124 @@ RequiresMasterEvaluation(Query *query)
 
 /*
  * ExecuteMasterEvaluableFunctions evaluates expressions that can be resolved
- * to a constant.
+ * to a constant. If keepExternParams is true, external parameters that are not
+ * part of an expression with a mutable function are kept, such that they can
+ * be sent to the workers along with the query.
  */
 void
-ExecuteMasterEvaluableFunctions(Query *query, PlanState *planState)
+ExecuteMasterEvaluableFunctions(Query *query, PlanState *planState,
+								bool keepExternParams)
+{
+	MasterEvaluationContext context;
+
+	context.planState = planState;
+	context.keepExternParams = keepExternParams;
+
+	PartiallyEvaluateExpressionMutator((Node *) query, &context);
+}
+
+
+/*
+ * MasterEvaluableTargetEntryResnos returns the resnos of the target entries
+ * that ExecuteMasterEvaluableFunctions would change in the given query, if the
+ * query is a single-row INSERT in which no other part would be changed, such
+ * that the executor can evaluate just those target entries instead of walking
+ * and copying the whole query on every execution. Otherwise, it returns NIL.
+ *
+ * Since ExecuteMasterEvaluableFunctions also replaces all parameters, target
+ * entries that contain parameters are included as well.
+ */
+List *
+MasterEvaluableTargetEntryResnos(Query *query)
+{
+	List *resnoList = NIL;
+	ListCell *targetEntryCell = NULL;
+
+	if (query->commandType != CMD_INSERT || query->onConflict != NULL ||
+		query->cteList != NIL || list_length(query->rtable) != 1 ||
+		query->jointree->fromlist != NIL || query->jointree->quals != NULL)
+	{
+		return NIL;
+	}
+
+	if (FindNodeCheck((Node *) query->returningList, RequiresMasterEvaluationNode))
+	{
+		return NIL;
+	}
+
+	foreach(targetEntryCell, query->targetList)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+
+		if (FindNodeCheck((Node *) targetEntry->expr, RequiresMasterEvaluationNode))
+		{
+			resnoList = lappend_int(resnoList, targetEntry->resno);
+		}
+	}
+
+	return resnoList;
+}
+
+
+/*
+ * MutableTargetEntryResnos returns the resnos in the given list, as returned by
+ * MasterEvaluableTargetEntryResnos, of the target entries that contain mutable
+ * functions. The other target entries in the list only need evaluation for
+ * their parameters.
+ */
+List *
+MutableTargetEntryResnos(Query *query, List *resnoList)
+{
+	List *mutableResnoList = NIL;
+	ListCell *targetEntryCell = NULL;
+
+	foreach(targetEntryCell, query->targetList)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+
+		if (list_member_int(resnoList, targetEntry->resno) &&
+			FindNodeCheck((Node *) targetEntry->expr, CitusIsMutableFunction))
+		{
+			mutableResnoList = lappend_int(mutableResnoList, targetEntry->resno);
+		}
+	}
+
+	return mutableResnoList;
+}
+
+
+/*
+ * ExecuteMasterEvaluableTargetEntries returns a copy of the given query in
+ * which the expressions of the target entries with the given resnos, as
+ * returned by MasterEvaluableTargetEntryResnos, are evaluated. The copy
+ * shares all other parts with the given query, which is not modified.
+ */
+Query *
+ExecuteMasterEvaluableTargetEntries(Query *query, List *resnoList,
+									PlanState *planState)
 {
-	PartiallyEvaluateExpression((Node *) query, planState);
+	ListCell *targetEntryCell = NULL;
+
+	Query *evaluatedQuery = palloc(sizeof(Query));
+	memcpy(evaluatedQuery, query, sizeof(Query));
+	evaluatedQuery->targetList = NIL;
+
+	foreach(targetEntryCell, query->targetList)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+
+		if (list_member_int(resnoList, targetEntry->resno))
+		{
+			targetEntry = flatCopyTargetEntry(targetEntry);
+			targetEntry->expr =
+				(Expr *) PartiallyEvaluateExpression((Node *) targetEntry->expr,
+													 planState);
+		}
+
+		evaluatedQuery->targetList = lappend(evaluatedQuery->targetList, targetEntry);
+	}
+
+	return evaluatedQuery;
 }
 
 
@@ -65,12 +192,35 @@ ExecuteMasterEvaluableFunctions(Query *query, PlanState *planState)
  */
 Node *
 PartiallyEvaluateExpression(Node *expression, PlanState *planState)
+{
+	MasterEvaluationContext context;
+
+	context.planState = planState;
+	context.keepExternParams = false;
+
+	return PartiallyEvaluateExpressionMutator(expression, &context);
+}
+
+
+/*
+ * PartiallyEvaluateExpressionMutator implements PartiallyEvaluateExpression
+ * and ExecuteMasterEvaluableFunctions.
+ */
+static Node *
+PartiallyEvaluateExpressionMutator(Node *expression, MasterEvaluationContext *context)
 {
 	if (expression == NULL || IsA(expression, Const))
 	{
 		return expression;
 	}
 
+	/* the workers can evaluate anything that does not involve mutable functions */
+	if (context->keepExternParams && !IsA(expression, Query) &&
+		!FindNodeCheck(expression, CitusIsMutableFunction))
+	{
+		return expression;
+	}
+
 	switch (nodeTag(expression))
 	{
 		case T_Param:
@@ -99,29 +249,29 @@ PartiallyEvaluateExpression(Node *expression, PlanState *planState)
 			if (FindNodeCheck(expression, IsVarNode))
 			{
 				return (Node *) expression_tree_mutator(expression,
-														PartiallyEvaluateExpression,
-														planState);
+														PartiallyEvaluateExpressionMutator,
+														context);
 			}
 
 			return (Node *) citus_evaluate_expr((Expr *) expression,
 												exprType(expression),
 												exprTypmod(expression),
 												exprCollation(expression),
-												planState);
+												context->planState);
 		}
 
 		case T_Query:
 		{
 			return (Node *) query_tree_mutator((Query *) expression,
-											   PartiallyEvaluateExpression,
-											   planState, QTW_DONT_COPY_QUERY);
+											   PartiallyEvaluateExpressionMutator,
+											   context, QTW_DONT_COPY_QUERY);
 		}
 
 		default:
 		{
 			return (Node *) expression_tree_mutator(expression,
-													PartiallyEvaluateExpression,
-													planState);
+													PartiallyEvaluateExpressionMutator,
+													context);
 		}
 	}
 
@@ -139,6 +289,18 @@ IsVarNode(Node *node)
 }
 
 
+/*
+ * RequiresMasterEvaluationNode returns whether ExecuteMasterEvaluableFunctions
+ * would replace the given node, because it is a mutable function or a
+ * parameter.
+ */
+static bool
+RequiresMasterEvaluationNode(Node *node)
+{
+	return CitusIsMutableFunction(node) || IsA(node, Param);
+}
+
+
 /*
  * a copy of pg's evaluate_expr, pre-evaluate a constant expression
  *
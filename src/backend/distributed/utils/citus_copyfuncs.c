@@ -83,6 +83,7 @@ copyJobInfo(Job *newnode, Job *from)
 	COPY_NODE_FIELD(dependentJobList);
 	COPY_SCALAR_FIELD(subqueryPushdown);
 	COPY_SCALAR_FIELD(requiresMasterEvaluation);
+	COPY_NODE_FIELD(masterEvaluationResnoList);
 	COPY_SCALAR_FIELD(deferredPruning);
 	COPY_NODE_FIELD(partitionKeyValue);
 }
@@ -109,8 +110,16 @@ CopyNodeDistributedPlan(COPYFUNC_ARGS)
 
 	COPY_NODE_FIELD(workerJob);
 	COPY_NODE_FIELD(masterQuery);
+	COPY_NODE_FIELD(taskResultMergeOrder);
+	COPY_SCALAR_FIELD(repartitionCountDistinct);
+	COPY_SCALAR_FIELD(topNCount);
+	COPY_SCALAR_FIELD(topNSortColumn);
+	COPY_NODE_FIELD(topNGroupColumnList);
+	COPY_SCALAR_FIELD(topNNullsFirst);
 	COPY_SCALAR_FIELD(queryId);
 	COPY_NODE_FIELD(relationIdList);
+	COPY_NODE_FIELD(prunedPartitionedRelationIdList);
+	COPY_NODE_FIELD(partitionIdList);
 
 	COPY_NODE_FIELD(insertSelectSubquery);
 	COPY_NODE_FIELD(insertTargetList);
@@ -131,6 +140,12 @@ CopyNodeDistributedSubPlan(COPYFUNC_ARGS)
 
 	COPY_SCALAR_FIELD(subPlanId);
 	COPY_NODE_FIELD(plan);
+	COPY_STRING_FIELD(queryKey);
+	COPY_SCALAR_FIELD(partitionRelationId);
+	COPY_SCALAR_FIELD(partitionColumnIndex);
+	COPY_SCALAR_FIELD(bytesSent);
+	COPY_SCALAR_FIELD(remoteWorkerCount);
+	COPY_SCALAR_FIELD(writeLocalFile);
 }
 
 
@@ -185,6 +200,8 @@ CopyNodeMapMergeJob(COPYFUNC_ARGS)
 
 	COPY_NODE_FIELD(mapTaskList);
 	COPY_NODE_FIELD(mergeTaskList);
+	COPY_SCALAR_FIELD(joinFilterJobId);
+	COPY_SCALAR_FIELD(joinFilterSource);
 }
 
 
@@ -249,6 +266,7 @@ CopyNodeTask(COPYFUNC_ARGS)
 	COPY_SCALAR_FIELD(jobId);
 	COPY_SCALAR_FIELD(taskId);
 	COPY_STRING_FIELD(queryString);
+	COPY_STRING_FIELD(queryTemplate);
 	COPY_SCALAR_FIELD(anchorShardId);
 	COPY_NODE_FIELD(taskPlacementList);
 	COPY_NODE_FIELD(dependentTaskList);
@@ -263,6 +281,10 @@ CopyNodeTask(COPYFUNC_ARGS)
 	COPY_NODE_FIELD(relationRowLockList);
 	COPY_NODE_FIELD(rowValuesLists);
 	COPY_SCALAR_FIELD(partiallyLocalOrRemote);
+	COPY_SCALAR_FIELD(joinFilterJobId);
+	COPY_STRING_FIELD(joinFilterMapQuery);
+	COPY_SCALAR_FIELD(joinFilterOffset);
+	COPY_STRING_FIELD(joinFilterBuildQuery);
 }
 
 
@@ -187,8 +187,16 @@ OutDistributedPlan(OUTFUNC_ARGS)
 
 	WRITE_NODE_FIELD(workerJob);
 	WRITE_NODE_FIELD(masterQuery);
+	WRITE_NODE_FIELD(taskResultMergeOrder);
+	WRITE_BOOL_FIELD(repartitionCountDistinct);
+	WRITE_UINT64_FIELD(topNCount);
+	WRITE_INT_FIELD(topNSortColumn);
+	WRITE_NODE_FIELD(topNGroupColumnList);
+	WRITE_BOOL_FIELD(topNNullsFirst);
 	WRITE_UINT64_FIELD(queryId);
 	WRITE_NODE_FIELD(relationIdList);
+	WRITE_NODE_FIELD(prunedPartitionedRelationIdList);
+	WRITE_NODE_FIELD(partitionIdList);
 
 	WRITE_NODE_FIELD(insertSelectSubquery);
 	WRITE_NODE_FIELD(insertTargetList);
@@ -211,6 +219,12 @@ OutDistributedSubPlan(OUTFUNC_ARGS)
 
 	WRITE_UINT_FIELD(subPlanId);
 	WRITE_NODE_FIELD(plan);
+	WRITE_STRING_FIELD(queryKey);
+	WRITE_OID_FIELD(partitionRelationId);
+	WRITE_INT_FIELD(partitionColumnIndex);
+	WRITE_UINT64_FIELD(bytesSent);
+	WRITE_UINT_FIELD(remoteWorkerCount);
+	WRITE_BOOL_FIELD(writeLocalFile);
 }
 
 
@@ -326,6 +340,7 @@ OutJobFields(StringInfo str, const Job *node)
 	WRITE_NODE_FIELD(dependentJobList);
 	WRITE_BOOL_FIELD(subqueryPushdown);
 	WRITE_BOOL_FIELD(requiresMasterEvaluation);
+	WRITE_NODE_FIELD(masterEvaluationResnoList);
 	WRITE_BOOL_FIELD(deferredPruning);
 	WRITE_NODE_FIELD(partitionKeyValue);
 }
@@ -395,6 +410,8 @@ OutMapMergeJob(OUTFUNC_ARGS)
 
 	WRITE_NODE_FIELD(mapTaskList);
 	WRITE_NODE_FIELD(mergeTaskList);
+	WRITE_UINT64_FIELD(joinFilterJobId);
+	WRITE_BOOL_FIELD(joinFilterSource);
 }
 
 
@@ -465,6 +482,7 @@ OutTask(OUTFUNC_ARGS)
 	WRITE_UINT64_FIELD(jobId);
 	WRITE_UINT_FIELD(taskId);
 	WRITE_STRING_FIELD(queryString);
+	WRITE_STRING_FIELD(queryTemplate);
 	WRITE_UINT64_FIELD(anchorShardId);
 	WRITE_NODE_FIELD(taskPlacementList);
 	WRITE_NODE_FIELD(dependentTaskList);
@@ -479,6 +497,10 @@ OutTask(OUTFUNC_ARGS)
 	WRITE_NODE_FIELD(relationRowLockList);
 	WRITE_NODE_FIELD(rowValuesLists);
 	WRITE_BOOL_FIELD(partiallyLocalOrRemote);
+	WRITE_UINT64_FIELD(joinFilterJobId);
+	WRITE_STRING_FIELD(joinFilterMapQuery);
+	WRITE_INT_FIELD(joinFilterOffset);
+	WRITE_STRING_FIELD(joinFilterBuildQuery);
 }
 
 
@@ -187,6 +187,7 @@ readJobInfo(Job *local_node)
 	READ_NODE_FIELD(dependentJobList);
 	READ_BOOL_FIELD(subqueryPushdown);
 	READ_BOOL_FIELD(requiresMasterEvaluation);
+	READ_NODE_FIELD(masterEvaluationResnoList);
 	READ_BOOL_FIELD(deferredPruning);
 	READ_NODE_FIELD(partitionKeyValue);
 }
@@ -215,8 +216,16 @@ ReadDistributedPlan(READFUNC_ARGS)
 
 	READ_NODE_FIELD(workerJob);
 	READ_NODE_FIELD(masterQuery);
+	READ_NODE_FIELD(taskResultMergeOrder);
+	READ_BOOL_FIELD(repartitionCountDistinct);
+	READ_UINT64_FIELD(topNCount);
+	READ_INT_FIELD(topNSortColumn);
+	READ_NODE_FIELD(topNGroupColumnList);
+	READ_BOOL_FIELD(topNNullsFirst);
 	READ_UINT64_FIELD(queryId);
 	READ_NODE_FIELD(relationIdList);
+	READ_NODE_FIELD(prunedPartitionedRelationIdList);
+	READ_NODE_FIELD(partitionIdList);
 
 	READ_NODE_FIELD(insertSelectSubquery);
 	READ_NODE_FIELD(insertTargetList);
@@ -239,6 +248,12 @@ ReadDistributedSubPlan(READFUNC_ARGS)
 
 	READ_UINT_FIELD(subPlanId);
 	READ_NODE_FIELD(plan);
+	READ_STRING_FIELD(queryKey);
+	READ_OID_FIELD(partitionRelationId);
+	READ_INT_FIELD(partitionColumnIndex);
+	READ_UINT64_FIELD(bytesSent);
+	READ_UINT_FIELD(remoteWorkerCount);
+	READ_BOOL_FIELD(writeLocalFile);
 
 	READ_DONE();
 }
@@ -304,6 +319,8 @@ ReadMapMergeJob(READFUNC_ARGS)
 
 	READ_NODE_FIELD(mapTaskList);
 	READ_NODE_FIELD(mergeTaskList);
+	READ_UINT64_FIELD(joinFilterJobId);
+	READ_BOOL_FIELD(joinFilterSource);
 
 	READ_DONE();
 }
@@ -379,6 +396,7 @@ ReadTask(READFUNC_ARGS)
 	READ_UINT64_FIELD(jobId);
 	READ_UINT_FIELD(taskId);
 	READ_STRING_FIELD(queryString);
+	READ_STRING_FIELD(queryTemplate);
 	READ_UINT64_FIELD(anchorShardId);
 	READ_NODE_FIELD(taskPlacementList);
 	READ_NODE_FIELD(dependentTaskList);
@@ -393,6 +411,10 @@ ReadTask(READFUNC_ARGS)
 	READ_NODE_FIELD(relationRowLockList);
 	READ_NODE_FIELD(rowValuesLists);
 	READ_BOOL_FIELD(partiallyLocalOrRemote);
+	READ_UINT64_FIELD(joinFilterJobId);
+	READ_STRING_FIELD(joinFilterMapQuery);
+	READ_INT_FIELD(joinFilterOffset);
+	READ_STRING_FIELD(joinFilterBuildQuery);
 
 	READ_DONE();
 }
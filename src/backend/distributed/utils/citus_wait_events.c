@@ -0,0 +1,104 @@
+/*-------------------------------------------------------------------------
+ *
+ * citus_wait_events.c
+ *
+ * Citus reports distinct wait events while it waits on remote nodes, such
+ * that the time a coordinator backend spends in distributed waits can be
+ * broken down by the kind of wait. Since extensions cannot register names
+ * for their wait events, pg_stat_activity shows them as "Extension" and
+ * citus_backend_wait_event() can be used to get the Citus names.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+
+#include "catalog/pg_authid.h"
+#include "distributed/citus_wait_events.h"
+#include "distributed/metadata_cache.h"
+#include "storage/proc.h"
+#include "storage/procarray.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+
+
+/* names of the Citus wait events, in the order of CitusWaitEvent */
+static const char *const CitusWaitEventNames[] = {
+	"CitusConnect",
+	"CitusRemoteResult",
+	"CitusCopyFlush",
+	"CitusTwoPhasePrepare",
+	"CitusConnectionSlot",
+	"CitusExecutionSlot"
+};
+
+
+PG_FUNCTION_INFO_V1(citus_backend_wait_event);
+
+
+/*
+ * citus_backend_wait_event returns the name of the wait event of the backend
+ * with the given pid, using the Citus names for Citus wait events. Like in
+ * pg_stat_activity, the wait event of other users' backends is only shown to
+ * members of pg_read_all_stats. NULL is returned if the backend does not
+ * exist, is not waiting or cannot be seen.
+ */
+Datum
+citus_backend_wait_event(PG_FUNCTION_ARGS)
+{
+	int32 processId = PG_GETARG_INT32(0);
+	Oid userId = GetUserId();
+
+	CheckCitusVersion(ERROR);
+
+	PGPROC *proc = BackendPidGetProc(processId);
+	if (proc == NULL)
+	{
+		PG_RETURN_NULL();
+	}
+
+	if (!has_privs_of_role(userId, proc->roleId) &&
+		!is_member_of_role(userId, DEFAULT_ROLE_READ_ALL_STATS))
+	{
+		PG_RETURN_NULL();
+	}
+
+	/* the backend updates its wait event without locking, read it only once */
+	uint32 waitEventInfo = *((volatile uint32 *) &proc->wait_event_info);
+
+	const char *waitEventName = CitusWaitEventName(waitEventInfo);
+	if (waitEventName == NULL)
+	{
+		waitEventName = pgstat_get_wait_event(waitEventInfo);
+	}
+
+	if (waitEventName == NULL)
+	{
+		PG_RETURN_NULL();
+	}
+
+	PG_RETURN_TEXT_P(cstring_to_text(waitEventName));
+}
+
+
+/*
+ * CitusWaitEventName returns the name of the given wait event if it is a
+ * Citus wait event, and NULL otherwise.
+ */
+const char *
+CitusWaitEventName(uint32 waitEventInfo)
+{
+	int citusWaitEventCount = lengthof(CitusWaitEventNames);
+
+	if (waitEventInfo < WAIT_EVENT_CITUS_CONNECT ||
+		waitEventInfo >= WAIT_EVENT_CITUS_CONNECT + citusWaitEventCount)
+	{
+		return NULL;
+	}
+
+	return CitusWaitEventNames[waitEventInfo - WAIT_EVENT_CITUS_CONNECT];
+}
@@ -0,0 +1,211 @@
+/*-------------------------------------------------------------------------
+ *
+ * deferred_cleanup.c
+ *
+ * Routines for removing job directories and intermediate result directories
+ * outside of the critical path of queries. Removing a directory with many
+ * files at the end of a transaction delays its commit, and removing many of
+ * them at once causes I/O latency spikes for concurrent queries.
+ *
+ * When citus.enable_deferred_cleanup is enabled, such directories are instead
+ * renamed into base/pgsql_job_cache_trash, which is a single cheap operation.
+ * The maintenance daemon then removes the contents of that directory in the
+ * background, at most citus.deferred_cleanup_files_per_second files per
+ * second. Since the queue of directories to remove lives in the file system,
+ * directories that were not removed yet are still removed after a restart.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include "distributed/deferred_cleanup.h"
+#include "distributed/worker_protocol.h"
+#include "storage/fd.h"
+#include "utils/timestamp.h"
+
+
+/* config variables managed via guc.c */
+bool EnableDeferredCleanup = false;
+int DeferredCleanupFilesPerSecond = 1000;
+
+/* number of directories that this process deferred, for unique names */
+static uint64 DeferredDirectoryCount = 0;
+
+
+/* local function forward declarations */
+static bool RemoveDirectoryContents(const char *directoryName, int maxFileCount,
+									int *removedFileCount);
+
+
+/*
+ * DeferredRemoveDirectory removes the given directory and its contents, like
+ * CitusRemoveDirectory. When citus.enable_deferred_cleanup is enabled, the
+ * directory is moved aside instead and its contents are removed later by the
+ * maintenance daemon. If the directory cannot be moved, for instance because
+ * the job cache directory is a symbolic link to another file system, it is
+ * removed right away.
+ */
+void
+DeferredRemoveDirectory(StringInfo directoryName)
+{
+	if (!EnableDeferredCleanup)
+	{
+		CitusRemoveDirectory(directoryName);
+		return;
+	}
+
+	StringInfo cleanupDirectoryName = makeStringInfo();
+	appendStringInfo(cleanupDirectoryName, "base/%s", DEFERRED_CLEANUP_DIR);
+
+	if (mkdir(cleanupDirectoryName->data, S_IRWXU) != 0 && errno != EEXIST)
+	{
+		CitusRemoveDirectory(directoryName);
+		return;
+	}
+
+	/* the timestamp keeps names unique when process IDs are reused */
+	StringInfo deferredDirectoryName = makeStringInfo();
+	appendStringInfo(deferredDirectoryName, "%s/%d_" INT64_FORMAT "_" UINT64_FORMAT,
+					 cleanupDirectoryName->data, MyProcPid,
+					 (int64) GetCurrentTimestamp(), DeferredDirectoryCount++);
+
+	if (rename(directoryName->data, deferredDirectoryName->data) != 0)
+	{
+		if (errno == ENOENT)
+		{
+			/* directory does not exist, nothing to remove */
+			return;
+		}
+
+		CitusRemoveDirectory(directoryName);
+	}
+}
+
+
+/*
+ * RemoveDeferredCleanupFiles removes at most the given number of files and
+ * directories that were moved aside by DeferredRemoveDirectory, and returns
+ * the number of files and directories it removed. Failures to remove a file
+ * are reported as warnings, such that the maintenance daemon keeps running.
+ */
+int
+RemoveDeferredCleanupFiles(int maxFileCount)
+{
+	int removedFileCount = 0;
+	struct stat fileStat;
+
+	StringInfo cleanupDirectoryName = makeStringInfo();
+	appendStringInfo(cleanupDirectoryName, "base/%s", DEFERRED_CLEANUP_DIR);
+
+	if (stat(cleanupDirectoryName->data, &fileStat) != 0)
+	{
+		if (errno != ENOENT)
+		{
+			ereport(WARNING, (errcode_for_file_access(),
+							  errmsg("could not stat directory \"%s\": %m",
+									 cleanupDirectoryName->data)));
+		}
+
+		return 0;
+	}
+
+	RemoveDirectoryContents(cleanupDirectoryName->data, maxFileCount,
+							&removedFileCount);
+
+	return removedFileCount;
+}
+
+
+/*
+ * RemoveDirectoryContents recursively removes the contents of the given
+ * directory until the number of removed files reaches the given maximum, and
+ * returns whether the directory is empty afterwards. Symbolic links are
+ * removed, not followed.
+ */
+static bool
+RemoveDirectoryContents(const char *directoryName, int maxFileCount,
+						int *removedFileCount)
+{
+	bool directoryEmpty = true;
+	struct dirent *directoryEntry = NULL;
+
+	DIR *directory = AllocateDir(directoryName);
+	if (directory == NULL)
+	{
+		ereport(WARNING, (errcode_for_file_access(),
+						  errmsg("could not open directory \"%s\": %m",
+								 directoryName)));
+		return false;
+	}
+
+	while ((directoryEntry = ReadDirExtended(directory, directoryName,
+											 WARNING)) != NULL)
+	{
+		const char *baseFilename = directoryEntry->d_name;
+		char filename[MAXPGPATH];
+		struct stat fileStat;
+		int removed = 0;
+
+		if (strcmp(baseFilename, ".") == 0 || strcmp(baseFilename, "..") == 0)
+		{
+			continue;
+		}
+
+		if (*removedFileCount >= maxFileCount)
+		{
+			directoryEmpty = false;
+			break;
+		}
+
+		snprintf(filename, MAXPGPATH, "%s/%s", directoryName, baseFilename);
+
+		if (lstat(filename, &fileStat) != 0)
+		{
+			if (errno != ENOENT)
+			{
+				ereport(WARNING, (errcode_for_file_access(),
+								  errmsg("could not stat file \"%s\": %m", filename)));
+				directoryEmpty = false;
+				break;
+			}
+
+			continue;
+		}
+
+		if (S_ISDIR(fileStat.st_mode))
+		{
+			if (!RemoveDirectoryContents(filename, maxFileCount, removedFileCount))
+			{
+				directoryEmpty = false;
+				break;
+			}
+
+			removed = rmdir(filename);
+		}
+		else
+		{
+			removed = unlink(filename);
+		}
+
+		if (removed != 0 && errno != ENOENT)
+		{
+			ereport(WARNING, (errcode_for_file_access(),
+							  errmsg("could not remove file \"%s\": %m", filename)));
+			directoryEmpty = false;
+			break;
+		}
+
+		(*removedFileCount)++;
+	}
+
+	FreeDir(directory);
+
+	return directoryEmpty;
+}
@@ -21,6 +21,7 @@
 
 #ifdef USE_OPENSSL
 #include "openssl/dsa.h"
+#include "openssl/ec.h"
 #include "openssl/err.h"
 #include "openssl/pem.h"
 #include "openssl/rsa.h"
@@ -50,8 +51,9 @@ static void GloballyReloadConfig(void);
 
 /* forward declaration of functions used when compiled with ssl */
 static bool ShouldUseAutoSSL(void);
-static bool CreateCertificatesWhenNeeded(void);
+static bool CreateCertificatesWhenNeeded(bool useEllipticCurveKey);
 static EVP_PKEY * GeneratePrivateKey(void);
+static EVP_PKEY * GenerateEllipticCurvePrivateKey(void);
 static X509 * CreateCertificate(EVP_PKEY *privateKey);
 static bool StoreCertificate(EVP_PKEY *privateKey, X509 *certificate);
 #endif /* USE_SSL */
@@ -82,7 +84,9 @@ citus_setup_ssl(PG_FUNCTION_ARGS)
 		Node *enableSSLParseTree = ParseTreeNode(ENABLE_SSL_QUERY);
 		AlterSystemSetConfigFile((AlterSystemStmt *) enableSSLParseTree);
 
-		if (strcmp(SSLCipherSuites, POSTGRES_DEFAULT_SSL_CIPHERS) == 0)
+		bool useCitusCipherSuites = strcmp(SSLCipherSuites,
+										   POSTGRES_DEFAULT_SSL_CIPHERS) == 0;
+		if (useCitusCipherSuites)
 		{
 			/*
 			 * postgres default cipher suite is configured, these allow TSL 1 and TLS 1.1,
@@ -97,9 +101,12 @@ citus_setup_ssl(PG_FUNCTION_ARGS)
 		 * enabled ssl mode here chances are the user didn't install credentials already.
 		 *
 		 * This function will check if they are available and if not it will generate a
-		 * self singed certificate.
+		 * self singed certificate. Signing with an elliptic curve key takes a fraction
+		 * of the CPU time of signing with an RSA key, which makes the TLS handshake of
+		 * every new connection cheaper for the node accepting it. We only use one when
+		 * we know that the cipher suites allow ECDSA certificates.
 		 */
-		CreateCertificatesWhenNeeded();
+		CreateCertificatesWhenNeeded(useCitusCipherSuites);
 
 		GloballyReloadConfig();
 	}
@@ -205,9 +212,11 @@ ShouldUseAutoSSL(void)
  * they will be created. The return value tells whether or not new certificates have been
  * created. After this function it is guaranteed that certificates are in place. It is not
  * guaranteed they have the right permissions as we will not touch the keys if they exist.
+ * When useEllipticCurveKey is true, the certificate is created for an elliptic curve key
+ * instead of an RSA key.
  */
 static bool
-CreateCertificatesWhenNeeded()
+CreateCertificatesWhenNeeded(bool useEllipticCurveKey)
 {
 	EVP_PKEY *privateKey = NULL;
 	X509 *certificate = NULL;
@@ -255,7 +264,15 @@ CreateCertificatesWhenNeeded()
 	}
 	ereport(LOG, (errmsg("no certificate present, generating self signed certificate")));
 
-	privateKey = GeneratePrivateKey();
+	if (useEllipticCurveKey)
+	{
+		privateKey = GenerateEllipticCurvePrivateKey();
+	}
+	else
+	{
+		privateKey = GeneratePrivateKey();
+	}
+
 	if (!privateKey)
 	{
 		ereport(ERROR, (errmsg("error while generating private key")));
@@ -321,6 +338,49 @@ GeneratePrivateKey()
 }
 
 
+/*
+ * GenerateEllipticCurvePrivateKey uses open ssl functions to generate a private key on
+ * the P-256 curve. All OpenSSL resources created during the process are added to the
+ * memory context active when the function is called and therefore should not be freed
+ * by the caller.
+ */
+static EVP_PKEY *
+GenerateEllipticCurvePrivateKey()
+{
+	/* Allocate memory for the EVP_PKEY structure. */
+	EVP_PKEY *privateKey = EVP_PKEY_new();
+	if (!privateKey)
+	{
+		ereport(ERROR, (errmsg("unable to allocate space for private key")));
+	}
+	EnsureReleaseResource((MemoryContextCallbackFunction) (&EVP_PKEY_free),
+						  privateKey);
+
+	EC_KEY *ecKey = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+	if (!ecKey)
+	{
+		ereport(ERROR, (errmsg("unable to prepare P-256 curve for EC algorithm")));
+	}
+
+	/* refer to the curve by name in the certificate, as clients expect */
+	EC_KEY_set_asn1_flag(ecKey, OPENSSL_EC_NAMED_CURVE);
+
+	int success = EC_KEY_generate_key(ecKey);
+	if (success != 1)
+	{
+		ereport(ERROR, (errmsg("unable to generate EC key")));
+	}
+
+	if (!EVP_PKEY_assign_EC_KEY(privateKey, ecKey))
+	{
+		ereport(ERROR, (errmsg("unable to assign EC key to use as private key")));
+	}
+
+	/* The key has been generated, return it. */
+	return privateKey;
+}
+
+
 /*
  * CreateCertificate creates a self signed certificate for citus to use. The certificate
  * will contain the public parts of the private key and will be signed in the end by the
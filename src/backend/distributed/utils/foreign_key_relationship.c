@@ -5,6 +5,11 @@
  *   between distributed tables. Created relationship graph will be hold by
  *   a static variable defined in this file until an invalidation comes in.
  *
+ *   When citus.enable_incremental_foreign_key_graph is set, relcache
+ *   invalidations of individual relations do not invalidate the graph but
+ *   only mark the relation, and the outgoing edges of the marked relations
+ *   are rebuilt from pg_constraint on the next access.
+ *
  * Copyright (c) Citus Data, Inc.
  *
  *-------------------------------------------------------------------------
@@ -20,6 +25,7 @@
 #if PG_VERSION_NUM >= 120000
 #include "access/table.h"
 #endif
+#include "catalog/indexing.h"
 #include "catalog/pg_constraint.h"
 #include "distributed/foreign_key_relationship.h"
 #include "distributed/hash_helpers.h"
@@ -41,6 +47,12 @@ typedef struct ForeignConstraintRelationshipGraph
 {
 	HTAB *nodeMap;
 	bool isValid;
+
+	/* context in which the graph and all of its nodes and lists are allocated */
+	MemoryContext graphContext;
+
+	/* set of relation ids whose edges should be rebuilt before the next access */
+	HTAB *invalidatedRelationSet;
 }ForeignConstraintRelationshipGraph;
 
 /*
@@ -71,9 +83,21 @@ typedef struct ForeignConstraintRelationshipEdge
 }ForeignConstraintRelationshipEdge;
 
 
+/*
+ * Once this many relations are waiting for their edges to be rebuilt, we
+ * rather rebuild the whole graph with a single scan over pg_constraint.
+ */
+#define MAX_INVALIDATED_FOREIGN_KEY_GRAPH_RELATIONS 1024
+
+
+/* config variable managed via guc.c */
+bool EnableIncrementalForeignKeyGraph = false;
+
 static ForeignConstraintRelationshipGraph *fConstraintRelationshipGraph = NULL;
 
 static void CreateForeignConstraintRelationshipGraph(void);
+static void UpdateInvalidatedRelationEdges(void);
+static void UpdateForeignConstraintRelationshipEdges(Oid relationId);
 static void PopulateAdjacencyLists(void);
 static int CompareForeignConstraintRelationshipEdges(const void *leftElement, const
 													 void *rightElement);
@@ -180,6 +204,7 @@ CreateForeignConstraintRelationshipGraph()
 	/* if we have already created the graph, use it */
 	if (IsForeignConstraintRelationshipGraphValid())
 	{
+		UpdateInvalidatedRelationEdges();
 		return;
 	}
 
@@ -198,6 +223,8 @@ CreateForeignConstraintRelationshipGraph()
 	fConstraintRelationshipGraph = (ForeignConstraintRelationshipGraph *) palloc(
 		sizeof(ForeignConstraintRelationshipGraph));
 	fConstraintRelationshipGraph->isValid = false;
+	fConstraintRelationshipGraph->graphContext = fConstraintRelationshipMemoryContext;
+	fConstraintRelationshipGraph->invalidatedRelationSet = NULL;
 
 	/* create (oid) -> [ForeignConstraintRelationshipNode] hash */
 	memset(&info, 0, sizeof(info));
@@ -246,6 +273,164 @@ SetForeignConstraintRelationshipGraphInvalid()
 }
 
 
+/*
+ * InvalidateForeignConstraintRelationshipGraphForRelation marks the edges of the
+ * given relation to be rebuilt before the graph is used the next time. It is
+ * called from the relcache invalidation callback, hence it should not access the
+ * catalogs. Any change to the foreign keys of a relation invalidates the relcache
+ * entries of both the referencing and the referenced relation, so rebuilding the
+ * outgoing edges of the invalidated relations keeps the graph up to date.
+ */
+void
+InvalidateForeignConstraintRelationshipGraphForRelation(Oid relationId)
+{
+	if (!IsForeignConstraintRelationshipGraphValid())
+	{
+		return;
+	}
+
+	if (fConstraintRelationshipGraph->invalidatedRelationSet == NULL)
+	{
+		HASHCTL info;
+
+		memset(&info, 0, sizeof(info));
+		info.keysize = sizeof(Oid);
+		info.entrysize = sizeof(Oid);
+		info.hash = oid_hash;
+		info.hcxt = fConstraintRelationshipGraph->graphContext;
+		uint32 hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+
+		fConstraintRelationshipGraph->invalidatedRelationSet = hash_create(
+			"invalidated foreign key relationship set (oid)",
+			32, &info, hashFlags);
+	}
+
+	HTAB *invalidatedRelationSet = fConstraintRelationshipGraph->invalidatedRelationSet;
+	if (hash_get_num_entries(invalidatedRelationSet) >=
+		MAX_INVALIDATED_FOREIGN_KEY_GRAPH_RELATIONS)
+	{
+		/* too many changes, rebuild the graph from scratch */
+		SetForeignConstraintRelationshipGraphInvalid();
+		return;
+	}
+
+	hash_search(invalidatedRelationSet, &relationId, HASH_ENTER, NULL);
+}
+
+
+/*
+ * UpdateInvalidatedRelationEdges rebuilds the outgoing edges of the relations
+ * that got invalidated since the last access to the graph. Reading pg_constraint
+ * might bring in new invalidations, hence we repeat until none are left.
+ */
+static void
+UpdateInvalidatedRelationEdges(void)
+{
+	while (IsForeignConstraintRelationshipGraphValid() &&
+		   fConstraintRelationshipGraph->invalidatedRelationSet != NULL)
+	{
+		HTAB *invalidatedRelationSet =
+			fConstraintRelationshipGraph->invalidatedRelationSet;
+		List *relationIdList = NIL;
+		HASH_SEQ_STATUS status;
+		Oid *relationId = NULL;
+
+		/* new invalidations are collected in a new set */
+		fConstraintRelationshipGraph->invalidatedRelationSet = NULL;
+
+		hash_seq_init(&status, invalidatedRelationSet);
+		while ((relationId = (Oid *) hash_seq_search(&status)) != NULL)
+		{
+			relationIdList = lappend_oid(relationIdList, *relationId);
+		}
+
+		hash_destroy(invalidatedRelationSet);
+
+		Oid invalidatedRelationId = InvalidOid;
+		foreach_oid(invalidatedRelationId, relationIdList)
+		{
+			UpdateForeignConstraintRelationshipEdges(invalidatedRelationId);
+		}
+	}
+
+	if (!IsForeignConstraintRelationshipGraphValid())
+	{
+		/* an invalidation during the update asked for a full rebuild */
+		CreateForeignConstraintRelationshipGraph();
+	}
+}
+
+
+/*
+ * UpdateForeignConstraintRelationshipEdges replaces the outgoing edges of the
+ * given relation in the graph with the foreign keys currently defined on it.
+ */
+static void
+UpdateForeignConstraintRelationshipEdges(Oid relationId)
+{
+	ScanKeyData scanKey[1];
+	int scanKeyCount = 1;
+	HeapTuple tuple = NULL;
+	List *referencedRelationIdList = NIL;
+	bool isFound = false;
+
+	ForeignConstraintRelationshipNode *relationNode =
+		(ForeignConstraintRelationshipNode *) hash_search(
+			fConstraintRelationshipGraph->nodeMap, &relationId,
+			HASH_FIND, &isFound);
+
+	if (isFound)
+	{
+		ForeignConstraintRelationshipNode *referencedNode = NULL;
+
+		foreach_ptr(referencedNode, relationNode->adjacencyList)
+		{
+			referencedNode->backAdjacencyList =
+				list_delete_ptr(referencedNode->backAdjacencyList, relationNode);
+		}
+
+		list_free(relationNode->adjacencyList);
+		relationNode->adjacencyList = NIL;
+	}
+
+	Relation pgConstraint = heap_open(ConstraintRelationId, AccessShareLock);
+
+	ScanKeyInit(&scanKey[0], Anum_pg_constraint_conrelid, BTEqualStrategyNumber,
+				F_OIDEQ, ObjectIdGetDatum(relationId));
+	SysScanDesc scanDescriptor = systable_beginscan(pgConstraint,
+													ConstraintRelidTypidNameIndexId,
+													true, NULL, scanKeyCount, scanKey);
+
+	while (HeapTupleIsValid(tuple = systable_getnext(scanDescriptor)))
+	{
+		Form_pg_constraint constraintForm = (Form_pg_constraint) GETSTRUCT(tuple);
+
+		if (constraintForm->contype != CONSTRAINT_FOREIGN)
+		{
+			continue;
+		}
+
+		/* multiple foreign keys between the same relations form a single edge */
+		referencedRelationIdList = list_append_unique_oid(referencedRelationIdList,
+														  constraintForm->confrelid);
+	}
+
+	systable_endscan(scanDescriptor);
+	heap_close(pgConstraint, AccessShareLock);
+
+	MemoryContext oldContext =
+		MemoryContextSwitchTo(fConstraintRelationshipGraph->graphContext);
+
+	Oid referencedRelationId = InvalidOid;
+	foreach_oid(referencedRelationId, referencedRelationIdList)
+	{
+		AddForeignConstraintRelationshipEdge(relationId, referencedRelationId);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
 /*
  * GetConnectedListHelper is the function for getting nodes connected (or connecting) to
  * the given relation. adjacentNodeList holds the result for recursive calls and
@@ -430,8 +615,7 @@ CreateOrFindNode(HTAB *adjacencyLists, Oid relid)
 /*
  * ClearForeignConstraintRelationshipGraphContext clear all the allocated memory obtained
  * for foreign constraint relationship graph. Since all the variables of relationship
- * graph was obtained within the same context, destroying hash map is enough as
- * it deletes the context.
+ * graph was obtained within the same context, deleting that context is enough.
  */
 void
 ClearForeignConstraintRelationshipGraphContext()
@@ -441,6 +625,6 @@ ClearForeignConstraintRelationshipGraphContext()
 		return;
 	}
 
-	hash_destroy(fConstraintRelationshipGraph->nodeMap);
+	MemoryContextDelete(fConstraintRelationshipGraph->graphContext);
 	fConstraintRelationshipGraph = NULL;
 }
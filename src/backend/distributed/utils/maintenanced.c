@@ -9,6 +9,11 @@
  * can then perform work like deadlock detection, prepared transaction
  * recovery, and cleanup.
  *
+ * The periodic maintenance tasks either run one after the other in the
+ * maintenance daemon, or each in its own background worker, such that a slow
+ * task does not delay the others. Other parts of Citus can also put one-off
+ * jobs on a queue, which the maintenance daemon runs in background workers.
+ *
  * Copyright (c) Citus Data, Inc.
  *
  *-------------------------------------------------------------------------
@@ -28,8 +33,10 @@
 #include "catalog/pg_namespace.h"
 #include "commands/async.h"
 #include "commands/extension.h"
+#include "fmgr.h"
 #include "libpq/pqsignal.h"
 #include "catalog/namespace.h"
+#include "distributed/deferred_cleanup.h"
 #include "distributed/distributed_deadlock_detection.h"
 #include "distributed/maintenanced.h"
 #include "distributed/master_protocol.h"
@@ -64,9 +71,53 @@ typedef struct MaintenanceDaemonControlData
 	int trancheId;
 	char *lockTrancheName;
 	LWLock lock;
+
+	/*
+	 * Deferred cleanup files are shared by all databases, so only one process
+	 * at a time removes them, until its lease ends. Protected by lock.
+	 */
+	pid_t deferredCleanupPid;
+	TimestampTz deferredCleanupLeaseEnd;
 } MaintenanceDaemonControlData;
 
 
+/* maximum number of jobs on the job queue of a database */
+#define MAX_QUEUED_MAINTENANCE_JOBS 16
+
+/* milliseconds after which the daemon checks again whether a task got enabled */
+#define DISABLED_TASK_CHECK_INTERVAL 10000.0
+
+/*
+ * Deferred cleanup removes files in batches every 100 milliseconds, to spread
+ * the I/O, and checks for new files every 10 seconds when there are none.
+ */
+#define DEFERRED_CLEANUP_BATCHES_PER_SECOND 10
+#define DEFERRED_CLEANUP_IDLE_INTERVAL 10000.0
+#define DEFERRED_CLEANUP_LEASE_TIME (3 * 10000)
+
+
+/* periodic maintenance tasks */
+typedef enum MaintenanceTaskId
+{
+	INVALID_MAINTENANCE_TASK_ID = -1,
+	MAINTENANCE_TASK_STATISTICS_COLLECTION,
+	MAINTENANCE_TASK_METADATA_SYNC,
+	MAINTENANCE_TASK_TRANSACTION_RECOVERY,
+	MAINTENANCE_TASK_DEADLOCK_DETECTION,
+	MAINTENANCE_TASK_DEFERRED_CLEANUP,
+
+	MAINTENANCE_TASK_COUNT
+} MaintenanceTaskId;
+
+
+/* a job on the maintenance job queue, see ScheduleMaintenanceJob() */
+typedef struct MaintenanceJob
+{
+	char functionName[NAMEDATALEN];
+	Datum argument;
+} MaintenanceJob;
+
+
 /*
  * Per database worker state.
  */
@@ -81,8 +132,62 @@ typedef struct MaintenanceDaemonDBData
 	pid_t workerPid;
 	bool triggerMetadataSync;
 	Latch *latch; /* pointer to the background worker's latch */
+
+	/* background workers running periodic tasks, 0 if the daemon runs them */
+	pid_t taskWorkerPid[MAINTENANCE_TASK_COUNT];
+	Latch *taskWorkerLatch[MAINTENANCE_TASK_COUNT];
+
+	/* background worker running a queued job, 0 if none */
+	pid_t jobWorkerPid;
+
+	/* circular queue of jobs that wait to be run */
+	int jobQueueHead;
+	int jobQueueLength;
+	MaintenanceJob jobQueue[MAX_QUEUED_MAINTENANCE_JOBS];
 } MaintenanceDaemonDBData;
 
+
+/*
+ * MaintenanceTask describes a periodic maintenance task. The run function
+ * performs the task once and returns the number of milliseconds until it
+ * should run again.
+ */
+typedef struct MaintenanceTask
+{
+	/* name of the task, used in the name of its background worker */
+	const char *name;
+
+	/* milliseconds to wait after the daemon starts before the first run */
+	int initialDelay;
+
+	/* whether the task writes, and should thus only run on primary nodes */
+	bool primaryOnly;
+
+	bool (*isEnabled)(void);
+
+	/* optional, returns whether the task should run before it is due */
+	bool (*isTriggered)(MaintenanceDaemonDBData *dbData);
+
+	double (*run)(void);
+} MaintenanceTask;
+
+
+/* arguments of a task or job worker, passed in bgw_extra */
+typedef struct MaintenanceWorkerArgs
+{
+	Oid userOid;
+
+	/* process ID of the maintenance daemon that started the worker */
+	pid_t daemonPid;
+
+	/* task to run, or INVALID_MAINTENANCE_TASK_ID for a job worker */
+	int taskId;
+
+	/* function and argument of the job to run */
+	char functionName[NAMEDATALEN];
+	Datum argument;
+} MaintenanceWorkerArgs;
+
 /* config variable for distributed deadlock detection timeout */
 double DistributedDeadlockDetectionTimeoutFactor = 2.0;
 int Recover2PCInterval = 60000;
@@ -91,6 +196,9 @@ int Recover2PCInterval = 60000;
 int MetadataSyncInterval = 60000;
 int MetadataSyncRetryInterval = 5000;
 
+/* config variable managed via guc.c */
+bool EnableParallelMaintenanceTasks = false;
+
 static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
 static MaintenanceDaemonControlData *MaintenanceDaemonControl = NULL;
 
@@ -102,12 +210,72 @@ static HTAB *MaintenanceDaemonDBHash;
 
 static volatile sig_atomic_t got_SIGHUP = false;
 
+/* whether statistics collection failed once and is retried */
+static bool RetryStatsCollection USED_WITH_LIBCURL_ONLY = false;
+
+/* task of the current task worker, INVALID_MAINTENANCE_TASK_ID in a job worker */
+static int AttachedWorkerTaskId = INVALID_MAINTENANCE_TASK_ID;
+
 static void MaintenanceDaemonSigHupHandler(SIGNAL_ARGS);
 static size_t MaintenanceDaemonShmemSize(void);
 static void MaintenanceDaemonShmemInit(void);
 static void MaintenanceDaemonErrorContext(void *arg);
 static bool LockCitusExtension(void);
 static bool MetadataSyncTriggeredCheckAndReset(MaintenanceDaemonDBData *dbData);
+static MaintenanceDaemonDBData * AttachMaintenanceWorker(Oid databaseOid,
+														 MaintenanceWorkerArgs *
+														 workerArgs);
+static void DetachMaintenanceWorker(int code, Datum arg);
+static double RunMaintenanceTaskIfDue(MaintenanceTaskId taskId,
+									  MaintenanceDaemonDBData *dbData,
+									  TimestampTz *nextRunTime);
+static bool EnsureMaintenanceTaskWorker(MaintenanceTaskId taskId,
+										MaintenanceDaemonDBData *dbData,
+										BackgroundWorkerHandle **handle);
+static bool MaintenanceTaskWorkerRunning(MaintenanceTaskId taskId,
+										 MaintenanceDaemonDBData *dbData);
+static void StartQueuedMaintenanceJob(MaintenanceDaemonDBData *dbData,
+									  BackgroundWorkerHandle **handle);
+static void InitializeMaintenanceWorker(BackgroundWorker *worker,
+										MaintenanceWorkerArgs *workerArgs,
+										const char *functionName);
+static bool StatisticsCollectionEnabled(void);
+static double RunStatisticsCollection(void);
+static bool MetadataSyncEnabled(void);
+static bool MetadataSyncTriggered(MaintenanceDaemonDBData *dbData);
+static double RunMetadataSync(void);
+static bool TransactionRecoveryEnabled(void);
+static double RunTransactionRecovery(void);
+static bool DeadlockDetectionEnabled(void);
+static double RunDeadlockDetection(void);
+static bool DeferredCleanupEnabled(void);
+static double RunDeferredCleanup(void);
+static bool AcquireDeferredCleanupLease(void);
+
+
+/* the periodic maintenance tasks, in the order of MaintenanceTaskId */
+static const MaintenanceTask MaintenanceTasks[MAINTENANCE_TASK_COUNT] = {
+	{
+		"statistics collection", 60 * 1000, false,
+		StatisticsCollectionEnabled, NULL, RunStatisticsCollection
+	},
+	{
+		"metadata sync", 0, true,
+		MetadataSyncEnabled, MetadataSyncTriggered, RunMetadataSync
+	},
+	{
+		"2PC recovery", 0, true,
+		TransactionRecoveryEnabled, NULL, RunTransactionRecovery
+	},
+	{
+		"deadlock detection", 0, false,
+		DeadlockDetectionEnabled, NULL, RunDeadlockDetection
+	},
+	{
+		"deferred cleanup", 0, false,
+		DeferredCleanupEnabled, NULL, RunDeferredCleanup
+	}
+};
 
 
 /*
@@ -154,6 +322,15 @@ InitializeMaintenanceDaemonBackend(void)
 		ereport(ERROR, (errmsg("ran out of database slots")));
 	}
 
+	if (!found)
+	{
+		memset(dbData->taskWorkerPid, 0, sizeof(dbData->taskWorkerPid));
+		memset(dbData->taskWorkerLatch, 0, sizeof(dbData->taskWorkerLatch));
+		dbData->jobWorkerPid = 0;
+		dbData->jobQueueHead = 0;
+		dbData->jobQueueLength = 0;
+	}
+
 	if (!found || !dbData->daemonStarted)
 	{
 		BackgroundWorker worker;
@@ -225,22 +402,33 @@ InitializeMaintenanceDaemonBackend(void)
  * CitusMaintenanceDaemonMain is the maintenance daemon's main routine, it'll
  * be started by the background worker infrastructure.  If it errors out,
  * it'll be restarted after a few seconds.
+ *
+ * The daemon runs the periodic maintenance tasks itself, or, when
+ * citus.enable_parallel_maintenance_tasks is enabled, starts a background
+ * worker for each of them and restarts the workers when they exit. It also
+ * starts the jobs on the maintenance job queue, one at a time.
  */
 void
 CitusMaintenanceDaemonMain(Datum main_arg)
 {
 	Oid databaseOid = DatumGetObjectId(main_arg);
-	TimestampTz nextStatsCollectionTime USED_WITH_LIBCURL_ONLY =
-		TimestampTzPlusMilliseconds(GetCurrentTimestamp(), 60 * 1000);
-	bool retryStatsCollection USED_WITH_LIBCURL_ONLY = false;
 	ErrorContextCallback errorCallback;
-	TimestampTz lastRecoveryTime = 0;
-	TimestampTz nextMetadataSyncTime = 0;
+	TimestampTz nextTaskRunTime[MAINTENANCE_TASK_COUNT];
+	BackgroundWorkerHandle *taskWorkerHandles[MAINTENANCE_TASK_COUNT];
+	BackgroundWorkerHandle *jobWorkerHandle = NULL;
+	TimestampTz startTime = GetCurrentTimestamp();
+
+	for (int taskId = 0; taskId < MAINTENANCE_TASK_COUNT; taskId++)
+	{
+		nextTaskRunTime[taskId] =
+			TimestampTzPlusMilliseconds(startTime, MaintenanceTasks[taskId].initialDelay);
+		taskWorkerHandles[taskId] = NULL;
+	}
 
 	/*
 	 * Look up this worker's configuration.
 	 */
-	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_SHARED);
+	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_EXCLUSIVE);
 
 	MaintenanceDaemonDBData *myDbData = (MaintenanceDaemonDBData *)
 										hash_search(MaintenanceDaemonDBHash, &databaseOid,
@@ -266,6 +454,18 @@ CitusMaintenanceDaemonMain(Datum main_arg)
 
 	myDbData->latch = MyLatch;
 
+	/*
+	 * Task workers of a previous incarnation of the daemon might still be
+	 * running, stop them since we start our own.
+	 */
+	for (int taskId = 0; taskId < MAINTENANCE_TASK_COUNT; taskId++)
+	{
+		if (myDbData->taskWorkerPid[taskId] > 0)
+		{
+			kill(myDbData->taskWorkerPid[taskId], SIGTERM);
+		}
+	}
+
 	LWLockRelease(&MaintenanceDaemonControl->lock);
 
 	/*
@@ -295,8 +495,7 @@ CitusMaintenanceDaemonMain(Datum main_arg)
 	{
 		int rc;
 		int latchFlags = WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH;
-		double timeout = 10000.0; /* use this if the deadlock detection is disabled */
-		bool foundDeadlock = false;
+		double timeout = DISABLED_TASK_CHECK_INTERVAL;
 
 		CHECK_FOR_INTERRUPTS();
 
@@ -310,199 +509,34 @@ CitusMaintenanceDaemonMain(Datum main_arg)
 		 */
 
 		/*
-		 * Perform Work.  If a specific task needs to be called sooner than
-		 * timeout indicates, it's ok to lower it to that value.  Expensive
-		 * tasks should do their own time math about whether to re-run checks.
+		 * Perform Work.  Each task returns when it should be checked again,
+		 * and we wait for the earliest of those.
 		 */
-
-#ifdef HAVE_LIBCURL
-		if (EnableStatisticsCollection &&
-			GetCurrentTimestamp() >= nextStatsCollectionTime)
+		for (int taskId = 0; taskId < MAINTENANCE_TASK_COUNT; taskId++)
 		{
-			bool statsCollectionSuccess = false;
-			InvalidateMetadataSystemCache();
-			StartTransactionCommand();
+			double taskTimeout = DISABLED_TASK_CHECK_INTERVAL;
 
-			/*
-			 * Lock the extension such that it cannot be dropped or created
-			 * concurrently. Skip statistics collection if citus extension is
-			 * not accessible.
-			 *
-			 * Similarly, we skip statistics collection if there exists any
-			 * version mismatch or the extension is not fully created yet.
-			 */
-			if (!LockCitusExtension())
-			{
-				ereport(DEBUG1, (errmsg("could not lock the citus extension, "
-										"skipping statistics collection")));
-			}
-			else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
+			if (EnableParallelMaintenanceTasks &&
+				EnsureMaintenanceTaskWorker(taskId, myDbData,
+											&taskWorkerHandles[taskId]))
 			{
-				FlushDistTableCache();
-				WarnIfSyncDNS();
-				statsCollectionSuccess = CollectBasicUsageStatistics();
+				/* the task runs in its own worker, which tells us when it exits */
 			}
-
-			/*
-			 * If statistics collection was successful the next collection is
-			 * 24-hours later. Also, if this was a retry attempt we don't do
-			 * any more retries until 24-hours later, so we limit number of
-			 * retries to one.
-			 */
-			if (statsCollectionSuccess || retryStatsCollection)
+			else if (MaintenanceTaskWorkerRunning(taskId, myDbData))
 			{
-				nextStatsCollectionTime =
-					TimestampTzPlusMilliseconds(GetCurrentTimestamp(),
-												STATS_COLLECTION_TIMEOUT_MILLIS);
-				retryStatsCollection = false;
+				/* a worker started before parallel tasks were disabled is exiting */
 			}
 			else
 			{
-				nextStatsCollectionTime =
-					TimestampTzPlusMilliseconds(GetCurrentTimestamp(),
-												STATS_COLLECTION_RETRY_TIMEOUT_MILLIS);
-				retryStatsCollection = true;
-			}
-
-			CommitTransactionCommand();
-		}
-#endif
-
-		if (!RecoveryInProgress() &&
-			(MetadataSyncTriggeredCheckAndReset(myDbData) ||
-			 GetCurrentTimestamp() >= nextMetadataSyncTime))
-		{
-			bool metadataSyncFailed = false;
-
-			InvalidateMetadataSystemCache();
-			StartTransactionCommand();
-
-			/*
-			 * Some functions in ruleutils.c, which we use to get the DDL for
-			 * metadata propagation, require an active snapshot.
-			 */
-			PushActiveSnapshot(GetTransactionSnapshot());
-
-			if (!LockCitusExtension())
-			{
-				ereport(DEBUG1, (errmsg("could not lock the citus extension, "
-										"skipping metadata sync")));
-			}
-			else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
-			{
-				MetadataSyncResult result = SyncMetadataToNodes();
-				metadataSyncFailed = (result != METADATA_SYNC_SUCCESS);
-
-				/*
-				 * Notification means we had an attempt on synchronization
-				 * without being blocked for pg_dist_node access.
-				 */
-				if (result != METADATA_SYNC_FAILED_LOCK)
-				{
-					Async_Notify(METADATA_SYNC_CHANNEL, NULL);
-				}
-			}
-
-			PopActiveSnapshot();
-			CommitTransactionCommand();
-			ProcessCompletedNotifies();
-
-			int64 nextTimeout = metadataSyncFailed ? MetadataSyncRetryInterval :
-								MetadataSyncInterval;
-			nextMetadataSyncTime =
-				TimestampTzPlusMilliseconds(GetCurrentTimestamp(), nextTimeout);
-			timeout = Min(timeout, nextTimeout);
-		}
-
-		/*
-		 * If enabled, run 2PC recovery on primary nodes (where !RecoveryInProgress()),
-		 * since we'll write to the pg_dist_transaction log.
-		 */
-		if (Recover2PCInterval > 0 && !RecoveryInProgress() &&
-			TimestampDifferenceExceeds(lastRecoveryTime, GetCurrentTimestamp(),
-									   Recover2PCInterval))
-		{
-			int recoveredTransactionCount = 0;
-
-			InvalidateMetadataSystemCache();
-			StartTransactionCommand();
-
-			if (!LockCitusExtension())
-			{
-				ereport(DEBUG1, (errmsg("could not lock the citus extension, "
-										"skipping 2PC recovery")));
-			}
-			else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
-			{
-				/*
-				 * Record last recovery time at start to ensure we run once per
-				 * Recover2PCInterval even if RecoverTwoPhaseCommits takes some time.
-				 */
-				lastRecoveryTime = GetCurrentTimestamp();
-
-				recoveredTransactionCount = RecoverTwoPhaseCommits();
-			}
-
-			CommitTransactionCommand();
-
-			if (recoveredTransactionCount > 0)
-			{
-				ereport(LOG, (errmsg("maintenance daemon recovered %d distributed "
-									 "transactions",
-									 recoveredTransactionCount)));
+				taskTimeout = RunMaintenanceTaskIfDue(taskId, myDbData,
+													  &nextTaskRunTime[taskId]);
 			}
 
 			/* make sure we don't wait too long */
-			timeout = Min(timeout, Recover2PCInterval);
+			timeout = Min(timeout, taskTimeout);
 		}
 
-		/* the config value -1 disables the distributed deadlock detection  */
-		if (DistributedDeadlockDetectionTimeoutFactor != -1.0)
-		{
-			double deadlockTimeout =
-				DistributedDeadlockDetectionTimeoutFactor * (double) DeadlockTimeout;
-
-			InvalidateMetadataSystemCache();
-			StartTransactionCommand();
-
-			/*
-			 * We skip the deadlock detection if citus extension
-			 * is not accessible.
-			 *
-			 * Similarly, we skip to run the deadlock checks if
-			 * there exists any version mismatch or the extension
-			 * is not fully created yet.
-			 */
-			if (!LockCitusExtension())
-			{
-				ereport(DEBUG1, (errmsg("could not lock the citus extension, "
-										"skipping deadlock detection")));
-			}
-			else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
-			{
-				foundDeadlock = CheckForDistributedDeadlocks();
-			}
-
-			CommitTransactionCommand();
-
-			/*
-			 * If we find any deadlocks, run the distributed deadlock detection
-			 * more often since it is quite possible that there are other
-			 * deadlocks need to be resolved.
-			 *
-			 * Thus, we use 1/20 of the calculated value. With the default
-			 * values (i.e., deadlock_timeout 1 seconds,
-			 * citus.distributed_deadlock_detection_factor 2), we'd be able to cancel
-			 * ~10 distributed deadlocks per second.
-			 */
-			if (foundDeadlock)
-			{
-				deadlockTimeout = deadlockTimeout / 20.0;
-			}
-
-			/* make sure we don't wait too long */
-			timeout = Min(timeout, deadlockTimeout);
-		}
+		StartQueuedMaintenanceJob(myDbData, &jobWorkerHandle);
 
 		/*
 		 * Wait until timeout, or until somebody wakes us up. Also cast the timeout to
@@ -556,116 +590,884 @@ CitusMaintenanceDaemonMain(Datum main_arg)
 
 
 /*
- * MaintenanceDaemonShmemSize computes how much shared memory is required.
+ * CitusMaintenanceTaskMain is the main routine of a background worker that
+ * runs a single periodic maintenance task, started by the maintenance daemon
+ * when citus.enable_parallel_maintenance_tasks is enabled. The worker exits
+ * when the task or parallel tasks get disabled, or when the daemon that
+ * started it is gone, after which the daemon takes over again.
  */
-static size_t
-MaintenanceDaemonShmemSize(void)
+void
+CitusMaintenanceTaskMain(Datum main_arg)
 {
-	Size size = 0;
+	Oid databaseOid = DatumGetObjectId(main_arg);
+	MaintenanceWorkerArgs workerArgs;
+	ErrorContextCallback errorCallback;
+	TimestampTz nextRunTime = 0;
 
-	size = add_size(size, sizeof(MaintenanceDaemonControlData));
+	memcpy(&workerArgs, MyBgworkerEntry->bgw_extra, sizeof(MaintenanceWorkerArgs));
 
-	/*
-	 * We request enough shared memory to have one hash-table entry for each
-	 * worker process. We couldn't start more anyway, so there's little point
-	 * in allocating more.
-	 */
-	Size hashSize = hash_estimate_size(max_worker_processes,
-									   sizeof(MaintenanceDaemonDBData));
-	size = add_size(size, hashSize);
+	MaintenanceTaskId taskId = workerArgs.taskId;
+	const MaintenanceTask *task = &MaintenanceTasks[taskId];
 
-	return size;
-}
+	/* wire up signals */
+	pqsignal(SIGTERM, die);
+	pqsignal(SIGHUP, MaintenanceDaemonSigHupHandler);
+	BackgroundWorkerUnblockSignals();
 
+	MaintenanceDaemonDBData *myDbData = AttachMaintenanceWorker(databaseOid,
+																&workerArgs);
 
-/*
- * MaintenanceDaemonShmemInit initializes the requested shared memory for the
- * maintenance daemon.
- */
-static void
-MaintenanceDaemonShmemInit(void)
-{
-	bool alreadyInitialized = false;
-	HASHCTL hashInfo;
+	memset(&errorCallback, 0, sizeof(errorCallback));
+	errorCallback.callback = MaintenanceDaemonErrorContext;
+	errorCallback.arg = (void *) myDbData;
+	errorCallback.previous = error_context_stack;
+	error_context_stack = &errorCallback;
 
-	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+	BackgroundWorkerInitializeConnectionByOid(databaseOid, workerArgs.userOid, 0);
 
-	MaintenanceDaemonControl =
-		(MaintenanceDaemonControlData *) ShmemInitStruct("Citus Maintenance Daemon",
-														 MaintenanceDaemonShmemSize(),
-														 &alreadyInitialized);
+	pgstat_report_appname("Citus Maintenance Task");
 
-	/*
-	 * Might already be initialized on EXEC_BACKEND type platforms that call
-	 * shared library initialization functions in every backend.
-	 */
-	if (!alreadyInitialized)
+	for (;;)
 	{
-		MaintenanceDaemonControl->trancheId = LWLockNewTrancheId();
-		MaintenanceDaemonControl->lockTrancheName = "Citus Maintenance Daemon";
-		LWLockRegisterTranche(MaintenanceDaemonControl->trancheId,
-							  MaintenanceDaemonControl->lockTrancheName);
+		int latchFlags = WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH;
 
-		LWLockInitialize(&MaintenanceDaemonControl->lock,
-						 MaintenanceDaemonControl->trancheId);
-	}
+		CHECK_FOR_INTERRUPTS();
 
+		if (!EnableParallelMaintenanceTasks || !task->isEnabled() ||
+			myDbData->workerPid != workerArgs.daemonPid)
+		{
+			proc_exit(0);
+		}
 
-	memset(&hashInfo, 0, sizeof(hashInfo));
-	hashInfo.keysize = sizeof(Oid);
-	hashInfo.entrysize = sizeof(MaintenanceDaemonDBData);
-	hashInfo.hash = tag_hash;
-	int hashFlags = (HASH_ELEM | HASH_FUNCTION);
+		double timeout = RunMaintenanceTaskIfDue(taskId, myDbData, &nextRunTime);
 
-	MaintenanceDaemonDBHash = ShmemInitHash("Maintenance Database Hash",
-											max_worker_processes, max_worker_processes,
-											&hashInfo, hashFlags);
+		int rc = WaitLatch(MyLatch, latchFlags, (long) timeout, PG_WAIT_EXTENSION);
 
-	LWLockRelease(AddinShmemInitLock);
+		/* emergency bailout if postmaster has died */
+		if (rc & WL_POSTMASTER_DEATH)
+		{
+			proc_exit(1);
+		}
 
-	if (prev_shmem_startup_hook != NULL)
-	{
-		prev_shmem_startup_hook();
+		if (rc & WL_LATCH_SET)
+		{
+			ResetLatch(MyLatch);
+			CHECK_FOR_INTERRUPTS();
+		}
+
+		if (got_SIGHUP)
+		{
+			got_SIGHUP = false;
+			ProcessConfigFile(PGC_SIGHUP);
+		}
 	}
 }
 
 
 /*
- * MaintenanceDaemonSigHupHandler set a flag to re-read config file at next
- * convenient time.
+ * CitusMaintenanceJobMain is the main routine of a background worker that
+ * runs a single job from the maintenance job queue. The job function is
+ * called in a transaction, with the Citus extension locked.
  */
-static void
-MaintenanceDaemonSigHupHandler(SIGNAL_ARGS)
+void
+CitusMaintenanceJobMain(Datum main_arg)
 {
-	int save_errno = errno;
+	Oid databaseOid = DatumGetObjectId(main_arg);
+	MaintenanceWorkerArgs workerArgs;
+	ErrorContextCallback errorCallback;
 
-	got_SIGHUP = true;
-	if (MyProc != NULL)
+	memcpy(&workerArgs, MyBgworkerEntry->bgw_extra, sizeof(MaintenanceWorkerArgs));
+
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	MaintenanceDaemonDBData *myDbData = AttachMaintenanceWorker(databaseOid,
+																&workerArgs);
+
+	memset(&errorCallback, 0, sizeof(errorCallback));
+	errorCallback.callback = MaintenanceDaemonErrorContext;
+	errorCallback.arg = (void *) myDbData;
+	errorCallback.previous = error_context_stack;
+	error_context_stack = &errorCallback;
+
+	BackgroundWorkerInitializeConnectionByOid(databaseOid, workerArgs.userOid, 0);
+
+	pgstat_report_appname("Citus Maintenance Job");
+
+	MaintenanceJobFunction jobFunction = (MaintenanceJobFunction)
+										 load_external_function("citus",
+																workerArgs.functionName,
+																true, NULL);
+
+	StartTransactionCommand();
+
+	if (!LockCitusExtension())
 	{
-		SetLatch(&MyProc->procLatch);
+		ereport(DEBUG1, (errmsg("could not lock the citus extension, "
+								"skipping maintenance job %s",
+								workerArgs.functionName)));
+	}
+	else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
+	{
+		jobFunction(workerArgs.argument);
 	}
 
-	errno = save_errno;
+	CommitTransactionCommand();
+
+	proc_exit(0);
 }
 
 
 /*
- * MaintenanceDaemonErrorContext adds some context to log messages to make it
- * easier to associate them with the maintenance daemon.
+ * AttachMaintenanceWorker registers the current task or job worker in the
+ * shared memory entry of its database, such that DROP DATABASE can stop it,
+ * and returns the entry. The worker exits if the daemon that started it is
+ * no longer running.
  */
-static void
-MaintenanceDaemonErrorContext(void *arg)
+static MaintenanceDaemonDBData *
+AttachMaintenanceWorker(Oid databaseOid, MaintenanceWorkerArgs *workerArgs)
 {
-	MaintenanceDaemonDBData *myDbData = (MaintenanceDaemonDBData *) arg;
-	errcontext("Citus maintenance daemon for database %u user %u",
-			   myDbData->databaseOid, myDbData->userOid);
-}
-
+	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_EXCLUSIVE);
 
-/*
- * LockCitusExtension acquires a lock on the Citus extension or returns
- * false if the extension does not exist or is being dropped.
- */
+	MaintenanceDaemonDBData *myDbData = (MaintenanceDaemonDBData *)
+										hash_search(MaintenanceDaemonDBHash, &databaseOid,
+													HASH_FIND, NULL);
+	if (!myDbData || myDbData->workerPid != workerArgs->daemonPid)
+	{
+		LWLockRelease(&MaintenanceDaemonControl->lock);
+		proc_exit(0);
+	}
+
+	if (workerArgs->taskId == INVALID_MAINTENANCE_TASK_ID)
+	{
+		myDbData->jobWorkerPid = MyProcPid;
+	}
+	else
+	{
+		myDbData->taskWorkerPid[workerArgs->taskId] = MyProcPid;
+		myDbData->taskWorkerLatch[workerArgs->taskId] = MyLatch;
+	}
+
+	LWLockRelease(&MaintenanceDaemonControl->lock);
+
+	/* remember which slot to clear on exit */
+	AttachedWorkerTaskId = workerArgs->taskId;
+	before_shmem_exit(DetachMaintenanceWorker, ObjectIdGetDatum(databaseOid));
+
+	return myDbData;
+}
+
+
+/*
+ * DetachMaintenanceWorker removes the exiting task or job worker from the
+ * shared memory entry of its database, if the entry still exists.
+ */
+static void
+DetachMaintenanceWorker(int code, Datum arg)
+{
+	Oid databaseOid = DatumGetObjectId(arg);
+
+	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_EXCLUSIVE);
+
+	MaintenanceDaemonDBData *myDbData = (MaintenanceDaemonDBData *)
+										hash_search(MaintenanceDaemonDBHash, &databaseOid,
+													HASH_FIND, NULL);
+	if (myDbData != NULL)
+	{
+		if (AttachedWorkerTaskId == INVALID_MAINTENANCE_TASK_ID)
+		{
+			if (myDbData->jobWorkerPid == MyProcPid)
+			{
+				myDbData->jobWorkerPid = 0;
+			}
+		}
+		else if (myDbData->taskWorkerPid[AttachedWorkerTaskId] == MyProcPid)
+		{
+			myDbData->taskWorkerPid[AttachedWorkerTaskId] = 0;
+			myDbData->taskWorkerLatch[AttachedWorkerTaskId] = NULL;
+		}
+	}
+
+	LWLockRelease(&MaintenanceDaemonControl->lock);
+}
+
+
+/*
+ * RunMaintenanceTaskIfDue runs the given maintenance task if it is enabled and
+ * due or triggered, and returns the number of milliseconds until it should be
+ * checked again. The next run is scheduled relative to the start of the run,
+ * such that a task runs once per interval even if it takes some time.
+ */
+static double
+RunMaintenanceTaskIfDue(MaintenanceTaskId taskId, MaintenanceDaemonDBData *dbData,
+						TimestampTz *nextRunTime)
+{
+	const MaintenanceTask *task = &MaintenanceTasks[taskId];
+
+	/* tasks that write, such as 2PC recovery, only run on primary nodes */
+	if (!task->isEnabled() || (task->primaryOnly && RecoveryInProgress()))
+	{
+		return DISABLED_TASK_CHECK_INTERVAL;
+	}
+
+	TimestampTz now = GetCurrentTimestamp();
+	bool triggered = task->isTriggered != NULL && task->isTriggered(dbData);
+
+	if (triggered || now >= *nextRunTime)
+	{
+		double interval = task->run();
+
+		*nextRunTime = TimestampTzPlusMilliseconds(now, (int64) interval);
+		now = GetCurrentTimestamp();
+	}
+
+	if (now >= *nextRunTime)
+	{
+		return 0.0;
+	}
+
+	return (double) (*nextRunTime - now) / 1000.0;
+}
+
+
+/*
+ * EnsureMaintenanceTaskWorker makes sure that a background worker runs the
+ * given task, if the task is enabled, and returns whether the task is taken
+ * care of that way. When no background worker can be started, for instance
+ * because max_worker_processes is reached, the function returns false and
+ * the daemon runs the task itself.
+ */
+static bool
+EnsureMaintenanceTaskWorker(MaintenanceTaskId taskId, MaintenanceDaemonDBData *dbData,
+							BackgroundWorkerHandle **handle)
+{
+	const MaintenanceTask *task = &MaintenanceTasks[taskId];
+	BackgroundWorker worker;
+	MaintenanceWorkerArgs workerArgs;
+	pid_t pid = 0;
+
+	if (!task->isEnabled() || (task->primaryOnly && RecoveryInProgress()))
+	{
+		/* nothing to run, the daemon checks again later */
+		return true;
+	}
+
+	if (*handle != NULL && GetBackgroundWorkerPid(*handle, &pid) != BGWH_STOPPED)
+	{
+		return true;
+	}
+
+	memset(&workerArgs, 0, sizeof(workerArgs));
+	workerArgs.userOid = dbData->userOid;
+	workerArgs.daemonPid = MyProcPid;
+	workerArgs.taskId = taskId;
+
+	InitializeMaintenanceWorker(&worker, &workerArgs, "CitusMaintenanceTaskMain");
+	snprintf(worker.bgw_name, BGW_MAXLEN, "Citus Maintenance Task: %s %u",
+			 task->name, MyDatabaseId);
+
+	if (!RegisterDynamicBackgroundWorker(&worker, handle))
+	{
+		ereport(DEBUG1, (errmsg("could not start background worker for %s, running "
+								"it in the maintenance daemon", task->name)));
+		*handle = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * MaintenanceTaskWorkerRunning returns whether a background worker for the
+ * given task is still running.
+ */
+static bool
+MaintenanceTaskWorkerRunning(MaintenanceTaskId taskId, MaintenanceDaemonDBData *dbData)
+{
+	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_SHARED);
+	bool workerRunning = dbData->taskWorkerPid[taskId] > 0;
+	LWLockRelease(&MaintenanceDaemonControl->lock);
+
+	return workerRunning;
+}
+
+
+/*
+ * StartQueuedMaintenanceJob starts a background worker for the first job on
+ * the maintenance job queue of the database, unless the previous job is still
+ * running. The job stays on the queue if no background worker can be started,
+ * the daemon then tries again the next time it wakes up.
+ */
+static void
+StartQueuedMaintenanceJob(MaintenanceDaemonDBData *dbData,
+						  BackgroundWorkerHandle **handle)
+{
+	BackgroundWorker worker;
+	MaintenanceWorkerArgs workerArgs;
+	pid_t pid = 0;
+
+	if (*handle != NULL && GetBackgroundWorkerPid(*handle, &pid) != BGWH_STOPPED)
+	{
+		return;
+	}
+
+	*handle = NULL;
+
+	memset(&workerArgs, 0, sizeof(workerArgs));
+
+	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_EXCLUSIVE);
+
+	if (dbData->jobQueueLength == 0)
+	{
+		LWLockRelease(&MaintenanceDaemonControl->lock);
+		return;
+	}
+
+	MaintenanceJob *job = &dbData->jobQueue[dbData->jobQueueHead];
+	strlcpy(workerArgs.functionName, job->functionName, NAMEDATALEN);
+	workerArgs.argument = job->argument;
+	workerArgs.userOid = dbData->userOid;
+	workerArgs.daemonPid = MyProcPid;
+	workerArgs.taskId = INVALID_MAINTENANCE_TASK_ID;
+
+	InitializeMaintenanceWorker(&worker, &workerArgs, "CitusMaintenanceJobMain");
+	snprintf(worker.bgw_name, BGW_MAXLEN, "Citus Maintenance Job: %s %u",
+			 workerArgs.functionName, MyDatabaseId);
+
+	if (RegisterDynamicBackgroundWorker(&worker, handle))
+	{
+		dbData->jobQueueHead = (dbData->jobQueueHead + 1) % MAX_QUEUED_MAINTENANCE_JOBS;
+		dbData->jobQueueLength--;
+	}
+	else
+	{
+		*handle = NULL;
+	}
+
+	LWLockRelease(&MaintenanceDaemonControl->lock);
+}
+
+
+/*
+ * InitializeMaintenanceWorker fills in the given background worker definition
+ * for a task or job worker of the maintenance daemon, which runs the given
+ * function of the citus library with the given arguments.
+ */
+static void
+InitializeMaintenanceWorker(BackgroundWorker *worker, MaintenanceWorkerArgs *workerArgs,
+							const char *functionName)
+{
+	StaticAssertStmt(sizeof(MaintenanceWorkerArgs) <= BGW_EXTRALEN,
+					 "maintenance worker arguments do not fit into bgw_extra");
+
+	memset(worker, 0, sizeof(BackgroundWorker));
+
+	worker->bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker->bgw_start_time = BgWorkerStart_ConsistentState;
+
+	/* the daemon restarts task workers when needed */
+	worker->bgw_restart_time = BGW_NEVER_RESTART;
+	sprintf(worker->bgw_library_name, "citus");
+	strlcpy(worker->bgw_function_name, functionName, BGW_MAXLEN);
+	worker->bgw_main_arg = ObjectIdGetDatum(MyDatabaseId);
+	memcpy(worker->bgw_extra, workerArgs, sizeof(MaintenanceWorkerArgs));
+
+	/* let the daemon know when the worker exits */
+	worker->bgw_notify_pid = MyProcPid;
+}
+
+
+/*
+ * ScheduleMaintenanceJob puts a job on the maintenance job queue of the given
+ * database. The maintenance daemon runs the jobs one at a time, each in its
+ * own background worker, by calling the function of the citus library with
+ * the given name and argument in a transaction. The function must have the
+ * signature of a MaintenanceJobFunction.
+ *
+ * The function returns false if the database has no maintenance daemon or if
+ * its job queue is full, in which case the caller may try again later.
+ */
+bool
+ScheduleMaintenanceJob(Oid databaseId, const char *functionName, Datum argument)
+{
+	bool found = false;
+	bool jobScheduled = false;
+
+	if (strlen(functionName) >= NAMEDATALEN)
+	{
+		ereport(ERROR, (errmsg("maintenance job function name \"%s\" is too long",
+							   functionName)));
+	}
+
+	/* error out early if the function does not exist */
+	load_external_function("citus", functionName, true, NULL);
+
+	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_EXCLUSIVE);
+
+	MaintenanceDaemonDBData *dbData = (MaintenanceDaemonDBData *) hash_search(
+		MaintenanceDaemonDBHash,
+		&databaseId,
+		HASH_FIND, &found);
+	if (found && dbData->daemonStarted &&
+		dbData->jobQueueLength < MAX_QUEUED_MAINTENANCE_JOBS)
+	{
+		int jobIndex = (dbData->jobQueueHead + dbData->jobQueueLength) %
+					   MAX_QUEUED_MAINTENANCE_JOBS;
+		MaintenanceJob *job = &dbData->jobQueue[jobIndex];
+
+		strlcpy(job->functionName, functionName, NAMEDATALEN);
+		job->argument = argument;
+		dbData->jobQueueLength++;
+		jobScheduled = true;
+
+		/* set latch to wake-up the maintenance loop */
+		if (dbData->latch != NULL)
+		{
+			SetLatch(dbData->latch);
+		}
+	}
+
+	LWLockRelease(&MaintenanceDaemonControl->lock);
+
+	return jobScheduled;
+}
+
+
+/*
+ * StatisticsCollectionEnabled returns whether basic usage statistics are
+ * collected.
+ */
+static bool
+StatisticsCollectionEnabled(void)
+{
+#ifdef HAVE_LIBCURL
+	return EnableStatisticsCollection;
+#else
+	return false;
+#endif
+}
+
+
+/*
+ * RunStatisticsCollection collects and sends basic usage statistics, and
+ * returns the number of milliseconds until the next collection.
+ */
+static double
+RunStatisticsCollection(void)
+{
+#ifdef HAVE_LIBCURL
+	bool statsCollectionSuccess = false;
+	double nextTimeout = STATS_COLLECTION_TIMEOUT_MILLIS;
+
+	InvalidateMetadataSystemCache();
+	StartTransactionCommand();
+
+	/*
+	 * Lock the extension such that it cannot be dropped or created
+	 * concurrently. Skip statistics collection if citus extension is
+	 * not accessible.
+	 *
+	 * Similarly, we skip statistics collection if there exists any
+	 * version mismatch or the extension is not fully created yet.
+	 */
+	if (!LockCitusExtension())
+	{
+		ereport(DEBUG1, (errmsg("could not lock the citus extension, "
+								"skipping statistics collection")));
+	}
+	else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
+	{
+		FlushDistTableCache();
+		WarnIfSyncDNS();
+		statsCollectionSuccess = CollectBasicUsageStatistics();
+	}
+
+	/*
+	 * If statistics collection was successful the next collection is
+	 * 24-hours later. Also, if this was a retry attempt we don't do
+	 * any more retries until 24-hours later, so we limit number of
+	 * retries to one.
+	 */
+	if (statsCollectionSuccess || RetryStatsCollection)
+	{
+		RetryStatsCollection = false;
+	}
+	else
+	{
+		nextTimeout = STATS_COLLECTION_RETRY_TIMEOUT_MILLIS;
+		RetryStatsCollection = true;
+	}
+
+	CommitTransactionCommand();
+
+	return nextTimeout;
+#else
+	return STATS_COLLECTION_TIMEOUT_MILLIS;
+#endif
+}
+
+
+/*
+ * MetadataSyncEnabled returns whether metadata is synced to the nodes, which
+ * is always the case.
+ */
+static bool
+MetadataSyncEnabled(void)
+{
+	return true;
+}
+
+
+/*
+ * MetadataSyncTriggered returns whether a metadata sync was triggered for the
+ * database of the given maintenance daemon, and resets the trigger.
+ */
+static bool
+MetadataSyncTriggered(MaintenanceDaemonDBData *dbData)
+{
+	return MetadataSyncTriggeredCheckAndReset(dbData);
+}
+
+
+/*
+ * RunMetadataSync syncs the metadata to the nodes that are out of sync, and
+ * returns the number of milliseconds until the next sync.
+ */
+static double
+RunMetadataSync(void)
+{
+	bool metadataSyncFailed = false;
+
+	InvalidateMetadataSystemCache();
+	StartTransactionCommand();
+
+	/*
+	 * Some functions in ruleutils.c, which we use to get the DDL for
+	 * metadata propagation, require an active snapshot.
+	 */
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	if (!LockCitusExtension())
+	{
+		ereport(DEBUG1, (errmsg("could not lock the citus extension, "
+								"skipping metadata sync")));
+	}
+	else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
+	{
+		MetadataSyncResult result = SyncMetadataToNodes();
+		metadataSyncFailed = (result != METADATA_SYNC_SUCCESS);
+
+		/*
+		 * Notification means we had an attempt on synchronization
+		 * without being blocked for pg_dist_node access.
+		 */
+		if (result != METADATA_SYNC_FAILED_LOCK)
+		{
+			Async_Notify(METADATA_SYNC_CHANNEL, NULL);
+		}
+	}
+
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+	ProcessCompletedNotifies();
+
+	return metadataSyncFailed ? MetadataSyncRetryInterval : MetadataSyncInterval;
+}
+
+
+/*
+ * TransactionRecoveryEnabled returns whether 2PC recovery runs periodically.
+ */
+static bool
+TransactionRecoveryEnabled(void)
+{
+	return Recover2PCInterval > 0;
+}
+
+
+/*
+ * RunTransactionRecovery recovers the prepared transactions of failed
+ * distributed transactions, and returns the number of milliseconds until the
+ * next recovery.
+ */
+static double
+RunTransactionRecovery(void)
+{
+	int recoveredTransactionCount = 0;
+
+	InvalidateMetadataSystemCache();
+	StartTransactionCommand();
+
+	if (!LockCitusExtension())
+	{
+		ereport(DEBUG1, (errmsg("could not lock the citus extension, "
+								"skipping 2PC recovery")));
+	}
+	else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
+	{
+		recoveredTransactionCount = RecoverTwoPhaseCommits();
+	}
+
+	CommitTransactionCommand();
+
+	if (recoveredTransactionCount > 0)
+	{
+		ereport(LOG, (errmsg("maintenance daemon recovered %d distributed "
+							 "transactions",
+							 recoveredTransactionCount)));
+	}
+
+	return Recover2PCInterval;
+}
+
+
+/*
+ * DeadlockDetectionEnabled returns whether distributed deadlock detection is
+ * enabled, the config value -1 disables it.
+ */
+static bool
+DeadlockDetectionEnabled(void)
+{
+	return DistributedDeadlockDetectionTimeoutFactor != -1.0;
+}
+
+
+/*
+ * RunDeadlockDetection checks for distributed deadlocks and cancels one of the
+ * transactions of each deadlock, and returns the number of milliseconds until
+ * the next check.
+ */
+static double
+RunDeadlockDetection(void)
+{
+	double deadlockTimeout =
+		DistributedDeadlockDetectionTimeoutFactor * (double) DeadlockTimeout;
+	bool foundDeadlock = false;
+
+	InvalidateMetadataSystemCache();
+	StartTransactionCommand();
+
+	/*
+	 * We skip the deadlock detection if citus extension
+	 * is not accessible.
+	 *
+	 * Similarly, we skip to run the deadlock checks if
+	 * there exists any version mismatch or the extension
+	 * is not fully created yet.
+	 */
+	if (!LockCitusExtension())
+	{
+		ereport(DEBUG1, (errmsg("could not lock the citus extension, "
+								"skipping deadlock detection")));
+	}
+	else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
+	{
+		foundDeadlock = CheckForDistributedDeadlocks();
+	}
+
+	CommitTransactionCommand();
+
+	/*
+	 * If we find any deadlocks, run the distributed deadlock detection
+	 * more often since it is quite possible that there are other
+	 * deadlocks need to be resolved.
+	 *
+	 * Thus, we use 1/20 of the calculated value. With the default
+	 * values (i.e., deadlock_timeout 1 seconds,
+	 * citus.distributed_deadlock_detection_factor 2), we'd be able to cancel
+	 * ~10 distributed deadlocks per second.
+	 */
+	if (foundDeadlock)
+	{
+		deadlockTimeout = deadlockTimeout / 20.0;
+	}
+
+	return deadlockTimeout;
+}
+
+
+/*
+ * DeferredCleanupEnabled returns true, the task also runs when deferring the
+ * cleanup was disabled, to remove the files that were deferred before.
+ */
+static bool
+DeferredCleanupEnabled(void)
+{
+	return true;
+}
+
+
+/*
+ * RunDeferredCleanup removes a batch of the files that wait for deferred
+ * cleanup, and returns the number of milliseconds until the next batch. The
+ * batches are sized such that at most citus.deferred_cleanup_files_per_second
+ * files are removed per second.
+ */
+static double
+RunDeferredCleanup(void)
+{
+	int maxFileCount = Max(DeferredCleanupFilesPerSecond /
+						   DEFERRED_CLEANUP_BATCHES_PER_SECOND, 1);
+
+	if (!AcquireDeferredCleanupLease())
+	{
+		/* the maintenance daemon of another database removes the files */
+		return DEFERRED_CLEANUP_IDLE_INTERVAL;
+	}
+
+	int removedFileCount = RemoveDeferredCleanupFiles(maxFileCount);
+	if (removedFileCount < maxFileCount)
+	{
+		return DEFERRED_CLEANUP_IDLE_INTERVAL;
+	}
+
+	return 1000.0 / DEFERRED_CLEANUP_BATCHES_PER_SECOND;
+}
+
+
+/*
+ * AcquireDeferredCleanupLease returns whether the current process may remove
+ * deferred cleanup files, which is the case if it holds the lease or no other
+ * process renewed the lease in time. The lease is renewed on success.
+ */
+static bool
+AcquireDeferredCleanupLease(void)
+{
+	bool acquiredLease = false;
+	TimestampTz now = GetCurrentTimestamp();
+
+	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_EXCLUSIVE);
+
+	if (MaintenanceDaemonControl->deferredCleanupPid == MyProcPid ||
+		MaintenanceDaemonControl->deferredCleanupLeaseEnd < now)
+	{
+		MaintenanceDaemonControl->deferredCleanupPid = MyProcPid;
+		MaintenanceDaemonControl->deferredCleanupLeaseEnd =
+			TimestampTzPlusMilliseconds(now, DEFERRED_CLEANUP_LEASE_TIME);
+		acquiredLease = true;
+	}
+
+	LWLockRelease(&MaintenanceDaemonControl->lock);
+
+	return acquiredLease;
+}
+
+
+/*
+ * MaintenanceDaemonShmemSize computes how much shared memory is required.
+ */
+static size_t
+MaintenanceDaemonShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(MaintenanceDaemonControlData));
+
+	/*
+	 * We request enough shared memory to have one hash-table entry for each
+	 * worker process. We couldn't start more anyway, so there's little point
+	 * in allocating more.
+	 */
+	Size hashSize = hash_estimate_size(max_worker_processes,
+									   sizeof(MaintenanceDaemonDBData));
+	size = add_size(size, hashSize);
+
+	return size;
+}
+
+
+/*
+ * MaintenanceDaemonShmemInit initializes the requested shared memory for the
+ * maintenance daemon.
+ */
+static void
+MaintenanceDaemonShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL hashInfo;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	MaintenanceDaemonControl =
+		(MaintenanceDaemonControlData *) ShmemInitStruct("Citus Maintenance Daemon",
+														 MaintenanceDaemonShmemSize(),
+														 &alreadyInitialized);
+
+	/*
+	 * Might already be initialized on EXEC_BACKEND type platforms that call
+	 * shared library initialization functions in every backend.
+	 */
+	if (!alreadyInitialized)
+	{
+		MaintenanceDaemonControl->trancheId = LWLockNewTrancheId();
+		MaintenanceDaemonControl->lockTrancheName = "Citus Maintenance Daemon";
+		LWLockRegisterTranche(MaintenanceDaemonControl->trancheId,
+							  MaintenanceDaemonControl->lockTrancheName);
+
+		LWLockInitialize(&MaintenanceDaemonControl->lock,
+						 MaintenanceDaemonControl->trancheId);
+
+		MaintenanceDaemonControl->deferredCleanupPid = 0;
+		MaintenanceDaemonControl->deferredCleanupLeaseEnd = 0;
+	}
+
+
+	memset(&hashInfo, 0, sizeof(hashInfo));
+	hashInfo.keysize = sizeof(Oid);
+	hashInfo.entrysize = sizeof(MaintenanceDaemonDBData);
+	hashInfo.hash = tag_hash;
+	int hashFlags = (HASH_ELEM | HASH_FUNCTION);
+
+	MaintenanceDaemonDBHash = ShmemInitHash("Maintenance Database Hash",
+											max_worker_processes, max_worker_processes,
+											&hashInfo, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+/*
+ * MaintenanceDaemonSigHupHandler set a flag to re-read config file at next
+ * convenient time.
+ */
+static void
+MaintenanceDaemonSigHupHandler(SIGNAL_ARGS)
+{
+	int save_errno = errno;
+
+	got_SIGHUP = true;
+	if (MyProc != NULL)
+	{
+		SetLatch(&MyProc->procLatch);
+	}
+
+	errno = save_errno;
+}
+
+
+/*
+ * MaintenanceDaemonErrorContext adds some context to log messages to make it
+ * easier to associate them with the maintenance daemon.
+ */
+static void
+MaintenanceDaemonErrorContext(void *arg)
+{
+	MaintenanceDaemonDBData *myDbData = (MaintenanceDaemonDBData *) arg;
+	errcontext("Citus maintenance daemon for database %u user %u",
+			   myDbData->databaseOid, myDbData->userOid);
+}
+
+
+/*
+ * LockCitusExtension acquires a lock on the Citus extension or returns
+ * false if the extension does not exist or is being dropped.
+ */
 static bool
 LockCitusExtension(void)
 {
@@ -702,6 +1504,10 @@ StopMaintenanceDaemon(Oid databaseId)
 {
 	bool found = false;
 	pid_t workerPid = 0;
+	pid_t taskWorkerPid[MAINTENANCE_TASK_COUNT];
+	pid_t jobWorkerPid = 0;
+
+	memset(taskWorkerPid, 0, sizeof(taskWorkerPid));
 
 	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_EXCLUSIVE);
 
@@ -712,6 +1518,8 @@ StopMaintenanceDaemon(Oid databaseId)
 	if (found)
 	{
 		workerPid = dbData->workerPid;
+		memcpy(taskWorkerPid, dbData->taskWorkerPid, sizeof(taskWorkerPid));
+		jobWorkerPid = dbData->jobWorkerPid;
 	}
 
 	LWLockRelease(&MaintenanceDaemonControl->lock);
@@ -720,6 +1528,20 @@ StopMaintenanceDaemon(Oid databaseId)
 	{
 		kill(workerPid, SIGTERM);
 	}
+
+	/* the task and job workers are connected to the database as well */
+	for (int taskId = 0; taskId < MAINTENANCE_TASK_COUNT; taskId++)
+	{
+		if (taskWorkerPid[taskId] > 0)
+		{
+			kill(taskWorkerPid[taskId], SIGTERM);
+		}
+	}
+
+	if (jobWorkerPid > 0)
+	{
+		kill(jobWorkerPid, SIGTERM);
+	}
 }
 
 
@@ -740,10 +1562,19 @@ TriggerMetadataSync(Oid databaseId)
 		HASH_FIND, &found);
 	if (found)
 	{
+		Latch *taskWorkerLatch =
+			dbData->taskWorkerLatch[MAINTENANCE_TASK_METADATA_SYNC];
+
 		dbData->triggerMetadataSync = true;
 
 		/* set latch to wake-up the maintenance loop */
 		SetLatch(dbData->latch);
+
+		/* metadata sync might be running in its own worker */
+		if (taskWorkerLatch != NULL)
+		{
+			SetLatch(taskWorkerLatch);
+		}
 	}
 
 	LWLockRelease(&MaintenanceDaemonControl->lock);
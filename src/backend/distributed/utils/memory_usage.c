@@ -0,0 +1,363 @@
+/*-------------------------------------------------------------------------
+ *
+ * memory_usage.c
+ *
+ * Routines for measuring how much memory the memory contexts that Citus owns
+ * use, such as the metadata cache and the connection hash. The contexts are
+ * found by name in the memory context tree of the backend, and each of them
+ * is accounted together with its child contexts.
+ *
+ * citus_memory_usage shows the contexts of the current backend. To compare
+ * backends, each backend also reports the memory it uses per category into
+ * its BackendData at the end of a transaction, at most once every
+ * citus.memory_usage_report_interval, which citus_backend_memory_usage shows.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include "access/parallel.h"
+#include "distributed/backend_data.h"
+#include "distributed/memory_usage.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/tuplestore.h"
+#include "nodes/memnodes.h"
+#include "storage/proc.h"
+#include "utils/builtins.h"
+#include "utils/memutils.h"
+#include "utils/timestamp.h"
+
+
+#define CITUS_MEMORY_USAGE_COLUMNS 6
+#define CITUS_BACKEND_MEMORY_USAGE_COLUMNS 7
+
+
+/* a memory context that Citus creates, and what it is used for */
+typedef struct CitusMemoryContextName
+{
+	const char *name;
+	CitusMemoryCategory category;
+} CitusMemoryContextName;
+
+
+/* function that is called for each Citus memory context by WalkCitusMemoryContexts */
+typedef void (*CitusMemoryContextVisitor)(MemoryContext context,
+										  CitusMemoryCategory category,
+										  MemoryContextCounters *counters,
+										  int contextCount, void *state);
+
+
+/* state of StoreCitusMemoryContext */
+typedef struct MemoryUsageTupleStore
+{
+	Tuplestorestate *tupleStore;
+	TupleDesc tupleDescriptor;
+} MemoryUsageTupleStore;
+
+
+/* names of the memory contexts that Citus creates */
+static const CitusMemoryContextName CitusMemoryContextNames[] = {
+	{ "MetadataCacheMemoryContext", CITUS_MEMORY_METADATA_CACHE },
+	{ "ShardSetCacheContext", CITUS_MEMORY_METADATA_CACHE },
+	{ "DependencyCacheContext", CITUS_MEMORY_METADATA_CACHE },
+	{ "TableDDLCommandCacheContext", CITUS_MEMORY_METADATA_CACHE },
+	{ "Forign Constraint Relationship Graph Context", CITUS_MEMORY_METADATA_CACHE },
+	{ "Connection Context", CITUS_MEMORY_CONNECTIONS },
+	{ "CommitContext", CITUS_MEMORY_TRANSACTIONS },
+	{ "IoContext", CITUS_MEMORY_EXECUTION },
+	{ "Columnar Result Chunk Context", CITUS_MEMORY_EXECUTION },
+	{ "Batch Modify Context", CITUS_MEMORY_EXECUTION },
+	{ "WorkerRowOutputContext", CITUS_MEMORY_EXECUTION }
+};
+
+/* names of the categories, in the order of CitusMemoryCategory */
+static const char *CitusMemoryCategoryNames[] = {
+	"metadata cache", "connections", "transactions", "execution"
+};
+
+
+/* config variable managed via guc.c */
+int MemoryUsageReportInterval = 0;
+
+/* time at which this backend last reported its memory usage */
+static TimestampTz LastMemoryUsageReportTime = 0;
+
+
+static void WalkCitusMemoryContexts(MemoryContext context,
+									CitusMemoryContextVisitor visitor, void *state);
+static int CitusMemoryContextCategory(MemoryContext context);
+static void MeasureMemoryContextTree(MemoryContext context,
+									 MemoryContextCounters *counters,
+									 int *contextCount);
+static void AddCitusMemoryContext(MemoryContext context, CitusMemoryCategory category,
+								  MemoryContextCounters *counters, int contextCount,
+								  void *state);
+static void StoreCitusMemoryContext(MemoryContext context, CitusMemoryCategory category,
+									MemoryContextCounters *counters, int contextCount,
+									void *state);
+static void StoreAllBackendMemoryUsage(Tuplestorestate *tupleStore,
+									   TupleDesc tupleDescriptor);
+
+
+PG_FUNCTION_INFO_V1(citus_memory_usage);
+PG_FUNCTION_INFO_V1(citus_backend_memory_usage);
+
+
+/*
+ * citus_memory_usage returns the memory used by each of the Citus memory
+ * contexts of the current backend, including their child contexts.
+ */
+Datum
+citus_memory_usage(PG_FUNCTION_ARGS)
+{
+	MemoryUsageTupleStore state;
+
+	CheckCitusVersion(ERROR);
+	state.tupleStore = SetupTuplestore(fcinfo, &state.tupleDescriptor);
+
+	WalkCitusMemoryContexts(TopMemoryContext, StoreCitusMemoryContext, &state);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(state.tupleStore);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * citus_backend_memory_usage returns the memory used by Citus per category,
+ * as last reported by each backend on this node.
+ */
+Datum
+citus_backend_memory_usage(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupleDescriptor = NULL;
+
+	CheckCitusVersion(ERROR);
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	StoreAllBackendMemoryUsage(tupleStore, tupleDescriptor);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupleStore);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * StoreAllBackendMemoryUsage writes the reported memory usage of all backends
+ * to the tuple store. Parallel workers share the data of their leader and are
+ * skipped.
+ */
+static void
+StoreAllBackendMemoryUsage(Tuplestorestate *tupleStore, TupleDesc tupleDescriptor)
+{
+	Datum values[CITUS_BACKEND_MEMORY_USAGE_COLUMNS];
+	bool isNulls[CITUS_BACKEND_MEMORY_USAGE_COLUMNS];
+
+	for (int backendIndex = 0; backendIndex < MaxBackends; backendIndex++)
+	{
+		PGPROC *proc = &ProcGlobal->allProcs[backendIndex];
+		BackendData backendData;
+		uint64 totalBytes = 0;
+
+		if (proc->pid == 0 ||
+			(proc->lockGroupLeader != NULL && proc->lockGroupLeader != proc))
+		{
+			continue;
+		}
+
+		GetBackendDataForProc(proc, &backendData);
+
+		CitusMemoryUsage *memoryUsage = &backendData.memoryUsage;
+		if (memoryUsage->reportTime == 0)
+		{
+			continue;
+		}
+
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		values[0] = Int32GetDatum(proc->pid);
+
+		for (int category = 0; category < CITUS_MEMORY_CATEGORY_COUNT; category++)
+		{
+			uint64 categoryBytes = memoryUsage->categoryBytes[category];
+
+			values[1 + category] = Int64GetDatum(categoryBytes);
+			totalBytes += categoryBytes;
+		}
+
+		values[5] = Int64GetDatum(totalBytes);
+		values[6] = TimestampTzGetDatum(memoryUsage->reportTime);
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+}
+
+
+/*
+ * ReportCitusMemoryUsage measures the memory used by the Citus memory contexts
+ * of this backend and stores it in shared memory, unless it was already done
+ * within citus.memory_usage_report_interval. It is called at the end of a
+ * transaction and does not allocate memory.
+ */
+void
+ReportCitusMemoryUsage(void)
+{
+	CitusMemoryUsage memoryUsage;
+
+	if (MemoryUsageReportInterval <= 0 || IsParallelWorker())
+	{
+		return;
+	}
+
+	TimestampTz currentTime = GetCurrentTimestamp();
+	if (!TimestampDifferenceExceeds(LastMemoryUsageReportTime, currentTime,
+									MemoryUsageReportInterval))
+	{
+		return;
+	}
+
+	MeasureCitusMemoryUsage(&memoryUsage);
+	memoryUsage.reportTime = currentTime;
+
+	SetBackendMemoryUsage(&memoryUsage);
+
+	LastMemoryUsageReportTime = currentTime;
+}
+
+
+/*
+ * MeasureCitusMemoryUsage writes the total size of the Citus memory contexts
+ * of this backend per category to memoryUsage.
+ */
+void
+MeasureCitusMemoryUsage(CitusMemoryUsage *memoryUsage)
+{
+	memset(memoryUsage, 0, sizeof(CitusMemoryUsage));
+
+	WalkCitusMemoryContexts(TopMemoryContext, AddCitusMemoryContext, memoryUsage);
+}
+
+
+/*
+ * WalkCitusMemoryContexts calls the visitor for each Citus memory context in
+ * the tree below the given context, with the counters of the context and all
+ * of its children. The children of a Citus memory context are not visited
+ * separately.
+ */
+static void
+WalkCitusMemoryContexts(MemoryContext context, CitusMemoryContextVisitor visitor,
+						void *state)
+{
+	int category = CitusMemoryContextCategory(context);
+
+	if (category >= 0)
+	{
+		MemoryContextCounters counters;
+		int contextCount = 0;
+
+		memset(&counters, 0, sizeof(counters));
+		MeasureMemoryContextTree(context, &counters, &contextCount);
+
+		visitor(context, (CitusMemoryCategory) category, &counters, contextCount,
+				state);
+		return;
+	}
+
+	for (MemoryContext child = context->firstchild; child != NULL;
+		 child = child->nextchild)
+	{
+		WalkCitusMemoryContexts(child, visitor, state);
+	}
+}
+
+
+/*
+ * CitusMemoryContextCategory returns the category of the given memory context
+ * if Citus created it, or -1 otherwise.
+ */
+static int
+CitusMemoryContextCategory(MemoryContext context)
+{
+	if (context->name == NULL)
+	{
+		return -1;
+	}
+
+	for (int nameIndex = 0; nameIndex < lengthof(CitusMemoryContextNames); nameIndex++)
+	{
+		if (strcmp(context->name, CitusMemoryContextNames[nameIndex].name) == 0)
+		{
+			return CitusMemoryContextNames[nameIndex].category;
+		}
+	}
+
+	return -1;
+}
+
+
+/*
+ * MeasureMemoryContextTree adds the memory used by the given memory context
+ * and its children to counters, and the number of contexts to contextCount.
+ */
+static void
+MeasureMemoryContextTree(MemoryContext context, MemoryContextCounters *counters,
+						 int *contextCount)
+{
+	context->methods->stats(context, NULL, NULL, counters);
+	(*contextCount)++;
+
+	for (MemoryContext child = context->firstchild; child != NULL;
+		 child = child->nextchild)
+	{
+		MeasureMemoryContextTree(child, counters, contextCount);
+	}
+}
+
+
+/*
+ * AddCitusMemoryContext adds the total size of a Citus memory context to its
+ * category in the CitusMemoryUsage in state.
+ */
+static void
+AddCitusMemoryContext(MemoryContext context, CitusMemoryCategory category,
+					  MemoryContextCounters *counters, int contextCount, void *state)
+{
+	CitusMemoryUsage *memoryUsage = (CitusMemoryUsage *) state;
+
+	memoryUsage->categoryBytes[category] += counters->totalspace;
+}
+
+
+/*
+ * StoreCitusMemoryContext writes the memory used by a Citus memory context to
+ * the tuple store in state.
+ */
+static void
+StoreCitusMemoryContext(MemoryContext context, CitusMemoryCategory category,
+						MemoryContextCounters *counters, int contextCount, void *state)
+{
+	MemoryUsageTupleStore *usageTupleStore = (MemoryUsageTupleStore *) state;
+	Datum values[CITUS_MEMORY_USAGE_COLUMNS];
+	bool isNulls[CITUS_MEMORY_USAGE_COLUMNS];
+
+	memset(values, 0, sizeof(values));
+	memset(isNulls, false, sizeof(isNulls));
+
+	values[0] = PointerGetDatum(cstring_to_text(context->name));
+	values[1] = PointerGetDatum(cstring_to_text(CitusMemoryCategoryNames[category]));
+	values[2] = Int64GetDatum(counters->totalspace);
+	values[3] = Int64GetDatum(counters->totalspace - counters->freespace);
+	values[4] = Int64GetDatum(counters->freespace);
+	values[5] = Int32GetDatum(contextCount);
+
+	tuplestore_putvalues(usageTupleStore->tupleStore, usageTupleStore->tupleDescriptor,
+						 values, isNulls);
+}
@@ -23,8 +23,17 @@
 #include "nodes/pg_list.h"
 #include "pgstat.h"
 #if PG_VERSION_NUM >= 120000
+#include "nodes/pathnodes.h"
+#include "optimizer/optimizer.h"
 #include "partitioning/partdesc.h"
+#include "utils/partcache.h"
+#else
+#include "nodes/relation.h"
+#include "optimizer/clauses.h"
+#include "optimizer/predtest.h"
 #endif
+#include "partitioning/partbounds.h"
+#include "rewrite/rewriteManip.h"
 #include "utils/builtins.h"
 #include "utils/fmgroids.h"
 #include "utils/lsyscache.h"
@@ -33,6 +42,7 @@
 
 
 static char * PartitionBound(Oid partitionId);
+static List * PartitionBoundConstraintList(Relation parentRelation, Oid partitionId);
 static Relation try_relation_open_nolock(Oid relationId);
 
 
@@ -303,6 +313,115 @@ PartitionList(Oid parentRelationId)
 }
 
 
+/*
+ * PartitionListMatchingRestrictions returns the partitions of the given
+ * partitioned table that may contain rows that satisfy the given restrictions
+ * on the range table entry with the given index, judging by the partition
+ * bounds. Default partitions and partitions of hash partitioned tables are
+ * always returned. Like relation_excluded_by_constraints(), the function
+ * ignores restrictions with mutable functions, since plans may be reused.
+ */
+List *
+PartitionListMatchingRestrictions(Oid parentRelationId, Index rangeTableIndex,
+								  List *restrictInfoList)
+{
+	List *restrictionList = NIL;
+	List *matchingPartitionList = NIL;
+	ListCell *restrictInfoCell = NULL;
+	ListCell *partitionCell = NULL;
+
+	foreach(restrictInfoCell, restrictInfoList)
+	{
+		RestrictInfo *restrictInfo = (RestrictInfo *) lfirst(restrictInfoCell);
+
+		if (!contain_mutable_functions((Node *) restrictInfo->clause))
+		{
+			restrictionList = lappend(restrictionList, restrictInfo->clause);
+		}
+	}
+
+	List *partitionList = PartitionList(parentRelationId);
+	if (restrictionList == NIL)
+	{
+		return partitionList;
+	}
+
+	/* PartitionList() already locked the parent */
+	Relation parentRelation = heap_open(parentRelationId, NoLock);
+	PartitionKey partitionKey = RelationGetPartitionKey(parentRelation);
+
+	if (partitionKey->strategy == PARTITION_STRATEGY_HASH)
+	{
+		heap_close(parentRelation, NoLock);
+		return partitionList;
+	}
+
+	foreach(partitionCell, partitionList)
+	{
+		Oid partitionId = lfirst_oid(partitionCell);
+		List *constraintList = PartitionBoundConstraintList(parentRelation,
+															partitionId);
+
+		if (constraintList != NIL)
+		{
+			/* the constraint refers to the parent as the first range table entry */
+			ChangeVarNodes((Node *) constraintList, 1, rangeTableIndex, 0);
+
+			if (predicate_refuted_by(constraintList, restrictionList, false))
+			{
+				continue;
+			}
+		}
+
+		matchingPartitionList = lappend_oid(matchingPartitionList, partitionId);
+	}
+
+	heap_close(parentRelation, NoLock);
+
+	return matchingPartitionList;
+}
+
+
+/*
+ * PartitionBoundConstraintList returns the implicitly AND'ed constraint that
+ * the bound of the given partition puts on the rows of the partition, in terms
+ * of the columns of the parent. The bound is read from pg_class, such that the
+ * partition does not need to be locked. The function returns NIL for default
+ * partitions, whose constraint depends on the other partitions.
+ */
+static List *
+PartitionBoundConstraintList(Relation parentRelation, Oid partitionId)
+{
+	bool isNull = false;
+
+	HeapTuple tuple = SearchSysCache1(RELOID, ObjectIdGetDatum(partitionId));
+	if (!HeapTupleIsValid(tuple))
+	{
+		elog(ERROR, "cache lookup failed for relation %u", partitionId);
+	}
+
+	Datum boundDatum = SysCacheGetAttr(RELOID, tuple, Anum_pg_class_relpartbound,
+									   &isNull);
+	if (isNull)
+	{
+		ReleaseSysCache(tuple);
+		return NIL;
+	}
+
+	PartitionBoundSpec *boundSpec =
+		castNode(PartitionBoundSpec, stringToNode(TextDatumGetCString(boundDatum)));
+
+	ReleaseSysCache(tuple);
+
+	if (boundSpec->is_default)
+	{
+		return NIL;
+	}
+
+	return get_qual_from_partbound(parentRelation, parentRelation, boundSpec);
+}
+
+
 /*
  * GenerateDetachPartitionCommand gets a partition table and returns
  * "ALTER TABLE parent_table DETACH PARTITION partitionName" command.
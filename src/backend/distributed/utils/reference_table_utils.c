@@ -40,8 +40,19 @@ static void ReplicateSingleShardTableToAllNodes(Oid relationId);
 static void ReplicateShardToAllNodes(ShardInterval *shardInterval);
 static void ReplicateShardToNode(ShardInterval *shardInterval, char *nodeName,
 								 int nodePort);
+static void ReplicateShardListToNode(List *shardIntervalList, char *nodeName,
+									 int nodePort);
+static bool ShardPlacementNeedsReplication(ShardInterval *shardInterval, char *nodeName,
+										   int nodePort,
+										   ShardPlacement **targetPlacement);
+static List * ReplicateShardCommandList(ShardInterval *shardInterval);
+static void MarkShardPlacementReplicated(ShardInterval *shardInterval, char *nodeName,
+										 int nodePort, ShardPlacement *targetPlacement);
 static void ConvertToReferenceTableMetadata(Oid relationId, uint64 shardId);
 
+/* config variable managed via guc.c */
+int MaxReferenceTableCopyConnections = 1;
+
 /* exports for SQL callable functions */
 PG_FUNCTION_INFO_V1(upgrade_to_reference_table);
 
@@ -149,15 +160,30 @@ ReplicateAllReferenceTablesToNode(char *nodeName, int nodePort)
 			BlockWritesToShardList(referenceShardIntervalList);
 		}
 
-		foreach(referenceShardIntervalCell, referenceShardIntervalList)
+		if (MaxReferenceTableCopyConnections > 1)
+		{
+			foreach(referenceShardIntervalCell, referenceShardIntervalList)
+			{
+				ShardInterval *shardInterval = (ShardInterval *) lfirst(
+					referenceShardIntervalCell);
+
+				LockShardDistributionMetadata(shardInterval->shardId, ExclusiveLock);
+			}
+
+			ReplicateShardListToNode(referenceShardIntervalList, nodeName, nodePort);
+		}
+		else
 		{
-			ShardInterval *shardInterval = (ShardInterval *) lfirst(
-				referenceShardIntervalCell);
-			uint64 shardId = shardInterval->shardId;
+			foreach(referenceShardIntervalCell, referenceShardIntervalList)
+			{
+				ShardInterval *shardInterval = (ShardInterval *) lfirst(
+					referenceShardIntervalCell);
+				uint64 shardId = shardInterval->shardId;
 
-			LockShardDistributionMetadata(shardId, ExclusiveLock);
+				LockShardDistributionMetadata(shardId, ExclusiveLock);
 
-			ReplicateShardToNode(shardInterval, nodeName, nodePort);
+				ReplicateShardToNode(shardInterval, nodeName, nodePort);
+			}
 		}
 
 		/* create foreign constraints between reference tables */
@@ -266,71 +292,204 @@ ReplicateShardToAllNodes(ShardInterval *shardInterval)
 static void
 ReplicateShardToNode(ShardInterval *shardInterval, char *nodeName, int nodePort)
 {
-	uint64 shardId = shardInterval->shardId;
+	ShardPlacement *targetPlacement = NULL;
 
-	bool missingOk = false;
-	ShardPlacement *sourceShardPlacement = FinalizedShardPlacement(shardId, missingOk);
-	char *srcNodeName = sourceShardPlacement->nodeName;
-	uint32 srcNodePort = sourceShardPlacement->nodePort;
-	bool includeData = true;
-	List *ddlCommandList =
-		CopyShardCommandList(shardInterval, srcNodeName, srcNodePort, includeData);
+	if (!ShardPlacementNeedsReplication(shardInterval, nodeName, nodePort,
+										&targetPlacement))
+	{
+		return;
+	}
 
-	List *shardPlacementList = ShardPlacementList(shardId);
-	bool missingWorkerOk = true;
-	ShardPlacement *targetPlacement = SearchShardPlacementInList(shardPlacementList,
-																 nodeName, nodePort,
-																 missingWorkerOk);
+	List *ddlCommandList = ReplicateShardCommandList(shardInterval);
 	char *tableOwner = TableOwner(shardInterval->relationId);
 
-	/*
-	 * Although this function is used for reference tables and reference table shard
-	 * placements always have shardState = FILE_FINALIZED, in case of an upgrade of
-	 * a non-reference table to reference table, unhealty placements may exist. In
-	 * this case, we repair the shard placement and update its state in
-	 * pg_dist_placement table.
-	 */
-	if (targetPlacement == NULL || targetPlacement->shardState != FILE_FINALIZED)
+	ereport(NOTICE, (errmsg("Replicating reference table \"%s\" to the node %s:%d",
+							get_rel_name(shardInterval->relationId), nodeName,
+							nodePort)));
+
+	EnsureNoModificationsHaveBeenDone();
+	SendCommandListToWorkerInSingleTransaction(nodeName, nodePort, tableOwner,
+											   ddlCommandList);
+
+	MarkShardPlacementReplicated(shardInterval, nodeName, nodePort, targetPlacement);
+}
+
+
+/*
+ * ReplicateShardListToNode replicates the given shards to the given worker node
+ * like ReplicateShardToNode, but copies the shards over up to
+ * citus.max_reference_table_copy_connections connections in parallel, where
+ * each connection streams the commands of its shards in a single transaction.
+ * Since the commands run as the table owner, the shards of tables with
+ * different owners are copied over different connections.
+ */
+static void
+ReplicateShardListToNode(List *shardIntervalList, char *nodeName, int nodePort)
+{
+	List *tableOwnerList = NIL;
+	List *ownerCommandListList = NIL;
+	List *replicatedShardList = NIL;
+	List *targetPlacementList = NIL;
+	ListCell *shardIntervalCell = NULL;
+	ListCell *tableOwnerCell = NULL;
+	ListCell *commandListCell = NULL;
+	ListCell *targetPlacementCell = NULL;
+
+	foreach(shardIntervalCell, shardIntervalList)
 	{
-		uint64 placementId = 0;
-		int32 groupId = 0;
+		ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
+		ShardPlacement *targetPlacement = NULL;
+		bool ownerFound = false;
+
+		if (!ShardPlacementNeedsReplication(shardInterval, nodeName, nodePort,
+											&targetPlacement))
+		{
+			continue;
+		}
+
+		List *ddlCommandList = ReplicateShardCommandList(shardInterval);
+		char *tableOwner = TableOwner(shardInterval->relationId);
 
 		ereport(NOTICE, (errmsg("Replicating reference table \"%s\" to the node %s:%d",
 								get_rel_name(shardInterval->relationId), nodeName,
 								nodePort)));
 
-		EnsureNoModificationsHaveBeenDone();
-		SendCommandListToWorkerInSingleTransaction(nodeName, nodePort, tableOwner,
-												   ddlCommandList);
-		if (targetPlacement == NULL)
+		forboth(tableOwnerCell, tableOwnerList, commandListCell, ownerCommandListList)
 		{
-			groupId = GroupForNode(nodeName, nodePort);
-
-			placementId = GetNextPlacementId();
-			InsertShardPlacementRow(shardId, placementId, FILE_FINALIZED, 0, groupId);
+			if (strcmp((char *) lfirst(tableOwnerCell), tableOwner) == 0)
+			{
+				lfirst(commandListCell) = lappend((List *) lfirst(commandListCell),
+												  ddlCommandList);
+				ownerFound = true;
+				break;
+			}
 		}
-		else
+
+		if (!ownerFound)
 		{
-			groupId = targetPlacement->groupId;
-			placementId = targetPlacement->placementId;
-			UpdateShardPlacementState(placementId, FILE_FINALIZED);
+			tableOwnerList = lappend(tableOwnerList, tableOwner);
+			ownerCommandListList = lappend(ownerCommandListList,
+										   list_make1(ddlCommandList));
 		}
 
-		/*
-		 * Although ReplicateShardToAllNodes is used only for reference tables,
-		 * during the upgrade phase, the placements are created before the table is
-		 * marked as a reference table. All metadata (including the placement
-		 * metadata) will be copied to workers after all reference table changed
-		 * are finished.
-		 */
-		if (ShouldSyncTableMetadata(shardInterval->relationId))
-		{
-			char *placementCommand = PlacementUpsertCommand(shardId, placementId,
-															FILE_FINALIZED, 0,
-															groupId);
+		replicatedShardList = lappend(replicatedShardList, shardInterval);
+		targetPlacementList = lappend(targetPlacementList, targetPlacement);
+	}
 
-			SendCommandToWorkersWithMetadata(placementCommand);
-		}
+	if (replicatedShardList == NIL)
+	{
+		return;
+	}
+
+	EnsureNoModificationsHaveBeenDone();
+
+	forboth(tableOwnerCell, tableOwnerList, commandListCell, ownerCommandListList)
+	{
+		char *tableOwner = (char *) lfirst(tableOwnerCell);
+		List *commandListList = (List *) lfirst(commandListCell);
+
+		SendCommandListsToWorkerInParallel(nodeName, nodePort, tableOwner,
+										   commandListList,
+										   MaxReferenceTableCopyConnections);
+	}
+
+	forboth(shardIntervalCell, replicatedShardList, targetPlacementCell,
+			targetPlacementList)
+	{
+		ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
+		ShardPlacement *targetPlacement = (ShardPlacement *) lfirst(targetPlacementCell);
+
+		MarkShardPlacementReplicated(shardInterval, nodeName, nodePort,
+									 targetPlacement);
+	}
+}
+
+
+/*
+ * ShardPlacementNeedsReplication returns true if the given node does not have a
+ * healthy placement of the given shard, and sets targetPlacement to the existing
+ * unhealthy placement on the node, if any.
+ *
+ * Although this function is used for reference tables and reference table shard
+ * placements always have shardState = FILE_FINALIZED, in case of an upgrade of
+ * a non-reference table to reference table, unhealty placements may exist. In
+ * this case, we repair the shard placement and update its state in
+ * pg_dist_placement table.
+ */
+static bool
+ShardPlacementNeedsReplication(ShardInterval *shardInterval, char *nodeName,
+							   int nodePort, ShardPlacement **targetPlacement)
+{
+	List *shardPlacementList = ShardPlacementList(shardInterval->shardId);
+	bool missingWorkerOk = true;
+
+	*targetPlacement = SearchShardPlacementInList(shardPlacementList, nodeName,
+												  nodePort, missingWorkerOk);
+
+	return *targetPlacement == NULL ||
+		   (*targetPlacement)->shardState != FILE_FINALIZED;
+}
+
+
+/*
+ * ReplicateShardCommandList returns the commands that create the given shard
+ * on a node and copy its data from a healthy placement.
+ */
+static List *
+ReplicateShardCommandList(ShardInterval *shardInterval)
+{
+	bool missingOk = false;
+	ShardPlacement *sourceShardPlacement =
+		FinalizedShardPlacement(shardInterval->shardId, missingOk);
+	char *srcNodeName = sourceShardPlacement->nodeName;
+	uint32 srcNodePort = sourceShardPlacement->nodePort;
+	bool includeData = true;
+
+	return CopyShardCommandList(shardInterval, srcNodeName, srcNodePort, includeData);
+}
+
+
+/*
+ * MarkShardPlacementReplicated records the placement of the given shard that
+ * was copied to the given node in pg_dist_placement, either by inserting a new
+ * placement or by marking the existing targetPlacement as healthy.
+ */
+static void
+MarkShardPlacementReplicated(ShardInterval *shardInterval, char *nodeName,
+							 int nodePort, ShardPlacement *targetPlacement)
+{
+	uint64 shardId = shardInterval->shardId;
+	uint64 placementId = 0;
+	int32 groupId = 0;
+
+	if (targetPlacement == NULL)
+	{
+		groupId = GroupForNode(nodeName, nodePort);
+
+		placementId = GetNextPlacementId();
+		InsertShardPlacementRow(shardId, placementId, FILE_FINALIZED, 0, groupId);
+	}
+	else
+	{
+		groupId = targetPlacement->groupId;
+		placementId = targetPlacement->placementId;
+		UpdateShardPlacementState(placementId, FILE_FINALIZED);
+	}
+
+	/*
+	 * Although ReplicateShardToAllNodes is used only for reference tables,
+	 * during the upgrade phase, the placements are created before the table is
+	 * marked as a reference table. All metadata (including the placement
+	 * metadata) will be copied to workers after all reference table changed
+	 * are finished.
+	 */
+	if (ShouldSyncTableMetadata(shardInterval->relationId))
+	{
+		char *placementCommand = PlacementUpsertCommand(shardId, placementId,
+														FILE_FINALIZED, 0,
+														groupId);
+
+		SendCommandToWorkersWithMetadata(placementCommand);
 	}
 }
 
@@ -9,6 +9,19 @@
  * advisory locks, but luckily advisory locks only two values for 'field4' in
  * the locktag.
  *
+ * When citus.enable_shard_range_locks is enabled, commands that lock all
+ * shards in a range of SHARD_RANGE_LOCK_SIZE consecutive shard ids take a
+ * single range lock instead of a lock per shard, which keeps multi-shard
+ * commands on tables with many shards from filling the lock table. Every
+ * shard lock is then accompanied by a RowExclusiveLock on the intent lock of
+ * its range for its lock mode. A range lock takes ShareLock on the intent
+ * locks of all lock modes it conflicts with, such that it waits for and
+ * blocks exactly the shard locks that conflict with it.
+ *
+ * citus.enable_table_shard_locks does the same for commands that lock all
+ * shards of a distributed table, such that they take a single lock for the
+ * table. It takes precedence over citus.enable_shard_range_locks.
+ *
  * Copyright (c) Citus Data, Inc.
  *-------------------------------------------------------------------------
  */
@@ -67,11 +80,25 @@ static const struct LockModeToStringType lockmode_to_string_map[] = {
 static const int lock_mode_to_string_map_count = sizeof(lockmode_to_string_map) /
 												 sizeof(lockmode_to_string_map[0]);
 
+/* distributed table of a shard in the array passed to LockShardIdArrayResources */
+typedef struct ShardIdRelation
+{
+	Oid relationId;
+	int shardIdIndex;
+} ShardIdRelation;
+
 
 /* local function forward declarations */
 static LOCKMODE IntToLockMode(int mode);
 static void LockReferencedReferenceShardResources(uint64 shardId, LOCKMODE lockMode);
 static void LockShardListResources(List *shardIntervalList, LOCKMODE lockMode);
+static bool ShardIntentLockTag(uint64 shardId, LOCKMODE lockmode, LOCKTAG *intentTag);
+static void LockShardIdArrayByTable(uint64 *shardIdArray, int shardIdCount,
+									LOCKMODE lockMode);
+static void LockShardRangeResource(uint64 rangeId, LOCKMODE lockMode);
+static void LockTableShardsResource(Oid relationId, LOCKMODE lockMode);
+static int CompareShardIdRelations(const void *leftElement, const void *rightElement);
+static int CompareShardIds(const void *leftElement, const void *rightElement);
 static void LockShardListResourcesOnFirstWorker(LOCKMODE lockmode,
 												List *shardIntervalList);
 static bool IsFirstWorkerNode();
@@ -80,6 +107,11 @@ static void CitusRangeVarCallbackForLockTable(const RangeVar *rangeVar, Oid rela
 static AclResult CitusLockTableAclCheck(Oid relationId, LOCKMODE lockmode, Oid userId);
 
 
+/* config variable managed via guc.c */
+bool EnableShardRangeLocks = false;
+bool EnableTableShardLocks = false;
+
+
 /* exports for SQL callable functions */
 PG_FUNCTION_INFO_V1(lock_shard_metadata);
 PG_FUNCTION_INFO_V1(lock_shard_resources);
@@ -127,8 +159,7 @@ lock_shard_metadata(PG_FUNCTION_ARGS)
  * lock_shard_resources allows shard resources to be locked
  * remotely to serialise non-commutative writes on shards.
  *
- * This function does not sort the array to avoid deadlock, callers
- * must ensure a consistent order.
+ * The shards are locked in order of shard id to avoid deadlock.
  */
 Datum
 lock_shard_resources(PG_FUNCTION_ARGS)
@@ -148,14 +179,15 @@ lock_shard_resources(PG_FUNCTION_ARGS)
 
 	int shardIdCount = ArrayObjectCount(shardIdArrayObject);
 	Datum *shardIdArrayDatum = DeconstructArrayObject(shardIdArrayObject);
+	uint64 *shardIdArray = palloc0(shardIdCount * sizeof(uint64));
 
 	for (int shardIdIndex = 0; shardIdIndex < shardIdCount; shardIdIndex++)
 	{
-		int64 shardId = DatumGetInt64(shardIdArrayDatum[shardIdIndex]);
-
-		LockShardResource(shardId, lockMode);
+		shardIdArray[shardIdIndex] = DatumGetInt64(shardIdArrayDatum[shardIdIndex]);
 	}
 
+	LockShardIdArrayResources(shardIdArray, shardIdCount, lockMode);
+
 	PG_RETURN_VOID();
 }
 
@@ -482,6 +514,14 @@ LockShardResource(uint64 shardId, LOCKMODE lockmode)
 
 	AssertArg(shardId != INVALID_SHARD_ID);
 
+	LOCKTAG intentTag;
+
+	/* block range or table locks that conflict with the shard lock */
+	if (ShardIntentLockTag(shardId, lockmode, &intentTag))
+	{
+		(void) LockAcquire(&intentTag, RowExclusiveLock, sessionLock, dontWait);
+	}
+
 	SET_LOCKTAG_SHARD_RESOURCE(tag, MyDatabaseId, shardId);
 
 	(void) LockAcquire(&tag, lockmode, sessionLock, dontWait);
@@ -498,6 +538,311 @@ UnlockShardResource(uint64 shardId, LOCKMODE lockmode)
 	SET_LOCKTAG_SHARD_RESOURCE(tag, MyDatabaseId, shardId);
 
 	LockRelease(&tag, lockmode, sessionLock);
+
+	LOCKTAG intentTag;
+
+	if (ShardIntentLockTag(shardId, lockmode, &intentTag))
+	{
+		LockRelease(&intentTag, RowExclusiveLock, sessionLock);
+	}
+}
+
+
+/*
+ * ShardIntentLockTag sets intentTag to the intent lock that accompanies a lock
+ * on the given shard in the given mode, and returns whether there is one.
+ */
+static bool
+ShardIntentLockTag(uint64 shardId, LOCKMODE lockmode, LOCKTAG *intentTag)
+{
+	if (EnableTableShardLocks)
+	{
+		Oid relationId = RelationIdForShardIfExists(shardId);
+
+		if (!OidIsValid(relationId))
+		{
+			/* shards without metadata cannot be locked by table */
+			return false;
+		}
+
+		SET_LOCKTAG_TABLE_SHARDS_INTENT(*intentTag, MyDatabaseId, relationId,
+										lockmode);
+
+		return true;
+	}
+	else if (EnableShardRangeLocks)
+	{
+		uint64 rangeId = shardId / SHARD_RANGE_LOCK_SIZE;
+
+		SET_LOCKTAG_SHARD_RANGE_INTENT(*intentTag, MyDatabaseId, rangeId, lockmode);
+
+		return true;
+	}
+
+	return false;
+}
+
+
+/*
+ * LockShardIdArrayResources locks the shards with the given ids in order of
+ * shard id, which sorts the array. When citus.enable_shard_range_locks is
+ * enabled, ranges of the array that contain all SHARD_RANGE_LOCK_SIZE shard
+ * ids of a range are locked with a single range lock. When
+ * citus.enable_table_shard_locks is enabled, all shards of a distributed table
+ * are locked with a single table lock instead.
+ */
+void
+LockShardIdArrayResources(uint64 *shardIdArray, int shardIdCount, LOCKMODE lockMode)
+{
+	int shardIdIndex = 0;
+
+	qsort(shardIdArray, shardIdCount, sizeof(uint64), CompareShardIds);
+
+	if (EnableTableShardLocks)
+	{
+		LockShardIdArrayByTable(shardIdArray, shardIdCount, lockMode);
+		return;
+	}
+
+	while (shardIdIndex < shardIdCount)
+	{
+		uint64 rangeId = shardIdArray[shardIdIndex] / SHARD_RANGE_LOCK_SIZE;
+		int rangeEndIndex = shardIdIndex;
+		int rangeShardCount = 0;
+
+		/* count the distinct shard ids in the range */
+		while (rangeEndIndex < shardIdCount &&
+			   shardIdArray[rangeEndIndex] / SHARD_RANGE_LOCK_SIZE == rangeId)
+		{
+			if (rangeEndIndex == shardIdIndex ||
+				shardIdArray[rangeEndIndex] != shardIdArray[rangeEndIndex - 1])
+			{
+				rangeShardCount++;
+			}
+
+			rangeEndIndex++;
+		}
+
+		if (EnableShardRangeLocks && rangeShardCount == SHARD_RANGE_LOCK_SIZE)
+		{
+			LockShardRangeResource(rangeId, lockMode);
+		}
+		else
+		{
+			for (int lockIndex = shardIdIndex; lockIndex < rangeEndIndex; lockIndex++)
+			{
+				LockShardResource(shardIdArray[lockIndex], lockMode);
+			}
+		}
+
+		shardIdIndex = rangeEndIndex;
+	}
+}
+
+
+/*
+ * LockShardIdArrayByTable locks the shards in the given sorted array of shard
+ * ids, taking a single table lock for the distributed tables of which all
+ * shards are in the array.
+ *
+ * The table lock is taken in the place of the table's shard with the highest
+ * shard id. Shard locks that conflict with it are taken before that shard in
+ * order of shard id, which preserves the deadlock freedom of locking in order
+ * of shard id.
+ */
+static void
+LockShardIdArrayByTable(uint64 *shardIdArray, int shardIdCount, LOCKMODE lockMode)
+{
+	ShardIdRelation *shardIdRelationArray =
+		palloc0(Max(shardIdCount, 1) * sizeof(ShardIdRelation));
+	bool *lockedByTable = palloc0(Max(shardIdCount, 1) * sizeof(bool));
+	Oid *tableLockRelationIds = palloc0(Max(shardIdCount, 1) * sizeof(Oid));
+	int distinctShardIdCount = 0;
+
+	/* remove duplicate shard ids, which would otherwise be counted twice */
+	for (int shardIdIndex = 0; shardIdIndex < shardIdCount; shardIdIndex++)
+	{
+		if (shardIdIndex == 0 ||
+			shardIdArray[shardIdIndex] != shardIdArray[distinctShardIdCount - 1])
+		{
+			shardIdArray[distinctShardIdCount++] = shardIdArray[shardIdIndex];
+		}
+	}
+
+	shardIdCount = distinctShardIdCount;
+
+	for (int shardIdIndex = 0; shardIdIndex < shardIdCount; shardIdIndex++)
+	{
+		shardIdRelationArray[shardIdIndex].relationId =
+			RelationIdForShardIfExists(shardIdArray[shardIdIndex]);
+		shardIdRelationArray[shardIdIndex].shardIdIndex = shardIdIndex;
+	}
+
+	/* group the shards by table, in order of shard id within each table */
+	qsort(shardIdRelationArray, shardIdCount, sizeof(ShardIdRelation),
+		  CompareShardIdRelations);
+
+	int groupStartIndex = 0;
+	while (groupStartIndex < shardIdCount)
+	{
+		Oid relationId = shardIdRelationArray[groupStartIndex].relationId;
+		int groupEndIndex = groupStartIndex;
+
+		while (groupEndIndex < shardIdCount &&
+			   shardIdRelationArray[groupEndIndex].relationId == relationId)
+		{
+			groupEndIndex++;
+		}
+
+		int groupShardCount = groupEndIndex - groupStartIndex;
+
+		/* a table lock only saves locks for tables with multiple shards */
+		if (OidIsValid(relationId) && groupShardCount > 1 &&
+			groupShardCount ==
+			DistributedTableCacheEntry(relationId)->shardIntervalArrayLength)
+		{
+			for (int groupIndex = groupStartIndex; groupIndex < groupEndIndex;
+				 groupIndex++)
+			{
+				lockedByTable[shardIdRelationArray[groupIndex].shardIdIndex] = true;
+			}
+
+			/* take the table lock in the place of its last shard */
+			int lastShardIdIndex = shardIdRelationArray[groupEndIndex - 1].shardIdIndex;
+			tableLockRelationIds[lastShardIdIndex] = relationId;
+		}
+
+		groupStartIndex = groupEndIndex;
+	}
+
+	for (int shardIdIndex = 0; shardIdIndex < shardIdCount; shardIdIndex++)
+	{
+		if (OidIsValid(tableLockRelationIds[shardIdIndex]))
+		{
+			LockTableShardsResource(tableLockRelationIds[shardIdIndex], lockMode);
+		}
+		else if (!lockedByTable[shardIdIndex])
+		{
+			LockShardResource(shardIdArray[shardIdIndex], lockMode);
+		}
+	}
+
+	pfree(shardIdRelationArray);
+	pfree(lockedByTable);
+	pfree(tableLockRelationIds);
+}
+
+
+/*
+ * LockShardRangeResource locks all shards in the given range of shard ids,
+ * with the same effect as locking each of them using LockShardResource.
+ */
+static void
+LockShardRangeResource(uint64 rangeId, LOCKMODE lockMode)
+{
+	LOCKTAG tag;
+	const bool sessionLock = false;
+	const bool dontWait = false;
+
+	/* range locks conflict with each other the way shard locks do */
+	SET_LOCKTAG_SHARD_RANGE_RESOURCE(tag, MyDatabaseId, rangeId);
+
+	(void) LockAcquire(&tag, lockMode, sessionLock, dontWait);
+
+	/* wait for and block the shard locks in the range that conflict */
+	for (LOCKMODE shardLockMode = AccessShareLock;
+		 shardLockMode <= AccessExclusiveLock;
+		 shardLockMode++)
+	{
+		LOCKTAG intentTag;
+
+		if (!DoLockModesConflict(lockMode, shardLockMode))
+		{
+			continue;
+		}
+
+		SET_LOCKTAG_SHARD_RANGE_INTENT(intentTag, MyDatabaseId, rangeId,
+									   shardLockMode);
+
+		(void) LockAcquire(&intentTag, ShareLock, sessionLock, dontWait);
+	}
+}
+
+
+/*
+ * LockTableShardsResource locks all shards of the given distributed table,
+ * with the same effect as locking each of them using LockShardResource.
+ */
+static void
+LockTableShardsResource(Oid relationId, LOCKMODE lockMode)
+{
+	LOCKTAG tag;
+	const bool sessionLock = false;
+	const bool dontWait = false;
+
+	/* table locks conflict with each other the way shard locks do */
+	SET_LOCKTAG_TABLE_SHARDS_RESOURCE(tag, MyDatabaseId, relationId);
+
+	(void) LockAcquire(&tag, lockMode, sessionLock, dontWait);
+
+	/* wait for and block the shard locks of the table that conflict */
+	for (LOCKMODE shardLockMode = AccessShareLock;
+		 shardLockMode <= AccessExclusiveLock;
+		 shardLockMode++)
+	{
+		LOCKTAG intentTag;
+
+		if (!DoLockModesConflict(lockMode, shardLockMode))
+		{
+			continue;
+		}
+
+		SET_LOCKTAG_TABLE_SHARDS_INTENT(intentTag, MyDatabaseId, relationId,
+										shardLockMode);
+
+		(void) LockAcquire(&intentTag, ShareLock, sessionLock, dontWait);
+	}
+}
+
+
+/*
+ * CompareShardIds is a comparator function for sorting an array of shard ids.
+ */
+static int
+CompareShardIds(const void *leftElement, const void *rightElement)
+{
+	uint64 leftShardId = *((const uint64 *) leftElement);
+	uint64 rightShardId = *((const uint64 *) rightElement);
+
+	if (leftShardId > rightShardId)
+	{
+		return 1;
+	}
+	else if (leftShardId < rightShardId)
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * CompareShardIdRelations is a comparator function for sorting an array of
+ * ShardIdRelation structs by relation id, and by position within a relation.
+ */
+static int
+CompareShardIdRelations(const void *leftElement, const void *rightElement)
+{
+	const ShardIdRelation *left = (const ShardIdRelation *) leftElement;
+	const ShardIdRelation *right = (const ShardIdRelation *) rightElement;
+
+	if (left->relationId != right->relationId)
+	{
+		return (left->relationId > right->relationId) ? 1 : -1;
+	}
+
+	return left->shardIdIndex - right->shardIdIndex;
 }
 
 
@@ -627,17 +972,27 @@ static void
 LockShardListResources(List *shardIntervalList, LOCKMODE lockMode)
 {
 	ListCell *shardIntervalCell = NULL;
+	int shardIdCount = list_length(shardIntervalList);
+	int shardIdIndex = 0;
 
-	/* lock shards in order of shard id to prevent deadlock */
-	shardIntervalList = SortList(shardIntervalList, CompareShardIntervalsById);
+	if (shardIdCount == 0)
+	{
+		return;
+	}
+
+	uint64 *shardIdArray = palloc0(shardIdCount * sizeof(uint64));
 
 	foreach(shardIntervalCell, shardIntervalList)
 	{
 		ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
-		int64 shardId = shardInterval->shardId;
 
-		LockShardResource(shardId, lockMode);
+		shardIdArray[shardIdIndex++] = shardInterval->shardId;
 	}
+
+	/* lock shards in order of shard id to prevent deadlock */
+	LockShardIdArrayResources(shardIdArray, shardIdCount, lockMode);
+
+	pfree(shardIdArray);
 }
 
 
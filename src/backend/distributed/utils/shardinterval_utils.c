@@ -11,6 +11,7 @@
 #include "stdint.h"
 #include "postgres.h"
 
+#include "access/hash.h"
 #include "access/nbtree.h"
 #include "catalog/pg_am.h"
 #include "catalog/pg_collation.h"
@@ -23,7 +24,23 @@
 #include "distributed/pg_dist_partition.h"
 #include "distributed/worker_protocol.h"
 #include "utils/catcache.h"
+#include "utils/fmgroids.h"
 #include "utils/memutils.h"
+#include "utils/uuid.h"
+
+
+static int LookupHashTokenShardIndex(int32 hashedValue,
+									 DistTableCacheEntry *cacheEntry);
+static int SearchCachedHashShardInterval(int32 hashedValue, int32 *minValueArray,
+										 int32 *maxValueArray, int shardCount);
+static inline int CompareShardIntervalBound(Datum partitionColumnValue, Datum bound,
+											FmgrInfo *compareFunction,
+											DatumCompareKind compareKind);
+static inline int SearchSortedShardIntervals(Datum partitionColumnValue,
+											 ShardInterval **shardIntervalCache,
+											 int shardCount,
+											 FmgrInfo *compareFunction,
+											 DatumCompareKind compareKind);
 
 
 /*
@@ -240,6 +257,56 @@ ShardIndex(ShardInterval *shardInterval)
 }
 
 
+/*
+ * HashPartitionColumnValue returns the hash of the given distribution column
+ * value using the given hash function, as the hash function itself would.
+ * The hash functions of the common distribution column types are computed
+ * directly, which avoids the overhead of a function call through fmgr for
+ * each row when routing or repartitioning many rows.
+ */
+Datum
+HashPartitionColumnValue(FmgrInfo *hashFunction, Oid collation,
+						 Datum partitionColumnValue)
+{
+	switch (hashFunction->fn_oid)
+	{
+		case F_HASHINT2:
+		{
+			return hash_uint32((int32) DatumGetInt16(partitionColumnValue));
+		}
+
+		case F_HASHINT4:
+		{
+			return hash_uint32(DatumGetInt32(partitionColumnValue));
+		}
+
+		case F_HASHINT8:
+		{
+			/* same as hashint8(), which keeps hashes of equal int4 and int8 values */
+			int64 value = DatumGetInt64(partitionColumnValue);
+			uint32 lowHalf = (uint32) value;
+			uint32 highHalf = (uint32) (value >> 32);
+
+			lowHalf ^= (value >= 0) ? highHalf : ~highHalf;
+
+			return hash_uint32(lowHalf);
+		}
+
+		case F_UUID_HASH:
+		{
+			pg_uuid_t *uuid = DatumGetUUIDP(partitionColumnValue);
+
+			return hash_any(uuid->data, UUID_LEN);
+		}
+
+		default:
+		{
+			return FunctionCall1Coll(hashFunction, collation, partitionColumnValue);
+		}
+	}
+}
+
+
 /*
  * FindShardInterval finds a single shard interval in the cache for the
  * given partition column value. Note that reference tables do not have
@@ -253,9 +320,9 @@ FindShardInterval(Datum partitionColumnValue, DistTableCacheEntry *cacheEntry)
 
 	if (cacheEntry->partitionMethod == DISTRIBUTE_BY_HASH)
 	{
-		searchedValue = FunctionCall1Coll(cacheEntry->hashFunction,
-										  cacheEntry->partitionColumn->varcollid,
-										  partitionColumnValue);
+		searchedValue = HashPartitionColumnValue(cacheEntry->hashFunction,
+												 cacheEntry->partitionColumn->varcollid,
+												 partitionColumnValue);
 	}
 
 	int shardIndex = FindShardIntervalIndex(searchedValue, cacheEntry);
@@ -301,10 +368,18 @@ FindShardIntervalIndex(Datum searchedValue, DistTableCacheEntry *cacheEntry)
 	{
 		if (useBinarySearch)
 		{
-			Assert(compareFunction != NULL);
+			int32 hashedValue = DatumGetInt32(searchedValue);
 
-			shardIndex = SearchCachedShardInterval(searchedValue, shardIntervalCache,
-												   shardCount, compareFunction);
+			if (cacheEntry->hashTokenShardIndexArray != NULL)
+			{
+				shardIndex = LookupHashTokenShardIndex(hashedValue, cacheEntry);
+			}
+			else
+			{
+				shardIndex = SearchCachedHashShardInterval(
+					hashedValue, cacheEntry->sortedShardMinValueArray,
+					cacheEntry->sortedShardMaxValueArray, shardCount);
+			}
 
 			/* we should always return a valid shard index for hash partitioned tables */
 			if (shardIndex == INVALID_SHARD_INDEX)
@@ -371,6 +446,46 @@ FindShardIntervalIndex(Datum searchedValue, DistTableCacheEntry *cacheEntry)
 int
 SearchCachedShardInterval(Datum partitionColumnValue, ShardInterval **shardIntervalCache,
 						  int shardCount, FmgrInfo *compareFunction)
+{
+	/*
+	 * Each call below passes a constant compare kind, such that the compiler
+	 * generates a search loop with inline comparisons for each of them.
+	 */
+	switch (DatumCompareKindForFunction(compareFunction->fn_oid))
+	{
+		case DATUM_COMPARE_INT32:
+		{
+			return SearchSortedShardIntervals(partitionColumnValue, shardIntervalCache,
+											  shardCount, compareFunction,
+											  DATUM_COMPARE_INT32);
+		}
+
+		case DATUM_COMPARE_INT64:
+		{
+			return SearchSortedShardIntervals(partitionColumnValue, shardIntervalCache,
+											  shardCount, compareFunction,
+											  DATUM_COMPARE_INT64);
+		}
+
+		default:
+		{
+			return SearchSortedShardIntervals(partitionColumnValue, shardIntervalCache,
+											  shardCount, compareFunction,
+											  DATUM_COMPARE_FUNCTION);
+		}
+	}
+}
+
+
+/*
+ * SearchSortedShardIntervals performs a binary search for the shard interval
+ * that contains the given value, comparing values as described by the given
+ * compare kind.
+ */
+static pg_attribute_always_inline int
+SearchSortedShardIntervals(Datum partitionColumnValue,
+						   ShardInterval **shardIntervalCache, int shardCount,
+						   FmgrInfo *compareFunction, DatumCompareKind compareKind)
 {
 	int lowerBoundIndex = 0;
 	int upperBoundIndex = shardCount;
@@ -379,25 +494,123 @@ SearchCachedShardInterval(Datum partitionColumnValue, ShardInterval **shardInter
 	{
 		int middleIndex = (lowerBoundIndex + upperBoundIndex) / 2;
 
-		int minValueComparison = FunctionCall2Coll(compareFunction,
-												   DEFAULT_COLLATION_OID,
-												   partitionColumnValue,
-												   shardIntervalCache[middleIndex]->
-												   minValue);
+		int minValueComparison =
+			CompareShardIntervalBound(partitionColumnValue,
+									  shardIntervalCache[middleIndex]->minValue,
+									  compareFunction, compareKind);
 
-		if (DatumGetInt32(minValueComparison) < 0)
+		if (minValueComparison < 0)
 		{
 			upperBoundIndex = middleIndex;
 			continue;
 		}
 
-		int maxValueComparison = FunctionCall2Coll(compareFunction,
-												   DEFAULT_COLLATION_OID,
-												   partitionColumnValue,
-												   shardIntervalCache[middleIndex]->
-												   maxValue);
+		int maxValueComparison =
+			CompareShardIntervalBound(partitionColumnValue,
+									  shardIntervalCache[middleIndex]->maxValue,
+									  compareFunction, compareKind);
+
+		if (maxValueComparison <= 0)
+		{
+			return middleIndex;
+		}
+
+		lowerBoundIndex = middleIndex + 1;
+	}
+
+	return INVALID_SHARD_INDEX;
+}
+
+
+/*
+ * CompareShardIntervalBound compares the given value to a shard interval
+ * bound, inline if the compare kind allows it.
+ */
+static pg_attribute_always_inline int
+CompareShardIntervalBound(Datum partitionColumnValue, Datum bound,
+						  FmgrInfo *compareFunction, DatumCompareKind compareKind)
+{
+	switch (compareKind)
+	{
+		case DATUM_COMPARE_INT32:
+		{
+			return CompareInt32Datums(partitionColumnValue, bound);
+		}
+
+		case DATUM_COMPARE_INT64:
+		{
+			return CompareInt64Datums(partitionColumnValue, bound);
+		}
+
+		default:
+		{
+			Datum comparison = FunctionCall2Coll(compareFunction, DEFAULT_COLLATION_OID,
+												 partitionColumnValue, bound);
+
+			return DatumGetInt32(comparison);
+		}
+	}
+}
+
+
+/*
+ * LookupHashTokenShardIndex finds the index of the shard that contains the
+ * given hash token using the lookup table of the cache entry. The table points
+ * to the first shard that may contain the tokens with the same prefix, and
+ * since the shards rarely end within a token range, the loop below usually
+ * does not advance at all.
+ */
+static int
+LookupHashTokenShardIndex(int32 hashedValue, DistTableCacheEntry *cacheEntry)
+{
+	int32 *minValueArray = cacheEntry->sortedShardMinValueArray;
+	int32 *maxValueArray = cacheEntry->sortedShardMaxValueArray;
+	int shardCount = cacheEntry->shardIntervalArrayLength;
+	uint32 rangeIndex = ((uint32) hashedValue - (uint32) INT32_MIN) >>
+						(32 - HASH_TOKEN_LOOKUP_BITS);
+	int shardIndex = cacheEntry->hashTokenShardIndexArray[rangeIndex];
+
+	while (shardIndex < shardCount && hashedValue > maxValueArray[shardIndex])
+	{
+		shardIndex++;
+	}
+
+	if (shardIndex == shardCount || hashedValue < minValueArray[shardIndex])
+	{
+		/* the token falls into a gap between the shards */
+		return INVALID_SHARD_INDEX;
+	}
+
+	return shardIndex;
+}
+
+
+/*
+ * SearchCachedHashShardInterval is a variant of SearchCachedShardInterval for
+ * hash distributed tables. The shard ranges of these tables are int4 hash
+ * tokens, so they are compared directly instead of through the compare
+ * function, which avoids two function calls per step of the search. The
+ * ranges are read from the contiguous arrays of the cache entry, such that
+ * the search does not dereference a ShardInterval at every step.
+ */
+static int
+SearchCachedHashShardInterval(int32 hashedValue, int32 *minValueArray,
+							  int32 *maxValueArray, int shardCount)
+{
+	int lowerBoundIndex = 0;
+	int upperBoundIndex = shardCount;
+
+	while (lowerBoundIndex < upperBoundIndex)
+	{
+		int middleIndex = (lowerBoundIndex + upperBoundIndex) / 2;
+
+		if (hashedValue < minValueArray[middleIndex])
+		{
+			upperBoundIndex = middleIndex;
+			continue;
+		}
 
-		if (DatumGetInt32(maxValueComparison) <= 0)
+		if (hashedValue <= maxValueArray[middleIndex])
 		{
 			return middleIndex;
 		}
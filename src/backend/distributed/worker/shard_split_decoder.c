@@ -0,0 +1,500 @@
+/*-------------------------------------------------------------------------
+ *
+ * shard_split_decoder.c
+ *
+ * This file implements the logical decoding output plugin that replicates
+ * the changes made to a shard that is being split into the new shards that
+ * replace it, while writes to the shard continue. The plugin wraps pgoutput,
+ * the output plugin of built-in logical replication: a change to the split
+ * shard is handed to pgoutput as a change to the new shard whose hash range
+ * covers the distribution column value of the changed row, such that the
+ * subscription on the node of the new shard applies it there. Changes that
+ * no route covers, including the changes that subscriptions apply to the new
+ * shards on this node, are skipped.
+ *
+ * The routes from split shards to new shards are kept in shared memory per
+ * replication slot. The coordinator adds them with worker_split_shard_add_route
+ * before it creates the slot and removes them once the split is done. New
+ * shards on other nodes need an empty table with the same name on the node of
+ * the split shard, since pgoutput describes changes using the local table.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "miscadmin.h"
+
+#include "access/htup_details.h"
+#include "access/tupconvert.h"
+#include "distributed/master_metadata_utility.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/shard_split_decoder.h"
+#include "distributed/version_compat.h"
+#include "replication/logical.h"
+#include "replication/reorderbuffer.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/relcache.h"
+#include "utils/typcache.h"
+
+
+/*
+ * ShardSplitRoute routes the changes to the rows of a split shard whose
+ * distribution column value hashes into the given range to a new shard.
+ */
+typedef struct ShardSplitRoute
+{
+	/* replication slot that decodes the changes, empty if the entry is free */
+	char slotName[NAMEDATALEN];
+	Oid databaseId;
+
+	Oid sourceRelationId;
+	Oid targetRelationId;
+	AttrNumber distributionColumnAttrNumber;
+	int32 minHashValue;
+	int32 maxHashValue;
+} ShardSplitRoute;
+
+
+/* shared memory state of the shard split routes */
+typedef struct ShardSplitDecoderSharedState
+{
+	int trancheId;
+	char *lockTrancheName;
+
+	/* lock protecting the routes */
+	LWLock lock;
+
+	ShardSplitRoute routes[MAX_SHARD_SPLIT_ROUTES];
+} ShardSplitDecoderSharedState;
+
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static ShardSplitDecoderSharedState *DecoderSharedState = NULL;
+
+/* callbacks of pgoutput, which sends the routed changes */
+static OutputPluginCallbacks PgOutputCallbacks;
+
+/* routes of the replication slot that the current process decodes */
+static ShardSplitRoute *SlotRoutes = NULL;
+static int SlotRouteCount = 0;
+
+/* memory context for routing a single change, reset after each change */
+static MemoryContext RouteChangeContext = NULL;
+
+
+/* local function forward declarations */
+static size_t ShardSplitDecoderShmemSize(void);
+static void ShardSplitDecoderShmemInit(void);
+static void ShardSplitDecoderStartup(LogicalDecodingContext *ctx,
+									 OutputPluginOptions *options, bool isInit);
+static void ShardSplitDecoderChange(LogicalDecodingContext *ctx,
+									ReorderBufferTXN *txn, Relation relation,
+									ReorderBufferChange *change);
+static void LoadSlotRoutes(const char *slotName, MemoryContext context);
+static ShardSplitRoute * FindSlotRoute(Relation relation, HeapTuple tuple);
+static ReorderBufferTupleBuf * ConvertRoutedTuple(ReorderBufferTupleBuf *tupleBuffer,
+												  TupleConversionMap *conversionMap);
+
+
+/* declarations for dynamic loading */
+PG_FUNCTION_INFO_V1(worker_split_shard_add_route);
+PG_FUNCTION_INFO_V1(worker_split_shard_remove_routes);
+
+
+/*
+ * InitializeShardSplitDecoder, called at server start, requests the shared
+ * memory for the shard split routes.
+ */
+void
+InitializeShardSplitDecoder(void)
+{
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(ShardSplitDecoderShmemSize());
+	}
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = ShardSplitDecoderShmemInit;
+}
+
+
+/*
+ * ShardSplitDecoderShmemSize computes how much shared memory is required.
+ */
+static size_t
+ShardSplitDecoderShmemSize(void)
+{
+	return sizeof(ShardSplitDecoderSharedState);
+}
+
+
+/*
+ * ShardSplitDecoderShmemInit initializes the shared memory of the shard split
+ * routes.
+ */
+static void
+ShardSplitDecoderShmemInit(void)
+{
+	bool alreadyInitialized = false;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	DecoderSharedState =
+		(ShardSplitDecoderSharedState *) ShmemInitStruct("Citus Shard Split Routes",
+														 ShardSplitDecoderShmemSize(),
+														 &alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		DecoderSharedState->trancheId = LWLockNewTrancheId();
+		DecoderSharedState->lockTrancheName = "Citus Shard Split Routes";
+		LWLockRegisterTranche(DecoderSharedState->trancheId,
+							  DecoderSharedState->lockTrancheName);
+
+		LWLockInitialize(&DecoderSharedState->lock, DecoderSharedState->trancheId);
+
+		memset(DecoderSharedState->routes, 0, sizeof(DecoderSharedState->routes));
+	}
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+/*
+ * worker_split_shard_add_route routes the changes that the given replication
+ * slot decodes for the rows of the given split shard whose distribution
+ * column value hashes into the given range to the given new shard.
+ */
+Datum
+worker_split_shard_add_route(PG_FUNCTION_ARGS)
+{
+	text *slotNameText = PG_GETARG_TEXT_P(0);
+	Oid sourceRelationId = PG_GETARG_OID(1);
+	Oid targetRelationId = PG_GETARG_OID(2);
+	text *columnNameText = PG_GETARG_TEXT_P(3);
+	int32 minHashValue = PG_GETARG_INT32(4);
+	int32 maxHashValue = PG_GETARG_INT32(5);
+	ShardSplitRoute *freeRoute = NULL;
+
+	CheckCitusVersion(ERROR);
+	EnsureSuperUser();
+
+	char *slotName = text_to_cstring(slotNameText);
+	if (strlen(slotName) >= NAMEDATALEN)
+	{
+		ereport(ERROR, (errcode(ERRCODE_NAME_TOO_LONG),
+						errmsg("replication slot name \"%s\" is too long", slotName)));
+	}
+
+	char *columnName = text_to_cstring(columnNameText);
+	AttrNumber attributeNumber = get_attnum(sourceRelationId, columnName);
+	if (attributeNumber == InvalidAttrNumber)
+	{
+		ereport(ERROR, (errcode(ERRCODE_UNDEFINED_COLUMN),
+						errmsg("column \"%s\" of relation \"%s\" does not exist",
+							   columnName, get_rel_name(sourceRelationId))));
+	}
+
+	LWLockAcquire(&DecoderSharedState->lock, LW_EXCLUSIVE);
+
+	for (int routeIndex = 0; routeIndex < MAX_SHARD_SPLIT_ROUTES; routeIndex++)
+	{
+		ShardSplitRoute *route = &DecoderSharedState->routes[routeIndex];
+
+		if (route->slotName[0] == '\0')
+		{
+			freeRoute = route;
+			break;
+		}
+	}
+
+	if (freeRoute == NULL)
+	{
+		LWLockRelease(&DecoderSharedState->lock);
+
+		ereport(ERROR, (errcode(ERRCODE_CONFIGURATION_LIMIT_EXCEEDED),
+						errmsg("too many shard split routes on this node"),
+						errdetail("Shard splits on a node can use at most %d "
+								  "routes at the same time.",
+								  MAX_SHARD_SPLIT_ROUTES)));
+	}
+
+	strlcpy(freeRoute->slotName, slotName, NAMEDATALEN);
+	freeRoute->databaseId = MyDatabaseId;
+	freeRoute->sourceRelationId = sourceRelationId;
+	freeRoute->targetRelationId = targetRelationId;
+	freeRoute->distributionColumnAttrNumber = attributeNumber;
+	freeRoute->minHashValue = minHashValue;
+	freeRoute->maxHashValue = maxHashValue;
+
+	LWLockRelease(&DecoderSharedState->lock);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * worker_split_shard_remove_routes removes the routes of the given replication
+ * slot.
+ */
+Datum
+worker_split_shard_remove_routes(PG_FUNCTION_ARGS)
+{
+	char *slotName = text_to_cstring(PG_GETARG_TEXT_P(0));
+
+	CheckCitusVersion(ERROR);
+	EnsureSuperUser();
+
+	LWLockAcquire(&DecoderSharedState->lock, LW_EXCLUSIVE);
+
+	for (int routeIndex = 0; routeIndex < MAX_SHARD_SPLIT_ROUTES; routeIndex++)
+	{
+		ShardSplitRoute *route = &DecoderSharedState->routes[routeIndex];
+
+		if (route->databaseId == MyDatabaseId &&
+			strncmp(route->slotName, slotName, NAMEDATALEN) == 0)
+		{
+			memset(route, 0, sizeof(ShardSplitRoute));
+		}
+	}
+
+	LWLockRelease(&DecoderSharedState->lock);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * _PG_output_plugin_init is called when a replication slot that uses the
+ * citus output plugin is created or decoded. It sets up the callbacks of
+ * pgoutput, and replaces the ones that need to know about shard splits.
+ */
+void
+_PG_output_plugin_init(OutputPluginCallbacks *callbacks)
+{
+	LogicalOutputPluginInit pgoutputInit =
+		(LogicalOutputPluginInit) load_external_function("pgoutput",
+														 "_PG_output_plugin_init",
+														 false, NULL);
+
+	pgoutputInit(callbacks);
+
+	PgOutputCallbacks = *callbacks;
+
+	callbacks->startup_cb = ShardSplitDecoderStartup;
+	callbacks->change_cb = ShardSplitDecoderChange;
+}
+
+
+/*
+ * ShardSplitDecoderStartup starts pgoutput and loads the routes of the
+ * replication slot. The coordinator adds the routes before it creates the
+ * slot, so they are known when decoding starts.
+ */
+static void
+ShardSplitDecoderStartup(LogicalDecodingContext *ctx, OutputPluginOptions *options,
+						 bool isInit)
+{
+	PgOutputCallbacks.startup_cb(ctx, options, isInit);
+
+	RouteChangeContext = AllocSetContextCreate(ctx->context,
+											   "Shard Split Route Context",
+											   ALLOCSET_DEFAULT_SIZES);
+
+	LoadSlotRoutes(NameStr(ctx->slot->data.name), ctx->context);
+}
+
+
+/*
+ * ShardSplitDecoderChange hands a change to a split shard to pgoutput as a
+ * change to the new shard that covers the changed row, after converting the
+ * row to the row type of the new shard. The new shard was created without
+ * the dropped columns of the split shard, so their attribute numbers may
+ * differ. Other changes are skipped.
+ */
+static void
+ShardSplitDecoderChange(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
+						Relation relation, ReorderBufferChange *change)
+{
+	ReorderBufferTupleBuf *routingTuple = NULL;
+
+	/* rows are routed by their new value, the distribution column is immutable */
+	switch (change->action)
+	{
+		case REORDER_BUFFER_CHANGE_INSERT:
+		case REORDER_BUFFER_CHANGE_UPDATE:
+		{
+			routingTuple = change->data.tp.newtuple;
+			break;
+		}
+
+		case REORDER_BUFFER_CHANGE_DELETE:
+		{
+			routingTuple = change->data.tp.oldtuple;
+			break;
+		}
+
+		default:
+		{
+			return;
+		}
+	}
+
+	if (routingTuple == NULL)
+	{
+		return;
+	}
+
+	ShardSplitRoute *route = FindSlotRoute(relation, &routingTuple->tuple);
+	if (route == NULL)
+	{
+		return;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(RouteChangeContext);
+
+	Relation targetRelation = RelationIdGetRelation(route->targetRelationId);
+	if (!RelationIsValid(targetRelation))
+	{
+		ereport(ERROR, (errmsg("could not open relation with OID %u",
+							   route->targetRelationId)));
+	}
+
+	TupleConversionMap *conversionMap =
+		convert_tuples_by_name(RelationGetDescr(relation),
+							   RelationGetDescr(targetRelation),
+							   gettext_noop("could not convert row type"));
+
+	ReorderBufferChange routedChange = *change;
+	routedChange.data.tp.newtuple = ConvertRoutedTuple(change->data.tp.newtuple,
+													   conversionMap);
+	routedChange.data.tp.oldtuple = ConvertRoutedTuple(change->data.tp.oldtuple,
+													   conversionMap);
+
+	PgOutputCallbacks.change_cb(ctx, txn, targetRelation, &routedChange);
+
+	RelationClose(targetRelation);
+
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextReset(RouteChangeContext);
+}
+
+
+/*
+ * LoadSlotRoutes copies the routes of the given replication slot from shared
+ * memory into the given memory context.
+ */
+static void
+LoadSlotRoutes(const char *slotName, MemoryContext context)
+{
+	SlotRoutes = MemoryContextAllocZero(context, MAX_SHARD_SPLIT_ROUTES *
+										sizeof(ShardSplitRoute));
+	SlotRouteCount = 0;
+
+	LWLockAcquire(&DecoderSharedState->lock, LW_SHARED);
+
+	for (int routeIndex = 0; routeIndex < MAX_SHARD_SPLIT_ROUTES; routeIndex++)
+	{
+		ShardSplitRoute *route = &DecoderSharedState->routes[routeIndex];
+
+		if (route->databaseId == MyDatabaseId &&
+			strncmp(route->slotName, slotName, NAMEDATALEN) == 0)
+		{
+			SlotRoutes[SlotRouteCount] = *route;
+			SlotRouteCount++;
+		}
+	}
+
+	LWLockRelease(&DecoderSharedState->lock);
+}
+
+
+/*
+ * FindSlotRoute returns the route of the current replication slot for the
+ * given row of the given relation, or NULL if there is none.
+ */
+static ShardSplitRoute *
+FindSlotRoute(Relation relation, HeapTuple tuple)
+{
+	Oid relationId = RelationGetRelid(relation);
+	TupleDesc tupleDescriptor = RelationGetDescr(relation);
+	bool hashValueComputed = false;
+	int32 hashValue = 0;
+
+	for (int routeIndex = 0; routeIndex < SlotRouteCount; routeIndex++)
+	{
+		ShardSplitRoute *route = &SlotRoutes[routeIndex];
+
+		if (route->sourceRelationId != relationId)
+		{
+			continue;
+		}
+
+		if (!hashValueComputed)
+		{
+			AttrNumber attributeNumber = route->distributionColumnAttrNumber;
+			Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor,
+														attributeNumber - 1);
+			bool isNull = false;
+
+			Datum partitionValue = heap_getattr(tuple, attributeNumber,
+												tupleDescriptor, &isNull);
+			if (isNull)
+			{
+				return NULL;
+			}
+
+			TypeCacheEntry *typeEntry = lookup_type_cache(attribute->atttypid,
+														  TYPECACHE_HASH_PROC_FINFO);
+
+			hashValue = DatumGetInt32(FunctionCall1Coll(&typeEntry->hash_proc_finfo,
+														attribute->attcollation,
+														partitionValue));
+			hashValueComputed = true;
+		}
+
+		if (hashValue >= route->minHashValue && hashValue <= route->maxHashValue)
+		{
+			return route;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * ConvertRoutedTuple returns the given decoded row converted using the given
+ * map, or the row itself if no conversion is needed.
+ */
+static ReorderBufferTupleBuf *
+ConvertRoutedTuple(ReorderBufferTupleBuf *tupleBuffer,
+				   TupleConversionMap *conversionMap)
+{
+	if (tupleBuffer == NULL || conversionMap == NULL)
+	{
+		return tupleBuffer;
+	}
+
+	HeapTuple convertedTuple = execute_attr_map_tuple(&tupleBuffer->tuple,
+													  conversionMap);
+
+	ReorderBufferTupleBuf *convertedBuffer = palloc0(sizeof(ReorderBufferTupleBuf));
+	convertedBuffer->tuple = *convertedTuple;
+
+	return convertedBuffer;
+}
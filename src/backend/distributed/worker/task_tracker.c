@@ -3,8 +3,9 @@
  * task_tracker.c
  *
  * The task tracker background process runs on every worker node. The process
- * wakes up at regular intervals, reads information from a shared hash, and
- * checks if any new tasks are assigned to this node. If they are, the process
+ * wakes up when a task is assigned or a running task's results arrive, and at
+ * regular intervals otherwise. It then reads information from a shared hash,
+ * and checks if any new tasks are assigned to this node. If they are, the process
  * runs task-specific logic, and sends queries to the postmaster for execution.
  * The task tracker then tracks the execution of these queries, and updates the
  * shared hash with task progress information.
@@ -27,9 +28,11 @@
 
 #include "postgres.h"
 #include "miscadmin.h"
+#include "pgstat.h"
 #include <unistd.h>
 
 #include "commands/dbcommands.h"
+#include "distributed/deferred_cleanup.h"
 #include "distributed/multi_client_executor.h"
 #include "distributed/multi_server_executor.h"
 #include "distributed/task_tracker.h"
@@ -38,11 +41,13 @@
 #include "distributed/version_compat.h"
 #include "libpq/hba.h"
 #include "libpq/pqsignal.h"
+#include "lib/binaryheap.h"
 #include "lib/stringinfo.h"
 #include "postmaster/bgworker.h"
 #include "postmaster/postmaster.h"
 #include "storage/fd.h"
 #include "storage/ipc.h"
+#include "storage/latch.h"
 #include "storage/lwlock.h"
 #include "storage/pmsignal.h"
 #include "storage/proc.h"
@@ -80,13 +85,11 @@ static void TrackerCleanupJobSchemas(void);
 static void TrackerCleanupConnections(HTAB *WorkerTasksHash);
 static void TrackerRegisterShutDown(HTAB *WorkerTasksHash);
 static void TrackerDelayLoop(void);
+static List * RunningTaskSocketList(HTAB *WorkerTasksHash);
 static List * SchedulableTaskList(HTAB *WorkerTasksHash);
-static WorkerTask * SchedulableTaskPriorityQueue(HTAB *WorkerTasksHash);
-static uint32 CountTasksMatchingCriteria(HTAB *WorkerTasksHash,
-										 bool (*CriteriaFunction)(WorkerTask *));
 static bool RunningTask(WorkerTask *workerTask);
 static bool SchedulableTask(WorkerTask *workerTask);
-static int CompareTasksByTime(const void *first, const void *second);
+static int CompareTasksByTime(Datum first, Datum second, void *arg);
 static void ScheduleWorkerTasks(HTAB *WorkerTasksHash, List *schedulableTaskList);
 static void ManageWorkerTasksHash(HTAB *WorkerTasksHash);
 static void ManageWorkerTask(WorkerTask *workerTask, HTAB *WorkerTasksHash);
@@ -207,6 +210,9 @@ TaskTrackerMain(Datum main_arg)
 	/* We can now handle ereport(ERROR) */
 	PG_exception_stack = &local_sigjmp_buf;
 
+	/* let the task tracker protocol functions wake us up on new tasks */
+	WorkerTasksSharedState->taskTrackerLatch = MyLatch;
+
 	/*
 	 * We run validation and cache cleanup functions as this process is starting
 	 * up. If these functions throw an error, we won't try running them again.
@@ -228,11 +234,6 @@ TaskTrackerMain(Datum main_arg)
 		/*
 		 * Emergency bailout if postmaster has died. This is to avoid the
 		 * necessity for manual cleanup of all postmaster children.
-		 *
-		 * XXX: Note that PostgreSQL background processes no longer nap between
-		 * their loops, but instead uses latches to wake up when necessary. We
-		 * should switch to using latches in here too, and have the task tracker
-		 * assign function notify us when there is a new task.
 		 */
 		if (!PostmasterIsAlive())
 		{
@@ -255,6 +256,9 @@ TaskTrackerMain(Datum main_arg)
 			 */
 			ExitOnAnyError = true;
 
+			/* no one should wake us up from here on */
+			WorkerTasksSharedState->taskTrackerLatch = NULL;
+
 			/* Close open connections to local backends */
 			TrackerCleanupConnections(TaskTrackerTaskHash);
 
@@ -268,7 +272,7 @@ TaskTrackerMain(Datum main_arg)
 		/* Call the function that does the actual work */
 		ManageWorkerTasksHash(TaskTrackerTaskHash);
 
-		/* Sleep for the configured time */
+		/* Sleep until there is new work, or for the configured time */
 		TrackerDelayLoop();
 	}
 }
@@ -336,7 +340,8 @@ WorkerTasksHashFind(uint64 jobId, uint32 taskId)
  * both tasks in the shared hash and these tasks' output files. When the task
  * tracker needs to shutdown, all shared hash entries are deleted, but the
  * associated files cannot be cleaned up safely. We therefore perform this
- * cleanup when the process restarts.
+ * cleanup when the process restarts. With deferred cleanup, the directory is
+ * moved aside and its files are removed by the maintenance daemon.
  */
 static void
 TrackerCleanupJobDirectories(void)
@@ -345,7 +350,7 @@ TrackerCleanupJobDirectories(void)
 	StringInfo jobCacheDirectory = makeStringInfo();
 	appendStringInfo(jobCacheDirectory, "base/%s", PG_JOB_CACHE_DIR);
 
-	CitusRemoveDirectory(jobCacheDirectory);
+	DeferredRemoveDirectory(jobCacheDirectory);
 	CitusCreateDirectory(jobCacheDirectory);
 
 	FreeStringInfo(jobCacheDirectory);
@@ -461,30 +466,104 @@ TrackerRegisterShutDown(HTAB *WorkerTasksHash)
 }
 
 
-/* Sleeps either for the configured time or until a signal is received. */
+/*
+ * TrackerDelayLoop sleeps until the configured time passes, a signal or a task
+ * assignment sets our latch, or one of the local backends running a task sends
+ * us its results. This way, we react to new and completed tasks right away and
+ * only fall back to the configured delay when nothing happens.
+ */
 static void
 TrackerDelayLoop(void)
 {
-	const long SignalCheckInterval = 1000000L; /* check signal every second */
+	List *socketList = RunningTaskSocketList(TaskTrackerTaskHash);
+	ListCell *socketCell = NULL;
 
-	/*
-	 * On some platforms, signals do not interrupt the sleep. To ensure we
-	 * respond promptly when someone signals us, we break down the sleep into
-	 * 1-second increments, and check for interrupts after each nap.
-	 */
-	long trackerDelay = TaskTrackerDelay * 1000L;
-	while (trackerDelay > (SignalCheckInterval - 1))
+	/* additional 2 is for postmaster and latch */
+	int eventSetSize = list_length(socketList) + 2;
+	WaitEventSet *waitEventSet = CreateWaitEventSet(CurrentMemoryContext,
+													eventSetSize);
+	WaitEvent *events = palloc0(eventSetSize * sizeof(WaitEvent));
+
+	AddWaitEventToSet(waitEventSet, WL_POSTMASTER_DEATH, PGINVALID_SOCKET, NULL, NULL);
+	AddWaitEventToSet(waitEventSet, WL_LATCH_SET, PGINVALID_SOCKET, MyLatch, NULL);
+
+	foreach(socketCell, socketList)
 	{
-		if (got_SIGHUP || got_SIGTERM)
+		int socket = lfirst_int(socketCell);
+
+		AddWaitEventToSet(waitEventSet, WL_SOCKET_READABLE, socket, NULL, NULL);
+	}
+
+	int eventCount = WaitEventSetWait(waitEventSet, TaskTrackerDelay, events,
+									  eventSetSize, PG_WAIT_EXTENSION);
+
+	for (int eventIndex = 0; eventIndex < eventCount; eventIndex++)
+	{
+		if (events[eventIndex].events & WL_POSTMASTER_DEATH)
 		{
-			break;
+			exit(1);
+		}
+	}
+
+	ResetLatch(MyLatch);
+
+	FreeWaitEventSet(waitEventSet);
+	pfree(events);
+	list_free(socketList);
+}
+
+
+/*
+ * RunningTaskSocketList returns the sockets of the connections over which the
+ * running tasks in the shared hash wait for their results.
+ */
+static List *
+RunningTaskSocketList(HTAB *WorkerTasksHash)
+{
+	List *socketList = NIL;
+	HASH_SEQ_STATUS status;
+
+	LWLockAcquire(&WorkerTasksSharedState->taskHashLock, LW_SHARED);
+
+	hash_seq_init(&status, WorkerTasksHash);
+
+	WorkerTask *currentTask = (WorkerTask *) hash_seq_search(&status);
+	while (currentTask != NULL)
+	{
+		bool waitingForResult = (currentTask->taskStatus == TASK_RUNNING ||
+								 currentTask->taskStatus == TASK_CANCEL_REQUESTED);
+
+		if (waitingForResult && currentTask->connectionId != INVALID_CONNECTION_ID)
+		{
+			int socket = MultiClientSocket(currentTask->connectionId);
+			if (socket != -1)
+			{
+				socketList = lappend_int(socketList, socket);
+			}
 		}
-		pg_usleep(SignalCheckInterval);
-		trackerDelay -= SignalCheckInterval;
+
+		currentTask = (WorkerTask *) hash_seq_search(&status);
 	}
-	if (!(got_SIGHUP || got_SIGTERM))
+
+	LWLockRelease(&WorkerTasksSharedState->taskHashLock);
+
+	return socketList;
+}
+
+
+/*
+ * WakeupTaskTracker sets the latch of the task tracker process, if it runs, so
+ * that the tracker picks up changes to the shared hash without waiting for its
+ * configured delay. Callers should release the shared hash lock beforehand.
+ */
+void
+WakeupTaskTracker(void)
+{
+	Latch *taskTrackerLatch = WorkerTasksSharedState->taskTrackerLatch;
+
+	if (taskTrackerLatch != NULL)
 	{
-		pg_usleep(trackerDelay);
+		SetLatch(taskTrackerLatch);
 	}
 }
 
@@ -586,6 +665,7 @@ TaskTrackerShmemInit(void)
 						 WorkerTasksSharedState->taskHashTrancheId);
 
 		WorkerTasksSharedState->conninfosValid = true;
+		WorkerTasksSharedState->taskTrackerLatch = NULL;
 	}
 
 	/*  allocate hash table */
@@ -615,123 +695,87 @@ TaskTrackerShmemInit(void)
  * in the list are sorted according to a priority criteria, currently the task's
  * assignment time. Note that this function expects the caller to hold a read
  * lock over the shared hash.
+ *
+ * At most MaxRunningTasksPerNode tasks can be scheduled at once, so instead of
+ * sorting all schedulable tasks, we count the running tasks and keep only the
+ * earliest assigned schedulable tasks in a bounded heap in a single pass over
+ * the shared hash. The heap references the tasks in the shared hash, which is
+ * safe since we hold the lock until we copy the tasks.
  */
 static List *
 SchedulableTaskList(HTAB *WorkerTasksHash)
 {
+	HASH_SEQ_STATUS status;
 	List *schedulableTaskList = NIL;
+	uint32 runningTaskCount = 0;
 
-	uint32 runningTaskCount = CountTasksMatchingCriteria(WorkerTasksHash, &RunningTask);
-	if (runningTaskCount >= MaxRunningTasksPerNode)
+	long trackedTaskCount = hash_get_num_entries(WorkerTasksHash);
+	if (trackedTaskCount == 0)
 	{
-		return NIL;  /* we already have enough tasks running */
+		return NIL;  /* we do not have any tasks */
 	}
 
-	uint32 schedulableTaskCount = CountTasksMatchingCriteria(WorkerTasksHash,
-															 &SchedulableTask);
-	if (schedulableTaskCount == 0)
-	{
-		return NIL;  /* we do not have any new tasks to schedule */
-	}
+	int heapCapacity = (int) Min((long) MaxRunningTasksPerNode, trackedTaskCount);
 
-	uint32 tasksToScheduleCount = MaxRunningTasksPerNode - runningTaskCount;
-	if (tasksToScheduleCount > schedulableTaskCount)
-	{
-		tasksToScheduleCount = schedulableTaskCount;
-	}
+	/* the task with the latest assignment time is at the top of the heap */
+	binaryheap *schedulableTaskHeap = binaryheap_allocate(heapCapacity,
+														  CompareTasksByTime, NULL);
 
-	/* get all schedulable tasks ordered according to a priority criteria */
-	WorkerTask *schedulableTaskQueue = SchedulableTaskPriorityQueue(WorkerTasksHash);
-
-	for (uint32 queueIndex = 0; queueIndex < tasksToScheduleCount; queueIndex++)
-	{
-		WorkerTask *schedulableTask = (WorkerTask *) palloc0(WORKER_TASK_SIZE);
-		WorkerTask *queuedTask = WORKER_TASK_AT(schedulableTaskQueue, queueIndex);
-		schedulableTask->jobId = queuedTask->jobId;
-		schedulableTask->taskId = queuedTask->taskId;
-
-		schedulableTaskList = lappend(schedulableTaskList, schedulableTask);
-	}
-
-	/* free priority queue */
-	pfree(schedulableTaskQueue);
-
-	return schedulableTaskList;
-}
-
-
-/*
- * SchedulableTaskPriorityQueue allocates an array containing all schedulable
- * tasks in the shared hash, orders these tasks according to a sorting criteria,
- * and returns the sorted array.
- */
-static WorkerTask *
-SchedulableTaskPriorityQueue(HTAB *WorkerTasksHash)
-{
-	HASH_SEQ_STATUS status;
-	uint32 queueIndex = 0;
-
-	/* our priority queue size equals to the number of schedulable tasks */
-	uint32 queueSize = CountTasksMatchingCriteria(WorkerTasksHash, &SchedulableTask);
-	if (queueSize == 0)
-	{
-		return NULL;
-	}
-
-	/* allocate an array of tasks for our priority queue */
-	WorkerTask *priorityQueue = (WorkerTask *) palloc0(WORKER_TASK_SIZE * queueSize);
-
-	/* copy tasks in the shared hash to the priority queue */
 	hash_seq_init(&status, WorkerTasksHash);
 
 	WorkerTask *currentTask = (WorkerTask *) hash_seq_search(&status);
 	while (currentTask != NULL)
 	{
-		if (SchedulableTask(currentTask))
+		if (RunningTask(currentTask))
 		{
-			/* tasks in the priority queue only need the first three fields */
-			WorkerTask *queueTask = WORKER_TASK_AT(priorityQueue, queueIndex);
-
-			queueTask->jobId = currentTask->jobId;
-			queueTask->taskId = currentTask->taskId;
-			queueTask->assignedAt = currentTask->assignedAt;
+			runningTaskCount++;
+		}
+		else if (SchedulableTask(currentTask))
+		{
+			Datum taskDatum = PointerGetDatum(currentTask);
 
-			queueIndex++;
+			if (schedulableTaskHeap->bh_size < heapCapacity)
+			{
+				binaryheap_add(schedulableTaskHeap, taskDatum);
+			}
+			else if (CompareTasksByTime(taskDatum, binaryheap_first(schedulableTaskHeap),
+										NULL) < 0)
+			{
+				/* replace the latest assigned task in the heap */
+				binaryheap_replace_first(schedulableTaskHeap, taskDatum);
+			}
 		}
 
 		currentTask = (WorkerTask *) hash_seq_search(&status);
 	}
 
-	/* now order elements in the queue according to our sorting criterion */
-	qsort(priorityQueue, queueSize, WORKER_TASK_SIZE, CompareTasksByTime);
-
-	return priorityQueue;
-}
-
-
-/* Counts the number of tasks that match the given criteria function. */
-static uint32
-CountTasksMatchingCriteria(HTAB *WorkerTasksHash,
-						   bool (*CriteriaFunction)(WorkerTask *))
-{
-	HASH_SEQ_STATUS status;
-	uint32 taskCount = 0;
+	uint32 tasksToScheduleCount = 0;
+	if (runningTaskCount < MaxRunningTasksPerNode)
+	{
+		tasksToScheduleCount = MaxRunningTasksPerNode - runningTaskCount;
+	}
 
-	hash_seq_init(&status, WorkerTasksHash);
+	/* drop the latest assigned tasks that do not fit next to the running ones */
+	while ((uint32) schedulableTaskHeap->bh_size > tasksToScheduleCount)
+	{
+		binaryheap_remove_first(schedulableTaskHeap);
+	}
 
-	WorkerTask *currentTask = (WorkerTask *) hash_seq_search(&status);
-	while (currentTask != NULL)
+	/* the heap returns the latest task first, so we prepend to the list */
+	while (!binaryheap_empty(schedulableTaskHeap))
 	{
-		bool matchesCriteria = (*CriteriaFunction)(currentTask);
-		if (matchesCriteria)
-		{
-			taskCount++;
-		}
+		WorkerTask *schedulableTask = (WorkerTask *) palloc0(WORKER_TASK_SIZE);
+		WorkerTask *queuedTask =
+			(WorkerTask *) DatumGetPointer(binaryheap_remove_first(schedulableTaskHeap));
+		schedulableTask->jobId = queuedTask->jobId;
+		schedulableTask->taskId = queuedTask->taskId;
 
-		currentTask = (WorkerTask *) hash_seq_search(&status);
+		schedulableTaskList = lcons(schedulableTask, schedulableTaskList);
 	}
 
-	return taskCount;
+	binaryheap_free(schedulableTaskHeap);
+
+	return schedulableTaskList;
 }
 
 
@@ -763,16 +807,27 @@ SchedulableTask(WorkerTask *workerTask)
 }
 
 
-/* Comparison function to compare two worker tasks by their assignment times. */
+/*
+ * Comparison function to compare two worker tasks by their assignment times,
+ * which are referenced by the given datums.
+ */
 static int
-CompareTasksByTime(const void *first, const void *second)
+CompareTasksByTime(Datum first, Datum second, void *arg)
 {
-	WorkerTask *firstTask = (WorkerTask *) first;
-	WorkerTask *secondTask = (WorkerTask *) second;
+	WorkerTask *firstTask = (WorkerTask *) DatumGetPointer(first);
+	WorkerTask *secondTask = (WorkerTask *) DatumGetPointer(second);
 
 	/* tasks that are assigned earlier have higher priority */
-	int timeDiff = firstTask->assignedAt - secondTask->assignedAt;
-	return timeDiff;
+	if (firstTask->assignedAt < secondTask->assignedAt)
+	{
+		return -1;
+	}
+	else if (firstTask->assignedAt > secondTask->assignedAt)
+	{
+		return 1;
+	}
+
+	return 0;
 }
 
 
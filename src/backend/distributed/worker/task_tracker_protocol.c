@@ -26,6 +26,7 @@
 #include "commands/dbcommands.h"
 #include "commands/schemacmds.h"
 #include "commands/trigger.h"
+#include "distributed/deferred_cleanup.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_client_executor.h"
 #include "distributed/multi_server_executor.h"
@@ -42,7 +43,6 @@
 
 /* Local functions forward declarations */
 static bool TaskTrackerRunning(void);
-static void CreateJobSchema(StringInfo schemaName);
 static void CreateTask(uint64 jobId, uint32 taskId, char *taskCallString);
 static void UpdateTask(WorkerTask *workerTask, char *taskCallString);
 static void CleanupTask(WorkerTask *workerTask);
@@ -129,6 +129,9 @@ task_tracker_assign_task(PG_FUNCTION_ARGS)
 
 	LWLockRelease(&WorkerTasksSharedState->taskHashLock);
 
+	/* have the task tracker schedule the task right away */
+	WakeupTaskTracker();
+
 	PG_RETURN_VOID();
 }
 
@@ -225,6 +228,9 @@ task_tracker_cleanup_job(PG_FUNCTION_ARGS)
 
 	LWLockRelease(&WorkerTasksSharedState->taskHashLock);
 
+	/* have the task tracker cancel the job's running tasks right away */
+	WakeupTaskTracker();
+
 	/*
 	 * We then delete the job directory and schema, if they exist. This cleans
 	 * up all intermediate files and tables allocated for the job. Note that the
@@ -232,7 +238,7 @@ task_tracker_cleanup_job(PG_FUNCTION_ARGS)
 	 * writing to a table within the schema.
 	 */
 	StringInfo jobDirectoryName = JobDirectoryName(jobId);
-	CitusRemoveDirectory(jobDirectoryName);
+	DeferredRemoveDirectory(jobDirectoryName);
 
 	RemoveJobSchema(jobSchemaName);
 	UnlockJobResource(jobId, AccessExclusiveLock);
@@ -308,7 +314,7 @@ TaskTrackerRunning(void)
  * Further note that the created schema does not become visible to other
  * processes until the transaction commits.
  */
-static void
+void
 CreateJobSchema(StringInfo schemaName)
 {
 	const char *queryString = NULL;
@@ -41,6 +41,7 @@
 #include "distributed/remote_commands.h"
 #include "distributed/resource_lock.h"
 #include "distributed/task_tracker.h"
+#include "distributed/transmit.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/version_compat.h"
 #include "nodes/makefuncs.h"
@@ -59,7 +60,7 @@ static void FetchRegularFileAsSuperUser(const char *nodeName, uint32 nodePort,
 										StringInfo localFilename);
 static bool ReceiveRegularFile(const char *nodeName, uint32 nodePort,
 							   const char *nodeUser, StringInfo transmitCommand,
-							   StringInfo filePath);
+							   StringInfo filePath, bool decompress);
 static void ReceiveResourceCleanup(int32 connectionId, const char *filename,
 								   int32 fileDescriptor);
 static void CitusDeleteFile(const char *filename);
@@ -180,15 +181,19 @@ FetchRegularFileAsSuperUser(const char *nodeName, uint32 nodePort,
 	appendStringInfo(attemptFilename, "%s_%0*u%s", localFilename->data,
 					 MIN_TASK_FILENAME_WIDTH, randomId, ATTEMPT_FILE_SUFFIX);
 
+	/* ask the remote node to compress the file blocks if enabled */
+	bool compress = (TransmitCompressionThreshold != DISABLE_TRANSMIT_COMPRESSION);
+
 	StringInfo transmitCommand = makeStringInfo();
-	appendStringInfo(transmitCommand, TRANSMIT_WITH_USER_COMMAND, remoteFilename->data,
+	appendStringInfo(transmitCommand, compress ? TRANSMIT_WITH_USER_COMPRESSED_COMMAND :
+					 TRANSMIT_WITH_USER_COMMAND, remoteFilename->data,
 					 quote_literal_cstr(userName));
 
 	/* connect as superuser to give file access */
 	char *nodeUser = CitusExtensionOwnerName();
 
 	bool received = ReceiveRegularFile(nodeName, nodePort, nodeUser, transmitCommand,
-									   attemptFilename);
+									   attemptFilename, compress);
 	if (!received)
 	{
 		ereport(ERROR, (errmsg("could not receive file \"%s\" from %s:%u",
@@ -212,11 +217,12 @@ FetchRegularFileAsSuperUser(const char *nodeName, uint32 nodePort,
  * then issues the given transmit command using client-side logic (libpq), reads
  * the remote file's contents, and appends these contents to the local file. On
  * success, the function returns success; on failure, it cleans up all resources
- * and returns false.
+ * and returns false. If decompress is set, the remote node sends compressed
+ * frames, which are decompressed before they are appended to the local file.
  */
 static bool
 ReceiveRegularFile(const char *nodeName, uint32 nodePort, const char *nodeUser,
-				   StringInfo transmitCommand, StringInfo filePath)
+				   StringInfo transmitCommand, StringInfo filePath, bool decompress)
 {
 	char filename[MAXPGPATH];
 	const int fileFlags = (O_APPEND | O_CREAT | O_RDWR | O_TRUNC | PG_BINARY);
@@ -224,6 +230,7 @@ ReceiveRegularFile(const char *nodeName, uint32 nodePort, const char *nodeUser,
 
 	bool queryReady = false;
 	bool copyDone = false;
+	uint64 bytesReceived = 0;
 
 	/* create local file to append remote data to */
 	snprintf(filename, MAXPGPATH, "%s", filePath->data);
@@ -292,7 +299,8 @@ ReceiveRegularFile(const char *nodeName, uint32 nodePort, const char *nodeUser,
 	/* loop until we receive and append all the data from remote node */
 	while (!copyDone)
 	{
-		CopyStatus copyStatus = MultiClientCopyData(connectionId, fileDescriptor, NULL);
+		CopyStatus copyStatus = MultiClientCopyData(connectionId, fileDescriptor,
+													&bytesReceived, decompress);
 		if (copyStatus == CLIENT_COPY_DONE)
 		{
 			copyDone = true;
@@ -312,6 +320,24 @@ ReceiveRegularFile(const char *nodeName, uint32 nodePort, const char *nodeUser,
 	/* we are done executing; release the connection and the file handle */
 	MultiClientDisconnect(connectionId);
 
+	if (decompress)
+	{
+		struct stat fileStat;
+
+		/* the remote node compressed the data if it sent fewer bytes than we wrote */
+		if (fstat(fileDescriptor, &fileStat) == 0 &&
+			bytesReceived < (uint64) fileStat.st_size)
+		{
+			ereport(DEBUG1, (errmsg("received file data from %s:%u in compressed "
+									"blocks", nodeName, nodePort)));
+		}
+		else
+		{
+			ereport(DEBUG1, (errmsg("received file data from %s:%u without "
+									"compression", nodeName, nodePort)));
+		}
+	}
+
 	int closed = close(fileDescriptor);
 	if (closed < 0)
 	{
@@ -668,7 +694,7 @@ worker_append_table_to_shard(PG_FUNCTION_ARGS)
 
 	bool received = ReceiveRegularFile(sourceNodeName, sourceNodePort, NULL,
 									   sourceCopyCommand,
-									   localFilePath);
+									   localFilePath, false);
 	if (!received)
 	{
 		ereport(ERROR, (errmsg("could not copy table \"%s\" from \"%s:%u\"",
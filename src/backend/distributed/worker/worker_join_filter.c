@@ -0,0 +1,216 @@
+/*-------------------------------------------------------------------------
+ *
+ * worker_join_filter.c
+ *
+ * Routines for building and probing the Bloom filters of the join keys of
+ * repartition joins. Map tasks of one side of a dual partition join build a
+ * filter of their join keys with worker_join_filter_agg. The coordinator
+ * combines the filters of all these tasks, and map tasks of the other side
+ * then use worker_join_filter_contains to skip the rows that cannot have a
+ * join partner before partitioning them.
+ *
+ * A filter is a bytea that holds the bits of the filter. Keys are hashed with
+ * the standard hash function of their type, and each key sets the bits of
+ * JOIN_FILTER_HASH_COUNT positions derived from its hash value. Filters of
+ * the same size can therefore be combined by OR'ing their bits.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "miscadmin.h"
+
+#include "access/hash.h"
+#include "distributed/worker_protocol.h"
+#include "utils/builtins.h"
+#include "utils/memutils.h"
+
+
+/* number of bits that each key sets in the filter */
+#define JOIN_FILTER_HASH_COUNT 3
+
+
+/* transition state of worker_join_filter_agg */
+typedef struct JoinFilterState
+{
+	FmgrInfo *hashFunction;
+	Oid collation;
+	bytea *filter;
+} JoinFilterState;
+
+
+/* cached hash function of worker_join_filter_contains */
+typedef struct JoinFilterProbeState
+{
+	Oid keyType;
+	FmgrInfo *hashFunction;
+} JoinFilterProbeState;
+
+
+static void JoinFilterAddHash(bytea *filter, uint32 hashValue);
+static bool JoinFilterContainsHash(bytea *filter, uint32 hashValue);
+
+
+PG_FUNCTION_INFO_V1(worker_join_filter_agg_sfunc);
+PG_FUNCTION_INFO_V1(worker_join_filter_agg_final);
+PG_FUNCTION_INFO_V1(worker_join_filter_contains);
+
+
+/*
+ * worker_join_filter_agg_sfunc adds the given join key to the filter of the
+ * aggregate, which it allocates with the given size in bytes on the first
+ * call. NULL keys never join, so we skip them.
+ */
+Datum
+worker_join_filter_agg_sfunc(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggregateContext = NULL;
+	JoinFilterState *state = NULL;
+
+	if (!AggCheckCallContext(fcinfo, &aggregateContext))
+	{
+		elog(ERROR, "worker_join_filter_agg_sfunc called in non-aggregate context");
+	}
+
+	if (!PG_ARGISNULL(0))
+	{
+		state = (JoinFilterState *) PG_GETARG_POINTER(0);
+	}
+
+	if (state == NULL)
+	{
+		int32 filterSize = PG_ARGISNULL(2) ? 0 : PG_GETARG_INT32(2);
+		Oid keyType = get_fn_expr_argtype(fcinfo->flinfo, 1);
+
+		if (filterSize <= 0 || filterSize > MaxAllocSize - VARHDRSZ)
+		{
+			ereport(ERROR, (errmsg("invalid join filter size: %d", filterSize)));
+		}
+
+		MemoryContext oldContext = MemoryContextSwitchTo(aggregateContext);
+
+		state = (JoinFilterState *) palloc0(sizeof(JoinFilterState));
+		state->hashFunction = GetFunctionInfo(keyType, HASH_AM_OID,
+											  HASHSTANDARD_PROC);
+		state->collation = PG_GET_COLLATION();
+		state->filter = (bytea *) palloc0(filterSize + VARHDRSZ);
+		SET_VARSIZE(state->filter, filterSize + VARHDRSZ);
+
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	if (!PG_ARGISNULL(1))
+	{
+		Datum hashDatum = FunctionCall1Coll(state->hashFunction, state->collation,
+											PG_GETARG_DATUM(1));
+
+		JoinFilterAddHash(state->filter, DatumGetUInt32(hashDatum));
+	}
+
+	PG_RETURN_POINTER(state);
+}
+
+
+/*
+ * worker_join_filter_agg_final returns the filter of the aggregate, or NULL
+ * if the aggregate did not see any rows.
+ */
+Datum
+worker_join_filter_agg_final(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+	{
+		PG_RETURN_NULL();
+	}
+
+	JoinFilterState *state = (JoinFilterState *) PG_GETARG_POINTER(0);
+
+	PG_RETURN_BYTEA_P(state->filter);
+}
+
+
+/*
+ * worker_join_filter_contains returns whether the given join key may be in
+ * the given filter. False positives are possible, false negatives are not.
+ */
+Datum
+worker_join_filter_contains(PG_FUNCTION_ARGS)
+{
+	bytea *filter = PG_GETARG_BYTEA_PP(0);
+	Oid keyType = get_fn_expr_argtype(fcinfo->flinfo, 1);
+	JoinFilterProbeState *probeState = (JoinFilterProbeState *) fcinfo->flinfo->fn_extra;
+
+	if (VARSIZE_ANY_EXHDR(filter) == 0)
+	{
+		PG_RETURN_BOOL(false);
+	}
+
+	if (probeState == NULL || probeState->keyType != keyType)
+	{
+		MemoryContext oldContext = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+
+		probeState = (JoinFilterProbeState *) palloc0(sizeof(JoinFilterProbeState));
+		probeState->keyType = keyType;
+		probeState->hashFunction = GetFunctionInfo(keyType, HASH_AM_OID,
+												   HASHSTANDARD_PROC);
+
+		MemoryContextSwitchTo(oldContext);
+
+		fcinfo->flinfo->fn_extra = probeState;
+	}
+
+	Datum hashDatum = FunctionCall1Coll(probeState->hashFunction, PG_GET_COLLATION(),
+										PG_GETARG_DATUM(1));
+
+	PG_RETURN_BOOL(JoinFilterContainsHash(filter, DatumGetUInt32(hashDatum)));
+}
+
+
+/*
+ * JoinFilterAddHash sets the bits of the given hash value in the filter. We
+ * derive the positions from the hash value and a rehash of it, which is as
+ * good as independent hash functions for a Bloom filter.
+ */
+static void
+JoinFilterAddHash(bytea *filter, uint32 hashValue)
+{
+	unsigned char *filterBits = (unsigned char *) VARDATA_ANY(filter);
+	uint64 bitCount = ((uint64) VARSIZE_ANY_EXHDR(filter)) * BITS_PER_BYTE;
+	uint32 hashIncrement = DatumGetUInt32(hash_uint32(hashValue));
+
+	for (int hashIndex = 0; hashIndex < JOIN_FILTER_HASH_COUNT; hashIndex++)
+	{
+		uint64 bitIndex = (hashValue + (uint64) hashIndex * hashIncrement) % bitCount;
+
+		filterBits[bitIndex / BITS_PER_BYTE] |= (1 << (bitIndex % BITS_PER_BYTE));
+	}
+}
+
+
+/*
+ * JoinFilterContainsHash returns whether all bits of the given hash value are
+ * set in the filter.
+ */
+static bool
+JoinFilterContainsHash(bytea *filter, uint32 hashValue)
+{
+	unsigned char *filterBits = (unsigned char *) VARDATA_ANY(filter);
+	uint64 bitCount = ((uint64) VARSIZE_ANY_EXHDR(filter)) * BITS_PER_BYTE;
+	uint32 hashIncrement = DatumGetUInt32(hash_uint32(hashValue));
+
+	for (int hashIndex = 0; hashIndex < JOIN_FILTER_HASH_COUNT; hashIndex++)
+	{
+		uint64 bitIndex = (hashValue + (uint64) hashIndex * hashIncrement) % bitCount;
+		unsigned char bitMask = 1 << (bitIndex % BITS_PER_BYTE);
+
+		if ((filterBits[bitIndex / BITS_PER_BYTE] & bitMask) == 0)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -29,6 +29,9 @@
 #include "commands/tablecmds.h"
 #include "common/string.h"
 #include "distributed/metadata_cache.h"
+#include "distributed/multi_executor.h"
+#include "distributed/resource_lock.h"
+#include "distributed/tuplestore.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/version_compat.h"
 #include "executor/spi.h"
@@ -47,12 +50,17 @@ static void CreateTaskTable(StringInfo schemaName, StringInfo relationName,
 							List *columnNameList, List *columnTypeList);
 static void CopyTaskFilesFromDirectory(StringInfo schemaName, StringInfo relationName,
 									   StringInfo sourceDirectoryName, Oid userId);
+static List * TaskFileList(StringInfo sourceDirectoryName, Oid userId);
 
 
 /* exports for SQL callable functions */
 PG_FUNCTION_INFO_V1(worker_merge_files_into_table);
 PG_FUNCTION_INFO_V1(worker_merge_files_and_run_query);
 PG_FUNCTION_INFO_V1(worker_cleanup_job_schema_cache);
+PG_FUNCTION_INFO_V1(worker_create_schema);
+PG_FUNCTION_INFO_V1(worker_repartition_cleanup);
+PG_FUNCTION_INFO_V1(worker_create_task_table);
+PG_FUNCTION_INFO_V1(worker_read_task_files);
 
 
 /*
@@ -210,23 +218,30 @@ worker_merge_files_and_run_query(PG_FUNCTION_ARGS)
 							   setSearchPathString->data)));
 	}
 
-	int createMergeTableResult = SPI_exec(createMergeTableQuery, 0);
-	if (createMergeTableResult < 0)
+	/*
+	 * Without a merge table query, the intermediate table query reads the
+	 * fetched files directly through worker_read_task_files().
+	 */
+	if (createMergeTableQuery[0] != '\0')
 	{
-		ereport(ERROR, (errmsg("execution was not successful \"%s\"",
-							   createMergeTableQuery)));
-	}
+		int createMergeTableResult = SPI_exec(createMergeTableQuery, 0);
+		if (createMergeTableResult < 0)
+		{
+			ereport(ERROR, (errmsg("execution was not successful \"%s\"",
+								   createMergeTableQuery)));
+		}
 
-	/* need superuser to copy from files */
-	GetUserIdAndSecContext(&savedUserId, &savedSecurityContext);
-	SetUserIdAndSecContext(CitusExtensionOwner(), SECURITY_LOCAL_USERID_CHANGE);
+		/* need superuser to copy from files */
+		GetUserIdAndSecContext(&savedUserId, &savedSecurityContext);
+		SetUserIdAndSecContext(CitusExtensionOwner(), SECURITY_LOCAL_USERID_CHANGE);
 
-	appendStringInfo(mergeTableName, "%s%s", intermediateTableName->data,
-					 MERGE_TABLE_SUFFIX);
-	CopyTaskFilesFromDirectory(jobSchemaName, mergeTableName, taskDirectoryName,
-							   userId);
+		appendStringInfo(mergeTableName, "%s%s", intermediateTableName->data,
+						 MERGE_TABLE_SUFFIX);
+		CopyTaskFilesFromDirectory(jobSchemaName, mergeTableName, taskDirectoryName,
+								   userId);
 
-	SetUserIdAndSecContext(savedUserId, savedSecurityContext);
+		SetUserIdAndSecContext(savedUserId, savedSecurityContext);
+	}
 
 	int createIntermediateTableResult = SPI_exec(createIntermediateTableQuery, 0);
 	if (createIntermediateTableResult < 0)
@@ -300,6 +315,161 @@ worker_cleanup_job_schema_cache(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * worker_create_schema creates the schema for the given job, if it doesn't
+ * already exist. The adaptive executor calls this function ahead of merge
+ * tasks, which the task tracker protocol otherwise creates the schema for.
+ */
+Datum
+worker_create_schema(PG_FUNCTION_ARGS)
+{
+	uint64 jobId = PG_GETARG_INT64(0);
+	StringInfo jobSchemaName = JobSchemaName(jobId);
+
+	CheckCitusVersion(ERROR);
+
+	/*
+	 * Merge tasks of the same job can run concurrently. When we create the
+	 * schema, we keep the lock until the transaction commits such that the
+	 * other merge tasks see the new schema.
+	 */
+	LockJobResource(jobId, AccessExclusiveLock);
+	bool schemaExists = JobSchemaExists(jobSchemaName);
+	if (!schemaExists)
+	{
+		CreateJobSchema(jobSchemaName);
+	}
+	else
+	{
+		Oid schemaId = get_namespace_oid(jobSchemaName->data, false);
+
+		EnsureSchemaOwner(schemaId);
+
+		UnlockJobResource(jobId, AccessExclusiveLock);
+	}
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * worker_repartition_cleanup removes the job directory and the job schema of
+ * the given job, if they exist. Unlike task_tracker_cleanup_job, the function
+ * does not depend on the task tracker, and is used by the adaptive executor
+ * once a repartition join has finished.
+ */
+Datum
+worker_repartition_cleanup(PG_FUNCTION_ARGS)
+{
+	uint64 jobId = PG_GETARG_INT64(0);
+	StringInfo jobDirectoryName = JobDirectoryName(jobId);
+	StringInfo jobSchemaName = JobSchemaName(jobId);
+
+	CheckCitusVersion(ERROR);
+
+	LockJobResource(jobId, AccessExclusiveLock);
+
+	bool schemaExists = JobSchemaExists(jobSchemaName);
+	if (schemaExists)
+	{
+		Oid schemaId = get_namespace_oid(jobSchemaName->data, false);
+
+		EnsureSchemaOwner(schemaId);
+	}
+
+	CitusRemoveDirectory(jobDirectoryName);
+	RemoveJobSchema(jobSchemaName);
+
+	UnlockJobResource(jobId, AccessExclusiveLock);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * worker_create_task_table creates the empty table of the given merge task in
+ * the schema of its job. When map tasks push their outputs straight into the
+ * merge tables, the adaptive executor creates the tables with this function
+ * ahead of the map tasks, in place of running worker_merge_files_into_table.
+ */
+Datum
+worker_create_task_table(PG_FUNCTION_ARGS)
+{
+	uint64 jobId = PG_GETARG_INT64(0);
+	uint32 taskId = PG_GETARG_UINT32(1);
+	ArrayType *columnNameObject = PG_GETARG_ARRAYTYPE_P(2);
+	ArrayType *columnTypeObject = PG_GETARG_ARRAYTYPE_P(3);
+
+	StringInfo jobSchemaName = JobSchemaName(jobId);
+	StringInfo taskTableName = TaskTableName(taskId);
+
+	/* we should have the same number of column names and types */
+	int32 columnNameCount = ArrayObjectCount(columnNameObject);
+	int32 columnTypeCount = ArrayObjectCount(columnTypeObject);
+
+	CheckCitusVersion(ERROR);
+
+	if (columnNameCount != columnTypeCount)
+	{
+		ereport(ERROR, (errmsg("column name array size: %d and type array size: %d"
+							   " do not match", columnNameCount, columnTypeCount)));
+	}
+
+	bool schemaExists = JobSchemaExists(jobSchemaName);
+	if (!schemaExists)
+	{
+		ereport(ERROR, (errmsg("job schema does not exist")));
+	}
+
+	Oid schemaId = get_namespace_oid(jobSchemaName->data, false);
+	EnsureSchemaOwner(schemaId);
+
+	List *columnNameList = ArrayObjectToCStringList(columnNameObject);
+	List *columnTypeList = ArrayObjectToCStringList(columnTypeObject);
+
+	CreateTaskTable(jobSchemaName, taskTableName, columnNameList, columnTypeList);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * worker_read_task_files reads the files that were fetched for the given merge
+ * task, and returns their rows as a set of records. Merge tasks that run a
+ * query on the map outputs use this function in place of a merge table, which
+ * saves loading the files into a heap table before reading them once more.
+ * Like the merge table, the function only reads the current user's files.
+ */
+Datum
+worker_read_task_files(PG_FUNCTION_ARGS)
+{
+	uint64 jobId = PG_GETARG_INT64(0);
+	uint32 taskId = PG_GETARG_UINT32(1);
+
+	StringInfo taskDirectoryName = TaskDirectoryName(jobId, taskId);
+	char *copyFormat = BinaryWorkerCopyFormat ? "binary" : "text";
+	TupleDesc tupleDescriptor = NULL;
+	ListCell *taskFileCell = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	List *taskFileList = TaskFileList(taskDirectoryName, GetUserId());
+
+	Tuplestorestate *tupstore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	foreach(taskFileCell, taskFileList)
+	{
+		char *taskFilename = (char *) lfirst(taskFileCell);
+
+		ReadFileIntoTupleStore(taskFilename, copyFormat, tupleDescriptor, tupstore);
+	}
+
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
+
 /* Constructs a standardized job schema name for the given job id. */
 StringInfo
 JobSchemaName(uint64 jobId)
@@ -516,8 +686,54 @@ static void
 CopyTaskFilesFromDirectory(StringInfo schemaName, StringInfo relationName,
 						   StringInfo sourceDirectoryName, Oid userId)
 {
-	const char *directoryName = sourceDirectoryName->data;
 	uint64 copiedRowTotal = 0;
+	ListCell *taskFileCell = NULL;
+
+	List *taskFileList = TaskFileList(sourceDirectoryName, userId);
+
+	foreach(taskFileCell, taskFileList)
+	{
+		char *fullFilename = (char *) lfirst(taskFileCell);
+		const char *queryString = NULL;
+		uint64 copiedRowCount = 0;
+
+		/* build relation object and copy statement */
+		RangeVar *relation = makeRangeVar(schemaName->data, relationName->data, -1);
+		CopyStmt *copyStatement = CopyStatement(relation, fullFilename);
+		if (BinaryWorkerCopyFormat)
+		{
+			DefElem *copyOption = makeDefElem("format", (Node *) makeString("binary"),
+											  -1);
+			copyStatement->options = list_make1(copyOption);
+		}
+
+		{
+			ParseState *pstate = make_parsestate(NULL);
+			pstate->p_sourcetext = queryString;
+
+			DoCopy(pstate, copyStatement, -1, -1, &copiedRowCount);
+
+			free_parsestate(pstate);
+		}
+
+		copiedRowTotal += copiedRowCount;
+		CommandCounterIncrement();
+	}
+
+	ereport(DEBUG2, (errmsg("copied " UINT64_FORMAT " rows into table: \"%s.%s\"",
+							copiedRowTotal, schemaName->data, relationName->data)));
+}
+
+
+/*
+ * TaskFileList returns the full names of the task files that the given user
+ * fetched into the given directory, and skips lingering attempt files.
+ */
+static List *
+TaskFileList(StringInfo sourceDirectoryName, Oid userId)
+{
+	const char *directoryName = sourceDirectoryName->data;
+	List *taskFileList = NIL;
 	StringInfo expectedFileSuffix = makeStringInfo();
 
 	DIR *directory = AllocateDir(directoryName);
@@ -533,8 +749,6 @@ CopyTaskFilesFromDirectory(StringInfo schemaName, StringInfo relationName,
 	for (; directoryEntry != NULL; directoryEntry = ReadDir(directory, directoryName))
 	{
 		const char *baseFilename = directoryEntry->d_name;
-		const char *queryString = NULL;
-		uint64 copiedRowCount = 0;
 
 		/* if system file or lingering task file, skip it */
 		if (strncmp(baseFilename, ".", MAXPGPATH) == 0 ||
@@ -559,33 +773,12 @@ CopyTaskFilesFromDirectory(StringInfo schemaName, StringInfo relationName,
 		StringInfo fullFilename = makeStringInfo();
 		appendStringInfo(fullFilename, "%s/%s", directoryName, baseFilename);
 
-		/* build relation object and copy statement */
-		RangeVar *relation = makeRangeVar(schemaName->data, relationName->data, -1);
-		CopyStmt *copyStatement = CopyStatement(relation, fullFilename->data);
-		if (BinaryWorkerCopyFormat)
-		{
-			DefElem *copyOption = makeDefElem("format", (Node *) makeString("binary"),
-											  -1);
-			copyStatement->options = list_make1(copyOption);
-		}
-
-		{
-			ParseState *pstate = make_parsestate(NULL);
-			pstate->p_sourcetext = queryString;
-
-			DoCopy(pstate, copyStatement, -1, -1, &copiedRowCount);
-
-			free_parsestate(pstate);
-		}
-
-		copiedRowTotal += copiedRowCount;
-		CommandCounterIncrement();
+		taskFileList = lappend(taskFileList, fullFilename->data);
 	}
 
-	ereport(DEBUG2, (errmsg("copied " UINT64_FORMAT " rows into table: \"%s.%s\"",
-							copiedRowTotal, schemaName->data, relationName->data)));
-
 	FreeDir(directory);
+
+	return taskFileList;
 }
 
 
@@ -16,6 +16,7 @@
 
 #include "postgres.h"
 #include "funcapi.h"
+#include "libpq-fe.h"
 #include "miscadmin.h"
 #include "pgstat.h"
 
@@ -35,10 +36,17 @@
 #include "commands/copy.h"
 #include "commands/defrem.h"
 #include "distributed/commands/multi_copy.h"
+#include "distributed/connection_management.h"
+#include "distributed/multi_executor.h"
 #include "distributed/multi_physical_planner.h"
+#include "distributed/remote_commands.h"
+#include "distributed/remote_transaction.h"
 #include "distributed/resource_lock.h"
+#include "distributed/shardinterval_utils.h"
+#include "distributed/transaction_management.h"
 #include "distributed/transmit.h"
 #include "distributed/worker_protocol.h"
+#include "distributed/worker_repartition_cache.h"
 #include "distributed/version_compat.h"
 #include "executor/spi.h"
 #include "mb/pg_wchar.h"
@@ -46,33 +54,103 @@
 #include "utils/builtins.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
+#include "utils/plancache.h"
+#include "utils/snapmgr.h"
 
 
 /* Config variables managed via guc.c */
 bool BinaryWorkerCopyFormat = false;   /* binary format for copying between workers */
 int PartitionBufferSize = 16384; /* total partitioning buffer size in KB */
 
+/* argument positions of the optional push targets of the partition functions */
+#define PUSH_TARGET_ARGUMENT_INDEX 6
+#define BROADCAST_PUSH_TARGET_ARGUMENT_INDEX 4
+
 /* Local variables */
-static uint32 FileBufferSizeInBytes = 0; /* file buffer size to init later */
+static uint64 PartitionBufferSizeInBytes = 0; /* total buffer size to init later */
+static uint64 PartitionBufferedBytes = 0;     /* bytes buffered over all partitions */
+
+
+/* PartitionDestReceiver partitions query results into partition files */
+typedef struct PartitionDestReceiver
+{
+	/* public DestReceiver interface */
+	DestReceiver pub;
+
+	/*
+	 * Partition column and function to compute the partition of a row. Without
+	 * a partition function, each row goes to all partitions.
+	 */
+	const char *partitionColumnName;
+	Oid partitionColumnType;
+	int partitionColumnIndex;
+	uint32 (*PartitionIdFunction)(Datum, const void *);
+	const void *partitionIdContext;
+
+	/* partition files to write to */
+	FileOutputStream *partitionFileArray;
+	uint32 fileCount;
+
+	/* state on how to copy out data types */
+	CopyOutState rowOutputState;
+	FmgrInfo *columnOutputFunctions;
+
+	/* MemoryContext for DestReceiver session */
+	MemoryContext memoryContext;
+} PartitionDestReceiver;
 
 
 /* Local functions forward declarations */
 static ShardInterval ** SyntheticShardIntervalArrayForShardMinValues(
 	Datum *shardMinValues,
 	int shardCount);
+static void PartitionTableIntoOutputs(FunctionCallInfo fcinfo, uint64 jobId,
+									  uint32 taskId, const char *filterQuery,
+									  const char *partitionColumn,
+									  Oid partitionColumnType,
+									  uint32 (*PartitionIdFunction)(Datum, const void *),
+									  const void *partitionIdContext,
+									  int pushTargetArgumentIndex,
+									  uint32 fileCount);
 static StringInfo InitTaskAttemptDirectory(uint64 jobId, uint32 taskId);
-static uint32 FileBufferSize(int partitionBufferSizeInKB, uint32 fileCount);
+static void InitPartitionBuffers(void);
 static FileOutputStream * OpenPartitionFiles(StringInfo directoryName, uint32 fileCount);
 static void ClosePartitionFiles(FileOutputStream *partitionFileArray, uint32 fileCount);
+static FileOutputStream * OpenPartitionPushStreams(uint64 jobId,
+												   ArrayType *pushTaskIdObject,
+												   ArrayType *pushNodeNameObject,
+												   ArrayType *pushNodePortObject,
+												   uint32 fileCount);
+static MultiConnection * PushConnection(List **connectionList, const char *nodeName,
+										int nodePort);
+static char * PushCopyCommand(StringInfo jobSchemaName, uint32 pushTaskId);
+static void ClosePartitionPushStreams(FileOutputStream *partitionStreamArray,
+									  uint32 fileCount);
 static void RenameDirectory(StringInfo oldDirectoryName, StringInfo newDirectoryName);
 static void FileOutputStreamWrite(FileOutputStream *file, StringInfo dataToWrite);
 static void FileOutputStreamFlush(FileOutputStream *file);
+static void FileOutputStreamPush(FileOutputStream *file);
+static void FlushLargestPartitionBuffer(FileOutputStream *partitionFileArray,
+										uint32 fileCount);
+static void PutPushCopyData(MultiConnection *connection, StringInfo copyData);
 static void FilterAndPartitionTable(const char *filterQuery,
 									const char *columnName, Oid columnType,
 									uint32 (*PartitionIdFunction)(Datum, const void *),
 									const void *partitionIdContext,
 									FileOutputStream *partitionFileArray,
-									uint32 fileCount);
+									uint32 fileCount, List **cacheRelationList);
+static DestReceiver * CreatePartitionDestReceiver(const char *partitionColumnName,
+												  Oid partitionColumnType,
+												  uint32 (*PartitionIdFunction)(
+													  Datum, const void *),
+												  const void *partitionIdContext,
+												  FileOutputStream *partitionFileArray,
+												  uint32 fileCount);
+static void PartitionDestReceiverStartup(DestReceiver *dest, int operation,
+										 TupleDesc inputTupleDescriptor);
+static bool PartitionDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest);
+static void PartitionDestReceiverShutdown(DestReceiver *dest);
+static void PartitionDestReceiverDestroy(DestReceiver *dest);
 static int ColumnIndex(TupleDesc rowDescriptor, const char *columnName);
 static CopyOutState InitRowOutputState(void);
 static void ClearRowOutputState(CopyOutState copyState);
@@ -80,13 +158,13 @@ static void OutputBinaryHeaders(FileOutputStream *partitionFileArray, uint32 fil
 static void OutputBinaryFooters(FileOutputStream *partitionFileArray, uint32 fileCount);
 static uint32 RangePartitionId(Datum partitionValue, const void *context);
 static uint32 HashPartitionId(Datum partitionValue, const void *context);
-static StringInfo UserPartitionFilename(StringInfo directoryName, uint32 partitionId);
 static bool FileIsLink(char *filename, struct stat filestat);
 
 
 /* exports for SQL callable functions */
 PG_FUNCTION_INFO_V1(worker_range_partition_table);
 PG_FUNCTION_INFO_V1(worker_hash_partition_table);
+PG_FUNCTION_INFO_V1(worker_broadcast_partition_table);
 
 
 /*
@@ -139,23 +217,10 @@ worker_range_partition_table(PG_FUNCTION_ARGS)
 	partitionContext->splitPointArray = splitPointArray;
 	partitionContext->splitPointCount = splitPointCount;
 
-	/* init directories and files to write the partitioned data to */
-	StringInfo taskDirectory = InitTaskDirectory(jobId, taskId);
-	StringInfo taskAttemptDirectory = InitTaskAttemptDirectory(jobId, taskId);
-
-	FileOutputStream *partitionFileArray = OpenPartitionFiles(taskAttemptDirectory,
-															  fileCount);
-	FileBufferSizeInBytes = FileBufferSize(PartitionBufferSize, fileCount);
-
-	/* call the partitioning function that does the actual work */
-	FilterAndPartitionTable(filterQuery, partitionColumn, partitionColumnType,
-							&RangePartitionId, (const void *) partitionContext,
-							partitionFileArray, fileCount);
-
-	/* close partition files and atomically rename (commit) them */
-	ClosePartitionFiles(partitionFileArray, fileCount);
-	CitusRemoveDirectory(taskDirectory);
-	RenameDirectory(taskAttemptDirectory, taskDirectory);
+	PartitionTableIntoOutputs(fcinfo, jobId, taskId, filterQuery, partitionColumn,
+							  partitionColumnType, &RangePartitionId,
+							  (const void *) partitionContext,
+							  PUSH_TARGET_ARGUMENT_INDEX, fileCount);
 
 	PG_RETURN_VOID();
 }
@@ -218,25 +283,137 @@ worker_hash_partition_table(PG_FUNCTION_ARGS)
 			GetFunctionInfo(partitionColumnType, BTREE_AM_OID, BTORDER_PROC);
 	}
 
+	PartitionTableIntoOutputs(fcinfo, jobId, taskId, filterQuery, partitionColumn,
+							  partitionColumnType, hashPartitionIdFunction,
+							  (const void *) partitionContext,
+							  PUSH_TARGET_ARGUMENT_INDEX, fileCount);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * worker_broadcast_partition_table executes the given filter query, and writes
+ * all of the query's results to each of the given number of partitions. The
+ * coordinator uses this function for small tables that it joins with a larger
+ * table without moving the larger table; each merge task then gets a full copy
+ * of the small table next to a shard of the larger table.
+ */
+Datum
+worker_broadcast_partition_table(PG_FUNCTION_ARGS)
+{
+	uint64 jobId = PG_GETARG_INT64(0);
+	uint32 taskId = PG_GETARG_UINT32(1);
+	text *filterQueryText = PG_GETARG_TEXT_P(2);
+	int32 partitionCount = PG_GETARG_INT32(3);
+
+	const char *filterQuery = text_to_cstring(filterQueryText);
+
+	CheckCitusVersion(ERROR);
+
+	if (partitionCount <= 0)
+	{
+		ereport(ERROR, (errmsg("partition count must be positive")));
+	}
+
+	PartitionTableIntoOutputs(fcinfo, jobId, taskId, filterQuery, NULL, InvalidOid,
+							  NULL, NULL, BROADCAST_PUSH_TARGET_ARGUMENT_INDEX,
+							  (uint32) partitionCount);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * PartitionTableIntoOutputs runs the filter query and writes the partitioned
+ * rows either to partition files on local disk, or when the caller passed push
+ * targets, straight into the tables of the merge tasks that consume them.
+ *
+ * The push targets are three arrays that hold the merge task id, node name and
+ * node port for each partition; a task id of 0 means that no merge task reads
+ * the partition, as do partitions past the end of the arrays. Merge tasks then
+ * find their rows in their tables, without fetching and re-reading files.
+ * The push targets start at the given argument index of the caller.
+ */
+static void
+PartitionTableIntoOutputs(FunctionCallInfo fcinfo, uint64 jobId, uint32 taskId,
+						  const char *filterQuery, const char *partitionColumn,
+						  Oid partitionColumnType,
+						  uint32 (*PartitionIdFunction)(Datum, const void *),
+						  const void *partitionIdContext, int pushTargetArgumentIndex,
+						  uint32 fileCount)
+{
+	if (PG_NARGS() > pushTargetArgumentIndex)
+	{
+		ArrayType *pushTaskIdObject = PG_GETARG_ARRAYTYPE_P(pushTargetArgumentIndex);
+		ArrayType *pushNodeNameObject =
+			PG_GETARG_ARRAYTYPE_P(pushTargetArgumentIndex + 1);
+		ArrayType *pushNodePortObject =
+			PG_GETARG_ARRAYTYPE_P(pushTargetArgumentIndex + 2);
+
+		FileOutputStream *partitionStreamArray =
+			OpenPartitionPushStreams(jobId, pushTaskIdObject, pushNodeNameObject,
+									 pushNodePortObject, fileCount);
+		InitPartitionBuffers();
+
+		FilterAndPartitionTable(filterQuery, partitionColumn, partitionColumnType,
+								PartitionIdFunction, partitionIdContext,
+								partitionStreamArray, fileCount, NULL);
+
+		/* the pushed rows become visible when our transaction commits */
+		ClosePartitionPushStreams(partitionStreamArray, fileCount);
+
+		return;
+	}
+
 	/* init directories and files to write the partitioned data to */
 	StringInfo taskDirectory = InitTaskDirectory(jobId, taskId);
 	StringInfo taskAttemptDirectory = InitTaskAttemptDirectory(jobId, taskId);
+	StringInfo cacheKey = NULL;
+	List *cacheRelationList = NIL;
+
+	if (RepartitionCacheEnabled())
+	{
+		cacheKey = RepartitionCacheKey(fcinfo, pushTargetArgumentIndex);
+	}
+
+	/* reuse the partition files of an earlier run of the same map task */
+	if (cacheKey != NULL)
+	{
+		StringInfo cacheEntryDirectory = RepartitionCacheEntryDirectory(cacheKey,
+																		fileCount);
+
+		if (cacheEntryDirectory != NULL &&
+			LinkPartitionFiles(cacheEntryDirectory, taskAttemptDirectory, fileCount))
+		{
+			ereport(DEBUG1, (errmsg("reusing cached map output for task %u", taskId)));
+
+			CitusRemoveDirectory(taskDirectory);
+			RenameDirectory(taskAttemptDirectory, taskDirectory);
+			return;
+		}
+	}
 
 	FileOutputStream *partitionFileArray = OpenPartitionFiles(taskAttemptDirectory,
 															  fileCount);
-	FileBufferSizeInBytes = FileBufferSize(PartitionBufferSize, fileCount);
+	InitPartitionBuffers();
 
 	/* call the partitioning function that does the actual work */
 	FilterAndPartitionTable(filterQuery, partitionColumn, partitionColumnType,
-							hashPartitionIdFunction, (const void *) partitionContext,
-							partitionFileArray, fileCount);
+							PartitionIdFunction, partitionIdContext,
+							partitionFileArray, fileCount,
+							cacheKey != NULL ? &cacheRelationList : NULL);
 
 	/* close partition files and atomically rename (commit) them */
 	ClosePartitionFiles(partitionFileArray, fileCount);
 	CitusRemoveDirectory(taskDirectory);
 	RenameDirectory(taskAttemptDirectory, taskDirectory);
 
-	PG_RETURN_VOID();
+	if (cacheRelationList != NIL)
+	{
+		StoreRepartitionCacheEntry(cacheKey, cacheRelationList, taskDirectory,
+								   fileCount);
+	}
 }
 
 
@@ -429,14 +606,19 @@ InitTaskAttemptDirectory(uint64 jobId, uint32 taskId)
 }
 
 
-/* Calculates and returns the buffer size to use for each file. */
-static uint32
-FileBufferSize(int partitionBufferSizeInKB, uint32 fileCount)
+/*
+ * InitPartitionBuffers sets up the buffer budget that all partitions of a
+ * partition operation share. Rather than giving each partition an equal slice
+ * of the budget, we let buffers grow as rows arrive, and once all buffers
+ * together exceed the budget, we flush the largest one. Partitions that get
+ * many rows thus get large buffers and few large writes, even when there are
+ * thousands of partitions.
+ */
+static void
+InitPartitionBuffers(void)
 {
-	double partitionBufferSize = (double) partitionBufferSizeInKB * 1024.0;
-	uint32 fileBufferSize = (uint32) rint(partitionBufferSize / fileCount);
-
-	return fileBufferSize;
+	PartitionBufferSizeInBytes = (uint64) PartitionBufferSize * 1024;
+	PartitionBufferedBytes = 0;
 }
 
 
@@ -500,6 +682,144 @@ ClosePartitionFiles(FileOutputStream *partitionFileArray, uint32 fileCount)
 }
 
 
+/*
+ * OpenPartitionPushStreams creates a stream for each partition that buffers
+ * the partition's rows in memory, and pushes them into the table of the merge
+ * task on the given node whenever the buffer fills up. Partitions on the same
+ * node share one connection, and we run all copies in a transaction block so
+ * that the merge tables see the rows of this map task all at once.
+ */
+static FileOutputStream *
+OpenPartitionPushStreams(uint64 jobId, ArrayType *pushTaskIdObject,
+						 ArrayType *pushNodeNameObject, ArrayType *pushNodePortObject,
+						 uint32 fileCount)
+{
+	List *connectionList = NIL;
+	StringInfo jobSchemaName = JobSchemaName(jobId);
+	uint32 pushTargetCount = (uint32) ArrayObjectCount(pushTaskIdObject);
+
+	if (pushTargetCount > fileCount ||
+		ArrayObjectCount(pushNodeNameObject) != pushTargetCount ||
+		ArrayObjectCount(pushNodePortObject) != pushTargetCount)
+	{
+		ereport(ERROR, (errmsg("push target arrays do not match partition count %u",
+							   fileCount)));
+	}
+
+	Datum *pushTaskIdArray = DeconstructArrayObject(pushTaskIdObject);
+	Datum *pushNodeNameArray = DeconstructArrayObject(pushNodeNameObject);
+	Datum *pushNodePortArray = DeconstructArrayObject(pushNodePortObject);
+
+	FileOutputStream *partitionStreamArray =
+		palloc0(fileCount * sizeof(FileOutputStream));
+
+	for (uint32 fileIndex = 0; fileIndex < fileCount; fileIndex++)
+	{
+		FileOutputStream *partitionStream = &partitionStreamArray[fileIndex];
+
+		partitionStream->fileBuffer = makeStringInfo();
+
+		/* no merge task reads this partition, so we drop its rows */
+		if (fileIndex >= pushTargetCount ||
+			DatumGetUInt32(pushTaskIdArray[fileIndex]) == 0)
+		{
+			continue;
+		}
+
+		uint32 pushTaskId = DatumGetUInt32(pushTaskIdArray[fileIndex]);
+
+		char *nodeName = TextDatumGetCString(pushNodeNameArray[fileIndex]);
+		int nodePort = DatumGetInt32(pushNodePortArray[fileIndex]);
+
+		partitionStream->pushConnection = PushConnection(&connectionList, nodeName,
+														 nodePort);
+		partitionStream->pushCopyCommand = PushCopyCommand(jobSchemaName, pushTaskId);
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	BeginOrContinueCoordinatedTransaction();
+	RemoteTransactionsBeginIfNecessary(connectionList);
+
+	return partitionStreamArray;
+}
+
+
+/*
+ * PushConnection returns the connection to the given node from the given
+ * list, and starts a new one if the list does not have it yet.
+ */
+static MultiConnection *
+PushConnection(List **connectionList, const char *nodeName, int nodePort)
+{
+	ListCell *connectionCell = NULL;
+
+	foreach(connectionCell, *connectionList)
+	{
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+
+		if (connection->port == nodePort &&
+			strncmp(connection->hostname, nodeName, MAX_NODE_LENGTH) == 0)
+		{
+			return connection;
+		}
+	}
+
+	MultiConnection *connection = StartNonDataAccessConnection(nodeName, nodePort);
+	ClaimConnectionExclusively(connection);
+	MarkRemoteTransactionCritical(connection);
+
+	*connectionList = lappend(*connectionList, connection);
+
+	return connection;
+}
+
+
+/*
+ * PushCopyCommand returns the command that copies pushed rows into the table
+ * of the given merge task.
+ */
+static char *
+PushCopyCommand(StringInfo jobSchemaName, uint32 pushTaskId)
+{
+	StringInfo taskTableName = TaskTableName(pushTaskId);
+	StringInfo copyCommand = makeStringInfo();
+
+	appendStringInfo(copyCommand, "COPY %s FROM STDIN%s",
+					 quote_qualified_identifier(jobSchemaName->data,
+												taskTableName->data),
+					 BinaryWorkerCopyFormat ? " WITH (format binary)" : "");
+
+	return copyCommand->data;
+}
+
+
+/*
+ * ClosePartitionPushStreams pushes any rows that remain in the buffers of the
+ * given streams, and releases the streams and their connections. The remote
+ * transactions commit together with the local transaction.
+ */
+static void
+ClosePartitionPushStreams(FileOutputStream *partitionStreamArray, uint32 fileCount)
+{
+	for (uint32 fileIndex = 0; fileIndex < fileCount; fileIndex++)
+	{
+		FileOutputStream *partitionStream = &partitionStreamArray[fileIndex];
+
+		FileOutputStreamFlush(partitionStream);
+
+		if (partitionStream->pushConnection != NULL)
+		{
+			UnclaimConnection(partitionStream->pushConnection);
+		}
+
+		FreeStringInfo(partitionStream->fileBuffer);
+	}
+
+	pfree(partitionStreamArray);
+}
+
+
 /*
  * MasterJobDirectoryName constructs a standardized job
  * directory path for the given job id on the master node.
@@ -579,7 +899,7 @@ PartitionFilename(StringInfo directoryName, uint32 partitionId)
  * UserPartitionFilename returns the path of a partition file for the given
  * partition ID and the current user.
  */
-static StringInfo
+StringInfo
 UserPartitionFilename(StringInfo directoryName, uint32 partitionId)
 {
 	StringInfo partitionFilename = PartitionFilename(directoryName, partitionId);
@@ -807,33 +1127,76 @@ RenameDirectory(StringInfo oldDirectoryName, StringInfo newDirectoryName)
 
 
 /*
- * FileOutputStreamWrite appends given data to file stream's internal buffers.
- * The function then checks if buffered data exceeds preconfigured buffer size;
- * if so, the function flushes the buffer to the underlying file.
+ * FileOutputStreamWrite appends given data to file stream's internal buffers,
+ * and accounts for the data in the buffer budget of the partition operation.
+ * FlushLargestPartitionBuffer() flushes buffers once the budget is exceeded.
  */
 static void
 FileOutputStreamWrite(FileOutputStream *file, StringInfo dataToWrite)
 {
 	StringInfo fileBuffer = file->fileBuffer;
-	uint32 newBufferSize = fileBuffer->len + dataToWrite->len;
 
 	appendBinaryStringInfo(fileBuffer, dataToWrite->data, dataToWrite->len);
 
-	if (newBufferSize > FileBufferSizeInBytes)
+	PartitionBufferedBytes += dataToWrite->len;
+}
+
+
+/*
+ * FlushLargestPartitionBuffer flushes the largest buffer among the given
+ * partitions to its file, and frees up its share of the buffer budget. As the
+ * largest buffer holds at least the average share of the budget, we need to
+ * look for it at most once per that many buffered bytes.
+ */
+static void
+FlushLargestPartitionBuffer(FileOutputStream *partitionFileArray, uint32 fileCount)
+{
+	FileOutputStream *largestPartitionFile = NULL;
+
+	for (uint32 fileIndex = 0; fileIndex < fileCount; fileIndex++)
 	{
-		FileOutputStreamFlush(file);
+		FileOutputStream *partitionFile = &partitionFileArray[fileIndex];
+
+		if (largestPartitionFile == NULL ||
+			partitionFile->fileBuffer->len > largestPartitionFile->fileBuffer->len)
+		{
+			largestPartitionFile = partitionFile;
+		}
+	}
 
-		resetStringInfo(fileBuffer);
+	if (largestPartitionFile == NULL)
+	{
+		return;
 	}
+
+	StringInfo fileBuffer = largestPartitionFile->fileBuffer;
+
+	FileOutputStreamFlush(largestPartitionFile);
+
+	PartitionBufferedBytes -= fileBuffer->len;
+	resetStringInfo(fileBuffer);
 }
 
 
-/* Flushes data buffered in the file stream object to the underlying file. */
+/*
+ * Flushes data buffered in the file stream object to the underlying file, or
+ * pushes it to the merge table for streams without a file.
+ */
 static void
 FileOutputStreamFlush(FileOutputStream *file)
 {
 	StringInfo fileBuffer = file->fileBuffer;
 
+	if (file->filePath == NULL)
+	{
+		if (file->pushConnection != NULL)
+		{
+			FileOutputStreamPush(file);
+		}
+
+		return;
+	}
+
 	errno = 0;
 	int written = FileWriteCompat(&file->fileCompat, fileBuffer->data, fileBuffer->len,
 								  PG_WAIT_IO);
@@ -847,11 +1210,101 @@ FileOutputStreamFlush(FileOutputStream *file)
 
 
 /*
- * FilterAndPartitionTable executes a given SQL query, and iterates over query
- * results in a read-only fashion. For each resulting row, the function applies
- * the partitioning function and determines the partition identifier. Then, the
- * function chooses the partition file corresponding to this identifier, and
- * serializes the row into this file using the copy command's text format.
+ * FileOutputStreamPush copies the data buffered in the given stream into the
+ * merge table over the stream's push connection. Every flush runs its own
+ * copy command, so we wrap the rows in binary headers and footers here.
+ */
+static void
+FileOutputStreamPush(FileOutputStream *file)
+{
+	MultiConnection *connection = file->pushConnection;
+	StringInfo fileBuffer = file->fileBuffer;
+	bool raiseInterrupts = true;
+	CopyOutStateData copyOutStateData;
+	CopyOutState copyOutState = (CopyOutState) & copyOutStateData;
+
+	if (fileBuffer->len == 0)
+	{
+		return;
+	}
+
+	memset(copyOutState, 0, sizeof(CopyOutStateData));
+	copyOutState->fe_msgbuf = makeStringInfo();
+
+	if (!SendRemoteCommand(connection, file->pushCopyCommand))
+	{
+		ReportConnectionError(connection, ERROR);
+	}
+
+	PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+	if (PQresultStatus(result) != PGRES_COPY_IN)
+	{
+		ReportResultError(connection, result, ERROR);
+	}
+
+	PQclear(result);
+
+	if (BinaryWorkerCopyFormat)
+	{
+		AppendCopyBinaryHeaders(copyOutState);
+		PutPushCopyData(connection, copyOutState->fe_msgbuf);
+		resetStringInfo(copyOutState->fe_msgbuf);
+	}
+
+	PutPushCopyData(connection, fileBuffer);
+
+	if (BinaryWorkerCopyFormat)
+	{
+		AppendCopyBinaryFooters(copyOutState);
+		PutPushCopyData(connection, copyOutState->fe_msgbuf);
+	}
+
+	if (!PutRemoteCopyEnd(connection, NULL))
+	{
+		ReportConnectionError(connection, ERROR);
+	}
+
+	result = GetRemoteCommandResult(connection, raiseInterrupts);
+	if (PQresultStatus(result) != PGRES_COMMAND_OK)
+	{
+		ReportResultError(connection, result, ERROR);
+	}
+
+	PQclear(result);
+	ForgetResults(connection);
+
+	FreeStringInfo(copyOutState->fe_msgbuf);
+}
+
+
+/* PutPushCopyData sends the given copy data over the given connection. */
+static void
+PutPushCopyData(MultiConnection *connection, StringInfo copyData)
+{
+	if (!PutRemoteCopyData(connection, copyData->data, copyData->len))
+	{
+		ReportConnectionError(connection, ERROR);
+	}
+}
+
+
+/*
+ * FilterAndPartitionTable executes a given SQL query, and sends the query
+ * results to a partition receiver. For each resulting row, the receiver
+ * applies the partitioning function and determines the partition identifier.
+ * Then, the receiver chooses the partition file corresponding to this
+ * identifier, and serializes the row into this file using the copy command's
+ * text format.
+ *
+ * We prepare the query through SPI, but run it to completion rather than
+ * through a cursor, such that the planner may pick a parallel plan for
+ * scanning and filtering large shards. Rows from all parallel workers still
+ * reach the partition files through our process.
+ *
+ * When the caller passes cacheRelationList, the function sets it to the state
+ * of the relations that the query reads if its output can be cached, and to
+ * NIL otherwise. The query then runs on a snapshot taken after reading that
+ * state; see worker_repartition_cache.c for why.
  */
 static void
 FilterAndPartitionTable(const char *filterQuery,
@@ -859,17 +1312,11 @@ FilterAndPartitionTable(const char *filterQuery,
 						uint32 (*PartitionIdFunction)(Datum, const void *),
 						const void *partitionIdContext,
 						FileOutputStream *partitionFileArray,
-						uint32 fileCount)
+						uint32 fileCount, List **cacheRelationList)
 {
-	FmgrInfo *columnOutputFunctions = NULL;
-	int partitionColumnIndex = 0;
-	Oid partitionColumnTypeId = InvalidOid;
-
-	const char *noPortalName = NULL;
-	const bool readOnly = true;
-	const bool fetchForward = true;
-	const int noCursorOptions = 0;
-	const int prefetchCount = ROW_PREFETCH_COUNT;
+	ParamListInfo paramListInfo = NULL;
+	const bool useResourceOwner = false;
+	bool snapshotPushed = false;
 
 	int connected = SPI_connect();
 	if (connected != SPI_OK_CONNECT)
@@ -877,117 +1324,264 @@ FilterAndPartitionTable(const char *filterQuery,
 		ereport(ERROR, (errmsg("could not connect to SPI manager")));
 	}
 
-	Portal queryPortal = SPI_cursor_open_with_args(noPortalName, filterQuery,
-												   0, NULL, NULL, NULL, /* no arguments */
-												   readOnly, noCursorOptions);
-	if (queryPortal == NULL)
+	SPIPlanPtr queryPlan = SPI_prepare_cursor(filterQuery, 0, NULL,
+											  CURSOR_OPT_PARALLEL_OK);
+	if (queryPlan == NULL)
 	{
-		ereport(ERROR, (errmsg("could not open implicit cursor for query \"%s\"",
+		ereport(ERROR, (errmsg("could not prepare query \"%s\"",
 							   ApplyLogRedaction(filterQuery))));
 	}
 
-	CopyOutState rowOutputState = InitRowOutputState();
+	CachedPlan *cachedPlan = SPI_plan_get_cached_plan(queryPlan);
+	if (cachedPlan == NULL || list_length(cachedPlan->stmt_list) != 1)
+	{
+		ereport(ERROR, (errmsg("filter query \"%s\" must be a single query",
+							   ApplyLogRedaction(filterQuery))));
+	}
 
-	SPI_cursor_fetch(queryPortal, fetchForward, prefetchCount);
-	if (SPI_processed > 0)
+	PlannedStmt *plannedStatement = (PlannedStmt *) linitial(cachedPlan->stmt_list);
+	if (plannedStatement->commandType != CMD_SELECT)
 	{
-		TupleDesc rowDescriptor = SPI_tuptable->tupdesc;
+		ereport(ERROR, (errmsg("filter query \"%s\" must be a SELECT query",
+							   ApplyLogRedaction(filterQuery))));
+	}
 
-		if (fileCount == 0)
-		{
-			ereport(ERROR, (errmsg("no partition to read into")));
-		}
+	if (cacheRelationList != NULL)
+	{
+		*cacheRelationList = RepartitionCacheRelationList(queryPlan, plannedStatement);
+	}
 
-		partitionColumnIndex = ColumnIndex(rowDescriptor, partitionColumnName);
-		partitionColumnTypeId = SPI_gettypeid(rowDescriptor, partitionColumnIndex);
-		if (partitionColumnType != partitionColumnTypeId)
+	if (cacheRelationList != NULL && *cacheRelationList != NIL)
+	{
+		PushActiveSnapshot(GetTransactionSnapshot());
+		snapshotPushed = true;
+
+		if (!SnapshotHasNoConcurrentTransactions(GetActiveSnapshot()))
 		{
-			ereport(ERROR, (errmsg("partition column types %u and %u do not match",
-								   partitionColumnTypeId, partitionColumnType)));
+			*cacheRelationList = NIL;
 		}
-
-		columnOutputFunctions = ColumnOutputFunctions(rowDescriptor,
-													  rowOutputState->binary);
 	}
 
+	DestReceiver *partitionDest =
+		CreatePartitionDestReceiver(partitionColumnName, partitionColumnType,
+									PartitionIdFunction, partitionIdContext,
+									partitionFileArray, fileCount);
+
 	if (BinaryWorkerCopyFormat)
 	{
 		OutputBinaryHeaders(partitionFileArray, fileCount);
 	}
 
-	uint32 columnCount = (uint32) SPI_tuptable->tupdesc->natts;
-	Datum *valueArray = (Datum *) palloc0(columnCount * sizeof(Datum));
-	bool *isNullArray = (bool *) palloc0(columnCount * sizeof(bool));
+	ExecutePlanIntoDestReceiver(plannedStatement, paramListInfo, partitionDest);
 
-	while (SPI_processed > 0)
+	if (BinaryWorkerCopyFormat)
 	{
-		for (int rowIndex = 0; rowIndex < SPI_processed; rowIndex++)
-		{
-			HeapTuple row = SPI_tuptable->vals[rowIndex];
-			TupleDesc rowDescriptor = SPI_tuptable->tupdesc;
-			bool partitionKeyNull = false;
-			uint32 partitionId = 0;
-
-			Datum partitionKey = SPI_getbinval(row, rowDescriptor,
-											   partitionColumnIndex, &partitionKeyNull);
-
-			/*
-			 * If we have a partition key, we compute its bucket. Else if we have
-			 * a null key, we then put this tuple into the 0th bucket. Note that
-			 * the 0th bucket may hold other tuples as well, such as tuples whose
-			 * partition keys hash to the value 0.
-			 */
-			if (!partitionKeyNull)
-			{
-				partitionId = (*PartitionIdFunction)(partitionKey, partitionIdContext);
-				if (partitionId == INVALID_SHARD_INDEX)
-				{
-					ereport(ERROR, (errmsg("invalid distribution column value")));
-				}
-			}
-			else
-			{
-				partitionId = 0;
-			}
+		OutputBinaryFooters(partitionFileArray, fileCount);
+	}
 
-			/* deconstruct the tuple; this is faster than repeated heap_getattr */
-			heap_deform_tuple(row, rowDescriptor, valueArray, isNullArray);
+	partitionDest->rDestroy(partitionDest);
 
-			AppendCopyRowData(valueArray, isNullArray, rowDescriptor,
-							  rowOutputState, columnOutputFunctions, NULL);
+	if (snapshotPushed)
+	{
+		PopActiveSnapshot();
+	}
 
-			StringInfo rowText = rowOutputState->fe_msgbuf;
+	ReleaseCachedPlan(cachedPlan, useResourceOwner);
+	SPI_freeplan(queryPlan);
+
+	int finished = SPI_finish();
+	if (finished != SPI_OK_FINISH)
+	{
+		ereport(ERROR, (errmsg("could not disconnect from SPI manager")));
+	}
+}
 
-			FileOutputStream *partitionFile = &partitionFileArray[partitionId];
-			FileOutputStreamWrite(partitionFile, rowText);
 
-			resetStringInfo(rowText);
-			MemoryContextReset(rowOutputState->rowcontext);
+/*
+ * CreatePartitionDestReceiver creates a DestReceiver that partitions the rows
+ * it receives into the given partition files.
+ */
+static DestReceiver *
+CreatePartitionDestReceiver(const char *partitionColumnName, Oid partitionColumnType,
+							uint32 (*PartitionIdFunction)(Datum, const void *),
+							const void *partitionIdContext,
+							FileOutputStream *partitionFileArray, uint32 fileCount)
+{
+	PartitionDestReceiver *partitionDest =
+		(PartitionDestReceiver *) palloc0(sizeof(PartitionDestReceiver));
+
+	/* set up the DestReceiver function pointers */
+	partitionDest->pub.receiveSlot = PartitionDestReceiverReceive;
+	partitionDest->pub.rStartup = PartitionDestReceiverStartup;
+	partitionDest->pub.rShutdown = PartitionDestReceiverShutdown;
+	partitionDest->pub.rDestroy = PartitionDestReceiverDestroy;
+	partitionDest->pub.mydest = DestCopyOut;
+
+	partitionDest->partitionColumnName = partitionColumnName;
+	partitionDest->partitionColumnType = partitionColumnType;
+	partitionDest->PartitionIdFunction = PartitionIdFunction;
+	partitionDest->partitionIdContext = partitionIdContext;
+	partitionDest->partitionFileArray = partitionFileArray;
+	partitionDest->fileCount = fileCount;
+	partitionDest->memoryContext = CurrentMemoryContext;
+
+	return (DestReceiver *) partitionDest;
+}
+
+
+/*
+ * PartitionDestReceiverStartup implements the rStartup interface of
+ * PartitionDestReceiver. It finds the partition column in the query results,
+ * and sets up the state for serializing rows.
+ */
+static void
+PartitionDestReceiverStartup(DestReceiver *dest, int operation,
+							 TupleDesc inputTupleDescriptor)
+{
+	PartitionDestReceiver *partitionDest = (PartitionDestReceiver *) dest;
+
+	MemoryContext oldContext = MemoryContextSwitchTo(partitionDest->memoryContext);
+
+	if (partitionDest->fileCount == 0)
+	{
+		ereport(ERROR, (errmsg("no partition to read into")));
+	}
+
+	if (partitionDest->PartitionIdFunction != NULL)
+	{
+		int partitionColumnIndex = ColumnIndex(inputTupleDescriptor,
+											   partitionDest->partitionColumnName);
+		Oid partitionColumnTypeId = SPI_gettypeid(inputTupleDescriptor,
+												  partitionColumnIndex);
+		if (partitionDest->partitionColumnType != partitionColumnTypeId)
+		{
+			ereport(ERROR, (errmsg("partition column types %u and %u do not match",
+								   partitionColumnTypeId,
+								   partitionDest->partitionColumnType)));
 		}
 
-		SPI_freetuptable(SPI_tuptable);
+		partitionDest->partitionColumnIndex = partitionColumnIndex;
+	}
 
-		SPI_cursor_fetch(queryPortal, fetchForward, prefetchCount);
+	partitionDest->rowOutputState = InitRowOutputState();
+	partitionDest->columnOutputFunctions =
+		ColumnOutputFunctions(inputTupleDescriptor,
+							  partitionDest->rowOutputState->binary);
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * PartitionDestReceiverReceive implements the receiveSlot function of
+ * PartitionDestReceiver. It serializes the row in the given slot into the
+ * buffer of the row's partition.
+ */
+static bool
+PartitionDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
+{
+	PartitionDestReceiver *partitionDest = (PartitionDestReceiver *) dest;
+	TupleDesc rowDescriptor = slot->tts_tupleDescriptor;
+	CopyOutState rowOutputState = partitionDest->rowOutputState;
+	int partitionColumnOffset = partitionDest->partitionColumnIndex - 1;
+	uint32 partitionId = 0;
+
+	/* deconstruct the tuple; this is faster than repeated heap_getattr */
+	slot_getallattrs(slot);
+
+	Datum *valueArray = slot->tts_values;
+	bool *isNullArray = slot->tts_isnull;
+
+	/*
+	 * If we have a partition key, we compute its bucket. Else if we have
+	 * a null key, we then put this tuple into the 0th bucket. Note that
+	 * the 0th bucket may hold other tuples as well, such as tuples whose
+	 * partition keys hash to the value 0.
+	 */
+	if (partitionDest->PartitionIdFunction != NULL &&
+		!isNullArray[partitionColumnOffset])
+	{
+		Datum partitionKey = valueArray[partitionColumnOffset];
+
+		partitionId = (*partitionDest->PartitionIdFunction)(
+			partitionKey, partitionDest->partitionIdContext);
+		if (partitionId == INVALID_SHARD_INDEX)
+		{
+			ereport(ERROR, (errmsg("invalid distribution column value")));
+		}
+	}
+	else
+	{
+		partitionId = 0;
 	}
 
-	pfree(valueArray);
-	pfree(isNullArray);
+	AppendCopyRowData(valueArray, isNullArray, rowDescriptor,
+					  rowOutputState, partitionDest->columnOutputFunctions, NULL);
 
-	SPI_cursor_close(queryPortal);
+	StringInfo rowText = rowOutputState->fe_msgbuf;
 
-	if (BinaryWorkerCopyFormat)
+	if (partitionDest->PartitionIdFunction == NULL)
 	{
-		OutputBinaryFooters(partitionFileArray, fileCount);
+		/* without a partition function, we broadcast the row */
+		for (partitionId = 0; partitionId < partitionDest->fileCount; partitionId++)
+		{
+			FileOutputStream *partitionFile =
+				&partitionDest->partitionFileArray[partitionId];
+			FileOutputStreamWrite(partitionFile, rowText);
+		}
+	}
+	else
+	{
+		FileOutputStream *partitionFile =
+			&partitionDest->partitionFileArray[partitionId];
+		FileOutputStreamWrite(partitionFile, rowText);
 	}
 
-	/* delete row output memory context */
-	ClearRowOutputState(rowOutputState);
+	if (PartitionBufferedBytes > PartitionBufferSizeInBytes)
+	{
+		FlushLargestPartitionBuffer(partitionDest->partitionFileArray,
+									partitionDest->fileCount);
+	}
 
-	int finished = SPI_finish();
-	if (finished != SPI_OK_FINISH)
+	resetStringInfo(rowText);
+	MemoryContextReset(rowOutputState->rowcontext);
+
+	return true;
+}
+
+
+/*
+ * PartitionDestReceiverShutdown implements the rShutdown interface of
+ * PartitionDestReceiver. The caller flushes and closes the partition files.
+ */
+static void
+PartitionDestReceiverShutdown(DestReceiver *dest)
+{
+	/* nothing to do */
+}
+
+
+/*
+ * PartitionDestReceiverDestroy implements the rDestroy interface of
+ * PartitionDestReceiver, and frees the row serialization state.
+ */
+static void
+PartitionDestReceiverDestroy(DestReceiver *dest)
+{
+	PartitionDestReceiver *partitionDest = (PartitionDestReceiver *) dest;
+
+	if (partitionDest->rowOutputState != NULL)
 	{
-		ereport(ERROR, (errmsg("could not disconnect from SPI manager")));
+		/* delete row output memory context */
+		ClearRowOutputState(partitionDest->rowOutputState);
+	}
+
+	if (partitionDest->columnOutputFunctions != NULL)
+	{
+		pfree(partitionDest->columnOutputFunctions);
 	}
+
+	pfree(partitionDest);
 }
 
 
@@ -1106,6 +1700,13 @@ OutputBinaryHeaders(FileOutputStream *partitionFileArray, uint32 fileCount)
 	{
 		/* Generate header for a binary copy */
 		FileOutputStream partitionFile = { };
+
+		/* pushed streams wrap every copy in its own binary headers */
+		if (partitionFileArray[fileIndex].filePath == NULL)
+		{
+			continue;
+		}
+
 		CopyOutStateData headerOutputStateData;
 		CopyOutState headerOutputState = (CopyOutState) & headerOutputStateData;
 
@@ -1131,6 +1732,13 @@ OutputBinaryFooters(FileOutputStream *partitionFileArray, uint32 fileCount)
 	{
 		/* Generate footer for a binary copy */
 		FileOutputStream partitionFile = { };
+
+		/* pushed streams wrap every copy in its own binary footers */
+		if (partitionFileArray[fileIndex].filePath == NULL)
+		{
+			continue;
+		}
+
 		CopyOutStateData footerOutputStateData;
 		CopyOutState footerOutputState = (CopyOutState) & footerOutputStateData;
 
@@ -1227,8 +1835,9 @@ HashPartitionId(Datum partitionValue, const void *context)
 	ShardInterval **syntheticShardIntervalArray =
 		hashPartitionContext->syntheticShardIntervalArray;
 	FmgrInfo *comparisonFunction = hashPartitionContext->comparisonFunction;
-	Datum hashDatum = FunctionCall1Coll(hashFunction, hashPartitionContext->collation,
-										partitionValue);
+	Datum hashDatum = HashPartitionColumnValue(hashFunction,
+											   hashPartitionContext->collation,
+											   partitionValue);
 	int32 hashResult = 0;
 	uint32 hashPartitionId = 0;
 
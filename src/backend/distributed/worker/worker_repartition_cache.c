@@ -0,0 +1,743 @@
+/*-------------------------------------------------------------------------
+ *
+ * worker_repartition_cache.c
+ *
+ * Routines for reusing the partition files of map tasks across repartition
+ * jobs. Reports often run the same repartition join over and over on data
+ * that did not change, and each run partitions the same shards into the same
+ * files. When citus.enable_repartition_cache is on, a map task that writes
+ * partition files also links them into a cache entry, and a later map task
+ * with the same filter query and partitioning arguments links the files of
+ * the entry into its task directory instead of running the filter query.
+ *
+ * An entry is only reused when the relations that the filter query read did
+ * not change since. For this, the entry records the file node, the number of
+ * blocks and the largest page LSN of each relation, which any write to the
+ * relation advances. We read the LSNs before taking the snapshot of the filter
+ * query, and only create an entry if no transaction was in progress at that
+ * snapshot. The map output then holds all changes up to the recorded LSNs,
+ * and any transaction that it misses writes pages with a larger LSN.
+ *
+ * Checking the LSNs reads all pages of the relations, but it is still much
+ * cheaper than filtering, partitioning and writing out their rows. Entries
+ * live in the job cache directory, which is removed when the server restarts,
+ * and worker_repartition_cache_reset() removes them at any time.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if PG_VERSION_NUM >= 120000
+#include "access/table.h"
+#endif
+#include "access/hash.h"
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "access/transam.h"
+#include "access/xact.h"
+#include "access/xlogdefs.h"
+#include "catalog/pg_class.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/worker_protocol.h"
+#include "distributed/worker_repartition_cache.h"
+#include "optimizer/clauses.h"
+#if PG_VERSION_NUM >= 120000
+#include "optimizer/optimizer.h"
+#endif
+#include "storage/bufmgr.h"
+#include "storage/fd.h"
+#include "storage/lmgr.h"
+#include "utils/acl.h"
+#include "utils/lsyscache.h"
+#include "utils/plancache.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+#include "utils/syscache.h"
+
+
+/* identifies the metadata files of cache entries */
+#define REPARTITION_CACHE_MAGIC 0x43525031
+#define REPARTITION_CACHE_METADATA_FILE "metadata"
+
+
+/* fixed size header of the metadata file of a cache entry */
+typedef struct RepartitionCacheHeader
+{
+	uint32 magic;
+	uint32 fileCount;
+	uint32 keyLength;
+	uint32 relationCount;
+} RepartitionCacheHeader;
+
+
+/*
+ * RepartitionCacheRelation describes the state of a relation that the filter
+ * query of a cache entry read. Relations without storage only have the xmin
+ * of their pg_class row, which changes with their definition or privileges.
+ */
+typedef struct RepartitionCacheRelation
+{
+	Oid relationId;
+	Oid relationFileNode;
+	TransactionId classXmin;
+	BlockNumber blockCount;
+	XLogRecPtr contentLsn;
+} RepartitionCacheRelation;
+
+
+/* Config variable managed via guc.c */
+bool EnableRepartitionCache = false;
+
+
+static StringInfo RepartitionCacheDirectoryName(void);
+static StringInfo RepartitionCacheEntryName(StringInfo cacheKey);
+static void AppendCacheKeyArgument(StringInfo cacheKey, FunctionCallInfo fcinfo,
+								   int argumentIndex);
+static bool QueryListHasMutableFunctions(SPIPlanPtr queryPlan);
+static bool RelationStateIsCacheable(Oid relationId,
+									 RepartitionCacheRelation *relationState);
+static bool RelationHasStorage(char relationKind);
+static XLogRecPtr RelationContentLsn(Relation relation);
+static bool RelationStateChanged(RepartitionCacheRelation *cachedState);
+static bool ReadRepartitionCacheMetadata(StringInfo metadataFileName,
+										 StringInfo cacheKey, uint32 fileCount,
+										 List **relationList);
+static void WriteRepartitionCacheMetadata(StringInfo metadataFileName,
+										  StringInfo cacheKey, uint32 fileCount,
+										  List *relationList);
+
+
+PG_FUNCTION_INFO_V1(worker_repartition_cache_reset);
+
+
+/*
+ * worker_repartition_cache_reset removes all cached map outputs of this node.
+ */
+Datum
+worker_repartition_cache_reset(PG_FUNCTION_ARGS)
+{
+	StringInfo cacheDirectoryName = RepartitionCacheDirectoryName();
+
+	CheckCitusVersion(ERROR);
+
+	CitusRemoveDirectory(cacheDirectoryName);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * RepartitionCacheEnabled returns whether map tasks should reuse and store
+ * cached partition files. Transactions that use a single snapshot might see
+ * older data than the cache entries, so they never use the cache.
+ */
+bool
+RepartitionCacheEnabled(void)
+{
+	return EnableRepartitionCache && !IsolationUsesXactSnapshot();
+}
+
+
+/*
+ * RepartitionCacheKey serializes everything that determines the output of the
+ * calling partition function: the function itself, the current user and
+ * database, the collation, the copy format, and all arguments past the job and
+ * task ids up to the given argument count. The function returns NULL when it
+ * cannot determine the types of the arguments.
+ */
+StringInfo
+RepartitionCacheKey(FunctionCallInfo fcinfo, int keyArgumentCount)
+{
+	StringInfo cacheKey = makeStringInfo();
+	Oid functionId = fcinfo->flinfo->fn_oid;
+	Oid userId = GetUserId();
+	Oid collationId = PG_GET_COLLATION();
+	int argumentCount = Min(PG_NARGS(), keyArgumentCount);
+
+	appendBinaryStringInfo(cacheKey, (char *) &functionId, sizeof(Oid));
+	appendBinaryStringInfo(cacheKey, (char *) &userId, sizeof(Oid));
+	appendBinaryStringInfo(cacheKey, (char *) &MyDatabaseId, sizeof(Oid));
+	appendBinaryStringInfo(cacheKey, (char *) &collationId, sizeof(Oid));
+	appendBinaryStringInfo(cacheKey, (char *) &BinaryWorkerCopyFormat, sizeof(bool));
+
+	/* the first two arguments are the job and task ids */
+	for (int argumentIndex = 2; argumentIndex < argumentCount; argumentIndex++)
+	{
+		if (!OidIsValid(get_fn_expr_argtype(fcinfo->flinfo, argumentIndex)))
+		{
+			return NULL;
+		}
+
+		AppendCacheKeyArgument(cacheKey, fcinfo, argumentIndex);
+	}
+
+	return cacheKey;
+}
+
+
+/*
+ * AppendCacheKeyArgument appends the length and the contents of the given
+ * argument of the partition function to the cache key.
+ */
+static void
+AppendCacheKeyArgument(StringInfo cacheKey, FunctionCallInfo fcinfo, int argumentIndex)
+{
+	Oid argumentType = get_fn_expr_argtype(fcinfo->flinfo, argumentIndex);
+	int16 typeLength = 0;
+	bool typeByValue = false;
+	int32 argumentLength = -1;
+
+	if (PG_ARGISNULL(argumentIndex))
+	{
+		appendBinaryStringInfo(cacheKey, (char *) &argumentLength, sizeof(int32));
+		return;
+	}
+
+	Datum argument = PG_GETARG_DATUM(argumentIndex);
+	char *argumentData = NULL;
+
+	get_typlenbyval(argumentType, &typeLength, &typeByValue);
+
+	if (typeByValue)
+	{
+		argumentData = (char *) &argument;
+		argumentLength = sizeof(Datum);
+	}
+	else if (typeLength == -1)
+	{
+		struct varlena *varlenaArgument = PG_DETOAST_DATUM_PACKED(argument);
+
+		argumentData = VARDATA_ANY(varlenaArgument);
+		argumentLength = VARSIZE_ANY_EXHDR(varlenaArgument);
+	}
+	else if (typeLength == -2)
+	{
+		argumentData = DatumGetCString(argument);
+		argumentLength = strlen(argumentData);
+	}
+	else
+	{
+		argumentData = DatumGetPointer(argument);
+		argumentLength = typeLength;
+	}
+
+	appendBinaryStringInfo(cacheKey, (char *) &argumentLength, sizeof(int32));
+	appendBinaryStringInfo(cacheKey, argumentData, argumentLength);
+}
+
+
+/*
+ * RepartitionCacheEntryDirectory returns the directory of the cache entry of
+ * the given key if the entry exists, has the given number of partition files,
+ * and none of the relations that its filter query read changed since.
+ * Otherwise, the function returns NULL.
+ */
+StringInfo
+RepartitionCacheEntryDirectory(StringInfo cacheKey, uint32 fileCount)
+{
+	StringInfo entryDirectoryName = RepartitionCacheEntryName(cacheKey);
+	StringInfo metadataFileName = makeStringInfo();
+	List *relationList = NIL;
+	ListCell *relationCell = NULL;
+
+	appendStringInfo(metadataFileName, "%s/%s", entryDirectoryName->data,
+					 REPARTITION_CACHE_METADATA_FILE);
+
+	if (!ReadRepartitionCacheMetadata(metadataFileName, cacheKey, fileCount,
+									  &relationList))
+	{
+		return NULL;
+	}
+
+	foreach(relationCell, relationList)
+	{
+		RepartitionCacheRelation *cachedState =
+			(RepartitionCacheRelation *) lfirst(relationCell);
+
+		if (RelationStateChanged(cachedState))
+		{
+			ereport(DEBUG2, (errmsg("relation %u changed since the map output in "
+									"\"%s\" was cached", cachedState->relationId,
+									entryDirectoryName->data)));
+			return NULL;
+		}
+	}
+
+	return entryDirectoryName;
+}
+
+
+/*
+ * RepartitionCacheRelationList returns the current state of the relations
+ * that the given filter query reads, which the cache entry for the output of
+ * the query records. The function returns NIL when the output of the query
+ * cannot be cached, because the query calls functions whose results might
+ * change without the relations changing, or because it reads relations whose
+ * changes we cannot detect.
+ *
+ * The function reads the page LSNs of the relations, and the caller should
+ * take the snapshot of the filter query afterwards.
+ */
+List *
+RepartitionCacheRelationList(SPIPlanPtr queryPlan, PlannedStmt *plannedStatement)
+{
+	List *relationIdList = NIL;
+	List *relationList = NIL;
+	ListCell *relationIdCell = NULL;
+
+	if (QueryListHasMutableFunctions(queryPlan))
+	{
+		return NIL;
+	}
+
+	foreach(relationIdCell, plannedStatement->relationOids)
+	{
+		relationIdList = list_append_unique_oid(relationIdList,
+												lfirst_oid(relationIdCell));
+	}
+
+	if (relationIdList == NIL)
+	{
+		return NIL;
+	}
+
+	foreach(relationIdCell, relationIdList)
+	{
+		Oid relationId = lfirst_oid(relationIdCell);
+		RepartitionCacheRelation *relationState =
+			palloc0(sizeof(RepartitionCacheRelation));
+
+		if (!RelationStateIsCacheable(relationId, relationState))
+		{
+			return NIL;
+		}
+
+		relationList = lappend(relationList, relationState);
+	}
+
+	return relationList;
+}
+
+
+/*
+ * QueryListHasMutableFunctions returns whether any query of the given plan
+ * calls a volatile or stable function, such as now().
+ */
+static bool
+QueryListHasMutableFunctions(SPIPlanPtr queryPlan)
+{
+	ListCell *planSourceCell = NULL;
+
+	foreach(planSourceCell, SPI_plan_get_plan_sources(queryPlan))
+	{
+		CachedPlanSource *planSource = (CachedPlanSource *) lfirst(planSourceCell);
+		ListCell *queryCell = NULL;
+
+		foreach(queryCell, planSource->query_list)
+		{
+			if (contain_mutable_functions((Node *) lfirst(queryCell)))
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * RelationStateIsCacheable fills the current state of the given relation, and
+ * returns whether the cache can detect changes to the relation. Only permanent
+ * tables and materialized views write WAL for all changes, and the rows that
+ * row level security shows depend on more than the relation itself.
+ */
+static bool
+RelationStateIsCacheable(Oid relationId, RepartitionCacheRelation *relationState)
+{
+	HeapTuple classTuple = SearchSysCache1(RELOID, ObjectIdGetDatum(relationId));
+	if (!HeapTupleIsValid(classTuple))
+	{
+		return false;
+	}
+
+	Form_pg_class classForm = (Form_pg_class) GETSTRUCT(classTuple);
+	char relationKind = classForm->relkind;
+	bool cacheable = classForm->relpersistence == RELPERSISTENCE_PERMANENT &&
+					 !classForm->relrowsecurity &&
+					 (relationKind == RELKIND_RELATION ||
+					  relationKind == RELKIND_MATVIEW ||
+					  relationKind == RELKIND_PARTITIONED_TABLE ||
+					  relationKind == RELKIND_VIEW);
+
+	relationState->relationId = relationId;
+	relationState->relationFileNode = classForm->relfilenode;
+	relationState->classXmin = HeapTupleHeaderGetXmin(classTuple->t_data);
+
+	ReleaseSysCache(classTuple);
+
+	if (!cacheable)
+	{
+		return false;
+	}
+
+	if (RelationHasStorage(relationKind))
+	{
+		Relation relation = relation_open(relationId, AccessShareLock);
+
+		relationState->blockCount = RelationGetNumberOfBlocks(relation);
+		relationState->contentLsn = RelationContentLsn(relation);
+
+		relation_close(relation, NoLock);
+	}
+
+	return true;
+}
+
+
+/* RelationHasStorage returns whether relations of the given kind have pages. */
+static bool
+RelationHasStorage(char relationKind)
+{
+	return relationKind == RELKIND_RELATION || relationKind == RELKIND_MATVIEW;
+}
+
+
+/*
+ * RelationContentLsn returns the largest LSN of the pages of the given
+ * relation. Inserts, updates and deletes all set the LSN of the pages they
+ * change, so the LSN only stays the same while the contents do.
+ */
+static XLogRecPtr
+RelationContentLsn(Relation relation)
+{
+	BlockNumber blockCount = RelationGetNumberOfBlocks(relation);
+	BufferAccessStrategy strategy = GetAccessStrategy(BAS_BULKREAD);
+	XLogRecPtr contentLsn = InvalidXLogRecPtr;
+
+	for (BlockNumber blockNumber = 0; blockNumber < blockCount; blockNumber++)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		Buffer buffer = ReadBufferExtended(relation, MAIN_FORKNUM, blockNumber,
+										   RBM_NORMAL, strategy);
+		XLogRecPtr pageLsn = BufferGetLSNAtomic(buffer);
+
+		ReleaseBuffer(buffer);
+
+		if (pageLsn > contentLsn)
+		{
+			contentLsn = pageLsn;
+		}
+	}
+
+	FreeAccessStrategy(strategy);
+
+	return contentLsn;
+}
+
+
+/*
+ * RelationStateChanged returns whether the given relation no longer has the
+ * state recorded in a cache entry, or the current user may no longer read it.
+ */
+static bool
+RelationStateChanged(RepartitionCacheRelation *cachedState)
+{
+	RepartitionCacheRelation currentState;
+	Oid relationId = cachedState->relationId;
+
+	memset(&currentState, 0, sizeof(currentState));
+
+	/* the map task reads the relation through the cache, lock it like a query */
+	LockRelationOid(relationId, AccessShareLock);
+
+	if (pg_class_aclcheck(relationId, GetUserId(), ACL_SELECT) != ACLCHECK_OK)
+	{
+		return true;
+	}
+
+	if (!RelationStateIsCacheable(relationId, &currentState))
+	{
+		return true;
+	}
+
+	return currentState.relationFileNode != cachedState->relationFileNode ||
+		   currentState.classXmin != cachedState->classXmin ||
+		   currentState.blockCount != cachedState->blockCount ||
+		   currentState.contentLsn != cachedState->contentLsn;
+}
+
+
+/*
+ * SnapshotHasNoConcurrentTransactions returns whether no transaction was in
+ * progress when the given snapshot was taken. The output of a filter query
+ * that runs on such a snapshot holds all changes whose LSNs precede the
+ * snapshot, so it can be cached with the LSNs read before the snapshot.
+ */
+bool
+SnapshotHasNoConcurrentTransactions(Snapshot snapshot)
+{
+	if (TransactionIdIsValid(GetTopTransactionIdIfAny()))
+	{
+		return false;
+	}
+
+	if (snapshot->xcnt != 0 || snapshot->subxcnt != 0 || snapshot->suboverflowed)
+	{
+		return false;
+	}
+
+	/* transactions that got their ids after the snapshot was computed */
+	return TransactionIdEquals(snapshot->xmin, snapshot->xmax) &&
+		   TransactionIdEquals(ReadNewTransactionId(), snapshot->xmax);
+}
+
+
+/*
+ * LinkPartitionFiles creates hard links to the partition files of the current
+ * user in the source directory in the target directory. If a file is missing,
+ * because another backend replaced the cache entry in the meantime, the
+ * function removes the links it created and returns false.
+ */
+bool
+LinkPartitionFiles(StringInfo sourceDirectoryName, StringInfo targetDirectoryName,
+				   uint32 fileCount)
+{
+	for (uint32 fileIndex = 0; fileIndex < fileCount; fileIndex++)
+	{
+		StringInfo sourceFileName = UserPartitionFilename(sourceDirectoryName,
+														  fileIndex);
+		StringInfo targetFileName = UserPartitionFilename(targetDirectoryName,
+														  fileIndex);
+
+		if (link(sourceFileName->data, targetFileName->data) == 0)
+		{
+			continue;
+		}
+
+		if (errno != ENOENT)
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not link file \"%s\" to \"%s\": %m",
+								   sourceFileName->data, targetFileName->data)));
+		}
+
+		/* the links share their files with the cache, never write to them */
+		for (uint32 linkedIndex = 0; linkedIndex < fileIndex; linkedIndex++)
+		{
+			StringInfo linkedFileName = UserPartitionFilename(targetDirectoryName,
+															  linkedIndex);
+
+			if (unlink(linkedFileName->data) != 0)
+			{
+				ereport(ERROR, (errcode_for_file_access(),
+								errmsg("could not remove file \"%s\": %m",
+									   linkedFileName->data)));
+			}
+		}
+
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * StoreRepartitionCacheEntry caches the partition files of a finished map task
+ * under the given key, along with the state of the relations that its filter
+ * query read. The entry is created in a directory of its own and renamed into
+ * place, replacing any stale entry. If another backend stores an entry for the
+ * same key at the same time, one of them keeps its entry.
+ */
+void
+StoreRepartitionCacheEntry(StringInfo cacheKey, List *relationList,
+						   StringInfo taskDirectoryName, uint32 fileCount)
+{
+	StringInfo cacheDirectoryName = RepartitionCacheDirectoryName();
+	StringInfo entryDirectoryName = RepartitionCacheEntryName(cacheKey);
+	StringInfo attemptDirectoryName = makeStringInfo();
+	StringInfo metadataFileName = makeStringInfo();
+
+	if (mkdir(cacheDirectoryName->data, S_IRWXU) != 0 && errno != EEXIST)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not create directory \"%s\": %m",
+							   cacheDirectoryName->data)));
+	}
+
+	appendStringInfo(attemptDirectoryName, "%s_%0*u", entryDirectoryName->data,
+					 MIN_TASK_FILENAME_WIDTH, (uint32) random());
+	CitusCreateDirectory(attemptDirectoryName);
+
+	if (!LinkPartitionFiles(taskDirectoryName, attemptDirectoryName, fileCount))
+	{
+		CitusRemoveDirectory(attemptDirectoryName);
+		return;
+	}
+
+	appendStringInfo(metadataFileName, "%s/%s", attemptDirectoryName->data,
+					 REPARTITION_CACHE_METADATA_FILE);
+	WriteRepartitionCacheMetadata(metadataFileName, cacheKey, fileCount,
+								  relationList);
+
+	CitusRemoveDirectory(entryDirectoryName);
+
+	if (rename(attemptDirectoryName->data, entryDirectoryName->data) != 0)
+	{
+		ereport(DEBUG2, (errcode_for_file_access(),
+						 errmsg("could not rename directory \"%s\" to \"%s\": %m",
+								attemptDirectoryName->data,
+								entryDirectoryName->data)));
+
+		CitusRemoveDirectory(attemptDirectoryName);
+		return;
+	}
+
+	ereport(DEBUG2, (errmsg("cached map output in \"%s\"", entryDirectoryName->data)));
+}
+
+
+/*
+ * ReadRepartitionCacheMetadata reads the metadata file of a cache entry into
+ * relationList, and returns whether the entry exists and belongs to the given
+ * key and number of partition files.
+ */
+static bool
+ReadRepartitionCacheMetadata(StringInfo metadataFileName, StringInfo cacheKey,
+							 uint32 fileCount, List **relationList)
+{
+	RepartitionCacheHeader header;
+	bool entryMatches = false;
+
+	int fileDescriptor = OpenTransientFile(metadataFileName->data, O_RDONLY | PG_BINARY);
+	if (fileDescriptor < 0)
+	{
+		if (errno != ENOENT)
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not open file \"%s\": %m",
+								   metadataFileName->data)));
+		}
+
+		return false;
+	}
+
+	if (read(fileDescriptor, &header, sizeof(header)) == sizeof(header) &&
+		header.magic == REPARTITION_CACHE_MAGIC &&
+		header.fileCount == fileCount &&
+		header.keyLength == (uint32) cacheKey->len)
+	{
+		char *keyData = palloc(header.keyLength);
+		Size relationArraySize = header.relationCount *
+								 sizeof(RepartitionCacheRelation);
+		RepartitionCacheRelation *relationArray = palloc0(relationArraySize);
+
+		/* a different key can hash to the same entry */
+		entryMatches =
+			read(fileDescriptor, keyData, header.keyLength) ==
+			(ssize_t) header.keyLength &&
+			memcmp(keyData, cacheKey->data, header.keyLength) == 0 &&
+			read(fileDescriptor, relationArray, relationArraySize) ==
+			(ssize_t) relationArraySize;
+
+		for (uint32 relationIndex = 0; entryMatches &&
+			 relationIndex < header.relationCount; relationIndex++)
+		{
+			*relationList = lappend(*relationList, &relationArray[relationIndex]);
+		}
+	}
+
+	CloseTransientFile(fileDescriptor);
+
+	return entryMatches;
+}
+
+
+/*
+ * WriteRepartitionCacheMetadata writes the key, the number of partition files
+ * and the relation states of a cache entry to its metadata file.
+ */
+static void
+WriteRepartitionCacheMetadata(StringInfo metadataFileName, StringInfo cacheKey,
+							  uint32 fileCount, List *relationList)
+{
+	RepartitionCacheHeader header;
+	StringInfo metadata = makeStringInfo();
+	ListCell *relationCell = NULL;
+	const int fileFlags = (O_CREAT | O_EXCL | O_WRONLY | PG_BINARY);
+
+	memset(&header, 0, sizeof(header));
+	header.magic = REPARTITION_CACHE_MAGIC;
+	header.fileCount = fileCount;
+	header.keyLength = cacheKey->len;
+	header.relationCount = list_length(relationList);
+
+	appendBinaryStringInfo(metadata, (char *) &header, sizeof(header));
+	appendBinaryStringInfo(metadata, cacheKey->data, cacheKey->len);
+
+	foreach(relationCell, relationList)
+	{
+		RepartitionCacheRelation *relationState =
+			(RepartitionCacheRelation *) lfirst(relationCell);
+
+		appendBinaryStringInfo(metadata, (char *) relationState,
+							   sizeof(RepartitionCacheRelation));
+	}
+
+	int fileDescriptor = OpenTransientFile(metadataFileName->data, fileFlags);
+	if (fileDescriptor < 0)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not create file \"%s\": %m",
+							   metadataFileName->data)));
+	}
+
+	if (write(fileDescriptor, metadata->data, metadata->len) != metadata->len)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not write file \"%s\": %m",
+							   metadataFileName->data)));
+	}
+
+	CloseTransientFile(fileDescriptor);
+}
+
+
+/* RepartitionCacheDirectoryName returns the directory of all cache entries. */
+static StringInfo
+RepartitionCacheDirectoryName(void)
+{
+	StringInfo cacheDirectoryName = makeStringInfo();
+
+	appendStringInfo(cacheDirectoryName, "base/%s/%s", PG_JOB_CACHE_DIR,
+					 REPARTITION_CACHE_DIRECTORY);
+
+	return cacheDirectoryName;
+}
+
+
+/*
+ * RepartitionCacheEntryName returns the directory of the cache entry for the
+ * given key, which is named after the hash of the key.
+ */
+static StringInfo
+RepartitionCacheEntryName(StringInfo cacheKey)
+{
+	StringInfo entryDirectoryName = RepartitionCacheDirectoryName();
+	uint64 keyHash = DatumGetUInt64(hash_any_extended((unsigned char *) cacheKey->data,
+													  cacheKey->len, 0));
+
+	appendStringInfo(entryDirectoryName, "/%016" INT64_MODIFIER "x", keyHash);
+
+	return entryDirectoryName;
+}
@@ -0,0 +1,40 @@
+/*-------------------------------------------------------------------------
+ *
+ * admission_control.h
+ *	  Limits on the number of concurrent distributed executions per role and
+ *	  per tenant.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef ADMISSION_CONTROL_H
+#define ADMISSION_CONTROL_H
+
+#include "nodes/primnodes.h"
+
+
+/* priority classes of distributed executions */
+typedef enum ExecutionPriority
+{
+	EXECUTION_PRIORITY_NORMAL = 0,
+	EXECUTION_PRIORITY_HIGH = 1
+} ExecutionPriority;
+
+
+/* config variables managed via guc.c */
+extern int MaxExecutionsPerRole;
+extern int MaxExecutionsPerTenant;
+extern int CurrentExecutionPriority;
+
+
+extern void InitializeAdmissionControl(void);
+extern bool AdmitDistributedExecution(Const *partitionKeyValue);
+extern void FinishAdmittedExecution(void);
+extern void AdmissionControlAtXactEnd(void);
+extern void AdmissionControlAtSubXactEnd(bool isCommit, SubTransactionId subId,
+										 SubTransactionId parentSubId);
+
+
+#endif /* ADMISSION_CONTROL_H */
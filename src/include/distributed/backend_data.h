@@ -15,6 +15,7 @@
 
 #include "access/twophase.h"
 #include "datatype/timestamp.h"
+#include "distributed/memory_usage.h"
 #include "distributed/transaction_identifier.h"
 #include "nodes/pg_list.h"
 #include "storage/lwlock.h"
@@ -52,6 +53,9 @@ typedef struct BackendData
 	bool cancelledDueToDeadlock;
 	CitusInitiatedBackend citusBackend;
 	DistributedTransactionId transactionId;
+
+	/* memory used by Citus as last reported by the backend, kept across transactions */
+	CitusMemoryUsage memoryUsage;
 } BackendData;
 
 
@@ -64,6 +68,7 @@ extern void UnSetDistributedTransactionId(void);
 extern void AssignDistributedTransactionId(void);
 extern void MarkCitusInitiatedCoordinatorBackend(void);
 extern void GetBackendDataForProc(PGPROC *proc, BackendData *result);
+extern void SetBackendMemoryUsage(CitusMemoryUsage *memoryUsage);
 extern void CancelTransactionDueToDeadlock(PGPROC *proc);
 extern bool MyBackendGotCancelledDueToDeadlock(void);
 extern List * ActiveDistributedTransactionNumbers(void);
@@ -16,7 +16,12 @@
 #include "nodes/parsenodes.h"
 
 extern bool RequiresMasterEvaluation(Query *query);
-extern void ExecuteMasterEvaluableFunctions(Query *query, PlanState *planState);
+extern void ExecuteMasterEvaluableFunctions(Query *query, PlanState *planState,
+											bool keepExternParams);
+extern List * MasterEvaluableTargetEntryResnos(Query *query);
+extern List * MutableTargetEntryResnos(Query *query, List *resnoList);
+extern Query * ExecuteMasterEvaluableTargetEntries(Query *query, List *resnoList,
+												   PlanState *planState);
 extern Node * PartiallyEvaluateExpression(Node *expression, PlanState *planState);
 extern bool CitusIsVolatileFunction(Node *node);
 extern bool CitusIsMutableFunction(Node *node);
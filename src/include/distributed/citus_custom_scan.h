@@ -13,6 +13,7 @@
 #include "distributed/distributed_planner.h"
 #include "distributed/multi_server_executor.h"
 #include "executor/execdesc.h"
+#include "portability/instr_time.h"
 #include "nodes/plannodes.h"
 
 
@@ -23,9 +24,28 @@ typedef struct CitusScanState
 	MultiExecutorType executorType;   /* distributed executor type */
 	bool finishedRemoteScan;          /* flag to check if remote scan is finished */
 	Tuplestorestate *tuplestorestate; /* tuple store to store distributed results */
+
+	/* whether rows may be returned while the execution is still running */
+	bool canStreamResults;
+
+	/* execution that runs or merges task results while rows are returned */
+	struct DistributedExecution *distributedExecution;
+
+	/* time at which the scan started, for citus_query_stats() */
+	instr_time startTime;
+
+	/* TaskExecutionInstrumentation of remote tasks, under EXPLAIN ANALYZE */
+	List *taskInstrumentationList;
+
+	/* whether the scan holds the execution slots of admission control */
+	bool admittedExecution;
 } CitusScanState;
 
 
+/* config variable managed via guc.c */
+extern bool EnableRouterParameterPassing;
+
+
 /* custom scan methods for all executors */
 extern CustomScanMethods AdaptiveExecutorCustomScanMethods;
 extern CustomScanMethods TaskTrackerCustomScanMethods;
@@ -52,5 +52,12 @@ extern char * generate_relation_name(Oid relid, List *namespaces);
 extern char * generate_qualified_relation_name(Oid relid);
 extern char * generate_operator_name(Oid operid, Oid arg1, Oid arg2);
 
+/* Config variable managed via guc.c */
+extern bool EnableFastShardQueryDeparse;
+
+/* Function declarations for deparsing simple shard queries without ruleutils */
+extern bool FastDeparseShardQuery(Query *query, Oid distrelid, int64 shardid,
+								  StringInfo buffer);
+
 
 #endif /* CITUS_RULEUTILS_H */
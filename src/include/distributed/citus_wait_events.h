@@ -0,0 +1,33 @@
+/*-------------------------------------------------------------------------
+ *
+ * citus_wait_events.h
+ *	  Wait events that Citus reports while waiting on remote nodes.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef CITUS_WAIT_EVENTS_H
+#define CITUS_WAIT_EVENTS_H
+
+#include "pgstat.h"
+
+/*
+ * CitusWaitEvent lists the waits that are reported with the PG_WAIT_EXTENSION
+ * class. PostgreSQL shows all of them as "Extension" in pg_stat_activity, the
+ * citus_backend_wait_event() function returns their names.
+ */
+typedef enum CitusWaitEvent
+{
+	WAIT_EVENT_CITUS_CONNECT = PG_WAIT_EXTENSION + 1,
+	WAIT_EVENT_CITUS_REMOTE_RESULT,
+	WAIT_EVENT_CITUS_COPY_FLUSH,
+	WAIT_EVENT_CITUS_TWO_PHASE_PREPARE,
+	WAIT_EVENT_CITUS_CONNECTION_SLOT,
+	WAIT_EVENT_CITUS_EXECUTION_SLOT
+} CitusWaitEvent;
+
+extern const char * CitusWaitEventName(uint32 waitEventInfo);
+
+#endif /* CITUS_WAIT_EVENTS_H */
@@ -0,0 +1,30 @@
+/*-------------------------------------------------------------------------
+ *
+ * binary_copy.h
+ *    Declarations for passing binary COPY ... FROM input through to the
+ *    shards without parsing the rows.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef BINARY_COPY_H
+#define BINARY_COPY_H
+
+
+#include "distributed/commands/multi_copy.h"
+#include "nodes/parsenodes.h"
+
+
+/* config variable managed via guc.c */
+extern bool EnableBinaryCopyPassthrough;
+
+
+extern bool CanPassThroughBinaryCopy(CopyStmt *copyStatement,
+									 CitusCopyDestReceiver *copyDest);
+extern uint64 PassThroughBinaryCopy(CopyStmt *copyStatement,
+									CitusCopyDestReceiver *copyDest);
+
+
+#endif /* BINARY_COPY_H */
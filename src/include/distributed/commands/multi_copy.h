@@ -15,6 +15,7 @@
 
 #include "distributed/master_metadata_utility.h"
 #include "distributed/metadata_cache.h"
+#include "distributed/multi_progress.h"
 #include "nodes/execnodes.h"
 #include "nodes/parsenodes.h"
 #include "parser/parse_coerce.h"
@@ -107,6 +108,15 @@ typedef struct CitusCopyDestReceiver
 	CopyOutState copyOutState;
 	FmgrInfo *columnOutputFunctions;
 
+	/*
+	 * Serialised rows that are not yet sent to the placements, indexed by the
+	 * index of the shard in the sorted shard interval array.
+	 */
+	StringInfo *shardRowDataArray;
+	int *pendingShardIndexArray;
+	int pendingShardCount;
+	int pendingRowDataSize;
+
 	/* instructions for coercing incoming tuples */
 	CopyCoercionData *columnCoercionPaths;
 
@@ -118,9 +128,27 @@ typedef struct CitusCopyDestReceiver
 
 	/* copy into intermediate result */
 	char *intermediateResultIdPrefix;
+
+	/* whether missing shards of a time range table are created on demand */
+	bool createTimeRangeShards;
+
+	/* whether rows for placements on this node are copied without a connection */
+	bool useLocalCopy;
+
+	/* operation under which the copy reports its progress per shard */
+	CitusOperationType progressOperation;
+
+	/* progress monitor of the copy, if citus.enable_operation_progress is on */
+	ProgressMonitorData *progressMonitor;
 } CitusCopyDestReceiver;
 
 
+/* config variables managed via guc.c */
+extern int TimeRangeShardInterval;
+extern int MaxCopyConnectionsPerNode;
+extern bool EnableLocalCopy;
+
+
 /* function declarations for copying into a distributed table */
 extern CitusCopyDestReceiver * CreateCitusCopyDestReceiver(Oid relationId,
 														   List *columnNameList,
@@ -128,6 +156,18 @@ extern CitusCopyDestReceiver * CreateCitusCopyDestReceiver(Oid relationId,
 														   EState *executorState,
 														   bool stopOnFailure,
 														   char *intermediateResultPrefix);
+extern void PrepareCopyRowSerialization(CitusCopyDestReceiver *copyDest,
+										TupleDesc inputTupleDescriptor);
+extern int ShardIndexForTuple(CitusCopyDestReceiver *copyDest, Datum *columnValues,
+							  bool *columnNulls);
+extern bool CanCreateTimeRangeShards(Oid relationId);
+extern void CitusSendCopyRowDataToShard(CitusCopyDestReceiver *copyDest, uint64 shardId,
+										StringInfo rowData, int64 rowCount);
+extern void CitusSendCopyRowToShardIndex(CitusCopyDestReceiver *copyDest,
+										 int shardIndex, const char *rowData,
+										 int rowLength);
+extern List * CopyColumnNameList(TupleDesc tupleDescriptor);
+extern Relation CopyRelationForCopyFrom(Relation distributedRelation);
 extern FmgrInfo * ColumnOutputFunctions(TupleDesc rowDescriptor, bool binaryFormat);
 extern bool CanUseBinaryCopyFormat(TupleDesc tupleDescription);
 extern bool CanUseBinaryCopyFormatForType(Oid typeId);
@@ -0,0 +1,40 @@
+/*-------------------------------------------------------------------------
+ *
+ * parallel_copy.h
+ *    Declarations for parsing and routing the rows of COPY ... FROM, and
+ *    the local data of tables in create_distributed_table, in parallel
+ *    workers.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef PARALLEL_COPY_H
+#define PARALLEL_COPY_H
+
+
+#include "distributed/commands/multi_copy.h"
+#include "nodes/parsenodes.h"
+#include "storage/dsm.h"
+#include "storage/shm_toc.h"
+#include "utils/relcache.h"
+
+
+/* config variable managed via guc.c */
+extern int MaxParallelCopyWorkers;
+
+
+extern bool CanCopyInParallel(CopyStmt *copyStatement, Relation distributedRelation);
+extern bool ParallelCopyToExistingShards(CopyStmt *copyStatement,
+										 CitusCopyDestReceiver *copyDest,
+										 uint64 *processedRowCount);
+extern bool ParallelCopyLocalDataToShards(Relation distributedRelation,
+										  CitusCopyDestReceiver *copyDest,
+										  uint64 *processedRowCount);
+extern PGDLLEXPORT void ParallelCopyWorkerMain(dsm_segment *segment, shm_toc *toc);
+extern PGDLLEXPORT void ParallelCopyLocalDataWorkerMain(dsm_segment *segment,
+														shm_toc *toc);
+
+
+#endif /* PARALLEL_COPY_H */
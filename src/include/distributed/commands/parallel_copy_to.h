@@ -0,0 +1,28 @@
+/*-------------------------------------------------------------------------
+ *
+ * parallel_copy_to.h
+ *    Declarations for streaming COPY ... TO STDOUT of distributed tables
+ *    from the shards in parallel.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef PARALLEL_COPY_TO_H
+#define PARALLEL_COPY_TO_H
+
+
+#include "nodes/parsenodes.h"
+
+
+/* config variable managed via guc.c */
+extern bool EnableParallelCopyToStdout;
+
+
+extern bool CanCopyToStdoutFromShards(CopyStmt *copyStatement, Oid relationId);
+extern void CopyToStdoutFromShards(CopyStmt *copyStatement, Oid relationId,
+								   char *completionTag);
+
+
+#endif /* PARALLEL_COPY_TO_H */
@@ -31,6 +31,9 @@ extern bool EnableDDLPropagation;
 extern bool EnableDependencyCreation;
 extern bool EnableCreateTypePropagation;
 extern bool EnableAlterRolePropagation;
+extern int MaxDDLExecutorPoolSize;
+extern bool EnableConcurrentIndexBuildRetries;
+extern bool EnableBatchedTruncate;
 
 /*
  * A DDLJob encapsulates the remote tasks and commands needed to process all or
@@ -44,6 +47,9 @@ typedef struct DDLJob
 	bool concurrentIndexCmd;   /* related to a CONCURRENTLY index command? */
 	const char *commandString; /* initial (coordinator) DDL command string */
 	List *taskList;            /* worker DDL tasks to execute */
+
+	/* name of the index created by CREATE INDEX CONCURRENTLY, NULL otherwise */
+	const char *concurrentIndexName;
 } DDLJob;
 
 
@@ -58,6 +64,8 @@ extern void MarkInvalidateForeignKeyGraph(void);
 extern void InvalidateForeignKeyGraphForDDL(void);
 extern List * DDLTaskList(Oid relationId, const char *commandString);
 extern List * NodeDDLTaskList(TargetWorkerSet targets, List *commands);
+extern int DDLTargetPoolSize(void);
+extern void ExecuteConcurrentIndexBuild(DDLJob *ddlJob);
 extern bool AlterTableInProgress(void);
 extern bool DropSchemaOrDBInProgress(void);
 
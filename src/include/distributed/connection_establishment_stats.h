@@ -0,0 +1,32 @@
+/*-------------------------------------------------------------------------
+ *
+ * connection_establishment_stats.h
+ *   Statistics on the connections that this node establishes to remote
+ *   nodes, kept across backends.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef CONNECTION_ESTABLISHMENT_STATS_H
+#define CONNECTION_ESTABLISHMENT_STATS_H
+
+#include "distributed/connection_management.h"
+
+/* outcome of establishing a connection */
+typedef enum ConnectionAttemptResult
+{
+	CONNECTION_ATTEMPT_SUCCEEDED,
+	CONNECTION_ATTEMPT_FAILED,
+	CONNECTION_ATTEMPT_TIMED_OUT
+} ConnectionAttemptResult;
+
+
+extern void InitializeConnectionEstablishmentStats(void);
+extern void RecordConnectionEstablishmentStart(MultiConnection *connection);
+extern void RecordConnectionEstablishmentResult(MultiConnection *connection,
+												ConnectionAttemptResult result);
+extern void RecordConnectionCacheLookup(const char *hostname, int port, bool cacheHit);
+
+#endif /* CONNECTION_ESTABLISHMENT_STATS_H */
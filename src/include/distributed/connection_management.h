@@ -47,7 +47,14 @@ enum MultiConnectionMode
 	FOR_DML = 1 << 2,
 
 	/* open a connection per (co-located set of) placement(s) */
-	CONNECTION_PER_PLACEMENT = 1 << 3
+	CONNECTION_PER_PLACEMENT = 1 << 3,
+
+	/*
+	 * Only establish a new connection if the node has not reached
+	 * citus.max_shared_pool_size yet. Otherwise, the connection API
+	 * returns NULL instead of waiting for a connection slot.
+	 */
+	OPTIONAL_CONNECTION = 1 << 4
 };
 
 typedef enum MultiConnectionState
@@ -105,6 +112,22 @@ typedef struct MultiConnection
 
 	/* number of bytes sent to PQputCopyData() since last flush */
 	uint64 copyBytesWrittenSinceLastFlush;
+
+	/* whether the connection is counted in the shared connection stats */
+	bool sharedConnectionCounterIncremented;
+
+	/* whether the result of an asynchronous COMMIT PREPARED is still pending */
+	bool commitPreparedPending;
+
+	/* whether the outcome of establishing the connection has been counted */
+	bool establishmentResultRecorded;
+
+	/* statements prepared on the connection, see remote_prepared_statements.c */
+	HTAB *preparedStatementHash;
+	int preparedStatementCount;
+
+	/* time the connection was last returned to the cache, 0 while in use */
+	TimestampTz cachedSince;
 } MultiConnection;
 
 
@@ -150,6 +173,12 @@ extern int NodeConnectionTimeout;
 /* maximum number of connections to cache per worker per session */
 extern int MaxCachedConnectionsPerWorker;
 
+/* whether to establish cached connections to all workers at session start */
+extern bool PrewarmWorkerConnectionsEnabled;
+
+/* idle time after which a cached connection is probed before it is reused */
+extern int CachedConnectionProbeIdleTime;
+
 /* parameters used for outbound connections */
 extern char *NodeConninfo;
 
@@ -168,6 +197,7 @@ extern void InitConnParams(void);
 extern void ResetConnParams(void);
 extern void InvalidateConnParamsHashEntries(void);
 extern void AddConnParam(const char *keyword, const char *value);
+extern void AddDefaultConnParams(void);
 extern void GetConnParams(ConnectionHashKey *key, char ***keywords, char ***values,
 						  Index *runtimeParamStart, MemoryContext context);
 extern const char * GetConnParam(const char *keyword);
@@ -192,6 +222,8 @@ extern MultiConnection * StartNodeUserDatabaseConnection(uint32 flags,
 														 int32 port,
 														 const char *user,
 														 const char *database);
+extern void PrewarmWorkerConnections(void);
+extern void ResetWorkerConnectionsPrewarmed(void);
 extern void CloseNodeConnectionsAfterTransaction(char *nodeName, int nodePort);
 extern void CloseConnection(MultiConnection *connection);
 extern void ShutdownConnection(MultiConnection *connection);
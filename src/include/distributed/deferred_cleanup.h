@@ -0,0 +1,31 @@
+/*-------------------------------------------------------------------------
+ *
+ * deferred_cleanup.h
+ *	  Removal of job directories and intermediate result files outside of
+ *	  the critical path of queries.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef DEFERRED_CLEANUP_H
+#define DEFERRED_CLEANUP_H
+
+#include "lib/stringinfo.h"
+
+
+/* directory in which files wait to be removed by the maintenance daemon */
+#define DEFERRED_CLEANUP_DIR "pgsql_job_cache_trash"
+
+
+/* config variables managed via guc.c */
+extern bool EnableDeferredCleanup;
+extern int DeferredCleanupFilesPerSecond;
+
+
+extern void DeferredRemoveDirectory(StringInfo directoryName);
+extern int RemoveDeferredCleanupFiles(int maxFileCount);
+
+
+#endif /* DEFERRED_CLEANUP_H */
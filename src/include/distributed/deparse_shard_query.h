@@ -15,6 +15,7 @@
 
 #include "c.h"
 
+#include "distributed/multi_physical_planner.h"
 #include "nodes/nodes.h"
 #include "nodes/parsenodes.h"
 #include "nodes/pg_list.h"
@@ -22,6 +23,10 @@
 
 extern void RebuildQueryStrings(Query *originalQuery, List *taskList);
 extern bool UpdateRelationToShardNames(Node *node, List *relationShardList);
+extern char * DeparseShardQueryTemplate(Query *query, List *relationIdList);
+extern char * InstantiateShardQueryTemplate(char *queryTemplate,
+											List *relationShardList);
+extern char * TaskQueryString(Task *task);
 
 
 #endif /* DEPARSE_SHARD_QUERY_H */
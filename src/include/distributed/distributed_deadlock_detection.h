@@ -31,9 +31,23 @@ typedef struct TransactionNode
 	PGPROC *initiatorProc;
 
 	bool transactionVisited;
+
+	/*
+	 * Strongly connected component of the wait graph that the transaction
+	 * belongs to, or INVALID_COMPONENT_ID if it is not part of any cycle.
+	 */
+	int componentId;
+
+	/* bookkeeping for finding the strongly connected components */
+	int componentSearchIndex;
+	int componentLowLink;
+	bool onComponentStack;
 } TransactionNode;
 
 
+#define INVALID_COMPONENT_ID 0
+
+
 /* GUC, determining whether debug messages for deadlock detection sent to LOG */
 extern bool LogDistributedDeadlockDetection;
 
@@ -103,6 +103,11 @@ typedef struct RelationRowLock
 } RelationRowLock;
 
 
+/* config variables managed via guc.c */
+extern bool EnableCoordinatorPartitionPruning;
+extern bool EnableRepartitionedCountDistinct;
+
+
 extern PlannedStmt * distributed_planner(Query *parse, int cursorOptions,
 										 ParamListInfo boundParams);
 extern List * ExtractRangeTableEntryList(Query *query);
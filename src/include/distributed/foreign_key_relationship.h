@@ -15,9 +15,13 @@
 #include "utils/hsearch.h"
 #include "nodes/primnodes.h"
 
+/* config variable managed via guc.c */
+extern bool EnableIncrementalForeignKeyGraph;
+
 extern List * ReferencedRelationIdList(Oid relationId);
 extern List * ReferencingRelationIdList(Oid relationId);
 extern void SetForeignConstraintRelationshipGraphInvalid(void);
+extern void InvalidateForeignConstraintRelationshipGraphForRelation(Oid relationId);
 extern bool IsForeignConstraintRelationshipGraphValid(void);
 extern void ClearForeignConstraintRelationshipGraphContext(void);
 
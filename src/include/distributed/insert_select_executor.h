@@ -17,6 +17,10 @@
 #include "executor/execdesc.h"
 
 
+/* Config variable managed via guc.c */
+extern bool EnableRepartitionedInsertSelect;
+
+
 extern TupleTableSlot * CoordinatorInsertSelectExecScan(CustomScanState *node);
 extern bool ExecutingInsertSelect(void);
 
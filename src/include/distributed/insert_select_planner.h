@@ -23,6 +23,16 @@
 #include "nodes/plannodes.h"
 
 
+#define DISABLE_MULTI_ROW_INSERT_COPY -1
+
+
+/* GUC to push down INSERT ... SELECT from reference tables */
+extern bool EnableReferenceTableInsertSelectPushdown;
+
+/* GUC to copy large multi-row INSERTs into the shards */
+extern int MultiRowInsertCopyThreshold;
+
+
 extern bool InsertSelectIntoDistributedTable(Query *query);
 extern bool InsertSelectIntoLocalTable(Query *query);
 extern Query * ReorderInsertSelectTargetLists(Query *originalQuery,
@@ -34,6 +44,10 @@ extern DistributedPlan * CreateInsertSelectPlan(uint64 planId, Query *originalQu
 												PlannerRestrictionContext *
 												plannerRestrictionContext);
 extern char * InsertSelectResultIdPrefix(uint64 planId);
+extern Var * ReferenceTableSelectPartitionColumn(Query *insertSelectQuery);
+extern bool IsLargeMultiRowInsert(Query *query);
+extern DistributedPlan * CreateMultiRowInsertCopyPlan(uint64 planId,
+													  Query *originalQuery);
 
 
 #endif /* INSERT_SELECT_PLANNER_H */
@@ -14,6 +14,7 @@
 #include "distributed/subplan_execution.h"
 
 extern bool LogIntermediateResults;
+extern bool EnableIntermediateResultPartitioning;
 
 extern List * FindSubPlansUsedInNode(Node *node);
 extern List * FindAllWorkerNodesUsingSubplan(HTAB *intermediateResultsHash,
@@ -21,6 +22,11 @@ extern List * FindAllWorkerNodesUsingSubplan(HTAB *intermediateResultsHash,
 extern HTAB * MakeIntermediateResultHTAB(void);
 extern void RecordSubplanExecutionsOnNodes(HTAB *intermediateResultsHash,
 										   DistributedPlan *distributedPlan);
+extern bool IntermediateResultUsedInSinglePlan(HTAB *intermediateResultsHash,
+											   char *resultId);
+extern void AssignSubPlanResultPartitioning(uint64 planId,
+											DistributedPlan *distributedPlan,
+											Query *originalQuery);
 
 
 #endif /* INTERMEDIATE_RESULT_PRUNING_H */
@@ -0,0 +1,33 @@
+/*-------------------------------------------------------------------------
+ *
+ * intermediate_result_scan.h
+ *   Custom scan that streams rows from an intermediate result file.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef INTERMEDIATE_RESULT_SCAN_H
+#define INTERMEDIATE_RESULT_SCAN_H
+
+#include "nodes/extensible.h"
+#include "nodes/parsenodes.h"
+#if PG_VERSION_NUM >= 120000
+#include "nodes/pathnodes.h"
+#else
+#include "nodes/relation.h"
+#endif
+
+
+/* GUC to stream rows from intermediate result files */
+extern bool EnableStreamingIntermediateResults;
+
+extern CustomScanMethods IntermediateResultCustomScanMethods;
+
+
+extern void AddIntermediateResultScanPath(PlannerInfo *root, RelOptInfo *relOptInfo,
+										  RangeTblEntry *rangeTableEntry);
+
+
+#endif /* INTERMEDIATE_RESULT_SCAN_H */
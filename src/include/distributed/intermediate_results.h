@@ -15,19 +15,79 @@
 #include "fmgr.h"
 
 #include "distributed/commands/multi_copy.h"
+#include "distributed/master_metadata_utility.h"
+#include "distributed/metadata_cache.h"
 #include "nodes/execnodes.h"
 #include "nodes/pg_list.h"
 #include "tcop/dest.h"
 #include "utils/builtins.h"
 #include "utils/palloc.h"
+#include "utils/tuplestore.h"
+
+
+/* writer and reader state for the columnar intermediate result format */
+typedef struct ColumnarResultWriter ColumnarResultWriter;
+typedef struct ColumnarResultReader ColumnarResultReader;
+
+
+/*
+ * DistributedResultFragment describes the part of a task result that belongs
+ * to one shard of a target relation, and the placement on whose node that part
+ * was written.
+ */
+typedef struct DistributedResultFragment
+{
+	char *resultId;
+	ShardPlacement *sourcePlacement;
+	int targetShardIndex;
+	int64 rowCount;
+} DistributedResultFragment;
+
+
+/* GUC to write intermediate results in the columnar format */
+extern bool EnableColumnarIntermediateResults;
 
 
 extern DestReceiver * CreateRemoteFileDestReceiver(char *resultId, EState *executorState,
 												   List *initialNodeList, bool
 												   writeLocalFile);
-extern void ReceiveQueryResultViaCopy(const char *resultId);
+extern void SetRemoteFileDestReceiverPartitioning(DestReceiver *dest, Oid relationId,
+												  int partitionColumnIndex);
+extern uint64 RemoteFileDestReceiverBytesSent(DestReceiver *dest);
+extern void ReceiveQueryResultViaCopy(const char *resultId, bool decompress);
+extern void SendQueryResultViaCopy(const char *resultId);
 extern void RemoveIntermediateResultsDirectory(void);
 extern int64 IntermediateResultSize(char *resultId);
+extern void LinkIntermediateResult(const char *sourceResultId, const char *resultId);
+extern char * QueryResultFileName(const char *resultId);
+
+/* functions defined in distributed_intermediate_results.c */
+extern List ** RedistributeTaskListResults(char *resultIdPrefix, List *selectTaskList,
+										   int partitionColumnIndex,
+										   DistTableCacheEntry *targetRelation);
+extern int64 CountDistinctRedistributedTaskResults(char *resultIdPrefix,
+												   List *selectTaskList,
+												   Node *distinctExpression);
+
+/* functions defined in columnar_intermediate_results.c */
+extern ColumnarResultWriter * CreateColumnarResultWriter(TupleDesc tupleDescriptor);
+extern void ColumnarResultWriteHeader(ColumnarResultWriter *writer,
+									  StringInfo outputBuffer);
+extern bool ColumnarResultAppendRow(ColumnarResultWriter *writer, Datum *columnValues,
+									bool *columnNulls);
+extern void ColumnarResultFlushChunk(ColumnarResultWriter *writer,
+									 StringInfo outputBuffer);
+extern void ColumnarResultWriteFooter(ColumnarResultWriter *writer,
+									  StringInfo outputBuffer);
+extern bool IsColumnarResultFile(const char *fileName);
+extern void ReadColumnarResultFileIntoTupleStore(char *fileName,
+												 TupleDesc tupleDescriptor,
+												 Tuplestorestate *tupstore);
+extern ColumnarResultReader * BeginColumnarResultRead(char *fileName,
+													  TupleDesc tupleDescriptor);
+extern bool ColumnarResultReadNextRow(ColumnarResultReader *reader, Datum *rowValues,
+									  bool *rowNulls);
+extern void EndColumnarResultRead(ColumnarResultReader *reader);
 
 
 #endif /* INTERMEDIATE_RESULTS_H */
@@ -15,6 +15,7 @@
 
 /* enabled with GUCs*/
 extern bool EnableLocalExecution;
+extern bool EnableLocalExecutionForMultiShardReads;
 extern bool LogLocalCommands;
 
 extern bool LocalExecutionHappened;
@@ -0,0 +1,21 @@
+/*-------------------------------------------------------------------------
+ *
+ * local_plan_cache.h
+ *	Functions for caching the plans of locally executed shard queries.
+ *
+ * Copyright (c) 2019, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef LOCAL_PLAN_CACHE_H
+#define LOCAL_PLAN_CACHE_H
+
+#include "nodes/params.h"
+#include "utils/plancache.h"
+
+extern CachedPlan * GetCachedLocalTaskPlan(const char *queryString, Oid *parameterTypes,
+										   int numParams, int cursorOptions,
+										   ParamListInfo paramListInfo);
+
+#endif /* LOCAL_PLAN_CACHE_H */
@@ -18,14 +18,24 @@
 /* if statistics collection fails, retry in 1 minute */
 #define STATS_COLLECTION_RETRY_TIMEOUT_MILLIS (60 * 1000)
 
+/* function run by a maintenance job, see ScheduleMaintenanceJob() */
+typedef void (*MaintenanceJobFunction)(Datum argument);
+
 /* config variable for */
 extern double DistributedDeadlockDetectionTimeoutFactor;
 
+/* config variable managed via guc.c */
+extern bool EnableParallelMaintenanceTasks;
+
 extern void StopMaintenanceDaemon(Oid databaseId);
 extern void TriggerMetadataSync(Oid databaseId);
+extern bool ScheduleMaintenanceJob(Oid databaseId, const char *functionName,
+								   Datum argument);
 extern void InitializeMaintenanceDaemon(void);
 extern void InitializeMaintenanceDaemonBackend(void);
 
 extern void CitusMaintenanceDaemonMain(Datum main_arg);
+extern void CitusMaintenanceTaskMain(Datum main_arg);
+extern void CitusMaintenanceJobMain(Datum main_arg);
 
 #endif /* MAINTENANCED_H */
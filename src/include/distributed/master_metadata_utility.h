@@ -88,8 +88,9 @@ typedef struct ShardPlacement
 } ShardPlacement;
 
 
-/* Config variable managed via guc.c */
+/* Config variables managed via guc.c */
 extern int ReplicationModel;
+extern int TableSizeCacheStaleness;
 
 /* Size functions */
 extern Datum citus_table_size(PG_FUNCTION_ARGS);
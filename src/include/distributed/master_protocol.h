@@ -48,6 +48,9 @@
 #define CANDIDATE_NODE_FIELDS 2
 #define WORKER_NODE_FIELDS 2
 
+/* Maximum number of placements created in a single round trip to a node */
+#define SHARD_CREATE_BATCH_SIZE 32
+
 /* Name of columnar foreign data wrapper */
 #define CSTORE_FDW_NAME "cstore_fdw"
 
@@ -67,6 +70,10 @@
 #define SHARD_RANGE_QUERY "SELECT min(%s), max(%s) FROM %s"
 #define SHARD_TABLE_SIZE_QUERY "SELECT pg_table_size(%s)"
 #define SHARD_CSTORE_TABLE_SIZE_QUERY "SELECT cstore_table_size(%s)"
+#define SHARD_STATISTICS_QUERY \
+	"SELECT " UINT64_FORMAT ", %s, reltuples::float8, relpages::bigint " \
+	"FROM pg_class WHERE oid = %s::regclass"
+#define SHARD_STATISTICS_FIELDS 4
 #define DROP_REGULAR_TABLE_COMMAND "DROP TABLE IF EXISTS %s CASCADE"
 #define DROP_FOREIGN_TABLE_COMMAND "DROP FOREIGN TABLE IF EXISTS %s CASCADE"
 #define CREATE_SCHEMA_COMMAND "CREATE SCHEMA IF NOT EXISTS %s AUTHORIZATION %s"
@@ -78,23 +85,34 @@
 	"SELECT master_update_shard_statistics(" INT64_FORMAT ")"
 #define PARTITION_METHOD_QUERY "SELECT part_method FROM master_get_table_metadata('%s');"
 
+/* values of the citus.shard_transfer_mode enum */
+#define TRANSFER_MODE_AUTOMATIC 'a'
+#define TRANSFER_MODE_FORCE_LOGICAL 'l'
+#define TRANSFER_MODE_BLOCK_WRITES 'b'
+
 /* Enumeration that defines the shard placement policy to use while staging */
 typedef enum
 {
 	SHARD_PLACEMENT_INVALID_FIRST = 0,
 	SHARD_PLACEMENT_LOCAL_NODE_FIRST = 1,
 	SHARD_PLACEMENT_ROUND_ROBIN = 2,
-	SHARD_PLACEMENT_RANDOM = 3
+	SHARD_PLACEMENT_RANDOM = 3,
+	SHARD_PLACEMENT_LEAST_UTILIZED = 4
 } ShardPlacementPolicyType;
 
 
 /* Config variables managed via guc.c */
 extern int ShardCount;
+extern int ShardUnitSize;
 extern int ShardReplicationFactor;
 extern int ShardMaxSize;
 extern int ShardPlacementPolicy;
 extern int NextShardId;
 extern int NextPlacementId;
+extern int RunCommandTimeout;
+extern bool EnableTableDDLCommandCache;
+extern bool RebalanceByShardAccess;
+extern int MaxShardMoveConnections;
 
 
 extern bool IsCoordinator(void);
@@ -109,16 +127,22 @@ extern List * GetTableCreationCommands(Oid relationId, bool forShardCreation);
 extern List * GetTableIndexAndConstraintCommands(Oid relationId);
 extern char ShardStorageType(Oid relationId);
 extern void CheckDistributedTable(Oid relationId);
+extern uint64 CreateEmptyShardWithBounds(Oid relationId, text *shardMinValue,
+										 text *shardMaxValue);
 extern void CreateAppendDistributedShardPlacements(Oid relationId, int64 shardId,
 												   List *workerNodeList, int
 												   replicationFactor);
 extern void CreateShardsOnWorkers(Oid distributedRelationId, List *shardPlacements,
 								  bool useExclusiveConnection,
 								  bool colocatedShard);
+extern void BeginBatchedShardCreation(void);
+extern void FinishBatchedShardCreation(void);
+extern void AbortBatchedShardCreation(void);
 extern List * InsertShardPlacementRows(Oid relationId, int64 shardId,
 									   List *workerNodeList, int workerStartIndex,
 									   int replicationFactor);
 extern uint64 UpdateShardStatistics(int64 shardId);
+extern void RecordTableStatistics(Oid relationId);
 extern void CreateShardsWithRoundRobinPolicy(Oid distributedTableId, int32 shardCount,
 											 int32 replicationFactor,
 											 bool useExclusiveConnections);
@@ -147,6 +171,7 @@ extern Datum master_stage_shard_placement_row(PG_FUNCTION_ARGS);
 /* Function declarations to help with data staging and deletion */
 extern Datum master_create_empty_shard(PG_FUNCTION_ARGS);
 extern Datum master_append_table_to_shard(PG_FUNCTION_ARGS);
+extern Datum master_append_tables_to_shards(PG_FUNCTION_ARGS);
 extern Datum master_update_shard_statistics(PG_FUNCTION_ARGS);
 extern Datum master_apply_delete_command(PG_FUNCTION_ARGS);
 extern Datum master_drop_sequences(PG_FUNCTION_ARGS);
@@ -160,6 +185,9 @@ extern Datum isolate_tenant_to_new_shard(PG_FUNCTION_ARGS);
 
 /* function declarations for shard repair functionality */
 extern Datum master_copy_shard_placement(PG_FUNCTION_ARGS);
+extern char LookupShardTransferMode(Oid shardReplicationModeOid);
+extern bool UseLogicalReplication(List *shardIntervalList, char *sourceNodeName,
+								  int32 sourceNodePort, char shardReplicationMode);
 
 /* function declarations for shard copy functinality */
 extern List * CopyShardCommandList(ShardInterval *shardInterval, char *sourceNodeName,
@@ -0,0 +1,42 @@
+/*-------------------------------------------------------------------------
+ *
+ * memory_usage.h
+ *	  Memory used by the memory contexts that Citus owns, per backend.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef MEMORY_USAGE_H
+#define MEMORY_USAGE_H
+
+#include "datatype/timestamp.h"
+
+
+/* what the memory of a Citus memory context is used for */
+typedef enum CitusMemoryCategory
+{
+	CITUS_MEMORY_METADATA_CACHE = 0,
+	CITUS_MEMORY_CONNECTIONS = 1,
+	CITUS_MEMORY_TRANSACTIONS = 2,
+	CITUS_MEMORY_EXECUTION = 3,
+	CITUS_MEMORY_CATEGORY_COUNT = 4
+} CitusMemoryCategory;
+
+
+/* memory used per category by a backend, as last reported */
+typedef struct CitusMemoryUsage
+{
+	uint64 categoryBytes[CITUS_MEMORY_CATEGORY_COUNT];
+	TimestampTz reportTime;
+} CitusMemoryUsage;
+
+
+/* config variable managed via guc.c */
+extern int MemoryUsageReportInterval;
+
+extern void MeasureCitusMemoryUsage(CitusMemoryUsage *memoryUsage);
+extern void ReportCitusMemoryUsage(void);
+
+#endif /* MEMORY_USAGE_H */
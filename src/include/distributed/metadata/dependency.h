@@ -17,8 +17,12 @@
 #include "catalog/objectaddress.h"
 #include "nodes/pg_list.h"
 
+/* config variable managed via guc.c */
+extern bool EnableDependencyCache;
+
 extern List * GetDependenciesForObject(const ObjectAddress *target);
 extern List * OrderObjectAddressListInDependencyOrder(List *objectAddressList);
 extern bool SupportedDependencyByCitus(const ObjectAddress *address);
+extern void ResetDependencyCache(void);
 
 #endif /* CITUS_DEPENDENCY_H */
@@ -0,0 +1,32 @@
+/*-------------------------------------------------------------------------
+ *
+ * shard_column_stats.h
+ *    Declarations for keeping min/max statistics of additional columns per
+ *    shard, and for pruning shards using them.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SHARD_COLUMN_STATS_H
+#define SHARD_COLUMN_STATS_H
+
+
+#include "nodes/pg_list.h"
+
+
+/* config variable managed via guc.c */
+extern bool EnableColumnStatisticsPruning;
+
+
+extern void UpdateShardColumnStatistics(Oid relationId, uint64 shardId,
+										char *shardQualifiedName,
+										List *shardPlacementList);
+extern void DeleteShardColumnStatistics(Oid relationId);
+extern List * PruneShardsByColumnStatistics(Oid relationId, Index rangeTableId,
+											List *whereClauseList,
+											List *shardIntervalList);
+
+
+#endif /* SHARD_COLUMN_STATS_H */
@@ -25,7 +25,8 @@ extern bool EnableVersionChecks;
 typedef enum
 {
 	USE_SECONDARY_NODES_NEVER = 0,
-	USE_SECONDARY_NODES_ALWAYS = 1
+	USE_SECONDARY_NODES_ALWAYS = 1,
+	USE_SECONDARY_NODES_PREFER = 2
 } ReadFromSecondariesType;
 extern int ReadFromSecondaries;
 
@@ -37,6 +38,14 @@ extern int ReadFromSecondaries;
  */
 #define GROUP_ID_UPGRADING -2
 
+/*
+ * Hash distributed tables without a uniform distribution keep a lookup table
+ * that maps the top HASH_TOKEN_LOOKUP_BITS bits of a hash token to the first
+ * shard that may contain tokens with that prefix.
+ */
+#define HASH_TOKEN_LOOKUP_BITS 10
+#define HASH_TOKEN_LOOKUP_SIZE (1 << HASH_TOKEN_LOOKUP_BITS)
+
 /*
  * Representation of a table's metadata that is frequently used for
  * distributed execution. Cached.
@@ -68,6 +77,32 @@ typedef struct
 	int shardIntervalArrayLength;
 	ShardInterval **sortedShardIntervalArray;
 
+	/*
+	 * Index of the first shard that may contain the hash tokens of each of the
+	 * HASH_TOKEN_LOOKUP_SIZE token ranges. Only built for hash distributed
+	 * tables with non-overlapping shards that are not uniformly distributed,
+	 * NULL otherwise.
+	 */
+	int *hashTokenShardIndexArray;
+
+	/*
+	 * Hash token ranges of the shards in sortedShardIntervalArray, stored
+	 * contiguously to keep the binary search over them cache friendly. Only
+	 * built for hash distributed tables, NULL otherwise.
+	 */
+	int32 *sortedShardMinValueArray;
+	int32 *sortedShardMaxValueArray;
+
+	/*
+	 * For each of the first initializedShardIntervalCount shards in
+	 * sortedShardIntervalArray, which are the ones with min/max values, the
+	 * index of the shard with the largest max value among the shards up to
+	 * it. Only built for append and range distributed tables with
+	 * overlapping shards, NULL otherwise.
+	 */
+	int *maxValuePrefixIndexArray;
+	int initializedShardIntervalCount;
+
 	/* comparator for partition column's type, NULL if DISTRIBUTE_BY_NONE */
 	FmgrInfo *shardColumnCompareFunction;
 
@@ -95,6 +130,12 @@ typedef struct
 	/* pg_dist_placement metadata */
 	GroupShardPlacement **arrayOfPlacementArrays;
 	int *arrayOfPlacementArrayLengths;
+
+	/*
+	 * Placements that have not been loaded yet or changed since they were
+	 * loaded, use CachedShardPlacementArray to access the placements.
+	 */
+	bool *arrayOfPlacementArrayIsStale;
 } DistTableCacheEntry;
 
 typedef struct DistObjectCacheEntryKey
@@ -121,11 +162,15 @@ extern bool IsDistributedTable(Oid relationId);
 extern List * DistributedTableList(void);
 extern ShardInterval * LoadShardInterval(uint64 shardId);
 extern Oid RelationIdForShard(uint64 shardId);
+extern Oid RelationIdForShardIfExists(uint64 shardId);
 extern bool ReferenceTableShardId(uint64 shardId);
 extern ShardPlacement * FindShardPlacementOnGroup(int32 groupId, uint64 shardId);
 extern GroupShardPlacement * LoadGroupShardPlacement(uint64 shardId, uint64 placementId);
 extern ShardPlacement * LoadShardPlacement(uint64 shardId, uint64 placementId);
 extern DistTableCacheEntry * DistributedTableCacheEntry(Oid distributedRelationId);
+extern GroupShardPlacement * CachedShardPlacementArray(DistTableCacheEntry *cacheEntry,
+													   int shardIndex,
+													   int *placementCount);
 extern DistObjectCacheEntry * LookupDistObjectCacheEntry(Oid classid, Oid objid, int32
 														 objsubid);
 extern int32 GetLocalGroupId(void);
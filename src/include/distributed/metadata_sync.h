@@ -19,6 +19,8 @@
 /* config variables */
 extern int MetadataSyncInterval;
 extern int MetadataSyncRetryInterval;
+extern bool EnableBinaryMetadataSync;
+extern int MaxConcurrentMetadataSyncs;
 
 typedef enum
 {
@@ -74,6 +76,21 @@ extern bool SendOptionalCommandListToWorkerInTransaction(char *nodeName, int32 n
 	"shardstate = EXCLUDED.shardstate, " \
 	"shardlength = EXCLUDED.shardlength, " \
 	"groupid = EXCLUDED.groupid"
+#define CREATE_SHARD_SNAPSHOT_TABLE \
+	"CREATE TEMPORARY TABLE citus_shard_snapshot " \
+	"(relname text, shardid bigint, shardstorage \"char\", " \
+	"shardminvalue text, shardmaxvalue text) ON COMMIT DROP"
+#define COPY_SHARD_SNAPSHOT_TABLE \
+	"COPY pg_temp.citus_shard_snapshot FROM STDIN WITH (format binary)"
+#define INSERT_SHARDS_FROM_SNAPSHOT_TABLE \
+	"INSERT INTO pg_dist_shard " \
+	"(logicalrelid, shardid, shardstorage, shardminvalue, shardmaxvalue) " \
+	"SELECT relname::regclass, shardid, shardstorage, shardminvalue, shardmaxvalue " \
+	"FROM pg_temp.citus_shard_snapshot"
+#define COPY_PLACEMENTS \
+	"COPY pg_dist_placement " \
+	"(shardid, shardstate, shardlength, groupid, placementid) " \
+	"FROM STDIN WITH (format binary)"
 #define METADATA_SYNC_CHANNEL "metadata_sync"
 
 #endif /* METADATA_SYNC_H */
@@ -31,7 +31,30 @@ extern bool WritableStandbyCoordinator;
 extern bool ForceMaxQueryParallelization;
 extern int MaxAdaptiveExecutorPoolSize;
 extern int ExecutorSlowStartInterval;
+extern int ExecutorTaskBatchSize;
 extern bool SortReturning;
+extern bool EnableStreamingResults;
+extern bool EnableBinaryProtocol;
+extern bool ExecuteLargestShardsFirst;
+extern bool EnableHedgedReads;
+extern bool SendBeginWithFirstTask;
+
+
+/*
+ * TaskResultDestination describes where the rows of a task go when the tasks
+ * of several queries run in a single execution.
+ */
+typedef struct TaskResultDestination
+{
+	Task *task;
+
+	/* description of the columns of the task's rows, and where to store them */
+	TupleDesc tupleDescriptor;
+	Tuplestorestate *tupleStore;
+
+	/* statistics of the query that the task belongs to */
+	DistributedExecutionStats *executionStats;
+} TaskResultDestination;
 
 
 extern void CitusExecutorStart(QueryDesc *queryDesc, int eflags);
@@ -42,14 +65,19 @@ extern uint64 ExecuteTaskListExtended(RowModifyLevel modLevel, List *taskList,
 									  TupleDesc tupleDescriptor,
 									  Tuplestorestate *tupleStore,
 									  bool hasReturning, int targetPoolSize);
+extern void ExecuteTaskListIntoTupleStores(List *taskResultDestinationList,
+										   int targetPoolSize);
 extern void ExecuteUtilityTaskListWithoutResults(List *taskList);
 extern uint64 ExecuteTaskList(RowModifyLevel modLevel, List *taskList, int
 							  targetPoolSize);
 extern TupleTableSlot * CitusExecScan(CustomScanState *node);
 extern TupleTableSlot * ReturnTupleFromTuplestore(CitusScanState *scanState);
+extern TupleTableSlot * ReturnTupleFromDistributedExecution(CitusScanState *scanState);
+extern void EndStreamingExecution(CitusScanState *scanState);
 extern void LoadTuplesIntoTupleStore(CitusScanState *citusScanState, Job *workerJob);
 extern void ReadFileIntoTupleStore(char *fileName, char *copyFormat, TupleDesc
 								   tupleDescriptor, Tuplestorestate *tupstore);
+extern Relation StubRelation(TupleDesc tupleDescriptor);
 extern Query * ParseQueryString(const char *queryString, Oid *paramOids, int numParams);
 extern void ExecuteQueryStringIntoDestReceiver(const char *queryString, ParamListInfo
 											   params,
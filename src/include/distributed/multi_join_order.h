@@ -32,8 +32,9 @@ typedef enum JoinRuleType
 	LOCAL_PARTITION_JOIN = 2,
 	SINGLE_HASH_PARTITION_JOIN = 3,
 	SINGLE_RANGE_PARTITION_JOIN = 4,
-	DUAL_PARTITION_JOIN = 5,
-	CARTESIAN_PRODUCT = 6,
+	BROADCAST_PARTITION_JOIN = 5,
+	DUAL_PARTITION_JOIN = 6,
+	CARTESIAN_PRODUCT = 7,
 
 	/*
 	 * Add new join rule types above this comment. After adding, you must also
@@ -77,6 +78,8 @@ typedef struct JoinOrderNode
 /* Config variables managed via guc.c */
 extern bool LogMultiJoinOrder;
 extern bool EnableSingleHashRepartitioning;
+extern bool EnableCostBasedJoinOrder;
+extern int BroadcastJoinSizeLimit;
 
 
 /* Function declaration for determining table join orders */
@@ -23,11 +23,13 @@
 #define DIVISION_OPER_NAME "/"
 #define DISABLE_LIMIT_APPROXIMATION -1
 #define DISABLE_DISTINCT_APPROXIMATION 0.0
+#define DISABLE_PERCENTILE_APPROXIMATION 0
 #define ARRAY_CAT_AGGREGATE_NAME "array_cat_agg"
 #define JSONB_CAT_AGGREGATE_NAME "jsonb_cat_agg"
 #define JSON_CAT_AGGREGATE_NAME "json_cat_agg"
 #define WORKER_PARTIAL_AGGREGATE_NAME "worker_partial_agg"
 #define COORD_COMBINE_AGGREGATE_NAME "coord_combine_agg"
+#define COORD_MERGE_SORTED_AGGREGATE_NAME "coord_merge_sorted_agg"
 #define WORKER_COLUMN_FORMAT "worker_column_%d"
 
 /* Definitions related to count(distinct) approximations */
@@ -41,6 +43,8 @@
 #define HLL_UNION_AGGREGATE_NAME "hll_union_agg"
 #define HLL_CARDINALITY_FUNC_NAME "hll_cardinality"
 #define HLL_FORCE_GROUPAGG_GUC_NAME "hll.force_groupagg"
+#define HLL_DEFAULT_REGISTER_WIDTH 5
+#define HLL_AUTO_EXPLICIT_THRESHOLD -1
 
 /* Definitions related to Top-N approximations */
 #define TOPN_ADD_AGGREGATE_NAME "topn_add_agg"
@@ -79,9 +83,28 @@ typedef enum
 	AGGREGATE_TOPN_ADD_AGG = 18,
 	AGGREGATE_TOPN_UNION_AGG = 19,
 	AGGREGATE_ANY_VALUE = 20,
+	AGGREGATE_STRING_AGG = 21,
+
+	/*
+	 * Aggregates of github.com/tvondra/tdigest are overloaded on their argument
+	 * types, so they are recognized by oid and have no entry in AggregateNames.
+	 */
+	AGGREGATE_TDIGEST_COMBINE = 22,
+	AGGREGATE_TDIGEST_ADD_DOUBLE = 23,
+	AGGREGATE_TDIGEST_PERCENTILE_ADD_DOUBLE = 24,
+	AGGREGATE_TDIGEST_PERCENTILE_ADD_DOUBLEARRAY = 25,
+	AGGREGATE_TDIGEST_PERCENTILE_TDIGEST_DOUBLE = 26,
+	AGGREGATE_TDIGEST_PERCENTILE_TDIGEST_DOUBLEARRAY = 27,
+	AGGREGATE_TDIGEST_PERCENTILE_OF_ADD_DOUBLE = 28,
+	AGGREGATE_TDIGEST_PERCENTILE_OF_ADD_DOUBLEARRAY = 29,
+	AGGREGATE_TDIGEST_PERCENTILE_OF_TDIGEST_DOUBLE = 30,
+	AGGREGATE_TDIGEST_PERCENTILE_OF_TDIGEST_DOUBLEARRAY = 31,
+
+	/* percentile_cont approximated through tdigest */
+	AGGREGATE_PERCENTILE_CONT_APPROXIMATE = 32,
 
 	/* AGGREGATE_CUSTOM must come last */
-	AGGREGATE_CUSTOM = 21
+	AGGREGATE_CUSTOM = 33
 } AggregateType;
 
 /*
@@ -119,6 +142,7 @@ typedef enum
  *
  * Please note that the order of elements in this array is tied to the order of
  * values in the preceding AggregateType enum. This order needs to be preserved.
+ * Aggregate types that come after string_agg are not matched by name.
  */
 static const char *const AggregateNames[] = {
 	"invalid", "avg", "min", "max",
@@ -128,13 +152,17 @@ static const char *const AggregateNames[] = {
 	"bit_and", "bit_or", "bool_and", "bool_or", "every",
 	"hll_add_agg", "hll_union_agg",
 	"topn_add_agg", "topn_union_agg",
-	"any_value"
+	"any_value", "string_agg"
 };
 
 
 /* Config variable managed via guc.c */
 extern int LimitClauseRowFetchCount;
 extern double CountDistinctErrorRate;
+extern bool CountDistinctSparseSketches;
+extern int PercentileApproximationCompression;
+extern bool EnableGroupPushdown;
+extern bool EnablePartialArrayAggregates;
 
 
 /* Function declaration for optimizing logical plans */
@@ -182,12 +182,17 @@ typedef struct MultiExtendedOp
 } MultiExtendedOp;
 
 
+/* Config variable managed via guc.c */
+extern bool EnableWindowFunctionRepartition;
+
+
 /* Function declarations for building logical plans */
 extern MultiTreeRoot * MultiLogicalPlanCreate(Query *originalQuery, Query *queryTree,
 											  PlannerRestrictionContext *
 											  plannerRestrictionContext);
 extern bool FindNodeCheck(Node *node, bool (*check)(Node *));
 extern bool SingleRelationRepartitionSubquery(Query *queryTree);
+extern Var * WindowRepartitionColumn(List *windowClauseList, List *targetEntryList);
 extern bool TargetListOnPartitionColumn(Query *query, List *targetEntryList);
 extern bool FindNodeCheckInRangeTableList(List *rtable, bool (*check)(Node *));
 extern bool IsDistributedTableRTE(Node *node);
@@ -0,0 +1,43 @@
+/*-------------------------------------------------------------------------
+ *
+ * multi_logical_replication.h
+ *
+ *    Declarations for moving and splitting shards using logical replication.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef MULTI_LOGICAL_REPLICATION_H
+#define MULTI_LOGICAL_REPLICATION_H
+
+
+#include "distributed/worker_manager.h"
+#include "nodes/pg_list.h"
+
+
+/* names of the replication objects of a shard move, suffixed with a shard id */
+#define SHARD_MOVE_PUBLICATION_PREFIX "citus_shard_move_publication_"
+#define SHARD_MOVE_SUBSCRIPTION_PREFIX "citus_shard_move_subscription_"
+
+/* names of the replication objects of a shard split, suffixed with shard and node */
+#define SHARD_SPLIT_PUBLICATION_PREFIX "citus_shard_split_publication_"
+#define SHARD_SPLIT_SUBSCRIPTION_PREFIX "citus_shard_split_subscription_"
+
+/* interval at which the progress of the replication is checked */
+#define LOGICAL_REPLICATION_POLL_INTERVAL_MS 100
+
+
+extern bool ShardListHasReplicaIdentity(List *shardIntervalList);
+extern bool NodeSupportsLogicalReplication(char *nodeName, int nodePort);
+extern void LogicallyReplicateShards(List *shardIntervalList, char *sourceNodeName,
+									 int sourceNodePort, char *targetNodeName,
+									 int targetNodePort);
+extern void LogicallyReplicateSplitShards(List *sourceShardList,
+										  List *splitShardListList,
+										  WorkerNode **splitNodes,
+										  WorkerNode *sourceNode);
+
+
+#endif /* MULTI_LOGICAL_REPLICATION_H */
@@ -19,6 +19,10 @@
 #include "nodes/plannodes.h"
 
 
+/* config variable managed via guc.c */
+extern bool EnableTaskResultMerge;
+
+
 /* Function declarations for building local plans on the master node */
 struct DistributedPlan;
 struct CustomScan;
@@ -26,6 +26,7 @@
 #include "distributed/distributed_planner.h"
 #include "lib/stringinfo.h"
 #include "nodes/parsenodes.h"
+#include "nodes/plannodes.h"
 #include "utils/array.h"
 
 
@@ -40,10 +41,22 @@
  (" UINT64_FORMAT ", %d, %s, '%s', '%s'::regtype, %s)"
 #define HASH_PARTITION_COMMAND "SELECT worker_hash_partition_table \
  (" UINT64_FORMAT ", %d, %s, '%s', '%s'::regtype, %s)"
+#define BROADCAST_PARTITION_COMMAND "SELECT worker_broadcast_partition_table \
+ (" UINT64_FORMAT ", %d, %s, %u)"
 #define MERGE_FILES_INTO_TABLE_COMMAND "SELECT worker_merge_files_into_table \
  (" UINT64_FORMAT ", %d, '%s', '%s')"
 #define MERGE_FILES_AND_RUN_QUERY_COMMAND \
 	"SELECT worker_merge_files_and_run_query(" UINT64_FORMAT ", %d, %s, %s)"
+#define JOIN_FILTER_BUILD_QUERY \
+	"SELECT worker_join_filter_agg(join_filter_source.%s, %d) " \
+	"FROM (%s) AS join_filter_source"
+#define JOIN_FILTER_QUERY_PREFIX \
+	"SELECT * FROM (%s) AS join_filter_target " \
+	"WHERE worker_join_filter_contains(decode('"
+#define JOIN_FILTER_QUERY_SUFFIX "', 'hex'), join_filter_target.%s)"
+#define READ_TASK_FILES_QUERY \
+	"WITH %s AS (SELECT * FROM worker_read_task_files(" UINT64_FORMAT ", %u) " \
+	"AS %s(%s)) %s"
 
 
 typedef enum CitusRTEKind
@@ -70,7 +83,8 @@ typedef enum
 	PARTITION_INVALID_FIRST = 0,
 	RANGE_PARTITION_TYPE = 1,
 	SINGLE_HASH_PARTITION_TYPE = 2,
-	DUAL_HASH_PARTITION_TYPE = 3
+	DUAL_HASH_PARTITION_TYPE = 3,
+	BROADCAST_PARTITION_TYPE = 4
 } PartitionType;
 
 
@@ -95,7 +109,8 @@ typedef enum
 	TASK_ASSIGNMENT_INVALID_FIRST = 0,
 	TASK_ASSIGNMENT_GREEDY = 1,
 	TASK_ASSIGNMENT_ROUND_ROBIN = 2,
-	TASK_ASSIGNMENT_FIRST_REPLICA = 3
+	TASK_ASSIGNMENT_FIRST_REPLICA = 3,
+	TASK_ASSIGNMENT_LEAST_LOADED = 4
 } TaskAssignmentPolicyType;
 
 
@@ -134,6 +149,7 @@ typedef struct Job
 	List *dependentJobList;
 	bool subqueryPushdown;
 	bool requiresMasterEvaluation; /* only applies to modify jobs */
+	List *masterEvaluationResnoList; /* target entries to evaluate, if only those */
 	bool deferredPruning;
 	Const *partitionKeyValue;
 } Job;
@@ -151,6 +167,15 @@ typedef struct MapMergeJob
 	ShardInterval **sortedShardIntervalArray; /* only applies to range partitioning */
 	List *mapTaskList;
 	List *mergeTaskList;
+
+	/*
+	 * Join filters of dual partition joins: the map tasks of the job that is
+	 * joinFilterSource build a Bloom filter of their partition column, and
+	 * the map tasks of the job with joinFilterJobId skip the rows that are
+	 * not in the filter of that job.
+	 */
+	uint64 joinFilterJobId;
+	bool joinFilterSource;
 } MapMergeJob;
 
 
@@ -182,6 +207,13 @@ typedef struct Task
 	uint64 jobId;
 	uint32 taskId;
 	char *queryString;
+
+	/*
+	 * Query with shard name placeholders, shared by the SELECT tasks of a
+	 * multi-shard query. When set and queryString is NULL, the query string
+	 * is produced on demand through TaskQueryString().
+	 */
+	char *queryTemplate;
 	uint64 anchorShardId;       /* only applies to compute tasks */
 	List *taskPlacementList;    /* only applies to compute tasks */
 	List *dependentTaskList;     /* only applies to compute tasks */
@@ -222,6 +254,18 @@ typedef struct Task
 	 * the task splitted into local and remote tasks.
 	 */
 	bool partiallyLocalOrRemote;
+
+	/*
+	 * Used only for the map tasks of dual partition joins with join filters.
+	 * Map tasks of the job with joinFilterJobId can run joinFilterMapQuery
+	 * instead of their query, after inserting the hex encoded filter of that
+	 * job at joinFilterOffset. Map tasks of the other job build their part of
+	 * the filter with joinFilterBuildQuery.
+	 */
+	uint64 joinFilterJobId;
+	char *joinFilterMapQuery;
+	int joinFilterOffset;
+	char *joinFilterBuildQuery;
 } Task;
 
 
@@ -275,12 +319,47 @@ typedef struct DistributedPlan
 	/* local query that merges results from the workers */
 	Query *masterQuery;
 
+	/*
+	 * Sort order of the master query when the workers already return the rows
+	 * of each task in that order, such that the executor merges the rows of
+	 * the tasks instead of sorting them. The sort node has no subplan and its
+	 * columns refer to the columns of the custom scan.
+	 */
+	Sort *taskResultMergeOrder;
+
+	/*
+	 * Whether the plan computes a single exact count(DISTINCT) by repartitioning
+	 * the distinct values that the worker job returns among the workers, which
+	 * then count them. Such plans have no master query.
+	 */
+	bool repartitionCountDistinct;
+
+	/*
+	 * When the master query returns the first topNCount groups in descending
+	 * order of a sum over the worker column topNSortColumn, the executor only
+	 * pulls the groups that can make it into the result (see
+	 * top_n_execution.c). topNGroupColumnList contains the worker columns
+	 * that the master groups by. topNCount is 0 for all other plans.
+	 */
+	uint64 topNCount;
+	AttrNumber topNSortColumn;
+	List *topNGroupColumnList;
+	bool topNNullsFirst;
+
 	/* query identifier (copied from the top-level PlannedStmt) */
 	uint64 queryId;
 
 	/* which relations are accessed by this distributed plan */
 	List *relationIdList;
 
+	/*
+	 * Partitioned tables in relationIdList whose partitions were pruned on the
+	 * coordinator, and the partitions of those tables that may be accessed.
+	 * The executor only locks those partitions of these tables.
+	 */
+	List *prunedPartitionedRelationIdList;
+	List *partitionIdList;
+
 	/* SELECT query in an INSERT ... SELECT via the coordinator */
 	Query *insertSelectSubquery;
 
@@ -334,6 +413,24 @@ typedef struct DistributedSubPlan
 
 	uint32 subPlanId;
 	PlannedStmt *plan;
+
+	/* deparsed query for reusing results, NULL if the result is not reusable */
+	char *queryKey;
+
+	/*
+	 * If the result is only joined on the distribution column of a hash
+	 * distributed table, partitionRelationId is that table and
+	 * partitionColumnIndex the joined column of the result. Each node then
+	 * only needs the rows that fall into the shards it has placements of.
+	 * partitionRelationId is InvalidOid if the result is broadcast.
+	 */
+	Oid partitionRelationId;
+	int partitionColumnIndex;
+
+	/* statistics of the last execution, shown by EXPLAIN ANALYZE */
+	uint64 bytesSent;
+	uint32 remoteWorkerCount;
+	bool writeLocalFile;
 } DistributedSubPlan;
 
 
@@ -353,6 +450,9 @@ typedef struct OperatorCacheEntry
 /* Config variable managed via guc.c */
 extern int TaskAssignmentPolicy;
 extern bool EnableUniqueJobIds;
+extern bool EnableTopNPushdown;
+extern bool EnableRepartitionJoinFilter;
+extern int RepartitionJoinFilterSize;
 
 
 /* Function declarations for building physical plans and constructing queries */
@@ -394,6 +494,8 @@ extern List * AssignAnchorShardTaskList(List *taskList);
 extern List * FirstReplicaAssignTaskList(List *taskList);
 extern List * RoundRobinAssignTaskList(List *taskList);
 extern List * RoundRobinReorder(Task *task, List *placementList);
+extern List * LeastLoadedAssignTaskList(List *taskList);
+extern List * LeastLoadedReorder(Task *task, List *placementList);
 extern int CompareTasksByTaskId(const void *leftElement, const void *rightElement);
 
 /* function declaration for creating Task */
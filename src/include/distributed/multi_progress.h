@@ -14,9 +14,14 @@
 
 
 #include "fmgr.h"
+#include "distributed/worker_manager.h"
 #include "nodes/pg_list.h"
 
 
+/* identifies the progress monitors of the operations shown in citus_progress */
+#define SHARD_OPERATION_PROGRESS_MAGIC_NUMBER 1339
+
+
 typedef struct ProgressMonitorData
 {
 	uint64 processId;
@@ -25,6 +30,49 @@ typedef struct ProgressMonitorData
 } ProgressMonitorData;
 
 
+/* distributed operations that report their progress per shard */
+typedef enum CitusOperationType
+{
+	CITUS_OPERATION_COPY = 0,
+	CITUS_OPERATION_CREATE_DISTRIBUTED_TABLE = 1,
+	CITUS_OPERATION_COPY_SHARD_PLACEMENT = 2,
+	CITUS_OPERATION_MOVE_SHARD_PLACEMENT = 3,
+	CITUS_OPERATION_CREATE_INDEX = 4
+} CitusOperationType;
+
+
+/* state of the work on a shard */
+typedef enum ShardOperationStatus
+{
+	SHARD_OPERATION_WAITING = 0,
+	SHARD_OPERATION_RUNNING = 1,
+	SHARD_OPERATION_DONE = 2,
+	SHARD_OPERATION_FAILED = 3
+} ShardOperationStatus;
+
+
+/*
+ * ShardOperationProgress is a step of the progress monitor of a distributed
+ * operation, which describes the work on a single shard or shard placement.
+ * The node is only set when the work is on a single placement.
+ */
+typedef struct ShardOperationProgress
+{
+	CitusOperationType operationType;
+	Oid relationId;
+	uint64 shardId;
+	char nodeName[WORKER_LENGTH];
+	int nodePort;
+	uint64 status;
+	uint64 rowsProcessed;
+	uint64 bytesProcessed;
+} ShardOperationProgress;
+
+
+/* config variable managed via guc.c */
+extern bool EnableOperationProgress;
+
+
 extern ProgressMonitorData * CreateProgressMonitor(uint64 progressTypeMagicNumber,
 												   int stepCount, Size stepSize,
 												   Oid relationId);
@@ -33,6 +81,16 @@ extern void FinalizeCurrentProgressMonitor(void);
 extern List * ProgressMonitorList(uint64 commandTypeMagicNumber,
 								  List **attachedDSMSegmentList);
 extern void DetachFromDSMSegments(List *dsmSegmentList);
+extern bool ProgressMonitorActive(void);
+extern ProgressMonitorData * CreateShardOperationProgressMonitor(
+	CitusOperationType operationType, Oid relationId, int stepCount);
+extern ProgressMonitorData * StartShardOperationProgress(CitusOperationType operationType,
+														 Oid relationId,
+														 List *shardIntervalList);
+extern ShardOperationProgress * FindShardOperationProgress(ProgressMonitorData *monitor,
+														   uint64 shardId);
+extern void SetShardOperationProgressStatus(ProgressMonitorData *monitor,
+											ShardOperationStatus status);
 
 
 #endif /* MULTI_PROGRESS_H */
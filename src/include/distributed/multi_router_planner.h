@@ -19,6 +19,7 @@
 #include "distributed/multi_logical_planner.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/distributed_planner.h"
+#include "nodes/execnodes.h"
 #include "nodes/parsenodes.h"
 
 
@@ -44,6 +45,7 @@ extern DeferredErrorMessage * PlanRouterQuery(Query *originalQuery,
 											  bool *multiShardModifyQuery,
 											  Const **partitionValueConst);
 extern List * RouterInsertTaskList(Query *query, DeferredErrorMessage **planningError);
+extern void PlanDeferredRouterSelectJob(Job *job, DeferredErrorMessage **planningError);
 extern Const * ExtractInsertPartitionKeyValue(Query *query);
 extern List * TargetShardIntervalsForRestrictInfo(RelationRestrictionContext *
 												  restrictionContext,
@@ -68,6 +70,8 @@ extern RangeTblEntry * ExtractDistributedInsertValuesRTE(Query *query);
 extern bool IsMultiRowInsert(Query *query);
 extern void AddShardIntervalRestrictionToSelect(Query *subqery,
 												ShardInterval *shardInterval);
+extern void AddHashRangeRestrictionToSelect(Query *subqery, Var *targetPartitionColumnVar,
+											ShardInterval *shardInterval);
 extern bool UpdateOrDeleteQuery(Query *query);
 extern List * WorkersContainingAllShards(List *prunedShardIntervalsList);
 
@@ -79,5 +83,7 @@ extern List * WorkersContainingAllShards(List *prunedShardIntervalsList);
 extern PlannedStmt * FastPathPlanner(Query *originalQuery, Query *parse, ParamListInfo
 									 boundParams);
 extern bool FastPathRouterQuery(Query *query);
+extern bool FastPathRequiresDeferredPruning(Query *query);
+extern void EvaluateFastPathDistributionKeyValue(Query *query, PlanState *planState);
 
 #endif /* MULTI_ROUTER_PLANNER_H */
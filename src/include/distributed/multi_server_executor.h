@@ -17,6 +17,7 @@
 #include "distributed/multi_physical_planner.h"
 #include "distributed/task_tracker.h"
 #include "distributed/worker_manager.h"
+#include "portability/instr_time.h"
 
 
 #define MAX_TASK_EXECUTION_FAILURES 3 /* allowed failure count for one task */
@@ -91,14 +92,50 @@ typedef enum
  *
  * totalIntermediateResultSize is a counter to keep the size
  * of the intermediate results of complex subqueries and CTEs
- * so that we can put a limit on the size.
+ * so that we can put a limit on the size. sizeLimitReported
+ * is set once the execution continues past the limit.
  */
 typedef struct DistributedExecutionStats
 {
 	uint64 totalIntermediateResultSize;
+	bool sizeLimitReported;
 } DistributedExecutionStats;
 
 
+/*
+ * TaskExecutionInstrumentation holds the timing of the execution of a task on
+ * a placement and the amount of data received for it, which EXPLAIN ANALYZE
+ * shows for the tasks of the adaptive executor. Times are in milliseconds.
+ */
+typedef struct TaskExecutionInstrumentation
+{
+	Task *task;
+	char *nodeName;
+	int nodePort;
+
+	/* time to establish the connection, if the task was the first one on it */
+	double connectTime;
+
+	/* time from the start of the execution until the task was sent */
+	double queueTime;
+
+	/* time from sending the task until it finished */
+	double executionTime;
+
+	uint64 rowCount;
+	uint64 byteCount;
+
+	/* whether the task finished successfully on the placement */
+	bool finished;
+
+	/* EXPLAIN ANALYZE output that the worker returned along with the rows */
+	char *explainAnalyzeOutput;
+
+	/* time at which the task was sent */
+	instr_time startTime;
+} TaskExecutionInstrumentation;
+
+
 /*
  * TaskExecution holds state that relates to a task's execution for task-tracker
  * executor.
@@ -156,12 +193,14 @@ typedef struct TaskTracker
 	bool connectionBusy;
 	TrackerTaskState *connectionBusyOnTask;
 	List *connectionBusyOnTaskList;
+	uint32 queuedTaskCount;         /* queued tasks, recounted before stealing */
 } TaskTracker;
 
 
 /* Config variable managed via guc.c */
 extern int RemoteTaskCheckInterval;
 extern int MaxAssignTaskBatchSize;
+extern bool EnableTaskStealing;
 extern int TaskExecutorType;
 extern bool EnableRepartitionJoins;
 extern bool BinaryMasterCopyFormat;
@@ -173,6 +212,7 @@ extern void MultiTaskTrackerExecute(Job *job);
 
 /* Function declarations common to more than one executor */
 extern MultiExecutorType JobExecutorType(DistributedPlan *distributedPlan);
+extern bool RepartitionJobsRequireTaskTracker(DistributedPlan *distributedPlan);
 extern void RemoveJobDirectory(uint64 jobId);
 extern TaskExecution * InitTaskExecution(Task *task, TaskExecStatus initialStatus);
 extern bool CheckIfSizeLimitIsExceeded(DistributedExecutionStats *executionStats);
@@ -42,6 +42,8 @@ extern void InitPlacementConnectionManagement(void);
 extern bool AnyConnectionAccessedPlacements(void);
 
 extern bool ConnectionModifiedPlacement(MultiConnection *connection);
+extern MultiConnection * FindModifyingConnectionForNode(const char *hostname, int port,
+														const char *userName);
 extern bool ConnectionUsedForAnyPlacements(MultiConnection *connection);
 
 #endif /* PLACEMENT_CONNECTION_H */
@@ -0,0 +1,49 @@
+/*-------------------------------------------------------------------------
+ *
+ * planning_phases.h
+ *   Time spent in the phases of distributed planning, for showing it in
+ *   EXPLAIN and in the server log.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef PLANNING_PHASES_H
+#define PLANNING_PHASES_H
+
+#include "commands/explain.h"
+#include "portability/instr_time.h"
+
+
+/* phases of distributed planning whose time is measured */
+typedef enum PlanningPhase
+{
+	PLANNING_PHASE_STANDARD_PLANNER,
+	PLANNING_PHASE_FAST_PATH_PLANNER,
+	PLANNING_PHASE_ROUTER_PLANNER,
+	PLANNING_PHASE_MODIFY_PLANNER,
+	PLANNING_PHASE_RECURSIVE_PLANNING,
+	PLANNING_PHASE_LOGICAL_OPTIMIZER,
+	PLANNING_PHASE_PHYSICAL_PLANNER,
+	PLANNING_PHASE_DEPARSE,
+
+	PLANNING_PHASE_COUNT
+} PlanningPhase;
+
+
+/* config variables managed via guc.c */
+extern bool LogPlanningPhases;
+extern bool ExplainPlanningPhases;
+
+
+extern void BeginPlanningPhaseStats(void);
+extern void EndPlanningPhaseStats(uint64 planId);
+extern void AbortPlanningPhaseStats(void);
+extern void BeginPlanningPhase(instr_time *phaseStartTime);
+extern void EndPlanningPhase(PlanningPhase phase, instr_time *phaseStartTime);
+extern void RecordShardPruning(int candidateShardCount, int remainingShardCount);
+extern void ExplainPlanningPhaseStats(uint64 planId, ExplainState *es);
+
+
+#endif /* PLANNING_PHASES_H */
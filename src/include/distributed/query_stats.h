@@ -12,8 +12,20 @@
 
 #include "distributed/multi_server_executor.h"
 
+/* values for citus.stat_statements_track */
+typedef enum
+{
+	STAT_STATEMENTS_TRACK_NONE = 0,
+	STAT_STATEMENTS_TRACK_ALL = 1
+} StatStatementsTrackType;
+
+
+extern int StatStatementsMax;
+extern int StatStatementsTrack;
+
+
 extern void InitializeCitusQueryStats(void);
 extern void CitusQueryStatsExecutorsEntry(uint64 queryId, MultiExecutorType executorType,
-										  char *partitionKey);
+										  char *partitionKey, double executionTime);
 
 #endif /* QUERY_STATS_H */
@@ -22,6 +22,11 @@
 #include "nodes/relation.h"
 #endif
 
+extern bool EnableSubqueryDecorrelation;
+extern bool EnableRepartitionAggregation;
+extern bool EnableUnionAggregatePushdown;
+extern bool EnableSingleShardJoinTransfer;
+
 extern List * GenerateSubplansForSubqueriesAndCTEs(uint64 planId, Query *originalQuery,
 												   PlannerRestrictionContext *
 												   plannerRestrictionContext);
@@ -29,5 +34,8 @@ extern char * GenerateResultId(uint64 planId, uint32 subPlanId);
 extern Query * BuildSubPlanResultQuery(List *targetEntryList, List *columnAliasList,
 									   char *resultId);
 extern bool GeneratingSubplans(void);
+extern bool WrapAggregationForRepartitioning(Query *query);
+extern bool PushDownQualsIntoAggregationSubquery(Query *query);
+extern bool PushDownAggregatesIntoUnionAll(Query *query);
 
 #endif /* RECURSIVE_PLANNING_H */
@@ -16,6 +16,9 @@
 
 #include "listutils.h"
 
+/* config variable managed via guc.c */
+extern int MaxReferenceTableCopyConnections;
+
 extern uint32 CreateReferenceTableColocationId(void);
 extern void ReplicateAllReferenceTablesToNode(char *nodeName, int nodePort);
 extern void DeleteAllReferenceTablePlacementsFromNodeGroup(int32 groupId);
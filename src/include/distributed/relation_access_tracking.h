@@ -15,6 +15,7 @@
 
 /* Config variables managed via guc.c */
 extern bool EnforceForeignKeyRestrictions;
+extern bool TrackForeignKeyRelationAccessesOnly;
 
 
 /* forward declare, to avoid dependency on ShardPlacement definition */
@@ -48,7 +48,15 @@ extern int ExecuteOptionalRemoteCommand(MultiConnection *connection,
 extern int SendRemoteCommand(MultiConnection *connection, const char *command);
 extern int SendRemoteCommandParams(MultiConnection *connection, const char *command,
 								   int parameterCount, const Oid *parameterTypes,
-								   const char *const *parameterValues);
+								   const char *const *parameterValues,
+								   bool binaryResults);
+extern int SendRemotePrepare(MultiConnection *connection, const char *statementName,
+							 const char *command, int parameterCount,
+							 const Oid *parameterTypes);
+extern int SendRemoteCommandPrepared(MultiConnection *connection,
+									 const char *statementName, int parameterCount,
+									 const char *const *parameterValues,
+									 bool binaryResults);
 extern List * ReadFirstColumnAsText(PGresult *queryResult);
 extern PGresult * GetRemoteCommandResult(MultiConnection *connection,
 										 bool raiseInterrupts);
@@ -58,6 +66,8 @@ extern bool PutRemoteCopyEnd(MultiConnection *connection, const char *errormsg);
 
 /* waiting for multiple command results */
 extern void WaitForAllConnections(List *connectionList, bool raiseInterrupts);
+extern void WaitForAllConnectionsExtended(List *connectionList, bool raiseInterrupts,
+										  uint32 waitEventInfo);
 
 extern bool SendCancelationRequest(MultiConnection *connection);
 
@@ -0,0 +1,48 @@
+/*-------------------------------------------------------------------------
+ *
+ * remote_prepared_statements.h
+ *	  Bookkeeping of the statements that are prepared on worker connections.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef REMOTE_PREPARED_STATEMENTS_H
+#define REMOTE_PREPARED_STATEMENTS_H
+
+#include "distributed/connection_management.h"
+
+
+/* a statement that was prepared on a connection for a task query */
+typedef struct RemotePreparedStatement
+{
+	/* hash key, must be the first field */
+	char *queryString;
+
+	char statementName[NAMEDATALEN];
+	int parameterCount;
+	Oid *parameterTypes;
+
+	/* value of RemotePreparedStatementGeneration when the statement was prepared */
+	uint64 generation;
+} RemotePreparedStatement;
+
+
+/* config variable managed via guc.c */
+extern bool EnableWorkerPreparedStatements;
+
+extern RemotePreparedStatement * FindRemotePreparedStatement(MultiConnection *connection,
+															  const char *queryString,
+															  int parameterCount,
+															  const Oid *parameterTypes);
+extern bool CanPrepareRemoteStatement(MultiConnection *connection);
+extern char * NextRemotePreparedStatementName(MultiConnection *connection);
+extern void AddRemotePreparedStatement(MultiConnection *connection,
+									   const char *statementName,
+									   const char *queryString, int parameterCount,
+									   const Oid *parameterTypes);
+extern void FreeRemotePreparedStatements(MultiConnection *connection);
+extern void InvalidateRemotePreparedStatements(void);
+
+#endif /* REMOTE_PREPARED_STATEMENTS_H */
@@ -19,6 +19,19 @@
 /* forward declare, to avoid recursive includes */
 struct MultiConnection;
 
+
+/* GUC, determining whether to wait for COMMIT PREPARED to finish on the workers */
+extern bool AsyncCommitPrepared;
+
+/* GUC, determining whether to send statement_timeout along with remote BEGINs */
+extern bool PropagateStatementTimeout;
+
+/* GUC, determining whether savepoints are only sent to connections that use them */
+extern bool PropagateSavepointsLazily;
+
+/* GUC, determining whether all connections to a node share the same snapshot */
+extern bool EnableSynchronizedSnapshots;
+
 /*
  * Enum that defines different remote transaction states, of a single remote
  * transaction.
@@ -86,6 +99,12 @@ typedef struct RemoteTransaction
 
 	/* set when BEGIN is sent over the connection */
 	bool beginSent;
+
+	/* savepoints established over the connection, in temporal order */
+	List *establishedSubXacts;
+
+	/* name of the snapshot exported by the transaction, or empty */
+	char exportedSnapshot[NAMEDATALEN];
 } RemoteTransaction;
 
 
@@ -96,6 +115,10 @@ extern bool ParsePreparedTransactionName(char *preparedTransactionName, int32 *g
 
 /* change an individual remote transaction's state */
 extern void StartRemoteTransactionBegin(struct MultiConnection *connection);
+extern bool CanPrependRemoteTransactionBegin(void);
+extern char * PrependRemoteTransactionBegin(struct MultiConnection *connection,
+											const char *command,
+											int *beginStatementCount);
 extern void FinishRemoteTransactionBegin(struct MultiConnection *connection);
 extern void RemoteTransactionBegin(struct MultiConnection *connection);
 extern void RemoteTransactionListBegin(List *connectionList);
@@ -115,6 +138,7 @@ extern void RemoteTransactionAbort(struct MultiConnection *connection);
 /* start transaction if necessary */
 extern void RemoteTransactionBeginIfNecessary(struct MultiConnection *connection);
 extern void RemoteTransactionsBeginIfNecessary(List *connectionList);
+extern void ExportRemoteTransactionSnapshots(List *placementList);
 
 /* other public functionality */
 extern void HandleRemoteTransactionConnectionError(struct MultiConnection *connection,
@@ -138,6 +162,7 @@ extern void ResetRemoteTransaction(struct MultiConnection *connection);
 /* perform handling for all in-progress transactions */
 extern void CoordinatedRemoteTransactionsPrepare(void);
 extern void CoordinatedRemoteTransactionsCommit(void);
+extern void FinishPendingCommitPrepared(struct MultiConnection *connection);
 extern void CoordinatedRemoteTransactionsAbort(void);
 extern void CheckRemoteTransactionsHealth(void);
 
@@ -145,5 +170,11 @@ extern void CheckRemoteTransactionsHealth(void);
 extern void CoordinatedRemoteTransactionsSavepointBegin(SubTransactionId subId);
 extern void CoordinatedRemoteTransactionsSavepointRelease(SubTransactionId subId);
 extern void CoordinatedRemoteTransactionsSavepointRollback(SubTransactionId subId);
+extern bool RemoteTransactionSavepointsPending(struct MultiConnection *connection);
+extern char * PrependRemoteTransactionSavepoints(struct MultiConnection *connection,
+												 const char *command,
+												 int *savepointStatementCount);
+extern void StartRemoteTransactionSavepointSync(struct MultiConnection *connection);
+extern void RemoteTransactionsSyncSavepoints(List *connectionList);
 
 #endif /* REMOTE_TRANSACTION_H */
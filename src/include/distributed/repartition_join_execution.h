@@ -0,0 +1,28 @@
+/*-------------------------------------------------------------------------
+ *
+ * repartition_join_execution.h
+ *
+ * Functions for running the map, fetch and merge tasks of repartition joins
+ * through the adaptive executor.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef REPARTITION_JOIN_EXECUTION_H
+#define REPARTITION_JOIN_EXECUTION_H
+
+
+#include "distributed/multi_physical_planner.h"
+
+
+/* Config variable managed via guc.c */
+extern bool EnableRepartitionPush;
+
+
+extern List * ExecuteDependentTasks(List *topLevelTaskList, Job *topLevelJob,
+									List **jobIdList);
+extern void DoRepartitionCleanup(List *topLevelTaskList, List *jobIdList);
+
+
+#endif /* REPARTITION_JOIN_EXECUTION_H */
@@ -36,10 +36,18 @@ typedef enum AdvisoryLocktagClass
 	ADV_LOCKTAG_CLASS_CITUS_SHARD_METADATA = 4,
 	ADV_LOCKTAG_CLASS_CITUS_SHARD = 5,
 	ADV_LOCKTAG_CLASS_CITUS_JOB = 6,
-	ADV_LOCKTAG_CLASS_CITUS_REBALANCE_COLOCATION = 7
+	ADV_LOCKTAG_CLASS_CITUS_REBALANCE_COLOCATION = 7,
+	ADV_LOCKTAG_CLASS_CITUS_SHARD_RANGE = 8,
+	ADV_LOCKTAG_CLASS_CITUS_SHARD_RANGE_INTENT = 9,
+	ADV_LOCKTAG_CLASS_CITUS_TABLE_SHARDS = 10,
+	ADV_LOCKTAG_CLASS_CITUS_TABLE_SHARDS_INTENT = 11
 } AdvisoryLocktagClass;
 
 
+/* number of consecutive shard ids covered by a shard range lock */
+#define SHARD_RANGE_LOCK_SIZE 64
+
+
 /* reuse advisory lock, but with different, unused field 4 (4)*/
 #define SET_LOCKTAG_SHARD_METADATA_RESOURCE(tag, db, shardid) \
 	SET_LOCKTAG_ADVISORY(tag, \
@@ -74,6 +82,50 @@ typedef enum AdvisoryLocktagClass
 						 (uint32) (colocationOrTableId), \
 						 ADV_LOCKTAG_CLASS_CITUS_REBALANCE_COLOCATION)
 
+/* reuse advisory lock, but with different, unused field 4 (8) */
+#define SET_LOCKTAG_SHARD_RANGE_RESOURCE(tag, db, rangeid) \
+	SET_LOCKTAG_ADVISORY(tag, \
+						 db, \
+						 (uint32) ((rangeid) >> 32), \
+						 (uint32) (rangeid), \
+						 ADV_LOCKTAG_CLASS_CITUS_SHARD_RANGE)
+
+/*
+ * reuse advisory lock, but with different, unused field 4 (9). The lock mode
+ * of the shard lock that the intent lock stands for is kept in the high bits
+ * of field 2, which range ids of 64-bit shard ids do not use.
+ */
+#define SET_LOCKTAG_SHARD_RANGE_INTENT(tag, db, rangeid, shardlockmode) \
+	SET_LOCKTAG_ADVISORY(tag, \
+						 db, \
+						 ((uint32) ((rangeid) >> 32)) | ((uint32) (shardlockmode) << 27), \
+						 (uint32) (rangeid), \
+						 ADV_LOCKTAG_CLASS_CITUS_SHARD_RANGE_INTENT)
+
+/* reuse advisory lock, but with different, unused field 4 (10) */
+#define SET_LOCKTAG_TABLE_SHARDS_RESOURCE(tag, db, relationid) \
+	SET_LOCKTAG_ADVISORY(tag, \
+						 db, \
+						 0, \
+						 (uint32) (relationid), \
+						 ADV_LOCKTAG_CLASS_CITUS_TABLE_SHARDS)
+
+/*
+ * reuse advisory lock, but with different, unused field 4 (11). Field 2 holds
+ * the lock mode of the shard lock that the intent lock stands for.
+ */
+#define SET_LOCKTAG_TABLE_SHARDS_INTENT(tag, db, relationid, shardlockmode) \
+	SET_LOCKTAG_ADVISORY(tag, \
+						 db, \
+						 (uint32) (shardlockmode), \
+						 (uint32) (relationid), \
+						 ADV_LOCKTAG_CLASS_CITUS_TABLE_SHARDS_INTENT)
+
+
+/* config variables managed via guc.c */
+extern bool EnableShardRangeLocks;
+extern bool EnableTableShardLocks;
+
 
 /* Lock shard/relation metadata for safe modifications */
 extern void LockShardDistributionMetadata(int64 shardId, LOCKMODE lockMode);
@@ -88,6 +140,8 @@ extern void LockReferencedReferenceShardDistributionMetadata(uint64 shardId,
 /* Lock shard data, for DML commands or remote fetches */
 extern void LockShardResource(uint64 shardId, LOCKMODE lockmode);
 extern void UnlockShardResource(uint64 shardId, LOCKMODE lockmode);
+extern void LockShardIdArrayResources(uint64 *shardIdArray, int shardIdCount,
+									  LOCKMODE lockMode);
 
 /* Lock a job schema or partition task directory */
 extern void LockJobResource(uint64 jobId, LOCKMODE lockmode);
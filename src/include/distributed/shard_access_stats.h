@@ -0,0 +1,25 @@
+/*-------------------------------------------------------------------------
+ *
+ * shard_access_stats.h
+ *    Number of reads and writes of each shard by distributed queries.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SHARD_ACCESS_STATS_H
+#define SHARD_ACCESS_STATS_H
+
+#include "distributed/multi_physical_planner.h"
+
+
+/* config variables managed via guc.c */
+extern bool TrackShardAccess;
+extern int ShardAccessStatsMax;
+
+
+extern void InitializeShardAccessStats(void);
+extern void RecordTaskShardAccess(Task *task);
+extern uint64 ShardAccessCount(uint64 shardId);
+
+#endif /* SHARD_ACCESS_STATS_H */
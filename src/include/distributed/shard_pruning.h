@@ -16,9 +16,13 @@
 
 #define INVALID_SHARD_INDEX -1
 
+/* config variable for the expansion of nested OR clauses */
+extern int MaxShardPruningInstances;
+
 /* Function declarations for shard pruning */
 extern List * PruneShards(Oid relationId, Index rangeTableId, List *whereClauseList,
 						  Const **partitionValueConst);
 extern bool ContainsFalseClause(List *whereClauseList);
+extern void InvalidateShardSetCache(Oid relationId);
 
 #endif /* SHARD_PRUNING_H_ */
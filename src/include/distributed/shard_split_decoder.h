@@ -0,0 +1,29 @@
+/*-------------------------------------------------------------------------
+ *
+ * shard_split_decoder.h
+ *	  Logical decoding output plugin that replicates the changes made to a
+ *	  shard that is being split into the new shards that replace it.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SHARD_SPLIT_DECODER_H
+#define SHARD_SPLIT_DECODER_H
+
+#include "replication/output_plugin.h"
+
+
+/* name of the output plugin, which is the name of the library that provides it */
+#define SHARD_SPLIT_DECODER_PLUGIN "citus"
+
+/* maximum number of routes of all concurrent shard splits on a node */
+#define MAX_SHARD_SPLIT_ROUTES 1024
+
+
+extern void InitializeShardSplitDecoder(void);
+extern void _PG_output_plugin_init(OutputPluginCallbacks *callbacks);
+
+
+#endif /* SHARD_SPLIT_DECODER_H */
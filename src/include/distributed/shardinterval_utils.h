@@ -15,9 +15,23 @@
 #include "distributed/master_metadata_utility.h"
 #include "distributed/metadata_cache.h"
 #include "nodes/primnodes.h"
+#include "utils/fmgroids.h"
 
 #define INVALID_SHARD_INDEX -1
 
+/*
+ * DatumCompareKind describes how the values compared by a btree comparison
+ * function can be compared without calling the function. The comparison
+ * functions of int4 and date compare the values as int32, those of int8,
+ * timestamp and timestamptz compare them as int64.
+ */
+typedef enum DatumCompareKind
+{
+	DATUM_COMPARE_FUNCTION,
+	DATUM_COMPARE_INT32,
+	DATUM_COMPARE_INT64
+} DatumCompareKind;
+
 /* OperatorCacheEntry contains information for each element in OperatorCache */
 typedef struct ShardIntervalCompareFunctionCacheEntry
 {
@@ -35,6 +49,8 @@ extern int CompareShardPlacementsByShardId(const void *leftElement, const
 extern int CompareRelationShards(const void *leftElement,
 								 const void *rightElement);
 extern int ShardIndex(ShardInterval *shardInterval);
+extern Datum HashPartitionColumnValue(FmgrInfo *hashFunction, Oid collation,
+									  Datum partitionColumnValue);
 extern ShardInterval * FindShardInterval(Datum partitionColumnValue,
 										 DistTableCacheEntry *cacheEntry);
 extern int FindShardIntervalIndex(Datum searchedValue, DistTableCacheEntry *cacheEntry);
@@ -44,4 +60,62 @@ extern int SearchCachedShardInterval(Datum partitionColumnValue,
 extern bool SingleReplicatedTable(Oid relationId);
 
 
+/*
+ * DatumCompareKindForFunction returns how the comparison function with the
+ * given OID can be evaluated inline.
+ */
+static inline DatumCompareKind
+DatumCompareKindForFunction(Oid compareFunctionId)
+{
+	switch (compareFunctionId)
+	{
+		case F_BTINT4CMP:
+		case F_DATE_CMP:
+		{
+			return DATUM_COMPARE_INT32;
+		}
+
+		case F_BTINT8CMP:
+		case F_TIMESTAMP_CMP:
+		case F_TIMESTAMPTZ_CMP:
+		{
+			return DATUM_COMPARE_INT64;
+		}
+
+		default:
+		{
+			return DATUM_COMPARE_FUNCTION;
+		}
+	}
+}
+
+
+/*
+ * CompareInt32Datums compares two int32 values like btint4cmp() and
+ * date_cmp() do.
+ */
+static inline int
+CompareInt32Datums(Datum left, Datum right)
+{
+	int32 leftValue = DatumGetInt32(left);
+	int32 rightValue = DatumGetInt32(right);
+
+	return (leftValue > rightValue) ? 1 : ((leftValue < rightValue) ? -1 : 0);
+}
+
+
+/*
+ * CompareInt64Datums compares two int64 values like btint8cmp() and
+ * timestamp_cmp() do.
+ */
+static inline int
+CompareInt64Datums(Datum left, Datum right)
+{
+	int64 leftValue = DatumGetInt64(left);
+	int64 rightValue = DatumGetInt64(right);
+
+	return (leftValue > rightValue) ? 1 : ((leftValue < rightValue) ? -1 : 0);
+}
+
+
 #endif /* SHARDINTERVAL_UTILS_H_ */
@@ -0,0 +1,35 @@
+/*-------------------------------------------------------------------------
+ *
+ * shared_metadata_cache.h
+ *   Shard and placement metadata that is shared across backends.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SHARED_METADATA_CACHE_H
+#define SHARED_METADATA_CACHE_H
+
+#include "nodes/pg_list.h"
+
+
+/* config variable managed via guc.c */
+extern int SharedMetadataCacheSize;
+
+
+extern void InitializeSharedMetadataCache(void);
+extern bool LookupSharedShardList(Oid relationId, List **shardTupleList,
+								  List ***shardPlacementListArray);
+extern uint64 BeginSharedShardListBuild(Oid relationId);
+extern void PublishSharedShardList(Oid relationId, uint64 buildId,
+								   List *shardTupleList,
+								   List **shardPlacementListArray);
+extern void InvalidateSharedShardList(Oid relationId);
+extern void LogShardPlacementChange(uint64 shardId);
+extern uint64 * ReadShardPlacementChanges(int *changedShardCount,
+										  bool *allShardsChanged);
+extern uint64 CurrentDDLGeneration(void);
+extern void AdvanceDDLGeneration(void);
+
+#endif /* SHARED_METADATA_CACHE_H */
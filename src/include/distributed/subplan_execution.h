@@ -14,10 +14,23 @@
 
 #include "distributed/multi_physical_planner.h"
 
+
+/* what to do when intermediate results exceed citus.max_intermediate_result_size */
+typedef enum IntermediateResultSizeLimitAction
+{
+	INTERMEDIATE_RESULT_SIZE_LIMIT_ERROR = 0,
+	INTERMEDIATE_RESULT_SIZE_LIMIT_SPILL = 1
+} IntermediateResultSizeLimitAction;
+
+
 extern int MaxIntermediateResult;
+extern int IntermediateResultSizeLimitAction;
 extern int SubPlanLevel;
+extern bool EnableSubPlanResultReuse;
+extern bool EnableParallelSubPlanExecution;
 
 extern void ExecuteSubPlans(DistributedPlan *distributedPlan);
+extern void ResetSubPlanResultCache(void);
 
 /**
  * IntermediateResultsHashEntry is used to store which nodes need to receive
@@ -27,12 +40,14 @@ extern void ExecuteSubPlans(DistributedPlan *distributedPlan);
  *
  * The nodeIdList contains a set of unique WorkerNode ids that have placements
  * that can be used in non-colocated subquery joins with the intermediate result
- * given in the key.
+ * given in the key. usingPlanCount is the number of distributed plans that read
+ * the intermediate result.
  */
 typedef struct IntermediateResultsHashEntry
 {
 	char key[NAMEDATALEN];
 	List *nodeIdList;
+	int usingPlanCount;
 } IntermediateResultsHashEntry;
 
 #endif /* SUBPLAN_EXECUTION_H */
@@ -15,6 +15,7 @@
 #ifndef TASK_TRACKER_H
 #define TASK_TRACKER_H
 
+#include "storage/latch.h"
 #include "storage/lwlock.h"
 #include "utils/hsearch.h"
 
@@ -106,6 +107,9 @@ typedef struct WorkerTasksSharedStateData
 	char *taskHashTrancheName;
 	LWLock taskHashLock;
 	bool conninfosValid;
+
+	/* latch of the running task tracker, set to wake it up on new work */
+	Latch *taskTrackerLatch;
 } WorkerTasksSharedStateData;
 
 
@@ -128,6 +132,7 @@ extern WorkerTask * WorkerTasksHashFind(uint64 jobId, uint32 taskId);
 
 /* Function declarations for starting up and running the task tracker */
 extern void TaskTrackerRegister(void);
+extern void WakeupTaskTracker(void);
 
 
 #endif   /* TASK_TRACKER_H */
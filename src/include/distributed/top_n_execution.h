@@ -0,0 +1,24 @@
+/*-------------------------------------------------------------------------
+ *
+ * top_n_execution.h
+ *
+ * Functions for pulling only the candidate groups of top-N queries.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef TOP_N_EXECUTION_H
+#define TOP_N_EXECUTION_H
+
+
+#include "distributed/multi_physical_planner.h"
+#include "nodes/params.h"
+
+
+extern bool ShouldPullTopNCandidates(DistributedPlan *distributedPlan,
+									 ParamListInfo paramListInfo);
+extern List * TopNCandidateTaskList(DistributedPlan *distributedPlan, List *taskList);
+
+
+#endif /* TOP_N_EXECUTION_H */
@@ -18,10 +18,37 @@
 #include "storage/fd.h"
 
 
+/* compression method that is requested with COPY ... WITH (compression ...) */
+#define TRANSMIT_COMPRESSION_METHOD "pglz"
+#define TRANSMIT_COMPRESSION_OPTION "compression"
+
+/* size of the blocks in which intermediate results are compressed */
+#define TRANSMIT_COMPRESSION_BLOCK_SIZE (64 * 1024)
+
+/* values for citus.transmit_compression_threshold with special meaning */
+#define DISABLE_TRANSMIT_COMPRESSION -1
+
+
+/* config variable managed via guc.c */
+extern int TransmitCompressionThreshold;
+
+
 /* Function declarations for transmitting files between two nodes */
-extern void RedirectCopyDataToRegularFile(const char *filename);
-extern void SendRegularFile(const char *filename);
+extern void RedirectCopyDataToRegularFile(const char *filename, bool decompress);
+extern void SendRegularFile(const char *filename, bool compress);
 extern File FileOpenForTransmit(const char *filename, int fileFlags, int fileMode);
+extern void SendCopyInStart(bool binaryFormat, int columnCount);
+extern bool ReceiveCopyData(StringInfo copyData);
+extern void SendCopyOutStart(bool binaryFormat, int columnCount);
+extern void SendCopyData(StringInfo copyData);
+extern void SendCopyDone(void);
+
+/* Function declarations for compressing data that is sent between nodes */
+extern bool CopyStatementRequestsCompression(CopyStmt *copyStatement);
+extern void AppendCompressedTransmitFrame(StringInfo frame, const char *data,
+										  int length);
+extern void DecompressTransmitFrame(const char *frame, int frameLength,
+									StringInfo output);
 
 /* Function declaration local to commands and worker modules */
 extern void FreeStringInfo(StringInfo stringInfo);
@@ -23,6 +23,7 @@
 #if PG_VERSION_NUM >= 120000
 
 #define MakeSingleTupleTableSlotCompat MakeSingleTupleTableSlot
+#define ExecCleanTypeFromTLCompat ExecCleanTypeFromTL
 #define AllocSetContextCreateExtended AllocSetContextCreateInternal
 #define NextCopyFromCompat NextCopyFrom
 #define ArrayRef SubscriptingRef
@@ -32,6 +33,10 @@
 #define GetSysCacheOid2Compat GetSysCacheOid2
 #define GetSysCacheOid3Compat GetSysCacheOid3
 #define GetSysCacheOid4Compat GetSysCacheOid4
+#define pglz_decompress_compat(source, slen, dest, rawsize) \
+	pglz_decompress(source, slen, dest, rawsize, true)
+#define CreateParallelContextCompat(library, function, workers) \
+	CreateParallelContext(library, function, workers)
 
 #define fcGetArgValue(fc, n) ((fc)->args[n].value)
 #define fcGetArgNull(fc, n) ((fc)->args[n].isnull)
@@ -84,8 +89,11 @@ FileCompatFromFileStart(File fileDesc)
 #define QTW_EXAMINE_RTES_BEFORE QTW_EXAMINE_RTES
 #define MakeSingleTupleTableSlotCompat(tupleDesc, tts_opts) \
 	MakeSingleTupleTableSlot(tupleDesc)
+#define ExecCleanTypeFromTLCompat(targetList) \
+	ExecCleanTypeFromTL(targetList, false)
 #define NextCopyFromCompat(cstate, econtext, values, nulls) \
 	NextCopyFrom(cstate, econtext, values, nulls, NULL)
+#define execute_attr_map_tuple(tuple, map) do_convert_tuple(tuple, map)
 
 /*
  * In PG12 GetSysCacheOid requires an oid column,
@@ -100,6 +108,11 @@ FileCompatFromFileStart(File fileDesc)
 #define GetSysCacheOid4Compat(cacheId, oidcol, key1, key2, key3, key4) \
 	GetSysCacheOid4(cacheId, key1, key2, key3, key4)
 
+#define pglz_decompress_compat(source, slen, dest, rawsize) \
+	pglz_decompress(source, slen, dest, rawsize)
+#define CreateParallelContextCompat(library, function, workers) \
+	CreateParallelContext(library, function, workers, false)
+
 #define LOCAL_FCINFO(name, nargs) \
 	FunctionCallInfoData name ## data; \
 	FunctionCallInfoData *name = &name ## data
@@ -0,0 +1,47 @@
+/*-------------------------------------------------------------------------
+ *
+ * worker_latency_stats.h
+ *	  Task and connection latencies observed by this backend per worker.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef WORKER_LATENCY_STATS_H
+#define WORKER_LATENCY_STATS_H
+
+#include "distributed/connection_management.h"
+#include "utils/timestamp.h"
+
+
+/* hash key of the latency statistics of a worker */
+typedef struct WorkerLatencyStatsKey
+{
+	char hostname[MAX_NODE_LENGTH];
+	int32 port;
+} WorkerLatencyStatsKey;
+
+/* smoothed latencies of the tasks and connections to a worker, in milliseconds */
+typedef struct WorkerLatencyStats
+{
+	WorkerLatencyStatsKey key;
+
+	double taskDuration;
+	double taskDurationDeviation;
+	uint64 taskCount;
+
+	double connectTime;
+	uint64 connectCount;
+} WorkerLatencyStats;
+
+
+/* config variable managed via guc.c */
+extern bool EnableAdaptiveSlowStart;
+
+extern WorkerLatencyStats * GetWorkerLatencyStats(const char *hostname, int port);
+extern void RecordWorkerTaskDuration(WorkerLatencyStats *stats, TimestampTz startTime);
+extern void RecordWorkerConnectTime(WorkerLatencyStats *stats, TimestampTz startTime);
+extern double EstimateWorkerTaskDurationP95(WorkerLatencyStats *stats);
+
+#endif /* WORKER_LATENCY_STATS_H */
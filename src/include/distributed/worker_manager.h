@@ -57,10 +57,25 @@ typedef struct WorkerNode
 } WorkerNode;
 
 
+/*
+ * NodeUtilization describes the estimated utilization of a worker node, used
+ * by the least-utilized shard placement policy.
+ */
+typedef struct NodeUtilization
+{
+	WorkerNode *workerNode;
+	uint64 diskUsage;           /* disk space used by the database on the node */
+	uint32 placementCount;      /* number of shard placements on the node */
+	uint64 placementSize;       /* average size of a placement in the cluster */
+	uint64 estimatedSize;       /* estimated utilization, including new placements */
+} NodeUtilization;
+
+
 /* Config variables managed via guc.c */
 extern int MaxWorkerNodesTracked;
 extern char *WorkerListFileName;
 extern char *CurrentCluster;
+extern int MaxSecondaryReplayLag;
 
 
 /* Function declarations for finding worker nodes to place shards on */
@@ -69,6 +84,10 @@ extern WorkerNode * WorkerGetRoundRobinCandidateNode(List *workerNodeList,
 													 uint64 shardId,
 													 uint32 placementIndex);
 extern WorkerNode * WorkerGetLocalFirstCandidateNode(List *currentNodeList);
+extern List * NodeUtilizationList(List *workerNodeList);
+extern WorkerNode * WorkerGetLeastUtilizedCandidateNode(List *utilizationList,
+														List *currentNodeList);
+extern List * LeastUtilizedNodeList(List *utilizationList, int nodeCount);
 extern uint32 ActivePrimaryWorkerNodeCount(void);
 extern List * ActivePrimaryWorkerNodeList(LOCKMODE lockMode);
 extern List * ActivePrimaryNodeList(LOCKMODE lockMode);
@@ -78,6 +97,7 @@ extern bool NodeCanHaveDistTablePlacements(WorkerNode *node);
 extern uint32 ActiveReadableWorkerNodeCount(void);
 extern List * ActiveReadableWorkerNodeList(void);
 extern List * ActiveReadableNodeList(void);
+extern WorkerNode * ReadableSecondaryNodeForGroup(int32 groupId);
 extern WorkerNode * FindWorkerNode(char *nodeName, int32 nodePort);
 extern WorkerNode * FindWorkerNodeAnyCluster(const char *nodeName, int32 nodePort);
 extern List * ReadDistNode(bool includeNodesFromOtherClusters);
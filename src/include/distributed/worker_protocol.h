@@ -49,6 +49,8 @@
 /* the tablename in the overloaded COPY statement is the to-be-transferred file */
 #define TRANSMIT_WITH_USER_COMMAND \
 	"COPY \"%s\" TO STDOUT WITH (format 'transmit', user %s)"
+#define TRANSMIT_WITH_USER_COMPRESSED_COMMAND \
+	"COPY \"%s\" TO STDOUT WITH (format 'transmit', user %s, compression 'pglz')"
 #define COPY_OUT_COMMAND "COPY %s TO STDOUT"
 #define COPY_SELECT_ALL_OUT_COMMAND "COPY (SELECT * FROM %s) TO STDOUT"
 #define COPY_IN_COMMAND "COPY %s FROM '%s'"
@@ -92,12 +94,19 @@ typedef struct HashPartitionContext
  * then regularly flushed to the underlying file. This structure differs from
  * standard file output streams in that it keeps a larger buffer, and only
  * supports appending data to virtual file descriptors.
+ *
+ * When map outputs are pushed to the nodes of their merge tasks, the stream
+ * has no file; its buffer is instead flushed by running the copy command over
+ * the push connection. Streams of partitions that no merge task consumes have
+ * neither a file nor a push connection, and drop their data.
  */
 typedef struct FileOutputStream
 {
 	FileCompat fileCompat;
 	StringInfo fileBuffer;
 	StringInfo filePath;
+	struct MultiConnection *pushConnection;
+	char *pushCopyCommand;
 } FileOutputStream;
 
 
@@ -114,12 +123,14 @@ extern StringInfo JobDirectoryName(uint64 jobId);
 extern StringInfo MasterJobDirectoryName(uint64 jobId);
 extern StringInfo TaskDirectoryName(uint64 jobId, uint32 taskId);
 extern StringInfo PartitionFilename(StringInfo directoryName, uint32 partitionId);
+extern StringInfo UserPartitionFilename(StringInfo directoryName, uint32 partitionId);
 extern bool CacheDirectoryElement(const char *filename);
 extern bool JobDirectoryElement(const char *filename);
 extern bool DirectoryExists(StringInfo directoryName);
 extern void CitusCreateDirectory(StringInfo directoryName);
 extern void CitusRemoveDirectory(StringInfo filename);
 extern StringInfo InitTaskDirectory(uint64 jobId, uint32 taskId);
+extern void CreateJobSchema(StringInfo schemaName);
 extern void RemoveJobSchema(StringInfo schemaName);
 extern Datum * DeconstructArrayObject(ArrayType *arrayObject);
 extern int32 ArrayObjectCount(ArrayType *arrayObject);
@@ -149,6 +160,7 @@ extern Datum worker_fetch_query_results_file(PG_FUNCTION_ARGS);
 extern Datum worker_apply_shard_ddl_command(PG_FUNCTION_ARGS);
 extern Datum worker_range_partition_table(PG_FUNCTION_ARGS);
 extern Datum worker_hash_partition_table(PG_FUNCTION_ARGS);
+extern Datum worker_broadcast_partition_table(PG_FUNCTION_ARGS);
 extern Datum worker_merge_files_into_table(PG_FUNCTION_ARGS);
 extern Datum worker_merge_files_and_run_query(PG_FUNCTION_ARGS);
 extern Datum worker_cleanup_job_schema_cache(PG_FUNCTION_ARGS);
@@ -0,0 +1,44 @@
+/*-------------------------------------------------------------------------
+ *
+ * worker_repartition_cache.h
+ *	  Reuse of the partition files of map tasks across repartition jobs.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef WORKER_REPARTITION_CACHE_H
+#define WORKER_REPARTITION_CACHE_H
+
+#include "postgres.h"
+
+#include "fmgr.h"
+#include "executor/spi.h"
+#include "lib/stringinfo.h"
+#include "nodes/pg_list.h"
+#include "nodes/plannodes.h"
+#include "utils/snapshot.h"
+
+
+/* directory below the job cache directory that holds the cached map outputs */
+#define REPARTITION_CACHE_DIRECTORY "repartition_cache"
+
+
+/* Config variable managed via guc.c */
+extern bool EnableRepartitionCache;
+
+
+extern bool RepartitionCacheEnabled(void);
+extern StringInfo RepartitionCacheKey(FunctionCallInfo fcinfo, int keyArgumentCount);
+extern StringInfo RepartitionCacheEntryDirectory(StringInfo cacheKey, uint32 fileCount);
+extern List * RepartitionCacheRelationList(SPIPlanPtr queryPlan,
+										   PlannedStmt *plannedStatement);
+extern bool SnapshotHasNoConcurrentTransactions(Snapshot snapshot);
+extern bool LinkPartitionFiles(StringInfo sourceDirectoryName,
+							   StringInfo targetDirectoryName, uint32 fileCount);
+extern void StoreRepartitionCacheEntry(StringInfo cacheKey, List *relationList,
+									   StringInfo taskDirectoryName, uint32 fileCount);
+
+
+#endif /* WORKER_REPARTITION_CACHE_H */
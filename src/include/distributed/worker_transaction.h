@@ -46,6 +46,10 @@ extern void SendCommandListToWorkerInSingleTransaction(const char *nodeName,
 													   int32 nodePort,
 													   const char *nodeUser,
 													   List *commandList);
+extern void SendCommandListsToWorkerInParallel(const char *nodeName, int32 nodePort,
+											   const char *nodeUser,
+											   List *commandListList,
+											   int connectionCount);
 extern void RemoveWorkerTransaction(char *nodeName, int32 nodePort);
 
 /* helper functions for worker transactions */
@@ -0,0 +1,316 @@
+#!/usr/bin/env python3
+
+"""cluster_bench
+Usage:
+    cluster_bench [options] --bindir=<bindir>
+
+Options:
+    --bindir=<bindir>           The PostgreSQL executable directory(ex: '~/.pgenv/pgsql-12.1/bin')
+    --workers=<workers>         Number of worker nodes to start [default: 2]
+    --workload=<workload>       Workload to run: tpch, tpcc or all [default: all]
+    --scale=<scale>             TPC-H scale factor [default: 0.1]
+    --warehouses=<warehouses>   Number of TPC-C warehouses [default: 10]
+    --shard-count=<count>       Shard count of the distributed tables [default: 32]
+    --runs=<runs>               Number of timed runs of each TPC-H query [default: 3]
+    --clients=<clients>         Number of pgbench clients for TPC-C [default: 16]
+    --duration=<seconds>        Duration of each TPC-C run in seconds [default: 60]
+    --seed=<seed>               Random seed of the data and of pgbench [default: 20200101]
+    --base-port=<port>          Port of the coordinator, workers use the next ports [default: 9700]
+    --results=<file>            File to append the JSON results to [default: ./results/cluster_bench.jsonl]
+    --keep-cluster              Leave the cluster running after the benchmark
+"""
+
+import atexit
+import datetime
+import json
+import os
+import re
+import shutil
+import statistics
+import subprocess
+import sys
+
+from docopt import docopt
+
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+TEMP_DIR = './tmp_cluster_bench'
+USER = 'postgres'
+DBNAME = 'postgres'
+
+# executors to run the analytical queries with, as the GUC settings to use
+EXECUTORS = {
+    'adaptive': {
+        'citus.task_executor_type': 'adaptive',
+        'citus.enable_repartition_joins': 'on',
+    },
+    'task-tracker': {
+        'citus.task_executor_type': 'task-tracker',
+    },
+}
+
+TIMING_REGEX = re.compile(r'^Time: ([0-9.]+) ms', re.MULTILINE)
+TPS_REGEX = re.compile(r'^tps = ([0-9.]+) \(excluding', re.MULTILINE)
+LATENCY_REGEX = re.compile(r'^latency average = ([0-9.]+) ms', re.MULTILINE)
+
+
+class ClusterBenchConfig():
+
+    def __init__(self, arguments):
+        self.bindir = os.path.expanduser(arguments['--bindir'])
+        self.worker_count = int(arguments['--workers'])
+        self.workload = arguments['--workload']
+        self.scale = float(arguments['--scale'])
+        self.warehouses = int(arguments['--warehouses'])
+        self.shard_count = int(arguments['--shard-count'])
+        self.runs = int(arguments['--runs'])
+        self.clients = int(arguments['--clients'])
+        self.duration = int(arguments['--duration'])
+        self.seed = int(arguments['--seed'])
+        self.results_path = os.path.abspath(arguments['--results'])
+        self.keep_cluster = arguments['--keep-cluster']
+        self.datadir = os.path.abspath(os.path.join(TEMP_DIR, 'data'))
+
+        base_port = int(arguments['--base-port'])
+        self.coordinator_port = base_port
+        self.worker_ports = [base_port + 1 + index
+                             for index in range(self.worker_count)]
+        self.settings = {
+            'shared_preload_libraries': 'citus',
+            'max_connections': 300,
+            'shared_buffers': '256MB',
+            'max_prepared_transactions': 100,
+            'citus.node_conninfo': 'sslmode=prefer',
+        }
+
+    def node_ports(self):
+        return [self.coordinator_port] + self.worker_ports
+
+
+def psql(config, port, command):
+    return subprocess.check_output([
+        os.path.join(config.bindir, 'psql'),
+        '-X', '-q',
+        '-v', 'ON_ERROR_STOP=1',
+        '-U', USER,
+        '-d', DBNAME,
+        '-p', str(port),
+        '-c', command]
+    )
+
+
+def psql_file(config, port, path, variables={}):
+    command = [
+        os.path.join(config.bindir, 'psql'),
+        '-X', '-q',
+        '-v', 'ON_ERROR_STOP=1',
+        '-U', USER,
+        '-d', DBNAME,
+        '-p', str(port),
+        '-f', path
+    ]
+    for name, value in variables.items():
+        command += ['-v', '{}={}'.format(name, value)]
+    subprocess.check_call(command, stdout=subprocess.DEVNULL)
+
+
+def node_datadir(config, port):
+    return os.path.join(config.datadir, 'node_{}'.format(port))
+
+
+def start_cluster(config):
+    if os.path.exists(TEMP_DIR):
+        shutil.rmtree(TEMP_DIR)
+    os.makedirs(config.datadir)
+
+    for port in config.node_ports():
+        abs_data_path = node_datadir(config, port)
+        subprocess.check_call([
+            os.path.join(config.bindir, 'initdb'),
+            '--pgdata', abs_data_path,
+            '--username', USER
+        ], stdout=subprocess.DEVNULL)
+
+        conf_path = os.path.join(abs_data_path, 'postgresql.conf')
+        with open(conf_path, 'a') as conf_file:
+            for setting_key, setting_val in config.settings.items():
+                conf_file.write("{} = '{}'\n".format(setting_key, setting_val))
+
+        subprocess.check_call([
+            os.path.join(config.bindir, 'pg_ctl'), 'start', '-w',
+            '--pgdata', abs_data_path,
+            '-o', '-p {}'.format(port),
+            '--log', os.path.join(abs_data_path, 'logfile')
+        ], stdout=subprocess.DEVNULL)
+
+    for port in config.node_ports():
+        psql(config, port, 'CREATE EXTENSION citus;')
+
+    for port in config.worker_ports:
+        psql(config, config.coordinator_port,
+             "SELECT master_add_node('localhost', {});".format(port))
+
+
+def stop_cluster(config):
+    for port in config.node_ports():
+        subprocess.call([
+            os.path.join(config.bindir, 'pg_ctl'), 'stop', '-w',
+            '--pgdata', node_datadir(config, port),
+            '-m', 'fast'
+        ], stdout=subprocess.DEVNULL)
+
+
+def workload_path(*parts):
+    return os.path.join(BENCH_DIR, *parts)
+
+
+def run_tpch(config, context):
+    variables = {
+        'scale': config.scale,
+        'shard_count': config.shard_count,
+        'seed': config.seed / 10 ** len(str(config.seed)),
+    }
+    psql_file(config, config.coordinator_port, workload_path('tpch', 'schema.sql'),
+              variables)
+    psql_file(config, config.coordinator_port, workload_path('tpch', 'load.sql'),
+              variables)
+
+    query_dir = workload_path('tpch', 'queries')
+    for query_file in sorted(os.listdir(query_dir)):
+        query_name = os.path.splitext(query_file)[0]
+        with open(os.path.join(query_dir, query_file)) as query:
+            query_text = query.read()
+
+        for executor, settings in sorted(EXECUTORS.items()):
+            result = dict(context, workload='tpch', scale=config.scale,
+                          name=query_name, executor=executor)
+            try:
+                timings = time_query(config, settings, query_text)
+                result['runs_ms'] = timings
+                result['median_ms'] = statistics.median(timings)
+            except subprocess.CalledProcessError as error:
+                # not every query is supported by every executor
+                result['error'] = error.output.decode('utf-8').strip()
+
+            write_result(config, result)
+
+
+def time_query(config, settings, query_text):
+    script = []
+    for setting_key, setting_val in sorted(settings.items()):
+        script.append("SET {} TO '{}';".format(setting_key, setting_val))
+
+    # the first run warms up the caches and is not timed
+    script += ['\\o /dev/null', query_text, '\\timing on']
+    script += [query_text] * config.runs
+
+    output = subprocess.check_output([
+        os.path.join(config.bindir, 'psql'),
+        '-X', '-q',
+        '-v', 'ON_ERROR_STOP=1',
+        '-U', USER,
+        '-d', DBNAME,
+        '-p', str(config.coordinator_port)],
+        input='\n'.join(script).encode('utf-8'),
+        stderr=subprocess.STDOUT
+    )
+
+    return [float(timing) for timing in TIMING_REGEX.findall(output.decode('utf-8'))]
+
+
+def run_tpcc(config, context):
+    variables = {
+        'warehouses': config.warehouses,
+        'shard_count': config.shard_count,
+        'seed': config.seed / 10 ** len(str(config.seed)),
+    }
+    psql_file(config, config.coordinator_port, workload_path('tpcc', 'schema.sql'),
+              variables)
+    psql_file(config, config.coordinator_port, workload_path('tpcc', 'load.sql'),
+              variables)
+
+    # transaction mix of TPC-C, each script is run with its weight
+    transactions = [
+        ('new_order', 45),
+        ('payment', 43),
+        ('order_status', 4),
+        ('delivery', 4),
+        ('stock_level', 4),
+    ]
+
+    command = [
+        os.path.join(config.bindir, 'pgbench'),
+        '-n',
+        '-U', USER,
+        '-p', str(config.coordinator_port),
+        '-c', str(config.clients),
+        '-j', str(config.clients),
+        '-T', str(config.duration),
+        '--random-seed={}'.format(config.seed),
+        '-D', 'warehouses={}'.format(config.warehouses)
+    ]
+    for name, weight in transactions:
+        command += ['-f', '{}@{}'.format(workload_path('tpcc', name + '.sql'), weight)]
+    command.append(DBNAME)
+
+    output = subprocess.check_output(command).decode('utf-8')
+
+    # router transactions always run on the adaptive executor
+    result = dict(context, workload='tpcc', scale=config.warehouses,
+                  name='mix', executor='adaptive', clients=config.clients,
+                  duration_s=config.duration,
+                  tps=float(TPS_REGEX.search(output).group(1)),
+                  latency_ms=float(LATENCY_REGEX.search(output).group(1)))
+    write_result(config, result)
+
+
+def write_result(config, result):
+    line = json.dumps(result, sort_keys=True)
+    print(line)
+
+    with open(config.results_path, 'a') as results_file:
+        results_file.write(line + '\n')
+
+
+def benchmark_context(config):
+    try:
+        commit = subprocess.check_output(
+            ['git', 'describe', '--dirty', '--always', '--tags'],
+            cwd=BENCH_DIR, stderr=subprocess.DEVNULL).decode('utf-8').strip()
+    except (OSError, subprocess.CalledProcessError):
+        commit = None
+
+    citus_version = psql(config, config.coordinator_port,
+                         'SELECT citus_version();').decode('utf-8').strip()
+
+    return {
+        'commit': commit,
+        'citus_version': citus_version,
+        'workers': config.worker_count,
+        'shard_count': config.shard_count,
+        'started_at': datetime.datetime.utcnow().isoformat() + 'Z',
+    }
+
+
+def main(config):
+    results_dir = os.path.dirname(config.results_path)
+    if not os.path.exists(results_dir):
+        os.makedirs(results_dir)
+
+    start_cluster(config)
+    context = benchmark_context(config)
+
+    if config.workload in ('tpch', 'all'):
+        run_tpch(config, context)
+    if config.workload in ('tpcc', 'all'):
+        run_tpcc(config, context)
+
+
+if __name__ == '__main__':
+    args = docopt(__doc__, version='cluster_bench')
+    config = ClusterBenchConfig(args)
+    if config.workload not in ('tpch', 'tpcc', 'all'):
+        sys.exit('unknown workload: {}'.format(config.workload))
+    if not config.keep_cluster:
+        atexit.register(stop_cluster, config)
+    main(config)
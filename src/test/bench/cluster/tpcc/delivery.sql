@@ -0,0 +1,14 @@
+\set w_id random(1, :warehouses)
+\set d_id random(1, 10)
+\set carrier_id random(1, 10)
+BEGIN;
+UPDATE tpcc.orders SET o_carrier_id = :carrier_id
+WHERE o_w_id = :w_id AND o_d_id = :d_id AND o_id = (
+	SELECT min(no_o_id) FROM tpcc.new_order WHERE no_w_id = :w_id AND no_d_id = :d_id);
+UPDATE tpcc.order_line SET ol_delivery_d = now()
+WHERE ol_w_id = :w_id AND ol_d_id = :d_id AND ol_o_id = (
+	SELECT min(no_o_id) FROM tpcc.new_order WHERE no_w_id = :w_id AND no_d_id = :d_id);
+DELETE FROM tpcc.new_order
+WHERE no_w_id = :w_id AND no_d_id = :d_id AND no_o_id = (
+	SELECT min(no_o_id) FROM tpcc.new_order WHERE no_w_id = :w_id AND no_d_id = :d_id);
+END;
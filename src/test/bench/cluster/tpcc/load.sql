@@ -0,0 +1,63 @@
+--
+-- Generates the initial TPC-C population for the given number of warehouses:
+-- 10 districts per warehouse, 3000 customers and orders per district, of which
+-- the last 900 are not delivered yet, and 100000 items in stock. The data is
+-- generated on the coordinator with a fixed seed, so every run loads the same
+-- data.
+--
+SET client_min_messages TO WARNING;
+SET search_path TO tpcc;
+SELECT setseed(:seed);
+
+INSERT INTO item
+SELECT i, 1 + (random() * 9999)::int, md5(i::text),
+	   round((1 + random() * 99)::numeric, 2), md5(random()::text)
+FROM generate_series(1, 100000) i;
+
+INSERT INTO warehouse
+SELECT w, 'warehouse ' || w, md5(random()::text), md5(random()::text),
+	   round((random() * 0.2)::numeric, 4), 300000
+FROM generate_series(1, :warehouses) w;
+
+INSERT INTO district
+SELECT w, d, 'district ' || d, md5(random()::text), md5(random()::text),
+	   round((random() * 0.2)::numeric, 4), 30000, 3001
+FROM generate_series(1, :warehouses) w, generate_series(1, 10) d;
+
+INSERT INTO customer
+SELECT w, d, c, md5(random()::text), 'customer ' || (c % 1000),
+	   timestamptz '2020-01-01', CASE WHEN random() < 0.1 THEN 'BC' ELSE 'GC' END,
+	   round((random() * 0.5)::numeric, 4), -10, 10, 1, 0, md5(random()::text)
+FROM generate_series(1, :warehouses) w, generate_series(1, 10) d,
+	 generate_series(1, 3000) c;
+
+INSERT INTO history
+SELECT c, d, w, d, w, timestamptz '2020-01-01', 10, md5(random()::text)
+FROM generate_series(1, :warehouses) w, generate_series(1, 10) d,
+	 generate_series(1, 3000) c;
+
+INSERT INTO orders
+SELECT w, d, o, 1 + (random() * 2999)::int, timestamptz '2020-01-01',
+	   CASE WHEN o <= 2100 THEN 1 + (random() * 9)::int END, 5 + o % 11, 1
+FROM generate_series(1, :warehouses) w, generate_series(1, 10) d,
+	 generate_series(1, 3000) o;
+
+INSERT INTO new_order
+SELECT w, d, o
+FROM generate_series(1, :warehouses) w, generate_series(1, 10) d,
+	 generate_series(2101, 3000) o;
+
+INSERT INTO order_line
+SELECT w, d, o, l, 1 + (random() * 99999)::int, w,
+	   CASE WHEN o <= 2100 THEN timestamptz '2020-01-01' END, 5,
+	   CASE WHEN o <= 2100 THEN 0 ELSE round((random() * 9999.99)::numeric, 2) END,
+	   md5(random()::text)
+FROM generate_series(1, :warehouses) w, generate_series(1, 10) d,
+	 generate_series(1, 3000) o, generate_series(1, 5 + o % 11) l;
+
+INSERT INTO stock
+SELECT w, i, 10 + (random() * 90)::int, 0, 0, 0, md5(random()::text)
+FROM generate_series(1, :warehouses) w, generate_series(1, 100000) i;
+
+VACUUM ANALYZE item, warehouse, district, customer, history, orders, new_order,
+			   order_line, stock;
@@ -0,0 +1,29 @@
+\set w_id random(1, :warehouses)
+\set d_id random(1, 10)
+\set c_id random(1, 3000)
+\set i1 random(1, 100000)
+\set i2 random(1, 100000)
+\set i3 random(1, 100000)
+\set i4 random(1, 100000)
+\set i5 random(1, 100000)
+\set quantity random(1, 10)
+BEGIN;
+SELECT c_discount, c_last, c_credit FROM tpcc.customer
+WHERE c_w_id = :w_id AND c_d_id = :d_id AND c_id = :c_id;
+UPDATE tpcc.district SET d_next_o_id = d_next_o_id + 1
+WHERE d_w_id = :w_id AND d_id = :d_id RETURNING d_next_o_id - 1 AS o_id \gset
+INSERT INTO tpcc.orders VALUES (:w_id, :d_id, :o_id, :c_id, now(), NULL, 5, 1);
+INSERT INTO tpcc.new_order VALUES (:w_id, :d_id, :o_id);
+SELECT i_id, i_price, i_name, i_data FROM tpcc.item WHERE i_id IN (:i1, :i2, :i3, :i4, :i5);
+UPDATE tpcc.stock SET
+	s_quantity = CASE WHEN s_quantity > :quantity + 10 THEN s_quantity - :quantity
+				 ELSE s_quantity - :quantity + 91 END,
+	s_ytd = s_ytd + :quantity, s_order_cnt = s_order_cnt + 1
+WHERE s_w_id = :w_id AND s_i_id IN (:i1, :i2, :i3, :i4, :i5);
+INSERT INTO tpcc.order_line VALUES
+	(:w_id, :d_id, :o_id, 1, :i1, :w_id, NULL, :quantity, :quantity * 10, 'dist info'),
+	(:w_id, :d_id, :o_id, 2, :i2, :w_id, NULL, :quantity, :quantity * 10, 'dist info'),
+	(:w_id, :d_id, :o_id, 3, :i3, :w_id, NULL, :quantity, :quantity * 10, 'dist info'),
+	(:w_id, :d_id, :o_id, 4, :i4, :w_id, NULL, :quantity, :quantity * 10, 'dist info'),
+	(:w_id, :d_id, :o_id, 5, :i5, :w_id, NULL, :quantity, :quantity * 10, 'dist info');
+END;
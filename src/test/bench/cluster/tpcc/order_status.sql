@@ -0,0 +1,12 @@
+\set w_id random(1, :warehouses)
+\set d_id random(1, 10)
+\set c_id random(1, 3000)
+BEGIN;
+SELECT c_balance, c_first, c_last FROM tpcc.customer
+WHERE c_w_id = :w_id AND c_d_id = :d_id AND c_id = :c_id;
+SELECT ol_i_id, ol_supply_w_id, ol_quantity, ol_amount, ol_delivery_d
+FROM tpcc.order_line
+WHERE ol_w_id = :w_id AND ol_d_id = :d_id AND ol_o_id = (
+	SELECT max(o_id) FROM tpcc.orders
+	WHERE o_w_id = :w_id AND o_d_id = :d_id AND o_c_id = :c_id);
+END;
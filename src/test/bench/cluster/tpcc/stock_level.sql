@@ -0,0 +1,9 @@
+\set w_id random(1, :warehouses)
+\set d_id random(1, 10)
+\set threshold random(10, 20)
+SELECT count(DISTINCT s_i_id)
+FROM tpcc.order_line, tpcc.stock
+WHERE ol_w_id = :w_id AND ol_d_id = :d_id
+	AND ol_o_id >= (SELECT d_next_o_id - 20 FROM tpcc.district
+					WHERE d_w_id = :w_id AND d_id = :d_id)
+	AND s_w_id = :w_id AND s_i_id = ol_i_id AND s_quantity < :threshold;
@@ -0,0 +1,75 @@
+--
+-- Generates TPC-H style data for the given scale factor. The row counts and
+-- value distributions follow the specification closely enough for the shape
+-- of the query plans, and the fixed seed makes every run load the same data.
+--
+SET client_min_messages TO WARNING;
+SET search_path TO tpch;
+SELECT setseed(:seed);
+
+\set supplier_count 'greatest(1, (10000 * ' :scale ')::int)'
+\set part_count 'greatest(1, (200000 * ' :scale ')::int)'
+\set customer_count 'greatest(1, (150000 * ' :scale ')::int)'
+\set order_count 'greatest(1, (1500000 * ' :scale ')::int)'
+
+INSERT INTO region
+SELECT r, (ARRAY['AFRICA', 'AMERICA', 'ASIA', 'EUROPE', 'MIDDLE EAST'])[r + 1],
+	   'region ' || r
+FROM generate_series(0, 4) r;
+
+INSERT INTO nation
+SELECT n, 'NATION ' || n, n % 5, 'nation ' || n
+FROM generate_series(0, 24) n;
+
+INSERT INTO supplier
+SELECT s, 'Supplier#' || lpad(s::text, 9, '0'), md5(random()::text), s % 25,
+	   to_char(10 + s % 25, 'FM00') || '-' || (100 + s % 900),
+	   round((random() * 10999 - 999)::numeric, 2), md5(random()::text)
+FROM generate_series(1, :supplier_count) s;
+
+INSERT INTO part
+SELECT p, md5(random()::text), 'Manufacturer#' || (1 + p % 5),
+	   'Brand#' || (1 + p % 5) || (1 + p % 5 * 7 % 5),
+	   (ARRAY['STANDARD', 'SMALL', 'MEDIUM', 'LARGE', 'ECONOMY', 'PROMO'])[1 + p % 6] ||
+	   (ARRAY[' ANODIZED', ' BURNISHED', ' PLATED', ' POLISHED', ' BRUSHED'])[1 + p % 5] ||
+	   (ARRAY[' TIN', ' NICKEL', ' BRASS', ' STEEL', ' COPPER'])[1 + p / 5 % 5],
+	   1 + p % 50,
+	   (ARRAY['SM', 'LG', 'MED', 'JUMBO', 'WRAP'])[1 + p % 5] ||
+	   (ARRAY[' CASE', ' BOX', ' BAG', ' JAR', ' PKG', ' PACK', ' CAN', ' DRUM'])[1 + p % 8],
+	   (90000 + (p / 10) % 20001 + 100 * (p % 1000)) / 100.0, md5(random()::text)
+FROM generate_series(1, :part_count) p;
+
+INSERT INTO customer
+SELECT c, 'Customer#' || lpad(c::text, 9, '0'), md5(random()::text), c % 25,
+	   to_char(10 + c % 25, 'FM00') || '-' || (100 + c % 900),
+	   round((random() * 10999 - 999)::numeric, 2),
+	   (ARRAY['AUTOMOBILE', 'BUILDING', 'FURNITURE', 'MACHINERY', 'HOUSEHOLD'])[1 + c % 5],
+	   md5(random()::text)
+FROM generate_series(1, :customer_count) c;
+
+INSERT INTO orders
+SELECT o, 1 + (random() * (:customer_count - 1))::int,
+	   (ARRAY['F', 'O', 'P'])[1 + o % 3], round((random() * 500000)::numeric, 2),
+	   date '1992-01-01' + (o::bigint * 7919 % 2406)::int,
+	   (ARRAY['1-URGENT', '2-HIGH', '3-MEDIUM', '4-NOT SPECIFIED', '5-LOW'])[1 + o % 5],
+	   'Clerk#' || lpad((1 + o % 1000)::text, 9, '0'), 0, md5(random()::text)
+FROM generate_series(1, :order_count) o;
+
+-- lineitem is generated on the coordinator as well, to keep the data
+-- deterministic, using the same order dates as above
+INSERT INTO lineitem
+SELECT o, 1 + (random() * (:part_count - 1))::int,
+	   1 + (random() * (:supplier_count - 1))::int, l,
+	   1 + (random() * 49)::int, round((random() * 100000)::numeric, 2),
+	   round((random() * 0.1)::numeric, 2), round((random() * 0.08)::numeric, 2),
+	   (ARRAY['R', 'A', 'N'])[1 + (o + l) % 3],
+	   (ARRAY['O', 'F'])[1 + (o + l) % 2],
+	   date '1992-01-01' + (o::bigint * 7919 % 2406)::int + 1 + l * 10,
+	   date '1992-01-01' + (o::bigint * 7919 % 2406)::int + 30 + l,
+	   date '1992-01-01' + (o::bigint * 7919 % 2406)::int + 2 + l * 11,
+	   (ARRAY['DELIVER IN PERSON', 'COLLECT COD', 'NONE', 'TAKE BACK RETURN'])[1 + l % 4],
+	   (ARRAY['REG AIR', 'AIR', 'RAIL', 'SHIP', 'TRUCK', 'MAIL', 'FOB'])[1 + (o + l) % 7],
+	   md5(random()::text)
+FROM generate_series(1, :order_count) o, generate_series(1, 1 + o % 7) l;
+
+VACUUM ANALYZE region, nation, supplier, part, customer, orders, lineitem;
@@ -0,0 +1,96 @@
+--
+-- Creates the TPC-H tables. The two largest tables are colocated on the order
+-- key, so that their join is pushed down, while the dimension tables are
+-- distributed on their own keys or replicated to all nodes.
+--
+SET client_min_messages TO WARNING;
+DROP SCHEMA IF EXISTS tpch CASCADE;
+CREATE SCHEMA tpch;
+SET search_path TO tpch;
+SET citus.shard_count TO :shard_count;
+
+CREATE TABLE region (
+	r_regionkey int PRIMARY KEY,
+	r_name text NOT NULL,
+	r_comment text
+);
+
+CREATE TABLE nation (
+	n_nationkey int PRIMARY KEY,
+	n_name text NOT NULL,
+	n_regionkey int NOT NULL,
+	n_comment text
+);
+
+CREATE TABLE supplier (
+	s_suppkey int PRIMARY KEY,
+	s_name text NOT NULL,
+	s_address text NOT NULL,
+	s_nationkey int NOT NULL,
+	s_phone text NOT NULL,
+	s_acctbal numeric(15,2) NOT NULL,
+	s_comment text NOT NULL
+);
+
+CREATE TABLE part (
+	p_partkey int PRIMARY KEY,
+	p_name text NOT NULL,
+	p_mfgr text NOT NULL,
+	p_brand text NOT NULL,
+	p_type text NOT NULL,
+	p_size int NOT NULL,
+	p_container text NOT NULL,
+	p_retailprice numeric(15,2) NOT NULL,
+	p_comment text NOT NULL
+);
+
+CREATE TABLE customer (
+	c_custkey int PRIMARY KEY,
+	c_name text NOT NULL,
+	c_address text NOT NULL,
+	c_nationkey int NOT NULL,
+	c_phone text NOT NULL,
+	c_acctbal numeric(15,2) NOT NULL,
+	c_mktsegment text NOT NULL,
+	c_comment text NOT NULL
+);
+
+CREATE TABLE orders (
+	o_orderkey bigint PRIMARY KEY,
+	o_custkey int NOT NULL,
+	o_orderstatus char(1) NOT NULL,
+	o_totalprice numeric(15,2) NOT NULL,
+	o_orderdate date NOT NULL,
+	o_orderpriority text NOT NULL,
+	o_clerk text NOT NULL,
+	o_shippriority int NOT NULL,
+	o_comment text NOT NULL
+);
+
+CREATE TABLE lineitem (
+	l_orderkey bigint NOT NULL,
+	l_partkey int NOT NULL,
+	l_suppkey int NOT NULL,
+	l_linenumber int NOT NULL,
+	l_quantity numeric(15,2) NOT NULL,
+	l_extendedprice numeric(15,2) NOT NULL,
+	l_discount numeric(15,2) NOT NULL,
+	l_tax numeric(15,2) NOT NULL,
+	l_returnflag char(1) NOT NULL,
+	l_linestatus char(1) NOT NULL,
+	l_shipdate date NOT NULL,
+	l_commitdate date NOT NULL,
+	l_receiptdate date NOT NULL,
+	l_shipinstruct text NOT NULL,
+	l_shipmode text NOT NULL,
+	l_comment text NOT NULL,
+	PRIMARY KEY (l_orderkey, l_linenumber)
+);
+
+SELECT create_reference_table('region');
+SELECT create_reference_table('nation');
+SELECT create_reference_table('supplier');
+SELECT create_distributed_table('part', 'p_partkey');
+SELECT create_distributed_table('customer', 'c_custkey');
+SELECT create_distributed_table('orders', 'o_orderkey');
+SELECT create_distributed_table('lineitem', 'l_orderkey', colocate_with => 'orders');
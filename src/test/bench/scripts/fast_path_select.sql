@@ -0,0 +1,2 @@
+\set key random(1, 100000)
+SELECT value FROM citus_bench.events_32 WHERE key = :key;
@@ -0,0 +1 @@
+SELECT count(*) FROM citus_bench.events_32;
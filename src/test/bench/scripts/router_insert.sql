@@ -0,0 +1,2 @@
+\set key random(1, 100000)
+INSERT INTO citus_bench.events_32 (key, value) VALUES (:key, 'bench');
@@ -0,0 +1,2 @@
+\set key random(1, 100000)
+UPDATE citus_bench.events_32 SET value = 'bench' WHERE key = :key;
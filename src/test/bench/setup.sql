@@ -0,0 +1,50 @@
+--
+-- Creates the tables and functions used by the benchmarks. The tables are
+-- recreated on every run, so every run starts from the same data.
+--
+SET client_min_messages TO WARNING;
+DROP SCHEMA IF EXISTS citus_bench CASCADE;
+CREATE SCHEMA citus_bench;
+SET search_path TO citus_bench;
+
+CREATE FUNCTION benchmark_prune_shards(regclass, text, int)
+	RETURNS float8
+	AS 'citus'
+	LANGUAGE C STRICT;
+
+CREATE FUNCTION benchmark_find_shard_interval(regclass, text, int)
+	RETURNS float8
+	AS 'citus'
+	LANGUAGE C STRICT;
+
+CREATE FUNCTION benchmark_plan_query(text, int)
+	RETURNS float8
+	AS 'citus'
+	LANGUAGE C STRICT;
+
+CREATE FUNCTION benchmark_deparse_shard_query(regclass, text, int)
+	RETURNS float8
+	AS 'citus'
+	LANGUAGE C STRICT;
+
+-- the same table with different shard counts, to see how costs scale
+CREATE TABLE events_32 (key bigint, value text, created_at timestamptz DEFAULT now());
+SET citus.shard_count TO 32;
+SELECT create_distributed_table('events_32', 'key');
+
+CREATE TABLE events_128 (LIKE events_32 INCLUDING DEFAULTS);
+SET citus.shard_count TO 128;
+SELECT create_distributed_table('events_128', 'key');
+
+CREATE TABLE events_1024 (LIKE events_32 INCLUDING DEFAULTS);
+SET citus.shard_count TO 1024;
+SELECT create_distributed_table('events_1024', 'key');
+
+INSERT INTO events_32 (key, value)
+	SELECT s, 'value-' || s FROM generate_series(1, 100000) s;
+INSERT INTO events_128 SELECT * FROM events_32;
+INSERT INTO events_1024 SELECT * FROM events_32;
+
+VACUUM ANALYZE events_32;
+VACUUM ANALYZE events_128;
+VACUUM ANALYZE events_1024;
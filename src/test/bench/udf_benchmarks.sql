@@ -0,0 +1,30 @@
+--
+-- Benchmarks of planner hot paths that run inside a single backend, reported
+-- as the average time per iteration in microseconds.
+--
+SET search_path TO citus_bench;
+SET client_min_messages TO WARNING;
+
+SELECT benchmark, round(usec_per_iteration::numeric, 3) AS usec_per_iteration
+FROM (VALUES
+	('prune_shards_32', benchmark_prune_shards('events_32', '42', 100000)),
+	('prune_shards_128', benchmark_prune_shards('events_128', '42', 100000)),
+	('prune_shards_1024', benchmark_prune_shards('events_1024', '42', 100000)),
+	('find_shard_interval_32',
+	 benchmark_find_shard_interval('events_32', '42', 1000000)),
+	('find_shard_interval_1024',
+	 benchmark_find_shard_interval('events_1024', '42', 1000000)),
+	('plan_fast_path_select',
+	 benchmark_plan_query('SELECT value FROM events_32 WHERE key = 42', 10000)),
+	('plan_router_insert',
+	 benchmark_plan_query('INSERT INTO events_32 (key, value) VALUES (42, ''x'')',
+						  10000)),
+	('plan_multi_shard_select_32',
+	 benchmark_plan_query('SELECT count(*) FROM events_32', 1000)),
+	('plan_multi_shard_select_1024',
+	 benchmark_plan_query('SELECT count(*) FROM events_1024', 100)),
+	('deparse_shard_select',
+	 benchmark_deparse_shard_query('events_32',
+								   'SELECT value FROM events_32 WHERE key = 42',
+								   100000))
+) AS benchmarks (benchmark, usec_per_iteration);
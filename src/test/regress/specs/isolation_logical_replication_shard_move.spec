@@ -0,0 +1,88 @@
+# we use 5 as the partition key value through out the test
+# so setting the corresponding shard here is useful
+setup
+{
+	SET citus.shard_count TO 2;
+	SET citus.shard_replication_factor TO 1;
+	CREATE TABLE logical_replicate_placement (x int PRIMARY KEY, y int);
+	SELECT create_distributed_table('logical_replicate_placement', 'x');
+	INSERT INTO logical_replicate_placement VALUES (5, 10), (15, 20);
+
+	SELECT get_shard_id_for_distribution_column('logical_replicate_placement', 5) INTO selected_shard;
+}
+
+teardown
+{
+	DROP TABLE logical_replicate_placement;
+	DROP TABLE selected_shard;
+}
+
+session "s1"
+
+step "s1-begin"
+{
+	BEGIN;
+}
+
+step "s1-move-placement"
+{
+	SELECT master_move_shard_placement((SELECT * FROM selected_shard), 'localhost', 57637, 'localhost', 57638, 'force_logical');
+}
+
+step "s1-end"
+{
+	COMMIT;
+}
+
+step "s1-select"
+{
+	SELECT * FROM logical_replicate_placement ORDER BY x;
+}
+
+step "s1-get-shard-distribution"
+{
+	SELECT nodeport FROM pg_dist_placement INNER JOIN pg_dist_node ON (pg_dist_placement.groupid = pg_dist_node.groupid) WHERE shardid IN (SELECT * FROM selected_shard);
+}
+
+session "s2"
+
+step "s2-begin"
+{
+	BEGIN;
+}
+
+# the move blocks writes only after the initial copy and the first catch up,
+# at which point it waits for this lock while writes keep going to the source
+step "s2-lock-shard-metadata"
+{
+	SELECT lock_shard_metadata(5, ARRAY[(SELECT * FROM selected_shard)]);
+}
+
+# 7 falls into the same shard as 5 and 15
+step "s2-insert"
+{
+	INSERT INTO logical_replicate_placement VALUES (7, 70);
+}
+
+step "s2-update"
+{
+	UPDATE logical_replicate_placement SET y = y + 1 WHERE x = 5;
+}
+
+step "s2-delete"
+{
+	DELETE FROM logical_replicate_placement WHERE x = 15;
+}
+
+step "s2-end"
+{
+	COMMIT;
+}
+
+# writes during the move are replicated to the new placement
+permutation "s2-begin" "s2-lock-shard-metadata" "s1-move-placement" "s2-insert" "s2-update" "s2-delete" "s2-end" "s1-select" "s1-get-shard-distribution"
+
+# writes after the final catch up wait for the move to commit
+permutation "s1-begin" "s1-move-placement" "s2-insert" "s1-end" "s1-select" "s1-get-shard-distribution"
+permutation "s1-begin" "s1-move-placement" "s2-update" "s1-end" "s1-select" "s1-get-shard-distribution"
+permutation "s1-begin" "s1-move-placement" "s2-delete" "s1-end" "s1-select" "s1-get-shard-distribution"
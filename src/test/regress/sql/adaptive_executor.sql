@@ -34,4 +34,10 @@ SELECT sum(result::bigint) FROM run_command_on_workers($$
 $$);
 END;
 
+-- send multiple modify tasks in a single command over a connection
+SET citus.executor_task_batch_size TO 4;
+UPDATE test SET y = y + 1;
+SELECT * FROM test ORDER BY x;
+RESET citus.executor_task_batch_size;
+
 DROP SCHEMA adaptive_executor CASCADE;
@@ -133,6 +133,19 @@ select create_distributed_function('array_collect_sort(int)');
 
 select array_collect_sort(val) from aggdata;
 
+-- test aggregate with an internal stype that is shipped through its serialfunc
+create aggregate sum_internal(numeric) (
+	sfunc = numeric_avg_accum,
+	stype = internal,
+	finalfunc = numeric_sum,
+	combinefunc = numeric_avg_combine,
+	serialfunc = numeric_avg_serialize,
+	deserialfunc = numeric_avg_deserialize
+);
+select create_distributed_function('sum_internal(numeric)');
+
+select key, sum_internal(val::numeric) from aggdata group by key order by key;
+
 -- Test multiuser scenario
 create user notsuper;
 select run_command_on_workers($$create user notsuper$$);
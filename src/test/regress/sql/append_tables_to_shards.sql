@@ -0,0 +1,70 @@
+--
+-- Test master_append_tables_to_shards, which appends several staging tables
+-- to append distributed shards in one call
+--
+CREATE SCHEMA append_tables;
+SET search_path TO append_tables;
+SET citus.next_shard_id TO 4239581;
+SET citus.shard_replication_factor TO 2;
+SET citus.shard_max_size TO '256kB';
+CREATE TABLE events (event_id int, payload text);
+SELECT create_distributed_table('events', 'event_id', 'append');
+SELECT master_create_empty_shard('events') AS shard_1 \gset
+SELECT master_create_empty_shard('events') AS shard_2 \gset
+
+-- staging tables on the coordinator
+CREATE TABLE stage_1 (LIKE events);
+CREATE TABLE stage_2 (LIKE events);
+CREATE TABLE stage_3 (LIKE events);
+CREATE TABLE stage_4 (LIKE events);
+INSERT INTO stage_1 SELECT i, 'a' FROM generate_series(1, 10) i;
+INSERT INTO stage_2 SELECT i, 'b' FROM generate_series(11, 20) i;
+INSERT INTO stage_3 SELECT i, 'c' FROM generate_series(21, 30) i;
+INSERT INTO stage_4 VALUES (15, 'd'), (50, 'd');
+
+-- a shard can appear several times to append several tables to it
+SELECT master_append_tables_to_shards(ARRAY[:shard_1, :shard_2, :shard_1]::bigint[],
+                                      ARRAY['append_tables.stage_1', 'append_tables.stage_2', 'append_tables.stage_3'],
+                                      'localhost', :master_port);
+
+-- the shard ranges are merged from the ranges of the staging tables
+SELECT shardid = :shard_1 AS first_shard, shardminvalue, shardmaxvalue
+FROM pg_dist_shard WHERE logicalrelid = 'events'::regclass ORDER BY shardid;
+SELECT shardid = :shard_1 AS first_shard, count(*), min(shardlength), max(shardlength)
+FROM pg_dist_shard_placement JOIN pg_dist_shard USING (shardid)
+WHERE logicalrelid = 'events'::regclass AND shardstate = 1
+GROUP BY shardid ORDER BY shardid;
+SELECT count(*), min(event_id), max(event_id) FROM events;
+SELECT payload FROM events WHERE event_id = 25;
+
+-- the range of a shard with data is widened to cover the new rows
+SELECT master_append_tables_to_shards(ARRAY[:shard_2]::bigint[], ARRAY['append_tables.stage_4'],
+                                      'localhost', :master_port);
+SELECT shardid = :shard_1 AS first_shard, shardminvalue, shardmaxvalue
+FROM pg_dist_shard WHERE logicalrelid = 'events'::regclass ORDER BY shardid;
+SELECT count(*), min(event_id), max(event_id) FROM events;
+
+-- a rolled back append does not change the shards
+BEGIN;
+SELECT master_append_tables_to_shards(ARRAY[:shard_1]::bigint[], ARRAY['append_tables.stage_4'],
+                                      'localhost', :master_port);
+ROLLBACK;
+SELECT shardid = :shard_1 AS first_shard, shardminvalue, shardmaxvalue
+FROM pg_dist_shard WHERE logicalrelid = 'events'::regclass ORDER BY shardid;
+SELECT count(*) FROM events;
+
+-- every shard needs a source table
+SELECT master_append_tables_to_shards(ARRAY[:shard_1, :shard_2]::bigint[], ARRAY['append_tables.stage_4'],
+                                      'localhost', :master_port);
+
+-- shards of hash distributed tables cannot be appended to
+SET citus.shard_count TO 1;
+CREATE TABLE hash_events (LIKE events);
+SELECT create_distributed_table('hash_events', 'event_id');
+SELECT master_append_tables_to_shards(ARRAY[:shard_1, 4239583]::bigint[],
+                                      ARRAY['append_tables.stage_4', 'append_tables.stage_4'],
+                                      'localhost', :master_port);
+SELECT count(*) FROM events;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA append_tables CASCADE;
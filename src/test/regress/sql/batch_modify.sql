@@ -0,0 +1,68 @@
+--
+-- Test citus_batch_modify, which runs an UPDATE or DELETE on each shard in
+-- batches of distribution column ranges
+--
+CREATE SCHEMA batch_modify;
+SET search_path TO batch_modify;
+SET citus.next_shard_id TO 4237581;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+CREATE TABLE events (id int, created date, value int);
+SELECT create_distributed_table('events', 'id');
+INSERT INTO events SELECT i, '2020-01-01'::date + i, i FROM generate_series(1, 100) i;
+
+-- the batches of all shards delete the rows that match the query
+SELECT citus_batch_modify($$DELETE FROM events WHERE created <= '2020-02-20'$$, 10);
+SELECT count(*), min(id) FROM events;
+
+-- rows that share the distribution column value at the end of a batch are modified together
+INSERT INTO events VALUES (60, '2020-01-01', 0), (60, '2020-01-01', 0);
+SELECT citus_batch_modify('UPDATE events SET value = value + 1', 1);
+SELECT count(*), sum(value) FROM events;
+SELECT value FROM events WHERE id = 60 ORDER BY value;
+
+-- stable functions are evaluated once for all batches
+SELECT citus_batch_modify('DELETE FROM events WHERE created < current_date', 5);
+SELECT count(*) FROM events;
+
+SET citus.shard_count TO 1;
+CREATE TABLE single_shard (id int, value int);
+SELECT create_distributed_table('single_shard', 'id', colocate_with := 'none');
+INSERT INTO single_shard SELECT i, i FROM generate_series(1, 20) i;
+
+-- every batch commits on its own, so the rows have one xmin per batch
+SELECT citus_batch_modify('UPDATE single_shard SET value = value + 1', 5);
+SELECT result FROM run_command_on_placements('single_shard', 'SELECT count(DISTINCT xmin::text) FROM %s');
+
+-- without commit_each_batch, all batches are part of the current transaction
+SELECT citus_batch_modify('UPDATE single_shard SET value = value + 1', 5, commit_each_batch := false);
+SELECT result FROM run_command_on_placements('single_shard', 'SELECT count(DISTINCT xmin::text) FROM %s');
+BEGIN;
+SELECT citus_batch_modify('DELETE FROM single_shard WHERE id > 10', 3, false);
+SELECT count(*) FROM single_shard;
+ROLLBACK;
+SELECT count(*), sum(value) FROM single_shard;
+
+-- committing each batch is not possible in a transaction block
+BEGIN;
+SELECT citus_batch_modify('DELETE FROM single_shard');
+ROLLBACK;
+
+-- invalid arguments
+SELECT citus_batch_modify('DELETE FROM single_shard', 0);
+SELECT citus_batch_modify('DELETE FROM single_shard', 10, true, -1);
+SELECT citus_batch_modify('SELECT 1');
+
+-- unsupported modifications
+CREATE TABLE reference_table (id int);
+SELECT create_reference_table('reference_table');
+SELECT citus_batch_modify('DELETE FROM reference_table');
+SELECT citus_batch_modify('DELETE FROM single_shard USING reference_table r WHERE single_shard.id = r.id');
+SELECT citus_batch_modify('DELETE FROM single_shard WHERE id IN (SELECT id FROM reference_table)');
+SELECT citus_batch_modify('DELETE FROM single_shard RETURNING id');
+SELECT citus_batch_modify('DELETE FROM single_shard WHERE value > random()');
+SELECT citus_batch_modify('UPDATE single_shard SET id = id + 1');
+SELECT count(*), sum(value) FROM single_shard;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA batch_modify CASCADE;
@@ -0,0 +1,46 @@
+--
+-- Test citus_query_stats(), which records the calls and the execution time of
+-- distributed queries per executor and partition key
+--
+CREATE SCHEMA query_stats;
+SET search_path TO query_stats;
+SET citus.next_shard_id TO 4243581;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+CREATE TABLE stats_test (key int, value int);
+SELECT create_distributed_table('stats_test', 'key');
+INSERT INTO stats_test SELECT i, i FROM generate_series(1, 10) i;
+SELECT citus_stat_statements_reset();
+
+-- nothing is recorded unless tracking is enabled
+SELECT count(*) FROM stats_test WHERE key = 1;
+SELECT count(*) FROM citus_query_stats();
+
+SET citus.stat_statements_track TO 'all';
+SELECT count(*) FROM stats_test WHERE key = 1;
+SELECT count(*) FROM stats_test WHERE key = 2;
+SELECT count(*) FROM stats_test WHERE key = 2;
+SELECT count(*) FROM stats_test;
+SELECT count(*) FROM stats_test;
+SELECT count(*) FROM stats_test;
+RESET citus.stat_statements_track;
+SELECT count(*) FROM stats_test;
+
+-- calls are recorded per query, executor and partition key
+SELECT query, executor, partition_key, calls, total_time >= 0 AS has_time
+FROM citus_stat_statements ORDER BY query, partition_key;
+
+-- partition keys of other users' queries are hidden
+CREATE USER query_stats_user;
+SET ROLE query_stats_user;
+SELECT partition_key, calls FROM citus_query_stats() ORDER BY calls;
+
+-- only superusers can enable tracking
+SET citus.stat_statements_track TO 'all';
+RESET ROLE;
+SELECT citus_stat_statements_reset();
+SELECT count(*) FROM citus_query_stats();
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA query_stats CASCADE;
+DROP USER query_stats_user;
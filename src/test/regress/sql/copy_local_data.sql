@@ -0,0 +1,67 @@
+--
+-- COPY_LOCAL_DATA
+--
+-- Tests that rows of fixed-width types survive the binary format that is used
+-- to copy them to the shards, and that the existing local data of a table is
+-- copied in create_distributed_table, also by parallel workers.
+CREATE SCHEMA copy_local_data;
+SET search_path TO copy_local_data;
+SET citus.next_shard_id TO 4219581;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+CREATE TABLE copy_types_local (key int, b bool, i2 int2, i4 int4, i8 int8, f4 float4, f8 float8, d date, ts timestamp, tstz timestamptz);
+INSERT INTO copy_types_local VALUES
+  (1, true, -32768, -2147483648, -9223372036854775808, 'NaN', 'NaN', '-infinity', '-infinity', '-infinity'),
+  (2, false, 32767, 2147483647, 9223372036854775807, '-0', '-0', 'infinity', 'infinity', 'infinity'),
+  (3, NULL, 0, 0, 0, 'Infinity', '-Infinity', '2000-01-01', '2000-01-01 00:00:00', '2000-01-01 00:00:00+00'),
+  (4, true, -1, -1, -1, '-Infinity', 'Infinity', '1999-12-31', '1999-12-31 23:59:59.999999', '1999-12-31 23:59:59.999999+00'),
+  (5, false, 1, 1, 1, 1.5, 3.141592653589793, '4713-01-01 BC', '1970-01-01 00:00:00.000001', '2038-01-19 03:14:08.123456+00'),
+  (6, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+SELECT string_agg(t::text, ' ' ORDER BY key) AS local_rows FROM copy_types_local t \gset
+-- the local data is sent to the shards in binary format
+CREATE TABLE copy_types (LIKE copy_types_local);
+INSERT INTO copy_types SELECT * FROM copy_types_local;
+SELECT create_distributed_table('copy_types', 'key');
+SELECT key, f4, f8, d, ts, tstz FROM copy_types WHERE key <= 2 ORDER BY key;
+SELECT key, f4, f8 FROM copy_types WHERE key <= 4 ORDER BY key;
+SELECT string_agg(t::text, ' ' ORDER BY key) = :'local_rows' FROM copy_types t;
+-- COPY sends the rows it parses in binary format as well
+CREATE TABLE copy_types_copy (LIKE copy_types_local);
+SELECT create_distributed_table('copy_types_copy', 'key');
+\COPY copy_types_copy FROM STDIN
+1	t	-32768	-2147483648	-9223372036854775808	NaN	NaN	-infinity	-infinity	-infinity
+2	f	32767	2147483647	9223372036854775807	-0	-0	infinity	infinity	infinity
+3	\N	0	0	0	Infinity	-Infinity	2000-01-01	2000-01-01 00:00:00	2000-01-01 00:00:00+00
+4	t	-1	-1	-1	-Infinity	Infinity	1999-12-31	1999-12-31 23:59:59.999999	1999-12-31 23:59:59.999999+00
+5	f	1	1	1	1.5	3.141592653589793	4713-01-01 BC	1970-01-01 00:00:00.000001	2038-01-19 03:14:08.123456+00
+6	\N	\N	\N	\N	\N	\N	\N	\N	\N
+\.
+SELECT key, f4, f8 FROM copy_types_copy WHERE key <= 4 ORDER BY key;
+SELECT string_agg(t::text, ' ' ORDER BY key) = :'local_rows' FROM copy_types_copy t;
+-- parallel workers scan the local data and the coordinator sends their rows
+CREATE TABLE copy_parallel (LIKE copy_types_local);
+INSERT INTO copy_parallel
+  SELECT s, s % 2 = 0, s % 1000, s, s * 1000000000::bigint, s / 7.0, s / 3.0,
+         '2000-01-01'::date + s, '2000-01-01'::timestamp + s * interval '1 second',
+         '2000-01-01 00:00:00+00'::timestamptz + s * interval '1 minute'
+  FROM generate_series(7, 10000) s;
+INSERT INTO copy_parallel SELECT * FROM copy_types_local;
+SELECT string_agg(t::text, ' ' ORDER BY key) AS parallel_rows FROM copy_parallel t \gset
+SET citus.max_parallel_copy_workers TO 2;
+SET client_min_messages TO DEBUG1;
+SELECT create_distributed_table('copy_parallel', 'key');
+RESET client_min_messages;
+SELECT count(*) FROM copy_parallel;
+SELECT string_agg(t::text, ' ' ORDER BY key) = :'parallel_rows' FROM copy_parallel t;
+-- reference tables have no distribution column
+CREATE TABLE copy_parallel_reference (LIKE copy_types_local);
+INSERT INTO copy_parallel_reference SELECT * FROM copy_types_local;
+SELECT create_reference_table('copy_parallel_reference');
+SELECT string_agg(t::text, ' ' ORDER BY key) = :'local_rows' FROM copy_parallel_reference t;
+-- an empty table needs no copy
+CREATE TABLE copy_parallel_empty (LIKE copy_types_local);
+SELECT create_distributed_table('copy_parallel_empty', 'key');
+SELECT count(*) FROM copy_parallel_empty;
+RESET citus.max_parallel_copy_workers;
+SET client_min_messages TO WARNING;
+DROP SCHEMA copy_local_data CASCADE;
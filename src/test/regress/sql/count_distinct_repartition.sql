@@ -0,0 +1,44 @@
+-- tests for counting distinct values after repartitioning them among the workers
+CREATE SCHEMA count_distinct_repartition;
+SET search_path TO 'count_distinct_repartition';
+SET citus.next_shard_id TO 4215581;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+
+CREATE TABLE events (user_id int, event_type int, payload text);
+SELECT create_distributed_table('events', 'user_id');
+INSERT INTO events SELECT s, s % 7, 'payload ' || (s % 13) FROM generate_series(1, 100) s;
+INSERT INTO events SELECT s, NULL, NULL FROM generate_series(1, 10) s;
+
+-- the distinct values are counted on the master without the setting
+SELECT count(DISTINCT event_type) FROM events;
+SET citus.enable_repartitioned_count_distinct TO on;
+SET client_min_messages TO DEBUG1;
+SELECT count(DISTINCT event_type) FROM events;
+SELECT count(DISTINCT payload) FROM events WHERE user_id > 50;
+-- expressions over several columns make the workers return all columns
+SELECT count(DISTINCT event_type + user_id % 3) AS total FROM events;
+-- a filter that matches no rows
+SELECT count(DISTINCT event_type) FROM events WHERE user_id < 0;
+-- queries that return more than the count are not repartitioned
+SELECT count(DISTINCT event_type), count(*) FROM events;
+RESET client_min_messages;
+-- prepared statements
+PREPARE count_event_types AS SELECT count(DISTINCT event_type) FROM events;
+EXECUTE count_event_types;
+EXECUTE count_event_types;
+EXECUTE count_event_types;
+EXECUTE count_event_types;
+EXECUTE count_event_types;
+EXECUTE count_event_types;
+DEALLOCATE count_event_types;
+-- repartitioned counts in a transaction block
+BEGIN;
+INSERT INTO events VALUES (1, 100, 'new payload');
+SELECT count(DISTINCT event_type) FROM events;
+SELECT count(DISTINCT payload) FROM events;
+ROLLBACK;
+
+RESET citus.enable_repartitioned_count_distinct;
+SET client_min_messages TO WARNING;
+DROP SCHEMA count_distinct_repartition CASCADE;
@@ -0,0 +1,54 @@
+--
+-- Test create_distributed_partitions, which creates the partitions of a
+-- distributed partitioned table and their shards in batches
+--
+CREATE SCHEMA distributed_partitions;
+SET search_path TO distributed_partitions;
+SET citus.next_shard_id TO 4241581;
+SET citus.shard_count TO 2;
+SET citus.shard_replication_factor TO 1;
+CREATE TABLE events (tenant_id int, event_time date, value int) PARTITION BY RANGE (event_time);
+SELECT create_distributed_table('events', 'tenant_id');
+SELECT create_distributed_partitions('events',
+                                     ARRAY['events_2020_01', 'events_2020_02', 'events_2020_03'],
+                                     ARRAY[$$FROM ('2020-01-01') TO ('2020-02-01')$$,
+                                           $$FROM ('2020-02-01') TO ('2020-03-01')$$,
+                                           $$FROM ('2020-03-01') TO ('2020-04-01')$$]);
+
+-- the partitions are distributed and co-located with the parent
+SELECT logicalrelid, count(*) FROM pg_dist_shard
+WHERE logicalrelid::text LIKE 'events%' GROUP BY logicalrelid ORDER BY logicalrelid;
+SELECT count(DISTINCT colocationid) FROM pg_dist_partition WHERE logicalrelid::text LIKE 'events%';
+
+-- the shards of the partitions are attached to the shards of the parent
+SELECT nodeport, result FROM run_command_on_workers($$
+  SELECT count(*) FROM pg_inherits JOIN pg_class ON (pg_class.oid = inhparent)
+  WHERE relname LIKE 'events_424158_'
+$$) ORDER BY nodeport;
+INSERT INTO events VALUES (1, '2020-01-15', 1), (2, '2020-02-15', 2), (3, '2020-03-15', 3), (4, '2020-03-20', 4);
+SELECT count(*) FROM events;
+SELECT tenant_id FROM events_2020_03 ORDER BY tenant_id;
+
+-- the partitions are created in a single transaction
+SELECT create_distributed_partitions('events',
+                                     ARRAY['events_2020_04', 'events_2020_01'],
+                                     ARRAY[$$FROM ('2020-04-01') TO ('2020-05-01')$$,
+                                           $$FROM ('2020-05-01') TO ('2020-06-01')$$]);
+SELECT count(*) FROM pg_class WHERE relname = 'events_2020_04';
+SELECT logicalrelid, count(*) FROM pg_dist_shard
+WHERE logicalrelid::text LIKE 'events%' GROUP BY logicalrelid ORDER BY logicalrelid;
+
+-- every partition needs bounds
+SELECT create_distributed_partitions('events', ARRAY['events_2020_04'], ARRAY[]::text[]);
+
+-- only partitioned tables that are distributed are supported
+CREATE TABLE plain_events (tenant_id int, event_time date);
+SELECT create_distributed_table('plain_events', 'tenant_id');
+SELECT create_distributed_partitions('plain_events', ARRAY['plain_events_2020_01'],
+                                     ARRAY[$$FROM ('2020-01-01') TO ('2020-02-01')$$]);
+CREATE TABLE local_events (tenant_id int, event_time date) PARTITION BY RANGE (event_time);
+SELECT create_distributed_partitions('local_events', ARRAY['local_events_2020_01'],
+                                     ARRAY[$$FROM ('2020-01-01') TO ('2020-02-01')$$]);
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA distributed_partitions CASCADE;
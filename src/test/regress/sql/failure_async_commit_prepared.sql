@@ -0,0 +1,66 @@
+--
+-- Test citus.async_commit_prepared, which makes 2PC commands return without
+-- waiting for COMMIT PREPARED on the workers
+--
+CREATE SCHEMA async_commit_prepared;
+SET search_path TO 'async_commit_prepared';
+SET citus.next_shard_id TO 4235581;
+SET citus.shard_count TO 2;
+SET citus.shard_replication_factor TO 1;
+SET citus.multi_shard_commit_protocol TO '2pc';
+
+-- disable automatic recovery, such that we can observe the recovery records
+ALTER SYSTEM SET citus.recover_2pc_interval TO -1;
+SELECT pg_reload_conf();
+
+SELECT citus.mitmproxy('conn.allow()');
+
+CREATE TABLE async_test (key int, value int);
+SELECT create_distributed_table('async_test', 'key');
+INSERT INTO async_test SELECT i, i FROM generate_series(1, 20) i;
+
+-- start without any recovery records
+SELECT recover_prepared_transactions();
+
+-- the prepared transactions on both workers are logged together
+UPDATE async_test SET value = value + 1;
+SELECT count(*) FROM pg_dist_transaction;
+SELECT recover_prepared_transactions();
+SELECT count(*) FROM pg_dist_transaction;
+
+-- commands that reuse a connection see the commit of the prepared transaction
+SET citus.async_commit_prepared TO on;
+UPDATE async_test SET value = value + 1;
+SELECT sum(value) FROM async_test;
+BEGIN;
+UPDATE async_test SET value = value + 1;
+COMMIT;
+UPDATE async_test SET value = value + 1 WHERE key = 1;
+SELECT sum(value) FROM async_test;
+SELECT value FROM async_test WHERE key = 1;
+
+-- all prepared transactions were committed, so there is nothing to recover
+SELECT recover_prepared_transactions();
+SELECT count(*) FROM pg_dist_transaction;
+
+-- a failed COMMIT PREPARED does not fail the command
+SELECT citus.mitmproxy('conn.onQuery(query="^COMMIT PREPARED").kill()');
+UPDATE async_test SET value = value + 1;
+SELECT citus.mitmproxy('conn.allow()');
+
+-- the failure is reported when the connection is reused, and recovery commits
+-- the prepared transaction that was left behind
+SELECT recover_prepared_transactions();
+SELECT count(*) FROM pg_dist_transaction;
+SELECT sum(value) FROM async_test;
+
+-- without the setting, commands wait for COMMIT PREPARED again
+RESET citus.async_commit_prepared;
+UPDATE async_test SET value = value + 1;
+SELECT sum(value) FROM async_test;
+
+ALTER SYSTEM RESET citus.recover_2pc_interval;
+SELECT pg_reload_conf();
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA async_commit_prepared CASCADE;
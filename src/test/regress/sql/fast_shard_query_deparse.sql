@@ -0,0 +1,100 @@
+--
+-- FAST_SHARD_QUERY_DEPARSE
+--
+-- Tests that citus.enable_fast_shard_query_deparse sends the same shard
+-- queries as deparse_shard_query(). Each INSERT runs once with the setting
+-- off and once with it on, and a trigger on the shard logs the query string
+-- that the worker receives.
+CREATE SCHEMA fast_deparse;
+SET search_path TO fast_deparse;
+SET citus.next_shard_id TO 4223581;
+SET citus.shard_count TO 1;
+SET citus.shard_replication_factor TO 1;
+CREATE TABLE items (
+    id int DEFAULT 1,
+    quantity int,
+    amount numeric,
+    price numeric(10,2),
+    label text,
+    source text
+);
+SELECT create_distributed_table('items', 'id');
+-- reference tables have no distribution column that needs a value
+CREATE TABLE tags (label text);
+SELECT create_reference_table('tags');
+-- a stable function makes the coordinator evaluate all values to constants
+CREATE FUNCTION stable_source() RETURNS text LANGUAGE sql STABLE AS $$SELECT 'stable'::text$$;
+\c - - - :worker_1_port
+CREATE TABLE fast_deparse_log (id serial, query text);
+CREATE FUNCTION log_shard_query() RETURNS trigger LANGUAGE plpgsql AS $$
+BEGIN
+    INSERT INTO public.fast_deparse_log (query) VALUES (current_query());
+    RETURN NULL;
+END;
+$$;
+CREATE TRIGGER log_shard_query AFTER INSERT ON fast_deparse.items_4223581
+FOR EACH ROW EXECUTE PROCEDURE log_shard_query();
+CREATE TRIGGER log_shard_query AFTER INSERT ON fast_deparse.tags_4223582
+FOR EACH ROW EXECUTE PROCEDURE log_shard_query();
+\c - - - :master_port
+SET search_path TO fast_deparse;
+-- negative int4 and numeric constants
+SET citus.enable_fast_shard_query_deparse TO off;
+INSERT INTO items (id, quantity, amount) VALUES (1, -5, -1.5);
+SET citus.enable_fast_shard_query_deparse TO on;
+INSERT INTO items (id, quantity, amount) VALUES (1, -5, -1.5);
+-- evaluated numerics, with and without a typmod
+SET citus.enable_fast_shard_query_deparse TO off;
+INSERT INTO items (id, amount, price, source) VALUES (2, 10, 2.5, stable_source());
+SET citus.enable_fast_shard_query_deparse TO on;
+INSERT INTO items (id, amount, price, source) VALUES (2, 10, 2.5, stable_source());
+-- NULL constants
+SET citus.enable_fast_shard_query_deparse TO off;
+INSERT INTO items VALUES (3, NULL, NULL, NULL, NULL, stable_source());
+SET citus.enable_fast_shard_query_deparse TO on;
+INSERT INTO items VALUES (3, NULL, NULL, NULL, NULL, stable_source());
+-- quotes and backslashes in text
+SET citus.enable_fast_shard_query_deparse TO off;
+INSERT INTO items (id, label) VALUES (4, 'it''s a \ test');
+SET citus.enable_fast_shard_query_deparse TO on;
+INSERT INTO items (id, label) VALUES (4, 'it''s a \ test');
+SET standard_conforming_strings TO off;
+SET citus.enable_fast_shard_query_deparse TO off;
+INSERT INTO items (id, label) VALUES (5, E'it''s a \\ test');
+SET citus.enable_fast_shard_query_deparse TO on;
+INSERT INTO items (id, label) VALUES (5, E'it''s a \\ test');
+RESET standard_conforming_strings;
+-- RETURNING with and without AS labels
+SET citus.enable_fast_shard_query_deparse TO off;
+INSERT INTO items (id, quantity) VALUES (6, 3)
+RETURNING id, quantity AS q, quantity * 2 AS doubled, quantity + 1;
+SET citus.enable_fast_shard_query_deparse TO on;
+INSERT INTO items (id, quantity) VALUES (6, 3)
+RETURNING id, quantity AS q, quantity * 2 AS doubled, quantity + 1;
+-- an aliased target relation
+SET citus.enable_fast_shard_query_deparse TO off;
+INSERT INTO items AS i (id, quantity) VALUES (7, 1) RETURNING i.quantity;
+SET citus.enable_fast_shard_query_deparse TO on;
+INSERT INTO items AS i (id, quantity) VALUES (7, 1) RETURNING i.quantity;
+-- DEFAULT VALUES
+SET citus.enable_fast_shard_query_deparse TO off;
+INSERT INTO items DEFAULT VALUES;
+SET citus.enable_fast_shard_query_deparse TO on;
+INSERT INTO items DEFAULT VALUES;
+SET citus.enable_fast_shard_query_deparse TO off;
+INSERT INTO tags DEFAULT VALUES;
+SET citus.enable_fast_shard_query_deparse TO on;
+INSERT INTO tags DEFAULT VALUES;
+RESET citus.enable_fast_shard_query_deparse;
+-- every query with the setting on equals the one before it with the setting off
+\c - - - :worker_1_port
+SELECT slow.query = fast.query AS same_query, slow.query
+FROM fast_deparse_log slow JOIN fast_deparse_log fast ON (fast.id = slow.id + 1)
+WHERE slow.id % 2 = 1 ORDER BY slow.id;
+DROP TABLE fast_deparse_log;
+\c - - - :master_port
+SET client_min_messages TO WARNING;
+DROP SCHEMA fast_deparse CASCADE;
+\c - - - :worker_1_port
+DROP FUNCTION log_shard_query();
+\c - - - :master_port
@@ -0,0 +1,71 @@
+-- tests for repartitioned INSERT ... SELECT and the UDFs it uses
+CREATE SCHEMA insert_select_repartition;
+SET search_path TO 'insert_select_repartition';
+SET citus.next_shard_id TO 4213581;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+
+-- worker_partition_query_result writes one intermediate result per hash range
+BEGIN;
+SELECT * FROM worker_partition_query_result('squares_part',
+                                            'SELECT s, s*s FROM generate_series(1,10) s',
+                                            0, ARRAY[-2147483648, 0], ARRAY[-1, 2147483647])
+ORDER BY partition_index;
+SELECT * FROM read_intermediate_result('squares_part_0', 'binary') AS res (x int, x2 int) ORDER BY x;
+SELECT * FROM read_intermediate_result('squares_part_1', 'binary') AS res (x int, x2 int) ORDER BY x;
+-- partitions without rows are not returned
+SELECT * FROM worker_partition_query_result('single_part',
+                                            'SELECT s FROM generate_series(1,10) s',
+                                            0, ARRAY[-2147483648, -2147483647], ARRAY[-2147483648, 2147483647]);
+-- partition hash ranges must be sorted
+SELECT * FROM worker_partition_query_result('bad_part',
+                                            'SELECT s FROM generate_series(1,10) s',
+                                            0, ARRAY[0, -2147483648], ARRAY[2147483647, -1]);
+ROLLBACK;
+
+-- fetch_intermediate_results copies results from another node
+SELECT fetch_intermediate_results(ARRAY['squares'], 'localhost', :worker_1_port);
+BEGIN;
+SELECT broadcast_intermediate_result('squares', 'SELECT s, s*s FROM generate_series(1,5) s');
+SELECT fetch_intermediate_results(ARRAY['squares'], 'localhost', :worker_1_port) > 0;
+SELECT * FROM read_intermediate_result('squares', 'binary') AS res (x int, x2 int) ORDER BY x;
+END;
+
+CREATE TABLE source_table (a int, b int);
+SELECT create_distributed_table('source_table', 'a');
+INSERT INTO source_table SELECT s, s * 10 FROM generate_series(1, 10) s;
+CREATE TABLE target_table (a int, b int);
+SELECT create_distributed_table('target_table', 'a');
+
+-- the SELECT does not return the partition column of the target table, so its
+-- results are repartitioned by the target shards on the workers
+SET citus.enable_repartitioned_insert_select TO on;
+SET client_min_messages TO DEBUG1;
+INSERT INTO target_table SELECT b, a FROM source_table;
+RESET client_min_messages;
+SELECT * FROM target_table ORDER BY a;
+SELECT shardid, result FROM run_command_on_placements('target_table', 'SELECT count(*) FROM %s')
+ORDER BY shardid;
+
+-- the rows are fetched to all placements of replicated target shards
+SET citus.shard_replication_factor TO 2;
+CREATE TABLE replicated_target (a int, b int);
+SELECT create_distributed_table('replicated_target', 'a');
+BEGIN;
+INSERT INTO replicated_target SELECT b, a FROM source_table;
+SELECT count(*), sum(a), sum(b) FROM replicated_target;
+COMMIT;
+SELECT shardid, nodeport, result FROM run_command_on_placements('replicated_target', 'SELECT count(*) FROM %s')
+ORDER BY shardid, nodeport;
+
+-- prepared statements without parameters are repartitioned as well
+TRUNCATE target_table;
+PREPARE insert_swapped AS INSERT INTO target_table SELECT b, a FROM source_table WHERE a > 5;
+EXECUTE insert_swapped;
+EXECUTE insert_swapped;
+SELECT a, count(*) FROM target_table GROUP BY a ORDER BY a;
+DEALLOCATE insert_swapped;
+
+RESET citus.enable_repartitioned_insert_select;
+SET client_min_messages TO WARNING;
+DROP SCHEMA insert_select_repartition CASCADE;
@@ -38,6 +38,46 @@ JOIN (SELECT * FROM read_intermediate_result('squares', 'binary') AS res (x int,
 ORDER BY x;
 END;
 
+-- columnar intermediate results are read regardless of the given format
+SET citus.enable_columnar_intermediate_results TO on;
+BEGIN;
+SELECT create_intermediate_result('squares', 'SELECT s, s*s, NULLIF(s, 3)::text FROM generate_series(1,5) s');
+SELECT * FROM read_intermediate_result('squares', 'binary') AS res (x int, x2 int, y text) ORDER BY x;
+SELECT * FROM read_intermediate_result('squares', 'text') AS res (x int, x2 int, y text) ORDER BY x;
+-- results larger than a single chunk
+SELECT create_intermediate_result('many', 'SELECT s FROM generate_series(1,25000) s');
+SELECT count(*), sum(s), min(s), max(s) FROM read_intermediate_result('many', 'binary') AS res (s int);
+-- put a columnar intermediate result on all workers
+SELECT broadcast_intermediate_result('squares', 'SELECT s, s*s FROM generate_series(1,5) s');
+SELECT x, x2
+FROM interesting_squares
+JOIN (SELECT * FROM read_intermediate_result('squares', 'binary') AS res (x int, x2 int)) squares ON (x::text = interested_in)
+ORDER BY x;
+-- column definition list does not match the result
+SELECT * FROM read_intermediate_result('squares', 'binary') AS res (x int);
+END;
+RESET citus.enable_columnar_intermediate_results;
+
+-- intermediate results can be compressed when broadcasting them
+SET citus.transmit_compression_threshold TO 0;
+BEGIN;
+SELECT broadcast_intermediate_result('squares', 'SELECT s, s*s FROM generate_series(1,1000) s');
+SELECT x, x2
+FROM interesting_squares
+JOIN (SELECT * FROM read_intermediate_result('squares', 'binary') AS res (x int, x2 int)) squares ON (x::text = interested_in)
+ORDER BY x;
+END;
+RESET citus.transmit_compression_threshold;
+
+-- intermediate results can be streamed rather than materialized
+SET citus.enable_streaming_intermediate_results TO on;
+BEGIN;
+SELECT create_intermediate_result('squares', 'SELECT s, s*s FROM generate_series(1,5) s');
+EXPLAIN (COSTS OFF) SELECT * FROM read_intermediate_result('squares', 'binary') AS res (x int, x2 int) WHERE x > 2;
+SELECT * FROM read_intermediate_result('squares', 'binary') AS res (x int, x2 int) WHERE x > 2 ORDER BY x;
+END;
+RESET citus.enable_streaming_intermediate_results;
+
 
 CREATE FUNCTION raise_failed_execution_int_result(query text) RETURNS void AS $$
 BEGIN
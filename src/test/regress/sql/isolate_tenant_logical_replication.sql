@@ -0,0 +1,65 @@
+--
+-- ISOLATE_TENANT_LOGICAL_REPLICATION
+--
+-- Tests isolating tenants using logical replication, which fills the new
+-- shards while writes continue and can place the shard of the tenant on
+-- another node.
+CREATE SCHEMA isolate_tenant_logical;
+SET search_path TO isolate_tenant_logical;
+SET citus.next_shard_id TO 4231581;
+SET citus.shard_count TO 2;
+SET citus.shard_replication_factor TO 1;
+CREATE TABLE tenants (id int PRIMARY KEY, name text);
+SELECT create_distributed_table('tenants', 'id', colocate_with := 'none');
+CREATE TABLE tenant_events (id int REFERENCES tenants (id), event_id int, PRIMARY KEY (id, event_id));
+SELECT create_distributed_table('tenant_events', 'id', colocate_with := 'tenants');
+INSERT INTO tenants SELECT s, 'tenant ' || s FROM generate_series(1, 100) s;
+INSERT INTO tenant_events SELECT s, e FROM generate_series(1, 100) s, generate_series(1, 3) e;
+-- router queries only find rows that are in the shard of their hash value
+CREATE FUNCTION rows_found_by_router_queries() RETURNS bigint LANGUAGE plpgsql AS $$
+DECLARE
+    found bigint := 0;
+    row_count bigint;
+BEGIN
+    FOR i IN 1..100 LOOP
+        SELECT count(*) INTO row_count FROM tenants JOIN tenant_events USING (id) WHERE tenants.id = i;
+        found := found + row_count;
+    END LOOP;
+    RETURN found;
+END;
+$$;
+-- the shard of tenant 5 is on worker 1, move the tenant to worker 2
+SELECT isolate_tenant_to_new_shard('tenants', 5, 'CASCADE', 'localhost', :worker_2_port, 'force_logical');
+SELECT shardid, shardminvalue, shardmaxvalue, nodeport
+FROM pg_dist_shard JOIN pg_dist_shard_placement USING (shardid)
+WHERE logicalrelid = 'tenants'::regclass ORDER BY shardminvalue::int;
+SELECT * FROM tenants JOIN tenant_events USING (id) WHERE id = 5 ORDER BY event_id;
+SELECT count(*) FROM tenants JOIN tenant_events USING (id);
+SELECT rows_found_by_router_queries();
+-- the old shards are dropped, and so are the stand-ins for the tenant shards on worker 1
+SELECT * FROM run_command_on_workers($$SELECT count(*) FROM pg_class WHERE relnamespace = 'isolate_tenant_logical'::regnamespace AND relkind = 'r'$$);
+SELECT * FROM run_command_on_workers($$SELECT count(*) FROM pg_constraint WHERE connamespace = 'isolate_tenant_logical'::regnamespace AND contype = 'f'$$);
+-- no replication objects are left behind
+SELECT * FROM run_command_on_workers($$SELECT (SELECT count(*) FROM pg_publication) + (SELECT count(*) FROM pg_subscription) + (SELECT count(*) FROM pg_replication_slots)$$);
+-- the new tenant shard accepts writes on worker 2
+INSERT INTO tenant_events VALUES (5, 4);
+SELECT count(*) FROM tenant_events WHERE id = 5;
+DELETE FROM tenant_events WHERE id = 5 AND event_id = 4;
+-- in auto mode, tables with a replica identity are split using logical replication
+SELECT isolate_tenant_to_new_shard('tenants', 8, 'CASCADE');
+SELECT shardid, shardminvalue, shardmaxvalue, nodeport
+FROM pg_dist_shard JOIN pg_dist_shard_placement USING (shardid)
+WHERE logicalrelid = 'tenants'::regclass ORDER BY shardminvalue::int;
+SELECT count(*) FROM tenants JOIN tenant_events USING (id);
+SELECT rows_found_by_router_queries();
+SELECT * FROM run_command_on_workers($$SELECT count(*) FROM pg_class WHERE relnamespace = 'isolate_tenant_logical'::regnamespace AND relkind = 'r'$$);
+SELECT * FROM run_command_on_workers($$SELECT count(*) FROM pg_constraint WHERE connamespace = 'isolate_tenant_logical'::regnamespace AND contype = 'f'$$);
+SELECT * FROM run_command_on_workers($$SELECT (SELECT count(*) FROM pg_publication) + (SELECT count(*) FROM pg_subscription) + (SELECT count(*) FROM pg_replication_slots)$$);
+SELECT isolate_tenant_to_new_shard('tenants', 10, 'CASCADE', 'localhost');
+SELECT isolate_tenant_to_new_shard('tenants', 10, 'CASCADE', 'localhost', 1);
+SELECT isolate_tenant_to_new_shard('tenants', 10, 'CASCADE', 'localhost', :worker_2_port, 'block_writes');
+CREATE TABLE no_identity (id int);
+SELECT create_distributed_table('no_identity', 'id', colocate_with := 'none');
+SELECT isolate_tenant_to_new_shard('no_identity', 10, shard_transfer_mode := 'force_logical');
+SET client_min_messages TO WARNING;
+DROP SCHEMA isolate_tenant_logical CASCADE;
@@ -65,6 +65,14 @@ SELECT * FROM master_run_on_worker(ARRAY[:node_name, :node_name]::text[],
 								   ARRAY['select a from generate_series(1,2) a',
 								   		 'select a from generate_series(1,2) a']::text[],
 								   false);
+-- commands that take too long are cancelled, others complete
+SET citus.run_command_timeout TO 200;
+SELECT * FROM master_run_on_worker(ARRAY[:node_name, :node_name]::text[],
+								   ARRAY[:node_port, :node_port]::int[],
+								   ARRAY['select pg_sleep(10)',
+								   		 'select a from generate_series(1,1) a']::text[],
+								   true);
+RESET citus.run_command_timeout;
 -- can create tables at worker
 SELECT * FROM master_run_on_worker(ARRAY[:node_name, :node_name]::text[],
 								   ARRAY[:node_port, :node_port]::int[],
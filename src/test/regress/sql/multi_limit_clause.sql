@@ -223,4 +223,58 @@ SELECT
 	LIMIT 5;
 
 SET client_min_messages TO NOTICE;
+-- multi-shard LIMIT without ORDER BY skips the remaining tasks once the
+-- coordinator received enough rows
+WITH some_lines AS (SELECT l_orderkey FROM lineitem_hash LIMIT 10)
+SELECT count(*) FROM some_lines;
+WITH some_lines AS (SELECT l_orderkey FROM lineitem_hash LIMIT 10 OFFSET 20)
+SELECT count(*) FROM some_lines;
+-- with streaming results, the sorted rows of the shards are merged
+SET citus.enable_streaming_results TO on;
+SET citus.enable_task_result_merge TO on;
+SELECT l_orderkey FROM lineitem ORDER BY l_orderkey ASC LIMIT 1;
+SELECT l_orderkey FROM lineitem ORDER BY l_orderkey DESC LIMIT 1;
+SELECT l_orderkey, l_linenumber, l_quantity FROM lineitem
+	ORDER BY l_orderkey DESC, l_linenumber DESC LIMIT 3;
+WITH some_lines AS (SELECT l_orderkey FROM lineitem_hash LIMIT 10)
+SELECT count(*) FROM some_lines;
+RESET citus.enable_streaming_results;
+-- merging also works when the execution does not stream
+BEGIN;
+SELECT l_orderkey, l_linenumber FROM lineitem
+	ORDER BY l_orderkey DESC, l_linenumber DESC LIMIT 3;
+END;
+RESET citus.enable_task_result_merge;
+-- once the coordinator received enough rows, the tasks that are still running
+-- are cancelled, so the slow shards do not hit the statement timeout
+CREATE FUNCTION limit_sleep_if(slow bool) RETURNS bool LANGUAGE plpgsql AS $body$
+BEGIN
+    IF slow THEN
+        PERFORM pg_sleep(30);
+    END IF;
+    RETURN true;
+END;
+$body$;
+SELECT * FROM run_command_on_workers($cmd$CREATE FUNCTION limit_sleep_if(slow bool) RETURNS bool LANGUAGE plpgsql AS $body$
+BEGIN
+    IF slow THEN
+        PERFORM pg_sleep(30);
+    END IF;
+    RETURN true;
+END;
+$body$$cmd$) ORDER BY nodeport;
+CREATE TABLE limit_stop (key int, slow bool);
+SELECT create_distributed_table('limit_stop', 'key');
+-- the rows of one shard come first and do not sleep, all other rows sleep
+INSERT INTO limit_stop SELECT 1, false FROM generate_series(1, 20);
+INSERT INTO limit_stop SELECT s, true FROM generate_series(2, 100) s;
+SET statement_timeout TO '5s';
+SELECT count(*) FROM (SELECT key FROM limit_stop WHERE limit_sleep_if(slow) LIMIT 10) s;
+SELECT count(*) FROM (SELECT key FROM limit_stop WHERE limit_sleep_if(slow) LIMIT 5 OFFSET 5) s;
+RESET statement_timeout;
+-- the connections of the cancelled tasks can be used again
+SELECT count(*) FROM limit_stop;
+DROP TABLE limit_stop;
+DROP FUNCTION limit_sleep_if(bool);
+SELECT * FROM run_command_on_workers($$DROP FUNCTION limit_sleep_if(bool)$$) ORDER BY nodeport;
 DROP TABLE lineitem_hash;
@@ -183,3 +183,28 @@ WHERE ut.user_id = et.user_id and et.value_2 < 5
 GROUP BY ut.user_id
 ORDER BY 2, AVG(ut.value_1), 1 DESC
 LIMIT 5;
+
+-- with group pushdown, the workers compute the final aggregates of each group
+SET citus.enable_group_pushdown TO on;
+SELECT user_id, avg(value_1)
+FROM users_table
+GROUP BY user_id
+ORDER BY avg(value_1) DESC
+LIMIT 5;
+
+EXPLAIN (COSTS OFF)
+SELECT user_id, avg(value_1)
+FROM users_table
+GROUP BY user_id
+ORDER BY avg(value_1) DESC
+LIMIT 1;
+RESET citus.enable_group_pushdown;
+
+-- the sorted rows of the tasks are merged instead of sorted on the coordinator
+SET citus.enable_task_result_merge TO on;
+EXPLAIN (COSTS OFF)
+SELECT user_id, value_1
+FROM users_table
+ORDER BY user_id DESC, value_1
+LIMIT 3;
+RESET citus.enable_task_result_merge;
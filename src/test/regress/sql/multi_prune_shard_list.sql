@@ -145,5 +145,31 @@ SELECT * FROM coerce_hash WHERE id = 1.0;
 
 SELECT * FROM coerce_hash WHERE id = 1.0::numeric;
 
+-- multi-shard queries deparse a template that is filled in with shard names,
+-- literals that look like the placeholders make the planner deparse per shard
+SELECT * FROM coerce_hash WHERE value LIKE 'test%';
+SELECT * FROM coerce_hash WHERE value <> 'citus_shard_name_placeholder_1';
+
+-- shards of hash distributed tables that are not uniformly distributed are
+-- found through a lookup table on the top bits of the hash token
+SET citus.shard_count TO 4;
+CREATE TABLE non_uniform_hash (id int);
+SELECT create_distributed_table('non_uniform_hash', 'id');
+RESET citus.shard_count;
+
+UPDATE pg_dist_shard SET shardminvalue = ranges.minvalue, shardmaxvalue = ranges.maxvalue
+FROM (SELECT shardid, row_number() OVER (ORDER BY shardid) AS shardindex
+	  FROM pg_dist_shard WHERE logicalrelid = 'non_uniform_hash'::regclass) shards
+	 JOIN (VALUES (1, '-2147483648', '-2000000000'), (2, '-1999999999', '5'),
+				  (3, '6', '6'), (4, '7', '2147483647')) ranges(shardindex, minvalue, maxvalue)
+	 USING (shardindex)
+WHERE pg_dist_shard.shardid = shards.shardid;
+
+SELECT count(*) AS value_count,
+	   count(*) FILTER (WHERE get_shard_id_for_distribution_column('non_uniform_hash', i) <> shards.shardid) AS misrouted_count
+FROM generate_series(-5000, 5000) i
+	 JOIN pg_dist_shard shards ON (logicalrelid = 'non_uniform_hash'::regclass AND
+		  worker_hash(i) BETWEEN shardminvalue::int AND shardmaxvalue::int);
+
 SET search_path TO public;
 DROP SCHEMA prune_shard_list CASCADE;
@@ -666,6 +666,20 @@ EXECUTE author_articles(1);
 EXECUTE author_articles(1);
 EXECUTE author_articles(1);
 
+-- once the generic plan is cached, the shard is picked based on the parameter
+PREPARE author_word_count(int) as
+	SELECT sum(word_count), count(*)
+	FROM articles_hash
+	WHERE author_id = $1;
+
+EXECUTE author_word_count(1);
+EXECUTE author_word_count(1);
+EXECUTE author_word_count(1);
+EXECUTE author_word_count(1);
+EXECUTE author_word_count(1);
+EXECUTE author_word_count(2);
+EXECUTE author_word_count(1);
+
 -- queries inside plpgsql functions could be router plannable
 CREATE OR REPLACE FUNCTION author_articles_max_id() RETURNS int AS $$
 DECLARE
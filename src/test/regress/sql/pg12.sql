@@ -21,7 +21,7 @@ CREATE ACCESS METHOD blackhole_am TYPE TABLE HANDLER blackhole_am_handler;
 
 create table test_am(id int, val int) using blackhole_am;
 insert into test_am values (1, 1);
--- Custom table access methods should be rejected
+-- Custom table access methods that are not created by an extension should be rejected
 select create_distributed_table('test_am','id');
 
 -- Test generated columns
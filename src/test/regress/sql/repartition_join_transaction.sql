@@ -0,0 +1,51 @@
+--
+-- REPARTITION_JOIN_TRANSACTION
+--
+-- Tests that cached repartition join plans built outside of a transaction
+-- block fall back to task-tracker when they are executed inside one.
+CREATE SCHEMA repartition_join_transaction;
+SET search_path TO repartition_join_transaction;
+SET citus.next_shard_id TO 4221581;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+SET citus.enable_repartition_joins TO on;
+CREATE TABLE left_table (a int, b int);
+SELECT create_distributed_table('left_table', 'a');
+CREATE TABLE right_table (a int, b int);
+SELECT create_distributed_table('right_table', 'a');
+CREATE TABLE events (a int, b int);
+SELECT create_distributed_table('events', 'a');
+INSERT INTO left_table SELECT s, s % 10 FROM generate_series(1, 100) s;
+INSERT INTO right_table SELECT s, s % 10 FROM generate_series(1, 10) s;
+INSERT INTO events SELECT s, s FROM generate_series(1, 10) s;
+-- the plan is built and cached outside of a transaction block
+PREPARE repartition_join AS
+SELECT count(*) FROM left_table l JOIN right_table r ON (l.b = r.b);
+EXECUTE repartition_join;
+EXECUTE repartition_join;
+-- the cached plan runs through task-tracker inside a transaction block
+BEGIN;
+SET LOCAL client_min_messages TO DEBUG1;
+EXECUTE repartition_join;
+COMMIT;
+-- and after a modification in the same transaction
+BEGIN;
+INSERT INTO events VALUES (11, 11);
+SET LOCAL client_min_messages TO DEBUG1;
+EXECUTE repartition_join;
+COMMIT;
+-- and after a modifying CTE in the same transaction
+BEGIN;
+WITH deleted AS (DELETE FROM events RETURNING *)
+SELECT count(*) FROM deleted;
+SET LOCAL client_min_messages TO DEBUG1;
+EXECUTE repartition_join;
+COMMIT;
+SELECT count(*) FROM events;
+-- outside of a transaction block the adaptive executor runs it again
+SET client_min_messages TO DEBUG1;
+EXECUTE repartition_join;
+RESET client_min_messages;
+DEALLOCATE repartition_join;
+SET client_min_messages TO WARNING;
+DROP SCHEMA repartition_join_transaction CASCADE;
@@ -0,0 +1,90 @@
+--
+-- ROUTER_PARAMETER_PASSING
+--
+-- Tests that citus.enable_router_parameter_passing keeps the parameters of
+-- generic router modification plans as $n in the shard queries. A trigger on
+-- the shard logs the query string that the worker receives. The first five
+-- executions of each prepared statement use custom plans, in which the
+-- parameters are constants, and the next ones use the generic plan.
+CREATE SCHEMA router_params;
+SET search_path TO router_params;
+SET citus.next_shard_id TO 4225581;
+SET citus.shard_count TO 1;
+SET citus.shard_replication_factor TO 1;
+CREATE TYPE status AS ENUM ('new', 'done');
+CREATE TABLE items (id int, quantity int, label text, state status);
+SELECT create_distributed_table('items', 'id');
+CREATE FUNCTION stable_label(text) RETURNS text LANGUAGE sql STABLE AS $$SELECT 'label ' || $1$$;
+\c - - - :worker_1_port
+CREATE TABLE router_params_log (id serial, query text);
+CREATE FUNCTION log_shard_query() RETURNS trigger LANGUAGE plpgsql AS $$
+BEGIN
+    INSERT INTO public.router_params_log (query) VALUES (current_query());
+    RETURN NULL;
+END;
+$$;
+CREATE TRIGGER log_shard_query AFTER INSERT OR UPDATE OR DELETE ON router_params.items_4225581
+FOR EACH STATEMENT EXECUTE PROCEDURE log_shard_query();
+\c - - - :master_port
+SET search_path TO router_params;
+SET citus.enable_router_parameter_passing TO on;
+-- with deferred pruning, only the distribution column is evaluated
+PREPARE insert_item(int, int) AS INSERT INTO items (id, quantity) VALUES ($1, $2);
+EXECUTE insert_item(1, 10);
+EXECUTE insert_item(1, 10);
+EXECUTE insert_item(1, 10);
+EXECUTE insert_item(1, 10);
+EXECUTE insert_item(1, 10);
+EXECUTE insert_item(1, 20);
+EXECUTE insert_item(1, 30);
+-- evaluated parameters are sent along although the query no longer uses them
+PREPARE insert_label(int, int, text) AS
+INSERT INTO items (id, quantity, label) VALUES ($1, $2, stable_label($3));
+EXECUTE insert_label(1, 10, 'a');
+EXECUTE insert_label(1, 10, 'a');
+EXECUTE insert_label(1, 10, 'a');
+EXECUTE insert_label(1, 10, 'a');
+EXECUTE insert_label(1, 10, 'a');
+EXECUTE insert_label(1, 20, 'a');
+EXECUTE insert_label(1, 30, 'a');
+-- parameters of custom types are still inlined
+PREPARE insert_state(int, int, status) AS
+INSERT INTO items (id, quantity, state) VALUES ($1, $2, $3);
+EXECUTE insert_state(1, 5, 'done');
+EXECUTE insert_state(1, 5, 'done');
+EXECUTE insert_state(1, 5, 'done');
+EXECUTE insert_state(1, 5, 'done');
+EXECUTE insert_state(1, 5, 'done');
+EXECUTE insert_state(1, 6, 'new');
+EXECUTE insert_state(1, 7, 'new');
+-- UPDATE and DELETE only evaluate the expressions with mutable functions
+PREPARE update_item(int, text) AS
+UPDATE items SET quantity = $1, label = stable_label($2) WHERE id = 1;
+EXECUTE update_item(7, 'b');
+EXECUTE update_item(7, 'b');
+EXECUTE update_item(7, 'b');
+EXECUTE update_item(7, 'b');
+EXECUTE update_item(7, 'b');
+EXECUTE update_item(8, 'b');
+EXECUTE update_item(9, 'b');
+SELECT quantity, label, count(*) FROM items GROUP BY 1, 2;
+PREPARE delete_item(int, text) AS
+DELETE FROM items WHERE id = 1 AND quantity = $1 AND label = stable_label($2);
+EXECUTE delete_item(0, 'c');
+EXECUTE delete_item(0, 'c');
+EXECUTE delete_item(0, 'c');
+EXECUTE delete_item(0, 'c');
+EXECUTE delete_item(0, 'c');
+EXECUTE delete_item(-1, 'c');
+EXECUTE delete_item(9, 'b');
+SELECT count(*) FROM items;
+RESET citus.enable_router_parameter_passing;
+\c - - - :worker_1_port
+SELECT count(*), query FROM router_params_log GROUP BY query ORDER BY min(id);
+DROP TABLE router_params_log;
+\c - - - :master_port
+SET client_min_messages TO WARNING;
+DROP SCHEMA router_params CASCADE;
+\c - - - :worker_1_port
+DROP FUNCTION log_shard_query();
+\c - - - :master_port
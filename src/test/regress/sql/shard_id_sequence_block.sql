@@ -0,0 +1,48 @@
+--
+-- Test handing out shard IDs from blocks of pg_dist_shardid_seq, which this
+-- backend reserves when the increment of the sequence is larger than 1
+--
+CREATE SCHEMA shard_id_block;
+SET search_path TO shard_id_block;
+SET citus.shard_count TO 6;
+SET citus.shard_replication_factor TO 1;
+SELECT last_value + 1 AS next_sequence_value FROM pg_catalog.pg_dist_shardid_seq \gset
+ALTER SEQUENCE pg_catalog.pg_dist_shardid_seq RESTART 4245581 INCREMENT BY 8;
+CREATE TABLE first_table (a int);
+SELECT create_distributed_table('first_table', 'a');
+SELECT shardid FROM pg_dist_shard WHERE logicalrelid = 'first_table'::regclass ORDER BY shardid;
+
+-- the IDs of a block are handed out without calling nextval again
+SELECT last_value FROM pg_catalog.pg_dist_shardid_seq;
+
+-- the first block ends at 4245588, and the next one starts at 4245589
+SET citus.shard_count TO 4;
+CREATE TABLE second_table (a int);
+SELECT create_distributed_table('second_table', 'a');
+SELECT shardid FROM pg_dist_shard WHERE logicalrelid = 'second_table'::regclass ORDER BY shardid;
+SELECT last_value FROM pg_catalog.pg_dist_shardid_seq;
+
+-- other callers of nextval skip the IDs reserved by this backend
+SELECT nextval('pg_catalog.pg_dist_shardid_seq');
+SELECT master_get_new_shardid();
+SELECT count(*), count(DISTINCT shardid), min(shardid), max(shardid) FROM pg_dist_shard
+WHERE logicalrelid IN ('first_table'::regclass, 'second_table'::regclass);
+
+-- a block does not extend beyond the maximum value of the sequence, and new
+-- backends start without a block
+ALTER SEQUENCE pg_catalog.pg_dist_shardid_seq RESTART 4245601 MAXVALUE 4245605;
+\c - - - :master_port
+SET search_path TO shard_id_block;
+SET citus.shard_count TO 5;
+SET citus.shard_replication_factor TO 1;
+CREATE TABLE third_table (a int);
+SELECT create_distributed_table('third_table', 'a');
+SELECT shardid FROM pg_dist_shard WHERE logicalrelid = 'third_table'::regclass ORDER BY shardid;
+SET citus.shard_count TO 1;
+CREATE TABLE fourth_table (a int);
+SELECT create_distributed_table('fourth_table', 'a');
+SELECT count(*) FROM pg_dist_shard WHERE logicalrelid = 'fourth_table'::regclass;
+
+ALTER SEQUENCE pg_catalog.pg_dist_shardid_seq INCREMENT BY 1 NO MAXVALUE RESTART :next_sequence_value;
+SET client_min_messages TO WARNING;
+DROP SCHEMA shard_id_block CASCADE;
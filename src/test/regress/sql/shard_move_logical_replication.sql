@@ -0,0 +1,70 @@
+--
+-- SHARD_MOVE_LOGICAL_REPLICATION
+--
+-- Tests moving shards using logical replication, which copies the shards
+-- while writes continue and only blocks writes for the final catch up.
+CREATE SCHEMA move_logical;
+SET search_path TO move_logical;
+SET citus.next_shard_id TO 4233581;
+SET citus.shard_count TO 2;
+SET citus.shard_replication_factor TO 1;
+CREATE TABLE move_items (id int PRIMARY KEY, value int);
+SELECT create_distributed_table('move_items', 'id', colocate_with := 'none');
+CREATE TABLE move_events (id int, payload text);
+ALTER TABLE move_events REPLICA IDENTITY FULL;
+SELECT create_distributed_table('move_events', 'id', colocate_with := 'move_items');
+CREATE TABLE no_identity (id int);
+SELECT create_distributed_table('no_identity', 'id', colocate_with := 'none');
+INSERT INTO move_items SELECT s, s FROM generate_series(1, 100) s;
+INSERT INTO move_events SELECT s, 'event ' || s || '-' || e FROM generate_series(1, 100) s, generate_series(1, 2) e;
+INSERT INTO no_identity SELECT s FROM generate_series(1, 100) s;
+-- router queries only find rows that are in the placements of their shards
+CREATE FUNCTION rows_found_by_router_queries() RETURNS bigint LANGUAGE plpgsql AS $$
+DECLARE
+    found bigint := 0;
+    row_count bigint;
+BEGIN
+    FOR i IN 1..100 LOOP
+        SELECT count(*) INTO row_count FROM move_items JOIN move_events USING (id) WHERE move_items.id = i;
+        found := found + row_count;
+    END LOOP;
+    RETURN found;
+END;
+$$;
+-- the co-located shard of move_events is moved along
+SELECT master_move_shard_placement(4233581, 'localhost', :worker_1_port, 'localhost', :worker_2_port, 'force_logical');
+SELECT logicalrelid, shardid, nodeport
+FROM pg_dist_shard JOIN pg_dist_shard_placement USING (shardid)
+WHERE logicalrelid IN ('move_items'::regclass, 'move_events'::regclass, 'no_identity'::regclass)
+ORDER BY shardid;
+SELECT count(*) FROM move_items JOIN move_events USING (id);
+SELECT rows_found_by_router_queries();
+-- the source shards are dropped
+SELECT * FROM run_command_on_workers($$SELECT count(*) FROM pg_class WHERE relnamespace = 'move_logical'::regnamespace AND relkind = 'r'$$);
+-- no replication objects are left behind
+SELECT * FROM run_command_on_workers($$SELECT (SELECT count(*) FROM pg_publication) + (SELECT count(*) FROM pg_subscription) + (SELECT count(*) FROM pg_replication_slots)$$);
+-- writes go to the new placements
+UPDATE move_items SET value = value + 1 WHERE id = 5;
+DELETE FROM move_events WHERE payload = 'event 5-2';
+-- in auto mode, tables with a replica identity are moved using logical replication
+SELECT master_move_shard_placement(4233581, 'localhost', :worker_2_port, 'localhost', :worker_1_port);
+SELECT logicalrelid, shardid, nodeport
+FROM pg_dist_shard JOIN pg_dist_shard_placement USING (shardid)
+WHERE logicalrelid IN ('move_items'::regclass, 'move_events'::regclass, 'no_identity'::regclass)
+ORDER BY shardid;
+SELECT * FROM move_items JOIN move_events USING (id) WHERE id = 5;
+SELECT rows_found_by_router_queries();
+SELECT * FROM run_command_on_workers($$SELECT (SELECT count(*) FROM pg_publication) + (SELECT count(*) FROM pg_subscription) + (SELECT count(*) FROM pg_replication_slots)$$);
+SELECT master_move_shard_placement(4233585, 'localhost', :worker_1_port, 'localhost', :worker_2_port, 'force_logical');
+-- in auto mode, tables without a replica identity are moved while blocking writes
+SELECT master_move_shard_placement(4233585, 'localhost', :worker_1_port, 'localhost', :worker_2_port);
+SELECT logicalrelid, shardid, nodeport
+FROM pg_dist_shard JOIN pg_dist_shard_placement USING (shardid)
+WHERE logicalrelid IN ('move_items'::regclass, 'move_events'::regclass, 'no_identity'::regclass)
+ORDER BY shardid;
+SELECT count(*) FROM no_identity;
+SELECT * FROM run_command_on_workers($$SELECT count(*) FROM pg_class WHERE relnamespace = 'move_logical'::regnamespace AND relkind = 'r'$$);
+SELECT master_move_shard_placement(4233582, 'localhost', :worker_2_port, 'localhost', 1, 'force_logical');
+SELECT master_move_shard_placement(4233582, 'localhost', :worker_2_port, 'localhost', :worker_2_port, 'force_logical');
+SET client_min_messages TO WARNING;
+DROP SCHEMA move_logical CASCADE;
@@ -0,0 +1,72 @@
+--
+-- SHARD_REBALANCER
+--
+-- Tests the shard rebalancer UDFs. All shards are first placed on worker 1 by
+-- creating the tables while worker 2 should not have shards, after which the
+-- rebalancer moves half of the shard groups to worker 2.
+CREATE SCHEMA shard_rebalancer;
+SET search_path TO shard_rebalancer;
+SET citus.next_shard_id TO 4227581;
+SET citus.shard_count TO 6;
+SET citus.shard_replication_factor TO 1;
+SELECT master_set_node_property('localhost', :worker_2_port, 'shouldhaveshards', false);
+CREATE TABLE rebalance_test (id int, value int);
+SELECT create_distributed_table('rebalance_test', 'id', colocate_with := 'none');
+CREATE TABLE rebalance_events (id int, payload text);
+SELECT create_distributed_table('rebalance_events', 'id', colocate_with := 'rebalance_test');
+INSERT INTO rebalance_test SELECT s, s FROM generate_series(1, 100) s;
+INSERT INTO rebalance_events SELECT s, 'event ' || s FROM generate_series(1, 100) s;
+SELECT master_set_node_property('localhost', :worker_2_port, 'shouldhaveshards', true);
+SELECT logicalrelid, nodeport, count(*)
+FROM pg_dist_shard JOIN pg_dist_shard_placement USING (shardid)
+WHERE logicalrelid IN ('rebalance_test'::regclass, 'rebalance_events'::regclass)
+GROUP BY 1, 2 ORDER BY 1, 2;
+-- moves the first shard groups of worker 1 until both workers have 3
+SELECT * FROM get_rebalance_table_shards_plan('rebalance_test');
+-- with a threshold of 0.5, nodes may have between 1 and 5 shard groups
+SELECT * FROM get_rebalance_table_shards_plan('rebalance_test', threshold := 0.5);
+SELECT * FROM get_rebalance_table_shards_plan('rebalance_test', max_shard_moves := 2);
+-- excluding a co-located shard excludes its whole shard group
+SELECT * FROM get_rebalance_table_shards_plan('rebalance_test', excluded_shard_list := ARRAY[4227587]);
+-- there is nothing to drain
+SELECT * FROM get_rebalance_table_shards_plan('rebalance_test', drain_only := true);
+SELECT rebalance_table_shards('rebalance_test', shard_transfer_mode := 'block_writes');
+SELECT logicalrelid, nodeport, count(*)
+FROM pg_dist_shard JOIN pg_dist_shard_placement USING (shardid)
+WHERE logicalrelid IN ('rebalance_test'::regclass, 'rebalance_events'::regclass)
+GROUP BY 1, 2 ORDER BY 1, 2;
+SELECT count(*) FROM rebalance_test JOIN rebalance_events USING (id);
+SELECT * FROM get_rebalance_table_shards_plan('rebalance_test');
+SELECT * FROM get_rebalance_progress();
+-- unbalance the cluster again by moving a shard group to worker 2
+SELECT master_move_shard_placement(4227584, 'localhost', :worker_1_port, 'localhost', :worker_2_port, 'block_writes');
+SELECT * FROM get_rebalance_table_shards_plan('rebalance_test');
+-- the rebalancer cannot run in a transaction block
+BEGIN;
+SELECT rebalance_table_shards('rebalance_test', shard_transfer_mode := 'block_writes');
+ROLLBACK;
+SELECT * FROM get_rebalance_table_shards_plan('rebalance_test', threshold := 1.5);
+CREATE TABLE rebalance_reference (id int);
+SELECT create_reference_table('rebalance_reference');
+SELECT * FROM get_rebalance_table_shards_plan('rebalance_reference');
+SELECT master_drain_node('localhost', 1);
+-- drain worker 2 of the shard groups of rebalance_test only
+SELECT master_set_node_property('localhost', :worker_2_port, 'shouldhaveshards', false);
+SELECT * FROM get_rebalance_table_shards_plan('rebalance_test', drain_only := true);
+SELECT master_set_node_property('localhost', :worker_1_port, 'shouldhaveshards', false);
+SELECT * FROM get_rebalance_table_shards_plan('rebalance_test', drain_only := true);
+SELECT master_set_node_property('localhost', :worker_1_port, 'shouldhaveshards', true);
+SELECT rebalance_table_shards('rebalance_test', drain_only := true, shard_transfer_mode := 'block_writes');
+SELECT logicalrelid, nodeport, count(*)
+FROM pg_dist_shard JOIN pg_dist_shard_placement USING (shardid)
+WHERE logicalrelid IN ('rebalance_test'::regclass, 'rebalance_events'::regclass)
+GROUP BY 1, 2 ORDER BY 1, 2;
+SELECT master_set_node_property('localhost', :worker_2_port, 'shouldhaveshards', true);
+SELECT rebalance_table_shards('rebalance_test', shard_transfer_mode := 'block_writes');
+SELECT logicalrelid, nodeport, count(*)
+FROM pg_dist_shard JOIN pg_dist_shard_placement USING (shardid)
+WHERE logicalrelid IN ('rebalance_test'::regclass, 'rebalance_events'::regclass)
+GROUP BY 1, 2 ORDER BY 1, 2;
+SELECT count(*) FROM rebalance_test JOIN rebalance_events USING (id);
+SET client_min_messages TO WARNING;
+DROP SCHEMA shard_rebalancer CASCADE;
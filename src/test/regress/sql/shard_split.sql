@@ -0,0 +1,58 @@
+--
+-- SHARD_SPLIT
+--
+-- Tests master_split_shard and isolate_tenant_to_new_shard, which split a
+-- hash shard along with its co-located shards on the nodes of its placements.
+CREATE SCHEMA shard_split;
+SET search_path TO shard_split;
+SET citus.next_shard_id TO 4229581;
+SET citus.shard_count TO 2;
+SET citus.shard_replication_factor TO 1;
+CREATE TABLE orders (id int PRIMARY KEY, value int);
+SELECT create_distributed_table('orders', 'id', colocate_with := 'none');
+CREATE TABLE order_lines (id int REFERENCES orders (id), line int);
+SELECT create_distributed_table('order_lines', 'id', colocate_with := 'orders');
+INSERT INTO orders SELECT s, s FROM generate_series(1, 100) s;
+INSERT INTO order_lines SELECT s, l FROM generate_series(1, 100) s, generate_series(1, 2) l;
+-- router queries only find rows that are in the shard of their hash value
+CREATE FUNCTION rows_found_by_router_queries() RETURNS bigint LANGUAGE plpgsql AS $$
+DECLARE
+    found bigint := 0;
+    row_count bigint;
+BEGIN
+    FOR i IN 1..100 LOOP
+        SELECT count(*) INTO row_count FROM orders JOIN order_lines USING (id) WHERE orders.id = i;
+        found := found + row_count;
+    END LOOP;
+    RETURN found;
+END;
+$$;
+-- split the first shard into two halves on the same node
+SELECT master_split_shard(4229581);
+SELECT shardid, shardminvalue, shardmaxvalue, nodeport
+FROM pg_dist_shard JOIN pg_dist_shard_placement USING (shardid)
+WHERE logicalrelid = 'orders'::regclass ORDER BY shardminvalue::int;
+SELECT count(*) FROM orders JOIN order_lines USING (id);
+SELECT rows_found_by_router_queries();
+-- the old shards are dropped and the foreign keys are recreated
+SELECT * FROM run_command_on_workers($$SELECT count(*) FROM pg_class WHERE relnamespace = 'shard_split'::regnamespace AND relkind = 'r'$$);
+SELECT * FROM run_command_on_workers($$SELECT count(*) FROM pg_constraint WHERE connamespace = 'shard_split'::regnamespace AND contype = 'f'$$);
+-- tenant isolation requires confirmation when there are co-located tables
+SELECT isolate_tenant_to_new_shard('orders', 5, shard_transfer_mode := 'block_writes');
+SELECT isolate_tenant_to_new_shard('orders', 5, 'CASCADE', shard_transfer_mode := 'block_writes');
+SELECT shardid, shardminvalue, shardmaxvalue, nodeport
+FROM pg_dist_shard JOIN pg_dist_shard_placement USING (shardid)
+WHERE logicalrelid = 'orders'::regclass ORDER BY shardminvalue::int;
+SELECT * FROM orders JOIN order_lines USING (id) WHERE id = 5 ORDER BY line;
+SELECT rows_found_by_router_queries();
+SELECT * FROM run_command_on_workers($$SELECT count(*) FROM pg_class WHERE relnamespace = 'shard_split'::regnamespace AND relkind = 'r'$$);
+SELECT * FROM run_command_on_workers($$SELECT count(*) FROM pg_constraint WHERE connamespace = 'shard_split'::regnamespace AND contype = 'f'$$);
+SELECT isolate_tenant_to_new_shard('orders', 5, 'CASCADE', shard_transfer_mode := 'block_writes');
+SELECT master_split_shard(4229590);
+SELECT master_split_shard(4229582, 1);
+CREATE TABLE split_reference (id int);
+SELECT create_reference_table('split_reference');
+SELECT master_split_shard(4229595);
+SELECT isolate_tenant_to_new_shard('split_reference', 5);
+SET client_min_messages TO WARNING;
+DROP SCHEMA shard_split CASCADE;
@@ -0,0 +1,72 @@
+-- tests for tracking and throttling the connections of all backends to the workers
+CREATE SCHEMA shared_connection_stats;
+SET search_path TO shared_connection_stats;
+SET citus.next_shard_id TO 4217581;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+CREATE TABLE test (key int, value int);
+SELECT create_distributed_table('test', 'key');
+INSERT INTO test SELECT s, s FROM generate_series(1, 100) s;
+
+-- connections are counted while the backend uses them
+BEGIN;
+SET LOCAL citus.force_max_query_parallelization TO on;
+SELECT count(*) FROM test;
+SELECT hostname, port, connection_count_to_node >= 2 AS counted
+FROM citus_remote_connection_stats()
+WHERE port IN (:worker_1_port, :worker_2_port)
+ORDER BY port;
+COMMIT;
+
+-- this backend keeps a cached connection to each worker
+SELECT count(*) FROM test;
+SELECT hostname, port, connection_count_to_node >= 1 AS counted
+FROM citus_remote_connection_stats()
+WHERE port IN (:worker_1_port, :worker_2_port)
+ORDER BY port;
+
+-- allow a single connection to each worker across all backends
+ALTER SYSTEM SET citus.max_shared_pool_size TO 1;
+SELECT pg_reload_conf();
+SELECT pg_sleep(0.1);
+SHOW citus.max_shared_pool_size;
+
+-- queries still run over the cached connections, additional ones are skipped
+SELECT count(*) FROM test;
+SELECT value FROM test WHERE key = 1;
+BEGIN;
+SELECT count(*) FROM test;
+UPDATE test SET value = value + 1 WHERE key = 1;
+SELECT value FROM test WHERE key = 1;
+ROLLBACK;
+
+-- a session without connections to the worker waits for a slot, and errors
+-- out when no slot is released within citus.node_connection_timeout
+SET citus.enable_ddl_propagation TO off;
+CREATE USER connection_stats_user;
+GRANT USAGE ON SCHEMA shared_connection_stats TO connection_stats_user;
+GRANT SELECT ON test TO connection_stats_user;
+RESET citus.enable_ddl_propagation;
+SET citus.node_connection_timeout TO 500;
+SET ROLE connection_stats_user;
+SELECT value FROM test WHERE key = 1;
+RESET ROLE;
+RESET citus.node_connection_timeout;
+
+-- connections are not throttled when throttling is disabled
+ALTER SYSTEM SET citus.max_shared_pool_size TO -1;
+SELECT pg_reload_conf();
+SELECT pg_sleep(0.1);
+BEGIN;
+SET LOCAL citus.force_max_query_parallelization TO on;
+SELECT count(*) FROM test;
+COMMIT;
+
+ALTER SYSTEM RESET citus.max_shared_pool_size;
+SELECT pg_reload_conf();
+SELECT pg_sleep(0.1);
+SELECT count(*) FROM test;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA shared_connection_stats CASCADE;
+DROP USER connection_stats_user;
@@ -0,0 +1,38 @@
+--
+-- TRANSMIT_COMPRESSION
+--
+-- Tests that the node that serves a file for a repartition join compresses it
+-- when the fetching node asks for compression, and that the threshold of the
+-- serving node only sets a minimum block size.
+\c - - - :worker_1_port
+SELECT worker_hash_partition_table(4242, 1, 'SELECT a, repeat(''x'', 100) AS b FROM generate_series(1, 10000) AS a', 'a', 23, ARRAY[-2147483648, -1073741824, 0, 1073741824]::int4[]);
+\c - - - :worker_2_port
+-- files are fetched as is by default
+SET client_min_messages TO DEBUG1;
+SELECT worker_fetch_partition_file(4242, 1, 1, 1, 'localhost', :worker_1_port);
+-- worker 1 compresses the file when asked, although its own threshold is -1
+SET citus.transmit_compression_threshold TO 1024;
+SELECT worker_fetch_partition_file(4242, 1, 1, 1, 'localhost', :worker_1_port);
+RESET client_min_messages;
+SELECT worker_merge_files_into_table(4242, 1, ARRAY['a', 'b'], ARRAY['integer', 'text']);
+SELECT count(*), sum(a), count(DISTINCT b) FROM pg_merge_job_4242.task_000001;
+DROP TABLE pg_merge_job_4242.task_000001;
+-- blocks below the threshold of the serving node are not compressed
+\c - - - :worker_1_port
+ALTER SYSTEM SET citus.transmit_compression_threshold TO 1000000;
+SELECT pg_reload_conf();
+SELECT pg_sleep(0.1);
+\c - - - :worker_2_port
+SET citus.transmit_compression_threshold TO 1024;
+SET client_min_messages TO DEBUG1;
+SELECT worker_fetch_partition_file(4242, 1, 1, 1, 'localhost', :worker_1_port);
+RESET client_min_messages;
+SELECT worker_merge_files_into_table(4242, 1, ARRAY['a', 'b'], ARRAY['integer', 'text']);
+SELECT count(*), sum(a), count(DISTINCT b) FROM pg_merge_job_4242.task_000001;
+-- clean up
+SELECT task_tracker_cleanup_job(4242);
+\c - - - :worker_1_port
+ALTER SYSTEM RESET citus.transmit_compression_threshold;
+SELECT pg_reload_conf();
+SELECT task_tracker_cleanup_job(4242);
+\c - - - :master_port